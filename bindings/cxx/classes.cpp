@@ -26,6 +26,7 @@
 #include <config.h>
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+#include <algorithm>
 #include <sstream>
 #include <cmath>
 
@@ -41,6 +42,17 @@ static void check(int result)
 		throw Error(result);
 }
 
+/** Helper function to get analog values, sharing a session's conversion. */
+static void analog_to_float(const struct sr_datafeed_analog *analog, float *dest)
+{
+	const float *values;
+
+	check(sr_analog_to_float_view(analog, dest, &values));
+	if (values != dest)
+		copy_n(values, analog->num_samples
+			* g_slist_length(analog->meaning->channels), dest);
+}
+
 /** Helper function to obtain valid strings from possibly null input. */
 static inline const char *valid_string(const char *input)
 {
@@ -561,6 +573,30 @@ void Configurable::config_set(const ConfigKey *key, const Glib::VariantBase &val
 		key->id(), const_cast<GVariant*>(value.gobj())));
 }
 
+void Configurable::config_set_multiple(
+	const vector<pair<const ConfigKey *, Glib::VariantBase> > &values,
+	bool commit)
+{
+	vector<struct sr_config> configs;
+
+	configs.reserve(values.size());
+	for (const auto &value : values) {
+		struct sr_config config;
+		config.key = value.first->id();
+		config.data = const_cast<GVariant *>(value.second.gobj());
+		configs.push_back(config);
+	}
+	check(sr_config_set_multiple(config_sdi, config_channel_group,
+		configs.data(), configs.size()));
+	if (commit)
+		config_commit();
+}
+
+void Configurable::config_commit()
+{
+	check(sr_config_commit(config_sdi));
+}
+
 set<const Capability *> Configurable::config_capabilities(const ConfigKey *key) const
 {
 	int caps = sr_dev_config_capabilities_list(config_sdi,
@@ -902,10 +938,22 @@ DatafeedCallbackData::DatafeedCallbackData(Session *session,
 {
 }
 
+DatafeedCallbackData::DatafeedCallbackData(Session *session,
+		DatafeedViewCallbackFunction callback) :
+	_view_callback(move(callback)),
+	_session(session)
+{
+}
+
 void DatafeedCallbackData::run(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *pkt)
 {
 	auto device = _session->get_device(sdi);
+	if (_view_callback) {
+		const PacketView view{device, pkt};
+		_view_callback(device, view);
+		return;
+	}
 	shared_ptr<Packet> packet {new Packet{device, pkt}, default_delete<Packet>{}};
 	_callback(move(device), move(packet));
 }
@@ -965,6 +1013,31 @@ shared_ptr<Device> Session::get_device(const struct sr_dev_inst *sdi)
 		throw Error(SR_ERR_BUG);
 }
 
+int Session::iteration_prepare(vector<GPollFD> &fds)
+{
+	if (fds.empty())
+		fds.resize(8);
+
+	for (;;) {
+		int num_fds = fds.size();
+		int timeout;
+		int ret = sr_session_iteration_prepare(_structure, fds.data(),
+			&num_fds, &timeout);
+		if (ret == SR_ERR_ARG && num_fds > (int)fds.size()) {
+			fds.resize(num_fds);
+			continue;
+		}
+		check(ret);
+		fds.resize(num_fds);
+		return timeout;
+	}
+}
+
+void Session::iteration_dispatch(vector<GPollFD> &fds)
+{
+	check(sr_session_iteration_dispatch(_structure, fds.data(), fds.size()));
+}
+
 void Session::add_device(shared_ptr<Device> device)
 {
 	const auto dev_struct = device->_structure;
@@ -1047,6 +1120,34 @@ void Session::add_datafeed_callback(DatafeedCallbackFunction callback)
 	_datafeed_callbacks.push_back(move(cb_data));
 }
 
+void Session::add_datafeed_view_callback(DatafeedViewCallbackFunction callback)
+{
+	unique_ptr<DatafeedCallbackData> cb_data
+		{new DatafeedCallbackData{this, move(callback)}};
+	check(sr_session_datafeed_callback_add(_structure,
+			&datafeed_callback, cb_data.get()));
+	_datafeed_callbacks.push_back(move(cb_data));
+}
+
+shared_ptr<Recorder> Session::add_recorder(shared_ptr<Device> device,
+	shared_ptr<OutputFormat> format, string filename,
+	map<string, Glib::VariantBase> options, size_t queue_size, bool drop)
+{
+	shared_ptr<Recorder> recorder{new Recorder{move(device), move(format),
+		move(filename), move(options), queue_size, drop},
+		default_delete<Recorder>{}};
+
+	/* The recorder finishes when the user releases it. */
+	weak_ptr<Recorder> weak = recorder;
+	add_datafeed_view_callback([weak] (const shared_ptr<Device> &device,
+			const PacketView &view) {
+		if (auto recorder = weak.lock())
+			recorder->push(device, view);
+	});
+
+	return recorder;
+}
+
 void Session::remove_datafeed_callbacks()
 {
 	check(sr_session_datafeed_callback_remove_all(_structure));
@@ -1079,9 +1180,10 @@ shared_ptr<Context> Session::context()
 }
 
 Packet::Packet(shared_ptr<Device> device,
-	const struct sr_datafeed_packet *structure) :
+	const struct sr_datafeed_packet *structure, bool owned) :
 	_structure(structure),
-	_device(move(device))
+	_device(move(device)),
+	_owned(owned)
 {
 	switch (structure->type)
 	{
@@ -1110,6 +1212,18 @@ Packet::Packet(shared_ptr<Device> device,
 
 Packet::~Packet()
 {
+	if (_owned)
+		sr_packet_free(const_cast<struct sr_datafeed_packet *>(_structure));
+}
+
+shared_ptr<Packet> Packet::copy()
+{
+	struct sr_datafeed_packet *packet;
+
+	check(sr_packet_copy(_structure, &packet));
+
+	return shared_ptr<Packet>{new Packet{_device, packet, true},
+		default_delete<Packet>{}};
 }
 
 const PacketType *Packet::type() const
@@ -1125,6 +1239,74 @@ shared_ptr<PacketPayload> Packet::payload()
 		throw Error(SR_ERR_NA);
 }
 
+PacketView::PacketView(const shared_ptr<Device> &device,
+	const struct sr_datafeed_packet *structure) :
+	_device(device),
+	_structure(structure)
+{
+}
+
+const PacketType *PacketView::type() const
+{
+	return PacketType::get(_structure->type);
+}
+
+const void *PacketView::data_pointer() const
+{
+	switch (_structure->type) {
+	case SR_DF_LOGIC:
+		return static_cast<const struct sr_datafeed_logic *>(
+			_structure->payload)->data;
+	case SR_DF_ANALOG:
+		return static_cast<const struct sr_datafeed_analog *>(
+			_structure->payload)->data;
+	default:
+		return nullptr;
+	}
+}
+
+size_t PacketView::data_length() const
+{
+	if (_structure->type != SR_DF_LOGIC)
+		return 0;
+	return static_cast<const struct sr_datafeed_logic *>(
+		_structure->payload)->length;
+}
+
+unsigned int PacketView::unit_size() const
+{
+	if (_structure->type != SR_DF_LOGIC)
+		return 0;
+	return static_cast<const struct sr_datafeed_logic *>(
+		_structure->payload)->unitsize;
+}
+
+unsigned int PacketView::num_samples() const
+{
+	if (_structure->type != SR_DF_ANALOG)
+		return 0;
+	return static_cast<const struct sr_datafeed_analog *>(
+		_structure->payload)->num_samples;
+}
+
+void PacketView::get_data_as_float(float *dest) const
+{
+	if (_structure->type != SR_DF_ANALOG)
+		throw Error(SR_ERR_NA);
+	analog_to_float(static_cast<const struct sr_datafeed_analog *>(
+		_structure->payload), dest);
+}
+
+shared_ptr<Packet> PacketView::retain() const
+{
+	struct sr_datafeed_packet *packet;
+
+	check(sr_packet_copy(_structure, &packet));
+
+	return shared_ptr<Packet>{new Packet{_device, packet, true},
+		default_delete<Packet>{}};
+}
+
 PacketPayload::PacketPayload()
 {
 }
@@ -1241,7 +1423,14 @@ void *Analog::data_pointer()
 
 void Analog::get_data_as_float(float *dest)
 {
-	check(sr_analog_to_float(_structure, dest));
+	analog_to_float(_structure, dest);
+}
+
+void Analog::get_data_as_float_channels(const vector<float *> &dests)
+{
+	if (dests.size() < g_slist_length(_structure->meaning->channels))
+		throw Error(SR_ERR_ARG);
+	check(sr_analog_to_float_channels(_structure, dests.data()));
 }
 
 unsigned int Analog::num_samples() const
@@ -1681,6 +1870,128 @@ string Output::receive(shared_ptr<Packet> packet)
 	}
 }
 
+Recorder::Recorder(shared_ptr<Device> device, shared_ptr<OutputFormat> format,
+		string filename, map<string, Glib::VariantBase> options,
+		size_t queue_size, bool drop) :
+	_device(move(device)),
+	_queue_size(max(queue_size, (size_t)1)),
+	_drop(drop),
+	_finishing(false),
+	_stats(),
+	_error(SR_OK)
+{
+	if (format->test_flag(OutputFlag::INTERNAL_IO_HANDLING)) {
+		_output = format->create_output(filename, _device, move(options));
+	} else {
+		_file.open(filename, ios::out | ios::binary | ios::trunc);
+		if (!_file.is_open())
+			throw Error(SR_ERR_IO);
+		_output = format->create_output(_device, move(options));
+	}
+	_thread = thread(&Recorder::write_packets, this);
+}
+
+Recorder::~Recorder()
+{
+	finish();
+}
+
+void Recorder::push(const shared_ptr<Device> &device, const PacketView &view)
+{
+	if (device != _device)
+		return;
+
+	const auto type = view.type();
+	const bool data = type == PacketType::LOGIC || type == PacketType::ANALOG;
+
+	unique_lock<mutex> lock(_mutex);
+	if (_finishing)
+		return;
+	/* Headers, meta and end packets are always kept. */
+	if (_queue.size() >= _queue_size && data) {
+		if (_drop) {
+			_stats.dropped++;
+			return;
+		}
+		_stats.stalls++;
+		_cond.wait(lock, [this] {
+			return _queue.size() < _queue_size || _finishing;
+		});
+		if (_finishing)
+			return;
+	}
+
+	_queue.push_back(view.retain());
+	_stats.high_water = max(_stats.high_water, _queue.size());
+	_cond.notify_all();
+}
+
+void Recorder::write_packets()
+{
+	unique_lock<mutex> lock(_mutex);
+
+	for (;;) {
+		_cond.wait(lock, [this] { return !_queue.empty() || _finishing; });
+		if (_queue.empty())
+			break;
+		auto packet = move(_queue.front());
+		_queue.pop_front();
+		_cond.notify_all();
+		lock.unlock();
+
+		int result = SR_OK;
+		string out;
+		try {
+			out = _output->receive(packet);
+			if (_file.is_open() && !out.empty())
+				_file.write(out.data(), out.size());
+			if (_file.is_open() && packet->type() == PacketType::END)
+				_file.flush();
+			if (_file.is_open() && _file.fail())
+				result = SR_ERR_IO;
+		} catch (const Error &e) {
+			result = e.result;
+		}
+		packet.reset();
+
+		lock.lock();
+		_stats.packets++;
+		if (_file.is_open())
+			_stats.bytes += out.size();
+		if (result != SR_OK && _error == SR_OK)
+			_error = result;
+	}
+}
+
+void Recorder::finish()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+		_finishing = true;
+	}
+	_cond.notify_all();
+
+	if (_thread.joinable())
+		_thread.join();
+	if (_file.is_open())
+		_file.close();
+	_output.reset();
+}
+
+RecorderStats Recorder::stats()
+{
+	lock_guard<mutex> lock(_mutex);
+	auto result = _stats;
+	result.queued = _queue.size();
+	return result;
+}
+
+int Recorder::error()
+{
+	lock_guard<mutex> lock(_mutex);
+	return _error;
+}
+
 #include <enums.cpp>
 
 }
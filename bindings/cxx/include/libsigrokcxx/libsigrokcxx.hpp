@@ -84,6 +84,12 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 #include <vector>
 #include <map>
 #include <set>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
 
 namespace sigrok
 {
@@ -109,6 +115,7 @@ class SR_API TriggerMatch;
 class SR_API TriggerMatchType;
 class SR_API ChannelType;
 class SR_API Packet;
+class SR_API PacketView;
 class SR_API PacketPayload;
 class SR_API PacketType;
 class SR_API Quantity;
@@ -118,6 +125,7 @@ class SR_API Rational;
 class SR_API Input;
 class SR_API InputDevice;
 class SR_API Output;
+class SR_API Recorder;
 class SR_API DataType;
 class SR_API Option;
 class SR_API UserDevice;
@@ -328,6 +336,17 @@ public:
 	 * @param key ConfigKey to set.
 	 * @param value Value to set. */
 	void config_set(const ConfigKey *key, const Glib::VariantBase &value);
+	/** Set configuration for several keys in one call.
+	 * The supported keys are looked up once for all of them, and the
+	 * values are passed on without copying. Keys are set in order, upon
+	 * errors the keys before the failing one keep their new values.
+	 * @param values (ConfigKey, value) pairs to set.
+	 * @param commit Apply the settings to the hardware afterwards. */
+	void config_set_multiple(
+		const std::vector<std::pair<const ConfigKey *, Glib::VariantBase> > &values,
+		bool commit = false);
+	/** Apply the configuration settings to the hardware. */
+	void config_commit();
 	/** Enumerate available values for the given configuration key.
 	 * @param key ConfigKey to enumerate values for. */
 	Glib::VariantContainerBase config_list(const ConfigKey *key) const;
@@ -578,6 +597,10 @@ typedef std::function<void()> SessionStoppedCallback;
 typedef std::function<void(std::shared_ptr<Device>, std::shared_ptr<Packet>)>
 	DatafeedCallbackFunction;
 
+/** Type of datafeed callback which receives packet views */
+typedef std::function<void(const std::shared_ptr<Device> &, const PacketView &)>
+	DatafeedViewCallbackFunction;
+
 /* Data required for C callback function to call a C++ datafeed callback */
 class SR_PRIV DatafeedCallbackData
 {
@@ -586,8 +609,11 @@ public:
 		const struct sr_datafeed_packet *pkt);
 private:
 	DatafeedCallbackFunction _callback;
+	DatafeedViewCallbackFunction _view_callback;
 	DatafeedCallbackData(Session *session,
 		DatafeedCallbackFunction callback);
+	DatafeedCallbackData(Session *session,
+		DatafeedViewCallbackFunction callback);
 	Session *_session;
 	friend class Session;
 };
@@ -620,6 +646,25 @@ public:
 	/** Add a datafeed callback to this session.
 	 * @param callback Callback of the form callback(Device, Packet). */
 	void add_datafeed_callback(DatafeedCallbackFunction callback);
+	/** Add a datafeed callback which receives packet views.
+	 * Unlike add_datafeed_callback(), no objects get allocated per
+	 * packet. The view is only valid while the callback runs, use
+	 * PacketView::retain() to keep a packet.
+	 * @param callback Callback of the form callback(Device, PacketView). */
+	void add_datafeed_view_callback(DatafeedViewCallbackFunction callback);
+	/** Record the datafeed of a device to a file, see Recorder.
+	 * @param device Device whose packets get recorded.
+	 * @param format Output format to write.
+	 * @param filename Name of destination file.
+	 * @param options Mapping of (option name, value) pairs.
+	 * @param queue_size Number of packets which may wait for the writer.
+	 * @param drop Drop logic and analog packets when the queue is full,
+	 *             instead of making the datafeed wait. */
+	std::shared_ptr<Recorder> add_recorder(std::shared_ptr<Device> device,
+		std::shared_ptr<OutputFormat> format, std::string filename,
+		std::map<std::string, Glib::VariantBase> options =
+			std::map<std::string, Glib::VariantBase>(),
+		size_t queue_size = 256, bool drop = false);
 	/** Remove all datafeed callbacks from this session. */
 	void remove_datafeed_callbacks();
 	/** Start the session. */
@@ -628,6 +673,16 @@ public:
 	void run();
 	/** Stop the session. */
 	void stop();
+	/** Prepare an iteration of the session's event processing, for
+	 * applications which run their own event loop instead of run().
+	 * See sr_session_iteration_prepare().
+	 * @param fds Filled with the file descriptors to wait for.
+	 * @return Timeout in ms, or -1 for none. */
+	int iteration_prepare(std::vector<GPollFD> &fds);
+	/** Dispatch the events of an iteration, after the descriptors
+	 * from iteration_prepare() got ready or the timeout has passed.
+	 * @param fds The descriptors, with their revents filled in. */
+	void iteration_dispatch(std::vector<GPollFD> &fds);
 	/** Return whether the session is running. */
 	bool is_running() const;
 	/** Set callback to be invoked on session stop. */
@@ -669,17 +724,24 @@ public:
 	const PacketType *type() const;
 	/** Payload of this packet. */
 	std::shared_ptr<PacketPayload> payload();
+	/** Copy of this packet which remains valid after the datafeed
+	 * callback returned. Sample data held in a refcounted buffer by
+	 * the driver is shared with the copy instead of being duplicated. */
+	std::shared_ptr<Packet> copy();
 private:
 	Packet(std::shared_ptr<Device> device,
-		const struct sr_datafeed_packet *structure);
+		const struct sr_datafeed_packet *structure,
+		bool owned = false);
 	~Packet();
 	const struct sr_datafeed_packet *_structure;
 	std::shared_ptr<Device> _device;
 	std::unique_ptr<PacketPayload> _payload;
+	bool _owned;
 
 	friend class Session;
 	friend class Output;
 	friend class DatafeedCallbackData;
+	friend class PacketView;
 	friend class Header;
 	friend class Meta;
 	friend class Logic;
@@ -688,6 +750,39 @@ private:
 	friend struct std::default_delete<Packet>;
 };
 
+/** A packet on the session datafeed, valid during the datafeed callback */
+class SR_API PacketView
+{
+public:
+	PacketView(const PacketView &) = delete;
+	PacketView &operator=(const PacketView &) = delete;
+	/** Type of this packet. */
+	const PacketType *type() const;
+	/** Pointer to the samples of a logic or analog packet, else nullptr. */
+	const void *data_pointer() const;
+	/** Length of the data of a logic packet in bytes, else 0. */
+	size_t data_length() const;
+	/** Size of each sample of a logic packet in bytes, else 0. */
+	unsigned int unit_size() const;
+	/** Number of samples in an analog packet, else 0. */
+	unsigned int num_samples() const;
+	/**
+	 * Fills dest pointer with the analog data converted to float.
+	 * The pointer must have space for num_samples() floats.
+	 */
+	void get_data_as_float(float *dest) const;
+	/** Copy of this packet which remains valid after the datafeed
+	 * callback returned, see Packet::copy(). */
+	std::shared_ptr<Packet> retain() const;
+private:
+	PacketView(const std::shared_ptr<Device> &device,
+		const struct sr_datafeed_packet *structure);
+	const std::shared_ptr<Device> &_device;
+	const struct sr_datafeed_packet *_structure;
+
+	friend class DatafeedCallbackData;
+};
+
 /** Abstract base class for datafeed packet payloads */
 class SR_API PacketPayload
 {
@@ -778,6 +873,12 @@ public:
 	 * The pointer must have space for num_samples() floats.
 	 */
 	void get_data_as_float(float *dest);
+	/**
+	 * Fills one buffer per channel, in the order of channels(), with
+	 * the analog data converted to float. Each buffer must have space
+	 * for num_samples() floats, nullptr entries skip a channel.
+	 */
+	void get_data_as_float_channels(const std::vector<float *> &dests);
 	/** Number of samples in this packet. */
 	unsigned int num_samples() const;
 	/** Channels for which this packet contains data. */
@@ -1034,6 +1135,64 @@ private:
 	friend struct std::default_delete<Output>;
 };
 
+/** Statistics of a Recorder */
+struct SR_API RecorderStats
+{
+	/** Packets which were passed to the output. */
+	uint64_t packets;
+	/** Packets which were dropped because the queue was full. */
+	uint64_t dropped;
+	/** Number of times the datafeed waited for room in the queue. */
+	uint64_t stalls;
+	/** Bytes written by the recorder (not by outputs doing their own I/O). */
+	uint64_t bytes;
+	/** Packets waiting for the writer. */
+	size_t queued;
+	/** Most packets which were waiting at the same time. */
+	size_t high_water;
+};
+
+/** Writes the datafeed of a device to a file on a background thread.
+ *
+ * Packets are taken from the datafeed without wrapping (see PacketView),
+ * queued, and run through the output by a writer thread. When the queue
+ * is full, the datafeed waits, or data packets get dropped. */
+class SR_API Recorder : public UserOwned<Recorder>
+{
+public:
+	/** Write all queued packets, then stop the writer thread and close
+	 * the file. Packets which arrive later are ignored. */
+	void finish();
+	/** Current statistics. */
+	RecorderStats stats();
+	/** Error code of the first failed write, or SR_OK. */
+	int error();
+private:
+	Recorder(std::shared_ptr<Device> device,
+		std::shared_ptr<OutputFormat> format, std::string filename,
+		std::map<std::string, Glib::VariantBase> options,
+		size_t queue_size, bool drop);
+	~Recorder();
+	void push(const std::shared_ptr<Device> &device, const PacketView &view);
+	void write_packets();
+
+	const std::shared_ptr<Device> _device;
+	std::shared_ptr<Output> _output;
+	std::ofstream _file;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	std::deque<std::shared_ptr<Packet> > _queue;
+	const size_t _queue_size;
+	const bool _drop;
+	bool _finishing;
+	RecorderStats _stats;
+	int _error;
+	std::thread _thread;
+
+	friend class Session;
+	friend struct std::default_delete<Recorder>;
+};
+
 /** Base class for objects which wrap an enumeration value from libsigrok */
 template <class Class, typename Enum> class SR_API EnumValue
 {
@@ -1077,6 +1236,96 @@ private:
 	const std::string _name;
 };
 
+#if !defined(SWIG) && __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define LIBSIGROKCXX_HAVE_COROUTINES 1
+#endif
+#endif
+
+#ifdef LIBSIGROKCXX_HAVE_COROUTINES
+} /* namespace sigrok */
+#include <coroutine>
+namespace sigrok
+{
+
+/**
+ * Stream of a session's packets, for C++20 coroutines.
+ *
+ * Each packet gets retained (see PacketView::retain()) and queued until
+ * it is awaited with next(). Waiting coroutines are resumed from within
+ * the datafeed callback, so the stream must be used from the thread
+ * which processes the session's events (see Session::iteration_dispatch())
+ * while no dispatch thread is configured. After the end packets of all
+ * the session's devices, next() yields an item without a packet.
+ */
+class PacketStream
+{
+	struct State;
+public:
+	/** A packet and the device which sent it. */
+	struct Item
+	{
+		std::shared_ptr<Device> device;
+		std::shared_ptr<Packet> packet;
+	};
+
+	explicit PacketStream(const std::shared_ptr<Session> &session) :
+		_state(std::make_shared<State>())
+	{
+		_state->devices_left = session->devices().size();
+		auto state = _state;
+		session->add_datafeed_view_callback([state] (
+				const std::shared_ptr<Device> &device,
+				const PacketView &view) {
+			if (!state->devices_left)
+				return;
+			state->queue.push_back(Item{device, view.retain()});
+			if (view.type() == PacketType::END)
+				state->devices_left--;
+			if (state->waiter)
+				std::exchange(state->waiter, nullptr).resume();
+		});
+	}
+
+	/** Awaitable which yields the next Item. */
+	struct Next
+	{
+		bool await_ready() const noexcept
+		{
+			return !state->queue.empty() || !state->devices_left;
+		}
+		void await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			state->waiter = handle;
+		}
+		Item await_resume()
+		{
+			if (state->queue.empty())
+				return Item{};
+			auto item = std::move(state->queue.front());
+			state->queue.pop_front();
+			return item;
+		}
+		std::shared_ptr<State> state;
+	};
+
+	/** Wait for the next packet. */
+	Next next()
+	{
+		return Next{_state};
+	}
+
+private:
+	struct State
+	{
+		std::deque<Item> queue;
+		std::coroutine_handle<> waiter;
+		size_t devices_left = 0;
+	};
+	std::shared_ptr<State> _state;
+};
+#endif
+
 }
 
 #include <libsigrokcxx/enums.hpp>
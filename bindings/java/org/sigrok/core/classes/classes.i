@@ -372,6 +372,98 @@ typedef jobject jdatafeedcallback;
   }
 }
 
+/* Direct buffer access to packet payload data. */
+
+%inline {
+typedef jobject jbytebuffer;
+typedef jobject jfloatbuffer;
+}
+
+%typemap(jni) jbytebuffer "jbytebuffer"
+%typemap(jtype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(jstype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(javaout) jbytebuffer { return $jnicall; }
+%typemap(out) jbytebuffer %{ $result = $1; %}
+
+%typemap(jni) jfloatbuffer "jfloatbuffer"
+%typemap(jtype) jfloatbuffer "java.nio.FloatBuffer"
+%typemap(jstype) jfloatbuffer "java.nio.FloatBuffer"
+%typemap(javaout) jfloatbuffer { return $jnicall; }
+%typemap(out) jfloatbuffer %{ $result = $1; %}
+
+%{
+/* Wrap payload memory in a direct ByteBuffer with the given byte order. */
+static jobject java_direct_buffer(JNIEnv *env,
+  void *data, size_t length, bool bigendian)
+{
+  jobject buffer = env->NewDirectByteBuffer(data, length);
+  if (!buffer)
+    throw sigrok::Error(SR_ERR_MALLOC);
+  jclass ByteOrder = env->FindClass("java/nio/ByteOrder");
+  jfieldID order_field = env->GetStaticFieldID(ByteOrder,
+    bigendian ? "BIG_ENDIAN" : "LITTLE_ENDIAN", "Ljava/nio/ByteOrder;");
+  jobject order = env->GetStaticObjectField(ByteOrder, order_field);
+  jclass ByteBuffer = env->GetObjectClass(buffer);
+  jmethodID order_method = env->GetMethodID(ByteBuffer, "order",
+    "(Ljava/nio/ByteOrder;)Ljava/nio/ByteBuffer;");
+  return env->CallObjectMethod(buffer, order_method, order);
+}
+%}
+
+/*
+ * The buffers below refer to the packet's memory without copying it. They
+ * are only valid as long as the payload object they were taken from is
+ * reachable, and must not be used after that.
+ */
+
+%extend sigrok::Packet
+{
+  std::shared_ptr<sigrok::Logic> logic()
+  {
+    return std::dynamic_pointer_cast<sigrok::Logic>($self->payload());
+  }
+
+  std::shared_ptr<sigrok::Analog> analog()
+  {
+    return std::dynamic_pointer_cast<sigrok::Analog>($self->payload());
+  }
+}
+
+%extend sigrok::Logic
+{
+  jbytebuffer data_buffer(JNIEnv *env)
+  {
+    return java_direct_buffer(env,
+      $self->data_pointer(), $self->data_length(), false);
+  }
+}
+
+%extend sigrok::Analog
+{
+  jbytebuffer data_buffer(JNIEnv *env)
+  {
+    size_t length = (size_t)$self->num_samples()
+      * $self->channels().size() * $self->unitsize();
+    return java_direct_buffer(env,
+      $self->data_pointer(), length, $self->is_bigendian());
+  }
+
+  /* Only for data encoded as 32-bit floats, null otherwise. */
+  jfloatbuffer float_buffer(JNIEnv *env)
+  {
+    if (!$self->is_float() || $self->unitsize() != sizeof(float))
+      return NULL;
+    size_t length = (size_t)$self->num_samples()
+      * $self->channels().size() * sizeof(float);
+    jobject buffer = java_direct_buffer(env,
+      $self->data_pointer(), length, $self->is_bigendian());
+    jclass ByteBuffer = env->GetObjectClass(buffer);
+    jmethodID method = env->GetMethodID(ByteBuffer, "asFloatBuffer",
+      "()Ljava/nio/FloatBuffer;");
+    return env->CallObjectMethod(buffer, method);
+  }
+}
+
 %include "doc.i"
 
 %define %enumextras(Class)
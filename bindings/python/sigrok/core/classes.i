@@ -553,9 +553,76 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
         return PyArray_SimpleNewFromData(nd, dims, typenum, data);
     }
 
+    /*
+     * Convert to one float32 array per channel. Without out, the rows
+     * of a new (channels, samples) array each start 64-byte aligned.
+     * Otherwise out holds a contiguous, writable float32 array with at
+     * least num_samples() elements, or None, for every channel.
+     */
+    PyObject * _data_as_float_channels(PyObject *out)
+    {
+        const size_t num_channels = $self->channels().size();
+        const size_t num_samples = $self->num_samples();
+        std::vector<float *> dests(num_channels, nullptr);
+
+        if (out && out != Py_None) {
+            if (!PySequence_Check(out)
+                    || (size_t)PySequence_Size(out) != num_channels)
+                throw sigrok::Error(SR_ERR_ARG);
+            for (size_t i = 0; i < num_channels; i++) {
+                auto item = PySequence_GetItem(out, i);
+                bool valid = item == Py_None || (PyArray_Check(item)
+                    && PyArray_TYPE((PyArrayObject *)item) == NPY_FLOAT32
+                    && PyArray_ISCARRAY((PyArrayObject *)item)
+                    && (size_t)PyArray_SIZE((PyArrayObject *)item) >= num_samples);
+                if (valid && item != Py_None)
+                    dests[i] = (float *)PyArray_DATA((PyArrayObject *)item);
+                Py_XDECREF(item);
+                if (!valid)
+                    throw sigrok::Error(SR_ERR_ARG);
+            }
+            $self->get_data_as_float_channels(dests);
+            Py_INCREF(out);
+            return out;
+        }
+
+        /* One allocation, rows padded to whole cache lines. */
+        const size_t row = ((num_samples * sizeof(float) + 63) / 64) * 64;
+        auto mem = static_cast<uint8_t *>(g_malloc(row * num_channels + 63));
+        auto data = reinterpret_cast<uint8_t *>(
+            (reinterpret_cast<uintptr_t>(mem) + 63) & ~(uintptr_t)63);
+        for (size_t i = 0; i < num_channels; i++)
+            dests[i] = reinterpret_cast<float *>(data + i * row);
+        try {
+            $self->get_data_as_float_channels(dests);
+        } catch (...) {
+            g_free(mem);
+            throw;
+        }
+
+        npy_intp dims[2], strides[2];
+        dims[0] = num_channels;
+        dims[1] = num_samples;
+        strides[0] = row;
+        strides[1] = sizeof(float);
+        auto array = PyArray_New(&PyArray_Type, 2, dims, NPY_FLOAT32,
+            strides, data, 0, NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE,
+            nullptr);
+        auto capsule = PyCapsule_New(mem, nullptr, [](PyObject *obj) {
+            g_free(PyCapsule_GetPointer(obj, nullptr));
+        });
+        PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array), capsule);
+
+        return array;
+    }
+
 %pythoncode
 {
     data = property(_data)
+
+    def get_data_as_float_channels(self, out=None):
+        """Convert the samples to float32, one array per channel."""
+        return self._data_as_float_channels(out)
 }
 }
 
@@ -578,6 +645,139 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
 }
 }
 
+%{
+#include <algorithm>
+
+/*
+ * Logic data which accumulates for Session.add_logic_batch_callback().
+ * The Python callback runs once per batch, with a NumPy array which
+ * takes over the batch's memory. The GIL is only taken for that call.
+ */
+class LogicBatch
+{
+public:
+    LogicBatch(PyObject *callback, size_t size, unsigned int interval_ms) :
+        _callback(callback),
+        _size(size),
+        _interval_us(interval_ms * (int64_t)1000)
+    {
+        Py_XINCREF(_callback);
+    }
+
+    ~LogicBatch()
+    {
+        g_free(_data);
+        auto gstate = PyGILState_Ensure();
+        Py_XDECREF(_callback);
+        PyGILState_Release(gstate);
+    }
+
+    void add(const std::shared_ptr<sigrok::Device> &device,
+        const sigrok::PacketView &view)
+    {
+        if (view.type() == sigrok::PacketType::END) {
+            flush(device);
+            return;
+        }
+        if (view.type() != sigrok::PacketType::LOGIC)
+            return;
+
+        size_t length = view.data_length();
+        unsigned int unit_size = view.unit_size();
+        if (!length || !unit_size)
+            return;
+        if (_fill && (unit_size != _unit_size || _fill + length > _capacity))
+            flush(device);
+
+        if (!_data) {
+            _capacity = std::max(_size, length);
+            _data = static_cast<uint8_t *>(g_malloc(_capacity));
+            _start = g_get_monotonic_time();
+        }
+        memcpy(_data + _fill, view.data_pointer(), length);
+        _fill += length;
+        _unit_size = unit_size;
+
+        if (_fill >= _size || g_get_monotonic_time() - _start >= _interval_us)
+            flush(device);
+    }
+
+private:
+    void flush(const std::shared_ptr<sigrok::Device> &device)
+    {
+        if (!_fill)
+            return;
+
+        auto gstate = PyGILState_Ensure();
+
+        /* The array owns the memory from here on, the next batch gets new memory. */
+        npy_intp dims[2];
+        dims[0] = _fill / _unit_size;
+        dims[1] = _unit_size;
+        auto array = PyArray_SimpleNewFromData(2, dims, NPY_UINT8, _data);
+        auto capsule = PyCapsule_New(_data, nullptr, [](PyObject *obj) {
+            g_free(PyCapsule_GetPointer(obj, nullptr));
+        });
+        PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array), capsule);
+        _data = nullptr;
+        _fill = 0;
+
+        auto device_obj = SWIG_NewPointerObj(
+            SWIG_as_voidptr(new std::shared_ptr<sigrok::Device>(device)),
+            SWIGTYPE_p_std__shared_ptrT_sigrok__Device_t, SWIG_POINTER_OWN);
+
+        auto arglist = Py_BuildValue("(OO)", device_obj, array);
+
+        auto result = PyEval_CallObject(_callback, arglist);
+
+        Py_XDECREF(arglist);
+        Py_XDECREF(device_obj);
+        Py_XDECREF(array);
+
+        bool completed = !PyErr_Occurred();
+
+        if (!completed)
+            PyErr_Print();
+
+        Py_XDECREF(result);
+
+        PyGILState_Release(gstate);
+
+        if (!completed)
+            throw sigrok::Error(SR_ERR);
+    }
+
+    PyObject *_callback;
+    size_t _size;
+    int64_t _interval_us;
+    uint8_t *_data = nullptr;
+    size_t _capacity = 0;
+    size_t _fill = 0;
+    unsigned int _unit_size = 0;
+    int64_t _start = 0;
+};
+
+%}
+
+/* Batched logic data callbacks. */
+%extend sigrok::Session
+{
+    void add_logic_batch_callback(PyObject *callback,
+        size_t buffer_size = 1048576, unsigned int interval_ms = 50)
+    {
+        if (!PyCallable_Check(callback))
+            throw sigrok::Error(SR_ERR_ARG);
+
+        auto batch = std::make_shared<LogicBatch>(callback,
+            std::max(buffer_size, (size_t)1), interval_ms);
+        $self->add_datafeed_view_callback([batch] (
+                const std::shared_ptr<sigrok::Device> &device,
+                const sigrok::PacketView &view) {
+            batch->add(device, view);
+        });
+    }
+}
+
 /* Create logic packet from Python buffer. */
 %extend sigrok::Context
 {
@@ -407,6 +407,33 @@ int convert_option_by_key(VALUE key, VALUE val, VALUE in) {
     }
 }
 
+/*
+ * Return the payload data as a frozen binary String which refers to the
+ * packet's memory without copying it. The String must not be used after
+ * the payload object it was taken from is released.
+ */
+%extend sigrok::Logic
+{
+    VALUE data_view()
+    {
+        VALUE str = rb_str_new_static((const char *) $self->data_pointer(),
+            $self->data_length());
+        return rb_obj_freeze(str);
+    }
+}
+
+%extend sigrok::Analog
+{
+    VALUE data_view()
+    {
+        long length = (long) $self->num_samples() *
+            $self->channels().size() * $self->unitsize();
+        VALUE str = rb_str_new_static((const char *) $self->data_pointer(),
+            length);
+        return rb_obj_freeze(str);
+    }
+}
+
 /* Return Ruby array from Analog::data(). */
 %rename sigrok::Analog::_data data;
 %extend sigrok::Analog
@@ -71,6 +71,7 @@ template< class T > class enable_shared_from_this;
 %shared_ptr(sigrok::Option);
 %shared_ptr(sigrok::OutputFormat);
 %shared_ptr(sigrok::Output);
+%shared_ptr(sigrok::Recorder);
 %shared_ptr(sigrok::Trigger);
 %shared_ptr(sigrok::TriggerStage);
 %shared_ptr(sigrok::TriggerMatch);
@@ -80,6 +81,13 @@ template< class T > class enable_shared_from_this;
 #define SR_PRIV
 
 %ignore sigrok::DatafeedCallbackData;
+/* Packet views only live during a C++ callback, keep them out of the wrappers. */
+%ignore sigrok::PacketView;
+%ignore sigrok::Session::add_datafeed_view_callback;
+%ignore sigrok::Analog::get_data_as_float_channels;
+%ignore sigrok::Configurable::config_set_multiple;
+%ignore sigrok::Session::iteration_prepare;
+%ignore sigrok::Session::iteration_dispatch;
 
 #ifndef SWIGJAVA
 
@@ -107,6 +107,33 @@ enum sr_loglevel {
 	SR_LOG_SPEW = 5, /**< Output very noisy debug messages. */
 };
 
+/** Flags for sr_init_ex(). */
+enum sr_init_flags {
+	/**
+	 * Defer the initialization of USB and HID support until the first
+	 * sr_driver_init() call. Applications which only use input, output
+	 * or transform modules never pay for it.
+	 */
+	SR_INIT_LAZY = 1 << 0,
+	/** Check all drivers and modules for internal consistency. */
+	SR_INIT_SANITY_CHECKS = 1 << 1,
+	/**
+	 * Handle all USB events in a dedicated thread of the context,
+	 * instead of polling the USB file descriptors in the main loop of
+	 * every running session. Recommended when several sessions run
+	 * in threads of their own. Drivers still see the completions of
+	 * their transfers in the thread which runs the session.
+	 */
+	SR_INIT_USB_EVENT_THREAD = 1 << 2,
+	/**
+	 * Run the USB event thread with real-time priority (SCHED_FIFO),
+	 * such that transfers get resubmitted in time while the system is
+	 * busy. Implies SR_INIT_USB_EVENT_THREAD. Without the privilege to
+	 * raise its priority, the thread runs at normal priority.
+	 */
+	SR_INIT_USB_EVENT_REALTIME = 1 << 3,
+};
+
 /*
  * Use SR_API to mark public API symbols, and SR_PRIV for private symbols.
  *
@@ -175,6 +202,8 @@ enum sr_packettype {
 	SR_DF_FRAME_END,
 	/** Payload is struct sr_datafeed_analog. */
 	SR_DF_ANALOG,
+	/** Payload is struct sr_datafeed_logic_rle. */
+	SR_DF_LOGIC_RLE,
 
 	/* Update datafeed_dump() (session.c) upon changes! */
 };
@@ -429,12 +458,24 @@ struct sr_trigger {
 	GSList *stages;
 };
 
+/** Serial protocols which the soft trigger can decode. */
+enum sr_trigger_protocols {
+	/** UART, 8 data bits, no parity, 1 stop bit, idle high. */
+	SR_TRIGGER_PROTO_UART = 1,
+	/** SPI, 8 bits per word, MSB first. */
+	SR_TRIGGER_PROTO_SPI,
+	/** I2C, the address of a transfer. */
+	SR_TRIGGER_PROTO_I2C,
+};
+
 /** A trigger stage. */
 struct sr_trigger_stage {
 	/** Starts at 0. */
 	int stage;
 	/** List of pointers to struct sr_trigger_match. */
 	GSList *matches;
+	/** Serial protocol condition, NULL for none. */
+	struct sr_trigger_protocol_match *protocol;
 };
 
 /** A channel to match and what to match it on. */
@@ -462,6 +503,29 @@ struct sr_trigger_match {
 	float value;
 };
 
+/**
+ * A serial protocol condition of a trigger stage. The stage matches on
+ * the sample which completes a word or address with the given value.
+ * Only the soft trigger evaluates these conditions.
+ */
+struct sr_trigger_protocol_match {
+	/** The protocol, from enum sr_trigger_protocols. */
+	int protocol;
+	/**
+	 * The logic channels. UART: RX. SPI: CLK, the data line (MOSI or
+	 * MISO), and CS# or NULL. I2C: SCL, SDA.
+	 */
+	struct sr_channel *channels[3];
+	/** UART: the baud rate. */
+	uint64_t baudrate;
+	/** SPI: the mode, 0 to 3. */
+	int spi_mode;
+	/** The byte (UART, SPI) or 7-bit address (I2C) to trigger on. */
+	uint8_t value;
+	/** The bits of value which get compared. */
+	uint8_t mask;
+};
+
 /**
  * @struct sr_context
  * Opaque structure representing a libsigrok context.
@@ -482,6 +546,135 @@ struct sr_context;
  */
 struct sr_session;
 
+/**
+ * Opaque, reference counted storage for datafeed payload data.
+ *
+ * Drivers which acquire sample data into memory of their own (e.g. USB
+ * transfer buffers) can pass such a buffer along with the packet whose
+ * payload points into it. Consumers which keep the data beyond the
+ * datafeed callback then share the storage instead of copying it.
+ *
+ * @see sr_datafeed_buffer_new(), sr_packet_copy().
+ */
+struct sr_datafeed_buffer;
+
+/** Flags for sr_session_datafeed_callback_add_full(). */
+enum sr_datafeed_callback_flags {
+	/**
+	 * The callback may run in a worker thread, concurrently with the
+	 * session's other datafeed callbacks.
+	 */
+	SR_DATAFEED_CB_THREAD_SAFE = 1 << 0,
+	/**
+	 * The callback handles SR_DF_LOGIC_RLE packets. Callbacks without
+	 * this flag receive such data expanded into SR_DF_LOGIC packets.
+	 */
+	SR_DATAFEED_CB_LOGIC_RLE = 1 << 1,
+};
+
+/** Flags for sr_session_merge_set(). */
+enum sr_merge_flags {
+	/** Align the devices' streams at their trigger positions. */
+	SR_MERGE_ALIGN_TRIGGER = 1 << 0,
+};
+
+/**
+ * Statistics of a session's datafeed dispatch queue.
+ *
+ * @see sr_session_dispatch_thread_set(), sr_session_dispatch_stats_get().
+ */
+struct sr_session_dispatch_stats {
+	/** Capacity of the queue in packets, 0 for synchronous dispatch. */
+	unsigned int depth;
+	/** Largest number of packets which were queued at the same time. */
+	unsigned int high_water;
+	/** Number of packets which passed through the queue. */
+	uint64_t packets;
+	/** Number of times a sender had to wait for room in the queue. */
+	uint64_t stalls;
+	/** Largest amount of sample data which was queued, in bytes. */
+	uint64_t high_water_bytes;
+};
+
+/**
+ * Throughput and timing statistics of a session's datafeed.
+ *
+ * Times are in microseconds. Apart from the transfer counters and the
+ * memory use, which get tracked at all times, the statistics are only
+ * collected while enabled.
+ *
+ * @see sr_session_stats_enable(), sr_session_stats_get().
+ */
+struct sr_session_stats {
+	/** Number of packets which were passed to the datafeed callbacks. */
+	uint64_t packets;
+	/** Number of logic and analog payload bytes in these packets. */
+	uint64_t bytes;
+	/** Cumulative time spent in transform modules. */
+	uint64_t transform_time;
+	/** Cumulative time spent in datafeed callbacks. */
+	uint64_t callback_time;
+	/** Longest time it took to dispatch a single send call. */
+	uint64_t max_latency;
+	/** Number of transfers which drivers reported as failed. */
+	uint64_t dropped_transfers;
+	/** Number of transfers which drivers reported as empty. */
+	uint64_t empty_transfers;
+	/** Bytes of large buffers which are currently held for the session. */
+	uint64_t memory_used;
+	/** Most bytes held at the same time since the session's start. */
+	uint64_t memory_peak;
+};
+
+/**
+ * Summary of a session file, read without loading the session.
+ *
+ * @see sr_session_file_info_get(), sr_session_file_info_free().
+ */
+struct sr_session_file_info {
+	/** Samplerate in Hz, 0 if the file does not specify one. */
+	uint64_t samplerate;
+	/** Number of samples in the capture. */
+	uint64_t num_samples;
+	/** Duration of the capture in nanoseconds, 0 without a samplerate. */
+	uint64_t duration;
+	/** Number of logic channels. */
+	unsigned int num_logic_channels;
+	/** Number of analog channels. */
+	unsigned int num_analog_channels;
+	/** Bytes per logic sample, 0 if the file holds no logic data. */
+	unsigned int unitsize;
+	/**
+	 * NULL-terminated list of channel names, indexed like the loaded
+	 * session's channels: logic channels first, then analog channels.
+	 */
+	char **channel_names;
+};
+
+/**
+ * Summary of a session file channel's samples, at reduced resolution.
+ *
+ * Each entry covers samples_per_entry samples, the last one can cover
+ * fewer. Depending on the channel's type either min and max, or first
+ * and transitions are set, the other pair is NULL.
+ *
+ * @see sr_session_file_summary_get(), sr_session_file_summary_free().
+ */
+struct sr_session_file_summary {
+	/** Number of samples which each entry covers. */
+	uint64_t samples_per_entry;
+	/** Number of entries. */
+	uint64_t num_entries;
+	/** Analog channels: smallest value within each entry. */
+	float *min;
+	/** Analog channels: largest value within each entry. */
+	float *max;
+	/** Logic channels: the level (0 or 1) at the start of each entry. */
+	uint8_t *first;
+	/** Logic channels: number of transitions within each entry. */
+	uint32_t *transitions;
+};
+
 struct sr_rational {
 	/** Numerator of the rational number. */
 	int64_t p;
@@ -513,6 +706,27 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/**
+ * Run-length encoded logic datafeed payload for type SR_DF_LOGIC_RLE.
+ *
+ * Run i repeats the sample value at values + i * unitsize for
+ * run_lengths[i] samples. Run lengths are never zero.
+ */
+struct sr_datafeed_logic_rle {
+	uint64_t num_runs;
+	uint16_t unitsize;
+	void *values;
+	uint64_t *run_lengths;
+};
+
+/** Read position in an SR_DF_LOGIC_RLE payload, see sr_logic_rle_expand(). */
+struct sr_logic_rle_pos {
+	/** Index of the current run. */
+	uint64_t run;
+	/** Number of samples of the current run which were consumed. */
+	uint64_t offset;
+};
+
 /** Analog datafeed payload for type SR_DF_ANALOG. */
 struct sr_datafeed_analog {
 	void *data;
@@ -592,12 +806,21 @@ struct sr_resource {
 enum sr_output_flag {
 	/** If set, this output module writes the output itself. */
 	SR_OUTPUT_INTERNAL_IO_HANDLING = 0x01,
+	/** If set, this output module accepts SR_DF_LOGIC_RLE packets. */
+	SR_OUTPUT_LOGIC_RLE = 0x02,
+	/**
+	 * If set, this output module uses analog data in the encoding which
+	 * it was sent in, an output pipeline doesn't convert it to floats.
+	 */
+	SR_OUTPUT_ANALOG_RAW = 0x04,
 };
 
 struct sr_input;
 struct sr_input_module;
 struct sr_output;
 struct sr_output_module;
+struct sr_output_pipeline;
+struct sr_file_writer;
 struct sr_transform;
 struct sr_transform_module;
 
@@ -1083,6 +1306,14 @@ enum sr_configkey {
 	 */
 	SR_CONF_RESISTANCE_TARGET,
 
+	/**
+	 * Progress of a download of data which the device had stored.
+	 * Sent in SR_DF_META packets while the download is running.
+	 * @arg type: uint64, in percent
+	 * @arg get: get download progress
+	 */
+	SR_CONF_DOWNLOAD_PROGRESS,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Special stuff -------------------------------------------------*/
@@ -1119,6 +1350,84 @@ enum sr_configkey {
 	/** Number of powerline cycles for ADC integration time. */
 	SR_CONF_ADC_POWERLINE_CYCLES,
 
+	/**
+	 * Adapt the number of USB transfers in flight to the host's
+	 * completion latency during acquisition.
+	 * @arg type: boolean
+	 * @arg get: get whether adaptive transfers are enabled
+	 * @arg set: enable or disable adaptive transfers
+	 */
+	SR_CONF_ADAPTIVE_TRANSFERS,
+
+	/**
+	 * Number of USB transfers in flight.
+	 * @arg type: uint64_t
+	 * @arg get: get the effective number of current (or last) acquisition
+	 */
+	SR_CONF_NUM_TRANSFERS,
+
+	/**
+	 * Size of a USB transfer in bytes.
+	 * @arg type: uint64_t
+	 * @arg get: get the effective size at the current samplerate
+	 */
+	SR_CONF_TRANSFER_SIZE,
+
+	/**
+	 * Sample number at which session file playback starts.
+	 * @arg type: uint64_t
+	 * @arg get: get the start sample
+	 * @arg set: skip the capture data before the given sample
+	 */
+	SR_CONF_CAPTURE_START_SAMPLE,
+
+	/**
+	 * Number of bytes which session file playback reads per packet.
+	 * Analog channels share it, a read of each of them takes its part.
+	 * @arg type: uint64_t
+	 * @arg get: get the read size, 0 is the default size
+	 * @arg set: set the read size, 0 selects the default size
+	 */
+	SR_CONF_CAPTURE_CHUNK_SIZE,
+
+	/**
+	 * Replay session files as fast as possible, instead of one read
+	 * per main loop iteration. Generating devices (demo) send data as
+	 * fast as the session accepts it, instead of at the samplerate.
+	 * @arg type: boolean
+	 * @arg get: get whether replay is unthrottled
+	 * @arg set: enable or disable unthrottled replay
+	 */
+	SR_CONF_CAPTURE_UNTHROTTLED,
+
+	/**
+	 * Number of session file chunks which get decompressed ahead of
+	 * their replay, by as many threads.
+	 * @arg type: uint64_t
+	 * @arg get: get the number of chunks
+	 * @arg set: set the number of chunks, 0 reads chunks on demand
+	 */
+	SR_CONF_CAPTURE_READ_AHEAD,
+
+	/**
+	 * Start session file playback at activity: at the start sample if
+	 * an enabled logic channel changes in its chunk, else at the next
+	 * chunk in which one does. Uses the edge index of the session file.
+	 * @arg type: boolean
+	 * @arg get: get whether playback seeks to edges
+	 * @arg set: enable or disable seeking to edges
+	 */
+	SR_CONF_CAPTURE_SEEK_EDGE,
+
+	/**
+	 * Send the analog channels of a session file in packets which
+	 * hold all of them, interleaved, instead of one packet for each.
+	 * @arg type: boolean
+	 * @arg get: get whether analog channels get interleaved
+	 * @arg set: enable or disable interleaving analog channels
+	 */
+	SR_CONF_CAPTURE_INTERLEAVE,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Acquisition modes, sample limiting ----------------------------*/
@@ -30,6 +30,12 @@
 
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *buf);
+SR_API int sr_analog_to_double(const struct sr_datafeed_analog *analog,
+		double *buf);
+SR_API int sr_analog_to_float_view(const struct sr_datafeed_analog *analog,
+		float *outbuf, const float **values);
+SR_API int sr_analog_to_float_channels(const struct sr_datafeed_analog *analog,
+		float *const *bufs);
 SR_API const char *sr_analog_si_prefix(float *value, int *digits);
 SR_API gboolean sr_analog_si_prefix_friendly(enum sr_unit unit);
 SR_API int sr_analog_unit_to_string(const struct sr_datafeed_analog *analog,
@@ -44,12 +50,17 @@ SR_API int sr_rational_div(struct sr_rational *res, const struct sr_rational *nu
 /*--- backend.c -------------------------------------------------------------*/
 
 SR_API int sr_init(struct sr_context **ctx);
+SR_API int sr_init_ex(struct sr_context **ctx, unsigned int flags);
 SR_API int sr_exit(struct sr_context *ctx);
 
 SR_API GSList *sr_buildinfo_libs_get(void);
 SR_API char *sr_buildinfo_host_get(void);
 SR_API char *sr_buildinfo_scpi_backends_get(void);
 
+/*--- cpu.c -----------------------------------------------------------------*/
+
+SR_API char *sr_cpu_features_get(void);
+
 /*--- conversion.c ----------------------------------------------------------*/
 
 SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
@@ -57,6 +68,12 @@ SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count);
+SR_API int sr_a2l_threshold_logic(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, size_t unitsize,
+		unsigned int bit, uint64_t count);
+SR_API int sr_a2l_schmitt_trigger_logic(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		size_t unitsize, unsigned int bit, uint64_t count);
 
 /*--- log.c -----------------------------------------------------------------*/
 
@@ -68,6 +85,7 @@ SR_API int sr_log_loglevel_get(void);
 SR_API int sr_log_callback_set(sr_log_callback cb, void *cb_data);
 SR_API int sr_log_callback_set_default(void);
 SR_API int sr_log_callback_get(sr_log_callback *cb, void **cb_data);
+SR_API int sr_log_async_set(gboolean enable);
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -105,6 +123,8 @@ SR_API int sr_driver_init(struct sr_context *ctx,
 		struct sr_dev_driver *driver);
 SR_API GArray *sr_driver_scan_options_list(const struct sr_dev_driver *driver);
 SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options);
+SR_API GSList *sr_drivers_scan(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, GSList *options);
 SR_API int sr_config_get(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
@@ -112,6 +132,30 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant *data);
+SR_API int sr_config_set_multiple(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *configs, size_t count);
+SR_API int sr_config_get_u64(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, uint64_t *value);
+SR_API int sr_config_get_bool(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, gboolean *value);
+SR_API int sr_config_get_double(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, double *value);
+SR_API int sr_config_set_u64(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, uint64_t value);
+SR_API int sr_config_set_bool(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, gboolean value);
+SR_API int sr_config_set_double(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, double value);
 SR_API int sr_config_commit(const struct sr_dev_inst *sdi);
 SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
@@ -125,12 +169,25 @@ SR_API const struct sr_key_info *sr_key_info_name_get(int keytype, const char *k
 typedef void (*sr_session_stopped_callback)(void *data);
 typedef void (*sr_datafeed_callback)(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet, void *cb_data);
+typedef void (*sr_datafeed_batch_callback)(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packets, size_t count,
+		void *cb_data);
 
 SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session);
 
 /* Session setup */
 SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	struct sr_session **session);
+SR_API int sr_session_file_info_get(const char *filename,
+	struct sr_session_file_info **info);
+SR_API void sr_session_file_info_free(struct sr_session_file_info *info);
+SR_API int sr_session_file_summary_get(const char *filename,
+	unsigned int channel, uint64_t samples_per_entry,
+	struct sr_session_file_summary **summary);
+SR_API void sr_session_file_summary_free(struct sr_session_file_summary *summary);
+SR_API int sr_session_file_export(struct sr_context *ctx, const char *filename,
+	const struct sr_output_module *omod, GHashTable *options,
+	const char *outfile, unsigned int threads);
 SR_API int sr_session_new(struct sr_context *ctx, struct sr_session **session);
 SR_API int sr_session_destroy(struct sr_session *session);
 SR_API int sr_session_dev_remove_all(struct sr_session *session);
@@ -145,19 +202,69 @@ SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger
 SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session);
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_add_full(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, unsigned int flags);
+SR_API int sr_session_datafeed_batch_callback_add(struct sr_session *session,
+		sr_datafeed_batch_callback cb, void *cb_data);
 
 /* Session control */
 SR_API int sr_session_start(struct sr_session *session);
 SR_API int sr_session_run(struct sr_session *session);
+SR_API int sr_session_iteration_prepare(struct sr_session *session,
+		GPollFD *fds, int *num_fds, int *timeout_ms);
+SR_API int sr_session_iteration_dispatch(struct sr_session *session,
+		GPollFD *fds, int num_fds);
 SR_API int sr_session_stop(struct sr_session *session);
 SR_API int sr_session_is_running(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
+SR_API int sr_session_dispatch_thread_set(struct sr_session *session,
+		unsigned int depth);
+SR_API int sr_session_dispatch_memory_set(struct sr_session *session,
+		uint64_t max_bytes);
+SR_API int sr_session_memory_limit_set(struct sr_session *session,
+		uint64_t max_bytes);
+SR_API int sr_session_logic_coalesce_set(struct sr_session *session,
+		size_t max_bytes, unsigned int max_latency_ms);
+SR_API int sr_session_raw_record_set(struct sr_session *session,
+		const char *dir);
+SR_API int sr_session_timer_coalesce_set(struct sr_session *session,
+		unsigned int slack_ms);
+SR_API int sr_session_epoll_set(struct sr_session *session, gboolean enable);
+SR_API int sr_session_dispatch_stats_get(struct sr_session *session,
+		struct sr_session_dispatch_stats *stats);
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats *stats);
+SR_API int sr_session_callback_time_get(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, uint64_t *elapsed);
+SR_API int sr_session_timestamps_enable(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_sync_master_set(struct sr_session *session,
+		struct sr_dev_inst *sdi);
+SR_API int64_t sr_session_packet_time_get(void);
+
+/*--- session_merge.c -------------------------------------------------------*/
 
+SR_API int sr_session_merge_set(struct sr_session *session,
+		unsigned int flags, sr_datafeed_callback cb, void *cb_data);
+
+SR_API uint64_t sr_logic_rle_num_samples(
+		const struct sr_datafeed_logic_rle *rle);
+SR_API uint64_t sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		struct sr_logic_rle_pos *pos, void *buf, uint64_t size);
 SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy);
 SR_API void sr_packet_free(struct sr_datafeed_packet *packet);
 
+SR_API struct sr_datafeed_buffer *sr_datafeed_buffer_new(size_t size);
+SR_API struct sr_datafeed_buffer *sr_datafeed_buffer_ref(
+		struct sr_datafeed_buffer *buf);
+SR_API void sr_datafeed_buffer_unref(struct sr_datafeed_buffer *buf);
+SR_API void *sr_datafeed_buffer_data(const struct sr_datafeed_buffer *buf);
+SR_API size_t sr_datafeed_buffer_size(const struct sr_datafeed_buffer *buf);
+
 /*--- input/input.c ---------------------------------------------------------*/
 
 SR_API const struct sr_input_module **sr_input_list(void);
@@ -176,6 +283,9 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in);
 SR_API const struct sr_input_module *sr_input_module_get(const struct sr_input *in);
 SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in);
 SR_API int sr_input_send(const struct sr_input *in, GString *buf);
+SR_API int sr_input_map_file(const struct sr_input *in, const char *filename);
+SR_API int sr_input_send_mapped(const struct sr_input *in, size_t len,
+		size_t *remain);
 SR_API int sr_input_end(const struct sr_input *in);
 SR_API int sr_input_reset(const struct sr_input *in);
 SR_API void sr_input_free(const struct sr_input *in);
@@ -199,6 +309,24 @@ SR_API gboolean sr_output_test_flag(const struct sr_output_module *omod,
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out);
 SR_API int sr_output_free(const struct sr_output *o);
+SR_API struct sr_output_pipeline *sr_output_pipeline_new(void);
+SR_API int sr_output_pipeline_add(struct sr_output_pipeline *pipeline,
+		const struct sr_output *o);
+SR_API int sr_output_pipeline_send(struct sr_output_pipeline *pipeline,
+		const struct sr_datafeed_packet *packet, GString **out);
+SR_API void sr_output_pipeline_free(struct sr_output_pipeline *pipeline);
+
+/*--- output/file_writer.c --------------------------------------------------*/
+
+SR_API struct sr_file_writer *sr_file_writer_new(const char *filename,
+		uint64_t max_pending);
+SR_API struct sr_file_writer *sr_file_writer_new_stream(FILE *file,
+		uint64_t max_pending);
+SR_API int sr_file_writer_write(struct sr_file_writer *fw,
+		const void *data, size_t size);
+SR_API int sr_file_writer_write_string(struct sr_file_writer *fw,
+		GString *str);
+SR_API int sr_file_writer_close(struct sr_file_writer *fw);
 
 /*--- transform/transform.c -------------------------------------------------*/
 
@@ -220,6 +348,8 @@ SR_API void sr_trigger_free(struct sr_trigger *trig);
 SR_API struct sr_trigger_stage *sr_trigger_stage_add(struct sr_trigger *trig);
 SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 		struct sr_channel *ch, int trigger_match, float value);
+SR_API int sr_trigger_protocol_match_set(struct sr_trigger_stage *stage,
+		const struct sr_trigger_protocol_match *match);
 
 /*--- serial.c --------------------------------------------------------------*/
 
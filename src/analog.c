@@ -157,6 +157,190 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
+/** @cond PRIVATE */
+/* Number of values which get converted in one go on the stack. */
+#define CONVERT_BLOCK_SIZE 256
+/** @endcond */
+
+/* Sample data formats which the conversion routines accept. */
+enum analog_format {
+	FMT_FLT_LE, FMT_FLT_BE, FMT_DBL_LE, FMT_DBL_BE,
+	FMT_I8, FMT_U8,
+	FMT_I16_LE, FMT_I16_BE, FMT_U16_LE, FMT_U16_BE,
+	FMT_I24_LE,
+	FMT_I32_LE, FMT_I32_BE, FMT_U32_LE, FMT_U32_BE,
+};
+
+/* Parameters of a conversion which apply to all sample values. */
+struct analog_conv {
+	enum analog_format format;
+	size_t unitsize;
+	size_t num_channels;
+	size_t count;
+	double scale, offset;
+	const uint8_t *data8;
+};
+
+/*
+ * Check the arguments of a conversion, and determine the input data's
+ * format and the common scale/offset factors. Error messages for
+ * unsupported input property combinations will only be seen by
+ * developers and maintainers of input formats or acquisition device
+ * drivers. Terse output is acceptable there, users shall never see them.
+ */
+static int analog_conv_init(const struct sr_datafeed_analog *analog,
+		struct analog_conv *conv)
+{
+	const struct sr_analog_encoding *enc;
+	gboolean be;
+	char type_text[10];
+
+	if (!analog || !analog->data || !analog->meaning || !analog->encoding)
+		return SR_ERR_ARG;
+
+	enc = analog->encoding;
+	be = enc->is_bigendian;
+	conv->unitsize = enc->unitsize;
+	conv->num_channels = g_slist_length(analog->meaning->channels);
+	conv->count = analog->num_samples * conv->num_channels;
+	conv->offset = enc->offset.p;
+	conv->offset /= enc->offset.q;
+	conv->scale = enc->scale.p;
+	conv->scale /= enc->scale.q;
+	conv->data8 = analog->data;
+
+	if (enc->is_float && enc->unitsize == sizeof(float))
+		conv->format = be ? FMT_FLT_BE : FMT_FLT_LE;
+	else if (enc->is_float && enc->unitsize == sizeof(double))
+		conv->format = be ? FMT_DBL_BE : FMT_DBL_LE;
+	else if (enc->is_float)
+		goto unsupported;
+	else if (enc->unitsize == sizeof(uint8_t))
+		conv->format = enc->is_signed ? FMT_I8 : FMT_U8;
+	else if (enc->unitsize == sizeof(uint16_t) && enc->is_signed)
+		conv->format = be ? FMT_I16_BE : FMT_I16_LE;
+	else if (enc->unitsize == sizeof(uint16_t))
+		conv->format = be ? FMT_U16_BE : FMT_U16_LE;
+	else if (enc->unitsize == 3 && enc->is_signed && !be)
+		conv->format = FMT_I24_LE;
+	else if (enc->unitsize == sizeof(uint32_t) && enc->is_signed)
+		conv->format = be ? FMT_I32_BE : FMT_I32_LE;
+	else if (enc->unitsize == sizeof(uint32_t))
+		conv->format = be ? FMT_U32_BE : FMT_U32_LE;
+	else
+		goto unsupported;
+
+	return SR_OK;
+
+unsupported:
+	snprintf(type_text, sizeof(type_text), "%c%zu%s",
+		enc->is_float ? 'f' : enc->is_signed ? 'i' : 'u',
+		conv->unitsize * 8, be ? "be" : "le");
+	sr_err("Unsupported type for analog conversion: %s.", type_text);
+	return SR_ERR;
+}
+
+/** @cond PRIVATE */
+#define CONVERT_LOOP_SIZE(reader, size) \
+	for (i = 0; i < count; i++) { \
+		value = reader(&data8[i * (size)]); \
+		value *= scale; \
+		value += offset; \
+		outbuf[i] = value; \
+	}
+#define CONVERT_LOOP(reader) CONVERT_LOOP_SIZE(reader, sizeof(reader(data8)))
+/** @endcond */
+
+/*
+ * Convert a run of count consecutive values at data8, applying the
+ * common scale/offset factors. Each format has a loop of its own which
+ * uses inlined readers, such that the compiler can vectorize it.
+ */
+static SR_ALWAYS_INLINE void analog_conv_loops(const struct analog_conv *conv,
+		const uint8_t *data8, size_t count, double *outbuf)
+{
+	double scale, offset, value;
+	size_t i;
+
+	scale = conv->scale;
+	offset = conv->offset;
+
+	switch (conv->format) {
+	case FMT_FLT_LE:
+		CONVERT_LOOP(read_fltle);
+		break;
+	case FMT_FLT_BE:
+		CONVERT_LOOP(read_fltbe);
+		break;
+	case FMT_DBL_LE:
+		CONVERT_LOOP(read_dblle);
+		break;
+	case FMT_DBL_BE:
+		CONVERT_LOOP(read_dblbe);
+		break;
+	case FMT_I8:
+		CONVERT_LOOP(read_i8);
+		break;
+	case FMT_U8:
+		CONVERT_LOOP(read_u8);
+		break;
+	case FMT_I16_LE:
+		CONVERT_LOOP(read_i16le);
+		break;
+	case FMT_I16_BE:
+		CONVERT_LOOP(read_i16be);
+		break;
+	case FMT_U16_LE:
+		CONVERT_LOOP(read_u16le);
+		break;
+	case FMT_U16_BE:
+		CONVERT_LOOP(read_u16be);
+		break;
+	case FMT_I24_LE:
+		CONVERT_LOOP_SIZE(read_i24le, 3);
+		break;
+	case FMT_I32_LE:
+		CONVERT_LOOP(read_i32le);
+		break;
+	case FMT_I32_BE:
+		CONVERT_LOOP(read_i32be);
+		break;
+	case FMT_U32_LE:
+		CONVERT_LOOP(read_u32le);
+		break;
+	case FMT_U32_BE:
+		CONVERT_LOOP(read_u32be);
+		break;
+	}
+}
+
+static void analog_conv_generic(const struct analog_conv *conv,
+		const uint8_t *data8, size_t count, double *outbuf)
+{
+	analog_conv_loops(conv, data8, count, outbuf);
+}
+
+#ifdef SR_CPU_DISPATCH_X86
+/* Same loops, with twice the vector width. */
+static SR_TARGET("avx2") void analog_conv_avx2(const struct analog_conv *conv,
+		const uint8_t *data8, size_t count, double *outbuf)
+{
+	analog_conv_loops(conv, data8, count, outbuf);
+}
+#endif
+
+static void analog_conv_run(const struct analog_conv *conv,
+		const uint8_t *data8, size_t count, double *outbuf)
+{
+#ifdef SR_CPU_DISPATCH_X86
+	if (sr_cpu_has(SR_CPU_AVX2)) {
+		analog_conv_avx2(conv, data8, count, outbuf);
+		return;
+	}
+#endif
+	analog_conv_generic(conv, data8, count, outbuf);
+}
+
 /**
  * Convert an analog datafeed payload to an array of floats.
  *
@@ -177,205 +361,331 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *outbuf)
 {
-	size_t count;
-	gboolean host_bigendian;
-	gboolean input_float, input_signed, input_bigendian;
-	size_t input_unitsize;
-	double scale, offset, value;
-	const uint8_t *data8;
-	gboolean input_is_native;
-	char type_text[10];
+	struct analog_conv conv;
+	double block[CONVERT_BLOCK_SIZE];
+	size_t count, n, i;
+	gboolean host_bigendian, input_is_native;
+	int ret;
 
-	if (!analog || !analog->data || !analog->meaning || !analog->encoding)
-		return SR_ERR_ARG;
 	if (!outbuf)
 		return SR_ERR_ARG;
-
-	count = analog->num_samples * g_slist_length(analog->meaning->channels);
+	ret = analog_conv_init(analog, &conv);
+	if (ret != SR_OK)
+		return ret;
 
 	/*
-	 * Determine properties of the input data's and the host's
-	 * native formats, to simplify test conditions below.
-	 * Error messages for unsupported input property combinations
-	 * will only be seen by developers and maintainers of input
-	 * formats or acquisition device drivers. Terse output is
-	 * acceptable there, users shall never see them.
+	 * Immediately handle the special case where input data needs
+	 * no conversion because it already is in the application's
+	 * native format. Do apply scale/offset though when applicable
+	 * on our way out.
 	 */
 #ifdef WORDS_BIGENDIAN
 	host_bigendian = TRUE;
 #else
 	host_bigendian = FALSE;
 #endif
-	input_float = analog->encoding->is_float;
-	input_signed = analog->encoding->is_signed;
-	input_bigendian = analog->encoding->is_bigendian;
-	input_unitsize = analog->encoding->unitsize;
-
-	/*
-	 * Prepare the iteration over the sample data: Get the common
-	 * scale/offset factors which apply to all individual values.
-	 * Position the read pointer on the first byte of input data.
-	 */
-	offset = analog->encoding->offset.p;
-	offset /= analog->encoding->offset.q;
-	scale = analog->encoding->scale.p;
-	scale /= analog->encoding->scale.q;
-	data8 = analog->data;
-
-	/*
-	 * Immediately handle the special case where input data needs
-	 * no conversion because it already is in the application's
-	 * native format. Do apply scale/offset though when applicable
-	 * on our way out.
-	 */
-	input_is_native = input_float &&
-		input_unitsize == sizeof(outbuf[0]) &&
-		input_bigendian == host_bigendian;
+	input_is_native = conv.format ==
+		(host_bigendian ? FMT_FLT_BE : FMT_FLT_LE);
 	if (input_is_native) {
-		memcpy(outbuf, data8, count * sizeof(outbuf[0]));
-		if (scale != 1.0 || offset != 0.0) {
-			while (count--) {
-				*outbuf *= scale;
-				*outbuf += offset;
-				outbuf++;
+		memcpy(outbuf, conv.data8, conv.count * sizeof(outbuf[0]));
+		if (conv.scale != 1.0 || conv.offset != 0.0) {
+			for (i = 0; i < conv.count; i++) {
+				outbuf[i] *= conv.scale;
+				outbuf[i] += conv.offset;
 			}
 		}
 		return SR_OK;
 	}
 
 	/*
-	 * Accept sample values in different widths and data types and
-	 * endianess formats (floating point or signed or unsigned
-	 * integer, in either endianess, for a set of supported widths).
-	 * Common scale/offset factors apply to all sample values.
-	 *
-	 * Do most internal calculations on double precision values.
-	 * Only trim the result data to single precision, since that's
-	 * the routine's result data type in its public API which needs
-	 * to be kept for compatibility. It remains an option for later
-	 * to add another public routine which returns double precision
-	 * result data, call sites could migrate at their own pace.
+	 * Do the internal calculations on double precision values, in
+	 * blocks which stay in the cache. Only trim the result data to
+	 * single precision, since that's the routine's result data type.
+	 * Use sr_analog_to_double() to get double precision results.
 	 */
-	if (input_float && input_unitsize == sizeof(float)) {
-		float (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_fltbe_inc;
-		else
-			reader = read_fltle_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
-		return SR_OK;
+	for (count = conv.count; count; count -= n) {
+		n = MIN(count, CONVERT_BLOCK_SIZE);
+		analog_conv_run(&conv, conv.data8, n, block);
+		for (i = 0; i < n; i++)
+			outbuf[i] = block[i];
+		conv.data8 += n * conv.unitsize;
+		outbuf += n;
 	}
-	if (input_float && input_unitsize == sizeof(double)) {
-		double (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_dblbe_inc;
-		else
-			reader = read_dblle_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+
+	return SR_OK;
+}
+
+/**
+ * Convert an analog datafeed payload to an array of doubles.
+ *
+ * Works like sr_analog_to_float(), but keeps the precision of the
+ * calculation for the result data.
+ *
+ * @param[in] analog The analog payload to convert. Must not be NULL.
+ *                   analog->data, analog->meaning, and analog->encoding
+ *                   must not be NULL.
+ * @param[out] outbuf Memory where to store the result. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_analog_to_double(const struct sr_datafeed_analog *analog,
+		double *outbuf)
+{
+	struct analog_conv conv;
+	int ret;
+
+	if (!outbuf)
+		return SR_ERR_ARG;
+	ret = analog_conv_init(analog, &conv);
+	if (ret != SR_OK)
+		return ret;
+
+	analog_conv_run(&conv, conv.data8, conv.count, outbuf);
+
+	return SR_OK;
+}
+
+/*
+ * Float values of an analog packet, converted on first request and
+ * shared by all datafeed callbacks which get the packet. The session
+ * registers its view while it delivers an analog packet.
+ */
+struct sr_analog_float_view {
+	const struct sr_datafeed_analog *analog;
+	/* Protects the fields below, callbacks may run concurrently. */
+	GMutex mutex;
+	gboolean done;
+	int ret;
+	const float *values;
+	float *buf;
+	size_t buf_size;
+};
+
+static GMutex float_views_mutex;
+static GSList *float_views;
+
+SR_PRIV struct sr_analog_float_view *sr_analog_float_view_new(void)
+{
+	struct sr_analog_float_view *view;
+
+	view = g_malloc0(sizeof(*view));
+	g_mutex_init(&view->mutex);
+
+	return view;
+}
+
+SR_PRIV void sr_analog_float_view_free(struct sr_analog_float_view *view)
+{
+	if (!view)
+		return;
+
+	g_mutex_clear(&view->mutex);
+	g_free(view->buf);
+	g_free(view);
+}
+
+SR_PRIV void sr_analog_float_view_begin(struct sr_analog_float_view *view,
+		const struct sr_datafeed_analog *analog)
+{
+	view->analog = analog;
+	view->done = FALSE;
+	view->values = NULL;
+
+	g_mutex_lock(&float_views_mutex);
+	float_views = g_slist_prepend(float_views, view);
+	g_mutex_unlock(&float_views_mutex);
+}
+
+SR_PRIV void sr_analog_float_view_end(struct sr_analog_float_view *view)
+{
+	g_mutex_lock(&float_views_mutex);
+	float_views = g_slist_remove(float_views, view);
+	g_mutex_unlock(&float_views_mutex);
+
+	view->analog = NULL;
+}
+
+/* Native floats without scale/offset need no conversion at all. */
+static gboolean analog_is_native_float(const struct analog_conv *conv)
+{
+#ifdef WORDS_BIGENDIAN
+	if (conv->format != FMT_FLT_BE)
+		return FALSE;
+#else
+	if (conv->format != FMT_FLT_LE)
+		return FALSE;
+#endif
+	if (conv->scale != 1.0 || conv->offset != 0.0)
+		return FALSE;
+
+	return ((uintptr_t)conv->data8 % sizeof(float)) == 0;
+}
+
+static int float_view_fill(struct sr_analog_float_view *view)
+{
+	struct analog_conv conv;
+	int ret;
+
+	ret = analog_conv_init(view->analog, &conv);
+	if (ret != SR_OK)
+		return ret;
+	if (analog_is_native_float(&conv)) {
+		view->values = (const float *)conv.data8;
 		return SR_OK;
 	}
-	if (input_float) {
-		snprintf(type_text, sizeof(type_text), "%c%zu%s",
-			'f', input_unitsize * 8, input_bigendian ? "be" : "le");
-		sr_err("Unsupported type for analog-to-float conversion: %s.",
-			type_text);
-		return SR_ERR;
-	}
 
-	if (input_unitsize == sizeof(uint8_t) && input_signed) {
-		int8_t (*reader)(const uint8_t **p);
-		reader = read_i8_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
-		return SR_OK;
+	if (conv.count > view->buf_size) {
+		g_free(view->buf);
+		view->buf = g_malloc(conv.count * sizeof(view->buf[0]));
+		view->buf_size = conv.count;
 	}
-	if (input_unitsize == sizeof(uint8_t)) {
-		uint8_t (*reader)(const uint8_t **p);
-		reader = read_u8_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
-		return SR_OK;
+	ret = sr_analog_to_float(view->analog, view->buf);
+	if (ret != SR_OK)
+		return ret;
+	view->values = view->buf;
+
+	return SR_OK;
+}
+
+/**
+ * Get an analog datafeed payload as an array of floats, converting it
+ * only once for all consumers.
+ *
+ * Within a session's datafeed callbacks, the first caller converts the
+ * packet, and all callers for the same packet share the result. Native
+ * float values without scale or offset are used in place. Otherwise,
+ * e.g. outside of a session, this works like sr_analog_to_float().
+ *
+ * @param[in] analog The analog payload to convert. Must not be NULL.
+ *                   analog->data, analog->meaning, and analog->encoding
+ *                   must not be NULL.
+ * @param[out] outbuf Memory for the result in case there is no shared
+ *                    one. Must not be NULL.
+ * @param[out] values Where to store the pointer to the float values,
+ *                    which stay valid until the callback returns. Points
+ *                    to @p outbuf upon errors. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_analog_to_float_view(const struct sr_datafeed_analog *analog,
+		float *outbuf, const float **values)
+{
+	struct sr_analog_float_view *view;
+	struct analog_conv conv;
+	GSList *l;
+	int ret;
+
+	if (!analog || !outbuf || !values)
+		return SR_ERR_ARG;
+	*values = outbuf;
+
+	view = NULL;
+	g_mutex_lock(&float_views_mutex);
+	for (l = float_views; l; l = l->next) {
+		view = l->data;
+		if (view->analog == analog)
+			break;
+		view = NULL;
 	}
-	if (input_unitsize == sizeof(uint16_t) && input_signed) {
-		int16_t (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_i16be_inc;
-		else
-			reader = read_i16le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
+	g_mutex_unlock(&float_views_mutex);
+
+	if (view) {
+		g_mutex_lock(&view->mutex);
+		if (!view->done) {
+			view->ret = float_view_fill(view);
+			view->done = TRUE;
 		}
-		return SR_OK;
+		ret = view->ret;
+		if (ret == SR_OK)
+			*values = view->values;
+		g_mutex_unlock(&view->mutex);
+		return ret;
 	}
-	if (input_unitsize == sizeof(uint16_t)) {
-		uint16_t (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_u16be_inc;
-		else
-			reader = read_u16le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+
+	ret = analog_conv_init(analog, &conv);
+	if (ret != SR_OK)
+		return ret;
+	if (analog_is_native_float(&conv)) {
+		*values = (const float *)conv.data8;
 		return SR_OK;
 	}
-	if (input_unitsize == sizeof(uint32_t) && input_signed) {
-		int32_t (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_i32be_inc;
-		else
-			reader = read_i32le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+
+	return sr_analog_to_float(analog, outbuf);
+}
+
+/**
+ * Convert an analog datafeed payload to one array of floats per channel.
+ *
+ * The payload's values are interleaved, one value for every channel
+ * in analog->meaning->channels per sample. This routine deinterleaves
+ * them while converting, in a single pass over the input data.
+ *
+ * @param[in] analog The analog payload to convert. Must not be NULL.
+ *                   analog->data, analog->meaning, and analog->encoding
+ *                   must not be NULL.
+ * @param[out] outbufs Array of one buffer per channel, in the order of
+ *                     analog->meaning->channels, which each receive
+ *                     analog->num_samples values. Must not be NULL.
+ *                     Entries may be NULL to skip a channel.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_analog_to_float_channels(const struct sr_datafeed_analog *analog,
+		float *const *outbufs)
+{
+	struct analog_conv conv;
+	double block[CONVERT_BLOCK_SIZE];
+	size_t num_channels, block_samples, sample, count, n, i, ch;
+	const double *rp;
+	int ret;
+
+	if (!outbufs)
+		return SR_ERR_ARG;
+	ret = analog_conv_init(analog, &conv);
+	if (ret != SR_OK)
+		return ret;
+
+	num_channels = conv.num_channels;
+	if (!num_channels)
 		return SR_OK;
+	if (num_channels > CONVERT_BLOCK_SIZE) {
+		sr_err("Too many channels for analog conversion: %zu.",
+			num_channels);
+		return SR_ERR_ARG;
 	}
-	if (input_unitsize == sizeof(uint32_t)) {
-		uint32_t (*reader)(const uint8_t **p);
-		if (input_bigendian)
-			reader = read_u32be_inc;
-		else
-			reader = read_u32le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
+
+	/* Convert blocks of whole samples, then spread their values. */
+	block_samples = CONVERT_BLOCK_SIZE / num_channels;
+	sample = 0;
+	for (count = analog->num_samples; count; count -= n) {
+		n = MIN(count, block_samples);
+		analog_conv_run(&conv, conv.data8, n * num_channels, block);
+		for (ch = 0; ch < num_channels; ch++) {
+			if (!outbufs[ch])
+				continue;
+			rp = &block[ch];
+			for (i = 0; i < n; i++) {
+				outbufs[ch][sample + i] = *rp;
+				rp += num_channels;
+			}
 		}
-		return SR_OK;
+		conv.data8 += n * num_channels * conv.unitsize;
+		sample += n;
 	}
-	snprintf(type_text, sizeof(type_text), "%c%zu%s",
-		input_float ? 'f' : input_signed ? 'i' : 'u',
-		input_unitsize * 8, input_bigendian ? "be" : "le");
-	sr_err("Unsupported type for analog-to-float conversion: %s.",
-		type_text);
-	return SR_ERR;
+
+	return SR_OK;
 }
 
 /**
@@ -516,17 +826,51 @@ SR_API void sr_rational_set(struct sr_rational *r, int64_t p, uint64_t q)
 	r->q = q;
 }
 
+/**
+ * Set sr_rational r to a floating point value.
+ *
+ * Drivers use this to put a device's gain and offset into the encoding
+ * of integer samples, leaving the conversion to sr_analog_to_float().
+ * Seven significant digits are kept, the precision of a float.
+ *
+ * @param[out] r Rational number struct to set. Must not be NULL.
+ * @param[in] value The value.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR The value can't be represented, r is set to 0.
+ *
+ * @private
+ */
+SR_PRIV int sr_rational_from_float(struct sr_rational *r, double value)
+{
+	char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (value == 0.0) {
+		sr_rational_set(r, 0, 1);
+		return SR_OK;
+	}
+
+	/* Keep the numerator and the denominator within 64 bits. */
+	if ((value > -1e-12 && value < 1e-12) || value >= 1e12 || value <= -1e12) {
+		sr_rational_set(r, 0, 1);
+		return SR_ERR;
+	}
+
+	g_ascii_formatd(buf, sizeof(buf), "%.6e", value);
+	if (sr_parse_rational(buf, r) != SR_OK) {
+		sr_rational_set(r, 0, 1);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
 #ifndef HAVE___INT128_T
 struct sr_int128_t {
 	int64_t high;
 	uint64_t low;
 };
 
-struct sr_uint128_t {
-	uint64_t high;
-	uint64_t low;
-};
-
 static void mult_int64(struct sr_int128_t *res, const int64_t a,
 	const int64_t b)
 {
@@ -542,24 +886,33 @@ static void mult_int64(struct sr_int128_t *res, const int64_t a,
 	res->high >>= 32;
 	res->high += ((int64_t)t2 >> 32) + ((int64_t)t3 >> 32) + t4;
 }
+#endif
 
-static void mult_uint64(struct sr_uint128_t *res, const uint64_t a,
-	const uint64_t b)
+/* Greatest common divisor, gcd(0, b) is b. */
+static uint64_t gcd_u64(uint64_t a, uint64_t b)
 {
-	uint64_t t1, t2, t3, t4;
+	uint64_t t;
 
-	// (x1 + x2) * (y1 + y2) = x1*y1 + x1*y2 + x2*y1 + x2*y2
-	t1 = (UINT32_MAX & a) * (UINT32_MAX & b);
-	t2 = (UINT32_MAX & a) * (b >> 32);
-	t3 = (a >> 32) * (UINT32_MAX & b);
-	t4 = (a >> 32) * (b >> 32);
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
 
-	res->low = t1 + (t2 << 32) + (t3 << 32);
-	res->high = (t1 >> 32) + (uint64_t)((uint32_t)(t2)) + (uint64_t)((uint32_t)(t3));
-	res->high >>= 32;
-	res->high += ((int64_t)t2 >> 32) + ((int64_t)t3 >> 32) + t4;
+	return a;
+}
+
+/* Divide two values by their common factors. */
+static void cancel_u64(uint64_t *a, uint64_t *b)
+{
+	uint64_t g;
+
+	g = gcd_u64(*a, *b);
+	if (g > 1) {
+		*a /= g;
+		*b /= g;
+	}
 }
-#endif
 
 /**
  * Compare two sr_rational for equality.
@@ -578,7 +931,15 @@ SR_API int sr_rational_eq(const struct sr_rational *a, const struct sr_rational
 {
 #ifdef HAVE___INT128_T
 	__int128_t m1, m2;
+#else
+	struct sr_int128_t m1, m2;
+#endif
+
+	/* Scale factors mostly get compared to copies of themselves. */
+	if (a->p == b->p && a->q == b->q)
+		return 1;
 
+#ifdef HAVE___INT128_T
 	/* p1/q1 = p2/q2  <=>  p1*q2 = p2*q1 */
 	m1 = ((__int128_t)(b->p)) * ((__uint128_t)a->q);
 	m2 = ((__int128_t)(a->p)) * ((__uint128_t)b->q);
@@ -586,8 +947,6 @@ SR_API int sr_rational_eq(const struct sr_rational *a, const struct sr_rational
 	return (m1 == m2);
 
 #else
-	struct sr_int128_t m1, m2;
-
 	mult_int64(&m1, a->q, b->p);
 	mult_int64(&m2, a->p, b->q);
 
@@ -598,9 +957,7 @@ SR_API int sr_rational_eq(const struct sr_rational *a, const struct sr_rational
 /**
  * Multiply two sr_rational.
  *
- * The resulting nominator/denominator are reduced if the result would not fit
- * otherwise. If the resulting nominator/denominator are relatively prime,
- * this may not be possible.
+ * The result is reduced to lowest terms.
  *
  * It is safe to use the same variable for result and input values.
  *
@@ -616,68 +973,57 @@ SR_API int sr_rational_eq(const struct sr_rational *a, const struct sr_rational
 SR_API int sr_rational_mult(struct sr_rational *res, const struct sr_rational *a,
 	const struct sr_rational *b)
 {
+	uint64_t ap, aq, bp, bq, p, q, p_max;
+	gboolean neg;
 #ifdef HAVE___INT128_T
-	__int128_t p;
-	__uint128_t q;
-
-	p = (__int128_t)(a->p) * (__int128_t)(b->p);
-	q = (__uint128_t)(a->q) * (__uint128_t)(b->q);
+	__uint128_t pp, qq;
+#endif
 
-	if ((p > INT64_MAX) || (p < INT64_MIN) || (q > UINT64_MAX)) {
-		while (!((p & 1) || (q & 1))) {
-			p /= 2;
-			q /= 2;
-		}
-	}
+	/*
+	 * Multiply the magnitudes, after cancelling the common factors
+	 * within and across the inputs. The products then are in lowest
+	 * terms, and only overflow when the result cannot be represented.
+	 */
+	neg = (a->p < 0) != (b->p < 0);
+	ap = (a->p < 0) ? -(uint64_t)a->p : (uint64_t)a->p;
+	bp = (b->p < 0) ? -(uint64_t)b->p : (uint64_t)b->p;
+	aq = a->q;
+	bq = b->q;
+	cancel_u64(&ap, &aq);
+	cancel_u64(&bp, &bq);
+	cancel_u64(&ap, &bq);
+	cancel_u64(&bp, &aq);
+	p_max = neg ? (uint64_t)INT64_MAX + 1 : INT64_MAX;
 
-	if ((p > INT64_MAX) || (p < INT64_MIN) || (q > UINT64_MAX)) {
-		// TODO: determine gcd to do further reduction
+#ifdef HAVE___INT128_T
+	pp = (__uint128_t)ap * bp;
+	qq = (__uint128_t)aq * bq;
+	if (pp > p_max || qq > UINT64_MAX)
 		return SR_ERR_ARG;
-	}
-
-	res->p = (int64_t)p;
-	res->q = (uint64_t)q;
-
-	return SR_OK;
-
+	p = pp;
+	q = qq;
 #else
-	struct sr_int128_t p;
-	struct sr_uint128_t q;
-
-	mult_int64(&p, a->p, b->p);
-	mult_uint64(&q, a->q, b->q);
-
-	while (!(p.low & 1) && !(q.low & 1)) {
-		p.low /= 2;
-		if (p.high & 1)
-			p.low |= (1ll << 63);
-		p.high >>= 1;
-		q.low /= 2;
-		if (q.high & 1)
-			q.low |= (1ll << 63);
-		q.high >>= 1;
-	}
-
-	if (q.high)
+	if (ap && bp > UINT64_MAX / ap)
 		return SR_ERR_ARG;
-	if ((p.high >= 0) && (p.low > INT64_MAX))
+	if (aq && bq > UINT64_MAX / aq)
 		return SR_ERR_ARG;
-	if (p.high < -1)
+	p = ap * bp;
+	q = aq * bq;
+	if (p > p_max)
 		return SR_ERR_ARG;
+#endif
 
-	res->p = (int64_t)p.low;
-	res->q = q.low;
+	/* Negate without overflow, the magnitude can be 2^63. */
+	res->p = (neg && p) ? -(int64_t)(p - 1) - 1 : (int64_t)p;
+	res->q = q;
 
 	return SR_OK;
-#endif
 }
 
 /**
  * Divide rational a by rational b.
  *
- * The resulting nominator/denominator are reduced if the result would not fit
- * otherwise. If the resulting nominator/denominator are relatively prime,
- * this may not be possible.
+ * The result is reduced to lowest terms.
  *
  * It is safe to use the same variable for result and input values.
  *
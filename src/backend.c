@@ -538,11 +538,91 @@ static int sanity_check_all_transform_modules(void)
 	return ret;
 }
 
+/**
+ * Initialize the USB and HID support of a libsigrok context.
+ *
+ * Runs as part of sr_init(), or upon the first sr_driver_init() call
+ * for contexts which were created with the SR_INIT_LAZY flag. Does
+ * nothing when the context's backends are initialized already.
+ *
+ * @param ctx Pointer to a libsigrok context struct. Must not be NULL.
+ *
+ * @return SR_OK upon success, SR_ERR upon failure.
+ *
+ * @private
+ */
+SR_PRIV int sr_backends_init(struct sr_context *ctx)
+{
+	int ret;
+
+	if (ctx->backends_ready)
+		return SR_OK;
+
+	(void)ret;
+#ifdef HAVE_LIBUSB_1_0
+	ret = libusb_init(&ctx->libusb_ctx);
+	if (LIBUSB_SUCCESS != ret) {
+		sr_err("libusb_init() returned %s.", libusb_error_name(ret));
+		ctx->libusb_ctx = NULL;
+		return SR_ERR;
+	}
+	ret = sr_usb_events_init(ctx,
+		(ctx->init_flags & (SR_INIT_USB_EVENT_THREAD
+			| SR_INIT_USB_EVENT_REALTIME)) != 0,
+		(ctx->init_flags & SR_INIT_USB_EVENT_REALTIME) != 0);
+	if (ret != SR_OK) {
+		libusb_exit(ctx->libusb_ctx);
+		ctx->libusb_ctx = NULL;
+		return SR_ERR;
+	}
+#endif
+#ifdef HAVE_LIBHIDAPI
+	/*
+	 * According to <hidapi.h>, the hid_init() routine just returns
+	 * zero or non-zero, and hid_error() appears to relate to calls
+	 * for a specific device after hid_open(). Which means that there
+	 * is no more detailled information available beyond success/fail
+	 * at this point in time.
+	 */
+	if (hid_init() != 0) {
+		sr_err("HIDAPI hid_init() failed.");
+#ifdef HAVE_LIBUSB_1_0
+		sr_usb_events_exit(ctx);
+		libusb_exit(ctx->libusb_ctx);
+		ctx->libusb_ctx = NULL;
+#endif
+		return SR_ERR;
+	}
+#endif
+	ctx->backends_ready = TRUE;
+
+	return SR_OK;
+}
+
+static void backends_exit(struct sr_context *ctx)
+{
+	if (!ctx->backends_ready)
+		return;
+
+#ifdef HAVE_LIBHIDAPI
+	hid_exit();
+#endif
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_renum_unwatch(ctx);
+	sr_usb_events_exit(ctx);
+	libusb_exit(ctx->libusb_ctx);
+	ctx->libusb_ctx = NULL;
+#endif
+	ctx->backends_ready = FALSE;
+}
+
 /**
  * Initialize libsigrok.
  *
  * This function must be called before any other libsigrok function.
  *
+ * This is equivalent to sr_init_ex() with the SR_INIT_SANITY_CHECKS flag.
+ *
  * @param ctx Pointer to a libsigrok context struct pointer. Must not be NULL.
  *            This will be a pointer to a newly allocated libsigrok context
  *            object upon success, and is undefined upon errors.
@@ -555,6 +635,43 @@ static int sanity_check_all_transform_modules(void)
  * @since 0.2.0
  */
 SR_API int sr_init(struct sr_context **ctx)
+{
+	return sr_init_ex(ctx, SR_INIT_SANITY_CHECKS);
+}
+
+/**
+ * Initialize libsigrok, with control over the startup cost.
+ *
+ * Without the SR_INIT_SANITY_CHECKS flag the consistency checks of all
+ * compiled-in drivers and modules are skipped. They only catch
+ * programming errors in libsigrok itself, and are best left to
+ * development builds and test suites. With the SR_INIT_LAZY flag the
+ * USB and HID support gets initialized when the first driver gets
+ * initialized.
+ *
+ * Sessions of one context may run concurrently, each in a thread of
+ * its own. All USB devices of a context share one libusb context though,
+ * and without the SR_INIT_USB_EVENT_THREAD flag the main loop of each
+ * running session polls its file descriptors. With the flag, a single
+ * thread of the context handles the USB events of all sessions, and the
+ * sessions' main loops only run the drivers' timeouts and transfer
+ * callbacks, which the thread hands over to them. The
+ * SR_INIT_USB_EVENT_REALTIME flag additionally gives that thread
+ * real-time priority.
+ *
+ * @param ctx Pointer to a libsigrok context struct pointer. Must not be NULL.
+ *            This will be a pointer to a newly allocated libsigrok context
+ *            object upon success, and is undefined upon errors.
+ * @param flags A bitwise combination of enum sr_init_flags values.
+ *
+ * @return SR_OK upon success, a (negative) error code otherwise. Upon errors
+ *         the 'ctx' pointer is undefined and should not be used. Upon success,
+ *         the context will be free'd by sr_exit() as part of the libsigrok
+ *         shutdown.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_init_ex(struct sr_context **ctx, unsigned int flags)
 {
 	int ret = SR_ERR;
 	struct sr_context *context;
@@ -571,28 +688,37 @@ SR_API int sr_init(struct sr_context **ctx)
 		return SR_ERR;
 	}
 
+	sr_trace_init();
+	sr_cpu_init();
+
 	context = g_malloc0(sizeof(struct sr_context));
+	context->init_flags = flags;
+	g_mutex_init(&context->resource_cache_lock);
+	g_mutex_init(&context->scpi_idn_cache_lock);
+	context->buffer_pool = sr_buffer_pool_new();
 
 	sr_drivers_init(context);
 
-	if (sanity_check_all_drivers(context) < 0) {
-		sr_err("Internal driver error(s), aborting.");
-		goto done;
-	}
+	if (flags & SR_INIT_SANITY_CHECKS) {
+		if (sanity_check_all_drivers(context) < 0) {
+			sr_err("Internal driver error(s), aborting.");
+			goto done;
+		}
 
-	if (sanity_check_all_input_modules() < 0) {
-		sr_err("Internal input module error(s), aborting.");
-		goto done;
-	}
+		if (sanity_check_all_input_modules() < 0) {
+			sr_err("Internal input module error(s), aborting.");
+			goto done;
+		}
 
-	if (sanity_check_all_output_modules() < 0) {
-		sr_err("Internal output module error(s), aborting.");
-		goto done;
-	}
+		if (sanity_check_all_output_modules() < 0) {
+			sr_err("Internal output module error(s), aborting.");
+			goto done;
+		}
 
-	if (sanity_check_all_transform_modules() < 0) {
-		sr_err("Internal transform module error(s), aborting.");
-		goto done;
+		if (sanity_check_all_transform_modules() < 0) {
+			sr_err("Internal transform module error(s), aborting.");
+			goto done;
+		}
 	}
 
 #ifdef _WIN32
@@ -611,28 +737,11 @@ SR_API int sr_init(struct sr_context **ctx)
 		goto done;
 	}
 
-#ifdef HAVE_LIBUSB_1_0
-	ret = libusb_init(&context->libusb_ctx);
-	if (LIBUSB_SUCCESS != ret) {
-		sr_err("libusb_init() returned %s.", libusb_error_name(ret));
-		ret = SR_ERR;
-		goto done;
-	}
-#endif
-#ifdef HAVE_LIBHIDAPI
-	/*
-	 * According to <hidapi.h>, the hid_init() routine just returns
-	 * zero or non-zero, and hid_error() appears to relate to calls
-	 * for a specific device after hid_open(). Which means that there
-	 * is no more detailled information available beyond success/fail
-	 * at this point in time.
-	 */
-	if (hid_init() != 0) {
-		sr_err("HIDAPI hid_init() failed.");
-		ret = SR_ERR;
-		goto done;
+	if (!(flags & SR_INIT_LAZY)) {
+		ret = sr_backends_init(context);
+		if (ret != SR_OK)
+			goto done;
 	}
-#endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
 	*ctx = context;
@@ -640,6 +749,13 @@ SR_API int sr_init(struct sr_context **ctx)
 	ret = SR_OK;
 
 done:
+	if (context) {
+		g_mutex_clear(&context->resource_cache_lock);
+		g_mutex_clear(&context->scpi_idn_cache_lock);
+		sr_buffer_pool_release(context->buffer_pool);
+		g_free(context->driver_list);
+		sr_trace_exit();
+	}
 	g_free(context);
 	return ret;
 }
@@ -667,16 +783,21 @@ SR_API int sr_exit(struct sr_context *ctx)
 	WSACleanup();
 #endif
 
-#ifdef HAVE_LIBHIDAPI
-	hid_exit();
-#endif
-#ifdef HAVE_LIBUSB_1_0
-	libusb_exit(ctx->libusb_ctx);
-#endif
+	backends_exit(ctx);
+
+	if (ctx->resource_cache)
+		g_hash_table_destroy(ctx->resource_cache);
+	g_mutex_clear(&ctx->resource_cache_lock);
+	if (ctx->scpi_idn_cache)
+		g_hash_table_destroy(ctx->scpi_idn_cache);
+	g_mutex_clear(&ctx->scpi_idn_cache_lock);
+	sr_buffer_pool_release(ctx->buffer_pool);
 
 	g_free(sr_driver_list(ctx));
 	g_free(ctx);
 
+	sr_trace_exit();
+
 	return SR_OK;
 }
 
@@ -96,6 +96,24 @@
 #define CONNECT_RFCOMM_TRIES	3
 #define CONNECT_RFCOMM_RETRY_MS	100
 
+/*
+ * BLE link tuning after connect. Ask for a larger ATT MTU, and shorter
+ * connection intervals (units of 1.25ms, supervision timeout in units
+ * of 10ms), so that meters can send more notifications per second.
+ * Peers and adapters are free to reject either, which is not fatal.
+ */
+#define BLE_ATT_MTU_DEFAULT	23
+#define BLE_ATT_MTU_WANT	247
+#define BLE_ATT_MTU_TIMEOUT_MS	1000
+#define BLE_CONN_INTERVAL_MIN	6
+#define BLE_CONN_INTERVAL_MAX	12
+#define BLE_CONN_LATENCY	0
+#define BLE_CONN_SUPERVISION	200
+#define BLE_CONN_UPDATE_TO_MS	2000
+
+/* Maximum number of ATT messages which one notify check handles. */
+#define CHECK_NOTIFY_BATCH	32
+
 /* Silence warning about (currently) unused routine. */
 #define WITH_WRITE_TYPE_HANDLE	0
 
@@ -242,6 +260,7 @@ struct sr_bt_desc {
 	/* Internal state. */
 	int devid;
 	int fd;
+	uint16_t att_mtu;
 	struct hci_filter orig_filter;
 };
 
@@ -268,6 +287,7 @@ SR_PRIV struct sr_bt_desc *sr_bt_desc_new(void)
 
 	desc->devid = -1;
 	desc->fd = -1;
+	desc->att_mtu = BLE_ATT_MTU_DEFAULT;
 
 	return desc;
 }
@@ -657,6 +677,100 @@ SR_PRIV int sr_bt_scan_bt(struct sr_bt_desc *desc, int duration)
 /* }}} scan */
 /* {{{ connect/disconnect */
 
+/*
+ * Negotiate a larger ATT MTU. Is run before notifications get enabled,
+ * so the response is the only message to expect.
+ */
+static void sr_bt_exchange_mtu(struct sr_bt_desc *desc)
+{
+	uint8_t buf[sizeof(uint8_t) + sizeof(uint16_t)];
+	uint8_t rx_buf[64];
+	struct pollfd fds[1];
+	gint64 deadline, now;
+	ssize_t rdlen;
+	uint16_t server_mtu;
+	int ret;
+
+	buf[0] = BLE_ATT_EXCHANGE_MTU_REQ;
+	write_u16le(&buf[1], BLE_ATT_MTU_WANT);
+	if (write(desc->fd, buf, sizeof(buf)) != sizeof(buf)) {
+		sr_dbg("Cannot send MTU exchange request.");
+		return;
+	}
+
+	deadline = g_get_monotonic_time() + BLE_ATT_MTU_TIMEOUT_MS * 1000;
+	while ((now = g_get_monotonic_time()) < deadline) {
+		memset(fds, 0, sizeof(fds));
+		fds[0].fd = desc->fd;
+		fds[0].events = POLLIN;
+		ret = poll(fds, ARRAY_SIZE(fds), (deadline - now) / 1000 + 1);
+		if (ret <= 0 || !(fds[0].revents & POLLIN))
+			continue;
+		rdlen = read(desc->fd, rx_buf, sizeof(rx_buf));
+		if (rdlen < 1)
+			break;
+		if (rx_buf[0] == BLE_ATT_ERROR_RESP) {
+			sr_dbg("Peer rejected MTU exchange.");
+			return;
+		}
+		if (rx_buf[0] != BLE_ATT_EXCHANGE_MTU_RESP || rdlen < 3)
+			continue;
+		server_mtu = bt_get_le16(&rx_buf[1]);
+		desc->att_mtu = MIN(server_mtu, BLE_ATT_MTU_WANT);
+		desc->att_mtu = MAX(desc->att_mtu, BLE_ATT_MTU_DEFAULT);
+		sr_dbg("ATT MTU is %u (peer %u).", desc->att_mtu, server_mtu);
+		return;
+	}
+	sr_dbg("No MTU exchange response, keeping ATT MTU %u.",
+		desc->att_mtu);
+}
+
+/*
+ * Ask the controller for shorter connection intervals. Depends on the
+ * permission to send HCI commands, the default parameters remain in
+ * effect when this fails.
+ */
+static void sr_bt_update_conn_params(struct sr_bt_desc *desc)
+{
+	struct l2cap_conninfo info;
+	socklen_t info_len;
+	bdaddr_t mac;
+	int id, dd, ret;
+
+	info_len = sizeof(info);
+	memset(&info, 0, sizeof(info));
+	ret = getsockopt(desc->fd, SOL_L2CAP, L2CAP_CONNINFO, &info, &info_len);
+	if (ret < 0) {
+		sr_dbg("Cannot get BLE connection handle.");
+		return;
+	}
+
+	if (desc->local_addr[0]) {
+		id = hci_devid(desc->local_addr);
+	} else {
+		str2ba(desc->remote_addr, &mac);
+		id = hci_get_route(&mac);
+	}
+	if (id < 0)
+		return;
+	dd = hci_open_dev(id);
+	if (dd < 0) {
+		sr_dbg("Cannot open HCI device for connection update.");
+		return;
+	}
+	ret = hci_le_conn_update(dd, htobs(info.hci_handle),
+		htobs(BLE_CONN_INTERVAL_MIN), htobs(BLE_CONN_INTERVAL_MAX),
+		htobs(BLE_CONN_LATENCY), htobs(BLE_CONN_SUPERVISION),
+		BLE_CONN_UPDATE_TO_MS);
+	if (ret < 0)
+		sr_dbg("BLE connection parameter update failed: %s.",
+			g_strerror(errno));
+	else
+		sr_dbg("BLE connection interval %.2f..%.2fms.",
+			BLE_CONN_INTERVAL_MIN * 1.25, BLE_CONN_INTERVAL_MAX * 1.25);
+	hci_close_dev(dd);
+}
+
 SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 {
 	struct sockaddr_l2 sl2;
@@ -784,6 +898,9 @@ SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 		return ret;
 	}
 
+	sr_bt_exchange_mtu(desc);
+	sr_bt_update_conn_params(desc);
+
 	return 0;
 }
 
@@ -898,14 +1015,22 @@ SR_PRIV int sr_bt_start_notify(struct sr_bt_desc *desc)
 	return 0;
 }
 
+/*
+ * Handle the ATT messages which the socket has pending, up to a batch
+ * limit. Notification payloads get collected and are passed to the
+ * data callback at once, instead of one call per notification.
+ */
 SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 {
 	uint8_t buf[1024];
+	uint8_t batch[CHECK_NOTIFY_BATCH * 64];
+	size_t batch_len, msg_count;
 	ssize_t rdlen;
 	uint8_t packet_type;
 	uint16_t packet_handle;
 	uint8_t *packet_data;
 	size_t packet_dlen;
+	int ret, rc;
 
 	if (!desc)
 		return -1;
@@ -913,61 +1038,92 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 	if (sr_bt_check_socket_usable(desc) < 0)
 		return -2;
 
-	/* Get another message from the Bluetooth socket. */
-	rdlen = sr_bt_read(desc, buf, sizeof(buf));
-	if (rdlen < 0)
-		return -2;
-	if (!rdlen)
-		return 0;
+	ret = 0;
+	batch_len = 0;
+	for (msg_count = 0; msg_count < CHECK_NOTIFY_BATCH; msg_count++) {
+		/* Get another message from the Bluetooth socket. */
+		rdlen = sr_bt_read(desc, buf, sizeof(buf));
+		if (rdlen < 0) {
+			ret = -2;
+			break;
+		}
+		if (!rdlen)
+			break;
 
-	/* Get header fields and references to the payload data. */
-	packet_type = 0x00;
-	packet_handle = 0x0000;
-	packet_data = NULL;
-	packet_dlen = 0;
-	if (rdlen >= 1)
-		packet_type = buf[0];
-	if (rdlen >= 3) {
-		packet_handle = bt_get_le16(&buf[1]);
-		packet_data = &buf[3];
-		packet_dlen = rdlen - 3;
-	}
+		/* Get header fields and references to the payload data. */
+		packet_type = 0x00;
+		packet_handle = 0x0000;
+		packet_data = NULL;
+		packet_dlen = 0;
+		if (rdlen >= 1)
+			packet_type = buf[0];
+		if (rdlen >= 3) {
+			packet_handle = bt_get_le16(&buf[1]);
+			packet_data = &buf[3];
+			packet_dlen = rdlen - 3;
+		}
 
-	/* Dispatch according to the message type. */
-	switch (packet_type) {
-	case BLE_ATT_ERROR_RESP:
-		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "error response");
-		/* EMPTY */
-		break;
-	case BLE_ATT_WRITE_RESP:
-		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "write response");
-		/* EMPTY */
-		break;
-	case BLE_ATT_HANDLE_INDICATION:
-		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle indication");
-		sr_bt_write_type(desc, BLE_ATT_HANDLE_CONFIRMATION);
-		if (packet_handle != desc->read_handle)
-			return -4;
-		if (!packet_data)
-			return -4;
-		if (!desc->data_cb)
-			return 0;
-		return desc->data_cb(desc->data_cb_data, packet_data, packet_dlen);
-	case BLE_ATT_HANDLE_NOTIFICATION:
-		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle notification");
-		if (packet_handle != desc->read_handle)
-			return -4;
-		if (!packet_data)
-			return -4;
+		/* Dispatch according to the message type. */
+		switch (packet_type) {
+		case BLE_ATT_ERROR_RESP:
+			sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "error response");
+			/* EMPTY */
+			continue;
+		case BLE_ATT_WRITE_RESP:
+			sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "write response");
+			/* EMPTY */
+			continue;
+		case BLE_ATT_HANDLE_INDICATION:
+			sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle indication");
+			sr_bt_write_type(desc, BLE_ATT_HANDLE_CONFIRMATION);
+			break;
+		case BLE_ATT_HANDLE_NOTIFICATION:
+			sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle notification");
+			break;
+		default:
+			sr_spew("unsupported type 0x%02x", packet_type);
+			ret = -3;
+			break;
+		}
+		if (ret)
+			break;
+		if (packet_handle != desc->read_handle || !packet_data) {
+			ret = -4;
+			break;
+		}
 		if (!desc->data_cb)
-			return 0;
-		return desc->data_cb(desc->data_cb_data, packet_data, packet_dlen);
-	default:
-		sr_spew("unsupported type 0x%02x", packet_type);
-		return -3;
+			continue;
+
+		/* Collect the payload, pass it on when the batch is full. */
+		if (batch_len + packet_dlen > sizeof(batch)) {
+			rc = desc->data_cb(desc->data_cb_data, batch, batch_len);
+			batch_len = 0;
+			if (rc) {
+				ret = rc;
+				break;
+			}
+		}
+		if (packet_dlen > sizeof(batch)) {
+			rc = desc->data_cb(desc->data_cb_data,
+				packet_data, packet_dlen);
+			if (rc) {
+				ret = rc;
+				break;
+			}
+			continue;
+		}
+		memcpy(&batch[batch_len], packet_data, packet_dlen);
+		batch_len += packet_dlen;
 	}
 
-	return 0;
+	/* Deliver what was collected, even when a later message failed. */
+	if (batch_len && desc->data_cb) {
+		rc = desc->data_cb(desc->data_cb_data, batch, batch_len);
+		if (rc && !ret)
+			ret = rc;
+	}
+
+	return ret;
 }
 
 /* }}} indication/notification */
@@ -0,0 +1,441 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "buffer-pool"
+
+/**
+ * @file
+ *
+ * Pooled allocation of transfer and conversion buffers.
+ *
+ * Buffers get rounded up to a power of two size class, and go back to
+ * their class' free list when released, so that acquisitions which run
+ * for a long time or get repeated don't keep going to the allocator for
+ * the same few sizes. Each class keeps at most POOL_CLASS_CACHE bytes.
+ * Larger requests than the largest class get allocated and released
+ * directly.
+ *
+ * Every context has a pool, code without a context (output and
+ * transform modules, sr_datafeed_buffer_new()) shares a process-wide
+ * one. A buffer remembers its pool, it can be released from any thread.
+ *
+ * The memory is aligned to POOL_ALIGN bytes, a cache line. With the
+ * SIGROK_HUGEPAGES environment variable set, buffers of a huge page and
+ * larger get mapped separately and advised to use transparent huge pages
+ * (Linux only). SIGROK_HUGEPAGES=explicit tries the huge pages which the
+ * administrator reserved (hugetlbfs) first.
+ *
+ * Buffers for a given NUMA node, e.g. the one of the USB host controller
+ * which fills them, get mapped separately as well, and the kernel gets
+ * asked to place their pages on that node. These don't get pooled.
+ */
+
+#define POOL_ALIGN 64
+#define POOL_MIN_SHIFT 10
+#define POOL_MAX_SHIFT 26
+#define POOL_NUM_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_CLASS_CACHE (32 * 1024 * 1024)
+#define POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+#define POOL_HAVE_MMAP 1
+#endif
+
+#if defined(__linux__) && defined(SYS_mbind)
+#define POOL_HAVE_MBIND 1
+/* MPOL_PREFERRED from <linux/mempolicy.h>, which not all systems ship. */
+#define POOL_MPOL_PREFERRED 1
+#define POOL_MAX_NODES 256
+#endif
+
+enum {
+	HUGEPAGES_OFF,
+	HUGEPAGES_TRANSPARENT,
+	HUGEPAGES_EXPLICIT,
+};
+
+/* Lives right before the buffer memory. */
+struct pool_block {
+	struct sr_buffer_pool *pool;
+	struct pool_block *next;
+	/* Start of the allocation or mapping. */
+	void *base;
+	/* Usable size, the class size for pooled blocks. */
+	size_t size;
+	/* Length of the mapping, for mapped blocks. */
+	size_t map_size;
+	/* Size class, -1 for blocks which don't get pooled. */
+	int cls;
+	gboolean mapped;
+};
+
+G_STATIC_ASSERT(sizeof(struct pool_block) <= POOL_ALIGN);
+
+struct sr_buffer_pool {
+	GMutex mutex;
+	struct pool_block *free[POOL_NUM_CLASSES];
+	size_t num_free[POOL_NUM_CLASSES];
+	/* Blocks handed out and not yet released. */
+	size_t outstanding;
+	/* The owner is gone, free the pool with the last block. */
+	gboolean released;
+	int hugepages;
+};
+
+static int size_class(size_t size)
+{
+	int shift;
+
+	for (shift = POOL_MIN_SHIFT; shift <= POOL_MAX_SHIFT; shift++) {
+		if (size <= (size_t)1 << shift)
+			return shift - POOL_MIN_SHIFT;
+	}
+
+	return -1;
+}
+
+#ifdef POOL_HAVE_MBIND
+static void bind_node(void *addr, size_t len, int node)
+{
+	unsigned long mask[POOL_MAX_NODES / (8 * sizeof(unsigned long))];
+
+	if (node >= POOL_MAX_NODES)
+		return;
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8 * sizeof(mask[0]))] |=
+		1UL << (node % (8 * sizeof(mask[0])));
+	if (syscall(SYS_mbind, addr, len, POOL_MPOL_PREFERRED, mask,
+			POOL_MAX_NODES + 1, 0) != 0)
+		sr_dbg("Cannot bind buffer to NUMA node %d: %s.", node,
+			g_strerror(errno));
+}
+#endif
+
+#ifdef POOL_HAVE_MMAP
+static struct pool_block *block_map(struct sr_buffer_pool *pool,
+		size_t size, int node)
+{
+	struct pool_block *block;
+	uint8_t *base;
+	size_t map_size;
+	int hugepages;
+
+	hugepages = size >= POOL_HUGEPAGE_SIZE ? pool->hugepages : HUGEPAGES_OFF;
+	map_size = size + POOL_ALIGN;
+	base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (hugepages == HUGEPAGES_EXPLICIT) {
+		map_size += POOL_HUGEPAGE_SIZE - 1;
+		map_size &= ~(size_t)(POOL_HUGEPAGE_SIZE - 1);
+		base = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (base == MAP_FAILED) {
+			sr_dbg("No reserved huge pages for %zu bytes.", size);
+			map_size = size + POOL_ALIGN;
+		} else {
+			hugepages = HUGEPAGES_OFF;
+		}
+	}
+#endif
+
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			sr_dbg("Cannot map %zu bytes, falling back to malloc.",
+				size);
+			return NULL;
+		}
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (hugepages != HUGEPAGES_OFF)
+		madvise(base, map_size, MADV_HUGEPAGE);
+#endif
+#ifdef POOL_HAVE_MBIND
+	/* Before the first touch, which is when the pages get placed. */
+	if (node >= 0)
+		bind_node(base, map_size, node);
+#else
+	(void)node;
+#endif
+
+	block = (struct pool_block *)(base + POOL_ALIGN) - 1;
+	block->base = base;
+	block->map_size = map_size;
+	block->mapped = TRUE;
+
+	return block;
+}
+#endif
+
+static struct pool_block *block_new(struct sr_buffer_pool *pool,
+		size_t size, int cls, int node)
+{
+	struct pool_block *block;
+	uint8_t *base;
+	uintptr_t data;
+
+	block = NULL;
+#ifdef POOL_HAVE_MMAP
+	if (node >= 0 || (pool->hugepages && size >= POOL_HUGEPAGE_SIZE))
+		block = block_map(pool, size, node);
+#else
+	(void)node;
+#endif
+
+	if (!block) {
+		base = g_try_malloc(size + sizeof(*block) + POOL_ALIGN - 1);
+		if (!base)
+			return NULL;
+		data = (uintptr_t)(base + sizeof(*block));
+		data = (data + POOL_ALIGN - 1) & ~(uintptr_t)(POOL_ALIGN - 1);
+		block = (struct pool_block *)data - 1;
+		block->base = base;
+		block->map_size = 0;
+		block->mapped = FALSE;
+	}
+
+	block->pool = pool;
+	block->next = NULL;
+	block->size = size;
+	block->cls = cls;
+
+	return block;
+}
+
+static void block_free(struct pool_block *block)
+{
+#ifdef POOL_HAVE_MMAP
+	if (block->mapped) {
+		munmap(block->base, block->map_size);
+		return;
+	}
+#endif
+	g_free(block->base);
+}
+
+static void pool_destroy(struct sr_buffer_pool *pool)
+{
+	g_mutex_clear(&pool->mutex);
+	g_free(pool);
+}
+
+/**
+ * Create a buffer pool.
+ *
+ * @return The new pool.
+ *
+ * @private
+ */
+SR_PRIV struct sr_buffer_pool *sr_buffer_pool_new(void)
+{
+	struct sr_buffer_pool *pool;
+	const char *hugepages;
+
+	pool = g_malloc0(sizeof(*pool));
+	g_mutex_init(&pool->mutex);
+#ifdef POOL_HAVE_MMAP
+	hugepages = g_getenv("SIGROK_HUGEPAGES");
+	if (hugepages && g_ascii_strcasecmp(hugepages, "explicit") == 0)
+		pool->hugepages = HUGEPAGES_EXPLICIT;
+	else if (hugepages && *hugepages)
+		pool->hugepages = HUGEPAGES_TRANSPARENT;
+#else
+	(void)hugepages;
+#endif
+
+	return pool;
+}
+
+/**
+ * Release a buffer pool.
+ *
+ * The cached buffers get freed. Buffers which are still in use stay
+ * valid, the pool goes away when the last one is released.
+ *
+ * @param pool The pool. NULL is silently ignored.
+ *
+ * @private
+ */
+SR_PRIV void sr_buffer_pool_release(struct sr_buffer_pool *pool)
+{
+	struct pool_block *block;
+	gboolean destroy;
+	int cls;
+
+	if (!pool)
+		return;
+
+	g_mutex_lock(&pool->mutex);
+	for (cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+		while ((block = pool->free[cls])) {
+			pool->free[cls] = block->next;
+			block_free(block);
+		}
+		pool->num_free[cls] = 0;
+	}
+	pool->released = TRUE;
+	destroy = pool->outstanding == 0;
+	if (!destroy)
+		sr_dbg("Releasing pool with %zu buffers in use.",
+			pool->outstanding);
+	g_mutex_unlock(&pool->mutex);
+
+	if (destroy)
+		pool_destroy(pool);
+}
+
+static struct sr_buffer_pool *default_pool(void)
+{
+	static struct sr_buffer_pool *pool;
+
+	if (g_once_init_enter(&pool))
+		g_once_init_leave(&pool, sr_buffer_pool_new());
+
+	return pool;
+}
+
+/**
+ * Allocate a buffer from a context's pool.
+ *
+ * The memory is not cleared, and is aligned to a cache line.
+ *
+ * @param ctx The context whose pool to use. Can be NULL for the
+ *            process-wide pool.
+ * @param size The size in bytes. Must not be 0.
+ *
+ * @return The buffer, or NULL upon allocation failure or invalid size.
+ *         Release it with sr_buffer_free().
+ *
+ * @private
+ */
+SR_PRIV void *sr_buffer_alloc(struct sr_context *ctx, size_t size)
+{
+	return sr_buffer_alloc_node(ctx, size, -1);
+}
+
+/**
+ * Allocate a buffer whose pages live on a given NUMA node.
+ *
+ * Use this for large buffers which a device fills, with the node of the
+ * device's bus controller. On systems without NUMA support this is the
+ * same as sr_buffer_alloc().
+ *
+ * @param ctx The context whose pool to use. Can be NULL for the
+ *            process-wide pool.
+ * @param size The size in bytes. Must not be 0.
+ * @param node The NUMA node, or -1 for any.
+ *
+ * @return The buffer, or NULL upon allocation failure or invalid size.
+ *         Release it with sr_buffer_free().
+ *
+ * @private
+ */
+SR_PRIV void *sr_buffer_alloc_node(struct sr_context *ctx, size_t size,
+		int node)
+{
+	struct sr_buffer_pool *pool;
+	struct pool_block *block;
+	int cls;
+
+	if (!size)
+		return NULL;
+
+	pool = ctx && ctx->buffer_pool ? ctx->buffer_pool : default_pool();
+	cls = node < 0 ? size_class(size) : -1;
+
+	g_mutex_lock(&pool->mutex);
+	block = NULL;
+	if (cls >= 0 && (block = pool->free[cls])) {
+		pool->free[cls] = block->next;
+		pool->num_free[cls]--;
+	}
+	pool->outstanding++;
+	g_mutex_unlock(&pool->mutex);
+
+	if (!block) {
+		if (cls >= 0)
+			size = (size_t)1 << (cls + POOL_MIN_SHIFT);
+		if (!(block = block_new(pool, size, cls, node))) {
+			g_mutex_lock(&pool->mutex);
+			pool->outstanding--;
+			g_mutex_unlock(&pool->mutex);
+			return NULL;
+		}
+	}
+
+	return block + 1;
+}
+
+/**
+ * Release a buffer which sr_buffer_alloc() returned.
+ *
+ * This may be called from any thread.
+ *
+ * @param data The buffer. NULL is silently ignored.
+ *
+ * @private
+ */
+SR_PRIV void sr_buffer_free(void *data)
+{
+	struct sr_buffer_pool *pool;
+	struct pool_block *block;
+	gboolean destroy;
+	int cls;
+
+	if (!data)
+		return;
+
+	block = (struct pool_block *)data - 1;
+	pool = block->pool;
+	cls = block->cls;
+
+	g_mutex_lock(&pool->mutex);
+	pool->outstanding--;
+	if (cls >= 0 && !pool->released && pool->num_free[cls]
+			< MAX(POOL_CLASS_CACHE >> (cls + POOL_MIN_SHIFT), 1)) {
+		block->next = pool->free[cls];
+		pool->free[cls] = block;
+		pool->num_free[cls]++;
+		block = NULL;
+	}
+	destroy = pool->released && pool->outstanding == 0;
+	g_mutex_unlock(&pool->mutex);
+
+	if (block)
+		block_free(block);
+	if (destroy)
+		pool_destroy(pool);
+}
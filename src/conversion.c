@@ -23,6 +23,7 @@
  * Conversion helper functions.
  */
 
+#include <math.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -30,6 +31,268 @@
 #define LOG_PREFIX "conv"
 /** @endcond */
 
+/*
+ * Integer samples get compared in the ADC's raw units, with the threshold
+ * converted once. Other encodings get converted to float in blocks of this
+ * many values on the stack.
+ */
+#define A2L_BLOCK_SIZE 256
+
+/* Integer sample formats which get compared without conversion. */
+enum a2l_format {
+	A2L_I8, A2L_U8,
+	A2L_I16_LE, A2L_I16_BE, A2L_U16_LE, A2L_U16_BE,
+	A2L_I24_LE,
+	A2L_I32_LE, A2L_I32_BE, A2L_U32_LE, A2L_U32_BE,
+};
+
+/*
+ * A comparison of a sample's value against a threshold, in raw units.
+ * The value is at or above the threshold when (raw >= k) != invert.
+ */
+struct a2l_cmp {
+	int64_t k;
+	gboolean invert;
+};
+
+/*
+ * Where to store the results. A mask of 0 stores one byte of 0 or 1
+ * per sample. Otherwise the mask's bit gets set or cleared in the byte
+ * at every stride bytes, i.e. in a channel of a logic sample stream.
+ */
+struct a2l_out {
+	uint8_t *data;
+	size_t stride;
+	uint8_t mask;
+};
+
+static gboolean a2l_format_get(const struct sr_analog_encoding *enc,
+		enum a2l_format *fmt)
+{
+	gboolean be;
+
+	if (enc->is_float)
+		return FALSE;
+
+	be = enc->is_bigendian;
+	if (enc->unitsize == sizeof(uint8_t))
+		*fmt = enc->is_signed ? A2L_I8 : A2L_U8;
+	else if (enc->unitsize == sizeof(uint16_t) && enc->is_signed)
+		*fmt = be ? A2L_I16_BE : A2L_I16_LE;
+	else if (enc->unitsize == sizeof(uint16_t))
+		*fmt = be ? A2L_U16_BE : A2L_U16_LE;
+	else if (enc->unitsize == 3 && enc->is_signed && !be)
+		*fmt = A2L_I24_LE;
+	else if (enc->unitsize == sizeof(uint32_t) && enc->is_signed)
+		*fmt = be ? A2L_I32_BE : A2L_I32_LE;
+	else if (enc->unitsize == sizeof(uint32_t))
+		*fmt = be ? A2L_U32_BE : A2L_U32_LE;
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+/*
+ * Set up the test "value >= thr" (or "value > thr" when strict), with
+ * value = raw * scale + offset, as a comparison of the raw value.
+ */
+static void a2l_cmp_init(struct a2l_cmp *cmp,
+		const struct sr_analog_encoding *enc, float thr, gboolean strict)
+{
+	const double limit = (double)(1LL << 62);
+	double scale, offset, t;
+
+	scale = (double)enc->scale.p / enc->scale.q;
+	offset = (double)enc->offset.p / enc->offset.q;
+
+	if (enc->scale.p == 0) {
+		/* Every sample has the value of the offset. */
+		cmp->k = INT64_MIN;
+		cmp->invert = strict ? !(offset > thr) : !(offset >= thr);
+		return;
+	}
+
+	t = (thr - offset) * enc->scale.q / enc->scale.p;
+	if (!(t > -limit))
+		t = -limit;
+	else if (!(t < limit))
+		t = limit;
+
+	/* Negative scales turn the comparison around. */
+	if ((scale > 0) != strict)
+		cmp->k = (int64_t)ceil(t);
+	else
+		cmp->k = (int64_t)floor(t) + 1;
+	cmp->invert = scale < 0;
+}
+
+/* Convert count values, starting at index first, to floats. */
+static int a2l_float_block(const struct sr_datafeed_analog *analog,
+		uint64_t first, size_t count, float *outbuf)
+{
+	struct sr_datafeed_analog block;
+	struct sr_analog_meaning meaning;
+	GSList channel;
+
+	/* A single channel, so that values and samples are the same. */
+	channel.data = NULL;
+	channel.next = NULL;
+	meaning = *analog->meaning;
+	meaning.channels = &channel;
+
+	block = *analog;
+	block.meaning = &meaning;
+	block.data = (uint8_t *)analog->data +
+		first * analog->encoding->unitsize;
+	block.num_samples = count;
+
+	return sr_analog_to_float(&block, outbuf);
+}
+
+/** @cond PRIVATE */
+#define A2L_PUT(i, bit) do { \
+	if (!mask) \
+		outp[i] = (bit); \
+	else if (bit) \
+		outp[(i) * stride] |= mask; \
+	else \
+		outp[(i) * stride] &= ~mask; \
+} while (0)
+
+#define A2L_DISPATCH(fmt, LOOP) do { \
+	switch (fmt) { \
+	case A2L_I8: LOOP(read_i8, 1); break; \
+	case A2L_U8: LOOP(read_u8, 1); break; \
+	case A2L_I16_LE: LOOP(read_i16le, 2); break; \
+	case A2L_I16_BE: LOOP(read_i16be, 2); break; \
+	case A2L_U16_LE: LOOP(read_u16le, 2); break; \
+	case A2L_U16_BE: LOOP(read_u16be, 2); break; \
+	case A2L_I24_LE: LOOP(read_i24le, 3); break; \
+	case A2L_I32_LE: LOOP(read_i32le, 4); break; \
+	case A2L_I32_BE: LOOP(read_i32be, 4); break; \
+	case A2L_U32_LE: LOOP(read_u32le, 4); break; \
+	case A2L_U32_BE: LOOP(read_u32be, 4); break; \
+	} \
+} while (0)
+
+#define THRESHOLD_LOOP(reader, size) \
+	for (i = 0; i < count; i++) { \
+		raw = reader(&data8[i * (size)]); \
+		A2L_PUT(i, (raw >= k) != invert); \
+	}
+
+#define SCHMITT_LOOP(reader, size) \
+	for (i = 0; i < count; i++) { \
+		raw = reader(&data8[i * (size)]); \
+		if ((raw >= lo_k) == lo_invert) \
+			st = 0; \
+		else if ((raw >= hi_k) != hi_invert) \
+			st = 1; \
+		A2L_PUT(i, st); \
+	}
+/** @endcond */
+
+static int a2l_threshold(const struct sr_datafeed_analog *analog,
+		float threshold, const struct a2l_out *out, uint64_t count)
+{
+	struct a2l_cmp cmp;
+	enum a2l_format fmt;
+	const uint8_t *data8;
+	uint8_t *outp, mask;
+	size_t stride, n;
+	uint64_t i, done;
+	int64_t raw, k;
+	gboolean invert;
+	float block[A2L_BLOCK_SIZE];
+
+	outp = out->data;
+	stride = out->stride;
+	mask = out->mask;
+
+	if (a2l_format_get(analog->encoding, &fmt)) {
+		a2l_cmp_init(&cmp, analog->encoding, threshold, FALSE);
+		k = cmp.k;
+		invert = cmp.invert;
+		data8 = analog->data;
+		A2L_DISPATCH(fmt, THRESHOLD_LOOP);
+		return SR_OK;
+	}
+
+	for (done = 0; done < count; done += n) {
+		n = MIN(count - done, A2L_BLOCK_SIZE);
+		if (a2l_float_block(analog, done, n, block) != SR_OK)
+			return SR_ERR;
+		for (i = 0; i < n; i++)
+			A2L_PUT(done + i, block[i] >= threshold);
+	}
+
+	return SR_OK;
+}
+
+static int a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state,
+		const struct a2l_out *out, uint64_t count)
+{
+	struct a2l_cmp lo, hi;
+	enum a2l_format fmt;
+	const uint8_t *data8;
+	uint8_t *outp, mask, st;
+	size_t stride, n;
+	uint64_t i, done;
+	int64_t raw, lo_k, hi_k;
+	gboolean lo_invert, hi_invert;
+	float block[A2L_BLOCK_SIZE];
+
+	outp = out->data;
+	stride = out->stride;
+	mask = out->mask;
+	st = *state;
+
+	if (a2l_format_get(analog->encoding, &fmt)) {
+		/* Becomes 0 below lo_thr, 1 above hi_thr. */
+		a2l_cmp_init(&lo, analog->encoding, lo_thr, FALSE);
+		a2l_cmp_init(&hi, analog->encoding, hi_thr, TRUE);
+		lo_k = lo.k;
+		lo_invert = lo.invert;
+		hi_k = hi.k;
+		hi_invert = hi.invert;
+		data8 = analog->data;
+		A2L_DISPATCH(fmt, SCHMITT_LOOP);
+		*state = st;
+		return SR_OK;
+	}
+
+	for (done = 0; done < count; done += n) {
+		n = MIN(count - done, A2L_BLOCK_SIZE);
+		if (a2l_float_block(analog, done, n, block) != SR_OK)
+			return SR_ERR;
+		for (i = 0; i < n; i++) {
+			if (block[i] < lo_thr)
+				st = 0;
+			else if (block[i] > hi_thr)
+				st = 1;
+			A2L_PUT(done + i, st);
+		}
+	}
+	*state = st;
+
+	return SR_OK;
+}
+
+static int a2l_out_init(struct a2l_out *out, uint8_t *output,
+		size_t unitsize, unsigned int bit)
+{
+	if (!output || !unitsize || bit >= unitsize * 8)
+		return SR_ERR_ARG;
+
+	out->data = output + bit / 8;
+	out->stride = unitsize;
+	out->mask = 1 << (bit % 8);
+
+	return SR_OK;
+}
+
 /**
  * Convert analog values to logic values by using a fixed threshold.
  *
@@ -44,24 +307,46 @@
 SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 		float threshold, uint8_t *output, uint64_t count)
 {
-	float *input;
+	struct a2l_out out;
 
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
-		if (!input)
-			return SR_ERR;
+	out.data = output;
+	out.stride = 1;
+	out.mask = 0;
 
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+	return a2l_threshold(analog, threshold, &out, count);
+}
 
-	for (uint64_t i = 0; i < count; i++)
-		output[i] = (input[i] >= threshold) ? 1 : 0;
+/**
+ * Convert analog values to logic values by using a fixed threshold, and
+ * store them in one channel of logic samples.
+ *
+ * Integer samples get compared without a conversion to float.
+ *
+ * @param[in] analog The analog input values. Must not be NULL.
+ * @param[in] threshold The threshold to use.
+ * @param[in,out] output The logic samples. Must provide space for count
+ *                       samples of unitsize bytes. Only the channel's bit
+ *                       gets changed.
+ * @param[in] unitsize The size of a logic sample in bytes.
+ * @param[in] bit The channel's bit number in a logic sample.
+ * @param[in] count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_threshold_logic(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, size_t unitsize,
+		unsigned int bit, uint64_t count)
+{
+	struct a2l_out out;
 
-	if (!analog->encoding->is_float)
-		g_free(input);
+	if (!analog || a2l_out_init(&out, output, unitsize, bit) != SR_OK)
+		return SR_ERR_ARG;
 
-	return SR_OK;
+	return a2l_threshold(analog, threshold, &out, count);
 }
 
 /**
@@ -82,28 +367,48 @@ SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count)
 {
-	float *input;
+	struct a2l_out out;
 
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
-		if (!input)
-			return SR_ERR;
-
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+	out.data = output;
+	out.stride = 1;
+	out.mask = 0;
 
-	for (uint64_t i = 0; i < count; i++) {
-		if (input[i] < lo_thr)
-			*state = 0;
-		else if (input[i] > hi_thr)
-			*state = 1;
+	return a2l_schmitt_trigger(analog, lo_thr, hi_thr, state, &out, count);
+}
 
-		output[i] = *state;
-	}
+/**
+ * Convert analog values to logic values by using a Schmitt-trigger
+ * algorithm, and store them in one channel of logic samples.
+ *
+ * Integer samples get compared without a conversion to float.
+ *
+ * @param[in] analog The analog input values. Must not be NULL.
+ * @param[in] lo_thr The low threshold - result becomes 0 below it.
+ * @param[in] hi_thr The high threshold - result becomes 1 above it.
+ * @param[in,out] state The internal converter state, see
+ *                      sr_a2l_schmitt_trigger(). Must not be NULL.
+ * @param[in,out] output The logic samples. Must provide space for count
+ *                       samples of unitsize bytes. Only the channel's bit
+ *                       gets changed.
+ * @param[in] unitsize The size of a logic sample in bytes.
+ * @param[in] bit The channel's bit number in a logic sample.
+ * @param[in] count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_schmitt_trigger_logic(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		size_t unitsize, unsigned int bit, uint64_t count)
+{
+	struct a2l_out out;
 
-	if (!analog->encoding->is_float)
-		g_free(input);
+	if (!analog || !state ||
+	    a2l_out_init(&out, output, unitsize, bit) != SR_OK)
+		return SR_ERR_ARG;
 
-	return SR_OK;
+	return a2l_schmitt_trigger(analog, lo_thr, hi_thr, state, &out, count);
 }
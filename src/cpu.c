@@ -0,0 +1,183 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_SYS_AUXV_H
+#include <sys/auxv.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "cpu"
+
+/**
+ * @file
+ *
+ * Run-time detection of the host CPU's vector extensions.
+ *
+ * Hot loops may come in variants which get compiled for a specific
+ * instruction set (see SR_TARGET()), and pick one with sr_cpu_has().
+ * That way a single library binary uses what the capture host offers,
+ * without a build-time -march. The SIGROK_CPU_FEATURES environment
+ * variable restricts the detected features to a comma separated list
+ * (e.g. "sse2" or "none"), to compare the variants when benchmarking.
+ */
+
+#if defined(__arm__) && !defined(HWCAP_NEON)
+#define HWCAP_NEON (1 << 12)
+#endif
+
+/* Detected features, tested by sr_cpu_has(). Zero until sr_cpu_init(). */
+SR_PRIV unsigned int sr_cpu_features;
+
+static const struct {
+	const char *name;
+	unsigned int feature;
+} feature_names[] = {
+	{ "sse2", SR_CPU_SSE2, },
+	{ "avx2", SR_CPU_AVX2, },
+	{ "avx512", SR_CPU_AVX512, },
+	{ "neon", SR_CPU_NEON, },
+};
+
+static unsigned int cpu_detect(void)
+{
+	unsigned int features;
+
+	features = 0;
+#if defined(SR_CPU_DISPATCH_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		features |= SR_CPU_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		features |= SR_CPU_AVX2;
+	if (__builtin_cpu_supports("avx512f")
+			&& __builtin_cpu_supports("avx512bw"))
+		features |= SR_CPU_AVX512;
+#elif defined(__aarch64__)
+	/* Mandatory in ARMv8-A. */
+	features |= SR_CPU_NEON;
+#elif defined(__arm__) && defined(HAVE_SYS_AUXV_H)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		features |= SR_CPU_NEON;
+#endif
+
+	return features;
+}
+
+static unsigned int cpu_restrict(unsigned int features, const char *spec)
+{
+	gchar **names;
+	unsigned int allowed;
+	size_t i, j;
+
+	names = g_strsplit(spec, ",", 0);
+	allowed = 0;
+	for (i = 0; names[i]; i++) {
+		g_strstrip(names[i]);
+		if (!*names[i] || !g_ascii_strcasecmp(names[i], "none"))
+			continue;
+		for (j = 0; j < G_N_ELEMENTS(feature_names); j++) {
+			if (!g_ascii_strcasecmp(names[i], feature_names[j].name))
+				break;
+		}
+		if (j == G_N_ELEMENTS(feature_names)) {
+			sr_warn("Unknown CPU feature '%s' in SIGROK_CPU_FEATURES.",
+				names[i]);
+			continue;
+		}
+		allowed |= feature_names[j].feature;
+	}
+	g_strfreev(names);
+
+	return features & allowed;
+}
+
+/* Space separated names of the features, or "none". */
+static char *features_string(unsigned int features)
+{
+	GString *text;
+	size_t i;
+
+	text = g_string_sized_new(32);
+	for (i = 0; i < G_N_ELEMENTS(feature_names); i++) {
+		if (!(features & feature_names[i].feature))
+			continue;
+		if (text->len)
+			g_string_append_c(text, ' ');
+		g_string_append(text, feature_names[i].name);
+	}
+	if (!text->len)
+		g_string_append(text, "none");
+
+	return g_string_free(text, FALSE);
+}
+
+static gpointer cpu_init_once(gpointer data)
+{
+	const char *spec;
+	unsigned int features;
+	char *text;
+
+	(void)data;
+
+	features = cpu_detect();
+	spec = g_getenv("SIGROK_CPU_FEATURES");
+	if (spec)
+		features = cpu_restrict(features, spec);
+
+	text = features_string(features);
+	sr_dbg("CPU features in use: %s.", text);
+	g_free(text);
+
+	sr_cpu_features = features;
+
+	return NULL;
+}
+
+/**
+ * Detect the host CPU's features, once per process.
+ *
+ * Every sr_init() calls this. Before that, only the generic code paths
+ * get used.
+ *
+ * @private
+ */
+SR_PRIV void sr_cpu_init(void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	g_once(&once, cpu_init_once, NULL);
+}
+
+/**
+ * Get the host CPU's vector extensions which libsigrok makes use of.
+ *
+ * This reflects the SIGROK_CPU_FEATURES restriction, if any. It is only
+ * valid after sr_init().
+ *
+ * @return A space separated list of feature names like "sse2 avx2", or
+ *         "none". The caller must g_free() it.
+ *
+ * @since 0.6.0
+ */
+SR_API char *sr_cpu_features_get(void)
+{
+	return features_string(sr_cpu_features);
+}
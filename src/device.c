@@ -311,6 +311,76 @@ SR_PRIV void sr_channel_group_free_cb(void *cg)
 	return sr_channel_group_free(cg);
 }
 
+/*
+ * Options of open devices, per device and channel group. Frontends
+ * query them on every UI refresh, and the config routines check each
+ * key against them. Drivers may have to talk to the device to tell
+ * them, so keep them until the driver's state may have changed.
+ */
+static GMutex options_cache_mutex;
+static GHashTable *options_cache;
+
+/** @private */
+SR_PRIV GVariant *sr_dev_options_cache_get(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg)
+{
+	GHashTable *per_cg;
+	GVariant *gvar;
+
+	gvar = NULL;
+	g_mutex_lock(&options_cache_mutex);
+	if (options_cache) {
+		per_cg = g_hash_table_lookup(options_cache, sdi);
+		if (per_cg)
+			gvar = g_hash_table_lookup(per_cg, cg);
+		if (gvar)
+			g_variant_ref(gvar);
+	}
+	g_mutex_unlock(&options_cache_mutex);
+
+	return gvar;
+}
+
+/** @private */
+SR_PRIV void sr_dev_options_cache_put(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, GVariant *gvar)
+{
+	GHashTable *per_cg;
+
+	g_mutex_lock(&options_cache_mutex);
+	if (!options_cache)
+		options_cache = g_hash_table_new_full(NULL, NULL, NULL,
+			(GDestroyNotify)g_hash_table_unref);
+	per_cg = g_hash_table_lookup(options_cache, sdi);
+	if (!per_cg) {
+		per_cg = g_hash_table_new_full(NULL, NULL, NULL,
+			(GDestroyNotify)g_variant_unref);
+		g_hash_table_insert(options_cache, (void *)sdi, per_cg);
+	}
+	g_hash_table_replace(per_cg, (void *)cg, g_variant_ref(gvar));
+	g_mutex_unlock(&options_cache_mutex);
+}
+
+/**
+ * Forget the cached options of a device instance.
+ *
+ * The options get queried from the driver again on next use. Drivers
+ * call this when their options change other than by setting config
+ * keys, which already takes care of it, e.g. when a device switched
+ * its mode by itself.
+ *
+ * @param sdi The device instance.
+ *
+ * @private
+ */
+SR_PRIV void sr_dev_options_changed(const struct sr_dev_inst *sdi)
+{
+	g_mutex_lock(&options_cache_mutex);
+	if (options_cache)
+		g_hash_table_remove(options_cache, sdi);
+	g_mutex_unlock(&options_cache_mutex);
+}
+
 /**
  * Determine whether the specified device instance has the specified
  * capability.
@@ -338,8 +408,8 @@ SR_API gboolean sr_dev_has_option(const struct sr_dev_inst *sdi, int key)
 	if (!sdi || !sdi->driver || !sdi->driver->config_list)
 		return FALSE;
 
-	if (sdi->driver->config_list(SR_CONF_DEVICE_OPTIONS,
-				&gvar, sdi, NULL) != SR_OK)
+	if (sr_config_list(sdi->driver, sdi, NULL,
+			SR_CONF_DEVICE_OPTIONS, &gvar) != SR_OK)
 		return FALSE;
 
 	ret = FALSE;
@@ -385,7 +455,7 @@ SR_API GArray *sr_dev_options(const struct sr_dev_driver *driver,
 	if (sdi && sdi->driver != driver)
 		return NULL;
 
-	if (driver->config_list(SR_CONF_DEVICE_OPTIONS, &gvar, sdi, cg) != SR_OK)
+	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar) != SR_OK)
 		return NULL;
 
 	opts = g_variant_get_fixed_array(gvar, &num_opts, sizeof(uint32_t));
@@ -394,7 +464,7 @@ SR_API GArray *sr_dev_options(const struct sr_dev_driver *driver,
 
 	for (i = 0; i < num_opts; i++) {
 		opt = opts[i] & SR_CONF_MASK;
-		g_array_insert_val(result, i, opt);
+		g_array_append_val(result, opt);
 	}
 
 	g_variant_unref(gvar);
@@ -431,8 +501,8 @@ SR_API int sr_dev_config_capabilities_list(const struct sr_dev_inst *sdi,
 	if (!sdi || !sdi->driver || !sdi->driver->config_list)
 		return 0;
 
-	if (sdi->driver->config_list(SR_CONF_DEVICE_OPTIONS,
-				&gvar, sdi, cg) != SR_OK)
+	if (sr_config_list(sdi->driver, sdi, cg,
+			SR_CONF_DEVICE_OPTIONS, &gvar) != SR_OK)
 		return 0;
 
 	ret = 0;
@@ -518,6 +588,7 @@ SR_PRIV void sr_dev_inst_free(struct sr_dev_inst *sdi)
 
 	if (sdi->session)
 		sr_session_dev_remove(sdi->session, sdi);
+	sr_dev_options_changed(sdi);
 
 	g_free(sdi->vendor);
 	g_free(sdi->model);
@@ -563,6 +634,13 @@ SR_PRIV struct sr_usb_dev_inst *sr_usb_dev_inst_new(uint8_t bus,
  */
 SR_PRIV void sr_usb_dev_inst_free(struct sr_usb_dev_inst *usb)
 {
+	if (!usb)
+		return;
+
+	/* Leave closing the handle to the last transfer buffer in use. */
+	if (usb->dev_mem)
+		sr_usb_close(usb);
+	sr_usb_dump_free(usb);
 	g_free(usb);
 }
 
@@ -774,6 +852,7 @@ SR_API int sr_dev_close(struct sr_dev_inst *sdi)
 	}
 
 	sdi->status = SR_ST_INACTIVE;
+	sr_dev_options_changed(sdi);
 
 	sr_dbg("%s: Closing device instance.", sdi->driver->name);
 
@@ -899,7 +978,7 @@ SR_API const char *sr_dev_inst_connid_get(const struct sr_dev_inst *sdi)
 		drvc = sdi->driver->context;
 		usb = sdi->conn;
 
-		if ((cnt = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist)) < 0) {
+		if ((cnt = sr_usb_get_device_list(drvc->sr_ctx, &devlist)) < 0) {
 			sr_err("Failed to retrieve device list: %s.",
 			       libusb_error_name(cnt));
 			return NULL;
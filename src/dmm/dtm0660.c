@@ -39,33 +39,17 @@
 
 #define LOG_PREFIX "dtm0660"
 
+/* Segment bytes of the digits 0 to 9. */
+static const int8_t digit_table[256] = SR_SEG7_TABLE(
+	0xeb, 0x0a, 0xad, 0x8f, 0x4e,
+	0xc7, 0xe7, 0x8a, 0xef, 0xcf);
+
 static int parse_digit(uint8_t b)
 {
-	switch (b) {
-	case 0xeb:
-		return 0;
-	case 0x0a:
-		return 1;
-	case 0xad:
-		return 2;
-	case 0x8f:
-		return 3;
-	case 0x4e:
-		return 4;
-	case 0xc7:
-		return 5;
-	case 0xe7:
-		return 6;
-	case 0x8a:
-		return 7;
-	case 0xef:
-		return 8;
-	case 0xcf:
-		return 9;
-	default:
+	if (digit_table[b] < 0)
 		sr_dbg("Invalid digit byte: 0x%02x.", b);
-		return -1;
-	}
+
+	return digit_table[b];
 }
 
 static gboolean sync_nibbles_valid(const uint8_t *buf)
@@ -345,6 +329,11 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		sr_spew("User-defined LCD symbol 1 is active.");
 }
 
+/* The first byte's sync nibble is 1, packets have no terminator. */
+SR_PRIV const struct sr_packet_framing sr_dtm0660_framing = {
+	DTM0660_PACKET_SIZE, 0xf0, 0x10, NULL,
+};
+
 SR_PRIV gboolean sr_dtm0660_packet_valid(const uint8_t *buf)
 {
 	struct dtm0660_info info;
@@ -40,33 +40,17 @@
 
 #define LOG_PREFIX "fs9721"
 
+/* Segment bytes of the digits 0 to 9. */
+static const int8_t digit_table[256] = SR_SEG7_TABLE(
+	0x7d, 0x05, 0x5b, 0x1f, 0x27,
+	0x3e, 0x7e, 0x15, 0x7f, 0x3f);
+
 static int parse_digit(uint8_t b)
 {
-	switch (b) {
-	case 0x7d:
-		return 0;
-	case 0x05:
-		return 1;
-	case 0x5b:
-		return 2;
-	case 0x1f:
-		return 3;
-	case 0x27:
-		return 4;
-	case 0x3e:
-		return 5;
-	case 0x7e:
-		return 6;
-	case 0x15:
-		return 7;
-	case 0x7f:
-		return 8;
-	case 0x3f:
-		return 9;
-	default:
+	if (digit_table[b] < 0)
 		sr_dbg("Invalid digit byte: 0x%02x.", b);
-		return -1;
-	}
+
+	return digit_table[b];
 }
 
 static gboolean sync_nibbles_valid(const uint8_t *buf)
@@ -323,6 +307,11 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		sr_spew("User-defined LCD symbol 3 is active.");
 }
 
+/* The first byte's sync nibble is 1, packets have no terminator. */
+SR_PRIV const struct sr_packet_framing sr_fs9721_framing = {
+	FS9721_PACKET_SIZE, 0xf0, 0x10, NULL,
+};
+
 SR_PRIV gboolean sr_fs9721_packet_valid(const uint8_t *buf)
 {
 	struct fs9721_info info;
@@ -320,6 +320,11 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 
 }
 
+/* Packets start with a '+' or '-' sign and end in CR/LF. */
+SR_PRIV const struct sr_packet_framing sr_fs9922_framing = {
+	FS9922_PACKET_SIZE, 0xf9, '+' & 0xf9, "\r\n",
+};
+
 SR_PRIV gboolean sr_fs9922_packet_valid(const uint8_t *buf)
 {
 	struct fs9922_info info;
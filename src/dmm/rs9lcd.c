@@ -221,37 +221,23 @@ SR_PRIV gboolean sr_rs9lcd_packet_valid(const uint8_t *buf)
 	return TRUE;
 }
 
+static const int8_t digit_table[256] = SR_SEG7_TABLE(
+	LCD_0, LCD_1, LCD_2, LCD_3, LCD_4, LCD_5, LCD_6, LCD_7, LCD_8, LCD_9);
+
 static uint8_t decode_digit(uint8_t raw_digit)
 {
-	/* Take out the decimal point, so we can use a simple switch(). */
+	/* Take out the decimal point, so we can use a simple lookup. */
 	raw_digit &= ~DP_MASK;
 
-	switch (raw_digit) {
-	case 0x00:
-	case LCD_0:
+	/* Blank digits read as zero. */
+	if (!raw_digit)
 		return 0;
-	case LCD_1:
-		return 1;
-	case LCD_2:
-		return 2;
-	case LCD_3:
-		return 3;
-	case LCD_4:
-		return 4;
-	case LCD_5:
-		return 5;
-	case LCD_6:
-		return 6;
-	case LCD_7:
-		return 7;
-	case LCD_8:
-		return 8;
-	case LCD_9:
-		return 9;
-	default:
+	if (digit_table[raw_digit] < 0) {
 		sr_dbg("Invalid digit byte: 0x%02x.", raw_digit);
 		return 0xff;
 	}
+
+	return digit_table[raw_digit];
 }
 
 static double lcd_to_double(const struct rs9lcd_packet *rs_packet, int type,
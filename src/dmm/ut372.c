@@ -30,18 +30,9 @@
 
 #define LOG_PREFIX "ut372"
 
-static const uint8_t lookup[] = {
-	0x7B,
-	0x60,
-	0x5E,
-	0x7C,
-	0x65,
-	0x3D,
-	0x3F,
-	0x70,
-	0x7F,
-	0x7D,
-};
+/* Segment bytes of the digits 0 to 9, without the decimal point. */
+static const int8_t lookup[256] = SR_SEG7_TABLE(
+	0x7B, 0x60, 0x5E, 0x7C, 0x65, 0x3D, 0x3F, 0x70, 0x7F, 0x7D);
 
 #define DECIMAL_POINT_MASK 0x80
 
@@ -70,6 +61,11 @@ static uint8_t decode_pair(const uint8_t *buf)
 	return strtol(hex, NULL, 16);
 }
 
+/* Packets end in CR/LF. */
+SR_PRIV const struct sr_packet_framing sr_ut372_framing = {
+	UT372_PACKET_SIZE, 0, 0, "\r\n",
+};
+
 SR_PRIV gboolean sr_ut372_packet_valid(const uint8_t *buf)
 {
 	uint8_t flags2;
@@ -89,7 +85,8 @@ SR_PRIV gboolean sr_ut372_packet_valid(const uint8_t *buf)
 SR_PRIV int sr_ut372_parse(const uint8_t *buf, float *floatval,
 		struct sr_datafeed_analog *analog, void *info)
 {
-	unsigned int i, j, value;
+	unsigned int i, value;
+	int digit;
 	uint8_t segments, flags1, flags2;
 	int exponent;
 
@@ -120,12 +117,9 @@ SR_PRIV int sr_ut372_parse(const uint8_t *buf, float *floatval,
 
 	for (i = 0; i < 5; i++) {
 		segments = decode_pair(buf + 1 + (2 * i));
-		for (j = 0; j < ARRAY_SIZE(lookup); j++) {
-			if (lookup[j] == (segments & ~DECIMAL_POINT_MASK)) {
-				value += j * pow(10, i);
-				break;
-			}
-		}
+		digit = lookup[segments & ~DECIMAL_POINT_MASK];
+		if (digit > 0)
+			value += digit * pow(10, i);
 		if (segments & DECIMAL_POINT_MASK)
 			exponent = -i;
 	}
@@ -316,6 +316,11 @@ static gboolean flags_valid(const struct ut71x_info *info)
 	return TRUE;
 }
 
+/* Packets end in CR/LF. */
+SR_PRIV const struct sr_packet_framing sr_ut71x_framing = {
+	UT71X_PACKET_SIZE, 0, 0, "\r\n",
+};
+
 SR_PRIV gboolean sr_ut71x_packet_valid(const uint8_t *buf)
 {
 	struct ut71x_info info;
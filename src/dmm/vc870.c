@@ -390,6 +390,11 @@ static gboolean flags_valid(const struct vc870_info *info)
 	return TRUE;
 }
 
+/* Packets end in CR/LF. */
+SR_PRIV const struct sr_packet_framing sr_vc870_framing = {
+	VC870_PACKET_SIZE, 0, 0, "\r\n",
+};
+
 SR_PRIV gboolean sr_vc870_packet_valid(const uint8_t *buf)
 {
 	struct vc870_info info;
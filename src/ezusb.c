@@ -56,17 +56,19 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx,
 				   libusb_device_handle *hdl,
 				   const char *name)
 {
-	unsigned char *firmware;
+	GBytes *bytes;
+	const unsigned char *firmware;
 	size_t length, offset, chunksize;
 	int ret, result;
 
 	/* Max size is 64 kiB since the value field of the setup packet,
 	 * which holds the firmware offset, is only 16 bit wide.
 	 */
-	firmware = sr_resource_load(ctx, SR_RESOURCE_FIRMWARE,
-			name, &length, 1 << 16);
-	if (!firmware)
+	bytes = sr_resource_load_bytes(ctx, SR_RESOURCE_FIRMWARE,
+			name, 1 << 16);
+	if (!bytes)
 		return SR_ERR;
+	firmware = g_bytes_get_data(bytes, &length);
 
 	sr_info("Uploading firmware '%s'.", name);
 
@@ -77,18 +79,18 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx,
 
 		ret = libusb_control_transfer(hdl, LIBUSB_REQUEST_TYPE_VENDOR |
 					      LIBUSB_ENDPOINT_OUT, 0xa0, offset,
-					      0x0000, firmware + offset,
+					      0x0000, (unsigned char *)firmware + offset,
 					      chunksize, 100);
 		if (ret < 0) {
 			sr_err("Unable to send firmware to device: %s.",
 					libusb_error_name(ret));
-			g_free(firmware);
+			g_bytes_unref(bytes);
 			return SR_ERR;
 		}
 		sr_info("Uploaded %zu bytes.", chunksize);
 		offset += chunksize;
 	}
-	g_free(firmware);
+	g_bytes_unref(bytes);
 
 	sr_info("Firmware upload done.");
 
@@ -135,6 +137,9 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 	if (ezusb_install_firmware(ctx, hdl, name) < 0)
 		return SR_ERR;
 
+	/* Catch the device when it comes back with the new firmware. */
+	sr_usb_renum_watch(ctx);
+
 	if ((ezusb_reset(hdl, 0)) < 0)
 		return SR_ERR;
 
@@ -148,7 +148,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all ASIX logic analyzers (which match the connection spec). */
 	devices = NULL;
-	libusb_get_device_list(usbctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (devidx = 0; devlist[devidx]; devidx++) {
 		devitem = devlist[devidx];
 
@@ -623,6 +623,7 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	} else {
 		devc->state = SIGMA_IDLE;
 		(void)sr_session_source_remove(sdi->session, -1);
+		sigma_abort_download(devc);
 	}
 
 	return SR_OK;
@@ -754,28 +754,24 @@ static int sigma_fpga_init_la(struct dev_context *devc)
 static int sigma_fw_2_bitbang(struct sr_context *ctx, const char *name,
 	uint8_t **bb_cmd, size_t *bb_cmd_size)
 {
-	uint8_t *firmware;
+	GBytes *firmware;
 	size_t file_size;
-	uint8_t *p;
+	const uint8_t *p;
 	size_t l;
 	uint32_t imm;
 	size_t bb_size;
 	uint8_t *bb_stream, *bbs, byte, mask, v;
 
-	/* Retrieve the on-disk firmware file content. */
-	firmware = sr_resource_load(ctx, SR_RESOURCE_FIRMWARE, name,
-		&file_size, SIGMA_FIRMWARE_SIZE_LIMIT);
+	/*
+	 * Retrieve the on-disk firmware file content. This is a shared
+	 * read-only view, the file gets unscrambled while the bitbang
+	 * samples are generated below.
+	 */
+	firmware = sr_resource_load_bytes(ctx, SR_RESOURCE_FIRMWARE, name,
+		SIGMA_FIRMWARE_SIZE_LIMIT);
 	if (!firmware)
 		return SR_ERR_IO;
-
-	/* Unscramble the file content (XOR with "random" sequence). */
-	p = firmware;
-	l = file_size;
-	imm = 0x3f6df2ab;
-	while (l--) {
-		imm = (imm + 0xa853753) % 177 + (imm * 0x8034052);
-		*p++ ^= imm & 0xff;
-	}
+	p = g_bytes_get_data(firmware, &file_size);
 
 	/*
 	 * Generate a sequence of bitbang samples. With two samples per
@@ -796,14 +792,16 @@ static int sigma_fw_2_bitbang(struct sr_context *ctx, const char *name,
 	bb_stream = g_try_malloc(bb_size);
 	if (!bb_stream) {
 		sr_err("Memory allocation failed during firmware upload.");
-		g_free(firmware);
+		g_bytes_unref(firmware);
 		return SR_ERR_MALLOC;
 	}
 	bbs = bb_stream;
-	p = firmware;
 	l = file_size;
+	imm = 0x3f6df2ab;
 	while (l--) {
-		byte = *p++;
+		/* Unscramble the file content (XOR with "random" sequence). */
+		imm = (imm + 0xa853753) % 177 + (imm * 0x8034052);
+		byte = *p++ ^ (imm & 0xff);
 		mask = 0x80;
 		while (mask) {
 			v = (byte & mask) ? BB_PIN_DIN : 0;
@@ -812,7 +810,7 @@ static int sigma_fw_2_bitbang(struct sr_context *ctx, const char *name,
 			*bbs++ = v;
 		}
 	}
-	g_free(firmware);
+	g_bytes_unref(firmware);
 
 	/* The transformation completed successfully, return the result. */
 	*bb_cmd = bb_stream;
@@ -1158,10 +1156,12 @@ struct submit_buffer {
 
 static int alloc_submit_buffer(struct sr_dev_inst *sdi)
 {
+	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct submit_buffer *buffer;
 	size_t size;
 
+	drvc = sdi->driver->context;
 	devc = sdi->priv;
 
 	buffer = g_malloc0(sizeof(*buffer));
@@ -1172,7 +1172,7 @@ static int alloc_submit_buffer(struct sr_dev_inst *sdi)
 	size /= buffer->unit_size;
 	buffer->max_samples = size;
 	size *= buffer->unit_size;
-	buffer->sample_data = g_try_malloc0(size);
+	buffer->sample_data = sr_buffer_alloc(drvc->sr_ctx, size);
 	if (!buffer->sample_data)
 		return SR_ERR_MALLOC;
 	buffer->write_pointer = buffer->sample_data;
@@ -1232,7 +1232,7 @@ static void free_submit_buffer(struct dev_context *devc)
 		return;
 	devc->buffer = NULL;
 
-	g_free(buffer->sample_data);
+	sr_buffer_free(buffer->sample_data);
 	g_free(buffer);
 }
 
@@ -1390,12 +1390,194 @@ static void rewind_trig_arm_pos(struct dev_context *devc, size_t count)
 	}
 }
 
+/*
+ * Sample memory download. A separate thread reads DRAM lines ahead into
+ * a ring of DRAM_READ_BLOCKS blocks, while the main thread interprets
+ * the previously received block and submits samples to the session.
+ * Only the reader thread communicates with the device while the
+ * download is in progress. Blocks get read synchronously when the
+ * thread cannot get created.
+ */
+
+#define DRAM_READ_BLOCKS	4
+
+struct dram_reader {
+	struct dev_context *devc;
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	struct sigma_dram_line *lines[DRAM_READ_BLOCKS];
+	size_t counts[DRAM_READ_BLOCKS];
+	/* Free running counts of filled and of consumed blocks. */
+	size_t filled, consumed;
+	/* Reader progress, only accessed by the reading side. */
+	size_t next_line, lines_remain;
+	int status;
+	gboolean quit;
+};
+
+static int dram_reader_read(struct dram_reader *reader, size_t slot)
+{
+	struct dev_context *devc;
+	size_t count;
+	int ret;
+
+	devc = reader->devc;
+	count = MIN(reader->lines_remain, devc->interp.fetch.lines_per_read);
+	ret = sigma_read_dram(devc, reader->next_line, count,
+		(uint8_t *)reader->lines[slot]);
+	if (ret != SR_OK)
+		return ret;
+	reader->counts[slot] = count;
+	reader->next_line += count;
+	reader->next_line %= ROW_COUNT;
+	reader->lines_remain -= count;
+
+	return SR_OK;
+}
+
+static gpointer dram_reader_thread(gpointer data)
+{
+	struct dram_reader *reader;
+	size_t slot;
+	int ret;
+
+	reader = data;
+
+	g_mutex_lock(&reader->mutex);
+	while (!reader->quit && reader->lines_remain) {
+		/* Wait for the main thread to consume a block. */
+		if (reader->filled - reader->consumed == DRAM_READ_BLOCKS) {
+			g_cond_wait(&reader->cond, &reader->mutex);
+			continue;
+		}
+		slot = reader->filled % DRAM_READ_BLOCKS;
+		g_mutex_unlock(&reader->mutex);
+		ret = dram_reader_read(reader, slot);
+		g_mutex_lock(&reader->mutex);
+		if (ret != SR_OK) {
+			reader->status = ret;
+			g_cond_broadcast(&reader->cond);
+			break;
+		}
+		reader->filled++;
+		g_cond_broadcast(&reader->cond);
+	}
+	g_mutex_unlock(&reader->mutex);
+
+	return NULL;
+}
+
+static void dram_reader_free(struct dram_reader *reader)
+{
+	size_t i;
+
+	if (!reader)
+		return;
+
+	if (reader->thread) {
+		g_mutex_lock(&reader->mutex);
+		reader->quit = TRUE;
+		g_cond_broadcast(&reader->cond);
+		g_mutex_unlock(&reader->mutex);
+		g_thread_join(reader->thread);
+	}
+	g_cond_clear(&reader->cond);
+	g_mutex_clear(&reader->mutex);
+	for (i = 0; i < ARRAY_SIZE(reader->lines); i++)
+		sr_buffer_free(reader->lines[i]);
+	g_free(reader);
+}
+
+static struct dram_reader *dram_reader_new(struct dev_context *devc)
+{
+	struct sigma_sample_interp *interp;
+	struct dram_reader *reader;
+	size_t alloc_size, i;
+
+	interp = &devc->interp;
+
+	reader = g_malloc0(sizeof(*reader));
+	reader->devc = devc;
+	reader->next_line = interp->start.line;
+	reader->lines_remain = interp->fetch.lines_total;
+	reader->status = SR_OK;
+	g_mutex_init(&reader->mutex);
+	g_cond_init(&reader->cond);
+
+	alloc_size = sizeof(reader->lines[0][0]);
+	alloc_size *= interp->fetch.lines_per_read;
+	for (i = 0; i < ARRAY_SIZE(reader->lines); i++) {
+		reader->lines[i] = sr_buffer_alloc(NULL, alloc_size);
+		if (!reader->lines[i]) {
+			dram_reader_free(reader);
+			return NULL;
+		}
+	}
+
+	reader->thread = g_thread_try_new("sigma-dram",
+		dram_reader_thread, reader, NULL);
+	if (!reader->thread)
+		sr_warn("Cannot create download thread, reading synchronously.");
+
+	return reader;
+}
+
+/* Get the next block of DRAM lines, wait for the reader if necessary. */
+static int dram_reader_get(struct dram_reader *reader,
+	struct sigma_dram_line **lines, size_t *count)
+{
+	size_t slot;
+	int ret;
+
+	slot = reader->consumed % DRAM_READ_BLOCKS;
+	if (!reader->thread) {
+		ret = dram_reader_read(reader, slot);
+		if (ret != SR_OK)
+			return ret;
+	} else {
+		g_mutex_lock(&reader->mutex);
+		while (reader->filled == reader->consumed &&
+				reader->status == SR_OK)
+			g_cond_wait(&reader->cond, &reader->mutex);
+		ret = reader->status;
+		if (reader->filled != reader->consumed)
+			ret = SR_OK;
+		g_mutex_unlock(&reader->mutex);
+		if (ret != SR_OK)
+			return ret;
+	}
+	*lines = reader->lines[slot];
+	*count = reader->counts[slot];
+
+	return SR_OK;
+}
+
+/* Hand a block which was interpreted back to the reader. */
+static void dram_reader_release(struct dram_reader *reader)
+{
+	if (!reader->thread) {
+		reader->consumed++;
+		return;
+	}
+
+	g_mutex_lock(&reader->mutex);
+	reader->consumed++;
+	g_cond_broadcast(&reader->cond);
+	g_mutex_unlock(&reader->mutex);
+}
+
+static uint16_t sigma_deinterlace_data_4x4(
+	const struct sigma_sample_interp *interp, uint16_t indata);
+static uint16_t sigma_deinterlace_data_2x8(
+	const struct sigma_sample_interp *interp, uint16_t indata);
+static void sigma_build_deinterlace_tables(struct sigma_sample_interp *interp);
+
 static int alloc_sample_buffer(struct dev_context *devc,
 	size_t stop_pos, size_t trig_pos, uint8_t mode)
 {
 	struct sigma_sample_interp *interp;
 	gboolean wrapped;
-	size_t alloc_size;
 
 	interp = &devc->interp;
 
@@ -1422,6 +1604,7 @@ static int alloc_sample_buffer(struct dev_context *devc,
 	}
 	interp->trig.raw = trig_pos;
 	interp->iter.raw = 0;
+	sigma_build_deinterlace_tables(interp);
 
 	/* Break down raw values to line, cluster, event fields. */
 	sigma_location_break_down(&interp->start);
@@ -1447,20 +1630,18 @@ static int alloc_sample_buffer(struct dev_context *devc,
 	interp->fetch.lines_total %= ROW_COUNT;
 	interp->fetch.lines_done = 0;
 
-	/* Arrange for chunked download, N lines per USB request. */
+	/*
+	 * Arrange for chunked download, N lines per USB request. Start
+	 * reading ahead in the background.
+	 */
 	interp->fetch.lines_per_read = 32;
-	alloc_size = sizeof(devc->interp.fetch.rcvd_lines[0]);
-	alloc_size *= devc->interp.fetch.lines_per_read;
-	devc->interp.fetch.rcvd_lines = g_try_malloc0(alloc_size);
-	if (!devc->interp.fetch.rcvd_lines)
+	interp->fetch.reader = dram_reader_new(devc);
+	if (!interp->fetch.reader)
 		return SR_ERR_MALLOC;
 
 	return SR_OK;
 }
 
-static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx);
-static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx);
-
 static int fetch_sample_buffer(struct dev_context *devc)
 {
 	struct sigma_sample_interp *interp;
@@ -1476,16 +1657,12 @@ static int fetch_sample_buffer(struct dev_context *devc)
 		interp->iter = interp->start;
 	}
 
-	/* Get another set of DRAM lines in one read call. */
-	count = interp->fetch.lines_total - interp->fetch.lines_done;
-	if (count > interp->fetch.lines_per_read)
-		count = interp->fetch.lines_per_read;
-	ret = sigma_read_dram(devc, interp->iter.line, count,
-		(uint8_t *)interp->fetch.rcvd_lines);
+	/* Get another set of DRAM lines which the reader received. */
+	ret = dram_reader_get(interp->fetch.reader,
+		&interp->fetch.curr_line, &count);
 	if (ret != SR_OK)
 		return ret;
 	interp->fetch.lines_rcvd = count;
-	interp->fetch.curr_line = &interp->fetch.rcvd_lines[0];
 
 	/* First invocation? Get initial timestamp and sample data. */
 	if (!interp->fetch.lines_done) {
@@ -1493,9 +1670,9 @@ static int fetch_sample_buffer(struct dev_context *devc)
 		ts = read_u16le_inc(&rdptr);
 		data = read_u16le_inc(&rdptr);
 		if (interp->samples_per_event == 4) {
-			data = sigma_deinterlace_data_4x4(data, 0);
+			data = sigma_deinterlace_data_4x4(interp, data) & 0xf;
 		} else if (interp->samples_per_event == 2) {
-			data = sigma_deinterlace_data_2x8(data, 0);
+			data = sigma_deinterlace_data_2x8(interp, data) & 0xff;
 		}
 		interp->last.ts = ts;
 		interp->last.sample = data;
@@ -1504,10 +1681,15 @@ static int fetch_sample_buffer(struct dev_context *devc)
 	return SR_OK;
 }
 
+static void release_sample_buffer(struct dev_context *devc)
+{
+	dram_reader_release(devc->interp.fetch.reader);
+}
+
 static void free_sample_buffer(struct dev_context *devc)
 {
-	g_free(devc->interp.fetch.rcvd_lines);
-	devc->interp.fetch.rcvd_lines = NULL;
+	dram_reader_free(devc->interp.fetch.reader);
+	devc->interp.fetch.reader = NULL;
 	devc->interp.fetch.lines_per_read = 0;
 }
 
@@ -1721,12 +1903,26 @@ static gboolean sample_matches_trigger(struct dev_context *devc, uint16_t sample
 
 static int send_trigger_marker(struct dev_context *devc)
 {
+	struct submit_buffer *buffer;
+	struct sr_datafeed_packet packets[2];
 	int ret;
 
-	ret = flush_submit_buffer(devc);
-	if (ret != SR_OK)
-		return ret;
-	ret = std_session_send_df_trigger(devc->buffer->sdi);
+	/* Have queued samples and the trigger delivered in one batch. */
+	buffer = devc->buffer;
+	if (buffer->curr_samples) {
+		buffer->logic.length = buffer->curr_samples * buffer->unit_size;
+		packets[0] = buffer->packet;
+		packets[1].type = SR_DF_TRIGGER;
+		packets[1].payload = NULL;
+		ret = sr_session_send_batch(buffer->sdi, packets, 2);
+		if (ret != SR_OK)
+			return ret;
+		buffer->curr_samples = 0;
+		buffer->write_pointer = buffer->sample_data;
+		return SR_OK;
+	}
+
+	ret = std_session_send_df_trigger(buffer->sdi);
 	if (ret != SR_OK)
 		return ret;
 
@@ -1811,50 +2007,60 @@ static uint16_t sigma_dram_cluster_data(struct sigma_dram_cluster *cl, int idx)
 /*
  * Deinterlace sample data that was retrieved at 100MHz samplerate.
  * One 16bit item contains two samples of 8bits each. The bits of
- * multiple samples are interleaved.
+ * multiple samples are interleaved. Returns both samples, the earlier
+ * one in the low byte.
  */
-static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx)
+static uint16_t sigma_deinterlace_data_2x8(
+	const struct sigma_sample_interp *interp, uint16_t indata)
 {
-	uint16_t outdata;
-
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 2 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 2 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 2 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 2 - 3)) & (1 << 3);
-	outdata |= (indata >> (4 * 2 - 4)) & (1 << 4);
-	outdata |= (indata >> (5 * 2 - 5)) & (1 << 5);
-	outdata |= (indata >> (6 * 2 - 6)) & (1 << 6);
-	outdata |= (indata >> (7 * 2 - 7)) & (1 << 7);
-	return outdata;
+	return interp->deint_2x8[indata & 0xff] |
+		(interp->deint_2x8[indata >> 8] << 4);
 }
 
 /*
  * Deinterlace sample data that was retrieved at 200MHz samplerate.
  * One 16bit item contains four samples of 4bits each. The bits of
- * multiple samples are interleaved.
+ * multiple samples are interleaved. Returns all four samples, one
+ * per nibble, the earliest one in the lowest nibble.
  */
-static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx)
+static uint16_t sigma_deinterlace_data_4x4(
+	const struct sigma_sample_interp *interp, uint16_t indata)
 {
-	uint16_t outdata;
+	return interp->deint_4x4[indata & 0xff] |
+		(interp->deint_4x4[indata >> 8] << 2);
+}
 
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 4 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 4 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 4 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 4 - 3)) & (1 << 3);
-	return outdata;
+/*
+ * Prepare the lookup tables for deinterlacing. Each table translates
+ * one byte of a 16bit item, the item's upper byte holds the upper half
+ * of each sample's bits.
+ */
+static void sigma_build_deinterlace_tables(struct sigma_sample_interp *interp)
+{
+	size_t byte, bit;
+	uint16_t value_2x8, value_4x4;
+
+	for (byte = 0; byte < ARRAY_SIZE(interp->deint_2x8); byte++) {
+		value_2x8 = 0;
+		value_4x4 = 0;
+		for (bit = 0; bit < 8; bit++) {
+			if (!(byte & (1 << bit)))
+				continue;
+			value_2x8 |= 1 << ((bit % 2) * 8 + bit / 2);
+			value_4x4 |= 1 << ((bit % 4) * 4 + bit / 4);
+		}
+		interp->deint_2x8[byte] = value_2x8;
+		interp->deint_4x4[byte] = value_4x4;
+	}
 }
 
 static void sigma_decode_dram_cluster(struct dev_context *devc,
 	struct sigma_dram_cluster *dram_cluster,
 	size_t events_in_cluster)
 {
-	uint16_t tsdiff, ts, sample, item16;
+	uint16_t tsdiff, ts, sample, item16, group;
 	size_t count;
-	size_t evt;
+	size_t evt, idx;
 
 	/*
 	 * If this cluster is not adjacent to the previously received
@@ -1886,23 +2092,19 @@ static void sigma_decode_dram_cluster(struct dev_context *devc,
 	for (evt = 0; evt < events_in_cluster; evt++) {
 		item16 = sigma_dram_cluster_data(dram_cluster, evt);
 		if (devc->interp.samples_per_event == 4) {
-			sample = sigma_deinterlace_data_4x4(item16, 0);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 1);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 2);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 3);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
+			group = sigma_deinterlace_data_4x4(&devc->interp, item16);
+			for (idx = 0; idx < 4; idx++) {
+				sample = group & 0xf;
+				check_and_submit_sample(devc, sample, 1);
+				devc->interp.last.sample = sample;
+				group >>= 4;
+			}
 		} else if (devc->interp.samples_per_event == 2) {
-			sample = sigma_deinterlace_data_2x8(item16, 0);
+			group = sigma_deinterlace_data_2x8(&devc->interp, item16);
+			sample = group & 0xff;
 			check_and_submit_sample(devc, sample, 1);
 			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_2x8(item16, 1);
+			sample = group >> 8;
 			check_and_submit_sample(devc, sample, 1);
 			devc->interp.last.sample = sample;
 		} else {
@@ -1978,11 +2180,17 @@ static int download_capture(struct sr_dev_inst *sdi)
 	 * FORCESTOP request makes the hardware "disable RLE" (store
 	 * clusters to DRAM regardless of whether pin state changes) and
 	 * raise the POSTTRIGGERED flag.
+	 *
+	 * Skip the check while the download is in progress, the reader
+	 * thread owns the device's communication channel then.
 	 */
-	ret = sigma_get_register(devc, READ_MODE, &modestatus);
-	if (ret != SR_OK) {
-		sr_err("Could not determine current device state.");
-		return FALSE;
+	modestatus = RMR_POSTTRIGGERED;
+	if (!interp->fetch.lines_per_read) {
+		ret = sigma_get_register(devc, READ_MODE, &modestatus);
+		if (ret != SR_OK) {
+			sr_err("Could not determine current device state.");
+			return FALSE;
+		}
 	}
 	if (!(modestatus & RMR_POSTTRIGGERED)) {
 		sr_info("Downloading sample data.");
@@ -2055,8 +2263,11 @@ static int download_capture(struct sr_dev_inst *sdi)
 
 		/* Read another chunk of sample memory (several lines). */
 		ret = fetch_sample_buffer(devc);
-		if (ret != SR_OK)
+		if (ret != SR_OK) {
+			sr_err("Could not read sample memory.");
+			sigma_abort_download(devc);
 			return FALSE;
+		}
 
 		/* Process lines of sample data. Last line may be short. */
 		while (interp->fetch.lines_rcvd--) {
@@ -2069,6 +2280,7 @@ static int download_capture(struct sr_dev_inst *sdi)
 			interp->fetch.curr_line++;
 			interp->fetch.lines_done++;
 		}
+		release_sample_buffer(devc);
 
 		/* Keep returning to application code for large data sets. */
 		if (!--chunks_per_receive_call) {
@@ -2102,6 +2314,16 @@ static int download_capture(struct sr_dev_inst *sdi)
 	return TRUE;
 }
 
+/*
+ * Release the resources of an incomplete sample memory download. Stops
+ * the reader thread if it is still running.
+ */
+SR_PRIV void sigma_abort_download(struct dev_context *devc)
+{
+	free_submit_buffer(devc);
+	free_sample_buffer(devc);
+}
+
 /*
  * Periodically check the Sigma status when in CAPTURE mode. This routine
  * checks whether the configured sample count or sample time have passed,
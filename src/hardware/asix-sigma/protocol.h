@@ -322,6 +322,7 @@ enum ext_clock_edge_t {
 };
 
 struct submit_buffer;
+struct dram_reader;
 
 struct dev_context {
 	struct {
@@ -359,6 +360,9 @@ struct dev_context {
 			uint16_t ts;
 			uint16_t sample;
 		} last;
+		/* Per byte lookup tables for 100/200 MHz deinterlacing. */
+		uint16_t deint_2x8[256];
+		uint16_t deint_4x4[256];
 		struct sigma_location {
 			size_t raw, line, cluster, event;
 		} start, stop, trig, iter, trig_arm;
@@ -366,7 +370,7 @@ struct dev_context {
 			size_t lines_total, lines_done;
 			size_t lines_per_read; /* USB transfer limit */
 			size_t lines_rcvd;
-			struct sigma_dram_line *rcvd_lines;
+			struct dram_reader *reader;
 			struct sigma_dram_line *curr_line;
 		} fetch;
 		struct {
@@ -421,5 +425,6 @@ SR_PRIV int sigma_build_basic_trigger(struct dev_context *devc,
 
 /* Callback to periodically drive acuisition progress. */
 SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV void sigma_abort_download(struct dev_context *devc);
 
 #endif
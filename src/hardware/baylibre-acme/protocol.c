@@ -39,9 +39,45 @@ enum channel_type {
 	TEMP_OUT,
 };
 
+/*
+ * Energy probes bound to the ina2xx-adc IIO driver instead of the hwmon
+ * one are read through the IIO buffer: the kernel samples bus voltage,
+ * power and current in the background, and one read() of the character
+ * device returns all three. These are the scan elements we enable, in
+ * the order of their scan index.
+ */
+#define IIO_NUM_CHANNELS	3
+
+/* Records drained from the buffer per read(). */
+#define IIO_READ_RECORDS	64
+
+struct iio_scan_element {
+	unsigned int offset;
+	unsigned int bytes;
+	unsigned int shift;
+	unsigned int bits;
+	gboolean is_signed;
+	gboolean is_be;
+	float scale;
+};
+
+static const struct {
+	int ch_type;
+	const char *name;
+} iio_channels[IIO_NUM_CHANNELS] = {
+	{ ENRG_VOL,	"in_voltage1" },
+	{ ENRG_PWR,	"in_power2" },
+	{ ENRG_CURR,	"in_current3" },
+};
+
 struct channel_group_priv {
 	uint8_t rev;
 	int hwmon_num;
+	int iio_num;
+	int iio_fd;
+	size_t iio_record_size;
+	struct iio_scan_element iio_scan[IIO_NUM_CHANNELS];
+	float iio_val[IIO_NUM_CHANNELS];
 	int probe_type;
 	int index;
 	int has_pws;
@@ -147,6 +183,12 @@ static void probe_hwmon_path(unsigned int addr, GString *path)
 			"/sys/class/i2c-adapter/i2c-1/1-00%02x/hwmon", addr);
 }
 
+static void probe_dev_path(unsigned int addr, GString *path)
+{
+	g_string_printf(path,
+			"/sys/class/i2c-adapter/i2c-1/1-00%02x", addr);
+}
+
 static void probe_eeprom_path(unsigned int addr, GString *path)
 {
 	g_string_printf(path,
@@ -154,6 +196,34 @@ static void probe_eeprom_path(unsigned int addr, GString *path)
 			addr + 0x10);
 }
 
+/*
+ * Returns the index of the IIO device registered for the probe at the
+ * given address, or -1 if its driver is not an IIO one.
+ */
+static int get_iio_index(unsigned int addr)
+{
+	GString *path = g_string_sized_new(64);
+	const char *name;
+	GDir *dir;
+	int iio;
+
+	probe_dev_path(addr, path);
+	dir = g_dir_open(path->str, 0, NULL);
+	g_string_free(path, TRUE);
+	if (!dir)
+		return -1;
+
+	iio = -1;
+	while ((name = g_dir_read_name(dir))) {
+		if (sscanf(name, "iio:device%d", &iio) == 1)
+			break;
+		iio = -1;
+	}
+	g_dir_close(dir);
+
+	return iio;
+}
+
 SR_PRIV gboolean bl_acme_detect_probe(unsigned int addr,
 				      int prb_num, const char *prb_name)
 {
@@ -182,7 +252,7 @@ SR_PRIV gboolean bl_acme_detect_probe(unsigned int addr,
 		 */
 		probe_hwmon_path(addr, path);
 		status = g_file_test(path->str, G_FILE_TEST_IS_DIR);
-		if (status) {
+		if (status || get_iio_index(addr) >= 0) {
 			/* We have found an ACME probe. */
 			ret = TRUE;
 		}
@@ -324,13 +394,19 @@ SR_PRIV gboolean bl_acme_register_probe(struct sr_dev_inst *sdi, int type,
 	struct sr_channel_group *cg;
 	struct channel_group_priv *cgp;
 	struct probe_eeprom eeprom;
-	int hwmon, status;
+	int hwmon, iio, status;
 	uint32_t gpio;
 
-	/* Obtain the hwmon index. */
-	hwmon = get_hwmon_index(addr);
-	if (hwmon < 0)
-		return FALSE;
+	/* Energy probes may use the IIO driver, else obtain the hwmon index. */
+	hwmon = -1;
+	iio = type == PROBE_ENRG ? get_iio_index(addr) : -1;
+	if (iio < 0) {
+		hwmon = get_hwmon_index(addr);
+		if (hwmon < 0)
+			return FALSE;
+	} else {
+		sr_dbg("Probe at 0x%02x uses iio:device%d.", addr, iio);
+	}
 
 	cgp = g_malloc0(sizeof(struct channel_group_priv));
 	cg = sr_channel_group_new(sdi, NULL, cgp);
@@ -346,6 +422,8 @@ SR_PRIV gboolean bl_acme_register_probe(struct sr_dev_inst *sdi, int type,
 	prb_num = cgp->rev == ACME_REV_A ? prb_num : revB_addr_to_num(addr);
 
 	cgp->hwmon_num = hwmon;
+	cgp->iio_num = iio;
+	cgp->iio_fd = -1;
 	cgp->probe_type = type;
 	cgp->index = prb_num - 1;
 	cg->name = g_strdup_printf("Probe_%d", prb_num);
@@ -413,9 +491,15 @@ static int get_shunt_path(const struct sr_channel_group *cg, GString *path)
 		return SR_ERR_ARG;
 	}
 
-	g_string_append_printf(path,
-			       "/sys/class/hwmon/hwmon%d/shunt_resistor",
-			       cgp->hwmon_num);
+	/* Both drivers take the resistance in micro-ohms. */
+	if (cgp->iio_num >= 0)
+		g_string_append_printf(path,
+				"/sys/bus/iio/devices/iio:device%d/in_shunt_resistor",
+				cgp->iio_num);
+	else
+		g_string_append_printf(path,
+				"/sys/class/hwmon/hwmon%d/shunt_resistor",
+				cgp->hwmon_num);
 
 	/*
 	 * The shunt_resistor sysfs attribute is available
@@ -433,8 +517,8 @@ static int get_shunt_path(const struct sr_channel_group *cg, GString *path)
 }
 
 /*
- * Try setting the update_interval sysfs attribute for each probe according
- * to samplerate.
+ * Try setting the update_interval sysfs attribute (or the sampling
+ * frequency for IIO probes) for each probe according to samplerate.
  */
 SR_PRIV void bl_acme_maybe_set_update_interval(const struct sr_dev_inst *sdi,
 					       uint64_t samplerate)
@@ -450,7 +534,12 @@ SR_PRIV void bl_acme_maybe_set_update_interval(const struct sr_dev_inst *sdi,
 		cgp = cg->priv;
 
 		hwmon = g_string_sized_new(64);
-		g_string_append_printf(hwmon,
+		if (cgp->iio_num >= 0)
+			g_string_append_printf(hwmon,
+				"/sys/bus/iio/devices/iio:device%d/in_sampling_frequency",
+				cgp->iio_num);
+		else
+			g_string_append_printf(hwmon,
 				"/sys/class/hwmon/hwmon%d/update_interval",
 				cgp->hwmon_num);
 
@@ -461,7 +550,10 @@ SR_PRIV void bl_acme_maybe_set_update_interval(const struct sr_dev_inst *sdi,
 				continue;
 			}
 
-			g_fprintf(fd, "%" PRIu64 "\n", 1000 / samplerate);
+			if (cgp->iio_num >= 0)
+				g_fprintf(fd, "%" PRIu64 "\n", samplerate);
+			else
+				g_fprintf(fd, "%" PRIu64 "\n", 1000 / samplerate);
 			fclose(fd);
 		}
 
@@ -629,6 +721,203 @@ static int type_digits(int type)
 	}
 }
 
+static int iio_channel_index(int ch_type)
+{
+	int i;
+
+	for (i = 0; i < IIO_NUM_CHANNELS; i++) {
+		if (iio_channels[i].ch_type == ch_type)
+			return i;
+	}
+
+	return -1;
+}
+
+static int iio_write_attr(int iio, const char *attr, const char *val)
+{
+	char path[96];
+	FILE *fd;
+
+	snprintf(path, sizeof(path), "/sys/bus/iio/devices/iio:device%d/%s",
+		 iio, attr);
+
+	/* See bl_acme_set_shunt() for why not g_file_set_contents(). */
+	fd = g_fopen(path, "w");
+	if (!fd) {
+		sr_err("Error opening %s: %s", path, g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	g_fprintf(fd, "%s\n", val);
+	if (fclose(fd)) {
+		sr_err("Error writing %s: %s", path, g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static char *iio_read_attr(int iio, const char *attr)
+{
+	char *path, *contents;
+
+	path = g_strdup_printf("/sys/bus/iio/devices/iio:device%d/%s",
+			       iio, attr);
+	if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+		sr_err("Error reading %s.", path);
+		contents = NULL;
+	}
+	g_free(path);
+
+	return contents;
+}
+
+/* Parse an element's "le:s16/16>>0" type and its scale. */
+static int iio_parse_scan_element(int iio, const char *name,
+				  struct iio_scan_element *el)
+{
+	char attr[64], *contents;
+	char endian, sign;
+	unsigned int bits, storage, shift;
+	int num;
+
+	snprintf(attr, sizeof(attr), "scan_elements/%s_type", name);
+	if (!(contents = iio_read_attr(iio, attr)))
+		return SR_ERR_IO;
+	num = sscanf(contents, "%ce:%c%u/%u>>%u",
+		     &endian, &sign, &bits, &storage, &shift);
+	g_free(contents);
+	if (num != 5 || !bits || bits > storage || storage > 32 ||
+	    storage % 8) {
+		sr_err("Unsupported IIO scan element type for %s.", name);
+		return SR_ERR_DATA;
+	}
+	el->bits = bits;
+	el->bytes = storage / 8;
+	el->shift = shift;
+	el->is_signed = sign == 's';
+	el->is_be = endian == 'b';
+
+	snprintf(attr, sizeof(attr), "%s_scale", name);
+	if (!(contents = iio_read_attr(iio, attr)))
+		return SR_ERR_IO;
+	el->scale = g_ascii_strtod(contents, NULL);
+	g_free(contents);
+
+	return SR_OK;
+}
+
+/*
+ * Enable the voltage, power and current scan elements, and the buffer,
+ * then open the character device. Elements are stored in scan index
+ * order, each aligned to its own size.
+ */
+static int iio_buffer_open(struct channel_group_priv *cgp)
+{
+	struct iio_scan_element *el;
+	char attr[64], path[32];
+	size_t offset;
+	int i;
+
+	/* A previous session may have left the buffer enabled. */
+	iio_write_attr(cgp->iio_num, "buffer/enable", "0");
+	iio_write_attr(cgp->iio_num, "scan_elements/in_voltage0_en", "0");
+	iio_write_attr(cgp->iio_num, "scan_elements/in_timestamp_en", "0");
+
+	offset = 0;
+	for (i = 0; i < IIO_NUM_CHANNELS; i++) {
+		el = &cgp->iio_scan[i];
+		snprintf(attr, sizeof(attr), "scan_elements/%s_en",
+			 iio_channels[i].name);
+		if (iio_write_attr(cgp->iio_num, attr, "1") != SR_OK)
+			return SR_ERR_IO;
+		if (iio_parse_scan_element(cgp->iio_num,
+					   iio_channels[i].name, el) != SR_OK)
+			return SR_ERR;
+		offset = (offset + el->bytes - 1) / el->bytes * el->bytes;
+		el->offset = offset;
+		offset += el->bytes;
+	}
+	cgp->iio_record_size = offset;
+
+	if (iio_write_attr(cgp->iio_num, "buffer/length", "1024") != SR_OK ||
+	    iio_write_attr(cgp->iio_num, "buffer/enable", "1") != SR_OK)
+		return SR_ERR_IO;
+
+	snprintf(path, sizeof(path), "/dev/iio:device%d", cgp->iio_num);
+	cgp->iio_fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (cgp->iio_fd < 0) {
+		sr_err("Error opening %s: %s", path, g_strerror(errno));
+		iio_write_attr(cgp->iio_num, "buffer/enable", "0");
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static void iio_buffer_close(struct channel_group_priv *cgp)
+{
+	if (cgp->iio_fd < 0)
+		return;
+
+	close(cgp->iio_fd);
+	cgp->iio_fd = -1;
+	iio_write_attr(cgp->iio_num, "buffer/enable", "0");
+}
+
+static float iio_decode(const struct iio_scan_element *el,
+			const uint8_t *rec)
+{
+	uint32_t raw;
+	int32_t val;
+	unsigned int i;
+
+	raw = 0;
+	for (i = 0; i < el->bytes; i++) {
+		if (el->is_be)
+			raw = (raw << 8) | rec[el->offset + i];
+		else
+			raw |= (uint32_t)rec[el->offset + i] << (8 * i);
+	}
+	raw >>= el->shift;
+	if (el->bits < 32)
+		raw &= (1UL << el->bits) - 1;
+	if (el->is_signed && el->bits < 32 && (raw & (1UL << (el->bits - 1))))
+		val = (int32_t)(raw - (1UL << el->bits));
+	else
+		val = (int32_t)raw;
+
+	return val * el->scale;
+}
+
+/*
+ * Drain what the kernel buffered since the last timer tick and keep
+ * the values of the most recent record. One read() covers all three
+ * channels, instead of a synchronous I2C transfer per sysfs read.
+ */
+static void iio_buffer_read(struct channel_group_priv *cgp)
+{
+	/* Elements are at most 32 bits wide. */
+	uint8_t buf[IIO_READ_RECORDS * IIO_NUM_CHANNELS * sizeof(uint32_t)];
+	size_t chunk;
+	ssize_t len;
+	int i;
+
+	chunk = cgp->iio_record_size * IIO_READ_RECORDS;
+	while ((len = read(cgp->iio_fd, buf, chunk)) > 0) {
+		if ((size_t)len < cgp->iio_record_size)
+			break;
+		len -= len % cgp->iio_record_size;
+		for (i = 0; i < IIO_NUM_CHANNELS; i++)
+			cgp->iio_val[i] = iio_decode(&cgp->iio_scan[i],
+				buf + len - cgp->iio_record_size);
+		if ((size_t)len < chunk)
+			break;
+	}
+	if (len < 0 && errno != EAGAIN)
+		sr_err("Error reading from iio:device%d: %s",
+		       cgp->iio_num, g_strerror(errno));
+}
+
 static float read_sample(struct sr_channel *ch)
 {
 	struct channel_priv *chp;
@@ -639,6 +928,13 @@ static float read_sample(struct sr_channel *ch)
 	chp = ch->priv;
 	fd = chp->fd;
 
+	chp->digits = type_digits(chp->ch_type);
+
+	/* The IIO driver scales to milli-units, like hwmon's voltage. */
+	if (chp->probe->iio_num >= 0)
+		return chp->probe->iio_val[iio_channel_index(chp->ch_type)] /
+			1000.0;
+
 	lseek(fd, 0, SEEK_SET);
 
 	len = read(fd, buf, sizeof(buf));
@@ -649,7 +945,6 @@ static float read_sample(struct sr_channel *ch)
 		return -1.0;
 	}
 
-	chp->digits = type_digits(chp->ch_type);
 	return strtol(buf, NULL, 10) * powf(10, -chp->digits);
 }
 
@@ -662,6 +957,19 @@ SR_PRIV int bl_acme_open_channel(struct sr_channel *ch)
 
 	chp = ch->priv;
 
+	/* All channels of an IIO probe share its buffer. */
+	if (chp->probe->iio_num >= 0) {
+		chp->fd = -1;
+		if (chp->probe->iio_fd >= 0)
+			return 0;
+		if (iio_buffer_open(chp->probe) != SR_OK) {
+			iio_buffer_close(chp->probe);
+			ch->enabled = FALSE;
+			return SR_ERR;
+		}
+		return 0;
+	}
+
 	switch (chp->ch_type) {
 	case ENRG_PWR:	file = "power1_input";	break;
 	case ENRG_CURR:	file = "curr1_input";	break;
@@ -693,6 +1001,10 @@ SR_PRIV void bl_acme_close_channel(struct sr_channel *ch)
 	struct channel_priv *chp;
 
 	chp = ch->priv;
+	if (chp->probe->iio_num >= 0) {
+		iio_buffer_close(chp->probe);
+		return;
+	}
 	close(chp->fd);
 	chp->fd = -1;
 }
@@ -709,6 +1021,7 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 	struct sr_channel *ch;
 	struct channel_priv *chp;
 	struct dev_context *devc;
+	struct channel_group_priv *cgp;
 	GSList *chl, chonly;
 	unsigned i;
 
@@ -739,6 +1052,12 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 	if (nrexpiration > 1)
 		devc->samples_missed += nrexpiration - 1;
 
+	for (chl = sdi->channel_groups; chl; chl = chl->next) {
+		cgp = ((struct sr_channel_group *)chl->data)->priv;
+		if (cgp->iio_fd >= 0)
+			iio_buffer_read(cgp);
+	}
+
 	/*
 	 * XXX This is a nasty workaround...
 	 *
@@ -187,7 +187,13 @@ static int dev_open(struct sr_dev_inst *sdi)
 			return SR_ERR;
 		}
 	} else {
-		devc->tcp_buffer = g_malloc(TCP_BUFFER_SIZE);
+		sr_datafeed_buffer_unref(devc->tcp_buffer);
+		devc->tcp_buffer = sr_datafeed_buffer_new(TCP_BUFFER_SIZE);
+		if (!devc->tcp_buffer) {
+			sr_err("Unable to allocate receive buffer");
+			devc->beaglelogic->close(devc);
+			return SR_ERR_MALLOC;
+		}
 	}
 
 	return SR_OK;
@@ -207,7 +213,7 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 static void clear_helper(struct dev_context *devc)
 {
-	g_free(devc->tcp_buffer);
+	sr_datafeed_buffer_unref(devc->tcp_buffer);
 	g_free(devc->address);
 	g_free(devc->port);
 }
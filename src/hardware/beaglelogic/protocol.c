@@ -40,6 +40,9 @@
  * It does not copy any data, just passes a pointer from the mmap'ed
  * kernel buffers appropriately. It is up to the application which is
  * using libsigrok to decide how to deal with the data.
+ * The packets are deliberately not backed by a refcounted buffer: the
+ * PRUs keep filling the ring whatever the read position is, so packets
+ * queued for a dispatch thread must take a copy.
  */
 SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 {
@@ -123,8 +126,9 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	uint8_t *buf;
 
-	int len;
+	int len, ret;
 	int pre_trigger_samples;
 	int trigger_offset;
 	uint32_t packetsize;
@@ -139,11 +143,34 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 	if (revents == G_IO_IN) {
 		sr_info("In callback G_IO_IN");
 
-		len = recv(fd, devc->tcp_buffer, TCP_BUFFER_SIZE, 0);
+		/* Queued packets may still use the buffer, take a fresh one. */
+		if (sr_datafeed_buffer_is_shared(devc->tcp_buffer)) {
+			sr_datafeed_buffer_unref(devc->tcp_buffer);
+			devc->tcp_buffer = sr_datafeed_buffer_new(TCP_BUFFER_SIZE);
+			if (!devc->tcp_buffer) {
+				sr_err("Unable to allocate receive buffer");
+				return SR_ERR;
+			}
+		}
+		buf = sr_datafeed_buffer_data(devc->tcp_buffer);
+
+		len = recv(fd, (char *)buf, TCP_BUFFER_SIZE, 0);
 		if (len < 0) {
 			sr_err("Receive error: %s", g_strerror(errno));
 			return SR_ERR;
 		}
+#ifdef MSG_DONTWAIT
+		/* Collect what else has arrived, for fewer and larger packets. */
+		while (len > 0 && len < TCP_BUFFER_SIZE) {
+			ret = recv(fd, (char *)buf + len, TCP_BUFFER_SIZE - len,
+				MSG_DONTWAIT);
+			if (ret <= 0)
+				break;
+			len += ret;
+		}
+#else
+		(void)ret;
+#endif
 
 		packetsize = len;
 
@@ -153,12 +180,12 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 		/* Configure data packet */
 		packet.type = SR_DF_LOGIC;
 		packet.payload = &logic;
-		logic.data = devc->tcp_buffer;
+		logic.data = buf;
 		logic.length = MIN(packetsize, bytes_remaining);
 
 		if (devc->trigger_fired) {
 			/* Send the incoming transfer to the session bus. */
-			sr_session_send(sdi, &packet);
+			sr_session_send_buffer(sdi, &packet, devc->tcp_buffer);
 		} else {
 			/* Check for trigger */
 			trigger_offset = soft_trigger_logic_check(devc->stl,
@@ -170,7 +197,8 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 						bytes_remaining);
 				logic.data += trigger_offset;
 
-				sr_session_send(sdi, &packet);
+				sr_session_send_buffer(sdi, &packet,
+					devc->tcp_buffer);
 
 				devc->trigger_fired = TRUE;
 			}
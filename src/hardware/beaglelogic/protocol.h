@@ -32,7 +32,7 @@
 
 #define SAMPLEUNIT_TO_BYTES(x)	((x) == 1 ? 1 : 2)
 
-#define TCP_BUFFER_SIZE         (128 * 1024)
+#define TCP_BUFFER_SIZE         (1024 * 1024)
 
 /** Private, per-device-instance driver context. */
 struct dev_context {
@@ -47,7 +47,8 @@ struct dev_context {
 	char *port;
 	int socket;
 	unsigned int read_timeout;
-	unsigned char *tcp_buffer;
+	/* Refcounted, queued packets may still point into it. */
+	struct sr_datafeed_buffer *tcp_buffer;
 
 	/* Acquisition settings: see beaglelogic.h */
 	uint64_t cur_samplerate;
@@ -151,7 +151,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		conn_devices = NULL;
 
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
@@ -69,6 +69,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_AVG_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_UNTHROTTLED | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t devopts_cg_logic[] = {
@@ -148,6 +149,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devc->limit_frames = limit_frames;
 	devc->capture_ratio = 20;
 	devc->stl = NULL;
+	demo_seed_logic_random(devc);
 
 	if (num_logic_channels > 0) {
 		/* Logic channels, all in one channel group. */
@@ -220,6 +222,7 @@ static void clear_helper(struct dev_context *devc)
 	void *value;
 
 	demo_free_analog_pattern(devc);
+	demo_free_logic_period(devc);
 
 	/* Analog generators. */
 	g_hash_table_iter_init(&iter, devc->ch_ag);
@@ -315,6 +318,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
 		break;
+	case SR_CONF_CAPTURE_UNTHROTTLED:
+		*data = g_variant_new_boolean(devc->unthrottled);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -428,6 +434,11 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_CAPTURE_RATIO:
 		devc->capture_ratio = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_CAPTURE_UNTHROTTLED:
+		devc->unthrottled = g_variant_get_boolean(data);
+		sr_dbg("%s unthrottled acquisition",
+			devc->unthrottled ? "Enabling" : "Disabling");
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -574,12 +585,16 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->spent_us = 0;
 	devc->step = 0;
 
+	if (devc->unthrottled && devc->enabled_logic_channels)
+		demo_prepare_logic_buffer((struct sr_dev_inst *)sdi);
+
 	return SR_OK;
 }
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	double elapsed;
 
 	sr_session_source_remove(sdi->session, -1);
 
@@ -587,6 +602,14 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	if (devc->limit_frames > 0)
 		std_session_send_df_frame_end(sdi);
 
+	if (devc->unthrottled) {
+		elapsed = (g_get_monotonic_time() - devc->start_us) / 1e6;
+		sr_info("Sent %" PRIu64 " samples in %.3f s, %.1f Msamples/s.",
+			devc->sent_samples, elapsed,
+			devc->sent_samples / MAX(elapsed, 1e-6) / 1e6);
+	}
+	demo_free_logic_buffer(devc);
+
 	std_session_send_df_end(sdi);
 
 	if (devc->stl) {
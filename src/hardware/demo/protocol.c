@@ -274,7 +274,40 @@ static void set_logic_data(uint64_t bits, uint8_t *data, size_t len)
 	}
 }
 
-static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
+/*
+ * Pseudo-random data from independent xorshift64 generators, which are
+ * advanced side by side so that the compiler can vectorize the loop.
+ */
+static void logic_random(struct dev_context *devc, uint8_t *data, uint64_t size)
+{
+	uint64_t *state, x, words[LOGIC_RNG_LANES];
+	uint64_t i;
+	size_t k;
+
+	state = devc->logic_rng;
+	for (i = 0; i < size; i += sizeof(words)) {
+		for (k = 0; k < LOGIC_RNG_LANES; k++) {
+			x = state[k];
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			state[k] = x;
+			words[k] = x;
+		}
+		memcpy(data + i, words, MIN(sizeof(words), size - i));
+	}
+}
+
+SR_PRIV void demo_seed_logic_random(struct dev_context *devc)
+{
+	size_t k;
+
+	/* Any non-zero seed will do, xorshift never leaves zero. */
+	for (k = 0; k < LOGIC_RNG_LANES; k++)
+		devc->logic_rng[k] = 0x9e3779b97f4a7c15ULL * (k + 1);
+}
+
+static void logic_compute(struct sr_dev_inst *sdi, uint8_t *data, uint64_t size)
 {
 	struct dev_context *devc;
 	uint64_t i, j;
@@ -288,23 +321,22 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 
 	switch (devc->logic_pattern) {
 	case PATTERN_SIGROK:
-		memset(devc->logic_data, 0x00, size);
+		memset(data, 0x00, size);
 		for (i = 0; i < size; i += devc->logic_unitsize) {
 			for (j = 0; j < devc->logic_unitsize; j++) {
 				pat = pattern_sigrok[(devc->step + j) % sizeof(pattern_sigrok)] >> 1;
-				devc->logic_data[i + j] = ~pat;
+				data[i + j] = ~pat;
 			}
 			devc->step++;
 		}
 		break;
 	case PATTERN_RANDOM:
-		for (i = 0; i < size; i++)
-			devc->logic_data[i] = (uint8_t)(rand() & 0xff);
+		logic_random(devc, data, size);
 		break;
 	case PATTERN_INC:
 		for (i = 0; i < size; i++) {
 			for (j = 0; j < devc->logic_unitsize; j++)
-				devc->logic_data[i + j] = devc->step;
+				data[i + j] = devc->step;
 			devc->step++;
 		}
 		break;
@@ -312,7 +344,7 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 		/* j contains the value of the highest bit */
 		j = 1 << (devc->num_logic_channels - 1);
 		for (i = 0; i < size; i++) {
-			devc->logic_data[i] = devc->step;
+			data[i] = devc->step;
 			if (devc->step == 0)
 				devc->step = 1;
 			else
@@ -327,7 +359,7 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 		/* j contains the value of the highest bit */
 		j = 1 << (devc->num_logic_channels - 1);
 		for (i = 0; i < size; i++) {
-			devc->logic_data[i] = ~devc->step;
+			data[i] = ~devc->step;
 			if (devc->step == 0)
 				devc->step = 1;
 			else
@@ -342,11 +374,11 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 		/* These were set when the pattern mode was selected. */
 		break;
 	case PATTERN_SQUID:
-		memset(devc->logic_data, 0x00, size);
+		memset(data, 0x00, size);
 		col_count = ARRAY_SIZE(pattern_squid);
 		col_height = ARRAY_SIZE(pattern_squid[0]);
 		for (i = 0; i < size; i += devc->logic_unitsize) {
-			sample = &devc->logic_data[i];
+			sample = &data[i];
 			image_col = pattern_squid[devc->step];
 			for (j = 0; j < devc->logic_unitsize; j++) {
 				pat = image_col[j % col_height];
@@ -362,7 +394,7 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 			devc->step &= devc->all_logic_channels_mask;
 			gray = encode_number_to_gray(devc->step);
 			gray &= devc->all_logic_channels_mask;
-			set_logic_data(gray, &devc->logic_data[i], devc->logic_unitsize);
+			set_logic_data(gray, &data[i], devc->logic_unitsize);
 		}
 		break;
 	default:
@@ -371,6 +403,100 @@ static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
 	}
 }
 
+/*
+ * Length in bytes after which the data of the current logic pattern
+ * repeats itself, or 0 if the pattern isn't worth (or can't be) cached.
+ */
+static size_t logic_period_len(struct dev_context *devc)
+{
+	size_t len;
+
+	switch (devc->logic_pattern) {
+	case PATTERN_SIGROK:
+		len = sizeof(pattern_sigrok) * devc->logic_unitsize;
+		break;
+	case PATTERN_INC:
+		/* The counter advances per byte, and wraps with it. */
+		len = 256;
+		break;
+	case PATTERN_WALKING_ONE:
+	case PATTERN_WALKING_ZERO:
+		/* One state per channel, plus the all-zero (all-one) one. */
+		if (devc->num_logic_channels >= 32)
+			return 0;
+		len = devc->num_logic_channels + 1;
+		break;
+	case PATTERN_SQUID:
+		len = ARRAY_SIZE(pattern_squid) * devc->logic_unitsize;
+		break;
+	case PATTERN_GRAYCODE:
+		if (devc->num_logic_channels > 16)
+			return 0;
+		len = (devc->all_logic_channels_mask + 1) * devc->logic_unitsize;
+		break;
+	default:
+		/* Random data doesn't repeat, all low/high is static. */
+		return 0;
+	}
+
+	return len <= LOGIC_PERIOD_MAX ? len : 0;
+}
+
+/*
+ * Precompute one period of the current logic pattern, followed by as
+ * much of the next period as a single generator call can ask for. Any
+ * chunk of the pattern then is a copy from the cache at the current
+ * phase, which devc->step holds for cached patterns.
+ */
+static void logic_period_build(struct sr_dev_inst *sdi, size_t len)
+{
+	struct dev_context *devc;
+	uint64_t step;
+
+	devc = sdi->priv;
+
+	g_free(devc->logic_period);
+	/* PATTERN_INC writes up to one unit past the requested size. */
+	devc->logic_period = g_malloc(len + LOGIC_BUFSIZE + devc->logic_unitsize);
+	devc->logic_period_len = len;
+	devc->logic_period_pattern = devc->logic_pattern;
+
+	step = devc->step;
+	devc->step = 0;
+	logic_compute(sdi, devc->logic_period, len + LOGIC_BUFSIZE);
+	devc->step = step % len;
+}
+
+SR_PRIV void demo_free_logic_period(struct dev_context *devc)
+{
+	g_free(devc->logic_period);
+	devc->logic_period = NULL;
+	devc->logic_period_len = 0;
+}
+
+static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
+{
+	struct dev_context *devc;
+	size_t len;
+
+	devc = sdi->priv;
+
+	if (!devc->logic_period || devc->logic_period_pattern != devc->logic_pattern) {
+		demo_free_logic_period(devc);
+		len = logic_period_len(devc);
+		if (len)
+			logic_period_build(sdi, len);
+	}
+
+	if (!devc->logic_period) {
+		logic_compute(sdi, devc->logic_data, size);
+		return;
+	}
+
+	memcpy(devc->logic_data, devc->logic_period + devc->step, size);
+	devc->step = (devc->step + size) % devc->logic_period_len;
+}
+
 /*
  * Fixup a memory image of generated logic data before it gets sent to
  * the session's datafeed. Mask out content from disabled channels.
@@ -572,47 +698,68 @@ do_send:
 	}
 }
 
-/* Callback handling data */
-SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
+/*
+ * Precompute the logic data for unthrottled acquisition. The buffer gets
+ * filled by the regular generator and is masked once, so that sending it
+ * over and over again comes at no generation cost.
+ */
+SR_PRIV void demo_prepare_logic_buffer(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_logic logic;
+	size_t chunk, len, off;
+
+	devc = sdi->priv;
+
+	len = UNTHROTTLED_BUFSIZE / devc->logic_unitsize * devc->logic_unitsize;
+	chunk = LOGIC_BUFSIZE / devc->logic_unitsize * devc->logic_unitsize;
+	devc->logic_buf = g_malloc(len);
+	devc->logic_send = g_malloc(len);
+	devc->logic_buf_samples = len / devc->logic_unitsize;
+	devc->logic_buf_pos = 0;
+
+	for (off = 0; off < len; off += chunk) {
+		chunk = MIN(chunk, len - off);
+		logic_generator(sdi, chunk);
+		memcpy(devc->logic_buf + off, devc->logic_data, chunk);
+	}
+
+	logic.unitsize = devc->logic_unitsize;
+	logic.length = len;
+	logic.data = devc->logic_buf;
+	logic_fixup_feed(devc, &logic);
+}
+
+SR_PRIV void demo_free_logic_buffer(struct dev_context *devc)
+{
+	g_free(devc->logic_buf);
+	g_free(devc->logic_send);
+	devc->logic_buf = NULL;
+	devc->logic_send = NULL;
+	devc->logic_buf_samples = 0;
+}
+
+/*
+ * Send the given number of samples at most (less when a limit is reached).
+ * Returns FALSE when the acquisition was stopped.
+ */
+static gboolean send_samples(struct sr_dev_inst *sdi, uint64_t samples_todo,
+		int64_t limit_us)
 {
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 	struct analog_gen *ag;
 	GHashTableIter iter;
 	void *value;
-	uint64_t samples_todo, logic_done, analog_done, analog_sent, sending_now;
-	int64_t elapsed_us, limit_us, todo_us;
+	uint64_t logic_done, analog_done, analog_sent, sending_now;
+	int64_t todo_us;
 	int64_t trigger_offset;
 	int pre_trigger_samples;
+	uint8_t *logic_data;
 
-	(void)fd;
-	(void)revents;
-
-	sdi = cb_data;
 	devc = sdi->priv;
 
-	/* Just in case. */
-	if (devc->cur_samplerate <= 0
-			|| (devc->num_logic_channels <= 0
-			&& devc->num_analog_channels <= 0)) {
-		sr_dev_acquisition_stop(sdi);
-		return G_SOURCE_CONTINUE;
-	}
-
-	/* What time span should we send samples for? */
-	elapsed_us = g_get_monotonic_time() - devc->start_us;
-	limit_us = 1000 * devc->limit_msec;
-	if (limit_us > 0 && limit_us < elapsed_us)
-		todo_us = MAX(0, limit_us - devc->spent_us);
-	else
-		todo_us = MAX(0, elapsed_us - devc->spent_us);
-
-	/* How many samples are outstanding since the last round? */
-	samples_todo = (todo_us * devc->cur_samplerate + G_USEC_PER_SEC - 1)
-			/ G_USEC_PER_SEC;
-
 	if (devc->limit_samples > 0) {
 		if (devc->limit_samples < devc->sent_samples)
 			samples_todo = 0;
@@ -621,7 +768,7 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 	}
 
 	if (samples_todo == 0)
-		return G_SOURCE_CONTINUE;
+		return TRUE;
 
 	if (devc->limit_frames) {
 		/* Never send more samples than a frame can fit... */
@@ -648,13 +795,31 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 	while (logic_done < samples_todo || analog_done < samples_todo) {
 		/* Logic */
 		if (logic_done < samples_todo) {
-			sending_now = MIN(samples_todo - logic_done,
-					LOGIC_BUFSIZE / devc->logic_unitsize);
-			logic_generator(sdi, sending_now * devc->logic_unitsize);
+			if (devc->logic_buf) {
+				/*
+				 * Precomputed (and already masked) data. It
+				 * gets copied, as the session's transforms may
+				 * modify the packet's data in place.
+				 */
+				sending_now = MIN(samples_todo - logic_done,
+						devc->logic_buf_samples - devc->logic_buf_pos);
+				logic_data = devc->logic_send;
+				memcpy(logic_data, devc->logic_buf +
+						devc->logic_buf_pos * devc->logic_unitsize,
+						sending_now * devc->logic_unitsize);
+				devc->logic_buf_pos += sending_now;
+				if (devc->logic_buf_pos == devc->logic_buf_samples)
+					devc->logic_buf_pos = 0;
+			} else {
+				sending_now = MIN(samples_todo - logic_done,
+						LOGIC_BUFSIZE / devc->logic_unitsize);
+				logic_generator(sdi, sending_now * devc->logic_unitsize);
+				logic_data = devc->logic_data;
+			}
 			/* Check for trigger and send pre-trigger data if needed */
 			if (devc->stl && (!devc->trigger_fired)) {
 				trigger_offset = soft_trigger_logic_check(devc->stl,
-						devc->logic_data, sending_now * devc->logic_unitsize,
+						logic_data, sending_now * devc->logic_unitsize,
 						&pre_trigger_samples);
 				if (trigger_offset > -1) {
 					devc->trigger_fired = TRUE;
@@ -672,14 +837,15 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 				if (devc->trigger_fired && (trigger_offset < (int)sending_now)) {
 					/* Send after-trigger data */
 					logic.length = (sending_now - trigger_offset) * devc->logic_unitsize;
-					logic.data = devc->logic_data + trigger_offset * devc->logic_unitsize;
-					logic_fixup_feed(devc, &logic);
+					logic.data = logic_data + trigger_offset * devc->logic_unitsize;
+					if (!devc->logic_buf)
+						logic_fixup_feed(devc, &logic);
 					sr_session_send(sdi, &packet);
 					logic_done += sending_now - trigger_offset;
 					/* End acquisition */
 					sr_dbg("Triggered, stopping acquisition.");
 					sr_dev_acquisition_stop(sdi);
-					break;
+					return FALSE;
 				} else {
 					/* Send nothing */
 					logic_done += sending_now;
@@ -687,8 +853,9 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 			} else if (!devc->stl) {
 				/* No trigger defined, send logic samples */
 				logic.length = sending_now * devc->logic_unitsize;
-				logic.data = devc->logic_data;
-				logic_fixup_feed(devc, &logic);
+				logic.data = logic_data;
+				if (!devc->logic_buf)
+					logic_fixup_feed(devc, &logic);
 				sr_session_send(sdi, &packet);
 				logic_done += sending_now;
 			}
@@ -720,6 +887,7 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 		if (!devc->limit_frames) {
 			sr_dbg("Requested number of frames reached.");
 			sr_dev_acquisition_stop(sdi);
+			return FALSE;
 		}
 	}
 
@@ -740,10 +908,76 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 		}
 		sr_dbg("Requested number of samples reached.");
 		sr_dev_acquisition_stop(sdi);
+		return FALSE;
 	} else if (devc->limit_frames) {
 		if (devc->sent_frame_samples == 0)
 			std_session_send_df_frame_begin(sdi);
 	}
 
+	return TRUE;
+}
+
+/* Callback handling data */
+SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	uint64_t samples_todo;
+	int64_t elapsed_us, limit_us, todo_us, deadline;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+
+	/* Just in case. */
+	if (devc->cur_samplerate <= 0
+			|| (devc->num_logic_channels <= 0
+			&& devc->num_analog_channels <= 0)) {
+		sr_dev_acquisition_stop(sdi);
+		return G_SOURCE_CONTINUE;
+	}
+
+	limit_us = 1000 * devc->limit_msec;
+
+	/*
+	 * Unthrottled acquisition sends as fast as the session's consumers
+	 * accept the data, and only returns to the main loop now and then
+	 * to have other sources serviced. The time limit then applies to
+	 * the time span which the samples cover, not to the wall clock.
+	 */
+	if (devc->unthrottled) {
+		deadline = g_get_monotonic_time() + UNTHROTTLED_SLICE;
+		do {
+			if (devc->logic_buf)
+				samples_todo = devc->logic_buf_samples;
+			else
+				samples_todo = UNTHROTTLED_BUFSIZE / sizeof(float);
+			if (limit_us > 0) {
+				todo_us = MAX(0, limit_us - devc->spent_us);
+				samples_todo = MIN(samples_todo,
+					(todo_us * devc->cur_samplerate + G_USEC_PER_SEC - 1)
+					/ G_USEC_PER_SEC);
+			}
+			if (!send_samples(sdi, samples_todo, limit_us))
+				break;
+		} while (g_get_monotonic_time() < deadline);
+		return G_SOURCE_CONTINUE;
+	}
+
+	/* What time span should we send samples for? */
+	elapsed_us = g_get_monotonic_time() - devc->start_us;
+	if (limit_us > 0 && limit_us < elapsed_us)
+		todo_us = MAX(0, limit_us - devc->spent_us);
+	else
+		todo_us = MAX(0, elapsed_us - devc->spent_us);
+
+	/* How many samples are outstanding since the last round? */
+	samples_todo = (todo_us * devc->cur_samplerate + G_USEC_PER_SEC - 1)
+			/ G_USEC_PER_SEC;
+
+	send_samples(sdi, samples_todo, limit_us);
+
 	return G_SOURCE_CONTINUE;
 }
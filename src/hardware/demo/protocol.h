@@ -32,6 +32,14 @@
 
 /* The size in bytes of chunks to send through the session bus. */
 #define LOGIC_BUFSIZE			4096
+/* The size in bytes of precomputed logic data for unthrottled acquisition. */
+#define UNTHROTTLED_BUFSIZE		(1024 * 1024)
+/* Upper limit for the size in bytes of a cached logic pattern period. */
+#define LOGIC_PERIOD_MAX		(256 * 1024)
+/* Number of independent generators for random logic data. */
+#define LOGIC_RNG_LANES			4
+/* Time in us which unthrottled acquisition keeps the main loop busy for. */
+#define UNTHROTTLED_SLICE		(100 * 1000)
 /* Size of the analog pattern space per channel. */
 #define ANALOG_BUFSIZE			4096
 /* This is a development feature: it starts a new frame every n samples. */
@@ -121,6 +129,7 @@ struct dev_context {
 	int64_t start_us;
 	int64_t spent_us;
 	uint64_t step;
+	gboolean unthrottled;
 	/* Logic */
 	int32_t num_logic_channels;
 	size_t logic_unitsize;
@@ -128,6 +137,17 @@ struct dev_context {
 	/* There is only ever one logic channel group, so its pattern goes here. */
 	enum logic_pattern_type logic_pattern;
 	uint8_t logic_data[LOGIC_BUFSIZE];
+	/* Cached period of the logic pattern, see logic_generator(). */
+	uint8_t *logic_period;
+	size_t logic_period_len;
+	enum logic_pattern_type logic_period_pattern;
+	uint64_t logic_rng[LOGIC_RNG_LANES];
+	/* Precomputed logic data for unthrottled acquisition. */
+	uint8_t *logic_buf;
+	/* Copy of the precomputed data which gets sent, see send_samples(). */
+	uint8_t *logic_send;
+	uint64_t logic_buf_samples;
+	uint64_t logic_buf_pos;
 	/* Analog */
 	struct analog_pattern *analog_patterns[ARRAY_SIZE(analog_pattern_str)];
 	int32_t num_analog_channels;
@@ -162,6 +182,10 @@ struct analog_gen {
 
 SR_PRIV void demo_generate_analog_pattern(struct dev_context *devc);
 SR_PRIV void demo_free_analog_pattern(struct dev_context *devc);
+SR_PRIV void demo_seed_logic_random(struct dev_context *devc);
+SR_PRIV void demo_free_logic_period(struct dev_context *devc);
+SR_PRIV void demo_prepare_logic_buffer(struct sr_dev_inst *sdi);
+SR_PRIV void demo_free_logic_buffer(struct dev_context *devc);
 SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data);
 
 #endif
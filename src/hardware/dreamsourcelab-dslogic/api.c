@@ -118,14 +118,92 @@ static gboolean is_plausible(const struct libusb_device_descriptor *des)
 	return FALSE;
 }
 
+static const struct dslogic_profile *find_profile(
+		const struct libusb_device_descriptor *des)
+{
+	int i;
+
+	for (i = 0; supported_device[i].vid; i++) {
+		if (des->idVendor == supported_device[i].vid &&
+				des->idProduct == supported_device[i].pid)
+			return &supported_device[i];
+	}
+
+	return NULL;
+}
+
+static struct sr_dev_inst *dev_inst_new(const struct dslogic_profile *prof,
+		const char *serial_num, const char *connection_id)
+{
+	struct dev_context *devc;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct sr_channel_group *cg;
+	int j;
+	char channel_name[16];
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INITIALIZING;
+	sdi->vendor = g_strdup(prof->vendor);
+	sdi->model = g_strdup(prof->model);
+	sdi->version = g_strdup(prof->model_version);
+	sdi->serial_num = g_strdup(serial_num);
+	sdi->connection_id = g_strdup(connection_id);
+
+	/* Logic channels, all in one channel group. */
+	cg = sr_channel_group_new(sdi, "Logic", NULL);
+	for (j = 0; j < NUM_CHANNELS; j++) {
+		sprintf(channel_name, "%d", j);
+		ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
+					TRUE, channel_name);
+		cg->channels = g_slist_append(cg->channels, ch);
+	}
+
+	devc = dslogic_dev_new();
+	devc->profile = prof;
+	devc->samplerates = samplerates;
+	devc->num_samplerates = ARRAY_SIZE(samplerates);
+	sdi->priv = devc;
+
+	return sdi;
+}
+
+/* Create a device which replays a USB dump, see usb_replay.c. */
+static GSList *scan_replay(struct sr_dev_driver *di, const char *path)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	GSList *devices;
+	const struct dslogic_profile *prof;
+	struct libusb_device_descriptor des;
+	const char *strings[3];
+
+	if (!(usb = sr_usb_replay_open(path)))
+		return NULL;
+
+	sr_usb_replay_identity(usb, &des, strings);
+	if (!(prof = find_profile(&des))) {
+		sr_usb_dev_inst_free(usb);
+		return NULL;
+	}
+
+	sdi = dev_inst_new(prof, strings[2], path);
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_USB;
+	sdi->conn = usb;
+
+	devices = std_scan_complete(di, g_slist_append(NULL, sdi));
+	sr_usb_replay_restore(sdi);
+
+	return devices;
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
-	struct sr_channel *ch;
-	struct sr_channel_group *cg;
 	struct sr_config *src;
 	const struct dslogic_profile *prof;
 	GSList *l, *devices, *conn_devices;
@@ -133,10 +211,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
 	struct libusb_device_handle *hdl;
-	int ret, i, j;
+	int ret, i;
 	const char *conn;
 	char manufacturer[64], product[64], serial_num[64], connection_id[64];
-	char channel_name[16];
 
 	drvc = di->context;
 
@@ -149,6 +226,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			break;
 		}
 	}
+	if (sr_usb_replay_path(conn))
+		return scan_replay(di, sr_usb_replay_path(conn));
 	if (conn)
 		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 	else
@@ -156,7 +235,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all DSLogic compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -219,43 +298,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		if (usb_get_port_path(devlist[i], connection_id, sizeof(connection_id)) < 0)
 			continue;
 
-		prof = NULL;
-		for (j = 0; supported_device[j].vid; j++) {
-			if (des.idVendor == supported_device[j].vid &&
-					des.idProduct == supported_device[j].pid) {
-				prof = &supported_device[j];
-				break;
-			}
-		}
-
-		if (!prof)
+		if (!(prof = find_profile(&des)))
 			continue;
 
-		sdi = g_malloc0(sizeof(struct sr_dev_inst));
-		sdi->status = SR_ST_INITIALIZING;
-		sdi->vendor = g_strdup(prof->vendor);
-		sdi->model = g_strdup(prof->model);
-		sdi->version = g_strdup(prof->model_version);
-		sdi->serial_num = g_strdup(serial_num);
-		sdi->connection_id = g_strdup(connection_id);
-
-		/* Logic channels, all in one channel group. */
-		cg = sr_channel_group_new(sdi, "Logic", NULL);
-		for (j = 0; j < NUM_CHANNELS; j++) {
-			sprintf(channel_name, "%d", j);
-			ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
-						TRUE, channel_name);
-			cg->channels = g_slist_append(cg->channels, ch);
-		}
-
-		devc = dslogic_dev_new();
-		devc->profile = prof;
-		sdi->priv = devc;
+		sdi = dev_inst_new(prof, serial_num, connection_id);
+		devc = sdi->priv;
 		devices = g_slist_append(devices, sdi);
 
-		devc->samplerates = samplerates;
-		devc->num_samplerates = ARRAY_SIZE(samplerates);
-		has_firmware = usb_match_manuf_prod(devlist[i], "DreamSourceLab", "USB-based Instrument");
+		has_firmware = usb_match_manuf_prod(drvc->sr_ctx, devlist[i], "DreamSourceLab", "USB-based Instrument");
 
 		if (has_firmware) {
 			/* Already has the firmware, so fix the new address. */
@@ -290,6 +340,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct sr_dev_driver *di = sdi->driver;
+	struct drv_context *drvc = di->context;
 	struct sr_usb_dev_inst *usb;
 	struct dev_context *devc;
 	int ret;
@@ -298,6 +349,10 @@ static int dev_open(struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	usb = sdi->conn;
 
+	/* The FPGA configuration is part of the replayed dump. */
+	if (usb->replay)
+		goto defaults;
+
 	/*
 	 * If the firmware was recently uploaded, wait up to MAX_RENUM_DELAY_MS
 	 * milliseconds for the FX2 to renumerate.
@@ -305,8 +360,14 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/*
+		 * Hotplug events tell when the device is back. Without them,
+		 * assume it takes >= 300ms for the FX2 to be gone from the
+		 * USB bus, then poll.
+		 */
+		if (sr_usb_renum_wait(drvc->sr_ctx, sdi->connection_id,
+				devc->fw_updated, MAX_RENUM_DELAY_MS) == SR_ERR_NA)
+			g_usleep(300 * 1000);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = dslogic_dev_open(sdi, di)) == SR_OK)
@@ -321,6 +382,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 			sr_err("Device failed to renumerate.");
 			return SR_ERR;
 		}
+		timediff_ms = (g_get_monotonic_time() - devc->fw_updated) / 1000;
 		sr_info("Device came back after %" PRIi64 "ms.", timediff_ms);
 	} else {
 		sr_info("Firmware upload was not needed.");
@@ -355,6 +417,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 	if ((ret = dslogic_fpga_firmware_upload(sdi)) != SR_OK)
 		return ret;
 
+defaults:
 	if (devc->cur_samplerate == 0) {
 		/* Samplerate hasn't been set; default to the slowest one. */
 		devc->cur_samplerate = devc->samplerates[0];
@@ -374,14 +437,16 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
+	if (usb->replay)
+		return SR_OK;
+
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
-	libusb_close(usb->devhdl);
-	usb->devhdl = NULL;
+	sr_usb_close(usb);
 
 	return SR_OK;
 }
@@ -39,6 +39,8 @@
 #define DS_CMD_RD_NVM_PRE		0xbb
 #define DS_CMD_GET_HW_INFO		0xbc
 
+#define DS_HW_INFO_FPGA_DONE		(1 << 6)
+
 #define DS_START_FLAGS_STOP		(1 << 7)
 #define DS_START_FLAGS_CLK_48MHZ	(1 << 6)
 #define DS_START_FLAGS_SAMPLE_WIDE	(1 << 5)
@@ -178,6 +180,24 @@ static int command_get_revid_version(struct sr_dev_inst *sdi, uint8_t *revid)
 	return SR_OK;
 }
 
+static int command_get_hw_info(const struct sr_dev_inst *sdi, uint8_t *hw_info)
+{
+	struct sr_usb_dev_inst *usb = sdi->conn;
+	int ret;
+
+	ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_ENDPOINT_IN, DS_CMD_GET_HW_INFO, 0x0000, 0x0000,
+		hw_info, 1, USB_TIMEOUT);
+
+	if (ret < 0) {
+		sr_dbg("Unable to get hardware info: %s.",
+		       libusb_error_name(ret));
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
 static int command_start_acquisition(const struct sr_dev_inst *sdi)
 {
 	struct sr_usb_dev_inst *usb;
@@ -188,7 +208,7 @@ static int command_start_acquisition(const struct sr_dev_inst *sdi)
 	mode.sample_delay_h = mode.sample_delay_l = 0;
 
 	usb = sdi->conn;
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&mode, sizeof(mode), USB_TIMEOUT);
 	if (ret < 0) {
@@ -209,7 +229,7 @@ static int command_stop_acquisition(const struct sr_dev_inst *sdi)
 	mode.sample_delay_h = mode.sample_delay_l = 0;
 
 	usb = sdi->conn;
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&mode, sizeof(struct dslogic_mode), USB_TIMEOUT);
 	if (ret < 0) {
@@ -223,13 +243,15 @@ static int command_stop_acquisition(const struct sr_dev_inst *sdi)
 SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi)
 {
 	const char *name = NULL;
-	uint64_t sum;
-	struct sr_resource bitstream;
+	GBytes *bitstream;
+	struct sr_resource_id bitstream_id;
+	const unsigned char *data;
+	size_t size, sum;
+	uint8_t hw_info;
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
-	unsigned char *buf;
-	ssize_t chunksize;
+	int chunksize;
 	int transferred;
 	int result, ret;
 	const uint8_t cmd[3] = {0, 0, 0};
@@ -256,46 +278,52 @@ SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	sr_dbg("Uploading FPGA firmware '%s'.", name);
+	bitstream = sr_resource_load_bytes(drvc->sr_ctx,
+			SR_RESOURCE_FIRMWARE, name, SIZE_MAX);
+	if (!bitstream)
+		return SR_ERR;
+	sr_resource_id_compute(&bitstream_id, bitstream);
+
+	/* Skip the upload when the FPGA still runs this firmware. */
+	if (sr_resource_id_equal(&devc->fpga_firmware_id, &bitstream_id) &&
+			command_get_hw_info(sdi, &hw_info) == SR_OK &&
+			(hw_info & DS_HW_INFO_FPGA_DONE)) {
+		sr_dbg("FPGA firmware '%s' is loaded already.", name);
+		g_bytes_unref(bitstream);
+		return SR_OK;
+	}
+	devc->fpga_firmware_id.valid = FALSE;
 
-	result = sr_resource_open(drvc->sr_ctx, &bitstream,
-			SR_RESOURCE_FIRMWARE, name);
-	if (result != SR_OK)
-		return result;
+	sr_dbg("Uploading FPGA firmware '%s'.", name);
+	data = g_bytes_get_data(bitstream, &size);
 
 	/* Tell the device firmware is coming. */
-	if ((ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	if ((ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_CONFIG, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT)) < 0) {
 		sr_err("Failed to upload FPGA firmware: %s.", libusb_error_name(ret));
-		sr_resource_close(drvc->sr_ctx, &bitstream);
+		g_bytes_unref(bitstream);
 		return SR_ERR;
 	}
 
 	/* Give the FX2 time to get ready for FPGA firmware upload. */
 	g_usleep(FPGA_UPLOAD_DELAY);
 
-	buf = g_malloc(FW_BUFSIZE);
 	sum = 0;
 	result = SR_OK;
-	while (1) {
-		chunksize = sr_resource_read(drvc->sr_ctx, &bitstream,
-				buf, FW_BUFSIZE);
-		if (chunksize < 0)
-			result = SR_ERR;
-		if (chunksize <= 0)
-			break;
+	while (sum < size) {
+		chunksize = MIN(size - sum, FW_BUFSIZE);
 
-		if ((ret = libusb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
-				buf, chunksize, &transferred, USB_TIMEOUT)) < 0) {
+		if ((ret = sr_usb_bulk_transfer(usb, 2 | LIBUSB_ENDPOINT_OUT,
+				(unsigned char *)data + sum, chunksize,
+				&transferred, USB_TIMEOUT)) < 0) {
 			sr_err("Unable to configure FPGA firmware: %s.",
 					libusb_error_name(ret));
 			result = SR_ERR;
 			break;
 		}
 		sum += transferred;
-		sr_spew("Uploaded %" PRIu64 "/%" PRIu64 " bytes.",
-			sum, bitstream.size);
+		sr_spew("Uploaded %zu/%zu bytes.", sum, size);
 
 		if (transferred != chunksize) {
 			sr_err("Short transfer while uploading FPGA firmware.");
@@ -303,11 +331,12 @@ SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi)
 			break;
 		}
 	}
-	g_free(buf);
-	sr_resource_close(drvc->sr_ctx, &bitstream);
+	g_bytes_unref(bitstream);
 
-	if (result == SR_OK)
+	if (result == SR_OK) {
 		sr_dbg("FPGA firmware upload done.");
+		devc->fpga_firmware_id = bitstream_id;
+	}
 
 	return result;
 }
@@ -428,7 +457,7 @@ static bool set_trigger(const struct sr_dev_inst *sdi, struct fpga_config *cfg)
 static int fpga_configure(const struct sr_dev_inst *sdi)
 {
 	const struct dev_context *const devc = sdi->priv;
-	const struct sr_usb_dev_inst *const usb = sdi->conn;
+	struct sr_usb_dev_inst *const usb = sdi->conn;
 	uint8_t c[3];
 	struct fpga_config cfg;
 	uint16_t mode = 0;
@@ -453,7 +482,7 @@ static int fpga_configure(const struct sr_dev_inst *sdi)
 	c[1] = (len >> 8) & 0xff;
 	c[2] = (len >> 16) & 0xff;
 
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_SETTING, 0x0000, 0x0000,
 			c, sizeof(c), USB_TIMEOUT);
 	if (ret < 0) {
@@ -479,7 +508,10 @@ static int fpga_configure(const struct sr_dev_inst *sdi)
 
 	if (devc->continuous_mode)
 		mode |= DS_MODE_STREAM_MODE;
-	if (devc->external_clock) {
+	/* Followers sample on the clock which their master outputs. */
+	if (devc->external_clock || sdi->sync_follower) {
+		if (!devc->external_clock)
+			sr_dbg("Sync follower, sampling on the external clock.");
 		mode |= DS_MODE_CLK_TYPE;
 		if (devc->clock_edge == DS_EDGE_FALLING)
 			mode |= DS_MODE_CLK_EDGE;
@@ -501,7 +533,7 @@ static int fpga_configure(const struct sr_dev_inst *sdi)
 	WL32(&cfg.count, devc->limit_samples / 16);
 
 	len = sizeof(struct fpga_config);
-	ret = libusb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
+	ret = sr_usb_bulk_transfer(usb, 2 | LIBUSB_ENDPOINT_OUT,
 			(unsigned char *)&cfg, len, &transferred, USB_TIMEOUT);
 	if (ret < 0 || transferred != len) {
 		sr_err("Failed to send FPGA configuration: %s.", libusb_error_name(ret));
@@ -515,12 +547,12 @@ SR_PRIV int dslogic_set_voltage_threshold(const struct sr_dev_inst *sdi, double
 {
 	int ret;
 	struct dev_context *const devc = sdi->priv;
-	const struct sr_usb_dev_inst *const usb = sdi->conn;
+	struct sr_usb_dev_inst *const usb = sdi->conn;
 	const uint8_t value = (threshold / 5.0) * 255;
 	const uint16_t cmd = value | (DS_ADDR_VTH << 8);
 
 	/* Send the control command. */
-	ret = libusb_control_transfer(usb->devhdl,
+	ret = sr_usb_control_transfer(usb,
 			LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT,
 			DS_CMD_WR_REG, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), 3000);
@@ -583,6 +615,8 @@ SR_PRIV int dslogic_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di)
 				 * upload, so we don't know the address yet.
 				 */
 				usb->address = libusb_get_device_address(devlist[i]);
+			devc->super_speed = libusb_get_device_speed(devlist[i])
+				>= LIBUSB_SPEED_SUPER;
 		} else {
 			sr_err("Failed to open device: %s.",
 			       libusb_error_name(ret));
@@ -660,100 +694,145 @@ SR_PRIV struct dev_context *dslogic_dev_new(void)
 	return devc;
 }
 
-static void abort_acquisition(struct dev_context *devc)
+static void abort_acquisition(const struct sr_dev_inst *sdi)
 {
-	int i;
+	struct dev_context *devc;
 
+	devc = sdi->priv;
 	devc->acq_aborted = TRUE;
 
-	for (i = devc->num_transfers - 1; i >= 0; i--) {
-		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
-	}
+	if (devc->trigger_transfer)
+		sr_usb_cancel_transfer(sdi, devc->trigger_transfer);
+	sr_usb_stream_stop(devc->stream);
 }
 
-static void finish_acquisition(struct sr_dev_inst *sdi)
+static void finish_acquisition(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	double elapsed;
 
 	devc = sdi->priv;
 
+	elapsed = (g_get_monotonic_time() - devc->stream_start) / 1e6;
+	if (devc->stream_bytes && elapsed > 0)
+		sr_info("Received %" PRIu64 " bytes in %.3f s, %.1f MB/s.",
+			devc->stream_bytes, elapsed,
+			devc->stream_bytes / elapsed / 1e6);
+
 	std_session_send_df_end(sdi);
 
 	usb_source_remove(sdi->session, devc->ctx);
 
+	sr_usb_raw_record_stop(sdi);
+	devc->raw_record = FALSE;
+
 	devc->num_transfers = 0;
-	g_free(devc->transfers);
-	g_free(devc->deinterleave_buffer);
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
+	sr_buffer_free(devc->deinterleave_buffer);
+	devc->deinterleave_buffer = NULL;
 }
 
-static void free_transfer(struct libusb_transfer *transfer)
+/*
+ * Set up the layout of the sample data for the enabled channels. When
+ * they are not the lowest ones, a table per group of eight maps each
+ * deinterleaved byte to the channels' bit positions.
+ */
+static void setup_deinterleave(const struct sr_dev_inst *sdi)
 {
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	unsigned int i;
+	uint16_t channel_bits[16];
+	unsigned int channel, group, i, k, b;
 
-	sdi = transfer->user_data;
 	devc = sdi->priv;
+	devc->channel_count = enabled_channel_count(sdi);
+	devc->channel_mask = enabled_channel_mask(sdi);
+	devc->unitsize = (devc->channel_mask & 0xff00) ? 2 : 1;
+	devc->direct = (devc->channel_mask & (devc->channel_mask + 1)) == 0;
+	if (devc->direct)
+		return;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
-	for (i = 0; i < devc->num_transfers; i++) {
-		if (devc->transfers[i] == transfer) {
-			devc->transfers[i] = NULL;
-			break;
+	/* Bit position of each enabled channel, in stream order. */
+	for (channel = 0, i = 0; channel < 16 && i < devc->channel_count; channel++) {
+		if (devc->channel_mask & (1 << channel))
+			channel_bits[i++] = 1 << channel;
+	}
+	for (; i < ARRAY_SIZE(channel_bits); i++)
+		channel_bits[i] = 0;
+
+	for (group = 0; group < 2; group++) {
+		for (b = 0; b < 256; b++) {
+			devc->scatter[group][b] = 0;
+			for (k = 0; k < 8; k++) {
+				if (b & (1 << k))
+					devc->scatter[group][b] |=
+						channel_bits[8 * group + k];
+			}
 		}
 	}
-
-	devc->submitted_transfers--;
-	if (devc->submitted_transfers == 0)
-		finish_acquisition(sdi);
 }
 
-static void resubmit_transfer(struct libusb_transfer *transfer)
+/*
+ * The device sends blocks of one 64-bit word per enabled channel, each
+ * word holding 64 consecutive samples of that channel. Deinterleave
+ * them into 16-bit samples, eight channels times eight samples at a
+ * time: gather byte j of up to eight channel words into one word, and
+ * an 8x8 bit transpose yields eight samples' worth of those channels.
+ */
+static void deinterleave_buffer(const struct dev_context *devc,
+	const uint8_t *src, size_t length, uint16_t *dst_ptr)
 {
-	int ret;
+	uint64_t words[16], rows[2];
+	size_t block, i, channel_count;
+	unsigned int j, k;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	channel_count = devc->channel_count;
+	if (!channel_count)
 		return;
 
-	sr_err("%s: %s", __func__, libusb_error_name(ret));
-	free_transfer(transfer);
-
-}
-
-static void deinterleave_buffer(const uint8_t *src, size_t length,
-	uint16_t *dst_ptr, size_t channel_count, uint16_t channel_mask)
-{
-	uint16_t sample;
-
-	for (const uint64_t *src_ptr = (uint64_t*)src;
-		src_ptr < (uint64_t*)(src + length);
-		src_ptr += channel_count) {
-		for (int bit = 0; bit != 64; bit++) {
-			const uint64_t *word_ptr = src_ptr;
-			sample = 0;
-			for (unsigned int channel = 0; channel != 16;
-				channel++) {
-				const uint16_t m = channel_mask >> channel;
-				if (!m)
-					break;
-				if ((m & 1) && ((*word_ptr++ >> bit) & UINT64_C(1)))
-					sample |= 1 << channel;
+	block = channel_count * sizeof(uint64_t);
+	memset(words, 0, sizeof(words));
+	for (; length >= block; src += block, length -= block) {
+		memcpy(words, src, block);
+		for (j = 0; j < 8; j++) {
+			rows[0] = rows[1] = 0;
+			for (i = 0; i < channel_count; i++)
+				rows[i / 8] |= ((words[i] >> (8 * j)) & 0xff)
+					<< (8 * (i % 8));
+			rows[0] = transpose_8x8(rows[0]);
+			rows[1] = transpose_8x8(rows[1]);
+			if (devc->direct) {
+				for (k = 0; k < 8; k++)
+					*dst_ptr++ = ((rows[0] >> (8 * k)) & 0xff)
+						| (((rows[1] >> (8 * k)) & 0xff) << 8);
+			} else {
+				for (k = 0; k < 8; k++)
+					*dst_ptr++ =
+						devc->scatter[0][(rows[0] >> (8 * k)) & 0xff]
+						| devc->scatter[1][(rows[1] >> (8 * k)) & 0xff];
 			}
-			*dst_ptr++ = sample;
 		}
 	}
 }
 
-static void send_data(struct sr_dev_inst *sdi,
-	uint16_t *data, size_t sample_count)
+/*
+ * Narrow 16bit samples to their low byte in place. Used when only the
+ * first eight channels are enabled, which halves the session's data.
+ */
+static void narrow_samples(uint16_t *data, size_t sample_count)
+{
+	uint8_t *dst = (uint8_t *)data;
+
+	for (size_t i = 0; i < sample_count; i++)
+		dst[i] = data[i] & 0xff;
+}
+
+static void send_data(const struct sr_dev_inst *sdi,
+	uint8_t *data, size_t sample_count, uint16_t unitsize)
 {
 	const struct sr_datafeed_logic logic = {
-		.length = sample_count * sizeof(uint16_t),
-		.unitsize = sizeof(uint16_t),
+		.length = sample_count * unitsize,
+		.unitsize = unitsize,
 		.data = data
 	};
 
@@ -765,65 +844,87 @@ static void send_data(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+/*
+ * Send samples which contain the trigger position, split at it. This
+ * happens once per acquisition, the transfers' path only checks for it.
+ */
+static void send_triggered(const struct sr_dev_inst *sdi, uint8_t *data,
+	size_t sample_count)
 {
-	struct sr_dev_inst *const sdi = transfer->user_data;
-	struct dev_context *const devc = sdi->priv;
-	const size_t channel_count = enabled_channel_count(sdi);
-	const uint16_t channel_mask = enabled_channel_mask(sdi);
-	const unsigned int cur_sample_count = DSLOGIC_ATOMIC_SAMPLES *
-		transfer->actual_length /
-		(DSLOGIC_ATOMIC_BYTES * channel_count);
+	struct dev_context *devc;
+	size_t trigger_offset;
 
-	gboolean packet_has_error = FALSE;
-	unsigned int num_samples;
-	int trigger_offset;
+	devc = sdi->priv;
+	devc->trigger_pending = FALSE;
+
+	/* Pre-trigger samples. */
+	trigger_offset = devc->trigger_pos - devc->sent_samples;
+	send_data(sdi, data, trigger_offset, devc->unitsize);
+	devc->sent_samples += trigger_offset;
+	/* Trigger position. */
+	std_session_send_df_trigger(sdi);
+	/* Post trigger samples. */
+	sample_count -= trigger_offset;
+	send_data(sdi, data + trigger_offset * devc->unitsize,
+		sample_count, devc->unitsize);
+	devc->sent_samples += sample_count;
+}
 
-	/*
-	 * If acquisition has already ended, just free any queued up
-	 * transfer that come in.
-	 */
-	if (devc->acq_aborted) {
-		free_transfer(transfer);
+/*
+ * Account received data, and report the bandwidth about once a second.
+ * In stream mode, warn when the data does not arrive as fast as the
+ * samplerate requires, the device's buffer then overflows.
+ */
+static void account_bandwidth(const struct sr_dev_inst *sdi, size_t length)
+{
+	struct dev_context *devc;
+	int64_t now;
+	double rate, required;
+
+	devc = sdi->priv;
+	devc->stream_bytes += length;
+	devc->report_bytes += length;
+
+	now = g_get_monotonic_time();
+	if (now - devc->report_time < G_USEC_PER_SEC)
 		return;
+
+	rate = devc->report_bytes / ((now - devc->report_time) / 1e6);
+	sr_dbg("Stream bandwidth %.1f MB/s.", rate / 1e6);
+	required = (double)devc->cur_samplerate * devc->channel_count / 8;
+	if (devc->continuous_mode && !devc->bandwidth_warned
+			&& rate < 0.95 * required) {
+		sr_warn("Stream bandwidth %.1f MB/s is below the %.1f MB/s "
+			"which the samplerate needs.", rate / 1e6, required / 1e6);
+		devc->bandwidth_warned = TRUE;
 	}
+	devc->report_time = now;
+	devc->report_bytes = 0;
+}
 
-	sr_dbg("receive_transfer(): status %s received %d bytes.",
-		libusb_error_name(transfer->status), transfer->actual_length);
+static int decode_transfer(const struct sr_dev_inst *sdi, uint64_t seq,
+	const uint8_t *buffer, size_t length, void *cb_data)
+{
+	struct dev_context *const devc = sdi->priv;
+	const uint64_t cur_sample_count = DSLOGIC_ATOMIC_SAMPLES *
+		(uint64_t)length / (DSLOGIC_ATOMIC_BYTES * devc->channel_count);
 
-	/* Save incoming transfer before reusing the transfer struct. */
+	uint8_t *data;
+	uint64_t num_samples;
 
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		abort_acquisition(devc);
-		free_transfer(transfer);
-		return;
-	case LIBUSB_TRANSFER_COMPLETED:
-	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
-		break;
-	default:
-		packet_has_error = TRUE;
-		break;
-	}
+	(void)seq;
+	(void)cb_data;
 
-	if (transfer->actual_length == 0 || packet_has_error) {
-		devc->empty_transfer_count++;
-		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
-			/*
-			 * The FX2 gave up. End the acquisition, the frontend
-			 * will work out that the samplecount is short.
-			 */
-			abort_acquisition(devc);
-			free_transfer(transfer);
-		} else {
-			resubmit_transfer(transfer);
-		}
-		return;
-	} else {
-		devc->empty_transfer_count = 0;
-	}
+	/* If acquisition has already ended, ignore any late data. */
+	if (devc->acq_aborted)
+		return SR_OK;
 
-	if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
+	account_bandwidth(sdi, length);
+
+	if (devc->raw_record) {
+		/* The dump has the data, replaying it decodes them. */
+		devc->sent_samples += cur_sample_count;
+	} else if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
 		if (devc->limit_samples && devc->sent_samples + cur_sample_count > devc->limit_samples)
 			num_samples = devc->limit_samples - devc->sent_samples;
 		else
@@ -840,38 +941,40 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		 *
 		 * Hopefully in future it will be possible to pass the data on as-is.
 		 */
-		if (transfer->actual_length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
+		if (length % (DSLOGIC_ATOMIC_BYTES * devc->channel_count) != 0)
 			sr_err("Invalid transfer length!");
-		deinterleave_buffer(transfer->buffer, transfer->actual_length,
-			devc->deinterleave_buffer, channel_count, channel_mask);
+		deinterleave_buffer(devc, buffer, length,
+			devc->deinterleave_buffer);
+		data = (uint8_t *)devc->deinterleave_buffer;
+		if (devc->unitsize == 1)
+			narrow_samples(devc->deinterleave_buffer, num_samples);
 
 		/* Send the incoming transfer to the session bus. */
-		if (devc->trigger_pos > devc->sent_samples
-			&& devc->trigger_pos <= devc->sent_samples + num_samples) {
-			/* DSLogic trigger in this block. Send trigger position. */
-			trigger_offset = devc->trigger_pos - devc->sent_samples;
-			/* Pre-trigger samples. */
-			send_data(sdi, devc->deinterleave_buffer, trigger_offset);
-			devc->sent_samples += trigger_offset;
-			/* Trigger position. */
-			devc->trigger_pos = 0;
-			std_session_send_df_trigger(sdi);
-			/* Post trigger samples. */
-			num_samples -= trigger_offset;
-			send_data(sdi, devc->deinterleave_buffer
-				+ trigger_offset, num_samples);
-			devc->sent_samples += num_samples;
+		if (G_UNLIKELY(devc->trigger_pending)
+				&& devc->trigger_pos <= devc->sent_samples + num_samples) {
+			send_triggered(sdi, data, num_samples);
 		} else {
-			send_data(sdi, devc->deinterleave_buffer, num_samples);
+			send_data(sdi, data, num_samples, devc->unitsize);
 			devc->sent_samples += num_samples;
 		}
 	}
 
-	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
-		abort_acquisition(devc);
-		free_transfer(transfer);
-	} else
-		resubmit_transfer(transfer);
+	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples)
+		abort_acquisition(sdi);
+
+	return SR_OK;
+}
+
+/* Runs once the stream ended and all of its transfers came back. */
+static void transfers_done(const struct sr_dev_inst *sdi, int status,
+	void *cb_data)
+{
+	(void)cb_data;
+
+	if (status != SR_OK)
+		sr_dbg("Stream ended: %s.", sr_strerror(status));
+
+	finish_acquisition(sdi);
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
@@ -920,10 +1023,18 @@ static size_t get_buffer_size(const struct sr_dev_inst *sdi)
 
 static unsigned int get_number_of_transfers(const struct sr_dev_inst *sdi)
 {
-	/* Total buffer size should be able to hold about 100ms of data. */
+	const struct dev_context *const devc = sdi->priv;
+	/*
+	 * Total buffer size should be able to hold about 100ms of data.
+	 * Stream mode via USB 3 keeps 250ms in flight, which rides out
+	 * the host's scheduling hiccups at the higher data rates.
+	 */
+	const gboolean deep = devc->continuous_mode && devc->super_speed;
+	const unsigned int max = deep ?
+		NUM_SIMUL_TRANSFERS_USB3 : NUM_SIMUL_TRANSFERS;
 	const unsigned int s = get_buffer_size(sdi);
-	const unsigned int n = (100 * to_bytes_per_ms(sdi) + s - 1) / s;
-	return (n > NUM_SIMUL_TRANSFERS) ? NUM_SIMUL_TRANSFERS : n;
+	const unsigned int n = ((deep ? 250 : 100) * to_bytes_per_ms(sdi) + s - 1) / s;
+	return (n > max) ? max : n;
 }
 
 static unsigned int get_timeout(const struct sr_dev_inst *sdi)
@@ -936,67 +1047,46 @@ static unsigned int get_timeout(const struct sr_dev_inst *sdi)
 
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
-	const size_t channel_count = enabled_channel_count(sdi);
 	const size_t size = get_buffer_size(sdi);
 	const unsigned int num_transfers = get_number_of_transfers(sdi);
 	const unsigned int timeout = get_timeout(sdi);
 
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
-	struct libusb_transfer *transfer;
-	unsigned int i;
-	int ret;
-	unsigned char *buf;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
 
 	devc->sent_samples = 0;
 	devc->acq_aborted = FALSE;
-	devc->empty_transfer_count = 0;
-	devc->submitted_transfers = 0;
-
-	g_free(devc->transfers);
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
-	if (!devc->transfers) {
-		sr_err("USB transfers malloc failed.");
-		return SR_ERR_MALLOC;
-	}
-
-	devc->deinterleave_buffer = g_try_malloc(DSLOGIC_ATOMIC_SAMPLES *
-		(size / (channel_count * DSLOGIC_ATOMIC_BYTES)) * sizeof(uint16_t));
+	devc->stream_start = devc->report_time = g_get_monotonic_time();
+	devc->stream_bytes = devc->report_bytes = 0;
+	devc->bandwidth_warned = FALSE;
+	setup_deinterleave(sdi);
+
+	devc->deinterleave_buffer = sr_buffer_alloc(devc->ctx,
+		DSLOGIC_ATOMIC_SAMPLES * (size / (devc->channel_count *
+		DSLOGIC_ATOMIC_BYTES)) * sizeof(uint16_t));
 	if (!devc->deinterleave_buffer) {
 		sr_err("Deinterleave buffer malloc failed.");
-		g_free(devc->deinterleave_buffer);
 		return SR_ERR_MALLOC;
 	}
 
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				6 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
+	devc->stream = sr_usb_stream_new(sdi, 6 | LIBUSB_ENDPOINT_IN,
+			num_transfers, size, timeout,
+			decode_transfer, transfers_done, NULL);
+	if (!devc->stream) {
+		sr_buffer_free(devc->deinterleave_buffer);
+		devc->deinterleave_buffer = NULL;
+		return SR_ERR_MALLOC;
 	}
+	/* Short queues still ride out as many empty transfers as before. */
+	sr_usb_stream_set_max_empty(devc->stream,
+		MAX(MAX_EMPTY_TRANSFERS, 2 * num_transfers));
+	devc->num_transfers = num_transfers;
 
+	/* From here on, transfers_done() sends the end of the feed. */
 	std_session_send_df_header(sdi);
 
-	return SR_OK;
+	return sr_usb_stream_start(devc->stream);
 }
 
 static void LIBUSB_CALL trigger_receive(struct libusb_transfer *transfer)
@@ -1007,19 +1097,19 @@ static void LIBUSB_CALL trigger_receive(struct libusb_transfer *transfer)
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
+	devc->trigger_transfer = NULL;
 	if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
 		sr_dbg("Trigger transfer canceled.");
 		/* Terminate session. */
 		std_session_send_df_end(sdi);
 		usb_source_remove(sdi->session, devc->ctx);
-		devc->num_transfers = 0;
-		g_free(devc->transfers);
 	} else if (transfer->status == LIBUSB_TRANSFER_COMPLETED
 			&& transfer->actual_length == sizeof(struct dslogic_trigger_pos)) {
 		tpos = (struct dslogic_trigger_pos *)transfer->buffer;
 		sr_info("tpos real_pos %d ram_saddr %d cnt_h %d cnt_l %d", tpos->real_pos,
 			tpos->ram_saddr, tpos->remain_cnt_h, tpos->remain_cnt_l);
 		devc->trigger_pos = tpos->real_pos;
+		devc->trigger_pending = tpos->real_pos > 0;
 		g_free(tpos);
 		start_transfers(sdi);
 	}
@@ -1045,8 +1135,8 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->ctx = drvc->sr_ctx;
 	devc->sent_samples = 0;
-	devc->empty_transfer_count = 0;
 	devc->acq_aborted = FALSE;
+	devc->raw_record = sr_usb_raw_record_start(sdi);
 
 	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
 
@@ -1065,21 +1155,14 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 	libusb_fill_bulk_transfer(transfer, usb->devhdl, 6 | LIBUSB_ENDPOINT_IN,
 			(unsigned char *)tpos, sizeof(struct dslogic_trigger_pos),
 			trigger_receive, (void *)sdi, 0);
-	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) < 0) {
 		sr_err("Failed to request trigger: %s.", libusb_error_name(ret));
 		libusb_free_transfer(transfer);
 		g_free(tpos);
 		return SR_ERR;
 	}
 
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers));
-	if (!devc->transfers) {
-		sr_err("USB trigger_pos transfer malloc failed.");
-		return SR_ERR_MALLOC;
-	}
-	devc->num_transfers = 1;
-	devc->submitted_transfers++;
-	devc->transfers[0] = transfer;
+	devc->trigger_transfer = transfer;
 
 	return ret;
 }
@@ -1087,6 +1170,6 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 SR_PRIV int dslogic_acquisition_stop(struct sr_dev_inst *sdi)
 {
 	command_stop_acquisition(sdi);
-	abort_acquisition(sdi->priv);
+	abort_acquisition(sdi);
 	return SR_OK;
 }
@@ -37,6 +37,8 @@
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
+/* Stream mode on SuperSpeed USB keeps more transfers in flight. */
+#define NUM_SIMUL_TRANSFERS_USB3	128
 
 #define NUM_CHANNELS		16
 #define NUM_TRIGGER_STAGES	16
@@ -123,23 +125,47 @@ struct dev_context {
 	uint64_t capture_ratio;
 
 	gboolean acq_aborted;
+	/* Recording raw transfers instead of decoding them. */
+	gboolean raw_record;
+	/* The device is connected via SuperSpeed USB. */
+	gboolean super_speed;
 
-	unsigned int sent_samples;
-	int submitted_transfers;
-	int empty_transfer_count;
+	uint64_t sent_samples;
 
 	unsigned int num_transfers;
-	struct libusb_transfer **transfers;
+	/* Requests the trigger position, before the stream starts. */
+	struct libusb_transfer *trigger_transfer;
+	struct sr_usb_stream *stream;
 	struct sr_context *ctx;
 
+	/*
+	 * Layout of the sample data, set up when the transfers start.
+	 * Unless the enabled channels are the lowest ones, the tables
+	 * map deinterleaved bytes to the channels' bit positions.
+	 */
+	unsigned int channel_count;
+	uint16_t channel_mask;
+	uint16_t unitsize;
+	gboolean direct;
+	uint16_t scatter[2][256];
 	uint16_t *deinterleave_buffer;
 
+	/* Stream bandwidth, in total and since the last report. */
+	int64_t stream_start;
+	int64_t report_time;
+	uint64_t stream_bytes;
+	uint64_t report_bytes;
+	gboolean bandwidth_warned;
+
 	uint16_t mode;
 	uint32_t trigger_pos;
+	/* The trigger position is yet to be marked in the data. */
+	gboolean trigger_pending;
 	gboolean external_clock;
 	gboolean continuous_mode;
 	int clock_edge;
 	double cur_threshold;
+	struct sr_resource_id fpga_firmware_id;
 };
 
 SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi);
@@ -275,7 +275,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	if (conn) {
 		devices = NULL;
-		libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+		sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 		for (i = 0; devlist[i]; i++) {
 			conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 			for (l = conn_devices; l; l = l->next) {
@@ -466,6 +466,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	std_session_send_df_header(sdi);
 
+	/* Prefer streaming, fall back to individual read calls. */
+	devc->async = ftdi_la_start_transfers(sdi) == SR_OK;
+	if (!devc->async)
+		sr_warn("Cannot stream sample data, reading synchronously.");
+
 	/* Hook up a dummy handler to receive data from the device. */
 	sr_session_source_add(sdi->session, -1, G_IO_IN, 0,
 			      ftdi_la_receive_data, (void *)sdi);
@@ -475,6 +480,15 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->async) {
+		ftdi_la_stop_transfers(devc);
+		devc->async = FALSE;
+	}
+
 	sr_session_source_remove(sdi->session, -1);
 
 	std_session_send_df_end(sdi);
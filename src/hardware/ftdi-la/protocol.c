@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <ftdi.h>
+#include <string.h>
 #include "protocol.h"
 
 static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
@@ -42,6 +43,164 @@ static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
 	devc->bytes_received -= samples_to_send;
 }
 
+/*
+ * Send the samples which were received into the data buffer. Returns
+ * TRUE when the requested number of samples was reached.
+ */
+static gboolean submit_samples(struct sr_dev_inst *sdi, int bytes_read)
+{
+	struct dev_context *devc;
+	uint64_t n;
+
+	devc = sdi->priv;
+
+	devc->bytes_received += bytes_read;
+
+	n = devc->samples_sent + devc->bytes_received;
+
+	if (devc->limit_samples && (n >= devc->limit_samples)) {
+		send_samples(sdi, devc->limit_samples - devc->samples_sent);
+		sr_info("Requested number of samples reached.");
+		return TRUE;
+	}
+	send_samples(sdi, devc->bytes_received);
+
+	return FALSE;
+}
+
+/*
+ * Copy a transfer's sample data to the data buffer. Each USB packet
+ * starts with two modem status bytes, which get stripped off.
+ */
+static int copy_transfer_data(struct dev_context *devc,
+	const struct libusb_transfer *transfer)
+{
+	const unsigned char *rdptr;
+	unsigned char *wrptr;
+	int remain, size, packet_size;
+
+	packet_size = devc->ftdic->max_packet_size;
+	rdptr = transfer->buffer;
+	wrptr = devc->data_buf;
+	remain = transfer->actual_length;
+	while (remain > 2) {
+		size = MIN(remain, packet_size);
+		memcpy(wrptr, rdptr + 2, size - 2);
+		wrptr += size - 2;
+		rdptr += size;
+		remain -= size;
+	}
+
+	return wrptr - devc->data_buf;
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	int bytes_read, ret, i;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	if (devc->stopping || transfer->status == LIBUSB_TRANSFER_CANCELLED)
+		goto release;
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+			transfer->status != LIBUSB_TRANSFER_TIMED_OUT) {
+		sr_err("FTDI data transfer failed: %s.",
+			libusb_error_name(transfer->status));
+		devc->stopping = TRUE;
+		goto release;
+	}
+
+	/* Have the transfer run again while this one's data gets sent. */
+	bytes_read = copy_transfer_data(devc, transfer);
+	ret = libusb_submit_transfer(transfer);
+	if (ret != 0) {
+		sr_err("Failed to resubmit FTDI data transfer: %s.",
+			libusb_error_name(ret));
+		devc->stopping = TRUE;
+	}
+
+	if (bytes_read && submit_samples(sdi, bytes_read))
+		devc->stopping = TRUE;
+	if (ret == 0)
+		return;
+
+release:
+	devc->submitted_transfers--;
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i] == transfer)
+			devc->transfers[i] = NULL;
+	}
+	libusb_free_transfer(transfer);
+}
+
+/*
+ * Start streaming sample data with several USB transfers in flight,
+ * such that the device's FIFO keeps getting drained while previously
+ * received data gets processed. Bypasses libftdi's read routines,
+ * which only support a single outstanding request.
+ */
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	int i, ret;
+
+	devc = sdi->priv;
+
+	devc->stopping = FALSE;
+	devc->submitted_transfers = 0;
+	memset(devc->transfers, 0, sizeof(devc->transfers));
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		transfer = libusb_alloc_transfer(0);
+		buf = g_try_malloc(DATA_BUF_SIZE);
+		if (!transfer || !buf) {
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			ftdi_la_stop_transfers(devc);
+			return SR_ERR_MALLOC;
+		}
+		libusb_fill_bulk_transfer(transfer, devc->ftdic->usb_dev,
+			devc->ftdic->out_ep, buf, DATA_BUF_SIZE,
+			receive_transfer, (void *)sdi,
+			devc->ftdic->usb_read_timeout);
+		transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+		ret = libusb_submit_transfer(transfer);
+		if (ret != 0) {
+			sr_dbg("Failed to submit FTDI data transfer: %s.",
+				libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			ftdi_la_stop_transfers(devc);
+			return SR_ERR_IO;
+		}
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
+	}
+
+	return SR_OK;
+}
+
+/* Cancel the transfers which are in flight, and wait for completion. */
+SR_PRIV void ftdi_la_stop_transfers(struct dev_context *devc)
+{
+	struct timeval tv;
+	int i;
+
+	devc->stopping = TRUE;
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+	}
+	while (devc->submitted_transfers > 0) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 100 * 1000;
+		libusb_handle_events_timeout(devc->ftdic->usb_ctx, &tv);
+	}
+}
+
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
 {
 	int ret;
@@ -60,8 +219,8 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	struct timeval tv;
 	int bytes_read;
-	uint64_t n;
 
 	(void)fd;
 	(void)revents;
@@ -75,6 +234,20 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 	if (!devc->ftdic)
 		return TRUE;
 
+	/*
+	 * Dispatch completed transfers, stop when done or failed. The
+	 * source has no fd to poll, wait here for libusb events so that
+	 * the main loop doesn't spin between completions.
+	 */
+	if (devc->async) {
+		tv.tv_sec = 0;
+		tv.tv_usec = EVENTS_POLL_MS * 1000;
+		libusb_handle_events_timeout(devc->ftdic->usb_ctx, &tv);
+		if (devc->stopping)
+			sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
 	/* Get a block of data. */
 	bytes_read = ftdi_read_data(devc->ftdic, devc->data_buf, DATA_BUF_SIZE);
 	if (bytes_read < 0) {
@@ -88,18 +261,9 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	}
 	sr_spew("Got some data.");
-	devc->bytes_received += bytes_read;
 
-	n = devc->samples_sent + devc->bytes_received;
-
-	if (devc->limit_samples && (n >= devc->limit_samples)) {
-		send_samples(sdi, devc->limit_samples - devc->samples_sent);
-		sr_info("Requested number of samples reached.");
+	if (submit_samples(sdi, bytes_read))
 		sr_dev_acquisition_stop(sdi);
-		return TRUE;
-	} else {
-		send_samples(sdi, devc->bytes_received);
-	}
 
 	return TRUE;
 }
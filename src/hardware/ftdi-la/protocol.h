@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <glib.h>
+#include <libusb.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -29,6 +30,12 @@
 
 #define DATA_BUF_SIZE (16 * 1024)
 
+/* Number of USB transfers which are kept in flight while streaming. */
+#define NUM_TRANSFERS 2
+
+/* Longest wait for libusb events per call of the receive handler. */
+#define EVENTS_POLL_MS 10
+
 struct ftdi_chip_desc {
 	uint16_t vendor;
 	uint16_t product;
@@ -46,9 +53,17 @@ struct dev_context {
 	unsigned char *data_buf;
 	uint64_t samples_sent;
 	uint64_t bytes_received;
+
+	/* Asynchronous streaming, ftdi_read_data() calls otherwise. */
+	gboolean async;
+	gboolean stopping;
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	int submitted_transfers;
 };
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc);
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi);
+SR_PRIV void ftdi_la_stop_transfers(struct dev_context *devc);
 SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data);
 
 #endif
@@ -131,6 +131,9 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_ADAPTIVE_TRANSFERS | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_NUM_TRANSFERS | SR_CONF_GET,
+	SR_CONF_TRANSFER_SIZE | SR_CONF_GET,
 };
 
 static const int32_t trigger_matches[] = {
@@ -175,14 +178,112 @@ static gboolean is_plausible(const struct libusb_device_descriptor *des)
 	return FALSE;
 }
 
+static const struct fx2lafw_profile *find_profile(
+		const struct libusb_device_descriptor *des,
+		const char *manufacturer, const char *product)
+{
+	int i;
+
+	for (i = 0; supported_fx2[i].vid; i++) {
+		if (des->idVendor == supported_fx2[i].vid &&
+				des->idProduct == supported_fx2[i].pid &&
+				(!supported_fx2[i].usb_manufacturer ||
+				 !strcmp(manufacturer, supported_fx2[i].usb_manufacturer)) &&
+				(!supported_fx2[i].usb_product ||
+				 !strcmp(product, supported_fx2[i].usb_product)))
+			return &supported_fx2[i];
+	}
+
+	return NULL;
+}
+
+static struct sr_dev_inst *dev_inst_new(const struct fx2lafw_profile *prof,
+		const char *serial_num, const char *connection_id)
+{
+	struct dev_context *devc;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct sr_channel_group *cg;
+	int j;
+	int num_logic_channels, num_analog_channels;
+	char channel_name[16];
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INITIALIZING;
+	sdi->vendor = g_strdup(prof->vendor);
+	sdi->model = g_strdup(prof->model);
+	sdi->version = g_strdup(prof->model_version);
+	sdi->serial_num = g_strdup(serial_num);
+	sdi->connection_id = g_strdup(connection_id);
+
+	/* Fill in channellist according to this device's profile. */
+	num_logic_channels = prof->dev_caps & DEV_CAPS_16BIT ? 16 : 8;
+	num_analog_channels = prof->dev_caps & DEV_CAPS_AX_ANALOG ? 1 : 0;
+
+	/* Logic channels, all in one channel group. */
+	cg = sr_channel_group_new(sdi, "Logic", NULL);
+	for (j = 0; j < num_logic_channels; j++) {
+		sprintf(channel_name, "D%d", j);
+		ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
+					TRUE, channel_name);
+		cg->channels = g_slist_append(cg->channels, ch);
+	}
+
+	for (j = 0; j < num_analog_channels; j++) {
+		snprintf(channel_name, 16, "A%d", j);
+		ch = sr_channel_new(sdi, j + num_logic_channels,
+				SR_CHANNEL_ANALOG, TRUE, channel_name);
+
+		/* Every analog channel gets its own channel group. */
+		cg = sr_channel_group_new(sdi, channel_name, NULL);
+		cg->channels = g_slist_append(NULL, ch);
+	}
+
+	devc = fx2lafw_dev_new();
+	devc->profile = prof;
+	devc->samplerates = samplerates;
+	devc->num_samplerates = ARRAY_SIZE(samplerates);
+	sdi->priv = devc;
+
+	return sdi;
+}
+
+/* Create a device which replays a USB dump, see usb_replay.c. */
+static GSList *scan_replay(struct sr_dev_driver *di, const char *path)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	GSList *devices;
+	const struct fx2lafw_profile *prof;
+	struct libusb_device_descriptor des;
+	const char *strings[3];
+
+	if (!(usb = sr_usb_replay_open(path)))
+		return NULL;
+
+	sr_usb_replay_identity(usb, &des, strings);
+	if (!(prof = find_profile(&des, strings[0], strings[1]))) {
+		sr_usb_dev_inst_free(usb);
+		return NULL;
+	}
+
+	sdi = dev_inst_new(prof, strings[2], path);
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_USB;
+	sdi->conn = usb;
+
+	devices = std_scan_complete(di, g_slist_append(NULL, sdi));
+	sr_usb_replay_restore(sdi);
+
+	return devices;
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
-	struct sr_channel *ch;
-	struct sr_channel_group *cg;
 	struct sr_config *src;
 	const struct fx2lafw_profile *prof;
 	GSList *l, *devices, *conn_devices;
@@ -190,11 +291,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
 	struct libusb_device_handle *hdl;
-	int ret, i, j;
-	int num_logic_channels = 0, num_analog_channels = 0;
+	int ret, i;
 	const char *conn;
 	char manufacturer[64], product[64], serial_num[64], connection_id[64];
-	char channel_name[16];
 
 	drvc = di->context;
 
@@ -207,6 +306,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			break;
 		}
 	}
+	if (sr_usb_replay_path(conn))
+		return scan_replay(di, sr_usb_replay_path(conn));
 	if (conn)
 		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 	else
@@ -214,7 +315,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all fx2lafw compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -277,61 +378,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		if (usb_get_port_path(devlist[i], connection_id, sizeof(connection_id)) < 0)
 			continue;
 
-		prof = NULL;
-		for (j = 0; supported_fx2[j].vid; j++) {
-			if (des.idVendor == supported_fx2[j].vid &&
-					des.idProduct == supported_fx2[j].pid &&
-					(!supported_fx2[j].usb_manufacturer ||
-					 !strcmp(manufacturer, supported_fx2[j].usb_manufacturer)) &&
-					(!supported_fx2[j].usb_product ||
-					 !strcmp(product, supported_fx2[j].usb_product))) {
-				prof = &supported_fx2[j];
-				break;
-			}
-		}
-
-		if (!prof)
+		if (!(prof = find_profile(&des, manufacturer, product)))
 			continue;
 
-		sdi = g_malloc0(sizeof(struct sr_dev_inst));
-		sdi->status = SR_ST_INITIALIZING;
-		sdi->vendor = g_strdup(prof->vendor);
-		sdi->model = g_strdup(prof->model);
-		sdi->version = g_strdup(prof->model_version);
-		sdi->serial_num = g_strdup(serial_num);
-		sdi->connection_id = g_strdup(connection_id);
-
-		/* Fill in channellist according to this device's profile. */
-		num_logic_channels = prof->dev_caps & DEV_CAPS_16BIT ? 16 : 8;
-		num_analog_channels = prof->dev_caps & DEV_CAPS_AX_ANALOG ? 1 : 0;
-
-		/* Logic channels, all in one channel group. */
-		cg = sr_channel_group_new(sdi, "Logic", NULL);
-		for (j = 0; j < num_logic_channels; j++) {
-			sprintf(channel_name, "D%d", j);
-			ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
-						TRUE, channel_name);
-			cg->channels = g_slist_append(cg->channels, ch);
-		}
-
-		for (j = 0; j < num_analog_channels; j++) {
-			snprintf(channel_name, 16, "A%d", j);
-			ch = sr_channel_new(sdi, j + num_logic_channels,
-					SR_CHANNEL_ANALOG, TRUE, channel_name);
-
-			/* Every analog channel gets its own channel group. */
-			cg = sr_channel_group_new(sdi, channel_name, NULL);
-			cg->channels = g_slist_append(NULL, ch);
-		}
-
-		devc = fx2lafw_dev_new();
-		devc->profile = prof;
-		sdi->priv = devc;
+		sdi = dev_inst_new(prof, serial_num, connection_id);
+		devc = sdi->priv;
 		devices = g_slist_append(devices, sdi);
 
-		devc->samplerates = samplerates;
-		devc->num_samplerates = ARRAY_SIZE(samplerates);
-		has_firmware = usb_match_manuf_prod(devlist[i],
+		has_firmware = usb_match_manuf_prod(drvc->sr_ctx, devlist[i],
 				"sigrok", "fx2lafw");
 
 		if (has_firmware) {
@@ -377,6 +431,7 @@ static int dev_clear(const struct sr_dev_driver *di)
 static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct sr_dev_driver *di = sdi->driver;
+	struct drv_context *drvc = di->context;
 	struct sr_usb_dev_inst *usb;
 	struct dev_context *devc;
 	int ret;
@@ -385,6 +440,9 @@ static int dev_open(struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	usb = sdi->conn;
 
+	if (usb->replay)
+		goto defaults;
+
 	/*
 	 * If the firmware was recently uploaded, wait up to MAX_RENUM_DELAY_MS
 	 * milliseconds for the FX2 to renumerate.
@@ -392,8 +450,14 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/*
+		 * Hotplug events tell when the device is back. Without them,
+		 * assume it takes >= 300ms for the FX2 to be gone from the
+		 * USB bus, then poll.
+		 */
+		if (sr_usb_renum_wait(drvc->sr_ctx, sdi->connection_id,
+				devc->fw_updated, MAX_RENUM_DELAY_MS) == SR_ERR_NA)
+			g_usleep(300 * 1000);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = fx2lafw_dev_open(sdi, di)) == SR_OK)
@@ -408,6 +472,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 			sr_err("Device failed to renumerate.");
 			return SR_ERR;
 		}
+		timediff_ms = (g_get_monotonic_time() - devc->fw_updated) / 1000;
 		sr_info("Device came back after %" PRIi64 "ms.", timediff_ms);
 	} else {
 		sr_info("Firmware upload was not needed.");
@@ -438,6 +503,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+defaults:
 	if (devc->cur_samplerate == 0) {
 		/* Samplerate hasn't been set; default to the slowest one. */
 		devc->cur_samplerate = devc->samplerates[0];
@@ -452,14 +518,16 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
+	if (usb->replay)
+		return SR_OK;
+
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
-	libusb_close(usb->devhdl);
-	usb->devhdl = NULL;
+	sr_usb_close(usb);
 
 	return SR_OK;
 }
@@ -500,6 +568,19 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
 		break;
+	case SR_CONF_ADAPTIVE_TRANSFERS:
+		*data = g_variant_new_boolean(devc->adaptive_transfers);
+		break;
+	case SR_CONF_NUM_TRANSFERS:
+		if (!devc->cur_samplerate)
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(fx2lafw_num_transfers(devc));
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		if (!devc->cur_samplerate)
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(fx2lafw_transfer_size(devc));
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -535,6 +616,9 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_CAPTURE_RATIO:
 		devc->capture_ratio = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_ADAPTIVE_TRANSFERS:
+		devc->adaptive_transfers = g_variant_get_boolean(data);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -572,7 +656,7 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	fx2lafw_abort_acquisition(sdi->priv);
+	fx2lafw_abort_acquisition(sdi);
 
 	return SR_OK;
 }
@@ -127,7 +127,7 @@ static int command_start_acquisition(const struct sr_dev_inst *sdi)
 	cmd.flags |= (g_slist_length(devc->enabled_analog_channels) > 0) ? CMD_START_FLAGS_CLK_CTL2 : 0;
 
 	/* Send the control message. */
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT);
 	if (ret < 0) {
@@ -267,15 +267,17 @@ SR_PRIV struct dev_context *fx2lafw_dev_new(void)
 	return devc;
 }
 
-SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc)
+SR_PRIV void fx2lafw_abort_acquisition(const struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	int i;
 
+	devc = sdi->priv;
 	devc->acq_aborted = TRUE;
 
 	for (i = devc->num_transfers - 1; i >= 0; i--) {
 		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
+			sr_usb_cancel_transfer(sdi, devc->transfers[i]);
 	}
 }
 
@@ -289,8 +291,13 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	usb_source_remove(sdi->session, devc->ctx);
 
+	sr_usb_raw_record_stop(sdi);
+	devc->raw_record = FALSE;
+
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
+	g_free(devc->transfer_buffers);
+	devc->transfer_buffers = NULL;
 
 	/* Free the deinterlace buffers if we had them. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
@@ -313,10 +320,6 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
 	for (i = 0; i < devc->num_transfers; i++) {
 		if (devc->transfers[i] == transfer) {
 			devc->transfers[i] = NULL;
@@ -324,16 +327,81 @@ static void free_transfer(struct libusb_transfer *transfer)
 		}
 	}
 
+	/* The buffer may live on in packet copies held by consumers. */
+	if (i < devc->num_transfers && devc->transfer_buffers[i]) {
+		sr_datafeed_buffer_unref(devc->transfer_buffers[i]);
+		devc->transfer_buffers[i] = NULL;
+	} else {
+		g_free(transfer->buffer);
+	}
+	transfer->buffer = NULL;
+	libusb_free_transfer(transfer);
+
 	devc->submitted_transfers--;
 	if (devc->submitted_transfers == 0)
 		finish_acquisition(sdi);
 }
 
+static struct sr_datafeed_buffer **transfer_buffer_slot(
+	struct dev_context *devc, struct libusb_transfer *transfer)
+{
+	unsigned int i;
+
+	for (i = 0; i < devc->num_transfers; i++) {
+		if (devc->transfers[i] == transfer)
+			return &devc->transfer_buffers[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Consumers may have kept a reference to the buffer which was sent
+ * from this transfer. Don't let the device overwrite their data, get
+ * the transfer a fresh buffer instead.
+ */
+static int renew_transfer_buffer(struct dev_context *devc,
+	struct libusb_transfer *transfer)
+{
+	struct sr_datafeed_buffer **slot, *buf;
+
+	slot = transfer_buffer_slot(devc, transfer);
+	if (!slot || !*slot || !sr_datafeed_buffer_is_shared(*slot))
+		return SR_OK;
+
+	if (!(buf = sr_datafeed_buffer_new(transfer->length)))
+		return SR_ERR_MALLOC;
+	sr_datafeed_buffer_unref(*slot);
+	*slot = buf;
+	transfer->buffer = sr_datafeed_buffer_data(buf);
+
+	return SR_OK;
+}
+
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/* Retire the transfer when the adaptive depth was lowered. */
+	if (devc->adaptive_transfers &&
+			(unsigned int)devc->submitted_transfers > devc->active_transfers) {
+		free_transfer(transfer);
+		return;
+	}
+
+	transfer->timeout = devc->transfer_timeout;
+	if (renew_transfer_buffer(devc, transfer) != SR_OK) {
+		sr_err("%s: USB transfer buffer malloc failed.", __func__);
+		free_transfer(transfer);
+		return;
+	}
+
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -341,10 +409,43 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 
 }
 
+/* Compact the even bytes of a little endian word into its low half. */
+static inline uint64_t even_bytes(uint64_t w)
+{
+	w &= UINT64_C(0x00ff00ff00ff00ff);
+	w = (w | (w >> 8)) & UINT64_C(0x0000ffff0000ffff);
+	w = (w | (w >> 16)) & UINT64_C(0x00000000ffffffff);
+
+	return w;
+}
+
+/*
+ * Split the interleaved logic and ADC bytes, eight samples at a time.
+ * Plain word operations, which compilers keep in registers or turn
+ * into vector shuffles.
+ */
+static void mso_deinterleave(const uint8_t *data, size_t count,
+	uint8_t *logic, uint8_t *analog)
+{
+	uint64_t lo, hi;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		lo = read_u64le(data + 2 * i);
+		hi = read_u64le(data + 2 * i + 8);
+		write_u64le(logic + i, even_bytes(lo) | (even_bytes(hi) << 32));
+		write_u64le(analog + i,
+			even_bytes(lo >> 8) | (even_bytes(hi >> 8) << 32));
+	}
+	for (; i < count; i++) {
+		logic[i] = data[2 * i];
+		analog[i] = data[2 * i + 1];
+	}
+}
+
 static void mso_send_data_proc(struct sr_dev_inst *sdi,
 	uint8_t *data, size_t length, size_t sample_width)
 {
-	size_t i;
 	struct dev_context *devc;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
@@ -357,13 +458,9 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	length /= 2;
 
-	/* Send the logic */
-	for (i = 0; i < length; i++) {
-		devc->logic_buffer[i] = data[i * 2];
-		/* Rescale to -10V - +10V from 0-255. */
-		devc->analog_buffer[i] = (data[i * 2 + 1] - 128.0f) / 12.8f;
-	};
+	mso_deinterleave(data, length, devc->logic_buffer, devc->analog_buffer);
 
+	/* Send the logic */
 	const struct sr_datafeed_logic logic = {
 		.length = length,
 		.unitsize = 1,
@@ -377,7 +474,16 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	sr_session_send(sdi, &logic_packet);
 
+	/*
+	 * The raw ADC bytes go out, rescaled to -10V - +10V from 0-255 by
+	 * the encoding: (x - 128) / 12.8 = x * 5/64 - 10.
+	 */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	encoding.unitsize = sizeof(uint8_t);
+	encoding.is_signed = FALSE;
+	encoding.is_float = FALSE;
+	sr_rational_set(&encoding.scale, 5, 64);
+	sr_rational_set(&encoding.offset, -10, 1);
 	analog.meaning->channels = devc->enabled_analog_channels;
 	analog.meaning->mq = SR_MQ_VOLTAGE;
 	analog.meaning->unit = SR_UNIT_VOLT;
@@ -396,6 +502,10 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 static void la_send_data_proc(struct sr_dev_inst *sdi,
 	uint8_t *data, size_t length, size_t sample_width)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
 	const struct sr_datafeed_logic logic = {
 		.length = length,
 		.unitsize = sample_width,
@@ -407,9 +517,11 @@ static void la_send_data_proc(struct sr_dev_inst *sdi,
 		.payload = &logic
 	};
 
-	sr_session_send(sdi, &packet);
+	sr_session_send_buffer(sdi, &packet, devc->send_buffer);
 }
 
+static void adapt_transfers(struct sr_dev_inst *sdi);
+
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
@@ -418,9 +530,11 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	unsigned int num_samples;
 	int trigger_offset, cur_sample_count, unitsize, processed_samples;
 	int pre_trigger_samples;
+	struct sr_datafeed_buffer **slot;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
+	slot = NULL;
 
 	/*
 	 * If acquisition has already ended, just free any queued up
@@ -441,7 +555,7 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 
 	switch (transfer->status) {
 	case LIBUSB_TRANSFER_NO_DEVICE:
-		fx2lafw_abort_acquisition(devc);
+		fx2lafw_abort_acquisition(sdi);
 		free_transfer(transfer);
 		return;
 	case LIBUSB_TRANSFER_COMPLETED:
@@ -453,13 +567,15 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	}
 
 	if (transfer->actual_length == 0 || packet_has_error) {
+		sr_session_report_transfers(sdi, packet_has_error ? 1 : 0,
+			packet_has_error ? 0 : 1);
 		devc->empty_transfer_count++;
 		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
 			/*
 			 * The FX2 gave up. End the acquisition, the frontend
 			 * will work out that the samplecount is short.
 			 */
-			fx2lafw_abort_acquisition(devc);
+			fx2lafw_abort_acquisition(sdi);
 			free_transfer(transfer);
 		} else {
 			resubmit_transfer(transfer);
@@ -469,6 +585,25 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		devc->empty_transfer_count = 0;
 	}
 
+	if (devc->adaptive_transfers)
+		adapt_transfers(sdi);
+
+	if (devc->raw_record) {
+		/* The dump has the data, replaying it decodes them. */
+		devc->sent_samples += cur_sample_count;
+		if (devc->limit_samples &&
+				devc->sent_samples >= devc->limit_samples) {
+			fx2lafw_abort_acquisition(sdi);
+			free_transfer(transfer);
+		} else {
+			resubmit_transfer(transfer);
+		}
+		return;
+	}
+
+	slot = transfer_buffer_slot(devc, transfer);
+	devc->send_buffer = slot ? *slot : NULL;
+
 check_trigger:
 	if (devc->trigger_fired) {
 		if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
@@ -488,7 +623,6 @@ check_trigger:
 			transfer->actual_length - processed_samples * unitsize,
 			&pre_trigger_samples);
 		if (trigger_offset > -1) {
-			std_session_send_df_frame_begin(sdi);
 			devc->sent_samples += pre_trigger_samples;
 			num_samples = cur_sample_count - processed_samples - trigger_offset;
 			if (devc->limit_samples &&
@@ -515,12 +649,15 @@ check_trigger:
 		devc->trigger_fired = FALSE;
 		std_session_send_df_frame_end(sdi);
 
+		/* Re-arm the trigger for the next segment. */
+		if (devc->stl)
+			soft_trigger_logic_rearm(devc->stl, processed_samples ?
+				(uint8_t *)transfer->buffer
+				+ (processed_samples - 1) * unitsize : NULL);
+
 		/* There may be another trigger in the remaining data, go back and check for it */
 		if (processed_samples < cur_sample_count) {
-			/* Reset the trigger stage */
-			if (devc->stl)
-				devc->stl->cur_stage = 0;
-			else {
+			if (!devc->stl) {
 				std_session_send_df_frame_begin(sdi);
 				devc->trigger_fired = TRUE;
 			}
@@ -529,7 +666,7 @@ check_trigger:
 		}
 	}
 	if (frame_ended && final_frame) {
-		fx2lafw_abort_acquisition(devc);
+		fx2lafw_abort_acquisition(sdi);
 		free_transfer(transfer);
 	} else
 		resubmit_transfer(transfer);
@@ -600,17 +737,132 @@ static unsigned int get_number_of_transfers(struct dev_context *devc)
 	return n;
 }
 
-static unsigned int get_timeout(struct dev_context *devc)
+static unsigned int get_timeout_for(struct dev_context *devc,
+	unsigned int num_transfers)
 {
 	size_t total_size;
 	unsigned int timeout;
 
-	total_size = get_buffer_size(devc) *
-			get_number_of_transfers(devc);
+	total_size = get_buffer_size(devc) * num_transfers;
 	timeout = total_size / to_bytes_per_ms(devc->cur_samplerate);
 	return timeout + timeout / 4; /* Leave a headroom of 25% percent. */
 }
 
+static unsigned int get_timeout(struct dev_context *devc)
+{
+	return get_timeout_for(devc, get_number_of_transfers(devc));
+}
+
+SR_PRIV size_t fx2lafw_transfer_size(struct dev_context *devc)
+{
+	return get_buffer_size(devc);
+}
+
+SR_PRIV unsigned int fx2lafw_num_transfers(struct dev_context *devc)
+{
+	/* Report the depth of the running (or last) acquisition. */
+	if (devc->active_transfers)
+		return devc->active_transfers;
+
+	return get_number_of_transfers(devc);
+}
+
+static int submit_transfer(const struct sr_dev_inst *sdi, unsigned int slot)
+{
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	struct libusb_transfer *transfer;
+	struct sr_datafeed_buffer *buf;
+	size_t size;
+	int ret;
+
+	devc = sdi->priv;
+	usb = sdi->conn;
+	size = get_buffer_size(devc);
+
+	if (!(buf = sr_usb_datafeed_buffer_new(usb, size))) {
+		sr_err("USB transfer buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	transfer = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(transfer, usb->devhdl,
+			2 | LIBUSB_ENDPOINT_IN,
+			sr_datafeed_buffer_data(buf), size,
+			receive_transfer, (void *)sdi, devc->transfer_timeout);
+	sr_info("submitting transfer: %d", slot);
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
+		sr_err("Failed to submit transfer: %s.",
+		       libusb_error_name(ret));
+		libusb_free_transfer(transfer);
+		sr_datafeed_buffer_unref(buf);
+		return SR_ERR;
+	}
+	devc->transfers[slot] = transfer;
+	devc->transfer_buffers[slot] = buf;
+	devc->submitted_transfers++;
+
+	return SR_OK;
+}
+
+/*
+ * Track the gaps between transfer completions. When the longest gap
+ * within a window of completions approaches the time which it takes
+ * the device to fill all transfers in flight, the host is at risk of
+ * letting the FX2's FIFO overflow: add transfers. When the gaps stay
+ * far below that for several windows, retire a transfer.
+ */
+static void adapt_transfers(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int64_t now, gap, budget;
+	unsigned int slot, n;
+
+	devc = sdi->priv;
+
+	now = g_get_monotonic_time();
+	if (devc->last_completion && now - devc->last_completion > devc->max_completion_gap)
+		devc->max_completion_gap = now - devc->last_completion;
+	devc->last_completion = now;
+	if (++devc->window_completions < ADAPT_WINDOW)
+		return;
+
+	gap = devc->max_completion_gap;
+	devc->max_completion_gap = 0;
+	devc->window_completions = 0;
+	budget = (int64_t)devc->active_transfers * get_buffer_size(devc)
+		* 1000 / to_bytes_per_ms(devc->cur_samplerate);
+
+	if (gap > budget / 2 && devc->active_transfers < devc->num_transfers) {
+		n = MAX(1, devc->active_transfers / 4);
+		n = MIN(n, devc->num_transfers - devc->active_transfers);
+		devc->active_transfers += n;
+		devc->transfer_timeout = get_timeout_for(devc, devc->active_transfers);
+		for (slot = 0; slot < devc->num_transfers && n; slot++) {
+			if (devc->transfers[slot])
+				continue;
+			if (submit_transfer(sdi, slot) != SR_OK)
+				break;
+			n--;
+		}
+		devc->active_transfers -= n;
+		devc->idle_windows = 0;
+		sr_dbg("Completion gap %" PRIi64 "us of %" PRIi64 "us budget, "
+			"now %u transfers.", gap, budget, devc->active_transfers);
+	} else if (gap < budget / 8) {
+		if (++devc->idle_windows < ADAPT_IDLE_WINDOWS)
+			return;
+		devc->idle_windows = 0;
+		if (devc->active_transfers <= MIN_ADAPTIVE_TRANSFERS)
+			return;
+		devc->active_transfers--;
+		devc->transfer_timeout = get_timeout_for(devc, devc->active_transfers);
+		sr_dbg("Completion gap %" PRIi64 "us of %" PRIi64 "us budget, "
+			"now %u transfers.", gap, budget, devc->active_transfers);
+	} else {
+		devc->idle_windows = 0;
+	}
+}
+
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
@@ -630,16 +882,11 @@ static int receive_data(int fd, int revents, void *cb_data)
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
 	struct sr_trigger *trigger;
-	struct libusb_transfer *transfer;
-	unsigned int i, num_transfers;
-	int timeout, ret;
-	unsigned char *buf;
-	size_t size;
+	unsigned int i, num_transfers, num_slots;
+	int ret;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
 
 	devc->sent_samples = 0;
 	devc->acq_aborted = FALSE;
@@ -652,6 +899,8 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
 		if (!devc->stl)
 			return SR_ERR_MALLOC;
+		/* Each trigger starts a frame, the pre-trigger data is in it. */
+		devc->stl->frames = TRUE;
 		devc->trigger_fired = FALSE;
 	} else {
 		std_session_send_df_frame_begin(sdi);
@@ -659,38 +908,38 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	}
 
 	num_transfers = get_number_of_transfers(devc);
-
-	size = get_buffer_size(devc);
+	devc->active_transfers = num_transfers;
+	devc->transfer_timeout = get_timeout(devc);
+	devc->last_completion = 0;
+	devc->max_completion_gap = 0;
+	devc->window_completions = 0;
+	devc->idle_windows = 0;
 	devc->submitted_transfers = 0;
 
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
-	if (!devc->transfers) {
+	/* Leave room for more transfers in adaptive mode. */
+	num_slots = num_transfers;
+	if (devc->adaptive_transfers)
+		num_slots = MAX(num_transfers, MAX_ADAPTIVE_TRANSFERS);
+
+	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_slots);
+	devc->transfer_buffers = g_try_malloc0(
+		sizeof(*devc->transfer_buffers) * num_slots);
+	if (!devc->transfers || !devc->transfer_buffers) {
 		sr_err("USB transfers malloc failed.");
+		g_free(devc->transfers);
+		g_free(devc->transfer_buffers);
+		devc->transfers = NULL;
+		devc->transfer_buffers = NULL;
 		return SR_ERR_MALLOC;
 	}
 
-	timeout = get_timeout(devc);
-	devc->num_transfers = num_transfers;
+	devc->num_transfers = num_slots;
 	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			fx2lafw_abort_acquisition(devc);
-			return SR_ERR;
+		ret = submit_transfer(sdi, i);
+		if (ret != SR_OK) {
+			fx2lafw_abort_acquisition(sdi);
+			return ret;
 		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
 	}
 
 	/*
@@ -725,6 +974,7 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	devc->sent_samples = 0;
 	devc->empty_transfer_count = 0;
 	devc->acq_aborted = FALSE;
+	devc->raw_record = sr_usb_raw_record_start(sdi);
 
 	if (configure_channels(sdi) != SR_OK) {
 		sr_err("Failed to configure channels.");
@@ -739,12 +989,11 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
 		/* We need a buffer half the size of a transfer. */
 		devc->logic_buffer = g_try_malloc(size / 2);
-		devc->analog_buffer = g_try_malloc(
-			sizeof(float) * size / 2);
+		devc->analog_buffer = g_try_malloc(size / 2);
 	}
 	start_transfers(sdi);
 	if ((ret = command_start_acquisition(sdi)) != SR_OK) {
-		fx2lafw_abort_acquisition(devc);
+		fx2lafw_abort_acquisition(sdi);
 		return ret;
 	}
 
@@ -39,6 +39,12 @@
 #define NUM_SIMUL_TRANSFERS	32
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
 
+/* Bounds and pace for adapting the number of transfers in flight. */
+#define MIN_ADAPTIVE_TRANSFERS	4
+#define MAX_ADAPTIVE_TRANSFERS	128
+#define ADAPT_WINDOW		64
+#define ADAPT_IDLE_WINDOWS	8
+
 #define NUM_CHANNELS		16
 
 #define FX2LAFW_REQUIRED_VERSION_MAJOR	1
@@ -108,6 +114,8 @@ struct dev_context {
 
 	gboolean trigger_fired;
 	gboolean acq_aborted;
+	/* Recording raw transfers instead of decoding them. */
+	gboolean raw_record;
 	gboolean sample_wide;
 	struct soft_trigger_logic *stl;
 
@@ -118,16 +126,32 @@ struct dev_context {
 
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
+	/*
+	 * In adaptive mode, num_transfers slots are allocated, and the
+	 * number of transfers in flight follows active_transfers.
+	 */
+	gboolean adaptive_transfers;
+	unsigned int active_transfers;
+	unsigned int transfer_timeout;
+	int64_t last_completion;
+	int64_t max_completion_gap;
+	unsigned int window_completions;
+	unsigned int idle_windows;
+	/* Refcounted sample memory of each transfer, shared with consumers. */
+	struct sr_datafeed_buffer **transfer_buffers;
+	struct sr_datafeed_buffer *send_buffer;
 	struct sr_context *ctx;
 	void (*send_data_proc)(struct sr_dev_inst *sdi,
 		uint8_t *data, size_t length, size_t sample_width);
 	uint8_t *logic_buffer;
-	float *analog_buffer;
+	uint8_t *analog_buffer;
 };
 
 SR_PRIV int fx2lafw_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di);
 SR_PRIV struct dev_context *fx2lafw_dev_new(void);
 SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi);
-SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc);
+SR_PRIV void fx2lafw_abort_acquisition(const struct sr_dev_inst *sdi);
+SR_PRIV size_t fx2lafw_transfer_size(struct dev_context *devc);
+SR_PRIV unsigned int fx2lafw_num_transfers(struct dev_context *devc);
 
 #endif
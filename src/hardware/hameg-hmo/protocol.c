@@ -870,64 +870,67 @@ static int analog_channel_state_get(struct sr_dev_inst *sdi,
 				    const struct scope_config *config,
 				    struct scope_state *state)
 {
-	unsigned int i, j;
-	char command[MAX_COMMAND_SIZE];
+	unsigned int i, j, q;
+	int ret, idx;
 	char *tmp_str;
 	struct sr_channel *ch;
-	struct sr_scpi_dev_inst *scpi = sdi->conn;
+	struct sr_scpi_batch *batch;
 
+	/* Query all channels at once, five queries per channel. */
+	batch = sr_scpi_batch_new(BATCH_MAX_LEN);
 	for (i = 0; i < config->analog_channels; i++) {
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_ANALOG_CHAN_STATE],
-			   i + 1);
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_ANALOG_CHAN_STATE], i + 1);
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_SCALE], i + 1);
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_OFFSET], i + 1);
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_COUPLING], i + 1);
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_PROBE_UNIT], i + 1);
+	}
 
-		if (sr_scpi_get_bool(scpi, command,
+	ret = SR_ERR;
+	if (sr_scpi_batch_run(sdi->conn, batch) != SR_OK)
+		goto exit;
+
+	for (i = 0, q = 0; i < config->analog_channels; i++, q += 5) {
+		if (sr_scpi_batch_get_bool(batch, q,
 				     &state->analog_channels[i].state) != SR_OK)
-			return SR_ERR;
+			goto exit;
 
 		ch = get_channel_by_index_and_type(sdi->channels, i, SR_CHANNEL_ANALOG);
 		if (ch)
 			ch->enabled = state->analog_channels[i].state;
 
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_SCALE],
-			   i + 1);
-
-		if (sr_scpi_get_string(scpi, command, &tmp_str) != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_string(batch, q + 1, &tmp_str) != SR_OK)
+			goto exit;
 
 		if (array_float_get(tmp_str, ARRAY_AND_SIZE(vdivs), &j) != SR_OK) {
 			g_free(tmp_str);
 			sr_err("Could not determine array index for vertical div scale.");
-			return SR_ERR;
+			goto exit;
 		}
 
 		g_free(tmp_str);
 		state->analog_channels[i].vdiv = j;
 
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_OFFSET],
-			   i + 1);
-
-		if (sr_scpi_get_float(scpi, command,
+		if (sr_scpi_batch_get_float(batch, q + 2,
 				     &state->analog_channels[i].vertical_offset) != SR_OK)
-			return SR_ERR;
-
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_COUPLING],
-			   i + 1);
-
-		if (scope_state_get_array_option(scpi, command, config->coupling_options,
-					 config->num_coupling_options,
-					 &state->analog_channels[i].coupling) != SR_OK)
-			return SR_ERR;
+			goto exit;
 
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_PROBE_UNIT],
-			   i + 1);
+		if (sr_scpi_batch_get_string(batch, q + 3, &tmp_str) != SR_OK)
+			goto exit;
+		idx = std_str_idx_s(tmp_str, *config->coupling_options,
+			config->num_coupling_options);
+		g_free(tmp_str);
+		if (idx < 0)
+			goto exit;
+		state->analog_channels[i].coupling = idx;
 
-		if (sr_scpi_get_string(scpi, command, &tmp_str) != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_string(batch, q + 4, &tmp_str) != SR_OK)
+			goto exit;
 
 		if (tmp_str[0] == 'A')
 			state->analog_channels[i].probe_unit = 'A';
@@ -936,7 +939,12 @@ static int analog_channel_state_get(struct sr_dev_inst *sdi,
 		g_free(tmp_str);
 	}
 
-	return SR_OK;
+	ret = SR_OK;
+
+exit:
+	sr_scpi_batch_free(batch);
+
+	return ret;
 }
 
 static int digital_channel_state_get(struct sr_dev_inst *sdi,
@@ -948,21 +956,28 @@ static int digital_channel_state_get(struct sr_dev_inst *sdi,
 	char *logic_threshold_short[MAX_NUM_LOGIC_THRESHOLD_ENTRIES];
 	char command[MAX_COMMAND_SIZE];
 	struct sr_channel *ch;
+	struct sr_scpi_batch *batch;
 	struct sr_scpi_dev_inst *scpi = sdi->conn;
 
-	for (i = 0; i < config->digital_channels; i++) {
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_DIG_CHAN_STATE],
-			   i);
-
-		if (sr_scpi_get_bool(scpi, command,
-				     &state->digital_channels[i]) != SR_OK)
-			return SR_ERR;
+	batch = sr_scpi_batch_new(BATCH_MAX_LEN);
+	for (i = 0; i < config->digital_channels; i++)
+		sr_scpi_batch_add(batch,
+			(*config->scpi_dialect)[SCPI_CMD_GET_DIG_CHAN_STATE], i);
+	result = sr_scpi_batch_run(scpi, batch);
+	for (i = 0; i < config->digital_channels && result == SR_OK; i++) {
+		result = sr_scpi_batch_get_bool(batch, i,
+				&state->digital_channels[i]);
+		if (result != SR_OK)
+			break;
 
 		ch = get_channel_by_index_and_type(sdi->channels, i, SR_CHANNEL_LOGIC);
 		if (ch)
 			ch->enabled = state->digital_channels[i];
 	}
+	sr_scpi_batch_free(batch);
+	if (result != SR_OK)
+		return SR_ERR;
+	result = SR_ERR;
 
 	/* According to the SCPI standard, on models that support multiple
 	 * user-defined logic threshold settings the response to the command
@@ -32,6 +32,7 @@
 
 #define MAX_INSTRUMENT_VERSIONS		10
 #define MAX_COMMAND_SIZE		128
+#define BATCH_MAX_LEN			256
 #define MAX_ANALOG_CHANNEL_COUNT	4
 #define MAX_DIGITAL_CHANNEL_COUNT	16
 #define MAX_DIGITAL_GROUP_COUNT		2
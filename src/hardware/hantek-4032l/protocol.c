@@ -53,11 +53,17 @@ static void abort_acquisition(struct dev_context *devc)
 	devc->status = H4032L_STATUS_IDLE;
 }
 
+static void flush_data(struct sr_dev_inst *sdi);
+
 static void finish_acquisition(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
 	struct drv_context *drvc = sdi->driver->context;
 
+	flush_data(sdi);
+	sr_datafeed_buffer_unref(devc->send_buffer);
+	devc->send_buffer = NULL;
+
 	std_session_send_df_end(sdi);
 	usb_source_remove(sdi->session, drvc->sr_ctx);
 
@@ -73,7 +79,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 
 	if ((transfer->buffer != (unsigned char *)&devc->cmd_pkt) &&
 	    (transfer->buffer != devc->buf)) {
-		g_free(transfer->buffer);
+		sr_buffer_free(transfer->buffer);
 	}
 
 	transfer->buffer = NULL;
@@ -92,9 +98,10 @@ static void free_transfer(struct libusb_transfer *transfer)
 
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *sdi = transfer->user_data;
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -102,7 +109,7 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 }
 
 static void send_data(struct sr_dev_inst *sdi,
-	uint32_t *data, size_t sample_count)
+	uint32_t *data, size_t sample_count, struct sr_datafeed_buffer *buf)
 {
 	struct dev_context *devc = sdi->priv;
 	struct sr_datafeed_logic logic = {
@@ -122,7 +129,7 @@ static void send_data(struct sr_dev_inst *sdi,
 		trigger_offset = devc->trigger_pos - devc->sent_samples;
 		logic.length = trigger_offset * sizeof(uint32_t);
 		if (logic.length)
-			sr_session_send(sdi, &packet);
+			sr_session_send_buffer(sdi, &packet, buf);
 
 		/* Send trigger position. */
 		std_session_send_df_trigger(sdi);
@@ -131,14 +138,66 @@ static void send_data(struct sr_dev_inst *sdi,
 		logic.length = (sample_count - trigger_offset) * sizeof(uint32_t);
 		logic.data = data + trigger_offset;
 		if (logic.length)
-			sr_session_send(sdi, &packet);
+			sr_session_send_buffer(sdi, &packet, buf);
 	} else {
-		sr_session_send(sdi, &packet);
+		sr_session_send_buffer(sdi, &packet, buf);
 	}
 
 	devc->sent_samples += sample_count;
 }
 
+/* Send the collected samples. */
+static void flush_data(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+
+	if (!devc->send_fill)
+		return;
+
+	send_data(sdi, sr_datafeed_buffer_data(devc->send_buffer),
+		devc->send_fill, devc->send_buffer);
+	devc->send_fill = 0;
+
+	/* Queued packets may still use the buffer, take a fresh one. */
+	if (sr_datafeed_buffer_is_shared(devc->send_buffer)) {
+		sr_datafeed_buffer_unref(devc->send_buffer);
+		devc->send_buffer = NULL;
+	}
+}
+
+/*
+ * Collect a transfer's samples, so that they go out in few large
+ * packets rather than one per 2 KiB transfer.
+ */
+static void queue_data(struct sr_dev_inst *sdi,
+	uint32_t *data, size_t sample_count)
+{
+	struct dev_context *devc = sdi->priv;
+	const size_t capacity = H4032L_SEND_BUFFER_SIZE / sizeof(uint32_t);
+	uint32_t *dst;
+	size_t count;
+
+	while (sample_count) {
+		if (!devc->send_buffer) {
+			devc->send_buffer =
+				sr_datafeed_buffer_new(H4032L_SEND_BUFFER_SIZE);
+			if (!devc->send_buffer) {
+				/* Send straight from the transfer instead. */
+				send_data(sdi, data, sample_count, NULL);
+				return;
+			}
+		}
+		dst = sr_datafeed_buffer_data(devc->send_buffer);
+		count = MIN(sample_count, capacity - devc->send_fill);
+		memcpy(dst + devc->send_fill, data, count * sizeof(uint32_t));
+		devc->send_fill += count;
+		data += count;
+		sample_count -= count;
+		if (devc->send_fill == capacity)
+			flush_data(sdi);
+	}
+}
+
 SR_PRIV int h4032l_receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
@@ -185,7 +244,7 @@ void LIBUSB_CALL h4032l_data_transfer_callback(struct libusb_transfer *transfer)
 
 	num_samples = MIN(devc->remaining_samples, max_samples);
 	devc->remaining_samples -= num_samples;
-	send_data(sdi, buf, num_samples);
+	queue_data(sdi, buf, num_samples);
 	sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
 		buf[0], buf[1]);
 
@@ -286,7 +345,7 @@ void LIBUSB_CALL h4032l_usb_callback(struct libusb_transfer *transfer)
 	case H4032L_STATUS_TRANSFER:
 		num_samples = MIN(devc->remaining_samples, max_samples);
 		devc->remaining_samples -= num_samples;
-		send_data(sdi, buf, num_samples);
+		queue_data(sdi, buf, num_samples);
 		sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
 		       buf[0], buf[1]);
 		break;
@@ -318,7 +377,7 @@ void LIBUSB_CALL h4032l_usb_callback(struct libusb_transfer *transfer)
 				(void *)sdi, H4032L_USB_TIMEOUT);
 		}
 		/* Send prepared USB packet. */
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			devc->status = H4032L_STATUS_IDLE;
@@ -356,6 +415,7 @@ uint16_t h4032l_voltage2pwm(double voltage)
 
 SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 {
+	struct drv_context *drvc = sdi->driver->context;
 	struct dev_context *devc = sdi->priv;
 	struct sr_usb_dev_inst *usb = sdi->conn;
 	struct libusb_transfer *transfer;
@@ -380,7 +440,11 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 	devc->num_transfers = num_transfers;
 
 	for (i = 0; i < num_transfers; i++) {
-		buf = g_malloc(H4032L_DATA_BUFFER_SIZE);
+		buf = sr_buffer_alloc(drvc->sr_ctx, H4032L_DATA_BUFFER_SIZE);
+		if (!buf) {
+			abort_acquisition(devc);
+			return SR_ERR_MALLOC;
+		}
 		transfer = libusb_alloc_transfer(0);
 
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
@@ -390,11 +454,11 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 			(void *)sdi, H4032L_USB_TIMEOUT);
 
 		/* Send prepared usb packet. */
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
-			g_free(buf);
+			sr_buffer_free(buf);
 			abort_acquisition(devc);
 			return SR_ERR;
 		}
@@ -437,7 +501,7 @@ SR_PRIV int h4032l_start(const struct sr_dev_inst *sdi)
 		sizeof(struct h4032l_cmd_pkt), h4032l_usb_callback,
 		(void *)sdi, H4032L_USB_TIMEOUT);
 
-	if ((ret = libusb_submit_transfer(transfer)) != 0) {
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
 		sr_err("Failed to submit transfer: %s.",
 		       libusb_error_name(ret));
 		libusb_free_transfer(transfer);
@@ -35,6 +35,8 @@
 
 #define H4032L_DATA_BUFFER_SIZE (2 * 1024)
 #define H4032L_DATA_TRANSFER_MAX_NUM 32
+/* Received samples are sent in packets of this size. */
+#define H4032L_SEND_BUFFER_SIZE (256 * 1024)
 
 #define H4043L_NUM_SAMPLES_MIN (2 * 1024)
 #define H4032L_NUM_SAMPLES_MAX (64 * 1024 * 1024)
@@ -164,6 +166,9 @@ struct dev_context {
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
 	uint8_t buf[512];
+	/* Samples collected from transfers, not sent yet. */
+	struct sr_datafeed_buffer *send_buffer;
+	size_t send_fill;
 	uint64_t capture_ratio;
 	uint32_t trigger_pos;
 	gboolean external_clock;
@@ -123,7 +123,7 @@ static const struct hantek_6xxx_profile dev_profiles[] = {
 };
 
 
-static int read_channel(const struct sr_dev_inst *sdi, uint32_t amount);
+static int start_transfers(const struct sr_dev_inst *sdi);
 
 static struct sr_dev_inst *hantek_6xxx_dev_new(const struct hantek_6xxx_profile *prof)
 {
@@ -232,7 +232,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		conn_devices = NULL;
 
 	/* Find all Hantek 60xx devices and upload firmware to all of them. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -540,7 +540,7 @@ static uint32_t data_amount(const struct sr_dev_inst *sdi)
 	return data_left_2;
 }
 
-static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
+static void send_chunk(struct sr_dev_inst *sdi, const unsigned char *buf,
 		int num_samples)
 {
 	struct sr_datafeed_packet packet;
@@ -550,6 +550,8 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	struct sr_analog_spec spec;
 	struct dev_context *devc = sdi->priv;
 	GSList *channels = devc->enabled_channels;
+	float *data, lut[256];
+	int i, v;
 
 	const float ch_bit[] = { RANGE(0) / 255, RANGE(1) / 255 };
 	const float ch_center[] = { RANGE(0) / 2, RANGE(1) / 2 };
@@ -564,12 +566,8 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0;
 
-	analog.data = g_try_malloc(num_samples * sizeof(float));
-	if (!analog.data) {
-		sr_err("Analog data buffer malloc failed.");
-		devc->dev_state = STOPPING;
-		return;
-	}
+	data = devc->analog_buf;
+	analog.data = data;
 
 	for (int ch = 0; ch < NUM_CHANNELS; ch++) {
 		if (!devc->ch_enabled[ch])
@@ -581,27 +579,29 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 		analog.spec->spec_digits = digits;
 		analog.meaning->channels = g_slist_append(NULL, channels->data);
 
-		for (int i = 0; i < num_samples; i++) {
-			/*
-			 * The device always sends data for both channels. If a channel
-			 * is disabled, it contains a copy of the enabled channel's
-			 * data. However, we only send the requested channels to
-			 * the bus.
-			 *
-			 * Voltage values are encoded as a value 0-255, where the
-			 * value is a point in the range represented by the vdiv
-			 * setting. There are 10 vertical divs, so e.g. 500mV/div
-			 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
-			 */
-			((float *)analog.data)[i] = ch_bit[ch] * *(buf + i * 2 + ch) - ch_center[ch];
-		}
+		/*
+		 * The device always sends data for both channels. If a channel
+		 * is disabled, it contains a copy of the enabled channel's
+		 * data. However, we only send the requested channels to
+		 * the bus.
+		 *
+		 * Voltage values are encoded as a value 0-255, where the
+		 * value is a point in the range represented by the vdiv
+		 * setting. There are 10 vertical divs, so e.g. 500mV/div
+		 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
+		 * Converting the 256 possible values up front leaves a table
+		 * lookup per sample.
+		 */
+		for (v = 0; v < 256; v++)
+			lut[v] = ch_bit[ch] * v - ch_center[ch];
+		for (i = 0; i < num_samples; i++)
+			data[i] = lut[buf[i * 2 + ch]];
 
 		sr_session_send(sdi, &packet);
 		g_slist_free(analog.meaning->channels);
 
 		channels = channels->next;
 	}
-	g_free(analog.data);
 }
 
 /*
@@ -614,21 +614,27 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	unsigned int samples_received;
+	int ret;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
 	if (devc->dev_state == FLUSH) {
-		g_free(transfer->buffer);
-		libusb_free_transfer(transfer);
+		hantek_6xxx_free_transfer(sdi, transfer);
 		devc->dev_state = CAPTURE;
 		devc->aq_started = g_get_monotonic_time();
-		read_channel(sdi, data_amount(sdi));
+		if (start_transfers(sdi) != SR_OK)
+			sr_dev_acquisition_stop(sdi);
 		return;
 	}
 
-	if (devc->dev_state != CAPTURE)
+	if (devc->dev_state != CAPTURE ||
+			transfer->status == LIBUSB_TRANSFER_CANCELLED ||
+			transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+		hantek_6xxx_free_transfer(sdi, transfer);
 		return;
+	}
 
 	sr_spew("receive_transfer(): calculated samplerate == %" PRIu64 "ks/s",
 		(uint64_t)(transfer->actual_length * 1000 /
@@ -638,45 +644,72 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sr_spew("receive_transfer(): status %s received %d bytes.",
 		libusb_error_name(transfer->status), transfer->actual_length);
 
-	if (transfer->actual_length == 0)
-		/* Nothing to send to the bus. */
-		return;
-
-	unsigned samples_received = transfer->actual_length / NUM_CHANNELS;
-	send_chunk(sdi, transfer->buffer, samples_received);
-	devc->samp_received += samples_received;
-
-	g_free(transfer->buffer);
-	libusb_free_transfer(transfer);
+	/* Transfers still in flight may bring more than was asked for. */
+	samples_received = transfer->actual_length / NUM_CHANNELS;
+	if (devc->limit_samples)
+		samples_received = MIN(samples_received,
+			devc->limit_samples - devc->samp_received);
+	if (samples_received) {
+		send_chunk(sdi, transfer->buffer, samples_received);
+		devc->samp_received += samples_received;
+	}
 
 	if (devc->limit_samples && devc->samp_received >= devc->limit_samples) {
 		sr_info("Requested number of samples reached, stopping. %"
 			PRIu64 " <= %" PRIu64, devc->limit_samples,
 			devc->samp_received);
+		hantek_6xxx_free_transfer(sdi, transfer);
 		sr_dev_acquisition_stop(sdi);
+		return;
 	} else if (devc->limit_msec && (g_get_monotonic_time() -
 			devc->aq_started) / 1000 >= devc->limit_msec) {
 		sr_info("Requested time limit reached, stopping. %d <= %d",
 			(uint32_t)devc->limit_msec,
 			(uint32_t)(g_get_monotonic_time() - devc->aq_started) / 1000);
+		hantek_6xxx_free_transfer(sdi, transfer);
+		sr_dev_acquisition_stop(sdi);
+		return;
+	}
+
+	/* The other transfers keep the device busy while this one is out. */
+	transfer->length = MIN(data_amount(sdi), devc->transfer_size);
+	devc->read_start_ts = g_get_monotonic_time();
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) < 0) {
+		sr_err("Failed to resubmit transfer: %s.",
+			libusb_error_name(ret));
+		hantek_6xxx_free_transfer(sdi, transfer);
 		sr_dev_acquisition_stop(sdi);
-	} else {
-		read_channel(sdi, data_amount(sdi));
 	}
 }
 
-static int read_channel(const struct sr_dev_inst *sdi, uint32_t amount)
+/* Set up the transfers which stream channel data until the end. */
+static int start_transfers(const struct sr_dev_inst *sdi)
 {
-	int ret;
 	struct dev_context *devc;
+	unsigned int i;
+	int ret;
 
 	devc = sdi->priv;
 
-	amount = MIN(amount, MAX_PACKET_SIZE);
-	ret = hantek_6xxx_get_channeldata(sdi, receive_transfer, amount);
+	devc->transfer_size = MIN(data_amount(sdi),
+		MAX_PACKET_SIZE / NUM_TRANSFERS);
+	g_free(devc->analog_buf);
+	devc->analog_buf = g_try_malloc(devc->transfer_size / NUM_CHANNELS *
+		sizeof(float));
+	if (!devc->analog_buf) {
+		sr_err("Analog data buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		ret = hantek_6xxx_get_channeldata(sdi, receive_transfer,
+			devc->transfer_size);
+		if (ret != SR_OK)
+			return ret;
+	}
 	devc->read_start_ts = g_get_monotonic_time();
 
-	return ret;
+	return SR_OK;
 }
 
 static int handle_event(int fd, int revents, void *cb_data)
@@ -700,15 +733,17 @@ static int handle_event(int fd, int revents, void *cb_data)
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
 	if (devc->dev_state == STOPPING) {
+		/* Wait for the cancelled transfers to come back. */
+		if (devc->submitted_transfers)
+			return TRUE;
+
 		/* We've been told to wind up the acquisition. */
 		sr_dbg("Stopping acquisition.");
 
 		hantek_6xxx_stop_data_collecting(sdi);
-		/*
-		 * TODO: Doesn't really cancel pending transfers so they might
-		 * come in after SR_DF_END is sent.
-		 */
 		usb_source_remove(sdi->session, drvc->sr_ctx);
+		g_free(devc->analog_buf);
+		devc->analog_buf = NULL;
 
 		std_session_send_df_end(sdi);
 
@@ -746,7 +781,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	hantek_6xxx_start_data_collecting(sdi);
 
-	read_channel(sdi, FLUSH_PACKET_SIZE);
+	devc->read_start_ts = g_get_monotonic_time();
+	hantek_6xxx_get_channeldata(sdi, receive_transfer, FLUSH_PACKET_SIZE);
 
 	return SR_OK;
 }
@@ -754,10 +790,16 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	unsigned int i;
 
 	devc = sdi->priv;
 	devc->dev_state = STOPPING;
 
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+	}
+
 	return SR_OK;
 }
 
@@ -96,42 +96,77 @@ SR_PRIV void hantek_6xxx_close(struct sr_dev_inst *sdi)
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
-	libusb_close(usb->devhdl);
-	usb->devhdl = NULL;
+	sr_usb_close(usb);
 	sdi->status = SR_ST_INACTIVE;
 }
 
+/*
+ * Submit a transfer for channel data. It takes a free slot in the
+ * device's transfer list, hantek_6xxx_free_transfer() releases it.
+ */
 SR_PRIV int hantek_6xxx_get_channeldata(const struct sr_dev_inst *sdi,
 		libusb_transfer_cb_fn cb, uint32_t data_amount)
 {
 	struct sr_usb_dev_inst *usb;
+	struct dev_context *devc;
 	struct libusb_transfer *transfer;
+	unsigned int slot;
 	int ret;
 	unsigned char *buf;
 
 	sr_dbg("Request channel data.");
 
 	usb = sdi->conn;
+	devc = sdi->priv;
 
-	if (!(buf = g_try_malloc(data_amount))) {
+	for (slot = 0; slot < NUM_TRANSFERS; slot++) {
+		if (!devc->transfers[slot])
+			break;
+	}
+	if (slot == NUM_TRANSFERS) {
+		sr_err("No free transfer slot.");
+		return SR_ERR_BUG;
+	}
+
+	if (!(buf = sr_usb_buffer_alloc(usb, data_amount))) {
 		sr_err("Failed to malloc USB endpoint buffer.");
 		return SR_ERR_MALLOC;
 	}
 	transfer = libusb_alloc_transfer(0);
 	libusb_fill_bulk_transfer(transfer, usb->devhdl, HANTEK_EP_IN, buf,
 			data_amount, cb, (void *)sdi, 4000);
-	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) < 0) {
 		sr_err("Failed to submit transfer: %s.",
 			libusb_error_name(ret));
-		/* TODO: Free them all. */
 		libusb_free_transfer(transfer);
-		g_free(buf);
+		sr_usb_buffer_free(usb, buf);
 		return SR_ERR;
 	}
+	devc->transfers[slot] = transfer;
+	devc->submitted_transfers++;
 
 	return SR_OK;
 }
 
+SR_PRIV void hantek_6xxx_free_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer)
+{
+	struct dev_context *devc;
+	unsigned int slot;
+
+	devc = sdi->priv;
+
+	for (slot = 0; slot < NUM_TRANSFERS; slot++) {
+		if (devc->transfers[slot] != transfer)
+			continue;
+		devc->transfers[slot] = NULL;
+		devc->submitted_transfers--;
+		break;
+	}
+	sr_usb_buffer_free(sdi->conn, transfer->buffer);
+	libusb_free_transfer(transfer);
+}
+
 static uint8_t samplerate_to_reg(uint64_t samplerate)
 {
 	const uint64_t samplerate_values[] = {SAMPLERATE_VALUES};
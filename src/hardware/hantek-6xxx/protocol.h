@@ -68,6 +68,8 @@
 #define FLUSH_PACKET_SIZE	1024
 
 #define MIN_PACKET_SIZE		512
+/* Transfers kept in flight, they share MAX_PACKET_SIZE between them. */
+#define NUM_TRANSFERS		4
 #ifdef _WIN32
 #define MAX_PACKET_SIZE		(2 * 1024 * 1024)
 #else
@@ -133,6 +135,13 @@ struct dev_context {
 
 	uint64_t read_start_ts;
 
+	/* Transfers in flight, resubmitted as they complete. */
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	unsigned int submitted_transfers;
+	uint32_t transfer_size;
+	/* One channel's samples of a transfer, converted to volts. */
+	float *analog_buf;
+
 	gboolean ch_enabled[NUM_CHANNELS];
 	int voltage[NUM_CHANNELS];
 	int coupling[NUM_CHANNELS];
@@ -151,6 +160,8 @@ SR_PRIV int hantek_6xxx_open(struct sr_dev_inst *sdi);
 SR_PRIV void hantek_6xxx_close(struct sr_dev_inst *sdi);
 SR_PRIV int hantek_6xxx_get_channeldata(const struct sr_dev_inst *sdi,
 		libusb_transfer_cb_fn cb, uint32_t data_amount);
+SR_PRIV void hantek_6xxx_free_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer);
 
 SR_PRIV int hantek_6xxx_start_data_collecting(const struct sr_dev_inst *sdi);
 SR_PRIV int hantek_6xxx_stop_data_collecting(const struct sr_dev_inst *sdi);
@@ -921,7 +921,7 @@ SR_PRIV int dso_get_channeldata(const struct sr_dev_inst *sdi,
 		transfer = libusb_alloc_transfer(0);
 		libusb_fill_bulk_transfer(transfer, usb->devhdl, DSO_EP_IN, buf,
 				devc->epin_maxpacketsize, cb, (void *)sdi, 40);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			/* TODO: Free them all. */
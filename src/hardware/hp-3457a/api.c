@@ -24,6 +24,7 @@
 
 static const uint32_t scanopts[] = {
 	SR_CONF_CONN,
+	SR_CONF_SERIALCOMM,
 };
 
 static const uint32_t drvopts[] = {
@@ -98,19 +99,19 @@ static int create_rear_channels(struct sr_dev_inst *sdi, int chan_idx,
 static gchar *get_revision(struct sr_scpi_dev_inst *scpi)
 {
 	int ret, major, minor;
-	GArray *rev_numbers;
+	float rev_numbers[2];
+	size_t count;
 
 	/* Report a version of '0.0' if we can't parse the response. */
 	major = minor = 0;
 
-	ret = sr_scpi_get_floatv(scpi, "REV?", &rev_numbers);
-	if ((ret == SR_OK) && (rev_numbers->len >= 2)) {
-		major = (int)g_array_index(rev_numbers, float, 0);
-		minor = (int)g_array_index(rev_numbers, float, 1);
+	ret = sr_scpi_read_floatv(scpi, "REV?", sizeof(float), FALSE,
+		rev_numbers, ARRAY_SIZE(rev_numbers), &count);
+	if ((ret == SR_OK) && (count >= 2)) {
+		major = (int)rev_numbers[0];
+		minor = (int)rev_numbers[1];
 	}
 
-	g_array_free(rev_numbers, TRUE);
-
 	return g_strdup_printf("%d.%d", major, minor);
 }
 
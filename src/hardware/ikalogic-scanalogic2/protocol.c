@@ -215,11 +215,11 @@ SR_PRIV int ikalogic_scanalogic2_receive_data(int fd, int revents, void *cb_data
 			if (!devc->stopping_in_progress) {
 				devc->next_state = STATE_RESET_AND_IDLE;
 				devc->stopping_in_progress = TRUE;
-				ret = libusb_submit_transfer(devc->xfer_in);
+				ret = sr_usb_submit_transfer(sdi, devc->xfer_in);
 			}
 		} else if (time_elapsed >= WAIT_DATA_READY_INTERVAL) {
 			devc->wait_data_ready_locked = TRUE;
-			ret = libusb_submit_transfer(devc->xfer_in);
+			ret = sr_usb_submit_transfer(sdi, devc->xfer_in);
 		}
 	}
 
@@ -263,7 +263,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		devc->next_state = STATE_RESET_AND_IDLE;
 		devc->stopping_in_progress = TRUE;
 
-		if (libusb_submit_transfer(devc->xfer_in) != 0) {
+		if (sr_usb_submit_transfer(sdi, devc->xfer_in) != 0) {
 			sr_err("Submit transfer failed: %s.",
 				libusb_error_name(ret));
 			devc->transfer_error = TRUE;
@@ -293,7 +293,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		if (devc->xfer_data_in[0] == 0x05 &&
 				devc->xfer_data_in[1] == STATUS_DATA_READY) {
 			devc->next_state = STATE_RECEIVE_DATA;
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(sdi, transfer);
 		} else {
 			devc->wait_data_ready_locked = FALSE;
 			devc->wait_data_ready_time = g_get_monotonic_time();
@@ -319,7 +319,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		if (devc->sample_packet == 0)
 			devc->channel++;
 
-		ret = libusb_submit_transfer(transfer);
+		ret = sr_usb_submit_transfer(sdi, transfer);
 	} else if (devc->state == STATE_RESET_AND_IDLE) {
 		/* Check if the received data are a valid device status. */
 		if (devc->xfer_data_in[0] == 0x05) {
@@ -331,7 +331,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 				devc->xfer_data_out[0] = CMD_RESET;
 			}
 
-			ret = libusb_submit_transfer(devc->xfer_out);
+			ret = sr_usb_submit_transfer(sdi, devc->xfer_out);
 		} else {
 			/*
 			 * The received device status is invalid which
@@ -339,7 +339,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 			 * commands. Request a new device status until a valid
 			 * device status is received.
 			 */
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(sdi, transfer);
 		}
 	} else if (devc->state == STATE_WAIT_DEVICE_READY) {
 		/* Check if the received data are a valid device status. */
@@ -357,14 +357,14 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 				devc->xfer_data_out[0] = CMD_RESET;
 			}
 
-			ret = libusb_submit_transfer(devc->xfer_out);
+			ret = sr_usb_submit_transfer(sdi, devc->xfer_out);
 		} else {
 			/*
 			 * The device is not ready and therefore not able to
 			 * change to the idle state. Request a new device
 			 * status until the device is ready.
 			 */
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(sdi, transfer);
 		}
 	}
 
@@ -394,7 +394,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_out( struct libusb_transfer *trans
 		devc->next_state = STATE_RESET_AND_IDLE;
 		devc->stopping_in_progress = TRUE;
 
-		if (libusb_submit_transfer(devc->xfer_in) != 0) {
+		if (sr_usb_submit_transfer(sdi, devc->xfer_in) != 0) {
 			sr_err("Submit transfer failed: %s.",
 				libusb_error_name(ret));
 
@@ -413,9 +413,9 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_out( struct libusb_transfer *trans
 		stop_acquisition(sdi);
 	} else if (devc->state == STATE_SAMPLE) {
 		devc->next_state = STATE_WAIT_DATA_READY;
-		ret = libusb_submit_transfer(devc->xfer_in);
+		ret = sr_usb_submit_transfer(sdi, devc->xfer_in);
 	} else if (devc->state == STATE_WAIT_DEVICE_READY) {
-		ret = libusb_submit_transfer(devc->xfer_in);
+		ret = sr_usb_submit_transfer(sdi, devc->xfer_in);
 	}
 
 	if (ret != 0) {
@@ -37,6 +37,9 @@
 
 #define BUFFER_SIZE 4
 
+/* Received bytes past the requested samples get read into this much. */
+#define DISCARD_SIZE (16 * 1024)
+
 /* Top-level command opcodes */
 #define CMD_SET_TRIGGER            0x00
 #define CMD_CFG_TRIGGER            0xF0
@@ -161,16 +164,17 @@ SR_PRIV int ipdbg_la_tcp_close(struct ipdbg_la_tcp *tcp)
 static int tcp_send(struct ipdbg_la_tcp *tcp, const uint8_t *buf, size_t len)
 {
 	int out;
-	out = send(tcp->socket, (const char *)buf, len, 0);
 
-	if (out < 0) {
-		sr_err("Send error: %s", g_strerror(errno));
-		return SR_ERR;
+	while (len) {
+		out = send(tcp->socket, (const char *)buf, len, 0);
+		if (out < 0) {
+			sr_err("Send error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		buf += out;
+		len -= out;
 	}
 
-	if (out < (int)len)
-		sr_dbg("Only sent %d/%d bytes of data.", out, (int)len);
-
 	return SR_OK;
 }
 
@@ -309,23 +313,29 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 
 	if (devc->num_transfers <
 		(devc->limit_samples_max * devc->data_width_bytes)) {
-		const size_t bufsize = 1024;
-		uint8_t buffer[bufsize];
-
-		const int recd = ipdbg_la_tcp_receive(tcp, buffer, bufsize);
-		if ( recd > 0) {
-			int num_move = (((devc->num_transfers + recd) <=
-							 (devc->limit_samples * devc->data_width_bytes))
-			?
-				recd
-			:
-				(int)((devc->limit_samples * devc->data_width_bytes) -
-						devc->num_transfers));
-			if ( num_move > 0 )
-				memcpy(&(devc->raw_sample_buf[devc->num_transfers]),
-						buffer, num_move);
-			devc->num_transfers += recd;
+		uint8_t discard[DISCARD_SIZE];
+		uint64_t wanted, remaining;
+		int recd;
+
+		/*
+		 * Receive straight into the sample buffer, as much as has
+		 * arrived. The device sends its whole memory, what lies past
+		 * the requested samples gets dropped.
+		 */
+		wanted = devc->limit_samples * devc->data_width_bytes;
+		if (devc->num_transfers < wanted) {
+			remaining = wanted - devc->num_transfers;
+			recd = ipdbg_la_tcp_receive(tcp,
+				&devc->raw_sample_buf[devc->num_transfers],
+				MIN(remaining, G_MAXINT));
+		} else {
+			remaining = devc->limit_samples_max *
+				devc->data_width_bytes - devc->num_transfers;
+			recd = ipdbg_la_tcp_receive(tcp, discard,
+				MIN(remaining, sizeof(discard)));
 		}
+		if (recd > 0)
+			devc->num_transfers += recd;
 	} else {
 		if (devc->delay_value > 0) {
 			/* There are pre-trigger samples, send those first. */
@@ -359,118 +369,81 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
-static int send_escaping(struct ipdbg_la_tcp *tcp, uint8_t *data_to_send,
-	uint32_t length)
+/*
+ * Append a value to a command, most significant byte first. Bytes which
+ * look like the reset or escape commands get escaped.
+ */
+static void append_escaping(GByteArray *cmd, const uint8_t *data,
+	size_t length)
 {
-	uint8_t escape = CMD_ESCAPE;
+	const uint8_t escape = CMD_ESCAPE;
 
 	while (length--) {
-		uint8_t payload = *data_to_send++;
-
-		if (payload == CMD_RESET)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
+		if (data[length] == CMD_RESET || data[length] == CMD_ESCAPE)
+			g_byte_array_append(cmd, &escape, 1);
+		g_byte_array_append(cmd, &data[length], 1);
+	}
+}
 
-		if (payload == CMD_ESCAPE)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
+/* Send a command built up with append_escaping() in one go. */
+static int send_command(struct ipdbg_la_tcp *tcp, GByteArray *cmd)
+{
+	int ret;
 
-		if (tcp_send(tcp, &payload, 1) != SR_OK)
-			sr_warn("Couldn't send data");
-	}
+	ret = tcp_send(tcp, cmd->data, cmd->len);
+	g_byte_array_free(cmd, TRUE);
 
-	return SR_OK;
+	return ret;
 }
 
 SR_PRIV int ipdbg_la_send_delay(struct dev_context *devc,
 	struct ipdbg_la_tcp *tcp)
 {
-	devc->delay_value = ((devc->limit_samples - 1) / 100.0) * devc->capture_ratio;
-
-	uint8_t buf;
-	buf = CMD_CFG_LA;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_LA_DELAY;
-	tcp_send(tcp, &buf, 1);
+	const uint8_t header[] = { CMD_CFG_LA, CMD_LA_DELAY };
+	uint8_t delay_buf[4];
+	GByteArray *cmd;
 
-	uint8_t delay_buf[4] = { devc->delay_value & 0x000000ff,
-		(devc->delay_value >> 8) & 0x000000ff,
-		(devc->delay_value >> 16) & 0x000000ff,
-		(devc->delay_value >> 24) & 0x000000ff
-	};
+	devc->delay_value = ((devc->limit_samples - 1) / 100.0) * devc->capture_ratio;
+	WL32(delay_buf, devc->delay_value);
 
-	for (uint64_t i = 0; i < devc->addr_width_bytes; i++)
-		send_escaping(tcp, &(delay_buf[devc->addr_width_bytes - 1 - i]), 1);
+	cmd = g_byte_array_new();
+	g_byte_array_append(cmd, header, sizeof(header));
+	append_escaping(cmd, delay_buf, MIN(devc->addr_width_bytes, 4));
 
-	return SR_OK;
+	return send_command(tcp, cmd);
 }
 
 SR_PRIV int ipdbg_la_send_trigger(struct dev_context *devc,
 	struct ipdbg_la_tcp *tcp)
 {
-	uint8_t buf;
-
-	/* Mask */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASK;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_mask + devc->data_width_bytes - 1 - i, 1);
-
-	/* Value */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_VALUE;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_value + devc->data_width_bytes - 1 - i, 1);
-
-	/* Mask_last */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS_LAST;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASK_LAST;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_mask_last + devc->data_width_bytes - 1 - i, 1);
-
-	/* Value_last */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS_LAST;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_VALUE_LAST;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_value_last + devc->data_width_bytes - 1 - i, 1);
-
-	/* Edge_mask */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_SELECT_EDGE_MASK;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_SET_EDGE_MASK;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_edge_mask + devc->data_width_bytes - 1 - i, 1);
+	const struct {
+		uint8_t select, set;
+		const uint8_t *value;
+	} settings[] = {
+		{ CMD_TRIG_MASKS, CMD_TRIG_MASK, devc->trigger_mask },
+		{ CMD_TRIG_MASKS, CMD_TRIG_VALUE, devc->trigger_value },
+		{ CMD_TRIG_MASKS_LAST, CMD_TRIG_MASK_LAST,
+			devc->trigger_mask_last },
+		{ CMD_TRIG_MASKS_LAST, CMD_TRIG_VALUE_LAST,
+			devc->trigger_value_last },
+		{ CMD_TRIG_SELECT_EDGE_MASK, CMD_TRIG_SET_EDGE_MASK,
+			devc->trigger_edge_mask },
+	};
+	uint8_t header[3];
+	GByteArray *cmd;
+	size_t i;
+
+	/* All trigger settings go out in one send. */
+	cmd = g_byte_array_new();
+	for (i = 0; i < ARRAY_SIZE(settings); i++) {
+		header[0] = CMD_CFG_TRIGGER;
+		header[1] = settings[i].select;
+		header[2] = settings[i].set;
+		g_byte_array_append(cmd, header, sizeof(header));
+		append_escaping(cmd, settings[i].value, devc->data_width_bytes);
+	}
 
-	return SR_OK;
+	return send_command(tcp, cmd);
 }
 
 SR_PRIV void ipdbg_la_get_addrwidth_and_datawidth(
@@ -410,7 +410,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	libusb_fill_bulk_transfer(devc->xfer, usb->devhdl, EP_IN, devc->buf,
 			req_len, kecheng_kc_330b_receive_transfer, (void *)sdi, 15);
-	if (libusb_submit_transfer(devc->xfer) != 0) {
+	if (sr_usb_submit_transfer(sdi, devc->xfer) != 0) {
 		libusb_free_transfer(devc->xfer);
 		return SR_ERR;
 	}
@@ -71,7 +71,7 @@ SR_PRIV int kecheng_kc_330b_handle_events(int fd, int revents, void *cb_data)
 				sr_dev_acquisition_stop(sdi);
 				return TRUE;
 			}
-			libusb_submit_transfer(devc->xfer);
+			sr_usb_submit_transfer(sdi, devc->xfer);
 			devc->last_live_request = now;
 			devc->state = LIVE_SPL_WAIT;
 		}
@@ -92,7 +92,7 @@ SR_PRIV int kecheng_kc_330b_handle_events(int fd, int revents, void *cb_data)
 			sr_dev_acquisition_stop(sdi);
 			return TRUE;
 		}
-		libusb_submit_transfer(devc->xfer);
+		sr_usb_submit_transfer(sdi, devc->xfer);
 		devc->state = LIVE_SPL_WAIT;
 	}
 
@@ -256,8 +256,7 @@ static void la2016_close_usb(struct sr_usb_dev_inst *usb)
 
 	if (usb->devhdl) {
 		libusb_release_interface(usb->devhdl, USB_INTERFACE);
-		libusb_close(usb->devhdl);
-		usb->devhdl = NULL;
+		sr_usb_close(usb);
 	}
 }
 
@@ -413,6 +412,50 @@ static int la2016_open_enum(struct sr_dev_inst *sdi)
 	return open_ret;
 }
 
+/*
+ * Create a device which replays a USB dump, see usb_replay.c. The
+ * identification gets replayed, the FPGA configuration is part of the
+ * dump and doesn't get repeated.
+ */
+static struct sr_dev_inst *la2016_replay_new(struct sr_dev_driver *di,
+	const char *path)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	struct dev_context *devc;
+	struct libusb_device_descriptor des;
+	const char *strings[3];
+
+	usb = sr_usb_replay_open(path);
+	if (!usb)
+		return NULL;
+	sr_usb_replay_identity(usb, &des, strings);
+	if (des.idVendor != LA2016_VID || des.idProduct != LA2016_PID) {
+		sr_err("USB dump is not of a Kingst LA device.");
+		sr_usb_dev_inst_free(usb);
+		return NULL;
+	}
+
+	sdi = g_malloc0(sizeof(*sdi));
+	sdi->driver = di;
+	sdi->status = SR_ST_INITIALIZING;
+	sdi->inst_type = SR_INST_USB;
+	sdi->connection_id = g_strdup(path);
+	sdi->conn = usb;
+
+	devc = g_malloc0(sizeof(*devc));
+	sdi->priv = devc;
+	devc->usb_pid = des.idProduct;
+
+	if (la2016_identify_device(sdi, TRUE) != SR_OK || !devc->model) {
+		sr_err("Unknown or unsupported device type.");
+		kingst_la2016_free_sdi(sdi);
+		return NULL;
+	}
+
+	return sdi;
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
@@ -449,6 +492,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			break;
 		}
 	}
+	devices = NULL;
+	found_devices = NULL;
+	if (sr_usb_replay_path(conn)) {
+		sdi = la2016_replay_new(di, sr_usb_replay_path(conn));
+		if (sdi)
+			found_devices = g_slist_append(found_devices, sdi);
+		goto identified;
+	}
 	if (conn)
 		conn_devices = sr_usb_find(ctx->libusb_ctx, conn);
 	if (conn && !conn_devices) {
@@ -464,10 +515,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	 * we cannot communicate to the device within the same USB enum
 	 * cycle, needs another USB enumeration after firmware upload.
 	 */
-	devices = NULL;
-	found_devices = NULL;
 	renum_devices = NULL;
-	ret = libusb_get_device_list(ctx->libusb_ctx, &devlist);
+	ret = sr_usb_get_device_list(ctx, &devlist);
 	if (ret < 0) {
 		sr_err("Cannot get device list: %s.", libusb_error_name(ret));
 		return devices;
@@ -577,6 +626,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	}
 	g_slist_free(renum_devices);
 
+identified:
 	/*
 	 * All found devices got identified, their type is known here.
 	 * Complete the sdi/devc creation. Assign default settings
@@ -653,12 +703,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
 	int ret;
 	size_t ch;
 
 	devc = sdi->priv;
+	usb = sdi->conn;
 
-	ret = la2016_open_enum(sdi);
+	ret = usb->replay ? SR_OK : la2016_open_enum(sdi);
 	if (ret != SR_OK) {
 		sr_err("Cannot open device.");
 		return ret;
@@ -680,6 +732,11 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
+	if (usb->replay) {
+		la2016_release_resources(sdi);
+		return SR_OK;
+	}
+
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
@@ -1043,8 +1100,16 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 			unitsize = sizeof(uint16_t);
 		else
 			return SR_ERR_ARG;
-		devc->feed_queue = feed_queue_logic_alloc(sdi,
-			LA2016_CONVBUFFER_SIZE, unitsize);
+		/*
+		 * The device compresses the capture data in normal mode,
+		 * pass the runs on rather than expanding them here.
+		 */
+		if (devc->continuous)
+			devc->feed_queue = feed_queue_logic_alloc(sdi,
+				LA2016_CONVBUFFER_SIZE, unitsize);
+		else
+			devc->feed_queue = feed_queue_logic_alloc_rle(sdi,
+				LA2016_RLE_RUNS, unitsize);
 		if (!devc->feed_queue) {
 			sr_err("Cannot allocate buffer for session feed.");
 			return SR_ERR_MALLOC;
@@ -118,7 +118,7 @@ static int ctrl_in(const struct sr_dev_inst *sdi,
 
 	usb = sdi->conn;
 
-	ret = libusb_control_transfer(usb->devhdl,
+	ret = sr_usb_control_transfer(usb,
 		LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN,
 		bRequest, wValue, wIndex, data, wLength,
 		DEFAULT_TIMEOUT_MS);
@@ -143,7 +143,7 @@ static int ctrl_out(const struct sr_dev_inst *sdi,
 
 	usb = sdi->conn;
 
-	ret = libusb_control_transfer(usb->devhdl,
+	ret = sr_usb_control_transfer(usb,
 		LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT,
 		bRequest, wValue, wIndex, data, wLength,
 		DEFAULT_TIMEOUT_MS);
@@ -282,41 +282,36 @@ static int check_fpga_bitstream(const struct sr_dev_inst *sdi)
 }
 
 static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
-	const char *bitstream_fname)
+	const char *bitstream_fname, GBytes *bitstream)
 {
-	struct drv_context *drvc;
 	struct sr_usb_dev_inst *usb;
-	struct sr_resource bitstream;
+	const uint8_t *data;
+	size_t size;
 	uint32_t bitstream_size;
 	uint8_t buffer[sizeof(uint32_t)];
 	uint8_t *wrptr;
 	uint8_t block[4096];
+	uint8_t *txptr;
 	int len, act_len;
 	unsigned int pos;
 	int ret;
 	unsigned int zero_pad_to;
 
-	drvc = sdi->driver->context;
 	usb = sdi->conn;
 
 	sr_info("Uploading FPGA bitstream '%s'.", bitstream_fname);
 
-	ret = sr_resource_open(drvc->sr_ctx, &bitstream,
-		SR_RESOURCE_FIRMWARE, bitstream_fname);
-	if (ret != SR_OK) {
-		sr_err("Cannot find FPGA bitstream %s.", bitstream_fname);
-		return ret;
-	}
+	data = g_bytes_get_data(bitstream, &size);
 
-	bitstream_size = (uint32_t)bitstream.size;
+	bitstream_size = (uint32_t)size;
 	wrptr = buffer;
 	write_u32le_inc(&wrptr, bitstream_size);
 	ret = ctrl_out(sdi, CMD_FPGA_INIT, 0x00, 0, buffer, wrptr - buffer);
 	if (ret != SR_OK) {
 		sr_err("Cannot initiate FPGA bitstream upload.");
-		sr_resource_close(drvc->sr_ctx, &bitstream);
 		return ret;
 	}
+	memset(block, 0, sizeof(block));
 	zero_pad_to = bitstream_size;
 	zero_pad_to += LA2016_EP2_PADDING - 1;
 	zero_pad_to /= LA2016_EP2_PADDING;
@@ -324,26 +319,22 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 
 	pos = 0;
 	while (1) {
-		if (pos < bitstream.size) {
-			len = (int)sr_resource_read(drvc->sr_ctx, &bitstream,
-				block, sizeof(block));
-			if (len < 0) {
-				sr_err("Cannot read FPGA bitstream.");
-				sr_resource_close(drvc->sr_ctx, &bitstream);
-				return SR_ERR_IO;
-			}
+		if (pos < size) {
+			/* Send straight from the (read-only) resource view. */
+			len = MIN(size - pos, sizeof(block));
+			txptr = (uint8_t *)&data[pos];
 		} else {
 			/*  Zero-pad until 'zero_pad_to'. */
 			len = zero_pad_to - pos;
 			if ((unsigned)len > sizeof(block))
 				len = sizeof(block);
-			memset(&block, 0, len);
+			txptr = &block[0];
 		}
 		if (len == 0)
 			break;
 
-		ret = libusb_bulk_transfer(usb->devhdl, USB_EP_FPGA_BITSTREAM,
-			&block[0], len, &act_len, DEFAULT_TIMEOUT_MS);
+		ret = sr_usb_bulk_transfer(usb, USB_EP_FPGA_BITSTREAM,
+			txptr, len, &act_len, DEFAULT_TIMEOUT_MS);
 		if (ret != 0) {
 			sr_dbg("Cannot write FPGA bitstream, block %#x len %d: %s.",
 				pos, (int)len, libusb_error_name(ret));
@@ -358,11 +349,9 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 		}
 		pos += len;
 	}
-	sr_resource_close(drvc->sr_ctx, &bitstream);
 	if (ret != SR_OK)
 		return ret;
-	sr_info("FPGA bitstream upload (%" PRIu64 " bytes) done.",
-		bitstream.size);
+	sr_info("FPGA bitstream upload (%zu bytes) done.", size);
 
 	return SR_OK;
 }
@@ -599,12 +588,9 @@ static int set_trigger_config(const struct sr_dev_inst *sdi)
 		uint32_t level;
 		uint32_t high_or_falling;
 	} cfg;
-	GSList *stages;
-	GSList *channel;
-	struct sr_trigger_stage *stage1;
-	struct sr_trigger_match *match;
-	uint32_t ch_mask;
-	int ret;
+	struct sr_trigger_hw_caps caps;
+	struct sr_trigger_hw_stage stage;
+	int num_stages, ret;
 	uint8_t buf[REG_UNKNOWN_30 - REG_TRIGGER]; /* Width of REG_TRIGGER. */
 	uint8_t *wrptr;
 
@@ -619,50 +605,21 @@ static int set_trigger_config(const struct sr_dev_inst *sdi)
 		return SR_ERR_ARG;
 	}
 	trigger = sr_session_trigger_get(sdi->session);
-	if (trigger && trigger->stages) {
-		stages = trigger->stages;
-		stage1 = stages->data;
-		if (stages->next) {
-			sr_err("Only one trigger stage supported for now.");
-			return SR_ERR_ARG;
-		}
-		channel = stage1->matches;
-		while (channel) {
-			match = channel->data;
-			ch_mask = 1UL << match->channel->index;
-
-			switch (match->match) {
-			case SR_TRIGGER_ZERO:
-				cfg.level |= ch_mask;
-				cfg.high_or_falling &= ~ch_mask;
-				break;
-			case SR_TRIGGER_ONE:
-				cfg.level |= ch_mask;
-				cfg.high_or_falling |= ch_mask;
-				break;
-			case SR_TRIGGER_RISING:
-				if ((cfg.enabled & ~cfg.level)) {
-					sr_err("Device only supports one edge trigger.");
-					return SR_ERR_ARG;
-				}
-				cfg.level &= ~ch_mask;
-				cfg.high_or_falling &= ~ch_mask;
-				break;
-			case SR_TRIGGER_FALLING:
-				if ((cfg.enabled & ~cfg.level)) {
-					sr_err("Device only supports one edge trigger.");
-					return SR_ERR_ARG;
-				}
-				cfg.level &= ~ch_mask;
-				cfg.high_or_falling |= ch_mask;
-				break;
-			default:
-				sr_err("Unknown trigger condition.");
-				return SR_ERR_ARG;
-			}
-			cfg.enabled |= ch_mask;
-			channel = channel->next;
-		}
+	caps.max_stages = 1;
+	caps.num_channels = devc->model->channel_count;
+	caps.matches = (1 << SR_TRIGGER_ZERO) | (1 << SR_TRIGGER_ONE)
+		| (1 << SR_TRIGGER_RISING) | (1 << SR_TRIGGER_FALLING);
+	caps.max_edges = 1;
+	ret = sr_trigger_hw_compile(trigger, &caps, &stage, &num_stages);
+	if (ret == SR_ERR_NA)
+		sr_err("The device cannot evaluate this trigger.");
+	if (ret != SR_OK)
+		return ret;
+	if (num_stages) {
+		/* Levels and falling edges are "high or falling". */
+		cfg.enabled = stage.mask;
+		cfg.level = stage.mask & ~stage.edge_mask;
+		cfg.high_or_falling = (stage.values ^ stage.edge_mask) & stage.mask;
 	}
 	sr_dbg("Set trigger config: "
 		"enabled-channels 0x%04x, triggering-channels 0x%04x, "
@@ -688,6 +645,10 @@ static int set_trigger_config(const struct sr_dev_inst *sdi)
 	}
 
 	devc->trigger_involved = cfg.enabled != 0;
+	/* Without an external clock input, followers wait for a trigger. */
+	if (sdi->sync_follower && !devc->trigger_involved)
+		sr_warn("Sync follower without hardware trigger, its capture "
+			"starts unsynchronized.");
 
 	wrptr = buf;
 	write_u32le_inc(&wrptr, cfg.channels);
@@ -1023,28 +984,152 @@ SR_PRIV int la2016_upload_firmware(const struct sr_dev_inst *sdi,
 	return SR_OK;
 }
 
+/*
+ * A USB transfer, and the runs which got decoded from it. Transfers of
+ * a download complete in sequence, get decoded by worker threads in
+ * parallel, and are sent to the session in sequence again. Only the
+ * decoding happens on the workers, sending and resubmitting stay on
+ * the session thread.
+ */
+struct decode_job {
+	const struct sr_dev_inst *sdi;
+	struct libusb_transfer *xfer;
+	size_t length;
+	gboolean resubmit;
+	uint64_t seq;
+	/* Records of the download before this transfer's. */
+	uint64_t first_record;
+	uint8_t *values;
+	uint64_t *run_lengths;
+	size_t num_runs;
+	uint64_t num_samples;
+	/* Runs and samples before the trigger, SIZE_MAX runs if none. */
+	size_t trigger_run;
+	uint64_t trigger_samples;
+};
+
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *xfer);
 
-static void la2016_usbxfer_release_cb(gpointer p)
+static void free_decode_runs(const struct sr_dev_inst *sdi,
+	struct decode_job *job)
 {
-	struct libusb_transfer *xfer;
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+	if (!job->run_lengths)
+		return;
+	g_free(job->values);
+	g_free(job->run_lengths);
+	job->values = NULL;
+	job->run_lengths = NULL;
+	sr_session_mem_release(sdi, devc->decode_runs_max
+		* (sizeof(uint32_t) + sizeof(uint64_t)));
+}
+
+static void decode_worker(gpointer data, gpointer user_data);
+
+/* Wait for the workers to complete pending transfers, release memory. */
+static void decode_teardown(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	GThreadPool *pool;
+	GSList *l;
+
+	devc = sdi->priv;
+
+	pool = devc->decode_pool;
+	devc->decode_pool = NULL;
+	if (pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+	/* Decoded but not sent any more. */
+	g_slist_free(devc->decode_done);
+	devc->decode_done = NULL;
+	if (devc->decode_idle) {
+		g_source_destroy(devc->decode_idle);
+		g_source_unref(devc->decode_idle);
+		devc->decode_idle = NULL;
+	}
+
+	for (l = devc->transfers; l; l = l->next)
+		free_decode_runs(sdi, ((struct libusb_transfer *)l->data)->user_data);
+}
+
+/*
+ * Allocate the transfers' run buffers, and start the workers. Without
+ * workers, transfers get decoded when they complete.
+ */
+static int decode_setup(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct decode_job *job;
+	GSList *l;
+	size_t runs;
+	guint threads;
+
+	devc = sdi->priv;
+	decode_teardown(sdi);
+
+	runs = devc->transfer_bufsize / TRANSFER_PACKET_LENGTH;
+	runs *= devc->packets_per_chunk;
+	devc->decode_runs_max = runs;
+	for (l = devc->transfers; l; l = l->next) {
+		job = ((struct libusb_transfer *)l->data)->user_data;
+		if (sr_session_mem_charge(sdi,
+				runs * (sizeof(uint32_t) + sizeof(uint64_t))) != SR_OK)
+			return SR_ERR_MALLOC;
+		job->values = g_try_malloc(runs * sizeof(uint32_t));
+		job->run_lengths = g_try_malloc(runs * sizeof(uint64_t));
+		if (!job->values || !job->run_lengths) {
+			sr_err("Cannot allocate decode buffers.");
+			g_free(job->values);
+			job->values = NULL;
+			g_free(job->run_lengths);
+			job->run_lengths = NULL;
+			sr_session_mem_release(sdi,
+				runs * (sizeof(uint32_t) + sizeof(uint64_t)));
+			return SR_ERR_MALLOC;
+		}
+	}
 
-	xfer = p;
-	g_free(xfer->buffer);
-	libusb_free_transfer(xfer);
+	devc->decode_seq_next = 0;
+	devc->decode_seq_done = 0;
+	devc->records_seen = 0;
+	threads = MIN(g_get_num_processors(), LA2016_DECODE_THREADS);
+	if (threads > 1)
+		devc->decode_pool = g_thread_pool_new(decode_worker, NULL,
+			threads, TRUE, NULL);
+
+	return SR_OK;
 }
 
 static int la2016_usbxfer_release(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	struct libusb_transfer *xfer;
+	struct decode_job *job;
+	GSList *l;
 
 	devc = sdi ? sdi->priv : NULL;
 	if (!devc)
 		return SR_ERR_ARG;
 
+	if (!devc->transfers)
+		return SR_OK;
+	/* Keep decoded transfers from getting resubmitted. */
+	devc->download_finished = TRUE;
+	decode_teardown(sdi);
+
 	/* Release all USB transfers. */
-	g_slist_free_full(devc->transfers, la2016_usbxfer_release_cb);
+	for (l = devc->transfers; l; l = l->next) {
+		xfer = l->data;
+		job = xfer->user_data;
+		g_free(job);
+		sr_usb_buffer_free(sdi->conn, xfer->buffer);
+		libusb_free_transfer(xfer);
+	}
+	g_slist_free(devc->transfers);
 	devc->transfers = NULL;
+	g_mutex_clear(&devc->decode_mutex);
 
 	return SR_OK;
 }
@@ -1055,6 +1140,7 @@ static int la2016_usbxfer_allocate(const struct sr_dev_inst *sdi)
 	size_t bufsize, xfercount;
 	uint8_t *buffer;
 	struct libusb_transfer *xfer;
+	struct decode_job *job;
 
 	devc = sdi ? sdi->priv : NULL;
 	if (!devc)
@@ -1063,6 +1149,9 @@ static int la2016_usbxfer_allocate(const struct sr_dev_inst *sdi)
 	/* Transfers were already allocated before? */
 	if (devc->transfers)
 		return SR_OK;
+	g_mutex_init(&devc->decode_mutex);
+	devc->decode_done = NULL;
+	devc->decode_idle = NULL;
 
 	/*
 	 * Allocate all USB transfers and their buffers. Arrange for a
@@ -1077,7 +1166,7 @@ static int la2016_usbxfer_allocate(const struct sr_dev_inst *sdi)
 	bufsize = LA2016_USB_BUFSZ;
 	xfercount = LA2016_USB_XFER_COUNT;
 	while (xfercount--) {
-		buffer = g_try_malloc(bufsize);
+		buffer = sr_usb_buffer_alloc(sdi->conn, bufsize);
 		if (!buffer) {
 			sr_err("Cannot allocate USB transfer buffer.");
 			return SR_ERR_MALLOC;
@@ -1085,10 +1174,14 @@ static int la2016_usbxfer_allocate(const struct sr_dev_inst *sdi)
 		xfer = libusb_alloc_transfer(0);
 		if (!xfer) {
 			sr_err("Cannot allocate USB transfer.");
-			g_free(buffer);
+			sr_usb_buffer_free(sdi->conn, buffer);
 			return SR_ERR_MALLOC;
 		}
 		xfer->buffer = buffer;
+		job = g_malloc0(sizeof(*job));
+		job->sdi = sdi;
+		job->xfer = xfer;
+		xfer->user_data = job;
 		devc->transfers = g_slist_append(devc->transfers, xfer);
 	}
 	devc->transfer_bufsize = bufsize;
@@ -1111,7 +1204,7 @@ static int la2016_usbxfer_cancel_all(const struct sr_dev_inst *sdi)
 		xfer = l->data;
 		if (!xfer)
 			continue;
-		libusb_cancel_transfer(xfer);
+		sr_usb_cancel_transfer(sdi, xfer);
 	}
 
 	return SR_OK;
@@ -1137,8 +1230,8 @@ static int la2016_usbxfer_resubmit(const struct sr_dev_inst *sdi,
 	libusb_fill_bulk_transfer(xfer, usb->devhdl,
 		USB_EP_CAPTURE_DATA | LIBUSB_ENDPOINT_IN,
 		xfer->buffer, devc->transfer_bufsize,
-		cb, (void *)sdi, CAPTURE_TIMEOUT_MS);
-	ret = libusb_submit_transfer(xfer);
+		cb, xfer->user_data, CAPTURE_TIMEOUT_MS);
+	ret = sr_usb_submit_transfer(sdi, xfer);
 	if (ret != 0) {
 		sr_err("Cannot submit USB transfer: %s.",
 			libusb_error_name(ret));
@@ -1283,11 +1376,16 @@ static int la2016_start_download(const struct sr_dev_inst *sdi)
 	devc->n_bytes_to_read = devc->n_transfer_packets_to_read;
 	devc->n_bytes_to_read *= TRANSFER_PACKET_LENGTH;
 	devc->read_pos = devc->info.write_pos - devc->n_bytes_to_read;
-	devc->n_reps_until_trigger = devc->info.n_rep_packets_before_trigger;
 
 	sr_dbg("Want to read %u xfer-packets starting from pos %" PRIu32 ".",
 		devc->n_transfer_packets_to_read, devc->read_pos);
 
+	ret = decode_setup(sdi);
+	if (ret != SR_OK) {
+		decode_teardown(sdi);
+		return ret;
+	}
+
 	ret = ctrl_out(sdi, CMD_BULK_RESET, 0x00, 0, NULL, 0);
 	if (ret != SR_OK) {
 		sr_err("Cannot reset USB bulk state.");
@@ -1323,16 +1421,76 @@ static int la2016_start_download(const struct sr_dev_inst *sdi)
  * A chunk (received via USB) contains a number of transfers (USB length
  * divided by 16) which contain a number of packets (5 per transfer) which
  * contain a number of samples (8bit repeat count per 16bit sample data).
+ *
+ * Chunks don't depend on each other, this runs on worker threads. The
+ * packets become runs, repetitions of a value get merged. The trigger
+ * position is known from the chunk's first packet number, its runs get
+ * split there.
  */
-static void send_chunk(struct sr_dev_inst *sdi,
-	const uint8_t *data_buffer, size_t data_length)
+static void decode_chunk(const struct dev_context *devc,
+	struct decode_job *job)
 {
-	struct dev_context *devc;
-	size_t num_xfers, num_pkts;
+	size_t num_xfers, num_pkts, unitsize, n;
 	const uint8_t *rp;
-	uint32_t sample_value;
+	uint32_t sample_value, last_value;
 	size_t repetitions;
-	uint8_t sample_buff[sizeof(sample_value)];
+	uint64_t record, trigger_record, samples;
+
+	unitsize = devc->model->channel_count / 8;
+	trigger_record = devc->trigger_involved
+		? devc->info.n_rep_packets_before_trigger : 0;
+	record = job->first_record;
+	samples = 0;
+	job->trigger_run = SIZE_MAX;
+
+	/* Process the received chunk of capture data. */
+	n = 0;
+	sample_value = last_value = 0;
+	rp = job->xfer->buffer;
+	num_xfers = job->length / TRANSFER_PACKET_LENGTH;
+	while (num_xfers--) {
+		num_pkts = devc->packets_per_chunk;
+		while (num_pkts--) {
+
+			/* TODO Verify 32channel layout. */
+			if (devc->model->channel_count == 32)
+				sample_value = read_u32le_inc(&rp);
+			else if (devc->model->channel_count == 16)
+				sample_value = read_u16le_inc(&rp);
+			repetitions = read_u8_inc(&rp);
+
+			/* Merge repetitions, but split at the trigger. */
+			if (n && sample_value == last_value
+					&& n != job->trigger_run) {
+				job->run_lengths[n - 1] += repetitions;
+			} else if (repetitions) {
+				if (unitsize == sizeof(uint32_t))
+					write_u32le(&job->values[n * unitsize],
+						sample_value);
+				else
+					write_u16le(&job->values[n * unitsize],
+						sample_value);
+				job->run_lengths[n++] = repetitions;
+				last_value = sample_value;
+			}
+			samples += repetitions;
+
+			if (++record == trigger_record) {
+				job->trigger_run = n;
+				job->trigger_samples = samples;
+			}
+		}
+		(void)read_u8_inc(&rp); /* Skip sequence number. */
+	}
+	job->num_runs = n;
+	job->num_samples = samples;
+}
+
+/* Send a chunk's runs, chunks are passed in download order. */
+static void send_chunk(const struct sr_dev_inst *sdi, struct decode_job *job)
+{
+	struct dev_context *devc;
+	size_t unitsize, first;
 
 	devc = sdi->priv;
 
@@ -1350,46 +1508,29 @@ static void send_chunk(struct sr_dev_inst *sdi,
 	 * before the processing of the currently received chunk affects
 	 * the variable which holds the number of received bytes.
 	 */
-	if (data_length > devc->n_bytes_to_read)
+	if (job->length > devc->n_bytes_to_read)
 		devc->n_bytes_to_read = 0;
 	else
-		devc->n_bytes_to_read -= data_length;
-
-	/* Process the received chunk of capture data. */
-	sample_value = 0;
-	rp = data_buffer;
-	num_xfers = data_length / TRANSFER_PACKET_LENGTH;
-	while (num_xfers--) {
-		num_pkts = devc->packets_per_chunk;
-		while (num_pkts--) {
-
-			/* TODO Verify 32channel layout. */
-			if (devc->model->channel_count == 32)
-				sample_value = read_u32le_inc(&rp);
-			else if (devc->model->channel_count == 16)
-				sample_value = read_u16le_inc(&rp);
-			repetitions = read_u8_inc(&rp);
+		devc->n_bytes_to_read -= job->length;
 
-			devc->total_samples += repetitions;
-
-			write_u32le(sample_buff, sample_value);
-			feed_queue_logic_submit(devc->feed_queue,
-				sample_buff, repetitions);
-			sr_sw_limits_update_samples_read(&devc->sw_limits,
-				repetitions);
-
-			if (devc->trigger_involved && !devc->trigger_marked) {
-				if (!--devc->n_reps_until_trigger) {
-					feed_queue_logic_send_trigger(devc->feed_queue);
-					devc->trigger_marked = TRUE;
-					sr_dbg("Trigger position after %" PRIu64 " samples, %.6fms.",
-						devc->total_samples,
-						(double)devc->total_samples / devc->samplerate * 1e3);
-				}
-			}
-		}
-		(void)read_u8_inc(&rp); /* Skip sequence number. */
-	}
+	unitsize = devc->model->channel_count / 8;
+	first = 0;
+	if (job->trigger_run != SIZE_MAX && !devc->trigger_marked) {
+		feed_queue_logic_submit_runs(devc->feed_queue, job->values,
+			job->run_lengths, job->trigger_run);
+		feed_queue_logic_send_trigger(devc->feed_queue);
+		devc->trigger_marked = TRUE;
+		sr_dbg("Trigger position after %" PRIu64 " samples, %.6fms.",
+			devc->total_samples + job->trigger_samples,
+			(double)(devc->total_samples + job->trigger_samples)
+				/ devc->samplerate * 1e3);
+		first = job->trigger_run;
+	}
+	feed_queue_logic_submit_runs(devc->feed_queue,
+		&job->values[first * unitsize], &job->run_lengths[first],
+		job->num_runs - first);
+	devc->total_samples += job->num_samples;
+	sr_sw_limits_update_samples_read(&devc->sw_limits, job->num_samples);
 
 	/*
 	 * Check for several conditions which shall terminate the
@@ -1414,6 +1555,112 @@ static void send_chunk(struct sr_dev_inst *sdi,
 	sr_dbg("Total samples after chunk: %" PRIu64 ".", devc->total_samples);
 }
 
+static void send_decoded(const struct sr_dev_inst *sdi);
+
+static gboolean decode_idle_cb(gpointer data)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+
+	sdi = data;
+	devc = sdi->priv;
+
+	g_mutex_lock(&devc->decode_mutex);
+	g_source_unref(devc->decode_idle);
+	devc->decode_idle = NULL;
+	g_mutex_unlock(&devc->decode_mutex);
+
+	send_decoded(sdi);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Have the session thread send decoded jobs as soon as it gets to it,
+ * instead of at its next poll of the USB source. Attaching the source
+ * wakes up the session's main context.
+ */
+static GSource *decode_idle_add(const struct sr_dev_inst *sdi)
+{
+	struct sr_session *session;
+	GSource *source;
+	guint id;
+
+	session = sdi->session;
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, decode_idle_cb, (void *)sdi, NULL);
+
+	id = 0;
+	g_mutex_lock(&session->main_mutex);
+	if (session->main_context)
+		id = g_source_attach(source, session->main_context);
+	g_mutex_unlock(&session->main_mutex);
+	if (!id) {
+		g_source_unref(source);
+		return NULL;
+	}
+
+	return source;
+}
+
+/* Decode a transfer, and hand it back to the session thread. */
+static void decode_worker(gpointer data, gpointer user_data)
+{
+	struct decode_job *job;
+	struct dev_context *devc;
+
+	(void)user_data;
+
+	job = data;
+	devc = job->sdi->priv;
+
+	decode_chunk(devc, job);
+
+	g_mutex_lock(&devc->decode_mutex);
+	devc->decode_done = g_slist_prepend(devc->decode_done, job);
+	if (!devc->decode_idle)
+		devc->decode_idle = decode_idle_add(job->sdi);
+	g_mutex_unlock(&devc->decode_mutex);
+}
+
+/*
+ * Send the decoded transfers which are next in download order, and
+ * resubmit them. Runs on the session thread, from the USB source or
+ * the workers' idle source, as sending packets is only safe from there.
+ * Transfers which the workers finished meanwhile get picked up by the
+ * next call.
+ */
+static void send_decoded(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct decode_job *job;
+	GSList *l;
+
+	devc = sdi->priv;
+	for (;;) {
+		job = NULL;
+		g_mutex_lock(&devc->decode_mutex);
+		for (l = devc->decode_done; l; l = l->next) {
+			if (((struct decode_job *)l->data)->seq == devc->decode_seq_done) {
+				job = l->data;
+				devc->decode_done = g_slist_delete_link(
+					devc->decode_done, l);
+				break;
+			}
+		}
+		g_mutex_unlock(&devc->decode_mutex);
+		if (!job)
+			return;
+
+		send_chunk(sdi, job);
+		devc->decode_seq_done++;
+		if (job->resubmit && !devc->download_finished
+				&& la2016_usbxfer_resubmit(sdi, job->xfer) != SR_OK)
+			devc->download_finished = TRUE;
+	}
+}
+
 /*
  * Process a chunk of capture data in streaming mode. The memory layout
  * is rather different from "normal mode" (see the send_chunk() routine
@@ -1436,7 +1683,7 @@ static void send_chunk(struct sr_dev_inst *sdi,
  * LA2016 device. The memory layout of 32 channel models is yet to get
  * determined.
  */
-static void stream_data(struct sr_dev_inst *sdi,
+static void stream_data(const struct sr_dev_inst *sdi,
 	const uint8_t *data_buffer, size_t data_length)
 {
 	struct dev_context *devc;
@@ -1444,7 +1691,8 @@ static void stream_data(struct sr_dev_inst *sdi,
 	size_t bit_count;
 	const uint8_t *rp;
 	uint32_t sample_value;
-	uint8_t sample_buff[sizeof(sample_value)];
+	uint8_t sample_block[32 * sizeof(sample_value)];
+	uint8_t *wp;
 	size_t bit_idx;
 	uint32_t ch_mask;
 
@@ -1498,11 +1746,16 @@ static void stream_data(struct sr_dev_inst *sdi,
 		stream->channel_index++;
 		if (stream->channel_index != stream->enabled_count)
 			continue;
+		wp = sample_block;
 		for (bit_idx = 0; bit_idx < bit_count; bit_idx++) {
 			sample_value = stream->sample_data[bit_idx];
-			write_u32le(sample_buff, sample_value);
-			feed_queue_logic_submit(devc->feed_queue, sample_buff, 1);
+			if (bit_count == 32)
+				write_u32le_inc(&wp, sample_value);
+			else
+				write_u16le_inc(&wp, sample_value);
 		}
+		feed_queue_logic_submit_many(devc->feed_queue,
+			sample_block, bit_count);
 		sr_sw_limits_update_samples_read(&devc->sw_limits, bit_count);
 		devc->total_samples += bit_count;
 		memset(stream->sample_data, 0, sizeof(stream->sample_data));
@@ -1534,12 +1787,14 @@ static void stream_data(struct sr_dev_inst *sdi,
 
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
-	struct sr_dev_inst *sdi;
+	struct decode_job *job;
+	const struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	gboolean was_cancelled, device_gone;
 	int ret;
 
-	sdi = transfer->user_data;
+	job = transfer->user_data;
+	sdi = job->sdi;
 	devc = sdi->priv;
 
 	was_cancelled = transfer->status == LIBUSB_TRANSFER_CANCELLED;
@@ -1551,6 +1806,11 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		devc->download_finished = TRUE;
 		return;
 	}
+	if (!was_cancelled && transfer->status != LIBUSB_TRANSFER_COMPLETED
+			&& transfer->status != LIBUSB_TRANSFER_TIMED_OUT)
+		sr_session_report_transfers(sdi, 1, 0);
+	else if (!was_cancelled && !transfer->actual_length)
+		sr_session_report_transfers(sdi, 0, 1);
 
 	/*
 	 * Implementation detail: A USB transfer timeout is not fatal
@@ -1559,10 +1819,29 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	 * or exhausting the device's captured data will complete the
 	 * sample data download.
 	 */
-	if (devc->continuous)
-		stream_data(sdi, transfer->buffer, transfer->actual_length);
-	else
-		send_chunk(sdi, transfer->buffer, transfer->actual_length);
+	if (!devc->continuous) {
+		/*
+		 * Number the download's transfers in their order, and
+		 * have a worker decode and send the data. Cancelled
+		 * transfers don't get resubmitted.
+		 */
+		job->length = transfer->actual_length;
+		job->resubmit = !was_cancelled;
+		if (devc->download_finished || !job->run_lengths)
+			return;
+		job->seq = devc->decode_seq_next++;
+		job->first_record = devc->records_seen;
+		devc->records_seen += job->length / TRANSFER_PACKET_LENGTH
+			* devc->packets_per_chunk;
+		if (devc->decode_pool)
+			g_thread_pool_push(devc->decode_pool, job, NULL);
+		else
+			decode_worker(job, NULL);
+		send_decoded(sdi);
+		return;
+	}
+
+	stream_data(sdi, transfer->buffer, transfer->actual_length);
 
 	/*
 	 * Re-submit completed transfers (regardless of timeout or
@@ -1655,6 +1934,8 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 	/* Handle USB reception. Drives sample data download. */
 	memset(&tv, 0, sizeof(tv));
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
+	if (!devc->continuous)
+		send_decoded(sdi);
 
 	/*
 	 * Periodically flush acquisition data in streaming mode.
@@ -1679,6 +1960,7 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 	if (devc->download_finished) {
 		sr_dbg("Download finished, post processing.");
 
+		decode_teardown(sdi);
 		la2016_stop_acquisition(sdi);
 		usb_source_remove(sdi->session, drvc->sr_ctx);
 
@@ -1859,22 +2141,46 @@ SR_PRIV int la2016_identify_device(const struct sr_dev_inst *sdi,
 
 SR_PRIV int la2016_init_hardware(const struct sr_dev_inst *sdi)
 {
+	struct drv_context *drvc;
 	struct dev_context *devc;
 	const char *bitstream_fn;
+	GBytes *bitstream;
+	struct sr_resource_id bitstream_id;
 	int ret;
 	uint16_t state;
 
+	drvc = sdi->driver->context;
 	devc = sdi->priv;
 	bitstream_fn = devc ? devc->fpga_bitstream : "";
 
-	ret = check_fpga_bitstream(sdi);
+	bitstream = sr_resource_load_bytes(drvc->sr_ctx,
+		SR_RESOURCE_FIRMWARE, bitstream_fn, UINT32_MAX);
+	if (!bitstream) {
+		sr_err("Cannot find FPGA bitstream %s.", bitstream_fn);
+		return SR_ERR;
+	}
+	sr_resource_id_compute(&bitstream_id, bitstream);
+
+	/*
+	 * Re-use a running bitstream unless a different one was uploaded
+	 * before (the file changed since). Register content which looks
+	 * unexpected always results in another upload.
+	 */
+	ret = SR_ERR_DATA;
+	if (!devc->fpga_bitstream_id.valid ||
+			sr_resource_id_equal(&devc->fpga_bitstream_id, &bitstream_id))
+		ret = check_fpga_bitstream(sdi);
 	if (ret != SR_OK) {
-		ret = upload_fpga_bitstream(sdi, bitstream_fn);
+		devc->fpga_bitstream_id.valid = FALSE;
+		ret = upload_fpga_bitstream(sdi, bitstream_fn, bitstream);
 		if (ret != SR_OK) {
 			sr_err("Cannot upload FPGA bitstream.");
+			g_bytes_unref(bitstream);
 			return ret;
 		}
 	}
+	g_bytes_unref(bitstream);
+	devc->fpga_bitstream_id = bitstream_id;
 	ret = enable_fpga_bitstream(sdi);
 	if (ret != SR_OK) {
 		sr_err("Cannot enable FPGA bitstream after upload.");
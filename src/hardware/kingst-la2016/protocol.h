@@ -47,6 +47,7 @@
 #define LA2016_EP6_PKTSZ	512 /* Max packet size of USB endpoint 6. */
 #define LA2016_USB_BUFSZ	(512 * 1024) /* 512KiB buffer. */
 #define LA2016_USB_XFER_COUNT	8 /* Size of USB bulk transfers pool. */
+#define LA2016_DECODE_THREADS	4 /* Max workers decoding downloads. */
 
 /* USB communication timeout during regular operation. */
 #define DEFAULT_TIMEOUT_MS	200
@@ -105,6 +106,8 @@
 #define WITH_DEINIT_IN_CLOSE	0
 
 #define LA2016_CONVBUFFER_SIZE	(4 * 1024 * 1024)
+/* Runs per SR_DF_LOGIC_RLE packet when sending compressed capture data. */
+#define LA2016_RLE_RUNS		(64 * 1024)
 
 struct kingst_model {
 	uint8_t magic, magic2;	/* EEPROM magic byte values. */
@@ -120,6 +123,7 @@ struct dev_context {
 	uint16_t usb_pid;
 	char *mcu_firmware;
 	char *fpga_bitstream;
+	struct sr_resource_id fpga_bitstream_id;
 	uint64_t fw_uploaded; /* Timestamp of most recent FW upload. */
 	uint8_t identify_magic, identify_magic2;
 	const struct kingst_model *model;
@@ -150,7 +154,6 @@ struct dev_context {
 	} info;
 	uint32_t n_transfer_packets_to_read; /* each with 5 acq packets */
 	uint32_t n_bytes_to_read;
-	uint32_t n_reps_until_trigger;
 	gboolean trigger_marked;
 	uint64_t total_samples;
 	uint32_t read_pos;
@@ -158,6 +161,14 @@ struct dev_context {
 	struct feed_queue_logic *feed_queue;
 	GSList *transfers;
 	size_t transfer_bufsize;
+	/* Parallel decoding of downloaded transfers, in sequence order. */
+	GThreadPool *decode_pool;
+	GMutex decode_mutex;
+	GSList *decode_done; /* Decoded jobs yet to be sent, by the mutex. */
+	GSource *decode_idle; /* Sends them in the session, by the mutex. */
+	uint64_t decode_seq_next, decode_seq_done;
+	uint64_t records_seen;
+	size_t decode_runs_max;
 	struct stream_state_t {
 		size_t enabled_count;
 		uint32_t enabled_mask;
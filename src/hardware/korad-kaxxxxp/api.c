@@ -36,6 +36,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_CONTINUOUS,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_VOLTAGE | SR_CONF_GET,
 	SR_CONF_VOLTAGE_TARGET | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_CURRENT | SR_CONF_GET,
@@ -218,6 +219,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	devc = g_malloc0(sizeof(struct dev_context));
 	sr_sw_limits_init(&devc->limits);
+	sr_poll_sched_init(&devc->poll, 2 * KAXXXXP_PROCESSING_TIME_MS,
+		KAXXXXP_IDLE_INTERVAL_MS, KAXXXXP_STATUS_EVERY);
 	g_mutex_init(&devc->rw_mutex);
 	devc->model = &models[model_id];
 	devc->req_sent_at = 0;
@@ -260,6 +263,8 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_LIMIT_MSEC:
 		return sr_sw_limits_config_get(&devc->limits, key, data);
+	case SR_CONF_SAMPLERATE:
+		return sr_poll_sched_config_get(&devc->poll, key, data);
 	case SR_CONF_CONN:
 		*data = g_variant_new_string(sdi->connection_id);
 		break;
@@ -318,6 +323,8 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_LIMIT_MSEC:
 	case SR_CONF_LIMIT_SAMPLES:
 		return sr_sw_limits_config_set(&devc->limits, key, data);
+	case SR_CONF_SAMPLERATE:
+		return sr_poll_sched_config_set(&devc->poll, key, data);
 	case SR_CONF_VOLTAGE_TARGET:
 		dval = g_variant_get_double(data);
 		if (dval < devc->model->voltage[0] || dval > devc->model->voltage[1])
@@ -410,6 +417,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	std_session_send_df_header(sdi);
 
 	devc->req_sent_at = 0;
+	devc->acquisition_target = KAXXXXP_CURRENT;
+	devc->readings_changed = FALSE;
+	sr_poll_sched_acquisition_start(&devc->poll);
 	serial = sdi->conn;
 	serial_source_add(sdi->session, serial, G_IO_IN,
 			KAXXXXP_POLL_INTERVAL_MS,
@@ -21,8 +21,6 @@
 #include <config.h>
 #include "protocol.h"
 
-#define DEVICE_PROCESSING_TIME_MS 80
-
 SR_PRIV int korad_kaxxxxp_send_cmd(struct sr_serial_dev_inst *serial,
 				const char *cmd)
 {
@@ -155,7 +153,7 @@ static void give_device_time_to_process(struct dev_context *devc)
 {
 	int64_t sleeping_time;
 
-	sleeping_time = devc->req_sent_at + (DEVICE_PROCESSING_TIME_MS * 1000);
+	sleeping_time = devc->req_sent_at + (KAXXXXP_PROCESSING_TIME_MS * 1000);
 	sleeping_time -= g_get_monotonic_time();
 
 	if (sleeping_time > 0) {
@@ -394,8 +392,9 @@ static void next_measurement(struct dev_context *devc)
 		devc->acquisition_target = KAXXXXP_VOLTAGE;
 		break;
 	case KAXXXXP_VOLTAGE:
-		devc->acquisition_target = KAXXXXP_STATUS;
-		break;
+		sr_poll_sched_update(&devc->poll, devc->readings_changed);
+		devc->readings_changed = FALSE;
+		/* FALLTHROUGH */
 	case KAXXXXP_STATUS:
 		devc->acquisition_target = KAXXXXP_CURRENT;
 		break;
@@ -405,6 +404,28 @@ static void next_measurement(struct dev_context *devc)
 	}
 }
 
+/*
+ * Have the poll scheduler pick the next query. The voltage query
+ * completes a measurement which was started with the current query,
+ * and is always due.
+ */
+static gboolean pick_measurement(struct dev_context *devc)
+{
+	if (devc->acquisition_target == KAXXXXP_VOLTAGE)
+		return TRUE;
+
+	switch (sr_poll_sched_next(&devc->poll)) {
+	case SR_POLL_MEASUREMENT:
+		devc->acquisition_target = KAXXXXP_CURRENT;
+		return TRUE;
+	case SR_POLL_STATUS:
+		devc->acquisition_target = KAXXXXP_STATUS;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 SR_PRIV int korad_kaxxxxp_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
@@ -416,6 +437,7 @@ SR_PRIV int korad_kaxxxxp_receive_data(int fd, int revents, void *cb_data)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	GSList *l;
+	float prev_value;
 
 	(void)fd;
 	(void)revents;
@@ -428,8 +450,24 @@ SR_PRIV int korad_kaxxxxp_receive_data(int fd, int revents, void *cb_data)
 
 	serial = sdi->conn;
 
+	/* Don't block the session while the device is still busy. */
+	if (g_get_monotonic_time() <
+			devc->req_sent_at + KAXXXXP_PROCESSING_TIME_MS * 1000)
+		return TRUE;
+	if (!pick_measurement(devc)) {
+		if (sr_sw_limits_check(&devc->limits))
+			sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
 	/* Get the value. */
+	prev_value = (devc->acquisition_target == KAXXXXP_CURRENT) ?
+		devc->current : devc->voltage;
 	korad_kaxxxxp_get_value(serial, devc->acquisition_target, devc);
+	if (devc->acquisition_target == KAXXXXP_CURRENT)
+		devc->readings_changed |= devc->current != prev_value;
+	else if (devc->acquisition_target == KAXXXXP_VOLTAGE)
+		devc->readings_changed |= devc->voltage != prev_value;
 
 	/* Note: digits/spec_digits will be overridden later. */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
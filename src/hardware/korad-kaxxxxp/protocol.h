@@ -29,7 +29,14 @@
 
 #define LOG_PREFIX "korad-kaxxxxp"
 
-#define KAXXXXP_POLL_INTERVAL_MS 80
+/* Period of the receive callback, the poll scheduler paces queries. */
+#define KAXXXXP_POLL_INTERVAL_MS 10
+/* Minimum time between two commands, the device drops faster ones. */
+#define KAXXXXP_PROCESSING_TIME_MS 80
+/* Query status after this many voltage and current measurements. */
+#define KAXXXXP_STATUS_EVERY 4
+/* Longest measurement interval while readings don't change. */
+#define KAXXXXP_IDLE_INTERVAL_MS 1000
 
 enum {
 	VELLEMAN_PS3005D,
@@ -86,6 +93,7 @@ struct dev_context {
 	const struct korad_kaxxxxp_model *model; /**< Model information. */
 
 	struct sr_sw_limits limits;
+	struct sr_poll_sched poll;
 	int64_t req_sent_at;
 	GMutex rw_mutex;
 
@@ -107,6 +115,7 @@ struct dev_context {
 	gboolean ovp_enabled_changed;    /**< OVP enabled state has changed. */
 
 	int acquisition_target;  /**< What reply to expect. */
+	gboolean readings_changed; /**< Measurement differs from previous. */
 	int program;             /**< Program to store or recall. */
 
 	float set_current_limit;     /**< New output current to set. */
@@ -361,7 +361,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	libusb_fill_bulk_transfer(xfer_in, usb->devhdl, LASCAR_EP_IN,
 			buf, 4096, lascar_el_usb_receive_transfer,
 			(struct sr_dev_inst *)sdi, 100);
-	if ((ret = libusb_submit_transfer(xfer_in) != 0)) {
+	if ((ret = sr_usb_submit_transfer(sdi, xfer_in) != 0)) {
 		sr_err("Unable to submit transfer: %s.", libusb_error_name(ret));
 		libusb_free_transfer(xfer_in);
 		g_free(buf);
@@ -361,7 +361,7 @@ SR_PRIV struct sr_dev_inst *lascar_scan(int bus, int address)
 	drvc = di->context;
 	sdi = NULL;
 
-	ret = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	ret = sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	if (ret < 0)
 		return NULL;
 
@@ -557,7 +557,7 @@ SR_PRIV void LIBUSB_CALL lascar_el_usb_receive_transfer(struct libusb_transfer *
 
 	if (sdi->status == SR_ST_ACTIVE) {
 		/* Send the same request again. */
-		if ((ret = libusb_submit_transfer(transfer) != 0)) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer) != 0)) {
 			sr_err("Unable to resubmit transfer: %s.",
 			       libusb_error_name(ret));
 			g_free(transfer->buffer);
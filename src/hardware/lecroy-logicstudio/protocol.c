@@ -225,7 +225,7 @@ static int write_registers_async(const struct sr_dev_inst *sdi,
 	libusb_fill_control_transfer(xfer, usb->devhdl,
 		xfer_buf, callback, (void *) sdi, USB_TIMEOUT_MS);
 
-	if (libusb_submit_transfer(xfer) < 0) {
+	if (sr_usb_submit_transfer(sdi, xfer) < 0) {
 		g_free(xfer->buffer);
 		xfer->buffer = NULL;
 		libusb_free_transfer(xfer);
@@ -260,7 +260,7 @@ static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
 		devc->fetched_samples, 17 << 10,
 		recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
 
-	libusb_submit_transfer(devc->bulk_xfer);
+	sr_usb_submit_transfer(sdi, devc->bulk_xfer);
 }
 
 static void calc_unk0(uint32_t *a, uint32_t *b)
@@ -928,7 +928,7 @@ static void LIBUSB_CALL recv_intr_transfer(struct libusb_transfer *xfer)
 			sr_err("Invalid size of interrupt transfer: %u.",
 				xfer->actual_length);
 		else if (handle_intr_data(sdi, xfer->buffer)) {
-			if (libusb_submit_transfer(xfer) < 0)
+			if (sr_usb_submit_transfer(sdi, xfer) < 0)
 				sr_err("Failed to submit interrupt transfer.");
 		}
 	}
@@ -1023,7 +1023,7 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 		xfer->length = MIN(16 << 10,
 			SAMPLE_BUF_SIZE - devc->total_received_sample_bytes);
 
-		libusb_submit_transfer(xfer);
+		sr_usb_submit_transfer(sdi, xfer);
 		return;
 	}
 
@@ -1114,7 +1114,7 @@ SR_PRIV int lls_start_acquisition(const struct sr_dev_inst *sdi)
 		devc->intr_buf, INTR_BUF_SIZE,
 		recv_intr_transfer, (void *) sdi, USB_TIMEOUT_MS);
 
-	libusb_submit_transfer(devc->intr_xfer);
+	sr_usb_submit_transfer(sdi, devc->intr_xfer);
 
 	if (devc->want_trigger == FALSE)
 		return SR_OK;
@@ -539,39 +539,42 @@ SR_PRIV int lecroy_xstream_init_device(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/*
+ * The samples get sent as they came in, with the gain and offset from the
+ * waveform descriptor in the encoding. Frontends which need floats get them
+ * from sr_analog_to_float(), the others skip the conversion.
+ */
 static int lecroy_waveform_2_x_to_analog(GByteArray *data,
 		struct lecroy_wavedesc *desc, struct sr_datafeed_analog *analog)
 {
 	struct sr_analog_encoding *encoding = analog->encoding;
 	struct sr_analog_meaning *meaning = analog->meaning;
 	struct sr_analog_spec *spec = analog->spec;
-	float *data_float;
-	int16_t *waveform_data;
-	unsigned int i, num_samples;
+	unsigned int num_samples, offset;
 
-	data_float = g_malloc(desc->version_2_x.wave_array_count * sizeof(float));
 	num_samples = desc->version_2_x.wave_array_count;
+	offset = desc->version_2_x.wave_descriptor_length
+		+ desc->version_2_x.user_text_len;
+	if (num_samples &&
+	    offset + (uint64_t)num_samples * sizeof(int16_t) > data->len) {
+		sr_err("Truncated waveform data received.");
+		return SR_ERR;
+	}
 
-	waveform_data = (int16_t*)(data->data +
-		+ desc->version_2_x.wave_descriptor_length
-		+ desc->version_2_x.user_text_len);
-
-	for (i = 0; i < num_samples; i++)
-		data_float[i] = (float)waveform_data[i]
-			* desc->version_2_x.vertical_gain
-			+ desc->version_2_x.vertical_offset;
-
-	analog->data = data_float;
+	analog->data = data->data + offset;
 	analog->num_samples = num_samples;
 
-	encoding->unitsize = sizeof(float);
+	encoding->unitsize = sizeof(int16_t);
 	encoding->is_signed = TRUE;
-	encoding->is_float = TRUE;
+	encoding->is_float = FALSE;
 	encoding->is_bigendian = FALSE;
-	encoding->scale.p = 1;
-	encoding->scale.q = 1;
-	encoding->offset.p = 0;
-	encoding->offset.q = 1;
+	if (sr_rational_from_float(&encoding->scale,
+			desc->version_2_x.vertical_gain) != SR_OK ||
+	    sr_rational_from_float(&encoding->offset,
+			desc->version_2_x.vertical_offset) != SR_OK) {
+		sr_err("Unsupported vertical gain or offset.");
+		return SR_ERR;
+	}
 
 	encoding->digits = 6;
 	encoding->is_digits_decimal = FALSE;
@@ -650,11 +653,12 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 	analog.meaning = &meaning;
 	analog.spec = &spec;
 
-	if (lecroy_waveform_to_analog(data, &analog) != SR_OK)
+	if (lecroy_waveform_to_analog(data, &analog) != SR_OK) {
+		g_byte_array_free(data, TRUE);
 		return SR_ERR;
+	}
 
 	if (analog.num_samples == 0) {
-		g_free(analog.data);
 		g_byte_array_free(data, TRUE);
 
 		/* No data available, we have to acquire data first. */
@@ -667,7 +671,6 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 		/* Update sample rate if needed. */
 		if (state->sample_rate == 0)
 			if (lecroy_xstream_update_sample_rate(sdi, analog.num_samples) != SR_OK) {
-				g_free(analog.data);
 				g_byte_array_free(data, TRUE);
 				return SR_ERR;
 			}
@@ -689,7 +692,6 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 	data = NULL;
 
 	g_slist_free(meaning.channels);
-	g_free(analog.data);
 
 	/*
 	 * Advance to the next enabled channel. When data for all enabled
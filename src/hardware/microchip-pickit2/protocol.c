@@ -317,7 +317,6 @@ static int pickit2_submit_logic_data(struct sr_dev_inst *sdi)
 	};
 	uint8_t *raw_buf, raw_byte, *conv_buf;
 	size_t raw_len, conv_len;
-	uint64_t limit;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 
@@ -364,10 +363,8 @@ static int pickit2_submit_logic_data(struct sr_dev_inst *sdi)
 	packet.payload = &logic;
 	logic.unitsize = sizeof(uint8_t);
 	logic.data = &devc->samples_conv[0];
-	logic.length = conv_len;
-	limit = devc->sw_limits.limit_samples;
-	if (limit && limit < logic.length)
-		logic.length = limit;
+	logic.length = MIN(conv_len,
+		sr_sw_limits_samples_remain(&devc->sw_limits));
 	sr_session_send(sdi, &packet);
 
 	return SR_OK;
@@ -375,6 +375,71 @@ SR_PRIV void abort_acquisition(const struct sr_dev_inst *sdi)
 	std_session_send_df_end(sdi);
 }
 
+/*
+ * Store one complete sample, or take note of an RLE count. The OLS
+ * sends its sample memory backwards, so samples get stored from the end
+ * of the buffer towards its start, ready to go out in one piece.
+ * @p groups lists the enabled channel groups, which the received bytes
+ * belong to.
+ */
+static void ols_store_sample(struct dev_context *devc,
+		const uint8_t *groups, int num_changroups)
+{
+	uint32_t sample;
+	uint8_t *dst;
+	unsigned int i;
+	int j;
+
+	devc->cnt_samples++;
+	devc->cnt_samples_rle++;
+
+	/* Convert from the OLS's little-endian sample to the local format. */
+	sample = 0;
+	for (j = 0; j < num_changroups; j++)
+		sample |= (uint32_t)devc->sample[j] << (8 * j);
+	devc->num_bytes = 0;
+
+	if (devc->capture_flags & CAPTURE_FLAG_RLE) {
+		/*
+		 * In RLE mode the high bit of the sample is the "count"
+		 * flag, meaning this sample is the number of times the
+		 * previous sample occurred.
+		 */
+		if (devc->sample[num_changroups - 1] & 0x80) {
+			/* Clear the high bit. */
+			sample &= ~(0x80 << (num_changroups - 1) * 8);
+			devc->rle_count = sample;
+			devc->cnt_samples_rle += devc->rle_count;
+			return;
+		}
+	}
+
+	devc->num_samples += devc->rle_count + 1;
+	if (devc->num_samples > devc->limit_samples) {
+		/* Save us from overrunning the buffer. */
+		devc->rle_count -= devc->num_samples - devc->limit_samples;
+		devc->num_samples = devc->limit_samples;
+	}
+
+	/*
+	 * Some channel groups may have been turned off, to speed up
+	 * transfer between the hardware and the PC. Expand that here,
+	 * whatever is listening on the bus will be expecting a full
+	 * 32-bit sample, based on the number of channels.
+	 */
+	if (num_changroups < 4) {
+		sample = 0;
+		for (j = 0; j < num_changroups; j++)
+			sample |= (uint32_t)devc->sample[j] << (8 * groups[j]);
+	}
+
+	dst = devc->raw_sample_buf +
+		(devc->limit_samples - devc->num_samples) * 4;
+	for (i = 0; i <= devc->rle_count; i++)
+		WL32(dst + i * 4, sample);
+	devc->rle_count = 0;
+}
+
 SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 {
 	struct dev_context *devc;
@@ -382,10 +447,9 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	struct sr_serial_dev_inst *serial;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	uint32_t sample;
-	int num_changroups, offset, j;
+	uint8_t buf[4096], groups[4];
+	int num_changroups, len, k;
 	unsigned int i;
-	unsigned char byte;
 
 	(void)fd;
 
@@ -408,106 +472,27 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		memset(devc->raw_sample_buf, 0x82, devc->limit_samples * 4);
 	}
 
+	/* The enabled channel groups, which samples carry bytes for. */
 	num_changroups = 0;
-	for (i = 0x20; i > 0x02; i >>= 1) {
-		if ((devc->capture_flags & i) == 0) {
-			num_changroups++;
-		}
+	for (i = 0; i < 4; i++) {
+		if (((devc->capture_flags >> 2) & (1 << i)) == 0)
+			groups[num_changroups++] = i;
 	}
 
 	if (revents == G_IO_IN && devc->num_samples < devc->limit_samples) {
-		if (serial_read_nonblocking(serial, &byte, 1) != 1)
+		/* Take whatever has arrived, not one byte per wakeup. */
+		len = serial_read_nonblocking(serial, buf, sizeof(buf));
+		if (len < 1)
 			return FALSE;
-		devc->cnt_bytes++;
-
-		/* Ignore it if we've read enough. */
-		if (devc->num_samples >= devc->limit_samples)
-			return TRUE;
-
-		devc->sample[devc->num_bytes++] = byte;
-		sr_spew("Received byte 0x%.2x.", byte);
-		if (devc->num_bytes == num_changroups) {
-			devc->cnt_samples++;
-			devc->cnt_samples_rle++;
-			/*
-			 * Got a full sample. Convert from the OLS's little-endian
-			 * sample to the local format.
-			 */
-			sample = devc->sample[0] | (devc->sample[1] << 8) |
-				 (devc->sample[2] << 16) |
-				 (devc->sample[3] << 24);
-			sr_dbg("Received sample 0x%.*x.", devc->num_bytes * 2,
-			       sample);
-			if (devc->capture_flags & CAPTURE_FLAG_RLE) {
-				/*
-				 * In RLE mode the high bit of the sample is the
-				 * "count" flag, meaning this sample is the number
-				 * of times the previous sample occurred.
-				 */
-				if (devc->sample[devc->num_bytes - 1] & 0x80) {
-					/* Clear the high bit. */
-					sample &= ~(0x80 << (devc->num_bytes -
-							     1) * 8);
-					devc->rle_count = sample;
-					devc->cnt_samples_rle +=
-						devc->rle_count;
-					sr_dbg("RLE count: %u.",
-					       devc->rle_count);
-					devc->num_bytes = 0;
-					return TRUE;
-				}
-			}
-			devc->num_samples += devc->rle_count + 1;
-			if (devc->num_samples > devc->limit_samples) {
-				/* Save us from overrunning the buffer. */
-				devc->rle_count -=
-					devc->num_samples - devc->limit_samples;
-				devc->num_samples = devc->limit_samples;
-			}
-
-			if (num_changroups < 4) {
-				/*
-				 * Some channel groups may have been turned
-				 * off, to speed up transfer between the
-				 * hardware and the PC. Expand that here before
-				 * submitting it over the session bus --
-				 * whatever is listening on the bus will be
-				 * expecting a full 32-bit sample, based on
-				 * the number of channels.
-				 */
-				j = 0;
-				uint8_t tmp_sample[4] = { 0, 0, 0, 0 };
-				for (i = 0; i < 4; i++) {
-					if (((devc->capture_flags >> 2) &
-					     (1 << i)) == 0) {
-						/*
-						 * This channel group was
-						 * enabled, copy from received
-						 * sample.
-						 */
-						tmp_sample[i] =
-							devc->sample[j++];
-					}
-				}
-				memcpy(devc->sample, tmp_sample, 4);
-				sr_spew("Expanded sample: 0x%.2hhx%.2hhx%.2hhx%.2hhx ",
-					devc->sample[3], devc->sample[2],
-					devc->sample[1], devc->sample[0]);
-			}
+		devc->cnt_bytes += len;
 
-			/*
-			 * the OLS sends its sample buffer backwards.
-			 * store it in reverse order here, so we can dump
-			 * this on the session bus later.
-			 */
-			offset = (devc->limit_samples - devc->num_samples) * 4;
-			for (i = 0; i <= devc->rle_count; i++) {
-				memcpy(devc->raw_sample_buf + offset + (i * 4),
-				       devc->sample, 4);
-			}
-			memset(devc->sample, 0, 4);
-			devc->num_bytes = 0;
-			devc->rle_count = 0;
+		/* Bytes beyond the requested samples get ignored. */
+		for (k = 0; k < len; k++) {
+			if (devc->num_samples >= devc->limit_samples)
+				break;
+			devc->sample[devc->num_bytes++] = buf[k];
+			if (devc->num_bytes == num_changroups)
+				ols_store_sample(devc, groups, num_changroups);
 		}
 	} else {
 		/*
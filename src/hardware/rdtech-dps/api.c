@@ -40,6 +40,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_CONTINUOUS,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_VOLTAGE | SR_CONF_GET,
 	SR_CONF_VOLTAGE_TARGET | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_CURRENT | SR_CONF_GET,
@@ -138,6 +139,7 @@ static struct sr_dev_inst *probe_device(struct sr_modbus_dev_inst *modbus,
 
 	devc = g_malloc0(sizeof(*devc));
 	sr_sw_limits_init(&devc->limits);
+	sr_poll_sched_init(&devc->poll, 0, RDTECH_DPS_IDLE_INTERVAL_MS, 0);
 	devc->model = model;
 	devc->current_multiplier = pow(10.0, model->current_digits);
 	devc->voltage_multiplier = pow(10.0, model->voltage_digits);
@@ -278,6 +280,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_LIMIT_MSEC:
 		ret = sr_sw_limits_config_get(&devc->limits, key, data);
 		break;
+	case SR_CONF_SAMPLERATE:
+		ret = sr_poll_sched_config_get(&devc->poll, key, data);
+		break;
 	case SR_CONF_ENABLED:
 		ret = rdtech_dps_get_state(sdi, &state, ST_CTX_CONFIG);
 		if (ret != SR_OK)
@@ -397,6 +402,8 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_LIMIT_MSEC:
 		return sr_sw_limits_config_set(&devc->limits, key, data);
+	case SR_CONF_SAMPLERATE:
+		return sr_poll_sched_config_set(&devc->poll, key, data);
 	case SR_CONF_ENABLED:
 		state.output_enabled = g_variant_get_boolean(data);
 		state.mask |= STATE_OUTPUT_ENABLED;
@@ -465,7 +472,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return ret;
 
 	/* Register the periodic data reception callback. */
-	ret = sr_modbus_source_add(sdi->session, modbus, G_IO_IN, 10,
+	sr_poll_sched_acquisition_start(&devc->poll);
+	ret = sr_modbus_source_add(sdi->session, modbus, G_IO_IN,
+			RDTECH_DPS_POLL_INTERVAL_MS,
 			rdtech_dps_receive_data, (void *)sdi);
 	if (ret != SR_OK)
 		return ret;
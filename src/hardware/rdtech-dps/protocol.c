@@ -118,6 +118,23 @@ static int rdtech_dps_read_holding_registers(struct sr_modbus_dev_inst *modbus,
 	return ret;
 }
 
+/* Retries failed multi block reads, like the single block read does. */
+static int rdtech_dps_read_register_blocks(struct sr_modbus_dev_inst *modbus,
+	struct sr_modbus_register_block *blocks, size_t count)
+{
+	size_t retries;
+	int ret;
+
+	retries = 3;
+	while (retries--) {
+		ret = sr_modbus_read_register_blocks(modbus, blocks, count, 0);
+		if (ret == SR_OK)
+			return ret;
+	}
+
+	return ret;
+}
+
 /* Set one 16bit register. LE format for DPS devices. */
 static int rdtech_dps_set_reg(const struct sr_dev_inst *sdi,
 	uint16_t address, uint16_t value)
@@ -259,7 +276,8 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	struct dev_context *devc;
 	struct sr_modbus_dev_inst *modbus;
 	gboolean get_config, get_init_state, get_curr_meas;
-	uint16_t registers[12];
+	struct sr_modbus_register_block blocks[2];
+	uint16_t registers[11], thresholds[2];
 	int ret;
 	const uint8_t *rdptr;
 	uint16_t uset_raw, iset_raw, uout_raw, iout_raw, power_raw;
@@ -299,28 +317,34 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		break;
 	}
 	/*
-	 * TODO Make use of this information to reduce the transfer
-	 * volume, especially on low bitrate serial connections. Though
-	 * the device firmware's samplerate is probably more limiting
-	 * than communication bandwidth is.
+	 * The protection thresholds live in a separate register range.
+	 * Only fetch them when the caller asked for configuration details,
+	 * the acquisition's polling loop need not transfer them.
 	 */
-	(void)get_config;
 	(void)get_init_state;
 	(void)get_curr_meas;
 
+	ovp_threshold = ocp_threshold = 0;
 	switch (devc->model->model_type) {
 	case MODEL_DPS:
 		/*
-		 * Transfer a chunk of registers in a single call. It's
-		 * unfortunate that the model dependency and the sparse
-		 * register map force us to open code addresses, sizes,
-		 * and the sequence of the registers and how to interpret
-		 * their bit fields. But then this is not too unusual for
-		 * a hardware specific device driver ...
+		 * Transfer the chunks of registers in as few calls as
+		 * possible. It's unfortunate that the model dependency
+		 * and the sparse register map force us to open code
+		 * addresses, sizes, and the sequence of the registers
+		 * and how to interpret their bit fields. But then this
+		 * is not too unusual for a hardware specific device
+		 * driver ...
 		 */
+		blocks[0].address = REG_DPS_USET;
+		blocks[0].nb_registers = 10;
+		blocks[0].registers = registers;
+		blocks[1].address = PRE_DPS_OVPSET;
+		blocks[1].nb_registers = 2;
+		blocks[1].registers = thresholds;
 		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_DPS_USET, 10, registers);
+		ret = rdtech_dps_read_register_blocks(modbus,
+			blocks, get_config ? 2 : 1);
 		g_mutex_unlock(&devc->rw_mutex);
 		if (ret != SR_OK)
 			return ret;
@@ -348,28 +372,28 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		out_state = read_u16be_inc(&rdptr); /* ENABLE */
 		is_out_enabled = out_state != 0;
 
-		/* Transfer another chunk of registers in a single call. */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			PRE_DPS_OVPSET, 2, registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
-
 		/* Interpret the second registers chunk's values. */
-		rdptr = (const void *)registers;
-		ovpset_raw = read_u16be_inc(&rdptr); /* PRE OVPSET */
-		ovp_threshold = ovpset_raw * devc->voltage_multiplier;
-		ocpset_raw = read_u16be_inc(&rdptr); /* PRE OCPSET */
-		ocp_threshold = ocpset_raw * devc->current_multiplier;
+		if (get_config) {
+			rdptr = (const void *)thresholds;
+			ovpset_raw = read_u16be_inc(&rdptr); /* PRE OVPSET */
+			ovp_threshold = ovpset_raw * devc->voltage_multiplier;
+			ocpset_raw = read_u16be_inc(&rdptr); /* PRE OCPSET */
+			ocp_threshold = ocpset_raw * devc->current_multiplier;
+		}
 
 		break;
 
 	case MODEL_RD:
-		/* Retrieve a set of adjacent registers. */
+		/* Retrieve the sets of adjacent registers. */
+		blocks[0].address = REG_RD_VOLT_TGT;
+		blocks[0].nb_registers = 11;
+		blocks[0].registers = registers;
+		blocks[1].address = REG_RD_OVP_THR;
+		blocks[1].nb_registers = 2;
+		blocks[1].registers = thresholds;
 		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_RD_VOLT_TGT, 11, registers);
+		ret = rdtech_dps_read_register_blocks(modbus,
+			blocks, get_config ? 2 : 1);
 		g_mutex_unlock(&devc->rw_mutex);
 		if (ret != SR_OK)
 			return ret;
@@ -397,20 +421,14 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		out_state = read_u16be_inc(&rdptr); /* ENABLE */
 		is_out_enabled = out_state != 0;
 
-		/* Retrieve a set of adjacent registers. */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_RD_OVP_THR, 2, registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
-
-		/* Interpret the registers' raw content. */
-		rdptr = (const void *)registers;
-		ovpset_raw = read_u16be_inc(&rdptr); /* OVP THR */
-		ovp_threshold = ovpset_raw / devc->voltage_multiplier;
-		ocpset_raw = read_u16be_inc(&rdptr); /* OCP THR */
-		ocp_threshold = ocpset_raw / devc->current_multiplier;
+		/* Interpret the second registers chunk's raw content. */
+		if (get_config) {
+			rdptr = (const void *)thresholds;
+			ovpset_raw = read_u16be_inc(&rdptr); /* OVP THR */
+			ovp_threshold = ovpset_raw / devc->voltage_multiplier;
+			ocpset_raw = read_u16be_inc(&rdptr); /* OCP THR */
+			ocp_threshold = ocpset_raw / devc->current_multiplier;
+		}
 
 		/* Details which we cannot query from the device. */
 		is_lock = FALSE;
@@ -422,13 +440,7 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		return SR_ERR_ARG;
 	}
 
-	/*
-	 * Store gathered details in the high level container.
-	 *
-	 * TODO Make use of the caller's context. The register access
-	 * code path above need not have gathered every detail in every
-	 * invocation.
-	 */
+	/* Store gathered details in the high level container. */
 	memset(state, 0, sizeof(*state));
 	state->lock = is_lock;
 	state->mask |= STATE_LOCK;
@@ -446,10 +458,12 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	state->mask |= STATE_VOLTAGE_TARGET;
 	state->current_limit = curr_limit;
 	state->mask |= STATE_CURRENT_LIMIT;
-	state->ovp_threshold = ovp_threshold;
-	state->mask |= STATE_OVP_THRESHOLD;
-	state->ocp_threshold = ocp_threshold;
-	state->mask |= STATE_OCP_THRESHOLD;
+	if (get_config) {
+		state->ovp_threshold = ovp_threshold;
+		state->mask |= STATE_OVP_THRESHOLD;
+		state->ocp_threshold = ocp_threshold;
+		state->mask |= STATE_OCP_THRESHOLD;
+	}
 	state->voltage = curr_voltage;
 	state->mask |= STATE_VOLTAGE;
 	state->current = curr_current;
@@ -602,6 +616,10 @@ SR_PRIV int rdtech_dps_seed_receive(const struct sr_dev_inst *sdi)
 		devc->curr_cc_state = state.regulation_cc;
 	if (state.mask & STATE_OUTPUT_ENABLED)
 		devc->curr_out_state = state.output_enabled;
+	if (state.mask & STATE_VOLTAGE)
+		devc->curr_voltage = state.voltage;
+	if (state.mask & STATE_CURRENT)
+		devc->curr_current = state.current;
 
 	return SR_OK;
 }
@@ -615,6 +633,8 @@ SR_PRIV int rdtech_dps_receive_data(int fd, int revents, void *cb_data)
 	int ret;
 	struct sr_channel *ch;
 	const char *regulation_text;
+	struct sr_meta_batch meta;
+	gboolean changed;
 
 	(void)fd;
 	(void)revents;
@@ -624,6 +644,13 @@ SR_PRIV int rdtech_dps_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	devc = sdi->priv;
 
+	/* Leave the bus alone until the next measurement is due. */
+	if (sr_poll_sched_next(&devc->poll) == SR_POLL_NONE) {
+		if (sr_sw_limits_check(&devc->limits))
+			sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
 	/* Get the device's current state. */
 	ret = rdtech_dps_get_state(sdi, &state, ST_CTX_IN_ACQ);
 	if (ret != SR_OK)
@@ -645,30 +672,42 @@ SR_PRIV int rdtech_dps_receive_data(int fd, int revents, void *cb_data)
 		SR_MQ_POWER, 0, SR_UNIT_WATT, 2);
 	std_session_send_df_frame_end(sdi);
 
-	/* Check for state changes. */
+	/* Check for state changes, report all of them in one packet. */
+	sr_meta_batch_init(&meta, sdi);
+	changed = devc->curr_voltage != state.voltage ||
+		devc->curr_current != state.current;
+	devc->curr_voltage = state.voltage;
+	devc->curr_current = state.current;
 	if (devc->curr_ovp_state != state.protect_ovp) {
-		(void)sr_session_send_meta(sdi,
+		changed = TRUE;
+		(void)sr_meta_batch_add(&meta,
 			SR_CONF_OVER_VOLTAGE_PROTECTION_ACTIVE,
 			g_variant_new_boolean(state.protect_ovp));
 		devc->curr_ovp_state = state.protect_ovp;
 	}
 	if (devc->curr_ocp_state != state.protect_ocp) {
-		(void)sr_session_send_meta(sdi,
+		changed = TRUE;
+		(void)sr_meta_batch_add(&meta,
 			SR_CONF_OVER_CURRENT_PROTECTION_ACTIVE,
 			g_variant_new_boolean(state.protect_ocp));
 		devc->curr_ocp_state = state.protect_ocp;
 	}
 	if (devc->curr_cc_state != state.regulation_cc) {
+		changed = TRUE;
 		regulation_text = state.regulation_cc ? "CC" : "CV";
-		(void)sr_session_send_meta(sdi, SR_CONF_REGULATION,
+		(void)sr_meta_batch_add(&meta, SR_CONF_REGULATION,
 			g_variant_new_string(regulation_text));
 		devc->curr_cc_state = state.regulation_cc;
 	}
 	if (devc->curr_out_state != state.output_enabled) {
-		(void)sr_session_send_meta(sdi, SR_CONF_ENABLED,
+		changed = TRUE;
+		(void)sr_meta_batch_add(&meta, SR_CONF_ENABLED,
 			g_variant_new_boolean(state.output_enabled));
 		devc->curr_out_state = state.output_enabled;
 	}
+	(void)sr_meta_batch_send(&meta);
+
+	sr_poll_sched_update(&devc->poll, changed);
 
 	/* Check optional acquisition limits. */
 	sr_sw_limits_update_samples_read(&devc->limits, 1);
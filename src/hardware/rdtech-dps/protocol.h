@@ -32,6 +32,11 @@
 
 #define LOG_PREFIX "rdtech-dps"
 
+/* Period of the receive callback, the poll scheduler paces queries. */
+#define RDTECH_DPS_POLL_INTERVAL_MS 10
+/* Longest measurement interval while readings don't change. */
+#define RDTECH_DPS_IDLE_INTERVAL_MS 1000
+
 enum rdtech_dps_model_type {
 	MODEL_NONE,
 	MODEL_DPS,
@@ -54,7 +59,10 @@ struct dev_context {
 	double current_multiplier;
 	double voltage_multiplier;
 	struct sr_sw_limits limits;
+	struct sr_poll_sched poll;
 	GMutex rw_mutex;
+	float curr_voltage;
+	float curr_current;
 	gboolean curr_ovp_state;
 	gboolean curr_ocp_state;
 	gboolean curr_cc_state;
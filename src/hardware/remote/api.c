@@ -0,0 +1,266 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "protocol.h"
+
+static const uint32_t scanopts[] = {
+	SR_CONF_CONN,
+};
+
+static const uint32_t drvopts[] = {
+	SR_CONF_LOGIC_ANALYZER,
+	SR_CONF_OSCILLOSCOPE,
+};
+
+static const uint32_t devopts[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_SAMPLERATE | SR_CONF_GET,
+};
+
+static GSList *scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct sr_config *src;
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	const char *conn;
+	gchar **params;
+	GSList *l;
+
+	conn = NULL;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_CONN)
+			conn = g_variant_get_string(src->data, NULL);
+	}
+	if (!conn)
+		return NULL;
+
+	params = g_strsplit(conn, "/", 3);
+	if (!params || !params[0] || !params[1] || (!params[2]
+			&& g_ascii_strcasecmp(params[0], "shm"))) {
+		sr_err("Invalid connection '%s', expected tcp/<host>/<port> "
+			"or shm/<name>.", conn);
+		g_strfreev(params);
+		return NULL;
+	}
+	if (g_ascii_strcasecmp(params[0], "tcp")
+			&& g_ascii_strcasecmp(params[0], "shm")) {
+		sr_err("Only TCP and shared memory connections are supported.");
+		g_strfreev(params);
+		return NULL;
+	}
+
+	devc = g_malloc0(sizeof(struct dev_context));
+	if (!g_ascii_strcasecmp(params[0], "shm")) {
+		/* Names of POSIX shared memory start with a slash. */
+		devc->shm_name = g_strconcat("/", params[1],
+			params[2] ? "/" : NULL, params[2], NULL);
+	} else {
+		devc->address = g_strdup(params[1]);
+		devc->port = g_strdup(params[2]);
+	}
+	devc->socket = -1;
+	devc->event_fd = -1;
+	devc->rx = g_byte_array_new();
+	sr_sw_limits_init(&devc->limits);
+	g_strfreev(params);
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INACTIVE;
+	sdi->vendor = g_strdup("sigrok");
+	sdi->model = g_strdup("Remote");
+	if (devc->shm_name)
+		sdi->connection_id = g_strdup(devc->shm_name);
+	else
+		sdi->connection_id = g_strdup_printf("%s:%s",
+			devc->address, devc->port);
+	sdi->priv = devc;
+
+	/*
+	 * The server streams a single run to its client, so keep this
+	 * connection open for the acquisition.
+	 */
+	if (remote_connect(devc) != SR_OK
+			|| remote_read_device(devc, sdi) != SR_OK) {
+		remote_disconnect(devc);
+		g_free(devc->address);
+		g_free(devc->port);
+		g_free(devc->shm_name);
+		g_byte_array_free(devc->rx, TRUE);
+		g_free(devc);
+		sdi->priv = NULL;
+		sr_dev_inst_free(sdi);
+		return NULL;
+	}
+	sr_info("Remote capture stream found at %s.", sdi->connection_id);
+
+	return std_scan_complete(di, g_slist_append(NULL, sdi));
+}
+
+static int dev_open(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	if (remote_connected(devc))
+		return SR_OK;
+
+	if ((ret = remote_connect(devc)) != SR_OK)
+		return ret;
+	if ((ret = remote_read_device(devc, sdi)) != SR_OK) {
+		remote_disconnect(devc);
+		return ret;
+	}
+
+	return SR_OK;
+}
+
+static int dev_close(struct sr_dev_inst *sdi)
+{
+	remote_disconnect(sdi->priv);
+
+	return SR_OK;
+}
+
+static void clear_helper(struct dev_context *devc)
+{
+	remote_disconnect(devc);
+	g_free(devc->address);
+	g_free(devc->port);
+	g_free(devc->shm_name);
+	g_byte_array_free(devc->rx, TRUE);
+	g_free(devc->scratch);
+	g_free(devc->fbuf);
+}
+
+static int dev_clear(const struct sr_dev_driver *di)
+{
+	return std_dev_clear_with_callback(di, (std_dev_clear_callback)clear_helper);
+}
+
+static int config_get(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+
+	(void)cg;
+
+	if (!sdi)
+		return SR_ERR_ARG;
+	devc = sdi->priv;
+
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		/* Only known once the server sent it. */
+		if (!devc->samplerate)
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(devc->samplerate);
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+	case SR_CONF_LIMIT_MSEC:
+		return sr_sw_limits_config_get(&devc->limits, key, data);
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+static int config_set(uint32_t key, GVariant *data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+
+	(void)cg;
+
+	devc = sdi->priv;
+
+	return sr_sw_limits_config_set(&devc->limits, key, data);
+}
+
+static int config_list(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	return STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
+}
+
+static int dev_acquisition_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	if (!remote_connected(devc))
+		return SR_ERR_DEV_CLOSED;
+
+	sr_sw_limits_acquisition_start(&devc->limits);
+	std_session_send_df_header(sdi);
+
+	if (devc->ring) {
+		if ((ret = remote_shm_notify_start(devc)) != SR_OK)
+			return ret;
+		return sr_session_source_add(sdi->session, devc->event_fd,
+			G_IO_IN, 100, remote_shm_receive_data, (void *)sdi);
+	}
+
+	return sr_session_source_add(sdi->session, devc->socket, G_IO_IN, 100,
+		remote_receive_data, (void *)sdi);
+}
+
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->ring) {
+		sr_session_source_remove(sdi->session, devc->event_fd);
+		remote_shm_notify_stop(devc);
+	} else {
+		sr_session_source_remove(sdi->session, devc->socket);
+	}
+	std_session_send_df_end(sdi);
+	g_byte_array_set_size(devc->rx, 0);
+
+	return SR_OK;
+}
+
+static struct sr_dev_driver remote_driver_info = {
+	.name = "remote",
+	.longname = "sigrok remote capture stream",
+	.api_version = 1,
+	.init = std_init,
+	.cleanup = std_cleanup,
+	.scan = scan,
+	.dev_list = std_dev_list,
+	.dev_clear = dev_clear,
+	.config_get = config_get,
+	.config_set = config_set,
+	.config_list = config_list,
+	.dev_open = dev_open,
+	.dev_close = dev_close,
+	.dev_acquisition_start = dev_acquisition_start,
+	.dev_acquisition_stop = dev_acquisition_stop,
+	.context = NULL,
+};
+SR_REGISTER_DEV_DRIVER(remote_driver_info);
@@ -0,0 +1,664 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Client of the "remote" output module, see src/output/remote.c for
+ * the stream format. The records get turned back into datafeed packets
+ * as they arrive, either over TCP or from a shared memory ring. The
+ * ring gets watched by a thread, which wakes up the session through an
+ * eventfd. Logic samples go out straight from the ring.
+ */
+
+#include <config.h>
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+#include "minilzo/minilzo.h"
+#include "protocol.h"
+
+SR_PRIV int remote_connect(struct dev_context *devc)
+{
+	struct addrinfo hints;
+	struct addrinfo *results, *res;
+#ifndef _WIN32
+	struct timeval tv;
+#endif
+	int err;
+
+	if (devc->shm_name) {
+		devc->ring = sr_shm_ring_open(devc->shm_name);
+		return devc->ring ? SR_OK : SR_ERR_IO;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	err = getaddrinfo(devc->address, devc->port, &hints, &results);
+	if (err) {
+		sr_err("Address lookup failed: %s:%s: %s", devc->address,
+			devc->port, gai_strerror(err));
+		return SR_ERR;
+	}
+
+	for (res = results; res; res = res->ai_next) {
+		if ((devc->socket = socket(res->ai_family, res->ai_socktype,
+				res->ai_protocol)) < 0)
+			continue;
+		if (connect(devc->socket, res->ai_addr, res->ai_addrlen) != 0) {
+			close(devc->socket);
+			devc->socket = -1;
+			continue;
+		}
+		break;
+	}
+	freeaddrinfo(results);
+
+	if (devc->socket < 0) {
+		sr_err("Failed to connect to %s:%s: %s", devc->address,
+			devc->port, g_strerror(errno));
+		return SR_ERR;
+	}
+
+#ifndef _WIN32
+	/* Don't wait forever for a stream which doesn't start. */
+	tv.tv_sec = REMOTE_SCAN_TIMEOUT / 1000;
+	tv.tv_usec = (REMOTE_SCAN_TIMEOUT % 1000) * 1000;
+	setsockopt(devc->socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#endif
+
+	return SR_OK;
+}
+
+SR_PRIV gboolean remote_connected(const struct dev_context *devc)
+{
+	return devc->ring || devc->socket >= 0;
+}
+
+SR_PRIV void remote_disconnect(struct dev_context *devc)
+{
+	sr_shm_ring_free(devc->ring);
+	devc->ring = NULL;
+
+	if (devc->socket < 0)
+		return;
+
+	close(devc->socket);
+	devc->socket = -1;
+}
+
+static int shm_read_all(struct dev_context *devc, uint8_t *buf, size_t len)
+{
+	const uint8_t *data;
+	uint32_t seen;
+	int64_t deadline;
+
+	deadline = g_get_monotonic_time() + REMOTE_SCAN_TIMEOUT * 1000;
+	seen = sr_shm_ring_wait(devc->ring, 0, 0);
+	while (sr_shm_ring_peek(devc->ring, &data) < len) {
+		if (sr_shm_ring_writer_done(devc->ring)
+				|| g_get_monotonic_time() > deadline) {
+			sr_err("Cannot receive stream start from %s.",
+				devc->shm_name);
+			return SR_ERR_IO;
+		}
+		seen = sr_shm_ring_wait(devc->ring, seen, 100);
+	}
+	memcpy(buf, data, len);
+	sr_shm_ring_consume(devc->ring, len);
+
+	return SR_OK;
+}
+
+static int recv_all(struct dev_context *devc, uint8_t *buf, size_t len)
+{
+	int ret;
+
+	if (devc->ring)
+		return shm_read_all(devc, buf, len);
+
+	while (len) {
+		ret = recv(devc->socket, (void *)buf, len, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			sr_err("Cannot receive stream start: %s",
+				ret ? g_strerror(errno) : "Connection closed");
+			return SR_ERR_IO;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Read the stream's start, and create the channels it describes. When
+ * reconnecting, the channels must be the same.
+ */
+SR_PRIV int remote_read_device(struct dev_context *devc,
+		struct sr_dev_inst *sdi)
+{
+	uint8_t hdr[SR_REMOTE_RECORD_HEADER_SIZE];
+	uint8_t magic[sizeof(SR_REMOTE_MAGIC)];
+	uint8_t *payload;
+	const uint8_t *p, *end;
+	uint32_t len;
+	unsigned int i, num_channels, index, name_len;
+	gboolean analog, enabled;
+	gboolean create;
+	char *name;
+	int ret;
+
+	if (recv_all(devc, magic, sizeof(magic)) != SR_OK)
+		return SR_ERR_IO;
+	if (memcmp(magic, SR_REMOTE_MAGIC, strlen(SR_REMOTE_MAGIC))) {
+		sr_err("Not a remote capture stream.");
+		return SR_ERR_DATA;
+	}
+	if (magic[strlen(SR_REMOTE_MAGIC)] != SR_REMOTE_VERSION) {
+		sr_err("Unsupported stream version %d.",
+			magic[strlen(SR_REMOTE_MAGIC)]);
+		return SR_ERR_DATA;
+	}
+
+	if (recv_all(devc, hdr, sizeof(hdr)) != SR_OK)
+		return SR_ERR_IO;
+	len = read_u32le(&hdr[2]);
+	if (hdr[0] != SR_REMOTE_DEVICE || hdr[1] || len > SR_REMOTE_MAX_RECORD) {
+		sr_err("Stream lacks the device description.");
+		return SR_ERR_DATA;
+	}
+	payload = g_malloc(len);
+	if ((ret = recv_all(devc, payload, len)) != SR_OK) {
+		g_free(payload);
+		return ret;
+	}
+
+	ret = SR_ERR_DATA;
+	p = payload;
+	end = payload + len;
+	if (end - p < 2)
+		goto out;
+	num_channels = read_u16le_inc(&p);
+	create = !sdi->channels;
+	if (!create && num_channels != g_slist_length(sdi->channels)) {
+		sr_err("The remote device's channels changed.");
+		goto out;
+	}
+	for (i = 0; i < num_channels; i++) {
+		if (end - p < 5)
+			goto out;
+		index = read_u16le_inc(&p);
+		analog = read_u8_inc(&p) == 1;
+		enabled = read_u8_inc(&p) != 0;
+		name_len = read_u8_inc(&p);
+		if ((size_t)(end - p) < name_len)
+			goto out;
+		name = g_strndup((const char *)p, name_len);
+		p += name_len;
+		if (create)
+			sr_channel_new(sdi, index, analog ? SR_CHANNEL_ANALOG
+				: SR_CHANNEL_LOGIC, enabled, name);
+		g_free(name);
+		if (!analog && enabled)
+			devc->has_logic = TRUE;
+	}
+	ret = SR_OK;
+
+out:
+	if (ret != SR_OK)
+		sr_err("Malformed device description.");
+	g_free(payload);
+
+	return ret;
+}
+
+static uint8_t *scratch_get(struct dev_context *devc, size_t size)
+{
+	if (size > devc->scratch_size) {
+		g_free(devc->scratch);
+		devc->scratch = g_malloc(size);
+		devc->scratch_size = size;
+	}
+
+	return devc->scratch;
+}
+
+/*
+ * Take the next entry of a meta packet. Returns FALSE for a malformed
+ * entry, *type is to be freed otherwise.
+ */
+static gboolean meta_entry_next(const uint8_t **p, const uint8_t *end,
+		uint32_t *key, char **type, const uint8_t **data, uint32_t *size)
+{
+	unsigned int type_len;
+
+	if (end - *p < 5)
+		return FALSE;
+	*key = read_u32le_inc(p);
+	type_len = read_u8_inc(p);
+	if ((size_t)(end - *p) < type_len + 4)
+		return FALSE;
+	*type = g_strndup((const char *)*p, type_len);
+	*p += type_len;
+	*size = read_u32le_inc(p);
+	if ((size_t)(end - *p) < *size
+			|| !g_variant_type_string_is_valid(*type)
+			|| !g_variant_type_is_definite(G_VARIANT_TYPE(*type))) {
+		g_free(*type);
+		return FALSE;
+	}
+	*data = *p;
+	*p += *size;
+
+	return TRUE;
+}
+
+static void handle_meta(const struct sr_dev_inst *sdi,
+		const uint8_t *p, const uint8_t *end)
+{
+	struct dev_context *devc;
+	struct sr_meta_batch batch;
+	GVariant *value, *tmp;
+	const uint8_t *entries, *src;
+	uint32_t key, size;
+	unsigned int i, count;
+	char *type;
+	void *data;
+
+	devc = sdi->priv;
+
+	if (end - p < 2)
+		return;
+	count = read_u16le_inc(&p);
+
+	/* Check all entries first, a malformed one rejects the packet. */
+	entries = p;
+	for (i = 0; i < count; i++) {
+		if (!meta_entry_next(&p, end, &key, &type, &src, &size)) {
+			sr_err("Malformed meta packet, ignoring it.");
+			return;
+		}
+		g_free(type);
+	}
+
+	p = entries;
+	sr_meta_batch_init(&batch, sdi);
+	for (i = 0; i < count; i++) {
+		meta_entry_next(&p, end, &key, &type, &src, &size);
+		data = g_malloc(size);
+		memcpy(data, src, size);
+		value = g_variant_new_from_data(G_VARIANT_TYPE(type),
+			data, size, FALSE, g_free, data);
+		g_free(type);
+		if (!value) {
+			sr_err("Cannot take meta value of key %u.", key);
+			continue;
+		}
+		value = g_variant_ref_sink(value);
+		if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+			tmp = g_variant_byteswap(value);
+			g_variant_unref(value);
+			value = tmp;
+		}
+		if (key == SR_CONF_SAMPLERATE
+				&& g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64))
+			devc->samplerate = g_variant_get_uint64(value);
+		sr_meta_batch_add(&batch, key, value);
+		g_variant_unref(value);
+	}
+	sr_meta_batch_send(&batch);
+}
+
+static void handle_logic(const struct sr_dev_inst *sdi,
+		const uint8_t *p, size_t len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	unsigned int unitsize;
+
+	devc = sdi->priv;
+
+	if (len < 1)
+		return;
+	unitsize = p[0];
+	if (!unitsize || (len - 1) % unitsize)
+		return;
+
+	logic.length = len - 1;
+	logic.unitsize = unitsize;
+	logic.data = (void *)(p + 1);
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	sr_session_send(sdi, &packet);
+	sr_sw_limits_update_samples_read(&devc->limits, logic.length / unitsize);
+}
+
+static void handle_analog(const struct sr_dev_inst *sdi,
+		const uint8_t *p, size_t len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	GSList *l;
+	uint32_t i, count, mq, unit;
+	uint64_t mqflags;
+	unsigned int index;
+	int digits;
+
+	devc = sdi->priv;
+
+	if (len < 23)
+		return;
+	index = read_u16le_inc(&p);
+	mq = read_u32le_inc(&p);
+	unit = read_u32le_inc(&p);
+	mqflags = read_u64le_inc(&p);
+	digits = (int8_t)read_u8_inc(&p);
+	count = read_u32le_inc(&p);
+	if ((len - 23) / sizeof(float) < count)
+		return;
+
+	ch = NULL;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG && ch->index == (int)index)
+			break;
+		ch = NULL;
+	}
+	if (!ch)
+		return;
+
+	if (count > devc->fbuf_size) {
+		g_free(devc->fbuf);
+		devc->fbuf = g_malloc(count * sizeof(float));
+		devc->fbuf_size = count;
+	}
+	for (i = 0; i < count; i++)
+		devc->fbuf[i] = read_fltle_inc(&p);
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
+	meaning.channels = g_slist_append(NULL, ch);
+	meaning.mq = mq;
+	meaning.unit = unit;
+	meaning.mqflags = mqflags;
+	analog.num_samples = count;
+	analog.data = devc->fbuf;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_session_send(sdi, &packet);
+	g_slist_free(meaning.channels);
+
+	/* Logic data carries the sample count, if there is any. */
+	if (!devc->has_logic)
+		sr_sw_limits_update_samples_read(&devc->limits, count);
+}
+
+/* Turn a record into a packet. Returns FALSE at the stream's end. */
+static gboolean handle_record(const struct sr_dev_inst *sdi, int type,
+		int flags, const uint8_t *data, size_t len)
+{
+	struct dev_context *devc;
+	lzo_uint raw_len;
+	uint8_t *raw;
+
+	devc = sdi->priv;
+
+	if (flags & SR_REMOTE_FLAG_LZO) {
+		if (len < 4)
+			return TRUE;
+		raw_len = read_u32le(data);
+		if (raw_len > SR_REMOTE_MAX_RECORD)
+			return TRUE;
+		raw = scratch_get(devc, raw_len);
+		if (lzo1x_decompress_safe(data + 4, len - 4, raw, &raw_len,
+				NULL) != LZO_E_OK || raw_len != read_u32le(data)) {
+			sr_warn("Dropping corrupt record.");
+			return TRUE;
+		}
+		data = raw;
+		len = raw_len;
+	}
+
+	switch (type) {
+	case SR_REMOTE_META:
+		handle_meta(sdi, data, data + len);
+		break;
+	case SR_REMOTE_LOGIC:
+		handle_logic(sdi, data, len);
+		break;
+	case SR_REMOTE_ANALOG:
+		handle_analog(sdi, data, len);
+		break;
+	case SR_REMOTE_TRIGGER:
+		std_session_send_df_trigger(sdi);
+		break;
+	case SR_REMOTE_FRAME_BEGIN:
+		std_session_send_df_frame_begin(sdi);
+		break;
+	case SR_REMOTE_FRAME_END:
+		std_session_send_df_frame_end(sdi);
+		break;
+	case SR_REMOTE_END:
+		return FALSE;
+	default:
+		/* The session sent its own header, newer records get skipped. */
+		break;
+	}
+
+	return TRUE;
+}
+
+/* Handle the complete records in buf, returns their size. */
+static size_t parse_records(const struct sr_dev_inst *sdi,
+		const uint8_t *buf, size_t len, gboolean *running)
+{
+	size_t pos;
+	uint32_t rec_len;
+
+	pos = 0;
+	while (*running && len - pos >= SR_REMOTE_RECORD_HEADER_SIZE) {
+		rec_len = read_u32le(&buf[pos + 2]);
+		if (rec_len > SR_REMOTE_MAX_RECORD) {
+			sr_err("Malformed remote stream.");
+			*running = FALSE;
+			break;
+		}
+		if (len - pos - SR_REMOTE_RECORD_HEADER_SIZE < rec_len)
+			break;
+		*running = handle_record(sdi, buf[pos], buf[pos + 1],
+			&buf[pos + SR_REMOTE_RECORD_HEADER_SIZE], rec_len);
+		pos += SR_REMOTE_RECORD_HEADER_SIZE + rec_len;
+	}
+
+	return pos;
+}
+
+SR_PRIV int remote_receive_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	size_t old, pos;
+	gboolean running;
+	int ret;
+
+	(void)fd;
+
+	if (!(sdi = cb_data) || !(devc = sdi->priv))
+		return TRUE;
+	if (!(revents & G_IO_IN))
+		return TRUE;
+
+	old = devc->rx->len;
+	g_byte_array_set_size(devc->rx, old + REMOTE_RECV_SIZE);
+	ret = recv(devc->socket, (void *)(devc->rx->data + old),
+		REMOTE_RECV_SIZE, 0);
+	g_byte_array_set_size(devc->rx, old + MAX(ret, 0));
+	if (ret < 0 && errno == EINTR)
+		return TRUE;
+	if (ret <= 0) {
+		if (ret)
+			sr_err("Receive error: %s", g_strerror(errno));
+		else
+			sr_info("The remote stream ended.");
+		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
+	running = TRUE;
+	pos = parse_records(sdi, devc->rx->data, devc->rx->len, &running);
+	g_byte_array_remove_range(devc->rx, 0, pos);
+
+	if (!running || sr_sw_limits_check(&devc->limits))
+		sr_dev_acquisition_stop(sdi);
+
+	return TRUE;
+}
+
+#ifdef HAVE_SYS_EVENTFD_H
+
+/* Turn ring writes into eventfd wakeups for the session. */
+static gpointer notify_thread(gpointer data)
+{
+	struct dev_context *devc;
+	uint64_t one;
+	uint32_t seen, head;
+
+	devc = data;
+	one = 1;
+
+	seen = sr_shm_ring_wait(devc->ring, 0, 0);
+	while (!g_atomic_int_get(&devc->notify_stop)) {
+		head = sr_shm_ring_wait(devc->ring, seen, 100);
+		if (head == seen && !sr_shm_ring_writer_done(devc->ring))
+			continue;
+		seen = head;
+		if (write(devc->event_fd, &one, sizeof(one)) < 0)
+			sr_spew("Cannot signal eventfd: %s", g_strerror(errno));
+		if (sr_shm_ring_writer_done(devc->ring))
+			break;
+	}
+
+	return NULL;
+}
+
+SR_PRIV int remote_shm_notify_start(struct dev_context *devc)
+{
+	uint64_t one;
+
+	devc->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (devc->event_fd < 0) {
+		sr_err("Cannot create eventfd: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	/* Handle what the writer sent ahead of the acquisition. */
+	one = 1;
+	if (write(devc->event_fd, &one, sizeof(one)) < 0)
+		sr_spew("Cannot signal eventfd: %s", g_strerror(errno));
+
+	g_atomic_int_set(&devc->notify_stop, 0);
+	devc->notify_thread = g_thread_new("remote-shm", notify_thread, devc);
+
+	return SR_OK;
+}
+
+SR_PRIV void remote_shm_notify_stop(struct dev_context *devc)
+{
+	if (devc->notify_thread) {
+		g_atomic_int_set(&devc->notify_stop, 1);
+		g_thread_join(devc->notify_thread);
+		devc->notify_thread = NULL;
+	}
+	if (devc->event_fd >= 0) {
+		close(devc->event_fd);
+		devc->event_fd = -1;
+	}
+}
+
+#else
+
+SR_PRIV int remote_shm_notify_start(struct dev_context *devc)
+{
+	(void)devc;
+
+	sr_err("Shared memory streams need eventfd support.");
+
+	return SR_ERR_NA;
+}
+
+SR_PRIV void remote_shm_notify_stop(struct dev_context *devc)
+{
+	(void)devc;
+}
+
+#endif
+
+SR_PRIV int remote_shm_receive_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	const uint8_t *data;
+	uint64_t count;
+	size_t len, pos;
+	gboolean running;
+
+	(void)fd;
+
+	if (!(sdi = cb_data) || !(devc = sdi->priv))
+		return TRUE;
+
+	if ((revents & G_IO_IN)
+			&& read(devc->event_fd, &count, sizeof(count)) < 0)
+		sr_spew("Cannot read eventfd: %s", g_strerror(errno));
+
+	/* The packets point into the ring, release it after sending them. */
+	running = TRUE;
+	len = sr_shm_ring_peek(devc->ring, &data);
+	pos = parse_records(sdi, data, len, &running);
+	sr_shm_ring_consume(devc->ring, pos);
+
+	if (running && sr_shm_ring_writer_done(devc->ring) && pos == len) {
+		sr_info("The remote stream ended.");
+		running = FALSE;
+	}
+	if (!running || sr_sw_limits_check(&devc->limits))
+		sr_dev_acquisition_stop(sdi);
+
+	return TRUE;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_HARDWARE_REMOTE_PROTOCOL_H
+#define LIBSIGROK_HARDWARE_REMOTE_PROTOCOL_H
+
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "remote"
+
+/* Bytes to receive per callback. */
+#define REMOTE_RECV_SIZE (256 * 1024)
+/* Timeout for the stream's start while scanning, in ms. */
+#define REMOTE_SCAN_TIMEOUT 3000
+
+struct dev_context {
+	char *address;
+	char *port;
+	int socket;
+	/* Shared memory transport, instead of TCP. */
+	char *shm_name;
+	struct sr_shm_ring *ring;
+	int event_fd;
+	GThread *notify_thread;
+	int notify_stop;
+	struct sr_sw_limits limits;
+	uint64_t samplerate;
+	/* Analog samples count towards the limit without logic channels. */
+	gboolean has_logic;
+	/* Received data which doesn't form a complete record yet. */
+	GByteArray *rx;
+	/* Decompressed payloads, and aligned analog samples. */
+	uint8_t *scratch;
+	size_t scratch_size;
+	float *fbuf;
+	size_t fbuf_size;
+};
+
+SR_PRIV int remote_connect(struct dev_context *devc);
+SR_PRIV gboolean remote_connected(const struct dev_context *devc);
+SR_PRIV void remote_disconnect(struct dev_context *devc);
+SR_PRIV int remote_read_device(struct dev_context *devc,
+		struct sr_dev_inst *sdi);
+SR_PRIV int remote_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV int remote_shm_notify_start(struct dev_context *devc);
+SR_PRIV void remote_shm_notify_stop(struct dev_context *devc);
+SR_PRIV int remote_shm_receive_data(int fd, int revents, void *cb_data);
+
+#endif
@@ -26,6 +26,7 @@ static struct sr_dev_driver rigol_dg_driver_info;
 
 static const uint32_t scanopts[] = {
 	SR_CONF_CONN,
+	SR_CONF_SERIALCOMM,
 };
 
 static const uint32_t drvopts[] = {
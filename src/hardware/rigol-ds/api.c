@@ -157,6 +157,7 @@ static const char *data_sources[] = {
 	"Live",
 	"Memory",
 	"Segmented",
+	"Record",
 };
 
 static const struct rigol_ds_command std_cmd[] = {
@@ -497,6 +498,7 @@ static int analog_frame_size(const struct sr_dev_inst *sdi)
 		return devc->model->series->live_samples;
 	case DATA_SOURCE_MEMORY:
 	case DATA_SOURCE_SEGMENTED:
+	case DATA_SOURCE_RECORD:
 		return devc->model->series->buffer_samples / analog_channels;
 	default:
 		return 0;
@@ -512,6 +514,7 @@ static int digital_frame_size(const struct sr_dev_inst *sdi)
 		return devc->model->series->live_samples * 2;
 	case DATA_SOURCE_MEMORY:
 	case DATA_SOURCE_SEGMENTED:
+	case DATA_SOURCE_RECORD:
 		return devc->model->series->buffer_samples * 2;
 	default:
 		return 0;
@@ -563,8 +566,10 @@ static int config_get(uint32_t key, GVariant **data,
 			*data = g_variant_new_string("Live");
 		else if (devc->data_source == DATA_SOURCE_MEMORY)
 			*data = g_variant_new_string("Memory");
-		else
+		else if (devc->data_source == DATA_SOURCE_SEGMENTED)
 			*data = g_variant_new_string("Segmented");
+		else
+			*data = g_variant_new_string("Record");
 		break;
 	case SR_CONF_LIMIT_FRAMES:
 		*data = g_variant_new_uint64(devc->limit_frames);
@@ -773,6 +778,10 @@ static int config_set(uint32_t key, GVariant *data,
 		else if (devc->model->series->protocol >= PROTOCOL_V3
 			 && !strcmp(tmp_str, "Segmented"))
 			devc->data_source = DATA_SOURCE_SEGMENTED;
+		else if ((devc->model->series->protocol == PROTOCOL_V3 ||
+			  devc->model->series->protocol == PROTOCOL_V4)
+			 && !strcmp(tmp_str, "Record"))
+			devc->data_source = DATA_SOURCE_RECORD;
 		else {
 			sr_err("Unknown data source: '%s'.", tmp_str);
 			return SR_ERR;
@@ -850,14 +859,18 @@ static int config_list(uint32_t key, GVariant **data,
 			return SR_ERR_ARG;
 		switch (devc->model->series->protocol) {
 		case PROTOCOL_V1:
-			*data = g_variant_new_strv(data_sources, ARRAY_SIZE(data_sources) - 2);
+			*data = g_variant_new_strv(data_sources, ARRAY_SIZE(data_sources) - 3);
 			break;
 		case PROTOCOL_V2:
-			*data = g_variant_new_strv(data_sources, ARRAY_SIZE(data_sources) - 1);
+			*data = g_variant_new_strv(data_sources, ARRAY_SIZE(data_sources) - 2);
 			break;
-		default:
+		case PROTOCOL_V3:
+		case PROTOCOL_V4:
 			*data = g_variant_new_strv(ARRAY_AND_SIZE(data_sources));
 			break;
+		default:
+			*data = g_variant_new_strv(data_sources, ARRAY_SIZE(data_sources) - 1);
+			break;
 		}
 		break;
 	default:
@@ -884,6 +897,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->num_frames = 0;
 	devc->num_frames_segmented = 0;
+	devc->recording = FALSE;
 
 	some_digital = FALSE;
 	for (l = sdi->channels; l; l = l->next) {
@@ -956,15 +970,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		case PROTOCOL_V3:
 		case PROTOCOL_V4:
 		{
-			int frames = 0;
-			if (sr_scpi_get_int(sdi->conn,
-						protocol == PROTOCOL_V4 ? "FUNC:WREP:FEND?" :
-						"FUNC:WREP:FMAX?", &frames) != SR_OK)
-				return SR_ERR;
-			if (frames <= 0) {
-				sr_err("No segmented data available");
+			int frames;
+			if (rigol_ds_get_recorded_frames(sdi, &frames) != SR_OK)
 				return SR_ERR;
-			}
 			devc->num_frames_segmented = frames;
 			break;
 		}
@@ -1010,6 +1018,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 50,
 			rigol_ds_receive, (void *)sdi);
+	/* Don't hold up faster devices of the session (not for USBTMC). */
+	(void)sr_session_source_set_priority(sdi->session, sdi, G_PRIORITY_LOW);
 
 	std_session_send_df_header(sdi);
 
@@ -1036,6 +1046,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		devc->sample_rate = 1. / xinc;
 	}
 
+	/* Recorded segments get read when the recording has ended. */
+	if (devc->data_source == DATA_SOURCE_RECORD)
+		return rigol_ds_record_start(sdi);
+
 	if (rigol_ds_capture_start(sdi) != SR_OK)
 		return SR_ERR;
 
@@ -1052,6 +1066,12 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	devc = sdi->priv;
 
+	/* Don't leave the instrument recording when stopped early. */
+	if (devc->recording) {
+		rigol_ds_config_set(sdi, "FUNC:WREC:OPER STOP");
+		devc->recording = FALSE;
+	}
+
 	std_session_send_df_end(sdi);
 
 	g_slist_free(devc->enabled_channels);
@@ -26,7 +26,6 @@
 #include <errno.h>
 #include <string.h>
 #include <math.h>
-#include <ctype.h>
 #include <time.h>
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
@@ -98,23 +97,59 @@ static void rigol_ds_set_wait_event(struct dev_context *devc, enum wait_events e
 	else
 		devc->wait_status = 1;
 	devc->wait_event = event;
+	devc->wait_start = 0;
+	devc->wait_next = 0;
 }
 
 /*
- * Waiting for a event will return a timeout after 2 to 3 seconds in order
+ * The waits below don't sleep or spin in the session's main loop, which
+ * would delay other devices' sources. Each call does at most one status
+ * query, and returns SR_ERR_NA when rigol_ds_receive() should try again
+ * with its next invocation.
+ */
+
+/* Check whether a wait's delay has passed, start the delay when not set. */
+static gboolean rigol_ds_wait_delay(struct dev_context *devc, int64_t delay_us)
+{
+	int64_t now;
+
+	now = g_get_monotonic_time();
+	if (!devc->wait_next)
+		devc->wait_next = now + delay_us;
+	if (now < devc->wait_next)
+		return FALSE;
+	devc->wait_next = 0;
+
+	return TRUE;
+}
+
+/* Check whether a wait exceeded 3 seconds, start the wait when not set. */
+static gboolean rigol_ds_wait_timeout(struct dev_context *devc)
+{
+	int64_t now;
+
+	now = g_get_monotonic_time();
+	if (!devc->wait_start)
+		devc->wait_start = now;
+	if (now - devc->wait_start < 3 * G_USEC_PER_SEC)
+		return FALSE;
+	devc->wait_start = 0;
+
+	return TRUE;
+}
+
+/*
+ * Waiting for a event will return a timeout after 3 seconds in order
  * to not block the application.
  */
 static int rigol_ds_event_wait(const struct sr_dev_inst *sdi, char status1, char status2)
 {
 	char *buf, c;
 	struct dev_context *devc;
-	time_t start;
 
 	if (!(devc = sdi->priv))
 		return SR_ERR;
 
-	start = time(NULL);
-
 	/*
 	 * Trigger status may return:
 	 * "TD" or "T'D" - triggered
@@ -124,36 +159,26 @@ static int rigol_ds_event_wait(const struct sr_dev_inst *sdi, char status1, char
 	 * "STOP"        - stopped
 	 */
 
-	if (devc->wait_status == 1) {
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for trigger");
-				return SR_ERR_TIMEOUT;
-			}
-
-			if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-			c = buf[0];
-			g_free(buf);
-		} while (c == status1 || c == status2);
-
-		devc->wait_status = 2;
+	if (rigol_ds_wait_timeout(devc)) {
+		sr_dbg("Timeout waiting for trigger");
+		return SR_ERR_TIMEOUT;
 	}
-	if (devc->wait_status == 2) {
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for trigger");
-				return SR_ERR_TIMEOUT;
-			}
 
-			if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-			c = buf[0];
-			g_free(buf);
-		} while (c != status1 && c != status2);
+	if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
+		return SR_ERR;
+	c = buf[0];
+	g_free(buf);
 
-		rigol_ds_set_wait_event(devc, WAIT_NONE);
+	/* First wait for the status to leave, then to return. */
+	if (devc->wait_status == 1) {
+		if (c == status1 || c == status2)
+			return SR_ERR_NA;
+		devc->wait_status = 2;
+		return SR_ERR_NA;
 	}
+	if (c != status1 && c != status2)
+		return SR_ERR_NA;
+	rigol_ds_set_wait_event(devc, WAIT_NONE);
 
 	return SR_OK;
 }
@@ -193,8 +218,10 @@ static int rigol_ds_trigger_wait(const struct sr_dev_inst *sdi)
 			 */
 			s = (devc->timebase * devc->model->series->num_horizontal_divs
 			     * 85e6) / 100L;
-			sr_spew("Sleeping for %ld usecs instead of trigger-wait", s);
-			g_usleep(s);
+			if (!devc->wait_next)
+				sr_spew("Waiting %ld usecs instead of trigger-wait", s);
+			if (!rigol_ds_wait_delay(devc, s))
+				return SR_ERR_NA;
 		}
 		rigol_ds_set_wait_event(devc, WAIT_NONE);
 		return SR_OK;
@@ -269,39 +296,37 @@ static int rigol_ds_block_wait(const struct sr_dev_inst *sdi)
 {
 	char *buf, c;
 	struct dev_context *devc;
-	time_t start;
 	int len, ret;
 
 	if (!(devc = sdi->priv))
 		return SR_ERR;
 
 	if (devc->model->series->protocol == PROTOCOL_V3) {
+		if (rigol_ds_wait_timeout(devc)) {
+			sr_dbg("Timeout waiting for data block");
+			return SR_ERR_TIMEOUT;
+		}
 
-		start = time(NULL);
-
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for data block");
-				return SR_ERR_TIMEOUT;
-			}
-
-			/*
-			 * The scope copies data really slowly from sample
-			 * memory to its output buffer, so try not to bother
-			 * it too much with SCPI requests but don't wait too
-			 * long for short sample frame sizes.
-			 */
-			g_usleep(devc->analog_frame_size < (15 * 1000) ? (100 * 1000) : (1000 * 1000));
+		/*
+		 * The scope copies data really slowly from sample
+		 * memory to its output buffer, so try not to bother
+		 * it too much with SCPI requests but don't wait too
+		 * long for short sample frame sizes.
+		 */
+		if (!rigol_ds_wait_delay(devc, devc->analog_frame_size < (15 * 1000) ?
+				(100 * 1000) : (1000 * 1000)))
+			return SR_ERR_NA;
 
-			/* "READ,nnnn" (still working) or "IDLE,nnnn" (finished) */
-			if (sr_scpi_get_string(sdi->conn, ":WAV:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-			ret = parse_int(buf + 5, &len);
-			c = buf[0];
-			g_free(buf);
-			if (ret != SR_OK)
-				return SR_ERR;
-		} while (c == 'R' && len < (1000 * 1000));
+		/* "READ,nnnn" (still working) or "IDLE,nnnn" (finished) */
+		if (sr_scpi_get_string(sdi->conn, ":WAV:STAT?", &buf) != SR_OK)
+			return SR_ERR;
+		ret = parse_int(buf + 5, &len);
+		c = buf[0];
+		g_free(buf);
+		if (ret != SR_OK)
+			return SR_ERR;
+		if (c == 'R' && len < (1000 * 1000))
+			return SR_ERR_NA;
 	}
 
 	rigol_ds_set_wait_event(devc, WAIT_NONE);
@@ -333,6 +358,74 @@ SR_PRIV int rigol_ds_config_set(const struct sr_dev_inst *sdi, const char *forma
 	}
 }
 
+/* Get the number of frames which the instrument has recorded. */
+SR_PRIV int rigol_ds_get_recorded_frames(const struct sr_dev_inst *sdi, int *frames)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	*frames = 0;
+	if (sr_scpi_get_int(sdi->conn,
+			devc->model->series->protocol == PROTOCOL_V4 ?
+			"FUNC:WREP:FEND?" : "FUNC:WREP:FMAX?", frames) != SR_OK)
+		return SR_ERR;
+	if (*frames <= 0) {
+		sr_err("No segmented data available");
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Have the instrument record the frame limit's number of segments, or
+ * as many as it can hold. They get read when the recording has ended.
+ */
+SR_PRIV int rigol_ds_record_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int frames;
+
+	devc = sdi->priv;
+
+	if (sr_scpi_get_int(sdi->conn, "FUNC:WREC:FMAX?", &frames) != SR_OK)
+		return SR_ERR;
+	if (frames <= 0) {
+		sr_err("Cannot record segments at the current settings");
+		return SR_ERR;
+	}
+	if (devc->limit_frames && devc->limit_frames < (uint64_t)frames)
+		frames = devc->limit_frames;
+
+	sr_dbg("Recording %d segments", frames);
+	if (rigol_ds_config_set(sdi, "FUNC:WREC:ENAB ON") != SR_OK)
+		return SR_ERR;
+	if (rigol_ds_config_set(sdi, "FUNC:WREC:FEND %d", frames) != SR_OK)
+		return SR_ERR;
+	if (rigol_ds_config_set(sdi, ":RUN") != SR_OK)
+		return SR_ERR;
+	if (rigol_ds_config_set(sdi, "FUNC:WREC:OPER RUN") != SR_OK)
+		return SR_ERR;
+	devc->recording = TRUE;
+
+	return SR_OK;
+}
+
+/* Check whether the instrument is done recording segments. */
+static int rigol_ds_record_wait(const struct sr_dev_inst *sdi)
+{
+	char *buf;
+	int ret;
+
+	if (sr_scpi_get_string(sdi->conn, "FUNC:WREC:OPER?", &buf) != SR_OK)
+		return SR_ERR;
+	ret = g_ascii_strncasecmp(buf, "STOP", 4) ? SR_ERR : SR_OK;
+	g_free(buf);
+
+	return ret;
+}
+
 /* Start capturing a new frameset */
 SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi)
 {
@@ -442,7 +535,8 @@ SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi)
 			if (devc->data_source == DATA_SOURCE_LIVE && rigol_ds_config_set(sdi, ":SINGL") != SR_OK)
 				return SR_ERR;
 			rigol_ds_set_wait_event(devc, WAIT_STOP);
-			if (devc->data_source == DATA_SOURCE_SEGMENTED &&
+			if ((devc->data_source == DATA_SOURCE_SEGMENTED ||
+					devc->data_source == DATA_SOURCE_RECORD) &&
 					devc->model->series->protocol <= PROTOCOL_V4)
 				if (rigol_ds_config_set(sdi, "FUNC:WREP:FCUR %d", devc->num_frames + 1) != SR_OK)
 					return SR_ERR;
@@ -544,6 +638,7 @@ SR_PRIV int rigol_ds_channel_start(const struct sr_dev_inst *sdi)
 	devc->num_channel_bytes = 0;
 	devc->num_header_bytes = 0;
 	devc->num_block_bytes = 0;
+	devc->block_requested = FALSE;
 
 	return SR_OK;
 }
@@ -554,55 +649,67 @@ static int rigol_ds_read_header(struct sr_dev_inst *sdi)
 	struct sr_scpi_dev_inst *scpi = sdi->conn;
 	struct dev_context *devc = sdi->priv;
 	char *buf = (char *) devc->buffer;
-	size_t header_length;
+	size_t header_length, data_length;
 	int ret;
 
-	/* Try to read the hashsign and length digit. */
-	if (devc->num_header_bytes < 2) {
-		ret = sr_scpi_read_data(scpi, buf + devc->num_header_bytes,
-				2 - devc->num_header_bytes);
+	/*
+	 * Read just the missing header bytes, so that the data bytes can
+	 * go straight to the sample buffer.
+	 */
+	while ((ret = sr_scpi_parse_block_header(buf, devc->num_header_bytes,
+			&header_length, &data_length)) > 0) {
+		ret = sr_scpi_read_data(scpi, buf + devc->num_header_bytes, ret);
 		if (ret < 0) {
 			sr_err("Read error while reading data header.");
 			return SR_ERR;
 		}
+		if (ret == 0)
+			/* Still waiting for the rest of the header. */
+			return 0;
 		devc->num_header_bytes += ret;
 	}
 
-	if (devc->num_header_bytes < 2)
-		return 0;
-
-	if (buf[0] != '#' || !isdigit(buf[1]) || buf[1] == '0') {
-		sr_err("Received invalid data block header '%c%c'.", buf[0], buf[1]);
+	if (ret != SR_OK || data_length == 0 || data_length > INT_MAX) {
+		sr_err("Received invalid data block header '%.*s'.",
+			(int)devc->num_header_bytes, buf);
 		return SR_ERR;
 	}
 
-	header_length = 2 + buf[1] - '0';
+	sr_dbg("Received data block header: '%.*s' -> block length %zu",
+		(int)header_length, buf, data_length);
 
-	/* Try to read the length. */
-	if (devc->num_header_bytes < header_length) {
-		ret = sr_scpi_read_data(scpi, buf + devc->num_header_bytes,
-				header_length - devc->num_header_bytes);
-		if (ret < 0) {
-			sr_err("Read error while reading data header.");
-			return SR_ERR;
-		}
-		devc->num_header_bytes += ret;
-	}
+	return data_length;
+}
 
-	if (devc->num_header_bytes < header_length)
-		return 0;
+/* Ask for the next data block of the current channel. */
+static int rigol_ds_request_block(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	const gboolean first_frame = (devc->num_frames == 0);
 
-	/* Read the data length. */
-	buf[header_length] = '\0';
+	if (devc->model->series->protocol >= PROTOCOL_V4) {
+		if (first_frame && rigol_ds_config_set(sdi, ":WAV:START %d",
+				devc->num_channel_bytes + 1) != SR_OK)
+			return SR_ERR;
+		if (first_frame && rigol_ds_config_set(sdi, ":WAV:STOP %d",
+				MIN(devc->num_channel_bytes + ACQ_BLOCK_SIZE,
+					devc->analog_frame_size)) != SR_OK)
+			return SR_ERR;
+	}
 
-	if (parse_int(buf + 2, &ret) != SR_OK) {
-		sr_err("Received invalid data block length '%s'.", buf + 2);
-		return -1;
+	if (devc->model->series->protocol >= PROTOCOL_V3) {
+		if (rigol_ds_config_set(sdi, ":WAV:BEG") != SR_OK)
+			return SR_ERR;
+		if (sr_scpi_send(sdi->conn, ":WAV:DATA?") != SR_OK)
+			return SR_ERR;
 	}
 
-	sr_dbg("Received data block header: '%s' -> block length %d", buf, ret);
+	if (sr_scpi_read_begin(sdi->conn) != SR_OK)
+		return SR_ERR;
+
+	devc->block_requested = TRUE;
 
-	return ret;
+	return SR_OK;
 }
 
 SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
@@ -617,9 +724,11 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	struct sr_analog_spec spec;
 	struct sr_datafeed_logic logic;
 	double vdiv, offset, origin;
-	int len, i, vref;
+	int len, i, vref, frames;
 	struct sr_channel *ch;
 	gsize expected_data_bytes;
+	gboolean channel_done, next_channel;
+	char linefeed;
 
 	(void)fd;
 
@@ -634,7 +743,20 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	if (!(revents == G_IO_IN || revents == 0))
 		return TRUE;
 
-	const gboolean first_frame = (devc->num_frames == 0);
+	/* Read the recorded segments once the instrument has all of them. */
+	if (devc->recording) {
+		if (rigol_ds_record_wait(sdi) != SR_OK)
+			return TRUE;
+		devc->recording = FALSE;
+		if (rigol_ds_get_recorded_frames(sdi, &frames) != SR_OK ||
+				rigol_ds_capture_start(sdi) != SR_OK) {
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
+		devc->num_frames_segmented = frames;
+		std_session_send_df_frame_begin(sdi);
+		return TRUE;
+	}
 
 	switch (devc->wait_event) {
 	case WAIT_NONE:
@@ -668,24 +790,7 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 			devc->analog_frame_size : devc->digital_frame_size;
 
 	if (devc->num_block_bytes == 0) {
-		if (devc->model->series->protocol >= PROTOCOL_V4) {
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:START %d",
-					devc->num_channel_bytes + 1) != SR_OK)
-				return TRUE;
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:STOP %d",
-					MIN(devc->num_channel_bytes + ACQ_BLOCK_SIZE,
-						devc->analog_frame_size)) != SR_OK)
-				return TRUE;
-		}
-
-		if (devc->model->series->protocol >= PROTOCOL_V3) {
-			if (rigol_ds_config_set(sdi, ":WAV:BEG") != SR_OK)
-				return TRUE;
-			if (sr_scpi_send(sdi->conn, ":WAV:DATA?") != SR_OK)
-				return TRUE;
-		}
-
-		if (sr_scpi_read_begin(scpi) != SR_OK)
+		if (!devc->block_requested && rigol_ds_request_block(sdi) != SR_OK)
 			return TRUE;
 
 		if (devc->format == FORMAT_IEEE488_2) {
@@ -700,6 +805,7 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 				sr_dev_acquisition_stop(sdi);
 				return TRUE;
 			}
+			devc->block_requested = FALSE;
 			/* At slow timebases in live capture the DS2072 and
 			 * DS1054Z sometimes return "short" data blocks, with
 			 * apparently no way to get the rest of the data.
@@ -715,6 +821,7 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 			}
 			devc->num_block_bytes = len;
 		} else {
+			devc->block_requested = FALSE;
 			devc->num_block_bytes = expected_data_bytes;
 		}
 		devc->num_block_read = 0;
@@ -738,6 +845,61 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 
 	devc->num_block_read += len;
 
+	if (devc->num_block_read == devc->num_block_bytes) {
+		sr_dbg("Block has been completed");
+		if (devc->model->series->protocol >= PROTOCOL_V3) {
+			/* Discard the terminating linefeed */
+			sr_scpi_read_data(scpi, &linefeed, 1);
+		}
+		if (devc->format == FORMAT_IEEE488_2) {
+			/* Prepare for possible next block */
+			devc->num_header_bytes = 0;
+			devc->num_block_bytes = 0;
+			if (devc->data_source != DATA_SOURCE_LIVE)
+				rigol_ds_set_wait_event(devc, WAIT_BLOCK);
+		}
+		if (!sr_scpi_read_complete(scpi) && !devc->channel_entry->next) {
+			sr_err("Read should have been completed");
+		}
+		devc->num_block_read = 0;
+	} else {
+		sr_dbg("%" PRIu64 " of %" PRIu64 " block bytes read",
+			devc->num_block_read, devc->num_block_bytes);
+	}
+
+	devc->num_channel_bytes += len;
+	channel_done = devc->num_channel_bytes >= expected_data_bytes;
+	next_channel = channel_done && devc->channel_entry->next;
+
+	if (channel_done && devc->model->series->protocol == PROTOCOL_V3) {
+		/* Signal end of data download to scope */
+		if (devc->data_source != DATA_SOURCE_LIVE)
+			/*
+			 * This causes a query error, without it switching
+			 * to the next channel causes an error. Fun with
+			 * firmware...
+			 */
+			rigol_ds_config_set(sdi, ":WAV:END");
+	}
+
+	if (next_channel) {
+		/*
+		 * We got the frame for this channel, now get the next channel.
+		 * The response was read completely, so the next channel can be
+		 * requested before this block gets converted and sent. The
+		 * scope prepares its data in the meantime. Scopes which poll
+		 * the waveform status before each block can't do this.
+		 */
+		devc->channel_entry = devc->channel_entry->next;
+		rigol_ds_channel_start(sdi);
+		if (devc->model->series->protocol >= PROTOCOL_V4 &&
+				devc->wait_event == WAIT_BLOCK) {
+			rigol_ds_set_wait_event(devc, WAIT_NONE);
+			if (rigol_ds_request_block(sdi) != SR_OK)
+				rigol_ds_set_wait_event(devc, WAIT_BLOCK);
+		}
+	}
+
 	if (ch->type == SR_CHANNEL_ANALOG) {
 		vref = devc->vert_reference[ch->index];
 		vdiv = devc->vert_inc[ch->index];
@@ -774,51 +936,11 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 		sr_session_send(sdi, &packet);
 	}
 
-	if (devc->num_block_read == devc->num_block_bytes) {
-		sr_dbg("Block has been completed");
-		if (devc->model->series->protocol >= PROTOCOL_V3) {
-			/* Discard the terminating linefeed */
-			sr_scpi_read_data(scpi, (char *)devc->buffer, 1);
-		}
-		if (devc->format == FORMAT_IEEE488_2) {
-			/* Prepare for possible next block */
-			devc->num_header_bytes = 0;
-			devc->num_block_bytes = 0;
-			if (devc->data_source != DATA_SOURCE_LIVE)
-				rigol_ds_set_wait_event(devc, WAIT_BLOCK);
-		}
-		if (!sr_scpi_read_complete(scpi) && !devc->channel_entry->next) {
-			sr_err("Read should have been completed");
-		}
-		devc->num_block_read = 0;
-	} else {
-		sr_dbg("%" PRIu64 " of %" PRIu64 " block bytes read",
-			devc->num_block_read, devc->num_block_bytes);
-	}
-
-	devc->num_channel_bytes += len;
-
-	if (devc->num_channel_bytes < expected_data_bytes)
+	if (!channel_done)
 		/* Don't have the full data for this channel yet, re-run. */
 		return TRUE;
 
-	/* End of data for this channel. */
-	if (devc->model->series->protocol == PROTOCOL_V3) {
-		/* Signal end of data download to scope */
-		if (devc->data_source != DATA_SOURCE_LIVE)
-			/*
-			 * This causes a query error, without it switching
-			 * to the next channel causes an error. Fun with
-			 * firmware...
-			 */
-			rigol_ds_config_set(sdi, ":WAV:END");
-	}
-
-	if (devc->channel_entry->next) {
-		/* We got the frame for this channel, now get the next channel. */
-		devc->channel_entry = devc->channel_entry->next;
-		rigol_ds_channel_start(sdi);
-	} else {
+	if (!next_channel) {
 		/* Done with this frame. */
 		std_session_send_df_frame_end(sdi);
 
@@ -856,23 +978,78 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
+/*
+ * Query batches for the device configuration. Scopes before the DS2000
+ * series get their queries one by one.
+ */
+static struct sr_scpi_batch *rigol_ds_batch_new(const struct dev_context *devc)
+{
+	return sr_scpi_batch_new(devc->model->series->protocol >= PROTOCOL_V3 ?
+		BATCH_MAX_LEN : 0);
+}
+
 SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct sr_channel *ch;
-	char *cmd;
+	struct sr_scpi_batch *batch;
 	unsigned int i;
+	unsigned int q_analog, q_la, q_digital, q_timebase, q_probe, q_coupling;
+	unsigned int q_trig_source, q_triggerpos, q_trig_slope, q_trig_level;
+	char *response;
 	int res;
 
 	devc = sdi->priv;
 
+	/* Send all queries at once, then pick up the responses. */
+	batch = rigol_ds_batch_new(devc);
+	q_analog = q_la = q_digital = 0;
+	for (i = 0; i < devc->model->analog_channels; i++) {
+		res = sr_scpi_batch_add(batch, ":CHAN%d:DISP?", i + 1);
+		if (i == 0)
+			q_analog = res;
+	}
+	if (devc->model->has_digital) {
+		q_la = sr_scpi_batch_add(batch, "%s",
+			devc->model->series->protocol >= PROTOCOL_V3 ?
+				":LA:STAT?" : ":LA:DISP?");
+		for (i = 0; i < ARRAY_SIZE(devc->digital_channels); i++) {
+			if (devc->model->series->protocol >= PROTOCOL_V5)
+				res = sr_scpi_batch_add(batch, ":LA:DISP? D%d", i);
+			else if (devc->model->series->protocol >= PROTOCOL_V3)
+				res = sr_scpi_batch_add(batch, ":LA:DIG%d:DISP?", i);
+			else
+				res = sr_scpi_batch_add(batch, ":DIG%d:TURN?", i);
+			if (i == 0)
+				q_digital = res;
+		}
+	}
+	q_timebase = sr_scpi_batch_add(batch, ":TIM:SCAL?");
+	q_probe = q_coupling = 0;
+	for (i = 0; i < devc->model->analog_channels; i++) {
+		res = sr_scpi_batch_add(batch, ":CHAN%d:PROB?", i + 1);
+		if (i == 0)
+			q_probe = res;
+	}
+	for (i = 0; i < devc->model->analog_channels; i++) {
+		res = sr_scpi_batch_add(batch, ":CHAN%d:COUP?", i + 1);
+		if (i == 0)
+			q_coupling = res;
+	}
+	q_trig_source = sr_scpi_batch_add(batch, ":TRIG:EDGE:SOUR?");
+	q_triggerpos = sr_scpi_batch_add(batch, "%s",
+		devc->model->cmds[CMD_GET_HORIZ_TRIGGERPOS].str);
+	q_trig_slope = sr_scpi_batch_add(batch, ":TRIG:EDGE:SLOP?");
+	q_trig_level = sr_scpi_batch_add(batch, ":TRIG:EDGE:LEV?");
+
+	if (sr_scpi_batch_run(sdi->conn, batch) != SR_OK)
+		goto fail;
+
 	/* Analog channel state. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:DISP?", i + 1);
-		res = sr_scpi_get_bool(sdi->conn, cmd, &devc->analog_channels[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_bool(batch, q_analog + i,
+				&devc->analog_channels[i]) != SR_OK)
+			goto fail;
 		ch = g_slist_nth_data(sdi->channels, i);
 		ch->enabled = devc->analog_channels[i];
 	}
@@ -882,24 +1059,14 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 
 	/* Digital channel state. */
 	if (devc->model->has_digital) {
-		if (sr_scpi_get_bool(sdi->conn,
-				devc->model->series->protocol >= PROTOCOL_V3 ?
-					":LA:STAT?" : ":LA:DISP?",
-				&devc->la_enabled) != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_bool(batch, q_la, &devc->la_enabled) != SR_OK)
+			goto fail;
 		sr_dbg("Logic analyzer %s, current digital channel state:",
 				devc->la_enabled ? "enabled" : "disabled");
 		for (i = 0; i < ARRAY_SIZE(devc->digital_channels); i++) {
-			if (devc->model->series->protocol >= PROTOCOL_V5)
-				cmd = g_strdup_printf(":LA:DISP? D%d", i);
-			else if (devc->model->series->protocol >= PROTOCOL_V3)
-				cmd = g_strdup_printf(":LA:DIG%d:DISP?", i);
-			else
-				cmd = g_strdup_printf(":DIG%d:TURN?", i);
-			res = sr_scpi_get_bool(sdi->conn, cmd, &devc->digital_channels[i]);
-			g_free(cmd);
-			if (res != SR_OK)
-				return SR_ERR;
+			if (sr_scpi_batch_get_bool(batch, q_digital + i,
+					&devc->digital_channels[i]) != SR_OK)
+				goto fail;
 			ch = g_slist_nth_data(sdi->channels, i + devc->model->analog_channels);
 			ch->enabled = devc->digital_channels[i];
 			sr_dbg("D%d: %s", i, devc->digital_channels[i] ? "on" : "off");
@@ -907,113 +1074,117 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 	}
 
 	/* Timebase. */
-	if (sr_scpi_get_float(sdi->conn, ":TIM:SCAL?", &devc->timebase) != SR_OK)
-		return SR_ERR;
+	if (sr_scpi_batch_get_float(batch, q_timebase, &devc->timebase) != SR_OK)
+		goto fail;
 	sr_dbg("Current timebase %g", devc->timebase);
 
 	/* Probe attenuation. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:PROB?", i + 1);
-
 		/* DSO1000B series prints an X after the probe factor, so
 		 * we get a string and check for that instead of only handling
 		 * floats. */
-		char *response;
-		res = sr_scpi_get_string(sdi->conn, cmd, &response);
-		if (res != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_string(batch, q_probe + i, &response) != SR_OK)
+			goto fail;
 
 		int len = strlen(response);
-		if (response[len-1] == 'X')
+		if (len && response[len-1] == 'X')
 			response[len-1] = 0;
 
 		res = sr_atof_ascii(response, &devc->attenuation[i]);
 		g_free(response);
-		g_free(cmd);
 		if (res != SR_OK)
-			return SR_ERR;
+			goto fail;
 	}
 	sr_dbg("Current probe attenuation:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->attenuation[i]);
 
-	/* Vertical gain and offset. */
-	if (rigol_ds_get_dev_cfg_vertical(sdi) != SR_OK)
-		return SR_ERR;
-
 	/* Coupling. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:COUP?", i + 1);
 		g_free(devc->coupling[i]);
 		devc->coupling[i] = NULL;
-		res = sr_scpi_get_string(sdi->conn, cmd, &devc->coupling[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
+		if (sr_scpi_batch_get_string(batch, q_coupling + i,
+				&devc->coupling[i]) != SR_OK)
+			goto fail;
 	}
-	sr_dbg("Current coupling:");
-	for (i = 0; i < devc->model->analog_channels; i++)
-		sr_dbg("CH%d %s", i + 1, devc->coupling[i]);
 
 	/* Trigger source. */
 	g_free(devc->trigger_source);
 	devc->trigger_source = NULL;
-	if (sr_scpi_get_string(sdi->conn, ":TRIG:EDGE:SOUR?", &devc->trigger_source) != SR_OK)
-		return SR_ERR;
-	sr_dbg("Current trigger source %s", devc->trigger_source);
+	if (sr_scpi_batch_get_string(batch, q_trig_source,
+			&devc->trigger_source) != SR_OK)
+		goto fail;
 
 	/* Horizontal trigger position. */
-	if (sr_scpi_get_float(sdi->conn, devc->model->cmds[CMD_GET_HORIZ_TRIGGERPOS].str,
+	if (sr_scpi_batch_get_float(batch, q_triggerpos,
 			&devc->horiz_triggerpos) != SR_OK)
-		return SR_ERR;
-	sr_dbg("Current horizontal trigger position %g", devc->horiz_triggerpos);
+		goto fail;
 
 	/* Trigger slope. */
 	g_free(devc->trigger_slope);
 	devc->trigger_slope = NULL;
-	if (sr_scpi_get_string(sdi->conn, ":TRIG:EDGE:SLOP?", &devc->trigger_slope) != SR_OK)
-		return SR_ERR;
-	sr_dbg("Current trigger slope %s", devc->trigger_slope);
+	if (sr_scpi_batch_get_string(batch, q_trig_slope,
+			&devc->trigger_slope) != SR_OK)
+		goto fail;
 
 	/* Trigger level. */
-	if (sr_scpi_get_float(sdi->conn, ":TRIG:EDGE:LEV?", &devc->trigger_level) != SR_OK)
+	if (sr_scpi_batch_get_float(batch, q_trig_level,
+			&devc->trigger_level) != SR_OK)
+		goto fail;
+
+	sr_scpi_batch_free(batch);
+
+	/* Vertical gain and offset. */
+	if (rigol_ds_get_dev_cfg_vertical(sdi) != SR_OK)
 		return SR_ERR;
+
+	sr_dbg("Current coupling:");
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_dbg("CH%d %s", i + 1, devc->coupling[i]);
+	sr_dbg("Current trigger source %s", devc->trigger_source);
+	sr_dbg("Current horizontal trigger position %g", devc->horiz_triggerpos);
+	sr_dbg("Current trigger slope %s", devc->trigger_slope);
 	sr_dbg("Current trigger level %g", devc->trigger_level);
 
 	return SR_OK;
+
+fail:
+	sr_scpi_batch_free(batch);
+	return SR_ERR;
 }
 
 SR_PRIV int rigol_ds_get_dev_cfg_vertical(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	char *cmd;
-	unsigned int i;
+	struct sr_scpi_batch *batch;
+	unsigned int i, n;
 	int res;
 
 	devc = sdi->priv;
+	n = devc->model->analog_channels;
+
+	/* Vertical gain and offset, queried for all channels at once. */
+	batch = rigol_ds_batch_new(devc);
+	for (i = 0; i < n; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:SCAL?", i + 1);
+	for (i = 0; i < n; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:OFFS?", i + 1);
+
+	res = sr_scpi_batch_run(sdi->conn, batch);
+	for (i = 0; i < n && res == SR_OK; i++)
+		res = sr_scpi_batch_get_float(batch, i, &devc->vdiv[i]);
+	for (i = 0; i < n && res == SR_OK; i++)
+		res = sr_scpi_batch_get_float(batch, n + i, &devc->vert_offset[i]);
+	sr_scpi_batch_free(batch);
+	if (res != SR_OK)
+		return SR_ERR;
 
-	/* Vertical gain. */
-	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:SCAL?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vdiv[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
-	}
 	sr_dbg("Current vertical gain:");
-	for (i = 0; i < devc->model->analog_channels; i++)
+	for (i = 0; i < n; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vdiv[i]);
 
-	/* Vertical offset. */
-	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:OFFS?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vert_offset[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
-	}
 	sr_dbg("Current vertical offset:");
-	for (i = 0; i < devc->model->analog_channels; i++)
+	for (i = 0; i < n; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vert_offset[i]);
 
 	return SR_OK;
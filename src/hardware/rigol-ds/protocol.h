@@ -29,11 +29,14 @@
 #define LOG_PREFIX "rigol-ds"
 
 /* Size of acquisition buffers */
-#define ACQ_BUFFER_SIZE (32 * 1024)
+#define ACQ_BUFFER_SIZE (256 * 1024)
 
 /* Maximum number of samples to retrieve at once. */
 #define ACQ_BLOCK_SIZE (30 * 1000)
 
+/* Maximum length of a message with several queries. */
+#define BATCH_MAX_LEN 256
+
 #define MAX_ANALOG_CHANNELS 4
 #define MAX_DIGITAL_CHANNELS 16
 
@@ -56,6 +59,8 @@ enum data_source {
 	DATA_SOURCE_LIVE,
 	DATA_SOURCE_MEMORY,
 	DATA_SOURCE_SEGMENTED,
+	/* Record segments on the instrument, then read them all. */
+	DATA_SOURCE_RECORD,
 };
 
 struct rigol_ds_vendor {
@@ -146,6 +151,8 @@ struct dev_context {
 	uint64_t num_frames;
 	/* Number of frames available from the Segmented data source */
 	uint64_t num_frames_segmented;
+	/* Set while the instrument records segments for the Record source. */
+	gboolean recording;
 	/* GSList entry for the current channel. */
 	GSList *channel_entry;
 	/* Number of bytes received for current channel. */
@@ -156,10 +163,15 @@ struct dev_context {
 	uint64_t num_block_bytes;
 	/* Number of data block bytes already read */
 	uint64_t num_block_read;
+	/* Whether the current data block was already asked for */
+	gboolean block_requested;
 	/* What to wait for in *_receive */
 	enum wait_events wait_event;
 	/* Trigger/block copying/stop waiting status */
 	int wait_status;
+	/* Start of the current wait, and time of its next check (us) */
+	int64_t wait_start;
+	int64_t wait_next;
 	/* Acq buffers used for reading from the scope and sending data to app */
 	unsigned char *buffer;
 	float *data;
@@ -167,6 +179,8 @@ struct dev_context {
 
 SR_PRIV int rigol_ds_config_set(const struct sr_dev_inst *sdi, const char *format, ...);
 SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi);
+SR_PRIV int rigol_ds_get_recorded_frames(const struct sr_dev_inst *sdi, int *frames);
+SR_PRIV int rigol_ds_record_start(const struct sr_dev_inst *sdi);
 SR_PRIV int rigol_ds_channel_start(const struct sr_dev_inst *sdi);
 SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data);
 SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi);
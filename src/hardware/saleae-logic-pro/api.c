@@ -190,7 +190,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (unsigned int i = 0; devlist[i]; i++) {
 		libusb_get_device_descriptor(devlist[i], &des);
 
@@ -408,7 +408,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
-	devc->conv_buffer = g_malloc(CONV_BUFFER_SIZE);
+	devc->conv_buffer = sr_buffer_alloc(drvc->sr_ctx, CONV_BUFFER_SIZE);
+	if (!devc->conv_buffer)
+		return SR_ERR_MALLOC;
 
 	devc->num_transfers = BUF_COUNT;
 	devc->transfers = g_malloc0(sizeof(*devc->transfers) * BUF_COUNT);
@@ -418,7 +420,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
 			2 | LIBUSB_ENDPOINT_IN, buf, BUF_SIZE,
 			saleae_logic_pro_receive_data, (void *)sdi, 0);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
@@ -452,7 +454,8 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	usb_source_remove(sdi->session, drvc->sr_ctx);
 
-	g_free(devc->conv_buffer);
+	sr_buffer_free(devc->conv_buffer);
+	devc->conv_buffer = NULL;
 
 	return SR_OK;
 }
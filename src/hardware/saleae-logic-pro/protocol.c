@@ -61,33 +61,44 @@ static void iterate_lfsr(const struct sr_dev_inst *sdi)
 	devc->lfsr = lfsr;
 }
 
+/*
+ * XOR data with the keystream, which repeats the bytes of the LFSR
+ * word (LSB first). Works a word at a time, the tail byte by byte.
+ */
+static void apply_keystream(uint32_t lfsr, uint8_t *data, size_t len)
+{
+	uint8_t key[4];
+	uint32_t word, key_word;
+	size_t i;
+
+	WL32(key, lfsr);
+	memcpy(&key_word, key, sizeof(key_word));
+	for (i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+		memcpy(&word, &data[i], sizeof(word));
+		word ^= key_word;
+		memcpy(&data[i], &word, sizeof(word));
+	}
+	for (; i < len; i++)
+		data[i] ^= key[i % 4];
+}
+
 static void encrypt(const struct sr_dev_inst *sdi, const uint8_t *in, uint8_t *out, uint16_t len)
 {
 	struct dev_context *devc = sdi->priv;
-	uint32_t lfsr = devc->lfsr;
-	uint8_t value, mask;
-	int i;
 
-	for (i = 0; i < len; i++) {
-		value = in[i];
-		mask = lfsr >> (i % 4 * 8);
-		if (i == 0)
-			value = (value & 0x28) | ((value ^ mask) & ~0x28);
-		else
-			value = value ^ mask;
-		out[i] = value;
-	}
+	memcpy(out, in, len);
+	apply_keystream(devc->lfsr, out, len);
+	/* Bits 3 and 5 of the first byte stay in the clear. */
+	if (len)
+		out[0] = (in[0] & 0x28) | (out[0] & ~0x28);
 	iterate_lfsr(sdi);
 }
 
 static void decrypt(const struct sr_dev_inst *sdi, uint8_t *data, uint16_t len)
 {
 	struct dev_context *devc = sdi->priv;
-	uint32_t lfsr = devc->lfsr;
-	int i;
 
-	for (i = 0; i < len; i++)
-		data[i] ^= (lfsr >> (i % 4 * 8));
+	apply_keystream(devc->lfsr, data, len);
 	iterate_lfsr(sdi);
 }
 
@@ -569,6 +580,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 	const struct sr_channel *c;
 	const GSList *l;
 	uint16_t mask;
+	unsigned int i, b;
 
 	devc->dig_channel_cnt = 0;
 	devc->dig_channel_mask = 0;
@@ -582,6 +594,16 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 		devc->dig_channel_mask |= mask;
 
 	}
+
+	memset(devc->channel_scatter, 0, sizeof(devc->channel_scatter));
+	for (i = 0; i < devc->dig_channel_cnt; i++) {
+		for (b = 0; b < 256; b++) {
+			if (b & (1 << (i % 8)))
+				devc->channel_scatter[i / 8][b] |=
+					devc->dig_channel_masks[i];
+		}
+	}
+
 	sr_dbg("%d channels enabled (0x%04x)",
 	       devc->dig_channel_cnt, devc->dig_channel_mask);
 
@@ -841,6 +863,34 @@ static void saleae_logic_pro_send_data(const struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
+/*
+ * Convert one complete batch: each 32-bit word holds 32 consecutive
+ * samples of one channel, the first sample in the MSB. Byte j of up to
+ * eight channel words makes up an 8x8 bit matrix, whose transpose holds
+ * one byte of channel bits per sample, which the scatter table turns
+ * into sample bits.
+ */
+static void saleae_logic_pro_convert_batch(const struct dev_context *devc,
+					  uint16_t *samples, const uint32_t *src)
+{
+	uint64_t rows[2];
+	unsigned int i, j, k;
+
+	for (j = 0; j < 4; j++) {
+		rows[0] = rows[1] = 0;
+		for (i = 0; i < devc->dig_channel_cnt; i++)
+			rows[i / 8] |= (uint64_t)((src[i] >> (8 * j)) & 0xff)
+				<< (8 * (i % 8));
+		rows[0] = transpose_8x8(rows[0]);
+		if (devc->dig_channel_cnt > 8)
+			rows[1] = transpose_8x8(rows[1]);
+		for (k = 0; k < 8; k++)
+			samples[31 - 8 * j - k] =
+				devc->channel_scatter[0][(rows[0] >> (8 * k)) & 0xff] |
+				devc->channel_scatter[1][(rows[1] >> (8 * k)) & 0xff];
+	}
+}
+
 /*
  * One batch from the device consists of 32 samples per active digital channel.
  * This stream of batches is packed into USB packets with 16384 bytes each.
@@ -861,8 +911,20 @@ static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
 	devc->conv_size = 0;
 
 	batch_index = devc->batch_index;
-	while (srccnt--) {
+	while (srccnt) {
+		/* Complete batches take the fast path. */
+		if (batch_index == 0 && devc->dig_channel_cnt &&
+				srccnt >= devc->dig_channel_cnt) {
+			saleae_logic_pro_convert_batch(devc, (uint16_t *)dst, src);
+			src += devc->dig_channel_cnt;
+			srccnt -= devc->dig_channel_cnt;
+			devc->conv_size += CONV_BATCH_SIZE;
+			dst += CONV_BATCH_SIZE;
+			continue;
+		}
+
 		samples = *src++;
+		srccnt--;
 		dst_batch = (uint16_t*)dst;
 
 		/* First index of the batch. */
@@ -906,6 +968,6 @@ SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *t
 	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer, 16 * 1024 / 4);
 	saleae_logic_pro_send_data(sdi, devc->conv_buffer, devc->conv_size, 2);
 
-	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS)
+	if ((ret = sr_usb_submit_transfer(sdi, transfer)) != LIBUSB_SUCCESS)
 		sr_dbg("FIXME resubmit failed");
 }
@@ -40,6 +40,8 @@ struct dev_context {
 	unsigned int dig_channel_cnt;
 	uint16_t dig_channel_mask;
 	uint16_t dig_channel_masks[16];
+	/* Maps bytes of transposed channel bits to sample bits. */
+	uint16_t channel_scatter[2][256];
 	uint64_t dig_samplerate;
 
 	uint32_t lfsr;
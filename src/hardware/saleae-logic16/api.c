@@ -138,6 +138,54 @@ static gboolean check_conf_profile(libusb_device *dev)
 	return ret;
 }
 
+static struct sr_dev_inst *dev_inst_new(const char *connection_id)
+{
+	struct dev_context *devc;
+	struct sr_dev_inst *sdi;
+	unsigned int j;
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INITIALIZING;
+	sdi->vendor = g_strdup("Saleae");
+	sdi->model = g_strdup("Logic16");
+	sdi->connection_id = g_strdup(connection_id);
+
+	for (j = 0; j < ARRAY_SIZE(channel_names); j++)
+		sr_channel_new(sdi, j, SR_CHANNEL_LOGIC, TRUE,
+				channel_names[j]);
+
+	devc = g_malloc0(sizeof(struct dev_context));
+	devc->selected_voltage_range = VOLTAGE_RANGE_18_33_V;
+	sdi->priv = devc;
+
+	return sdi;
+}
+
+/* Create a device which replays a USB dump, see usb_replay.c. */
+static GSList *scan_replay(struct sr_dev_driver *di, const char *path)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	struct libusb_device_descriptor des;
+	const char *strings[3];
+
+	if (!(usb = sr_usb_replay_open(path)))
+		return NULL;
+
+	sr_usb_replay_identity(usb, &des, strings);
+	if (des.idVendor != LOGIC16_VID || des.idProduct != LOGIC16_PID) {
+		sr_usb_dev_inst_free(usb);
+		return NULL;
+	}
+
+	sdi = dev_inst_new(path);
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_USB;
+	sdi->conn = usb;
+
+	return std_scan_complete(di, g_slist_append(NULL, sdi));
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
@@ -148,7 +196,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	GSList *l, *devices, *conn_devices;
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
-	unsigned int i, j;
+	unsigned int i;
 	const char *conn;
 	char connection_id[64];
 
@@ -163,6 +211,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			break;
 		}
 	}
+	if (sr_usb_replay_path(conn))
+		return scan_replay(di, sr_usb_replay_path(conn));
 	if (conn)
 		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 	else
@@ -170,7 +220,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all Logic16 devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -194,19 +244,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		if (des.idVendor != LOGIC16_VID || des.idProduct != LOGIC16_PID)
 			continue;
 
-		sdi = g_malloc0(sizeof(struct sr_dev_inst));
-		sdi->status = SR_ST_INITIALIZING;
-		sdi->vendor = g_strdup("Saleae");
-		sdi->model = g_strdup("Logic16");
-		sdi->connection_id = g_strdup(connection_id);
-
-		for (j = 0; j < ARRAY_SIZE(channel_names); j++)
-			sr_channel_new(sdi, j, SR_CHANNEL_LOGIC, TRUE,
-					channel_names[j]);
-
-		devc = g_malloc0(sizeof(struct dev_context));
-		devc->selected_voltage_range = VOLTAGE_RANGE_18_33_V;
-		sdi->priv = devc;
+		sdi = dev_inst_new(connection_id);
+		devc = sdi->priv;
 		devices = g_slist_append(devices, sdi);
 
 		if (check_conf_profile(devlist[i])) {
@@ -250,6 +289,10 @@ static int logic16_dev_open(struct sr_dev_inst *sdi)
 	drvc = di->context;
 	usb = sdi->conn;
 
+	/* The initialization talks to the replayed dump instead. */
+	if (usb->replay)
+		return logic16_init_device(sdi);
+
 	device_count = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	if (device_count < 0) {
 		sr_err("Failed to get device list: %s.",
@@ -325,8 +368,7 @@ static int logic16_dev_open(struct sr_dev_inst *sdi)
 	if (ret != SR_OK) {
 		if (usb->devhdl) {
 			libusb_release_interface(usb->devhdl, USB_INTERFACE);
-			libusb_close(usb->devhdl);
-			usb->devhdl = NULL;
+			sr_usb_close(usb);
 		}
 		return SR_ERR;
 	}
@@ -390,14 +432,16 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
+	if (usb->replay)
+		return SR_OK;
+
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
-	libusb_close(usb->devhdl);
-	usb->devhdl = NULL;
+	sr_usb_close(usb);
 
 	return SR_OK;
 }
@@ -509,14 +553,9 @@ static int config_list(uint32_t key, GVariant **data,
 
 static void abort_acquisition(struct dev_context *devc)
 {
-	int i;
-
 	devc->sent_samples = -1;
 
-	for (i = devc->num_transfers - 1; i >= 0; i--) {
-		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
-	}
+	sr_usb_stream_stop(devc->stream);
 }
 
 static unsigned int bytes_per_ms(struct dev_context *devc)
@@ -565,6 +604,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 	struct sr_channel *ch;
 	GSList *l;
 	uint16_t channel_bit;
+	int i, b;
 
 	devc = sdi->priv;
 
@@ -591,6 +631,16 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 		devc->channel_masks[devc->num_channels++] = channel_bit;
 	}
 
+	/* Map each byte of transposed channel bits to the sample bits. */
+	memset(devc->channel_scatter, 0, sizeof(devc->channel_scatter));
+	for (i = 0; i < devc->num_channels; i++) {
+		for (b = 0; b < 256; b++) {
+			if (b & (1 << (i % 8)))
+				devc->channel_scatter[i / 8][b] |=
+					devc->channel_masks[i];
+		}
+	}
+
 	return SR_OK;
 }
 
@@ -618,6 +668,9 @@ static int receive_data(int fd, int revents, void *cb_data)
 		abort_acquisition(devc);
 	}
 
+	if (devc->stream_done)
+		logic16_finish_acquisition(sdi);
+
 	return TRUE;
 }
 
@@ -626,17 +679,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct sr_dev_driver *di = sdi->driver;
 	struct dev_context *devc;
 	struct drv_context *drvc;
-	struct sr_usb_dev_inst *usb;
 	struct sr_trigger *trigger;
-	struct libusb_transfer *transfer;
-	unsigned int i, timeout, num_transfers;
+	unsigned int timeout;
 	int ret;
-	unsigned char *buf;
 	size_t size, convsize;
 
 	drvc = di->context;
 	devc = sdi->priv;
-	usb = sdi->conn;
 
 	/* Configures devc->cur_channels. */
 	if (configure_channels(sdi) != SR_OK) {
@@ -645,7 +694,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	}
 
 	devc->sent_samples = 0;
-	devc->empty_transfer_count = 0;
+	devc->stream_done = FALSE;
 	devc->cur_channel = 0;
 	memset(devc->channel_data, 0, sizeof(devc->channel_data));
 
@@ -661,10 +710,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		devc->trigger_fired = TRUE;
 
 	timeout = get_timeout(devc);
-	num_transfers = get_number_of_transfers(devc);
 	size = get_buffer_size(devc);
 	convsize = (size / devc->num_channels + 2) * 16;
-	devc->submitted_transfers = 0;
 
 	devc->convbuffer_size = convsize;
 	if (!(devc->convbuffer = g_try_malloc(convsize))) {
@@ -672,54 +719,35 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR_MALLOC;
 	}
 
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
-	if (!devc->transfers) {
-		sr_err("USB transfers malloc failed.");
+	devc->stream = sr_usb_stream_new(sdi, 2 | LIBUSB_ENDPOINT_IN,
+			get_number_of_transfers(devc), size, timeout,
+			logic16_decode_transfer, logic16_transfers_done, NULL);
+	if (!devc->stream) {
 		g_free(devc->convbuffer);
 		return SR_ERR_MALLOC;
 	}
 
 	if ((ret = logic16_setup_acquisition(sdi, devc->cur_samplerate,
 					     devc->cur_channels)) != SR_OK) {
-		g_free(devc->transfers);
+		sr_usb_stream_free(devc->stream);
+		devc->stream = NULL;
 		g_free(devc->convbuffer);
 		return ret;
 	}
 
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			if (devc->submitted_transfers)
-				abort_acquisition(devc);
-			else {
-				g_free(devc->transfers);
-				g_free(devc->convbuffer);
-			}
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
-				logic16_receive_transfer, (void *)sdi, timeout);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
-	}
-
 	devc->ctx = drvc->sr_ctx;
 
 	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, (void *)sdi);
 
+	/*
+	 * From here on, receive_data() cleans up once the stream ended,
+	 * and sends the end of the feed. So the header goes out first.
+	 */
 	std_session_send_df_header(sdi);
 
+	if ((ret = sr_usb_stream_start(devc->stream)) != SR_OK)
+		return ret;
+
 	if ((ret = logic16_start_acquisition(sdi)) != SR_OK) {
 		abort_acquisition(devc);
 		return ret;
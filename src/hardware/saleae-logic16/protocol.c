@@ -60,7 +60,6 @@
 #define READ_EEPROM_COOKIE2		0x81
 #define ABORT_ACQUISITION_SYNC_PATTERN	0x55
 
-#define MAX_EMPTY_TRANSFERS		64
 
 /* Register mappings for old and new bitstream versions */
 
@@ -203,7 +202,7 @@ static int do_ep1_command(const struct sr_dev_inst *sdi,
 
 	encrypt(buf, command, cmd_len);
 
-	ret = libusb_bulk_transfer(usb->devhdl, 1, buf, cmd_len, &xfer, 1000);
+	ret = sr_usb_bulk_transfer(usb, 1, buf, cmd_len, &xfer, 1000);
 	if (ret != 0) {
 		sr_dbg("Failed to send EP1 command 0x%02x: %s.",
 		       command[0], libusb_error_name(ret));
@@ -218,7 +217,7 @@ static int do_ep1_command(const struct sr_dev_inst *sdi,
 	if (reply_len == 0)
 		return SR_OK;
 
-	ret = libusb_bulk_transfer(usb->devhdl, 0x80 | 1, buf, reply_len,
+	ret = sr_usb_bulk_transfer(usb, 0x80 | 1, buf, reply_len,
 				   &xfer, 1000);
 	if (ret != 0) {
 		sr_dbg("Failed to receive reply to EP1 command 0x%02x: %s.",
@@ -457,25 +456,84 @@ static int configure_led(const struct sr_dev_inst *sdi)
 	return set_led_mode(sdi, 1, 6250, 0, 1);
 }
 
+static gboolean is_fpga_version(uint8_t version)
+{
+	return version == 0x10 || version == 0x13;
+}
+
+/*
+ * Check whether the FPGA runs a bitstream, by looking for a known
+ * version number at the old and new version register location.
+ */
+static gboolean fpga_is_configured(const struct sr_dev_inst *sdi)
+{
+	uint8_t reg0, reg7;
+
+	if (read_fpga_register(sdi, 0 /* No mapping */, &reg0) != SR_OK)
+		return FALSE;
+	if (is_fpga_version(reg0))
+		return TRUE;
+	if (reg0 != 0)
+		return FALSE;
+	if (read_fpga_register(sdi, 7 /* No mapping */, &reg7) != SR_OK)
+		return FALSE;
+
+	return is_fpga_version(reg7);
+}
+
+static int send_fpga_bitstream(const struct sr_dev_inst *sdi,
+			       const char *name, GBytes *bitstream)
+{
+	const uint8_t *data;
+	size_t sum, size, chunksize;
+	int ret;
+	uint8_t command[64];
+
+	sr_info("Uploading FPGA bitstream '%s'.", name);
+	data = g_bytes_get_data(bitstream, &size);
+
+	command[0] = COMMAND_FPGA_UPLOAD_INIT;
+	if ((ret = do_ep1_command(sdi, command, 1, NULL, 0)) != SR_OK)
+		return ret;
+
+	for (sum = 0; sum < size; sum += chunksize) {
+		chunksize = MIN(size - sum, sizeof(command) - 2);
+		command[0] = COMMAND_FPGA_UPLOAD_SEND_DATA;
+		command[1] = chunksize;
+		memcpy(&command[2], &data[sum], chunksize);
+
+		ret = do_ep1_command(sdi, command, chunksize + 2, NULL, 0);
+		if (ret != SR_OK)
+			return ret;
+	}
+	sr_info("FPGA bitstream upload (%zu bytes) done.", sum);
+
+	return SR_OK;
+}
+
 static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 				 enum voltage_range vrange)
 {
-	uint64_t sum;
-	struct sr_resource bitstream;
+	GBytes *bitstream;
+	struct sr_resource_id bitstream_id;
 	struct dev_context *devc;
 	struct drv_context *drvc;
+	struct sr_usb_dev_inst *usb;
 	const char *name;
-	ssize_t chunksize;
 	int ret;
-	uint8_t command[64];
 
 	devc = sdi->priv;
 	drvc = sdi->driver->context;
+	usb = sdi->conn;
 
 	if (devc->cur_voltage_range == vrange)
 		return SR_OK;
 
-	if (devc->fpga_variant != FPGA_VARIANT_MCUPRO) {
+	/*
+	 * A replayed dump has the upload in it already, which doesn't
+	 * get any replies. So it can be left out.
+	 */
+	if (devc->fpga_variant != FPGA_VARIANT_MCUPRO && !usb->replay) {
 		switch (vrange) {
 		case VOLTAGE_RANGE_18_33_V:
 			name = FPGA_FIRMWARE_18;
@@ -488,41 +546,26 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 			return SR_ERR;
 		}
 
-		sr_info("Uploading FPGA bitstream '%s'.", name);
-		ret = sr_resource_open(drvc->sr_ctx, &bitstream,
-				SR_RESOURCE_FIRMWARE, name);
-		if (ret != SR_OK)
-			return ret;
-
-		command[0] = COMMAND_FPGA_UPLOAD_INIT;
-		if ((ret = do_ep1_command(sdi, command, 1, NULL, 0)) != SR_OK) {
-			sr_resource_close(drvc->sr_ctx, &bitstream);
-			return ret;
-		}
-
-		sum = 0;
-		while (1) {
-			chunksize = sr_resource_read(drvc->sr_ctx, &bitstream,
-					&command[2], sizeof(command) - 2);
-			if (chunksize < 0) {
-				sr_resource_close(drvc->sr_ctx, &bitstream);
-				return SR_ERR;
-			}
-			if (chunksize == 0)
-				break;
-			command[0] = COMMAND_FPGA_UPLOAD_SEND_DATA;
-			command[1] = chunksize;
+		bitstream = sr_resource_load_bytes(drvc->sr_ctx,
+				SR_RESOURCE_FIRMWARE, name, SIZE_MAX);
+		if (!bitstream)
+			return SR_ERR;
+		sr_resource_id_compute(&bitstream_id, bitstream);
 
-			ret = do_ep1_command(sdi, command, chunksize + 2,
-					NULL, 0);
+		/* Skip the upload when the FPGA still runs this bitstream. */
+		if (sr_resource_id_equal(&devc->fpga_bitstream_id, &bitstream_id) &&
+				fpga_is_configured(sdi)) {
+			sr_info("FPGA bitstream '%s' is loaded already.", name);
+		} else {
+			devc->fpga_bitstream_id.valid = FALSE;
+			ret = send_fpga_bitstream(sdi, name, bitstream);
 			if (ret != SR_OK) {
-				sr_resource_close(drvc->sr_ctx, &bitstream);
+				g_bytes_unref(bitstream);
 				return ret;
 			}
-			sum += chunksize;
+			devc->fpga_bitstream_id = bitstream_id;
 		}
-		sr_resource_close(drvc->sr_ctx, &bitstream);
-		sr_info("FPGA bitstream upload (%" PRIu64 " bytes) done.", sum);
+		g_bytes_unref(bitstream);
 	}
 
 	/* This needs to be called before accessing any FPGA registers. */
@@ -746,7 +789,7 @@ SR_PRIV int logic16_init_device(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void finish_acquisition(struct sr_dev_inst *sdi)
+SR_PRIV void logic16_finish_acquisition(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 
@@ -756,8 +799,8 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	usb_source_remove(sdi->session, devc->ctx);
 
-	devc->num_transfers = 0;
-	g_free(devc->transfers);
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
 	g_free(devc->convbuffer);
 	if (devc->stl) {
 		soft_trigger_logic_free(devc->stl);
@@ -765,42 +808,61 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 	}
 }
 
-static void free_transfer(struct libusb_transfer *transfer)
+SR_PRIV void logic16_transfers_done(const struct sr_dev_inst *sdi,
+		int status, void *cb_data)
 {
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	unsigned int i;
 
-	sdi = transfer->user_data;
-	devc = sdi->priv;
+	(void)cb_data;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
+	devc = sdi->priv;
 
-	for (i = 0; i < devc->num_transfers; i++) {
-		if (devc->transfers[i] == transfer) {
-			devc->transfers[i] = NULL;
-			break;
-		}
-	}
+	if (status != SR_OK)
+		sr_dbg("Stream ended: %s.", sr_strerror(status));
 
-	devc->submitted_transfers--;
-	if (devc->submitted_transfers == 0)
-		finish_acquisition(sdi);
+	/*
+	 * When the stream ended on its own, the device still needs to be
+	 * told. Either way the rest happens outside the USB callbacks.
+	 */
+	if (devc->sent_samples >= 0)
+		devc->sent_samples = -2;
+	devc->stream_done = TRUE;
 }
 
-static void resubmit_transfer(struct libusb_transfer *transfer)
+/*
+ * Convert one complete round of channel words: each 16-bit word holds
+ * 16 consecutive samples of one channel, the first sample in the MSB.
+ * The high and low bytes of up to eight channels make up two 8x8 bit
+ * matrices each, whose transposes hold one byte of channel bits per
+ * sample, which the scatter table turns into sample bits.
+ */
+static void convert_channel_words(const struct dev_context *devc,
+		uint16_t *samples, const uint8_t *src)
 {
-	int ret;
-
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
-		return;
+	uint64_t rows[2][2];
+	unsigned int k;
+	int i;
 
-	free_transfer(transfer);
-	/* TODO: Stop session? */
+	memset(rows, 0, sizeof(rows));
+	for (i = 0; i < devc->num_channels; i++) {
+		rows[i / 8][0] |= (uint64_t)src[2 * i + 1] << (8 * (i % 8));
+		rows[i / 8][1] |= (uint64_t)src[2 * i] << (8 * (i % 8));
+	}
+	rows[0][0] = transpose_8x8(rows[0][0]);
+	rows[0][1] = transpose_8x8(rows[0][1]);
+	if (devc->num_channels > 8) {
+		rows[1][0] = transpose_8x8(rows[1][0]);
+		rows[1][1] = transpose_8x8(rows[1][1]);
+	}
 
-	sr_err("%s: %s", __func__, libusb_error_name(ret));
+	for (k = 0; k < 8; k++) {
+		samples[7 - k] =
+			devc->channel_scatter[0][(rows[0][0] >> (8 * k)) & 0xff] |
+			devc->channel_scatter[1][(rows[1][0] >> (8 * k)) & 0xff];
+		samples[15 - k] =
+			devc->channel_scatter[0][(rows[0][1] >> (8 * k)) & 0xff] |
+			devc->channel_scatter[1][(rows[1][1] >> (8 * k)) & 0xff];
+	}
 }
 
 static size_t convert_sample_data(struct dev_context *devc,
@@ -816,9 +878,27 @@ static size_t convert_sample_data(struct dev_context *devc,
 	channel_data = devc->channel_data;
 	cur_channel = devc->cur_channel;
 
-	while (srccnt--) {
+	while (srccnt) {
+		/* Complete rounds of channel words take the fast path. */
+		if (cur_channel == 0 && srccnt >= (size_t)devc->num_channels) {
+			if (destcnt < 16 * 2) {
+				sr_err("Conversion buffer too small!");
+				break;
+			}
+			convert_channel_words(devc, channel_data, src);
+			src += 2 * devc->num_channels;
+			srccnt -= devc->num_channels;
+			memcpy(dest, channel_data, 16 * 2);
+			memset(channel_data, 0, 16 * 2);
+			dest += 16 * 2;
+			ret += 16;
+			destcnt -= 16 * 2;
+			continue;
+		}
+
 		sample = src[0] | (src[1] << 8);
 		src += 2;
+		srccnt--;
 
 		channel_mask = devc->channel_masks[cur_channel];
 
@@ -845,77 +925,37 @@ static size_t convert_sample_data(struct dev_context *devc,
 	return ret;
 }
 
-SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transfer)
+SR_PRIV int logic16_decode_transfer(const struct sr_dev_inst *sdi,
+		uint64_t seq, const uint8_t *data, size_t length, void *cb_data)
 {
-	gboolean packet_has_error = FALSE;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	size_t new_samples, num_samples;
 	int trigger_offset;
 	int pre_trigger_samples;
 
-	sdi = transfer->user_data;
-	devc = sdi->priv;
-
-	/*
-	 * If acquisition has already ended, just free any queued up
-	 * transfer that come in.
-	 */
-	if (devc->sent_samples < 0) {
-		free_transfer(transfer);
-		return;
-	}
+	(void)seq;
+	(void)cb_data;
 
-	sr_info("receive_transfer(): status %s received %d bytes.",
-		libusb_error_name(transfer->status), transfer->actual_length);
+	devc = sdi->priv;
 
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		devc->sent_samples = -2;
-		free_transfer(transfer);
-		return;
-	case LIBUSB_TRANSFER_COMPLETED:
-	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
-		break;
-	default:
-		packet_has_error = TRUE;
-		break;
-	}
+	/* If acquisition has already ended, ignore any late data. */
+	if (devc->sent_samples < 0)
+		return SR_OK;
 
-	if (transfer->actual_length & 1) {
+	if (length & 1) {
 		sr_err("Got an odd number of bytes from the device. "
 		       "This should not happen.");
 		/* Bail out right away. */
-		packet_has_error = TRUE;
-		devc->empty_transfer_count = MAX_EMPTY_TRANSFERS;
-	}
-
-	if (transfer->actual_length == 0 || packet_has_error) {
-		devc->empty_transfer_count++;
-		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
-			/*
-			 * The FX2 gave up. End the acquisition, the frontend
-			 * will work out that the samplecount is short.
-			 */
-			devc->sent_samples = -2;
-			free_transfer(transfer);
-		} else {
-			resubmit_transfer(transfer);
-		}
-		return;
-	} else {
-		devc->empty_transfer_count = 0;
+		return SR_ERR_DATA;
 	}
 
 	new_samples = convert_sample_data(devc, devc->convbuffer,
-			devc->convbuffer_size, transfer->buffer, transfer->actual_length);
+			devc->convbuffer_size, data, length);
 
-	if (new_samples <= 0) {
-		resubmit_transfer(transfer);
-		return;
-	}
+	if (new_samples <= 0)
+		return SR_OK;
 
 	/* At least one new sample. */
 	if (devc->trigger_fired) {
@@ -954,9 +994,8 @@ SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transf
 	if (devc->limit_samples &&
 			(uint64_t)devc->sent_samples >= devc->limit_samples) {
 		devc->sent_samples = -2;
-		free_transfer(transfer);
-		return;
+		sr_usb_stream_stop(devc->stream);
 	}
 
-	resubmit_transfer(transfer);
+	return SR_OK;
 }
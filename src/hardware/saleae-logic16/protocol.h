@@ -68,6 +68,9 @@ struct dev_context {
 	/** The input voltage selected by the user. */
 	enum voltage_range selected_voltage_range;
 
+	/** The FPGA bitstream which got uploaded last. */
+	struct sr_resource_id fpga_bitstream_id;
+
 	/** Channels to use. */
 	uint16_t cur_channels;
 
@@ -75,19 +78,18 @@ struct dev_context {
 	uint8_t eeprom_data[8];
 
 	int64_t sent_samples;
-	int submitted_transfers;
-	int empty_transfer_count;
 	int num_channels;
 	int cur_channel;
 	uint16_t channel_masks[16];
 	uint16_t channel_data[16];
+	uint16_t channel_scatter[2][256];
 	uint8_t *convbuffer;
 	size_t convbuffer_size;
 	struct soft_trigger_logic *stl;
 	gboolean trigger_fired;
 
-	unsigned int num_transfers;
-	struct libusb_transfer **transfers;
+	struct sr_usb_stream *stream;
+	gboolean stream_done;
 	struct sr_context *ctx;
 
 	const uint8_t *fpga_register_map;
@@ -100,6 +102,10 @@ SR_PRIV int logic16_setup_acquisition(const struct sr_dev_inst *sdi,
 SR_PRIV int logic16_start_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV int logic16_abort_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV int logic16_init_device(const struct sr_dev_inst *sdi);
-SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transfer);
+SR_PRIV int logic16_decode_transfer(const struct sr_dev_inst *sdi,
+		uint64_t seq, const uint8_t *data, size_t length, void *cb_data);
+SR_PRIV void logic16_transfers_done(const struct sr_dev_inst *sdi,
+		int status, void *cb_data);
+SR_PRIV void logic16_finish_acquisition(const struct sr_dev_inst *sdi);
 
 #endif
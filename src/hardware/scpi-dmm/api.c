@@ -48,6 +48,34 @@ static const uint32_t devopts_generic_range[] = {
 	SR_CONF_RANGE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 };
 
+/* Models which take buffered readings, see DMM_CMD_QUERY_VALUES. */
+static const uint32_t devopts_buffered[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_CONN | SR_CONF_GET,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_MEASURED_QUANTITY | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+};
+
+static const uint32_t devopts_buffered_range[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_CONN | SR_CONF_GET,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_MEASURED_QUANTITY | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_RANGE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+};
+
+/*
+ * Readings per round trip. With more than one, the meter takes them into
+ * its reading memory (SAMP:COUN), READ? returns them as a list.
+ */
+static const uint64_t buffersizes[] = {
+	1, 10, 50, 100, 500, 1000,
+};
+
 static const struct scpi_command cmdset_agilent[] = {
 	{ DMM_CMD_SETUP_REMOTE, "\n", },
 	{ DMM_CMD_SETUP_FUNC, "CONF:%s", },
@@ -59,6 +87,8 @@ static const struct scpi_command cmdset_agilent[] = {
 	{ DMM_CMD_QUERY_RANGE_AUTO, "%s:RANGE:AUTO?", },
 	{ DMM_CMD_QUERY_RANGE, "%s:RANGE?", },
 	{ DMM_CMD_SETUP_RANGE, "CONF:%s %s", },
+	{ DMM_CMD_SETUP_SAMPLE_COUNT, "SAMP:COUN %d", },
+	{ DMM_CMD_QUERY_VALUES, "READ?", },
 	ALL_ZERO,
 };
 
@@ -90,6 +120,8 @@ static const struct scpi_command cmdset_hp[] = {
 	{ DMM_CMD_STOP_ACQ, "ABORT", },
 	{ DMM_CMD_QUERY_VALUE, "READ?", },
 	{ DMM_CMD_QUERY_PREC, "CONF?", },
+	{ DMM_CMD_SETUP_SAMPLE_COUNT, "SAMP:COUN %d", },
+	{ DMM_CMD_QUERY_VALUES, "READ?", },
 	ALL_ZERO,
 };
 
@@ -211,7 +243,7 @@ SR_PRIV const struct scpi_dmm_model models[] = {
 		"Agilent", "34410A",
 		1, 6, cmdset_hp, ARRAY_AND_SIZE(mqopts_agilent_34405a),
 		scpi_dmm_get_meas_agilent,
-		ARRAY_AND_SIZE(devopts_generic),
+		ARRAY_AND_SIZE(devopts_buffered),
 		0, 0, 0, 0, FALSE,
 		NULL, NULL, NULL,
 	},
@@ -219,7 +251,7 @@ SR_PRIV const struct scpi_dmm_model models[] = {
 		"Agilent", "34460A",
 		1, 6, cmdset_agilent, ARRAY_AND_SIZE(mqopts_agilent_34405a),
 		scpi_dmm_get_meas_agilent,
-		ARRAY_AND_SIZE(devopts_generic_range),
+		ARRAY_AND_SIZE(devopts_buffered_range),
 		0, 0, 10 * 1000, 0, FALSE,
 		scpi_dmm_get_range_text, scpi_dmm_set_range_from_text, NULL,
 	},
@@ -259,7 +291,7 @@ SR_PRIV const struct scpi_dmm_model models[] = {
 		"HP", "34401A",
 		1, 6, cmdset_hp, ARRAY_AND_SIZE(mqopts_agilent_34401a),
 		scpi_dmm_get_meas_agilent,
-		ARRAY_AND_SIZE(devopts_generic),
+		ARRAY_AND_SIZE(devopts_buffered),
 		/* 34401A: typ. 1020ms for AC readings (default is 1000ms). */
 		1500 * 1000, 0, 0, 0, FALSE,
 		NULL, NULL, NULL,
@@ -268,7 +300,7 @@ SR_PRIV const struct scpi_dmm_model models[] = {
 		"Keysight", "34465A",
 		1, 6, cmdset_agilent, ARRAY_AND_SIZE(mqopts_agilent_34405a),
 		scpi_dmm_get_meas_agilent,
-		ARRAY_AND_SIZE(devopts_generic_range),
+		ARRAY_AND_SIZE(devopts_buffered_range),
 		0, 0, 10 * 1000, 0, FALSE,
 		scpi_dmm_get_range_text, scpi_dmm_set_range_from_text, NULL,
 	},
@@ -368,6 +400,7 @@ static struct sr_dev_inst *probe_device(struct sr_scpi_dev_inst *scpi)
 	devc->num_channels = model->num_channels;
 	devc->cmdset = model->cmdset;
 	devc->model = model;
+	devc->buffer_size = 1;
 
 	for (i = 0; i < devc->num_channels; i++) {
 		channel_name = g_strdup_printf("P%zu", i + 1);
@@ -474,6 +507,11 @@ static int config_get(uint32_t key, GVariant **data,
 			return SR_ERR_NA;
 		*data = g_variant_new_string(range);
 		return SR_OK;
+	case SR_CONF_BUFFERSIZE:
+		if (!sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUES))
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(devc->buffer_size);
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
@@ -487,6 +525,7 @@ static int config_set(uint32_t key, GVariant *data,
 	enum sr_mqflag mqflag;
 	GVariant *tuple_child;
 	const char *range;
+	int idx;
 
 	(void)cg;
 
@@ -509,6 +548,13 @@ static int config_set(uint32_t key, GVariant *data,
 			return SR_ERR_NA;
 		range = g_variant_get_string(data, NULL);
 		return devc->model->set_range_from_text(sdi, range);
+	case SR_CONF_BUFFERSIZE:
+		if (!sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUES))
+			return SR_ERR_NA;
+		if ((idx = std_u64_idx(data, ARRAY_AND_SIZE(buffersizes))) < 0)
+			return SR_ERR_ARG;
+		devc->buffer_size = buffersizes[idx];
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
@@ -553,6 +599,11 @@ static int config_list(uint32_t key, GVariant **data,
 			return SR_ERR_NA;
 		*data = devc->model->get_range_text_list(sdi);
 		return SR_OK;
+	case SR_CONF_BUFFERSIZE:
+		if (!devc || !sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUES))
+			return SR_ERR_NA;
+		*data = std_gvar_array_u64(ARRAY_AND_SIZE(buffersizes));
+		return SR_OK;
 	default:
 		(void)devc;
 		return SR_ERR_NA;
@@ -596,6 +647,15 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		}
 	}
 
+	/* Have the meter take a buffer of readings per query. */
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_SETUP_SAMPLE_COUNT);
+	if (command && *command && devc->buffer_size > 1) {
+		scpi_dmm_cmd_delay(scpi);
+		ret = sr_scpi_send(scpi, command, (int)devc->buffer_size);
+		if (ret != SR_OK)
+			return ret;
+	}
+
 	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_START_ACQ);
 	if (command && *command) {
 		scpi_dmm_cmd_delay(scpi);
@@ -635,12 +695,22 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 		scpi_dmm_cmd_delay(scpi);
 		(void)sr_scpi_send(scpi, command);
 	}
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_SETUP_SAMPLE_COUNT);
+	if (command && *command && devc->buffer_size > 1) {
+		scpi_dmm_cmd_delay(scpi);
+		(void)sr_scpi_send(scpi, command, 1);
+	}
 	sr_scpi_source_remove(sdi->session, scpi);
 
 	std_session_send_df_end(sdi);
 
 	g_free(devc->precision);
 	devc->precision = NULL;
+	g_free(devc->run_acq_info.d_values);
+	g_free(devc->run_acq_info.f_values);
+	devc->run_acq_info.d_values = NULL;
+	devc->run_acq_info.f_values = NULL;
+	devc->run_acq_info.values_size = 0;
 
 	return SR_OK;
 }
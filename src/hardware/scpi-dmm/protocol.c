@@ -269,6 +269,71 @@ SR_PRIV GVariant *scpi_dmm_get_range_text_list(const struct sr_dev_inst *sdi)
 	return list;
 }
 
+/*
+ * Get a buffer of readings, which the meter took after SAMP:COUN was
+ * set up. READ? returns them as a comma separated list, which saves a
+ * round trip per value:
+ *   +1.09450000E-01,+1.09460000E-01,+1.09450000E-01
+ */
+static int get_values_agilent(const struct sr_dev_inst *sdi, size_t *count)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	struct scpi_dmm_acq_info *info;
+	const char *command;
+	char *response;
+	char **fields;
+	size_t num_fields, idx;
+	double value, limit;
+	int ret;
+
+	scpi = sdi->conn;
+	devc = sdi->priv;
+	info = &devc->run_acq_info;
+
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUES);
+	if (!command || !*command)
+		return SR_ERR_NA;
+	scpi_dmm_cmd_delay(scpi);
+	ret = sr_scpi_get_string(scpi, command, &response);
+	if (ret != SR_OK)
+		return ret;
+	if (!response)
+		return SR_ERR;
+	fields = g_strsplit(response, ",", 0);
+	g_free(response);
+	num_fields = g_strv_length(fields);
+	if (!num_fields) {
+		g_strfreev(fields);
+		return SR_ERR_DATA;
+	}
+
+	if (num_fields > info->values_size) {
+		info->d_values = g_renew(double, info->d_values, num_fields);
+		info->f_values = g_renew(float, info->f_values, num_fields);
+		info->values_size = num_fields;
+	}
+	limit = 9e37;
+	ret = SR_OK;
+	for (idx = 0; idx < num_fields; idx++) {
+		ret = sr_atod_ascii(g_strstrip(fields[idx]), &value);
+		if (ret != SR_OK)
+			break;
+		if (value > +limit)
+			value = +INFINITY;
+		else if (value < -limit)
+			value = -INFINITY;
+		info->d_values[idx] = value;
+		info->f_values[idx] = value;
+	}
+	g_strfreev(fields);
+	if (ret != SR_OK)
+		return ret;
+	*count = num_fields;
+
+	return SR_OK;
+}
+
 SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 {
 	struct sr_scpi_dev_inst *scpi;
@@ -388,53 +453,59 @@ SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 	 * downgrade to single precision later to reduce the amount of
 	 * logged information.
 	 */
-	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUE);
-	if (!command || !*command)
-		return SR_ERR_NA;
-	scpi_dmm_cmd_delay(scpi);
-	ret = sr_scpi_get_string(scpi, command, &response);
-	if (ret != SR_OK)
-		return ret;
-	g_strstrip(response);
 	use_double = devc->model->digits > 6;
-	ret = sr_atod_ascii(response, &info->d_value);
-	if (ret != SR_OK) {
-		g_free(response);
-		return ret;
-	}
-	if (!response)
-		return SR_ERR;
-	limit = 9e37;
-	if (info->d_value > +limit) {
-		info->d_value = +INFINITY;
-	} else if (info->d_value < -limit) {
-		info->d_value = -INFINITY;
+	if (devc->buffer_size > 1) {
+		ret = get_values_agilent(sdi, &count);
+		if (ret != SR_OK)
+			return ret;
 	} else {
-		p = response;
-		while (p && *p && g_ascii_isspace(*p))
-			p++;
-		if (p && *p && (*p == '-' || *p == '+'))
-			p++;
-		sig_digits = 0;
-		while (p && *p && g_ascii_isdigit(*p)) {
-			sig_digits++;
-			p++;
+		command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_VALUE);
+		if (!command || !*command)
+			return SR_ERR_NA;
+		scpi_dmm_cmd_delay(scpi);
+		ret = sr_scpi_get_string(scpi, command, &response);
+		if (ret != SR_OK)
+			return ret;
+		g_strstrip(response);
+		ret = sr_atod_ascii(response, &info->d_value);
+		if (ret != SR_OK) {
+			g_free(response);
+			return ret;
 		}
-		if (p && *p && *p == '.')
-			p++;
-		while (p && *p && g_ascii_isdigit(*p))
-			p++;
-		ret = SR_OK;
-		if (!p || !*p)
-			val_exp = 0;
-		else if (*p != 'e' && *p != 'E')
-			ret = SR_ERR_DATA;
-		else
-			ret = sr_atoi(++p, &val_exp);
+		if (!response)
+			return SR_ERR;
+		limit = 9e37;
+		if (info->d_value > +limit) {
+			info->d_value = +INFINITY;
+		} else if (info->d_value < -limit) {
+			info->d_value = -INFINITY;
+		} else {
+			p = response;
+			while (p && *p && g_ascii_isspace(*p))
+				p++;
+			if (p && *p && (*p == '-' || *p == '+'))
+				p++;
+			sig_digits = 0;
+			while (p && *p && g_ascii_isdigit(*p)) {
+				sig_digits++;
+				p++;
+			}
+			if (p && *p && *p == '.')
+				p++;
+			while (p && *p && g_ascii_isdigit(*p))
+				p++;
+			ret = SR_OK;
+			if (!p || !*p)
+				val_exp = 0;
+			else if (*p != 'e' && *p != 'E')
+				ret = SR_ERR_DATA;
+			else
+				ret = sr_atoi(++p, &val_exp);
+		}
+		g_free(response);
+		if (ret != SR_OK)
+			return ret;
 	}
-	g_free(response);
-	if (ret != SR_OK)
-		return ret;
 	/*
 	 * TODO Come up with the most appropriate 'digits' calculation.
 	 * This implementation assumes that either the device provides
@@ -472,7 +543,16 @@ SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 	 * Callers will fill in the sample count, and channel name,
 	 * and will send out the packet.
 	 */
-	if (use_double) {
+	if (devc->buffer_size > 1) {
+		analog->num_samples = count;
+		if (use_double) {
+			analog->data = info->d_values;
+			analog->encoding->unitsize = sizeof(info->d_values[0]);
+		} else {
+			analog->data = info->f_values;
+			analog->encoding->unitsize = sizeof(info->f_values[0]);
+		}
+	} else if (use_double) {
 		analog->data = &info->d_value;
 		analog->encoding->unitsize = sizeof(info->d_value);
 	} else {
@@ -725,6 +805,7 @@ SR_PRIV int scpi_dmm_receive_data(int fd, int revents, void *cb_data)
 	struct dev_context *devc;
 	struct scpi_dmm_acq_info *info;
 	gboolean sent_sample;
+	uint64_t num_samples, remain;
 	size_t ch;
 	struct sr_channel *channel;
 	int ret;
@@ -742,6 +823,8 @@ SR_PRIV int scpi_dmm_receive_data(int fd, int revents, void *cb_data)
 	info = &devc->run_acq_info;
 
 	sent_sample = FALSE;
+	num_samples = 1;
+	remain = sr_sw_limits_samples_remain(&devc->limits);
 	ret = SR_OK;
 	for (ch = 0; ch < devc->num_channels; ch++) {
 		/* Check the channel's enabled status. */
@@ -784,15 +867,23 @@ SR_PRIV int scpi_dmm_receive_data(int fd, int revents, void *cb_data)
 		if (ret != SR_OK)
 			break;
 
-		/* Send the packet that was filled in by the model's routine. */
-		info->analog[ch].num_samples = 1;
+		/*
+		 * Send the packet that was filled in by the model's routine.
+		 * Buffered readings may overshoot the sample limit, don't
+		 * send more than was asked for.
+		 */
+		if (!info->analog[ch].num_samples)
+			info->analog[ch].num_samples = 1;
+		if (remain && info->analog[ch].num_samples > remain)
+			info->analog[ch].num_samples = remain;
+		num_samples = info->analog[ch].num_samples;
 		info->analog[ch].meaning->channels = g_slist_append(NULL, channel);
 		sr_session_send(sdi, &info->packet);
 		g_slist_free(info->analog[ch].meaning->channels);
 		sent_sample = TRUE;
 	}
 	if (sent_sample)
-		sr_sw_limits_update_samples_read(&devc->limits, 1);
+		sr_sw_limits_update_samples_read(&devc->limits, num_samples);
 	if (ret != SR_OK) {
 		/* Stop acquisition upon communication or data errors. */
 		sr_dev_acquisition_stop(sdi);
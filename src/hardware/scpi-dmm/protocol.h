@@ -45,6 +45,8 @@ enum scpi_dmm_cmdcode {
 	DMM_CMD_QUERY_RANGE,
 	DMM_CMD_SETUP_RANGE_AUTO,
 	DMM_CMD_SETUP_RANGE,
+	DMM_CMD_SETUP_SAMPLE_COUNT,
+	DMM_CMD_QUERY_VALUES,
 };
 
 struct mqopt_item {
@@ -92,9 +94,15 @@ struct dev_context {
 		enum sr_mq curr_mq;
 		enum sr_mqflag curr_mqflag;
 	} start_acq_mq;
+	/* Readings per round trip, taken into the meter's buffer. */
+	uint64_t buffer_size;
 	struct scpi_dmm_acq_info {
 		float f_value;
 		double d_value;
+		/* Buffered readings. */
+		double *d_values;
+		float *f_values;
+		size_t values_size;
 		struct sr_datafeed_packet packet;
 		struct sr_datafeed_analog analog[SCPI_DMM_MAX_CHANNELS];
 		struct sr_analog_encoding encoding[SCPI_DMM_MAX_CHANNELS];
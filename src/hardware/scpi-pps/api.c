@@ -278,6 +278,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 	devc = sdi->priv;
 
+	sr_scpi_cache_enable(scpi, CONFIG_CACHE_MAX_AGE_US);
+
 	/* Don't send SCPI_CMD_REMOTE for HP 66xxB using SCPI over GPIB. */
 	if (!(devc->device->dialect == SCPI_DIALECT_HP_66XXB &&
 			scpi->transport == SCPI_TRANSPORT_LIBGPIB))
@@ -342,7 +344,7 @@ static int config_get(uint32_t key, GVariant **data,
 	int cmd, ret;
 	const char *s;
 	int reg;
-	gboolean is_hmp_sqii;
+	gboolean is_hmp_sqii, cached;
 
 	if (!sdi)
 		return SR_ERR_ARG;
@@ -472,6 +474,25 @@ static int config_get(uint32_t key, GVariant **data,
 		channel_group_name = g_strdup(cg->name);
 	}
 
+	/*
+	 * Settings get served from the SCPI layer's cache, frontends
+	 * tend to poll them. Measurements and status don't.
+	 */
+	cached = FALSE;
+	switch (cmd) {
+	case SCPI_CMD_GET_OUTPUT_ENABLED:
+	case SCPI_CMD_GET_VOLTAGE_TARGET:
+	case SCPI_CMD_GET_FREQUENCY_TARGET:
+	case SCPI_CMD_GET_CURRENT_LIMIT:
+	case SCPI_CMD_GET_OVER_VOLTAGE_PROTECTION_ENABLED:
+	case SCPI_CMD_GET_OVER_VOLTAGE_PROTECTION_THRESHOLD:
+	case SCPI_CMD_GET_OVER_CURRENT_PROTECTION_ENABLED:
+	case SCPI_CMD_GET_OVER_CURRENT_PROTECTION_THRESHOLD:
+	case SCPI_CMD_GET_OVER_TEMPERATURE_PROTECTION:
+		cached = TRUE;
+		break;
+	}
+
 	is_hmp_sqii = FALSE;
 	is_hmp_sqii |= cmd == SCPI_CMD_GET_OUTPUT_REGULATION;
 	is_hmp_sqii |= cmd == SCPI_CMD_GET_OVER_TEMPERATURE_PROTECTION_ACTIVE;
@@ -484,6 +505,9 @@ static int config_get(uint32_t key, GVariant **data,
 		}
 		ret = sr_scpi_cmd_resp(sdi, devc->device->commands,
 			0, NULL, data, gvtype, cmd, channel_group_name);
+	} else if (cached) {
+		ret = sr_scpi_cmd_resp_cached(sdi, devc->device->commands,
+			channel_group_cmd, channel_group_name, data, gvtype, cmd);
 	} else {
 		ret = sr_scpi_cmd_resp(sdi, devc->device->commands,
 			channel_group_cmd, channel_group_name, data, gvtype, cmd);
@@ -811,6 +835,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	scpi = sdi->conn;
 
+	/* Don't serve settings from before the acquisition. */
+	sr_scpi_cache_invalidate(scpi);
+
 	/* Prime the pipe with the first channel. */
 	devc->cur_acquisition_channel = sr_next_enabled_channel(sdi, NULL);
 
@@ -821,6 +848,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if ((ret = sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 10,
 			scpi_pps_receive_data, (void *)sdi)) != SR_OK)
 		return ret;
+	/* Don't hold up faster devices of the session (not for USBTMC). */
+	(void)sr_session_source_set_priority(sdi->session, sdi, G_PRIORITY_LOW);
 	std_session_send_df_header(sdi);
 	sr_sw_limits_acquisition_start(&devc->limits);
 
@@ -29,6 +29,9 @@
 
 #define LOG_PREFIX "scpi-pps"
 
+/* How long polled settings get served without asking the device. */
+#define CONFIG_CACHE_MAX_AGE_US (500 * 1000)
+
 enum pps_scpi_cmds {
 	SCPI_CMD_REMOTE = 1,
 	SCPI_CMD_LOCAL,
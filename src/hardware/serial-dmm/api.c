@@ -44,60 +44,91 @@ static const uint32_t devopts[] = {
 	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
 };
 
-static GSList *scan(struct sr_dev_driver *di, GSList *options)
+/* Number of serial ports which get probed at the same time. */
+#define SCAN_MAX_THREADS 16
+
+struct scan_job {
+	struct dmm_info *dmm;
+	const char *conn;
+	const char *serialcomm;
+	struct sr_serial_dev_inst *serial;
+};
+
+/*
+ * Check whether the port was identified as a DMM of another model, which
+ * cannot also match this model's packets.
+ */
+static gboolean port_has_other_model(struct sr_dev_driver *di,
+	const char *conn)
+{
+	struct drv_context *drvc;
+	struct sr_dev_driver **drivers, *drv;
+	const struct dmm_info *dmm, *other;
+	const struct sr_serial_dev_inst *serial;
+	const struct sr_dev_inst *sdi;
+	GSList *l;
+	size_t i;
+
+	drvc = di->context;
+	if (!drvc || !drvc->sr_ctx || !drvc->sr_ctx->driver_list)
+		return FALSE;
+	dmm = (const struct dmm_info *)di;
+
+	drivers = drvc->sr_ctx->driver_list;
+	for (i = 0; (drv = drivers[i]); i++) {
+		if (drv == di || drv->scan != di->scan || !drv->context)
+			continue;
+		other = (const struct dmm_info *)drv;
+		for (l = ((struct drv_context *)drv->context)->instances; l; l = l->next) {
+			sdi = l->data;
+			serial = sdi->conn;
+			if (!serial || g_strcmp0(serial->port, conn) != 0)
+				continue;
+			if (other->packet_valid == dmm->packet_valid &&
+					other->packet_valid_len == dmm->packet_valid_len &&
+					other->packet_size == dmm->packet_size &&
+					g_strcmp0(other->serialcomm, dmm->serialcomm) == 0)
+				continue;
+			sr_dbg("Port %s is a %s %s, skipping.", conn,
+				other->vendor, other->device);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Check whether a DMM of the expected model is connected to a port. */
+static void scan_job_run(struct scan_job *job)
 {
 	struct dmm_info *dmm;
-	struct sr_config *src;
-	GSList *l, *devices;
-	const char *conn, *serialcomm;
-	struct sr_dev_inst *sdi;
-	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
 	int ret;
 	size_t dropped, len, packet_len;
 	uint8_t buf[128];
-	size_t ch_idx;
-	char ch_name[12];
 
-	dmm = (struct dmm_info *)di;
+	dmm = job->dmm;
+	serial = sr_serial_dev_inst_new(job->conn, job->serialcomm);
 
-	conn = dmm->conn;
-	serialcomm = dmm->serialcomm;
-	for (l = options; l; l = l->next) {
-		src = l->data;
-		switch (src->key) {
-		case SR_CONF_CONN:
-			conn = g_variant_get_string(src->data, NULL);
-			break;
-		case SR_CONF_SERIALCOMM:
-			serialcomm = g_variant_get_string(src->data, NULL);
-			break;
-		}
+	if (serial_open(serial, SERIAL_RDWR) != SR_OK) {
+		sr_serial_dev_inst_free(serial);
+		return;
 	}
-	if (!conn)
-		return NULL;
-
-	serial = sr_serial_dev_inst_new(conn, serialcomm);
-
-	if (serial_open(serial, SERIAL_RDWR) != SR_OK)
-		return NULL;
-	sr_info("Probing serial port %s.", conn);
+	sr_info("Probing serial port %s.", job->conn);
 
 	if (dmm->after_open) {
 		ret = dmm->after_open(serial);
 		if (ret != SR_OK) {
 			sr_err("Activity after port open failed: %d.", ret);
-			return NULL;
+			goto probe_failed;
 		}
 	}
 
-	devices = NULL;
-
 	/* Request a packet if the DMM requires this. */
 	if (dmm->packet_request) {
 		if ((ret = dmm->packet_request(serial)) < 0) {
 			sr_err("Failed to request packet: %d.", ret);
-			return NULL;
+			goto probe_failed;
 		}
 	}
 
@@ -116,72 +147,166 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	ret = serial_stream_detect(serial, buf, &len, dmm->packet_size,
 		dmm->packet_valid, dmm->packet_valid_len, &packet_len, 3000);
 	if (ret != SR_OK)
-		goto scan_cleanup;
+		goto probe_failed;
 	dropped = len - dmm->packet_size;
 	if (dropped > 2 * packet_len)
 		sr_warn("Packet search dropped a lot of data.");
-	sr_info("Found device on port %s.", conn);
+	sr_info("Found device on port %s.", job->conn);
 
-	/*
-	 * Setup optional additional callbacks when sub device drivers
-	 * happen to provide them. (This is a compromise to do it here,
-	 * and not extend the DMM_CONN() et al set of macros.)
-	 */
-	if (strcmp(dmm->di.name, "brymen-bm52x") == 0) {
-		/* Applicable to BM520s but not to BM820s. */
-		dmm->dmm_state_init = brymen_bm52x_state_init;
-		dmm->dmm_state_free = brymen_bm52x_state_free;
-		dmm->config_get = brymen_bm52x_config_get;
-		dmm->config_set = brymen_bm52x_config_set;
-		dmm->config_list = brymen_bm52x_config_list;
-		dmm->acquire_start = brymen_bm52x_acquire_start;
-	}
-	if (dmm->dmm_state_init)
-		dmm->dmm_state = dmm->dmm_state_init();
-
-	/* Setup the device instance. */
-	sdi = g_malloc0(sizeof(*sdi));
-	sdi->status = SR_ST_INACTIVE;
-	sdi->vendor = g_strdup(dmm->vendor);
-	sdi->model = g_strdup(dmm->device);
-	devc = g_malloc0(sizeof(*devc));
-	sr_sw_limits_init(&devc->limits);
-	sdi->inst_type = SR_INST_SERIAL;
-	sdi->conn = serial;
-	sdi->priv = devc;
-
-	/* Create (optionally device dependent) channel(s). */
-	dmm->channel_count = 1;
-	if (dmm->packet_parse == sr_brymen_bm52x_parse)
-		dmm->channel_count = BRYMEN_BM52X_DISPLAY_COUNT;
-	if (dmm->packet_parse == sr_brymen_bm86x_parse)
-		dmm->channel_count = BRYMEN_BM86X_DISPLAY_COUNT;
-	if (dmm->packet_parse == sr_eev121gw_3displays_parse) {
-		dmm->channel_count = EEV121GW_DISPLAY_COUNT;
-		dmm->channel_formats = eev121gw_channel_formats;
+	serial_close(serial);
+	job->serial = serial;
+	return;
+
+probe_failed:
+	serial_close(serial);
+	sr_serial_dev_inst_free(serial);
+}
+
+static void scan_job_thread(gpointer data, gpointer user_data)
+{
+	(void)user_data;
+
+	scan_job_run(data);
+}
+
+/*
+ * Probe the ports concurrently, a probe mostly waits for receive data
+ * or its timeout.
+ */
+static void run_scan_jobs(struct scan_job *jobs, size_t count)
+{
+	GThreadPool *pool;
+	size_t i, threads;
+
+	threads = MIN(count, SCAN_MAX_THREADS);
+	pool = NULL;
+	if (threads > 1)
+		pool = g_thread_pool_new(scan_job_thread, NULL,
+			threads, FALSE, NULL);
+	for (i = 0; i < count; i++) {
+		if (!pool || !g_thread_pool_push(pool, &jobs[i], NULL))
+			scan_job_run(&jobs[i]);
 	}
-	if (dmm->packet_parse == sr_metex14_4packets_parse)
-		dmm->channel_count = 4;
-	if (dmm->packet_parse == sr_ms2115b_parse) {
-		dmm->channel_count = MS2115B_DISPLAY_COUNT;
-		dmm->channel_formats = ms2115b_channel_formats;
+	if (pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+static GSList *scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct dmm_info *dmm;
+	struct sr_config *src;
+	GSList *l, *devices;
+	const char *conn, *serialcomm;
+	gchar **ports;
+	struct scan_job *jobs;
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	size_t count, i;
+	size_t ch_idx;
+	char ch_name[12];
+
+	dmm = (struct dmm_info *)di;
+
+	conn = dmm->conn;
+	serialcomm = dmm->serialcomm;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		switch (src->key) {
+		case SR_CONF_CONN:
+			conn = g_variant_get_string(src->data, NULL);
+			break;
+		case SR_CONF_SERIALCOMM:
+			serialcomm = g_variant_get_string(src->data, NULL);
+			break;
+		}
 	}
-	for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++) {
-		size_t ch_num;
-		const char *fmt;
-		fmt = "P%zu";
-		if (dmm->channel_formats && dmm->channel_formats[ch_idx])
-			fmt = dmm->channel_formats[ch_idx];
-		ch_num = ch_idx + 1;
-		snprintf(ch_name, sizeof(ch_name), fmt, ch_num);
-		sr_channel_new(sdi, ch_idx, SR_CHANNEL_ANALOG, TRUE, ch_name);
+	if (!conn)
+		return NULL;
+
+	/* Accept a comma separated list of ports, e.g. for racks of DMMs. */
+	ports = g_strsplit(conn, ",", 0);
+	jobs = g_malloc0_n(g_strv_length(ports), sizeof(*jobs));
+	count = 0;
+	for (i = 0; ports[i]; i++) {
+		g_strstrip(ports[i]);
+		if (!*ports[i] || port_has_other_model(di, ports[i]))
+			continue;
+		jobs[count].dmm = dmm;
+		jobs[count].conn = ports[i];
+		jobs[count].serialcomm = serialcomm;
+		count++;
 	}
+	run_scan_jobs(jobs, count);
 
-	/* Add found device to result set. */
-	devices = g_slist_append(devices, sdi);
+	devices = NULL;
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].serial)
+			continue;
+
+		if (!devices) {
+			/*
+			 * Setup optional additional callbacks when sub device
+			 * drivers happen to provide them. (This is a compromise
+			 * to do it here, and not extend the DMM_CONN() et al
+			 * set of macros.)
+			 */
+			if (strcmp(dmm->di.name, "brymen-bm52x") == 0) {
+				/* Applicable to BM520s but not to BM820s. */
+				dmm->dmm_state_init = brymen_bm52x_state_init;
+				dmm->dmm_state_free = brymen_bm52x_state_free;
+				dmm->config_get = brymen_bm52x_config_get;
+				dmm->config_set = brymen_bm52x_config_set;
+				dmm->config_list = brymen_bm52x_config_list;
+				dmm->acquire_start = brymen_bm52x_acquire_start;
+			}
+			if (dmm->dmm_state_init && !dmm->dmm_state)
+				dmm->dmm_state = dmm->dmm_state_init();
+
+			/* Determine the (optionally device dependent) channels. */
+			dmm->channel_count = 1;
+			if (dmm->packet_parse == sr_brymen_bm52x_parse)
+				dmm->channel_count = BRYMEN_BM52X_DISPLAY_COUNT;
+			if (dmm->packet_parse == sr_brymen_bm86x_parse)
+				dmm->channel_count = BRYMEN_BM86X_DISPLAY_COUNT;
+			if (dmm->packet_parse == sr_eev121gw_3displays_parse) {
+				dmm->channel_count = EEV121GW_DISPLAY_COUNT;
+				dmm->channel_formats = eev121gw_channel_formats;
+			}
+			if (dmm->packet_parse == sr_metex14_4packets_parse)
+				dmm->channel_count = 4;
+			if (dmm->packet_parse == sr_ms2115b_parse) {
+				dmm->channel_count = MS2115B_DISPLAY_COUNT;
+				dmm->channel_formats = ms2115b_channel_formats;
+			}
+		}
 
-scan_cleanup:
-	serial_close(serial);
+		/* Setup the device instance. */
+		sdi = g_malloc0(sizeof(*sdi));
+		sdi->status = SR_ST_INACTIVE;
+		sdi->vendor = g_strdup(dmm->vendor);
+		sdi->model = g_strdup(dmm->device);
+		devc = g_malloc0(sizeof(*devc));
+		sr_sw_limits_init(&devc->limits);
+		sdi->inst_type = SR_INST_SERIAL;
+		sdi->conn = jobs[i].serial;
+		sdi->priv = devc;
+
+		for (ch_idx = 0; ch_idx < dmm->channel_count; ch_idx++) {
+			size_t ch_num;
+			const char *fmt;
+			fmt = "P%zu";
+			if (dmm->channel_formats && dmm->channel_formats[ch_idx])
+				fmt = dmm->channel_formats[ch_idx];
+			ch_num = ch_idx + 1;
+			snprintf(ch_name, sizeof(ch_name), fmt, ch_num);
+			sr_channel_new(sdi, ch_idx, SR_CHANNEL_ANALOG, TRUE, ch_name);
+		}
+
+		/* Add found device to result set. */
+		devices = g_slist_append(devices, sdi);
+	}
+	g_free(jobs);
+	g_strfreev(ports);
 
 	return std_scan_complete(di, devices);
 }
@@ -268,13 +393,14 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct sr_serial_dev_inst *serial;
 
 	devc = sdi->priv;
+	dmm = (struct dmm_info *)sdi->driver;
+	devc->framing = dmm_framing_lookup(dmm);
 
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
 	cb_func = receive_data;
 	cb_data = (void *)sdi;
-	dmm = (struct dmm_info *)sdi->driver;
 	if (dmm && dmm->acquire_start) {
 		ret = dmm->acquire_start(dmm->dmm_state, sdi,
 			&cb_func, &cb_data);
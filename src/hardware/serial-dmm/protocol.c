@@ -100,6 +100,40 @@ static void handle_packet(struct sr_dev_inst *sdi,
 	}
 }
 
+/* Chip parsers which describe the framing of their fixed size packets. */
+static const struct {
+	gboolean (*packet_valid)(const uint8_t *);
+	const struct sr_packet_framing *framing;
+} dmm_framings[] = {
+	{ sr_dtm0660_packet_valid, &sr_dtm0660_framing, },
+	{ sr_fs9721_packet_valid, &sr_fs9721_framing, },
+	{ sr_fs9922_packet_valid, &sr_fs9922_framing, },
+	{ sr_metex14_packet_valid, &sr_metex14_framing, },
+	{ sr_ut372_packet_valid, &sr_ut372_framing, },
+	{ sr_ut71x_packet_valid, &sr_ut71x_framing, },
+	{ sr_vc870_packet_valid, &sr_vc870_framing, },
+};
+
+/** Lookup the packet framing of a DMM's chip parser, if it has one. */
+SR_PRIV const struct sr_packet_framing *dmm_framing_lookup(
+	const struct dmm_info *dmm)
+{
+	size_t i;
+
+	if (!dmm || !dmm->packet_valid || dmm->packet_valid_len)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(dmm_framings); i++) {
+		if (dmm_framings[i].packet_valid != dmm->packet_valid)
+			continue;
+		if (dmm_framings[i].framing->packet_size != dmm->packet_size)
+			return NULL;
+		return dmm_framings[i].framing;
+	}
+
+	return NULL;
+}
+
 /** Request packet, if required. */
 SR_PRIV int req_packet(struct sr_dev_inst *sdi)
 {
@@ -176,6 +210,18 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 			break;
 		sr_dbg("Checking: pos %zu, len %zu.", check_pos, check_len);
 
+		/*
+		 * Skip positions which cannot start a packet. Candidates
+		 * which still lack receive data stop the search.
+		 */
+		if (devc->framing) {
+			check_pos += sr_packet_framing_skip(devc->framing,
+				&devc->buf[check_pos], check_len);
+			check_len = devc->buflen - check_pos;
+			if (check_len < dmm->packet_size)
+				break;
+		}
+
 		/* Is it a valid packet? */
 		check_ptr = &devc->buf[check_pos];
 		if (dmm->packet_valid_len) {
@@ -93,8 +93,13 @@ struct dev_context {
 	 * Used only if device needs polling.
 	 */
 	uint64_t req_next_at;
+
+	/** (Optional) Packet framing of the chip parser. */
+	const struct sr_packet_framing *framing;
 };
 
+SR_PRIV const struct sr_packet_framing *dmm_framing_lookup(
+	const struct dmm_info *dmm);
 SR_PRIV int req_packet(struct sr_dev_inst *sdi);
 SR_PRIV int receive_data(int fd, int revents, void *cb_data);
 
@@ -314,6 +314,8 @@ static int siglent_sds_read_header(struct sr_dev_inst *sdi)
 	struct sr_scpi_dev_inst *scpi = sdi->conn;
 	struct dev_context *devc = sdi->priv;
 	char *buf = (char *)devc->buffer;
+	const char *block;
+	size_t header_length, block_length;
 	int ret, desc_length;
 	int block_offset = 15; /* Offset for descriptor block. */
 	long data_length = 0;
@@ -326,6 +328,16 @@ static int siglent_sds_read_header(struct sr_dev_inst *sdi)
 	}
 	sr_dbg("Device returned %i bytes.", ret);
 	devc->num_header_bytes += ret;
+
+	/* The definite length block header ends where the descriptor starts. */
+	block = memchr(buf, '#', block_offset);
+	if (!block || sr_scpi_parse_block_header(block, buf + block_offset - block,
+			&header_length, &block_length) != SR_OK ||
+			block + header_length != buf + block_offset) {
+		sr_err("Received invalid data block header '%.*s'.",
+			block_offset, buf);
+		return SR_ERR;
+	}
 	buf += block_offset; /* Skip to start descriptor block. */
 
 	/* Parse WaveDescriptor header. */
@@ -335,7 +347,9 @@ static int siglent_sds_read_header(struct sr_dev_inst *sdi)
 	devc->block_header_size = desc_length + 15;
 	devc->num_samples = data_length;
 
-	sr_dbg("Received data block header: '%s' -> block length %d.", buf, ret);
+	sr_dbg("Received data block header: block length %zu, "
+		"descriptor length %d, data length %ld.",
+		block_length, desc_length, data_length);
 
 	return ret;
 }
@@ -345,14 +359,14 @@ static int siglent_sds_get_digital(const struct sr_dev_inst *sdi, struct sr_chan
 	struct sr_scpi_dev_inst *scpi = sdi->conn;
 	struct dev_context *devc = sdi->priv;
 	GArray *tmp_samplebuf; /* Temp buffer while iterating over the scope samples */
-	char *buf = (char *)devc->buffer; /* Buffer from scope */
 	uint8_t tmp_value; /* Holding temp value from data */
-	GArray *data_low_channels, *data_high_channels, *buffdata;
+	GArray *data_low_channels, *data_high_channels;
 	GSList *l;
 	gboolean low_channels; /* Lower channels enabled */
 	gboolean high_channels; /* Higher channels enabled */
 	int len, channel_index;
 	uint64_t samples_index;
+	size_t size;
 
 	len = 0;
 	channel_index = 0;
@@ -368,18 +382,14 @@ static int siglent_sds_get_digital(const struct sr_dev_inst *sdi, struct sr_chan
 			if (ch->enabled) {
 				if (sr_scpi_send(sdi->conn, "D%d:WF? DAT2", ch->index) != SR_OK)
 					return SR_ERR;
-				if (sr_scpi_read_begin(scpi) != SR_OK)
-					return TRUE;
-				len = sr_scpi_read_data(scpi, buf, -1);
-				if (len < 0)
+				/* Receive the data block right into the sample buffer. */
+				if (sr_scpi_read_block(scpi, NULL, devc->buffer,
+						devc->model->series->buffer_samples, &size) != SR_OK)
 					return TRUE;
-				len -= 15;
-				buffdata = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len);
-				buf += 15; /* Skipping the data header. */
-				g_array_append_vals(buffdata, buf, len);
+				len = size;
 				tmp_samplebuf = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len); /* New temp buffer. */
-				for (uint64_t cur_sample_index = 0; cur_sample_index < devc->memory_depth_digital; cur_sample_index++) {
-					char sample = (char)g_array_index(buffdata, uint8_t, cur_sample_index);
+				for (uint64_t cur_sample_index = 0; cur_sample_index < MIN(devc->memory_depth_digital, size); cur_sample_index++) {
+					char sample = (char)devc->buffer[cur_sample_index];
 					for (int ii = 0; ii < 8; ii++, sample >>= 1) {
 						if (ch->index < 8) {
 							channel_index = ch->index;
@@ -426,7 +436,6 @@ static int siglent_sds_get_digital(const struct sr_dev_inst *sdi, struct sr_chan
 						g_array_append_val(data_high_channels, value);
 				}
 				g_array_free(tmp_samplebuf, TRUE);
-				g_array_free(buffdata, TRUE);
 			}
 		}
 	}
@@ -470,6 +479,7 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 	struct sr_datafeed_logic logic;
 	struct sr_channel *ch;
 	int len, i;
+	uint64_t remaining;
 	float wait;
 	gboolean read_complete = FALSE;
 
@@ -559,46 +569,37 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 
 			do {
 				read_complete = FALSE;
-				if (devc->num_block_bytes > devc->num_samples) {
-					/* We received all data as one block. */
-					/* Offset the data block buffer past the IEEE header and description header. */
-					devc->buffer += devc->block_header_size;
-					len = devc->num_samples;
-				} else {
-					sr_dbg("Requesting: %" PRIu64 " bytes.", devc->num_samples - devc->num_block_bytes);
-					len = sr_scpi_read_data(scpi, (char *)devc->buffer, devc->num_samples-devc->num_block_bytes);
-					if (len == -1) {
-						sr_err("Read error, aborting capture.");
-						std_session_send_df_frame_end(sdi);
-						sdi->driver->dev_acquisition_stop(sdi);
-						return TRUE;
-					}
-					devc->num_block_read++;
-					devc->num_block_bytes += len;
+				/* Read as much of the remaining samples as the buffer takes. */
+				remaining = devc->num_samples + SIGLENT_HEADER_SIZE - devc->num_block_bytes;
+				remaining = MIN(remaining, (uint64_t)devc->model->series->buffer_samples);
+				sr_dbg("Requesting: %" PRIu64 " bytes.", remaining);
+				len = sr_scpi_read_data(scpi, (char *)devc->buffer, remaining);
+				if (len == -1) {
+					sr_err("Read error, aborting capture.");
+					std_session_send_df_frame_end(sdi);
+					sdi->driver->dev_acquisition_stop(sdi);
+					return TRUE;
 				}
+				devc->num_block_read++;
+				devc->num_block_bytes += len;
 				sr_dbg("Received block: %i, %d bytes.", devc->num_block_read, len);
 				if (ch->type == SR_CHANNEL_ANALOG) {
 					float vdiv = devc->vdiv[ch->index];
 					float offset = devc->vert_offset[ch->index];
-					GArray *float_data;
-					static GArray *data;
 					float voltage, vdivlog;
 					int digits;
 
-					data = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len);
-					g_array_append_vals(data, devc->buffer, len);
-					float_data = g_array_new(FALSE, FALSE, sizeof(float));
+					/* Convert the samples in place of the receive buffer. */
 					for (i = 0; i < len; i++) {
-						voltage = (float)g_array_index(data, int8_t, i) / 25;
-						voltage = ((vdiv * voltage) - offset);
-						g_array_append_val(float_data, voltage);
+						voltage = (float)(int8_t)devc->buffer[i] / 25;
+						devc->data[i] = (vdiv * voltage) - offset;
 					}
 					vdivlog = log10f(vdiv);
 					digits = -(int) vdivlog + (vdivlog < 0.0);
 					sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
 					analog.meaning->channels = g_slist_append(NULL, ch);
-					analog.num_samples = float_data->len;
-					analog.data = (float *)float_data->data;
+					analog.num_samples = len;
+					analog.data = devc->data;
 					analog.meaning->mq = SR_MQ_VOLTAGE;
 					analog.meaning->unit = SR_UNIT_VOLT;
 					analog.meaning->mqflags = 0;
@@ -606,7 +607,6 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 					packet.payload = &analog;
 					sr_session_send(sdi, &packet);
 					g_slist_free(analog.meaning->channels);
-					g_array_free(data, TRUE);
 				}
 				len = 0;
 				if (devc->num_samples == (devc->num_block_bytes - SIGLENT_HEADER_SIZE)) {
@@ -160,7 +160,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	}
 
 	/* List all libusb devices. */
-	num_devs = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	num_devs = sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	if (num_devs < 0) {
 		sr_err("Failed to list USB devices: %s.",
 			libusb_error_name(num_devs));
@@ -485,64 +485,31 @@ static int config_channel_set(const struct sr_dev_inst *sdi,
 /* Derive trigger masks from the session's trigger configuration. */
 static int prepare_trigger_masks(const struct sr_dev_inst *sdi)
 {
-	uint64_t trigger_mask, trigger_values, trigger_edge_mask;
-	uint64_t level_bit, type_bit;
 	struct dev_context *devc;
-	struct sr_trigger *trigger;
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	const GSList *node;
-	int idx;
-	enum sr_trigger_matches trg;
+	struct sr_trigger_hw_caps caps;
+	struct sr_trigger_hw_stage stage;
+	int num_stages, ret;
 
 	devc = sdi->priv;
 
-	trigger = sr_session_trigger_get(sdi->session);
-	if (!trigger || !trigger->stages)
-		return SR_OK;
-
-	if (trigger->stages->next) {
-		sr_err("This device only supports 1 trigger stage.");
-		return SR_ERR_ARG;
-	}
-	stage = trigger->stages->data;
-
-	trigger_mask = 0;
-	trigger_values = 0;
-	trigger_edge_mask = 0;
-
-	for (node = stage->matches; node; node = node->next) {
-		match = node->data;
-
-		if (!match->channel->enabled)
-			continue; /* Ignore disabled channel. */
+	caps.max_stages = 1;
+	caps.num_channels = devc->model->num_channels;
+	caps.matches = (1 << SR_TRIGGER_ZERO) | (1 << SR_TRIGGER_ONE)
+		| (1 << SR_TRIGGER_RISING) | (1 << SR_TRIGGER_FALLING);
+	caps.max_edges = 0;
 
-		idx = match->channel->index;
-		trg = match->match;
+	ret = sr_trigger_hw_compile(sr_session_trigger_get(sdi->session),
+		&caps, &stage, &num_stages);
+	if (ret == SR_ERR_NA)
+		sr_err("The device cannot evaluate this trigger.");
+	if (ret != SR_OK)
+		return ret;
+	if (!num_stages)
+		return SR_OK;
 
-		if (idx < 0 || idx >= devc->model->num_channels) {
-			sr_err("Channel index %d out of range.", idx);
-			return SR_ERR_BUG; /* Should not happen. */
-		}
-		if (trg != SR_TRIGGER_ZERO
-				&& trg != SR_TRIGGER_ONE
-				&& trg != SR_TRIGGER_RISING
-				&& trg != SR_TRIGGER_FALLING) {
-			sr_err("Unsupported trigger match for CH%d.", idx + 1);
-			return SR_ERR_ARG;
-		}
-		level_bit = (trg == SR_TRIGGER_ONE
-			|| trg == SR_TRIGGER_RISING) ? 1 : 0;
-		type_bit = (trg == SR_TRIGGER_RISING
-			|| trg == SR_TRIGGER_FALLING) ? 1 : 0;
-
-		trigger_mask |= UINT64_C(1) << idx;
-		trigger_values |= level_bit << idx;
-		trigger_edge_mask |= type_bit << idx;
-	}
-	devc->trigger_mask = trigger_mask;
-	devc->trigger_values = trigger_values;
-	devc->trigger_edge_mask = trigger_edge_mask;
+	devc->trigger_mask = stage.mask;
+	devc->trigger_values = stage.values;
+	devc->trigger_edge_mask = stage.edge_mask;
 
 	return SR_OK;
 }
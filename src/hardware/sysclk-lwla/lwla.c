@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include <libsigrok-internal.h>
@@ -33,41 +34,37 @@
 static unsigned char *load_bitstream(struct sr_context *ctx,
 				     const char *name, int *length_p)
 {
-	struct sr_resource rbf;
+	GBytes *rbf;
+	const unsigned char *data;
 	unsigned char *stream;
-	ssize_t length, count;
+	size_t size, length;
 
-	if (sr_resource_open(ctx, &rbf, SR_RESOURCE_FIRMWARE, name) != SR_OK)
+	rbf = sr_resource_load_bytes(ctx, SR_RESOURCE_FIRMWARE, name,
+				     BITSTREAM_MAX_SIZE);
+	if (!rbf)
 		return NULL;
+	data = g_bytes_get_data(rbf, &size);
 
-	if (rbf.size == 0 || rbf.size > BITSTREAM_MAX_SIZE) {
-		sr_err("Refusing to load bitstream of unreasonable size "
-		       "(%" PRIu64 " bytes).", rbf.size);
-		sr_resource_close(ctx, &rbf);
+	if (size == 0) {
+		sr_err("Refusing to load empty bitstream '%s'.", name);
+		g_bytes_unref(rbf);
 		return NULL;
 	}
 
 	/* The message length includes the 4-byte header. */
-	length = BITSTREAM_HEADER_SIZE + rbf.size;
+	length = BITSTREAM_HEADER_SIZE + size;
 	stream = g_try_malloc(length);
 	if (!stream) {
 		sr_err("Failed to allocate bitstream buffer.");
-		sr_resource_close(ctx, &rbf);
+		g_bytes_unref(rbf);
 		return NULL;
 	}
 
 	/* Write the message length header. */
 	*(uint32_t *)stream = GUINT32_TO_BE(length);
 
-	count = sr_resource_read(ctx, &rbf, stream + BITSTREAM_HEADER_SIZE,
-				 length - BITSTREAM_HEADER_SIZE);
-	sr_resource_close(ctx, &rbf);
-
-	if (count != length - BITSTREAM_HEADER_SIZE) {
-		sr_err("Failed to read bitstream '%s'.", name);
-		g_free(stream);
-		return NULL;
-	}
+	memcpy(stream + BITSTREAM_HEADER_SIZE, data, size);
+	g_bytes_unref(rbf);
 
 	*length_p = length;
 	return stream;
@@ -68,6 +68,8 @@ struct sr_usb_dev_inst;
  * and memory granularity.
  */
 #define PACKET_SIZE		(5000 * 4 * 5)
+/* Maximum number of runs per run-length encoded session packet. */
+#define PACKET_RUNS		4096
 
 /** LWLA protocol command ID codes. */
 enum command_id {
@@ -116,12 +118,14 @@ struct acquisition_state {
 	unsigned int mem_addr_fill;	/* capture memory fill level */
 	unsigned int mem_addr_done;	/* next address to be processed */
 	unsigned int mem_addr_next;	/* start address for next async read */
+	unsigned int mem_addr_recv;	/* end address of block being decoded */
 	unsigned int mem_addr_stop;	/* end of memory range to be read */
 	unsigned int in_index;		/* position in read transfer buffer */
 	unsigned int out_index;		/* position in logic packet buffer */
 	enum rle_state rle;		/* RLE decoding state */
 
 	gboolean rle_enabled;	/* capturing in timing-state mode */
+	gboolean out_rle;	/* logic packet buffer holds runs */
 	gboolean clock_boost;	/* switch to faster clock during capture */
 	unsigned int status;	/* last received device status */
 
@@ -129,9 +133,12 @@ struct acquisition_state {
 	unsigned int reg_seq_len;	/* length of register/value sequence */
 
 	struct regval reg_sequence[MAX_REG_SEQ_LEN];	/* register buffer */
+	uint32_t *in_buf;	/* received block being decoded */
 	uint32_t xfer_buf_in[MAX_ACQ_RECV_LEN32];	/* USB in buffer */
+	uint32_t xfer_buf_ahead[MAX_ACQ_RECV_LEN32];	/* read-ahead buffer */
 	uint16_t xfer_buf_out[MAX_ACQ_SEND_LEN16];	/* USB out buffer */
 	uint8_t out_packet[PACKET_SIZE];		/* logic payload */
+	uint64_t out_run_len[PACKET_RUNS];	/* run lengths if out_rle */
 };
 
 static inline void lwla_queue_regval(struct acquisition_state *acq,
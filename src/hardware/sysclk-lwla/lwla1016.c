@@ -95,7 +95,7 @@ static void read_response(struct acquisition_state *acq)
 	unsigned int max_samples, run_samples;
 	unsigned int i;
 
-	words_left = MIN(acq->mem_addr_next, acq->mem_addr_stop)
+	words_left = MIN(acq->mem_addr_recv, acq->mem_addr_stop)
 			- acq->mem_addr_done;
 	/* Calculate number of samples to write into packet. */
 	max_samples = MIN(acq->samples_max - acq->samples_done,
@@ -110,7 +110,7 @@ static void read_response(struct acquisition_state *acq)
 	 * alignment is guaranteed.
 	 */
 	out_p = (uint32_t *)&acq->out_packet[acq->out_index * UNIT_SIZE];
-	in_p = &acq->xfer_buf_in[acq->in_index];
+	in_p = &acq->in_buf[acq->in_index];
 	/*
 	 * Transfer two samples at a time, taking care to swap the 16-bit
 	 * halves of each input word but keeping the samples themselves in
@@ -125,38 +125,48 @@ static void read_response(struct acquisition_state *acq)
 	acq->samples_done += run_samples;
 }
 
-/* Demangle and decompress incoming sample data from the transfer buffer. */
+/* Collect the runs of compressed sample data from the transfer buffer,
+ * merging runs of the same value, without expanding them to samples.
+ */
 static void read_response_rle(struct acquisition_state *acq)
 {
 	uint32_t *in_p;
-	uint16_t *out_p;
-	unsigned int words_left, max_samples, run_samples, wi, ri;
+	uint16_t *values;
+	unsigned int words_left, wi;
+	uint64_t max_samples, run_samples;
 	uint32_t word;
 	uint16_t sample;
 
-	words_left = MIN(acq->mem_addr_next, acq->mem_addr_stop)
+	words_left = MIN(acq->mem_addr_recv, acq->mem_addr_stop)
 			- acq->mem_addr_done;
-	in_p = &acq->xfer_buf_in[acq->in_index];
+	in_p = &acq->in_buf[acq->in_index];
+	values = (uint16_t *)acq->out_packet;
 
 	for (wi = 0;; wi++) {
-		/* Calculate number of samples to write into packet. */
-		max_samples = MIN(acq->samples_max - acq->samples_done,
-				  PACKET_SIZE / UNIT_SIZE - acq->out_index);
+		/* Calculate number of samples to add to the packet. */
+		max_samples = acq->samples_max - acq->samples_done;
 		run_samples = MIN(max_samples, acq->run_len);
 
-		/* Expand run-length samples into session packet. */
+		/* Extend the last run, or start a new one. */
 		sample = GUINT16_TO_LE(acq->sample);
-		out_p = &((uint16_t *)acq->out_packet)[acq->out_index];
-
-		for (ri = 0; ri < run_samples; ri++)
-			out_p[ri] = sample;
+		if (run_samples > 0) {
+			if (acq->out_index > 0
+					&& values[acq->out_index - 1] == sample) {
+				acq->out_run_len[acq->out_index - 1] += run_samples;
+			} else {
+				values[acq->out_index] = sample;
+				acq->out_run_len[acq->out_index] = run_samples;
+				acq->out_index++;
+			}
+		}
 
 		acq->run_len -= run_samples;
-		acq->out_index += run_samples;
 		acq->samples_done += run_samples;
 
 		if (run_samples == max_samples)
-			break; /* Packet full or sample limit reached. */
+			break; /* Sample limit reached. */
+		if (acq->out_index == PACKET_RUNS)
+			break; /* Packet full. */
 		if (wi >= words_left)
 			break; /* Done with current transfer. */
 
@@ -406,9 +416,10 @@ static int handle_response(const struct sr_dev_inst *sdi)
 	case STATE_LENGTH_REQUEST:
 		acq->mem_addr_next = READ_START_ADDR;
 		acq->mem_addr_stop = acq->reg_sequence[0].val + READ_START_ADDR - 1;
+		acq->out_rle = acq->rle_enabled;
 		break;
 	case STATE_READ_REQUEST:
-		expect_len = (acq->mem_addr_next - acq->mem_addr_done
+		expect_len = (acq->mem_addr_recv - acq->mem_addr_done
 				+ acq->in_index) * sizeof(acq->xfer_buf_in[0]);
 		if (acq->xfer_in->actual_length != expect_len) {
 			sr_err("Received size %d does not match expected size %d.",
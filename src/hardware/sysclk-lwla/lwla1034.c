@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include "lwla.h"
 #include "protocol.h"
 
@@ -183,19 +184,41 @@ static inline uint64_t bulk_long_get(const struct acquisition_state *acq,
 	return (high << 32) | low;
 }
 
+/* Fill the packet with a run of one sample. The sample is stored once,
+ * then the filled part is copied onto the rest, doubling it each time.
+ */
+static void expand_run(uint8_t *out_p, uint64_t sample, unsigned int count)
+{
+	size_t filled, total, len;
+
+	if (count == 0)
+		return;
+
+	out_p[0] =  sample        & 0xFF;
+	out_p[1] = (sample >>  8) & 0xFF;
+	out_p[2] = (sample >> 16) & 0xFF;
+	out_p[3] = (sample >> 24) & 0xFF;
+	out_p[4] = (sample >> 32) & 0xFF;
+
+	total = (size_t)count * UNIT_SIZE;
+	for (filled = UNIT_SIZE; filled < total; filled += len) {
+		len = MIN(filled, total - filled);
+		memcpy(out_p + filled, out_p, len);
+	}
+}
+
 /* Demangle and decompress incoming sample data from the transfer buffer.
  * The data chunk is taken from the acquisition state, and is expected to
  * contain a multiple of 8 packed 36-bit words.
  */
 static void read_response(struct acquisition_state *acq)
 {
-	uint64_t sample, high_nibbles, word;
+	uint64_t high_nibbles, word;
 	uint32_t *slice;
-	uint8_t *out_p;
-	unsigned int words_left, max_samples, run_samples, wi, ri, si;
+	unsigned int words_left, max_samples, run_samples, wi, si;
 
 	/* Number of 36-bit words remaining in the transfer buffer. */
-	words_left = MIN(acq->mem_addr_next, acq->mem_addr_stop)
+	words_left = MIN(acq->mem_addr_recv, acq->mem_addr_stop)
 			- acq->mem_addr_done;
 
 	for (wi = 0;; wi++) {
@@ -205,17 +228,8 @@ static void read_response(struct acquisition_state *acq)
 		run_samples = MIN(max_samples, acq->run_len);
 
 		/* Expand run-length samples into session packet. */
-		sample = acq->sample;
-		out_p = &acq->out_packet[acq->out_index * UNIT_SIZE];
-
-		for (ri = 0; ri < run_samples; ri++) {
-			out_p[0] =  sample        & 0xFF;
-			out_p[1] = (sample >>  8) & 0xFF;
-			out_p[2] = (sample >> 16) & 0xFF;
-			out_p[3] = (sample >> 24) & 0xFF;
-			out_p[4] = (sample >> 32) & 0xFF;
-			out_p += UNIT_SIZE;
-		}
+		expand_run(&acq->out_packet[acq->out_index * UNIT_SIZE],
+			   acq->sample, run_samples);
 		acq->run_len -= run_samples;
 		acq->out_index += run_samples;
 		acq->samples_done += run_samples;
@@ -226,7 +240,7 @@ static void read_response(struct acquisition_state *acq)
 			break; /* Done with current transfer. */
 
 		/* Get the current slice of 8 packed 36-bit words. */
-		slice = &acq->xfer_buf_in[(acq->in_index + wi) / 8 * 9];
+		slice = &acq->in_buf[(acq->in_index + wi) / 8 * 9];
 		si = (acq->in_index + wi) % 8; /* Word index within slice. */
 
 		/* Extract the next 36-bit word. */
@@ -527,7 +541,7 @@ static int handle_response(const struct sr_dev_inst *sdi)
 	case STATE_READ_REQUEST:
 		/* Expect a multiple of 8 36-bit words packed into 9 32-bit
 		 * words. */
-		expect_len = (acq->mem_addr_next - acq->mem_addr_done
+		expect_len = (acq->mem_addr_recv - acq->mem_addr_done
 			+ acq->in_index + 7) / 8 * 9 * sizeof(acq->xfer_buf_in[0]);
 
 		if (acq->xfer_in->actual_length != expect_len) {
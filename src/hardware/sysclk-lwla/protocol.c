@@ -23,12 +23,14 @@
 #include "lwla.h"
 
 /* Submit an already filled-in USB transfer. */
-static int submit_transfer(struct dev_context *devc,
+static int submit_transfer(const struct sr_dev_inst *sdi,
 			   struct libusb_transfer *xfer)
 {
+	struct dev_context *devc;
 	int ret;
 
-	ret = libusb_submit_transfer(xfer);
+	devc = sdi->priv;
+	ret = sr_usb_submit_transfer(sdi, xfer);
 
 	if (ret != 0) {
 		sr_err("Submit transfer failed: %s.", libusb_error_name(ret));
@@ -115,7 +117,7 @@ static int submit_request(const struct sr_dev_inst *sdi,
 			next_reg_write(acq);
 	}
 
-	return submit_transfer(devc, acq->xfer_out);
+	return submit_transfer(sdi, acq->xfer_out);
 }
 
 /* Evaluate and act on the response to a capture status request. */
@@ -184,26 +186,65 @@ static void handle_length_response(const struct sr_dev_inst *sdi)
 	submit_request(sdi, STATE_READ_PREPARE);
 }
 
-/* Evaluate and act on the response to a capture memory read request. */
-static void handle_read_response(const struct sr_dev_inst *sdi)
+/* Send off the accumulated samples or runs as one session packet. */
+static void send_out_packet(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct acquisition_state *acq;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	unsigned int end_addr;
+	struct sr_datafeed_logic_rle rle;
+	uint16_t unitsize;
 
 	devc = sdi->priv;
 	acq = devc->acquisition;
+	unitsize = (devc->model->num_channels + 7) / 8;
+
+	if (acq->out_rle) {
+		packet.type = SR_DF_LOGIC_RLE;
+		packet.payload = &rle;
+		rle.num_runs = acq->out_index;
+		rle.unitsize = unitsize;
+		rle.values = acq->out_packet;
+		rle.run_lengths = acq->out_run_len;
+	} else {
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = acq->out_index * unitsize;
+		logic.unitsize = unitsize;
+		logic.data = acq->out_packet;
+	}
+	sr_session_send(sdi, &packet);
+	acq->out_index = 0;
+}
+
+/* Check whether another block of capture memory is to be read. */
+static gboolean more_to_read(const struct dev_context *devc)
+{
+	const struct acquisition_state *acq = devc->acquisition;
 
-	/* Prepare session packet. */
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = (devc->model->num_channels + 7) / 8;
-	logic.data = acq->out_packet;
+	return !devc->cancel_requested
+		&& acq->samples_done < acq->samples_max
+		&& acq->mem_addr_next < acq->mem_addr_stop;
+}
 
-	end_addr = MIN(acq->mem_addr_next, acq->mem_addr_stop);
+/* Evaluate and act on the response to a capture memory read request. */
+static void handle_read_response(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct acquisition_state *acq;
+	unsigned int end_addr, unitsize;
+	gboolean full, read_ahead;
+
+	devc = sdi->priv;
+	acq = devc->acquisition;
+
+	unitsize = (devc->model->num_channels + 7) / 8;
+	acq->mem_addr_recv = acq->mem_addr_next;
+	end_addr = MIN(acq->mem_addr_recv, acq->mem_addr_stop);
 	acq->in_index = 0;
+	acq->in_buf = (uint32_t *)acq->xfer_in->buffer;
+	read_ahead = FALSE;
 
 	/*
 	 * Repeatedly call the model-specific read response handler until
@@ -217,28 +258,41 @@ static void handle_read_response(const struct sr_dev_inst *sdi)
 			devc->transfer_error = TRUE;
 			return;
 		}
-		if (acq->out_index * logic.unitsize >= PACKET_SIZE) {
+		/*
+		 * Once the block checked out, request the next one into
+		 * the other buffer, so the device gets going on it while
+		 * the rest of this one is decoded.
+		 */
+		if (!read_ahead && more_to_read(devc)) {
+			acq->xfer_in->buffer = (unsigned char *)
+				((acq->in_buf == acq->xfer_buf_in)
+				? acq->xfer_buf_ahead : acq->xfer_buf_in);
+			submit_request(sdi, STATE_READ_REQUEST);
+			read_ahead = TRUE;
+		}
+		if (acq->out_rle)
+			full = acq->out_index >= PACKET_RUNS;
+		else
+			full = acq->out_index * unitsize >= PACKET_SIZE;
+		if (full) {
 			/* Send off full logic packet. */
-			logic.length = acq->out_index * logic.unitsize;
-			sr_session_send(sdi, &packet);
-			acq->out_index = 0;
+			send_out_packet(sdi);
 		}
 	}
 
-	if (!devc->cancel_requested
-			&& acq->samples_done < acq->samples_max
-			&& acq->mem_addr_next < acq->mem_addr_stop) {
+	/* The read ahead block's completion carries on from here. */
+	if (read_ahead)
+		return;
+	if (more_to_read(devc)) {
 		/* Request the next block. */
 		submit_request(sdi, STATE_READ_REQUEST);
 		return;
 	}
+	acq->xfer_in->buffer = (unsigned char *)acq->xfer_buf_in;
 
 	/* Send partially filled packet as it is the last one. */
-	if (!devc->cancel_requested && acq->out_index > 0) {
- 		logic.length = acq->out_index * logic.unitsize;
-		sr_session_send(sdi, &packet);
-		acq->out_index = 0;
-	}
+	if (!devc->cancel_requested && acq->out_index > 0)
+		send_out_packet(sdi);
 	submit_request(sdi, STATE_READ_FINISH);
 }
 
@@ -331,7 +385,7 @@ static void LIBUSB_CALL transfer_out_completed(struct libusb_transfer *transfer)
 
 	/* If this was a read request, wait for the response. */
 	if ((devc->state & STATE_EXPECT_RESPONSE) != 0) {
-		submit_transfer(devc, acq->xfer_in);
+		submit_transfer(sdi, acq->xfer_in);
 		return;
 	}
 	if (acq->reg_seq_pos < acq->reg_seq_len)
@@ -340,7 +394,7 @@ static void LIBUSB_CALL transfer_out_completed(struct libusb_transfer *transfer)
 	/* Repeat until all queued registers have been written. */
 	if (acq->reg_seq_pos < acq->reg_seq_len && !devc->cancel_requested) {
 		next_reg_write(acq);
-		submit_transfer(devc, acq->xfer_out);
+		submit_transfer(sdi, acq->xfer_out);
 		return;
 	}
 
@@ -408,7 +462,7 @@ static void LIBUSB_CALL transfer_in_completed(struct libusb_transfer *transfer)
 		/* Repeat until all queued registers have been read. */
 		if (++acq->reg_seq_pos < acq->reg_seq_len) {
 			next_reg_read(acq);
-			submit_transfer(devc, acq->xfer_out);
+			submit_transfer(sdi, acq->xfer_out);
 			return;
 		}
 	}
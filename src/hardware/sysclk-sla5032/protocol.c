@@ -412,15 +412,26 @@ static int sla5032_get_status(const struct sr_usb_dev_inst *usb, uint32_t status
 	return ret;
 }
 
-static int la_read_samples_data(const struct sr_usb_dev_inst *usb, void *buf,
-		unsigned int len, int *xfer_len)
+/* Completion of a sample data transfer which is in flight. */
+struct data_chunk_read {
+	struct libusb_transfer *xfer;
+	int completed;
+};
+
+static void LIBUSB_CALL data_chunk_read_cb(struct libusb_transfer *xfer)
 {
-	return libusb_bulk_transfer(usb->devhdl, EP_DATA, (uint8_t *)buf, len,
-			xfer_len, USB_DATA_TIMEOUT_MS);
+	struct data_chunk_read *rd;
+
+	rd = xfer->user_data;
+	rd->completed = 1;
 }
 
-static int sla5032_read_data_chunk(const struct sr_usb_dev_inst *usb,
-		void *buf, unsigned int len, int *xfer_len)
+/*
+ * Request another chunk of sample data, and start its transfer. The
+ * caller can process the previous chunk while the transfer is running.
+ */
+static int sla5032_submit_data_chunk(const struct sr_usb_dev_inst *usb,
+		struct data_chunk_read *rd, void *buf, unsigned int len)
 {
 	int ret;
 
@@ -440,7 +451,46 @@ static int sla5032_read_data_chunk(const struct sr_usb_dev_inst *usb,
 	if (ret != SR_OK)
 		return ret;
 
-	return la_read_samples_data(usb, buf, len, xfer_len);
+	libusb_fill_bulk_transfer(rd->xfer, usb->devhdl, EP_DATA,
+		(uint8_t *)buf, len, data_chunk_read_cb, rd,
+		USB_DATA_TIMEOUT_MS);
+	rd->completed = 0;
+	ret = libusb_submit_transfer(rd->xfer);
+	if (ret != 0) {
+		sr_err("Failed to submit data transfer: %s.",
+			libusb_error_name(ret));
+		rd->completed = 1;
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/* Wait for a sample data transfer to complete, optionally cancel it. */
+static int sla5032_wait_data_chunk(struct libusb_context *ctx,
+		struct data_chunk_read *rd, gboolean cancel, int *xfer_len)
+{
+	struct timeval tv;
+
+	if (cancel && !rd->completed)
+		libusb_cancel_transfer(rd->xfer);
+	while (!rd->completed) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 100 * 1000;
+		libusb_handle_events_timeout_completed(ctx, &tv,
+			&rd->completed);
+	}
+
+	if (xfer_len)
+		*xfer_len = rd->xfer->actual_length;
+	if (rd->xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		if (!cancel)
+			sr_err("Failed to read sample data: %s.",
+				libusb_error_name(rd->xfer->status));
+		return SR_ERR;
+	}
+
+	return SR_OK;
 }
 
 static int sla5032_set_read_back(const struct sr_usb_dev_inst *usb)
@@ -687,10 +737,13 @@ SR_PRIV int sla5032_apply_fpga_config(const struct sr_dev_inst *sdi)
 static int la_prepare_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
+	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
-	int i, j, ret, xfer_len;
-	uint8_t *rle_buf, *samples;
+	struct data_chunk_read rd;
+	int i, j, ret, xfer_len, buf_idx;
+	gboolean more;
+	uint8_t *rle_bufs[2], *rle_buf, *samples;
 	const uint8_t *p, *q;
 	uint16_t rle_count;
 	int samples_count, rle_samples_count;
@@ -711,6 +764,7 @@ static int la_prepare_data(int fd, int revents, void *cb_data)
 	(void)revents;
 
 	sdi = cb_data;
+	drvc = sdi->driver->context;
 	devc = sdi->priv;
 	usb = sdi->conn;
 
@@ -736,33 +790,42 @@ static int la_prepare_data(int fd, int revents, void *cb_data)
 		return G_SOURCE_CONTINUE;
 	}
 
-	rle_buf = g_try_malloc(RLE_BUF_SIZE);
-	if (rle_buf == NULL) {
+	/*
+	 * Download sample data in chunks. Have the next chunk's transfer
+	 * run while the previous chunk gets decoded and sent. Alternate
+	 * between two receive buffers in the process.
+	 */
+	rd.xfer = libusb_alloc_transfer(0);
+	rle_bufs[0] = g_try_malloc(RLE_BUF_SIZE);
+	rle_bufs[1] = g_try_malloc(RLE_BUF_SIZE);
+	if (!rd.xfer || !rle_bufs[0] || !rle_bufs[1]) {
 		sla5032_write_reg14_zero(usb);
+		g_free(rle_bufs[0]);
+		g_free(rle_bufs[1]);
+		if (rd.xfer)
+			libusb_free_transfer(rd.xfer);
 		sr_dev_acquisition_stop(sdi);
 		return G_SOURCE_CONTINUE;
 	}
+	rd.completed = 1;
+	ret = sla5032_submit_data_chunk(usb, &rd, rle_bufs[0], RLE_BUF_SIZE);
+	buf_idx = 0;
+	more = ret == SR_OK;
 
-	do {
+	while (more) {
+		rle_buf = rle_bufs[buf_idx];
 		xfer_len = 0;
-		ret = sla5032_read_data_chunk(usb, rle_buf, RLE_BUF_SIZE, &xfer_len);
+		ret = sla5032_wait_data_chunk(drvc->sr_ctx->libusb_ctx, &rd,
+			FALSE, &xfer_len);
 		if (ret != SR_OK) {
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-
 			sr_dbg("acquision done, ret: %d.", ret);
-			return G_SOURCE_CONTINUE;
+			break;
 		}
 
 		sr_dbg("acquision done, xfer_len: %d.", xfer_len);
 
-		if (xfer_len == 0) {
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
-		}
+		if (xfer_len == 0)
+			break;
 
 		p = rle_buf;
 		samples_count = 0;
@@ -785,20 +848,24 @@ static int la_prepare_data(int fd, int revents, void *cb_data)
 
 		if (samples_count == 0) {
 			sr_dbg("acquision done, no samples.");
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
+			break;
+		}
+
+		/* Start the next chunk's transfer before decoding this one. */
+		more = rle_samples_count == RLE_SAMPLES_COUNT;
+		if (more) {
+			buf_idx ^= 1;
+			ret = sla5032_submit_data_chunk(usb, &rd,
+				rle_bufs[buf_idx], RLE_BUF_SIZE);
+			if (ret != SR_OK)
+				more = FALSE;
 		}
 
 		/* Decode RLE */
 		samples = g_try_malloc(samples_count * sizeof(uint32_t));
 		if (!samples) {
 			sr_dbg("memory allocation error.");
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
+			break;
 		}
 
 		p = rle_buf;
@@ -848,7 +915,12 @@ static int la_prepare_data(int fd, int revents, void *cb_data)
 		}
 
 		g_free(samples);
-	} while (rle_samples_count == RLE_SAMPLES_COUNT);
+	}
+
+	/* Don't leave a transfer in flight after errors. */
+	(void)sla5032_wait_data_chunk(drvc->sr_ctx->libusb_ctx, &rd,
+		TRUE, NULL);
+	libusb_free_transfer(rd.xfer);
 
 	sr_dbg("acquision stop, rle_samples_count < RLE_SAMPLES_COUNT.");
 
@@ -856,7 +928,8 @@ static int la_prepare_data(int fd, int revents, void *cb_data)
 
 	sr_dev_acquisition_stop(sdi); /* if all data transfered */
 
-	g_free(rle_buf);
+	g_free(rle_bufs[0]);
+	g_free(rle_bufs[1]);
 
 	if (devc->stl) {
 		soft_trigger_logic_free(devc->stl);
@@ -70,7 +70,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, str);
 	}
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn_devices) {
 			usb = NULL;
@@ -294,7 +294,7 @@ SR_PRIV void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	 * we were just going to send another transfer request anyway. */
 
 	if (sdi->status == SR_ST_ACTIVE) {
-		if ((ret = libusb_submit_transfer(transfer) != 0)) {
+		if ((ret = sr_usb_submit_transfer(sdi, transfer) != 0)) {
 			sr_err("Unable to resubmit transfer: %s.",
 			       libusb_error_name(ret));
 			g_free(transfer->buffer);
@@ -372,7 +372,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	transfer = libusb_alloc_transfer(0);
 	libusb_fill_bulk_transfer(transfer, usb->devhdl, EP_IN, buf,
 			MAX_REPLY_SIZE, receive_transfer, (void *)sdi, 100);
-	if ((ret = libusb_submit_transfer(transfer) != 0)) {
+	if ((ret = sr_usb_submit_transfer(sdi, transfer) != 0)) {
 		sr_err("Unable to submit transfer: %s.", libusb_error_name(ret));
 		libusb_free_transfer(transfer);
 		g_free(buf);
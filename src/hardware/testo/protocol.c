@@ -156,7 +156,7 @@ SR_PRIV int testo_request_packet(const struct sr_dev_inst *sdi)
 	libusb_fill_bulk_transfer(devc->out_transfer, usb->devhdl, EP_OUT,
 			(unsigned char *)devc->model->request, devc->model->request_size,
 			receive_transfer, (void *)sdi, 100);
-	if ((ret = libusb_submit_transfer(devc->out_transfer) != 0)) {
+	if ((ret = sr_usb_submit_transfer(sdi, devc->out_transfer) != 0)) {
 		sr_err("Failed to request packet: %s.", libusb_error_name(ret));
 		sr_dev_acquisition_stop((struct sr_dev_inst *)sdi);
 		return SR_ERR;
@@ -528,9 +528,15 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		ret = ut181a_waitfor_response(sdi, 200);
 		if (ret < 0)
 			return ret;
+		devc->info.rec_data.rec_idx = rec_idx;
 		devc->info.rec_data.samples_total = devc->wait_state.data_value;
 		devc->info.rec_data.samples_curr = 0;
-		ret = ut181a_send_cmd_get_rec_samples(serial, rec_idx, 0);
+		devc->info.rec_data.samples_req = 0;
+		devc->info.rec_data.chunk_size = 0;
+		devc->info.rec_data.pending_count = 0;
+		devc->info.rec_data.resync = FALSE;
+		devc->info.rec_data.progress = 0;
+		ret = ut181a_request_rec_samples(sdi);
 	} else {
 		sr_err("Unhandled data source %d, programming error?",
 			(int)devc->data_source);
@@ -1232,6 +1232,46 @@ SR_PRIV int ut181a_send_cmd_get_rec_samples(struct sr_serial_dev_inst *serial, s
 	return ut181a_send_frame(serial, cmd, sizeof(cmd));
 }
 
+/*
+ * Keep the pipeline of "get recording samples" requests filled. Only
+ * one request is in flight until the chunk size is known. After a chunk
+ * arrived for an unexpected offset, the pipeline drains, and requests
+ * restart at the first sample which is still missing.
+ */
+SR_PRIV int ut181a_request_rec_samples(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct ut181a_info *info;
+	size_t window, off;
+	int ret;
+
+	devc = sdi->priv;
+	info = &devc->info;
+
+	if (info->rec_data.resync) {
+		if (info->rec_data.pending_count)
+			return SR_OK;
+		info->rec_data.resync = FALSE;
+		info->rec_data.samples_req = info->rec_data.samples_curr;
+	}
+
+	window = info->rec_data.chunk_size ? REC_DATA_PIPELINE : 1;
+	while (info->rec_data.pending_count < window &&
+			info->rec_data.samples_req < info->rec_data.samples_total) {
+		off = info->rec_data.samples_req;
+		ret = ut181a_send_cmd_get_rec_samples(sdi->conn,
+			info->rec_data.rec_idx, off);
+		if (ret < 0)
+			return ret;
+		info->rec_data.pending_offs[info->rec_data.pending_count++] = off;
+		if (!info->rec_data.chunk_size)
+			break;
+		info->rec_data.samples_req += info->rec_data.chunk_size;
+	}
+
+	return SR_OK;
+}
+
 /* TODO
  * Construct and transmit "record on/off" command. Requires a caption,
  * an interval, and a duration to start a recording. Recordings can get
@@ -1727,6 +1767,60 @@ static int consume_str(char *buff, size_t sz, const uint8_t **p, size_t *l)
 }
 
 /* Process a DMM packet (a frame in the serial protocol). */
+/*
+ * Account for a received chunk of record data. Returns the number of
+ * leading samples in the chunk which were received before, the whole
+ * chunk's sample count when the chunk cannot get used because samples
+ * before it are missing.
+ */
+static size_t ut181a_rec_data_chunk(struct ut181a_info *info, size_t count)
+{
+	size_t off, skip;
+
+	if (info->rec_data.pending_count) {
+		off = info->rec_data.pending_offs[0];
+		info->rec_data.pending_count--;
+		memmove(&info->rec_data.pending_offs[0],
+			&info->rec_data.pending_offs[1],
+			info->rec_data.pending_count * sizeof(off));
+	} else {
+		off = info->rec_data.samples_curr;
+	}
+
+	if (count > info->rec_data.chunk_size)
+		info->rec_data.chunk_size = count;
+	if (off + count > info->rec_data.samples_req)
+		info->rec_data.samples_req = off + count;
+
+	if (off > info->rec_data.samples_curr) {
+		sr_dbg("Chunk at %zu, expected %zu, re-requesting.",
+			off, info->rec_data.samples_curr);
+		info->rec_data.resync = TRUE;
+		return count;
+	}
+	skip = MIN(info->rec_data.samples_curr - off, count);
+	info->rec_data.samples_curr += count - skip;
+
+	return skip;
+}
+
+/* Send the download progress when its percentage has changed. */
+static void ut181a_rec_data_progress(struct sr_dev_inst *sdi,
+	struct ut181a_info *info)
+{
+	uint64_t progress;
+
+	if (!info->rec_data.samples_total)
+		return;
+	progress = 100 * MIN(info->rec_data.samples_curr,
+		info->rec_data.samples_total) / info->rec_data.samples_total;
+	if (progress == info->rec_data.progress)
+		return;
+	info->rec_data.progress = progress;
+	(void)sr_session_send_meta(sdi, SR_CONF_DOWNLOAD_PROGRESS,
+		g_variant_new_uint64(progress));
+}
+
 static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 {
 	struct dev_context *devc;
@@ -1742,6 +1836,7 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 	struct feed_buffer feedbuff;
 	struct value_params value;
 	const struct mqopt_item *mqitem;
+	size_t rec_skip;
 	int ret;
 	uint8_t v8; uint16_t v16; uint32_t v32; float vf;
 
@@ -2564,7 +2659,13 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 		ret = consume_u8(&info->rec_data.samples_chunk, &payload, &pl_dlen);
 		if (ret != SR_OK)
 			return SR_ERR_DATA;
-		info->rec_data.samples_curr += info->rec_data.samples_chunk;
+		if (!info->rec_data.samples_chunk) {
+			sr_err("Empty chunk of record data.");
+			ut181a_cond_stop_acquisition(sdi);
+			break;
+		}
+		rec_skip = ut181a_rec_data_chunk(info,
+			info->rec_data.samples_chunk);
 		while (info->rec_data.samples_chunk--) {
 			/*
 			 * Implementation detail: Consume all received
@@ -2578,6 +2679,10 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 			if (ret != SR_OK)
 				return SR_ERR_DATA;
 
+			if (rec_skip) {
+				rec_skip--;
+				continue;
+			}
 			if (sdi->status != SR_ST_ACTIVE)
 				continue;
 
@@ -2597,6 +2702,8 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 				return SR_ERR_DATA;
 		}
 		ret = ut181a_feedbuff_cleanup(&feedbuff);
+		if (sdi->status == SR_ST_ACTIVE)
+			ut181a_rec_data_progress(sdi, info);
 		break;
 
 	case RSP_TYPE_REPLY_DATA:
@@ -2667,7 +2774,7 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 				ut181a_cond_stop_acquisition(sdi);
 			break;
 		case RSP_TYPE_REC_DATA:
-			if (!info)
+			if (!info || sdi->status != SR_ST_ACTIVE)
 				break;
 			/*
 			 * The sample count was incremented above during
@@ -2678,8 +2785,7 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 				ut181a_cond_stop_acquisition(sdi);
 				break;
 			}
-			ret = ut181a_send_cmd_get_rec_samples(serial,
-				info->rec_data.rec_idx, info->rec_data.samples_curr);
+			ret = ut181a_request_rec_samples(sdi);
 			if (ret < 0)
 				ut181a_cond_stop_acquisition(sdi);
 			break;
@@ -48,6 +48,15 @@
 #define SEND_BUFF_SIZE 32
 #define SEND_TO_MS 100
 
+/*
+ * Recording downloads keep several "get samples" requests in flight,
+ * each for the chunk after the previously requested one. The device
+ * handles requests in order, so replies map to the requested offsets.
+ * The chunk size is learned from the first reply. A value of 1 gets
+ * the strict request/response sequence.
+ */
+#define REC_DATA_PIPELINE 4
+
 /*
  * The device can hold several recordings, their number is under the
  * user's control and dynamic at runtime. It's assumed that there is an
@@ -356,6 +365,12 @@ struct ut181a_info {
 		size_t samples_total;
 		size_t samples_curr;
 		uint8_t samples_chunk;
+		size_t samples_req;
+		size_t chunk_size;
+		size_t pending_offs[REC_DATA_PIPELINE];
+		size_t pending_count;
+		gboolean resync;
+		uint64_t progress;
 	} rec_data;
 	struct {
 		enum ut181_cmd_code code;
@@ -421,6 +436,7 @@ SR_PRIV int ut181a_send_cmd_get_saved_value(struct sr_serial_dev_inst *serial, s
 SR_PRIV int ut181a_send_cmd_get_recs_count(struct sr_serial_dev_inst *serial);
 SR_PRIV int ut181a_send_cmd_get_rec_info(struct sr_serial_dev_inst *serial, size_t idx);
 SR_PRIV int ut181a_send_cmd_get_rec_samples(struct sr_serial_dev_inst *serial, size_t idx, size_t off);
+SR_PRIV int ut181a_request_rec_samples(const struct sr_dev_inst *sdi);
 
 SR_PRIV int ut181a_configure_waitfor(struct dev_context *devc,
 	gboolean want_code, enum ut181_cmd_code want_data,
@@ -29,6 +29,7 @@ static const char *MANUFACTURER_ID = "YOKOGAWA";
 
 static const uint32_t scanopts[] = {
 	SR_CONF_CONN,
+	SR_CONF_SERIALCOMM,
 };
 
 static const uint32_t drvopts[] = {
@@ -25,6 +25,13 @@
 #define NUM_TRIGGER_STAGES		4
 #define PACKET_SIZE			2048	/* ?? */
 
+/*
+ * Capture memory gets read in blocks of this size, a multiple of
+ * PACKET_SIZE. While one block is transferred, the previous one gets
+ * sent to the session.
+ */
+#define READ_BLOCK_SIZE			(32 * PACKET_SIZE)
+
 //#define ZP_EXPERIMENTAL
 
 struct zp_model {
@@ -179,7 +186,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devices = NULL;
 
 	/* Find all ZEROPLUS analyzers and add them to device list. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist); /* TODO: Errors. */
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist); /* TODO: Errors. */
 
 	for (i = 0; devlist[i]; i++) {
 		libusb_get_device_descriptor(devlist[i], &des);
@@ -415,7 +422,94 @@ static int config_list(uint32_t key, GVariant **data,
 		*data = std_gvar_array_i32(ARRAY_AND_SIZE(trigger_matches));
 		break;
 	case SR_CONF_VOLTAGE_THRESHOLD:
-		*data = std_gvar_min_max_step_thresholds(-6.0, 6.0, 0.1);
+		*data = std_gvar_min_max_step_thresholds(-6.0, 6.0, 0.1struct read_state {
+	unsigned int samples_read;
+	unsigned int valid_samples;
+	unsigned int trigger_offset;
+	unsigned int discard;
+	gboolean done;
+};
+
+/* Send the samples of one block of capture memory, skipping the discarded. */
+static void send_block(const struct sr_dev_inst *sdi, struct read_state *st,
+		unsigned char *buf, unsigned int size)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	unsigned int len;
+	unsigned int buf_offset;
+
+	if (st->done)
+		return;
+
+	if (st->discard >= size / 4) {
+		st->discard -= size / 4;
+		return;
+	}
+
+	len = size - st->discard * 4;
+	buf_offset = st->discard * 4;
+	st->discard = 0;
+
+	/* Check if we've read all the samples */
+	if (st->samples_read + len / 4 >= st->valid_samples) {
+		len = (st->valid_samples - st->samples_read) * 4;
+		st->done = TRUE;
+	}
+	if (!len)
+		return;
+
+	if (st->samples_read < st->trigger_offset &&
+	    st->samples_read + len / 4 > st->trigger_offset) {
+		/* Send out samples remaining before trigger */
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = (st->trigger_offset - st->samples_read) * 4;
+		logic.unitsize = 4;
+		logic.data = buf + buf_offset;
+		sr_session_send(sdi, &packet);
+		len -= logic.length;
+		st->samples_read += logic.length / 4;
+		buf_offset += logic.length;
+	}
+
+	if (st->samples_read == st->trigger_offset)
+		std_session_send_df_trigger(sdi);
+
+	/* Send out data (or data after trigger) */
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = len;
+	logic.unitsize = 4;
+	logic.data = buf + buf_offset;
+	sr_session_send(sdi, &packet);
+	st->samples_read += len / 4;
+}
+
+static void LIBUSB_CALL read_block_done(struct libusb_transfer *transfer)
+{
+	/* Cleared when the transfer got abandoned. */
+	if (transfer->user_data)
+		*(int *)transfer->user_data = 1;
+}
+
+static int wait_block(struct libusb_context *ctx, int *completed)
+{
+	int ret;
+
+	while (!*completed) {
+		ret = libusb_handle_events_completed(ctx, completed);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+			sr_err("Failed to handle USB events: %s.",
+			       libusb_error_name(ret));
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+);
 		break;
 	case SR_CONF_LIMIT_SAMPLES:
 		if (!sdi)
@@ -432,14 +526,15 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	unsigned int samples_read;
-	int res;
-	unsigned int packet_num, n;
-	unsigned char *buf;
+	struct libusb_transfer *transfer;
+	struct read_state st;
+	gboolean in_flight;
+	int completed;
+	unsigned int block, block_size, num_blocks, n;
+	unsigned char *bufs[2];
 	unsigned int status;
 	unsigned int stop_address;
 	unsigned int now_address;
@@ -452,6 +547,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	unsigned int discard;
 	int trigger_now;
 
+	drvc = sdi->driver->context;
 	devc = sdi->priv;
 
 	if (analyzer_add_triggers(sdi) != SR_OK) {
@@ -497,7 +593,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_OK;
 	}
 
-	buf = g_malloc(PACKET_SIZE);
+	block_size = MIN(n, READ_BLOCK_SIZE);
+	num_blocks = n / block_size;
+	bufs[0] = g_malloc(block_size);
+	bufs[1] = g_malloc(block_size);
+	transfer = libusb_alloc_transfer(0);
 
 	/* Check if the trigger is in the samples we are throwing away */
 	trigger_now = now_address == trigger_address ||
@@ -543,60 +643,43 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	/* Recalculate the number of samples available */
 	valid_samples = (stop_address - now_address) % memory_size;
 
-	/* Send the incoming transfer to the session bus. */
-	samples_read = 0;
-	for (packet_num = 0; packet_num < n / PACKET_SIZE; packet_num++) {
-		unsigned int len;
-		unsigned int buf_offset;
-
-		res = analyzer_read_data(usb->devhdl, buf, PACKET_SIZE);
-		if (res != PACKET_SIZE)
-			sr_warn("Tried to read %d bytes, actually read %d.",
-				PACKET_SIZE, res);
-
-		if (discard >= PACKET_SIZE / 4) {
-			discard -= PACKET_SIZE / 4;
-			continue;
-		}
-
-		len = PACKET_SIZE - discard * 4;
-		buf_offset = discard * 4;
-		discard = 0;
-
-		/* Check if we've read all the samples */
-		if (samples_read + len / 4 >= valid_samples)
-			len = (valid_samples - samples_read) * 4;
-		if (!len)
+	/*
+	 * Send the incoming transfer to the session bus. Keep the next
+	 * block in flight while the current one gets sent.
+	 */
+	st.samples_read = 0;
+	st.valid_samples = valid_samples;
+	st.trigger_offset = trigger_offset;
+	st.discard = discard;
+	st.done = FALSE;
+	completed = 0;
+	in_flight = analyzer_read_data_submit(usb->devhdl, transfer, bufs[0],
+			block_size, read_block_done, &completed) >= 0;
+	for (block = 0; in_flight; block++) {
+		if (wait_block(drvc->sr_ctx->libusb_ctx, &completed) != SR_OK)
 			break;
-
-		if (samples_read < trigger_offset &&
-		    samples_read + len / 4 > trigger_offset) {
-			/* Send out samples remaining before trigger */
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = (trigger_offset - samples_read) * 4;
-			logic.unitsize = 4;
-			logic.data = buf + buf_offset;
-			sr_session_send(sdi, &packet);
-			len -= logic.length;
-			samples_read += logic.length / 4;
-			buf_offset += logic.length;
-		}
-
-		if (samples_read == trigger_offset)
-			std_session_send_df_trigger(sdi);
-
-		/* Send out data (or data after trigger) */
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.length = len;
-		logic.unitsize = 4;
-		logic.data = buf + buf_offset;
-		sr_session_send(sdi, &packet);
-		samples_read += len / 4;
+		in_flight = FALSE;
+		if (transfer->actual_length != (int)block_size)
+			sr_warn("Tried to read %d bytes, actually read %d.",
+				block_size, transfer->actual_length);
+		completed = 0;
+		if (block + 1 < num_blocks && !st.done)
+			in_flight = analyzer_read_data_submit(usb->devhdl,
+				transfer, bufs[(block + 1) % 2], block_size,
+				read_block_done, &completed) >= 0;
+		send_block(sdi, &st, bufs[block % 2], block_size);
+	}
+	if (in_flight) {
+		/* Don't free what the transfer may still write to. */
+		transfer->user_data = NULL;
+		libusb_cancel_transfer(transfer);
+		transfer = NULL;
+		bufs[0] = bufs[1] = NULL;
 	}
+	libusb_free_transfer(transfer);
 	analyzer_read_stop(usb->devhdl);
-	g_free(buf);
+	g_free(bufs[0]);
+	g_free(bufs[1]);
 
 	std_session_send_df_end(sdi);
 
@@ -112,6 +112,38 @@ SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
 	return transferred;
 }
 
+/*
+ * Like gl_read_bulk(), but the bulk part completes in the background.
+ * The caller provides the transfer, and waits for cb to be called.
+ */
+SR_PRIV int gl_read_bulk_submit(libusb_device_handle *devh,
+		struct libusb_transfer *transfer, void *buffer,
+		unsigned int size, libusb_transfer_cb_fn cb, void *user_data)
+{
+	unsigned char packet[8] = {
+		0, 0, 0, 0, size & 0xff, (size & 0xff00) >> 8,
+		(size & 0xff0000) >> 16, (size & 0xff000000) >> 24
+	};
+	int ret;
+
+	ret = libusb_control_transfer(devh, CTRL_OUT, 0x4, REQ_READBULK,
+				      0, packet, 8, TIMEOUT_MS);
+	if (ret != 8) {
+		sr_err("%s: libusb_control_transfer: %s.", __func__,
+		       libusb_error_name(ret));
+		return ret < 0 ? ret : LIBUSB_ERROR_IO;
+	}
+
+	libusb_fill_bulk_transfer(transfer, devh, EP1_BULK_IN, buffer, size,
+				  cb, user_data, TIMEOUT_MS);
+	ret = libusb_submit_transfer(transfer);
+	if (ret < 0)
+		sr_err("%s: libusb_submit_transfer: %s.", __func__,
+		       libusb_error_name(ret));
+
+	return ret;
+}
+
 SR_PRIV int gl_reg_write(libusb_device_handle *devh, unsigned int reg,
 		 unsigned int val)
 {
@@ -37,6 +37,9 @@
 
 SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
 			 unsigned int size);
+SR_PRIV int gl_read_bulk_submit(libusb_device_handle *devh,
+		struct libusb_transfer *transfer, void *buffer,
+		unsigned int size, libusb_transfer_cb_fn cb, void *user_data);
 SR_PRIV int gl_reg_write(libusb_device_handle *devh, unsigned int reg,
 			 unsigned int val);
 SR_PRIV int gl_reg_read(libusb_device_handle *devh, unsigned int reg);
@@ -212,6 +212,8 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Power Target", NULL},
 	{SR_CONF_RESISTANCE_TARGET, SR_T_FLOAT, "resistance_target",
 		"Resistance Target", NULL},
+	{SR_CONF_DOWNLOAD_PROGRESS, SR_T_UINT64, "download_progress",
+		"Download Progress", NULL},
 
 	/* Special stuff */
 	{SR_CONF_SESSIONFILE, SR_T_STRING, "sessionfile",
@@ -228,6 +230,24 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Probe factor", NULL},
 	{SR_CONF_ADC_POWERLINE_CYCLES, SR_T_FLOAT, "nplc",
 		"Number of ADC powerline cycles", NULL},
+	{SR_CONF_ADAPTIVE_TRANSFERS, SR_T_BOOL, "adaptive_transfers",
+		"Adaptive USB transfers", NULL},
+	{SR_CONF_NUM_TRANSFERS, SR_T_UINT64, "num_transfers",
+		"Number of USB transfers", NULL},
+	{SR_CONF_TRANSFER_SIZE, SR_T_UINT64, "transfer_size",
+		"USB transfer size", NULL},
+	{SR_CONF_CAPTURE_START_SAMPLE, SR_T_UINT64, "capture_start_sample",
+		"Capture start sample", NULL},
+	{SR_CONF_CAPTURE_CHUNK_SIZE, SR_T_UINT64, "capture_chunk_size",
+		"Capture read size", NULL},
+	{SR_CONF_CAPTURE_UNTHROTTLED, SR_T_BOOL, "capture_unthrottled",
+		"Unthrottled capture", NULL},
+	{SR_CONF_CAPTURE_READ_AHEAD, SR_T_UINT64, "capture_read_ahead",
+		"Capture chunks to read ahead", NULL},
+	{SR_CONF_CAPTURE_SEEK_EDGE, SR_T_BOOL, "capture_seek_edge",
+		"Seek capture to edges", NULL},
+	{SR_CONF_CAPTURE_INTERLEAVE, SR_T_BOOL, "capture_interleave",
+		"Interleave capture channels", NULL},
 
 	/* Acquisition modes, sample limiting */
 	{SR_CONF_LIMIT_MSEC, SR_T_UINT64, "limit_time",
@@ -432,6 +452,9 @@ SR_API int sr_driver_init(struct sr_context *ctx, struct sr_dev_driver *driver)
 
 	/* No log message here, too verbose and not very useful. */
 
+	if ((ret = sr_backends_init(ctx)) != SR_OK)
+		return ret;
+
 	if ((ret = driver->init(driver, ctx)) < 0)
 		sr_err("Failed to initialize the driver: %d.", ret);
 
@@ -570,6 +593,202 @@ SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 	return l;
 }
 
+/* Number of drivers which scan at the same time. */
+#define SCAN_MAX_THREADS 8
+
+struct scan_job {
+	struct sr_dev_driver *driver;
+	GSList *options;
+	GSList *devices;
+	/* Next job which has to run on the same worker, after this one. */
+	struct scan_job *next;
+	gboolean chained;
+};
+
+static void scan_job_thread(gpointer data, gpointer user_data)
+{
+	struct scan_job *job;
+
+	(void)user_data;
+
+	for (job = data; job; job = job->next)
+		job->devices = sr_driver_scan(job->driver, job->options);
+}
+
+/*
+ * Check whether a driver's scan probes serial ports or SCPI resources
+ * (serial, USBTMC, ...), which other drivers would probe as well. All
+ * of these accept SR_CONF_SERIALCOMM as a scan option.
+ */
+static gboolean driver_shares_transport(const struct sr_dev_driver *driver)
+{
+	GArray *opts;
+	gboolean shared;
+	guint i;
+
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+
+	shared = FALSE;
+	for (i = 0; i < opts->len; i++) {
+		if (g_array_index(opts, uint32_t, i) == SR_CONF_SERIALCOMM)
+			shared = TRUE;
+	}
+	g_array_free(opts, TRUE);
+
+	return shared;
+}
+
+/* Check quietly whether a driver accepts all of the scan options. */
+static gboolean driver_takes_options(const struct sr_dev_driver *driver,
+		GSList *options)
+{
+	const struct sr_config *src;
+	GArray *opts;
+	GSList *l;
+	guint i;
+
+	if (!options)
+		return TRUE;
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		for (i = 0; i < opts->len; i++) {
+			if (g_array_index(opts, uint32_t, i) == src->key)
+				break;
+		}
+		if (i == opts->len)
+			break;
+	}
+	g_array_free(opts, TRUE);
+
+	return !l;
+}
+
+/**
+ * Tell several hardware drivers to scan for devices.
+ *
+ * The USB bus is enumerated once and the drivers share the device list,
+ * as well as string descriptors which some of them read. The drivers
+ * scan concurrently, unless the options include SR_CONF_CONN. In that
+ * case the drivers run one after the other, since they would compete
+ * for the same connection. Drivers which probe serial ports or SCPI
+ * resources (those taking SR_CONF_SERIALCOMM) always run one after the
+ * other on a single worker, as they would claim the same ports.
+ *
+ * Drivers which don't support all of the options are skipped, as are
+ * repeated entries of the same driver.
+ *
+ * @param ctx A libsigrok context object allocated by a previous call to
+ *            sr_init(). Must not be NULL.
+ * @param drivers A NULL terminated array of the drivers that should scan,
+ *                or NULL for all drivers that were initialized.
+ * @param options A list of 'struct sr_hwopt' options to pass to the drivers'
+ *                scanners. Can be NULL/empty.
+ *
+ * @return A GSList * of 'struct sr_dev_inst', in the order of the drivers,
+ *         or NULL if no devices were found. This list must be freed by the
+ *         caller using g_slist_free(), but without freeing the data
+ *         pointed to in the list.
+ *
+ * @since 0.6.0
+ */
+SR_API GSList *sr_drivers_scan(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, GSList *options)
+{
+	struct scan_job *jobs, *shared;
+	struct sr_config *src;
+	GThreadPool *pool;
+	GSList *l, *devices;
+	gboolean parallel;
+	size_t i, j, count, threads;
+#ifdef HAVE_LIBUSB_1_0
+	gboolean usb_scan;
+#endif
+
+	if (!ctx) {
+		sr_err("Invalid libsigrok context, can't scan for devices.");
+		return NULL;
+	}
+	if (!drivers)
+		drivers = sr_driver_list(ctx);
+
+	parallel = TRUE;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_CONN)
+			parallel = FALSE;
+	}
+
+	for (count = 0; drivers[count]; count++)
+		;
+	jobs = g_new0(struct scan_job, count);
+	shared = NULL;
+	threads = 0;
+	for (i = 0; i < count; i++) {
+		if (!drivers[i]->context || !driver_takes_options(drivers[i], options))
+			continue;
+		/* A driver's scan must not run concurrently with itself. */
+		for (j = 0; j < i; j++) {
+			if (jobs[j].driver == drivers[i])
+				break;
+		}
+		if (j < i)
+			continue;
+		jobs[i].driver = drivers[i];
+		jobs[i].options = options;
+		/* Chain up drivers sharing a transport behind the first one. */
+		if (parallel && driver_shares_transport(drivers[i])) {
+			if (shared) {
+				shared->next = &jobs[i];
+				shared = &jobs[i];
+				shared->chained = TRUE;
+				continue;
+			}
+			shared = &jobs[i];
+		}
+		threads++;
+	}
+	sr_dbg("Scanning with %zu jobs%s.", threads,
+		parallel ? ", concurrently" : "");
+
+#ifdef HAVE_LIBUSB_1_0
+	/* Another scan which is still running owns the shared snapshot. */
+	usb_scan = sr_usb_scan_begin(ctx) == SR_OK;
+#endif
+
+	threads = parallel ? MIN(threads, SCAN_MAX_THREADS) : 1;
+	pool = NULL;
+	if (threads > 1)
+		pool = g_thread_pool_new(scan_job_thread, NULL,
+			threads, FALSE, NULL);
+	for (i = 0; i < count; i++) {
+		/* Chained jobs run from the job which heads their chain. */
+		if (!jobs[i].driver || jobs[i].chained)
+			continue;
+		if (!pool || !g_thread_pool_push(pool, &jobs[i], NULL))
+			scan_job_thread(&jobs[i], NULL);
+	}
+	if (pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+
+#ifdef HAVE_LIBUSB_1_0
+	if (usb_scan)
+		sr_usb_scan_end(ctx);
+#endif
+
+	devices = NULL;
+	for (i = 0; i < count; i++)
+		devices = g_slist_concat(devices, jobs[i].devices);
+	g_free(jobs);
+
+	sr_dbg("Scan found %u devices.", g_slist_length(devices));
+
+	return devices;
+}
+
 /**
  * Call driver cleanup function for all drivers.
  *
@@ -684,6 +903,9 @@ static void log_key(const struct sr_dev_inst *sdi,
 	/* Don't log SR_CONF_DEVICE_OPTIONS, it's verbose and not too useful. */
 	if (key == SR_CONF_DEVICE_OPTIONS)
 		return;
+	/* Don't print the variant when nobody gets to see it. */
+	if (!sr_log_level_enabled(SR_LOG_SPEW))
+		return;
 
 	opstr = op == SR_CONF_GET ? "get" : op == SR_CONF_SET ? "set" : "list";
 	srci = sr_key_info_get(SR_KEY_CONFIG, key);
@@ -695,32 +917,22 @@ static void log_key(const struct sr_dev_inst *sdi,
 	g_free(tmp_str);
 }
 
-static int check_key(const struct sr_dev_driver *driver,
-		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg,
-		uint32_t key, unsigned int op, GVariant *data)
+static const char *key_suffix(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg)
 {
-	const struct sr_key_info *srci;
-	gsize num_opts, i;
-	GVariant *gvar_opts;
-	const uint32_t *opts;
-	uint32_t pub_opt;
-	const char *suffix;
-	const char *opstr;
-
 	if (sdi && cg)
-		suffix = " for this device instance and channel group";
+		return " for this device instance and channel group";
 	else if (sdi)
-		suffix = " for this device instance";
+		return " for this device instance";
 	else
-		suffix = "";
-
-	if (!(srci = sr_key_info_get(SR_KEY_CONFIG, key))) {
-		sr_err("Invalid key %d.", key);
-		return SR_ERR_ARG;
-	}
-	opstr = op == SR_CONF_GET ? "get" : op == SR_CONF_SET ? "set" : "list";
+		return "";
+}
 
-	switch (key) {
+/* Reject values which are never useful for a key. */
+static int check_key_value(const struct sr_key_info *srci,
+		unsigned int op, GVariant *data)
+{
+	switch (srci->key) {
 	case SR_CONF_LIMIT_MSEC:
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_SAMPLERATE:
@@ -743,26 +955,32 @@ static int check_key(const struct sr_dev_driver *driver,
 		break;
 	}
 
-	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK) {
-		/* Driver publishes no options. */
-		sr_err("No options available%s.", suffix);
-		return SR_ERR_ARG;
-	}
-	opts = g_variant_get_fixed_array(gvar_opts, &num_opts, sizeof(uint32_t));
+	return SR_OK;
+}
+
+/* Check a key against the options which the driver publishes. */
+static int check_key_option(const struct sr_key_info *srci,
+		const uint32_t *opts, gsize num_opts, unsigned int op,
+		const char *suffix)
+{
+	uint32_t pub_opt;
+	const char *opstr;
+	gsize i;
+
 	pub_opt = 0;
 	for (i = 0; i < num_opts; i++) {
-		if ((opts[i] & SR_CONF_MASK) == key) {
+		if ((opts[i] & SR_CONF_MASK) == srci->key) {
 			pub_opt = opts[i];
 			break;
 		}
 	}
-	g_variant_unref(gvar_opts);
 	if (!pub_opt) {
 		sr_err("Option '%s' not available%s.", srci->id, suffix);
 		return SR_ERR_ARG;
 	}
 
 	if (!(pub_opt & op)) {
+		opstr = op == SR_CONF_GET ? "get" : op == SR_CONF_SET ? "set" : "list";
 		sr_err("Option '%s' not available to %s%s.", srci->id, opstr, suffix);
 		return SR_ERR_ARG;
 	}
@@ -770,6 +988,39 @@ static int check_key(const struct sr_dev_driver *driver,
 	return SR_OK;
 }
 
+static int check_key(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg,
+		uint32_t key, unsigned int op, GVariant *data)
+{
+	const struct sr_key_info *srci;
+	gsize num_opts;
+	GVariant *gvar_opts;
+	const uint32_t *opts;
+	const char *suffix;
+	int ret;
+
+	suffix = key_suffix(sdi, cg);
+
+	if (!(srci = sr_key_info_get(SR_KEY_CONFIG, key))) {
+		sr_err("Invalid key %d.", key);
+		return SR_ERR_ARG;
+	}
+
+	if ((ret = check_key_value(srci, op, data)) != SR_OK)
+		return ret;
+
+	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK) {
+		/* Driver publishes no options. */
+		sr_err("No options available%s.", suffix);
+		return SR_ERR_ARG;
+	}
+	opts = g_variant_get_fixed_array(gvar_opts, &num_opts, sizeof(uint32_t));
+	ret = check_key_option(srci, opts, num_opts, op, suffix);
+	g_variant_unref(gvar_opts);
+
+	return ret;
+}
+
 /**
  * Query value of a configuration key at the given driver or device instance.
  *
@@ -830,6 +1081,45 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 	return ret;
 }
 
+/*
+ * Common part of sr_config_set() and the typed setters. The latter have
+ * checked the key's data type already, and create variants of the right
+ * type, so they skip sr_variant_type_check().
+ */
+static int config_set(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, GVariant *data, gboolean type_checked)
+{
+	int ret;
+
+	g_variant_ref_sink(data);
+
+	if (!sdi || !sdi->driver || !sdi->priv || !data)
+		ret = SR_ERR;
+	else if (!sdi->driver->config_set)
+		ret = SR_ERR_ARG;
+	else if (sdi->status != SR_ST_ACTIVE) {
+		sr_err("%s: Device instance not active, can't set config.",
+			sdi->driver->name);
+		ret = SR_ERR_DEV_CLOSED;
+	} else if (check_key(sdi->driver, sdi, cg, key, SR_CONF_SET, data) != SR_OK)
+		ret = SR_ERR_ARG;
+	else if (type_checked || (ret = sr_variant_type_check(key, data)) == SR_OK) {
+		log_key(sdi, cg, key, SR_CONF_SET, data);
+		ret = sdi->driver->config_set(key, data, sdi, cg);
+		/* The options may depend on the key's value. */
+		sr_dev_options_changed(sdi);
+	}
+
+	g_variant_unref(data);
+
+	if (ret == SR_ERR_CHANNEL_GROUP)
+		sr_err("%s: No channel group specified.",
+			(sdi) ? sdi->driver->name : "unknown");
+
+	return ret;
+}
+
 /**
  * Set value of a configuration key in a device instance.
  *
@@ -854,34 +1144,297 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant *data)
 {
-	int ret;
+	return config_set(sdi, cg, key, data, FALSE);
+}
 
-	g_variant_ref_sink(data);
+/**
+ * Set the values of several configuration keys in a device instance.
+ *
+ * This works like calling sr_config_set() for each of the keys in turn,
+ * but the device's options are looked up once for all of them. The keys
+ * are set in the order given. Upon errors, the keys before the failing
+ * one keep their new values, the later ones are not touched.
+ *
+ * @param[in] sdi The device instance. Must not be NULL. sdi->driver and
+ *                sdi->priv must not be NULL either.
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in] configs Array of keys and their new values. The values
+ *                    must not be floating references, the caller keeps
+ *                    its references.
+ * @param[in] count Number of entries in configs.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Error.
+ * @retval SR_ERR_ARG A key is not applicable, or its value is invalid.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_multiple(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *configs, size_t count)
+{
+	const struct sr_key_info *srci;
+	GVariant *gvar_opts;
+	const uint32_t *opts;
+	gsize num_opts;
+	const char *suffix;
+	size_t i;
+	int ret;
 
-	if (!sdi || !sdi->driver || !sdi->priv || !data)
-		ret = SR_ERR;
-	else if (!sdi->driver->config_set)
-		ret = SR_ERR_ARG;
-	else if (sdi->status != SR_ST_ACTIVE) {
+	if (!sdi || !sdi->driver || !sdi->priv || (!configs && count))
+		return SR_ERR;
+	if (!count)
+		return SR_OK;
+	if (!sdi->driver->config_set)
+		return SR_ERR_ARG;
+	if (sdi->status != SR_ST_ACTIVE) {
 		sr_err("%s: Device instance not active, can't set config.",
 			sdi->driver->name);
-		ret = SR_ERR_DEV_CLOSED;
-	} else if (check_key(sdi->driver, sdi, cg, key, SR_CONF_SET, data) != SR_OK)
+		return SR_ERR_DEV_CLOSED;
+	}
+
+	suffix = key_suffix(sdi, cg);
+	if (sr_config_list(sdi->driver, sdi, cg, SR_CONF_DEVICE_OPTIONS,
+			&gvar_opts) != SR_OK) {
+		sr_err("No options available%s.", suffix);
 		return SR_ERR_ARG;
-	else if ((ret = sr_variant_type_check(key, data)) == SR_OK) {
-		log_key(sdi, cg, key, SR_CONF_SET, data);
-		ret = sdi->driver->config_set(key, data, sdi, cg);
 	}
+	opts = g_variant_get_fixed_array(gvar_opts, &num_opts, sizeof(uint32_t));
+
+	ret = SR_OK;
+	for (i = 0; i < count && ret == SR_OK; i++) {
+		if (!configs[i].data) {
+			ret = SR_ERR;
+			break;
+		}
+		if (!(srci = sr_key_info_get(SR_KEY_CONFIG, configs[i].key))) {
+			sr_err("Invalid key %d.", configs[i].key);
+			ret = SR_ERR_ARG;
+			break;
+		}
+		if (check_key_value(srci, SR_CONF_SET, configs[i].data) != SR_OK
+				|| check_key_option(srci, opts, num_opts,
+					SR_CONF_SET, suffix) != SR_OK) {
+			ret = SR_ERR_ARG;
+			break;
+		}
+		if ((ret = sr_variant_type_check(srci->key, configs[i].data)) != SR_OK)
+			break;
+		log_key(sdi, cg, srci->key, SR_CONF_SET, configs[i].data);
+		ret = sdi->driver->config_set(srci->key, configs[i].data, sdi, cg);
+	}
+	sr_dev_options_changed(sdi);
 
-	g_variant_unref(data);
+	g_variant_unref(gvar_opts);
 
 	if (ret == SR_ERR_CHANNEL_GROUP)
-		sr_err("%s: No channel group specified.",
-			(sdi) ? sdi->driver->name : "unknown");
+		sr_err("%s: No channel group specified.", sdi->driver->name);
 
 	return ret;
 }
 
+/*
+ * Check whether a config key holds values of the given type. This is
+ * what the typed accessors use instead of comparing variant types.
+ */
+static int check_key_datatype(uint32_t key, int datatype)
+{
+	const struct sr_key_info *srci;
+
+	if (!(srci = sr_key_info_get(SR_KEY_CONFIG, key))) {
+		sr_err("Invalid key %d.", key);
+		return SR_ERR_ARG;
+	}
+	if (srci->datatype != datatype) {
+		sr_err("Wrong data type for key '%s'.", srci->id);
+		return SR_ERR_ARG;
+	}
+
+	return SR_OK;
+}
+
+static int config_get_typed(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, int datatype, GVariant **data)
+{
+	int ret;
+
+	if ((ret = check_key_datatype(key, datatype)) != SR_OK)
+		return ret;
+	if ((ret = sr_config_get(driver, sdi, cg, key, data)) != SR_OK)
+		return ret;
+
+	/* Drivers are trusted less than the key table. */
+	if (!g_variant_is_of_type(*data, sr_variant_type_get(datatype))) {
+		sr_err("%s: Wrong variant type for key %d.",
+			driver->name, key);
+		g_variant_unref(*data);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Query the value of an unsigned 64-bit integer configuration key.
+ *
+ * This works like sr_config_get(), except that the caller doesn't deal
+ * with a GVariant. The key's data type must be SR_T_UINT64.
+ *
+ * @param[in] driver The sr_dev_driver struct to query. Must not be NULL.
+ * @param[in] sdi (optional) The device instance, see sr_config_get().
+ * @param[in] cg The channel group, or NULL.
+ * @param[in] key The configuration key (SR_CONF_*).
+ * @param[out] value Pointer where the value will be stored. Must not be
+ *             NULL. Left untouched when an error is returned.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Error.
+ * @retval SR_ERR_ARG The key is not applicable, or is not of type
+ *         SR_T_UINT64.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_u64(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, uint64_t *value)
+{
+	GVariant *data;
+	int ret;
+
+	if (!value)
+		return SR_ERR;
+	ret = config_get_typed(driver, sdi, cg, key, SR_T_UINT64, &data);
+	if (ret != SR_OK)
+		return ret;
+	*value = g_variant_get_uint64(data);
+	g_variant_unref(data);
+
+	return SR_OK;
+}
+
+/**
+ * Query the value of a boolean configuration key.
+ *
+ * See sr_config_get_u64(). The key's data type must be SR_T_BOOL.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_bool(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, gboolean *value)
+{
+	GVariant *data;
+	int ret;
+
+	if (!value)
+		return SR_ERR;
+	ret = config_get_typed(driver, sdi, cg, key, SR_T_BOOL, &data);
+	if (ret != SR_OK)
+		return ret;
+	*value = g_variant_get_boolean(data);
+	g_variant_unref(data);
+
+	return SR_OK;
+}
+
+/**
+ * Query the value of a floating point configuration key.
+ *
+ * See sr_config_get_u64(). The key's data type must be SR_T_FLOAT.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_double(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, double *value)
+{
+	GVariant *data;
+	int ret;
+
+	if (!value)
+		return SR_ERR;
+	ret = config_get_typed(driver, sdi, cg, key, SR_T_FLOAT, &data);
+	if (ret != SR_OK)
+		return ret;
+	*value = g_variant_get_double(data);
+	g_variant_unref(data);
+
+	return SR_OK;
+}
+
+/**
+ * Set the value of an unsigned 64-bit integer configuration key.
+ *
+ * This works like sr_config_set(), except that the caller doesn't deal
+ * with a GVariant. The key's data type must be SR_T_UINT64.
+ *
+ * @param[in] sdi The device instance. Must not be NULL.
+ * @param[in] cg The channel group, or NULL.
+ * @param[in] key The configuration key (SR_CONF_*).
+ * @param[in] value The new value for the key.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Error.
+ * @retval SR_ERR_ARG The key is not applicable, or is not of type
+ *         SR_T_UINT64.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_u64(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, uint64_t value)
+{
+	int ret;
+
+	if ((ret = check_key_datatype(key, SR_T_UINT64)) != SR_OK)
+		return ret;
+
+	return config_set(sdi, cg, key, g_variant_new_uint64(value), TRUE);
+}
+
+/**
+ * Set the value of a boolean configuration key.
+ *
+ * See sr_config_set_u64(). The key's data type must be SR_T_BOOL.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_bool(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, gboolean value)
+{
+	int ret;
+
+	if ((ret = check_key_datatype(key, SR_T_BOOL)) != SR_OK)
+		return ret;
+
+	return config_set(sdi, cg, key, g_variant_new_boolean(value), TRUE);
+}
+
+/**
+ * Set the value of a floating point configuration key.
+ *
+ * See sr_config_set_u64(). The key's data type must be SR_T_FLOAT.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_double(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		uint32_t key, double value)
+{
+	int ret;
+
+	if ((ret = check_key_datatype(key, SR_T_FLOAT)) != SR_OK)
+		return ret;
+
+	return config_set(sdi, cg, key, g_variant_new_double(value), TRUE);
+}
+
 /**
  * Apply configuration settings to the device hardware.
  *
@@ -943,6 +1496,7 @@ SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant **data)
 {
+	gboolean cache;
 	int ret;
 
 	if (!driver || !data)
@@ -982,9 +1536,17 @@ SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		return SR_ERR_ARG;
 	}
 
+	/* Open devices' options are kept, see sr_dev_options_changed(). */
+	cache = key == SR_CONF_DEVICE_OPTIONS && sdi
+		&& sdi->status == SR_ST_ACTIVE;
+	if (cache && (*data = sr_dev_options_cache_get(sdi, cg)))
+		return SR_OK;
+
 	if ((ret = driver->config_list(key, data, sdi, cg)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_LIST, *data);
 		g_variant_ref_sink(*data);
+		if (cache)
+			sr_dev_options_cache_put(sdi, cg, *data);
 	}
 
 	if (ret == SR_ERR_CHANNEL_GROUP)
@@ -1016,6 +1578,46 @@ static struct sr_key_info *get_keytable(int keytype)
 	return table;
 }
 
+/* Lookup tables for a key table, by key and by key id string. */
+struct key_index {
+	GHashTable *by_key;
+	GHashTable *by_id;
+};
+
+/*
+ * Index of a key table, built on first use. Lookups happen on every
+ * config get/set/list call, the tables hold hundreds of entries. The
+ * first entry wins when a key or id is listed twice, like in the linear
+ * search before.
+ */
+static const struct key_index *get_keyindex(int keytype,
+		struct sr_key_info *table)
+{
+	static gsize keyindex[SR_KEY_MQFLAGS + 1];
+	struct key_index *index;
+	gpointer key;
+	int i;
+
+	if (g_once_init_enter(&keyindex[keytype])) {
+		index = g_malloc(sizeof(*index));
+		index->by_key = g_hash_table_new(g_direct_hash, g_direct_equal);
+		index->by_id = g_hash_table_new(g_str_hash, g_str_equal);
+		for (i = 0; table[i].key; i++) {
+			key = GUINT_TO_POINTER(table[i].key);
+			if (!g_hash_table_contains(index->by_key, key))
+				g_hash_table_insert(index->by_key, key, &table[i]);
+			if (!table[i].id)
+				continue;
+			if (!g_hash_table_contains(index->by_id, table[i].id))
+				g_hash_table_insert(index->by_id,
+					(gpointer)table[i].id, &table[i]);
+		}
+		g_once_init_leave(&keyindex[keytype], (gsize)index);
+	}
+
+	return (const struct key_index *)keyindex[keytype];
+}
+
 /**
  * Get information about a key, by key.
  *
@@ -1030,17 +1632,12 @@ static struct sr_key_info *get_keytable(int keytype)
 SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
 {
 	struct sr_key_info *table;
-	int i;
 
 	if (!(table = get_keytable(keytype)))
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (table[i].key == key)
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(get_keyindex(keytype, table)->by_key,
+		GUINT_TO_POINTER(key));
 }
 
 /**
@@ -1057,19 +1654,11 @@ SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
 SR_API const struct sr_key_info *sr_key_info_name_get(int keytype, const char *keyid)
 {
 	struct sr_key_info *table;
-	int i;
 
-	if (!(table = get_keytable(keytype)))
+	if (!(table = get_keytable(keytype)) || !keyid)
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (!table[i].id)
-			continue;
-		if (!strcmp(table[i].id, keyid))
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(get_keyindex(keytype, table)->by_id, keyid);
 }
 
 /** @} */
@@ -66,7 +66,8 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of a block of data, returns the size used. */
+static gsize process_data(struct sr_input *in, const uint8_t *data, gsize len)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -91,17 +92,26 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = inc->unitsize;
 
 	/* Cut off at multiple of unitsize. */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = (void *)(data + i);
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		chunk /= logic.unitsize;
 		chunk *= logic.unitsize;
 		logic.length = chunk;
 		sr_session_send(in->sdi, &packet);
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	gsize used;
+
+	used = process_data(in, (const uint8_t *)in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, used);
 
 	return SR_OK;
 }
@@ -123,6 +133,20 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	*used = process_data(in, data, len);
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -174,6 +198,7 @@ SR_PRIV struct sr_input_module input_binary = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
 	.reset = reset,
 };
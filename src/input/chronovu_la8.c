@@ -127,7 +127,8 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of a block of data, returns the size used. */
+static gsize process_data(struct sr_input *in, const uint8_t *data, gsize len)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -158,11 +159,11 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = unitsize;
 
 	/* Cut off at multiple of unitsize. Avoid sending the "header". */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
 	chunk_size = MIN(chunk_size, inc->samples_remain * unitsize);
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = (void *)(data + i);
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		if (chunk) {
 			logic.length = chunk;
@@ -170,7 +171,16 @@ static int process_buffer(struct sr_input *in)
 			inc->samples_remain -= chunk / unitsize;
 		}
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	gsize used;
+
+	used = process_data(in, (const uint8_t *)in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, used);
 
 	return SR_OK;
 }
@@ -192,6 +202,27 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	struct context *inc;
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	*used = process_data(in, data, len);
+
+	/* Drop the trailing "header" after all samples were sent. */
+	inc = in->priv;
+	if (!inc->samples_remain)
+		*used = len;
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -245,6 +276,7 @@ SR_PRIV struct sr_input_module input_chronovu_la8 = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
 	.reset = reset,
 };
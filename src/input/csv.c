@@ -34,6 +34,9 @@
 
 #define CHUNK_SIZE	(4 * 1024 * 1024)
 
+/* Minimum amount of input text which gets split for worker threads. */
+#define PARALLEL_MIN_SIZE	(64 * 1024)
+
 /*
  * The CSV input module has the following options:
  *
@@ -225,6 +228,8 @@ struct context {
 	const char *column_formats;
 	size_t column_want_count;
 	struct column_details *column_details;
+	/* Current line's column texts, these point into the input buffer. */
+	char **column_texts;
 
 	/* Line number to start processing. */
 	size_t start_line;
@@ -256,6 +261,47 @@ struct context {
 	/* List of previously created sigrok channels. */
 	GSList *prev_sr_channels;
 	GSList **prev_df_channels;
+
+	/*
+	 * Column details which the first proper line resulted in. They
+	 * are kept across reset(), a re-read of the same file takes them
+	 * instead of interpreting the format specs again.
+	 */
+	char *first_line;
+	struct csv_plan {
+		char *first_line;
+		struct column_details *column_details;
+		size_t column_seen_count;
+		size_t column_want_count;
+		size_t logic_channels;
+		size_t analog_channels;
+		int *analog_datafeed_digits;
+	} plan;
+
+	/* Worker threads which parse parts of large input buffers. */
+	uint32_t num_threads;
+	GThreadPool *pool;
+	struct parse_job *jobs;
+	size_t jobs_pending;
+	GMutex mutex;
+	GCond cond;
+};
+
+/*
+ * A worker's part of the input text. The context copy references the
+ * job's own sample buffers, so that the regular line processing code
+ * fills these instead of the datafeed buffers.
+ */
+struct parse_job {
+	struct context ctx;
+	char *text;
+	char *text_end;
+	uint8_t *logic;
+	size_t logic_size;
+	csv_analog_t *analog;
+	size_t analog_size;
+	char **column_texts;
+	int status;
 };
 
 /*
@@ -614,6 +660,7 @@ static int make_column_details_from_format(const struct sr_input *in,
 	inc->analog_datafeed_digits = g_malloc0(inc->analog_channels * sizeof(inc->analog_datafeed_digits[0]));
 	inc->analog_datafeed_channels = g_malloc0(inc->analog_channels * sizeof(inc->analog_datafeed_channels[0]));
 	inc->column_details = g_malloc0_n(column_count, sizeof(inc->column_details[0]));
+	inc->column_texts = g_malloc0_n(column_count + 1, sizeof(inc->column_texts[0]));
 	column_idx = channel_idx = analog_idx = 0;
 	channel_name = g_string_sized_new(64);
 	for (format_idx = 0; format_idx < format_count; format_idx++) {
@@ -774,6 +821,66 @@ static char **split_line(char *buf, struct context *inc)
 	return fields;
 }
 
+/*
+ * Find the next occurrence of a separator in a text. The search for
+ * the separator's first character uses memchr(), which C libraries
+ * implement with wide (vector) loads.
+ */
+static char *find_separator(char *text, const char *end,
+	const char *sep, size_t sep_len)
+{
+	char *p;
+
+	while (text + sep_len <= end) {
+		p = memchr(text, sep[0], end - text - sep_len + 1);
+		if (!p)
+			return NULL;
+		if (sep_len == 1 || !memcmp(p, sep, sep_len))
+			return p;
+		text = p + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * Split a text line into columns, in place.
+ *
+ * @param[in] buf	The input text line to split, gets modified.
+ * @param[in] inc	The input module's context.
+ *
+ * @returns The number of columns which were found, at most the number
+ *   of columns that are wanted.
+ *
+ * This is the equivalent of split_line() for the processing of data
+ * lines. The column texts are terminated and have trailing whitespace
+ * removed within the input buffer, and get referenced by the context's
+ * column_texts[] array. Nothing gets allocated, and columns past the
+ * wanted ones are not inspected.
+ */
+static size_t split_line_inplace(char *buf, struct context *inc)
+{
+	char *end, *sep, *field_end;
+	size_t count;
+
+	end = buf + strlen(buf);
+	count = 0;
+	while (count < inc->column_want_count) {
+		sep = find_separator(buf, end,
+			inc->delimiter->str, inc->delimiter->len);
+		field_end = sep ? sep : end;
+		while (field_end > buf && g_ascii_isspace(field_end[-1]))
+			field_end--;
+		*field_end = '\0';
+		inc->column_texts[count++] = buf;
+		if (!sep)
+			break;
+		buf = sep + inc->delimiter->len;
+	}
+
+	return count;
+}
+
 /**
  * Parse a multi-bit field into several logic channels.
  *
@@ -1216,6 +1323,7 @@ static int init(struct sr_input *in, GHashTable *options)
 	first_column = g_variant_get_uint32(g_hash_table_lookup(options, "first_column"));
 	inc->use_header = g_variant_get_boolean(g_hash_table_lookup(options, "header"));
 	inc->start_line = g_variant_get_uint32(g_hash_table_lookup(options, "start_line"));
+	inc->num_threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
 	if (inc->start_line < 1) {
 		sr_err("Invalid start line %zu.", inc->start_line);
 		return SR_ERR_ARG;
@@ -1343,13 +1451,115 @@ static const char *get_line_termination(GString *buf)
 	return term;
 }
 
-static int initial_parse(const struct sr_input *in, GString *buf)
+static void free_column_details(struct column_details *details,
+	size_t count)
+{
+	size_t idx, ch_idx;
+
+	if (!details)
+		return;
+	for (idx = 0; idx < count; idx++) {
+		if (!details[idx].channel_names)
+			continue;
+		for (ch_idx = 0; ch_idx < details[idx].channel_count; ch_idx++) {
+			if (details[idx].channel_names[ch_idx])
+				g_string_free(details[idx].channel_names[ch_idx], TRUE);
+		}
+		g_free(details[idx].channel_names);
+	}
+	g_free(details);
+}
+
+static void free_parse_plan(struct context *inc)
+{
+	struct csv_plan *plan;
+
+	plan = &inc->plan;
+	g_free(plan->first_line);
+	free_column_details(plan->column_details, plan->column_want_count);
+	g_free(plan->analog_datafeed_digits);
+	memset(plan, 0, sizeof(*plan));
+}
+
+/*
+ * Keep the column details for a re-read of the input file. Gets called
+ * from reset(), before cleanup() releases the context's resources.
+ */
+static void keep_parse_plan(struct context *inc)
+{
+	struct csv_plan *plan;
+
+	if (!inc->first_line || !inc->column_details)
+		return;
+
+	free_parse_plan(inc);
+	plan = &inc->plan;
+	plan->first_line = inc->first_line;
+	inc->first_line = NULL;
+	plan->column_details = inc->column_details;
+	inc->column_details = NULL;
+	plan->column_seen_count = inc->column_seen_count;
+	plan->column_want_count = inc->column_want_count;
+	plan->logic_channels = inc->logic_channels;
+	plan->analog_channels = inc->analog_channels;
+	plan->analog_datafeed_digits = inc->analog_datafeed_digits;
+	inc->analog_datafeed_digits = NULL;
+}
+
+/*
+ * Take the previous read's column details and channels when the first
+ * proper line is the very same. Applications re-read files to run a
+ * second pass over them, which need not repeat the header's work.
+ */
+static gboolean reuse_parse_plan(const struct sr_input *in, const char *line)
+{
+	struct context *inc;
+	struct csv_plan *plan;
+
+	inc = in->priv;
+	plan = &inc->plan;
+	if (!plan->first_line || strcmp(plan->first_line, line) != 0)
+		return FALSE;
+	if (!inc->prev_sr_channels || in->sdi->channels)
+		return FALSE;
+
+	inc->column_details = plan->column_details;
+	plan->column_details = NULL;
+	inc->column_seen_count = plan->column_seen_count;
+	inc->column_want_count = plan->column_want_count;
+	inc->logic_channels = plan->logic_channels;
+	inc->analog_channels = plan->analog_channels;
+	inc->analog_datafeed_digits = plan->analog_datafeed_digits;
+	plan->analog_datafeed_digits = NULL;
+	inc->column_texts = g_malloc0_n(inc->column_want_count + 1,
+		sizeof(inc->column_texts[0]));
+
+	in->sdi->channels = inc->prev_sr_channels;
+	inc->prev_sr_channels = NULL;
+	release_df_channels(inc, inc->analog_datafeed_channels);
+	inc->analog_datafeed_channels = inc->prev_df_channels;
+	inc->prev_df_channels = NULL;
+
+	inc->first_line = plan->first_line;
+	plan->first_line = NULL;
+	free_parse_plan(inc);
+	sr_dbg("Same first line as before, re-using its column details.");
+
+	return TRUE;
+}
+
+/*
+ * Interpret the first proper line of the input text. Only takes the
+ * text up to that line, the input may be a large mapped file.
+ */
+static int initial_parse(const struct sr_input *in, char *text, size_t len)
 {
 	struct context *inc;
 	size_t num_columns;
-	size_t line_number, line_idx;
+	size_t line_number, line_len, term_len;
+	gboolean found;
 	int ret;
-	char **lines, *line, **columns;
+	char *line, **columns, *end, *p;
 
 	ret = SR_OK;
 	inc = in->priv;
@@ -1357,11 +1567,18 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 
 	/* Search for the first line to process (header or data). */
 	line_number = 0;
-	if (inc->termination)
-		lines = g_strsplit(buf->str, inc->termination, 0);
-	else
-		lines = g_strsplit_set(buf->str, delim_set, 0);
-	for (line_idx = 0; (line = lines[line_idx]); line_idx++) {
+	line = NULL;
+	found = FALSE;
+	end = text + len;
+	term_len = strlen(inc->termination);
+	while (text < end) {
+		p = find_separator(text, end, inc->termination, term_len);
+		line_len = p ? (size_t)(p - text) : (size_t)(end - text);
+		g_free(line);
+		line = g_strndup(text, line_len);
+		text += line_len;
+		if (p)
+			text += term_len;
 		line_number++;
 		if (inc->start_line > line_number) {
 			sr_spew("Line %zu skipped (before start).", line_number);
@@ -1378,14 +1595,22 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 		}
 
 		/* Reached first proper line. */
+		found = TRUE;
 		break;
 	}
-	if (!line) {
+	if (!found) {
 		/* Not enough data for a proper line yet. */
 		ret = SR_ERR_NA;
 		goto out;
 	}
 
+	/* A re-read of the same input takes the previous results. */
+	if (reuse_parse_plan(in, line))
+		goto alloc;
+	free_parse_plan(inc);
+	g_free(inc->first_line);
+	inc->first_line = g_strdup(line);
+
 	/* Get the number of columns in the line. */
 	columns = split_line(line, inc);
 	if (!columns) {
@@ -1421,6 +1646,7 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 		goto out;
 	}
 
+alloc:
 	/*
 	 * Allocate buffer memory for datafeed submission of sample data.
 	 * Calculate the minimum buffer size to store the set of samples
@@ -1466,7 +1692,7 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 out:
 	if (columns)
 		g_strfreev(columns);
-	g_strfreev(lines);
+	g_free(line);
 
 	return ret;
 }
@@ -1495,8 +1721,7 @@ static void initial_bom_check(const struct sr_input *in)
 static int initial_receive(const struct sr_input *in)
 {
 	struct context *inc;
-	GString *new_buf;
-	int len, ret;
+	int ret;
 	char *p;
 	const char *termination;
 
@@ -1513,32 +1738,385 @@ static int initial_receive(const struct sr_input *in)
 	if (!p)
 		/* Don't have a full line yet. */
 		return SR_ERR_NA;
-	len = p - in->buf->str - 1;
-	new_buf = g_string_new_len(in->buf->str, len);
-	g_string_append_c(new_buf, '\0');
 
 	inc->termination = g_strdup(termination);
 
 	if (in->buf->str[0] != '\0')
-		ret = initial_parse(in, new_buf);
+		ret = initial_parse(in, in->buf->str, p - in->buf->str);
 	else
 		ret = SR_OK;
 
-	g_string_free(new_buf, TRUE);
-
 	return ret;
 }
 
-static int process_buffer(struct sr_input *in, gboolean is_eof)
+/*
+ * Process a text line, have its columns' values stored in the current
+ * sample set. Lines without sample data (before the start line, blank,
+ * comment-only, the header) are not an error, but leave have_sample
+ * unset.
+ */
+static int process_line(struct context *inc, char *line, gboolean *have_sample)
 {
-	struct context *inc;
-	gsize num_columns;
-	size_t line_idx, col_idx, col_nr;
+	size_t num_columns, col_idx, col_nr;
 	const struct column_details *details;
 	col_parse_cb parse_func;
+	char *column;
+	int ret;
+
+	*have_sample = FALSE;
+	inc->line_number++;
+	if (inc->line_number < inc->start_line) {
+		sr_spew("Line %zu skipped (before start).", inc->line_number);
+		return SR_OK;
+	}
+	if (line[0] == '\0') {
+		sr_spew("Blank line %zu skipped.", inc->line_number);
+		return SR_OK;
+	}
+
+	/* Remove trailing comment. */
+	strip_comment(line, inc->comment);
+	if (line[0] == '\0') {
+		sr_spew("Comment-only line %zu skipped.", inc->line_number);
+		return SR_OK;
+	}
+
+	/* Skip the header line, its content was used as the channel names. */
+	if (inc->use_header && !inc->header_seen) {
+		sr_spew("Header line %zu skipped.", inc->line_number);
+		inc->header_seen = TRUE;
+		return SR_OK;
+	}
+
+	/* Split the line into columns, check for minimum length. */
+	num_columns = split_line_inplace(line, inc);
+	if (num_columns < inc->column_want_count) {
+		sr_err("Insufficient column count %zu in line %zu.",
+			num_columns, inc->line_number);
+		return SR_ERR;
+	}
+
+	/* Have the columns of the current text line processed. */
+	clear_logic_samples(inc);
+	clear_analog_samples(inc);
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		column = inc->column_texts[col_idx];
+		col_nr = col_idx + 1;
+		details = lookup_column_details(inc, col_nr);
+		if (!details || !details->text_format)
+			continue;
+		parse_func = col_parse_funcs[details->text_format];
+		if (!parse_func)
+			continue;
+		ret = parse_func(column, inc, details);
+		if (ret != SR_OK)
+			return SR_ERR;
+	}
+	*have_sample = TRUE;
+
+	return SR_OK;
+}
+
+/*
+ * Check whether the remaining input lines can get processed in any
+ * order. Which is not the case while leading lines or the header are
+ * pending, or timestamps still get inspected to determine the rate.
+ */
+static gboolean can_process_parallel(struct context *inc)
+{
+	size_t col_idx;
+
+	if (!inc->num_threads)
+		return FALSE;
+	if (inc->line_number + 1 < inc->start_line)
+		return FALSE;
+	if (inc->use_header && !inc->header_seen)
+		return FALSE;
+	if (inc->calc_samplerate)
+		return TRUE;
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		if (format_is_timestamp(inc->column_details[col_idx].text_format))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Worker thread routine, fills the job's sample buffers. */
+static void parse_job_run(gpointer data, gpointer user_data)
+{
+	struct parse_job *job;
+	struct context *inc, *ctx;
+	char *line, *next_line;
+	size_t term_len;
+	gboolean have_sample;
+
+	job = data;
+	inc = user_data;
+	ctx = &job->ctx;
+
+	term_len = strlen(ctx->termination);
+	job->status = SR_OK;
+	for (line = job->text; line; line = next_line) {
+		next_line = find_separator(line, job->text_end,
+			ctx->termination, term_len);
+		if (next_line) {
+			*next_line = '\0';
+			next_line += term_len;
+		}
+		job->status = process_line(ctx, line, &have_sample);
+		if (job->status != SR_OK)
+			break;
+		if (!have_sample)
+			continue;
+		if (ctx->logic_channels)
+			ctx->datafeed_buf_fill += ctx->sample_unit_size;
+		if (ctx->analog_channels)
+			ctx->analog_datafeed_buf_fill++;
+	}
+
+	g_mutex_lock(&inc->mutex);
+	inc->jobs_pending--;
+	g_cond_signal(&inc->cond);
+	g_mutex_unlock(&inc->mutex);
+}
+
+/*
+ * Prepare a job for a part of the input text, which spans num_lines
+ * lines. The job's buffers can hold one sample set per line.
+ */
+static void parse_job_prepare(struct context *inc, struct parse_job *job,
+	char *text, char *text_end, size_t num_lines)
+{
+	size_t size;
+
+	job->text = text;
+	job->text_end = text_end;
+	job->ctx = *inc;
+	job->ctx.column_texts = job->column_texts;
+
+	if (inc->logic_channels) {
+		size = num_lines * inc->sample_unit_size;
+		if (size > job->logic_size) {
+			job->logic = g_realloc(job->logic, size);
+			job->logic_size = size;
+		}
+		job->ctx.datafeed_buffer = job->logic;
+		job->ctx.datafeed_buf_size = size;
+		job->ctx.datafeed_buf_fill = 0;
+	}
+	if (inc->analog_channels) {
+		size = num_lines * inc->analog_channels;
+		if (size > job->analog_size) {
+			job->analog = g_realloc(job->analog,
+				size * sizeof(job->analog[0]));
+			job->analog_size = size;
+		}
+		memset(job->analog, 0, size * sizeof(job->analog[0]));
+		job->ctx.analog_datafeed_buffer = job->analog;
+		job->ctx.analog_datafeed_buf_size = num_lines;
+		job->ctx.analog_datafeed_buf_fill = 0;
+	}
+}
+
+/* Copy a job's sample sets to the datafeed buffers, in input order. */
+static int submit_job_samples(const struct sr_input *in, struct parse_job *job)
+{
+	struct context *inc;
+	const struct context *ctx;
+	size_t rows, row, count, ch_idx, unitsize;
+	csv_analog_t *dst;
+	const csv_analog_t *src;
 	int ret;
-	char *processed_up_to;
-	char **lines, *line, **columns, *column;
+
+	inc = in->priv;
+	ctx = &job->ctx;
+	unitsize = inc->sample_unit_size;
+	if (inc->logic_channels)
+		rows = ctx->datafeed_buf_fill / unitsize;
+	else
+		rows = ctx->analog_datafeed_buf_fill;
+
+	for (row = 0; row < rows; row += count) {
+		count = rows - row;
+		if (inc->logic_channels)
+			count = MIN(count, (inc->datafeed_buf_size
+				- inc->datafeed_buf_fill) / unitsize);
+		if (inc->analog_channels)
+			count = MIN(count, inc->analog_datafeed_buf_size
+				- inc->analog_datafeed_buf_fill);
+
+		if (inc->logic_channels) {
+			memcpy(&inc->datafeed_buffer[inc->datafeed_buf_fill],
+				&ctx->datafeed_buffer[row * unitsize],
+				count * unitsize);
+			inc->datafeed_buf_fill += count * unitsize;
+			if (inc->datafeed_buf_fill == inc->datafeed_buf_size) {
+				ret = flush_logic_samples(in);
+				if (ret != SR_OK)
+					return ret;
+			}
+		}
+		if (inc->analog_channels) {
+			for (ch_idx = 0; ch_idx < inc->analog_channels; ch_idx++) {
+				dst = &inc->analog_datafeed_buffer[ch_idx
+					* inc->analog_datafeed_buf_size];
+				src = &ctx->analog_datafeed_buffer[ch_idx
+					* ctx->analog_datafeed_buf_size];
+				memcpy(&dst[inc->analog_datafeed_buf_fill],
+					&src[row], count * sizeof(*src));
+			}
+			inc->analog_datafeed_buf_fill += count;
+			if (inc->analog_datafeed_buf_fill == inc->analog_datafeed_buf_size) {
+				ret = flush_analog_samples(in);
+				if (ret != SR_OK)
+					return ret;
+			}
+		}
+	}
+
+	return SR_OK;
+}
+
+static int start_parse_workers(struct context *inc)
+{
+	GError *error;
+	uint32_t i;
+
+	if (inc->pool)
+		return SR_OK;
+
+	error = NULL;
+	inc->pool = g_thread_pool_new(parse_job_run, inc,
+		inc->num_threads, FALSE, &error);
+	if (!inc->pool) {
+		sr_err("Cannot create parser threads: %s.", error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+	g_mutex_init(&inc->mutex);
+	g_cond_init(&inc->cond);
+	inc->jobs = g_malloc0_n(inc->num_threads, sizeof(inc->jobs[0]));
+	for (i = 0; i < inc->num_threads; i++) {
+		inc->jobs[i].column_texts = g_malloc0_n(
+			inc->column_want_count + 1, sizeof(char *));
+	}
+	sr_dbg("Parsing input text on %" PRIu32 " threads.", inc->num_threads);
+
+	return SR_OK;
+}
+
+static void stop_parse_workers(struct context *inc)
+{
+	uint32_t i;
+
+	if (!inc->pool)
+		return;
+
+	g_thread_pool_free(inc->pool, FALSE, TRUE);
+	inc->pool = NULL;
+	g_cond_clear(&inc->cond);
+	g_mutex_clear(&inc->mutex);
+	for (i = 0; i < inc->num_threads; i++) {
+		g_free(inc->jobs[i].logic);
+		g_free(inc->jobs[i].analog);
+		g_free(inc->jobs[i].column_texts);
+	}
+	g_free(inc->jobs);
+	inc->jobs = NULL;
+}
+
+/*
+ * Process the text lines in [text, text_end) on the worker threads.
+ * The text gets split at line boundaries into one part per thread,
+ * the resulting sample sets get submitted in input order.
+ */
+static int process_lines_parallel(const struct sr_input *in,
+	char *text, char *text_end)
+{
+	struct context *inc;
+	struct parse_job *job;
+	char *part_end, *p;
+	size_t term_len, num_lines, num_jobs, i;
+	GError *error;
+	int ret;
+
+	inc = in->priv;
+	ret = start_parse_workers(inc);
+	if (ret != SR_OK)
+		return ret;
+
+	/*
+	 * Find the parts' boundaries, and count their lines (which is
+	 * cheap compared to parsing them) to keep track of line numbers.
+	 */
+	term_len = strlen(inc->termination);
+	num_jobs = 0;
+	while (text && num_jobs < inc->num_threads) {
+		part_end = NULL;
+		if (num_jobs + 1 < inc->num_threads) {
+			p = text + (text_end - text) / (inc->num_threads - num_jobs);
+			part_end = find_separator(p, text_end,
+				inc->termination, term_len);
+		}
+		if (!part_end)
+			part_end = text_end;
+		num_lines = 1;
+		p = text;
+		while ((p = find_separator(p, part_end,
+				inc->termination, term_len))) {
+			num_lines++;
+			p += term_len;
+		}
+
+		job = &inc->jobs[num_jobs++];
+		parse_job_prepare(inc, job, text, part_end, num_lines);
+		inc->line_number += num_lines;
+		if (part_end == text_end) {
+			text = NULL;
+		} else {
+			*part_end = '\0';
+			text = part_end + term_len;
+		}
+	}
+
+	inc->jobs_pending = num_jobs;
+	for (i = 0; i < num_jobs; i++) {
+		error = NULL;
+		if (!g_thread_pool_push(inc->pool, &inc->jobs[i], &error)) {
+			sr_warn("Cannot queue parser job: %s.", error->message);
+			g_error_free(error);
+			parse_job_run(&inc->jobs[i], inc);
+		}
+	}
+	g_mutex_lock(&inc->mutex);
+	while (inc->jobs_pending)
+		g_cond_wait(&inc->cond, &inc->mutex);
+	g_mutex_unlock(&inc->mutex);
+
+	/* Sample sets of a failed part are sent up to the failing line. */
+	for (i = 0; i < num_jobs; i++) {
+		job = &inc->jobs[i];
+		ret = submit_job_samples(in, job);
+		if (ret != SR_OK) {
+			sr_err("Sending samples failed.");
+			return SR_ERR;
+		}
+		if (job->status != SR_OK)
+			return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static int process_buffer(struct sr_input *in, gboolean is_eof)
+{
+	struct context *inc;
+	int ret;
+	char *processed_up_to, *lines_end, *next_line;
+	char *line;
+	size_t term_len;
+	gboolean have_sample;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -1561,94 +2139,57 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	 */
 	if (!in->buf->len)
 		return SR_OK;
+	term_len = strlen(inc->termination);
 	if (is_eof) {
 		processed_up_to = in->buf->str + in->buf->len;
+		lines_end = processed_up_to;
 	} else {
 		processed_up_to = g_strrstr_len(in->buf->str, in->buf->len,
 			inc->termination);
 		if (!processed_up_to)
 			return SR_OK;
 		*processed_up_to = '\0';
-		processed_up_to += strlen(inc->termination);
+		lines_end = processed_up_to;
+		processed_up_to += term_len;
 	}
 
-	/* Split input text lines and process their columns. */
-	ret = SR_OK;
-	lines = g_strsplit(in->buf->str, inc->termination, 0);
-	for (line_idx = 0; (line = lines[line_idx]); line_idx++) {
-		inc->line_number++;
-		if (inc->line_number < inc->start_line) {
-			sr_spew("Line %zu skipped (before start).", inc->line_number);
-			continue;
-		}
-		if (line[0] == '\0') {
-			sr_spew("Blank line %zu skipped.", inc->line_number);
-			continue;
-		}
+	/* Have large amounts of text parsed by worker threads. */
+	if (lines_end - in->buf->str >= PARALLEL_MIN_SIZE
+			&& can_process_parallel(inc)) {
+		ret = process_lines_parallel(in, in->buf->str, lines_end);
+		if (ret != SR_OK)
+			return ret;
+		g_string_erase(in->buf, 0, processed_up_to - in->buf->str);
+		return SR_OK;
+	}
 
-		/* Remove trailing comment. */
-		strip_comment(line, inc->comment);
-		if (line[0] == '\0') {
-			sr_spew("Comment-only line %zu skipped.", inc->line_number);
-			continue;
+	/*
+	 * Split input text lines and process their columns. Lines and
+	 * columns get terminated in place, the input buffer's content
+	 * is discarded after processing anyway.
+	 */
+	ret = SR_OK;
+	for (line = in->buf->str; line; line = next_line) {
+		next_line = find_separator(line, lines_end,
+			inc->termination, term_len);
+		if (next_line) {
+			*next_line = '\0';
+			next_line += term_len;
 		}
-
-		/* Skip the header line, its content was used as the channel names. */
-		if (inc->use_header && !inc->header_seen) {
-			sr_spew("Header line %zu skipped.", inc->line_number);
-			inc->header_seen = TRUE;
+		ret = process_line(inc, line, &have_sample);
+		if (ret != SR_OK)
+			return ret;
+		if (!have_sample)
 			continue;
-		}
-
-		/* Split the line into columns, check for minimum length. */
-		columns = split_line(line, inc);
-		if (!columns) {
-			sr_err("Error while parsing line %zu.", inc->line_number);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-		num_columns = g_strv_length(columns);
-		if (num_columns < inc->column_want_count) {
-			sr_err("Insufficient column count %zu in line %zu.",
-				num_columns, inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-
-		/* Have the columns of the current text line processed. */
-		clear_logic_samples(inc);
-		clear_analog_samples(inc);
-		for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
-			column = columns[col_idx];
-			col_nr = col_idx + 1;
-			details = lookup_column_details(inc, col_nr);
-			if (!details || !details->text_format)
-				continue;
-			parse_func = col_parse_funcs[details->text_format];
-			if (!parse_func)
-				continue;
-			ret = parse_func(column, inc, details);
-			if (ret != SR_OK) {
-				g_strfreev(columns);
-				g_strfreev(lines);
-				return SR_ERR;
-			}
-		}
 
 		/* Send sample data to the session bus (buffered). */
 		ret = queue_logic_samples(in);
 		ret += queue_analog_samples(in);
 		if (ret != SR_OK) {
 			sr_err("Sending samples failed.");
-			g_strfreev(columns);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
-
-		g_strfreev(columns);
 	}
-	g_strfreev(lines);
 	g_string_erase(in->buf, 0, processed_up_to - in->buf->str);
 
 	return ret;
@@ -1723,9 +2264,14 @@ static void cleanup(struct sr_input *in)
 	g_free(inc->analog_datafeed_digits);
 	inc->analog_datafeed_digits = NULL;
 	/* analog_datafeed_channels was released in keep_header_for_reread() */
-	/* TODO Release channel names (before releasing details). */
-	g_free(inc->column_details);
+	free_column_details(inc->column_details, inc->column_want_count);
 	inc->column_details = NULL;
+	g_free(inc->first_line);
+	inc->first_line = NULL;
+	free_parse_plan(inc);
+	g_free(inc->column_texts);
+	inc->column_texts = NULL;
+	stop_parse_workers(inc);
 
 	/* Clear internal state, but keep what .init() has provided. */
 	save_ctx = *inc;
@@ -1736,6 +2282,7 @@ static void cleanup(struct sr_input *in)
 	inc->column_formats = save_ctx.column_formats;
 	inc->start_line = save_ctx.start_line;
 	inc->use_header = save_ctx.use_header;
+	inc->num_threads = save_ctx.num_threads;
 	inc->prev_sr_channels = save_ctx.prev_sr_channels;
 	inc->prev_df_channels = save_ctx.prev_df_channels;
 }
@@ -1743,9 +2290,14 @@ static void cleanup(struct sr_input *in)
 static int reset(struct sr_input *in)
 {
 	struct context *inc;
+	struct csv_plan plan;
 
 	inc = in->priv;
+	keep_parse_plan(inc);
+	plan = inc->plan;
+	memset(&inc->plan, 0, sizeof(inc->plan));
 	cleanup(in);
+	inc->plan = plan;
 	inc->started = FALSE;
 	g_string_truncate(in->buf, 0);
 
@@ -1763,6 +2315,7 @@ enum option_index {
 	OPT_SAMPLERATE,
 	OPT_COL_SEP,
 	OPT_COMMENT,
+	OPT_THREADS,
 	OPT_MAX,
 };
 
@@ -1817,6 +2370,11 @@ static struct sr_option options[] = {
 		"The text which starts comments at the end of text lines, semicolon by default.",
 		NULL, NULL,
 	},
+	[OPT_THREADS] = {
+		"threads", "Parser threads",
+		"Number of threads which parse large amounts of input text, 0 parses while receiving (default).",
+		NULL, NULL,
+	},
 	[OPT_MAX] = ALL_ZERO,
 };
 
@@ -1840,6 +2398,7 @@ static const struct sr_option *get_options(void)
 		options[OPT_SAMPLERATE].def = g_variant_ref_sink(g_variant_new_uint64(0));
 		options[OPT_COL_SEP].def = g_variant_ref_sink(g_variant_new_string(","));
 		options[OPT_COMMENT].def = g_variant_ref_sink(g_variant_new_string(";"));
+		options[OPT_THREADS].def = g_variant_ref_sink(g_variant_new_uint32(0));
 	}
 
 	return options;
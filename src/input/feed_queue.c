@@ -27,8 +27,11 @@ struct feed_queue_logic {
 	size_t alloc_count;
 	size_t fill_count;
 	uint8_t *data_bytes;
+	uint64_t *run_lengths;
+	size_t mem_bytes;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle logic_rle;
 };
 
 SR_API struct feed_queue_logic *feed_queue_logic_alloc(
@@ -36,13 +39,20 @@ SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	size_t sample_count, size_t unit_size)
 {
 	struct feed_queue_logic *q;
+	size_t size;
+
+	size = sample_count * unit_size;
+	if (sr_session_mem_charge(sdi, size) != SR_OK)
+		return NULL;
 
 	q = g_malloc0(sizeof(*q));
 	q->sdi = sdi;
 	q->unit_size = unit_size;
 	q->alloc_count = sample_count;
-	q->data_bytes = g_try_malloc(q->alloc_count * q->unit_size);
+	q->mem_bytes = size;
+	q->data_bytes = g_try_malloc(size);
 	if (!q->data_bytes) {
+		sr_session_mem_release(sdi, size);
 		g_free(q);
 		return NULL;
 	}
@@ -57,25 +67,256 @@ SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	return q;
 }
 
-SR_API int feed_queue_logic_submit(struct feed_queue_logic *q,
+/*
+ * Like feed_queue_logic_alloc(), but the queue sends SR_DF_LOGIC_RLE
+ * packets of up to run_count runs. Repeated submissions of the same
+ * value extend the current run.
+ */
+SR_API struct feed_queue_logic *feed_queue_logic_alloc_rle(
+	const struct sr_dev_inst *sdi,
+	size_t run_count, size_t unit_size)
+{
+	struct feed_queue_logic *q;
+	size_t size;
+
+	q = feed_queue_logic_alloc(sdi, run_count, unit_size);
+	if (!q)
+		return NULL;
+	size = run_count * sizeof(q->run_lengths[0]);
+	if (sr_session_mem_charge(sdi, size) != SR_OK) {
+		feed_queue_logic_free(q);
+		return NULL;
+	}
+	q->mem_bytes += size;
+	q->run_lengths = g_try_malloc(size);
+	if (!q->run_lengths) {
+		feed_queue_logic_free(q);
+		return NULL;
+	}
+
+	q->packet.type = SR_DF_LOGIC_RLE;
+	q->packet.payload = &q->logic_rle;
+	q->logic_rle.unitsize = q->unit_size;
+	q->logic_rle.values = q->data_bytes;
+	q->logic_rle.run_lengths = q->run_lengths;
+
+	return q;
+}
+
+static int feed_queue_logic_submit_rle(struct feed_queue_logic *q,
 	const uint8_t *data, size_t count)
 {
 	uint8_t *wrptr;
-	int ret;
+
+	if (!count)
+		return SR_OK;
+
+	if (q->fill_count) {
+		wrptr = &q->data_bytes[(q->fill_count - 1) * q->unit_size];
+		if (memcmp(wrptr, data, q->unit_size) == 0) {
+			q->run_lengths[q->fill_count - 1] += count;
+			return SR_OK;
+		}
+	}
 
 	wrptr = &q->data_bytes[q->fill_count * q->unit_size];
-	while (count--) {
-		memcpy(wrptr, data, q->unit_size);
-		wrptr += q->unit_size;
-		q->fill_count++;
+	memcpy(wrptr, data, q->unit_size);
+	q->run_lengths[q->fill_count++] = count;
+	if (q->fill_count == q->alloc_count)
+		return feed_queue_logic_flush(q);
+
+	return SR_OK;
+}
+
+/* Complete the pending packet's payload description before sending. */
+static void feed_queue_logic_fill_payload(struct feed_queue_logic *q)
+{
+	if (q->run_lengths)
+		q->logic_rle.num_runs = q->fill_count;
+	else
+		q->logic.length = q->fill_count * q->unit_size;
+}
+
+/*
+ * Write count copies of a sample. The copied range doubles in every
+ * step, long runs take a logarithmic number of memcpy() calls.
+ */
+static void fill_repeated(uint8_t *wrptr, const uint8_t *data,
+	size_t unit_size, size_t count)
+{
+	size_t done, total, n;
+
+	if (!count)
+		return;
+
+	memcpy(wrptr, data, unit_size);
+	done = unit_size;
+	total = count * unit_size;
+	while (done < total) {
+		n = MIN(done, total - done);
+		memcpy(&wrptr[done], wrptr, n);
+		done += n;
+	}
+}
+
+SR_API int feed_queue_logic_submit(struct feed_queue_logic *q,
+	const uint8_t *data, size_t count)
+{
+	size_t n;
+	int ret;
+
+	if (q->run_lengths)
+		return feed_queue_logic_submit_rle(q, data, count);
+
+	while (count) {
+		n = MIN(count, q->alloc_count - q->fill_count);
+		fill_repeated(&q->data_bytes[q->fill_count * q->unit_size],
+			data, q->unit_size, n);
+		q->fill_count += n;
+		count -= n;
+		if (q->fill_count == q->alloc_count) {
+			ret = feed_queue_logic_flush(q);
+			if (ret != SR_OK)
+				return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Send a block of caller provided samples without copying them. */
+static int feed_queue_logic_send_direct(struct feed_queue_logic *q,
+	const uint8_t *data, size_t samples_count)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	memset(&logic, 0, sizeof(logic));
+	logic.unitsize = q->unit_size;
+	logic.length = samples_count * q->unit_size;
+	logic.data = (void *)data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	return sr_session_send(q->sdi, &packet);
+}
+
+/*
+ * Submit a block of samples_count individual samples. Blocks of at
+ * least the queue's size get passed to the session as they are, only
+ * the remainder which does not fill a complete packet gets copied.
+ * Queues for RLE packets collapse repeated values into runs.
+ */
+SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
+	const uint8_t *data, size_t samples_count)
+{
+	size_t count;
+	int ret;
+
+	if (q->run_lengths) {
+		while (samples_count) {
+			count = 1;
+			while (count < samples_count && memcmp(data,
+					&data[count * q->unit_size],
+					q->unit_size) == 0)
+				count++;
+			ret = feed_queue_logic_submit_rle(q, data, count);
+			if (ret != SR_OK)
+				return ret;
+			data += count * q->unit_size;
+			samples_count -= count;
+		}
+		return SR_OK;
+	}
+
+	/* Complete a pending packet first, to keep the sample order. */
+	if (q->fill_count) {
+		count = MIN(samples_count, q->alloc_count - q->fill_count);
+		memcpy(&q->data_bytes[q->fill_count * q->unit_size],
+			data, count * q->unit_size);
+		q->fill_count += count;
+		data += count * q->unit_size;
+		samples_count -= count;
 		if (q->fill_count == q->alloc_count) {
 			ret = feed_queue_logic_flush(q);
 			if (ret != SR_OK)
 				return ret;
-			wrptr = &q->data_bytes[0];
 		}
 	}
 
+	while (samples_count >= q->alloc_count) {
+		ret = feed_queue_logic_send_direct(q, data, q->alloc_count);
+		if (ret != SR_OK)
+			return ret;
+		data += q->alloc_count * q->unit_size;
+		samples_count -= q->alloc_count;
+	}
+
+	if (samples_count) {
+		memcpy(q->data_bytes, data, samples_count * q->unit_size);
+		q->fill_count = samples_count;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Submit a block of num_runs runs, each of them a sample value and its
+ * repeat count. Queues for RLE packets pass blocks of at least the
+ * queue's size to the session without a copy. Other queues expand the
+ * runs into individual samples.
+ */
+SR_API int feed_queue_logic_submit_runs(struct feed_queue_logic *q,
+	const uint8_t *values, const uint64_t *run_lengths, size_t num_runs)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle logic_rle;
+	size_t count;
+	int ret;
+
+	if (!q->run_lengths) {
+		while (num_runs--) {
+			ret = feed_queue_logic_submit(q, values, *run_lengths++);
+			if (ret != SR_OK)
+				return ret;
+			values += q->unit_size;
+		}
+		return SR_OK;
+	}
+
+	/* Copy runs while a packet is pending or the rest is short. */
+	while (num_runs && (q->fill_count || num_runs < q->alloc_count)) {
+		ret = feed_queue_logic_submit_rle(q, values, *run_lengths++);
+		if (ret != SR_OK)
+			return ret;
+		values += q->unit_size;
+		num_runs--;
+	}
+
+	memset(&logic_rle, 0, sizeof(logic_rle));
+	logic_rle.unitsize = q->unit_size;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &logic_rle;
+	while (num_runs >= q->alloc_count) {
+		count = q->alloc_count;
+		logic_rle.num_runs = count;
+		logic_rle.values = (void *)values;
+		logic_rle.run_lengths = (uint64_t *)run_lengths;
+		ret = sr_session_send(q->sdi, &packet);
+		if (ret != SR_OK)
+			return ret;
+		values += count * q->unit_size;
+		run_lengths += count;
+		num_runs -= count;
+	}
+
+	while (num_runs--) {
+		ret = feed_queue_logic_submit_rle(q, values, *run_lengths++);
+		if (ret != SR_OK)
+			return ret;
+		values += q->unit_size;
+	}
+
 	return SR_OK;
 }
 
@@ -86,7 +327,7 @@ SR_API int feed_queue_logic_flush(struct feed_queue_logic *q)
 	if (!q->fill_count)
 		return SR_OK;
 
-	q->logic.length = q->fill_count * q->unit_size;
+	feed_queue_logic_fill_payload(q);
 	ret = sr_session_send(q->sdi, &q->packet);
 	if (ret != SR_OK)
 		return ret;
@@ -97,11 +338,21 @@ SR_API int feed_queue_logic_flush(struct feed_queue_logic *q)
 
 SR_API int feed_queue_logic_send_trigger(struct feed_queue_logic *q)
 {
+	struct sr_datafeed_packet packets[2];
 	int ret;
 
-	ret = feed_queue_logic_flush(q);
-	if (ret != SR_OK)
-		return ret;
+	/* Have pending samples and the trigger delivered in one batch. */
+	if (q->fill_count) {
+		feed_queue_logic_fill_payload(q);
+		packets[0] = q->packet;
+		packets[1].type = SR_DF_TRIGGER;
+		packets[1].payload = NULL;
+		ret = sr_session_send_batch(q->sdi, packets, 2);
+		if (ret != SR_OK)
+			return ret;
+		q->fill_count = 0;
+		return SR_OK;
+	}
 
 	ret = std_session_send_df_trigger(q->sdi);
 	if (ret != SR_OK)
@@ -117,6 +368,8 @@ SR_API void feed_queue_logic_free(struct feed_queue_logic *q)
 		return;
 
 	g_free(q->data_bytes);
+	g_free(q->run_lengths);
+	sr_session_mem_release(q->sdi, q->mem_bytes);
 	g_free(q);
 }
 
@@ -140,11 +393,15 @@ SR_API struct feed_queue_analog *feed_queue_analog_alloc(
 {
 	struct feed_queue_analog *q;
 
+	if (sr_session_mem_charge(sdi, sample_count * sizeof(float)) != SR_OK)
+		return NULL;
+
 	q = g_malloc0(sizeof(*q));
 	q->sdi = sdi;
 	q->alloc_count = sample_count;
 	q->data_values = g_try_malloc(q->alloc_count * sizeof(float));
 	if (!q->data_values) {
+		sr_session_mem_release(sdi, sample_count * sizeof(float));
 		g_free(q);
 		return NULL;
 	}
@@ -202,6 +459,7 @@ SR_API void feed_queue_analog_free(struct feed_queue_analog *q)
 		return;
 
 	g_free(q->data_values);
+	sr_session_mem_release(q->sdi, q->alloc_count * sizeof(float));
 	g_slist_free(q->channels);
 	g_free(q);
 }
@@ -344,6 +344,125 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 	return TRUE;
 }
 
+/** @cond PRIVATE */
+/* Confidence level of a match which no other module can beat. */
+#define SCAN_CONF_CERTAIN	1
+/** @endcond */
+
+/* One input module's format_match() call during a format scan. */
+struct scan_job {
+	const struct sr_input_module *imod;
+	GHashTable *meta;
+	gboolean done;
+	int ret;
+	unsigned int conf;
+};
+
+static void scan_job_run(struct scan_job *job)
+{
+	sr_spew("Trying module %s.", job->imod->id);
+	job->ret = job->imod->format_match(job->meta, &job->conf);
+	job->done = TRUE;
+	if (job->ret == SR_OK)
+		sr_dbg("Module %s matched, confidence %u.",
+			job->imod->id, job->conf);
+}
+
+static void scan_job_thread(gpointer data, gpointer user_data)
+{
+	(void)user_data;
+
+	scan_job_run(data);
+}
+
+/* Returns TRUE if the filename's extension is listed by the module. */
+static gboolean check_extension(const struct sr_input_module *imod,
+	const char *filename)
+{
+	const char *ext;
+	size_t i;
+
+	if (!imod->exts || !filename)
+		return FALSE;
+	ext = strrchr(filename, '.');
+	if (!ext || strchr(ext, G_DIR_SEPARATOR))
+		return FALSE;
+	ext++;
+	for (i = 0; imod->exts[i]; i++) {
+		if (g_ascii_strcasecmp(ext, imod->exts[i]) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Run the format_match() calls of the candidate modules, and return the
+ * module with the highest confidence (the lowest value). Ties go to the
+ * module which comes first in the input module list.
+ *
+ * Modules which claim the filename's extension get tried first, a
+ * certain match of theirs ends the scan. The remaining modules' checks
+ * run concurrently, some of them involve a lot of text parsing.
+ */
+static const struct sr_input_module *run_scan_jobs(struct scan_job *jobs,
+	size_t count, const char *filename)
+{
+	GThreadPool *pool;
+	struct scan_job *job;
+	const struct sr_input_module *best_imod;
+	unsigned int best_conf;
+	size_t i, pending, threads;
+
+	for (i = 0; filename && i < count; i++) {
+		job = &jobs[i];
+		if (!check_extension(job->imod, filename))
+			continue;
+		scan_job_run(job);
+		if (job->ret == SR_OK && job->conf <= SCAN_CONF_CERTAIN)
+			return job->imod;
+	}
+
+	pending = 0;
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].done)
+			pending++;
+	}
+	threads = MIN(pending, (size_t)g_get_num_processors());
+	pool = NULL;
+	if (threads > 1)
+		pool = g_thread_pool_new(scan_job_thread, NULL,
+			threads, FALSE, NULL);
+	for (i = 0; i < count; i++) {
+		job = &jobs[i];
+		if (job->done)
+			continue;
+		if (!pool || !g_thread_pool_push(pool, job, NULL))
+			scan_job_run(job);
+	}
+	if (pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+
+	best_imod = NULL;
+	best_conf = ~0;
+	for (i = 0; i < count; i++) {
+		job = &jobs[i];
+		/*
+		 * SR_ERR means the module didn't recognize the data,
+		 * SR_ERR_DATA that it recognized but cannot handle it.
+		 * Can also be SR_ERR_NA.
+		 */
+		if (job->ret != SR_OK)
+			continue;
+		if (job->conf >= best_conf)
+			continue;
+		best_imod = job->imod;
+		best_conf = job->conf;
+	}
+
+	return best_imod;
+}
+
 /**
  * Try to find an input module that can parse the given buffer.
  *
@@ -368,10 +487,10 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 {
 	const struct sr_input_module *imod, *best_imod;
+	struct scan_job *jobs;
 	GHashTable *meta;
 	unsigned int m, i;
-	unsigned int conf, best_conf;
-	int ret;
+	size_t count;
 	uint8_t mitem, avail_metadata[8];
 
 	/* No more metadata to be had from a buffer. */
@@ -379,8 +498,8 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 	avail_metadata[1] = 0;
 
 	*in = NULL;
-	best_imod = NULL;
-	best_conf = ~0;
+	jobs = g_malloc0_n(ARRAY_SIZE(input_module_list), sizeof(*jobs));
+	count = 0;
 	for (i = 0; input_module_list[i]; i++) {
 		imod = input_module_list[i];
 		if (!imod->metadata[0]) {
@@ -403,28 +522,16 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 			g_hash_table_destroy(meta);
 			continue;
 		}
-		sr_spew("Trying module %s.", imod->id);
-		ret = imod->format_match(meta, &conf);
-		g_hash_table_destroy(meta);
-		if (ret == SR_ERR_DATA) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		} else if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Can be SR_ERR_NA. */
-			continue;
-		}
-
-		/* Found a matching module. */
-		sr_spew("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
+		jobs[count].imod = imod;
+		jobs[count].meta = meta;
+		count++;
 	}
 
+	best_imod = run_scan_jobs(jobs, count, NULL);
+	for (i = 0; i < count; i++)
+		g_hash_table_destroy(jobs[i].meta);
+	g_free(jobs);
+
 	if (best_imod) {
 		*in = sr_input_new(best_imod, NULL);
 		g_string_insert_len((*in)->buf, 0, buf->str, buf->len);
@@ -448,12 +555,11 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	int64_t filesize;
 	FILE *stream;
 	const struct sr_input_module *imod, *best_imod;
+	struct scan_job *jobs;
 	GHashTable *meta;
 	GString *header;
 	size_t count;
 	unsigned int midx, i;
-	unsigned int conf, best_conf;
-	int ret;
 	uint8_t avail_metadata[8];
 
 	*in = NULL;
@@ -499,8 +605,8 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	avail_metadata[midx] = 0;
 	/* TODO: MIME type */
 
-	best_imod = NULL;
-	best_conf = ~0;
+	jobs = g_malloc0_n(ARRAY_SIZE(input_module_list), sizeof(*jobs));
+	count = 0;
 	for (i = 0; input_module_list[i]; i++) {
 		imod = input_module_list[i];
 		if (!imod->metadata[0]) {
@@ -512,23 +618,14 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 			/* Cannot satisfy this module's requirements. */
 			continue;
 
-		sr_dbg("Trying module %s.", imod->id);
-
-		ret = imod->format_match(meta, &conf);
-		if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		}
-		/* Found a matching module. */
-		sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
+		/* The modules only read from the shared metadata. */
+		jobs[count].imod = imod;
+		jobs[count].meta = meta;
+		count++;
 	}
+
+	best_imod = run_scan_jobs(jobs, count, filename);
+	g_free(jobs);
 	g_hash_table_destroy(meta);
 	g_string_free(header, TRUE);
 
@@ -597,6 +694,136 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
 	return in->module->receive((struct sr_input *)in, buf);
 }
 
+/**
+ * Memory map an input file, to feed it to the input instance.
+ *
+ * After the file was mapped, sr_input_send_mapped() passes slices of
+ * the file to the input instance. Input modules which support it process
+ * the slices where they are, others receive copies the way sr_input_send()
+ * passes them.
+ *
+ * @param in_ro The input instance.
+ * @param filename The name of the file to map.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The file could not be mapped.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_map_file(const struct sr_input *in_ro, const char *filename)
+{
+	struct sr_input *in;
+	GMappedFile *mapped;
+	GError *error;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+	if (!in || !filename || !filename[0])
+		return SR_ERR_ARG;
+
+	error = NULL;
+	mapped = sr_file_map(filename, &error);
+	if (!mapped) {
+		sr_err("Failed to map %s: %s", filename, error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+	if (in->mapped_file)
+		g_mapped_file_unref(in->mapped_file);
+	in->mapped_file = mapped;
+	in->mapped_pos = 0;
+	sr_dbg("Mapped %s, %zu bytes.", filename,
+		(size_t)g_mapped_file_get_length(mapped));
+
+	return SR_OK;
+}
+
+/**
+ * Send the next slice of a mapped input file to the input instance.
+ *
+ * Like sr_input_send(), this returns the moment the instance's device
+ * becomes ready, so that callers can examine it before sample data is
+ * sent to the session.
+ *
+ * @param in_ro The input instance, with a file mapped by sr_input_map_file().
+ * @param len The maximum number of bytes to send.
+ * @param remain Pointer where the number of bytes which the instance has
+ *               yet to consume gets stored. Zero after the complete file
+ *               was sent, callers then continue with sr_input_end().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no file was mapped.
+ * @retval other Error code of the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_send_mapped(const struct sr_input *in_ro, size_t len,
+		size_t *remain)
+{
+	struct sr_input *in;
+	const uint8_t *data;
+	size_t total, slice, used;
+	gboolean was_ready;
+	GString *buf;
+	int ret;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+	if (!in || !in->mapped_file || !len || !remain)
+		return SR_ERR_ARG;
+
+	data = (const uint8_t *)g_mapped_file_get_contents(in->mapped_file);
+	total = g_mapped_file_get_length(in->mapped_file);
+	*remain = total - MIN(in->mapped_pos, total);
+	if (!*remain)
+		return SR_OK;
+	data += in->mapped_pos;
+	slice = MIN(len, total - in->mapped_pos);
+
+	/* Modules without slice support get a copy, as from a file read. */
+	if (!in->module->receive_slice) {
+		buf = g_string_new_len((const char *)data, slice);
+		ret = sr_input_send(in, buf);
+		g_string_free(buf, TRUE);
+		if (ret != SR_OK)
+			return ret;
+		in->mapped_pos += slice;
+		*remain = total - in->mapped_pos;
+		return SR_OK;
+	}
+
+	/*
+	 * Offer larger slices while the module neither consumed data
+	 * nor became ready, it may need more data in one piece.
+	 */
+	while (TRUE) {
+		was_ready = in->sdi_ready;
+		used = 0;
+		sr_spew("Sending %zu mapped bytes to %s module.",
+			slice, in->module->id);
+		ret = in->module->receive_slice(in, data, slice, &used);
+		if (ret != SR_OK)
+			return ret;
+		used = MIN(used, slice);
+		if (used || in->sdi_ready != was_ready)
+			break;
+		if (in->mapped_pos + slice >= total)
+			break;
+		slice = MIN(2 * slice, total - in->mapped_pos);
+	}
+	in->mapped_pos += used;
+
+	/* Keep what remains of the last slice for end() to process. */
+	if (in->mapped_pos + (slice - used) >= total && used < slice
+			&& in->sdi_ready == was_ready) {
+		g_string_append_len(in->buf, (const char *)data + used,
+			slice - used);
+		in->mapped_pos = total;
+	}
+	*remain = total - in->mapped_pos;
+
+	return SR_OK;
+}
+
 /**
  * Signal the input module no more data will come.
  *
@@ -661,6 +888,7 @@ SR_API int sr_input_reset(const struct sr_input *in_ro)
 	if (in->buf)
 		g_string_truncate(in->buf, 0);
 	in->sdi_ready = FALSE;
+	in->mapped_pos = 0;
 
 	return rc;
 }
@@ -695,6 +923,8 @@ SR_API void sr_input_free(const struct sr_input *in)
 			" unprocessed bytes at free time.", in->buf->len);
 	}
 	g_string_free(in->buf, TRUE);
+	if (in->mapped_file)
+		g_mapped_file_unref(in->mapped_file);
 	g_free(in->priv);
 	g_free((gpointer)in);
 }
@@ -63,7 +63,8 @@
 #define LOG_PREFIX	"input/logicport"
 
 #define MAX_CHANNELS	34
-#define CHUNK_SIZE	(4 * 1024 * 1024)
+/* Sample lines carry repetition counts, they get sent as runs. */
+#define MAX_FEED_RUNS	(64 * 1024)
 
 #define CRLF		"\r\n"
 #define DC1_CHR		'\x11'
@@ -127,9 +128,7 @@ struct context {
 	GSList *signal_groups;
 	GSList *channels;
 	size_t unitsize;
-	size_t samples_per_chunk;
-	size_t samples_in_buffer;
-	uint8_t *feed_buffer;
+	struct feed_queue_logic *feed;
 };
 
 static struct signal_group_desc *alloc_signal_group(const char *name)
@@ -415,32 +414,39 @@ static int process_inverted_channels(struct context *inc, char **flags)
 	return SR_OK;
 }
 
-static int process_sample_line(struct context *inc, char **values)
+static int process_sample_line(struct context *inc, char *line)
 {
-	size_t count, idx;
+	size_t idx;
 	struct sample_data_entry *entry;
 	uint64_t mask;
+	char *value, *sep;
 	long conv_ret;
 	int rc;
 
 	/*
-	 * The 'values' array contains '0'/'1' text representation of
-	 * wire's values, as well as a (a textual representation of a)
-	 * repeat counter for that set of samples.
+	 * The comma separated line contains '0'/'1' text representation
+	 * of wire's values, as well as a (a textual representation of a)
+	 * repeat counter for that set of samples. Lines are many and
+	 * short, so they get split in place rather than into a vector.
 	 */
-	count = g_strv_length(values);
-	if (count != inc->channel_count + 1)
-		return SR_ERR_DATA;
 	entry = &inc->sample_data_queue[inc->sample_lines_read];
 	entry->bits = 0;
 	mask = UINT64_C(1);
+	value = line;
 	for (idx = 0; idx < inc->channel_count; idx++, mask <<= 1) {
-		if (strcmp(values[idx], "1") == 0)
+		sep = strchr(value, ',');
+		if (!sep)
+			return SR_ERR_DATA;
+		*sep = '\0';
+		if (strcmp(value, "1") == 0)
 			entry->bits |= mask;
-		if (strcmp(values[idx], "U") == 0)
+		if (strcmp(value, "U") == 0)
 			inc->wires_undefined |= mask;
+		value = sep + 1;
 	}
-	rc = sr_atol(values[inc->channel_count], &conv_ret);
+	if (strchr(value, ','))
+		return SR_ERR_DATA;
+	rc = sr_atol(value, &conv_ret);
 	if (rc != SR_OK)
 		return rc;
 	entry->repeat = conv_ret;
@@ -489,9 +495,7 @@ static int process_keyvalue_line(struct context *inc, char *line)
 	case SAMPLEDATA_DATA_LINES:
 		while (isspace(*line))
 			line++;
-		args = g_strsplit(line, ",", 0);
-		rc = process_sample_line(inc, args);
-		g_strfreev(args);
+		rc = process_sample_line(inc, line);
 		if (rc)
 			return rc;
 		inc->sample_lines_read++;
@@ -634,14 +638,15 @@ static int process_keyvalue_line(struct context *inc, char *line)
 	return SR_OK;
 }
 
-/* Check for, and isolate another line of text input. */
-static int have_text_line(struct sr_input *in, char **line, char **next)
+/* Check for, and isolate another line of text input, starting at pos. */
+static int have_text_line(struct sr_input *in, size_t pos,
+	char **line, char **next)
 {
 	char *sol_ptr, *eol_ptr;
 
-	if (!in || !in->buf || !in->buf->str)
+	if (!in || !in->buf || !in->buf->str || pos >= in->buf->len)
 		return 0;
-	sol_ptr = in->buf->str;
+	sol_ptr = in->buf->str + pos;
 	eol_ptr = strstr(sol_ptr, CRLF);
 	if (!eol_ptr)
 		return 0;
@@ -730,17 +735,22 @@ static int parse_header(struct sr_input *in)
 {
 	struct context *inc;
 	char *line, *next;
+	size_t pos;
 	int rc;
 
+	/* Drop the processed lines at once, not line by line. */
 	inc = in->priv;
-	while (have_text_line(in, &line, &next)) {
+	pos = 0;
+	rc = SR_OK;
+	while (have_text_line(in, pos, &line, &next)) {
 		rc = process_text_line(inc, line);
-		g_string_erase(in->buf, 0, next - line);
+		pos = next - in->buf->str;
 		if (rc)
-			return rc;
+			break;
 	}
+	g_string_erase(in->buf, 0, pos);
 
-	return SR_OK;
+	return rc;
 }
 
 /* Create sigrok channels and groups. */
@@ -795,7 +805,7 @@ static int create_channels_groups(struct sr_input *in)
 	return SR_OK;
 }
 
-/* Allocate the session feed buffer. */
+/* Allocate the session feed queue. */
 static int create_feed_buffer(struct sr_input *in)
 {
 	struct context *inc;
@@ -803,26 +813,21 @@ static int create_feed_buffer(struct sr_input *in)
 	inc = in->priv;
 
 	inc->unitsize = (inc->channel_count + 7) / 8;
-	inc->samples_per_chunk = CHUNK_SIZE / inc->unitsize;
-	inc->samples_in_buffer = 0;
-	inc->feed_buffer = g_malloc0(inc->samples_per_chunk * inc->unitsize);
-	if (!inc->feed_buffer)
+	inc->feed = feed_queue_logic_alloc_rle(in->sdi,
+		MIN(inc->sample_lines_total, MAX_FEED_RUNS), inc->unitsize);
+	if (!inc->feed)
 		return SR_ERR_MALLOC;
 
 	return SR_OK;
 }
 
-/* Send all accumulated sample data values to the session. */
-static int send_buffer(struct sr_input *in)
+/* Send the datafeed header and the samplerate, before the first samples. */
+static int send_feed_header(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	int rc;
 
 	inc = in->priv;
-	if (!inc->samples_in_buffer)
-		return SR_OK;
 
 	if (!inc->header_sent) {
 		rc = std_session_send_df_header(in->sdi);
@@ -839,60 +844,41 @@ static int send_buffer(struct sr_input *in)
 		inc->rate_sent = TRUE;
 	}
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->unitsize;
-	logic.data = inc->feed_buffer;
-	logic.length = inc->unitsize * inc->samples_in_buffer;
-	rc = sr_session_send(in->sdi, &packet);
+	return SR_OK;
+}
 
-	inc->samples_in_buffer = 0;
+/* Send all accumulated sample data values to the session. */
+static int send_buffer(struct sr_input *in)
+{
+	struct context *inc;
 
-	if (rc)
-		return rc;
+	inc = in->priv;
+	if (!inc->feed)
+		return SR_OK;
 
-	return SR_OK;
+	return feed_queue_logic_flush(inc->feed);
 }
 
 /*
- * Add N copies of the current sample to the buffer. Send the buffer to
- * the session feed when a maximum amount of data was collected.
+ * Add N copies of the current sample. They become a run of the session
+ * feed, however large the repetition count is.
  */
 static int add_samples(struct sr_input *in, uint64_t samples, size_t count)
 {
 	struct context *inc;
 	uint8_t sample_buffer[sizeof(uint64_t)];
-	size_t idx;
-	size_t copy_count;
-	uint8_t *p;
 	int rc;
 
 	inc = in->priv;
-	for (idx = 0; idx < inc->unitsize; idx++) {
-		sample_buffer[idx] = samples & 0xff;
-		samples >>= 8;
-	}
-	while (count) {
-		copy_count = inc->samples_per_chunk - inc->samples_in_buffer;
-		if (copy_count > count)
-			copy_count = count;
-		count -= copy_count;
-
-		p = inc->feed_buffer + inc->samples_in_buffer * inc->unitsize;
-		while (copy_count-- > 0) {
-			memcpy(p, sample_buffer, inc->unitsize);
-			p += inc->unitsize;
-			inc->samples_in_buffer++;
-		}
+	if (!count)
+		return SR_OK;
 
-		if (inc->samples_in_buffer == inc->samples_per_chunk) {
-			rc = send_buffer(in);
-			if (rc)
-				return rc;
-		}
-	}
+	rc = send_feed_header(in);
+	if (rc)
+		return rc;
+	write_u64le(sample_buffer, samples);
 
-	return SR_OK;
+	return feed_queue_logic_submit(inc->feed, sample_buffer, count);
 }
 
 /* Pass on previously received samples to the session. */
@@ -1125,7 +1111,7 @@ static void cleanup(struct sr_input *in)
 		g_free(inc->signal_names[idx]);
 	g_slist_free_full(inc->signal_groups, sg_free);
 	g_slist_free_full(inc->channels, g_free);
-	g_free(inc->feed_buffer);
+	feed_queue_logic_free(inc->feed);
 	memset(inc, 0, sizeof(*inc));
 }
 
@@ -32,6 +32,8 @@
 
 /* How many bytes at a time to process and send to the session bus. */
 #define CHUNK_SIZE		(4 * 1024 * 1024)
+/* Size of converted float data per packet, sized to stay in the L2 cache. */
+#define FLOAT_CHUNK_SIZE	(256 * 1024)
 #define DEFAULT_NUM_CHANNELS	1
 #define DEFAULT_SAMPLERATE	0
 
@@ -40,11 +42,19 @@ struct context {
 	int fmt_index;
 	uint64_t samplerate;
 	int samplesize;
+	int num_channels;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+	/* Conversion to native floats during import. */
+	gboolean to_float;
+	float *float_data;
+	size_t float_samples;
+	struct sr_datafeed_packet float_packet;
+	struct sr_datafeed_analog float_analog;
+	struct sr_analog_encoding float_encoding;
 };
 
 struct sample_format {
@@ -110,6 +120,29 @@ static void init_context(struct context *inc, const struct sample_format *fmt, G
 	inc->meaning.channels = channels;
 
 	inc->spec.spec_digits = 0;
+
+	inc->float_packet.type = SR_DF_ANALOG;
+	inc->float_packet.payload = &inc->float_analog;
+
+	inc->float_analog.data = NULL;
+	inc->float_analog.num_samples = 0;
+	inc->float_analog.encoding = &inc->float_encoding;
+	inc->float_analog.meaning = &inc->meaning;
+	inc->float_analog.spec = &inc->spec;
+
+	memcpy(&inc->float_encoding, &fmt->encoding, sizeof(inc->float_encoding));
+	inc->float_encoding.unitsize = sizeof(float);
+	inc->float_encoding.is_signed = TRUE;
+	inc->float_encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	inc->float_encoding.is_bigendian = TRUE;
+#else
+	inc->float_encoding.is_bigendian = FALSE;
+#endif
+	inc->float_encoding.scale.p = 1;
+	inc->float_encoding.scale.q = 1;
+	inc->float_encoding.offset.p = 0;
+	inc->float_encoding.offset.q = 1;
 }
 
 static int init(struct sr_input *in, GHashTable *options)
@@ -147,15 +180,52 @@ static int init(struct sr_input *in, GHashTable *options)
 
 	inc->samplerate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
 	inc->samplesize = sample_formats[fmt_index].encoding.unitsize * num_channels;
+	inc->num_channels = num_channels;
 	init_context(inc, &sample_formats[fmt_index], in->sdi->channels);
 
+	inc->to_float = g_variant_get_boolean(g_hash_table_lookup(options, "tofloat"));
+	if (inc->to_float) {
+		inc->float_samples = FLOAT_CHUNK_SIZE / sizeof(float) / num_channels;
+		inc->float_samples = MAX(inc->float_samples, 1);
+		inc->float_data = g_malloc(inc->float_samples * num_channels * sizeof(float));
+	}
+
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/*
+ * Convert the complete samples of a block of data to native floats in
+ * cache sized pieces, and send them. Returns the size used.
+ */
+static size_t process_data_float(struct sr_input *in, const uint8_t *data, size_t len)
 {
 	struct context *inc;
-	unsigned int offset, chunk_size;
+	size_t offset, count;
+
+	inc = in->priv;
+
+	offset = 0;
+	while (len - offset >= (size_t)inc->samplesize) {
+		count = (len - offset) / inc->samplesize;
+		count = MIN(count, inc->float_samples);
+		inc->analog.data = (void *)(data + offset);
+		inc->analog.num_samples = count;
+		if (sr_analog_to_float(&inc->analog, inc->float_data) != SR_OK)
+			break;
+		inc->float_analog.data = inc->float_data;
+		inc->float_analog.num_samples = count;
+		sr_session_send(in->sdi, &inc->float_packet);
+		offset += count * inc->samplesize;
+	}
+
+	return offset;
+}
+
+/* Send the complete samples of a block of data, returns the size used. */
+static size_t process_data(struct sr_input *in, const uint8_t *data, size_t len)
+{
+	struct context *inc;
+	size_t offset, chunk_size;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -169,26 +239,37 @@ static int process_buffer(struct sr_input *in)
 		inc->started = TRUE;
 	}
 
+	if (inc->to_float)
+		return process_data_float(in, data, len);
+
 	/* Round down to the last channels * unitsize boundary. */
 	inc->analog.num_samples = CHUNK_SIZE / inc->samplesize;
 	chunk_size = inc->analog.num_samples * inc->samplesize;
 	offset = 0;
 
-	while ((offset + chunk_size) < in->buf->len) {
-		inc->analog.data = in->buf->str + offset;
+	while ((offset + chunk_size) < len) {
+		inc->analog.data = (void *)(data + offset);
 		sr_session_send(in->sdi, &inc->packet);
 		offset += chunk_size;
 	}
 
-	inc->analog.num_samples = (in->buf->len - offset) / inc->samplesize;
+	inc->analog.num_samples = (len - offset) / inc->samplesize;
 	chunk_size = inc->analog.num_samples * inc->samplesize;
 	if (chunk_size > 0) {
-		inc->analog.data = in->buf->str + offset;
+		inc->analog.data = (void *)(data + offset);
 		sr_session_send(in->sdi, &inc->packet);
 		offset += chunk_size;
 	}
 
-	if ((unsigned int)offset < in->buf->len) {
+	return offset;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	size_t offset;
+
+	offset = process_data(in, (const uint8_t *)in->buf->str, in->buf->len);
+	if (offset < in->buf->len) {
 		/*
 		 * The incoming buffer wasn't processed completely. Stash
 		 * the leftover data for next time.
@@ -218,6 +299,20 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	*used = process_data(in, data, len);
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -239,6 +334,7 @@ static struct sr_option options[] = {
 	{ "numchannels", "Number of analog channels", "The number of (analog) channels in the data", NULL, NULL },
 	{ "samplerate", "Sample rate (Hz)", "The sample rate of the (analog) data in Hz", NULL, NULL },
 	{ "format", "Data format", "The format of the data (data type, signedness, endianness)", NULL, NULL },
+	{ "tofloat", "Convert to float", "Convert the data to native float values during import", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -248,6 +344,7 @@ static const struct sr_option *get_options(void)
 		options[0].def = g_variant_ref_sink(g_variant_new_int32(DEFAULT_NUM_CHANNELS));
 		options[1].def = g_variant_ref_sink(g_variant_new_uint64(DEFAULT_SAMPLERATE));
 		options[2].def = g_variant_ref_sink(g_variant_new_string(sample_formats[0].fmt_name));
+		options[3].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
 		for (unsigned int i = 0; i < ARRAY_SIZE(sample_formats); i++) {
 			options[2].values = g_slist_append(options[2].values,
 				g_variant_ref_sink(g_variant_new_string(sample_formats[i].fmt_name)));
@@ -259,12 +356,18 @@ static const struct sr_option *get_options(void)
 
 static void cleanup(struct sr_input *in)
 {
+	struct context *inc;
+
+	inc = in->priv;
+	if (inc)
+		g_free(inc->float_data);
 	g_free(in->priv);
 	in->priv = NULL;
 
 	g_variant_unref(options[0].def);
 	g_variant_unref(options[1].def);
 	g_variant_unref(options[2].def);
+	g_variant_unref(options[3].def);
 	g_slist_free_full(options[2].values, (GDestroyNotify)g_variant_unref);
 }
 
@@ -287,6 +390,7 @@ SR_PRIV struct sr_input_module input_raw_analog = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
 	.cleanup = cleanup,
 	.reset = reset,
@@ -79,6 +79,17 @@
 
 #define CHUNK_SIZE  (4 * 1024 * 1024)
 
+/*
+ * Digital data which is stored as transitions gets passed on as runs,
+ * in SR_DF_LOGIC_RLE packets of up to this many runs. The session
+ * expands them for consumers which want plain logic packets, sparse
+ * signals don't get expanded to their full sample count here.
+ */
+#define RLE_RUNS  (64 * 1024)
+
+/* The largest sample data item: a timestamp and a 64bit data word. */
+#define MAX_ITEM_SIZE  (2 * sizeof(uint64_t))
+
 #define LOGIC2_MAGIC "<SALEAE>"
 #define LOGIC2_VERSION 0
 #define LOGIC2_TYPE_DIGITAL 0
@@ -160,6 +171,7 @@ struct context {
 		size_t samples_in_buffer;
 		uint8_t *buffer_digital;
 		float *buffer_analog;
+		struct feed_queue_logic *rle;
 		uint8_t *write_pos;
 		struct {
 			uint64_t stamp;
@@ -245,6 +257,14 @@ static int alloc_feed_buffer(struct sr_input *in)
 	case FMT_LOGIC1_DIGITAL:
 	case FMT_LOGIC2_DIGITAL:
 		inc->feed.unit_size = sizeof(inc->feed.last.digital);
+		if (inc->logic_state.format == FMT_LOGIC2_DIGITAL
+				|| inc->logic_state.when_changed) {
+			inc->feed.rle = feed_queue_logic_alloc_rle(in->sdi,
+				RLE_RUNS, inc->feed.unit_size);
+			if (!inc->feed.rle)
+				return SR_ERR_MALLOC;
+			break;
+		}
 		alloc_size /= inc->feed.unit_size;
 		inc->feed.samples_per_chunk = alloc_size;
 		alloc_size *= inc->feed.unit_size;
@@ -286,6 +306,8 @@ static int relse_feed_buffer(struct sr_input *in)
 	inc->feed.buffer_digital = NULL;
 	g_free(inc->feed.buffer_analog);
 	inc->feed.buffer_analog = NULL;
+	feed_queue_logic_free(inc->feed.rle);
+	inc->feed.rle = NULL;
 	inc->feed.write_pos = NULL;
 
 	return SR_OK;
@@ -310,22 +332,14 @@ static int setup_feed_buffer_channel(struct sr_input *in, size_t ch_idx)
 	return SR_OK;
 }
 
-static int flush_feed_buffer(struct sr_input *in)
+/* Send the datafeed header and the samplerate, before the first samples. */
+static int send_feed_header(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	struct sr_datafeed_analog analog;
-	struct sr_analog_encoding encoding;
-	struct sr_analog_meaning meaning;
-	struct sr_analog_spec spec;
 	int rc;
 
 	inc = in->priv;
 
-	if (!inc->feed.samples_in_buffer)
-		return SR_OK;
-
 	/* Automatically send a datafeed header before meta and samples. */
 	if (!inc->module_state.header_sent) {
 		rc = std_session_send_df_header(in->sdi);
@@ -341,6 +355,32 @@ static int flush_feed_buffer(struct sr_input *in)
 		inc->module_state.rate_sent = TRUE;
 	}
 
+	return SR_OK;
+}
+
+static int flush_feed_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	int rc;
+
+	inc = in->priv;
+
+	if (inc->feed.rle)
+		return feed_queue_logic_flush(inc->feed.rle);
+
+	if (!inc->feed.samples_in_buffer)
+		return SR_OK;
+
+	rc = send_feed_header(in);
+	if (rc)
+		return rc;
+
 	/*
 	 * Create a packet with either logic or analog payload. Rewind
 	 * the caller's write position.
@@ -378,12 +418,25 @@ static int addto_feed_buffer_logic(struct sr_input *in,
 	uint64_t data, size_t count)
 {
 	struct context *inc;
+	uint8_t unit[sizeof(uint64_t)];
+	int rc;
 
 	inc = in->priv;
 
 	if (inc->feed.is_analog)
 		return SR_ERR_ARG;
 
+	/* Runs take the count as it is, however large. */
+	if (inc->feed.rle) {
+		if (!count)
+			return SR_OK;
+		rc = send_feed_header(in);
+		if (rc)
+			return rc;
+		write_u64le(unit, data);
+		return feed_queue_logic_submit(inc->feed.rle, unit, count);
+	}
+
 	while (count--) {
 		if (inc->feed.unit_size == sizeof(uint64_t))
 			write_u64le_inc(&inc->feed.write_pos, data);
@@ -845,18 +898,17 @@ static int parse_next_item(struct sr_input *in,
 	/* UNREACH */
 }
 
-static int parse_samples(struct sr_input *in)
+/* Process the complete items of the data, get the number of bytes used. */
+static int parse_data(struct sr_input *in,
+	const uint8_t *start, size_t blen, size_t *used)
 {
-	const uint8_t *buff, *start;
-	size_t blen;
+	const uint8_t *buff;
 
 	const uint8_t *curr, *next;
 	size_t len;
 	int rc;
 
-	start = (const uint8_t *)in->buf->str;
 	buff = start;
-	blen = in->buf->len;
 	while (have_next_item(in, buff, blen, &curr, &next)) {
 		len = next - curr;
 		rc = parse_next_item(in, curr, len);
@@ -865,7 +917,19 @@ static int parse_samples(struct sr_input *in)
 		buff += len;
 		blen -= len;
 	}
-	len = buff - start;
+	*used = buff - start;
+
+	return SR_OK;
+}
+
+static int parse_samples(struct sr_input *in)
+{
+	size_t len;
+	int rc;
+
+	rc = parse_data(in, (const uint8_t *)in->buf->str, in->buf->len, &len);
+	if (rc)
+		return rc;
 	g_string_erase(in->buf, 0, len);
 
 	return SR_OK;
@@ -1029,6 +1093,49 @@ static int receive(struct sr_input *in, GString *buf)
 	return parse_samples(in);
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	struct context *inc;
+	GString *buf;
+	size_t fill;
+	int rc;
+
+	inc = in->priv;
+
+	/* The header goes through the receive buffer. */
+	if (!inc->module_state.got_header) {
+		buf = g_string_new_len((const char *)data, len);
+		rc = receive(in, buf);
+		g_string_free(buf, TRUE);
+		*used = len;
+		return rc;
+	}
+
+	/*
+	 * Complete the item which the receive buffer holds a part of.
+	 * What remains of the appended data gets offered again.
+	 */
+	fill = 0;
+	if (in->buf->len) {
+		fill = MIN(len, MAX_ITEM_SIZE);
+		g_string_append_len(in->buf, (const char *)data, fill);
+		rc = parse_samples(in);
+		if (rc)
+			return rc;
+		if (in->buf->len > fill) {
+			*used = fill;
+			return SR_OK;
+		}
+		fill -= in->buf->len;
+		g_string_truncate(in->buf, 0);
+	}
+	rc = parse_data(in, data + fill, len - fill, used);
+	*used += fill;
+
+	return rc;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -1209,6 +1316,7 @@ SR_PRIV struct sr_input_module input_saleae = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
 	.cleanup = cleanup,
 	.reset = reset,
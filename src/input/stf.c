@@ -155,6 +155,25 @@
 #define STF_CHUNK_STAMP_SIZE	8
 #define STF_CHUNK_SAMPLE_SIZE	14
 
+/* Up to 4 samples per 16bit item, when each takes 4 bits. */
+#define STF_CLUSTER_SAMPLES_MAX	(STF_CHUNK_SAMPLE_SIZE / sizeof(uint16_t) * 4)
+
+/*
+ * Records get their CRC checked and get decompressed independently
+ * of each other. With several threads, as many records as threads are
+ * collected from the receive buffer, and get decompressed in parallel.
+ * Their samples are processed in file order afterwards.
+ */
+struct stf_record {
+	size_t len;		/* Payload length. */
+	uint32_t crc;		/* Payload checksum. */
+	const uint8_t *comp;	/* Compressed payload, in the receive buffer. */
+	size_t comp_len;
+	gboolean crc_ok;
+	int lzo_rc;
+	uint8_t raw[STF_DATA_REC_PLMAX];	/* Payload data. */
+};
+
 struct context {
 	enum stf_stage {
 		STF_STAGE_MAGIC,
@@ -183,13 +202,17 @@ struct context {
 		time_t c_date_time;	/* File creation time (Unix epoch). */
 		char *omega_data_class;	/* Chunked or streamed, Omega only. */
 	} header;
-	struct stf_record {
-		size_t len;		/* Payload length. */
-		uint32_t crc;		/* Payload checksum. */
-		uint8_t raw[STF_DATA_REC_PLMAX];	/* Payload data. */
-	} record_data;
+	struct {
+		struct stf_record *records;	/* Decompression buffers. */
+		size_t count;
+		GThreadPool *pool;
+		size_t pending;
+		GMutex mutex;
+		GCond cond;
+	} decomp;
 	struct keep_specs {
 		uint64_t sample_rate;
+		uint32_t num_threads;
 		GSList *prev_sr_channels;
 	} keep;
 	struct {
@@ -202,6 +225,8 @@ struct context {
 		size_t unit_size;
 		uint16_t curr_data;	/* Current sample data. */
 		struct feed_queue_logic *feed;	/* Session feed helper. */
+		/* Sample in an item, low/high byte of the item, byte value. */
+		uint16_t xlat[4][2][256];
 	} submit;
 };
 
@@ -527,6 +552,8 @@ static int eval_header(const struct sr_input *in)
 	return SR_OK;
 }
 
+static void xlat_prepare(const struct sr_input *in);
+
 /* Preare datafeed submission in the DATA phase. */
 static int data_enter(const struct sr_input *in)
 {
@@ -562,6 +589,7 @@ static int data_enter(const struct sr_input *in)
 		CHUNKSIZE, inc->submit.unit_size);
 	if (!inc->submit.feed)
 		return SR_ERR_MALLOC;
+	xlat_prepare(in);
 
 	return SR_OK;
 }
@@ -640,6 +668,51 @@ static void add_sample(const struct sr_input *in, uint16_t data, size_t count)
 	}
 }
 
+/* Forward several individual samples, optionally mark trigger location. */
+static void add_samples(const struct sr_input *in,
+	const uint16_t *data, size_t count)
+{
+	struct context *inc;
+	uint8_t buffer[STF_CLUSTER_SAMPLES_MAX * sizeof(uint16_t)];
+	size_t unit_size, idx, send_first;
+
+	inc = in->priv;
+
+	if (inc->submit.submit_count + count > inc->submit.sample_count)
+		count = inc->submit.sample_count - inc->submit.submit_count;
+	if (!count)
+		return;
+
+	/* Same as add_sample(), for a block of different values. */
+	unit_size = inc->submit.unit_size;
+	for (idx = 0; idx < count; idx++) {
+		if (unit_size == 1)
+			write_u8(&buffer[idx], data[idx]);
+		else
+			write_u16le(&buffer[idx * unit_size], data[idx]);
+	}
+	send_first = 0;
+	if (inc->submit.samples_to_trigger
+			&& count >= inc->submit.samples_to_trigger)
+		send_first = inc->submit.samples_to_trigger;
+	if (send_first) {
+		(void)feed_queue_logic_submit_many(inc->submit.feed,
+			buffer, send_first);
+		inc->submit.submit_count += send_first;
+		inc->submit.samples_to_trigger = 0;
+		sr_dbg("Trigger: sending DF packet, at %" PRIu64 ".",
+			inc->submit.submit_count);
+		feed_queue_logic_send_trigger(inc->submit.feed);
+	}
+	if (count > send_first) {
+		(void)feed_queue_logic_submit_many(inc->submit.feed,
+			&buffer[send_first * unit_size], count - send_first);
+		inc->submit.submit_count += count - send_first;
+		if (inc->submit.samples_to_trigger)
+			inc->submit.samples_to_trigger -= count - send_first;
+	}
+}
+
 static int match_magic(GString *buf)
 {
 
@@ -818,7 +891,7 @@ static uint16_t get_sample_bits_4(uint16_t indata, int idx)
 }
 
 /* Map from Sigma file bit position to sigrok channel bit position. */
-static uint16_t map_input_chans(struct sr_input *in, uint16_t bits)
+static uint16_t map_input_chans(const struct sr_input *in, uint16_t bits)
 {
 	struct context *inc;
 	uint16_t data;
@@ -835,60 +908,60 @@ static uint16_t map_input_chans(struct sr_input *in, uint16_t bits)
 	return data;
 }
 
-/* Forward one 16bit entity to the session feed. */
-static void xlat_send_sample_data(struct sr_input *in, uint16_t indata)
+/*
+ * Prepare the translation of 16bit entities to sample data. Depending
+ * on the sample rate the memory layout for sample data varies. Get one,
+ * two, or four samples of 16, 8, or 4 bits each from one 16bit entity.
+ * Get a "dense" mapping of the enabled channels from the "spread" input
+ * data. Both steps only move bits, so a sample's value is the OR of
+ * what the entity's low and high byte contribute, which gets looked up
+ * in tables instead of being computed bit by bit for every sample.
+ */
+static void xlat_prepare(const struct sr_input *in)
 {
 	struct context *inc;
-	uint16_t bits, data;
+	size_t count, idx, byte;
+	uint16_t value, indata, bits;
 
-	/*
-	 * Depending on the sample rate the memory layout for sample
-	 * data varies. Get one, two, or four samples of 16, 8, or 4
-	 * bits each from one 16bit entity. Get a "dense" mapping of
-	 * the enabled channels from the "spread" input data. Forward
-	 * the dense logic data for datafeed submission to the session,
-	 * increment the timestamp for each submitted sample, and keep
-	 * the last submitted pattern since it must be repeated when
-	 * the next sample's timestamp is not adjacent to the current.
-	 */
 	inc = in->priv;
-	switch (inc->submit.bits_per_sample) {
-	case 16:
-		bits = get_sample_bits_16(indata);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		inc->submit.last_submit_ts++;
-		inc->submit.curr_data = data;
-		break;
-	case 8:
-		bits = get_sample_bits_8(indata, 0);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		bits = get_sample_bits_8(indata, 1);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		inc->submit.last_submit_ts++;
-		inc->submit.curr_data = data;
-		break;
-	case 4:
-		bits = get_sample_bits_4(indata, 0);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		bits = get_sample_bits_4(indata, 1);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		bits = get_sample_bits_4(indata, 2);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		bits = get_sample_bits_4(indata, 3);
-		data = map_input_chans(in, bits);
-		add_sample(in, data, 1);
-		inc->submit.last_submit_ts++;
-		inc->submit.curr_data = data;
-		break;
+	count = 16 / inc->submit.bits_per_sample;
+	for (idx = 0; idx < count; idx++) {
+		for (byte = 0; byte < 2; byte++) {
+			for (value = 0; value < 256; value++) {
+				indata = value << (8 * byte);
+				switch (inc->submit.bits_per_sample) {
+				case 16:
+					bits = get_sample_bits_16(indata);
+					break;
+				case 8:
+					bits = get_sample_bits_8(indata, idx);
+					break;
+				default:
+					bits = get_sample_bits_4(indata, idx);
+					break;
+				}
+				inc->submit.xlat[idx][byte][value] =
+					map_input_chans(in, bits);
+			}
+		}
 	}
 }
 
+/* Get the samples of one 16bit entity, returns their count. */
+static size_t xlat_sample_data(const struct context *inc,
+	uint16_t indata, uint16_t *samples)
+{
+	size_t count, idx;
+
+	count = 16 / inc->submit.bits_per_sample;
+	for (idx = 0; idx < count; idx++) {
+		samples[idx] = inc->submit.xlat[idx][0][indata & 0xff]
+			| inc->submit.xlat[idx][1][indata >> 8];
+	}
+
+	return count;
+}
+
 /* Parse one "chunk" of a "record" of the file. */
 static int stf_parse_data_chunk(struct sr_input *in,
 	const uint8_t *info, const uint8_t *stamps, const uint8_t *samples)
@@ -897,8 +970,9 @@ static int stf_parse_data_chunk(struct sr_input *in,
 	uint32_t chunk_id;
 	uint64_t first_ts, last_ts, chunk_len;
 	uint64_t ts, ts_diff;
-	size_t cluster, sample_count, sample;
+	size_t cluster, sample_count, sample, fill;
 	uint16_t sample_data;
+	uint16_t cluster_data[STF_CLUSTER_SAMPLES_MAX];
 
 	inc = in->priv;
 
@@ -970,10 +1044,15 @@ static int stf_parse_data_chunk(struct sr_input *in,
 			add_sample(in, inc->submit.curr_data, ts_diff);
 		}
 		inc->submit.last_submit_ts = ts;
+		fill = 0;
 		for (sample = 0; sample < sample_count; sample++) {
 			sample_data = read_u16le_inc(&samples);
-			xlat_send_sample_data(in, sample_data);
+			fill += xlat_sample_data(inc, sample_data,
+				&cluster_data[fill]);
 		}
+		add_samples(in, cluster_data, fill);
+		inc->submit.last_submit_ts += sample_count;
+		inc->submit.curr_data = cluster_data[fill - 1];
 		if (inc->submit.submit_count >= inc->submit.sample_count) {
 			sr_dbg("Cluster: Sample count reached, stopping.");
 			return SR_OK;
@@ -1024,21 +1103,127 @@ static int stf_parse_data_record(struct sr_input *in, struct stf_record *rec)
 	return SR_OK;
 }
 
+/* Check and uncompress a record's payload, runs on worker threads. */
+static void decompress_record(struct stf_record *rec)
+{
+	lzo_uint raw_len;
+
+	rec->crc_ok = crc32(0, rec->comp, rec->comp_len) == rec->crc;
+	if (!rec->crc_ok)
+		return;
+	raw_len = sizeof(rec->raw);
+	rec->lzo_rc = lzo1x_decompress_safe(rec->comp, rec->comp_len,
+		rec->raw, &raw_len, NULL);
+	rec->len = raw_len;
+}
+
+static void decompress_job_run(gpointer data, gpointer user_data)
+{
+	struct context *inc;
+
+	inc = user_data;
+	decompress_record(data);
+
+	g_mutex_lock(&inc->decomp.mutex);
+	inc->decomp.pending--;
+	g_cond_signal(&inc->decomp.cond);
+	g_mutex_unlock(&inc->decomp.mutex);
+}
+
+/*
+ * Get the decompression buffers, which get reused for all records.
+ * Start worker threads when the user asked for several.
+ */
+static int start_decompression(struct context *inc)
+{
+	GError *error;
+
+	if (inc->decomp.records)
+		return SR_OK;
+
+	inc->decomp.count = MAX(inc->keep.num_threads, 1);
+	inc->decomp.records = g_try_malloc0(inc->decomp.count
+		* sizeof(inc->decomp.records[0]));
+	if (!inc->decomp.records)
+		return SR_ERR_MALLOC;
+	if (inc->decomp.count == 1)
+		return SR_OK;
+
+	error = NULL;
+	inc->decomp.pool = g_thread_pool_new(decompress_job_run, inc,
+		inc->decomp.count, FALSE, &error);
+	if (!inc->decomp.pool) {
+		sr_err("Cannot create decompression threads: %s.", error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+	g_mutex_init(&inc->decomp.mutex);
+	g_cond_init(&inc->decomp.cond);
+	sr_dbg("Decompressing records on %zu threads.", inc->decomp.count);
+
+	return SR_OK;
+}
+
+static void stop_decompression(struct context *inc)
+{
+	if (inc->decomp.pool) {
+		g_thread_pool_free(inc->decomp.pool, FALSE, TRUE);
+		inc->decomp.pool = NULL;
+		g_cond_clear(&inc->decomp.cond);
+		g_mutex_clear(&inc->decomp.mutex);
+	}
+	g_free(inc->decomp.records);
+	inc->decomp.records = NULL;
+	inc->decomp.count = 0;
+}
+
+/* Decompress the first count records, in parallel when possible. */
+static void decompress_records(struct context *inc, size_t count)
+{
+	GError *error;
+	size_t i;
+
+	if (count == 1 || !inc->decomp.pool) {
+		for (i = 0; i < count; i++)
+			decompress_record(&inc->decomp.records[i]);
+		return;
+	}
+
+	inc->decomp.pending = count;
+	for (i = 0; i < count; i++) {
+		error = NULL;
+		if (!g_thread_pool_push(inc->decomp.pool,
+				&inc->decomp.records[i], &error)) {
+			sr_warn("Cannot queue decompression job: %s.",
+				error->message);
+			g_error_free(error);
+			decompress_job_run(&inc->decomp.records[i], inc);
+		}
+	}
+	g_mutex_lock(&inc->decomp.mutex);
+	while (inc->decomp.pending)
+		g_cond_wait(&inc->decomp.cond, &inc->decomp.mutex);
+	g_mutex_unlock(&inc->decomp.mutex);
+}
+
 /* Parse the "data" section of the file (sample data). */
 static int parse_file_data(struct sr_input *in)
 {
 	struct context *inc;
+	struct stf_record *rec;
 	size_t len, final_len;
-	uint32_t crc, crc_calc;
-	size_t have_len, want_len;
+	uint32_t crc;
+	size_t have_len, taken, count, idx;
 	const uint8_t *read_ptr;
-	void *compressed;
-	lzo_uint raw_len;
+	gboolean last_seen;
 	int rc;
 
 	inc = in->priv;
 
 	rc = data_enter(in);
+	if (rc != SR_OK)
+		return rc;
+	rc = start_decompression(inc);
 	if (rc != SR_OK)
 		return rc;
 
@@ -1062,68 +1247,77 @@ static int parse_file_data(struct sr_input *in)
 		 * Wait for record data to become available. Check for
 		 * the availability of a header, get the payload size
 		 * from the header, check for the data's availability.
-		 * Check the CRC of the (compressed) payload data.
+		 * Collect as many complete records as there are
+		 * decompression buffers.
 		 */
 		have_len = in->buf->len;
-		if (have_len < STF_DATA_REC_HDRLEN) {
-			sr_dbg("Data: Need more receive data (header).");
-			return SR_OK;
-		}
 		read_ptr = (const uint8_t *)in->buf->str;
-		len = read_u32le_inc(&read_ptr);
-		crc = read_u32le_inc(&read_ptr);
-		if (len == final_len && !crc) {
-			sr_dbg("Data: Last record seen.");
-			g_string_erase(in->buf, 0, STF_DATA_REC_HDRLEN);
-			inc->file_stage = STF_STAGE_DONE;
-			return SR_OK;
-		}
-		sr_dbg("Data: Record header, len %zu, crc 0x%08lx.",
-			len, (unsigned long)crc);
-		if (len > STF_DATA_REC_PLMAX) {
-			sr_err("Data: Illegal record length %zu.", len);
-			return SR_ERR_DATA;
+		taken = 0;
+		count = 0;
+		last_seen = FALSE;
+		while (count < inc->decomp.count) {
+			if (have_len - taken < STF_DATA_REC_HDRLEN)
+				break;
+			len = read_u32le_inc(&read_ptr);
+			crc = read_u32le_inc(&read_ptr);
+			if (len == final_len && !crc) {
+				last_seen = TRUE;
+				break;
+			}
+			sr_dbg("Data: Record header, len %zu, crc 0x%08lx.",
+				len, (unsigned long)crc);
+			if (len > STF_DATA_REC_PLMAX) {
+				sr_err("Data: Illegal record length %zu.", len);
+				return SR_ERR_DATA;
+			}
+			if (have_len - taken < STF_DATA_REC_HDRLEN + len)
+				break;
+			rec = &inc->decomp.records[count++];
+			rec->comp = read_ptr;
+			rec->comp_len = len;
+			rec->crc = crc;
+			read_ptr += len;
+			taken += STF_DATA_REC_HDRLEN + len;
 		}
-		inc->record_data.len = len;
-		inc->record_data.crc = crc;
-		want_len = inc->record_data.len;
-		if (have_len < STF_DATA_REC_HDRLEN + want_len) {
-			sr_dbg("Data: Need more receive data (payload).");
+		if (!count && !last_seen) {
+			sr_dbg("Data: Need more receive data.");
 			return SR_OK;
 		}
-		crc_calc = crc32(0, read_ptr, want_len);
-		sr_spew("DBG: CRC32 calc comp 0x%08lx.",
-			(unsigned long)crc_calc);
-		if (crc_calc != inc->record_data.crc) {
-			sr_err("Data: Record payload CRC mismatch.");
-			return SR_ERR_DATA;
-		}
 
 		/*
-		 * Uncompress the payload data, have the record processed.
-		 * Drop the compressed receive data from the input buffer.
+		 * Check and uncompress the payload data, have the records
+		 * processed in file order. Drop the compressed receive
+		 * data from the input buffer.
 		 */
-		compressed = (void *)read_ptr;
-		raw_len = sizeof(inc->record_data.raw);
-		memset(&inc->record_data.raw, 0, sizeof(inc->record_data.raw));
-		rc = lzo1x_decompress_safe(compressed, want_len,
-			inc->record_data.raw, &raw_len, NULL);
-		g_string_erase(in->buf, 0, STF_DATA_REC_HDRLEN + want_len);
-		if (rc) {
-			sr_err("Data: Decompression error %d.", rc);
-			return SR_ERR_DATA;
+		decompress_records(inc, count);
+		for (idx = 0; idx < count; idx++) {
+			rec = &inc->decomp.records[idx];
+			if (!rec->crc_ok) {
+				sr_err("Data: Record payload CRC mismatch.");
+				return SR_ERR_DATA;
+			}
+			if (rec->lzo_rc) {
+				sr_err("Data: Decompression error %d.", rec->lzo_rc);
+				return SR_ERR_DATA;
+			}
+			if (rec->len > sizeof(rec->raw)) {
+				sr_err("Data: Excessive decompressed size %zu.",
+					rec->len);
+				return SR_ERR_DATA;
+			}
+			sr_spew("Data: Uncompressed record, len %zu.", rec->len);
+			rc = stf_parse_data_record(in, rec);
+			if (rc != SR_OK)
+				return rc;
 		}
-		if (raw_len > sizeof(inc->record_data.raw)) {
-			sr_err("Data: Excessive decompressed size %zu.",
-				(size_t)raw_len);
-			return SR_ERR_DATA;
+		g_string_erase(in->buf, 0, taken);
+
+		if (last_seen) {
+			sr_dbg("Data: Last record seen.");
+			g_string_erase(in->buf, 0, STF_DATA_REC_HDRLEN);
+			inc->file_stage = STF_STAGE_DONE;
+			return SR_OK;
 		}
-		inc->record_data.len = raw_len;
-		sr_spew("Data: Uncompressed record, len %zu.",
-			inc->record_data.len);
-		rc = stf_parse_data_record(in, &inc->record_data);
-		if (rc != SR_OK)
-			return rc;
 	}
 	return SR_OK;
 }
@@ -1260,6 +1454,8 @@ static int init(struct sr_input *in, GHashTable *options)
 	var = g_hash_table_lookup(options, "samplerate");
 	sample_rate = g_variant_get_uint64(var);
 	inc->keep.sample_rate = sample_rate;
+	var = g_hash_table_lookup(options, "threads");
+	inc->keep.num_threads = g_variant_get_uint32(var);
 
 	return SR_OK;
 }
@@ -1309,6 +1505,7 @@ static void cleanup(struct sr_input *in)
 	inc = in->priv;
 
 	g_slist_free_full(inc->channels, free_channel);
+	stop_decompression(inc);
 	feed_queue_logic_free(inc->submit.feed);
 	inc->submit.feed = NULL;
 	g_strfreev(inc->header.sigma_clksrc);
@@ -1337,6 +1534,7 @@ static int reset(struct sr_input *in)
 
 enum option_index {
 	OPT_SAMPLERATE,
+	OPT_THREADS,
 	OPT_MAX,
 };
 
@@ -1346,7 +1544,12 @@ static struct sr_option options[] = {
 		"The input data's sample rate in Hz. No default value.",
 		NULL, NULL,
 	},
-	ALL_ZERO,
+	[OPT_THREADS] = {
+		"threads", "Decompression threads",
+		"Number of threads which decompress data records, 0 decompresses while parsing (default).",
+		NULL, NULL,
+	},
+	[OPT_MAX] = ALL_ZERO,
 };
 
 static const struct sr_option *get_options(void)
@@ -1356,6 +1559,8 @@ static const struct sr_option *get_options(void)
 	if (!options[0].def) {
 		var = g_variant_new_uint64(0);
 		options[OPT_SAMPLERATE].def = g_variant_ref_sink(var);
+		var = g_variant_new_uint32(0);
+		options[OPT_THREADS].def = g_variant_ref_sink(var);
 	}
 
 	return options;
@@ -45,7 +45,8 @@
 
 #define LOG_PREFIX "input/trace32_ad"
 
-#define CHUNK_SIZE        (4 * 1024 * 1024)
+/* Records carry a value and a timestamp, they get sent as runs. */
+#define RLE_RUNS          (64 * 1024)
 #define MAX_POD_COUNT     12
 
 #define SPACE             ' '
@@ -100,7 +101,15 @@ struct context {
 	int32_t last_record;
 	uint64_t samplerate;
 	double timestamp_scale;
-	GString *out_buf;
+	/* Record offsets of the enabled pods' data and clock bits. */
+	size_t pod_used;
+	struct {
+		uint16_t data_offset;
+		uint16_t clk_offset;
+		uint8_t clk_bit;
+	} pod_layout[MAX_POD_COUNT];
+	size_t unitsize;
+	struct feed_queue_logic *feed;
 };
 
 static int process_header(GString *buf, struct context *inc);
@@ -182,7 +191,10 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR;
 	}
 
-	inc->out_buf = g_string_sized_new(CHUNK_SIZE);
+	inc->unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
+	inc->feed = feed_queue_logic_alloc_rle(in->sdi, RLE_RUNS, inc->unitsize);
+	if (!inc->feed)
+		return SR_ERR_MALLOC;
 
 	return SR_OK;
 }
@@ -418,60 +430,41 @@ static void send_metadata(struct sr_input *in)
 static void flush_output_buffer(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 
 	inc = in->priv;
-
-	if (inc->out_buf->len) {
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
-		logic.data = inc->out_buf->str;
-		logic.length = inc->out_buf->len;
-		sr_session_send(in->sdi, &packet);
-
-		g_string_truncate(inc->out_buf, 0);
-	}
+	if (inc->feed)
+		(void)feed_queue_logic_flush(inc->feed);
 }
 
-static void process_record_pi(struct sr_input *in, gsize start)
+/*
+ * Determine where the enabled pods' data lives in a PowerIntegrator
+ * record. The layout depends on the recording mode from the header.
+ *
+ * 0x00 u8  timestamp
+ * 0x08 u16 A15..0
+ * 0x0A u16 B15..0
+ * 0x0C u16 C15..0
+ * 0x0E u16 D15..0
+ * 0x10 u16 E15..0
+ * 0x12 u16 F15..0
+ * 0x14 u32 ??
+ * 0x18 u16 J15..0                          Not present in 500MHz mode
+ * 0x1A u16 K15..0                          Not present in 500MHz mode
+ * 0x1C u16 L15..0                          Not present in 500MHz mode
+ * 0x1E u16 M15..0                          Not present in 500MHz mode
+ * 0x20 u16 N15..0                          Not present in 500MHz mode
+ * 0x22 u16 O15..0                          Not present in 500MHz mode
+ * 0x24 u32 ??                              Not present in 500MHz mode
+ * 0x28/18 u8 CLKF..A (32=CLKF, .., 1=CLKA)
+ * 0x29/1A u8 CLKO..J (32=CLKO, .., 1=CLKJ) Not present in 500MHz mode
+ * 0x2A/19 u8 ??
+ * 0x2B/1A u8 ??
+ * 0x2C/1B u8 ??
+ */
+static void prepare_pod_layout(struct context *inc)
 {
-	struct context *inc;
-	uint64_t timestamp, next_timestamp;
-	uint32_t pod_data;
-	char single_payload[12 * 3];
-	GString *buf;
-	int i, pod_count, clk_offset, packet_count, pod;
-	int payload_bit, payload_len, value;
-
-	inc = in->priv;
-	buf = in->buf;
-
-	/*
-	 * 0x00 u8  timestamp
-	 * 0x08 u16 A15..0
-	 * 0x0A u16 B15..0
-	 * 0x0C u16 C15..0
-	 * 0x0E u16 D15..0
-	 * 0x10 u16 E15..0
-	 * 0x12 u16 F15..0
-	 * 0x14 u32 ??
-	 * 0x18 u16 J15..0                          Not present in 500MHz mode
-	 * 0x1A u16 K15..0                          Not present in 500MHz mode
-	 * 0x1C u16 L15..0                          Not present in 500MHz mode
-	 * 0x1E u16 M15..0                          Not present in 500MHz mode
-	 * 0x20 u16 N15..0                          Not present in 500MHz mode
-	 * 0x22 u16 O15..0                          Not present in 500MHz mode
-	 * 0x24 u32 ??                              Not present in 500MHz mode
-	 * 0x28/18 u8 CLKF..A (32=CLKF, .., 1=CLKA)
-	 * 0x29/1A u8 CLKO..J (32=CLKO, .., 1=CLKJ) Not present in 500MHz mode
-	 * 0x2A/19 u8 ??
-	 * 0x2B/1A u8 ??
-	 * 0x2C/1B u8 ??
-	 */
-
-	timestamp = RL64(buf->str + start);
+	int pod, pod_count, clk_offset;
+	size_t idx;
 
 	if (inc->record_mode == AD_MODE_500MHZ) {
 		pod_count = 6;
@@ -481,166 +474,114 @@ static void process_record_pi(struct sr_input *in, gsize start)
 		clk_offset = 0x28;
 	}
 
-	payload_bit = 0;
-	payload_len = 0;
-	single_payload[0] = 0;
-
+	idx = 0;
 	for (pod = 0; pod < pod_count; pod++) {
 		if (!inc->pod_status[pod])
 			continue;
-
-		switch (pod) {
-		case 0: /* A */
-			pod_data = RL16(buf->str + start + 0x08);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 1) << 16;
-			break;
-		case 1: /* B */
-			pod_data = RL16(buf->str + start + 0x0A);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 2) << 15;
-			break;
-		case 2: /* C */
-			pod_data = RL16(buf->str + start + 0x0C);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 4) << 14;
-			break;
-		case 3: /* D */
-			pod_data = RL16(buf->str + start + 0x0E);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 8) << 13;
-			break;
-		case 4: /* E */
-			pod_data = RL16(buf->str + start + 0x10);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 16) << 12;
-			break;
-		case 5: /* F */
-			pod_data = RL16(buf->str + start + 0x12);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 32) << 11;
-			break;
-		case 6: /* J */
-			pod_data = RL16(buf->str + start + 0x18);
-			pod_data |= (RL16(buf->str + start + 0x29) & 1) << 16;
-			break;
-		case 7: /* K */
-			pod_data = RL16(buf->str + start + 0x1A);
-			pod_data |= (RL16(buf->str + start + 0x29) & 2) << 15;
-			break;
-		case 8: /* L */
-			pod_data = RL16(buf->str + start + 0x1C);
-			pod_data |= (RL16(buf->str + start + 0x29) & 4) << 14;
-			break;
-		case 9: /* M */
-			pod_data = RL16(buf->str + start + 0x1E);
-			pod_data |= (RL16(buf->str + start + 0x29) & 8) << 13;
-			break;
-		case 10: /* N */
-			pod_data = RL16(buf->str + start + 0x20);
-			pod_data |= (RL16(buf->str + start + 0x29) & 16) << 12;
-			break;
-		case 11: /* O */
-			pod_data = RL16(buf->str + start + 0x22);
-			pod_data |= (RL16(buf->str + start + 0x29) & 32) << 11;
-			break;
-		default:
-			pod_data = 0;
-			sr_err("Don't know how to obtain data for pod %d.", pod);
-		}
-
-		for (i = 0; i < 17; i++) {
-			value = (pod_data >> i) & 1;
-			single_payload[payload_len] |= value << payload_bit;
-
-			payload_bit++;
-			if (payload_bit > 7) {
-				payload_bit = 0;
-				payload_len++;
-				single_payload[payload_len] = 0;
-			}
+		if (pod < 6) {
+			inc->pod_layout[idx].data_offset = 0x08 + 2 * pod;
+			inc->pod_layout[idx].clk_offset = clk_offset;
+			inc->pod_layout[idx].clk_bit = pod;
+		} else {
+			inc->pod_layout[idx].data_offset = 0x18 + 2 * (pod - 6);
+			inc->pod_layout[idx].clk_offset = 0x29;
+			inc->pod_layout[idx].clk_bit = pod - 6;
 		}
+		idx++;
 	}
+	inc->pod_used = idx;
+}
 
-	/* Make sure that payload_len accounts for any incomplete bytes used. */
-	if (payload_bit)
-		payload_len++;
+/*
+ * Send a record's sample data. The record's value is held until the
+ * next record's timestamp, which results in one run of samples.
+ */
+static void submit_record(struct sr_input *in, const char *rec,
+	const uint8_t *payload, size_t payload_len)
+{
+	struct context *inc;
+	uint64_t timestamp, next_timestamp, count;
 
-	i = (g_slist_length(in->sdi->channels) + 7) / 8;
-	if (payload_len != i) {
-		sr_err("Payload unit size is %d but should be %d!", payload_len, i);
+	inc = in->priv;
+
+	if (payload_len != inc->unitsize) {
+		sr_err("Payload unit size is %zu but should be %zu!",
+			payload_len, inc->unitsize);
 		return;
 	}
 
+	timestamp = RL64(rec);
 	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
 		sr_dbg("Trigger @%lf s, record #%d.",
 			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
+		feed_queue_logic_send_trigger(inc->feed);
 		inc->trigger_sent = TRUE;
 	}
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
-
+	/* The last record in the file is sent only once. */
+	count = 1;
+	if (inc->cur_record != inc->record_count - 1) {
+		next_timestamp = RL64(rec + inc->record_size);
+		count = (next_timestamp - timestamp) / inc->timestamp_scale;
 		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
-
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
+		if (!count)
+			count = 1;
 	}
 
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	(void)feed_queue_logic_submit(inc->feed, payload, count);
 }
 
-static void process_record_iprobe(struct sr_input *in, gsize start)
+static void process_record_pi(struct sr_input *in, const char *rec)
 {
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
-	char single_payload[3];
-	int i, payload_len, packet_count;
+	uint8_t payload[MAX_POD_COUNT * 3];
+	uint64_t acc;
+	uint32_t pod_data;
+	size_t idx, payload_len;
+	int acc_bits;
 
 	inc = in->priv;
 
 	/*
-	 * 0x00 u64 timestamp
-	 * 0x08 u16 IP15..0
-	 * 0x0A u8  CLK
+	 * Each pod contributes its 16 data bits and its clock bit to
+	 * the sample. Collect them in an accumulator and emit bytes.
 	 */
-
-	timestamp = RL64(in->buf->str + start);
-	single_payload[0] = R8(in->buf->str + start + 0x08);
-	single_payload[1] = R8(in->buf->str + start + 0x09);
-	single_payload[2] = R8(in->buf->str + start + 0x0A) & 1;
-	payload_len = 3;
-
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
-		inc->trigger_sent = TRUE;
+	acc = 0;
+	acc_bits = 0;
+	payload_len = 0;
+	for (idx = 0; idx < inc->pod_used; idx++) {
+		pod_data = RL16(rec + inc->pod_layout[idx].data_offset);
+		pod_data |= ((R8(rec + inc->pod_layout[idx].clk_offset)
+			>> inc->pod_layout[idx].clk_bit) & 1) << 16;
+		acc |= (uint64_t)pod_data << acc_bits;
+		acc_bits += 17;
+		while (acc_bits >= 8) {
+			payload[payload_len++] = acc & 0xff;
+			acc >>= 8;
+			acc_bits -= 8;
+		}
 	}
+	/* Make sure that payload_len accounts for any incomplete bytes used. */
+	if (acc_bits)
+		payload[payload_len++] = acc & 0xff;
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(in->buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
+	submit_record(in, rec, payload, payload_len);
+}
 
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
+static void process_record_iprobe(struct sr_input *in, const char *rec)
+{
+	uint8_t payload[3];
 
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
-	}
+	/*
+	 * 0x00 u64 timestamp
+	 * 0x08 u16 IP15..0
+	 * 0x0A u8  CLK
+	 */
+	payload[0] = R8(rec + 0x08);
+	payload[1] = R8(rec + 0x09);
+	payload[2] = R8(rec + 0x0A) & 1;
 
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	submit_record(in, rec, payload, sizeof(payload));
 }
 
 static void process_practice_token(struct sr_input *in, char *cmd_token)
@@ -728,7 +669,7 @@ static void process_practice(struct sr_input *in)
 	int i;
 
 	/* Gather all input data until we see the end marker. */
-	if (in->buf->str[in->buf->len - 1] != 0x29)
+	if (!in->buf->len || in->buf->str[in->buf->len - 1] != 0x29)
 		return;
 
 	delimiter[0] = 0x0A;
@@ -752,10 +693,52 @@ static void process_practice(struct sr_input *in)
 	g_string_erase(in->buf, 0, in->buf->len);
 }
 
+/*
+ * Process the complete records of the data, except for the last one,
+ * which process_record() needs to peek into. Get the number of bytes
+ * which were used.
+ */
+static int process_records(struct sr_input *in, const char *data,
+	size_t len, size_t *used)
+{
+	struct context *inc;
+	size_t i, chunk_size;
+
+	inc = in->priv;
+
+	/* Cut off at a multiple of the record size. */
+	chunk_size = (len / inc->record_size) * inc->record_size;
+
+	/* There needs to be at least one more record process_record() can peek into. */
+	chunk_size -= MIN(chunk_size, inc->record_size);
+
+	for (i = 0; (i < chunk_size) && (!inc->records_read); i += inc->record_size) {
+		switch (inc->device) {
+		case AD_DEVICE_PI:
+			process_record_pi(in, data + i);
+			break;
+		case AD_DEVICE_IPROBE:
+			process_record_iprobe(in, data + i);
+			break;
+		default:
+			sr_err("Trying to process records for unknown device!");
+			return SR_ERR;
+		}
+
+		inc->cur_record++;
+		if (inc->cur_record == inc->record_count)
+			inc->records_read = TRUE;
+	}
+	*used = i;
+
+	return SR_OK;
+}
+
 static int process_buffer(struct sr_input *in)
 {
 	struct context *inc;
-	int i, chunk_size, res;
+	size_t used;
+	int res;
 
 	inc = in->priv;
 
@@ -764,6 +747,7 @@ static int process_buffer(struct sr_input *in)
 		g_string_erase(in->buf, 0, inc->header_size);
 		if (res != SR_OK)
 			return res;
+		prepare_pod_layout(inc);
 	}
 
 	if (!inc->meta_sent) {
@@ -772,31 +756,10 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	if (!inc->records_read) {
-		/* Cut off at a multiple of the record size. */
-		chunk_size = ((in->buf->len) / inc->record_size) * inc->record_size;
-
-		/* There needs to be at least one more record process_record() can peek into. */
-		chunk_size -= inc->record_size;
-
-		for (i = 0; (i < chunk_size) && (!inc->records_read); i += inc->record_size) {
-			switch (inc->device) {
-			case AD_DEVICE_PI:
-				process_record_pi(in, i);
-				break;
-			case AD_DEVICE_IPROBE:
-				process_record_iprobe(in, i);
-				break;
-			default:
-				sr_err("Trying to process records for unknown device!");
-				return SR_ERR;
-			}
-
-			inc->cur_record++;
-			if (inc->cur_record == inc->record_count)
-				inc->records_read = TRUE;
-		}
-
-		g_string_erase(in->buf, 0, i);
+		res = process_records(in, in->buf->str, in->buf->len, &used);
+		if (res != SR_OK)
+			return res;
+		g_string_erase(in->buf, 0, used);
 	}
 
 	if (inc->records_read) {
@@ -820,6 +783,53 @@ static int receive(struct sr_input *in, GString *buf)
 	return process_buffer(in);
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	struct context *inc;
+	GString *buf;
+	size_t fill;
+	int res;
+
+	inc = in->priv;
+
+	/* The header and the trailing commands go through the receive buffer. */
+	if (!in->sdi_ready || !inc->header_read || inc->records_read) {
+		buf = g_string_new_len((const char *)data, len);
+		res = receive(in, buf);
+		g_string_free(buf, TRUE);
+		*used = len;
+		return res;
+	}
+
+	/*
+	 * Complete the records which the receive buffer holds parts of.
+	 * What remains of the appended data gets offered again.
+	 */
+	fill = 0;
+	if (in->buf->len) {
+		fill = MIN(len, 2 * inc->record_size);
+		g_string_append_len(in->buf, (const char *)data, fill);
+		res = process_buffer(in);
+		if (res != SR_OK)
+			return res;
+		if (in->buf->len > fill) {
+			*used = fill;
+			return SR_OK;
+		}
+		fill -= in->buf->len;
+		g_string_truncate(in->buf, 0);
+	}
+	if (inc->records_read) {
+		*used = fill;
+		return SR_OK;
+	}
+	res = process_records(in, (const char *)data + fill, len - fill, used);
+	*used += fill;
+
+	return res;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -852,9 +862,24 @@ static int reset(struct sr_input *in)
 
 	g_string_truncate(in->buf, 0);
 
+	/* Discard samples which have not been sent yet. */
+	feed_queue_logic_free(inc->feed);
+	inc->feed = feed_queue_logic_alloc_rle(in->sdi, RLE_RUNS, inc->unitsize);
+	if (!inc->feed)
+		return SR_ERR_MALLOC;
+
 	return SR_OK;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	feed_queue_logic_free(inc->feed);
+	inc->feed = NULL;
+}
+
 static struct sr_option options[] = {
 	{ "podA", "Import pod A / iprobe",
 		"Create channels and data for pod A / iprobe", NULL, NULL },
@@ -907,6 +932,8 @@ SR_PRIV struct sr_input_module input_trace32_ad = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
@@ -120,6 +120,21 @@
 #define CHUNK_SIZE (4 * 1024 * 1024)
 #define SCOPE_SEP '.'
 
+/*
+ * VCD identifiers consist of printable ASCII characters except space.
+ * Identifiers of one and two characters (which covers files with up
+ * to 8930 signals) map to a slot in a direct index table.
+ */
+#define IDENT_FIRST_CHAR '!'
+#define IDENT_CHAR_COUNT ('~' - '!' + 1)
+#define IDENT_TABLE_SIZE (IDENT_CHAR_COUNT + IDENT_CHAR_COUNT * IDENT_CHAR_COUNT)
+
+/* Channels which a VCD identifier translates to. */
+struct vcd_ident {
+	GSList *channels;
+	gboolean ignored;
+};
+
 struct context {
 	struct vcd_user_opt {
 		size_t maxchannels; /* sigrok channels (output) */
@@ -151,6 +166,8 @@ struct context {
 		size_t sig_count;
 	} conv_bits;
 	GString *scope_prefix;
+	struct vcd_ident *ident_table;
+	GHashTable *ident_hash;
 	struct feed_queue_logic *feed_logic;
 	struct split_state {
 		size_t alloced;
@@ -173,6 +190,23 @@ struct context {
 		GSList *sr_channels;
 		GSList *sr_groups;
 	} prev;
+	/* Header text of the current read, kept for the parse plan. */
+	GString *header_text;
+	/*
+	 * Results of parsing the header, kept across reset(). A re-read
+	 * of the same file takes them instead of parsing the header text
+	 * again, see reuse_parse_plan().
+	 */
+	struct vcd_plan {
+		GString *header_text;
+		GSList *channels;
+		GSList *ignored_signals;
+		uint64_t samplerate;
+		size_t vcdsignals;
+		size_t logic_count;
+		size_t analog_count;
+		size_t max_bits;
+	} plan;
 };
 
 struct vcd_channel {
@@ -205,6 +239,105 @@ static void free_channel(void *data)
 	g_free(vcd_ch);
 }
 
+/* Get an identifier's direct index table slot, or -1 for long ones. */
+static int ident_table_index(const char *id)
+{
+	unsigned int c0, c1;
+
+	c0 = (unsigned char)id[0] - IDENT_FIRST_CHAR;
+	if (c0 >= IDENT_CHAR_COUNT)
+		return -1;
+	if (!id[1])
+		return c0;
+	c1 = (unsigned char)id[1] - IDENT_FIRST_CHAR;
+	if (c1 >= IDENT_CHAR_COUNT || id[2])
+		return -1;
+
+	return IDENT_CHAR_COUNT + c0 * IDENT_CHAR_COUNT + c1;
+}
+
+static struct vcd_ident *lookup_ident(struct context *inc, const char *id)
+{
+	int idx;
+
+	idx = ident_table_index(id);
+	if (idx >= 0)
+		return &inc->ident_table[idx];
+
+	return g_hash_table_lookup(inc->ident_hash, id);
+}
+
+static struct vcd_ident *add_ident(struct context *inc, const char *id)
+{
+	struct vcd_ident *ident;
+
+	ident = lookup_ident(inc, id);
+	if (!ident) {
+		ident = g_malloc0(sizeof(*ident));
+		g_hash_table_insert(inc->ident_hash, g_strdup(id), ident);
+	}
+
+	return ident;
+}
+
+static void free_ident(void *data)
+{
+	struct vcd_ident *ident;
+
+	ident = data;
+	g_slist_free(ident->channels);
+	g_free(ident);
+}
+
+/*
+ * Map VCD identifiers to their sigrok channels (and ignored signals),
+ * so that value changes need not search the list of channels.
+ */
+static void create_ident_lookup(struct context *inc)
+{
+	GSList *l;
+	struct vcd_channel *vcd_ch;
+	struct vcd_ident *ident;
+
+	inc->ident_table = g_malloc0_n(IDENT_TABLE_SIZE,
+		sizeof(inc->ident_table[0]));
+	inc->ident_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, free_ident);
+	for (l = inc->channels; l; l = l->next) {
+		vcd_ch = l->data;
+		ident = add_ident(inc, vcd_ch->identifier);
+		ident->channels = g_slist_append(ident->channels, vcd_ch);
+	}
+	for (l = inc->ignored_signals; l; l = l->next) {
+		ident = add_ident(inc, l->data);
+		ident->ignored = TRUE;
+	}
+}
+
+static void free_ident_lookup(struct context *inc)
+{
+	size_t idx;
+
+	if (inc->ident_table) {
+		for (idx = 0; idx < IDENT_TABLE_SIZE; idx++)
+			g_slist_free(inc->ident_table[idx].channels);
+		g_free(inc->ident_table);
+		inc->ident_table = NULL;
+	}
+	if (inc->ident_hash) {
+		g_hash_table_destroy(inc->ident_hash);
+		inc->ident_hash = NULL;
+	}
+}
+
+static gboolean is_ignored(struct context *inc, const char *id)
+{
+	struct vcd_ident *ident;
+
+	ident = lookup_ident(inc, id);
+	return ident && ident->ignored;
+}
+
 /*
  * Another timestamp delta was observed, update statistics: Update the
  * sorted list of minimum values, and increment the occurance counter.
@@ -657,7 +790,7 @@ static void free_text_split(struct context *inc, char **words)
 	state->in_use = FALSE;
 }
 
-static gboolean have_header(GString *buf)
+static gboolean have_header(GString *buf, size_t *header_len)
 {
 	static const char *enddef_txt = "$enddefinitions";
 	static const char *end_txt = "$end";
@@ -678,6 +811,7 @@ static gboolean have_header(GString *buf)
 	if (strncmp(p, end_txt, strlen(end_txt)) != 0)
 		return FALSE;
 	p += strlen(end_txt);
+	*header_len = p - buf->str;
 
 	return TRUE;
 }
@@ -1172,8 +1306,96 @@ static gboolean check_header_in_reread(const struct sr_input *in)
 	return TRUE;
 }
 
+/* Release the kept results of a previous header parse. */
+static void free_parse_plan(struct context *inc)
+{
+	struct vcd_plan *plan;
+
+	plan = &inc->plan;
+	if (plan->header_text)
+		g_string_free(plan->header_text, TRUE);
+	g_slist_free_full(plan->channels, free_channel);
+	g_slist_free_full(plan->ignored_signals, g_free);
+	memset(plan, 0, sizeof(*plan));
+}
+
+/*
+ * Keep the results of parsing the header for a re-read of the file.
+ * The feeds are not kept, they get created for the new read's sdi.
+ * Gets called from reset(), before the context gets released.
+ */
+static void keep_parse_plan(struct context *inc)
+{
+	struct vcd_plan *plan;
+	GSList *l;
+	struct vcd_channel *vcd_ch;
+
+	if (!inc->got_header || !inc->header_text)
+		return;
+
+	free_parse_plan(inc);
+	plan = &inc->plan;
+	for (l = inc->channels; l; l = l->next) {
+		vcd_ch = l->data;
+		feed_queue_analog_free(vcd_ch->feed_analog);
+		vcd_ch->feed_analog = NULL;
+	}
+	plan->header_text = inc->header_text;
+	inc->header_text = NULL;
+	plan->channels = inc->channels;
+	inc->channels = NULL;
+	plan->ignored_signals = inc->ignored_signals;
+	inc->ignored_signals = NULL;
+	plan->samplerate = inc->samplerate;
+	plan->vcdsignals = inc->vcdsignals;
+	plan->logic_count = inc->logic_count;
+	plan->analog_count = inc->analog_count;
+	plan->max_bits = inc->conv_bits.max_bits;
+}
+
+/*
+ * Take the kept results of the previous read when the input's header
+ * text is the very same, and consume the text like parse_section()
+ * would. Applications re-read files to run a second pass over them,
+ * which need not repeat the header's parse then.
+ */
+static gboolean reuse_parse_plan(struct context *inc, GString *buf,
+	size_t header_len)
+{
+	struct vcd_plan *plan;
+	size_t pos;
+
+	plan = &inc->plan;
+	if (!plan->header_text || plan->header_text->len != header_len)
+		return FALSE;
+	if (memcmp(plan->header_text->str, buf->str, header_len) != 0)
+		return FALSE;
+
+	inc->header_text = plan->header_text;
+	plan->header_text = NULL;
+	inc->channels = plan->channels;
+	plan->channels = NULL;
+	inc->ignored_signals = plan->ignored_signals;
+	plan->ignored_signals = NULL;
+	inc->samplerate = plan->samplerate;
+	inc->vcdsignals = plan->vcdsignals;
+	inc->logic_count = plan->logic_count;
+	inc->analog_count = plan->analog_count;
+	inc->conv_bits.max_bits = plan->max_bits;
+	free_parse_plan(inc);
+
+	pos = header_len;
+	while (pos < buf->len && g_ascii_isspace(buf->str[pos]))
+		pos++;
+	g_string_erase(buf, 0, pos);
+	sr_dbg("Same header as before, re-using its parse results.");
+
+	return TRUE;
+}
+
 /* Parse VCD file header sections (rate and variables declarations). */
-static int parse_header(const struct sr_input *in, GString *buf)
+static int parse_header(const struct sr_input *in, GString *buf,
+	size_t header_len)
 {
 	struct context *inc;
 	gboolean status;
@@ -1184,10 +1406,14 @@ static int parse_header(const struct sr_input *in, GString *buf)
 	inc = in->priv;
 
 	/* Parse sections until complete header was seen. */
-	status = FALSE;
+	status = reuse_parse_plan(inc, buf, header_len);
+	if (!status) {
+		free_parse_plan(inc);
+		inc->header_text = g_string_new_len(buf->str, header_len);
+		inc->conv_bits.max_bits = 1;
+	}
 	name = contents = NULL;
-	inc->conv_bits.max_bits = 1;
-	while (parse_section(buf, &name, &contents)) {
+	while (!status && parse_section(buf, &name, &contents)) {
 		sr_dbg("Section '%s', contents '%s'.", name, contents);
 
 		if (g_strcmp0(name, "enddefinitions") == 0) {
@@ -1237,6 +1463,7 @@ done_section:
 	if (!check_header_in_reread(in))
 		return SR_ERR_DATA;
 	create_feeds(in);
+	create_ident_lookup(inc);
 
 	/*
 	 * Allocate space for text to number conversion, and buffers to
@@ -1310,19 +1537,6 @@ static void add_samples(const struct sr_input *in, size_t count, gboolean flush)
 	}
 }
 
-static gint vcd_compare_id(gconstpointer a, gconstpointer b)
-{
-	return strcmp((const char *)a, (const char *)b);
-}
-
-static gboolean is_ignored(struct context *inc, const char *id)
-{
-	GSList *ignored;
-
-	ignored = g_slist_find_custom(inc->ignored_signals, id, vcd_compare_id);
-	return ignored != NULL;
-}
-
 /*
  * Get an analog channel's value from a bit pattern (VCD 'integer' type).
  * The implementation assumes a maximum integer width (64bit), the API
@@ -1359,6 +1573,7 @@ static void process_bits(struct context *inc, char *identifier,
 {
 	size_t size;
 	gboolean have_int;
+	struct vcd_ident *ident;
 	GSList *l;
 	struct vcd_channel *vcd_ch;
 	float int_val;
@@ -1370,10 +1585,9 @@ static void process_bits(struct context *inc, char *identifier,
 	size = 0;
 	have_int = FALSE;
 	int_val = 0;
-	for (l = inc->channels; l; l = l->next) {
+	ident = lookup_ident(inc, identifier);
+	for (l = ident ? ident->channels : NULL; l; l = l->next) {
 		vcd_ch = l->data;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 		if (vcd_ch->type == SR_CHANNEL_ANALOG) {
 			/* Special case for 'integer' VCD signal types. */
 			size = vcd_ch->size; /* Flag for "VCD signal found". */
@@ -1429,7 +1643,7 @@ static void process_bits(struct context *inc, char *identifier,
 			}
 		}
 	}
-	if (!size && !is_ignored(inc, identifier))
+	if (!size && !(ident && ident->ignored))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -1440,16 +1654,16 @@ static void process_bits(struct context *inc, char *identifier,
 static void process_real(struct context *inc, char *identifier, float real_val)
 {
 	gboolean found;
+	struct vcd_ident *ident;
 	GSList *l;
 	struct vcd_channel *vcd_ch;
 
 	found = FALSE;
-	for (l = inc->channels; l; l = l->next) {
+	ident = lookup_ident(inc, identifier);
+	for (l = ident ? ident->channels : NULL; l; l = l->next) {
 		vcd_ch = l->data;
 		if (vcd_ch->type != SR_CHANNEL_ANALOG)
 			continue;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 
 		/* Found our (analog) channel. */
 		found = TRUE;
@@ -1457,7 +1671,7 @@ static void process_real(struct context *inc, char *identifier, float real_val)
 			identifier, vcd_ch->array_index, real_val);
 		inc->current_floats[vcd_ch->array_index] = real_val;
 	}
-	if (!found && !is_ignored(inc, identifier))
+	if (!found && !(ident && ident->ignored))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -2034,7 +2248,7 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	rdptr = in->buf->str;
 	while (TRUE) {
 		rdlen = &in->buf->str[in->buf->len] - rdptr;
-		endptr = g_strstr_len(rdptr, rdlen, "\n");
+		endptr = memchr(rdptr, '\n', rdlen);
 		if (!endptr)
 			break;
 		trimptr = endptr;
@@ -2126,6 +2340,7 @@ static int init(struct sr_input *in, GHashTable *options)
 static int receive(struct sr_input *in, GString *buf)
 {
 	struct context *inc;
+	size_t header_len;
 	int ret;
 
 	inc = in->priv;
@@ -2137,9 +2352,9 @@ static int receive(struct sr_input *in, GString *buf)
 
 	/* Must complete reception of the VCD header first. */
 	if (!inc->got_header) {
-		if (!have_header(in->buf))
+		if (!have_header(in->buf, &header_len))
 			return SR_OK;
-		ret = parse_header(in, in->buf);
+		ret = parse_header(in, in->buf, header_len);
 		if (ret != SR_OK)
 			return ret;
 		/* sdi is ready, notify frontend. */
@@ -2189,6 +2404,7 @@ static void cleanup(struct sr_input *in)
 
 	keep_header_for_reread(in);
 
+	free_ident_lookup(inc);
 	g_slist_free_full(inc->channels, free_channel);
 	inc->channels = NULL;
 	feed_queue_logic_free(inc->feed_logic);
@@ -2204,6 +2420,10 @@ static void cleanup(struct sr_input *in)
 	g_slist_free_full(inc->ignored_signals, g_free);
 	inc->ignored_signals = NULL;
 	free_text_split(inc, NULL);
+	if (inc->header_text)
+		g_string_free(inc->header_text, TRUE);
+	inc->header_text = NULL;
+	free_parse_plan(inc);
 }
 
 static int reset(struct sr_input *in)
@@ -2211,10 +2431,14 @@ static int reset(struct sr_input *in)
 	struct context *inc;
 	struct vcd_user_opt save;
 	struct vcd_prev prev;
+	struct vcd_plan plan;
 
 	inc = in->priv;
 
-	/* Relase previously allocated resources. */
+	/* Relase previously allocated resources, keep the header's plan. */
+	keep_parse_plan(inc);
+	plan = inc->plan;
+	memset(&inc->plan, 0, sizeof(inc->plan));
 	cleanup(in);
 	g_string_truncate(in->buf, 0);
 
@@ -2224,6 +2448,7 @@ static int reset(struct sr_input *in)
 	memset(inc, 0, sizeof(*inc));
 	inc->options = save;
 	inc->prev = prev;
+	inc->plan = plan;
 	inc->scope_prefix = g_string_new("\0");
 
 	return SR_OK;
@@ -70,15 +70,19 @@ static int parse_wav_header(GString *buf, struct context *inc)
 	if (num_channels == 0)
 		return SR_ERR;
 	unitsize = samplesize / num_channels;
-	if (unitsize != 1 && unitsize != 2 && unitsize != 4) {
-		sr_err("Only 8, 16 or 32 bits per sample supported.");
+	if ((unitsize < 1 || unitsize > 4) && unitsize != 8) {
+		sr_err("Only 8, 16, 24, 32 or 64 bits per sample supported.");
 		return SR_ERR_DATA;
 	}
 
 	if (fmt_code == WAVE_FORMAT_PCM_) {
+		if (unitsize > 4) {
+			sr_err("Only 8, 16, 24 or 32 bits per sample supported.");
+			return SR_ERR_DATA;
+		}
 	} else if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_) {
-		if (unitsize != 4) {
-			sr_err("only 32-bit floats supported.");
+		if (unitsize != 4 && unitsize != 8) {
+			sr_err("Only 32-bit and 64-bit floats supported.");
 			return SR_ERR_DATA;
 		}
 	} else if (fmt_code == WAVE_FORMAT_EXTENSIBLE_) {
@@ -104,8 +108,13 @@ static int parse_wav_header(GString *buf, struct context *inc)
 			sr_err("Only PCM and floating point samples are supported.");
 			return SR_ERR_DATA;
 		}
-		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_ && unitsize != 4) {
-			sr_err("only 32-bit floats supported.");
+		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_ &&
+				unitsize != 4 && unitsize != 8) {
+			sr_err("Only 32-bit and 64-bit floats supported.");
+			return SR_ERR_DATA;
+		}
+		if (fmt_code == WAVE_FORMAT_PCM_ && unitsize > 4) {
+			sr_err("Only 8, 16, 24 or 32 bits per sample supported.");
 			return SR_ERR_DATA;
 		}
 	} else {
@@ -189,51 +198,52 @@ static int find_data_chunk(GString *buf, int initial_offset)
 	return offset;
 }
 
-static void send_chunk(const struct sr_input *in, int offset, int num_samples)
+/*
+ * Describe the PCM data as an analog payload, and have the common
+ * conversion routine turn it into floats. Integer samples get scaled
+ * to the -1.0 .. 1.0 range (0.0 .. 1.0 when unsigned).
+ */
+static void send_chunk(const struct sr_input *in, const uint8_t *data,
+		int num_samples)
 {
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_analog analog;
-	struct sr_analog_encoding encoding;
-	struct sr_analog_meaning meaning;
-	struct sr_analog_spec spec;
+	struct sr_datafeed_analog analog, pcm;
+	struct sr_analog_encoding encoding, pcm_encoding;
+	struct sr_analog_meaning meaning, pcm_meaning;
+	struct sr_analog_spec spec, pcm_spec;
 	struct context *inc;
 	float *fdata;
-	int total_samples, samplenum;
-	char *s, *d;
+	uint64_t full_scale;
+	int total_samples;
 
 	inc = in->priv;
 
 	total_samples = num_samples * inc->num_channels;
 	fdata = g_malloc0(total_samples * sizeof(float));
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
-#ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
-#endif
-		}
-		s += inc->unitsize;
-		d += inc->unitsize;
+
+	sr_analog_init(&pcm, &pcm_encoding, &pcm_meaning, &pcm_spec, 0);
+	pcm.data = (void *)data;
+	pcm.num_samples = num_samples;
+	pcm_meaning.channels = in->sdi->channels;
+	pcm_encoding.unitsize = inc->unitsize;
+	pcm_encoding.is_bigendian = FALSE;
+	if (inc->fmt_code == WAVE_FORMAT_PCM_) {
+		/* 8-bit PCM samples are unsigned. */
+		pcm_encoding.is_float = FALSE;
+		pcm_encoding.is_signed = inc->unitsize > 1;
+		if (inc->unitsize == 1)
+			full_scale = UINT8_MAX;
+		else
+			full_scale = (UINT64_C(1) << (inc->unitsize * 8 - 1)) - 1;
+		pcm_encoding.scale.p = 1;
+		pcm_encoding.scale.q = full_scale;
+	} else {
+		pcm_encoding.is_float = TRUE;
+		pcm_encoding.is_signed = TRUE;
+	}
+	if (sr_analog_to_float(&pcm, fdata) != SR_OK) {
+		g_free(fdata);
+		return;
 	}
 
 	/* TODO: Use proper 'digits' value for this device (and its modes). */
@@ -250,11 +260,34 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	g_free(fdata);
 }
 
+/*
+ * Send the complete samples of the data in chunks, return the number
+ * of bytes which they take up.
+ */
+static size_t process_data(const struct sr_input *in, const uint8_t *data,
+		size_t len)
+{
+	struct context *inc;
+	size_t chunk_samples, max_chunk_samples, num_samples, offset;
+
+	inc = in->priv;
+	chunk_samples = len / inc->samplesize;
+	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
+	offset = 0;
+	while (chunk_samples) {
+		num_samples = MIN(chunk_samples, max_chunk_samples);
+		send_chunk(in, data + offset, num_samples);
+		offset += num_samples * inc->samplesize;
+		chunk_samples -= num_samples;
+	}
+
+	return offset;
+}
+
 static int process_buffer(struct sr_input *in)
 {
 	struct context *inc;
-	int offset, chunk_samples, total_samples, processed, max_chunk_samples;
-	int num_samples, i;
+	int offset, i;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -279,20 +312,8 @@ static int process_buffer(struct sr_input *in)
 		offset = 0;
 
 	/* Round off up to the last channels * unitsize boundary. */
-	chunk_samples = (in->buf->len - offset) / inc->samplesize;
-	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
-	processed = 0;
-	total_samples = chunk_samples;
-	while (processed < total_samples) {
-		if (chunk_samples > max_chunk_samples)
-			num_samples = max_chunk_samples;
-		else
-			num_samples = chunk_samples;
-		send_chunk(in, offset, num_samples);
-		offset += num_samples * inc->samplesize;
-		chunk_samples -= num_samples;
-		processed += num_samples;
-	}
+	offset += process_data(in, (const uint8_t *)in->buf->str + offset,
+		in->buf->len - offset);
 
 	if ((unsigned int)offset < in->buf->len) {
 		/*
@@ -349,6 +370,38 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_slice(struct sr_input *in, const uint8_t *data,
+	size_t len, size_t *used)
+{
+	struct context *inc;
+	GString *buf;
+	size_t fill;
+	int ret;
+
+	inc = in->priv;
+
+	/* The header goes through the receive buffer. */
+	if (!in->sdi_ready || !inc->found_data) {
+		buf = g_string_new_len((const char *)data, len);
+		ret = receive(in, buf);
+		g_string_free(buf, TRUE);
+		*used = len;
+		return ret;
+	}
+
+	/* Complete the sample which the receive buffer holds a part of. */
+	fill = 0;
+	if (in->buf->len) {
+		fill = MIN(len, inc->samplesize - in->buf->len);
+		g_string_append_len(in->buf, (const char *)data, fill);
+		if ((ret = process_buffer(in)) != SR_OK)
+			return ret;
+	}
+	*used = fill + process_data(in, data + fill, len - fill);
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -389,6 +442,7 @@ SR_PRIV struct sr_input_module input_wav = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_slice = receive_slice,
 	.end = end,
 	.reset = reset,
 };
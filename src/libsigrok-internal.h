@@ -172,6 +172,23 @@ static inline uint32_t read_u24le(const uint8_t *p)
 	return u;
 }
 
+/**
+ * Read a 24 bits little endian signed integer out of memory.
+ * @param x a pointer to the input memory
+ * @return the corresponding signed integer
+ */
+static inline int32_t read_i24le(const uint8_t *p)
+{
+	uint32_t u;
+	int32_t i;
+
+	u = read_u24le(p);
+	u ^= UINT32_C(1) << 23;
+	i = (int32_t)u - (INT32_C(1) << 23);
+
+	return i;
+}
+
 /**
  * Read a 32 bits big endian unsigned integer out of memory.
  * @param x a pointer to the input memory
@@ -1030,6 +1047,27 @@ static inline void write_dblle_inc(uint8_t **p, double x)
 	*p += sizeof(x);
 }
 
+/**
+ * Transpose an 8x8 bit matrix which is held in a 64bit word.
+ * Bit c of byte r moves to bit r of byte c. Used to turn per-channel
+ * bit streams into per-sample bytes, eight by eight.
+ * @param[in] x The matrix, byte r holding row r.
+ * @return The transposed matrix.
+ */
+static inline uint64_t transpose_8x8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & UINT64_C(0x00aa00aa00aa00aa);
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & UINT64_C(0x0000cccc0000cccc);
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & UINT64_C(0x00000000f0f0f0f0);
+	x ^= t ^ (t << 28);
+
+	return x;
+}
+
 /* Portability fixes for FreeBSD. */
 #ifdef __FreeBSD__
 #define LIBUSB_CLASS_APPLICATION 0xfe
@@ -1138,16 +1176,33 @@ static inline void write_dblle_inc(uint8_t **p, double x)
 	SR_REGISTER_DEV_DRIVER_LIST(name##_list, &name);
 
 SR_API void sr_drivers_init(struct sr_context *context);
+SR_PRIV int sr_backends_init(struct sr_context *ctx);
 
 struct sr_context {
 	struct sr_dev_driver **driver_list;
+	unsigned int init_flags;
+	gboolean backends_ready;
 #ifdef HAVE_LIBUSB_1_0
 	libusb_context *libusb_ctx;
+	/* Shared USB bus snapshot while several drivers scan. */
+	struct sr_usb_scan *usb_scan;
+	/* Watch for devices which come back after firmware uploads. */
+	struct sr_usb_renum *usb_renum;
+	/* USB event sources of all sessions, or the event thread. */
+	struct sr_usb_events *usb_events;
 #endif
 	sr_resource_open_callback resource_open_cb;
 	sr_resource_close_callback resource_close_cb;
 	sr_resource_read_callback resource_read_cb;
 	void *resource_cb_data;
+	/* Mapped resource files, see sr_resource_load_bytes(). */
+	GHashTable *resource_cache;
+	GMutex resource_cache_lock;
+	/* Transfer and conversion buffers, see sr_buffer_alloc(). */
+	struct sr_buffer_pool *buffer_pool;
+	/* *IDN? responses by SCPI connection ID, see sr_scpi_get_hw_id(). */
+	GHashTable *scpi_idn_cache;
+	GMutex scpi_idn_cache_lock;
 };
 
 /** Input module metadata keys. */
@@ -1173,6 +1228,10 @@ struct sr_input {
 	struct sr_dev_inst *sdi;
 	gboolean sdi_ready;
 	void *priv;
+	/** Mapped input file, see sr_input_map_file(). */
+	GMappedFile *mapped_file;
+	/** Position of the next slice of the mapped file. */
+	size_t mapped_pos;
 };
 
 /** Input (file) module driver. */
@@ -1274,6 +1333,28 @@ struct sr_input_module {
 	 */
 	int (*receive) (struct sr_input *in, GString *buf);
 
+	/**
+	 * Consume a slice of a memory mapped input file.
+	 *
+	 * This function is optional. Modules which implement it process
+	 * the input data where it is, instead of having receive() append
+	 * it to the receive buffer first. The slice is only valid during
+	 * the call.
+	 *
+	 * Modules consume as much of the slice as they can, and report
+	 * the number of bytes in 'used'. Data which is not consumed gets
+	 * offered again at the start of the next slice. Consuming nothing
+	 * is valid when the module needs more data, or when it just got
+	 * ready (like receive() returns when sdi_ready gets set). Data of
+	 * the last slice which is not consumed is appended to the receive
+	 * buffer, for end() to handle it.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_slice) (struct sr_input *in, const uint8_t *data,
+		size_t len, size_t *used);
+
 	/**
 	 * Signal the input module no more data will come.
 	 *
@@ -1331,6 +1412,21 @@ struct sr_output {
 	 * there, and only flush it when it reaches a certain size.
 	 */
 	void *priv;
+
+	/**
+	 * The number of the first sample when the instance converts a
+	 * segment of a capture (see sr_session_file_export()), and whether
+	 * the segment follows others, so the output omits its header.
+	 */
+	uint64_t segment_start;
+	gboolean segment_continued;
+
+	/**
+	 * Set by modules which can convert segments: segments start at
+	 * multiples of this many samples. 0 (the default) when the output
+	 * of segments does not concatenate to the output of the capture.
+	 */
+	uint64_t segment_align;
 };
 
 /** Output module driver. */
@@ -1500,6 +1596,29 @@ struct sr_transform_module {
 			struct sr_datafeed_packet *packet_in,
 			struct sr_datafeed_packet **packet_out);
 
+	/**
+	 * Optional in-place variant of receive() for logic sample data.
+	 *
+	 * A module which provides this function declares that receive()
+	 * passes SR_DF_LOGIC packets on as they are, apart from modifying
+	 * their sample data in place. The session then may call this
+	 * function instead of receive(), on consecutive blocks of the
+	 * packet's sample data, interleaved with the other in-place
+	 * transforms of the chain. Each sample is thus touched once by
+	 * all of them while it is still in the cache.
+	 *
+	 * @param t Pointer to the respective 'struct sr_transform'.
+	 * @param data Pointer to the block of sample data.
+	 * @param length Length of the block in bytes, always a multiple
+	 *               of unitsize.
+	 * @param unitsize Number of bytes per sample.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_logic_inplace) (const struct sr_transform *t,
+			uint8_t *data, uint64_t length, uint16_t unitsize);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the transform module, and can be used to free any internal
@@ -1520,6 +1639,20 @@ struct sr_usb_dev_inst {
 	uint8_t address;
 	/** libusb device handle */
 	struct libusb_device_handle *devhdl;
+	/** Transfer buffers which live in device memory, see usb.c. */
+	struct usb_dev_mem_pool *dev_mem;
+	/** Set once allocating device memory failed. */
+	gboolean dev_mem_failed;
+	/** Dump which the device records its transfers to, if any. */
+	struct sr_usb_record *record;
+	gboolean record_checked;
+	/** The record is a raw recording of the session, see usb_replay.c. */
+	gboolean record_raw;
+	/** Dump which completes the transfers instead of the device. */
+	struct sr_usb_replay *replay;
+	/** NUMA node of the host controller, see sr_usb_numa_node(). */
+	int numa_node;
+	gboolean numa_checked;
 };
 #endif
 
@@ -1527,9 +1660,19 @@ struct sr_serial_dev_inst;
 #ifdef HAVE_SERIAL_COMM
 struct ser_lib_functions;
 struct ser_hid_chip_functions;
+struct ser_hid_reader;
 struct sr_bt_desc;
 typedef void (*serial_rx_chunk_callback)(struct sr_serial_dev_inst *serial,
 	void *cb_data, const void *buf, size_t count);
+/** Ring buffer of received data, which only grows when it overflows. */
+struct sr_ser_rx_queue {
+	uint8_t *buf;
+	size_t size;
+	/** Position of the oldest queued byte. */
+	size_t pos;
+	/** Number of queued bytes. */
+	size_t len;
+};
 struct sr_serial_dev_inst {
 	/** Port name, e.g. '/dev/tty42'. */
 	char *port;
@@ -1542,7 +1685,7 @@ struct sr_serial_dev_inst {
 		int parity_bits;
 		int stop_bits;
 	} comm_params;
-	GString *rcv_buffer;
+	struct sr_ser_rx_queue *rcv_buffer;
 	serial_rx_chunk_callback rx_chunk_cb_func;
 	void *rx_chunk_cb_data;
 #ifdef HAVE_LIBSERIALPORT
@@ -1564,6 +1707,8 @@ struct sr_serial_dev_inst {
 	const char *hid_path;
 	hid_device *hid_dev;
 	GSList *hid_source_args;
+	int hid_source_fd;
+	struct ser_hid_reader *hid_reader;
 #endif
 #ifdef HAVE_BLUETOOTH
 	enum ser_bt_conn_t {
@@ -1612,12 +1757,101 @@ SR_PRIV int sr_log(int loglevel, const char *format, ...)
 SR_PRIV int sr_log(int loglevel, const char *format, ...) G_GNUC_PRINTF(2, 3);
 #endif
 
-/* Message logging helpers with subsystem-specific prefix string. */
-#define sr_spew(...)	sr_log(SR_LOG_SPEW, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_dbg(...)	sr_log(SR_LOG_DBG,  LOG_PREFIX ": " __VA_ARGS__)
-#define sr_info(...)	sr_log(SR_LOG_INFO, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_warn(...)	sr_log(SR_LOG_WARN, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_err(...)	sr_log(SR_LOG_ERR,  LOG_PREFIX ": " __VA_ARGS__)
+/* The currently selected loglevel, see sr_log_loglevel_set(). */
+SR_PRIV extern int sr_log_level_current;
+
+/*
+ * Message logging helpers with subsystem-specific prefix string.
+ *
+ * The loglevel gets checked before the message's arguments are evaluated,
+ * disabled messages cost a compare and a (predicted) branch. Builds with
+ * SR_LOG_NO_SPEW (see configure's --disable-log-spew option) drop spew
+ * messages entirely, their arguments are still type checked.
+ */
+#define sr_log_level_enabled(l)	((l) <= sr_log_level_current)
+#define SR_LOG_IF(cond, l, ...) do { \
+	if (cond) \
+		sr_log(l, LOG_PREFIX ": " __VA_ARGS__); \
+} while (0)
+
+#ifdef SR_LOG_NO_SPEW
+#define sr_spew(...)	SR_LOG_IF(0, SR_LOG_SPEW, __VA_ARGS__)
+#else
+#define sr_spew(...)	SR_LOG_IF(G_UNLIKELY(sr_log_level_enabled(SR_LOG_SPEW)), \
+				SR_LOG_SPEW, __VA_ARGS__)
+#endif
+#define sr_dbg(...)	SR_LOG_IF(G_UNLIKELY(sr_log_level_enabled(SR_LOG_DBG)), \
+				SR_LOG_DBG, __VA_ARGS__)
+#define sr_info(...)	SR_LOG_IF(G_UNLIKELY(sr_log_level_enabled(SR_LOG_INFO)), \
+				SR_LOG_INFO, __VA_ARGS__)
+#define sr_warn(...)	SR_LOG_IF(sr_log_level_enabled(SR_LOG_WARN), \
+				SR_LOG_WARN, __VA_ARGS__)
+#define sr_err(...)	SR_LOG_IF(sr_log_level_enabled(SR_LOG_ERR), \
+				SR_LOG_ERR, __VA_ARGS__)
+
+/*--- trace.c ---------------------------------------------------------------*/
+
+/* Whether acquisition tracing is on, see SIGROK_TRACE in trace.c. */
+SR_PRIV extern gboolean sr_trace_on;
+#define sr_trace_enabled()	G_UNLIKELY(sr_trace_on)
+
+SR_PRIV void sr_trace_init(void);
+SR_PRIV void sr_trace_exit(void);
+SR_PRIV int64_t sr_trace_now(void);
+SR_PRIV void sr_trace_span(const char *name, int64_t start,
+		const char *arg_name, int64_t arg);
+SR_PRIV void sr_trace_instant(const char *name, const char *arg_name,
+		int64_t arg);
+SR_PRIV void sr_trace_async(const char *name, gboolean begin, const void *id,
+		const char *arg_name, int64_t arg);
+
+/*--- cpu.c -----------------------------------------------------------------*/
+
+/* Vector extensions of the host CPU, see sr_cpu_has(). */
+enum sr_cpu_feature {
+	SR_CPU_SSE2 = 1 << 0,
+	SR_CPU_AVX2 = 1 << 1,
+	SR_CPU_AVX512 = 1 << 2,
+	SR_CPU_NEON = 1 << 3,
+};
+
+/*
+ * SR_TARGET() compiles a function for an instruction set beyond the
+ * build's baseline, and has GCC vectorize its loops at -O2 too. Such
+ * variants must only run when sr_cpu_has() says so. Loops in
+ * SR_ALWAYS_INLINE helpers get compiled for each caller's instruction
+ * set, which is how one body yields several variants.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SR_CPU_DISPATCH_X86 1
+#if defined(__clang__)
+#define SR_TARGET(isa)		__attribute__((target(isa)))
+#else
+#define SR_TARGET(isa)		__attribute__((target(isa), \
+				optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#endif
+#endif
+#ifdef __GNUC__
+#define SR_ALWAYS_INLINE	inline __attribute__((always_inline))
+#else
+#define SR_ALWAYS_INLINE	inline
+#endif
+
+SR_PRIV extern unsigned int sr_cpu_features;
+#define sr_cpu_has(feature)	((sr_cpu_features & (feature)) != 0)
+
+SR_PRIV void sr_cpu_init(void);
+
+/*--- buffer_pool.c ---------------------------------------------------------*/
+
+struct sr_buffer_pool;
+
+SR_PRIV struct sr_buffer_pool *sr_buffer_pool_new(void);
+SR_PRIV void sr_buffer_pool_release(struct sr_buffer_pool *pool);
+SR_PRIV void *sr_buffer_alloc(struct sr_context *ctx, size_t size);
+SR_PRIV void *sr_buffer_alloc_node(struct sr_context *ctx, size_t size,
+		int node);
+SR_PRIV void sr_buffer_free(void *data);
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -1644,6 +1878,11 @@ SR_PRIV struct sr_channel *sr_next_enabled_channel(const struct sr_dev_inst *sdi
 		struct sr_channel *cur_channel);
 SR_PRIV gboolean sr_channels_differ(struct sr_channel *ch1, struct sr_channel *ch2);
 SR_PRIV gboolean sr_channel_lists_differ(GSList *l1, GSList *l2);
+SR_PRIV GVariant *sr_dev_options_cache_get(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg);
+SR_PRIV void sr_dev_options_cache_put(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, GVariant *gvar);
+SR_PRIV void sr_dev_options_changed(const struct sr_dev_inst *sdi);
 
 SR_PRIV struct sr_channel_group *sr_channel_group_new(struct sr_dev_inst *sdi,
 	const char *name, void *priv);
@@ -1678,6 +1917,11 @@ struct sr_dev_inst {
 	void *priv;
 	/** Session to which this device is currently assigned. */
 	struct sr_session *session;
+	/**
+	 * Whether the device follows the clock or trigger of another
+	 * device while the session runs, see sr_session_sync_master_set().
+	 */
+	gboolean sync_follower;
 };
 
 /* Generic device instances */
@@ -1747,6 +1991,12 @@ struct sr_session {
 	GSList *owned_devs;
 	/** List of struct datafeed_callback pointers. */
 	GSList *datafeed_callbacks;
+	/** List of struct datafeed_batch_callback pointers. */
+	GSList *datafeed_batch_callbacks;
+	/** Worker threads for thread-safe datafeed callbacks, or NULL. */
+	struct callback_pool *callback_pool;
+	/** Whether the current set of callbacks is run in sequence. */
+	gboolean callback_pool_unused;
 	GSList *transforms;
 	struct sr_trigger *trigger;
 
@@ -1768,6 +2018,66 @@ struct sr_session {
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+	/** Step width of the common timer grid [us], 0 if not aligned. */
+	int64_t timer_slack_us;
+	/** Whether sources put their descriptors into an epoll set. */
+	gboolean epoll;
+	/** The epoll set's event source, while it has members. */
+	struct epoll_source *epoll_source;
+
+	/** Capacity of the datafeed dispatch queue, 0 to dispatch inline. */
+	unsigned int dispatch_depth;
+	/** Memory budget of the dispatch queue in bytes, 0 for none. */
+	uint64_t dispatch_max_bytes;
+	/** Limit of the large buffers held for the session, 0 for none. */
+	uint64_t mem_limit;
+	/** Bytes held and their peak, protected by stats_mutex. */
+	uint64_t mem_used;
+	uint64_t mem_peak;
+	/** Whether the current run was stopped for exceeding mem_limit. */
+	gboolean mem_exceeded;
+	/** Where drivers record raw transfers instead of decoding them. */
+	char *raw_record_dir;
+	/** Dispatch queue and its consumer thread, while running. */
+	struct dispatch_queue *dispatch;
+	/** Size and age limits of coalesced logic packets, 0 for none. */
+	size_t coalesce_bytes;
+	int64_t coalesce_latency_us;
+	/** Logic data which awaits delivery in a larger packet. */
+	struct logic_coalesce *coalesce;
+	/** Dispatch queue statistics of the current or last run. */
+	struct sr_session_dispatch_stats dispatch_stats;
+	/** Whether timing and throughput statistics are collected. */
+	gboolean stats_enabled;
+	/** Protects stats and the callbacks' times. */
+	GMutex stats_mutex;
+	struct sr_session_stats stats;
+	/** Whether packets get host receive timestamps. */
+	gboolean timestamps_enabled;
+	/** Context of an iteration driven by an external event loop. */
+	GMainContext *iteration_context;
+	/** Priority passed from the prepare to the check step. */
+	gint iteration_priority;
+	/** Merge stage for the logic data of all devices, or NULL. */
+	struct sr_merge *merge;
+	/** Device which the others follow, started last, or NULL. */
+	struct sr_dev_inst *sync_master;
+	/** Float values of the analog packet in delivery. */
+	struct sr_analog_float_view *float_view;
+};
+
+/** Number of config keys a meta packet batch holds. */
+#define SR_META_BATCH_SIZE 8
+
+/**
+ * A meta packet which gets built without allocations, see
+ * sr_meta_batch_init().
+ */
+struct sr_meta_batch {
+	const struct sr_dev_inst *sdi;
+	size_t count;
+	struct sr_config configs[SR_META_BATCH_SIZE];
+	GSList nodes[SR_META_BATCH_SIZE];
 };
 
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
@@ -1788,20 +2098,56 @@ SR_PRIV int sr_session_source_add_pollfd(struct sr_session *session,
 SR_PRIV int sr_session_source_add_channel(struct sr_session *session,
 		GIOChannel *channel, int events, int timeout,
 		sr_receive_data_callback cb, void *cb_data);
+SR_PRIV int sr_session_source_set_priority(struct sr_session *session,
+		const void *cb_data, int priority);
+SR_PRIV int sr_session_source_set_pending(struct sr_session *session,
+		int fd, gboolean (*pending)(void *data), void *data);
 SR_PRIV int sr_session_source_remove(struct sr_session *session, int fd);
 SR_PRIV int sr_session_source_remove_pollfd(struct sr_session *session,
 		GPollFD *pollfd);
 SR_PRIV int sr_session_source_remove_channel(struct sr_session *session,
 		GIOChannel *channel);
 
+SR_PRIV void sr_session_receive_mark(void);
+SR_PRIV void sr_session_receive_unmark(void);
 SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
 		uint32_t key, GVariant *var);
+SR_PRIV void sr_meta_batch_init(struct sr_meta_batch *batch,
+		const struct sr_dev_inst *sdi);
+SR_PRIV int sr_meta_batch_add(struct sr_meta_batch *batch,
+		uint32_t key, GVariant *var);
+SR_PRIV int sr_meta_batch_send(struct sr_meta_batch *batch);
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_send_batch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packets, size_t count);
+SR_PRIV void sr_session_report_transfers(const struct sr_dev_inst *sdi,
+		unsigned int dropped, unsigned int empty);
+SR_PRIV int sr_session_mem_charge(const struct sr_dev_inst *sdi,
+		size_t bytes);
+SR_PRIV void sr_session_mem_release(const struct sr_dev_inst *sdi,
+		size_t bytes);
+SR_PRIV int sr_session_send_buffer(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		struct sr_datafeed_buffer *buf);
+SR_PRIV struct sr_datafeed_buffer *sr_datafeed_buffer_new_wrap(void *data,
+		size_t size, void (*free_cb)(void *data, void *cb_data),
+		void *cb_data);
+SR_PRIV gboolean sr_datafeed_buffer_is_shared(
+		const struct sr_datafeed_buffer *buf);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
 
+/*--- session_merge.c -------------------------------------------------------*/
+
+struct sr_merge;
+
+SR_PRIV void sr_session_merge_feed(struct sr_merge *merge,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_merge_free(struct sr_merge *merge);
+
 /*--- session_file.c --------------------------------------------------------*/
 
 #if !HAVE_ZIP_DISCARD
@@ -1813,6 +2159,52 @@ SR_PRIV void sr_zip_discard(struct zip *archive);
 SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 			const struct zip_stat *entry);
 
+/*--- shm_ring.c ------------------------------------------------------------*/
+
+struct sr_shm_ring;
+
+SR_PRIV struct sr_shm_ring *sr_shm_ring_create(const char *name, size_t size);
+SR_PRIV struct sr_shm_ring *sr_shm_ring_open(const char *name);
+SR_PRIV void sr_shm_ring_free(struct sr_shm_ring *ring);
+SR_PRIV uint8_t *sr_shm_ring_reserve(struct sr_shm_ring *ring, size_t len);
+SR_PRIV void sr_shm_ring_commit(struct sr_shm_ring *ring, size_t len);
+SR_PRIV int sr_shm_ring_write(struct sr_shm_ring *ring,
+		const uint8_t *data, size_t len);
+SR_PRIV size_t sr_shm_ring_peek(struct sr_shm_ring *ring, const uint8_t **data);
+SR_PRIV void sr_shm_ring_consume(struct sr_shm_ring *ring, size_t len);
+SR_PRIV uint32_t sr_shm_ring_wait(struct sr_shm_ring *ring, uint32_t seen,
+		int timeout_ms);
+SR_PRIV gboolean sr_shm_ring_writer_done(struct sr_shm_ring *ring);
+
+/*--- output/output.c -------------------------------------------------------*/
+
+SR_PRIV const struct sr_output *sr_output_new_segment(
+		const struct sr_output_module *omod, GHashTable *options,
+		const struct sr_dev_inst *sdi, uint64_t start, gboolean continued);
+
+/*--- output/remote.c -------------------------------------------------------*/
+
+/* Framing of remote capture streams, shared with the remote driver. */
+#define SR_REMOTE_MAGIC "SRREMOTE"
+#define SR_REMOTE_VERSION 1
+/* u8 record type, u8 flags, u32 payload length. */
+#define SR_REMOTE_RECORD_HEADER_SIZE 6
+#define SR_REMOTE_MAX_RECORD (64 * 1024 * 1024)
+/* The payload is a u32 length, then LZO1X compressed data. */
+#define SR_REMOTE_FLAG_LZO (1 << 0)
+
+enum sr_remote_record {
+	SR_REMOTE_DEVICE = 1,
+	SR_REMOTE_HEADER,
+	SR_REMOTE_META,
+	SR_REMOTE_LOGIC,
+	SR_REMOTE_ANALOG,
+	SR_REMOTE_TRIGGER,
+	SR_REMOTE_FRAME_BEGIN,
+	SR_REMOTE_FRAME_END,
+	SR_REMOTE_END,
+};
+
 /*--- analog.c --------------------------------------------------------------*/
 
 SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
@@ -1820,6 +2212,13 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_meaning *meaning,
                            struct sr_analog_spec *spec,
                            int digits);
+SR_PRIV int sr_rational_from_float(struct sr_rational *r, double value);
+
+SR_PRIV struct sr_analog_float_view *sr_analog_float_view_new(void);
+SR_PRIV void sr_analog_float_view_free(struct sr_analog_float_view *view);
+SR_PRIV void sr_analog_float_view_begin(struct sr_analog_float_view *view,
+		const struct sr_datafeed_analog *analog);
+SR_PRIV void sr_analog_float_view_end(struct sr_analog_float_view *view);
 
 /*--- std.c -----------------------------------------------------------------*/
 
@@ -1899,6 +2298,7 @@ SR_PRIV int std_dummy_set_handshake(struct sr_serial_dev_inst *serial,
 /*--- resource.c ------------------------------------------------------------*/
 
 SR_PRIV int64_t sr_file_get_size(FILE *file);
+SR_PRIV GMappedFile *sr_file_map(const char *filename, GError **error);
 
 SR_PRIV int sr_resource_open(struct sr_context *ctx,
 		struct sr_resource *res, int type, const char *name)
@@ -1911,6 +2311,24 @@ SR_PRIV gssize sr_resource_read(struct sr_context *ctx,
 SR_PRIV void *sr_resource_load(struct sr_context *ctx, int type,
 		const char *name, size_t *size, size_t max_size)
 		G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV GBytes *sr_resource_load_bytes(struct sr_context *ctx, int type,
+		const char *name, size_t max_size)
+		G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV void sr_resource_cache_flush(struct sr_context *ctx);
+
+/**
+ * Identity of a resource's content, e.g. of the FPGA bitstream which
+ * got uploaded to a device. Drivers keep it in their device context to
+ * skip uploads of a bitstream which the device already runs.
+ */
+struct sr_resource_id {
+	gboolean valid;
+	uint8_t digest[32];
+};
+
+SR_PRIV void sr_resource_id_compute(struct sr_resource_id *id, GBytes *bytes);
+SR_PRIV gboolean sr_resource_id_equal(const struct sr_resource_id *a,
+		const struct sr_resource_id *b);
 
 /*--- strutil.c -------------------------------------------------------------*/
 
@@ -1924,22 +2342,41 @@ SR_PRIV int sr_atod_ascii(const char *str, double *ret);
 SR_PRIV int sr_atod_ascii_digits(const char *str, double *ret, int *digits);
 SR_PRIV int sr_atof_ascii(const char *str, float *ret);
 
+/* Output buffer size of sr_ftoa_shortest(). */
+#define SR_FTOA_BUFSIZE 24
+SR_PRIV int sr_ftoa_shortest(char *buf, float value);
+
 SR_PRIV GString *sr_hexdump_new(const uint8_t *data, const size_t len);
 SR_PRIV void sr_hexdump_free(GString *s);
 
 /*--- soft-trigger.c --------------------------------------------------------*/
 
+struct soft_trigger_stage;
+struct soft_trigger_proto;
+
 struct soft_trigger_logic {
 	const struct sr_dev_inst *sdi;
 	const struct sr_trigger *trigger;
+	/* Non-zero once a sample was seen, i.e. prev_sample is valid. */
 	int count;
 	int unitsize;
 	int cur_stage;
 	uint8_t *prev_sample;
+	/* The trigger's stages, compiled into bit masks. */
+	struct soft_trigger_stage *stages;
+	int num_stages;
+	/* Decoder of a serial protocol condition, or NULL. */
+	struct soft_trigger_proto *proto;
+	/* Number of 64-bit words per sample, and scratch for two samples. */
+	int num_words;
+	uint64_t *cur_words;
+	uint64_t *prev_words;
 	uint8_t *pre_trigger_buffer;
 	uint8_t *pre_trigger_head;
 	int pre_trigger_size;
 	int pre_trigger_fill;
+	/* Send SR_DF_FRAME_BEGIN ahead of each trigger's pre-trigger data. */
+	gboolean frames;
 };
 
 SR_PRIV int logic_channel_unitsize(GSList *channels);
@@ -1949,9 +2386,55 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
+SR_PRIV void soft_trigger_logic_rearm(struct soft_trigger_logic *stl,
+		const uint8_t *last_sample);
+
+/** What a device's hardware trigger can evaluate. */
+struct sr_trigger_hw_caps {
+	/** Number of stages. */
+	int max_stages;
+	/** Number of logic channels which the trigger sees, up to 64. */
+	int num_channels;
+	/** Supported match types, bits of (1 << SR_TRIGGER_*). */
+	uint32_t matches;
+	/** Number of edge conditions per stage, 0 for no limit. */
+	int max_edges;
+};
+
+/** A trigger stage in the form of hardware trigger registers. */
+struct sr_trigger_hw_stage {
+	/** Channels with a condition. */
+	uint64_t mask;
+	/** Channels with an edge condition, the others check levels. */
+	uint64_t edge_mask;
+	/** High level or rising edge, low level or falling edge if 0. */
+	uint64_t values;
+	/** Channels which check for either edge. */
+	uint64_t any_edge_mask;
+};
+
+SR_PRIV int sr_trigger_hw_compile(const struct sr_trigger *trigger,
+		const struct sr_trigger_hw_caps *caps,
+		struct sr_trigger_hw_stage *stages, int *num_stages);
 
 /*--- serial.c --------------------------------------------------------------*/
 
+/**
+ * Framing of a chip's fixed size packets, which lets receive paths skip
+ * positions which cannot start a packet without calling the (expensive)
+ * packet validity check for each of them. The validity check remains
+ * authoritative for the positions which pass the framing checks.
+ */
+struct sr_packet_framing {
+	/** Packet size in bytes. */
+	size_t packet_size;
+	/** A packet's first byte satisfies (byte & sync_mask) == sync_value. */
+	uint8_t sync_mask;
+	uint8_t sync_value;
+	/** (Optional) Text which ends every packet. */
+	const char *terminator;
+};
+
 #ifdef HAVE_SERIAL_COMM
 enum {
 	SERIAL_RDWR = 1,
@@ -1994,6 +2477,8 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 		size_t packet_size, packet_valid_callback is_valid,
 		packet_valid_len_callback is_valid_len, size_t *return_size,
 		uint64_t timeout_ms);
+SR_PRIV size_t sr_packet_framing_skip(const struct sr_packet_framing *framing,
+		const uint8_t *buf, size_t len);
 SR_PRIV int serial_source_add(struct sr_session *session,
 		struct sr_serial_dev_inst *serial, int events, int timeout,
 		sr_receive_data_callback cb, void *cb_data);
@@ -2002,12 +2487,18 @@ SR_PRIV int serial_source_remove(struct sr_session *session,
 SR_PRIV GSList *sr_serial_find_usb(uint16_t vendor_id, uint16_t product_id);
 SR_PRIV int serial_timeout(struct sr_serial_dev_inst *port, int num_bytes);
 
+SR_PRIV struct sr_ser_rx_queue *sr_ser_rx_queue_new(size_t size);
+SR_PRIV void sr_ser_rx_queue_free(struct sr_ser_rx_queue *queue);
 SR_PRIV void sr_ser_discard_queued_data(struct sr_serial_dev_inst *serial);
 SR_PRIV size_t sr_ser_has_queued_data(struct sr_serial_dev_inst *serial);
 SR_PRIV void sr_ser_queue_rx_data(struct sr_serial_dev_inst *serial,
 		const uint8_t *data, size_t len);
 SR_PRIV size_t sr_ser_unqueue_rx_data(struct sr_serial_dev_inst *serial,
 		uint8_t *data, size_t len);
+SR_PRIV size_t sr_ser_peek_rx_data(struct sr_serial_dev_inst *serial,
+		size_t len, const uint8_t **data);
+SR_PRIV void sr_ser_consume_rx_data(struct sr_serial_dev_inst *serial,
+		size_t len);
 
 struct ser_lib_functions {
 	int (*open)(struct sr_serial_dev_inst *serial, int flags);
@@ -2133,9 +2624,81 @@ SR_PRIV void sr_usb_close(struct sr_usb_dev_inst *usb);
 SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data);
 SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx);
+SR_PRIV void *sr_usb_forward_begin(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer);
+SR_PRIV void sr_usb_forward_cancel(struct libusb_transfer *transfer,
+		void *handle);
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len);
-SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
-		const char *manufacturer, const char *product);
+SR_PRIV int sr_usb_scan_begin(struct sr_context *ctx);
+SR_PRIV void sr_usb_scan_end(struct sr_context *ctx);
+SR_PRIV ssize_t sr_usb_get_device_list(struct sr_context *ctx,
+		libusb_device ***list);
+SR_PRIV int sr_usb_renum_watch(struct sr_context *ctx);
+SR_PRIV int sr_usb_renum_wait(struct sr_context *ctx, const char *port_path,
+		int64_t since_us, int timeout_ms);
+SR_PRIV void sr_usb_renum_unwatch(struct sr_context *ctx);
+SR_PRIV int sr_usb_events_init(struct sr_context *ctx, gboolean thread,
+		gboolean realtime);
+SR_PRIV void sr_usb_events_exit(struct sr_context *ctx);
+SR_PRIV gboolean usb_match_manuf_prod(struct sr_context *ctx,
+		libusb_device *dev, const char *manufacturer, const char *product);
+SR_PRIV void *sr_usb_buffer_alloc(struct sr_usb_dev_inst *usb, size_t size);
+SR_PRIV void sr_usb_buffer_free(struct sr_usb_dev_inst *usb, void *data);
+SR_PRIV int sr_usb_numa_node(struct sr_usb_dev_inst *usb);
+SR_PRIV struct sr_datafeed_buffer *sr_usb_datafeed_buffer_new(
+		struct sr_usb_dev_inst *usb, size_t size);
+
+struct sr_usb_stream;
+
+/**
+ * Decode hook of a USB stream, called with each completed buffer in
+ * submission order. Returning anything but SR_OK stops the stream.
+ */
+typedef int (*sr_usb_stream_decode_cb)(const struct sr_dev_inst *sdi,
+		uint64_t seq, const uint8_t *data, size_t length, void *cb_data);
+/** Called once a USB stream ended and all its transfers were released. */
+typedef void (*sr_usb_stream_done_cb)(const struct sr_dev_inst *sdi,
+		int status, void *cb_data);
+
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(const struct sr_dev_inst *sdi,
+		unsigned char endpoint, size_t num_transfers, size_t transfer_size,
+		unsigned int timeout, sr_usb_stream_decode_cb decode,
+		sr_usb_stream_done_cb done, void *cb_data);
+SR_PRIV void sr_usb_stream_set_max_empty(struct sr_usb_stream *stream,
+		unsigned int max_empty);
+SR_PRIV int sr_usb_stream_start(struct sr_usb_stream *stream);
+SR_PRIV void sr_usb_stream_stop(struct sr_usb_stream *stream);
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *stream);
+#endif
+
+/*--- usb_replay.c ----------------------------------------------------------*/
+
+#ifdef HAVE_LIBUSB_1_0
+/* Selects replay of a dump in place of a USB device, e.g. conn=replay:x.dump */
+#define SR_USB_REPLAY_PREFIX "replay:"
+
+struct sr_usb_record;
+struct sr_usb_replay;
+
+SR_PRIV int sr_usb_control_transfer(struct sr_usb_dev_inst *usb,
+		uint8_t request_type, uint8_t request, uint16_t value,
+		uint16_t index, unsigned char *data, uint16_t length,
+		unsigned int timeout);
+SR_PRIV int sr_usb_bulk_transfer(struct sr_usb_dev_inst *usb,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout);
+SR_PRIV int sr_usb_submit_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_cancel_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer);
+SR_PRIV const char *sr_usb_replay_path(const char *conn);
+SR_PRIV struct sr_usb_dev_inst *sr_usb_replay_open(const char *path);
+SR_PRIV void sr_usb_replay_identity(const struct sr_usb_dev_inst *usb,
+		struct libusb_device_descriptor *des, const char *strings[3]);
+SR_PRIV void sr_usb_dump_free(struct sr_usb_dev_inst *usb);
+SR_PRIV void sr_usb_replay_restore(struct sr_dev_inst *sdi);
+SR_PRIV gboolean sr_usb_raw_record_start(const struct sr_dev_inst *sdi);
+SR_PRIV void sr_usb_raw_record_stop(const struct sr_dev_inst *sdi);
 #endif
 
 /*--- binary_helpers.c ------------------------------------------------------*/
@@ -2247,6 +2810,13 @@ struct sr_modbus_dev_inst {
 	void *priv;
 };
 
+/** A span of holding registers, see sr_modbus_read_register_blocks(). */
+struct sr_modbus_register_block {
+	int address;
+	int nb_registers;
+	uint16_t *registers;
+};
+
 SR_PRIV GSList *sr_modbus_scan(struct drv_context *drvc, GSList *options,
 		struct sr_dev_inst *(*probe_device)(struct sr_modbus_dev_inst *modbus));
 SR_PRIV struct sr_modbus_dev_inst *modbus_dev_inst_new(const char *resource,
@@ -2269,6 +2839,9 @@ SR_PRIV int sr_modbus_read_coils(struct sr_modbus_dev_inst *modbus,
 SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
                                              int address, int nb_registers,
                                              uint16_t *registers);
+SR_PRIV int sr_modbus_read_register_blocks(struct sr_modbus_dev_inst *modbus,
+                                           struct sr_modbus_register_block *blocks,
+                                           size_t count, int max_gap);
 SR_PRIV int sr_modbus_write_coil(struct sr_modbus_dev_inst *modbus,
                                  int address, int value);
 SR_PRIV int sr_modbus_write_multiple_registers(struct sr_modbus_dev_inst*modbus,
@@ -2277,6 +2850,53 @@ SR_PRIV int sr_modbus_write_multiple_registers(struct sr_modbus_dev_inst*modbus,
 SR_PRIV int sr_modbus_close(struct sr_modbus_dev_inst *modbus);
 SR_PRIV void sr_modbus_free(struct sr_modbus_dev_inst *modbus);
 
+/*--- dmm seven segment digits ----------------------------------------------*/
+
+/**
+ * Lookup table of seven segment LCD digits, generated at compile time.
+ *
+ * Maps each of the 256 possible segment bytes to the decimal digit it
+ * displays, or to -1 for patterns which are not a digit. The arguments
+ * are the segment bytes of the digits 0 to 9, in this order:
+ *
+ * @code{c}
+ * static const int8_t digits[256] = SR_SEG7_TABLE(0x7d, 0x05, ...);
+ * @endcode
+ */
+#define SR_SEG7_TABLE(...) { \
+	SR_SEG7_ROW(0x00, __VA_ARGS__), \
+	SR_SEG7_ROW(0x10, __VA_ARGS__), \
+	SR_SEG7_ROW(0x20, __VA_ARGS__), \
+	SR_SEG7_ROW(0x30, __VA_ARGS__), \
+	SR_SEG7_ROW(0x40, __VA_ARGS__), \
+	SR_SEG7_ROW(0x50, __VA_ARGS__), \
+	SR_SEG7_ROW(0x60, __VA_ARGS__), \
+	SR_SEG7_ROW(0x70, __VA_ARGS__), \
+	SR_SEG7_ROW(0x80, __VA_ARGS__), \
+	SR_SEG7_ROW(0x90, __VA_ARGS__), \
+	SR_SEG7_ROW(0xa0, __VA_ARGS__), \
+	SR_SEG7_ROW(0xb0, __VA_ARGS__), \
+	SR_SEG7_ROW(0xc0, __VA_ARGS__), \
+	SR_SEG7_ROW(0xd0, __VA_ARGS__), \
+	SR_SEG7_ROW(0xe0, __VA_ARGS__), \
+	SR_SEG7_ROW(0xf0, __VA_ARGS__), \
+}
+#define SR_SEG7_ROW(b, ...) \
+	SR_SEG7_ENTRY((b) + 0, __VA_ARGS__), SR_SEG7_ENTRY((b) + 1, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 2, __VA_ARGS__), SR_SEG7_ENTRY((b) + 3, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 4, __VA_ARGS__), SR_SEG7_ENTRY((b) + 5, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 6, __VA_ARGS__), SR_SEG7_ENTRY((b) + 7, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 8, __VA_ARGS__), SR_SEG7_ENTRY((b) + 9, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 10, __VA_ARGS__), SR_SEG7_ENTRY((b) + 11, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 12, __VA_ARGS__), SR_SEG7_ENTRY((b) + 13, __VA_ARGS__), \
+	SR_SEG7_ENTRY((b) + 14, __VA_ARGS__), SR_SEG7_ENTRY((b) + 15, __VA_ARGS__)
+#define SR_SEG7_ENTRY(b, ...) SR_SEG7_DIGIT(b, __VA_ARGS__)
+#define SR_SEG7_DIGIT(b, d0, d1, d2, d3, d4, d5, d6, d7, d8, d9) \
+	((b) == (d0) ? 0 : (b) == (d1) ? 1 : (b) == (d2) ? 2 : \
+	 (b) == (d3) ? 3 : (b) == (d4) ? 4 : (b) == (d5) ? 5 : \
+	 (b) == (d6) ? 6 : (b) == (d7) ? 7 : (b) == (d8) ? 8 : \
+	 (b) == (d9) ? 9 : -1)
+
 /*--- dmm/es519xx.c ---------------------------------------------------------*/
 
 /**
@@ -2336,6 +2956,7 @@ struct fs9922_info {
 	int bargraph_sign, bargraph_value;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_fs9922_framing;
 SR_PRIV gboolean sr_fs9922_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_fs9922_parse(const uint8_t *buf, float *floatval,
 			    struct sr_datafeed_analog *analog, void *info);
@@ -2352,6 +2973,7 @@ struct fs9721_info {
 	gboolean is_c2c1_11, is_c2c1_10, is_c2c1_01, is_c2c1_00, is_sign;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_fs9721_framing;
 SR_PRIV gboolean sr_fs9721_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_fs9721_parse(const uint8_t *buf, float *floatval,
 			    struct sr_datafeed_analog *analog, void *info);
@@ -2422,6 +3044,7 @@ struct dtm0660_info {
 	gboolean is_minmax, is_max, is_sign;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_dtm0660_framing;
 SR_PRIV gboolean sr_dtm0660_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_dtm0660_parse(const uint8_t *buf, float *floatval,
 			struct sr_datafeed_analog *analog, void *info);
@@ -2454,6 +3077,7 @@ struct metex14_info {
 #ifdef HAVE_SERIAL_COMM
 SR_PRIV int sr_metex14_packet_request(struct sr_serial_dev_inst *serial);
 #endif
+extern SR_PRIV const struct sr_packet_framing sr_metex14_framing;
 SR_PRIV gboolean sr_metex14_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_metex14_parse(const uint8_t *buf, float *floatval,
 			     struct sr_datafeed_analog *analog, void *info);
@@ -2554,6 +3178,7 @@ struct ut71x_info {
 	gboolean is_auto, is_manual, is_sign, is_power, is_loop_current;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_ut71x_framing;
 SR_PRIV gboolean sr_ut71x_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_ut71x_parse(const uint8_t *buf, float *floatval,
 		struct sr_datafeed_analog *analog, void *info);
@@ -2575,6 +3200,7 @@ struct vc870_info {
 	gboolean is_frequency, is_dual_display, is_auto;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_vc870_framing;
 SR_PRIV gboolean sr_vc870_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_vc870_parse(const uint8_t *buf, float *floatval,
 		struct sr_datafeed_analog *analog, void *info);
@@ -2652,6 +3278,7 @@ struct ut372_info {
 	int dummy;
 };
 
+extern SR_PRIV const struct sr_packet_framing sr_ut372_framing;
 SR_PRIV gboolean sr_ut372_packet_valid(const uint8_t *buf);
 SR_PRIV int sr_ut372_parse(const uint8_t *buf, float *floatval,
 		struct sr_datafeed_analog *analog, void *info);
@@ -2744,6 +3371,8 @@ struct sr_sw_limits {
 	uint64_t samples_read;
 	uint64_t frames_read;
 	uint64_t start_time;
+	/* End of the acquisition time, 0 without a time limit. */
+	uint64_t deadline;
 };
 
 SR_PRIV int sr_sw_limits_config_get(const struct sr_sw_limits *limits, uint32_t key,
@@ -2755,12 +3384,44 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits);
 SR_PRIV int sr_sw_limits_get_remain(const struct sr_sw_limits *limits,
 	uint64_t *samples, uint64_t *frames, uint64_t *msecs,
 	gboolean *exceeded);
+SR_PRIV uint64_t sr_sw_limits_samples_remain(const struct sr_sw_limits *limits);
 SR_PRIV void sr_sw_limits_update_samples_read(struct sr_sw_limits *limits,
 	uint64_t samples_read);
 SR_PRIV void sr_sw_limits_update_frames_read(struct sr_sw_limits *limits,
 	uint64_t frames_read);
 SR_PRIV void sr_sw_limits_init(struct sr_sw_limits *limits);
 
+/*--- poll_sched.c ----------------------------------------------------------*/
+
+enum sr_poll_kind {
+	SR_POLL_NONE,
+	SR_POLL_MEASUREMENT,
+	SR_POLL_STATUS,
+};
+
+struct sr_poll_sched {
+	uint64_t samplerate;
+	uint64_t min_interval_us;
+	uint64_t max_interval_us;
+	unsigned int status_every;
+	uint64_t interval_us;
+	unsigned int idle_polls;
+	unsigned int meas_since_status;
+	int64_t next_meas_us;
+};
+
+SR_PRIV void sr_poll_sched_init(struct sr_poll_sched *sched,
+	uint64_t min_interval_ms, uint64_t max_interval_ms,
+	unsigned int status_every);
+SR_PRIV int sr_poll_sched_config_get(const struct sr_poll_sched *sched,
+	uint32_t key, GVariant **data);
+SR_PRIV int sr_poll_sched_config_set(struct sr_poll_sched *sched,
+	uint32_t key, GVariant *data);
+SR_PRIV void sr_poll_sched_acquisition_start(struct sr_poll_sched *sched);
+SR_PRIV enum sr_poll_kind sr_poll_sched_next(struct sr_poll_sched *sched);
+SR_PRIV void sr_poll_sched_update(struct sr_poll_sched *sched,
+	gboolean changed);
+
 /*--- feed_queue.h ----------------------------------------------------------*/
 
 struct feed_queue_logic;
@@ -2769,8 +3430,15 @@ struct feed_queue_analog;
 SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	const struct sr_dev_inst *sdi,
 	size_t sample_count, size_t unit_size);
+SR_API struct feed_queue_logic *feed_queue_logic_alloc_rle(
+	const struct sr_dev_inst *sdi,
+	size_t run_count, size_t unit_size);
 SR_API int feed_queue_logic_submit(struct feed_queue_logic *q,
 	const uint8_t *data, size_t count);
+SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
+	const uint8_t *data, size_t samples_count);
+SR_API int feed_queue_logic_submit_runs(struct feed_queue_logic *q,
+	const uint8_t *values, const uint64_t *run_lengths, size_t num_runs);
 SR_API int feed_queue_logic_flush(struct feed_queue_logic *q);
 SR_API int feed_queue_logic_send_trigger(struct feed_queue_logic *q);
 SR_API void feed_queue_logic_free(struct feed_queue_logic *q);
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib/gprintf.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -42,8 +43,11 @@
  * @{
  */
 
-/* Currently selected libsigrok loglevel. Default: SR_LOG_WARN. */
-static int cur_loglevel = SR_LOG_WARN; /* Show errors+warnings per default. */
+/*
+ * Currently selected libsigrok loglevel. Default: SR_LOG_WARN.
+ * Not static, the logging macros check it before evaluating arguments.
+ */
+SR_PRIV int sr_log_level_current = SR_LOG_WARN; /* Show errors+warnings per default. */
 
 /* Function prototype. */
 static int sr_logv(void *cb_data, int loglevel, const char *format,
@@ -60,9 +64,31 @@ static void *sr_log_cb_data = NULL;
 
 /** @cond PRIVATE */
 #define LOGLEVEL_TIMESTAMP SR_LOG_DBG
+/* Number of queued messages beyond which the async sink drops messages. */
+#define ASYNC_MAX_PENDING 4096
+/* Interval in which the async sink's thread delivers queued messages. */
+#define ASYNC_INTERVAL_US (10 * 1000)
 /** @endcond */
 static int64_t sr_log_start_time = 0;
 
+/* A message which was formatted and queued for the async sink. */
+struct async_msg {
+	struct async_msg *next;
+	int loglevel;
+	char text[];
+};
+
+/*
+ * State of the async sink. Messages get pushed to a lock-free stack,
+ * the sink's thread periodically takes all of them at once.
+ */
+static struct async_msg *async_head = NULL;
+static gint async_pending = 0;
+static gint async_dropped = 0;
+static gint async_stop = 0;
+static GThread *async_thread = NULL;
+static GMutex async_lock;
+
 /**
  * Set the libsigrok loglevel.
  *
@@ -90,7 +116,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
 	if (loglevel >= LOGLEVEL_TIMESTAMP && sr_log_start_time == 0)
 		sr_log_start_time = g_get_monotonic_time();
 
-	cur_loglevel = loglevel;
+	sr_log_level_current = loglevel;
 
 	sr_dbg("libsigrok loglevel set to %d.", loglevel);
 
@@ -106,7 +132,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
  */
 SR_API int sr_log_loglevel_get(void)
 {
-	return cur_loglevel;
+	return sr_log_level_current;
 }
 
 /**
@@ -194,7 +220,7 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 
 	(void)loglevel;
 
-	if (cur_loglevel >= LOGLEVEL_TIMESTAMP) {
+	if (sr_log_level_current >= LOGLEVEL_TIMESTAMP) {
 		elapsed_us = g_get_monotonic_time() - sr_log_start_time;
 
 		minutes = elapsed_us / G_TIME_SPAN_MINUTE;
@@ -231,6 +257,147 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 	return SR_OK;
 }
 
+/* Pass a message to the log callback, from a variadic argument list. */
+static int async_emit(int loglevel, const char *format, ...)
+{
+	int ret;
+	va_list args;
+
+	va_start(args, format);
+	ret = sr_log_cb(sr_log_cb_data, loglevel, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+/* Deliver all queued messages, in the order in which they were logged. */
+static void async_drain(void)
+{
+	struct async_msg *list, *msg, *rev;
+	gint dropped;
+
+	do {
+		list = g_atomic_pointer_get(&async_head);
+	} while (list && !g_atomic_pointer_compare_and_exchange(&async_head,
+		list, NULL));
+
+	rev = NULL;
+	while (list) {
+		msg = list;
+		list = msg->next;
+		msg->next = rev;
+		rev = msg;
+	}
+	while (rev) {
+		msg = rev;
+		rev = msg->next;
+		g_atomic_int_add(&async_pending, -1);
+		async_emit(msg->loglevel, "%s", msg->text);
+		g_free(msg);
+	}
+
+	do {
+		dropped = g_atomic_int_get(&async_dropped);
+	} while (dropped && !g_atomic_int_compare_and_exchange(&async_dropped,
+		dropped, 0));
+	if (dropped)
+		async_emit(SR_LOG_WARN, LOG_PREFIX ": Dropped %d messages.",
+			dropped);
+}
+
+static gpointer async_thread_func(gpointer data)
+{
+	(void)data;
+
+	while (!g_atomic_int_get(&async_stop)) {
+		async_drain();
+		g_usleep(ASYNC_INTERVAL_US);
+	}
+	async_drain();
+
+	return NULL;
+}
+
+/* Format a message and queue it for the async sink's thread. */
+static int async_push(int loglevel, const char *format, va_list args)
+{
+	struct async_msg *msg;
+	char *text;
+	size_t len;
+
+	if (g_atomic_int_add(&async_pending, 1) >= ASYNC_MAX_PENDING) {
+		g_atomic_int_add(&async_pending, -1);
+		g_atomic_int_inc(&async_dropped);
+		return SR_OK;
+	}
+
+	text = g_strdup_vprintf(format, args);
+	len = strlen(text);
+	msg = g_malloc(sizeof(*msg) + len + 1);
+	msg->loglevel = loglevel;
+	memcpy(msg->text, text, len + 1);
+	g_free(text);
+
+	do {
+		msg->next = g_atomic_pointer_get(&async_head);
+	} while (!g_atomic_pointer_compare_and_exchange(&async_head,
+		msg->next, msg));
+
+	return SR_OK;
+}
+
+/**
+ * Deliver log messages from a separate thread.
+ *
+ * With the async sink enabled, messages get formatted by the thread
+ * which logs them, and are queued. A separate thread passes them
+ * to the log callback. Threads which log never wait for slow output
+ * (terminals, files, GUI widgets), a log callback which takes a lock
+ * cannot stall data acquisition. The log callback then runs in the
+ * sink's thread, and message delivery lags by a few milliseconds.
+ * When more messages are pending than the sink can keep, messages
+ * get dropped and their number gets reported.
+ *
+ * Disabling the async sink delivers all pending messages before
+ * returning.
+ *
+ * @param enable TRUE to enable the async sink, FALSE to disable it.
+ *
+ * @return SR_OK upon success, SR_ERR upon failure to create the thread.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_log_async_set(gboolean enable)
+{
+	GThread *thread;
+	GError *error;
+
+	g_mutex_lock(&async_lock);
+	if (enable && !async_thread) {
+		error = NULL;
+		g_atomic_int_set(&async_stop, 0);
+		thread = g_thread_try_new("sr-log", async_thread_func,
+			NULL, &error);
+		if (!thread) {
+			g_mutex_unlock(&async_lock);
+			sr_err("Cannot start log thread: %s.", error->message);
+			g_error_free(error);
+			return SR_ERR;
+		}
+		g_atomic_pointer_set(&async_thread, thread);
+	} else if (!enable && async_thread) {
+		thread = async_thread;
+		g_atomic_pointer_set(&async_thread, NULL);
+		g_atomic_int_set(&async_stop, 1);
+		g_thread_join(thread);
+		/* Catch messages of threads which raced with the above. */
+		async_drain();
+	}
+	g_mutex_unlock(&async_lock);
+
+	return SR_OK;
+}
+
 /** @private */
 SR_PRIV int sr_log(int loglevel, const char *format, ...)
 {
@@ -238,11 +405,14 @@ SR_PRIV int sr_log(int loglevel, const char *format, ...)
 	va_list args;
 
 	/* Only output messages of at least the selected loglevel(s). */
-	if (loglevel > cur_loglevel)
+	if (loglevel > sr_log_level_current)
 		return SR_OK;
 
 	va_start(args, format);
-	ret = sr_log_cb(sr_log_cb_data, loglevel, format, args);
+	if (g_atomic_pointer_get(&async_thread))
+		ret = async_push(loglevel, format, args);
+	else
+		ret = sr_log_cb(sr_log_cb_data, loglevel, format, args);
 	va_end(args);
 
 	return ret;
@@ -478,6 +478,84 @@ SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
 	return SR_OK;
 }
 
+/* Largest number of registers which one read request can cover. */
+#define MODBUS_MAX_READ_REGISTERS 125
+
+/**
+ * Read several spans of holding registers with as few requests as possible.
+ *
+ * The blocks get sorted by address. Blocks which overlap or which are
+ * separated by at most max_gap unused registers are merged into a single
+ * read holding registers request, as long as the merged span does not
+ * exceed the protocol's limit of 125 registers. The reply is then
+ * scattered to the blocks' buffers. Gap registers are read but discarded,
+ * only allow gaps when reading them has no side effects on the device.
+ *
+ * @param modbus Previously initialized Modbus device structure.
+ * @param blocks The register spans to read. Gets reordered by address.
+ * @param count The number of blocks.
+ * @param max_gap The number of unused registers which may get read to
+ *                merge two blocks, 0 only merges adjacent blocks.
+ *
+ * @return SR_OK upon success, SR_ERR_ARG upon invalid arguments,
+ *         SR_ERR_DATA upon invalid data, or SR_ERR on failure.
+ */
+SR_PRIV int sr_modbus_read_register_blocks(struct sr_modbus_dev_inst *modbus,
+		struct sr_modbus_register_block *blocks, size_t count, int max_gap)
+{
+	struct sr_modbus_register_block tmp;
+	uint16_t registers[MODBUS_MAX_READ_REGISTERS];
+	size_t i, j, first;
+	int start, end, next_end;
+	int ret;
+
+	if (!modbus || (count && !blocks) || max_gap < 0)
+		return SR_ERR_ARG;
+	for (i = 0; i < count; i++) {
+		if (blocks[i].address < 0 || blocks[i].nb_registers < 1 ||
+		    blocks[i].nb_registers > MODBUS_MAX_READ_REGISTERS ||
+		    blocks[i].address + blocks[i].nb_registers > 0x10000 ||
+		    !blocks[i].registers)
+			return SR_ERR_ARG;
+	}
+
+	/* Callers pass a handful of blocks, insertion sort will do. */
+	for (i = 1; i < count; i++) {
+		tmp = blocks[i];
+		for (j = i; j > 0 && blocks[j - 1].address > tmp.address; j--)
+			blocks[j] = blocks[j - 1];
+		blocks[j] = tmp;
+	}
+
+	for (first = 0; first < count; first = i) {
+		start = blocks[first].address;
+		end = start + blocks[first].nb_registers;
+		for (i = first + 1; i < count; i++) {
+			if (blocks[i].address > end + max_gap)
+				break;
+			next_end = MAX(end, blocks[i].address + blocks[i].nb_registers);
+			if (next_end - start > MODBUS_MAX_READ_REGISTERS)
+				break;
+			end = next_end;
+		}
+
+		if (i - first > 1)
+			sr_spew("Reading %zu register blocks as %d registers "
+				"from 0x%04x.", i - first, end - start, start);
+		ret = sr_modbus_read_holding_registers(modbus, start,
+			end - start, registers);
+		if (ret != SR_OK)
+			return ret;
+
+		for (j = first; j < i; j++)
+			memcpy(blocks[j].registers,
+				&registers[blocks[j].address - start],
+				2 * blocks[j].nb_registers);
+	}
+
+	return SR_OK;
+}
+
 /**
  * Send a Modbus write coil command.
  *
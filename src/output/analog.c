@@ -83,6 +83,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	struct sr_channel *ch;
 	GSList *l;
 	float *fdata;
+	const float *values;
 	unsigned int i;
 	int num_channels, c, ret, digits, actual_digits;
 	char *number, *suffix;
@@ -132,7 +133,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 						analog->num_samples * num_channels * sizeof(float))))
 			return SR_ERR_MALLOC;
 		ctx->fdata = fdata;
-		if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
+		if ((ret = sr_analog_to_float_view(analog, fdata, &values)) != SR_OK)
 			return ret;
 		*out = g_string_sized_new(512);
 		if (ctx->digits == DIGITS_ALL)
@@ -145,7 +146,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		sr_analog_unit_to_string(analog, &suffix);
 		for (i = 0; i < analog->num_samples; i++) {
 			for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
-				float value = fdata[i * num_channels + c];
+				float value = values[i * num_channels + c];
 				const char *prefix = "";
 				actual_digits = digits;
 				if (si_friendly)
@@ -0,0 +1,315 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Binary analog output, which keeps the samples in the encoding which
+ * the device sent them in. No value gets converted, the raw samples of
+ * an analog packet are copied to the output as they are.
+ *
+ * All numbers are stored in little endian byte order. The file starts
+ * with a header:
+ *
+ *   8 bytes  magic "SRANALOG"
+ *   u8       format version (1)
+ *   u16      number of enabled analog channels, then for each of them:
+ *     u16    channel index
+ *     u8     length of the channel name, followed by the name
+ *
+ * Then a sequence of records follows, each of which starts with a tag
+ * byte:
+ *
+ *   'S'  samplerate change: u64 samplerate in Hz
+ *   'F'  format of the following data records:
+ *          u8 unitsize, u8 flags (bit 0 signed, bit 1 float,
+ *          bit 2 big endian, bit 3 decimal digits), i8 digits,
+ *          i64 scale numerator, u64 scale denominator,
+ *          i64 offset numerator, u64 offset denominator,
+ *          u32 mq, u32 unit, u64 mqflags,
+ *          u16 number of channels, followed by their u16 indices
+ *   'D'  data: u32 number of samples, followed by the raw samples,
+ *        interleaved in the channel order of the last format record
+ *   'T'  trigger
+ *   'B'  frame begin
+ *   'E'  frame end
+ *
+ * A format record is only written when a packet's encoding, meaning
+ * or channels differ from the previous packet's.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/analog_binary"
+
+#define FILE_MAGIC "SRANALOG"
+#define FILE_VERSION 1
+
+/* Size of a format record without its channel indices. */
+#define FORMAT_RECORD_SIZE (1 + 3 + 4 * 8 + 2 * 4 + 8 + 2)
+
+enum format_flags {
+	FORMAT_SIGNED = 1 << 0,
+	FORMAT_FLOAT = 1 << 1,
+	FORMAT_BIGENDIAN = 1 << 2,
+	FORMAT_DIGITS_DECIMAL = 1 << 3,
+};
+
+struct context {
+	gboolean header_done;
+	/* The format which the last data record was written in. */
+	gboolean format_done;
+	struct sr_analog_encoding encoding;
+	enum sr_mq mq;
+	enum sr_unit unit;
+	enum sr_mqflag mqflags;
+	GArray *channels;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+
+	(void)options;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	o->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->channels = g_array_new(FALSE, FALSE, sizeof(uint16_t));
+
+	return SR_OK;
+}
+
+static void append_header(const struct sr_output *o, GString *out)
+{
+	struct sr_channel *ch;
+	GSList *l;
+	uint8_t tmp[3];
+	size_t len;
+	unsigned int count;
+
+	g_string_append_len(out, FILE_MAGIC, strlen(FILE_MAGIC));
+	tmp[0] = FILE_VERSION;
+	g_string_append_len(out, (const char *)tmp, 1);
+
+	count = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG && ch->enabled)
+			count++;
+	}
+	write_u16le(tmp, count);
+	g_string_append_len(out, (const char *)tmp, 2);
+
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_ANALOG || !ch->enabled)
+			continue;
+		len = MIN(strlen(ch->name), UINT8_MAX);
+		write_u16le(tmp, ch->index);
+		tmp[2] = len;
+		g_string_append_len(out, (const char *)tmp, 3);
+		g_string_append_len(out, ch->name, len);
+	}
+}
+
+/* Check whether a packet can go into the current format's data records. */
+static gboolean format_matches(const struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *enc;
+	const struct sr_channel *ch;
+	const GSList *l;
+	unsigned int i;
+
+	if (!ctx->format_done)
+		return FALSE;
+
+	enc = analog->encoding;
+	if (enc->unitsize != ctx->encoding.unitsize ||
+			!enc->is_signed != !ctx->encoding.is_signed ||
+			!enc->is_float != !ctx->encoding.is_float ||
+			!enc->is_bigendian != !ctx->encoding.is_bigendian ||
+			!enc->is_digits_decimal != !ctx->encoding.is_digits_decimal ||
+			enc->digits != ctx->encoding.digits ||
+			enc->scale.p != ctx->encoding.scale.p ||
+			enc->scale.q != ctx->encoding.scale.q ||
+			enc->offset.p != ctx->encoding.offset.p ||
+			enc->offset.q != ctx->encoding.offset.q)
+		return FALSE;
+	if (analog->meaning->mq != ctx->mq ||
+			analog->meaning->unit != ctx->unit ||
+			analog->meaning->mqflags != ctx->mqflags)
+		return FALSE;
+
+	for (i = 0, l = analog->meaning->channels; l; i++, l = l->next) {
+		ch = l->data;
+		if (i >= ctx->channels->len ||
+				g_array_index(ctx->channels, uint16_t, i) != ch->index)
+			return FALSE;
+	}
+
+	return i == ctx->channels->len;
+}
+
+static void append_format(struct context *ctx,
+		const struct sr_datafeed_analog *analog, GString *out)
+{
+	const struct sr_analog_encoding *enc;
+	const struct sr_channel *ch;
+	const GSList *l;
+	uint8_t tmp[FORMAT_RECORD_SIZE], *wp;
+	uint16_t index;
+	unsigned int i;
+
+	enc = analog->encoding;
+	ctx->encoding = *enc;
+	ctx->mq = analog->meaning->mq;
+	ctx->unit = analog->meaning->unit;
+	ctx->mqflags = analog->meaning->mqflags;
+	g_array_set_size(ctx->channels, 0);
+	for (l = analog->meaning->channels; l; l = l->next) {
+		ch = l->data;
+		index = ch->index;
+		g_array_append_val(ctx->channels, index);
+	}
+	ctx->format_done = TRUE;
+
+	wp = tmp;
+	write_u8_inc(&wp, 'F');
+	write_u8_inc(&wp, enc->unitsize);
+	write_u8_inc(&wp, (enc->is_signed ? FORMAT_SIGNED : 0) |
+		(enc->is_float ? FORMAT_FLOAT : 0) |
+		(enc->is_bigendian ? FORMAT_BIGENDIAN : 0) |
+		(enc->is_digits_decimal ? FORMAT_DIGITS_DECIMAL : 0));
+	write_u8_inc(&wp, (uint8_t)enc->digits);
+	write_u64le_inc(&wp, (uint64_t)enc->scale.p);
+	write_u64le_inc(&wp, enc->scale.q);
+	write_u64le_inc(&wp, (uint64_t)enc->offset.p);
+	write_u64le_inc(&wp, enc->offset.q);
+	write_u32le_inc(&wp, ctx->mq);
+	write_u32le_inc(&wp, ctx->unit);
+	write_u64le_inc(&wp, ctx->mqflags);
+	write_u16le_inc(&wp, ctx->channels->len);
+	g_string_append_len(out, (const char *)tmp, wp - tmp);
+	for (i = 0; i < ctx->channels->len; i++) {
+		write_u16le(tmp, g_array_index(ctx->channels, uint16_t, i));
+		g_string_append_len(out, (const char *)tmp, 2);
+	}
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
+		GString **out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GSList *l;
+	uint8_t tmp[1 + sizeof(uint64_t)];
+	size_t num_channels, size;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	*out = g_string_sized_new(64);
+	if (!ctx->header_done) {
+		append_header(o, *out);
+		ctx->header_done = TRUE;
+	}
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			tmp[0] = 'S';
+			write_u64le(&tmp[1], g_variant_get_uint64(src->data));
+			g_string_append_len(*out, (const char *)tmp, 9);
+		}
+		break;
+	case SR_DF_TRIGGER:
+		g_string_append_c(*out, 'T');
+		break;
+	case SR_DF_FRAME_BEGIN:
+		g_string_append_c(*out, 'B');
+		break;
+	case SR_DF_FRAME_END:
+		g_string_append_c(*out, 'E');
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		if (!analog->encoding || !analog->meaning) {
+			g_string_free(*out, TRUE);
+			*out = NULL;
+			return SR_ERR_ARG;
+		}
+		num_channels = g_slist_length(analog->meaning->channels);
+		if (!analog->num_samples || !num_channels)
+			break;
+		if (!format_matches(ctx, analog))
+			append_format(ctx, analog, *out);
+
+		size = (size_t)analog->num_samples * num_channels
+			* analog->encoding->unitsize;
+		tmp[0] = 'D';
+		write_u32le(&tmp[1], analog->num_samples);
+		g_string_append_len(*out, (const char *)tmp, 5);
+		g_string_append_len(*out, analog->data, size);
+		break;
+	}
+
+	if (!(*out)->len) {
+		g_string_free(*out, TRUE);
+		*out = NULL;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+	ctx = o->priv;
+
+	g_array_free(ctx->channels, TRUE);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_analog_binary = {
+	.id = "analog-binary",
+	.name = "Analog binary",
+	.desc = "Raw analog samples in their original encoding",
+	.exts = NULL,
+	.flags = SR_OUTPUT_ANALOG_RAW,
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,648 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Apache Arrow IPC stream output. Every enabled channel becomes a column
+ * of the table: logic channels are bit-packed Bool columns, analog
+ * channels are single precision FloatingPoint columns. Rows are sample
+ * numbers, and get written in record batches of a configurable number
+ * of rows. Arrow based tools (pyarrow, polars, DuckDB, ...) read the
+ * stream without any parsing, and can convert it to Parquet if needed.
+ *
+ * The stream consists of a schema message, a record batch message per
+ * chunk of rows, and an end-of-stream marker. The message metadata are
+ * flatbuffers, which get assembled here by a minimal writer: tables are
+ * laid out front to back, each one preceded by its vtable, and every
+ * offset gets patched when the object which it refers to is written.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/arrow"
+
+#define DEFAULT_CHUNK_ROWS (64 * 1024)
+
+/* Record batches which columns may get ahead of the others by. */
+#define MAX_PENDING_BATCHES 4
+
+/* Values from the Arrow format's Schema.fbs and Message.fbs files. */
+#define ARROW_METADATA_V5		4
+#define ARROW_HEADER_SCHEMA		1
+#define ARROW_HEADER_RECORD_BATCH	3
+#define ARROW_TYPE_FLOATING_POINT	3
+#define ARROW_TYPE_BOOL			6
+#define ARROW_PRECISION_SINGLE		1
+#define ARROW_CONTINUATION		0xffffffff
+
+struct column {
+	struct sr_channel *ch;
+	/* Bits of logic columns, floats of analog columns. */
+	uint8_t *data;
+	size_t size;
+	uint64_t rows;
+};
+
+struct context {
+	uint64_t chunk_rows;
+	uint64_t samplerate;
+	gboolean header_done;
+	size_t num_columns;
+	struct column *columns;
+	float *fdata;
+	size_t fdata_size;
+};
+
+/* A table field of 1, 2, 4, or 8 bytes. Fields of size 0 are absent. */
+struct fb_field {
+	size_t size;
+	uint64_t value;
+};
+
+static void fb_pad(GString *b, size_t align)
+{
+	while (b->len % align)
+		g_string_append_c(b, 0);
+}
+
+static void fb_put(GString *b, uint64_t value, size_t size)
+{
+	uint8_t tmp[sizeof(uint64_t)];
+
+	write_u64le(tmp, value);
+	g_string_append_len(b, (const char *)tmp, size);
+}
+
+/* Point the offset at position 'at' to the current end of the buffer. */
+static void fb_patch(GString *b, size_t at)
+{
+	write_u32le((uint8_t *)b->str + at, b->len - at);
+}
+
+/*
+ * Write a table and its vtable, and patch the offset at 'at' to refer
+ * to it. The positions of the table's fields get stored in 'pos', to
+ * patch offset fields when their objects get written.
+ */
+static void fb_table(GString *b, size_t at,
+		const struct fb_field *fields, size_t count, size_t *pos)
+{
+	size_t vtsize, tsize, start, off[8], i;
+
+	vtsize = 4 + 2 * count;
+	tsize = 4;
+	for (i = 0; i < count; i++) {
+		off[i] = 0;
+		if (!fields[i].size)
+			continue;
+		tsize = (tsize + fields[i].size - 1) / fields[i].size * fields[i].size;
+		off[i] = tsize;
+		tsize += fields[i].size;
+	}
+
+	/* Start tables at 8 byte boundaries, which aligns all fields. */
+	while ((b->len + vtsize) % 8)
+		g_string_append_c(b, 0);
+	fb_put(b, vtsize, 2);
+	fb_put(b, tsize, 2);
+	for (i = 0; i < count; i++)
+		fb_put(b, off[i], 2);
+
+	start = b->len;
+	fb_patch(b, at);
+	fb_put(b, vtsize, 4);
+	for (i = 0; i < count; i++) {
+		if (!fields[i].size)
+			continue;
+		while (b->len < start + off[i])
+			g_string_append_c(b, 0);
+		if (pos)
+			pos[i] = b->len;
+		fb_put(b, fields[i].value, fields[i].size);
+	}
+}
+
+static void fb_string(GString *b, size_t at, const char *s)
+{
+	fb_pad(b, 4);
+	fb_patch(b, at);
+	fb_put(b, strlen(s), 4);
+	g_string_append_len(b, s, strlen(s) + 1);
+}
+
+/* Start a vector of offsets, return the position of its first element. */
+static size_t fb_vector(GString *b, size_t at, size_t count)
+{
+	size_t start, i;
+
+	fb_pad(b, 4);
+	fb_patch(b, at);
+	fb_put(b, count, 4);
+	start = b->len;
+	for (i = 0; i < count; i++)
+		fb_put(b, 0, 4);
+
+	return start;
+}
+
+/* Start a vector of 16 byte structs, the caller appends the elements. */
+static void fb_struct_vector(GString *b, size_t at, size_t count)
+{
+	while ((b->len + 4) % 8)
+		g_string_append_c(b, 0);
+	fb_patch(b, at);
+	fb_put(b, count, 4);
+}
+
+/* Wrap message metadata and append the message to the output. */
+static void append_message(GString *out, GString *meta)
+{
+	fb_pad(meta, 8);
+	fb_put(out, ARROW_CONTINUATION, 4);
+	fb_put(out, meta->len, 4);
+	g_string_append_len(out, meta->str, meta->len);
+}
+
+static void append_schema(const struct context *ctx, GString *out)
+{
+	GString *b;
+	struct fb_field fields[6];
+	size_t msg[5], schema[3], field[6], kv[2], vec, meta, i;
+	char *samplerate;
+	gboolean logic;
+
+	b = g_string_sized_new(1024);
+	fb_put(b, 0, 4);
+
+	/* Message */
+	memset(fields, 0, sizeof(fields));
+	fields[0] = (struct fb_field){ 2, ARROW_METADATA_V5 };
+	fields[1] = (struct fb_field){ 1, ARROW_HEADER_SCHEMA };
+	fields[2] = (struct fb_field){ 4, 0 };
+	fields[3] = (struct fb_field){ 8, 0 };
+	fb_table(b, 0, fields, 4, msg);
+
+	/* Schema: little endian, fields, and custom metadata. */
+	memset(fields, 0, sizeof(fields));
+	fields[0] = (struct fb_field){ 2, 0 };
+	fields[1] = (struct fb_field){ 4, 0 };
+	fields[2] = (struct fb_field){ ctx->samplerate ? 4 : 0, 0 };
+	fb_table(b, msg[2], fields, 3, schema);
+
+	vec = fb_vector(b, schema[1], ctx->num_columns);
+	for (i = 0; i < ctx->num_columns; i++) {
+		logic = ctx->columns[i].ch->type == SR_CHANNEL_LOGIC;
+		memset(fields, 0, sizeof(fields));
+		fields[0] = (struct fb_field){ 4, 0 };
+		fields[1] = (struct fb_field){ 1, 0 };
+		fields[2] = (struct fb_field){ 1, logic ?
+			ARROW_TYPE_BOOL : ARROW_TYPE_FLOATING_POINT };
+		fields[3] = (struct fb_field){ 4, 0 };
+		fields[5] = (struct fb_field){ 4, 0 };
+		fb_table(b, vec + 4 * i, fields, 6, field);
+		fb_string(b, field[0], ctx->columns[i].ch->name);
+		if (logic) {
+			fb_table(b, field[3], NULL, 0, NULL);
+		} else {
+			fields[0] = (struct fb_field){ 2, ARROW_PRECISION_SINGLE };
+			fb_table(b, field[3], fields, 1, NULL);
+		}
+		/* Readers insist on the (empty) children vector. */
+		fb_vector(b, field[5], 0);
+	}
+
+	if (ctx->samplerate) {
+		meta = fb_vector(b, schema[2], 1);
+		memset(fields, 0, sizeof(fields));
+		fields[0] = (struct fb_field){ 4, 0 };
+		fields[1] = (struct fb_field){ 4, 0 };
+		fb_table(b, meta, fields, 2, kv);
+		fb_string(b, kv[0], "samplerate");
+		samplerate = g_strdup_printf("%" G_GUINT64_FORMAT, ctx->samplerate);
+		fb_string(b, kv[1], samplerate);
+		g_free(samplerate);
+	}
+
+	append_message(out, b);
+	g_string_free(b, TRUE);
+}
+
+static size_t column_bytes(const struct column *col, uint64_t rows)
+{
+	if (col->ch->type == SR_CHANNEL_LOGIC)
+		return (rows + 7) / 8;
+
+	return rows * sizeof(float);
+}
+
+static size_t padded(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+/* Write the first 'rows' rows of all columns as a record batch. */
+static void append_record_batch(const struct context *ctx,
+		GString *out, uint64_t rows)
+{
+	GString *b;
+	struct fb_field fields[4];
+	size_t msg[4], batch[3], body, offset, len, i;
+	static const char zeroes[8];
+
+	body = 0;
+	for (i = 0; i < ctx->num_columns; i++)
+		body += padded(column_bytes(&ctx->columns[i], rows));
+
+	b = g_string_sized_new(256 + 48 * ctx->num_columns);
+	fb_put(b, 0, 4);
+
+	memset(fields, 0, sizeof(fields));
+	fields[0] = (struct fb_field){ 2, ARROW_METADATA_V5 };
+	fields[1] = (struct fb_field){ 1, ARROW_HEADER_RECORD_BATCH };
+	fields[2] = (struct fb_field){ 4, 0 };
+	fields[3] = (struct fb_field){ 8, body };
+	fb_table(b, 0, fields, 4, msg);
+
+	memset(fields, 0, sizeof(fields));
+	fields[0] = (struct fb_field){ 8, rows };
+	fields[1] = (struct fb_field){ 4, 0 };
+	fields[2] = (struct fb_field){ 4, 0 };
+	fb_table(b, msg[2], fields, 3, batch);
+
+	/* One field node per column, none of them has nulls. */
+	fb_struct_vector(b, batch[1], ctx->num_columns);
+	for (i = 0; i < ctx->num_columns; i++) {
+		fb_put(b, rows, 8);
+		fb_put(b, 0, 8);
+	}
+
+	/* An empty validity buffer and the values of each column. */
+	fb_struct_vector(b, batch[2], 2 * ctx->num_columns);
+	offset = 0;
+	for (i = 0; i < ctx->num_columns; i++) {
+		len = column_bytes(&ctx->columns[i], rows);
+		fb_put(b, offset, 8);
+		fb_put(b, 0, 8);
+		fb_put(b, offset, 8);
+		fb_put(b, len, 8);
+		offset += padded(len);
+	}
+
+	append_message(out, b);
+	g_string_free(b, TRUE);
+
+	for (i = 0; i < ctx->num_columns; i++) {
+		len = column_bytes(&ctx->columns[i], rows);
+		g_string_append_len(out, (const char *)ctx->columns[i].data, len);
+		g_string_append_len(out, zeroes, padded(len) - len);
+	}
+}
+
+/* Drop the first 'rows' rows of each column. */
+static void consume_rows(struct context *ctx, uint64_t rows)
+{
+	struct column *col;
+	size_t done, left, i;
+
+	for (i = 0; i < ctx->num_columns; i++) {
+		col = &ctx->columns[i];
+		done = column_bytes(col, rows);
+		left = column_bytes(col, col->rows) - done;
+		/* Logic columns get consumed in multiples of 8 rows. */
+		memmove(col->data, col->data + done, left);
+		memset(col->data + left, 0, done);
+		col->rows -= rows;
+	}
+}
+
+static int reserve_rows(struct column *col, uint64_t rows)
+{
+	uint8_t *data;
+	size_t size;
+
+	size = column_bytes(col, col->rows + rows);
+	if (size <= col->size)
+		return SR_OK;
+	size = MAX(size, 2 * col->size);
+	if (!(data = g_try_realloc(col->data, size))) {
+		sr_err("Cannot allocate column buffer.");
+		return SR_ERR_MALLOC;
+	}
+	memset(data + col->size, 0, size - col->size);
+	col->data = data;
+	col->size = size;
+
+	return SR_OK;
+}
+
+/* Fill a column up to 'rows' rows, with low bits or NaN values. */
+static int pad_column(struct column *col, uint64_t rows)
+{
+	float *wp;
+	uint64_t i;
+	int ret;
+
+	if (col->rows >= rows)
+		return SR_OK;
+	if ((ret = reserve_rows(col, rows - col->rows)) != SR_OK)
+		return ret;
+	if (col->ch->type == SR_CHANNEL_ANALOG) {
+		wp = (float *)col->data;
+		for (i = col->rows; i < rows; i++)
+			wp[i] = NAN;
+	}
+	col->rows = rows;
+
+	return SR_OK;
+}
+
+/*
+ * Write the rows which all columns have values for. When some columns
+ * get too far ahead of the others, or on a flush at the end of a frame
+ * or of the stream, the lagging columns get padded instead.
+ */
+static int release_rows(struct context *ctx, GString *out, gboolean flush)
+{
+	uint64_t rows, max_rows;
+	size_t i;
+	int ret;
+
+	if (!ctx->num_columns)
+		return SR_OK;
+
+	/* Rows are complete when all columns have values for them. */
+	rows = UINT64_MAX;
+	max_rows = 0;
+	for (i = 0; i < ctx->num_columns; i++) {
+		rows = MIN(rows, ctx->columns[i].rows);
+		max_rows = MAX(max_rows, ctx->columns[i].rows);
+	}
+	if (rows < max_rows && (flush
+			|| max_rows - rows >= MAX_PENDING_BATCHES * ctx->chunk_rows)) {
+		sr_dbg("Padding %" PRIu64 " rows of lagging columns.",
+			max_rows - rows);
+		for (i = 0; i < ctx->num_columns; i++) {
+			if ((ret = pad_column(&ctx->columns[i], max_rows)) != SR_OK)
+				return ret;
+		}
+		rows = max_rows;
+	}
+
+	while (rows >= ctx->chunk_rows) {
+		append_record_batch(ctx, out, ctx->chunk_rows);
+		consume_rows(ctx, ctx->chunk_rows);
+		rows -= ctx->chunk_rows;
+	}
+	if (flush && rows) {
+		append_record_batch(ctx, out, rows);
+		for (i = 0; i < ctx->num_columns; i++) {
+			memset(ctx->columns[i].data, 0, ctx->columns[i].size);
+			ctx->columns[i].rows = 0;
+		}
+	}
+
+	return SR_OK;
+}
+
+static int process_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	struct column *col;
+	const uint8_t *rp;
+	uint64_t num_samples, row, i;
+	size_t byte, c;
+	uint8_t mask;
+	int ret;
+
+	num_samples = logic->length / logic->unitsize;
+	for (c = 0; c < ctx->num_columns; c++) {
+		col = &ctx->columns[c];
+		if (col->ch->type != SR_CHANNEL_LOGIC)
+			continue;
+		if ((ret = reserve_rows(col, num_samples)) != SR_OK)
+			return ret;
+		byte = col->ch->index / 8;
+		mask = 1 << (col->ch->index % 8);
+		row = col->rows;
+		if (byte < logic->unitsize) {
+			rp = (const uint8_t *)logic->data + byte;
+			for (i = 0; i < num_samples; i++, row++, rp += logic->unitsize) {
+				if (*rp & mask)
+					col->data[row / 8] |= 1 << (row % 8);
+			}
+		}
+		col->rows += num_samples;
+	}
+
+	return SR_OK;
+}
+
+static int process_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	struct column *col;
+	const GSList *l;
+	float *fdata, *wp;
+	const float *values;
+	size_t num_channels, count, c, j;
+	uint32_t i;
+	int ret;
+
+	num_channels = g_slist_length(analog->meaning->channels);
+	count = analog->num_samples * num_channels;
+	if (!count)
+		return SR_OK;
+	if (count > ctx->fdata_size) {
+		if (!(fdata = g_try_realloc(ctx->fdata, count * sizeof(float))))
+			return SR_ERR_MALLOC;
+		ctx->fdata = fdata;
+		ctx->fdata_size = count;
+	}
+	ret = sr_analog_to_float_view(analog, ctx->fdata, &values);
+	if (ret != SR_OK)
+		return ret;
+
+	for (j = 0, l = analog->meaning->channels; l; j++, l = l->next) {
+		for (c = 0; c < ctx->num_columns; c++) {
+			if (ctx->columns[c].ch == l->data)
+				break;
+		}
+		if (c == ctx->num_columns)
+			continue;
+		col = &ctx->columns[c];
+		if ((ret = reserve_rows(col, analog->num_samples)) != SR_OK)
+			return ret;
+		wp = (float *)col->data + col->rows;
+		for (i = 0; i < analog->num_samples; i++)
+			wp[i] = values[i * num_channels + j];
+		col->rows += analog->num_samples;
+	}
+
+	return SR_OK;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GSList *l;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	o->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->chunk_rows = g_variant_get_uint64(g_hash_table_lookup(options, "rows"));
+	/* Keep bit-packed columns byte aligned between record batches. */
+	ctx->chunk_rows = (MAX(ctx->chunk_rows, 1) + 7) & ~UINT64_C(7);
+
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled && (ch->type == SR_CHANNEL_LOGIC ||
+				ch->type == SR_CHANNEL_ANALOG))
+			ctx->num_columns++;
+	}
+	ctx->columns = g_malloc0(sizeof(ctx->columns[0]) * ctx->num_columns);
+	ctx->num_columns = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled && (ch->type == SR_CHANNEL_LOGIC ||
+				ch->type == SR_CHANNEL_ANALOG))
+			ctx->columns[ctx->num_columns++].ch = ch;
+	}
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_config *src;
+	GVariant *gvar;
+	GSList *l;
+	int ret;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				ctx->samplerate = g_variant_get_uint64(src->data);
+		}
+		return SR_OK;
+	case SR_DF_LOGIC:
+	case SR_DF_ANALOG:
+	case SR_DF_FRAME_END:
+	case SR_DF_END:
+		break;
+	default:
+		return SR_OK;
+	}
+
+	*out = g_string_sized_new(512);
+	if (!ctx->header_done) {
+		if (!ctx->samplerate && sr_config_get(o->sdi->driver, o->sdi,
+				NULL, SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+			ctx->samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		append_schema(ctx, *out);
+		ctx->header_done = TRUE;
+	}
+
+	ret = SR_OK;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (logic->unitsize)
+			ret = process_logic(ctx, logic);
+		if (ret == SR_OK)
+			ret = release_rows(ctx, *out, FALSE);
+		break;
+	case SR_DF_ANALOG:
+		ret = process_analog(ctx, packet->payload);
+		if (ret == SR_OK)
+			ret = release_rows(ctx, *out, FALSE);
+		break;
+	case SR_DF_FRAME_END:
+		ret = release_rows(ctx, *out, TRUE);
+		break;
+	case SR_DF_END:
+		ret = release_rows(ctx, *out, TRUE);
+		/* End-of-stream marker. */
+		fb_put(*out, ARROW_CONTINUATION, 4);
+		fb_put(*out, 0, 4);
+		break;
+	}
+
+	return ret;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+	size_t i;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+	ctx = o->priv;
+
+	for (i = 0; i < ctx->num_columns; i++)
+		g_free(ctx->columns[i].data);
+	g_free(ctx->columns);
+	g_free(ctx->fdata);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "rows", "Rows per batch", "Number of samples per record batch", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(DEFAULT_CHUNK_ROWS));
+
+	return options;
+}
+
+SR_PRIV struct sr_output_module output_arrow = {
+	.id = "arrow",
+	.name = "Arrow",
+	.desc = "Apache Arrow IPC stream, one column per channel",
+	.exts = (const char *[]){"arrows", NULL},
+	.flags = 0,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -19,6 +19,7 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <glib.h>
@@ -29,6 +30,9 @@
 
 #define DEFAULT_SAMPLES_PER_LINE 74
 
+/* Line width which keeps memory bounded when no width was given. */
+#define MAX_SAMPLES_PER_LINE (64 * 1024)
+
 /*
  * The string looks ugly with escape characters, here is the readable
  * version: Use . and " for low and high bits, use \ and / to draw
@@ -36,6 +40,9 @@
  */
 #define DEFAULT_ASCII_CHARS ".\"\\/"
 
+/* Samples which get rendered per step, one table lookup per channel. */
+#define GROUP_SIZE 8
+
 struct context {
 	size_t num_enabled_channels;
 	size_t spl;
@@ -43,14 +50,25 @@ struct context {
 	int trigger;
 	uint64_t samplerate;
 	int *channel_index;
-	char **aligned_names;
 	size_t max_namelen;
-	char **line_values;
 	uint8_t *prev_sample;
 	gboolean header_done;
-	GString **lines;
+	/* Fixed size line buffers, starting with the channel name. */
+	char **lines;
+	size_t prefix_len;
+	/*
+	 * Characters for eight samples of a channel, indexed by their bits
+	 * (sample 0 in the LSB) shifted left by one, OR'ed with the bit of
+	 * the sample before them.
+	 */
+	char (*glyphs)[GROUP_SIZE];
+	/* Sample bytes which hold enabled channels, and their bit planes. */
+	size_t num_bytes;
+	uint64_t *planes;
 	const char *charset;
 	gboolean edges;
+	gboolean collapse;
+	gboolean have_prev;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -58,7 +76,8 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct context *ctx;
 	struct sr_channel *ch;
 	GSList *l;
-	size_t j, max_namelen, alloc_line_len;
+	size_t i, j, k, max_namelen, num_bytes;
+	unsigned int cur, prev, charidx;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
@@ -67,6 +86,10 @@ static int init(struct sr_output *o, GHashTable *options)
 	o->priv = ctx;
 	ctx->trigger = -1;
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
+	if (!ctx->spl)
+		ctx->spl = MAX_SAMPLES_PER_LINE;
+	ctx->collapse = g_variant_get_boolean(
+		g_hash_table_lookup(options, "collapse"));
 	ctx->charset = g_strdup(g_variant_get_string(
 		g_hash_table_lookup(options, "charset"), NULL));
 	if (!ctx->charset || strlen(ctx->charset) < 2) {
@@ -84,12 +107,12 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->num_enabled_channels++;
 	}
 	ctx->channel_index = g_malloc0(sizeof(ctx->channel_index[0]) * ctx->num_enabled_channels);
-	ctx->aligned_names = g_malloc0(sizeof(ctx->aligned_names[0]) * ctx->num_enabled_channels);
 	ctx->lines = g_malloc0(sizeof(ctx->lines[0]) * ctx->num_enabled_channels);
 	ctx->prev_sample = g_malloc0(g_slist_length(o->sdi->channels));
 
 	/* Get the maximum length across all active logic channels. */
 	max_namelen = 0;
+	num_bytes = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_LOGIC)
@@ -97,10 +120,13 @@ static int init(struct sr_output *o, GHashTable *options)
 		if (!ch->enabled)
 			continue;
 		max_namelen = MAX(max_namelen, strlen(ch->name));
+		num_bytes = MAX(num_bytes, (size_t)ch->index / 8 + 1);
 	}
 	ctx->max_namelen = max_namelen;
+	ctx->num_bytes = num_bytes;
+	ctx->planes = g_malloc0(sizeof(ctx->planes[0]) * num_bytes);
 
-	alloc_line_len = ctx->max_namelen + 8 + ctx->spl;
+	ctx->prefix_len = max_namelen + 1;
 	j = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -110,22 +136,33 @@ static int init(struct sr_output *o, GHashTable *options)
 			continue;
 
 		ctx->channel_index[j] = ch->index;
-		ctx->aligned_names[j] = g_strdup_printf("%*s", (int)max_namelen, ch->name);
-
-		ctx->lines[j] = g_string_sized_new(alloc_line_len);
-		g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
+		ctx->lines[j] = g_malloc(ctx->prefix_len + ctx->spl + 1);
+		snprintf(ctx->lines[j], ctx->prefix_len + 1, "%*s:",
+			(int)max_namelen, ch->name);
 
 		j++;
 	}
 
+	ctx->glyphs = g_malloc(sizeof(ctx->glyphs[0]) << (GROUP_SIZE + 1));
+	for (i = 0; i < (1U << (GROUP_SIZE + 1)); i++) {
+		prev = i & 1;
+		for (k = 0; k < GROUP_SIZE; k++) {
+			cur = (i >> (k + 1)) & 1;
+			charidx = cur;
+			if (ctx->edges && cur != prev)
+				charidx += 2;
+			ctx->glyphs[i][k] = ctx->charset[charidx];
+			prev = cur;
+		}
+	}
+
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	size_t num_channels;
 	char *samplerate_s;
 
@@ -138,8 +175,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %zu/%zu channels",
 			ctx->num_enabled_channels, num_channels);
@@ -149,8 +185,6 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
-
-	return header;
 }
 
 static void maybe_add_trigger(struct context *ctx, GString *out)
@@ -172,6 +206,92 @@ static void maybe_add_trigger(struct context *ctx, GString *out)
 		offset + 1, "^", offset);
 }
 
+/* Check whether any enabled channel differs from the previous sample. */
+static gboolean sample_changed(const struct context *ctx,
+		const uint8_t *sample, const uint8_t *prev_sample)
+{
+	size_t j, idx;
+	uint8_t bitmask;
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		idx = ctx->channel_index[j];
+		bitmask = 1U << (idx % 8);
+		if ((sample[idx / 8] ^ prev_sample[idx / 8]) & bitmask)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Emit the lines rendered so far, and start over with empty ones. */
+static void flush_lines(struct context *ctx, GString *out)
+{
+	size_t j;
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		g_string_append_len(out, ctx->lines[j],
+			ctx->prefix_len + ctx->spl_cnt);
+		g_string_append_c(out, '\n');
+	}
+	maybe_add_trigger(ctx, out);
+	ctx->spl_cnt = 0;
+}
+
+/*
+ * Transpose an 8x8 bit matrix: bit i of byte k moves to bit k of byte i.
+ * Turns one sample byte of eight samples into eight channels' bits.
+ */
+static inline uint64_t transpose8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+
+	return x;
+}
+
+/*
+ * Render up to eight samples into all channels' lines. The group must
+ * not extend past the end of the line. The prev sample determines edges
+ * at the start of the group, except for a line's first column.
+ */
+static void render_group(struct context *ctx, const uint8_t **group,
+		size_t count, size_t unitsize, const uint8_t *prev)
+{
+	size_t i, j, k, idx, bytepos, bitpos, col;
+	uint64_t plane;
+	unsigned int bits, prevbit;
+
+	for (i = 0; i < ctx->num_bytes; i++) {
+		plane = 0;
+		if (i < unitsize) {
+			for (k = 0; k < count; k++)
+				plane |= (uint64_t)group[k][i] << (8 * k);
+		}
+		ctx->planes[i] = transpose8(plane);
+	}
+
+	col = ctx->prefix_len + ctx->spl_cnt;
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		idx = ctx->channel_index[j];
+		bytepos = idx / 8;
+		bitpos = idx % 8;
+		bits = (ctx->planes[bytepos] >> (8 * bitpos)) & 0xff;
+		if (ctx->spl_cnt && bytepos < unitsize)
+			prevbit = (prev[bytepos] >> bitpos) & 1;
+		else
+			prevbit = bits & 1;
+		memcpy(&ctx->lines[j][col], ctx->glyphs[(bits << 1) | prevbit],
+			count);
+	}
+	ctx->spl_cnt += count;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -180,13 +300,8 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	size_t idx, i, j;
-	size_t num_samples;
-	const uint8_t *curr_sample;
-	size_t bytepos;
-	uint8_t bitmask, curbit, prevbit;
-	char c;
-	size_t charidx;
+	size_t num_samples, count, room, num_lines, line_len;
+	const uint8_t *curr_sample, *prev, *group[GROUP_SIZE];
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -208,58 +323,53 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		ctx->trigger = ctx->spl_cnt;
 		break;
 	case SR_DF_LOGIC:
+		logic = packet->payload;
+		num_samples = logic->length / logic->unitsize;
+
+		/* Size the text for the lines which this packet completes. */
+		num_lines = (ctx->spl_cnt + num_samples) / ctx->spl;
+		line_len = ctx->prefix_len + ctx->spl + 1;
+		*out = g_string_sized_new(512 +
+			num_lines * (ctx->num_enabled_channels + 1) * line_len);
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, *out);
 			ctx->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
 		}
 
-		logic = packet->payload;
-		num_samples = logic->length / logic->unitsize;
 		curr_sample = logic->data;
-		while (num_samples--) {
-			ctx->spl_cnt++;
-			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				bytepos = idx / 8;
-				bitmask = 1U << (idx % 8);
-				curbit = curr_sample[bytepos] & bitmask;
-				prevbit = ctx->prev_sample[bytepos] & bitmask;
-
-				charidx = curbit ? 1 : 0;
-				if (ctx->edges && ctx->spl_cnt > 1) {
-					if (curbit != prevbit)
-						charidx += 2;
-				}
-				c = ctx->charset[charidx];
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j + 1 == ctx->num_enabled_channels)
-						maybe_add_trigger(ctx, *out);
-					g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
+		prev = ctx->prev_sample;
+		while (num_samples) {
+			/* Gather as many samples as fit the current line. */
+			room = MIN(ctx->spl - ctx->spl_cnt, GROUP_SIZE);
+			count = 0;
+			while (count < room && num_samples) {
+				num_samples--;
+				/* Only draw sample sets which differ from the last. */
+				if (ctx->collapse && ctx->have_prev &&
+						!sample_changed(ctx, curr_sample,
+							count ? group[count - 1] : prev)) {
+					curr_sample += logic->unitsize;
+					continue;
 				}
+				ctx->have_prev = TRUE;
+				group[count++] = curr_sample;
+				curr_sample += logic->unitsize;
 			}
+			if (!count)
+				break;
+			render_group(ctx, group, count, logic->unitsize, prev);
+			prev = group[count - 1];
 			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
-			memcpy(ctx->prev_sample, curr_sample, logic->unitsize);
-			curr_sample += logic->unitsize;
+				flush_lines(ctx, *out);
 		}
+		if (prev != ctx->prev_sample)
+			memcpy(ctx->prev_sample, prev, logic->unitsize);
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
 			*out = g_string_sized_new(512);
-			for (i = 0; i < ctx->num_enabled_channels; i++) {
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
-			}
-			maybe_add_trigger(ctx, *out);
+			flush_lines(ctx, *out);
 		}
 		break;
 	}
@@ -280,12 +390,11 @@ static int cleanup(struct sr_output *o)
 
 	g_free(ctx->channel_index);
 	g_free(ctx->prev_sample);
-	for (i = 0; i < ctx->num_enabled_channels; i++) {
-		g_free(ctx->aligned_names[i]);
-		g_string_free(ctx->lines[i], TRUE);
-	}
-	g_free(ctx->aligned_names);
+	for (i = 0; i < ctx->num_enabled_channels; i++)
+		g_free(ctx->lines[i]);
 	g_free(ctx->lines);
+	g_free(ctx->glyphs);
+	g_free(ctx->planes);
 	g_free((gpointer)ctx->charset);
 	g_free(ctx);
 	o->priv = NULL;
@@ -296,6 +405,7 @@ static int cleanup(struct sr_output *o)
 static struct sr_option options[] = {
 	{ "width", "Width", "Number of samples per line", NULL, NULL },
 	{ "charset", "Charset", "Characters for 0/1 bits (and fall/rise edges)", NULL, NULL },
+	{ "collapse", "Collapse", "Skip samples which repeat the previous one", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -306,6 +416,8 @@ static const struct sr_option *get_options(void)
 		g_variant_ref_sink(options[0].def);
 		options[1].def = g_variant_new_string(DEFAULT_ASCII_CHARS);
 		g_variant_ref_sink(options[1].def);
+		options[2].def = g_variant_new_boolean(FALSE);
+		g_variant_ref_sink(options[2].def);
 	}
 
 	return options;
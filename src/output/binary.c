@@ -26,18 +26,280 @@
 
 #define LOG_PREFIX "output/binary"
 
+/* Number of logic channels which can be selected for packing. */
+#define MAX_CHANNELS 64
+
+enum packing {
+	PACK_NONE,	/* Raw sample data at the device's unitsize. */
+	PACK_BYTES,	/* Selected channels, in as few bytes per sample. */
+	PACK_BITS,	/* Selected channels, as a continuous bit stream. */
+};
+
+static const char *packing_names[] = {
+	[PACK_NONE] = "none",
+	[PACK_BYTES] = "bytes",
+	[PACK_BITS] = "bits",
+};
+
+struct context {
+	enum packing packing;
+	unsigned int num_channels;
+	unsigned int out_unitsize;
+	/*
+	 * Bit gather tables, one per source byte which holds selected
+	 * channels. An entry holds the packed bits which the source
+	 * byte's value contributes to the output sample.
+	 */
+	unsigned int num_gather;
+	unsigned int gather_byte[MAX_CHANNELS / 8];
+	uint64_t (*gather)[256];
+	/* Bits which did not yet make a complete byte in bits mode. */
+	uint64_t bits;
+	unsigned int num_bits;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GSList *l;
+	const char *packing;
+	uint64_t mask, selected;
+	unsigned int src[MAX_CHANNELS];
+	unsigned int i, k, byte, value;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	packing = g_variant_get_string(g_hash_table_lookup(options, "packing"), NULL);
+	for (i = 0; i < ARRAY_SIZE(packing_names); i++) {
+		if (strcmp(packing, packing_names[i]) == 0)
+			break;
+	}
+	if (i == ARRAY_SIZE(packing_names)) {
+		sr_err("Unsupported packing '%s'.", packing);
+		return SR_ERR_ARG;
+	}
+
+	o->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->packing = i;
+	/* Every sample starts a new byte, so segments concatenate. */
+	o->segment_align = 1;
+	if (ctx->packing == PACK_NONE)
+		return SR_OK;
+
+	/* Keep the enabled logic channels which the mask selects. */
+	mask = g_variant_get_uint64(g_hash_table_lookup(options, "mask"));
+	selected = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+			continue;
+		if (ch->index >= MAX_CHANNELS) {
+			sr_err("Cannot pack channel %d, only the first %d "
+				"channels are supported.", ch->index, MAX_CHANNELS);
+			g_free(ctx);
+			o->priv = NULL;
+			return SR_ERR_ARG;
+		}
+		selected |= UINT64_C(1) << ch->index;
+	}
+	selected &= mask;
+
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		if (selected & (UINT64_C(1) << i))
+			src[ctx->num_channels++] = i;
+	}
+	ctx->out_unitsize = (ctx->num_channels + 7) / 8;
+	if (!ctx->num_channels) {
+		sr_warn("No channels selected, output will be empty.");
+		return SR_OK;
+	}
+
+	/* Segments of the bit stream must start on a byte boundary. */
+	if (ctx->packing == PACK_BITS) {
+		o->segment_align = 8;
+		for (k = ctx->num_channels; o->segment_align > 1 && k % 2 == 0; k /= 2)
+			o->segment_align /= 2;
+	}
+
+	/* Precompute the bit gather, one table per used source byte. */
+	ctx->gather = g_malloc0(sizeof(*ctx->gather) * (MAX_CHANNELS / 8));
+	for (k = 0; k < ctx->num_channels; k++) {
+		byte = src[k] / 8;
+		if (!ctx->num_gather || ctx->gather_byte[ctx->num_gather - 1] != byte)
+			ctx->gather_byte[ctx->num_gather++] = byte;
+		for (value = 0; value < 256; value++) {
+			if (value & (1 << (src[k] % 8)))
+				ctx->gather[ctx->num_gather - 1][value] |= UINT64_C(1) << k;
+		}
+	}
+
+	sr_dbg("Packing %u channels into %s.", ctx->num_channels,
+		ctx->packing == PACK_BITS ? "a bit stream" : "whole bytes");
+
+	return SR_OK;
+}
+
+/* Gather the selected channels' bits of one sample. */
+static inline uint64_t gather_sample(const struct context *ctx,
+		const uint8_t *sample, uint16_t unitsize)
+{
+	uint64_t value;
+	unsigned int i;
+
+	value = 0;
+	for (i = 0; i < ctx->num_gather; i++) {
+		if (ctx->gather_byte[i] < unitsize)
+			value |= ctx->gather[i][sample[ctx->gather_byte[i]]];
+	}
+
+	return value;
+}
+
+static void pack_bytes(const struct context *ctx,
+		const struct sr_datafeed_logic *logic, GString *out)
+{
+	const uint8_t *rp;
+	uint8_t *wp;
+	uint64_t num_samples, i, value;
+	unsigned int k;
+
+	num_samples = logic->length / logic->unitsize;
+	g_string_set_size(out, num_samples * ctx->out_unitsize);
+	rp = logic->data;
+	wp = (uint8_t *)out->str;
+	for (i = 0; i < num_samples; i++) {
+		value = gather_sample(ctx, rp, logic->unitsize);
+		for (k = 0; k < ctx->out_unitsize; k++) {
+			*wp++ = value & 0xff;
+			value >>= 8;
+		}
+		rp += logic->unitsize;
+	}
+}
+
+static void pack_bits(struct context *ctx,
+		const struct sr_datafeed_logic *logic, GString *out)
+{
+	const uint8_t *rp;
+	uint8_t *wp;
+	uint64_t num_samples, i, value, bits;
+	unsigned int count, pending;
+
+	num_samples = logic->length / logic->unitsize;
+	g_string_set_size(out,
+		(ctx->num_bits + num_samples * ctx->num_channels) / 8);
+	rp = logic->data;
+	wp = (uint8_t *)out->str;
+	bits = ctx->bits;
+	pending = ctx->num_bits;
+	count = ctx->num_channels;
+	for (i = 0; i < num_samples; i++) {
+		value = gather_sample(ctx, rp, logic->unitsize);
+		rp += logic->unitsize;
+		/* At most 7 bits are pending, wider samples go in halves. */
+		if (count > 56) {
+			bits |= (value & 0xffffffff) << pending;
+			pending += 32;
+			while (pending >= 8) {
+				*wp++ = bits & 0xff;
+				bits >>= 8;
+				pending -= 8;
+			}
+			value >>= 32;
+			bits |= value << pending;
+			pending += count - 32;
+		} else {
+			bits |= value << pending;
+			pending += count;
+		}
+		while (pending >= 8) {
+			*wp++ = bits & 0xff;
+			bits >>= 8;
+			pending -= 8;
+		}
+	}
+	ctx->bits = bits;
+	ctx->num_bits = pending;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
+	struct context *ctx;
 	const struct sr_datafeed_logic *logic;
-
-	(void)o;
+	char tail;
 
 	*out = NULL;
-	if (packet->type != SR_DF_LOGIC)
-		return SR_OK;
-	logic = packet->payload;
-	*out = g_string_new_len(logic->data, logic->length);
+	if (!o || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (ctx->packing == PACK_NONE) {
+			*out = g_string_new_len(logic->data, logic->length);
+			break;
+		}
+		if (!ctx->num_channels || !logic->unitsize)
+			break;
+		*out = g_string_sized_new(0);
+		if (ctx->packing == PACK_BYTES)
+			pack_bytes(ctx, logic, *out);
+		else
+			pack_bits(ctx, logic, *out);
+		break;
+	case SR_DF_END:
+		/* Pad the last partial byte of the bit stream with zeroes. */
+		if (ctx->packing == PACK_BITS && ctx->num_bits) {
+			tail = ctx->bits & 0xff;
+			*out = g_string_new_len(&tail, 1);
+			ctx->bits = 0;
+			ctx->num_bits = 0;
+		}
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "packing", "Packing", "Write raw samples, or only the selected channels packed into bytes or bits", NULL, NULL },
+	{ "mask", "Mask", "Bit mask of the enabled logic channels to pack", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	GSList *l = NULL;
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(
+			packing_names[PACK_NONE]));
+		for (i = 0; i < ARRAY_SIZE(packing_names); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(packing_names[i])));
+		options[0].values = l;
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(UINT64_MAX));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+
+	if (!o)
+		return SR_ERR_ARG;
+	ctx = o->priv;
+
+	if (ctx)
+		g_free(ctx->gather);
+	g_free(ctx);
+	o->priv = NULL;
 
 	return SR_OK;
 }
@@ -48,6 +310,8 @@ SR_PRIV struct sr_output_module output_binary = {
 	.desc = "Raw binary logic data",
 	.exts = NULL,
 	.flags = 0,
-	.options = NULL,
+	.options = get_options,
+	.init = init,
 	.receive = receive,
+	.cleanup = cleanup,
 };
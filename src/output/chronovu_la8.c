@@ -138,11 +138,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		c[1] = (ctx->samplecount >> 8) & 0xff;
 		c[2] = (ctx->samplecount >> 16) & 0xff;
 		c[3] = (ctx->samplecount >> 24) & 0xff;
-		*out = g_string_new_len(c, 4);
-		/* Flush the pre-trigger buffer. */
-		if (ctx->pretrig_buf->len)
-			g_string_append_len(*out, ctx->pretrig_buf->str,
-					ctx->pretrig_buf->len);
+		/* Flush the pre-trigger buffer, hand it over as is. */
+		*out = g_string_prepend_len(ctx->pretrig_buf, c, 4);
+		ctx->pretrig_buf = g_string_sized_new(1024);
 		ctx->triggered = TRUE;
 		break;
 	case SR_DF_LOGIC:
@@ -156,9 +154,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	case SR_DF_END:
 		if (!ctx->triggered && ctx->pretrig_buf->len) {
 			/* We never got a trigger, submit an empty one. */
-			*out = g_string_sized_new(ctx->pretrig_buf->len + 4);
-			g_string_append_len(*out, "\x00\x00\x00\x00", 4);
-			g_string_append_len(*out, ctx->pretrig_buf->str, ctx->pretrig_buf->len);
+			*out = g_string_prepend_len(ctx->pretrig_buf,
+				"\x00\x00\x00\x00", 4);
+			ctx->pretrig_buf = g_string_sized_new(1024);
 		}
 		break;
 	}
@@ -99,6 +99,11 @@ struct context {
 	uint8_t *previous_sample;
 	float *analog_samples;
 	uint8_t *logic_samples;
+	/* Source bit positions of the enabled logic channels. */
+	size_t *logic_bytes;
+	uint8_t *logic_masks;
+	gboolean logic_dense;
+	size_t value_len, record_len;
 	const char *xlabel;	/* Don't free: will point to a static string. */
 	const char *title;	/* Don't free: will point into the driver struct. */
 
@@ -116,7 +121,7 @@ struct context {
 
 static int init(struct sr_output *o, GHashTable *options)
 {
-	unsigned int i, analog_channels, logic_channels;
+	unsigned int i, j, analog_channels, logic_channels, num_channels;
 	struct context *ctx;
 	struct sr_channel *ch;
 	const char *label_string;
@@ -207,6 +212,43 @@ static int init(struct sr_output *o, GHashTable *options)
 		}
 	}
 
+	/*
+	 * Keep the byte offsets and bit masks of the enabled logic
+	 * channels at hand, in output column order. Check whether the
+	 * channels are the first bits of the data image, in order.
+	 */
+	ctx->logic_bytes = g_malloc0_n(ctx->num_logic_channels + 1,
+		sizeof(ctx->logic_bytes[0]));
+	ctx->logic_masks = g_malloc0(ctx->num_logic_channels + 1);
+	ctx->logic_dense = TRUE;
+	num_channels = ctx->num_analog_channels + ctx->num_logic_channels;
+	for (i = 0, j = 0; i < num_channels; i++) {
+		ch = ctx->channels[i].ch;
+		if (ch->type != SR_CHANNEL_LOGIC)
+			continue;
+		ctx->logic_bytes[j] = ch->index / 8;
+		ctx->logic_masks[j] = 1 << (ch->index % 8);
+		if (ch->index != (int)j)
+			ctx->logic_dense = FALSE;
+		j++;
+	}
+
+	ctx->value_len = strlen(ctx->value);
+	ctx->record_len = strlen(ctx->record);
+
+	/*
+	 * Segments of a capture continue the time column, and only the
+	 * first one gets the header and labels. The gnuplot script needs
+	 * the whole capture, and dedup depends on the packet boundaries.
+	 */
+	if (!*ctx->gnuplot && !ctx->dedup)
+		o->segment_align = 1;
+	ctx->out_sample_count = o->segment_start;
+	if (o->segment_continued) {
+		ctx->header = FALSE;
+		ctx->label_do = FALSE;
+	}
+
 	return SR_OK;
 }
 
@@ -323,6 +365,7 @@ static void process_analog(struct context *ctx,
 	struct sr_analog_meaning *meaning;
 	GSList *l;
 	float *fdata = NULL;
+	const float *values;
 	struct sr_channel *ch;
 
 	if (!ctx->analog_samples) {
@@ -340,7 +383,7 @@ static void process_analog(struct context *ctx,
 	ctx->channels_seen += num_rcvd_ch;
 	sr_dbg("Processing packet of %zu analog channels", num_rcvd_ch);
 	fdata = g_malloc(analog->num_samples * num_rcvd_ch * sizeof(float));
-	if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
+	if ((ret = sr_analog_to_float_view(analog, fdata, &values)) != SR_OK)
 		sr_warn("Problems converting data to floating point values.");
 
 	num_have_ch = ctx->num_analog_channels + ctx->num_logic_channels;
@@ -360,7 +403,7 @@ static void process_analog(struct context *ctx,
 					&ctx->channels[idx_have].label);
 			}
 			for (idx_smpl = 0; idx_smpl < analog->num_samples; idx_smpl++)
-				ctx->analog_samples[idx_smpl * ctx->num_analog_channels + idx_send] = fdata[idx_smpl * num_rcvd_ch + idx_rcvd];
+				ctx->analog_samples[idx_smpl * ctx->num_analog_channels + idx_send] = values[idx_smpl * num_rcvd_ch + idx_rcvd];
 			break;
 		}
 		idx_send++;
@@ -368,16 +411,35 @@ static void process_analog(struct context *ctx,
 	g_free(fdata);
 }
 
+/* Bit values of a data image byte, least significant bit first. */
+static uint8_t logic_bit_table[256][8];
+
+static void init_logic_bit_table(void)
+{
+	size_t value, bit;
+
+	if (logic_bit_table[0xff][0])
+		return;
+	for (value = 0; value < 256; value++) {
+		for (bit = 0; bit < 8; bit++)
+			logic_bit_table[value][bit] = (value >> bit) & 1;
+	}
+}
+
 /*
  * We treat logic packets the same as analog packets, though it's not
  * strictly required. This allows us to process mixed signals properly.
+ *
+ * The bits of all enabled channels get extracted sample by sample.
+ * When the enabled channels are the first bits of the data image (the
+ * common case), whole bytes get expanded by table lookup.
  */
 static void process_logic(struct context *ctx,
 			  const struct sr_datafeed_logic *logic)
 {
-	unsigned int i, j, ch, num_samples;
-	int idx;
-	uint8_t *sample;
+	unsigned int i, j, ch, num_samples, count;
+	const uint8_t *sample;
+	uint8_t *wrptr;
 
 	num_samples = logic->length / logic->unitsize;
 	ctx->channels_seen += ctx->logic_channel_count;
@@ -390,21 +452,79 @@ static void process_logic(struct context *ctx,
 	if (ctx->num_samples != num_samples)
 		sr_warn("Expecting %u samples, got %u",
 			ctx->num_samples, num_samples);
+	num_samples = MIN(num_samples, ctx->num_samples);
+
+	if (ctx->label_do && !ctx->label_names) {
+		for (j = 0; j < ctx->num_analog_channels + ctx->num_logic_channels; j++) {
+			if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC)
+				ctx->channels[j].label = "logic";
+		}
+	}
+
+	if (ctx->logic_dense && ctx->num_logic_channels <= logic->unitsize * 8u) {
+		init_logic_bit_table();
+		for (i = 0; i < num_samples; i++) {
+			sample = (const uint8_t *)logic->data + i * logic->unitsize;
+			wrptr = &ctx->logic_samples[i * ctx->num_logic_channels];
+			for (ch = 0; ch < ctx->num_logic_channels; ch += count) {
+				count = MIN(8, ctx->num_logic_channels - ch);
+				memcpy(&wrptr[ch], logic_bit_table[sample[ch / 8]], count);
+			}
+		}
+		return;
+	}
 
-	for (j = ch = 0; ch < ctx->num_logic_channels; j++) {
-		if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-			for (i = 0; i < num_samples; i++) {
-				sample = logic->data + i * logic->unitsize;
-				idx = ctx->channels[j].ch->index;
-				if (ctx->label_do && !ctx->label_names)
-					ctx->channels[j].label = "logic";
-				ctx->logic_samples[i * ctx->num_logic_channels + ch] = sample[idx / 8] & (1 << (idx % 8));
+	for (i = 0; i < num_samples; i++) {
+		sample = (const uint8_t *)logic->data + i * logic->unitsize;
+		wrptr = &ctx->logic_samples[i * ctx->num_logic_channels];
+		for (ch = 0; ch < ctx->num_logic_channels; ch++) {
+			if (ctx->logic_bytes[ch] >= logic->unitsize) {
+				wrptr[ch] = 0;
+				continue;
 			}
-			ch++;
+			wrptr[ch] = (sample[ctx->logic_bytes[ch]] & ctx->logic_masks[ch]) ? 1 : 0;
 		}
 	}
 }
 
+/* Append a decimal number to the text, without printf() overhead. */
+static void append_u64(GString *s, uint64_t value)
+{
+	char text[24], *p;
+
+	p = &text[sizeof(text)];
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	g_string_append_len(s, p, &text[sizeof(text)] - p);
+}
+
+/*
+ * Append an analog value in "%g" format. Integer values of less than
+ * six digits print the same in both, and are common for scaled ADC
+ * data. They are formatted directly. Other values use snprintf().
+ */
+static void append_float(GString *s, float value)
+{
+	char text[32];
+	int len;
+
+	if (fabsf(value) < 1e6 && value == (int32_t)value &&
+			!(value == 0 && signbit(value))) {
+		if (value < 0)
+			g_string_append_c(s, '-');
+		append_u64(s, (uint64_t)fabsf(value));
+		return;
+	}
+
+	len = snprintf(text, sizeof(text), "%g", value);
+	if (len > 0 && (size_t)len < sizeof(text))
+		g_string_append_len(s, text, len);
+	else
+		g_string_append_printf(s, "%g", value);
+}
+
 static void dump_saved_values(struct context *ctx, GString **out)
 {
 	unsigned int i, j, analog_size, num_channels;
@@ -474,14 +594,15 @@ static void dump_saved_values(struct context *ctx, GString **out)
 			}
 
 			if (ctx->time && !ctx->sample_rate) {
-				g_string_append_printf(*out, "0%s", ctx->value);
+				g_string_append_c(*out, '0');
+				g_string_append_len(*out, ctx->value, ctx->value_len);
 			} else if (ctx->time) {
 				sample_time_dbl = ctx->out_sample_count++;
 				sample_time_dbl /= ctx->sample_rate;
 				sample_time_dbl *= ctx->sample_scale;
 				sample_time_u64 = sample_time_dbl;
-				g_string_append_printf(*out, "%" PRIu64 "%s",
-					sample_time_u64, ctx->value);
+				append_u64(*out, sample_time_u64);
+				g_string_append_len(*out, ctx->value, ctx->value_len);
 			}
 
 			for (j = 0; j < num_channels; j++) {
@@ -491,11 +612,12 @@ static void dump_saved_values(struct context *ctx, GString **out)
 					    fmax(value, ctx->channels[j].max);
 					ctx->channels[j].min =
 					    fmin(value, ctx->channels[j].min);
-					g_string_append_printf(*out, "%g%s",
-						value, ctx->value);
+					append_float(*out, value);
+					g_string_append_len(*out, ctx->value, ctx->value_len);
 				} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-					g_string_append_printf(*out, "%c%s",
-							       ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0', ctx->value);
+					g_string_append_c(*out,
+						ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0');
+					g_string_append_len(*out, ctx->value, ctx->value_len);
 				} else {
 					sr_warn("Unexpected channel type: %d",
 						ctx->channels[i].ch->type);
@@ -508,7 +630,7 @@ static void dump_saved_values(struct context *ctx, GString **out)
 				ctx->trigger = FALSE;
 			}
 			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+			g_string_append_len(*out, ctx->record, ctx->record_len);
 		}
 	}
 
@@ -729,6 +851,8 @@ static int cleanup(struct sr_output *o)
 		g_free((gpointer)ctx->gnuplot);
 		g_free((gpointer)ctx->value);
 		g_free(ctx->previous_sample);
+		g_free(ctx->logic_bytes);
+		g_free(ctx->logic_masks);
 		g_free(ctx->channels);
 		g_free(o->priv);
 		o->priv = NULL;
@@ -0,0 +1,416 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "file-writer"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Asynchronous writing of output files.
+ */
+
+/**
+ * @addtogroup grp_output
+ *
+ * @{
+ */
+
+/*
+ * Small writes get collected into blocks of WRITER_BLOCK_SIZE, which a
+ * writer thread writes to the file. Large GStrings are handed over as
+ * they are. The caller only waits when more than max_pending bytes are
+ * queued, so a slow disk doesn't stall the datafeed until then.
+ */
+#define WRITER_BLOCK_SIZE (1024 * 1024)
+
+/* Writes of at least this size skip the copy into a block. */
+#define WRITER_HANDOVER_SIZE (64 * 1024)
+
+#define DEFAULT_MAX_PENDING (64 * 1024 * 1024)
+
+struct writer_block {
+	uint8_t *data;
+	size_t length;
+	/* Handed over GString data, from g_malloc() not the buffer pool. */
+	gboolean gstring;
+};
+
+/** @cond PRIVATE */
+struct sr_file_writer {
+	GMutex lock;
+	GCond cond;
+	FILE *file;
+	gboolean close_file;
+	/* The block being filled. */
+	uint8_t *block;
+	size_t fill;
+	/* Blocks for the writer thread, and their total size. */
+	GQueue queue;
+	uint64_t pending;
+	uint64_t max_pending;
+	GThread *thread;
+	gboolean quit;
+	int status;
+};
+/** @endcond */
+
+static void writer_block_free(struct writer_block *block)
+{
+	if (block->gstring)
+		g_free(block->data);
+	else
+		sr_buffer_free(block->data);
+	g_free(block);
+}
+
+/* Called without the lock held. */
+static int writer_block_write(struct sr_file_writer *fw,
+		struct writer_block *block)
+{
+	int ret;
+
+	ret = SR_OK;
+	if (fwrite(block->data, 1, block->length, fw->file) != block->length) {
+		sr_err("Cannot write output file: %s.", g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	writer_block_free(block);
+
+	return ret;
+}
+
+static gpointer writer_thread(gpointer data)
+{
+	struct sr_file_writer *fw;
+	struct writer_block *block;
+	size_t length;
+	int ret;
+
+	fw = data;
+
+	g_mutex_lock(&fw->lock);
+	for (;;) {
+		if (!(block = g_queue_pop_head(&fw->queue))) {
+			if (fw->quit)
+				break;
+			g_cond_wait(&fw->cond, &fw->lock);
+			continue;
+		}
+		g_mutex_unlock(&fw->lock);
+		length = block->length;
+		/* Keep draining after an error, the caller may be waiting. */
+		if (fw->status == SR_OK) {
+			ret = writer_block_write(fw, block);
+		} else {
+			writer_block_free(block);
+			ret = SR_OK;
+		}
+		g_mutex_lock(&fw->lock);
+		if (ret != SR_OK)
+			fw->status = ret;
+		fw->pending -= length;
+		g_cond_broadcast(&fw->cond);
+	}
+	g_mutex_unlock(&fw->lock);
+
+	return NULL;
+}
+
+/* Queue a block for the writer. Called with the lock held. */
+static void writer_queue(struct sr_file_writer *fw,
+		struct writer_block *block)
+{
+	if (!fw->thread) {
+		if (fw->status == SR_OK)
+			fw->status = writer_block_write(fw, block);
+		else
+			writer_block_free(block);
+		return;
+	}
+
+	/* Anything fits into an empty queue, the budget only limits backlog. */
+	while (fw->pending && fw->pending + block->length > fw->max_pending)
+		g_cond_wait(&fw->cond, &fw->lock);
+	fw->pending += block->length;
+	g_queue_push_tail(&fw->queue, block);
+	g_cond_broadcast(&fw->cond);
+}
+
+/* Hand the current block to the writer. Called with the lock held. */
+static void writer_push(struct sr_file_writer *fw)
+{
+	struct writer_block *block;
+
+	if (!fw->fill)
+		return;
+
+	block = g_malloc0(sizeof(*block));
+	block->data = fw->block;
+	block->length = fw->fill;
+	fw->block = NULL;
+	fw->fill = 0;
+	writer_queue(fw, block);
+}
+
+static struct sr_file_writer *writer_new(FILE *file, gboolean close_file,
+		uint64_t max_pending)
+{
+	struct sr_file_writer *fw;
+
+	/* Only whole blocks get written, stdio buffering won't help. */
+	setvbuf(file, NULL, _IONBF, 0);
+
+	fw = g_malloc0(sizeof(*fw));
+	g_mutex_init(&fw->lock);
+	g_cond_init(&fw->cond);
+	g_queue_init(&fw->queue);
+	fw->file = file;
+	fw->close_file = close_file;
+	fw->max_pending = max_pending ? max_pending : DEFAULT_MAX_PENDING;
+	fw->status = SR_OK;
+	fw->thread = g_thread_try_new("sr-file-writer",
+		writer_thread, fw, NULL);
+	if (!fw->thread)
+		sr_warn("Cannot create file writer thread, writing synchronously.");
+
+	return fw;
+}
+
+/**
+ * Create a new file, to be written in the background.
+ *
+ * Frontends can pass the text which sr_output_send() returns to
+ * sr_file_writer_write_string(), so that writing to slow storage
+ * doesn't hold up the session's datafeed.
+ *
+ * @param filename The name of the file to create or overwrite. Must not
+ *                 be NULL.
+ * @param max_pending The number of bytes which may wait to be written
+ *                    before writing calls block. 0 selects a default of
+ *                    64 MiB.
+ *
+ * @return The writer, to be closed with sr_file_writer_close(), or NULL
+ *         if the file cannot be created.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_file_writer *sr_file_writer_new(const char *filename,
+		uint64_t max_pending)
+{
+	FILE *file;
+
+	if (!filename) {
+		sr_err("%s: filename was NULL", __func__);
+		return NULL;
+	}
+
+	if (!(file = g_fopen(filename, "wb"))) {
+		sr_err("Cannot create '%s': %s.", filename, g_strerror(errno));
+		return NULL;
+	}
+
+	return writer_new(file, TRUE, max_pending);
+}
+
+/**
+ * Write to an open stream in the background, e.g. to stdout.
+ *
+ * The stream gets flushed, but not closed, by sr_file_writer_close().
+ * The caller must not use it in the meantime. Its buffering is turned
+ * off.
+ *
+ * @param file The stream. Must not be NULL.
+ * @param max_pending The number of bytes which may wait to be written
+ *                    before writing calls block. 0 selects a default of
+ *                    64 MiB.
+ *
+ * @return The writer, to be closed with sr_file_writer_close(), or NULL
+ *         on errors.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_file_writer *sr_file_writer_new_stream(FILE *file,
+		uint64_t max_pending)
+{
+	if (!file) {
+		sr_err("%s: file was NULL", __func__);
+		return NULL;
+	}
+
+	fflush(file);
+
+	return writer_new(file, FALSE, max_pending);
+}
+
+/**
+ * Queue data to be written.
+ *
+ * The data gets copied, the caller can reuse its buffer right away.
+ *
+ * @param fw The writer. Must not be NULL.
+ * @param data The data to write.
+ * @param size The number of bytes to write.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR_MALLOC Out of memory.
+ * @retval SR_ERR_IO An earlier write failed, the file is incomplete.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_file_writer_write(struct sr_file_writer *fw,
+		const void *data, size_t size)
+{
+	const uint8_t *rdptr;
+	size_t count;
+	int ret;
+
+	if (!fw || (!data && size))
+		return SR_ERR_ARG;
+
+	rdptr = data;
+	g_mutex_lock(&fw->lock);
+	while (size && fw->status == SR_OK) {
+		if (!fw->block) {
+			fw->block = sr_buffer_alloc(NULL, WRITER_BLOCK_SIZE);
+			if (!fw->block) {
+				sr_err("Cannot allocate file writer block.");
+				g_mutex_unlock(&fw->lock);
+				return SR_ERR_MALLOC;
+			}
+		}
+		count = MIN(size, WRITER_BLOCK_SIZE - fw->fill);
+		memcpy(fw->block + fw->fill, rdptr, count);
+		fw->fill += count;
+		rdptr += count;
+		size -= count;
+		if (fw->fill == WRITER_BLOCK_SIZE)
+			writer_push(fw);
+	}
+	ret = fw->status;
+	g_mutex_unlock(&fw->lock);
+
+	return ret;
+}
+
+/**
+ * Queue a string to be written, e.g. the text from sr_output_send().
+ *
+ * The writer takes ownership of the string. Large strings get written
+ * without copying their text.
+ *
+ * @param fw The writer. Must not be NULL.
+ * @param str The string. Can be NULL, which writes nothing.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR_MALLOC Out of memory.
+ * @retval SR_ERR_IO An earlier write failed, the file is incomplete.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_file_writer_write_string(struct sr_file_writer *fw,
+		GString *str)
+{
+	struct writer_block *block;
+	int ret;
+
+	if (!fw) {
+		if (str)
+			g_string_free(str, TRUE);
+		return SR_ERR_ARG;
+	}
+	if (!str)
+		return SR_OK;
+
+	if (str->len < WRITER_HANDOVER_SIZE) {
+		ret = sr_file_writer_write(fw, str->str, str->len);
+		g_string_free(str, TRUE);
+		return ret;
+	}
+
+	block = g_malloc0(sizeof(*block));
+	block->length = str->len;
+	block->data = (uint8_t *)g_string_free(str, FALSE);
+	block->gstring = TRUE;
+
+	g_mutex_lock(&fw->lock);
+	/* Keep the order with what was written before. */
+	writer_push(fw);
+	if (fw->status == SR_OK)
+		writer_queue(fw, block);
+	else
+		writer_block_free(block);
+	ret = fw->status;
+	g_mutex_unlock(&fw->lock);
+
+	return ret;
+}
+
+/**
+ * Write out what is queued, and close the writer.
+ *
+ * @param fw The writer. Can be NULL.
+ *
+ * @retval SR_OK Success, all data was written.
+ * @retval SR_ERR_IO Writing failed, the file is incomplete.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_file_writer_close(struct sr_file_writer *fw)
+{
+	int ret;
+
+	if (!fw)
+		return SR_OK;
+
+	g_mutex_lock(&fw->lock);
+	writer_push(fw);
+	fw->quit = TRUE;
+	g_cond_broadcast(&fw->cond);
+	g_mutex_unlock(&fw->lock);
+	if (fw->thread)
+		g_thread_join(fw->thread);
+
+	ret = fw->status;
+	sr_buffer_free(fw->block);
+	if (fw->close_file) {
+		if (fclose(fw->file) != 0 && ret == SR_OK) {
+			sr_err("Cannot write output file: %s.",
+				g_strerror(errno));
+			ret = SR_ERR_IO;
+		}
+	} else if (fflush(fw->file) != 0 && ret == SR_OK) {
+		ret = SR_ERR_IO;
+	}
+	g_cond_clear(&fw->cond);
+	g_mutex_clear(&fw->lock);
+	g_free(fw);
+
+	return ret;
+}
+
+/** @} */
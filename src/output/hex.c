@@ -41,8 +41,13 @@ struct context {
 	uint8_t *sample_buf;
 	gboolean header_done;
 	GString **lines;
+	/* Bytes of the data image which hold enabled channels. */
+	size_t num_columns;
+	uint8_t *columns;
 };
 
+static const char hex_digits[] = "0123456789abcdef";
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
@@ -83,8 +88,15 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->lines[j] = g_string_sized_new(80);
 		ctx->sample_buf[j] = 0;
 		g_string_printf(ctx->lines[j], "%s:", ch->name);
+		ctx->num_columns = MAX(ctx->num_columns, (size_t)ch->index / 8 + 1);
 		j++;
 	}
+	ctx->columns = g_malloc0(ctx->num_columns * 8);
+
+	/* Segments of a capture which start on a new line concatenate. */
+	if (ctx->spl > 0)
+		o->segment_align = ctx->spl;
+	ctx->header_done = o->segment_continued;
 
 	return SR_OK;
 }
@@ -121,6 +133,89 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/* Append a line per channel to the output, and start the next lines. */
+static void flush_lines(struct context *ctx, GString *out)
+{
+	unsigned int j;
+	int offset;
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+		g_string_append_c(out, '\n');
+		g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+	}
+	if (ctx->num_enabled_channels && ctx->trigger > -1) {
+		/*
+		 * Sample data lines have one character per nibble,
+		 * plus one separator per byte. Align trigger marker
+		 * to this layout.
+		 */
+		offset = ctx->trigger / 4 + ctx->trigger / 8;
+		g_string_append_printf(out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+		ctx->trigger = -1;
+	}
+}
+
+/* Shift one sample's bits into the channels' bytes, one at a time. */
+static void process_sample(struct context *ctx, const uint8_t *sample)
+{
+	unsigned int j;
+	int idx;
+	char text[3];
+
+	ctx->spl_cnt++;
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		idx = ctx->channel_index[j];
+		ctx->sample_buf[j] <<= 1;
+		if (sample[idx / 8] & (1 << (idx % 8)))
+			ctx->sample_buf[j] |= 1;
+		if ((ctx->spl_cnt & 7) == 0) {
+			/* Buffered a byte's worth, output hex. */
+			text[0] = hex_digits[ctx->sample_buf[j] >> 4];
+			text[1] = hex_digits[ctx->sample_buf[j] & 0xf];
+			text[2] = ' ';
+			g_string_append_len(ctx->lines[j], text, sizeof(text));
+			ctx->sample_buf[j] = 0;
+		}
+	}
+}
+
+/*
+ * Process eight samples at once, starting at a byte boundary of the
+ * output lines. Transpose the data image's bytes such that each byte
+ * holds one channel's eight samples, the first sample in the MSB.
+ */
+static void process_eight_samples(struct context *ctx,
+	const uint8_t *samples, size_t unitsize)
+{
+	unsigned int j;
+	size_t col, s;
+	uint64_t rows;
+	uint8_t value;
+	int idx;
+	char text[3];
+
+	for (col = 0; col < ctx->num_columns; col++) {
+		rows = 0;
+		for (s = 0; s < 8; s++)
+			rows |= (uint64_t)samples[s * unitsize + col] << (8 * (7 - s));
+		rows = transpose_8x8(rows);
+		for (s = 0; s < 8; s++)
+			ctx->columns[col * 8 + s] = rows >> (8 * s);
+	}
+
+	text[2] = ' ';
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		idx = ctx->channel_index[j];
+		value = ctx->columns[idx];
+		text[0] = hex_digits[value >> 4];
+		text[1] = hex_digits[value & 0xf];
+		g_string_append_len(ctx->lines[j], text, sizeof(text));
+		ctx->sample_buf[j] = 0;
+	}
+	ctx->spl_cnt += 8;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -129,9 +224,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	int idx, pos, offset;
-	uint64_t i, j;
-	gchar *p;
+	const uint8_t *data;
+	uint64_t i, count;
+	gboolean fast;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -160,42 +255,24 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			*out = g_string_sized_new(512);
 
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
-			pos = ctx->spl_cnt & 7;
-			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				ctx->sample_buf[j] <<= 1;
-				if (*p & (1 << (idx % 8)))
-					ctx->sample_buf[j] |= 1;
-				if (ctx->spl_cnt && pos == 0) {
-					/* Buffered a byte's worth, output hex. */
-					g_string_append_printf(ctx->lines[j], "%.2x ",
-							ctx->sample_buf[j]);
-					ctx->sample_buf[j] = 0;
-				}
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per nibble,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger / 4 + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				}
+		data = logic->data;
+		count = logic->length / logic->unitsize;
+		fast = ctx->num_columns <= logic->unitsize;
+		for (i = 0; i < count; ) {
+			if (fast && (ctx->spl_cnt & 7) == 0 && count - i >= 8 &&
+					(ctx->spl <= 0 || ctx->spl_cnt + 8 <= ctx->spl)) {
+				process_eight_samples(ctx,
+					&data[i * logic->unitsize], logic->unitsize);
+				i += 8;
+			} else {
+				process_sample(ctx, &data[i * logic->unitsize]);
+				i++;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
+			if (ctx->spl_cnt == ctx->spl) {
+				/* Flush line buffers. */
+				flush_lines(ctx, *out);
 				ctx->spl_cnt = 0;
+			}
 		}
 		break;
 	case SR_DF_END:
@@ -229,6 +306,7 @@ static int cleanup(struct sr_output *o)
 
 	g_free(ctx->channel_index);
 	g_free(ctx->sample_buf);
+	g_free(ctx->columns);
 	g_free(ctx->channel_names);
 	for (i = 0; i < ctx->num_enabled_channels; i++)
 		g_string_free(ctx->lines[i], TRUE);
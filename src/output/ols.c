@@ -33,6 +33,9 @@
 
 #define LOG_PREFIX "output/ols"
 
+/* Longest decimal representation of a 64bit sample number. */
+#define MAX_NUM_DIGITS 20
+
 struct context {
 	uint64_t samplerate;
 	uint64_t num_samples;
@@ -52,6 +55,56 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Write the decimal representation of a number, returns its length. */
+static size_t format_decimal(char *p, uint64_t value)
+{
+	char digits[MAX_NUM_DIGITS];
+	size_t len, i;
+
+	len = 0;
+	do {
+		digits[len++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	for (i = 0; i < len; i++)
+		p[i] = digits[len - 1 - i];
+
+	return len;
+}
+
+/*
+ * Format "<hex>@<num>\n" lines straight into the output text, which
+ * gets sized for the packet's longest line before.
+ */
+static void append_samples(GString *out, struct context *ctx,
+	const uint8_t *data, size_t unitsize, size_t count)
+{
+	char digits[MAX_NUM_DIGITS];
+	size_t line_max, pos, i, j;
+	uint8_t c;
+	char *p;
+
+	line_max = 2 * unitsize + 1 + 1;
+	line_max += format_decimal(digits, ctx->num_samples + count);
+	pos = out->len;
+	g_string_set_size(out, pos + count * line_max);
+	p = out->str + pos;
+	for (i = 0; i < count; i++, data += unitsize) {
+		/* The OLS format wants the samples presented MSB first. */
+		for (j = unitsize; j; j--) {
+			c = data[j - 1];
+			*p++ = hex_digits[c >> 4];
+			*p++ = hex_digits[c & 0xf];
+		}
+		*p++ = '@';
+		p += format_decimal(p, ctx->num_samples++);
+		*p++ = '\n';
+	}
+	g_string_truncate(out, p - out->str);
+}
+
 static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
 {
 	struct sr_channel *ch;
@@ -94,8 +147,6 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
-	unsigned int i, j;
-	uint8_t c;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -118,14 +169,8 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			*out = gen_header(o->sdi, ctx);
 		} else
 			*out = g_string_sized_new(512);
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* The OLS format wants the samples presented MSB first. */
-				c = *((uint8_t *)logic->data + i + logic->unitsize - 1 - j);
-				g_string_append_printf(*out, "%02x", c);
-			}
-			g_string_append_printf(*out, "@%"PRIu64"\n", ctx->num_samples++);
-		}
+		append_samples(*out, ctx, logic->data, logic->unitsize,
+			logic->length / logic->unitsize);
 		break;
 	}
 
@@ -62,6 +62,9 @@ extern SR_PRIV struct sr_output_module output_ols;
 extern SR_PRIV struct sr_output_module output_chronovu_la8;
 extern SR_PRIV struct sr_output_module output_csv;
 extern SR_PRIV struct sr_output_module output_analog;
+extern SR_PRIV struct sr_output_module output_analog_binary;
+extern SR_PRIV struct sr_output_module output_arrow;
+extern SR_PRIV struct sr_output_module output_remote;
 extern SR_PRIV struct sr_output_module output_srzip;
 extern SR_PRIV struct sr_output_module output_wav;
 extern SR_PRIV struct sr_output_module output_wavedrom;
@@ -78,6 +81,9 @@ static const struct sr_output_module *output_module_list[] = {
 	&output_vcd,
 	&output_chronovu_la8,
 	&output_analog,
+	&output_analog_binary,
+	&output_arrow,
+	&output_remote,
 	&output_srzip,
 	&output_wav,
 	&output_wavedrom,
@@ -246,22 +252,10 @@ SR_API void sr_output_options_free(const struct sr_option **options)
 	g_free(options);
 }
 
-/**
- * Create a new output instance using the specified output module.
- *
- * <code>options</code> is a *HashTable with the keys corresponding with
- * the module options' <code>id</code> field. The values should be GVariant
- * pointers with sunk * references, of the same GVariantType as the option's
- * default value.
- *
- * The sr_dev_inst passed in can be used by the instance to determine
- * channel names, samplerate, and so on.
- *
- * @since 0.4.0
- */
-SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod,
+static const struct sr_output *output_new(const struct sr_output_module *omod,
 		GHashTable *options, const struct sr_dev_inst *sdi,
-		const char *filename)
+		const char *filename, uint64_t segment_start,
+		gboolean segment_continued)
 {
 	struct sr_output *op;
 	const struct sr_option *mod_opts;
@@ -275,6 +269,9 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	op->module = omod;
 	op->sdi = sdi;
 	op->filename = g_strdup(filename);
+	op->segment_start = segment_start;
+	op->segment_continued = segment_continued;
+	op->segment_align = 0;
 
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
@@ -325,17 +322,119 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	return op;
 }
 
+/**
+ * Create a new output instance using the specified output module.
+ *
+ * <code>options</code> is a *HashTable with the keys corresponding with
+ * the module options' <code>id</code> field. The values should be GVariant
+ * pointers with sunk * references, of the same GVariantType as the option's
+ * default value.
+ *
+ * The sr_dev_inst passed in can be used by the instance to determine
+ * channel names, samplerate, and so on.
+ *
+ * @since 0.4.0
+ */
+SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod,
+		GHashTable *options, const struct sr_dev_inst *sdi,
+		const char *filename)
+{
+	return output_new(omod, options, sdi, filename, 0, FALSE);
+}
+
+/**
+ * Create an output instance which converts a segment of a capture.
+ *
+ * The first sample the instance receives is sample number @a start of
+ * the capture. With @a continued set, the segment follows others and
+ * the instance omits the header. Check segment_align of the returned
+ * instance before relying on the output of segments to concatenate.
+ *
+ * @private
+ */
+SR_PRIV const struct sr_output *sr_output_new_segment(
+		const struct sr_output_module *omod, GHashTable *options,
+		const struct sr_dev_inst *sdi, uint64_t start, gboolean continued)
+{
+	return output_new(omod, options, sdi, NULL, start, continued);
+}
+
+/* Size of the chunks which run-length encoded data gets expanded into. */
+#define RLE_EXPAND_SIZE (256 * 1024)
+
+/*
+ * Feed run-length encoded logic data to a module which only understands
+ * plain SR_DF_LOGIC packets, in chunks of expanded samples. The text of
+ * all chunks gets collected into a single GString.
+ */
+static int output_send_expanded(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_packet expanded;
+	struct sr_datafeed_logic logic;
+	struct sr_logic_rle_pos pos;
+	GString *chunk;
+	uint64_t size;
+	int ret;
+
+	*out = NULL;
+	rle = packet->payload;
+	if (!rle || !rle->unitsize)
+		return SR_ERR_ARG;
+
+	size = sr_logic_rle_num_samples(rle) * rle->unitsize;
+	size = MIN(size, RLE_EXPAND_SIZE - RLE_EXPAND_SIZE % rle->unitsize);
+	if (!size)
+		return SR_OK;
+	logic.unitsize = rle->unitsize;
+	logic.data = g_try_malloc(size);
+	if (!logic.data) {
+		sr_err("Cannot allocate buffer to expand run-length data.");
+		return SR_ERR_MALLOC;
+	}
+	expanded.type = SR_DF_LOGIC;
+	expanded.payload = &logic;
+
+	ret = SR_OK;
+	memset(&pos, 0, sizeof(pos));
+	while ((logic.length = sr_logic_rle_expand(rle, &pos,
+			logic.data, size))) {
+		chunk = NULL;
+		ret = o->module->receive(o, &expanded, &chunk);
+		if (chunk && *out) {
+			g_string_append_len(*out, chunk->str, chunk->len);
+			g_string_free(chunk, TRUE);
+		} else if (chunk) {
+			*out = chunk;
+		}
+		if (ret != SR_OK)
+			break;
+	}
+	g_free(logic.data);
+
+	return ret;
+}
+
 /**
  * Send a packet to the specified output instance.
  *
  * The instance's output is returned as a newly allocated GString,
  * which must be freed by the caller.
  *
+ * SR_DF_LOGIC_RLE packets are expanded to SR_DF_LOGIC for modules which
+ * lack the SR_OUTPUT_LOGIC_RLE flag, so callers may pass them to any
+ * output module.
+ *
  * @since 0.4.0
  */
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
+	if (packet->type == SR_DF_LOGIC_RLE &&
+			!(o->module->flags & SR_OUTPUT_LOGIC_RLE))
+		return output_send_expanded(o, packet, out);
+
 	return o->module->receive(o, packet, out);
 }
 
@@ -360,4 +459,403 @@ SR_API int sr_output_free(const struct sr_output *o)
 	return ret;
 }
 
+/** @cond PRIVATE */
+struct pipeline_job {
+	const struct sr_output *output;
+	const struct sr_datafeed_packet *packet;
+	GString **out;
+	gboolean active;
+	int ret;
+};
+
+struct sr_output_pipeline {
+	GPtrArray *outputs;
+	struct pipeline_job *jobs;
+	GThreadPool *pool;
+	GMutex lock;
+	GCond done;
+	unsigned int pending;
+	/* Analog data which got converted once for all outputs. */
+	float *fdata;
+	size_t fdata_size;
+};
+/** @endcond */
+
+/* Which of the pipeline's outputs a packet gets passed to. */
+enum pipeline_select {
+	PIPELINE_ALL,
+	PIPELINE_RLE,
+	PIPELINE_PLAIN,
+	PIPELINE_ANALOG_RAW,
+	PIPELINE_ANALOG_FLOAT,
+};
+
+static gboolean pipeline_selects(const struct sr_output *o,
+		enum pipeline_select select)
+{
+	switch (select) {
+	case PIPELINE_RLE:
+		return (o->module->flags & SR_OUTPUT_LOGIC_RLE) != 0;
+	case PIPELINE_PLAIN:
+		return (o->module->flags & SR_OUTPUT_LOGIC_RLE) == 0;
+	case PIPELINE_ANALOG_RAW:
+		return (o->module->flags & SR_OUTPUT_ANALOG_RAW) != 0;
+	case PIPELINE_ANALOG_FLOAT:
+		return (o->module->flags & SR_OUTPUT_ANALOG_RAW) == 0;
+	default:
+		return TRUE;
+	}
+}
+
+static void pipeline_job_run(struct pipeline_job *job)
+{
+	GString *chunk;
+
+	chunk = NULL;
+	job->ret = job->output->module->receive(job->output, job->packet, &chunk);
+	if (chunk && *job->out) {
+		g_string_append_len(*job->out, chunk->str, chunk->len);
+		g_string_free(chunk, TRUE);
+	} else if (chunk) {
+		*job->out = chunk;
+	}
+}
+
+static void pipeline_job_thread(gpointer data, gpointer user_data)
+{
+	struct sr_output_pipeline *pipeline;
+
+	pipeline = user_data;
+	pipeline_job_run(data);
+
+	g_mutex_lock(&pipeline->lock);
+	if (!--pipeline->pending)
+		g_cond_signal(&pipeline->done);
+	g_mutex_unlock(&pipeline->lock);
+}
+
+/*
+ * Pass one packet to the selected outputs. Each output runs on a pool
+ * thread, except for the last one which the caller's thread handles.
+ * Returns when all outputs are done with the packet, so that every
+ * output still sees its packets in order and one at a time.
+ */
+static int pipeline_run(struct sr_output_pipeline *pipeline,
+		const struct sr_datafeed_packet *packet,
+		enum pipeline_select select, GString **out)
+{
+	const struct sr_output *o;
+	struct pipeline_job *job, *last;
+	unsigned int i;
+	int ret;
+
+	last = NULL;
+	for (i = 0; i < pipeline->outputs->len; i++) {
+		o = g_ptr_array_index(pipeline->outputs, i);
+		job = &pipeline->jobs[i];
+		job->active = pipeline_selects(o, select);
+		if (!job->active)
+			continue;
+		job->packet = packet;
+		job->out = &out[i];
+		job->ret = SR_OK;
+		if (!last) {
+			last = job;
+			continue;
+		}
+		g_mutex_lock(&pipeline->lock);
+		pipeline->pending++;
+		g_mutex_unlock(&pipeline->lock);
+		if (!pipeline->pool || !g_thread_pool_push(pipeline->pool, last, NULL)) {
+			g_mutex_lock(&pipeline->lock);
+			pipeline->pending--;
+			g_mutex_unlock(&pipeline->lock);
+			pipeline_job_run(last);
+		}
+		last = job;
+	}
+	if (!last)
+		return SR_OK;
+	pipeline_job_run(last);
+
+	g_mutex_lock(&pipeline->lock);
+	while (pipeline->pending)
+		g_cond_wait(&pipeline->done, &pipeline->lock);
+	g_mutex_unlock(&pipeline->lock);
+
+	ret = SR_OK;
+	for (i = 0; i < pipeline->outputs->len && ret == SR_OK; i++) {
+		job = &pipeline->jobs[i];
+		if (job->active)
+			ret = job->ret;
+	}
+
+	return ret;
+}
+
+/*
+ * Expand run-length encoded logic data once, and pass the chunks
+ * of plain samples to all outputs which need them.
+ */
+static int pipeline_run_expanded(struct sr_output_pipeline *pipeline,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_packet expanded;
+	struct sr_datafeed_logic logic;
+	struct sr_logic_rle_pos pos;
+	uint64_t size;
+	int ret;
+
+	rle = packet->payload;
+	if (!rle || !rle->unitsize)
+		return SR_ERR_ARG;
+
+	size = sr_logic_rle_num_samples(rle) * rle->unitsize;
+	size = MIN(size, RLE_EXPAND_SIZE - RLE_EXPAND_SIZE % rle->unitsize);
+	if (!size)
+		return SR_OK;
+	logic.unitsize = rle->unitsize;
+	logic.data = g_try_malloc(size);
+	if (!logic.data) {
+		sr_err("Cannot allocate buffer to expand run-length data.");
+		return SR_ERR_MALLOC;
+	}
+	expanded.type = SR_DF_LOGIC;
+	expanded.payload = &logic;
+
+	ret = SR_OK;
+	memset(&pos, 0, sizeof(pos));
+	while ((logic.length = sr_logic_rle_expand(rle, &pos,
+			logic.data, size))) {
+		ret = pipeline_run(pipeline, &expanded, PIPELINE_PLAIN, out);
+		if (ret != SR_OK)
+			break;
+	}
+	g_free(logic.data);
+
+	return ret;
+}
+
+/*
+ * Convert analog data to native floats once, so that the outputs
+ * can use the values in place. Outputs which use the original
+ * encoding get the packet as it is.
+ */
+static int pipeline_run_analog(struct sr_output_pipeline *pipeline,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	const struct sr_datafeed_analog *analog;
+	struct sr_datafeed_analog converted;
+	struct sr_analog_encoding encoding;
+	struct sr_datafeed_packet native;
+	size_t count;
+	float *fdata;
+	const float *values;
+	int ret;
+
+	analog = packet->payload;
+	if (!analog || !analog->encoding || !analog->meaning)
+		return SR_ERR_ARG;
+
+	count = analog->num_samples * g_slist_length(analog->meaning->channels);
+	if (!count)
+		return pipeline_run(pipeline, packet, PIPELINE_ALL, out);
+	ret = pipeline_run(pipeline, packet, PIPELINE_ANALOG_RAW, out);
+	if (ret != SR_OK)
+		return ret;
+	if (count > pipeline->fdata_size) {
+		fdata = g_try_realloc(pipeline->fdata, count * sizeof(float));
+		if (!fdata) {
+			sr_err("Cannot allocate analog conversion buffer.");
+			return SR_ERR_MALLOC;
+		}
+		pipeline->fdata = fdata;
+		pipeline->fdata_size = count;
+	}
+	ret = sr_analog_to_float_view(analog, pipeline->fdata, &values);
+	if (ret != SR_OK)
+		return ret;
+
+	encoding = *analog->encoding;
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#else
+	encoding.is_bigendian = FALSE;
+#endif
+	encoding.scale.p = 1;
+	encoding.scale.q = 1;
+	encoding.offset.p = 0;
+	encoding.offset.q = 1;
+
+	converted = *analog;
+	converted.data = (void *)values;
+	converted.encoding = &encoding;
+	native.type = SR_DF_ANALOG;
+	native.payload = &converted;
+
+	return pipeline_run(pipeline, &native, PIPELINE_ANALOG_FLOAT, out);
+}
+
+/**
+ * Create a new output pipeline.
+ *
+ * A pipeline passes each packet to several output instances at once,
+ * for example to write CSV, VCD, and srzip files of one acquisition.
+ * Work which all outputs would repeat on their own is done once per
+ * packet: run-length encoded logic data gets expanded once, analog
+ * data gets converted to floats once for the outputs which lack the
+ * SR_OUTPUT_ANALOG_RAW flag. The outputs then process the packet in
+ * parallel, each on its own thread.
+ *
+ * @return A new pipeline, to be freed with sr_output_pipeline_free().
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_output_pipeline *sr_output_pipeline_new(void)
+{
+	struct sr_output_pipeline *pipeline;
+
+	pipeline = g_malloc0(sizeof(*pipeline));
+	pipeline->outputs = g_ptr_array_new();
+	g_mutex_init(&pipeline->lock);
+	g_cond_init(&pipeline->done);
+
+	return pipeline;
+}
+
+/**
+ * Add an output instance to a pipeline.
+ *
+ * The pipeline does not take ownership, the caller must free the
+ * output instance after the pipeline. The output's text is returned
+ * by sr_output_pipeline_send() at the index in the order of addition.
+ *
+ * @param pipeline The pipeline. Must not be NULL.
+ * @param o The output instance to add. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_pipeline_add(struct sr_output_pipeline *pipeline,
+		const struct sr_output *o)
+{
+	struct pipeline_job *job;
+
+	if (!pipeline || !o)
+		return SR_ERR_ARG;
+
+	g_ptr_array_add(pipeline->outputs, (gpointer)o);
+	pipeline->jobs = g_realloc_n(pipeline->jobs,
+		pipeline->outputs->len, sizeof(pipeline->jobs[0]));
+	job = &pipeline->jobs[pipeline->outputs->len - 1];
+	memset(job, 0, sizeof(*job));
+	job->output = o;
+
+	/* The caller's thread handles one of the outputs. */
+	if (pipeline->outputs->len < 2)
+		return SR_OK;
+	if (!pipeline->pool) {
+		pipeline->pool = g_thread_pool_new(pipeline_job_thread,
+			pipeline, 1, FALSE, NULL);
+		if (!pipeline->pool)
+			sr_warn("Cannot create threads, running outputs in turn.");
+	} else {
+		g_thread_pool_set_max_threads(pipeline->pool,
+			pipeline->outputs->len - 1, NULL);
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Send a packet to all output instances of a pipeline.
+ *
+ * Each output's text is returned as a newly allocated GString, which
+ * must be freed by the caller. Outputs which have nothing to emit for
+ * this packet get NULL.
+ *
+ * @param pipeline The pipeline. Must not be NULL.
+ * @param packet The packet to send. Must not be NULL.
+ * @param out Array which receives one GString pointer per output, in
+ *            the order in which they were added. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval other The first error which an output returned.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_pipeline_send(struct sr_output_pipeline *pipeline,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	const struct sr_output *o;
+	gboolean plain_only, rle_only;
+	unsigned int i, num_float;
+	int ret;
+
+	if (!pipeline || !packet || !out)
+		return SR_ERR_ARG;
+
+	plain_only = rle_only = TRUE;
+	num_float = 0;
+	for (i = 0; i < pipeline->outputs->len; i++) {
+		out[i] = NULL;
+		o = g_ptr_array_index(pipeline->outputs, i);
+		if (o->module->flags & SR_OUTPUT_LOGIC_RLE)
+			plain_only = FALSE;
+		else
+			rle_only = FALSE;
+		if (!(o->module->flags & SR_OUTPUT_ANALOG_RAW))
+			num_float++;
+	}
+
+	switch (packet->type) {
+	case SR_DF_LOGIC_RLE:
+		if (rle_only)
+			break;
+		ret = SR_OK;
+		if (!plain_only)
+			ret = pipeline_run(pipeline, packet, PIPELINE_RLE, out);
+		if (ret != SR_OK)
+			return ret;
+		return pipeline_run_expanded(pipeline, packet, out);
+	case SR_DF_ANALOG:
+		/* A single output converts the data just as well by itself. */
+		if (num_float > 1)
+			return pipeline_run_analog(pipeline, packet, out);
+		break;
+	}
+
+	return pipeline_run(pipeline, packet, PIPELINE_ALL, out);
+}
+
+/**
+ * Free an output pipeline.
+ *
+ * The output instances which were added to it are not freed.
+ *
+ * @param pipeline The pipeline to free.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_output_pipeline_free(struct sr_output_pipeline *pipeline)
+{
+	if (!pipeline)
+		return;
+
+	if (pipeline->pool)
+		g_thread_pool_free(pipeline->pool, FALSE, TRUE);
+	g_mutex_clear(&pipeline->lock);
+	g_cond_clear(&pipeline->done);
+	g_ptr_array_free(pipeline->outputs, TRUE);
+	g_free(pipeline->jobs);
+	g_free(pipeline->fdata);
+	g_free(pipeline);
+}
+
 /** @} */
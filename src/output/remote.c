@@ -0,0 +1,594 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Remote capture stream, which the "remote" driver replays as a live
+ * device on another machine. With the "listen" option the module waits
+ * for a client to connect, and sends the stream over TCP itself. Else
+ * the stream is the module's output, e.g. for piping it through ssh.
+ * With the "shm" option it goes to a shared memory ring of that name
+ * instead, for a reader process on the same host. Logic samples then
+ * get copied into the ring once, and the reader sends them on from
+ * there.
+ *
+ * All numbers are stored in little endian byte order. The stream starts
+ * with the 8 bytes magic "SRREMOTE" and a u8 format version (1). Then a
+ * sequence of records follows, each of which starts with a u8 record
+ * type, u8 flags and the u32 length of the payload:
+ *
+ *   DEVICE       u16 number of channels, then for each of them:
+ *                  u16 index, u8 type (0 logic, 1 analog), u8 enabled,
+ *                  u8 length of the name, followed by the name
+ *   HEADER       i64 start time seconds, i64 microseconds
+ *   META         u16 number of keys, then for each of them: u32 key,
+ *                  u8 length of the GVariant type string, the type
+ *                  string, u32 length of the serialized value (in
+ *                  little endian), the value
+ *   LOGIC        u8 unitsize, then the samples
+ *   ANALOG       u16 channel index, u32 mq, u32 unit, u64 mqflags,
+ *                  i8 digits, u32 number of samples, then the samples
+ *                  as float
+ *   TRIGGER, FRAME_BEGIN, FRAME_END, END   no payload
+ *
+ * The DEVICE record comes first. With flag bit 0 set, the payload is
+ * the u32 length of the uncompressed payload, followed by its LZO1X
+ * compressed form. Only sample records get compressed, and only when
+ * that makes them smaller.
+ */
+
+#include <config.h>
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#endif
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "minilzo/minilzo.h"
+
+#define LOG_PREFIX "output/remote"
+
+/* Smaller sample records don't get compressed. */
+#define COMPRESS_MIN_SIZE 256
+
+struct context {
+	int socket;
+	struct sr_shm_ring *ring;
+	gboolean header_done;
+	gboolean compress;
+	/* LZO work memory and output. */
+	lzo_voidp wrkmem;
+	uint8_t *cbuf;
+	size_t cbuf_size;
+	/* Payload of the record being built. */
+	GByteArray *payload;
+	float *fbuf;
+	size_t fbuf_size;
+};
+
+/* Split "host:port", the host may be empty. */
+static int parse_listen(const char *spec, char **host, char **port)
+{
+	const char *colon;
+
+	if (!(colon = strrchr(spec, ':')) || !colon[1]) {
+		sr_err("Invalid listen address '%s', use host:port.", spec);
+		return SR_ERR_ARG;
+	}
+	*host = colon > spec ? g_strndup(spec, colon - spec) : NULL;
+	*port = g_strdup(colon + 1);
+
+	return SR_OK;
+}
+
+/* Wait for a client on the listen address. */
+static int accept_client(const char *spec)
+{
+	struct addrinfo hints, *results, *res;
+	char *host, *port;
+	int lsock, sock, one, err;
+
+	if (parse_listen(spec, &host, &port) != SR_OK)
+		return -1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_PASSIVE;
+	err = getaddrinfo(host, port, &hints, &results);
+	if (err) {
+		sr_err("Address lookup failed: %s: %s", spec, gai_strerror(err));
+		g_free(host);
+		g_free(port);
+		return -1;
+	}
+
+	lsock = -1;
+	for (res = results; res; res = res->ai_next) {
+		lsock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (lsock < 0)
+			continue;
+		one = 1;
+		setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR,
+			(const void *)&one, sizeof(one));
+		if (bind(lsock, res->ai_addr, res->ai_addrlen) == 0
+				&& listen(lsock, 1) == 0)
+			break;
+		close(lsock);
+		lsock = -1;
+	}
+	freeaddrinfo(results);
+	g_free(host);
+	g_free(port);
+	if (lsock < 0) {
+		sr_err("Cannot listen on %s: %s", spec, g_strerror(errno));
+		return -1;
+	}
+
+	sr_info("Waiting for a client on %s.", spec);
+	sock = accept(lsock, NULL, NULL);
+	close(lsock);
+	if (sock < 0) {
+		sr_err("Cannot accept client: %s", g_strerror(errno));
+		return -1;
+	}
+	/* Records are complete messages, don't hold them back. */
+	one = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+		(const void *)&one, sizeof(one));
+	sr_info("Client connected.");
+
+	return sock;
+}
+
+static int send_all(int sock, const uint8_t *data, size_t len)
+{
+	int flags, ret;
+
+	flags = 0;
+#ifdef MSG_NOSIGNAL
+	/* A vanished client is an error, not a reason to terminate. */
+	flags |= MSG_NOSIGNAL;
+#endif
+	while (len) {
+		ret = send(sock, (const void *)data, len, flags);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			sr_err("Cannot send to client: %s", g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/* Write a logic record straight into the ring. */
+static int write_logic_shm(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	uint8_t *dst;
+	size_t len;
+
+	len = 1 + logic->length;
+	dst = sr_shm_ring_reserve(ctx->ring, SR_REMOTE_RECORD_HEADER_SIZE + len);
+	if (!dst)
+		return SR_ERR_IO;
+	write_u8(&dst[0], SR_REMOTE_LOGIC);
+	write_u8(&dst[1], 0);
+	write_u32le(&dst[2], len);
+	write_u8(&dst[6], logic->unitsize);
+	memcpy(&dst[7], logic->data, logic->length);
+	sr_shm_ring_commit(ctx->ring, SR_REMOTE_RECORD_HEADER_SIZE + len);
+
+	return SR_OK;
+}
+
+/* Append the record in ctx->payload to the stream. */
+static void append_record(struct context *ctx, GString *out, int type)
+{
+	uint8_t hdr[SR_REMOTE_RECORD_HEADER_SIZE];
+	const uint8_t *data;
+	size_t len, need;
+	lzo_uint clen;
+	uint8_t flags;
+
+	data = ctx->payload->data;
+	len = ctx->payload->len;
+	flags = 0;
+
+	if (ctx->compress && len >= COMPRESS_MIN_SIZE
+			&& (type == SR_REMOTE_LOGIC || type == SR_REMOTE_ANALOG)) {
+		/* The LZO worst case expansion, plus the length. */
+		need = 4 + len + len / 16 + 64 + 3;
+		if (need > ctx->cbuf_size) {
+			g_free(ctx->cbuf);
+			ctx->cbuf = g_malloc(need);
+			ctx->cbuf_size = need;
+		}
+		clen = 0;
+		if (lzo1x_1_compress(data, len, ctx->cbuf + 4, &clen,
+				ctx->wrkmem) == LZO_E_OK && 4 + clen < len) {
+			write_u32le(ctx->cbuf, len);
+			data = ctx->cbuf;
+			len = 4 + clen;
+			flags |= SR_REMOTE_FLAG_LZO;
+		}
+	}
+
+	write_u8(&hdr[0], type);
+	write_u8(&hdr[1], flags);
+	write_u32le(&hdr[2], len);
+	g_string_append_len(out, (const char *)hdr, sizeof(hdr));
+	g_string_append_len(out, (const char *)data, len);
+	g_byte_array_set_size(ctx->payload, 0);
+}
+
+static void payload_append(struct context *ctx, const void *data, size_t len)
+{
+	g_byte_array_append(ctx->payload, data, len);
+}
+
+static void payload_u8(struct context *ctx, uint8_t v)
+{
+	payload_append(ctx, &v, 1);
+}
+
+static void payload_u16(struct context *ctx, uint16_t v)
+{
+	uint8_t buf[2];
+
+	write_u16le(buf, v);
+	payload_append(ctx, buf, sizeof(buf));
+}
+
+static void payload_u32(struct context *ctx, uint32_t v)
+{
+	uint8_t buf[4];
+
+	write_u32le(buf, v);
+	payload_append(ctx, buf, sizeof(buf));
+}
+
+static void payload_u64(struct context *ctx, uint64_t v)
+{
+	uint8_t buf[8];
+
+	write_u64le(buf, v);
+	payload_append(ctx, buf, sizeof(buf));
+}
+
+static void append_device(const struct sr_output *o, GString *out)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GSList *l;
+	size_t len;
+
+	ctx = o->priv;
+
+	g_string_append_len(out, SR_REMOTE_MAGIC, strlen(SR_REMOTE_MAGIC));
+	g_string_append_c(out, SR_REMOTE_VERSION);
+
+	payload_u16(ctx, g_slist_length(o->sdi->channels));
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		len = MIN(strlen(ch->name), 255);
+		payload_u16(ctx, ch->index);
+		payload_u8(ctx, ch->type == SR_CHANNEL_ANALOG ? 1 : 0);
+		payload_u8(ctx, ch->enabled ? 1 : 0);
+		payload_u8(ctx, len);
+		payload_append(ctx, ch->name, len);
+	}
+	append_record(ctx, out, SR_REMOTE_DEVICE);
+}
+
+static void append_meta(struct context *ctx, GString *out,
+		const struct sr_datafeed_meta *meta)
+{
+	struct sr_config *src;
+	GVariant *value, *tmp;
+	const char *type;
+	GSList *l;
+	size_t len;
+
+	payload_u16(ctx, g_slist_length(meta->config));
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		value = g_variant_get_normal_form(src->data);
+		if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+			tmp = g_variant_byteswap(value);
+			g_variant_unref(value);
+			value = tmp;
+		}
+		type = g_variant_get_type_string(value);
+		len = strlen(type);
+		payload_u32(ctx, src->key);
+		payload_u8(ctx, len);
+		payload_append(ctx, type, len);
+		payload_u32(ctx, g_variant_get_size(value));
+		payload_append(ctx, g_variant_get_data(value),
+			g_variant_get_size(value));
+		g_variant_unref(value);
+	}
+	append_record(ctx, out, SR_REMOTE_META);
+}
+
+static int append_analog(struct context *ctx, GString *out,
+		const struct sr_datafeed_analog *analog)
+{
+	struct sr_channel *ch;
+	const float *values;
+	GSList *l;
+	uint32_t i, count, num_channels, c;
+	uint8_t buf[4];
+	int ret;
+
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (!num_channels)
+		return SR_OK;
+	count = analog->num_samples;
+	if ((size_t)count * num_channels > ctx->fbuf_size) {
+		g_free(ctx->fbuf);
+		ctx->fbuf_size = (size_t)count * num_channels;
+		ctx->fbuf = g_malloc(ctx->fbuf_size * sizeof(float));
+	}
+	if ((ret = sr_analog_to_float_view(analog, ctx->fbuf, &values)) != SR_OK)
+		return ret;
+
+	/* Interleaved multi-channel packets get one record per channel. */
+	for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
+		ch = l->data;
+		payload_u16(ctx, ch->index);
+		payload_u32(ctx, analog->meaning->mq);
+		payload_u32(ctx, analog->meaning->unit);
+		payload_u64(ctx, analog->meaning->mqflags);
+		payload_u8(ctx, (uint8_t)analog->encoding->digits);
+		payload_u32(ctx, count);
+		for (i = 0; i < count; i++) {
+			write_fltle(buf, values[i * num_channels + c]);
+			payload_append(ctx, buf, sizeof(buf));
+		}
+		append_record(ctx, out, SR_REMOTE_ANALOG);
+	}
+
+	return SR_OK;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	const char *listen_spec, *shm_name;
+	uint32_t shm_size;
+	GString *start;
+	int ret;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	o->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->socket = -1;
+	ctx->payload = g_byte_array_new();
+	ctx->compress = g_variant_get_boolean(
+		g_hash_table_lookup(options, "compress"));
+	if (ctx->compress)
+		ctx->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+
+	listen_spec = g_variant_get_string(
+		g_hash_table_lookup(options, "listen"), NULL);
+	shm_name = g_variant_get_string(
+		g_hash_table_lookup(options, "shm"), NULL);
+	shm_size = g_variant_get_uint32(
+		g_hash_table_lookup(options, "shmsize"));
+	if (*listen_spec && *shm_name) {
+		sr_err("Cannot both listen and write to shared memory.");
+		ret = SR_ERR_ARG;
+		goto err_free;
+	}
+
+	if (*shm_name) {
+		ctx->ring = sr_shm_ring_create(shm_name,
+			(size_t)shm_size * 1024 * 1024);
+		if (!ctx->ring) {
+			ret = SR_ERR_IO;
+			goto err_free;
+		}
+		/* Readers learn about the channels while scanning. */
+		start = g_string_sized_new(256);
+		append_device(o, start);
+		ctx->header_done = TRUE;
+		ret = sr_shm_ring_write(ctx->ring, (const uint8_t *)start->str,
+			start->len);
+		g_string_free(start, TRUE);
+		if (ret != SR_OK) {
+			sr_shm_ring_free(ctx->ring);
+			goto err_free;
+		}
+	} else if (*listen_spec) {
+		if ((ctx->socket = accept_client(listen_spec)) < 0) {
+			ret = SR_ERR_IO;
+			goto err_free;
+		}
+		/* Clients learn about the channels while scanning. */
+		start = g_string_sized_new(256);
+		append_device(o, start);
+		ctx->header_done = TRUE;
+		ret = send_all(ctx->socket, (const uint8_t *)start->str,
+			start->len);
+		g_string_free(start, TRUE);
+		if (ret != SR_OK) {
+			close(ctx->socket);
+			ctx->socket = -1;
+		}
+	}
+
+	return SR_OK;
+
+err_free:
+	g_byte_array_free(ctx->payload, TRUE);
+	g_free(ctx->wrkmem);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return ret;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_header *header;
+	const struct sr_datafeed_logic *logic;
+	GString *s;
+	int ret;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	s = g_string_sized_new(512);
+	if (!ctx->header_done) {
+		append_device(o, s);
+		ctx->header_done = TRUE;
+	}
+
+	ret = SR_OK;
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		header = packet->payload;
+		payload_u64(ctx, header->starttime.tv_sec);
+		payload_u64(ctx, header->starttime.tv_usec);
+		append_record(ctx, s, SR_REMOTE_HEADER);
+		break;
+	case SR_DF_META:
+		append_meta(ctx, s, packet->payload);
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (ctx->ring && !ctx->compress) {
+			ret = write_logic_shm(ctx, logic);
+			break;
+		}
+		payload_u8(ctx, logic->unitsize);
+		payload_append(ctx, logic->data, logic->length);
+		append_record(ctx, s, SR_REMOTE_LOGIC);
+		break;
+	case SR_DF_ANALOG:
+		ret = append_analog(ctx, s, packet->payload);
+		break;
+	case SR_DF_TRIGGER:
+		append_record(ctx, s, SR_REMOTE_TRIGGER);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		append_record(ctx, s, SR_REMOTE_FRAME_BEGIN);
+		break;
+	case SR_DF_FRAME_END:
+		append_record(ctx, s, SR_REMOTE_FRAME_END);
+		break;
+	case SR_DF_END:
+		append_record(ctx, s, SR_REMOTE_END);
+		break;
+	default:
+		break;
+	}
+
+	if (ctx->ring) {
+		if (ret == SR_OK && s->len)
+			ret = sr_shm_ring_write(ctx->ring, (const uint8_t *)s->str,
+				s->len);
+		g_string_free(s, TRUE);
+		return ret;
+	}
+	if (ctx->socket >= 0) {
+		if (ret == SR_OK && s->len)
+			ret = send_all(ctx->socket, (const uint8_t *)s->str, s->len);
+		g_string_free(s, TRUE);
+		return ret;
+	}
+	if (s->len)
+		*out = s;
+	else
+		g_string_free(s, TRUE);
+
+	return ret;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+	ctx = o->priv;
+
+	if (ctx->socket >= 0)
+		close(ctx->socket);
+	sr_shm_ring_free(ctx->ring);
+	g_byte_array_free(ctx->payload, TRUE);
+	g_free(ctx->wrkmem);
+	g_free(ctx->cbuf);
+	g_free(ctx->fbuf);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "listen", "Listen", "Wait for a client on host:port and stream to it, instead of writing the stream out", NULL, NULL },
+	{ "compress", "Compress", "Compress sample data with LZO", NULL, NULL },
+	{ "shm", "Shared memory", "Name of a shared memory ring to write the stream to, like /sigrok", NULL, NULL },
+	{ "shmsize", "Shared memory size", "Size of the shared memory ring in MiB, a power of two", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[2].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[3].def = g_variant_ref_sink(g_variant_new_uint32(64));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_output_module output_remote = {
+	.id = "remote",
+	.name = "Remote",
+	.desc = "Live datafeed stream for the remote driver",
+	.exts = NULL,
+	.flags = 0,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
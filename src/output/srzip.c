@@ -18,43 +18,1043 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
+#include <stdio.h>
 #include <glib.h>
-#include <glib/gstdio.h>
-#include <zip.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "output/srzip"
 #define CHUNK_SIZE (4 * 1024 * 1024)
 
+/*
+ * Summaries of the capture at decreasing resolution, which let viewers
+ * zoom out without reading all samples. Level 0 has an entry for every
+ * SUMMARY_BASE samples, each further level combines SUMMARY_FANOUT
+ * entries of the level below. Analog entries hold the minimum and the
+ * maximum value, logic entries the first sample of the block and each
+ * channel's number of transitions. Level 0 gets collected while chunks
+ * are written, the other levels get derived from it in zip_finish().
+ */
+#define SUMMARY_BASE (16 * 1024)
+#define SUMMARY_FANOUT 16
+#define LOGIC_SUMMARY_SIZE(unitsize) ((unitsize) * (1 + 8 * sizeof(uint32_t)))
+#define ANALOG_SUMMARY_SIZE (2 * sizeof(float))
+
+/*
+ * The edge index has a bitmap of the logic channels which change in
+ * each chunk, unit size bytes per chunk, in the order of the chunks.
+ * Changes from the last sample of the previous chunk count as well.
+ * Readers use it to skip chunks without activity on the channels of
+ * interest.
+ */
+
+struct logic_summary {
+	GByteArray *entries;
+	uint64_t fill;
+	uint8_t *first;
+	/* The last sample seen, transitions into a block count in it. */
+	uint8_t *prev;
+	gboolean started;
+	uint32_t *counts;
+	/* The channels which changed in the chunk, and the edge index. */
+	uint8_t *changed;
+	GByteArray *edges;
+};
+
+struct analog_summary {
+	GByteArray *entries;
+	uint64_t fill;
+	float min, max;
+};
+
+struct zip_writer;
+
 struct out_context {
 	gboolean zip_created;
 	uint64_t samplerate;
 	char *filename;
+	unsigned int threads;
+	/* Compression of sample data chunks, -1 is the codec's default. */
+	uint16_t method;
+	int level;
+	unsigned int align;
+	gboolean zip64;
+	gboolean index;
+	/*
+	 * Start a new archive when the current one reaches the size (in
+	 * bytes) or the age (in seconds), zero disables either. Archives
+	 * are numbered from 1, and know their first sample's number.
+	 */
+	uint64_t rotate_size;
+	uint64_t rotate_time;
+	unsigned int sequence;
+	gint64 open_time;
+	uint64_t start_sample;
+	size_t logic_ch_count;
+	gboolean have_logic;
 	size_t first_analog_index;
 	size_t analog_ch_count;
 	gint *analog_index_map;
+	/* The archive which is being written, and its pending metadata. */
+	struct zip_writer *writer;
+	GKeyFile *meta;
 	struct logic_buff {
 		size_t unit_size;
 		size_t alloc_size;
 		uint8_t *samples;
 		size_t fill_size;
+		unsigned int chunk_num;
+		struct logic_summary summary;
 	} logic_buff;
 	struct analog_buff {
 		size_t alloc_size;
 		float *samples;
 		size_t fill_size;
+		unsigned int chunk_num;
+		struct analog_summary summary;
 	} *analog_buff;
+	/* Samples written to archives, of logic data or the first analog channel. */
+	uint64_t samples_written;
 };
 
-static int init(struct sr_output *o, GHashTable *options)
+/*
+ * Sequential ZIP archive writer. Entries get written one after another,
+ * the central directory gets written once when the archive is closed.
+ * Unlike updates of an archive via libzip, the cost of adding a chunk
+ * does not depend on how many chunks were written before. Entries get
+ * deflated when zlib is available, and stored otherwise (or when
+ * compression doesn't pay off). ZIP64 records are used when archives
+ * grow beyond the limits of the original format, or when requested.
+ *
+ * Until the central directory is written, readers cannot open the
+ * archive. This happens on SR_DF_END, and when the output gets released
+ * without one after an aborted acquisition. An archive which is still
+ * open when the process dies loses its samples (with rotation, only
+ * the current file does), zip repair tools can recover them from the
+ * entries' local headers.
+ */
+
+#define ZIP_LOCAL_HEADER_SIG	0x04034b50
+#define ZIP_CENTRAL_HEADER_SIG	0x02014b50
+#define ZIP_END_SIG		0x06054b50
+#define ZIP64_END_SIG		0x06064b50
+#define ZIP64_LOCATOR_SIG	0x07064b50
+#define ZIP_METHOD_STORE	0
+#define ZIP_METHOD_DEFLATE	8
+#define ZIP_METHOD_ZSTD		93
+#define ZIP_VERSION_DEFAULT	20
+#define ZIP_VERSION_ZIP64	45
+#define ZIP_VERSION_ZSTD	63
+/* Extra field which pads stored data, as used by Android's zipalign. */
+#define ZIP_EXTRA_ALIGNMENT	0xd935
+
+struct zip_writer_entry {
+	char *name;
+	uint64_t offset;
+	uint32_t crc;
+	uint32_t comp_size;
+	uint32_t size;
+	uint16_t method;
+};
+
+/*
+ * An entry on its way into the archive. Compression workers fill in
+ * the CRC and the compressed data, entries get written in the order
+ * of their submission.
+ */
+struct zip_writer_job {
+	char *name;
+	uint8_t *data;
+	size_t size;
+	uint16_t method;
+	int level;
+	uint32_t crc;
+	uint8_t *comp_buf;
+	size_t comp_buf_size;
+	size_t comp_size;
+	gboolean done;
+};
+
+struct zip_writer {
+	/* Writes in the background, compression and I/O overlap. */
+	struct sr_file_writer *out;
+	uint64_t offset;
+	uint16_t dos_time, dos_date;
+	GArray *entries;
+	uint8_t *comp_buf;
+	size_t comp_buf_size;
+	/* Background compression, entries compress inline without. */
+	GThreadPool *pool;
+	GQueue *jobs;
+	guint max_jobs;
+	GMutex mutex;
+	GCond cond;
+	int status;
+	/* Alignment of stored entries' data in the file, 0 for none. */
+	unsigned int align;
+	/* Write ZIP64 records even when the archive doesn't need them. */
+	gboolean zip64;
+};
+
+#ifndef HAVE_ZLIB
+static uint32_t crc_table[256];
+
+static void crc_table_init(void)
+{
+	static gsize initialized = 0;
+	uint32_t c;
+	size_t i, k;
+
+	if (!g_once_init_enter(&initialized))
+		return;
+	for (i = 0; i < ARRAY_SIZE(crc_table); i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+		crc_table[i] = c;
+	}
+	g_once_init_leave(&initialized, 1);
+}
+#endif
+
+/* Get the CRC-32 of an entry's data, as ZIP archives specify it. */
+static uint32_t zip_crc32(const uint8_t *data, size_t size)
+{
+#ifdef HAVE_ZLIB
+	uLong crc;
+	size_t len;
+
+	/* Chop large blocks into pieces for zlib's uInt length. */
+	crc = crc32(0, Z_NULL, 0);
+	while (size) {
+		len = MIN(size, 1024 * 1024 * 1024);
+		crc = crc32(crc, data, len);
+		data += len;
+		size -= len;
+	}
+
+	return crc;
+#else
+	uint32_t crc;
+
+	crc_table_init();
+	crc = 0xffffffff;
+	while (size--)
+		crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+#endif
+}
+
+static int zip_writer_write(struct zip_writer *zw,
+	const void *data, size_t size)
+{
+	int ret;
+
+	if ((ret = sr_file_writer_write(zw->out, data, size)) != SR_OK) {
+		sr_err("Cannot write session file.");
+		return ret;
+	}
+	zw->offset += size;
+
+	return SR_OK;
+}
+
+static void zip_writer_job_free(struct zip_writer_job *job)
+{
+	g_free(job->name);
+	g_free(job->data);
+	g_free(job->comp_buf);
+	g_free(job);
+}
+
+static void zip_writer_free(struct zip_writer *zw)
+{
+	struct zip_writer_entry *entry;
+	size_t i;
+
+	if (!zw)
+		return;
+
+	/* Wait for running compression jobs, discard their results. */
+	if (zw->pool)
+		g_thread_pool_free(zw->pool, FALSE, TRUE);
+	if (zw->jobs)
+		g_queue_free_full(zw->jobs, (GDestroyNotify)zip_writer_job_free);
+	g_cond_clear(&zw->cond);
+	g_mutex_clear(&zw->mutex);
+
+	sr_file_writer_close(zw->out);
+	for (i = 0; i < zw->entries->len; i++) {
+		entry = &g_array_index(zw->entries, struct zip_writer_entry, i);
+		g_free(entry->name);
+	}
+	g_array_free(zw->entries, TRUE);
+	g_free(zw->comp_buf);
+	g_free(zw);
+}
+
+static struct zip_writer *zip_writer_new(const char *filename)
+{
+	struct zip_writer *zw;
+	GDateTime *now;
+
+	zw = g_malloc0(sizeof(*zw));
+	zw->entries = g_array_new(FALSE, TRUE, sizeof(struct zip_writer_entry));
+	g_mutex_init(&zw->mutex);
+	g_cond_init(&zw->cond);
+	zw->out = sr_file_writer_new(filename, 0);
+	if (!zw->out) {
+		sr_err("Cannot create session file '%s'.", filename);
+		zip_writer_free(zw);
+		return NULL;
+	}
+
+	/* All entries carry the archive's creation time. */
+	now = g_date_time_new_now_local();
+	zw->dos_time = g_date_time_get_hour(now) << 11;
+	zw->dos_time |= g_date_time_get_minute(now) << 5;
+	zw->dos_time |= g_date_time_get_second(now) / 2;
+	zw->dos_date = MAX(g_date_time_get_year(now) - 1980, 0) << 9;
+	zw->dos_date |= g_date_time_get_month(now) << 5;
+	zw->dos_date |= g_date_time_get_day_of_month(now);
+	g_date_time_unref(now);
+
+	return zw;
+}
+
+/* Get the buffer for compressed data, which grows as needed. */
+static uint8_t *zip_comp_buf(uint8_t **comp_buf, size_t *comp_buf_size,
+	size_t size)
+{
+	if (size > *comp_buf_size) {
+		g_free(*comp_buf);
+		*comp_buf = g_try_malloc(size);
+		*comp_buf_size = *comp_buf ? size : 0;
+	}
+
+	return *comp_buf;
+}
+
+#ifdef HAVE_ZLIB
+static size_t zip_deflate(const uint8_t *data, size_t size, int level,
+	uint8_t **comp_buf, size_t *comp_buf_size)
+{
+	z_stream strm;
+	size_t comp_size;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	if (level < 0)
+		level = Z_DEFAULT_COMPRESSION;
+	if (deflateInit2(&strm, level, Z_DEFLATED,
+			-MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return 0;
+
+	if (!zip_comp_buf(comp_buf, comp_buf_size, deflateBound(&strm, size))) {
+		deflateEnd(&strm);
+		return 0;
+	}
+
+	strm.next_in = (Bytef *)data;
+	strm.avail_in = size;
+	strm.next_out = *comp_buf;
+	strm.avail_out = *comp_buf_size;
+	ret = deflate(&strm, Z_FINISH);
+	comp_size = strm.total_out;
+	deflateEnd(&strm);
+
+	return (ret == Z_STREAM_END) ? comp_size : 0;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+static size_t zip_zstd(const uint8_t *data, size_t size, int level,
+	uint8_t **comp_buf, size_t *comp_buf_size)
+{
+	size_t comp_size;
+
+	if (level < 0)
+		level = ZSTD_CLEVEL_DEFAULT;
+	if (!zip_comp_buf(comp_buf, comp_buf_size, ZSTD_compressBound(size)))
+		return 0;
+
+	comp_size = ZSTD_compress(*comp_buf, *comp_buf_size, data, size, level);
+
+	return ZSTD_isError(comp_size) ? 0 : comp_size;
+}
+#endif
+
+/*
+ * Get an entry's CRC, and compress its data with the given method into
+ * the given buffer. Returns the compressed size, or 0 when the data
+ * should get stored instead. Does not access the writer, and can run
+ * in any thread.
+ */
+static size_t zip_compress(uint16_t method, int level,
+	const uint8_t *data, size_t size, uint32_t *crc,
+	uint8_t **comp_buf, size_t *comp_buf_size)
+{
+	size_t comp_size;
+
+	*crc = zip_crc32(data, size);
+
+	switch (method) {
+#ifdef HAVE_ZLIB
+	case ZIP_METHOD_DEFLATE:
+		comp_size = zip_deflate(data, size, level,
+			comp_buf, comp_buf_size);
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case ZIP_METHOD_ZSTD:
+		comp_size = zip_zstd(data, size, level,
+			comp_buf, comp_buf_size);
+		break;
+#endif
+	default:
+		(void)level;
+		comp_size = 0;
+		break;
+	}
+
+	/* Store data which does not shrink. */
+	if (comp_size >= size)
+		return 0;
+
+	return comp_size;
+}
+
+/* Get the version which the given entry requires to get extracted. */
+static uint16_t zip_version_needed(uint16_t method, gboolean zip64)
+{
+	if (method == ZIP_METHOD_ZSTD)
+		return ZIP_VERSION_ZSTD;
+
+	return zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT;
+}
+
+/* Write an entry's local header and data, register it for the directory. */
+static int zip_writer_emit(struct zip_writer *zw, const char *name,
+	const void *data, size_t size, uint32_t crc,
+	uint16_t method, const void *comp_data, size_t comp_size)
+{
+	struct zip_writer_entry entry;
+	uint8_t header[30 + 4], *wrptr;
+	const void *payload;
+	size_t pad;
+	int ret;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.offset = zw->offset;
+	entry.crc = crc;
+	entry.size = size;
+	entry.method = ZIP_METHOD_STORE;
+	entry.comp_size = size;
+	payload = data;
+	if (comp_size) {
+		entry.method = method;
+		entry.comp_size = comp_size;
+		payload = comp_data;
+	}
+
+	/*
+	 * Have stored data start at a multiple of the alignment, so that
+	 * readers can map the file and use the data where it is.
+	 */
+	pad = 0;
+	if (zw->align && entry.method == ZIP_METHOD_STORE) {
+		pad = zw->align - (zw->offset + 30 + strlen(name) + 4) % zw->align;
+		pad %= zw->align;
+	}
+
+	wrptr = header;
+	write_u32le_inc(&wrptr, ZIP_LOCAL_HEADER_SIG);
+	write_u16le_inc(&wrptr, zip_version_needed(entry.method, FALSE));
+	write_u16le_inc(&wrptr, 0);
+	write_u16le_inc(&wrptr, entry.method);
+	write_u16le_inc(&wrptr, zw->dos_time);
+	write_u16le_inc(&wrptr, zw->dos_date);
+	write_u32le_inc(&wrptr, entry.crc);
+	write_u32le_inc(&wrptr, entry.comp_size);
+	write_u32le_inc(&wrptr, entry.size);
+	write_u16le_inc(&wrptr, strlen(name));
+	write_u16le_inc(&wrptr, (zw->align && !comp_size) ? 4 + pad : 0);
+
+	ret = zip_writer_write(zw, header, wrptr - header);
+	if (ret == SR_OK)
+		ret = zip_writer_write(zw, name, strlen(name));
+	if (ret == SR_OK && zw->align && !comp_size) {
+		wrptr = header;
+		write_u16le_inc(&wrptr, ZIP_EXTRA_ALIGNMENT);
+		write_u16le_inc(&wrptr, pad);
+		ret = zip_writer_write(zw, header, wrptr - header);
+		while (ret == SR_OK && pad) {
+			memset(header, 0, sizeof(header));
+			ret = zip_writer_write(zw, header, MIN(pad, sizeof(header)));
+			pad -= MIN(pad, sizeof(header));
+		}
+	}
+	if (ret == SR_OK)
+		ret = zip_writer_write(zw, payload, entry.comp_size);
+	if (ret != SR_OK)
+		return ret;
+
+	entry.name = g_strdup(name);
+	g_array_append_val(zw->entries, entry);
+
+	return SR_OK;
+}
+
+static void zip_writer_job_run(gpointer data, gpointer user_data)
+{
+	struct zip_writer_job *job;
+	struct zip_writer *zw;
+
+	job = data;
+	zw = user_data;
+
+	job->comp_size = zip_compress(job->method, job->level,
+		job->data, job->size, &job->crc,
+		&job->comp_buf, &job->comp_buf_size);
+
+	g_mutex_lock(&zw->mutex);
+	job->done = TRUE;
+	g_cond_broadcast(&zw->cond);
+	g_mutex_unlock(&zw->mutex);
+}
+
+/*
+ * Write the completed jobs at the head of the queue. Waits for more
+ * jobs to complete while the queue is full, or for all of them.
+ */
+static int zip_writer_drain(struct zip_writer *zw, gboolean all)
+{
+	struct zip_writer_job *job;
+	int ret;
+
+	g_mutex_lock(&zw->mutex);
+	while ((job = g_queue_peek_head(zw->jobs))) {
+		if (!job->done) {
+			if (!all && g_queue_get_length(zw->jobs) < zw->max_jobs)
+				break;
+			g_cond_wait(&zw->cond, &zw->mutex);
+			continue;
+		}
+		g_queue_pop_head(zw->jobs);
+		g_mutex_unlock(&zw->mutex);
+		ret = SR_OK;
+		if (zw->status == SR_OK)
+			ret = zip_writer_emit(zw, job->name, job->data,
+				job->size, job->crc, job->method,
+				job->comp_buf, job->comp_size);
+		if (ret != SR_OK)
+			zw->status = ret;
+		zip_writer_job_free(job);
+		g_mutex_lock(&zw->mutex);
+	}
+	g_mutex_unlock(&zw->mutex);
+
+	return zw->status;
+}
+
+/*
+ * Have entries get compressed by a number of background threads. Keeps
+ * at most two jobs per thread queued, to cap memory consumption.
+ */
+static int zip_writer_set_threads(struct zip_writer *zw, unsigned int threads)
+{
+	GError *error;
+
+	if (!threads)
+		return SR_OK;
+
+	error = NULL;
+	zw->pool = g_thread_pool_new(zip_writer_job_run, zw,
+		threads, TRUE, &error);
+	if (!zw->pool) {
+		sr_warn("Cannot start compression threads: %s",
+			error ? error->message : "unknown error");
+		g_clear_error(&error);
+		return SR_ERR;
+	}
+	zw->jobs = g_queue_new();
+	zw->max_jobs = 2 * threads;
+
+	return SR_OK;
+}
+
+/*
+ * Append an entry to the archive, compressed by the given method and
+ * level. Entries must not exceed 4 GiB. With compression threads, the
+ * data gets copied and the entry gets written later, in order of
+ * submission.
+ */
+static int zip_writer_add(struct zip_writer *zw, const char *name,
+	const void *data, size_t size, uint16_t method, int level)
+{
+	struct zip_writer_job *job;
+	size_t comp_size;
+	uint32_t crc;
+	GError *error;
+
+	if (size > UINT32_MAX)
+		return SR_ERR_ARG;
+	if (zw->status != SR_OK)
+		return zw->status;
+
+	if (!zw->pool) {
+		comp_size = zip_compress(method, level, data, size, &crc,
+			&zw->comp_buf, &zw->comp_buf_size);
+		return zip_writer_emit(zw, name, data, size, crc,
+			method, zw->comp_buf, comp_size);
+	}
+
+	job = g_malloc0(sizeof(*job));
+	job->name = g_strdup(name);
+	job->size = size;
+	job->method = method;
+	job->level = level;
+	job->data = g_try_malloc(MAX(size, 1));
+	if (!job->data) {
+		zip_writer_job_free(job);
+		return SR_ERR_MALLOC;
+	}
+	memcpy(job->data, data, size);
+
+	g_mutex_lock(&zw->mutex);
+	g_queue_push_tail(zw->jobs, job);
+	g_mutex_unlock(&zw->mutex);
+	error = NULL;
+	if (!g_thread_pool_push(zw->pool, job, &error)) {
+		/* Compress inline when the job cannot get dispatched. */
+		g_clear_error(&error);
+		zip_writer_job_run(job, zw);
+	}
+
+	return zip_writer_drain(zw, FALSE);
+}
+
+/* Write the central directory, then close and release the writer. */
+static int zip_writer_close(struct zip_writer *zw)
+{
+	struct zip_writer_entry *entry;
+	uint8_t header[56 + 20 + 22], *wrptr;
+	uint64_t cd_offset, cd_size, zip64_offset, count;
+	gboolean need_zip64, entry_zip64;
+	size_t i;
+	int ret;
+
+	/* Write out entries which still get compressed. */
+	ret = SR_OK;
+	if (zw->pool) {
+		ret = zip_writer_drain(zw, TRUE);
+		g_thread_pool_free(zw->pool, FALSE, TRUE);
+		zw->pool = NULL;
+	}
+
+	cd_offset = zw->offset;
+	count = zw->entries->len;
+	for (i = 0; ret == SR_OK && i < count; i++) {
+		entry = &g_array_index(zw->entries, struct zip_writer_entry, i);
+		entry_zip64 = zw->zip64 || entry->offset >= UINT32_MAX;
+		wrptr = header;
+		write_u32le_inc(&wrptr, ZIP_CENTRAL_HEADER_SIG);
+		write_u16le_inc(&wrptr, ZIP_VERSION_ZSTD);
+		write_u16le_inc(&wrptr, zip_version_needed(entry->method,
+			entry_zip64));
+		write_u16le_inc(&wrptr, 0);
+		write_u16le_inc(&wrptr, entry->method);
+		write_u16le_inc(&wrptr, zw->dos_time);
+		write_u16le_inc(&wrptr, zw->dos_date);
+		write_u32le_inc(&wrptr, entry->crc);
+		write_u32le_inc(&wrptr, entry->comp_size);
+		write_u32le_inc(&wrptr, entry->size);
+		write_u16le_inc(&wrptr, strlen(entry->name));
+		write_u16le_inc(&wrptr, entry_zip64 ? 12 : 0);
+		write_u16le_inc(&wrptr, 0);
+		write_u16le_inc(&wrptr, 0);
+		write_u16le_inc(&wrptr, 0);
+		write_u32le_inc(&wrptr, 0);
+		write_u32le_inc(&wrptr, entry_zip64 ? UINT32_MAX : entry->offset);
+		ret = zip_writer_write(zw, header, wrptr - header);
+		if (ret == SR_OK)
+			ret = zip_writer_write(zw, entry->name,
+				strlen(entry->name));
+		if (ret == SR_OK && entry_zip64) {
+			/* ZIP64 extra field, holding the header offset. */
+			wrptr = header;
+			write_u16le_inc(&wrptr, 0x0001);
+			write_u16le_inc(&wrptr, 8);
+			write_u64le_inc(&wrptr, entry->offset);
+			ret = zip_writer_write(zw, header, wrptr - header);
+		}
+	}
+	cd_size = zw->offset - cd_offset;
+
+	/* The end records, in their ZIP64 variant when necessary. */
+	need_zip64 = zw->zip64 || count >= UINT16_MAX
+		|| cd_offset >= UINT32_MAX || cd_size >= UINT32_MAX;
+	wrptr = header;
+	if (need_zip64) {
+		zip64_offset = zw->offset;
+		write_u32le_inc(&wrptr, ZIP64_END_SIG);
+		write_u64le_inc(&wrptr, 44);
+		write_u16le_inc(&wrptr, ZIP_VERSION_ZIP64);
+		write_u16le_inc(&wrptr, ZIP_VERSION_ZIP64);
+		write_u32le_inc(&wrptr, 0);
+		write_u32le_inc(&wrptr, 0);
+		write_u64le_inc(&wrptr, count);
+		write_u64le_inc(&wrptr, count);
+		write_u64le_inc(&wrptr, cd_size);
+		write_u64le_inc(&wrptr, cd_offset);
+		write_u32le_inc(&wrptr, ZIP64_LOCATOR_SIG);
+		write_u32le_inc(&wrptr, 0);
+		write_u64le_inc(&wrptr, zip64_offset);
+		write_u32le_inc(&wrptr, 1);
+	}
+	write_u32le_inc(&wrptr, ZIP_END_SIG);
+	write_u16le_inc(&wrptr, 0);
+	write_u16le_inc(&wrptr, 0);
+	write_u16le_inc(&wrptr, MIN(count, UINT16_MAX));
+	write_u16le_inc(&wrptr, MIN(count, UINT16_MAX));
+	write_u32le_inc(&wrptr, MIN(cd_size, UINT32_MAX));
+	write_u32le_inc(&wrptr, MIN(cd_offset, UINT32_MAX));
+	write_u16le_inc(&wrptr, 0);
+	if (ret == SR_OK)
+		ret = zip_writer_write(zw, header, wrptr - header);
+
+	if (sr_file_writer_close(zw->out) != SR_OK && ret == SR_OK) {
+		sr_err("Cannot write session file.");
+		ret = SR_ERR_IO;
+	}
+	zw->out = NULL;
+	zip_writer_free(zw);
+
+	return ret;
+}
+
+static void logic_summary_init(struct logic_summary *s, size_t unitsize)
+{
+	s->entries = g_byte_array_new();
+	s->fill = 0;
+	s->first = g_malloc0(unitsize);
+	s->prev = g_malloc0(unitsize);
+	s->started = FALSE;
+	s->counts = g_malloc0(unitsize * 8 * sizeof(s->counts[0]));
+	s->changed = g_malloc0(unitsize);
+	s->edges = g_byte_array_new();
+}
+
+static void logic_summary_free(struct logic_summary *s)
+{
+	if (s->entries)
+		g_byte_array_free(s->entries, TRUE);
+	g_free(s->first);
+	g_free(s->prev);
+	g_free(s->counts);
+	g_free(s->changed);
+	if (s->edges)
+		g_byte_array_free(s->edges, TRUE);
+	memset(s, 0, sizeof(*s));
+}
+
+/* Append the block in progress to the level 0 entries. */
+static void logic_summary_commit(struct logic_summary *s, size_t unitsize)
+{
+	uint8_t count[sizeof(uint32_t)];
+	size_t i;
+
+	g_byte_array_append(s->entries, s->first, unitsize);
+	for (i = 0; i < unitsize * 8; i++) {
+		write_u32le(count, s->counts[i]);
+		g_byte_array_append(s->entries, count, sizeof(count));
+		s->counts[i] = 0;
+	}
+	s->fill = 0;
+}
+
+static void logic_summary_feed(struct logic_summary *s,
+	const uint8_t *buf, size_t unitsize, size_t count)
+{
+	const uint8_t *prev;
+	size_t i, b;
+	uint8_t diff;
+
+	if (!s->entries || !count)
+		return;
+
+	prev = s->started ? s->prev : NULL;
+	for (i = 0; i < count; i++) {
+		if (prev && memcmp(prev, buf, unitsize)) {
+			for (b = 0; b < unitsize; b++) {
+				diff = prev[b] ^ buf[b];
+				s->changed[b] |= diff;
+				while (diff) {
+					s->counts[b * 8 + g_bit_nth_lsf(diff, -1)]++;
+					diff &= diff - 1;
+				}
+			}
+		}
+		if (!s->fill)
+			memcpy(s->first, buf, unitsize);
+		if (++s->fill == SUMMARY_BASE)
+			logic_summary_commit(s, unitsize);
+		prev = buf;
+		buf += unitsize;
+	}
+	memcpy(s->prev, prev, unitsize);
+	s->started = TRUE;
+}
+
+/* Record the channels which changed in the chunk, in the edge index. */
+static void logic_summary_end_chunk(struct logic_summary *s, size_t unitsize)
+{
+	if (!s->entries)
+		return;
+
+	g_byte_array_append(s->edges, s->changed, unitsize);
+	memset(s->changed, 0, unitsize);
+}
+
+/* Keep the first sample, and sum up the transitions. */
+static void logic_summary_merge(uint8_t *dst, const uint8_t *src,
+	size_t entry_size)
+{
+	size_t unitsize, i;
+	uint32_t sum, add;
+
+	unitsize = entry_size / LOGIC_SUMMARY_SIZE(1);
+	dst += unitsize;
+	src += unitsize;
+	for (i = 0; i < unitsize * 8; i++) {
+		sum = read_u32le(dst);
+		add = read_u32le(src);
+		/* Saturate, coarse levels of huge captures could overflow. */
+		sum = (sum > UINT32_MAX - add) ? UINT32_MAX : sum + add;
+		write_u32le(dst, sum);
+		dst += sizeof(uint32_t);
+		src += sizeof(uint32_t);
+	}
+}
+
+static void analog_summary_init(struct analog_summary *s)
+{
+	s->entries = g_byte_array_new();
+	s->fill = 0;
+}
+
+static void analog_summary_free(struct analog_summary *s)
+{
+	if (s->entries)
+		g_byte_array_free(s->entries, TRUE);
+	memset(s, 0, sizeof(*s));
+}
+
+static void analog_summary_commit(struct analog_summary *s)
+{
+	uint8_t entry[ANALOG_SUMMARY_SIZE];
+
+	write_fltle(&entry[0], s->min);
+	write_fltle(&entry[sizeof(float)], s->max);
+	g_byte_array_append(s->entries, entry, sizeof(entry));
+	s->fill = 0;
+}
+
+static void analog_summary_feed(struct analog_summary *s,
+	const float *values, size_t count)
+{
+	size_t i;
+
+	if (!s->entries)
+		return;
+
+	for (i = 0; i < count; i++) {
+		/* NaN samples don't affect the range. */
+		if (!s->fill) {
+			s->min = INFINITY;
+			s->max = -INFINITY;
+		}
+		if (values[i] < s->min)
+			s->min = values[i];
+		if (values[i] > s->max)
+			s->max = values[i];
+		if (++s->fill == SUMMARY_BASE)
+			analog_summary_commit(s);
+	}
+}
+
+static void analog_summary_merge(uint8_t *dst, const uint8_t *src,
+	size_t entry_size)
+{
+	(void)entry_size;
+
+	if (read_fltle(&src[0]) < read_fltle(&dst[0]))
+		write_fltle(&dst[0], read_fltle(&src[0]));
+	if (read_fltle(&src[sizeof(float)]) > read_fltle(&dst[sizeof(float)]))
+		write_fltle(&dst[sizeof(float)], read_fltle(&src[sizeof(float)]));
+}
+
+/*
+ * Write all levels of a summary, derived from its level 0 entries. The
+ * entries are named "summary-<capture file>-<level>".
+ */
+static int summary_write(const struct sr_output *o, const char *name,
+	GByteArray *entries, size_t entry_size,
+	void (*merge)(uint8_t *dst, const uint8_t *src, size_t entry_size),
+	unsigned int *num_levels)
 {
 	struct out_context *outc;
+	GByteArray *level, *next;
+	const uint8_t *src;
+	char *chunkname;
+	size_t num, i;
+	unsigned int lvl;
+	int ret;
+
+	outc = o->priv;
+	level = entries;
+	ret = SR_OK;
+	for (lvl = 0; ; lvl++) {
+		chunkname = g_strdup_printf("summary-%s-%u", name, lvl);
+		ret = zip_writer_add(outc->writer, chunkname,
+			level->data, level->len, outc->method, outc->level);
+		if (ret != SR_OK)
+			sr_err("Failed to add summary '%s'.", chunkname);
+		g_free(chunkname);
+		if (ret != SR_OK || level->len <= entry_size)
+			break;
+
+		next = g_byte_array_new();
+		num = level->len / entry_size;
+		for (i = 0; i < num; i++) {
+			src = level->data + i * entry_size;
+			if (i % SUMMARY_FANOUT == 0)
+				g_byte_array_append(next, src, entry_size);
+			else
+				merge(next->data + next->len - entry_size,
+					src, entry_size);
+		}
+		if (level != entries)
+			g_byte_array_free(level, TRUE);
+		level = next;
+	}
+	if (level != entries)
+		g_byte_array_free(level, TRUE);
+	*num_levels = lvl + 1;
+
+	return ret;
+}
 
-	(void)options;
+/* Complete the summaries, and add them to the archive. */
+static int zip_finish_summaries(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct logic_summary *ls;
+	struct analog_summary *as;
+	char *name;
+	size_t idx;
+	unsigned int levels, num_levels;
+	int ret;
+
+	outc = o->priv;
+	num_levels = 0;
+
+	ls = &outc->logic_buff.summary;
+	if (ls->entries && outc->logic_buff.chunk_num) {
+		if (ls->fill)
+			logic_summary_commit(ls, outc->logic_buff.unit_size);
+		ret = summary_write(o, "logic-1", ls->entries,
+			LOGIC_SUMMARY_SIZE(outc->logic_buff.unit_size),
+			logic_summary_merge, &levels);
+		if (ret != SR_OK)
+			return ret;
+		num_levels = MAX(num_levels, levels);
+		if (outc->index) {
+			ret = zip_writer_add(outc->writer, "index-logic-1",
+				ls->edges->data, ls->edges->len,
+				outc->method, outc->level);
+			if (ret != SR_OK) {
+				sr_err("Failed to add the edge index.");
+				return ret;
+			}
+		}
+	}
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		as = &outc->analog_buff[idx].summary;
+		if (!as->entries || !outc->analog_buff[idx].chunk_num)
+			continue;
+		if (as->fill)
+			analog_summary_commit(as);
+		name = g_strdup_printf("analog-1-%zu",
+			outc->first_analog_index + idx);
+		ret = summary_write(o, name, as->entries, ANALOG_SUMMARY_SIZE,
+			analog_summary_merge, &levels);
+		g_free(name);
+		if (ret != SR_OK)
+			return ret;
+		num_levels = MAX(num_levels, levels);
+	}
+
+	if (num_levels) {
+		g_key_file_set_integer(outc->meta, "device 1",
+			"summary base", SUMMARY_BASE);
+		g_key_file_set_integer(outc->meta, "device 1",
+			"summary fanout", SUMMARY_FANOUT);
+		g_key_file_set_integer(outc->meta, "device 1",
+			"summary levels", num_levels);
+	}
+
+	return SR_OK;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+	const char *codec;
+	uint16_t method;
+	int level;
+	unsigned int align;
+
+	codec = g_variant_get_string(g_hash_table_lookup(options, "codec"), NULL);
+	level = g_variant_get_int32(g_hash_table_lookup(options, "level"));
+	align = g_variant_get_uint32(g_hash_table_lookup(options, "align"));
+	if (align > 32768 || (align & (align - 1))) {
+		sr_err("Alignment %u is not a power of two up to 32768.", align);
+		return SR_ERR_ARG;
+	}
+	if (!strcmp(codec, "store")) {
+		method = ZIP_METHOD_STORE;
+#ifdef HAVE_ZLIB
+	} else if (!strcmp(codec, "deflate")) {
+		method = ZIP_METHOD_DEFLATE;
+		if (level > 9) {
+			sr_err("Deflate level %d is out of range 0-9.", level);
+			return SR_ERR_ARG;
+		}
+#endif
+#ifdef HAVE_LIBZSTD
+	} else if (!strcmp(codec, "zstd")) {
+		method = ZIP_METHOD_ZSTD;
+		if (level > ZSTD_maxCLevel()) {
+			sr_err("Zstd level %d is out of range 0-%d.",
+				level, ZSTD_maxCLevel());
+			return SR_ERR_ARG;
+		}
+#endif
+	} else {
+		sr_err("Unsupported codec '%s'.", codec);
+		return SR_ERR_ARG;
+	}
 
 	if (!o->filename || o->filename[0] == '\0') {
 		sr_info("srzip output module requires a file name, cannot save.");
@@ -63,25 +1063,170 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	outc = g_malloc0(sizeof(*outc));
 	outc->filename = g_strdup(o->filename);
+	outc->threads = g_variant_get_uint32(g_hash_table_lookup(options,
+		"threads"));
+	outc->method = method;
+	outc->level = level;
+	outc->align = align;
+	outc->zip64 = g_variant_get_boolean(g_hash_table_lookup(options,
+		"zip64"));
+	outc->index = g_variant_get_boolean(g_hash_table_lookup(options,
+		"index"));
+	outc->rotate_size = g_variant_get_uint64(g_hash_table_lookup(options,
+		"rotatesize"));
+	outc->rotate_time = g_variant_get_uint32(g_hash_table_lookup(options,
+		"rotatetime"));
 	o->priv = outc;
 
 	return SR_OK;
 }
 
+/*
+ * Get the file name of a rotated archive, which has the sequence number
+ * inserted before the extension ("capture.sr" becomes "capture-0001.sr").
+ */
+static char *rotate_filename(const char *filename, unsigned int sequence)
+{
+	const char *ext;
+
+	ext = strrchr(filename, '.');
+	if (!ext || ext == filename || strchr(ext, G_DIR_SEPARATOR))
+		return g_strdup_printf("%s-%04u", filename, sequence);
+
+	return g_strdup_printf("%.*s-%04u%s", (int)(ext - filename),
+		filename, sequence, ext);
+}
+
+/*
+ * Start an archive, and its metadata. Sample buffers must be empty,
+ * their data went to the previous archive. Each archive of a rotated
+ * capture is a complete session file.
+ */
+static int zip_open(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct sr_channel *ch;
+	size_t ch_nr, idx;
+	GKeyFile *meta;
+	GSList *l;
+	const char *devgroup;
+	char *s, *filename;
+	int ret;
+	guint index;
+
+	outc = o->priv;
+
+	/* Start over after a previous failed attempt. */
+	logic_summary_free(&outc->logic_buff.summary);
+	for (idx = 0; idx < outc->analog_ch_count; idx++)
+		analog_summary_free(&outc->analog_buff[idx].summary);
+	zip_writer_free(outc->writer);
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+	outc->meta = NULL;
+
+	if (outc->rotate_size || outc->rotate_time) {
+		filename = rotate_filename(outc->filename, outc->sequence + 1);
+		sr_info("Starting session file '%s'.", filename);
+	} else {
+		filename = g_strdup(outc->filename);
+	}
+	outc->writer = zip_writer_new(filename);
+	g_free(filename);
+	if (!outc->writer)
+		return SR_ERR;
+	if (zip_writer_set_threads(outc->writer, outc->threads) != SR_OK)
+		sr_info("Compressing session file data inline.");
+	outc->writer->align = outc->align;
+	outc->writer->zip64 = outc->zip64;
+	outc->sequence++;
+	outc->open_time = g_get_monotonic_time();
+	outc->start_sample = outc->samples_written;
+
+	/* "version" */
+	ret = zip_writer_add(outc->writer, "version", "2", 1,
+		ZIP_METHOD_STORE, -1);
+	if (ret != SR_OK) {
+		sr_err("Error saving version into zipfile.");
+		return ret;
+	}
+
+	/*
+	 * init "metadata", which gets written when the archive is
+	 * complete, see zip_finish()
+	 */
+	meta = g_key_file_new();
+	outc->meta = meta;
+
+	g_key_file_set_string(meta, "global", "sigrok version",
+			sr_package_version_string_get());
+
+	devgroup = "device 1";
+
+	/* Only set capturefile and probes if we will actually save logic data. */
+	if (outc->have_logic) {
+		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
+		g_key_file_set_integer(meta, devgroup, "total probes",
+			outc->logic_ch_count);
+	}
+
+	s = sr_samplerate_string(outc->samplerate);
+	g_key_file_set_string(meta, devgroup, "samplerate", s);
+	g_free(s);
+
+	g_key_file_set_integer(meta, devgroup, "total analog", outc->analog_ch_count);
+
+	/* Where this archive's samples are in a rotated capture. */
+	if (outc->rotate_size || outc->rotate_time) {
+		g_key_file_set_integer(meta, devgroup, "sequence",
+			outc->sequence);
+		g_key_file_set_uint64(meta, devgroup, "start sample",
+			outc->start_sample);
+	}
+
+	index = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled)
+			continue;
+
+		s = NULL;
+		switch (ch->type) {
+		case SR_CHANNEL_LOGIC:
+			ch_nr = ch->index + 1;
+			s = g_strdup_printf("probe%zu", ch_nr);
+			break;
+		case SR_CHANNEL_ANALOG:
+			ch_nr = outc->first_analog_index + index;
+			s = g_strdup_printf("analog%zu", ch_nr);
+			index++;
+			break;
+		}
+		if (s) {
+			g_key_file_set_string(meta, devgroup, s, ch->name);
+			g_free(s);
+		}
+	}
+
+	outc->logic_buff.chunk_num = 0;
+	if (outc->have_logic)
+		logic_summary_init(&outc->logic_buff.summary,
+			outc->logic_buff.unit_size);
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		outc->analog_buff[idx].chunk_num = 0;
+		analog_summary_init(&outc->analog_buff[idx].summary);
+	}
+
+	return SR_OK;
+}
+
 static int zip_create(const struct sr_output *o)
 {
 	struct out_context *outc;
-	struct zip *zipfile;
-	struct zip_source *versrc, *metasrc;
 	struct sr_channel *ch;
-	size_t ch_nr;
 	size_t alloc_size;
 	GVariant *gvar;
-	GKeyFile *meta;
 	GSList *l;
-	const char *devgroup;
-	char *s, *metabuf;
-	gsize metalen;
 	guint logic_channels, enabled_logic_channels;
 	guint enabled_analog_channels;
 	guint index;
@@ -91,32 +1236,12 @@ static int zip_create(const struct sr_output *o)
 	if (outc->samplerate == 0 && sr_config_get(o->sdi->driver, o->sdi, NULL,
 					SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
 		outc->samplerate = g_variant_get_uint64(gvar);
-		g_variant_unref(gvar);
-	}
-
-	/* Quietly delete it first, libzip wants replace ops otherwise. */
-	g_unlink(outc->filename);
-	zipfile = zip_open(outc->filename, ZIP_CREATE, NULL);
-	if (!zipfile)
-		return SR_ERR;
-
-	/* "version" */
-	versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
-	if (zip_add(zipfile, "version", versrc) < 0) {
-		sr_err("Error saving version into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(versrc);
-		zip_discard(zipfile);
-		return SR_ERR;
+		g_variant_unref(gvar);
 	}
 
-	/* init "metadata" */
-	meta = g_key_file_new();
-
-	g_key_file_set_string(meta, "global", "sigrok version",
-			sr_package_version_string_get());
-
-	devgroup = "device 1";
+	/* Buffers remain from a previous failed attempt. */
+	if (outc->analog_buff)
+		return zip_open(o);
 
 	logic_channels = 0;
 	enabled_logic_channels = 0;
@@ -144,46 +1269,19 @@ static int zip_create(const struct sr_output *o)
 		outc->first_analog_index = logic_channels + 1;
 	else
 		outc->first_analog_index = 1;
-
-	/* Only set capturefile and probes if we will actually save logic data. */
-	if (enabled_logic_channels > 0) {
-		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
-		g_key_file_set_integer(meta, devgroup, "total probes", logic_channels);
-	}
-
-	s = sr_samplerate_string(outc->samplerate);
-	g_key_file_set_string(meta, devgroup, "samplerate", s);
-	g_free(s);
-
-	g_key_file_set_integer(meta, devgroup, "total analog", enabled_analog_channels);
+	outc->logic_ch_count = logic_channels;
+	outc->have_logic = enabled_logic_channels > 0;
 
 	outc->analog_ch_count = enabled_analog_channels;
 	alloc_size = sizeof(gint) * outc->analog_ch_count + 1;
+	g_free(outc->analog_index_map);
 	outc->analog_index_map = g_malloc0(alloc_size);
 
 	index = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
-		if (!ch->enabled)
-			continue;
-
-		s = NULL;
-		switch (ch->type) {
-		case SR_CHANNEL_LOGIC:
-			ch_nr = ch->index + 1;
-			s = g_strdup_printf("probe%zu", ch_nr);
-			break;
-		case SR_CHANNEL_ANALOG:
-			ch_nr = outc->first_analog_index + index;
-			outc->analog_index_map[index] = ch->index;
-			s = g_strdup_printf("analog%zu", ch_nr);
-			index++;
-			break;
-		}
-		if (s) {
-			g_key_file_set_string(meta, devgroup, s, ch->name);
-			g_free(s);
-		}
+		if (ch->enabled && ch->type == SR_CHANNEL_ANALOG)
+			outc->analog_index_map[index++] = ch->index;
 	}
 
 	/*
@@ -227,28 +1325,52 @@ static int zip_create(const struct sr_output *o)
 		outc->analog_buff[index].fill_size = 0;
 	}
 
-	metabuf = g_key_file_to_data(meta, &metalen, NULL);
-	g_key_file_free(meta);
+	return zip_open(o);
+}
 
-	metasrc = zip_source_buffer(zipfile, metabuf, metalen, FALSE);
-	if (zip_add(zipfile, "metadata", metasrc) < 0) {
-		sr_err("Error saving metadata into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(metasrc);
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
-	}
+/*
+ * Complete the archive. Writes the metadata, and the archive's central
+ * directory. Should execute exactly once, upon SR_DF_END or when the
+ * output gets released.
+ */
+static int zip_finish(const struct sr_output *o)
+{
+	struct out_context *outc;
+	char *metabuf;
+	gsize metalen;
+	int ret;
 
-	if (zip_close(zipfile) < 0) {
-		sr_err("Error saving zipfile: %s", zip_strerror(zipfile));
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	outc = o->priv;
+	if (!outc->writer)
+		return SR_OK;
+
+	/* Files without logic data don't have a unitsize field. */
+	if (outc->logic_buff.chunk_num)
+		g_key_file_set_integer(outc->meta, "device 1", "unitsize",
+			outc->logic_buff.unit_size);
+
+	ret = zip_finish_summaries(o);
+	if (ret != SR_OK) {
+		zip_writer_free(outc->writer);
+		outc->writer = NULL;
+		return ret;
 	}
+
+	metabuf = g_key_file_to_data(outc->meta, &metalen, NULL);
+	/* Keep the metadata readable with any codec for the samples. */
+	ret = zip_writer_add(outc->writer, "metadata", metabuf, metalen,
+		ZIP_METHOD_DEFLATE, -1);
 	g_free(metabuf);
+	if (ret != SR_OK)
+		sr_err("Error saving metadata into zipfile.");
 
-	return SR_OK;
+	if (ret == SR_OK)
+		ret = zip_writer_close(outc->writer);
+	else
+		zip_writer_free(outc->writer);
+	outc->writer = NULL;
+
+	return ret;
 }
 
 /**
@@ -265,121 +1387,35 @@ static int zip_append(const struct sr_output *o,
 	uint8_t *buf, size_t unitsize, size_t length)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *logicsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	struct zip_source *metasrc;
-	GKeyFile *kf;
-	GError *error;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *metabuf;
-	gsize metalen;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	int ret;
 
 	if (!length)
 		return SR_OK;
 
 	outc = o->priv;
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
-
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
+	if (!outc->writer)
 		return SR_ERR;
-	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	if (!kf) {
-		zip_discard(archive);
-		return SR_ERR_DATA;
-	}
-	/*
-	 * If the file was only initialized but doesn't yet have any
-	 * data it in, it won't have a unitsize field in metadata yet.
-	 */
-	error = NULL;
-	metabuf = NULL;
-	if (!g_key_file_has_key(kf, "device 1", "unitsize", &error)) {
-		if (error && error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
-			sr_err("Failed to check unitsize key: %s", error->message);
-			g_error_free(error);
-			g_key_file_free(kf);
-			zip_discard(archive);
-			return SR_ERR;
-		}
-		g_clear_error(&error);
-
-		/* Add unitsize field. */
-		g_key_file_set_integer(kf, "device 1", "unitsize", unitsize);
-		metabuf = g_key_file_to_data(kf, &metalen, NULL);
-		metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
-
-		if (zip_replace(archive, zs.index, metasrc) < 0) {
-			sr_err("Failed to replace metadata: %s",
-				zip_strerror(archive));
-			g_key_file_free(kf);
-			zip_source_free(metasrc);
-			zip_discard(archive);
-			g_free(metabuf);
-			return SR_ERR;
-		}
-	}
-	g_key_file_free(kf);
-
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, "logic-1", 7) != 0)
-			continue;
-		if (entry_name[7] == '\0') {
-			/*
-			 * This file has no extra chunks, just a single
-			 * "logic-1". Rename it to "logic-1-1" and continue
-			 * with chunk 2.
-			 */
-			if (zip_rename(archive, i, "logic-1-1") < 0) {
-				sr_err("Failed to rename 'logic-1' to 'logic-1-1': %s",
-					zip_strerror(archive));
-				zip_discard(archive);
-				g_free(metabuf);
-				return SR_ERR;
-			}
-			next_chunk_num = 2;
-			break;
-		} else if (entry_name[7] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + 8, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
 
 	if (length % unitsize != 0) {
 		sr_warn("Chunk size %zu not a multiple of the"
 			" unit size %zu.", length, unitsize);
 	}
-	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
-	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
-		zip_source_free(logicsrc);
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
-	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
+	chunkname = g_strdup_printf("logic-1-%u",
+		outc->logic_buff.chunk_num + 1);
+	ret = zip_writer_add(outc->writer, chunkname, buf, length,
+		outc->method, outc->level);
+	if (ret != SR_OK) {
+		sr_err("Failed to add chunk '%s'.", chunkname);
+		g_free(chunkname);
+		return ret;
 	}
-	g_free(metabuf);
+	g_free(chunkname);
+	outc->logic_buff.chunk_num++;
+	outc->samples_written += length / unitsize;
+	logic_summary_feed(&outc->logic_buff.summary, buf, unitsize,
+		length / unitsize);
+	logic_summary_end_chunk(&outc->logic_buff.summary, unitsize);
 
 	return SR_OK;
 }
@@ -450,6 +1486,59 @@ static int zip_append_queue(const struct sr_output *o,
 	return SR_OK;
 }
 
+/**
+ * Queue run-length encoded logic data for the srzip archive.
+ *
+ * Runs get expanded directly into the local buffer, which avoids an
+ * intermediate copy of the expanded samples.
+ *
+ * @param[in] o Output module instance.
+ * @param[in] rle The run-length encoded logic data.
+ *
+ * @returns SR_OK et al error codes.
+ */
+static int zip_append_rle_queue(const struct sr_output *o,
+	const struct sr_datafeed_logic_rle *rle)
+{
+	struct out_context *outc;
+	struct logic_buff *buff;
+	struct sr_logic_rle_pos pos;
+	uint64_t written;
+	uint8_t *wrptr;
+	size_t remain;
+	int ret;
+
+	outc = o->priv;
+	buff = &outc->logic_buff;
+	if (!rle->num_runs)
+		return SR_OK;
+	if (rle->unitsize != buff->unit_size) {
+		sr_warn("Unexpected unit size, discarding logic data.");
+		return SR_ERR_ARG;
+	}
+
+	memset(&pos, 0, sizeof(pos));
+	while (pos.run < rle->num_runs) {
+		remain = buff->alloc_size - buff->fill_size;
+		if (!remain) {
+			ret = zip_append(o, buff->samples, buff->unit_size,
+				buff->fill_size * buff->unit_size);
+			if (ret != SR_OK)
+				return ret;
+			buff->fill_size = 0;
+			continue;
+		}
+		wrptr = &buff->samples[buff->fill_size * buff->unit_size];
+		written = sr_logic_rle_expand(rle, &pos, wrptr,
+			remain * buff->unit_size);
+		if (!written)
+			break;
+		buff->fill_size += written / buff->unit_size;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Append analog data of a channel to an srzip archive.
  *
@@ -464,71 +1553,100 @@ static int zip_append_analog(const struct sr_output *o,
 	const float *values, size_t count, size_t ch_nr)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *analogsrc;
-	int64_t i, num_files;
-	size_t size;
-	struct zip_stat zs;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *basename;
-	gsize baselen;
+	struct analog_buff *buff;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	int ret;
 
 	outc = o->priv;
-
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
+	if (!outc->writer)
 		return SR_ERR;
+	buff = &outc->analog_buff[ch_nr - outc->first_analog_index];
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
+	chunkname = g_strdup_printf("analog-1-%zu-%u",
+		ch_nr, buff->chunk_num + 1);
+	ret = zip_writer_add(outc->writer, chunkname,
+		values, sizeof(values[0]) * count,
+		outc->method, outc->level);
+	if (ret != SR_OK) {
+		sr_err("Failed to add chunk '%s'.", chunkname);
+		g_free(chunkname);
+		return ret;
 	}
+	g_free(chunkname);
+	buff->chunk_num++;
+	if (!outc->have_logic && buff == &outc->analog_buff[0])
+		outc->samples_written += count;
+	analog_summary_feed(&buff->summary, values, count);
+
+	return SR_OK;
+}
+
+/**
+ * Queue analog samples of a channel for srzip archive writes.
+ *
+ * @param[in] o Output module instance.
+ * @param[in] idx Index of the channel's buffer.
+ * @param[in] rdptr The channel's first sample.
+ * @param[in] stride Distance between the channel's samples (float items).
+ * @param[in] count Number of samples of the channel.
+ * @param[in] flush Force ZIP archive update (queue by default).
+ *
+ * @returns SR_OK et al error codes.
+ */
+static int zip_append_analog_channel(const struct sr_output *o,
+	size_t idx, const float *rdptr, size_t stride, size_t count,
+	gboolean flush)
+{
+	struct out_context *outc;
+	struct analog_buff *buff;
+	float *wrptr;
+	size_t nr, remain, copy_size, i;
+	int ret;
+
+	outc = o->priv;
+	nr = outc->first_analog_index + idx;
+	buff = &outc->analog_buff[idx];
 
-	basename = g_strdup_printf("analog-1-%zu", ch_nr);
-	baselen = strlen(basename);
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, basename, baselen) != 0) {
+	/*
+	 * Queue most recently received samples to the local buffer.
+	 * Flush to the ZIP archive when the buffer space is exhausted.
+	 */
+	while (count) {
+		remain = buff->alloc_size - buff->fill_size;
+		if (!remain) {
+			ret = zip_append_analog(o,
+				buff->samples, buff->fill_size, nr);
+			if (ret != SR_OK)
+				return ret;
+			buff->fill_size = 0;
 			continue;
-		} else if (entry_name[baselen] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + baselen + 1, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
 		}
+		wrptr = &buff->samples[buff->fill_size];
+		copy_size = MIN(count, remain);
+		if (stride == 1) {
+			memcpy(wrptr, rdptr, copy_size * sizeof(rdptr[0]));
+		} else {
+			for (i = 0; i < copy_size; i++)
+				wrptr[i] = rdptr[i * stride];
+		}
+		rdptr += copy_size * stride;
+		buff->fill_size += copy_size;
+		count -= copy_size;
 	}
 
-	size = sizeof(values[0]) * count;
-	analogsrc = zip_source_buffer(archive, values, size, FALSE);
-	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
-	i = zip_add(archive, chunkname, analogsrc);
-	if (i < 0) {
-		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
-		g_free(chunkname);
-		g_free(basename);
-		zip_source_free(analogsrc);
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	g_free(chunkname);
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		g_free(basename);
-		zip_discard(archive);
-		return SR_ERR;
+	/* Flush to the ZIP archive if the caller wants us to. */
+	if (flush && buff->fill_size) {
+		ret = zip_append_analog(o, buff->samples, buff->fill_size, nr);
+		if (ret != SR_OK)
+			return ret;
+		buff->fill_size = 0;
 	}
 
-	g_free(basename);
-
 	return SR_OK;
 }
 
 /**
- * Queue analog data of a channel for srzip archive writes.
+ * Queue analog data of the packet's channels for srzip archive writes.
  *
  * @param[in] o Output module instance.
  * @param[in] analog Sample data (session feed packet format).
@@ -541,10 +1659,11 @@ static int zip_append_analog_queue(const struct sr_output *o,
 {
 	struct out_context *outc;
 	const struct sr_channel *ch;
-	size_t idx, nr;
+	size_t idx, nr, num_channels, pos;
 	struct analog_buff *buff;
-	float *values, *wrptr, *rdptr;
-	size_t send_size, remain, copy_size;
+	float *values;
+	const float *rdptr;
+	GSList *l;
 	int ret;
 
 	outc = o->priv;
@@ -565,71 +1684,93 @@ static int zip_append_analog_queue(const struct sr_output *o,
 		return SR_OK;
 	}
 
-	/* Lookup index and number of the analog channel. */
-	/* TODO: support packets covering multiple channels */
-	if (g_slist_length(analog->meaning->channels) != 1) {
-		sr_err("Analog packets covering multiple channels not supported yet");
-		return SR_ERR;
-	}
-	ch = g_slist_nth_data(analog->meaning->channels, 0);
-	for (idx = 0; idx < outc->analog_ch_count; idx++) {
-		if (outc->analog_index_map[idx] == ch->index)
-			break;
-	}
-	if (idx == outc->analog_ch_count)
-		return SR_ERR_ARG;
-	nr = outc->first_analog_index + idx;
-	buff = &outc->analog_buff[idx];
-
 	/* Convert the analog data to an array of float values. */
-	values = g_try_malloc0(analog->num_samples * sizeof(values[0]));
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (!num_channels)
+		return SR_ERR_ARG;
+	values = g_try_malloc0(analog->num_samples * num_channels
+		* sizeof(values[0]));
 	if (!values)
 		return SR_ERR_MALLOC;
-	ret = sr_analog_to_float(analog, values);
+	ret = sr_analog_to_float_view(analog, values, &rdptr);
 	if (ret != SR_OK) {
 		g_free(values);
 		return ret;
 	}
 
 	/*
-	 * Queue most recently received samples to the local buffer.
-	 * Flush to the ZIP archive when the buffer space is exhausted.
+	 * Packets of several channels have their samples interleaved.
+	 * Lookup each channel's buffer, and queue its samples.
 	 */
-	rdptr = values;
-	send_size = analog->num_samples;
-	while (send_size) {
-		remain = buff->alloc_size - buff->fill_size;
-		if (remain) {
-			wrptr = &buff->samples[buff->fill_size];
-			copy_size = MIN(send_size, remain);
-			send_size -= copy_size;
-			buff->fill_size += copy_size;
-			memcpy(wrptr, rdptr, copy_size * sizeof(values[0]));
-			rdptr += copy_size;
-			remain -= copy_size;
+	pos = 0;
+	for (l = analog->meaning->channels; l; l = l->next, pos++) {
+		ch = l->data;
+		for (idx = 0; idx < outc->analog_ch_count; idx++) {
+			if (outc->analog_index_map[idx] == ch->index)
+				break;
 		}
-		if (send_size && !remain) {
-			ret = zip_append_analog(o,
-				buff->samples, buff->fill_size, nr);
-			if (ret != SR_OK) {
-				g_free(values);
-				return ret;
-			}
-			buff->fill_size = 0;
-			remain = buff->alloc_size - buff->fill_size;
+		if (idx == outc->analog_ch_count) {
+			ret = SR_ERR_ARG;
+			break;
 		}
+		ret = zip_append_analog_channel(o, idx, &rdptr[pos],
+			num_channels, analog->num_samples, flush);
+		if (ret != SR_OK)
+			break;
 	}
 	g_free(values);
 
-	/* Flush to the ZIP archive if the caller wants us to. */
-	if (flush && buff->fill_size) {
-		ret = zip_append_analog(o, buff->samples, buff->fill_size, nr);
-		if (ret != SR_OK)
-			return ret;
-		buff->fill_size = 0;
-	}
+	return ret;
+}
 
-	return SR_OK;
+/*
+ * Write out the buffered samples, and complete the archive. The archive
+ * gets completed when writing the samples fails, too, so that it keeps
+ * the samples which were written before.
+ */
+static int zip_complete(const struct sr_output *o)
+{
+	int ret, finish_ret;
+
+	ret = zip_append_queue(o, NULL, 0, 0, TRUE);
+	if (ret == SR_OK)
+		ret = zip_append_analog_queue(o, NULL, TRUE);
+	finish_ret = zip_finish(o);
+
+	return ret != SR_OK ? ret : finish_ret;
+}
+
+/*
+ * Continue in a new archive when the current one reached the size or
+ * the age limit. Queued samples go to the current archive first, so
+ * the archives hold all samples in sequence. Archives get checked
+ * between packets, and the size is the one of the data written so far
+ * (compression threads keep a few chunks in flight).
+ */
+static int zip_rotate(const struct sr_output *o)
+{
+	struct out_context *outc;
+	gboolean due;
+	int ret;
+
+	outc = o->priv;
+	if (!outc->writer)
+		return SR_OK;
+
+	due = FALSE;
+	if (outc->rotate_size && outc->writer->offset >= outc->rotate_size)
+		due = TRUE;
+	if (outc->rotate_time && g_get_monotonic_time() - outc->open_time
+			>= (gint64)outc->rotate_time * G_USEC_PER_SEC)
+		due = TRUE;
+	if (!due)
+		return SR_OK;
+
+	ret = zip_complete(o);
+	if (ret != SR_OK)
+		return ret;
+
+	return zip_open(o);
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -662,6 +1803,8 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			if ((ret = zip_create(o)) != SR_OK)
 				return ret;
 			outc->zip_created = TRUE;
+		} else if ((ret = zip_rotate(o)) != SR_OK) {
+			return ret;
 		}
 		logic = packet->payload;
 		ret = zip_append_queue(o, logic->data,
@@ -669,11 +1812,25 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_LOGIC_RLE:
+		if (!outc->zip_created) {
+			if ((ret = zip_create(o)) != SR_OK)
+				return ret;
+			outc->zip_created = TRUE;
+		} else if ((ret = zip_rotate(o)) != SR_OK) {
+			return ret;
+		}
+		ret = zip_append_rle_queue(o, packet->payload);
+		if (ret != SR_OK)
+			return ret;
+		break;
 	case SR_DF_ANALOG:
 		if (!outc->zip_created) {
 			if ((ret = zip_create(o)) != SR_OK)
 				return ret;
 			outc->zip_created = TRUE;
+		} else if ((ret = zip_rotate(o)) != SR_OK) {
+			return ret;
 		}
 		analog = packet->payload;
 		ret = zip_append_analog_queue(o, analog, FALSE);
@@ -681,11 +1838,8 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return ret;
 		break;
 	case SR_DF_END:
-		if (outc->zip_created) {
-			ret = zip_append_queue(o, NULL, 0, 0, TRUE);
-			if (ret != SR_OK)
-				return ret;
-			ret = zip_append_analog_queue(o, NULL, TRUE);
+		if (outc->zip_created && outc->writer) {
+			ret = zip_complete(o);
 			if (ret != SR_OK)
 				return ret;
 		}
@@ -696,11 +1850,45 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 }
 
 static struct sr_option options[] = {
+	{ "threads", "Compression threads", "Number of threads which compress chunks in the background, 0 compresses while receiving", NULL, NULL },
+	{ "codec", "Codec", "Compression of sample data, readers need support for it", NULL, NULL },
+	{ "level", "Level", "Compression level, -1 is the codec's default", NULL, NULL },
+	{ "align", "Alignment", "Alignment of uncompressed data in the file, e.g. 4096 to have readers map it, 0 for none", NULL, NULL },
+	{ "index", "Edge index", "Record which logic channels change in each chunk, for readers to seek to activity", NULL, NULL },
+	{ "rotatesize", "Rotation size", "Continue in a new numbered file when the file reaches this size in bytes, 0 for never", NULL, NULL },
+	{ "rotatetime", "Rotation time", "Continue in a new numbered file after this many seconds, 0 for never", NULL, NULL },
+	{ "zip64", "ZIP64", "Write ZIP64 records also when the file doesn't need them", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
+	GSList *l;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint32(0));
+#ifdef HAVE_ZLIB
+		options[1].def = g_variant_ref_sink(g_variant_new_string("deflate"));
+#else
+		options[1].def = g_variant_ref_sink(g_variant_new_string("store"));
+#endif
+		l = NULL;
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("store")));
+#ifdef HAVE_ZLIB
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("deflate")));
+#endif
+#ifdef HAVE_LIBZSTD
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("zstd")));
+#endif
+		options[1].values = l;
+		options[2].def = g_variant_ref_sink(g_variant_new_int32(-1));
+		options[3].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[4].def = g_variant_ref_sink(g_variant_new_boolean(TRUE));
+		options[5].def = g_variant_ref_sink(g_variant_new_uint64(0));
+		options[6].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[7].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	}
+
 	return options;
 }
 
@@ -711,11 +1899,20 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 
+	/* Keep what was received if the feed did not end regularly. */
+	if (outc->writer)
+		(void)zip_complete(o);
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+
 	g_free(outc->analog_index_map);
 	g_free(outc->filename);
 	g_free(outc->logic_buff.samples);
-	for (idx = 0; idx < outc->analog_ch_count; idx++)
+	logic_summary_free(&outc->logic_buff.summary);
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
 		g_free(outc->analog_buff[idx].samples);
+		analog_summary_free(&outc->analog_buff[idx].summary);
+	}
 	g_free(outc->analog_buff);
 
 	g_free(outc);
@@ -729,7 +1926,7 @@ SR_PRIV struct sr_output_module output_srzip = {
 	.name = "srzip",
 	.desc = "srzip session file format data",
 	.exts = (const char*[]){"sr", NULL},
-	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING | SR_OUTPUT_LOGIC_RLE,
 	.options = get_options,
 	.init = init,
 	.receive = receive,
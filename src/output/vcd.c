@@ -31,6 +31,7 @@
 
 #include <ctype.h>
 #include <glib.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -42,6 +43,13 @@
 static const int with_queue_stats = 0;
 static const int with_pool_stats = 0;
 
+/* Initial number of queue items, the queue grows on demand. */
+#define VCD_QUEUE_SIZE	256
+/* Marks the absence of a current queue position. */
+#define VCD_QUEUE_NOPOS	SIZE_MAX
+/* Minimum size of a packet's output text buffer. */
+#define VCD_OUT_SIZE	512
+
 struct vcd_channel_desc {
 	size_t index;
 	GString *name;
@@ -60,19 +68,25 @@ struct vcd_queue_item {
 };
 
 struct context {
+	const struct sr_dev_inst *sdi;
 	size_t enabled_count;
 	size_t logic_count;
 	size_t analog_count;
 	gboolean header_done;
 	uint64_t period;
+	uint64_t ts_factor;
+	size_t out_size;
 	struct vcd_channel_desc *channels;
 	uint64_t samplerate;
-	GSList *free_list, *used_list;
+	GPtrArray *free_strings;
 	size_t alloced, freed, reused, pooled;
-	GList *vcd_queue_list;
-	GList *vcd_queue_last;
+	struct vcd_queue_item *queue;
+	size_t queue_head, queue_tail, queue_size;
+	size_t queue_pos;
 	gboolean immediate_write;
 	uint8_t *last_logic;
+	/* Analog changes up to this magnitude don't get written. */
+	double deadband;
 };
 
 /*
@@ -174,15 +188,47 @@ static GString *vcd_identifier(size_t idx)
  *   of significant digits. The Verilog VCD spec specifically picked the
  *   "%.16g" format such that all bits of the internal presentation of
  *   the IEEE754 floating point value get communicated between the
- *   writer and the reader.
+ *   writer and the reader. Sample values are single precision here,
+ *   the shortest text which reads back as the same float communicates
+ *   all of their bits, too.
  */
 
-static void append_vcd_timestamp(GString *s, double ts, gboolean lf)
+static double snum_to_ts(const struct context *ctx, uint64_t snum)
+{
+	double ts;
+
+	ts = (double)snum;
+	ts /= ctx->samplerate;
+	ts *= ctx->period;
+
+	return ts;
+}
+
+/*
+ * Timestamps are integer multiples of the sample number in the common
+ * case where the timescale is a multiple of the samplerate. Print these
+ * without floating point formatting. Fall back to the calculation in
+ * double precision for odd samplerates.
+ */
+static void append_vcd_timestamp(const struct context *ctx, GString *s,
+	uint64_t snum, gboolean lf)
 {
+	char text[24], *p;
+	uint64_t ts;
 
 	g_string_append_c(s, '\n');
 	g_string_append_c(s, '#');
-	g_string_append_printf(s, "%.0f", ts);
+	if (ctx->ts_factor && snum <= UINT64_MAX / ctx->ts_factor) {
+		ts = snum * ctx->ts_factor;
+		p = &text[sizeof(text)];
+		do {
+			*--p = '0' + ts % 10;
+			ts /= 10;
+		} while (ts);
+		g_string_append_len(s, p, &text[sizeof(text)] - p);
+	} else {
+		g_string_append_printf(s, "%.0f", snum_to_ts(ctx, snum));
+	}
 	g_string_append_c(s, lf ? '\n' : ' ');
 }
 
@@ -190,16 +236,25 @@ static void format_vcd_value_bit(GString *s, uint8_t bit_value, GString *id)
 {
 
 	g_string_append_c(s, bit_value ? '1' : '0');
-	g_string_append(s, id->str);
+	g_string_append_len(s, id->str, id->len);
 }
 
-static void format_vcd_value_real(GString *s, double real_value, GString *id)
+static void format_vcd_value_real(GString *s, float real_value, GString *id)
 {
+	char text[SR_FTOA_BUFSIZE];
+	int len;
 
+	len = sr_ftoa_shortest(text, real_value);
 	g_string_append_c(s, 'r');
-	g_string_append_printf(s, "%.16g", real_value);
+	g_string_append_len(s, text, len);
 	g_string_append_c(s, ' ');
-	g_string_append(s, id->str);
+	g_string_append_len(s, id->str, id->len);
+}
+
+/* Release a pooled text buffer of the value change queue. */
+static void free_text(gpointer data)
+{
+	g_string_free(data, TRUE);
 }
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -210,8 +265,13 @@ static int init(struct sr_output *o, GHashTable *options)
 	GSList *l;
 	size_t num_enabled, num_logic, num_analog, desc_idx;
 	struct vcd_channel_desc *desc;
+	double deadband;
 
-	(void)options;
+	deadband = g_variant_get_double(g_hash_table_lookup(options, "deadband"));
+	if (deadband < 0.0) {
+		sr_err("Invalid dead band %g, must not be negative.", deadband);
+		return SR_ERR_ARG;
+	}
 
 	/* Determine the number of involved channels. */
 	num_enabled = 0;
@@ -238,9 +298,11 @@ static int init(struct sr_output *o, GHashTable *options)
 	/* Allocate space for channel descriptions. */
 	ctx = g_malloc0(sizeof(*ctx));
 	o->priv = ctx;
+	ctx->sdi = o->sdi;
 	ctx->enabled_count = num_enabled;
 	ctx->logic_count = num_logic;
 	ctx->analog_count = num_analog;
+	ctx->deadband = deadband;
 	alloc_size = sizeof(ctx->channels[0]) * ctx->enabled_count;
 	ctx->channels = g_malloc0(alloc_size);
 
@@ -298,6 +360,18 @@ static int init(struct sr_output *o, GHashTable *options)
 	if (ctx->logic_count && !ctx->last_logic)
 		return SR_ERR_MALLOC;
 
+	/* Preallocate the value change queue for mixed signal setups. */
+	ctx->out_size = VCD_OUT_SIZE;
+	ctx->free_strings = g_ptr_array_new_with_free_func(free_text);
+	ctx->queue_pos = VCD_QUEUE_NOPOS;
+	if (!ctx->immediate_write) {
+		if (sr_session_mem_charge(ctx->sdi,
+				VCD_QUEUE_SIZE * sizeof(ctx->queue[0])) != SR_OK)
+			return SR_ERR_MALLOC;
+		ctx->queue_size = VCD_QUEUE_SIZE;
+		ctx->queue = g_malloc_n(ctx->queue_size, sizeof(ctx->queue[0]));
+	}
+
 	return SR_OK;
 }
 
@@ -361,6 +435,9 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 	ctx->period = get_timescale_freq(ctx->samplerate);
+	ctx->ts_factor = 0;
+	if (ctx->samplerate && ctx->period % ctx->samplerate == 0)
+		ctx->ts_factor = ctx->period / ctx->samplerate;
 	t = time(NULL);
 	timestamp = g_strdup(ctime(&t));
 	timestamp[strlen(timestamp) - 1] = '\0';
@@ -431,7 +508,7 @@ static GString *chk_header(const struct sr_output *o)
 		ctx->header_done = TRUE;
 		s = gen_header(o);
 	} else {
-		s = g_string_sized_new(512);
+		s = g_string_sized_new(ctx->out_size);
 	}
 
 	return s;
@@ -445,313 +522,144 @@ static GString *chk_header(const struct sr_output *o)
  * no other channel's data can arrive any more.
  */
 
-static struct vcd_queue_item *queue_alloc_item(struct context *ctx, uint64_t snum)
+/*
+ * The queue is a flat array of items, sorted by sample number. Items
+ * get consumed from the head, the range before queue_head is unused.
+ * Text buffers of consumed items are kept in a pool for reuse.
+ */
+static GString *queue_alloc_text(struct context *ctx)
 {
-	GSList *node;
-	struct vcd_queue_item *item;
+	GString *text;
 
-	/* Get an item from the free list if available. */
-	node = ctx->free_list;
-	if (node) {
+	if (ctx->free_strings->len) {
 		ctx->reused++;
-
-		/* Unlink GSList node from the free list. */
-		ctx->free_list = node->next;
-		node->next = NULL;
-		item = node->data;
-		node->data = NULL;
-
-		/* Setup content of the item. */
-		item->samplenum = snum;
-		if (!item->values)
-			item->values = g_string_sized_new(32);
-		else
-			g_string_truncate(item->values, 0);
-
-		/* Keep GSList node in the used list (avoid free/alloc). */
-		node->next = ctx->used_list;
-		ctx->used_list = node;
-
-		return item;
+		text = g_ptr_array_remove_index_fast(ctx->free_strings,
+			ctx->free_strings->len - 1);
+		g_string_truncate(text, 0);
+		return text;
 	}
 
-	/* Dynamic allocation of an item. */
 	ctx->alloced++;
-	item = g_malloc0(sizeof(*item));
-	if (!item)
-		return NULL;
-	item->samplenum = snum;
-	item->values = g_string_sized_new(32);
-
-	/* Create a used list item, to later move to the free list. */
-	ctx->used_list = g_slist_prepend(ctx->used_list, item);
-
-	return item;
+	return g_string_sized_new(32);
 }
 
-static void queue_free_item(struct context *ctx, struct vcd_queue_item *item)
+static void queue_free_text(struct context *ctx, GString *text)
 {
-	GSList *node;
-
-	/*
-	 * Put item back into the free list. We can assume to find a
-	 * used list node, it got allocated when the item was acquired.
-	 */
-	node = ctx->used_list;
-	if (node) {
-		ctx->pooled++;
-
-		ctx->used_list = node->next;
-		node->next = NULL;
-		node->data = item;
-
-		item->samplenum = 0;
-		g_string_truncate(item->values, 0);
-
-		node->next = ctx->free_list;
-		ctx->free_list = node;
 
+	if (!text)
 		return;
-	}
-
-	/*
-	 * Release dynamically allocated resources. Could also be used
-	 * to release free list items when the use list is empty.
-	 */
-	ctx->freed++;
-	if (item->values)
-		g_string_free(item->values, TRUE);
-	g_free(item);
+	ctx->pooled++;
+	g_ptr_array_add(ctx->free_strings, text);
 }
 
-static void queue_drain_pool_cb(gpointer data, gpointer cb_data)
+static void queue_drain_pool(struct context *ctx)
 {
-	struct context *ctx;
-	struct vcd_queue_item *item;
+	size_t idx;
+
+	for (idx = ctx->queue_head; idx < ctx->queue_tail; idx++)
+		queue_free_text(ctx, ctx->queue[idx].values);
+	ctx->queue_head = ctx->queue_tail = 0;
+	ctx->queue_pos = VCD_QUEUE_NOPOS;
 
-	item = data;
-	ctx = cb_data;
-	queue_free_item(ctx, item);
+	if (ctx->free_strings) {
+		ctx->freed += ctx->free_strings->len;
+		g_ptr_array_free(ctx->free_strings, TRUE);
+		ctx->free_strings = NULL;
+	}
+	g_free(ctx->queue);
+	ctx->queue = NULL;
+	sr_session_mem_release(ctx->sdi, ctx->queue_size * sizeof(ctx->queue[0]));
+	ctx->queue_size = 0;
 }
 
-static void queue_drain_pool(struct context *ctx)
+/* Make room for one more item at the queue's tail. */
+static int queue_reserve(struct context *ctx)
 {
-	GSList *list;
+	struct vcd_queue_item *queue;
+	size_t count, size, grow;
 
-	/*
-	 * Grab the list and "empty" the context member. Then
-	 * iterate over the items, have dymamic memory released.
-	 * Then free the GSList nodes (but not their data parts).
-	 * Do this for the used and the free lists.
-	 */
-	list = ctx->used_list;
-	ctx->used_list = NULL;
-	g_slist_foreach(list, queue_drain_pool_cb, ctx);
-	g_slist_free(list);
-
-	list = ctx->free_list;
-	ctx->free_list = NULL;
-	g_slist_foreach(list, queue_drain_pool_cb, ctx);
-	g_slist_free(list);
-}
+	if (ctx->queue_tail < ctx->queue_size)
+		return SR_OK;
 
-static int cmp_snum(gconstpointer l, gconstpointer d)
-{
-	const struct vcd_queue_item *list_item;
-	const uint64_t *snum_ptr;
-
-	list_item = l;
-	snum_ptr = d;
-	if (list_item->samplenum > *snum_ptr)
-		return +1;
-	if (list_item->samplenum < *snum_ptr)
-		return -1;
-	return 0;
-}
+	/* Move the items to the start of the array when that helps. */
+	count = ctx->queue_tail - ctx->queue_head;
+	if (ctx->queue_head && ctx->queue_head >= ctx->queue_size / 2) {
+		memmove(&ctx->queue[0], &ctx->queue[ctx->queue_head],
+			count * sizeof(ctx->queue[0]));
+		if (ctx->queue_pos != VCD_QUEUE_NOPOS)
+			ctx->queue_pos -= ctx->queue_head;
+		ctx->queue_head = 0;
+		ctx->queue_tail = count;
+		return SR_OK;
+	}
 
-static int cmp_items(gconstpointer a, gconstpointer b)
-{
-	const struct vcd_queue_item *item_a, *item_b;
-
-	item_a = a;
-	item_b = b;
-	if (item_a->samplenum > item_b->samplenum)
-		return +1;
-	if (item_a->samplenum < item_b->samplenum)
-		return -1;
-	return 0;
+	size = ctx->queue_size ? 2 * ctx->queue_size : VCD_QUEUE_SIZE;
+	grow = (size - ctx->queue_size) * sizeof(ctx->queue[0]);
+	if (sr_session_mem_charge(ctx->sdi, grow) != SR_OK)
+		return SR_ERR_MALLOC;
+	queue = g_try_realloc_n(ctx->queue, size, sizeof(ctx->queue[0]));
+	if (!queue) {
+		sr_session_mem_release(ctx->sdi, grow);
+		return SR_ERR_MALLOC;
+	}
+	ctx->queue = queue;
+	ctx->queue_size = size;
+
+	return SR_OK;
 }
 
 /*
  * Position the current pointer of the VCD value queue to a specific
- * sample number. Create a new queue item when needed. The logic assumes
- * a specific use pattern: Reception of striped sample data for channels
- * and processing in strict order of sample numbers within a channel.
- * Lower sample numbers near the start of the queue when channels change
- * between session feed packets, before another linear sequence follows.
- *
- * Naive use of convenience glib routines would severely lose performance.
- * That's why custom code is used, which is as complex as it needs to be,
- * yet shall execute faster than a simpler implementation. For trivial
- * cases (logic only, one analog channel only) this queue is bypassed.
+ * sample number. Create a new queue item when needed. Reception of
+ * striped sample data for channels results in mostly increasing sample
+ * numbers, which get appended. Lower numbers are found by a binary
+ * search. For trivial cases (logic only, one analog channel only) this
+ * queue is bypassed.
  */
 static int queue_samplenum(struct context *ctx, uint64_t snum)
 {
-	struct vcd_queue_item *item, *add_item;
-	GList *walk_list, *after_snum, *before_snum, *add_list;
-	GList *last;
-	gboolean add_after_last, do_search;
+	struct vcd_queue_item *item;
+	size_t lo, hi, mid;
+	int rc;
 
 	/* Already at that position? */
-	item = ctx->vcd_queue_last ? ctx->vcd_queue_last->data : NULL;
-	if (item && item->samplenum == snum)
+	if (ctx->queue_pos != VCD_QUEUE_NOPOS &&
+			ctx->queue[ctx->queue_pos].samplenum == snum)
 		return SR_OK;
 
-	/*
-	 * Search after the current position in the remaining queue. The
-	 * custom code uses the queue's being sorted by sample number.
-	 * Narrow down a later insert position as much as possible. This
-	 * avoids linear search in huge spaces later on.
-	 */
-	last = NULL;
-	add_after_last = FALSE;
-	after_snum = NULL;
-	before_snum = NULL;
-	walk_list = ctx->vcd_queue_last;
-	while (walk_list) {
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
-			return SR_OK;
-		}
-		last = walk_list;
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-		if (item->samplenum > snum) {
-			after_snum = walk_list;
-			break;
-		}
-		if (!walk_list->next)
-			add_after_last = TRUE;
-		walk_list = walk_list->next;
-	}
-
-	/*
-	 * No exact match at or beyond the current position. Run another
-	 * search from the start of the queue, again restrict the space
-	 * which is searched, and narrow down the insert position when
-	 * no match is found.
-	 *
-	 * If the searched sample number is larger than any we have seen
-	 * before, or was in the above covered range but was not found,
-	 * then we know that another queue item needs to get added, and
-	 * where to put it. In that case we need not iterate the earlier
-	 * list items.
-	 */
-	walk_list = ctx->vcd_queue_list;
-	do_search = TRUE;
-	if (add_after_last)
-		do_search = FALSE;
-	if (before_snum)
-		do_search = FALSE;
-	while (do_search && walk_list && walk_list != ctx->vcd_queue_last) {
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
-			return SR_OK;
-		}
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-		if (item->samplenum > snum) {
-			after_snum = walk_list;
-			break;
-		}
-		walk_list = walk_list->next;
-	}
-
-	/*
-	 * The complete existing queue was exhausted, no exact match was
-	 * found. A new queue item must get inserted. Identify a good
-	 * position where to start searching for the exact position to
-	 * link the new item to the list. Assume that the combination of
-	 * the glib routine's list traversal and the sample number check
-	 * in the callback is expensive, reduce the amount of work done.
-	 *
-	 * If we have seen an item with a larger sample number than the
-	 * wanted, check its immediate predecessor. If this has a smaller
-	 * sample number, then we found a perfect location to insert the
-	 * new item. If we know that the new item must be inserted after
-	 * the last traversed queue item, start there.
-	 */
-	if (!before_snum) do {
-		if (add_after_last)
-			break;
-		if (!after_snum)
-			break;
-		walk_list = after_snum->prev;
-		if (!walk_list)
-			break;
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
-			return SR_OK;
-		}
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-	} while (0);
-	add_list = add_after_last ? last : before_snum;
-	if (!add_list) {
-		walk_list = ctx->vcd_queue_list;
-		while (walk_list) {
-			item = walk_list->data;
-			if (!item)
-				break;
-			if (item->samplenum == snum) {
-				ctx->vcd_queue_last = walk_list;
-				return SR_OK;
-			}
-			if (item->samplenum > snum) {
-				after_snum = walk_list;
-				break;
-			}
-			add_list = walk_list;
-			walk_list = walk_list->next;
-		}
+	/* Find the first item with a sample number not below snum. */
+	lo = ctx->queue_head;
+	hi = ctx->queue_tail;
+	if (lo < hi && ctx->queue[hi - 1].samplenum < snum)
+		lo = hi;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ctx->queue[mid].samplenum < snum)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	if (add_list && (item = add_list->data) && item->samplenum == snum) {
-		ctx->vcd_queue_last = add_list;
+	if (lo < ctx->queue_tail && ctx->queue[lo].samplenum == snum) {
+		ctx->queue_pos = lo;
 		return SR_OK;
 	}
 
-	/*
-	 * Create a new queue item for the so far untracked sample
-	 * number. Immediately search for the inserted position (is
-	 * unfortunately not returned from the insert call), and
-	 * cache that position for subsequent lookups.
-	 */
+	/* Insert a new item for the so far untracked sample number. */
 	if (with_queue_stats)
 		sr_dbg("%s(), queue nr %" PRIu64, __func__, snum);
-	add_item = queue_alloc_item(ctx, snum);
-	if (!add_item)
-		return SR_ERR_MALLOC;
-	if (!add_list)
-		add_list = ctx->vcd_queue_list;
-	if (add_list && add_list->prev)
-		add_list = add_list->prev;
-	walk_list = g_list_insert_sorted(add_list, add_item, cmp_items);
-	if (!walk_list->prev)
-		ctx->vcd_queue_list = walk_list;
-	walk_list = g_list_find_custom(walk_list, &snum, cmp_snum);
-	item = walk_list ? walk_list->data : NULL;
-	if (item && item->samplenum == snum) {
-		ctx->vcd_queue_last = walk_list;
-	}
+	lo -= ctx->queue_head;
+	rc = queue_reserve(ctx);
+	if (rc != SR_OK)
+		return rc;
+	lo += ctx->queue_head;
+	memmove(&ctx->queue[lo + 1], &ctx->queue[lo],
+		(ctx->queue_tail - lo) * sizeof(ctx->queue[0]));
+	ctx->queue_tail++;
+	item = &ctx->queue[lo];
+	item->samplenum = snum;
+	item->values = NULL;
+	ctx->queue_pos = lo;
+
 	return SR_OK;
 }
 
@@ -766,14 +674,14 @@ static GString *queue_value_text_prep(struct context *ctx)
 	GString *buff;
 
 	/* Cope with not-yet-positioned write pointers. */
-	item = ctx->vcd_queue_last ? ctx->vcd_queue_last->data : NULL;
-	if (!item)
+	if (ctx->queue_pos == VCD_QUEUE_NOPOS)
 		return NULL;
+	item = &ctx->queue[ctx->queue_pos];
 
-	/* Create a GString if not done already. */
+	/* Get a GString if not done already. */
 	buff = item->values;
 	if (!buff) {
-		buff = g_string_sized_new(20);
+		buff = queue_alloc_text(ctx);
 		item->values = buff;
 	}
 
@@ -784,17 +692,6 @@ static GString *queue_value_text_prep(struct context *ctx)
 	return buff;
 }
 
-static double snum_to_ts(struct context *ctx, uint64_t snum)
-{
-	double ts;
-
-	ts = (double)snum;
-	ts /= ctx->samplerate;
-	ts *= ctx->period;
-
-	return ts;
-}
-
 /*
  * Unqueue one item of the VCD values queue which corresponds to one
  * sample number. Append all of the text to the passed in GString.
@@ -802,7 +699,6 @@ static double snum_to_ts(struct context *ctx, uint64_t snum)
 static int unqueue_item(struct context *ctx,
 	struct vcd_queue_item *item, GString *s)
 {
-	double ts;
 	GString *buff;
 	gboolean is_empty;
 
@@ -812,12 +708,11 @@ static int unqueue_item(struct context *ctx,
 	 * timestamp but no value changes, assuming this is the last
 	 * entry which corresponds to SR_DF_END.
 	 */
-	ts = snum_to_ts(ctx, item->samplenum);
 	buff = item->values;
 	is_empty = !buff || !buff->len || !buff->str || !*buff->str;
-	append_vcd_timestamp(s, ts, is_empty);
+	append_vcd_timestamp(ctx, s, item->samplenum, is_empty);
 	if (!is_empty)
-		g_string_append(s, buff->str);
+		g_string_append_len(s, buff->str, buff->len);
 
 	return SR_OK;
 }
@@ -934,10 +829,8 @@ static uint64_t get_max_snum_flush(struct context *ctx)
 static int write_completed_changes(struct context *ctx, GString *out)
 {
 	uint64_t upto_snum;
-	GList **listref, *node;
 	struct vcd_queue_item *item;
 	int rc;
-	size_t dumped;
 
 	/* Determine the number which all data was received for so far. */
 	upto_snum = get_max_snum_export(ctx);
@@ -945,40 +838,167 @@ static int write_completed_changes(struct context *ctx, GString *out)
 		sr_spew("%s(), check up to %" PRIu64, __func__, upto_snum);
 
 	/*
-	 * Forward and consume those items from the head of the list
+	 * Forward and consume those items from the head of the queue
 	 * which we completely have accumulated and are certain about.
+	 * Void the cached position when its item gets consumed.
 	 */
-	dumped = 0;
-	listref = &ctx->vcd_queue_list;
-	while (*listref) {
-		/* Find items before the targetted sample number. */
-		node = *listref;
-		item = node->data;
-		if (!item)
-			break;
+	while (ctx->queue_head < ctx->queue_tail) {
+		item = &ctx->queue[ctx->queue_head];
 		if (item->samplenum >= upto_snum)
 			break;
 
-		/*
-		 * Unlink the item from the list. Void cached positions.
-		 * Append its timestamp and values to the caller's text.
-		 */
-		dumped++;
 		if (with_queue_stats)
 			sr_dbg("%s(), dump nr %" PRIu64,
 				__func__, item->samplenum);
-		if (ctx->vcd_queue_last == node)
-			ctx->vcd_queue_last = NULL;
-		*listref = g_list_remove_link(*listref, node);
+		if (ctx->queue_pos == ctx->queue_head)
+			ctx->queue_pos = VCD_QUEUE_NOPOS;
+		ctx->queue_head++;
 		rc = unqueue_item(ctx, item, out);
-		queue_free_item(ctx, item);
+		queue_free_text(ctx, item->values);
+		item->values = NULL;
 		if (rc != SR_OK)
 			return rc;
 	}
+	if (ctx->queue_head == ctx->queue_tail) {
+		ctx->queue_head = ctx->queue_tail = 0;
+		ctx->queue_pos = VCD_QUEUE_NOPOS;
+	}
 
 	return SR_OK;
 }
 
+/*
+ * Find the next logic sample which differs from its predecessor, at or
+ * after byte offset pos in the data image. Compares the image against
+ * itself shifted by one sample, a machine word at a time, and returns
+ * the byte offset of the first difference (or len when there is none).
+ */
+static size_t find_logic_change(const uint8_t *data, size_t len,
+	size_t unit_size, size_t pos)
+{
+	uint64_t curr, prev;
+
+	while (pos + sizeof(curr) <= len) {
+		memcpy(&curr, &data[pos], sizeof(curr));
+		memcpy(&prev, &data[pos - unit_size], sizeof(prev));
+		if (curr ^ prev)
+			break;
+		pos += sizeof(curr);
+	}
+	while (pos < len && data[pos] == data[pos - unit_size])
+		pos++;
+
+	return pos;
+}
+
+/*
+ * Check one logic sample for value changes, and queue or emit the text
+ * for the channels which changed.
+ */
+static void logic_sample(struct context *ctx, GString *out,
+	const uint8_t *sample, size_t unit_size, uint64_t snum)
+{
+	struct vcd_channel_desc *desc;
+	size_t index, p;
+	gboolean changed;
+	GString *s_val;
+	uint8_t prevbit, curbit;
+
+	/* Check whether any logic value has changed. */
+	changed = memcmp(ctx->last_logic, sample, unit_size) != 0;
+	changed |= snum == 0;
+	if (!changed)
+		return;
+	memcpy(ctx->last_logic, sample, unit_size);
+
+	/*
+	 * Start or continue tracking that sample number.
+	 * Avoid string copies for logic-only setups.
+	 */
+	if (ctx->immediate_write)
+		append_vcd_timestamp(ctx, out, snum, FALSE);
+	else
+		queue_samplenum(ctx, snum);
+
+	/* Iterate over individual logic channels. */
+	for (p = 0; p < ctx->enabled_count; p++) {
+		/*
+		 * TODO Check whether the mapping from
+		 * data image positions to channel numbers
+		 * is required. Experiments suggest that
+		 * the data image "is dense", and packs
+		 * bits of enabled channels, and leaves no
+		 * room for positions of disabled channels.
+		 */
+		desc = &ctx->channels[p];
+		if (desc->type != SR_CHANNEL_LOGIC)
+			continue;
+		index = desc->index;
+		prevbit = desc->last.logic;
+
+		/* Skip over unchanged values. */
+		curbit = sample[index / 8];
+		curbit = (curbit & (1 << (index % 8))) ? 1 : 0;
+		if (snum != 0 && prevbit == curbit)
+			continue;
+		desc->last.logic = curbit;
+
+		/*
+		 * Queue, or immediately emit the text for
+		 * the observed value change.
+		 */
+		if (ctx->immediate_write) {
+			g_string_append_c(out, ' ');
+			s_val = out;
+		} else {
+			s_val = queue_value_text_prep(ctx);
+			if (!s_val)
+				break;
+		}
+		format_vcd_value_bit(s_val, curbit, desc->name);
+	}
+}
+
+/*
+ * Check for changes in an analog channel's values, which are 'stride'
+ * floats apart. Have the sample number's timestamp and new value printed
+ * when the value has changed by more than the dead band, relative to the
+ * last written value (so slow drifts still show). The negated compare
+ * also catches the initial NaN.
+ */
+static void analog_samples(struct context *ctx, GString *out,
+	struct vcd_channel_desc *desc, const float *values, size_t stride,
+	size_t count)
+{
+	uint64_t snum_curr;
+	size_t index;
+	gboolean changed;
+	GString *s_val;
+	float value;
+
+	snum_curr = get_last_snum_analog(desc);
+	upd_last_snum_analog(desc, count);
+
+	for (index = 0; index < count; index++) {
+		value = values[index * stride];
+		changed = !(fabs(value - desc->last.real) <= ctx->deadband);
+		changed |= snum_curr + index == 0;
+		if (!changed)
+			continue;
+		desc->last.real = value;
+
+		/* Queue, or emit the timestamp and the new value. */
+		if (ctx->immediate_write) {
+			append_vcd_timestamp(ctx, out, snum_curr + index, FALSE);
+			s_val = out;
+		} else {
+			queue_samplenum(ctx, snum_curr + index);
+			s_val = queue_value_text_prep(ctx);
+		}
+		format_vcd_value_real(s_val, value, desc->name);
+	}
+}
+
 /* Get packets from the session feed, generate output text. */
 static int receive(const struct sr_output *o,
 	const struct sr_datafeed_packet *packet, GString **out)
@@ -986,20 +1006,18 @@ static int receive(const struct sr_output *o,
 	struct context *ctx;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
 	GSList *l;
 	struct vcd_channel_desc *desc;
-	uint64_t snum_curr;
-	size_t count, index, p, unit_size;
-	gboolean changed;
-	GString *s_val;
-	uint8_t *sample, *last_logic, prevbit, curbit;
-	GSList *channels;
+	uint64_t snum_curr, run;
+	size_t count, index, unit_size, len, pos, num_channels;
+	uint8_t *sample;
 	struct sr_channel *channel;
 	int rc;
-	float *floats, value;
-	double ts;
+	float *floats;
+	const float *values;
 
 	*out = NULL;
 	if (!o || !o->priv)
@@ -1014,6 +1032,8 @@ static int receive(const struct sr_output *o,
 			if (src->key != SR_CONF_SAMPLERATE)
 				continue;
 			ctx->samplerate = g_variant_get_uint64(src->data);
+			/* The timescale was fixed by an earlier header. */
+			ctx->ts_factor = 0;
 		}
 		break;
 	case SR_DF_LOGIC:
@@ -1026,67 +1046,44 @@ static int receive(const struct sr_output *o,
 		snum_curr = get_last_snum_logic(ctx);
 		upd_last_snum_logic(ctx, count);
 
-		last_logic = ctx->last_logic;
-		while (count--) {
-			/* Check whether any logic value has changed. */
-			changed = memcmp(last_logic, sample, unit_size) != 0;
-			changed |= snum_curr == 0;
-			if (changed)
-				memcpy(last_logic, sample, unit_size);
-
-			/*
-			 * Start or continue tracking that sample number.
-			 * Avoid string copies for logic-only setups.
-			 */
-			if (changed) {
-				if (ctx->immediate_write) {
-					ts = snum_to_ts(ctx, snum_curr);
-					append_vcd_timestamp(*out, ts, FALSE);
-				} else {
-					queue_samplenum(ctx, snum_curr);
-				}
-			}
+		/*
+		 * Check the first sample against the previous packet's
+		 * last value. Then skip over runs of unchanged samples
+		 * and only inspect the samples which differ.
+		 */
+		if (count)
+			logic_sample(ctx, *out, sample, unit_size, snum_curr);
+		len = count * unit_size;
+		pos = unit_size;
+		while (pos < len) {
+			pos = find_logic_change(sample, len, unit_size, pos);
+			if (pos >= len)
+				break;
+			index = pos / unit_size;
+			logic_sample(ctx, *out, &sample[index * unit_size],
+				unit_size, snum_curr + index);
+			pos = (index + 1) * unit_size;
+		}
+		write_completed_changes(ctx, *out);
+		break;
+	case SR_DF_LOGIC_RLE:
+		*out = chk_header(o);
 
-			/* Iterate over individual logic channels. */
-			for (p = 0; changed && p < ctx->enabled_count; p++) {
-				/*
-				 * TODO Check whether the mapping from
-				 * data image positions to channel numbers
-				 * is required. Experiments suggest that
-				 * the data image "is dense", and packs
-				 * bits of enabled channels, and leaves no
-				 * room for positions of disabled channels.
-				 */
-				desc = &ctx->channels[p];
-				if (desc->type != SR_CHANNEL_LOGIC)
-					continue;
-				index = desc->index;
-				prevbit = desc->last.logic;
-
-				/* Skip over unchanged values. */
-				curbit = sample[index / 8];
-				curbit = (curbit & (1 << (index % 8))) ? 1 : 0;
-				if (snum_curr != 0 && prevbit == curbit)
-					continue;
-				desc->last.logic = curbit;
-
-				/*
-				 * Queue, or immediately emit the text for
-				 * the observed value change.
-				 */
-				if (ctx->immediate_write) {
-					g_string_append_c(*out, ' ');
-					s_val = *out;
-				} else {
-					s_val = queue_value_text_prep(ctx);
-					if (!s_val)
-						break;
-				}
-				format_vcd_value_bit(s_val, curbit, desc->name);
+		/*
+		 * A run holds one value, only its first sample can carry
+		 * a change. Skip over the rest of the run.
+		 */
+		rle = packet->payload;
+		sample = rle->values;
+		unit_size = rle->unitsize;
+		snum_curr = get_last_snum_logic(ctx);
+		upd_last_snum_logic(ctx, sr_logic_rle_num_samples(rle));
+		for (run = 0; run < rle->num_runs; run++) {
+			if (rle->run_lengths[run]) {
+				logic_sample(ctx, *out, sample, unit_size,
+					snum_curr);
+				snum_curr += rle->run_lengths[run];
 			}
-
-			/* Advance to next set of logic samples. */
-			snum_curr++;
 			sample += unit_size;
 		}
 		write_completed_changes(ctx, *out);
@@ -1095,68 +1092,43 @@ static int receive(const struct sr_output *o,
 		*out = chk_header(o);
 
 		/*
-		 * This implementation expects one analog packet per
-		 * individual channel, with a number of samples each.
-		 * Lookup the VCD output channel description.
+		 * Convert incoming data to an array of single precision
+		 * floating point values. Packets of several channels have
+		 * their samples interleaved.
 		 */
 		analog = packet->payload;
 		count = analog->num_samples;
-		channels = analog->meaning->channels;
-		if (g_slist_length(channels) != 1) {
-			sr_err("Analog packets must be single-channel.");
+		num_channels = g_slist_length(analog->meaning->channels);
+		if (!num_channels)
 			return SR_ERR_ARG;
-		}
-		channel = g_slist_nth_data(channels, 0);
-		desc = NULL;
-		for (index = 0; index < ctx->enabled_count; index++) {
-			desc = &ctx->channels[index];
-			if ((int)desc->index == channel->index)
-				break;
-		}
-		if (!desc)
-			return SR_OK;
-		if (desc->type != SR_CHANNEL_ANALOG)
-			return SR_ERR;
-		snum_curr = get_last_snum_analog(desc);
-		upd_last_snum_analog(desc, count);
-
-		/*
-		 * Convert incoming data to an array of single precision
-		 * floating point values.
-		 */
-		floats = g_try_malloc(sizeof(*floats) * analog->num_samples);
+		floats = g_try_malloc(sizeof(*floats) * count * num_channels);
 		if (!floats)
 			return SR_ERR_MALLOC;
-		rc = sr_analog_to_float(analog, floats);
+		rc = sr_analog_to_float_view(analog, floats, &values);
 		if (rc != SR_OK) {
 			g_free(floats);
 			return rc;
 		}
 
-		/*
-		 * Check for changes in the channel's values. Have the
-		 * sample number's timestamp and new value printed when
-		 * the value has changed.
-		 */
-		for (index = 0; index < count; index++) {
-			/* Check for changes in the channel's values. */
-			value = floats[index];
-			changed = value != desc->last.real;
-			changed |= snum_curr + index == 0;
-			if (!changed)
+		/* Lookup each channel's VCD output channel description. */
+		pos = 0;
+		for (l = analog->meaning->channels; l; l = l->next, pos++) {
+			channel = l->data;
+			desc = NULL;
+			for (index = 0; index < ctx->enabled_count; index++) {
+				if ((int)ctx->channels[index].index == channel->index) {
+					desc = &ctx->channels[index];
+					break;
+				}
+			}
+			if (!desc)
 				continue;
-			desc->last.real = value;
-
-			/* Queue, or emit the timestamp and the new value. */
-			if (ctx->immediate_write) {
-				ts = snum_to_ts(ctx, snum_curr + index);
-				append_vcd_timestamp(*out, ts, FALSE);
-				s_val = *out;
-			} else {
-				queue_samplenum(ctx, snum_curr + index);
-				s_val = queue_value_text_prep(ctx);
+			if (desc->type != SR_CHANNEL_ANALOG) {
+				g_free(floats);
+				return SR_ERR;
 			}
-			format_vcd_value_real(s_val, value, desc->name);
+			analog_samples(ctx, *out, desc, &values[pos],
+				num_channels, count);
 		}
 
 		g_free(floats);
@@ -1172,6 +1144,10 @@ static int receive(const struct sr_output *o,
 		break;
 	}
 
+	/* Size the next packet's text after this one's, avoid reallocs. */
+	if (*out)
+		ctx->out_size = MAX(VCD_OUT_SIZE, (*out)->len + 1);
+
 	return SR_OK;
 }
 
@@ -1189,6 +1165,7 @@ static int cleanup(struct sr_output *o)
 		sr_info("STATS: alloc/reuse %zu/%zu, pool/free %zu/%zu",
 			ctx->alloced, ctx->reused, ctx->pooled, ctx->freed);
 	queue_drain_pool(ctx);
+	g_free(ctx->last_logic);
 	if (with_pool_stats)
 		sr_info("STATS: alloc/reuse %zu/%zu, pool/free %zu/%zu",
 			ctx->alloced, ctx->reused, ctx->pooled, ctx->freed);
@@ -1203,13 +1180,26 @@ static int cleanup(struct sr_output *o)
 	return SR_OK;
 }
 
+static struct sr_option options[] = {
+	{ "deadband", "Dead band", "Skip analog value changes up to this magnitude", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_double(0.0));
+
+	return options;
+}
+
 struct sr_output_module output_vcd = {
 	.id = "vcd",
 	.name = "VCD",
 	.desc = "Value Change Dump data",
 	.exts = (const char*[]){"vcd", NULL},
-	.flags = 0,
-	.options = NULL,
+	.flags = SR_OUTPUT_LOGIC_RLE,
+	.options = get_options,
 	.init = init,
 	.receive = receive,
 	.cleanup = cleanup,
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -27,65 +28,85 @@
 /* Minimum/maximum number of samples per channel to put in a data chunk */
 #define MIN_DATA_CHUNK_SAMPLES 10
 
+enum sample_format {
+	FMT_FLOAT32,
+	FMT_INT16,
+	FMT_INT24,
+};
+
+static const struct {
+	const char *name;
+	uint16_t code;		/* WAVE format tag */
+	size_t size;		/* Bytes per value */
+	float full_scale;	/* Integer value for +1.0, unused for float */
+} sample_formats[] = {
+	[FMT_FLOAT32] = { "float32", 0x0003, 4, 0.0f, },
+	[FMT_INT16] = { "int16", 0x0001, 2, 32767.0f, },
+	[FMT_INT24] = { "int24", 0x0001, 3, 8388607.0f, },
+};
+
 struct out_context {
 	double scale;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
-	int chanbuf_size;
-	int *chanbuf_used;
-	uint8_t **chanbuf;
+	enum sample_format format;
+	size_t sample_size;
+	size_t frame_size;
+	/*
+	 * Interleaved frames for packets which don't carry all channels.
+	 * Each channel's values get encoded into its column, complete
+	 * frames are written out as soon as all channels caught up.
+	 */
+	uint8_t *framebuf;
+	size_t framebuf_size;
+	size_t *frames_used;
+	int *chan_idx;
 	float *fdata;
 };
 
-static int realloc_chanbufs(const struct sr_output *o, int size)
+static int realloc_framebuf(struct out_context *outc, size_t frames)
 {
-	struct out_context *outc;
-	int i;
+	uint8_t *buf;
 
-	outc = o->priv;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (!(outc->chanbuf[i] = g_try_realloc(outc->chanbuf[i], sizeof(float) * size))) {
-			sr_err("Unable to allocate enough output buffer memory.");
-			return SR_ERR;
-		}
-		outc->chanbuf_used[i] = 0;
+	if (frames <= outc->framebuf_size)
+		return SR_OK;
+	frames = MAX(frames, 2 * outc->framebuf_size);
+	if (!(buf = g_try_realloc(outc->framebuf, frames * outc->frame_size))) {
+		sr_err("Unable to allocate enough output buffer memory.");
+		return SR_ERR_MALLOC;
 	}
-	outc->chanbuf_size = size;
+	outc->framebuf = buf;
+	outc->framebuf_size = frames;
 
 	return SR_OK;
 }
 
-static int flush_chanbufs(const struct sr_output *o, GString *out)
+/* Write out complete frames, keep partially filled ones for later. */
+static void flush_framebuf(struct out_context *outc, GString *out,
+		size_t min_frames)
 {
-	struct out_context *outc;
-	int num_samples, i, j;
-	char *buf, *bufp;
+	size_t complete, used, i;
 
-	outc = o->priv;
-
-	/* Any one of them will do. */
-	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
+	complete = SIZE_MAX;
+	used = 0;
+	for (i = 0; i < (size_t)outc->num_channels; i++) {
+		complete = MIN(complete, outc->frames_used[i]);
+		used = MAX(used, outc->frames_used[i]);
 	}
-
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
-		}
+	if (!used || !complete || complete <= min_frames)
+		return;
+
+	g_string_append_len(out, (const char *)outc->framebuf,
+		complete * outc->frame_size);
+	if (used > complete) {
+		memmove(outc->framebuf,
+			outc->framebuf + complete * outc->frame_size,
+			(used - complete) * outc->frame_size);
 	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
-
-	for (i = 0; i < outc->num_channels; i++)
-		outc->chanbuf_used[i] = 0;
-
-	return SR_OK;
+	for (i = 0; i < (size_t)outc->num_channels; i++)
+		outc->frames_used[i] -= complete;
 }
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -93,11 +114,27 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct out_context *outc;
 	struct sr_channel *ch;
 	GSList *l;
+	const char *format;
+	size_t i;
 
 	outc = g_malloc0(sizeof(struct out_context));
 	o->priv = outc;
 	outc->scale = g_variant_get_double(g_hash_table_lookup(options, "scale"));
 
+	format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+	for (i = 0; i < ARRAY_SIZE(sample_formats); i++) {
+		if (strcmp(format, sample_formats[i].name) == 0)
+			break;
+	}
+	if (i == ARRAY_SIZE(sample_formats)) {
+		sr_err("Unsupported sample format '%s'.", format);
+		g_free(outc);
+		o->priv = NULL;
+		return SR_ERR_ARG;
+	}
+	outc->format = i;
+	outc->sample_size = sample_formats[i].size;
+
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_ANALOG)
@@ -107,12 +144,17 @@ static int init(struct sr_output *o, GHashTable *options)
 		outc->channels = g_slist_append(outc->channels, ch);
 		outc->num_channels++;
 	}
+	outc->frame_size = outc->sample_size * outc->num_channels;
 
-	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
-	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->frames_used = g_malloc0(sizeof(size_t) * outc->num_channels);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
 
 	/* Start off the interleaved buffer with 100 samples/channel. */
-	realloc_chanbufs(o, 100);
+	realloc_framebuf(outc, 100);
+
+	/* The header maxes out the sizes, segments simply append frames. */
+	o->segment_align = 1;
+	outc->header_done = o->segment_continued;
 
 	return SR_OK;
 }
@@ -127,8 +169,8 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Remaining chunk size */
 	WL32(tmp, 0x12);
 	g_string_append_len(gs, tmp, 4);
-	/* Format code 3 = IEEE float */
-	WL16(tmp, 0x0003);
+	/* Format code 1 = integer PCM, 3 = IEEE float */
+	WL16(tmp, sample_formats[outc->format].code);
 	g_string_append_len(gs, tmp, 2);
 	/* Number of channels */
 	WL16(tmp, outc->num_channels);
@@ -136,14 +178,14 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Samplerate */
 	WL32(tmp, outc->samplerate);
 	g_string_append_len(gs, tmp, 4);
-	/* Byterate, using 32-bit floats. */
-	WL32(tmp, outc->samplerate * outc->num_channels * 4);
+	/* Byterate */
+	WL32(tmp, outc->samplerate * outc->frame_size);
 	g_string_append_len(gs, tmp, 4);
 	/* Blockalign */
-	WL16(tmp, outc->num_channels * 4);
+	WL16(tmp, outc->frame_size);
 	g_string_append_len(gs, tmp, 2);
 	/* Bits per sample */
-	WL16(tmp, 32);
+	WL16(tmp, 8 * outc->sample_size);
 	g_string_append_len(gs, tmp, 2);
 	WL16(tmp, 0);
 	g_string_append_len(gs, tmp, 2);
@@ -181,56 +223,69 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
-/*
- * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
- */
-static void float_to_le(uint8_t *buf, float value)
+/* Map a value to the integer range, clipping at full scale. */
+static inline int32_t float_to_pcm(float value, float full_scale)
 {
-	uint8_t *old;
-
-	old = (uint8_t *)&value;
-#ifdef WORDS_BIGENDIAN
-	buf[0] = old[3];
-	buf[1] = old[2];
-	buf[2] = old[1];
-	buf[3] = old[0];
-#else
-	buf[0] = old[0];
-	buf[1] = old[1];
-	buf[2] = old[2];
-	buf[3] = old[3];
-#endif
+	value *= full_scale;
+	if (isnan(value))
+		return 0;
+	if (value >= full_scale)
+		return full_scale;
+	if (value <= -full_scale)
+		return -full_scale;
+
+	return lrintf(value);
 }
 
 /*
- * Returns the number of samples used in the current channel buffers,
- * or -1 if they're not all the same.
+ * Convert 'count' values to the output format, taking every
+ * 'src_stride'th value from 'src' and storing them 'dst_stride'
+ * bytes apart. Both strides are in units of samples and bytes.
  */
-static int check_chanbuf_size(const struct sr_output *o)
+static void encode_values(const struct out_context *outc,
+		uint8_t *dst, size_t dst_stride,
+		const float *src, size_t src_stride, size_t count)
 {
-	struct out_context *outc;
-	int size, i;
-
-	outc = o->priv;
-	size = 0;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (size == 0) {
-			if (outc->chanbuf_used[i] == 0) {
-				/* Nothing in all the buffers yet. */
-				size = -1;
+	float f, full_scale;
+	size_t i;
+
+	full_scale = sample_formats[outc->format].full_scale;
+	switch (outc->format) {
+	case FMT_FLOAT32:
+		if (outc->scale == 1.0) {
+#ifndef WORDS_BIGENDIAN
+			if (src_stride == 1 && dst_stride == sizeof(float)) {
+				memcpy(dst, src, count * sizeof(float));
 				break;
-			} else {
-				/* New high water mark. */
-				size = outc->chanbuf_used[i];
 			}
-		} else if (outc->chanbuf_used[i] != size) {
-			/* All channel buffers are not equally full yet. */
-			size = -1;
+#endif
+			for (i = 0; i < count; i++, dst += dst_stride)
+				write_fltle(dst, src[i * src_stride]);
 			break;
 		}
+		for (i = 0; i < count; i++, dst += dst_stride) {
+			f = src[i * src_stride];
+			f /= outc->scale;
+			write_fltle(dst, f);
+		}
+		break;
+	case FMT_INT16:
+		for (i = 0; i < count; i++, dst += dst_stride) {
+			f = src[i * src_stride];
+			if (outc->scale != 1.0)
+				f /= outc->scale;
+			write_u16le(dst, float_to_pcm(f, full_scale));
+		}
+		break;
+	case FMT_INT24:
+		for (i = 0; i < count; i++, dst += dst_stride) {
+			f = src[i * src_stride];
+			if (outc->scale != 1.0)
+				f /= outc->scale;
+			write_u24le(dst, float_to_pcm(f, full_scale));
+		}
+		break;
 	}
-
-	return size;
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -240,13 +295,13 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
-	struct sr_channel *ch;
 	GSList *l;
 	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
+	int num_channels, idx, i, ret;
+	gboolean in_order, pending;
+	size_t num_samples, len;
 	float *data;
-	uint8_t *buf;
+	const float *values;
 
 	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
@@ -277,7 +332,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (!(data = g_try_realloc(outc->fdata, sizeof(float) * num_samples * num_channels)))
 			return SR_ERR_MALLOC;
 		outc->fdata = data;
-		ret = sr_analog_to_float(analog, data);
+		ret = sr_analog_to_float_view(analog, data, &values);
 		if (ret != SR_OK)
 			return ret;
 
@@ -290,41 +345,57 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return SR_ERR;
 		}
 
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
-				return SR_ERR_MALLOC;
-		}
-
 		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
-		for (i = 0; i < num_channels; i++) {
-			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
+		in_order = num_channels == outc->num_channels;
+		for (i = 0, l = (GSList *)channels; l; i++, l = l->next) {
+			idx = g_slist_index(outc->channels, l->data);
+			if (idx < 0) {
+				sr_err("Packet has data for a channel which is not enabled.");
+				return SR_ERR;
+			}
+			outc->chan_idx[i] = idx;
+			if (idx != i)
+				in_order = FALSE;
+		}
+		pending = FALSE;
+		for (i = 0; i < outc->num_channels; i++) {
+			if (outc->frames_used[i])
+				pending = TRUE;
 		}
 
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 1.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
-			}
+		/*
+		 * A packet with all channels in output order is already
+		 * interleaved. Convert it into the output text in one go.
+		 */
+		if (in_order && !pending) {
+			len = (*out)->len;
+			g_string_set_size(*out, len + num_samples * outc->frame_size);
+			encode_values(outc, (uint8_t *)(*out)->str + len,
+				outc->sample_size, values, 1,
+				num_samples * num_channels);
+			break;
 		}
-		g_free(chan_idx);
 
-		size = check_chanbuf_size(o);
-		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
+		for (i = 0; i < num_channels; i++) {
+			idx = outc->chan_idx[i];
+			ret = realloc_framebuf(outc,
+				outc->frames_used[idx] + num_samples);
+			if (ret != SR_OK)
+				return ret;
+			encode_values(outc, outc->framebuf
+				+ outc->frames_used[idx] * outc->frame_size
+				+ idx * outc->sample_size, outc->frame_size,
+				values + i, num_channels, num_samples);
+			outc->frames_used[idx] += num_samples;
+		}
+		flush_framebuf(outc, *out, MIN_DATA_CHUNK_SAMPLES);
 		break;
 	case SR_DF_END:
-		size = check_chanbuf_size(o);
-		if (size > 0) {
-			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
+		*out = g_string_sized_new(512);
+		flush_framebuf(outc, *out, 0);
+		if (!(*out)->len) {
+			g_string_free(*out, TRUE);
+			*out = NULL;
 		}
 		break;
 	}
@@ -334,13 +405,24 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "format", "Sample format", "Sample format, integer formats clip at +/-1.0 after scaling", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
+	GSList *l = NULL;
+	size_t i;
+
+	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_double(1.0));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(
+			sample_formats[FMT_FLOAT32].name));
+		for (i = 0; i < ARRAY_SIZE(sample_formats); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(sample_formats[i].name)));
+		options[1].values = l;
+	}
 
 	return options;
 }
@@ -348,15 +430,12 @@ static const struct sr_option *get_options(void)
 static int cleanup(struct sr_output *o)
 {
 	struct out_context *outc;
-	int i;
 
 	outc = o->priv;
 	g_slist_free(outc->channels);
-	g_variant_unref(options[0].def);
-	for (i = 0; i < outc->num_channels; i++)
-		g_free(outc->chanbuf[i]);
-	g_free(outc->chanbuf_used);
-	g_free(outc->chanbuf);
+	g_free(outc->framebuf);
+	g_free(outc->frames_used);
+	g_free(outc->chan_idx);
 	g_free(outc->fdata);
 	g_free(outc);
 	o->priv = NULL;
@@ -27,93 +27,116 @@
 struct context {
 	uint32_t channel_count;
 	struct sr_channel **channels;
-	GString **channel_outputs; /* output strings */
+	/* Bytes of a sample set which hold enabled channels, and their mask. */
+	size_t sample_bytes;
+	uint8_t *sample_mask;
+	uint8_t *sample;
+	/*
+	 * Run-length encoded sample sets of the current document. Memory
+	 * use depends on the number of changes, not the number of samples.
+	 */
+	GByteArray *run_data;
+	GArray *run_length;
+	uint64_t num_steps;
+	uint64_t num_documents;
+	gboolean collapse;
+	uint64_t window;
 };
 
-/* Converts accumulated output data to a JSON string. */
-static GString *wavedrom_render(const struct context *ctx)
+/* Renders accumulated sample runs as a JSON document. */
+static void wavedrom_render(struct context *ctx, GString *output)
 {
-	GString *output;
-	size_t ch, i;
+	const uint8_t *data;
+	uint64_t length;
+	size_t ch, i, len;
 	char last_char, curr_char;
+	gboolean first;
 
-	output = g_string_new("{ \"signal\": [");
+	if (ctx->num_documents++)
+		g_string_append_c(output, '\n');
+	g_string_append(output, "{ \"signal\": [");
+	first = TRUE;
 	for (ch = 0; ch < ctx->channel_count; ch++) {
-		if (!ctx->channel_outputs[ch])
+		if (!ctx->channels[ch])
 			continue;
 
 		/* Channel strip. */
 		g_string_append_printf(output,
-			"{ \"name\": \"%s\", \"wave\": \"", ctx->channels[ch]->name);
+			"%s{ \"name\": \"%s\", \"wave\": \"",
+			first ? "" : ",", ctx->channels[ch]->name);
+		first = FALSE;
 
 		last_char = 0;
-		for (i = 0; i < ctx->channel_outputs[ch]->len; i++) {
-			curr_char = ctx->channel_outputs[ch]->str[i];
-			/* Data point. */
-			if (curr_char == last_char) {
-				g_string_append_c(output, '.');
-			} else {
+		for (i = 0; i < ctx->run_length->len; i++) {
+			data = ctx->run_data->data + i * ctx->sample_bytes;
+			length = ctx->collapse ? 1 :
+				g_array_index(ctx->run_length, uint64_t, i);
+			curr_char = (data[ch / 8] & (1 << (ch % 8))) ? '1' : '0';
+			/* Data point, repeated ones are shown as dots. */
+			if (curr_char != last_char) {
 				g_string_append_c(output, curr_char);
 				last_char = curr_char;
+				length--;
+			}
+			if (length) {
+				len = output->len;
+				g_string_set_size(output, len + length);
+				memset(output->str + len, '.', length);
 			}
 		}
-		if (ch < ctx->channel_count - 1) {
-			g_string_append(output, "\" },");
-		} else {
-			/* Last channel, no comma. */
-			g_string_append(output, "\" }");
-		}
+		g_string_append(output, "\" }");
 	}
 	g_string_append(output, "], \"config\": { \"skin\": \"narrow\" }}");
 
-	return output;
+	g_byte_array_set_size(ctx->run_data, 0);
+	g_array_set_size(ctx->run_length, 0);
+	ctx->num_steps = 0;
 }
 
-static void process_logic(const struct context *ctx,
-	const struct sr_datafeed_logic *logic)
+static void process_logic(struct context *ctx,
+	const struct sr_datafeed_logic *logic, GString **out)
 {
-	size_t sample_count, ch, i;
-	uint8_t *sample, bit;
-	GString *accu;
+	size_t sample_count, i, b;
+	const uint8_t *sample;
+	uint64_t *length, one;
 
-	if (!ctx->channel_count)
+	if (!ctx->sample_bytes || !logic->unitsize)
 		return;
 
 	/*
-	 * Extract the logic bits for each channel and store them
-	 * as wavedrom letters (1/0) in each channel's text string.
-	 * This transforms the input which consists of sample sets
-	 * that span multiple channels into output stripes per logic
-	 * channel which consist of bits for that individual channel.
-	 *
-	 * TODO Reduce memory consumption during accumulation of
-	 * output data.
-	 *
-	 * Ideally we'd accumulate binary chunks, and defer conversion
-	 * to the text format. Analog data already won't get here, only
-	 * logic data does. When the per-channel transformation also
-	 * gets deferred until later, then the only overhead would be
-	 * for disabled logic channels. Which may be acceptable or even
-	 * negligable.
-	 *
-	 * An optional addition to the above mentioned accumulation of
-	 * binary data is RLE compression. Mark both the position in the
-	 * accumulated data as well as a repetition counter, instead of
-	 * repeatedly storing the same sample set. The efficiency of
-	 * this approach of course depends on the change rate of input
-	 * data. But the approach perfectly matches the WaveDrom syntax
-	 * for repeated bit patterns, and thus is easily handled in the
-	 * text rendering stage of the output module.
+	 * Only keep the enabled channels' bits of each sample set, and
+	 * count repetitions instead of storing the same sample set again.
+	 * This matches the WaveDrom syntax for repeated bit patterns, the
+	 * per-channel strips get created in the text rendering stage.
 	 */
+	one = 1;
 	sample_count = logic->length / logic->unitsize;
 	for (i = 0; i < sample_count; i++) {
 		sample = logic->data + i * logic->unitsize;
-		for (ch = 0; ch < ctx->channel_count; ch++) {
-			accu = ctx->channel_outputs[ch];
-			if (!accu)
-				continue;
-			bit = sample[ch / 8] & (1 << (ch % 8));
-			g_string_append_c(accu, bit ? '1' : '0');
+		for (b = 0; b < ctx->sample_bytes; b++) {
+			ctx->sample[b] = b < logic->unitsize ?
+				sample[b] & ctx->sample_mask[b] : 0;
+		}
+		if (ctx->run_length->len && memcmp(ctx->sample,
+				ctx->run_data->data + ctx->run_data->len - ctx->sample_bytes,
+				ctx->sample_bytes) == 0) {
+			length = &g_array_index(ctx->run_length, uint64_t,
+				ctx->run_length->len - 1);
+			(*length)++;
+			if (!ctx->collapse)
+				ctx->num_steps++;
+		} else {
+			g_byte_array_append(ctx->run_data, ctx->sample,
+				ctx->sample_bytes);
+			g_array_append_val(ctx->run_length, one);
+			ctx->num_steps++;
+		}
+
+		/* Emit a complete document per window of steps. */
+		if (ctx->window && ctx->num_steps >= ctx->window) {
+			if (!*out)
+				*out = g_string_sized_new(512);
+			wavedrom_render(ctx, *out);
 		}
 	}
 }
@@ -132,10 +155,14 @@ static int receive(const struct sr_output *o,
 
 	switch (packet->type) {
 	case SR_DF_LOGIC:
-		process_logic(ctx, packet->payload);
+		process_logic(ctx, packet->payload, out);
 		break;
 	case SR_DF_END:
-		*out = wavedrom_render(ctx);
+		if (ctx->run_length->len || !ctx->num_documents) {
+			if (!*out)
+				*out = g_string_sized_new(512);
+			wavedrom_render(ctx, *out);
+		}
 		break;
 	}
 
@@ -149,26 +176,32 @@ static int init(struct sr_output *o, GHashTable *options)
 	GSList *l;
 	size_t i;
 
-	(void)options;
-
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
 	o->priv = ctx = g_malloc0(sizeof(*ctx));
 
+	ctx->collapse = g_variant_get_boolean(
+		g_hash_table_lookup(options, "collapse"));
+	ctx->window = g_variant_get_uint64(
+		g_hash_table_lookup(options, "window"));
+
 	ctx->channel_count = g_slist_length(o->sdi->channels);
 	ctx->channels = g_malloc0(
 		sizeof(ctx->channels[0]) * ctx->channel_count);
-	ctx->channel_outputs = g_malloc0(
-		sizeof(ctx->channel_outputs[0]) * ctx->channel_count);
+	ctx->sample_mask = g_malloc0((ctx->channel_count + 7) / 8);
 
 	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
 		channel = l->data;
 		if (channel->enabled && channel->type == SR_CHANNEL_LOGIC) {
 			ctx->channels[i] = channel;
-			ctx->channel_outputs[i] = g_string_new(NULL);
+			ctx->sample_mask[i / 8] |= 1 << (i % 8);
+			ctx->sample_bytes = i / 8 + 1;
 		}
 	}
+	ctx->sample = g_malloc0(ctx->sample_bytes + 1);
+	ctx->run_data = g_byte_array_new();
+	ctx->run_length = g_array_new(FALSE, FALSE, sizeof(uint64_t));
 
 	return SR_OK;
 }
@@ -176,7 +209,6 @@ static int init(struct sr_output *o, GHashTable *options)
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
-	GString *s;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -185,12 +217,10 @@ static int cleanup(struct sr_output *o)
 	o->priv = NULL;
 
 	if (ctx) {
-		while (--ctx->channel_count) {
-			s = ctx->channel_outputs[ctx->channel_count];
-			if (s)
-				g_string_free(s, TRUE);
-		}
-		g_free(ctx->channel_outputs);
+		g_byte_array_free(ctx->run_data, TRUE);
+		g_array_free(ctx->run_length, TRUE);
+		g_free(ctx->sample);
+		g_free(ctx->sample_mask);
 		g_free(ctx->channels);
 		g_free(ctx);
 	}
@@ -198,13 +228,29 @@ static int cleanup(struct sr_output *o)
 	return SR_OK;
 }
 
+static struct sr_option options[] = {
+	{ "collapse", "Collapse", "Show repeated sample sets as a single step", NULL, NULL },
+	{ "window", "Window", "Start a new document after this many steps (0 = whole capture)", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(0));
+	}
+
+	return options;
+}
+
 SR_PRIV struct sr_output_module output_wavedrom = {
 	.id = "wavedrom",
 	.name = "WaveDrom",
 	.desc = "WaveDrom.com file format",
 	.exts = (const char *[]){"wavedrom", "json", NULL},
 	.flags = 0,
-	.options = NULL,
+	.options = get_options,
 	.init = init,
 	.receive = receive,
 	.cleanup = cleanup,
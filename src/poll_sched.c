@@ -0,0 +1,210 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Polling scheduler helper functions
+ *
+ * Drivers for power supplies and electronic loads query readings from
+ * the device in a periodic callback. The scheduler decides in each
+ * invocation whether a measurement or a status query is due. It paces
+ * measurements to the configured samplerate, has status queries take
+ * only every n-th slot, and backs off while readings don't change when
+ * no samplerate was configured.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "poll_sched"
+
+/* Unchanged readings in a row after which the interval gets doubled. */
+#define IDLE_POLLS_BACKOFF 8
+
+/**
+ * Initialize a polling scheduler instance
+ *
+ * @param sched the polling scheduler instance to initialize
+ * @param min_interval_ms the shortest interval between measurements
+ *        which the device or its connection can sustain
+ * @param max_interval_ms the longest interval to back off to while
+ *        readings don't change, or 0 to never back off
+ * @param status_every query status after this many measurements, or 0
+ *        when the driver does not query status separately
+ */
+SR_PRIV void sr_poll_sched_init(struct sr_poll_sched *sched,
+	uint64_t min_interval_ms, uint64_t max_interval_ms,
+	unsigned int status_every)
+{
+	memset(sched, 0, sizeof(*sched));
+	sched->min_interval_us = min_interval_ms * 1000;
+	sched->max_interval_us = MAX(max_interval_ms * 1000,
+		sched->min_interval_us);
+	sched->status_every = status_every;
+}
+
+/**
+ * Get polling scheduler configuration
+ *
+ * @param sched polling scheduler instance
+ * @param key config item key
+ * @param data config item data
+ * @return SR_ERR_NA if @p key is not supported, SR_OK otherwise
+ */
+SR_PRIV int sr_poll_sched_config_get(const struct sr_poll_sched *sched,
+	uint32_t key, GVariant **data)
+{
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		*data = g_variant_new_uint64(sched->samplerate);
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Set polling scheduler configuration
+ *
+ * A samplerate of 0 has the device polled as fast as it can sustain.
+ * Rates beyond that are accepted, but cannot be met.
+ *
+ * @param sched polling scheduler instance
+ * @param key config item key
+ * @param data config item data
+ * @return SR_ERR_NA if @p key is not supported, SR_OK otherwise
+ */
+SR_PRIV int sr_poll_sched_config_set(struct sr_poll_sched *sched,
+	uint32_t key, GVariant *data)
+{
+	switch (key) {
+	case SR_CONF_SAMPLERATE:
+		sched->samplerate = g_variant_get_uint64(data);
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+/* The measurement interval before any backoff is applied. */
+static uint64_t base_interval(const struct sr_poll_sched *sched)
+{
+	uint64_t interval;
+
+	if (!sched->samplerate)
+		return sched->min_interval_us;
+	interval = G_USEC_PER_SEC / sched->samplerate;
+
+	return MAX(interval, sched->min_interval_us);
+}
+
+/**
+ * Prepare the polling scheduler for a new acquisition
+ *
+ * Should be called from the driver's dev_acquisition_start() callback.
+ * The first measurement is due immediately.
+ *
+ * @param sched polling scheduler instance
+ */
+SR_PRIV void sr_poll_sched_acquisition_start(struct sr_poll_sched *sched)
+{
+	sched->interval_us = base_interval(sched);
+	sched->idle_polls = 0;
+	sched->meas_since_status = 0;
+	sched->next_meas_us = g_get_monotonic_time();
+
+	sr_dbg("Polling every %" PRIu64 " us, status every %u polls.",
+		sched->interval_us, sched->status_every);
+}
+
+/**
+ * Determine which query a periodic callback should send next
+ *
+ * Measurements are due on a grid of the current interval. Is a
+ * measurement late by more than one interval, then the grid restarts
+ * at the current time instead of sending a burst of queries. A status
+ * query takes the slot after every status_every measurements, so that
+ * status details are kept up to date without starving measurements.
+ *
+ * @param sched polling scheduler instance
+ *
+ * @return The kind of query to send, SR_POLL_NONE when nothing is due.
+ */
+SR_PRIV enum sr_poll_kind sr_poll_sched_next(struct sr_poll_sched *sched)
+{
+	int64_t now;
+
+	if (sched->status_every &&
+			sched->meas_since_status >= sched->status_every) {
+		sched->meas_since_status = 0;
+		return SR_POLL_STATUS;
+	}
+
+	now = g_get_monotonic_time();
+	if (now < sched->next_meas_us)
+		return SR_POLL_NONE;
+
+	sched->next_meas_us += sched->interval_us;
+	if (sched->next_meas_us <= now)
+		sched->next_meas_us = now + sched->interval_us;
+	sched->meas_since_status++;
+
+	return SR_POLL_MEASUREMENT;
+}
+
+/**
+ * Have the polling scheduler adapt to the most recent readings
+ *
+ * Should be called after a measurement was taken. Without a configured
+ * samplerate the interval doubles after a series of unchanged readings,
+ * up to the maximum interval. Changed readings return to the shortest
+ * interval immediately.
+ *
+ * @param sched polling scheduler instance
+ * @param changed whether the readings differ from the previous ones
+ */
+SR_PRIV void sr_poll_sched_update(struct sr_poll_sched *sched,
+	gboolean changed)
+{
+	uint64_t base;
+
+	base = base_interval(sched);
+	if (changed || sched->samplerate) {
+		sched->next_meas_us += (int64_t)base - (int64_t)sched->interval_us;
+		sched->interval_us = base;
+		sched->idle_polls = 0;
+		return;
+	}
+
+	if (++sched->idle_polls < IDLE_POLLS_BACKOFF)
+		return;
+	sched->idle_polls = 0;
+	if (sched->interval_us >= sched->max_interval_us)
+		return;
+	sched->next_meas_us -= sched->interval_us;
+	sched->interval_us = MIN(MAX(2 * sched->interval_us, 1000),
+		sched->max_interval_us);
+	sched->next_meas_us += sched->interval_us;
+	sr_spew("Readings idle, polling every %" PRIu64 " us.",
+		sched->interval_us);
+}
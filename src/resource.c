@@ -19,7 +19,10 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
@@ -29,6 +32,10 @@
 #define LOG_PREFIX "resource"
 /** @endcond */
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 /**
  * @file
  *
@@ -120,6 +127,37 @@ SR_PRIV int64_t sr_file_get_size(FILE *file)
 	return filesize;
 }
 
+/**
+ * Map a file's content into memory.
+ *
+ * The mapping is private and writable, while the file itself is opened
+ * for reading only. Code which processes datafeed packets (transforms
+ * for example) may modify payload data in place, which then affects
+ * copies of the mapped pages, never the file.
+ *
+ * @param filename The name of the file to map.
+ * @param error Where to store error details. Can be NULL.
+ * @return The mapped file, or NULL on failure.
+ *
+ * @private
+ */
+SR_PRIV GMappedFile *sr_file_map(const char *filename, GError **error)
+{
+	GMappedFile *mapped;
+	int fd;
+
+	fd = g_open(filename, O_RDONLY | O_BINARY, 0);
+	if (fd < 0) {
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+			"%s", g_strerror(errno));
+		return NULL;
+	}
+	mapped = g_mapped_file_new_from_fd(fd, TRUE, error);
+	close(fd);
+
+	return mapped;
+}
+
 static FILE *try_open_file(const char *datadir, const char *subdir,
 		const char *name)
 {
@@ -143,6 +181,45 @@ static FILE *try_open_file(const char *datadir, const char *subdir,
 	return file;
 }
 
+/* A resource file which got mapped into memory, see sr_resource_load_bytes(). */
+struct resource_cache_entry {
+	char *filename;
+	GBytes *bytes;
+	goffset size;
+	gint64 mtime;
+};
+
+static void resource_cache_entry_free(void *data)
+{
+	struct resource_cache_entry *entry;
+
+	entry = data;
+	g_free(entry->filename);
+	g_bytes_unref(entry->bytes);
+	g_free(entry);
+}
+
+/* Find the first file of the given name in the resource paths. */
+static char *locate_file(int type, const char *name)
+{
+	GSList *paths, *p;
+	char *filename;
+
+	paths = sr_resourcepaths_get(type);
+	filename = NULL;
+	for (p = paths; p && !filename; p = p->next) {
+		filename = g_build_filename(p->data, name, NULL);
+		if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+			sr_spew("Attempt to locate '%s' failed.", filename);
+			g_free(filename);
+			filename = NULL;
+		}
+	}
+	g_slist_free_full(paths, g_free);
+
+	return filename;
+}
+
 static int resource_open_default(struct sr_resource *res,
 		const char *name, void *cb_data)
 {
@@ -270,6 +347,9 @@ SR_API int sr_resource_set_hooks(struct sr_context *ctx,
 		sr_err("%s: inconsistent callback pointers.", __func__);
 		return SR_ERR_ARG;
 	}
+	/* Cached files are only valid for the default hooks. */
+	sr_resource_cache_flush(ctx);
+
 	return SR_OK;
 }
 
@@ -374,10 +454,25 @@ SR_PRIV void *sr_resource_load(struct sr_context *ctx,
 		int type, const char *name, size_t *size, size_t max_size)
 {
 	struct sr_resource res;
+	GBytes *bytes;
 	void *buf;
 	size_t res_size;
 	gssize n_read;
 
+	/* Copy from the cached mapping when the default hooks are used. */
+	if (ctx->resource_open_cb == &resource_open_default) {
+		bytes = sr_resource_load_bytes(ctx, type, name, max_size);
+		if (!bytes)
+			return NULL;
+		buf = g_bytes_unref_to_data(bytes, &res_size);
+		if (!buf) {
+			sr_err("Failed to allocate buffer for '%s'.", name);
+			return NULL;
+		}
+		*size = res_size;
+		return buf;
+	}
+
 	if (sr_resource_open(ctx, &res, type, name) != SR_OK)
 		return NULL;
 
@@ -410,3 +505,181 @@ SR_PRIV void *sr_resource_load(struct sr_context *ctx,
 	*size = res_size;
 	return buf;
 }
+
+/*
+ * Map a resource file via the cache, or return the cached mapping when
+ * the file did not change since it got mapped. The caller holds the
+ * cache lock.
+ */
+static GBytes *resource_cache_get(struct sr_context *ctx,
+		int type, const char *name)
+{
+	struct resource_cache_entry *entry;
+	GMappedFile *mapped;
+	GError *error;
+	GStatBuf st;
+	char *key, *filename;
+
+	if (!ctx->resource_cache)
+		ctx->resource_cache = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, resource_cache_entry_free);
+
+	filename = locate_file(type, name);
+	if (!filename) {
+		sr_dbg("Failed to locate '%s'.", name);
+		return NULL;
+	}
+	if (g_stat(filename, &st) < 0) {
+		sr_err("Failed to access '%s': %s", filename, g_strerror(errno));
+		g_free(filename);
+		return NULL;
+	}
+
+	key = g_strdup_printf("%d/%s", type, name);
+	entry = g_hash_table_lookup(ctx->resource_cache, key);
+	if (entry && !strcmp(entry->filename, filename) &&
+			entry->size == (goffset)st.st_size &&
+			entry->mtime == (gint64)st.st_mtime) {
+		sr_dbg("Using cached '%s'.", filename);
+		g_free(filename);
+		g_free(key);
+		return g_bytes_ref(entry->bytes);
+	}
+
+	error = NULL;
+	mapped = g_mapped_file_new(filename, FALSE, &error);
+	if (!mapped) {
+		sr_err("Failed to map '%s': %s", filename, error->message);
+		g_error_free(error);
+		g_free(filename);
+		g_free(key);
+		return NULL;
+	}
+	sr_info("Mapped '%s'.", filename);
+
+	entry = g_malloc0(sizeof(*entry));
+	entry->filename = filename;
+	entry->bytes = g_mapped_file_get_bytes(mapped);
+	entry->size = st.st_size;
+	entry->mtime = st.st_mtime;
+	g_mapped_file_unref(mapped);
+	g_hash_table_replace(ctx->resource_cache, key, entry);
+
+	return g_bytes_ref(entry->bytes);
+}
+
+/**
+ * Load a resource as a shared, read-only view of its content.
+ *
+ * With the default resource hooks, the file gets mapped into memory
+ * once and is kept in a context wide cache. Later requests for the
+ * same resource share the mapping as long as the file is unchanged.
+ * Custom hooks which an application installed are used to read the
+ * resource into a new buffer each time.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param type Resource type ID.
+ * @param name Name of the resource. Must not be NULL.
+ * @param max_size Size limit. Error out if the resource is larger than this.
+ *
+ * @return The resource content, or NULL on failure. Must be released by
+ *         the caller using g_bytes_unref(). The data must not be modified.
+ *
+ * @private
+ */
+SR_PRIV GBytes *sr_resource_load_bytes(struct sr_context *ctx,
+		int type, const char *name, size_t max_size)
+{
+	GBytes *bytes;
+	void *buf;
+	size_t size;
+
+	if (ctx->resource_open_cb != &resource_open_default) {
+		buf = sr_resource_load(ctx, type, name, &size, max_size);
+		if (!buf)
+			return NULL;
+		return g_bytes_new_take(buf, size);
+	}
+
+	if (type != SR_RESOURCE_FIRMWARE) {
+		sr_err("%s: unknown type %d.", __func__, type);
+		return NULL;
+	}
+
+	g_mutex_lock(&ctx->resource_cache_lock);
+	bytes = resource_cache_get(ctx, type, name);
+	g_mutex_unlock(&ctx->resource_cache_lock);
+
+	if (!bytes) {
+		sr_err("Failed to open resource '%s' (use loglevel 5/spew for"
+		       " details).", name);
+		return NULL;
+	}
+	if (g_bytes_get_size(bytes) > max_size) {
+		sr_err("Size %zu of '%s' exceeds limit %zu.",
+			g_bytes_get_size(bytes), name, max_size);
+		g_bytes_unref(bytes);
+		return NULL;
+	}
+
+	return bytes;
+}
+
+/**
+ * Drop all cached resource mappings.
+ *
+ * Views which callers still hold remain valid until they get released.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_resource_cache_flush(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->resource_cache_lock);
+	if (ctx->resource_cache)
+		g_hash_table_remove_all(ctx->resource_cache);
+	g_mutex_unlock(&ctx->resource_cache_lock);
+}
+
+/**
+ * Compute the identity of a resource's content.
+ *
+ * @param[out] id The identity to fill in. Must not be NULL.
+ * @param bytes The resource content, see sr_resource_load_bytes().
+ *
+ * @private
+ */
+SR_PRIV void sr_resource_id_compute(struct sr_resource_id *id, GBytes *bytes)
+{
+	GChecksum *checksum;
+	const guchar *data;
+	gsize size, digest_len;
+
+	data = g_bytes_get_data(bytes, &size);
+	checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(checksum, data, size);
+	digest_len = sizeof(id->digest);
+	g_checksum_get_digest(checksum, id->digest, &digest_len);
+	g_checksum_free(checksum);
+	id->valid = TRUE;
+}
+
+/**
+ * Check whether two resource identities are valid and equal.
+ *
+ * @param a An identity. Must not be NULL.
+ * @param b Another identity. Must not be NULL.
+ *
+ * @return TRUE when both identities refer to the same content.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_resource_id_equal(const struct sr_resource_id *a,
+		const struct sr_resource_id *b)
+{
+	if (!a->valid || !b->valid)
+		return FALSE;
+
+	return memcmp(a->digest, b->digest, sizeof(a->digest)) == 0;
+}
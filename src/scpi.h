@@ -114,8 +114,16 @@ struct sr_scpi_dev_inst {
 	GMutex scpi_mutex;
 	char *actual_channel_name;
 	gboolean no_opc_command;
+	/* Responses of sr_scpi_cmd_resp_cached(), NULL when disabled. */
+	GHashTable *cache;
+	int64_t cache_max_age_us;
+	/* The scan's context, whose *IDN? cache is used while probing. */
+	struct sr_context *ctx;
+	gboolean probing;
 };
 
+struct sr_scpi_batch;
+
 SR_PRIV GSList *sr_scpi_scan(struct drv_context *drvc, GSList *options,
 		struct sr_dev_inst *(*probe_device)(struct sr_scpi_dev_inst *scpi));
 SR_PRIV struct sr_scpi_dev_inst *scpi_dev_inst_new(struct drv_context *drvc,
@@ -154,12 +162,33 @@ SR_PRIV int sr_scpi_get_double(struct sr_scpi_dev_inst *scpi,
 SR_PRIV int sr_scpi_get_opc(struct sr_scpi_dev_inst *scpi);
 SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 			const char *command, GArray **scpi_response);
+SR_PRIV int sr_scpi_read_floatv(struct sr_scpi_dev_inst *scpi,
+			const char *command, size_t elem_size, gboolean big_endian,
+			float *buf, size_t size, size_t *count);
 SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 			const char *command, GArray **scpi_response);
 SR_PRIV int sr_scpi_get_data(struct sr_scpi_dev_inst *scpi,
 			const char *command, GString **scpi_response);
+SR_PRIV int sr_scpi_parse_block_header(const char *buf, size_t len,
+			size_t *header_len, size_t *data_len);
 SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			const char *command, GByteArray **scpi_response);
+SR_PRIV int sr_scpi_read_block(struct sr_scpi_dev_inst *scpi,
+			const char *command, uint8_t *buf, size_t size, size_t *len);
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(size_t max_len);
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch);
+SR_PRIV unsigned int sr_scpi_batch_add(struct sr_scpi_batch *batch,
+			const char *format, ...);
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_batch *batch);
+SR_PRIV int sr_scpi_batch_get_string(const struct sr_scpi_batch *batch,
+			unsigned int index, char **scpi_response);
+SR_PRIV int sr_scpi_batch_get_bool(const struct sr_scpi_batch *batch,
+			unsigned int index, gboolean *scpi_response);
+SR_PRIV int sr_scpi_batch_get_int(const struct sr_scpi_batch *batch,
+			unsigned int index, int *scpi_response);
+SR_PRIV int sr_scpi_batch_get_float(const struct sr_scpi_batch *batch,
+			unsigned int index, float *scpi_response);
 SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			struct sr_scpi_hw_info **scpi_response);
 SR_PRIV void sr_scpi_hw_info_free(struct sr_scpi_hw_info *hw_info);
@@ -177,6 +206,13 @@ SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
 		const struct scpi_command *cmdtable,
 		int channel_command, const char *channel_name,
 		GVariant **gvar, const GVariantType *gvtype, int command, ...);
+SR_PRIV int sr_scpi_cmd_resp_cached(const struct sr_dev_inst *sdi,
+		const struct scpi_command *cmdtable,
+		int channel_command, const char *channel_name,
+		GVariant **gvar, const GVariantType *gvtype, int command, ...);
+SR_PRIV void sr_scpi_cache_enable(struct sr_scpi_dev_inst *scpi,
+		int64_t max_age_us);
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_dev_inst *scpi);
 
 /*--- GPIB only functions ---------------------------------------------------*/
 
@@ -77,6 +77,30 @@ static int parse_strict_bool(const char *str, gboolean *ret)
 	return SR_ERR;
 }
 
+/**
+ * Parse a response as an integer, which may be given in a rational form.
+ *
+ * @param str The response.
+ * @param ret Pointer to the integer where the value should be stored.
+ *
+ * @return SR_OK on success, SR_ERR_DATA on failure.
+ */
+static int parse_int_response(const char *str, int *ret)
+{
+	struct sr_rational ret_rational = { 0, 1 };
+
+	if (sr_parse_rational(str, &ret_rational) == SR_OK &&
+			(ret_rational.p % ret_rational.q) == 0) {
+		*ret = ret_rational.p / ret_rational.q;
+		return SR_OK;
+	}
+
+	sr_dbg("get_int: non-integer rational=%" PRId64 "/%" PRIu64,
+		ret_rational.p, ret_rational.q);
+
+	return SR_ERR_DATA;
+}
+
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_serial_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_raw_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_rigol_dev;
@@ -115,6 +139,7 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	if (!(scpi = scpi_dev_inst_new(drvc, resource, serialcomm)))
 		return NULL;
 
+	scpi->probing = TRUE;
 	if (sr_scpi_open(scpi) != SR_OK) {
 		sr_info("Couldn't open SCPI device.");
 		sr_scpi_free(scpi);
@@ -124,6 +149,7 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	sdi = probe_device(scpi);
 
 	sr_scpi_close(scpi);
+	scpi->probing = FALSE;
 
 	if (sdi)
 		sdi->status = SR_ST_INACTIVE;
@@ -133,6 +159,75 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	return sdi;
 }
 
+/* Number of resources which get probed at the same time. */
+#define SCAN_MAX_THREADS 8
+
+struct scan_job {
+	struct drv_context *drvc;
+	const char *resource;
+	const char *serialcomm;
+	struct sr_dev_inst *(*probe_device)(struct sr_scpi_dev_inst *scpi);
+	struct sr_dev_inst *sdi;
+};
+
+/* Probe a resource as returned by a transport's scan() routine. */
+static void scan_job_run(struct scan_job *job)
+{
+	gchar **res;
+	const char *comm;
+
+	res = g_strsplit(job->resource, ":", 2);
+	if (res[0]) {
+		comm = job->serialcomm ? : res[1];
+		job->sdi = sr_scpi_scan_resource(job->drvc, res[0], comm,
+			job->probe_device);
+	}
+	g_strfreev(res);
+}
+
+static void scan_job_thread(gpointer data, gpointer user_data)
+{
+	(void)user_data;
+
+	scan_job_run(data);
+}
+
+/*
+ * Probe the resources concurrently, a probe mostly waits for responses
+ * or timeouts. Devices are returned in the order of the resources.
+ */
+static GSList *run_scan_jobs(struct scan_job *jobs, size_t count)
+{
+	GThreadPool *pool;
+	struct scan_job *job;
+	GSList *devices;
+	size_t i, threads;
+
+	threads = MIN(count, SCAN_MAX_THREADS);
+	pool = NULL;
+	if (threads > 1)
+		pool = g_thread_pool_new(scan_job_thread, NULL,
+			threads, FALSE, NULL);
+	for (i = 0; i < count; i++) {
+		job = &jobs[i];
+		if (!pool || !g_thread_pool_push(pool, job, NULL))
+			scan_job_run(job);
+	}
+	if (pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+
+	devices = NULL;
+	for (i = 0; i < count; i++) {
+		job = &jobs[i];
+		if (!job->sdi)
+			continue;
+		job->sdi->connection_id = g_strdup(job->resource);
+		devices = g_slist_append(devices, job->sdi);
+	}
+
+	return devices;
+}
+
 /**
  * Send a SCPI command with a variadic argument list without mutex.
  *
@@ -315,42 +410,40 @@ SR_PRIV GSList *sr_scpi_scan(struct drv_context *drvc, GSList *options,
 {
 	GSList *resources, *l, *devices;
 	struct sr_dev_inst *sdi;
-	const char *resource, *conn;
-	const char *serialcomm, *comm;
-	gchar **res;
+	const char *resource;
+	const char *serialcomm;
+	struct scan_job *jobs;
+	size_t count;
 	unsigned i;
 
 	resource = NULL;
 	serialcomm = NULL;
 	(void)sr_serial_extract_options(options, &resource, &serialcomm);
 
-	devices = NULL;
+	resources = NULL;
 	for (i = 0; i < ARRAY_SIZE(scpi_devs); i++) {
 		if (resource && strcmp(resource, scpi_devs[i]->prefix) != 0)
 			continue;
 		if (!scpi_devs[i]->scan)
 			continue;
-		resources = scpi_devs[i]->scan(drvc);
-		for (l = resources; l; l = l->next) {
-			res = g_strsplit(l->data, ":", 2);
-			if (!res[0]) {
-				g_strfreev(res);
-				continue;
-			}
-			conn = res[0];
-			comm = serialcomm ? : res[1];
-			sdi = sr_scpi_scan_resource(drvc, conn, comm, probe_device);
-			if (sdi) {
-				devices = g_slist_append(devices, sdi);
-				sdi->connection_id = g_strdup(l->data);
-			}
-			g_strfreev(res);
-		}
-		g_slist_free_full(resources, g_free);
+		resources = g_slist_concat(resources, scpi_devs[i]->scan(drvc));
+	}
+
+	count = g_slist_length(resources);
+	jobs = g_malloc0_n(count, sizeof(*jobs));
+	for (i = 0, l = resources; l; i++, l = l->next) {
+		jobs[i].drvc = drvc;
+		jobs[i].resource = l->data;
+		jobs[i].serialcomm = serialcomm;
+		jobs[i].probe_device = probe_device;
 	}
+	devices = run_scan_jobs(jobs, count);
+	g_free(jobs);
+	g_slist_free_full(resources, g_free);
 
 	if (!devices && resource) {
-		sdi = sr_scpi_scan_resource(drvc, resource, serialcomm, probe_device);
+		sdi = sr_scpi_scan_resource(drvc, resource, serialcomm,
+			probe_device);
 		if (sdi)
 			devices = g_slist_append(NULL, sdi);
 	}
@@ -378,6 +471,7 @@ SR_PRIV struct sr_scpi_dev_inst *scpi_dev_inst_new(struct drv_context *drvc,
 			*scpi = *scpi_dev;
 			scpi->priv = g_malloc0(scpi->priv_size);
 			scpi->read_timeout_us = 1000 * 1000;
+			scpi->ctx = drvc->sr_ctx;
 			params = g_strsplit(resource, "/", 0);
 			if (scpi->dev_inst_new(scpi->priv, drvc, resource,
 			                       params, serialcomm) != SR_OK) {
@@ -392,6 +486,26 @@ SR_PRIV struct sr_scpi_dev_inst *scpi_dev_inst_new(struct drv_context *drvc,
 	return scpi;
 }
 
+/* Forget the connection's *IDN? response, see sr_scpi_get_hw_id(). */
+static void idn_cache_drop(struct sr_scpi_dev_inst *scpi)
+{
+	struct sr_context *ctx;
+	char *connection_id;
+
+	ctx = scpi->ctx;
+	if (!ctx || scpi->probing)
+		return;
+
+	connection_id = NULL;
+	if (sr_scpi_connection_id(scpi, &connection_id) == SR_OK) {
+		g_mutex_lock(&ctx->scpi_idn_cache_lock);
+		if (ctx->scpi_idn_cache)
+			g_hash_table_remove(ctx->scpi_idn_cache, connection_id);
+		g_mutex_unlock(&ctx->scpi_idn_cache_lock);
+	}
+	g_free(connection_id);
+}
+
 /**
  * Open SCPI device.
  *
@@ -401,9 +515,15 @@ SR_PRIV struct sr_scpi_dev_inst *scpi_dev_inst_new(struct drv_context *drvc,
  */
 SR_PRIV int sr_scpi_open(struct sr_scpi_dev_inst *scpi)
 {
+	int ret;
+
 	g_mutex_init(&scpi->scpi_mutex);
 
-	return scpi->open(scpi);
+	ret = scpi->open(scpi);
+	if (ret == SR_OK)
+		idn_cache_drop(scpi);
+
+	return ret;
 }
 
 /**
@@ -583,6 +703,8 @@ SR_PRIV int sr_scpi_close(struct sr_scpi_dev_inst *scpi)
 {
 	int ret;
 
+	idn_cache_drop(scpi);
+
 	g_mutex_lock(&scpi->scpi_mutex);
 	ret = scpi->close(scpi);
 	g_mutex_unlock(&scpi->scpi_mutex);
@@ -605,6 +727,8 @@ SR_PRIV void sr_scpi_free(struct sr_scpi_dev_inst *scpi)
 	scpi->free(scpi->priv);
 	g_free(scpi->priv);
 	g_free(scpi->actual_channel_name);
+	if (scpi->cache)
+		g_hash_table_destroy(scpi->cache);
 	g_free(scpi);
 }
 
@@ -730,7 +854,6 @@ SR_PRIV int sr_scpi_get_int(struct sr_scpi_dev_inst *scpi,
 			    const char *command, int *scpi_response)
 {
 	int ret;
-	struct sr_rational ret_rational;
 	char *response;
 
 	response = NULL;
@@ -739,14 +862,7 @@ SR_PRIV int sr_scpi_get_int(struct sr_scpi_dev_inst *scpi,
 	if (ret != SR_OK && !response)
 		return ret;
 
-	ret = sr_parse_rational(response, &ret_rational);
-	if (ret == SR_OK && (ret_rational.p % ret_rational.q) == 0) {
-		*scpi_response = ret_rational.p / ret_rational.q;
-	} else {
-		sr_dbg("get_int: non-integer rational=%" PRId64 "/%" PRIu64,
-			ret_rational.p, ret_rational.q);
-		ret = SR_ERR_DATA;
-	}
+	ret = parse_int_response(response, scpi_response);
 
 	g_free(response);
 
@@ -817,6 +933,291 @@ SR_PRIV int sr_scpi_get_double(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/** A list of queries which get sent together, and their responses. */
+struct sr_scpi_batch {
+	/* Maximum length of a combined message, 0 to send queries one by one. */
+	size_t max_len;
+	GPtrArray *commands;
+	GPtrArray *responses;
+};
+
+/**
+ * Create a batch of SCPI queries.
+ *
+ * Queries which are added to the batch get sent in as few program
+ * messages as possible, joined with ';', and their responses are taken
+ * from a single response message each. This saves a round trip per
+ * query, which adds up when a driver reads the device state.
+ *
+ * Queries which return definite length blocks can't be batched.
+ *
+ * @param max_len Maximum length of a combined message, chosen to fit
+ *        the device's input buffer. Use 0 for devices which don't accept
+ *        compound messages, their queries get sent one by one.
+ *
+ * @return The new batch, to be freed with sr_scpi_batch_free().
+ */
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(size_t max_len)
+{
+	struct sr_scpi_batch *batch;
+
+	batch = g_malloc0(sizeof(*batch));
+	batch->max_len = max_len;
+	batch->commands = g_ptr_array_new_with_free_func(g_free);
+	batch->responses = g_ptr_array_new_with_free_func(g_free);
+
+	return batch;
+}
+
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch)
+{
+	if (!batch)
+		return;
+
+	g_ptr_array_free(batch->commands, TRUE);
+	g_ptr_array_free(batch->responses, TRUE);
+	g_free(batch);
+}
+
+/**
+ * Add a query to a batch.
+ *
+ * @param batch The batch.
+ * @param format Format string, to be followed by any necessary arguments.
+ *
+ * @return The query's index, to retrieve its response with.
+ */
+SR_PRIV unsigned int sr_scpi_batch_add(struct sr_scpi_batch *batch,
+		const char *format, ...)
+{
+	va_list args;
+	char *command;
+	int len;
+
+	va_start(args, format);
+	len = sr_vsnprintf_ascii(NULL, 0, format, args);
+	va_end(args);
+
+	command = g_malloc0(len + 1);
+	va_start(args, format);
+	sr_vsprintf_ascii(command, format, args);
+	va_end(args);
+
+	g_ptr_array_add(batch->commands, command);
+	g_ptr_array_add(batch->responses, NULL);
+
+	return batch->commands->len - 1;
+}
+
+/* Read one response message and strip its line termination, without mutex. */
+static int scpi_batch_read(struct sr_scpi_dev_inst *scpi,
+		const char *command, GString **response)
+{
+	int ret;
+
+	*response = g_string_sized_new(1024);
+	ret = scpi_get_data(scpi, command, response);
+	if (ret != SR_OK) {
+		g_string_free(*response, TRUE);
+		*response = NULL;
+		return ret;
+	}
+
+	if ((*response)->len >= 1 && (*response)->str[(*response)->len - 1] == '\n')
+		g_string_truncate(*response, (*response)->len - 1);
+	if ((*response)->len >= 1 && (*response)->str[(*response)->len - 1] == '\r')
+		g_string_truncate(*response, (*response)->len - 1);
+
+	return SR_OK;
+}
+
+/*
+ * Split a compound response at the ';' separators which are not part
+ * of a quoted string. Strings start with a quote, a doubled quote within
+ * them stands for the quote character. Returns whether the expected
+ * number of responses was found.
+ */
+static gboolean scpi_batch_split(struct sr_scpi_batch *batch,
+		unsigned int first, unsigned int count, char *str)
+{
+	unsigned int i;
+	char *start, *p, quote;
+
+	quote = '\0';
+	start = str;
+	i = first;
+	for (p = str; ; p++) {
+		if (quote) {
+			if (!*p)
+				break;
+			if (*p == quote && p[1] == quote)
+				p++;
+			else if (*p == quote)
+				quote = '\0';
+			continue;
+		}
+		if (p == start && (*p == '"' || *p == '\'')) {
+			quote = *p;
+			continue;
+		}
+		if (*p != ';' && *p)
+			continue;
+		if (i == first + count)
+			break;
+		g_free(batch->responses->pdata[i]);
+		batch->responses->pdata[i++] = g_strndup(start, p - start);
+		if (!*p)
+			return i == first + count;
+		start = p + 1;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Send the queries of a batch and receive their responses.
+ *
+ * When sending a compound message or reading its response fails or
+ * times out, or the response does not have the expected number of parts,
+ * its queries get repeated one by one. Only a failure of those single
+ * queries is reported.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param batch The batch.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+		struct sr_scpi_batch *batch)
+{
+	GString *message, *response;
+	const char *command;
+	unsigned int first, count, i;
+	int ret;
+
+	ret = SR_OK;
+	message = g_string_sized_new(batch->max_len + 2);
+
+	g_mutex_lock(&scpi->scpi_mutex);
+
+	for (first = 0; first < batch->commands->len; first += count) {
+		/*
+		 * Collect as many queries as fit. Each one starts at the
+		 * root of the command tree, as a following query's header
+		 * would otherwise be relative to the previous one's.
+		 */
+		g_string_truncate(message, 0);
+		for (count = 0; first + count < batch->commands->len; count++) {
+			command = batch->commands->pdata[first + count];
+			if (count && message->len + 2 + strlen(command) > batch->max_len)
+				break;
+			if (count)
+				g_string_append_c(message, ';');
+			if (command[0] != ':' && command[0] != '*')
+				g_string_append_c(message, ':');
+			g_string_append(message, command);
+		}
+
+		if (count > 1) {
+			ret = scpi_send(scpi, "%s", message->str);
+			if (ret == SR_OK)
+				ret = scpi_batch_read(scpi, NULL, &response);
+			if (ret != SR_OK) {
+				sr_dbg("Batch query failed (%d), repeating %u "
+					"queries one by one.", ret, count);
+			} else {
+				sr_spew("Got batch response: '%.70s', length %"
+					G_GSIZE_FORMAT ".", response->str,
+					response->len);
+				if (scpi_batch_split(batch, first, count,
+						response->str)) {
+					g_string_free(response, TRUE);
+					continue;
+				}
+				sr_dbg("Batch response has an unexpected number "
+					"of parts, repeating %u queries one by "
+					"one.", count);
+				g_string_free(response, TRUE);
+			}
+		}
+
+		for (i = first; i < first + count; i++) {
+			ret = scpi_batch_read(scpi, batch->commands->pdata[i], &response);
+			if (ret != SR_OK)
+				break;
+			g_free(batch->responses->pdata[i]);
+			batch->responses->pdata[i] = g_string_free(response, FALSE);
+		}
+		if (ret != SR_OK)
+			break;
+	}
+
+	g_mutex_unlock(&scpi->scpi_mutex);
+
+	g_string_free(message, TRUE);
+
+	return ret;
+}
+
+/**
+ * Get the response to a batched query as a string.
+ *
+ * @param batch The batch, after sr_scpi_batch_run().
+ * @param index The query's index.
+ * @param scpi_response Pointer where to store a copy of the response,
+ *        which must be freed with g_free().
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_batch_get_string(const struct sr_scpi_batch *batch,
+		unsigned int index, char **scpi_response)
+{
+	*scpi_response = NULL;
+
+	if (index >= batch->responses->len || !batch->responses->pdata[index])
+		return SR_ERR;
+
+	*scpi_response = g_strdup(batch->responses->pdata[index]);
+
+	return SR_OK;
+}
+
+/** Get the response to a batched query as a bool value. */
+SR_PRIV int sr_scpi_batch_get_bool(const struct sr_scpi_batch *batch,
+		unsigned int index, gboolean *scpi_response)
+{
+	if (index >= batch->responses->len || !batch->responses->pdata[index])
+		return SR_ERR;
+
+	if (parse_strict_bool(batch->responses->pdata[index], scpi_response) != SR_OK)
+		return SR_ERR_DATA;
+
+	return SR_OK;
+}
+
+/** Get the response to a batched query as an integer. */
+SR_PRIV int sr_scpi_batch_get_int(const struct sr_scpi_batch *batch,
+		unsigned int index, int *scpi_response)
+{
+	if (index >= batch->responses->len || !batch->responses->pdata[index])
+		return SR_ERR;
+
+	return parse_int_response(batch->responses->pdata[index], scpi_response);
+}
+
+/** Get the response to a batched query as a float. */
+SR_PRIV int sr_scpi_batch_get_float(const struct sr_scpi_batch *batch,
+		unsigned int index, float *scpi_response)
+{
+	if (index >= batch->responses->len || !batch->responses->pdata[index])
+		return SR_ERR;
+
+	if (sr_atof_ascii(batch->responses->pdata[index], scpi_response) != SR_OK)
+		return SR_ERR_DATA;
+
+	return SR_OK;
+}
+
 /**
  * Send a SCPI *OPC? command, read the reply and return the result of the
  * command.
@@ -960,6 +1361,158 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/**
+ * Parse the header of a "definite length block".
+ *
+ * The header consists of a '#' marker, one digit which specifies the
+ * character count of the length spec, and the respective number of
+ * characters which specify the data block's length. A "#0" header
+ * introduces an indefinite length block, it is reported with a data
+ * length of 0.
+ *
+ * The header's size is only known after its first two bytes were seen.
+ * Callers which receive the header in pieces can pass in what they got
+ * so far, and read as many more bytes as the return value asks for.
+ *
+ * @param[in] buf The received bytes, starting with the '#' marker.
+ * @param[in] len The number of bytes in buf.
+ * @param[out] header_len The size of the complete header.
+ * @param[out] data_len The length of the data block following the header.
+ *
+ * @return SR_OK when the header is complete, the number of header bytes
+ *         still missing, or SR_ERR_DATA upon an invalid header.
+ */
+SR_PRIV int sr_scpi_parse_block_header(const char *buf, size_t len,
+		size_t *header_len, size_t *data_len)
+{
+	size_t digits, value, i;
+
+	if (len >= 1 && buf[0] != '#')
+		return SR_ERR_DATA;
+	if (len < 2)
+		return 2 - len;
+	if (!g_ascii_isdigit(buf[1]))
+		return SR_ERR_DATA;
+
+	digits = buf[1] - '0';
+	if (len < 2 + digits)
+		return 2 + digits - len;
+
+	value = 0;
+	for (i = 0; i < digits; i++) {
+		if (!g_ascii_isdigit(buf[2 + i]))
+			return SR_ERR_DATA;
+		value = value * 10 + buf[2 + i] - '0';
+	}
+
+	*header_len = 2 + digits;
+	*data_len = value;
+
+	return SR_OK;
+}
+
+/**
+ * Read a given number of bytes into a buffer, without mutex.
+ *
+ * The timeout gets extended whenever data was received, so that only a
+ * stalled transfer times out.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param buf Buffer to store the data.
+ * @param len Number of bytes to read.
+ * @param abs_timeout_us Absolute timeout in microseconds.
+ * @param count Number of bytes which were read, also upon failure.
+ *
+ * @return SR_OK on success, SR_ERR_TIMEOUT or SR_ERR on failure.
+ */
+static int scpi_read_full(struct sr_scpi_dev_inst *scpi, char *buf,
+		size_t len, gint64 *abs_timeout_us, size_t *count)
+{
+	int ret;
+
+	*count = 0;
+	while (*count < len) {
+		ret = scpi_read_data(scpi, buf + *count,
+			MIN(len - *count, (size_t)G_MAXINT));
+		if (ret < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		}
+		if (ret > 0) {
+			*count += ret;
+			*abs_timeout_us = g_get_monotonic_time()
+				+ scpi->read_timeout_us;
+			continue;
+		}
+		if (g_get_monotonic_time() > *abs_timeout_us) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR_TIMEOUT;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Read the rest of a block header after its '#' marker, without mutex. */
+static int scpi_read_block_length(struct sr_scpi_dev_inst *scpi,
+		gint64 *abs_timeout_us, size_t *data_len)
+{
+	char buf[2 + 9];
+	size_t len, count, header_len;
+	int ret;
+
+	buf[0] = '#';
+	len = 1;
+	while ((ret = sr_scpi_parse_block_header(buf, len,
+			&header_len, data_len)) > 0) {
+		ret = scpi_read_full(scpi, buf + len, ret,
+			abs_timeout_us, &count);
+		if (ret != SR_OK)
+			return ret;
+		len += count;
+	}
+	if (ret != SR_OK)
+		sr_err("Invalid definite length block header.");
+
+	return ret;
+}
+
+/**
+ * Read the header of a "definite length block", without mutex.
+ *
+ * The header is read in exactly the pieces which it consists of, so that
+ * no data bytes get consumed and the data can be read into its final
+ * location. Up to max_skip bytes of a response header which precede the
+ * '#' marker get discarded.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param max_skip Number of bytes to skip at most before the '#' marker.
+ * @param abs_timeout_us Absolute timeout in microseconds.
+ * @param data_len The length of the data block following the header.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+static int scpi_read_block_header(struct sr_scpi_dev_inst *scpi,
+		size_t max_skip, gint64 *abs_timeout_us, size_t *data_len)
+{
+	char c;
+	size_t count;
+	int ret;
+
+	do {
+		ret = scpi_read_full(scpi, &c, 1, abs_timeout_us, &count);
+		if (ret != SR_OK)
+			return ret;
+	} while (c != '#' && max_skip--);
+
+	if (c != '#') {
+		sr_err("Invalid definite length block header.");
+		return SR_ERR_DATA;
+	}
+
+	return scpi_read_block_length(scpi, abs_timeout_us, data_len);
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as binary data with a
  * "definite length block" header and store the as an result in scpi_response.
@@ -978,11 +1531,8 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GByteArray **scpi_response)
 {
 	int ret;
-	GString* response;
-	gsize oldlen;
-	char buf[10];
-	long llen;
-	long datalen;
+	GByteArray *response;
+	size_t datalen, count;
 	gint64 timeout;
 
 	*scpi_response = NULL;
@@ -1000,111 +1550,326 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 		return SR_ERR;
 	}
 
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+
+	ret = scpi_read_block_header(scpi, 0, &timeout, &datalen);
+	if (ret != SR_OK || datalen == 0) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
+	}
+
+	/* Now that the length is known, read the data to its final place. */
+	response = g_byte_array_sized_new(datalen);
+	g_byte_array_set_size(response, datalen);
+	ret = scpi_read_full(scpi, (char *)response->data, datalen,
+		&timeout, &count);
+
+	g_mutex_unlock(&scpi->scpi_mutex);
+
 	/*
-	 * Assume an initial maximum length, optionally gets adjusted below.
-	 * Prepare a NULL return value for when error paths will be taken.
+	 * On timeout truncate the buffer and send the partial response
+	 * instead of getting stuck on timeouts...
 	 */
-	response = g_string_sized_new(1024);
+	if (ret == SR_ERR_TIMEOUT) {
+		g_byte_array_set_size(response, count);
+		ret = SR_OK;
+	}
+	if (ret != SR_OK) {
+		g_byte_array_free(response, TRUE);
+		return ret;
+	}
 
-	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+	*scpi_response = response;
 
-	/* Get (the first chunk of) the response. */
-	do {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
+	return SR_OK;
+}
+
+/**
+ * Send a SCPI command and read a "definite length block" reply into a
+ * caller provided buffer.
+ *
+ * Unlike sr_scpi_get_block() no memory gets allocated, the data is read
+ * right into the buffer, in reads as large as the remaining data. This
+ * suits repeated transfers of large blocks, which can reuse one buffer.
+ * Up to 64 bytes of a response header before the '#' marker are skipped.
+ *
+ * A block which does not fit into the buffer is read to its end to keep
+ * the connection usable, but only the first size bytes are kept and
+ * SR_ERR_DATA gets returned.
+ *
+ * @param[in] scpi Previously initialised SCPI device structure.
+ * @param[in] command The SCPI command to send to the device (can be NULL).
+ * @param[out] buf Buffer to store the data block.
+ * @param[in] size Size of buf.
+ * @param[out] len Number of bytes stored in buf. Less than the block's
+ *             length when the device stopped sending.
+ *
+ * @return SR_OK upon success, SR_ERR* upon failure.
+ */
+SR_PRIV int sr_scpi_read_block(struct sr_scpi_dev_inst *scpi,
+		const char *command, uint8_t *buf, size_t size, size_t *len)
+{
+	int ret;
+	char discard[256];
+	size_t datalen, count;
+	gint64 timeout;
+
+	*len = 0;
+
+	g_mutex_lock(&scpi->scpi_mutex);
+
+	if (command)
+		if (scpi_send(scpi, command) != SR_OK) {
 			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
+			return SR_ERR;
 		}
-	} while (response->len < 2);
 
-	/*
-	 * SCPI protocol data blocks are preceeded with a length spec.
-	 * The length spec consists of a '#' marker, one digit which
-	 * specifies the character count of the length spec, and the
-	 * respective number of characters which specify the data block's
-	 * length. Raw data bytes follow (thus one must no longer assume
-	 * that the received input stream would be an ASCIIZ string).
-	 *
-	 * Get the data block length, and strip off the length spec from
-	 * the input buffer, leaving just the data bytes.
-	 */
-	if (response->str[0] != '#') {
+	if (sr_scpi_read_begin(scpi) != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
-		return SR_ERR_DATA;
+		return SR_ERR;
 	}
-	buf[0] = response->str[1];
-	buf[1] = '\0';
-	ret = sr_atol(buf, &llen);
-	if ((ret != SR_OK) || (llen == 0)) {
+
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+
+	ret = scpi_read_block_header(scpi, 64, &timeout, &datalen);
+	if (ret != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return ret;
 	}
 
-	while (response->len < (unsigned long)(2 + llen)) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
+	ret = scpi_read_full(scpi, (char *)buf, MIN(datalen, size),
+		&timeout, len);
+	if (ret != SR_ERR && datalen > size) {
+		sr_err("Data block of %zu bytes exceeds buffer of %zu bytes.",
+			datalen, size);
+		ret = SR_OK;
+		for (datalen -= size; datalen && ret == SR_OK; datalen -= count)
+			ret = scpi_read_full(scpi, discard,
+				MIN(datalen, sizeof(discard)), &timeout, &count);
+		if (ret != SR_ERR)
+			ret = SR_ERR_DATA;
 	}
 
-	memcpy(buf, &response->str[2], llen);
-	buf[llen] = '\0';
-	ret = sr_atol(buf, &datalen);
-	if ((ret != SR_OK) || (datalen == 0)) {
+	g_mutex_unlock(&scpi->scpi_mutex);
+
+	/* Like sr_scpi_get_block(), return partial data upon timeout. */
+	if (ret == SR_ERR_TIMEOUT)
+		ret = SR_OK;
+
+	return ret;
+}
+
+/* Parser state of sr_scpi_read_floatv() for text responses. */
+struct scpi_floatv_text {
+	char token[64];
+	size_t len;
+	gboolean overlong;
+};
+
+/*
+ * Take a text value which is complete. Surrounding whitespace is
+ * skipped, empty values are not taken.
+ */
+static int scpi_floatv_text_end(struct scpi_floatv_text *text,
+		float *buf, size_t size, size_t *count)
+{
+	char *token;
+	float value;
+	int ret;
+
+	text->token[text->len] = '\0';
+	token = g_strstrip(text->token);
+	ret = SR_OK;
+	if (text->overlong || (*token && sr_atof_ascii(token, &value) != SR_OK)) {
+		sr_dbg("Cannot parse value '%s'.", token);
+		ret = SR_ERR_DATA;
+	} else if (*token) {
+		if (*count < size)
+			buf[*count] = value;
+		else
+			ret = SR_ERR_DATA;
+		(*count)++;
+	}
+	text->len = 0;
+	text->overlong = FALSE;
+
+	return ret;
+}
+
+/**
+ * Send a SCPI command and read the floating point values of its reply
+ * into a caller provided buffer.
+ *
+ * When the instrument was set up to transfer binary data, e.g. with
+ * "FORM REAL,32", the reply is a definite length block of IEEE 754
+ * numbers. These get read as large chunks and converted to host floats.
+ * Any other reply is taken as comma separated text, which gets parsed
+ * as it arrives, without a copy of the complete response or allocations
+ * per value.
+ *
+ * @param[in] scpi Previously initialised SCPI device structure.
+ * @param[in] command The SCPI command to send to the device (can be NULL).
+ * @param[in] elem_size Size of the binary values, 4 or 8.
+ * @param[in] big_endian Whether binary values are in big endian order,
+ *            which is the default of most instruments ("FORM:BORD NORM").
+ * @param[out] buf Buffer to store the values.
+ * @param[in] size Number of values which fit into buf.
+ * @param[out] count Number of values in the reply. When this exceeds
+ *             size, only the first values are stored and SR_ERR_DATA
+ *             gets returned.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_read_floatv(struct sr_scpi_dev_inst *scpi,
+		const char *command, size_t elem_size, gboolean big_endian,
+		float *buf, size_t size, size_t *count)
+{
+	struct scpi_floatv_text text;
+	uint8_t chunk[4096];
+	const uint8_t *rp;
+	size_t datalen, len, n, i;
+	gint64 timeout;
+	int ret, data_ret;
+	char c;
+
+	*count = 0;
+	if (elem_size != sizeof(float) && elem_size != sizeof(double))
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&scpi->scpi_mutex);
+
+	if (command && scpi_send(scpi, command) != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
-		return ret;
+		return SR_ERR;
 	}
-	g_string_erase(response, 0, 2 + llen);
 
-	/*
-	 * Re-allocate the buffer size to the now known length
-	 * and keep reading more chunks of response data.
-	 */
-	oldlen = response->len;
-	g_string_set_size(response, datalen);
-	g_string_set_size(response, oldlen);
-
-	if (oldlen < (unsigned long)(datalen)) {
-		do {
-			oldlen = response->len;
-			ret = scpi_read_response(scpi, response, timeout);
-
-			/* On timeout truncate the buffer and send the partial response
-			 * instead of getting stuck on timeouts...
-			 */
-			if (ret == SR_ERR_TIMEOUT) {
-				datalen = oldlen;
-				break;
+	if (sr_scpi_read_begin(scpi) != SR_OK) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return SR_ERR;
+	}
+
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+	data_ret = SR_OK;
+
+	ret = scpi_read_full(scpi, &c, 1, &timeout, &n);
+	if (ret == SR_OK && c == '#') {
+		ret = scpi_read_block_length(scpi, &timeout, &datalen);
+		if (ret == SR_OK && datalen % elem_size) {
+			sr_err("Block of %zu bytes holds no %zu byte values.",
+				datalen, elem_size);
+			data_ret = SR_ERR_DATA;
+		}
+		for (; ret == SR_OK && datalen; datalen -= len) {
+			len = MIN(datalen, sizeof(chunk));
+			ret = scpi_read_full(scpi, (char *)chunk, len, &timeout, &n);
+			rp = chunk;
+			for (i = 0; ret == SR_OK && i + elem_size <= len; i += elem_size) {
+				if (*count < size) {
+					if (elem_size == sizeof(float))
+						buf[*count] = big_endian ?
+							read_fltbe(rp) : read_fltle(rp);
+					else
+						buf[*count] = big_endian ?
+							read_dblbe(rp) : read_dblle(rp);
+				}
+				(*count)++;
+				rp += elem_size;
+			}
+		}
+		if (ret == SR_OK && *count > size)
+			data_ret = SR_ERR_DATA;
+	} else if (ret == SR_OK) {
+		text.len = 0;
+		text.overlong = FALSE;
+		chunk[0] = c;
+		n = 1;
+		for (;;) {
+			for (i = 0; i < n; i++) {
+				c = chunk[i];
+				if (c == ',' || c == '\n' || c == '\r') {
+					if (scpi_floatv_text_end(&text, buf, size, count) != SR_OK)
+						data_ret = SR_ERR_DATA;
+				} else if (text.len < sizeof(text.token) - 1) {
+					text.token[text.len++] = c;
+				} else {
+					text.overlong = TRUE;
+				}
 			}
+			if (sr_scpi_read_complete(scpi))
+				break;
+			ret = scpi_read_data(scpi, (char *)chunk, sizeof(chunk));
 			if (ret < 0) {
-				g_mutex_unlock(&scpi->scpi_mutex);
-				g_string_free(response, TRUE);
-				return ret;
+				sr_err("Incompletely read SCPI response.");
+				ret = SR_ERR;
+				break;
 			}
-			if (ret > 0)
+			n = ret;
+			ret = SR_OK;
+			if (n > 0) {
 				timeout = g_get_monotonic_time() + scpi->read_timeout_us;
-		} while (response->len < (unsigned long)(datalen));
+			} else if (g_get_monotonic_time() > timeout) {
+				sr_err("Timed out waiting for SCPI response.");
+				ret = SR_ERR_TIMEOUT;
+				break;
+			}
+		}
+		if (ret == SR_OK &&
+				scpi_floatv_text_end(&text, buf, size, count) != SR_OK)
+			data_ret = SR_ERR_DATA;
 	}
 
 	g_mutex_unlock(&scpi->scpi_mutex);
 
-	/* Convert received data to byte array. */
-	*scpi_response = g_byte_array_new_take(
-		(guint8*)g_string_free(response, FALSE), datalen);
+	return ret != SR_OK ? ret : data_ret;
+}
 
-	return SR_OK;
+/* Return a copy of the cached response, or NULL. */
+static char *idn_cache_lookup(struct sr_context *ctx,
+		const char *connection_id)
+{
+	char *response;
+
+	if (!ctx || !connection_id)
+		return NULL;
+
+	g_mutex_lock(&ctx->scpi_idn_cache_lock);
+	response = NULL;
+	if (ctx->scpi_idn_cache)
+		response = g_strdup(g_hash_table_lookup(ctx->scpi_idn_cache,
+			connection_id));
+	g_mutex_unlock(&ctx->scpi_idn_cache_lock);
+
+	if (response)
+		sr_spew("Using cached IDN response for %s.", connection_id);
+
+	return response;
+}
+
+static void idn_cache_store(struct sr_context *ctx,
+		const char *connection_id, const char *response)
+{
+	if (!ctx || !connection_id)
+		return;
+
+	g_mutex_lock(&ctx->scpi_idn_cache_lock);
+	if (!ctx->scpi_idn_cache)
+		ctx->scpi_idn_cache = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+	g_hash_table_insert(ctx->scpi_idn_cache, g_strdup(connection_id),
+		g_strdup(response));
+	g_mutex_unlock(&ctx->scpi_idn_cache_lock);
 }
 
 /**
  * Send the *IDN? SCPI command, receive the reply, parse it and store the
  * reply as a sr_scpi_hw_info structure in the supplied scpi_response pointer.
  *
+ * During scans, a valid reply is kept in the context for the connection,
+ * and is used instead of querying the device again when later scans
+ * probe the same connection. The reply is dropped when a device on the
+ * connection gets opened or closed outside of a scan, as it may have
+ * been replaced or reconfigured by then.
+ *
  * Callers must free the allocated memory regardless of the routine's
  * return code. See @ref sr_scpi_hw_info_free().
  *
@@ -1117,7 +1882,7 @@ SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			      struct sr_scpi_hw_info **scpi_response)
 {
 	int num_tokens, ret;
-	char *response;
+	char *response, *connection_id;
 	gchar **tokens;
 	struct sr_scpi_hw_info *hw_info;
 	gchar *idn_substr;
@@ -1126,9 +1891,23 @@ SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 	response = NULL;
 	tokens = NULL;
 
-	ret = sr_scpi_get_string(scpi, SCPI_CMD_IDN, &response);
-	if (ret != SR_OK && !response)
-		return ret;
+	connection_id = NULL;
+	if (scpi->probing &&
+			sr_scpi_connection_id(scpi, &connection_id) != SR_OK) {
+		g_free(connection_id);
+		connection_id = NULL;
+	}
+
+	response = idn_cache_lookup(scpi->ctx, connection_id);
+	if (response) {
+		ret = SR_OK;
+	} else {
+		ret = sr_scpi_get_string(scpi, SCPI_CMD_IDN, &response);
+		if (ret != SR_OK && !response) {
+			g_free(connection_id);
+			return ret;
+		}
+	}
 
 	/*
 	 * The response to a '*IDN?' is specified by the SCPI spec. It contains
@@ -1147,12 +1926,16 @@ SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 		sr_dbg("IDN response not according to spec: '%s'", response);
 		g_strfreev(tokens);
 		g_free(response);
+		g_free(connection_id);
 		return SR_ERR_DATA;
 	}
 	if (num_tokens < 4) {
 		sr_warn("Short IDN response, assume missing serial number.");
 	}
+	if (ret == SR_OK)
+		idn_cache_store(scpi->ctx, connection_id, response);
 	g_free(response);
+	g_free(connection_id);
 
 	hw_info = g_malloc0(sizeof(*hw_info));
 
@@ -1290,6 +2073,10 @@ SR_PRIV int sr_scpi_cmd(const struct sr_dev_inst *sdi,
 
 	g_mutex_lock(&scpi->scpi_mutex);
 
+	/* Any command may change what cached queries would return. */
+	if (scpi->cache)
+		g_hash_table_remove_all(scpi->cache);
+
 	/* Select channel. */
 	channel_cmd = sr_scpi_cmd_get(cmdtable, channel_command);
 	if (channel_cmd && channel_name &&
@@ -1298,8 +2085,10 @@ SR_PRIV int sr_scpi_cmd(const struct sr_dev_inst *sdi,
 		g_free(scpi->actual_channel_name);
 		scpi->actual_channel_name = g_strdup(channel_name);
 		ret = scpi_send(scpi, channel_cmd, channel_name);
-		if (ret != SR_OK)
+		if (ret != SR_OK) {
+			g_mutex_unlock(&scpi->scpi_mutex);
 			return ret;
+		}
 	}
 
 	va_start(args, command);
@@ -1311,20 +2100,96 @@ SR_PRIV int sr_scpi_cmd(const struct sr_dev_inst *sdi,
 	return ret;
 }
 
-SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
+/** A cached response of sr_scpi_cmd_resp_cached(). */
+struct scpi_cache_entry {
+	gint64 time;
+	char *response;
+};
+
+static void scpi_cache_entry_free(void *data)
+{
+	struct scpi_cache_entry *entry;
+
+	entry = data;
+	g_free(entry->response);
+	g_free(entry);
+}
+
+/**
+ * Enable the response cache of sr_scpi_cmd_resp_cached().
+ *
+ * Cached responses are served without device access until they are older
+ * than the given age, or until any command gets sent via sr_scpi_cmd().
+ * The age limits how long changes which are made at the instrument's
+ * front panel can go unnoticed.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param max_age_us Maximum age of cached responses in microseconds.
+ */
+SR_PRIV void sr_scpi_cache_enable(struct sr_scpi_dev_inst *scpi,
+		int64_t max_age_us)
+{
+	g_mutex_lock(&scpi->scpi_mutex);
+	if (!scpi->cache)
+		scpi->cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, scpi_cache_entry_free);
+	scpi->cache_max_age_us = max_age_us;
+	g_mutex_unlock(&scpi->scpi_mutex);
+}
+
+/**
+ * Drop all cached responses, e.g. when the device state may have changed
+ * other than through sr_scpi_cmd().
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ */
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_dev_inst *scpi)
+{
+	g_mutex_lock(&scpi->scpi_mutex);
+	if (scpi->cache)
+		g_hash_table_remove_all(scpi->cache);
+	g_mutex_unlock(&scpi->scpi_mutex);
+}
+
+/* Convert a response to the GVariant type which the caller asked for. */
+static int scpi_resp_to_variant(const char *s, const GVariantType *gvtype,
+		GVariant **gvar)
+{
+	gboolean b;
+	double d;
+	int ret;
+
+	ret = SR_OK;
+	if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_BOOLEAN)) {
+		if ((ret = parse_strict_bool(s, &b)) == SR_OK)
+			*gvar = g_variant_new_boolean(b);
+	} else if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_DOUBLE)) {
+		if ((ret = sr_atod_ascii(s, &d)) == SR_OK)
+			*gvar = g_variant_new_double(d);
+	} else if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_STRING)) {
+		*gvar = g_variant_new_string(s);
+	} else {
+		sr_err("Unable to convert to desired GVariant type.");
+		ret = SR_ERR_NA;
+	}
+
+	return ret;
+}
+
+static int scpi_cmd_resp(const struct sr_dev_inst *sdi,
 		const struct scpi_command *cmdtable,
 		int channel_command, const char *channel_name,
-		GVariant **gvar, const GVariantType *gvtype, int command, ...)
+		GVariant **gvar, const GVariantType *gvtype, gboolean cached,
+		int command, va_list args)
 {
 	struct sr_scpi_dev_inst *scpi;
-	va_list args;
+	struct scpi_cache_entry *entry;
+	va_list args_copy;
 	const char *channel_cmd;
 	const char *cmd;
 	GString *response;
-	char *s;
-	gboolean b;
-	double d;
-	int ret;
+	char *s, *text, *key;
+	int ret, len;
 
 	scpi = sdi->conn;
 
@@ -1333,25 +2198,53 @@ SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
 		return SR_ERR_NA;
 	}
 
+	va_copy(args_copy, args);
+	len = sr_vsnprintf_ascii(NULL, 0, cmd, args_copy);
+	va_end(args_copy);
+	text = g_malloc0(len + 1);
+	sr_vsprintf_ascii(text, cmd, args);
+
 	g_mutex_lock(&scpi->scpi_mutex);
 
-	/* Select channel. */
 	channel_cmd = sr_scpi_cmd_get(cmdtable, channel_command);
-	if (channel_cmd && channel_name &&
-			g_strcmp0(channel_name, scpi->actual_channel_name)) {
+	if (!channel_cmd)
+		channel_name = NULL;
+
+	/* Serve the response from the cache while it's recent enough. */
+	key = NULL;
+	if (cached && scpi->cache) {
+		key = g_strconcat(channel_name ? channel_name : "", "\n", text, NULL);
+		entry = g_hash_table_lookup(scpi->cache, key);
+		if (entry && g_get_monotonic_time() - entry->time <= scpi->cache_max_age_us) {
+			s = g_strdup(entry->response);
+			g_mutex_unlock(&scpi->scpi_mutex);
+			ret = scpi_resp_to_variant(s, gvtype, gvar);
+			g_free(s);
+			g_free(key);
+			g_free(text);
+			return ret;
+		}
+	}
+
+	/* Select channel. */
+	if (channel_name && g_strcmp0(channel_name, scpi->actual_channel_name)) {
 		sr_spew("sr_scpi_cmd_get(): new channel = %s", channel_name);
 		g_free(scpi->actual_channel_name);
 		scpi->actual_channel_name = g_strdup(channel_name);
 		ret = scpi_send(scpi, channel_cmd, channel_name);
-		if (ret != SR_OK)
+		if (ret != SR_OK) {
+			g_mutex_unlock(&scpi->scpi_mutex);
+			g_free(key);
+			g_free(text);
 			return ret;
+		}
 	}
 
-	va_start(args, command);
-	ret = scpi_send_variadic(scpi, cmd, args);
-	va_end(args);
+	ret = scpi_send(scpi, "%s", text);
+	g_free(text);
 	if (ret != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
+		g_free(key);
 		return ret;
 	}
 
@@ -1361,11 +2254,10 @@ SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
 		g_mutex_unlock(&scpi->scpi_mutex);
 		if (response)
 			g_string_free(response, TRUE);
+		g_free(key);
 		return ret;
 	}
 
-	g_mutex_unlock(&scpi->scpi_mutex);
-
 	/* Get rid of trailing linefeed if present */
 	if (response->len >= 1 && response->str[response->len - 1] == '\n')
 		g_string_truncate(response, response->len - 1);
@@ -1376,21 +2268,58 @@ SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
 
 	s = g_string_free(response, FALSE);
 
-	ret = SR_OK;
-	if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_BOOLEAN)) {
-		if ((ret = parse_strict_bool(s, &b)) == SR_OK)
-			*gvar = g_variant_new_boolean(b);
-	} else if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_DOUBLE)) {
-		if ((ret = sr_atod_ascii(s, &d)) == SR_OK)
-			*gvar = g_variant_new_double(d);
-	} else if (g_variant_type_equal(gvtype, G_VARIANT_TYPE_STRING)) {
-		*gvar = g_variant_new_string(s);
-	} else {
-		sr_err("Unable to convert to desired GVariant type.");
-		ret = SR_ERR_NA;
+	if (key) {
+		entry = g_malloc(sizeof(*entry));
+		entry->time = g_get_monotonic_time();
+		entry->response = g_strdup(s);
+		g_hash_table_replace(scpi->cache, key, entry);
 	}
 
+	g_mutex_unlock(&scpi->scpi_mutex);
+
+	ret = scpi_resp_to_variant(s, gvtype, gvar);
+
 	g_free(s);
 
 	return ret;
 }
+
+SR_PRIV int sr_scpi_cmd_resp(const struct sr_dev_inst *sdi,
+		const struct scpi_command *cmdtable,
+		int channel_command, const char *channel_name,
+		GVariant **gvar, const GVariantType *gvtype, int command, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, command);
+	ret = scpi_cmd_resp(sdi, cmdtable, channel_command, channel_name,
+		gvar, gvtype, FALSE, command, args);
+	va_end(args);
+
+	return ret;
+}
+
+/**
+ * Like sr_scpi_cmd_resp(), but serve the response from the cache when
+ * one was enabled with sr_scpi_cache_enable(). Suits queries for device
+ * settings, which frontends tend to poll, but not for measurements.
+ *
+ * The returned value is owned by the caller, like the one which
+ * sr_scpi_cmd_resp() returns.
+ */
+SR_PRIV int sr_scpi_cmd_resp_cached(const struct sr_dev_inst *sdi,
+		const struct scpi_command *cmdtable,
+		int channel_command, const char *channel_name,
+		GVariant **gvar, const GVariantType *gvtype, int command, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, command);
+	ret = scpi_cmd_resp(sdi, cmdtable, channel_command, channel_name,
+		gvar, gvtype, TRUE, command, args);
+	va_end(args);
+
+	return ret;
+}
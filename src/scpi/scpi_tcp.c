@@ -27,8 +27,10 @@
 #include <string.h>
 #include <unistd.h>
 #ifndef _WIN32
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #endif
@@ -41,20 +43,35 @@
 
 #define LENGTH_BYTES 4
 
+/* Size of the buffer which received data is read through. */
+#define READ_BUFFER_SIZE (256 * 1024)
+/* Socket receive buffer size, unless the connection spec has one. */
+#define DEFAULT_RCVBUF_SIZE (1024 * 1024)
+
 struct scpi_tcp {
 	char *address;
 	char *port;
+	int rcvbuf_size;
 	int socket;
 	char length_buf[LENGTH_BYTES];
 	int length_bytes_read;
 	int response_length;
 	int response_bytes_read;
+	/* Received data which no read has taken yet. */
+	char *read_buf;
+	size_t read_pos;
+	size_t read_len;
+	/* Throughput counters, reported when the connection gets closed. */
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	gint64 open_time;
 };
 
 static int scpi_tcp_dev_inst_new(void *priv, struct drv_context *drvc,
 		const char *resource, char **params, const char *serialcomm)
 {
 	struct scpi_tcp *tcp = priv;
+	int rcvbuf_size;
 
 	(void)drvc;
 	(void)resource;
@@ -65,8 +82,17 @@ static int scpi_tcp_dev_inst_new(void *priv, struct drv_context *drvc,
 		return SR_ERR;
 	}
 
+	/* An optional fourth field is the socket receive buffer size. */
+	rcvbuf_size = DEFAULT_RCVBUF_SIZE;
+	if (params[3] && (sr_atoi(params[3], &rcvbuf_size) != SR_OK ||
+			rcvbuf_size < 0)) {
+		sr_err("Invalid receive buffer size '%s'.", params[3]);
+		return SR_ERR;
+	}
+
 	tcp->address = g_strdup(params[1]);
 	tcp->port = g_strdup(params[2]);
+	tcp->rcvbuf_size = rcvbuf_size;
 	tcp->socket = -1;
 
 	return SR_OK;
@@ -77,7 +103,7 @@ static int scpi_tcp_open(struct sr_scpi_dev_inst *scpi)
 	struct scpi_tcp *tcp = scpi->priv;
 	struct addrinfo hints;
 	struct addrinfo *results, *res;
-	int err;
+	int err, opt;
 
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_UNSPEC;
@@ -96,6 +122,12 @@ static int scpi_tcp_open(struct sr_scpi_dev_inst *scpi)
 		if ((tcp->socket = socket(res->ai_family, res->ai_socktype,
 						res->ai_protocol)) < 0)
 			continue;
+		/* Set before connecting, so the TCP window can scale. */
+		if (tcp->rcvbuf_size && setsockopt(tcp->socket, SOL_SOCKET,
+				SO_RCVBUF, (const void *)&tcp->rcvbuf_size,
+				sizeof(tcp->rcvbuf_size)) != 0)
+			sr_dbg("Cannot set receive buffer size: %s",
+				g_strerror(errno));
 		if (connect(tcp->socket, res->ai_addr, res->ai_addrlen) != 0) {
 			close(tcp->socket);
 			tcp->socket = -1;
@@ -112,6 +144,18 @@ static int scpi_tcp_open(struct sr_scpi_dev_inst *scpi)
 		return SR_ERR;
 	}
 
+	/* Commands are short, don't hold them back to coalesce them. */
+	opt = 1;
+	if (setsockopt(tcp->socket, IPPROTO_TCP, TCP_NODELAY,
+			(const void *)&opt, sizeof(opt)) != 0)
+		sr_dbg("Cannot disable Nagle's algorithm: %s",
+			g_strerror(errno));
+
+	tcp->read_buf = g_malloc(READ_BUFFER_SIZE);
+	tcp->read_pos = tcp->read_len = 0;
+	tcp->bytes_sent = tcp->bytes_received = 0;
+	tcp->open_time = g_get_monotonic_time();
+
 	return SR_OK;
 }
 
@@ -126,13 +170,28 @@ static int scpi_tcp_connection_id(struct sr_scpi_dev_inst *scpi,
 	return SR_OK;
 }
 
+/* Whether received data is waiting in the read buffer. */
+static gboolean scpi_tcp_pending(void *priv)
+{
+	struct scpi_tcp *tcp = priv;
+
+	return tcp->read_pos < tcp->read_len;
+}
+
 static int scpi_tcp_source_add(struct sr_session *session, void *priv,
 		int events, int timeout, sr_receive_data_callback cb, void *cb_data)
 {
 	struct scpi_tcp *tcp = priv;
+	int ret;
 
-	return sr_session_source_add(session, tcp->socket, events, timeout,
+	ret = sr_session_source_add(session, tcp->socket, events, timeout,
 			cb, cb_data);
+	if (ret != SR_OK)
+		return ret;
+
+	/* The socket doesn't report what the buffer holds already. */
+	return sr_session_source_set_pending(session, tcp->socket,
+			scpi_tcp_pending, tcp);
 }
 
 static int scpi_tcp_source_remove(struct sr_session *session, void *priv)
@@ -154,6 +213,7 @@ static int scpi_tcp_send(void *priv, const char *command)
 		sr_err("Send error: %s", g_strerror(errno));
 		return SR_ERR;
 	}
+	tcp->bytes_sent += out;
 
 	if (out < len) {
 		sr_dbg("Only sent %d/%d bytes of SCPI command: '%s'.", out,
@@ -175,18 +235,92 @@ static int scpi_tcp_read_begin(void *priv)
 	return SR_OK;
 }
 
-static int scpi_tcp_raw_read_data(void *priv, char *buf, int maxlen)
+/*
+ * Receive what the socket has got into the read buffer. Blocks until
+ * data arrives when wait is set, returns 0 when none is there otherwise.
+ */
+static int scpi_tcp_fill(struct scpi_tcp *tcp, gboolean wait)
 {
-	struct scpi_tcp *tcp = priv;
+	fd_set fds;
+	struct timeval tv;
+	size_t space;
 	int len;
 
-	len = recv(tcp->socket, buf, maxlen, 0);
+	if (tcp->read_pos) {
+		memmove(tcp->read_buf, tcp->read_buf + tcp->read_pos,
+			tcp->read_len - tcp->read_pos);
+		tcp->read_len -= tcp->read_pos;
+		tcp->read_pos = 0;
+	}
+	space = READ_BUFFER_SIZE - tcp->read_len;
+	if (!space)
+		return 0;
+
+	if (!wait) {
+		FD_ZERO(&fds);
+		FD_SET(tcp->socket, &fds);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		len = select(tcp->socket + 1, &fds, NULL, NULL, &tv);
+		if (len < 0 && errno != EINTR) {
+			sr_err("Receive error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		if (len <= 0)
+			return 0;
+	}
 
+	len = recv(tcp->socket, tcp->read_buf + tcp->read_len, space, 0);
 	if (len < 0) {
 		sr_err("Receive error: %s", g_strerror(errno));
 		return SR_ERR;
 	}
+	if (len == 0) {
+		sr_err("Connection closed by the device.");
+		return SR_ERR;
+	}
+	tcp->read_len += len;
+	tcp->bytes_received += len;
 
+	return len;
+}
+
+/* Hand out up to maxlen bytes of the buffered data. */
+static size_t scpi_tcp_take(struct scpi_tcp *tcp, char *buf, size_t maxlen)
+{
+	size_t len;
+
+	len = MIN(tcp->read_len - tcp->read_pos, maxlen);
+	memcpy(buf, tcp->read_buf + tcp->read_pos, len);
+	tcp->read_pos += len;
+
+	return len;
+}
+
+static int scpi_tcp_raw_read_data(void *priv, char *buf, int maxlen)
+{
+	struct scpi_tcp *tcp = priv;
+	size_t avail;
+	int len, ret;
+
+	maxlen = MIN(maxlen, READ_BUFFER_SIZE);
+
+	/*
+	 * Block for the first byte like a plain recv() would, when there
+	 * is none. Otherwise just pick up what has arrived meanwhile.
+	 */
+	avail = tcp->read_len - tcp->read_pos;
+	if (avail < (size_t)maxlen) {
+		ret = scpi_tcp_fill(tcp, !avail);
+		if (ret < 0)
+			return ret;
+	}
+
+	len = scpi_tcp_take(tcp, buf, maxlen);
+	if (!len)
+		return 0;
+
+	/* A short read means that the device has sent all of its response. */
 	tcp->length_bytes_read = LENGTH_BYTES;
 	tcp->response_length = len < maxlen ? len : maxlen + 1;
 	tcp->response_bytes_read = len;
@@ -205,6 +339,7 @@ static int scpi_tcp_raw_write_data(void *priv, char *buf, int len)
 		sr_err("Send error: %s.", g_strerror(errno));
 		return SR_ERR;
 	}
+	tcp->bytes_sent += sentlen;
 
 	return sentlen;
 }
@@ -212,15 +347,17 @@ static int scpi_tcp_raw_write_data(void *priv, char *buf, int len)
 static int scpi_tcp_rigol_read_data(void *priv, char *buf, int maxlen)
 {
 	struct scpi_tcp *tcp = priv;
-	int len;
+	int len, ret;
+
+	if (tcp->read_pos == tcp->read_len) {
+		ret = scpi_tcp_fill(tcp, TRUE);
+		if (ret < 0)
+			return ret;
+	}
 
 	if (tcp->length_bytes_read < LENGTH_BYTES) {
-		len = recv(tcp->socket, tcp->length_buf + tcp->length_bytes_read,
-				LENGTH_BYTES - tcp->length_bytes_read, 0);
-		if (len < 0) {
-			sr_err("Receive error: %s", g_strerror(errno));
-			return SR_ERR;
-		}
+		len = scpi_tcp_take(tcp, tcp->length_buf + tcp->length_bytes_read,
+				LENGTH_BYTES - tcp->length_bytes_read);
 
 		tcp->length_bytes_read += len;
 
@@ -233,12 +370,9 @@ static int scpi_tcp_rigol_read_data(void *priv, char *buf, int maxlen)
 	if (tcp->response_bytes_read >= tcp->response_length)
 		return SR_ERR;
 
-	len = recv(tcp->socket, buf, maxlen, 0);
-
-	if (len < 0) {
-		sr_err("Receive error: %s", g_strerror(errno));
-		return SR_ERR;
-	}
+	/* Leave data of a following response for the next read. */
+	len = scpi_tcp_take(tcp, buf, MIN(maxlen,
+			tcp->response_length - tcp->response_bytes_read));
 
 	tcp->response_bytes_read += len;
 
@@ -256,6 +390,16 @@ static int scpi_tcp_read_complete(void *priv)
 static int scpi_tcp_close(struct sr_scpi_dev_inst *scpi)
 {
 	struct scpi_tcp *tcp = scpi->priv;
+	double secs;
+
+	secs = (g_get_monotonic_time() - tcp->open_time) / (double)G_USEC_PER_SEC;
+	sr_dbg("%s:%s: Sent %" PRIu64 " bytes, received %" PRIu64
+		" bytes in %.3f s (%.1f kB/s).", tcp->address, tcp->port,
+		tcp->bytes_sent, tcp->bytes_received, secs,
+		secs > 0 ? tcp->bytes_received / secs / 1000 : 0);
+
+	g_free(tcp->read_buf);
+	tcp->read_buf = NULL;
 
 	if (close(tcp->socket) < 0)
 		return SR_ERR;
@@ -269,6 +413,7 @@ static void scpi_tcp_free(void *priv)
 
 	g_free(tcp->address);
 	g_free(tcp->port);
+	g_free(tcp->read_buf);
 }
 
 SR_PRIV const struct sr_scpi_dev_inst scpi_tcp_raw_dev = {
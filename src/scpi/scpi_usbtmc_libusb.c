@@ -29,6 +29,13 @@
 #define MAX_TRANSFER_LENGTH 2048
 #define TRANSFER_TIMEOUT 1000
 
+/*
+ * Bulk in transfers which get queued for the rest of a long message,
+ * so that the device can keep sending while a chunk gets parsed.
+ */
+#define BULKIN_TRANSFERS 4
+#define BULKIN_TRANSFER_SIZE (64 * 1024)
+
 struct scpi_usbtmc_libusb {
 	struct sr_context *ctx;
 	struct sr_usb_dev_inst *usb;
@@ -43,9 +50,20 @@ struct scpi_usbtmc_libusb {
 	uint8_t bTag;
 	uint8_t bulkin_attributes;
 	uint8_t buffer[MAX_TRANSFER_LENGTH];
+	/* Either the above buffer, or a completed bulk in transfer's. */
+	uint8_t *response_data;
 	int response_length;
 	int response_bytes_read;
 	int remaining_length;
+	/* Ring of bulk in transfers, starting at the oldest queued one. */
+	struct libusb_transfer *bulkin[BULKIN_TRANSFERS];
+	int bulkin_completed[BULKIN_TRANSFERS];
+	int bulkin_head;
+	int bulkin_queued;
+	/* Set while response_data is the buffer of the transfer before head. */
+	gboolean bulkin_held;
+	/* Bytes which the queued transfers can receive. */
+	int bulkin_queued_length;
 };
 
 /* Some USBTMC-specific enums, as defined in the USBTMC standard. */
@@ -130,7 +148,7 @@ static GSList *scpi_usbtmc_libusb_scan(struct drv_context *drvc)
 	int confidx, intfidx, ret, i;
 	char *res;
 
-	ret = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	ret = sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	if (ret < 0) {
 		sr_err("Failed to get device list: %s.",
 		       libusb_error_name(ret));
@@ -301,7 +319,7 @@ static int scpi_usbtmc_libusb_open(struct sr_scpi_dev_inst *scpi)
 	int confidx, intfidx, epidx, config = 0, current_config;
 	uint8_t capabilities[24];
 	int ret, found = 0;
-	int do_reset;
+	int do_reset, i;
 
 	if (usb->devhdl)
 		return SR_OK;
@@ -410,6 +428,15 @@ static int scpi_usbtmc_libusb_open(struct sr_scpi_dev_inst *scpi)
 	       uscpi->usb488_dev_cap & USB488_DEV_CAP_RL1         ? "RL1"  : "RL0",
 	       uscpi->usb488_dev_cap & USB488_DEV_CAP_DT1         ? "DT1"  : "DT0");
 
+	for (i = 0; i < BULKIN_TRANSFERS; i++) {
+		uscpi->bulkin[i] = libusb_alloc_transfer(0);
+		uscpi->bulkin[i]->buffer = g_malloc(BULKIN_TRANSFER_SIZE);
+	}
+	uscpi->bulkin_head = 0;
+	uscpi->bulkin_queued = 0;
+	uscpi->bulkin_held = FALSE;
+	uscpi->response_data = uscpi->buffer;
+
 	scpi_usbtmc_remote(uscpi);
 
 	return SR_OK;
@@ -570,25 +597,141 @@ static int scpi_usbtmc_bulkin_start(struct scpi_usbtmc_libusb *uscpi,
 	return transferred - USBTMC_BULK_HEADER_SIZE;
 }
 
-static int scpi_usbtmc_bulkin_continue(struct scpi_usbtmc_libusb *uscpi,
-                                       void *data, int size)
+static void LIBUSB_CALL bulkin_callback(struct libusb_transfer *transfer)
 {
-	struct sr_usb_dev_inst *usb = uscpi->usb;
-	int ret, transferred;
+	int *completed = transfer->user_data;
 
-	ret = libusb_bulk_transfer(usb->devhdl, uscpi->bulk_in_ep, data, size,
-	                           &transferred, TRANSFER_TIMEOUT);
-	if (ret < 0) {
-		sr_err("USBTMC bulk in transfer error: %s.",
-		       libusb_error_name(ret));
+	*completed = 1;
+}
+
+/* Wait for a queued bulk in transfer to complete, or to time out. */
+static int scpi_usbtmc_bulkin_wait(struct scpi_usbtmc_libusb *uscpi, int idx)
+{
+	struct timeval tv;
+	gint64 deadline, now;
+	int ret;
+
+	deadline = g_get_monotonic_time() + TRANSFER_TIMEOUT * 1000;
+	while (!uscpi->bulkin_completed[idx]) {
+		now = g_get_monotonic_time();
+		if (now >= deadline)
+			return SR_ERR_TIMEOUT;
+		tv.tv_sec = (deadline - now) / G_USEC_PER_SEC;
+		tv.tv_usec = (deadline - now) % G_USEC_PER_SEC;
+		ret = libusb_handle_events_timeout_completed(
+			uscpi->ctx->libusb_ctx, &tv,
+			&uscpi->bulkin_completed[idx]);
+		if (ret < 0) {
+			sr_err("USBTMC bulk in event handling error: %s.",
+			       libusb_error_name(ret));
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Cancel the queued bulk in transfers. They must not be left around to
+ * receive the start of the next message.
+ */
+static void scpi_usbtmc_bulkin_cancel(struct scpi_usbtmc_libusb *uscpi)
+{
+	int i, idx;
+
+	for (i = 0; i < uscpi->bulkin_queued; i++) {
+		idx = (uscpi->bulkin_head + i) % BULKIN_TRANSFERS;
+		if (!uscpi->bulkin_completed[idx])
+			libusb_cancel_transfer(uscpi->bulkin[idx]);
+	}
+	for (i = 0; i < uscpi->bulkin_queued; i++) {
+		idx = (uscpi->bulkin_head + i) % BULKIN_TRANSFERS;
+		if (scpi_usbtmc_bulkin_wait(uscpi, idx) != SR_OK)
+			sr_warn("USBTMC bulk in transfer did not cancel.");
+	}
+	uscpi->bulkin_queued = 0;
+	uscpi->bulkin_queued_length = 0;
+	uscpi->bulkin_held = FALSE;
+}
+
+/* Queue bulk in transfers until the rest of the message is covered. */
+static int scpi_usbtmc_bulkin_queue(struct scpi_usbtmc_libusb *uscpi)
+{
+	struct libusb_transfer *transfer;
+	int idx, size, ret;
+
+	while (uscpi->bulkin_queued_length < uscpi->remaining_length &&
+	       uscpi->bulkin_queued + uscpi->bulkin_held < BULKIN_TRANSFERS) {
+		idx = (uscpi->bulkin_head + uscpi->bulkin_queued) % BULKIN_TRANSFERS;
+		transfer = uscpi->bulkin[idx];
+
+		/*
+		 * Size the transfer to what is left of the announced length,
+		 * plus alignment padding, in whole maximum sized packets.
+		 */
+		size = uscpi->remaining_length - uscpi->bulkin_queued_length + 3;
+		size = (size + MAX_TRANSFER_LENGTH - 1) / MAX_TRANSFER_LENGTH
+			* MAX_TRANSFER_LENGTH;
+		size = MIN(size, BULKIN_TRANSFER_SIZE);
+
+		libusb_fill_bulk_transfer(transfer, uscpi->usb->devhdl,
+			uscpi->bulk_in_ep, transfer->buffer, size,
+			bulkin_callback, &uscpi->bulkin_completed[idx], 0);
+		uscpi->bulkin_completed[idx] = 0;
+		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+			sr_err("USBTMC bulk in transfer submit error: %s.",
+			       libusb_error_name(ret));
+			return SR_ERR;
+		}
+		uscpi->bulkin_queued++;
+		uscpi->bulkin_queued_length += size;
+	}
+
+	return SR_OK;
+}
+
+/* Take the next chunk of the message from the queued transfers. */
+static int scpi_usbtmc_bulkin_continue(struct scpi_usbtmc_libusb *uscpi)
+{
+	struct libusb_transfer *transfer;
+	int idx, ret;
+
+	uscpi->bulkin_held = FALSE;
+	if (scpi_usbtmc_bulkin_queue(uscpi) != SR_OK || !uscpi->bulkin_queued) {
+		scpi_usbtmc_bulkin_cancel(uscpi);
+		return SR_ERR;
+	}
+
+	idx = uscpi->bulkin_head;
+	transfer = uscpi->bulkin[idx];
+	ret = scpi_usbtmc_bulkin_wait(uscpi, idx);
+	if (ret == SR_OK && transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		sr_err("USBTMC bulk in transfer error: %d.", transfer->status);
+		ret = SR_ERR;
+	} else if (ret == SR_ERR_TIMEOUT) {
+		sr_err("USBTMC bulk in transfer timed out.");
+	}
+	if (ret != SR_OK) {
+		scpi_usbtmc_bulkin_cancel(uscpi);
 		return SR_ERR;
 	}
 
-	uscpi->response_length = MIN(transferred, uscpi->remaining_length);
+	uscpi->bulkin_head = (idx + 1) % BULKIN_TRANSFERS;
+	uscpi->bulkin_queued--;
+	uscpi->bulkin_queued_length -= transfer->length;
+	uscpi->bulkin_held = TRUE;
+
+	uscpi->response_data = transfer->buffer;
+	uscpi->response_length = MIN(transfer->actual_length,
+		uscpi->remaining_length);
 	uscpi->response_bytes_read = 0;
 	uscpi->remaining_length -= uscpi->response_length;
 
-	return transferred;
+	/* Transfers which are still queued cannot be part of the message. */
+	if (uscpi->remaining_length <= 0 && uscpi->bulkin_queued)
+		scpi_usbtmc_bulkin_cancel(uscpi);
+
+	return transfer->actual_length;
 }
 
 static int scpi_usbtmc_libusb_send(void *priv, const char *command)
@@ -608,6 +751,8 @@ static int scpi_usbtmc_libusb_read_begin(void *priv)
 {
 	struct scpi_usbtmc_libusb *uscpi = priv;
 
+	scpi_usbtmc_bulkin_cancel(uscpi);
+	uscpi->response_data = uscpi->buffer;
 	uscpi->remaining_length = 0;
 
 	if (scpi_usbtmc_bulkout(uscpi, REQUEST_DEV_DEP_MSG_IN,
@@ -628,8 +773,7 @@ static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
 
 	if (uscpi->response_bytes_read >= uscpi->response_length) {
 		if (uscpi->remaining_length > 0) {
-			if (scpi_usbtmc_bulkin_continue(uscpi, uscpi->buffer,
-			                                sizeof(uscpi->buffer)) <= 0)
+			if (scpi_usbtmc_bulkin_continue(uscpi) <= 0)
 				return SR_ERR;
 		} else {
 			if (uscpi->bulkin_attributes & EOM)
@@ -641,7 +785,7 @@ static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
 
 	read_length = MIN(uscpi->response_length - uscpi->response_bytes_read, maxlen);
 
-	memcpy(buf, uscpi->buffer + uscpi->response_bytes_read, read_length);
+	memcpy(buf, uscpi->response_data + uscpi->response_bytes_read, read_length);
 
 	uscpi->response_bytes_read += read_length;
 
@@ -660,11 +804,20 @@ static int scpi_usbtmc_libusb_close(struct sr_scpi_dev_inst *scpi)
 {
 	struct scpi_usbtmc_libusb *uscpi = scpi->priv;
 	struct sr_usb_dev_inst *usb = uscpi->usb;
-	int ret;
+	int ret, i;
 
 	if (!usb->devhdl)
 		return SR_ERR;
 
+	scpi_usbtmc_bulkin_cancel(uscpi);
+	for (i = 0; i < BULKIN_TRANSFERS; i++) {
+		if (!uscpi->bulkin[i])
+			continue;
+		g_free(uscpi->bulkin[i]->buffer);
+		libusb_free_transfer(uscpi->bulkin[i]);
+		uscpi->bulkin[i] = NULL;
+	}
+
 	scpi_usbtmc_local(uscpi);
 
 	if ((ret = libusb_release_interface(usb->devhdl, uscpi->interface)) < 0)
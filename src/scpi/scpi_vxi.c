@@ -31,13 +31,28 @@
 #define LOG_PREFIX "scpi_vxi"
 #define VXI_DEFAULT_TIMEOUT_MS 2000
 
+/*
+ * Range of the read request size. It starts small for each response,
+ * and grows as long as the device fills the requests, so that large
+ * blocks take few RPC round trips.
+ */
+#define VXI_MIN_READ_SIZE (16 * 1024)
+#define VXI_MAX_READ_SIZE (4 * 1024 * 1024)
+
 struct scpi_vxi {
 	char *address;
 	char *instrument;
 	CLIENT *client;
+	/* Asynchronous channel for aborts, if the device offers one. */
+	CLIENT *abort_client;
 	Device_Link link;
 	unsigned int max_send_size;
+	unsigned int read_size;
 	unsigned int read_complete;
+	/* Received data which no read has taken yet. */
+	char *rx_data;
+	unsigned int rx_len;
+	unsigned int rx_pos;
 };
 
 static int scpi_vxi_dev_inst_new(void *priv, struct drv_context *drvc,
@@ -61,6 +76,50 @@ static int scpi_vxi_dev_inst_new(void *priv, struct drv_context *drvc,
 	return SR_OK;
 }
 
+/*
+ * Connect to the abort channel, which is at the given port of the
+ * host the core channel is connected to. Not having it is not fatal.
+ */
+static void scpi_vxi_abort_open(struct scpi_vxi *vxi, u_short port)
+{
+	struct sockaddr_in addr;
+	int sock;
+
+	vxi->abort_client = NULL;
+	if (!port)
+		return;
+
+	memset(&addr, 0, sizeof(addr));
+	if (!clnt_control(vxi->client, CLGET_SERVER_ADDR, (char *)&addr) ||
+			addr.sin_family != AF_INET) {
+		sr_dbg("No abort channel for %s.", vxi->address);
+		return;
+	}
+	addr.sin_port = htons(port);
+
+	sock = RPC_ANYSOCK;
+	vxi->abort_client = clnttcp_create(&addr,
+		DEVICE_ASYNC, DEVICE_ASYNC_VERSION, &sock, 0, 0);
+	if (!vxi->abort_client)
+		sr_dbg("Cannot connect to abort channel of %s.", vxi->address);
+}
+
+/* Abort an operation of the core channel which did not return. */
+static void scpi_vxi_abort(struct scpi_vxi *vxi)
+{
+	Device_Error *dev_error;
+
+	if (!vxi->abort_client)
+		return;
+
+	dev_error = device_abort_1(&vxi->link, vxi->abort_client);
+	if (!dev_error || dev_error->error)
+		sr_dbg("Device abort failed for %s with error %ld",
+		       vxi->address, dev_error ? dev_error->error : 0);
+	else
+		sr_dbg("Aborted pending operation of %s.", vxi->address);
+}
+
 static int scpi_vxi_open(struct sr_scpi_dev_inst *scpi)
 {
 	struct scpi_vxi *vxi;
@@ -93,6 +152,8 @@ static int scpi_vxi_open(struct sr_scpi_dev_inst *scpi)
 	if (vxi->max_send_size <= 0)
 		vxi->max_send_size = 4096;
 
+	scpi_vxi_abort_open(vxi, link_resp->abortPort);
+
 	return SR_OK;
 }
 
@@ -167,7 +228,9 @@ static int scpi_vxi_read_begin(void *priv)
 	struct scpi_vxi *vxi;
 
 	vxi = priv;
-	vxi->read_complete = 0;
+	vxi->read_size = VXI_MIN_READ_SIZE;
+	if (vxi->rx_pos == vxi->rx_len)
+		vxi->read_complete = 0;
 
 	return SR_OK;
 }
@@ -182,38 +245,56 @@ static int scpi_vxi_read_data(void *priv, char *buf, int maxlen)
 	struct scpi_vxi *vxi;
 	Device_ReadParms read_parms;
 	Device_ReadResp *read_resp;
+	unsigned int len;
 
 	vxi = priv;
-	read_parms.lid          = vxi->link;
-	read_parms.io_timeout   = VXI_DEFAULT_TIMEOUT_MS;
-	read_parms.lock_timeout = VXI_DEFAULT_TIMEOUT_MS;
-	read_parms.flags        = 0;
-	read_parms.termChar     = 0;
-	read_parms.requestSize  = maxlen;
-
-	read_resp = device_read_1(&read_parms, vxi->client);
-	if (!read_resp || read_resp->error) {
-		sr_err("Device read failed for %s with error %ld",
-		       vxi->address, read_resp ? read_resp->error : 0);
-		if (read_resp) {
-			g_free(read_resp->data.data_val);
-			read_resp->data.data_val = NULL;
+	if (vxi->rx_pos == vxi->rx_len) {
+		g_free(vxi->rx_data);
+		vxi->rx_data = NULL;
+		vxi->rx_len = vxi->rx_pos = 0;
+
+		read_parms.lid          = vxi->link;
+		read_parms.io_timeout   = VXI_DEFAULT_TIMEOUT_MS;
+		read_parms.lock_timeout = VXI_DEFAULT_TIMEOUT_MS;
+		read_parms.flags        = 0;
+		read_parms.termChar     = 0;
+		read_parms.requestSize  = MAX((unsigned int)maxlen, vxi->read_size);
+
+		read_resp = device_read_1(&read_parms, vxi->client);
+		if (!read_resp || read_resp->error) {
+			sr_err("Device read failed for %s with error %ld",
+			       vxi->address, read_resp ? read_resp->error : 0);
+			if (read_resp) {
+				g_free(read_resp->data.data_val);
+				read_resp->data.data_val = NULL;
+			} else {
+				scpi_vxi_abort(vxi);
+			}
+			return SR_ERR;
 		}
-		return SR_ERR;
+
+		/* Keep the received data, and hand it out from there. */
+		vxi->rx_data = read_resp->data.data_val;
+		vxi->rx_len = read_resp->data.data_len;
+		read_resp->data.data_val = NULL;
+		vxi->read_complete = read_resp->reason & (RRR_TERM | RRR_END);
+
+		if (!vxi->read_complete && (read_resp->reason & RRR_SIZE))
+			vxi->read_size = MIN(2 * vxi->read_size, VXI_MAX_READ_SIZE);
 	}
 
-	memcpy(buf, read_resp->data.data_val, read_resp->data.data_len);
-	g_free(read_resp->data.data_val);
-	read_resp->data.data_val = NULL;
-	vxi->read_complete = read_resp->reason & (RRR_TERM | RRR_END);
-	return read_resp->data.data_len;  /* actual number of bytes received */
+	len = MIN((unsigned int)maxlen, vxi->rx_len - vxi->rx_pos);
+	memcpy(buf, vxi->rx_data + vxi->rx_pos, len);
+	vxi->rx_pos += len;
+
+	return len;  /* actual number of bytes received */
 }
 
 static int scpi_vxi_read_complete(void *priv)
 {
 	struct scpi_vxi *vxi = priv;
 
-	return vxi->read_complete;
+	return vxi->read_complete && vxi->rx_pos == vxi->rx_len;
 }
 
 static int scpi_vxi_close(struct sr_scpi_dev_inst *scpi)
@@ -231,9 +312,17 @@ static int scpi_vxi_close(struct sr_scpi_dev_inst *scpi)
 		return SR_ERR;
 	}
 
+	if (vxi->abort_client) {
+		clnt_destroy(vxi->abort_client);
+		vxi->abort_client = NULL;
+	}
 	clnt_destroy(vxi->client);
 	vxi->client = NULL;
 
+	g_free(vxi->rx_data);
+	vxi->rx_data = NULL;
+	vxi->rx_len = vxi->rx_pos = 0;
+
 	return SR_OK;
 }
 
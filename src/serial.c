@@ -168,7 +168,7 @@ SR_PRIV int serial_close(struct sr_serial_dev_inst *serial)
 
 	rc = serial->lib_funcs->close(serial);
 	if (rc == SR_OK && serial->rcv_buffer) {
-		g_string_free(serial->rcv_buffer, TRUE);
+		sr_ser_rx_queue_free(serial->rcv_buffer);
 		serial->rcv_buffer = NULL;
 	}
 
@@ -274,6 +274,60 @@ SR_PRIV int serial_set_read_chunk_cb(struct sr_serial_dev_inst *serial,
 	return SR_OK;
 }
 
+/**
+ * Create a queue for received data. Internal to the serial subsystem,
+ * for transports which receive data in chunks.
+ *
+ * @param[in] size Initial capacity in bytes, the queue grows when
+ *                 it overflows.
+ *
+ * @private
+ */
+SR_PRIV struct sr_ser_rx_queue *sr_ser_rx_queue_new(size_t size)
+{
+	struct sr_ser_rx_queue *queue;
+
+	queue = g_malloc0(sizeof(*queue));
+	queue->size = MAX(size, 64);
+	queue->buf = g_malloc(queue->size);
+
+	return queue;
+}
+
+/** @private */
+SR_PRIV void sr_ser_rx_queue_free(struct sr_ser_rx_queue *queue)
+{
+	if (!queue)
+		return;
+
+	g_free(queue->buf);
+	g_free(queue);
+}
+
+/* Copy the oldest len queued bytes, which may wrap around the end. */
+static void rx_queue_copy(const struct sr_ser_rx_queue *queue,
+	uint8_t *data, size_t len)
+{
+	size_t first;
+
+	first = MIN(len, queue->size - queue->pos);
+	memcpy(data, &queue->buf[queue->pos], first);
+	memcpy(&data[first], queue->buf, len - first);
+}
+
+/* Move the queued bytes to a buffer of the given size, at its start. */
+static void rx_queue_realloc(struct sr_ser_rx_queue *queue, size_t size)
+{
+	uint8_t *buf;
+
+	buf = g_malloc(size);
+	rx_queue_copy(queue, buf, queue->len);
+	g_free(queue->buf);
+	queue->buf = buf;
+	queue->size = size;
+	queue->pos = 0;
+}
+
 /**
  * Discard previously queued RX data. Internal to the serial subsystem,
  * coordination between common and transport specific support code.
@@ -287,7 +341,8 @@ SR_PRIV void sr_ser_discard_queued_data(struct sr_serial_dev_inst *serial)
 	if (!serial || !serial->rcv_buffer)
 		return;
 
-	g_string_truncate(serial->rcv_buffer, 0);
+	serial->rcv_buffer->pos = 0;
+	serial->rcv_buffer->len = 0;
 }
 
 /**
@@ -319,13 +374,31 @@ SR_PRIV size_t sr_ser_has_queued_data(struct sr_serial_dev_inst *serial)
 SR_PRIV void sr_ser_queue_rx_data(struct sr_serial_dev_inst *serial,
 	const uint8_t *data, size_t len)
 {
+	struct sr_ser_rx_queue *queue;
+	size_t size, end, first;
+
 	if (!serial || !data || !len)
 		return;
 
-	if (serial->rx_chunk_cb_func)
+	if (serial->rx_chunk_cb_func) {
 		serial->rx_chunk_cb_func(serial, serial->rx_chunk_cb_data, data, len);
-	else if (serial->rcv_buffer)
-		g_string_append_len(serial->rcv_buffer, (const gchar *)data, len);
+		return;
+	}
+	if (!(queue = serial->rcv_buffer))
+		return;
+
+	if (queue->len + len > queue->size) {
+		size = queue->size;
+		while (queue->len + len > size)
+			size *= 2;
+		rx_queue_realloc(queue, size);
+	}
+
+	end = (queue->pos + queue->len) % queue->size;
+	first = MIN(len, queue->size - end);
+	memcpy(&queue->buf[end], data, first);
+	memcpy(queue->buf, &data[first], len - first);
+	queue->len += len;
 }
 
 /**
@@ -342,7 +415,6 @@ SR_PRIV size_t sr_ser_unqueue_rx_data(struct sr_serial_dev_inst *serial,
 	uint8_t *data, size_t len)
 {
 	size_t qlen;
-	GString *buf;
 
 	if (!serial || !data || !len)
 		return 0;
@@ -351,17 +423,70 @@ SR_PRIV size_t sr_ser_unqueue_rx_data(struct sr_serial_dev_inst *serial,
 	if (!qlen)
 		return 0;
 
-	buf = serial->rcv_buffer;
-	if (len > buf->len)
-		len = buf->len;
-	if (len) {
-		memcpy(data, buf->str, len);
-		g_string_erase(buf, 0, len);
-	}
+	if (len > qlen)
+		len = qlen;
+	rx_queue_copy(serial->rcv_buffer, data, len);
+	sr_ser_consume_rx_data(serial, len);
 
 	return len;
 }
 
+/**
+ * Look at previously queued RX data without taking it. Internal to the
+ * serial subsystem, and for parsers which scan the data in place.
+ *
+ * @param[in] serial Previously opened serial port instance.
+ * @param[in] len Number of data bytes to look at.
+ * @param[out] data Pointer to the oldest queued byte.
+ *
+ * @returns The number of bytes available at *data, up to len.
+ *
+ * The bytes are made contiguous when they wrap around the end of the
+ * queue. They stay available until sr_ser_consume_rx_data() or more
+ * data gets queued.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_ser_peek_rx_data(struct sr_serial_dev_inst *serial,
+	size_t len, const uint8_t **data)
+{
+	struct sr_ser_rx_queue *queue;
+
+	*data = NULL;
+	len = MIN(len, sr_ser_has_queued_data(serial));
+	if (!len)
+		return 0;
+
+	queue = serial->rcv_buffer;
+	if (queue->pos + len > queue->size)
+		rx_queue_realloc(queue, queue->size);
+	*data = &queue->buf[queue->pos];
+
+	return len;
+}
+
+/**
+ * Drop the oldest queued RX data, after sr_ser_peek_rx_data().
+ *
+ * @param[in] serial Previously opened serial port instance.
+ * @param[in] len Number of data bytes to drop.
+ *
+ * @private
+ */
+SR_PRIV void sr_ser_consume_rx_data(struct sr_serial_dev_inst *serial,
+	size_t len)
+{
+	struct sr_ser_rx_queue *queue;
+
+	len = MIN(len, sr_ser_has_queued_data(serial));
+	if (!len)
+		return;
+
+	queue = serial->rcv_buffer;
+	queue->len -= len;
+	queue->pos = queue->len ? (queue->pos + len) % queue->size : 0;
+}
+
 /**
  * Check for available receive data.
  *
@@ -464,8 +589,10 @@ static int _serial_read(struct sr_serial_dev_inst *serial,
 		return SR_ERR_NA;
 	ret = serial->lib_funcs->read(serial, buf, count,
 		nonblocking, timeout_ms);
-	if (ret > 0)
+	if (ret > 0) {
+		sr_session_receive_mark();
 		sr_spew("Read %zd/%zu bytes.", ret, count);
+	}
 
 	return ret;
 }
@@ -784,6 +911,48 @@ SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial,
 	return SR_OK;
 }
 
+/**
+ * Find the next position in receive data where a packet can start.
+ *
+ * @param[in] framing The chip's packet framing description.
+ * @param[in] buf Receive data.
+ * @param[in] len Number of bytes in the receive data.
+ *
+ * Positions which fail the framing's sync byte or terminator check get
+ * skipped. The search stops at the first position which does not yet
+ * have the complete packet in the receive data, so that callers don't
+ * need to inspect skipped bytes again when more data arrives.
+ *
+ * @return The offset of the next candidate packet, or the offset where
+ *         the search needs more receive data. Never exceeds len.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_packet_framing_skip(const struct sr_packet_framing *framing,
+	const uint8_t *buf, size_t len)
+{
+	size_t pos, term_len, term_pos;
+
+	if (!framing || !buf)
+		return 0;
+
+	term_len = framing->terminator ? strlen(framing->terminator) : 0;
+	term_pos = framing->packet_size - term_len;
+	for (pos = 0; pos < len; pos++) {
+		if ((buf[pos] & framing->sync_mask) != framing->sync_value)
+			continue;
+		if (!term_len)
+			return pos;
+		if (len - pos < framing->packet_size)
+			return pos;
+		if (memcmp(&buf[pos + term_pos], framing->terminator,
+				term_len) == 0)
+			return pos;
+	}
+
+	return len;
+}
+
 /**
  * Try to find a valid packet in a serial data stream.
  *
@@ -816,9 +985,9 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 	packet_valid_len_callback is_valid_len, size_t *return_size,
 	uint64_t timeout_ms)
 {
-	uint64_t start_us, elapsed_ms, byte_delay_us;
-	size_t fill_idx, check_idx, max_fill_idx;
-	ssize_t recv_len;
+	uint64_t start_us, elapsed_ms;
+	size_t fill_idx, check_idx, max_fill_idx, want_len;
+	int recv_len;
 	const uint8_t *check_ptr;
 	size_t check_len, pkt_len;
 	gboolean do_dump;
@@ -838,20 +1007,30 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 		return SR_ERR_ARG;
 	}
 
-	byte_delay_us = serial_timeout(serial, 1) * 1000;
 	start_us = g_get_monotonic_time();
 
 	check_idx = fill_idx = 0;
+	elapsed_ms = 0;
 	while (fill_idx < max_fill_idx) {
 		/*
-		 * Read bytes individually. Lets callers continue to
-		 * successfully process next RX data after first match.
-		 * Run full loop bodies for empty or failed reception
-		 * in an iteration, to have timeouts checked.
+		 * Block until the bytes which complete the next packet
+		 * candidate were received, but never read beyond it.
+		 * Lets callers continue to successfully process next
+		 * RX data after first match. Run full loop bodies for
+		 * short reception in an iteration, to have timeouts
+		 * checked.
 		 */
-		recv_len = serial_read_nonblocking(serial, &buf[fill_idx], 1);
-		if (recv_len > 0)
-			fill_idx += recv_len;
+		want_len = fill_idx - check_idx;
+		want_len = (want_len < packet_size) ? packet_size - want_len : 1;
+		want_len = MIN(want_len, max_fill_idx - fill_idx);
+		recv_len = serial_read_blocking(serial, &buf[fill_idx],
+			want_len, MAX(timeout_ms - elapsed_ms, 1));
+		if (recv_len < 0) {
+			sr_dbg("Read error %d during packet detection.",
+				recv_len);
+			break;
+		}
+		fill_idx += recv_len;
 
 		/* Dump receive data when (a minimum) size is reached. */
 		check_ptr = &buf[check_idx];
@@ -916,8 +1095,6 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 				elapsed_ms);
 			break;
 		}
-		if (recv_len < 1)
-			g_usleep(byte_delay_us);
 	}
 	sr_info("Didn't find a valid packet (read %zu bytes).", fill_idx);
 	*buflen = fill_idx;
@@ -29,6 +29,9 @@
 #include <string.h>
 #ifdef G_OS_WIN32
 #include <windows.h> /* for HANDLE */
+#else
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #define LOG_PREFIX "serial-hid"
@@ -69,6 +72,199 @@ static void ser_hid_mask_databits(struct sr_serial_dev_inst *serial,
 		data[idx] &= mask;
 }
 
+/* }}} */
+/* {{{ background reception of HID reports */
+
+/* Period [ms] at which the reader thread checks for its termination. */
+#define SER_HID_READER_POLL_MS	100
+
+/*
+ * A thread which receives HID reports for one device, and keeps their
+ * data until the session thread moves it to the serial RX queue. Lets
+ * the session's main loop handle several HID attached devices without
+ * waiting for USB round trips. The wakeup pipe (where available) lets
+ * the session source fire as soon as receive data has arrived.
+ */
+struct ser_hid_reader {
+	struct sr_serial_dev_inst *serial;
+	GThread *thread;
+	gint stop;
+	GMutex mutex;
+	GCond cond;
+	GByteArray *data;
+	int error;
+	int wakeup[2];
+};
+
+static void ser_hid_reader_wakeup(struct ser_hid_reader *reader)
+{
+#ifndef G_OS_WIN32
+	const uint8_t token = 0;
+
+	if (reader->wakeup[1] >= 0 && write(reader->wakeup[1], &token, 1) < 0)
+		sr_spew("Wakeup pipe is full.");
+#else
+	(void)reader;
+#endif
+}
+
+static void ser_hid_reader_clear_wakeup(struct ser_hid_reader *reader)
+{
+#ifndef G_OS_WIN32
+	uint8_t tokens[16];
+
+	if (reader->wakeup[0] < 0)
+		return;
+	while (read(reader->wakeup[0], tokens, sizeof(tokens)) > 0)
+		;
+#else
+	(void)reader;
+#endif
+}
+
+static gpointer ser_hid_reader_thread(gpointer data)
+{
+	struct ser_hid_reader *reader;
+	struct sr_serial_dev_inst *serial;
+	uint8_t rx_buf[SER_HID_CHUNK_SIZE];
+	gboolean was_empty;
+	int rc;
+
+	reader = data;
+	serial = reader->serial;
+	while (!g_atomic_int_get(&reader->stop)) {
+		rc = serial->hid_chip_funcs->read_bytes(serial,
+				rx_buf, sizeof(rx_buf), SER_HID_READER_POLL_MS);
+		if (rc < 0) {
+			sr_err("HID report reception failed: %d.", rc);
+			g_mutex_lock(&reader->mutex);
+			reader->error = SR_ERR_IO;
+			g_cond_broadcast(&reader->cond);
+			g_mutex_unlock(&reader->mutex);
+			ser_hid_reader_wakeup(reader);
+			break;
+		}
+		if (!rc)
+			continue;
+		ser_hid_mask_databits(serial, rx_buf, rc);
+
+		g_mutex_lock(&reader->mutex);
+		was_empty = !reader->data->len;
+		g_byte_array_append(reader->data, rx_buf, rc);
+		g_cond_broadcast(&reader->cond);
+		g_mutex_unlock(&reader->mutex);
+		if (was_empty)
+			ser_hid_reader_wakeup(reader);
+	}
+
+	return NULL;
+}
+
+static int ser_hid_reader_start(struct sr_serial_dev_inst *serial)
+{
+	struct ser_hid_reader *reader;
+	GError *err;
+	int fd;
+
+	if (serial->hid_reader)
+		return SR_OK;
+	if (!serial->hid_chip_funcs || !serial->hid_chip_funcs->read_bytes)
+		return SR_ERR_NA;
+
+	reader = g_malloc0(sizeof(*reader));
+	reader->serial = serial;
+	g_mutex_init(&reader->mutex);
+	g_cond_init(&reader->cond);
+	reader->data = g_byte_array_sized_new(SER_HID_CHUNK_SIZE);
+	reader->wakeup[0] = reader->wakeup[1] = -1;
+#ifndef G_OS_WIN32
+	if (pipe(reader->wakeup) == 0) {
+		for (fd = 0; fd < 2; fd++)
+			fcntl(reader->wakeup[fd], F_SETFL, O_NONBLOCK);
+	} else {
+		sr_warn("Cannot create wakeup pipe, polling for HID data.");
+		reader->wakeup[0] = reader->wakeup[1] = -1;
+	}
+#else
+	(void)fd;
+#endif
+
+	err = NULL;
+	reader->thread = g_thread_try_new("sr-hid-rx",
+		ser_hid_reader_thread, reader, &err);
+	if (!reader->thread) {
+		sr_warn("Cannot start HID reader thread: %s.", err->message);
+		g_error_free(err);
+#ifndef G_OS_WIN32
+		if (reader->wakeup[0] >= 0) {
+			close(reader->wakeup[0]);
+			close(reader->wakeup[1]);
+		}
+#endif
+		g_byte_array_free(reader->data, TRUE);
+		g_cond_clear(&reader->cond);
+		g_mutex_clear(&reader->mutex);
+		g_free(reader);
+		return SR_ERR;
+	}
+	serial->hid_reader = reader;
+
+	return SR_OK;
+}
+
+/* Move receive data which the reader thread has kept to the RX queue. */
+static void ser_hid_reader_take_locked(struct sr_serial_dev_inst *serial)
+{
+	struct ser_hid_reader *reader;
+
+	reader = serial->hid_reader;
+	if (!reader->data->len)
+		return;
+	sr_ser_queue_rx_data(serial, reader->data->data, reader->data->len);
+	g_byte_array_set_size(reader->data, 0);
+}
+
+static int ser_hid_reader_take(struct sr_serial_dev_inst *serial)
+{
+	struct ser_hid_reader *reader;
+	int ret;
+
+	reader = serial->hid_reader;
+	ser_hid_reader_clear_wakeup(reader);
+	g_mutex_lock(&reader->mutex);
+	ser_hid_reader_take_locked(serial);
+	ret = reader->error;
+	g_mutex_unlock(&reader->mutex);
+
+	return ret;
+}
+
+static void ser_hid_reader_stop(struct sr_serial_dev_inst *serial)
+{
+	struct ser_hid_reader *reader;
+
+	reader = serial->hid_reader;
+	if (!reader)
+		return;
+
+	g_atomic_int_set(&reader->stop, 1);
+	g_thread_join(reader->thread);
+	/* Keep what was received, later reads may still want it. */
+	ser_hid_reader_take_locked(serial);
+	serial->hid_reader = NULL;
+
+#ifndef G_OS_WIN32
+	if (reader->wakeup[0] >= 0) {
+		close(reader->wakeup[0]);
+		close(reader->wakeup[1]);
+	}
+#endif
+	g_byte_array_free(reader->data, TRUE);
+	g_cond_clear(&reader->cond);
+	g_mutex_clear(&reader->mutex);
+	g_free(reader);
+}
+
 /* }}} */
 /* {{{ open/close/list/find HIDAPI connection, exchange HID requests and data */
 
@@ -392,6 +588,7 @@ static int ser_hid_hidapi_open_dev(struct sr_serial_dev_inst *serial)
 
 static void ser_hid_hidapi_close_dev(struct sr_serial_dev_inst *serial)
 {
+	ser_hid_reader_stop(serial);
 	if (serial->hid_dev) {
 		hid_close(serial->hid_dev);
 		serial->hid_dev = NULL;
@@ -425,19 +622,27 @@ static int hidapi_source_cb(int fd, int revents, void *cb_data)
 	args = cb_data;
 
 	/*
-	 * Drain receive data which the chip might have pending. This is
-	 * "a copy" of the "background part" of ser_hid_read(), without
-	 * the timeout support code, and not knowing how much data the
-	 * application is expecting.
+	 * Pick up what the reader thread has received. Or drain receive
+	 * data which the chip might have pending. This is "a copy" of
+	 * the "background part" of ser_hid_read(), without the timeout
+	 * support code, and not knowing how much data the application
+	 * is expecting.
 	 */
-	do {
-		rc = args->serial->hid_chip_funcs->read_bytes(args->serial,
-				rx_buf, sizeof(rx_buf), 0);
-		if (rc > 0) {
-			ser_hid_mask_databits(args->serial, rx_buf, rc);
-			sr_ser_queue_rx_data(args->serial, rx_buf, rc);
-		}
-	} while (rc > 0);
+	if (args->serial->hid_reader) {
+		/* The wakeup pipe's events are of no interest to callers. */
+		revents = 0;
+		if (ser_hid_reader_take(args->serial) < 0)
+			revents |= G_IO_ERR;
+	} else {
+		do {
+			rc = args->serial->hid_chip_funcs->read_bytes(args->serial,
+					rx_buf, sizeof(rx_buf), 0);
+			if (rc > 0) {
+				ser_hid_mask_databits(args->serial, rx_buf, rc);
+				sr_ser_queue_rx_data(args->serial, rx_buf, rc);
+			}
+		} while (rc > 0);
+	}
 
 	/*
 	 * When RX data became available (now or earlier), pass this
@@ -458,13 +663,22 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 	sr_receive_data_callback cb, void *cb_data)
 {
 	struct hidapi_source_args_t *args;
-	int rc;
+	int fd, rc;
 
 	(void)events;
 
-	/* Optionally enforce a minimum poll period. */
-	if (WITH_MAXIMUM_TIMEOUT_VALUE && timeout > WITH_MAXIMUM_TIMEOUT_VALUE)
+	/*
+	 * Receive in background. Have the source fire when the reader
+	 * thread got data, or else optionally enforce a minimum poll
+	 * period.
+	 */
+	fd = -1;
+	if (ser_hid_reader_start(serial) == SR_OK)
+		fd = serial->hid_reader->wakeup[0];
+	if (fd < 0 && WITH_MAXIMUM_TIMEOUT_VALUE &&
+			timeout > WITH_MAXIMUM_TIMEOUT_VALUE)
 		timeout = WITH_MAXIMUM_TIMEOUT_VALUE;
+	serial->hid_source_fd = fd;
 
 	/* Allocate status container for background data reception. */
 	args = g_malloc0(sizeof(*args));
@@ -478,9 +692,10 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 	 * free the memory, and we haven't bothered to create a custom
 	 * HIDAPI specific GSource.
 	 */
-	rc = sr_session_source_add(session, -1, events, timeout,
+	rc = sr_session_source_add(session, fd, G_IO_IN, timeout,
 			hidapi_source_cb, args);
 	if (rc != SR_OK) {
+		ser_hid_reader_stop(serial);
 		g_free(args);
 		return rc;
 	}
@@ -492,13 +707,13 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 static int ser_hid_hidapi_setup_source_remove(struct sr_session *session,
 	struct sr_serial_dev_inst *serial)
 {
-	(void)serial;
-
-	(void)sr_session_source_remove(session, -1);
+	(void)sr_session_source_remove(session, serial->hid_source_fd);
+	serial->hid_source_fd = -1;
+	ser_hid_reader_stop(serial);
 	/*
 	 * Release callback args here already? Can there be more than
-	 * one source registered at any time, given that we pass fd -1
-	 * which is used as the key for the session?
+	 * one source registered at any time, given that we pass a
+	 * single fd which is used as the key for the session?
 	 */
 
 	return SR_OK;
@@ -1114,7 +1329,8 @@ static int ser_hid_open(struct sr_serial_dev_inst *serial, int flags)
 	}
 
 	if (!serial->rcv_buffer)
-		serial->rcv_buffer = g_string_sized_new(SER_HID_CHUNK_SIZE);
+		serial->rcv_buffer = sr_ser_rx_queue_new(SER_HID_CHUNK_SIZE);
+	serial->hid_source_fd = -1;
 
 	return SR_OK;
 }
@@ -1225,6 +1441,40 @@ static int ser_hid_write(struct sr_serial_dev_inst *serial,
 	return total;
 }
 
+static int ser_hid_read_background(struct sr_serial_dev_inst *serial,
+	void *buf, size_t count, int nonblocking, gint64 deadline_us)
+{
+	struct ser_hid_reader *reader;
+	int ret;
+
+	reader = serial->hid_reader;
+	ser_hid_reader_clear_wakeup(reader);
+	g_mutex_lock(&reader->mutex);
+	while (TRUE) {
+		ser_hid_reader_take_locked(serial);
+		if (sr_ser_has_queued_data(serial) >= count)
+			break;
+		if (nonblocking || reader->error)
+			break;
+		if (!deadline_us) {
+			g_cond_wait(&reader->cond, &reader->mutex);
+			continue;
+		}
+		if (!g_cond_wait_until(&reader->cond, &reader->mutex,
+				deadline_us)) {
+			ser_hid_reader_take_locked(serial);
+			sr_dbg("DBG: %s() read loop timeout.", __func__);
+			break;
+		}
+	}
+	ret = reader->error;
+	g_mutex_unlock(&reader->mutex);
+	if (ret < 0 && !sr_ser_has_queued_data(serial))
+		return SR_ERR;
+
+	return sr_ser_unqueue_rx_data(serial, buf, count);
+}
+
 static int ser_hid_read(struct sr_serial_dev_inst *serial,
 	void *buf, size_t count,
 	int nonblocking, unsigned int timeout_ms)
@@ -1257,6 +1507,14 @@ static int ser_hid_read(struct sr_serial_dev_inst *serial,
 		deadline_us = now_us + timeout_ms * 1000;
 	}
 
+	/*
+	 * Wait for the reader thread's data when reception runs in
+	 * background. Don't access the HID device from here then.
+	 */
+	if (serial->hid_reader)
+		return ser_hid_read_background(serial, buf, count,
+			nonblocking, deadline_us);
+
 	/*
 	 * Keep receiving from the port until the caller's requested
 	 * amount of data has become available, or the timeout has
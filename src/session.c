@@ -25,11 +25,23 @@
 #include <unistd.h>
 #include <string.h>
 #include <glib.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 /** @cond PRIVATE */
 #define LOG_PREFIX "session"
+
+/*
+ * Chunk size for running in-place transforms back to back, small enough
+ * to stay in the L1 data cache of common CPUs.
+ */
+#define TRANSFORM_BLOCK_SIZE (16 * 1024)
+
+/* Chunk size for expanding run-length data for callbacks which need it. */
+#define RLE_EXPAND_SIZE (256 * 1024)
 /** @endcond */
 
 /**
@@ -49,8 +61,462 @@
 struct datafeed_callback {
 	sr_datafeed_callback cb;
 	void *cb_data;
+	/** Flags passed to sr_session_datafeed_callback_add_full(). */
+	unsigned int flags;
+	/** Cumulative time spent in the callback, in microseconds. */
+	uint64_t time;
+	/** The pool this callback's current invocation was pushed to. */
+	struct callback_pool *pool;
+	/* The invocation which is pending while the callback is in a pool. */
+	const struct sr_dev_inst *sdi;
+	const struct sr_datafeed_packet *packet;
+	struct sr_datafeed_buffer *buf;
+	int64_t packet_time;
+};
+
+struct datafeed_batch_callback {
+	sr_datafeed_batch_callback cb;
+	void *cb_data;
+};
+
+/** Worker threads which run thread-safe datafeed callbacks concurrently. */
+struct callback_pool {
+	GThreadPool *threads;
+	GMutex mutex;
+	GCond cond;
+	/** Number of callbacks still running for the current packet. */
+	unsigned int pending;
+};
+
+/** Reference counted storage for datafeed payload data. */
+struct sr_datafeed_buffer {
+	/** Reference count, modified atomically. */
+	volatile int refcount;
+	/** Start of the payload memory. */
+	void *data;
+	/** Size of the payload memory in bytes. */
+	size_t size;
+	/** Releases the payload memory, NULL for g_free(). */
+	void (*free_cb)(void *data, void *cb_data);
+	/** User data passed to free_cb. */
+	void *cb_data;
+};
+
+/**
+ * Packet copy as created by sr_packet_copy(). The packet must be the
+ * first member, sr_packet_free() casts the caller's pointer back.
+ */
+struct packet_copy {
+	struct sr_datafeed_packet packet;
+	/** Buffer owning the payload data, or NULL if data was copied. */
+	struct sr_datafeed_buffer *buf;
+};
+
+/*
+ * The buffer which backs the packet that is currently being dispatched
+ * by the calling thread (see sr_session_send_buffer()).
+ */
+static GPrivate send_buffer;
+
+/*
+ * Host receive times in microseconds, on the g_get_monotonic_time()
+ * clock. The I/O code marks when the data which the calling thread
+ * works on arrived, the datafeed code keeps the time of the packet
+ * which the calling thread delivers. See sr_session_timestamps_enable().
+ */
+static GPrivate receive_time = G_PRIVATE_INIT(g_free);
+static GPrivate packet_time = G_PRIVATE_INIT(g_free);
+
+/* Number of sessions which have timestamps enabled. */
+static gint timestamp_sessions;
+
+/** Packet waiting in the dispatch queue. */
+struct dispatch_item {
+	const struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet *packet;
+	int64_t time;
+	uint64_t bytes;
+};
+
+/* Sample data bytes of a packet, run-length packets count expanded. */
+static uint64_t packet_payload_bytes(const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		return logic->length;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		return sr_logic_rle_num_samples(rle) * rle->unitsize;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		return (uint64_t)analog->num_samples
+			* analog->encoding->unitsize
+			* g_slist_length(analog->meaning->channels);
+	default:
+		return 0;
+	}
+}
+
+static int64_t *thread_time(GPrivate *key)
+{
+	int64_t *t;
+
+	if (!(t = g_private_get(key))) {
+		t = g_malloc0(sizeof(*t));
+		g_private_set(key, t);
+	}
+
+	return t;
+}
+
+/* Pick the timestamp for a packet which the calling thread sends. */
+static int64_t send_time(void)
+{
+	int64_t t;
+
+	/* Packets sent from a datafeed callback inherit its packet's time. */
+	if ((t = *thread_time(&receive_time)) || (t = *thread_time(&packet_time)))
+		return t;
+
+	return g_get_monotonic_time();
+}
+
+/**
+ * Bounded single-producer/single-consumer queue between the session
+ * thread, which runs the drivers' event sources, and a consumer thread
+ * which runs the transforms and datafeed callbacks.
+ *
+ * The producer only writes @a head, the consumer only writes @a tail.
+ * Both only take the mutex to sleep when the queue is full or empty,
+ * respectively, and to wake up the other side.
+ *
+ * With a memory budget, the queue also counts as full while its packets
+ * hold at least @a max_bytes of sample data. One packet always fits,
+ * however large it is.
+ */
+struct dispatch_queue {
+	struct dispatch_item *items;
+	/** Number of slots, a power of two. */
+	unsigned int size;
+	/** Free running count of packets pushed. */
+	volatile int head;
+	/** Free running count of packets popped. */
+	volatile int tail;
+	/** Sample data bytes of the queued packets. */
+	volatile gssize bytes;
+	/** Memory budget in bytes, 0 for none. */
+	uint64_t max_bytes;
+	/** Set by either side before it sleeps on @a cond. */
+	volatile int waiting;
+	/** Tells the consumer to exit once the queue is empty. */
+	volatile int quit;
+	GMutex mutex;
+	GCond cond;
+	GThread *thread;
+};
+
+static unsigned int dispatch_queue_fill(struct dispatch_queue *queue)
+{
+	return (unsigned int)g_atomic_int_get(&queue->head)
+		- (unsigned int)g_atomic_int_get(&queue->tail);
+}
+
+static void dispatch_queue_wake(struct dispatch_queue *queue)
+{
+	if (!g_atomic_int_get(&queue->waiting))
+		return;
+
+	g_mutex_lock(&queue->mutex);
+	g_cond_broadcast(&queue->cond);
+	g_mutex_unlock(&queue->mutex);
+}
+
+static gboolean dispatch_queue_full(struct dispatch_queue *queue)
+{
+	unsigned int fill;
+
+	fill = dispatch_queue_fill(queue);
+	if (fill == queue->size)
+		return TRUE;
+	if (!queue->max_bytes || !fill)
+		return FALSE;
+
+	return (gsize)g_atomic_pointer_get(&queue->bytes) >= queue->max_bytes;
+}
+
+/*
+ * Sleep until the queue has room for a packet (producer), or holds more
+ * than @a limit packets (consumer). The consumer also returns when it
+ * is told to quit.
+ */
+static void dispatch_queue_wait(struct dispatch_queue *queue,
+		gboolean producer, unsigned int limit)
+{
+	unsigned int fill;
+
+	g_mutex_lock(&queue->mutex);
+	g_atomic_int_set(&queue->waiting, 1);
+	for (;;) {
+		fill = dispatch_queue_fill(queue);
+		if (producer ? !dispatch_queue_full(queue) : (fill > limit))
+			break;
+		if (!producer && g_atomic_int_get(&queue->quit))
+			break;
+		g_cond_wait(&queue->cond, &queue->mutex);
+	}
+	g_atomic_int_set(&queue->waiting, 0);
+	g_mutex_unlock(&queue->mutex);
+}
+
+/* Which of the datafeed callbacks a delivery is meant for. */
+enum deliver_to {
+	DELIVER_ALL,
+	/* Run-length packets, for the callbacks which handle them. */
+	DELIVER_RLE_AWARE,
+	/* Expanded run-length data, for all other callbacks. */
+	DELIVER_RLE_UNAWARE,
 };
 
+static int session_dispatch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+static int session_deliver(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packets, size_t count,
+		int64_t start, enum deliver_to to);
+static void coalesce_start(struct sr_session *session);
+static void coalesce_stop(struct sr_session *session);
+
+static gpointer dispatch_thread(gpointer data)
+{
+	struct sr_session *session;
+	struct dispatch_queue *queue;
+	struct dispatch_item *item;
+	struct packet_copy *pcopy;
+	unsigned int tail;
+
+	session = data;
+	queue = session->dispatch;
+
+	for (;;) {
+		if (dispatch_queue_fill(queue) == 0) {
+			dispatch_queue_wait(queue, FALSE, 0);
+			if (dispatch_queue_fill(queue) == 0)
+				break;
+		}
+		tail = (unsigned int)g_atomic_int_get(&queue->tail);
+		item = &queue->items[tail & (queue->size - 1)];
+
+		/* Let consumers share the buffer the driver had sent. */
+		pcopy = (struct packet_copy *)item->packet;
+		g_private_set(&send_buffer, pcopy->buf);
+		if (item->time)
+			*thread_time(&packet_time) = item->time;
+		session_dispatch(item->sdi, item->packet);
+		if (item->time)
+			*thread_time(&packet_time) = 0;
+		g_private_set(&send_buffer, NULL);
+		sr_packet_free(item->packet);
+		g_atomic_pointer_add(&queue->bytes, -(gssize)item->bytes);
+
+		g_atomic_int_set(&queue->tail, (int)(tail + 1));
+		dispatch_queue_wake(queue);
+	}
+
+	return NULL;
+}
+
+static int dispatch_queue_push(struct sr_session *session,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, int64_t time)
+{
+	struct dispatch_queue *queue;
+	struct dispatch_item *item;
+	unsigned int head, fill;
+	uint64_t bytes;
+	int ret;
+
+	queue = session->dispatch;
+
+	if (dispatch_queue_full(queue)) {
+		session->dispatch_stats.stalls++;
+		dispatch_queue_wait(queue, TRUE, 0);
+	}
+
+	head = (unsigned int)g_atomic_int_get(&queue->head);
+	item = &queue->items[head & (queue->size - 1)];
+	item->sdi = sdi;
+	item->time = time;
+	item->bytes = packet_payload_bytes(packet);
+	ret = sr_packet_copy(packet, &item->packet);
+	if (ret != SR_OK)
+		return ret;
+	g_atomic_pointer_add(&queue->bytes, (gssize)item->bytes);
+	g_atomic_int_set(&queue->head, (int)(head + 1));
+	dispatch_queue_wake(queue);
+
+	session->dispatch_stats.packets++;
+	fill = dispatch_queue_fill(queue);
+	if (fill > session->dispatch_stats.high_water)
+		session->dispatch_stats.high_water = fill;
+	bytes = (gsize)g_atomic_pointer_get(&queue->bytes);
+	if (bytes > session->dispatch_stats.high_water_bytes)
+		session->dispatch_stats.high_water_bytes = bytes;
+
+	return SR_OK;
+}
+
+static int dispatch_start(struct sr_session *session)
+{
+	struct dispatch_queue *queue;
+	unsigned int size;
+
+	memset(&session->dispatch_stats, 0, sizeof(session->dispatch_stats));
+	if (!session->dispatch_depth)
+		return SR_OK;
+
+	size = 2;
+	while (size < session->dispatch_depth)
+		size <<= 1;
+
+	queue = g_malloc0(sizeof(*queue));
+	queue->items = g_malloc0(size * sizeof(queue->items[0]));
+	queue->size = size;
+	queue->max_bytes = session->dispatch_max_bytes;
+	g_mutex_init(&queue->mutex);
+	g_cond_init(&queue->cond);
+	session->dispatch = queue;
+	session->dispatch_stats.depth = size;
+
+	queue->thread = g_thread_try_new("sr-dispatch",
+			dispatch_thread, session, NULL);
+	if (!queue->thread) {
+		sr_err("Cannot create datafeed dispatch thread.");
+		session->dispatch = NULL;
+		g_cond_clear(&queue->cond);
+		g_mutex_clear(&queue->mutex);
+		g_free(queue->items);
+		g_free(queue);
+		return SR_ERR;
+	}
+	sr_dbg("Dispatching datafeed from a separate thread, %u slots.",
+		size);
+
+	return SR_OK;
+}
+
+/* Deliver all pending packets, then terminate the consumer thread. */
+static void dispatch_stop(struct sr_session *session)
+{
+	struct dispatch_queue *queue;
+
+	queue = session->dispatch;
+	if (!queue)
+		return;
+
+	g_atomic_int_set(&queue->quit, 1);
+	g_mutex_lock(&queue->mutex);
+	g_cond_broadcast(&queue->cond);
+	g_mutex_unlock(&queue->mutex);
+	g_thread_join(queue->thread);
+	session->dispatch = NULL;
+
+	sr_dbg("Dispatch queue high water mark %u of %u (%" PRIu64
+		" bytes), %" PRIu64 " stalls.",
+		session->dispatch_stats.high_water, queue->size,
+		session->dispatch_stats.high_water_bytes,
+		session->dispatch_stats.stalls);
+
+	g_cond_clear(&queue->cond);
+	g_mutex_clear(&queue->mutex);
+	g_free(queue->items);
+	g_free(queue);
+}
+
+/* Invoke a datafeed callback, and account its time when requested. */
+static void run_callback(struct datafeed_callback *cb_struct,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	int64_t start, elapsed;
+
+	session = sdi->session;
+	if (!session->stats_enabled && !sr_trace_enabled()) {
+		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		return;
+	}
+
+	start = g_get_monotonic_time();
+	cb_struct->cb(sdi, packet, cb_struct->cb_data);
+	elapsed = g_get_monotonic_time() - start;
+	if (sr_trace_enabled())
+		sr_trace_span("datafeed callback", start, "type", packet->type);
+	if (!session->stats_enabled)
+		return;
+
+	g_mutex_lock(&session->stats_mutex);
+	cb_struct->time += elapsed;
+	session->stats.callback_time += elapsed;
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+static void callback_pool_run(gpointer data, gpointer user_data)
+{
+	struct datafeed_callback *cb_struct;
+	struct callback_pool *pool;
+
+	cb_struct = data;
+	pool = cb_struct->pool;
+	(void)user_data;
+
+	g_private_set(&send_buffer, cb_struct->buf);
+	if (cb_struct->packet_time)
+		*thread_time(&packet_time) = cb_struct->packet_time;
+	run_callback(cb_struct, cb_struct->sdi, cb_struct->packet);
+	if (cb_struct->packet_time)
+		*thread_time(&packet_time) = 0;
+	g_private_set(&send_buffer, NULL);
+
+	g_mutex_lock(&pool->mutex);
+	if (--pool->pending == 0)
+		g_cond_signal(&pool->cond);
+	g_mutex_unlock(&pool->mutex);
+}
+
+static struct callback_pool *callback_pool_new(unsigned int num_threads)
+{
+	struct callback_pool *pool;
+
+	pool = g_malloc0(sizeof(*pool));
+	g_mutex_init(&pool->mutex);
+	g_cond_init(&pool->cond);
+	pool->threads = g_thread_pool_new(callback_pool_run, pool,
+			num_threads, FALSE, NULL);
+	if (!pool->threads) {
+		g_cond_clear(&pool->cond);
+		g_mutex_clear(&pool->mutex);
+		g_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+static void callback_pool_free(struct callback_pool *pool)
+{
+	if (!pool)
+		return;
+
+	g_thread_pool_free(pool->threads, FALSE, TRUE);
+	g_cond_clear(&pool->cond);
+	g_mutex_clear(&pool->mutex);
+	g_free(pool);
+}
+
 /** Custom GLib event source for generic descriptor I/O.
  * @see https://developer.gnome.org/glib/stable/glib-The-Main-Event-Loop.html
  */
@@ -63,10 +529,200 @@ struct fd_source {
 	/* Meta-data needed to keep track of installed sources */
 	struct sr_session *session;
 	void *key;
+	/* The callback's data, identifies the device for priorities. */
+	void *cb_data;
+
+	GPollFD pollfd;
+	/* The descriptor is in the session's epoll set, see below. */
+	gboolean epoll;
+	/* Data buffered above the descriptor, see sr_session_source_set_pending(). */
+	gboolean (*pending)(void *data);
+	void *pending_data;
+};
 
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * With sr_session_epoll_set(), the descriptors of a session's sources
+ * go into one epoll set, instead of each source having GLib poll() its
+ * descriptor. GLib then only polls the epoll descriptor. The sources
+ * themselves remain, for their callbacks, timeouts and life cycle.
+ *
+ * The epoll source runs at a higher priority than the sources, such
+ * that GLib checks it first. Its check() method collects the ready
+ * descriptors into their sources' revents, and never dispatches, so
+ * that the sources get checked and dispatched in the same iteration.
+ */
+struct epoll_source {
+	GSource base;
 	GPollFD pollfd;
+	/* Number of sources with a descriptor in the set. */
+	unsigned int count;
 };
 
+/* Ready descriptors collected per epoll_wait() call. */
+#define EPOLL_MAX_EVENTS 64
+
+static gboolean epoll_source_prepare(GSource *source, int *timeout)
+{
+	(void)source;
+
+	*timeout = -1;
+
+	return FALSE;
+}
+
+static gboolean epoll_source_check(GSource *source)
+{
+	struct epoll_source *esource;
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+	struct fd_source *fsource;
+	int i, n;
+
+	esource = (struct epoll_source *)source;
+	if (!esource->pollfd.revents)
+		return FALSE;
+
+	n = epoll_wait(esource->pollfd.fd, events, EPOLL_MAX_EVENTS, 0);
+	for (i = 0; i < n; i++) {
+		fsource = events[i].data.ptr;
+		/* The EPOLL* flags have the values of the G_IO_* ones. */
+		fsource->pollfd.revents = events[i].events
+			& (G_IO_IN | G_IO_PRI | G_IO_OUT | G_IO_ERR | G_IO_HUP);
+	}
+
+	return FALSE;
+}
+
+static gboolean epoll_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	(void)source;
+	(void)callback;
+	(void)user_data;
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void epoll_source_finalize(GSource *source)
+{
+	struct epoll_source *esource;
+
+	esource = (struct epoll_source *)source;
+	close(esource->pollfd.fd);
+}
+
+/* Get the session's epoll source, creating it with the first member. */
+static struct epoll_source *epoll_source_get(struct sr_session *session)
+{
+	static GSourceFuncs epoll_source_funcs = {
+		.prepare  = &epoll_source_prepare,
+		.check    = &epoll_source_check,
+		.dispatch = &epoll_source_dispatch,
+		.finalize = &epoll_source_finalize
+	};
+	struct epoll_source *esource;
+	GSource *source;
+	int epfd;
+
+	if (session->epoll_source)
+		return session->epoll_source;
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		sr_warn("Cannot create epoll set: %s.", g_strerror(errno));
+		return NULL;
+	}
+
+	source = g_source_new(&epoll_source_funcs, sizeof(struct epoll_source));
+	esource = (struct epoll_source *)source;
+	g_source_set_name(source, "epoll");
+	g_source_set_priority(source, G_PRIORITY_HIGH);
+	esource->pollfd.fd = epfd;
+	esource->pollfd.events = G_IO_IN;
+	g_source_add_poll(source, &esource->pollfd);
+
+	g_mutex_lock(&session->main_mutex);
+	if (session->main_context)
+		g_source_attach(source, session->main_context);
+	g_mutex_unlock(&session->main_mutex);
+	if (!g_source_get_context(source)) {
+		g_source_unref(source);
+		return NULL;
+	}
+	session->epoll_source = esource;
+
+	return esource;
+}
+
+/* Put a source's descriptor into the epoll set, FALSE if unsupported. */
+static gboolean fd_source_epoll_add(struct fd_source *fsource)
+{
+	struct epoll_source *esource;
+	struct epoll_event event;
+
+	if (!(esource = epoll_source_get(fsource->session)))
+		return FALSE;
+
+	memset(&event, 0, sizeof(event));
+	event.events = fsource->pollfd.events & (G_IO_IN | G_IO_PRI | G_IO_OUT);
+	event.data.ptr = fsource;
+	/* E.g. regular files, which epoll doesn't support. */
+	if (epoll_ctl(esource->pollfd.fd, EPOLL_CTL_ADD,
+			fsource->pollfd.fd, &event) < 0)
+		return FALSE;
+
+	fsource->epoll = TRUE;
+	esource->count++;
+
+	return TRUE;
+}
+
+/* Take a source's descriptor out of the epoll set. */
+static void fd_source_epoll_remove(struct fd_source *fsource)
+{
+	struct sr_session *session;
+	struct epoll_source *esource;
+
+	if (!fsource->epoll)
+		return;
+	fsource->epoll = FALSE;
+
+	session = fsource->session;
+	esource = session->epoll_source;
+	/* Fails when the descriptor was closed already, that's fine. */
+	epoll_ctl(esource->pollfd.fd, EPOLL_CTL_DEL, fsource->pollfd.fd, NULL);
+	if (--esource->count)
+		return;
+
+	session->epoll_source = NULL;
+	g_source_destroy(&esource->base);
+	g_source_unref(&esource->base);
+}
+#else
+static gboolean fd_source_epoll_add(struct fd_source *fsource)
+{
+	(void)fsource;
+
+	return FALSE;
+}
+
+static void fd_source_epoll_remove(struct fd_source *fsource)
+{
+	(void)fsource;
+}
+#endif
+
+/* Move an expiration time to the session's common timer grid, if any. */
+static int64_t fd_source_align(const struct fd_source *fsource, int64_t due_us)
+{
+	int64_t slack_us;
+
+	slack_us = fsource->session->timer_slack_us;
+	if (slack_us <= 0)
+		return due_us;
+
+	return ((due_us + slack_us - 1) / slack_us) * slack_us;
+}
+
 /** FD event source prepare() method.
  * This is called immediately before poll().
  */
@@ -83,12 +739,15 @@ static gboolean fd_source_prepare(GSource *source, int *timeout)
 
 		if (fsource->due_us == 0) {
 			/* First-time initialization of the expiration time */
-			fsource->due_us = now_us + fsource->timeout_us;
+			fsource->due_us = fd_source_align(fsource,
+				now_us + fsource->timeout_us);
 		}
 		remaining_ms = (MAX(0, fsource->due_us - now_us) + 999) / 1000;
 	} else {
 		remaining_ms = -1;
 	}
+	if (fsource->pending && fsource->pending(fsource->pending_data))
+		remaining_ms = 0;
 	*timeout = remaining_ms;
 
 	return (remaining_ms == 0);
@@ -105,6 +764,9 @@ static gboolean fd_source_check(GSource *source)
 	fsource = (struct fd_source *)source;
 	revents = fsource->pollfd.revents;
 
+	if (fsource->pending && fsource->pending(fsource->pending_data))
+		return TRUE;
+
 	return (revents != 0 || (fsource->timeout_us >= 0
 			&& fsource->due_us <= g_source_get_time(source)));
 }
@@ -118,21 +780,30 @@ static gboolean fd_source_dispatch(GSource *source,
 	struct fd_source *fsource;
 	unsigned int revents;
 	gboolean keep;
+	int64_t start;
 
 	fsource = (struct fd_source *)source;
 	revents = fsource->pollfd.revents;
+	if (fsource->pending && fsource->pending(fsource->pending_data))
+		revents |= G_IO_IN;
 
 	if (!callback) {
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	/* GLib only resets the events of descriptors it polls itself. */
+	if (fsource->epoll)
+		fsource->pollfd.revents = 0;
+	start = sr_trace_now();
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))
 			(fsource->pollfd.fd, revents, user_data);
+	sr_trace_span("source dispatch", start, "revents", revents);
+	sr_session_receive_unmark();
 
 	if (fsource->timeout_us >= 0 && G_LIKELY(keep)
 			&& G_LIKELY(!g_source_is_destroyed(source)))
-		fsource->due_us = g_source_get_time(source)
-				+ fsource->timeout_us;
+		fsource->due_us = fd_source_align(fsource,
+				g_source_get_time(source) + fsource->timeout_us);
 	return keep;
 }
 
@@ -146,9 +817,17 @@ static void fd_source_finalize(GSource *source)
 
 	sr_dbg("%s: key %p", __func__, fsource->key);
 
+	fd_source_epoll_remove(fsource);
 	sr_session_source_destroyed(fsource->session, fsource->key, source);
 }
 
+static GSourceFuncs fd_source_funcs = {
+	.prepare  = &fd_source_prepare,
+	.check    = &fd_source_check,
+	.dispatch = &fd_source_dispatch,
+	.finalize = &fd_source_finalize
+};
+
 /** Create an event source for I/O on a file descriptor.
  *
  * In order to maintain API compatibility, this event source also doubles
@@ -165,12 +844,6 @@ static void fd_source_finalize(GSource *source)
 static GSource *fd_source_new(struct sr_session *session, void *key,
 		gintptr fd, int events, int timeout_ms)
 {
-	static GSourceFuncs fd_source_funcs = {
-		.prepare  = &fd_source_prepare,
-		.check    = &fd_source_check,
-		.dispatch = &fd_source_dispatch,
-		.finalize = &fd_source_finalize
-	};
 	GSource *source;
 	struct fd_source *fsource;
 
@@ -193,7 +866,7 @@ static GSource *fd_source_new(struct sr_session *session, void *key,
 	fsource->pollfd.events = events;
 	fsource->pollfd.revents = 0;
 
-	if (fd >= 0)
+	if (fd >= 0 && !(session->epoll && fd_source_epoll_add(fsource)))
 		g_source_add_poll(source, &fsource->pollfd);
 
 	return source;
@@ -225,6 +898,8 @@ SR_API int sr_session_new(struct sr_context *ctx,
 	session->ctx = ctx;
 
 	g_mutex_init(&session->main_mutex);
+	g_mutex_init(&session->stats_mutex);
+	session->float_view = sr_analog_float_view_new();
 
 	/* To maintain API compatibility, we need a lookup table
 	 * which maps poll_object IDs to GSource* pointers.
@@ -258,11 +933,17 @@ SR_API int sr_session_destroy(struct sr_session *session)
 	g_slist_free_full(session->owned_devs, (GDestroyNotify)sr_dev_inst_free);
 
 	sr_session_datafeed_callback_remove_all(session);
+	callback_pool_free(session->callback_pool);
+	sr_session_merge_free(session->merge);
+	sr_session_timestamps_enable(session, FALSE);
 
 	g_hash_table_unref(session->event_sources);
 
+	sr_analog_float_view_free(session->float_view);
+	g_mutex_clear(&session->stats_mutex);
 	g_mutex_clear(&session->main_mutex);
 
+	g_free(session->raw_record_dir);
 	g_free(session);
 
 	return SR_OK;
@@ -298,6 +979,7 @@ SR_API int sr_session_dev_remove_all(struct sr_session *session)
 
 	g_slist_free(session->devs);
 	session->devs = NULL;
+	session->sync_master = NULL;
 
 	return SR_OK;
 }
@@ -440,6 +1122,8 @@ SR_API int sr_session_dev_remove(struct sr_session *session,
 
 	session->devs = g_slist_remove(session->devs, sdi);
 	sdi->session = NULL;
+	if (session->sync_master == sdi)
+		session->sync_master = NULL;
 
 	return SR_OK;
 }
@@ -463,6 +1147,9 @@ SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
 
 	g_slist_free_full(session->datafeed_callbacks, g_free);
 	session->datafeed_callbacks = NULL;
+	g_slist_free_full(session->datafeed_batch_callbacks, g_free);
+	session->datafeed_batch_callbacks = NULL;
+	session->callback_pool_unused = FALSE;
 
 	return SR_OK;
 }
@@ -482,6 +1169,33 @@ SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
  */
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data)
+{
+	return sr_session_datafeed_callback_add_full(session, cb, cb_data, 0);
+}
+
+/**
+ * Add a datafeed callback to a session, with flags.
+ *
+ * Callbacks which are marked SR_DATAFEED_CB_THREAD_SAFE are run in worker
+ * threads, concurrently with the other callbacks of the session, as long
+ * as the session has at least two of them. All callbacks have returned
+ * before the next packet is dispatched, so each callback still receives
+ * the packets one at a time and in order.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
+ * @param flags Bitwise OR of enum sr_datafeed_callback_flags values.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG No session exists.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_callback_add_full(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, unsigned int flags)
 {
 	struct datafeed_callback *cb_struct;
 
@@ -498,48 +1212,93 @@ SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
 	cb_struct->cb = cb;
 	cb_struct->cb_data = cb_data;
+	cb_struct->flags = flags;
 
 	session->datafeed_callbacks =
 	    g_slist_append(session->datafeed_callbacks, cb_struct);
+	session->callback_pool_unused = FALSE;
 
 	return SR_OK;
 }
 
 /**
- * Get the trigger assigned to this session.
- *
- * @param session The session to use.
- *
- * @retval NULL Invalid (NULL) session was passed to the function.
- * @retval other The trigger assigned to this session (can be NULL).
+ * Add a datafeed callback which receives packets in batches.
  *
- * @since 0.4.0
- */
-SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
-{
-	if (!session)
-		return NULL;
-
-	return session->trigger;
-}
-
-/**
- * Set the trigger of this session.
+ * When a driver sends several packets at once with
+ * sr_session_send_batch(), the callback is invoked once for all of
+ * them. Packets which are sent individually are passed in a batch of
+ * one. The packets are only valid for the duration of the call.
  *
  * @param session The session to use. Must not be NULL.
- * @param trig The trigger to assign to this session. Can be NULL.
+ * @param cb Function to call when a batch of packets is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_BUG No session exists.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger *trig)
+SR_API int sr_session_datafeed_batch_callback_add(struct sr_session *session,
+		sr_datafeed_batch_callback cb, void *cb_data)
 {
-	if (!session)
-		return SR_ERR_ARG;
+	struct datafeed_batch_callback *cb_struct;
 
-	session->trigger = trig;
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (!cb) {
+		sr_err("%s: cb was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	cb_struct = g_malloc0(sizeof(struct datafeed_batch_callback));
+	cb_struct->cb = cb;
+	cb_struct->cb_data = cb_data;
+
+	session->datafeed_batch_callbacks =
+	    g_slist_append(session->datafeed_batch_callbacks, cb_struct);
+
+	return SR_OK;
+}
+
+/**
+ * Get the trigger assigned to this session.
+ *
+ * @param session The session to use.
+ *
+ * @retval NULL Invalid (NULL) session was passed to the function.
+ * @retval other The trigger assigned to this session (can be NULL).
+ *
+ * @since 0.4.0
+ */
+SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
+{
+	if (!session)
+		return NULL;
+
+	return session->trigger;
+}
+
+/**
+ * Set the trigger of this session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param trig The trigger to assign to this session. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger *trig)
+{
+	if (!session)
+		return SR_ERR_ARG;
+
+	session->trigger = trig;
 
 	return SR_OK;
 }
@@ -690,6 +1449,8 @@ static gboolean delayed_stop_check(void *data)
 		return G_SOURCE_REMOVE;
 
 	session->running = FALSE;
+	coalesce_stop(session);
+	dispatch_stop(session);
 	unset_main_context(session);
 
 	sr_info("Stopped.");
@@ -754,7 +1515,8 @@ SR_API int sr_session_start(struct sr_session *session)
 {
 	struct sr_dev_inst *sdi;
 	struct sr_channel *ch;
-	GSList *l, *c, *lend;
+	GSList *l, *c, *lend, *order;
+	int64_t armed_us;
 	int ret;
 
 	if (!session) {
@@ -782,6 +1544,8 @@ SR_API int sr_session_start(struct sr_session *session)
 	/* Check enabled channels and commit settings of all devices. */
 	for (l = session->devs; l; l = l->next) {
 		sdi = l->data;
+		sdi->sync_follower = session->sync_master
+			&& sdi != session->sync_master;
 		for (c = sdi->channels; c; c = c->next) {
 			ch = c->data;
 			if (ch->enabled)
@@ -806,17 +1570,39 @@ SR_API int sr_session_start(struct sr_session *session)
 	if (ret != SR_OK)
 		return ret;
 
+	ret = dispatch_start(session);
+	if (ret != SR_OK) {
+		unset_main_context(session);
+		return ret;
+	}
+	coalesce_start(session);
+
 	sr_info("Starting.");
 
+	g_mutex_lock(&session->stats_mutex);
+	session->mem_peak = session->mem_used;
+	session->mem_exceeded = FALSE;
+	g_mutex_unlock(&session->stats_mutex);
+
 	session->running = TRUE;
 
+	/* Arm the followers before their master starts to run. */
+	order = g_slist_copy(session->devs);
+	if (session->sync_master) {
+		order = g_slist_remove(order, session->sync_master);
+		order = g_slist_append(order, session->sync_master);
+	}
+	armed_us = 0;
+
 	/* Have all devices start acquisition. */
-	for (l = session->devs; l; l = l->next) {
+	for (l = order; l; l = l->next) {
 		if (!(sdi = l->data)) {
 			sr_err("Device sdi was NULL, can't start session.");
 			ret = SR_ERR;
 			break;
 		}
+		if (sdi == session->sync_master)
+			armed_us = g_get_monotonic_time();
 		ret = sr_dev_acquisition_start(sdi);
 		if (ret != SR_OK) {
 			sr_err("Could not start %s device %s acquisition.",
@@ -829,17 +1615,24 @@ SR_API int sr_session_start(struct sr_session *session)
 		/* If there are multiple devices, some of them may already have
 		 * started successfully. Stop them now before returning. */
 		lend = l->next;
-		for (l = session->devs; l != lend; l = l->next) {
+		for (l = order; l != lend; l = l->next) {
 			sdi = l->data;
 			sr_dev_acquisition_stop(sdi);
 		}
+		g_slist_free(order);
 		/* TODO: Handle delayed stops. Need to iterate the event
 		 * sources... */
 		session->running = FALSE;
 
+		coalesce_stop(session);
+		dispatch_stop(session);
 		unset_main_context(session);
 		return ret;
 	}
+	g_slist_free(order);
+	if (session->sync_master)
+		sr_dbg("Followers armed, starting the master took %" PRId64 " us.",
+			g_get_monotonic_time() - armed_us);
 
 	if (g_hash_table_size(session->event_sources) == 0)
 		stop_check_later(session);
@@ -847,6 +1640,55 @@ SR_API int sr_session_start(struct sr_session *session)
 	return SR_OK;
 }
 
+/**
+ * Make one device of a session the master of the others.
+ *
+ * The other devices of the session become followers. They are meant to
+ * be wired to the master's clock or trigger output, and to not capture
+ * before the master provides it. sr_session_start() arms all followers
+ * before it starts the master, so that all devices begin capturing
+ * within the same sample. Drivers of followers which support it switch
+ * to sampling on the external clock. Other followers need a trigger on
+ * the channel which the master's trigger output is wired to, the merge
+ * stage (see sr_session_merge_set()) then aligns them.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The master device, which must be part of the session, or
+ *            NULL to start all devices independently again.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_sync_master_set(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	GSList *l;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (sdi && sdi->session != session) {
+		sr_err("%s: not assigned to this session", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change the sync master of a running session.");
+		return SR_ERR;
+	}
+
+	session->sync_master = sdi;
+	if (!sdi) {
+		for (l = session->devs; l; l = l->next)
+			((struct sr_dev_inst *)l->data)->sync_follower = FALSE;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Block until the running session stops.
  *
@@ -899,6 +1741,120 @@ SR_API int sr_session_run(struct sr_session *session)
 	return SR_OK;
 }
 
+/**
+ * Prepare one iteration of a session's event processing.
+ *
+ * Applications with their own event loop call this instead of
+ * sr_session_run(). It returns the file descriptors to wait for and a
+ * timeout. Once the descriptors are ready or the timeout has passed,
+ * the application calls sr_session_iteration_dispatch() with the
+ * descriptors' revents filled in. The calls must be made in pairs, from
+ * the thread which started the session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param fds Array where the descriptors get stored.
+ * @param num_fds In: the number of entries in fds. Out: the number of
+ *                descriptors to wait for. Must not be NULL.
+ * @param timeout_ms Where to store the timeout in ms, -1 for none.
+ *                   Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or fds is too small. In the
+ *         latter case *num_fds holds the required size, and no
+ *         sr_session_iteration_dispatch() call must follow.
+ * @retval SR_ERR The session is not running, or its events are
+ *         processed by another thread.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_iteration_prepare(struct sr_session *session,
+		GPollFD *fds, int *num_fds, int *timeout_ms)
+{
+	GMainContext *context;
+	int needed;
+
+	if (!session || !num_fds || !timeout_ms || (!fds && *num_fds))
+		return SR_ERR_ARG;
+	if (session->iteration_context) {
+		sr_err("Iteration already prepared.");
+		return SR_ERR;
+	}
+
+	g_mutex_lock(&session->main_mutex);
+	context = session->main_context;
+	if (context)
+		g_main_context_ref(context);
+	g_mutex_unlock(&session->main_mutex);
+	if (!context) {
+		sr_err("No session running.");
+		return SR_ERR;
+	}
+	if (!g_main_context_acquire(context)) {
+		sr_err("Session events are processed by another thread.");
+		g_main_context_unref(context);
+		return SR_ERR;
+	}
+
+	g_main_context_prepare(context, &session->iteration_priority);
+	needed = g_main_context_query(context, session->iteration_priority,
+			timeout_ms, fds, *num_fds);
+	if (needed > *num_fds) {
+		/* Finish the iteration without dispatching anything. */
+		g_main_context_check(context, session->iteration_priority,
+			NULL, 0);
+		g_main_context_release(context);
+		g_main_context_unref(context);
+		*num_fds = needed;
+		return SR_ERR_ARG;
+	}
+	*num_fds = needed;
+	session->iteration_context = context;
+
+	return SR_OK;
+}
+
+/**
+ * Dispatch the events of one iteration of a session's event processing.
+ *
+ * See sr_session_iteration_prepare(). Driver callbacks and datafeed
+ * callbacks run from within this call. When the session stops during
+ * an iteration, its stopped callback runs here as well.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param fds The descriptors from sr_session_iteration_prepare(), with
+ *            their revents filled in.
+ * @param num_fds The number of descriptors.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR No iteration was prepared.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_iteration_dispatch(struct sr_session *session,
+		GPollFD *fds, int num_fds)
+{
+	GMainContext *context;
+
+	if (!session || (!fds && num_fds))
+		return SR_ERR_ARG;
+	if (!(context = session->iteration_context)) {
+		sr_err("No iteration prepared.");
+		return SR_ERR;
+	}
+	session->iteration_context = NULL;
+
+	if (g_main_context_check(context, session->iteration_priority,
+			fds, num_fds))
+		g_main_context_dispatch(context);
+
+	/* The session may have stopped and dropped its own reference. */
+	g_main_context_release(context);
+	g_main_context_unref(context);
+
+	return SR_OK;
+}
+
 static gboolean session_stop_sync(void *user_data)
 {
 	struct sr_session *session;
@@ -1027,123 +1983,1383 @@ SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 }
 
 /**
- * Debug helper.
+ * Dispatch the session's datafeed from a separate thread.
  *
- * @param packet The packet to show debugging information for.
+ * By default, transforms and datafeed callbacks run synchronously in
+ * the thread which executes the session, in between servicing the
+ * devices' event sources. A slow callback then delays the drivers,
+ * which may lose data at high sample rates.
+ *
+ * With a non-zero @a depth, packets which drivers send are put into a
+ * bounded queue, and a separate thread runs the transforms and the
+ * datafeed callbacks. Drivers only wait when the queue is full. All
+ * queued packets are delivered before the session stops.
+ *
+ * Datafeed callbacks must not assume they run in the session thread
+ * when this is enabled. Packet copies taken with sr_packet_copy() from
+ * within callbacks remain valid as usual.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param depth The number of packets the queue can hold. It is rounded
+ *              up to the next power of two. Use 0 to dispatch from the
+ *              session thread (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
  */
-static void datafeed_dump(const struct sr_datafeed_packet *packet)
+SR_API int sr_session_dispatch_thread_set(struct sr_session *session,
+		unsigned int depth)
 {
-	const struct sr_datafeed_logic *logic;
-	const struct sr_datafeed_analog *analog;
-
-	/* Please use the same order as in libsigrok.h. */
-	switch (packet->type) {
-	case SR_DF_HEADER:
-		sr_dbg("bus: Received SR_DF_HEADER packet.");
-		break;
-	case SR_DF_END:
-		sr_dbg("bus: Received SR_DF_END packet.");
-		break;
-	case SR_DF_META:
-		sr_dbg("bus: Received SR_DF_META packet.");
-		break;
-	case SR_DF_TRIGGER:
-		sr_dbg("bus: Received SR_DF_TRIGGER packet.");
-		break;
-	case SR_DF_LOGIC:
-		logic = packet->payload;
-		sr_dbg("bus: Received SR_DF_LOGIC packet (%" PRIu64 " bytes, "
-		       "unitsize = %d).", logic->length, logic->unitsize);
-		break;
-	case SR_DF_FRAME_BEGIN:
-		sr_dbg("bus: Received SR_DF_FRAME_BEGIN packet.");
-		break;
-	case SR_DF_FRAME_END:
-		sr_dbg("bus: Received SR_DF_FRAME_END packet.");
-		break;
-	case SR_DF_ANALOG:
-		analog = packet->payload;
-		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
-		       analog->num_samples);
-		break;
-	default:
-		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
-		break;
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change dispatch mode while session is running.");
+		return SR_ERR;
 	}
+	session->dispatch_depth = depth;
+
+	return SR_OK;
 }
 
 /**
- * Helper to send a meta datafeed package (SR_DF_META) to the session bus.
+ * Bound the memory which the datafeed dispatch queue holds.
  *
- * @param sdi The device instance to send the package from. Must not be NULL.
- * @param key The config key to send to the session bus.
- * @param var The value to send to the session bus.
+ * A fast driver and slow datafeed callbacks otherwise fill the queue
+ * with as many packets as it has slots, however large they are. With a
+ * budget set, drivers also wait while the queued packets' sample data
+ * takes up @a max_bytes or more. Drivers which download a capture from
+ * device memory (e.g. kingst-la2016, asix-sigma) pause their download
+ * meanwhile, so that the host's memory use does not depend on the
+ * capture depth, nor on the consumers' speed.
+ *
+ * This only takes effect with a dispatch thread, see
+ * sr_session_dispatch_thread_set(). Without one, drivers wait for the
+ * callbacks anyway.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param max_bytes The budget in bytes. A single packet which is larger
+ *                  still gets queued. Use 0 for no budget (the default).
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Session is running.
  *
- * @private
+ * @since 0.6.0
  */
-SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
-		uint32_t key, GVariant *var)
+SR_API int sr_session_dispatch_memory_set(struct sr_session *session,
+		uint64_t max_bytes)
 {
-	struct sr_config *cfg;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_meta meta;
-	int ret;
-
-	cfg = sr_config_new(key, var);
-
-	memset(&meta, 0, sizeof(meta));
-
-	packet.type = SR_DF_META;
-	packet.payload = &meta;
-
-	meta.config = g_slist_append(NULL, cfg);
-
-	ret = sr_session_send(sdi, &packet);
-	g_slist_free(meta.config);
-	sr_config_free(cfg);
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change dispatch mode while session is running.");
+		return SR_ERR;
+	}
+	session->dispatch_max_bytes = max_bytes;
 
-	return ret;
+	return SR_OK;
 }
 
 /**
- * Send a packet to whatever is listening on the datafeed bus.
+ * Limit the memory which a session's large buffers may take up.
  *
- * Hardware drivers use this to send a data packet to the frontend.
+ * Drivers, soft triggers and output modules account their large
+ * buffers to the session of their device: the feed queues' sample
+ * buffers, pre-trigger buffers, the value queue of the VCD output.
+ * When an allocation would take the total beyond @a max_bytes, it
+ * fails and the session gets stopped, instead of the host running out
+ * of memory during long unattended captures. The current and the
+ * peak amount show up in the session's statistics.
  *
- * @param sdi TODO.
- * @param packet The datafeed packet to send to the session bus.
+ * To have drivers wait for slow consumers instead of queueing their
+ * data, see sr_session_dispatch_memory_set().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param max_bytes The limit in bytes. Use 0 for no limit (the default).
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_ARG Invalid session passed.
  *
- * @private
+ * @since 0.6.0
  */
-SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
-		const struct sr_datafeed_packet *packet)
+SR_API int sr_session_memory_limit_set(struct sr_session *session,
+		uint64_t max_bytes)
 {
-	GSList *l;
-	struct datafeed_callback *cb_struct;
-	struct sr_datafeed_packet *packet_in, *packet_out;
-	struct sr_transform *t;
-	int ret;
-
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	if (!packet) {
-		sr_err("%s: packet was NULL", __func__);
-		return SR_ERR_ARG;
-	}
+	g_mutex_lock(&session->stats_mutex);
+	session->mem_limit = max_bytes;
+	g_mutex_unlock(&session->stats_mutex);
 
-	if (!sdi->session) {
-		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
-	}
+	return SR_OK;
+}
+
+/**
+ * Combine small logic packets before they reach the datafeed callbacks.
+ *
+ * At low samplerates, drivers like fx2lafw send a small logic packet
+ * per USB transfer, and the callbacks run thousands of times a second.
+ * With coalescing, consecutive logic packets of a device get collected
+ * and delivered as one, once they hold @a max_bytes, or at the latest
+ * @a max_latency_ms after the first collected one arrived. Any
+ * other packet (trigger, meta, frame, end, analog) delivers the
+ * collected data first, so the order of the datafeed is unchanged.
+ * Logic packets of @a max_bytes or more are delivered as they are.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param max_bytes Size of the combined packets, 0 to deliver each
+ *                  packet as it is sent (the default).
+ * @param max_latency_ms Longest time to hold back data, 0 for no limit.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_logic_coalesce_set(struct sr_session *session,
+		size_t max_bytes, unsigned int max_latency_ms)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change coalescing while session is running.");
+		return SR_ERR;
+	}
+	session->coalesce_bytes = max_bytes;
+	session->coalesce_latency_us = 1000 * (int64_t)max_latency_ms;
+
+	return SR_OK;
+}
+
+/**
+ * Record raw USB transfers to disk instead of decoding them.
+ *
+ * For long unattended recordings. Devices whose driver supports it
+ * (currently fx2lafw and dreamsourcelab-dslogic) write the transfers
+ * they make from the acquisition start on to a dump file in @a dir,
+ * named usb-<bus>.<address>.dump, together with their configuration.
+ * They skip their decoding and send no sample data, sample limits
+ * count the recorded samples, soft triggers and frame limits don't
+ * apply. Other devices acquire as usual.
+ *
+ * Scanning with conn=replay:<dump> later creates a device with the
+ * recorded configuration, whose acquisition decodes the dump through
+ * the driver's usual receive path. Its triggers apply then.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param dir The directory to record to, or NULL to decode as usual
+ *            (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_raw_record_set(struct sr_session *session,
+		const char *dir)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change raw recording while session is running.");
+		return SR_ERR;
+	}
+	g_free(session->raw_record_dir);
+	session->raw_record_dir = g_strdup(dir);
+
+	return SR_OK;
+}
+
+/**
+ * Align the timeouts of the session's event sources to a common grid.
+ *
+ * Sessions with many devices, e.g. a rack of multimeters and power
+ * supplies, otherwise wake up for each device's timeout separately.
+ * With a slack time set, the expiration of each source's timeout is
+ * deferred to the next multiple of the slack time. Sources which share
+ * a grid point get dispatched in the same main loop iteration, their
+ * readings arrive together, and the session wakes up less often.
+ *
+ * Timeouts get extended by up to the slack time, sources with shorter
+ * timeouts expire once per slack time. Receive data on a source's file
+ * descriptor is still handled as soon as it arrives.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param slack_ms The grid's step width in ms, or 0 to let each source
+ *                 expire on its own (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_timer_coalesce_set(struct sr_session *session,
+		unsigned int slack_ms)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	session->timer_slack_us = 1000 * (int64_t)slack_ms;
+
+	return SR_OK;
+}
+
+/**
+ * Have the session wait for its file descriptors with epoll.
+ *
+ * Sessions with many instruments on serial ports or network sockets
+ * otherwise have GLib poll() every descriptor in each main loop
+ * iteration. With epoll the descriptors are registered once, and
+ * GLib only polls the epoll descriptor. Descriptors which epoll can't
+ * handle are polled as before. Only available on Linux.
+ *
+ * The setting applies to event sources which get added later on, i.e.
+ * set it before starting the session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable Whether to use epoll.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_NA epoll is not available on this platform.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_epoll_set(struct sr_session *session, gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	session->epoll = enable;
+
+	return SR_OK;
+#else
+	if (!enable)
+		return SR_OK;
+	sr_err("epoll is not supported on this platform.");
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Get statistics of the session's datafeed dispatch queue.
+ *
+ * The statistics are reset when the session starts, and remain
+ * available after it stopped. They are approximate while the session
+ * is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Pointer to store the statistics in. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @see sr_session_dispatch_thread_set()
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_dispatch_stats_get(struct sr_session *session,
+		struct sr_session_dispatch_stats *stats)
+{
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	*stats = session->dispatch_stats;
+
+	return SR_OK;
+}
+
+/**
+ * Enable or disable the collection of datafeed statistics.
+ *
+ * While enabled, the session counts the packets and payload bytes
+ * which pass through it, and measures the time spent in transform
+ * modules and datafeed callbacks. Enabling the collection resets all
+ * statistics to zero.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to collect statistics, FALSE to stop doing so.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+
+	if (!session)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&session->stats_mutex);
+	if (enable && !session->stats_enabled) {
+		memset(&session->stats, 0, sizeof(session->stats));
+		for (l = session->datafeed_callbacks; l; l = l->next) {
+			cb_struct = l->data;
+			cb_struct->time = 0;
+		}
+	}
+	session->stats_enabled = enable;
+	g_mutex_unlock(&session->stats_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get the datafeed statistics of a session.
+ *
+ * This may be called from any thread, also while the session runs.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Where to store the statistics. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats *stats)
+{
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&session->stats_mutex);
+	*stats = session->stats;
+	stats->memory_used = session->mem_used;
+	stats->memory_peak = session->mem_peak;
+	g_mutex_unlock(&session->stats_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get the time a datafeed callback has spent processing packets.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb The callback, as passed to sr_session_datafeed_callback_add().
+ * @param cb_data The callback's opaque pointer.
+ * @param elapsed Where to store the cumulative time in microseconds.
+ *                Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such callback.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_callback_time_get(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, uint64_t *elapsed)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	int ret;
+
+	if (!session || !cb || !elapsed)
+		return SR_ERR_ARG;
+
+	ret = SR_ERR_ARG;
+	g_mutex_lock(&session->stats_mutex);
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->cb == cb && cb_struct->cb_data == cb_data) {
+			*elapsed = cb_struct->time;
+			ret = SR_OK;
+			break;
+		}
+	}
+	g_mutex_unlock(&session->stats_mutex);
+
+	return ret;
+}
+
+/**
+ * Enable or disable host receive timestamps for a session's packets.
+ *
+ * With timestamps enabled, every packet gets the time at which its data
+ * arrived at the host. That is when the USB transfer completed or the
+ * serial port read returned, or else when the driver sent the packet.
+ * Datafeed callbacks query it with sr_session_packet_time_get().
+ *
+ * The packets themselves are unchanged. When no session has timestamps
+ * enabled, the I/O code doesn't read the clock.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to enable timestamps, FALSE to disable them.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_timestamps_enable(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session)
+		return SR_ERR_ARG;
+
+	enable = !!enable;
+	if (enable == session->timestamps_enabled)
+		return SR_OK;
+
+	session->timestamps_enabled = enable;
+	if (enable)
+		g_atomic_int_inc(&timestamp_sessions);
+	else
+		(void)g_atomic_int_dec_and_test(&timestamp_sessions);
+
+	return SR_OK;
+}
+
+/**
+ * Get the host receive time of the packet which is being delivered.
+ *
+ * This is meant to be called from a datafeed callback. The packets of a
+ * batch callback (see sr_session_datafeed_batch_callback_add()) share a
+ * single time.
+ *
+ * @return The time in microseconds, on the clock of
+ *         g_get_monotonic_time(). 0 if timestamps are not enabled for
+ *         the session (see sr_session_timestamps_enable()), or if the
+ *         calling thread is not delivering a packet.
+ *
+ * @since 0.6.0
+ */
+SR_API int64_t sr_session_packet_time_get(void)
+{
+	int64_t *t;
+
+	t = g_private_get(&packet_time);
+
+	return t ? *t : 0;
+}
+
+/**
+ * Record that data arrived at the host just now.
+ *
+ * The I/O code calls this when a transfer completed or a read returned
+ * data. Packets which the calling thread sends until the end of the
+ * current event source dispatch carry this time. Nothing happens when no
+ * session has timestamps enabled.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_receive_mark(void)
+{
+	if (G_LIKELY(!g_atomic_int_get(&timestamp_sessions)))
+		return;
+
+	*thread_time(&receive_time) = g_get_monotonic_time();
+}
+
+/**
+ * Forget the receive time which sr_session_receive_mark() recorded.
+ *
+ * Event sources call this after their callback returned.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_receive_unmark(void)
+{
+	int64_t *t;
+
+	if ((t = g_private_get(&receive_time)))
+		*t = 0;
+}
+
+/**
+ * Report the outcome of a driver's data transfers.
+ *
+ * Drivers call this for transfers which failed or came back without
+ * data, so that the counts show up in the session's statistics.
+ *
+ * @param sdi The device instance the transfers belong to.
+ * @param dropped Number of failed transfers.
+ * @param empty Number of transfers without data.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_report_transfers(const struct sr_dev_inst *sdi,
+		unsigned int dropped, unsigned int empty)
+{
+	struct sr_session *session;
+
+	if (!sdi || !sdi->session)
+		return;
+	session = sdi->session;
+
+	g_mutex_lock(&session->stats_mutex);
+	session->stats.dropped_transfers += dropped;
+	session->stats.empty_transfers += empty;
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/**
+ * Account a large buffer to the session of a device.
+ *
+ * Call this before allocating the buffer, and sr_session_mem_release()
+ * with the same size after freeing it. Devices which aren't part of a
+ * session have no limit.
+ *
+ * @param sdi The device instance the buffer is for. May be NULL.
+ * @param bytes The buffer's size.
+ *
+ * @retval SR_OK The buffer may be allocated.
+ * @retval SR_ERR_MALLOC The session's memory limit would be exceeded.
+ *         The session gets stopped.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_mem_charge(const struct sr_dev_inst *sdi,
+		size_t bytes)
+{
+	struct sr_session *session;
+	gboolean exceeded;
+
+	if (!sdi || !(session = sdi->session))
+		return SR_OK;
+
+	g_mutex_lock(&session->stats_mutex);
+	exceeded = session->mem_limit
+		&& session->mem_used + bytes > session->mem_limit;
+	if (!exceeded) {
+		session->mem_used += bytes;
+		session->mem_peak = MAX(session->mem_peak, session->mem_used);
+	} else if (session->mem_exceeded) {
+		/* Already stopping, don't repeat the message. */
+		g_mutex_unlock(&session->stats_mutex);
+		return SR_ERR_MALLOC;
+	}
+	session->mem_exceeded |= exceeded;
+	g_mutex_unlock(&session->stats_mutex);
+
+	if (!exceeded)
+		return SR_OK;
+
+	sr_err("Memory limit of %" PRIu64 " bytes reached, stopping.",
+		session->mem_limit);
+	sr_session_stop(session);
+
+	return SR_ERR_MALLOC;
+}
+
+/**
+ * Return a buffer's size to the session, see sr_session_mem_charge().
+ *
+ * @param sdi The device instance the buffer was for. May be NULL.
+ * @param bytes The buffer's size.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_mem_release(const struct sr_dev_inst *sdi,
+		size_t bytes)
+{
+	struct sr_session *session;
+
+	if (!sdi || !(session = sdi->session))
+		return;
+
+	g_mutex_lock(&session->stats_mutex);
+	session->mem_used -= MIN(bytes, session->mem_used);
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/**
+ * Debug helper.
+ *
+ * @param packet The packet to show debugging information for.
+ */
+static void datafeed_dump(const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+
+	/* Please use the same order as in libsigrok.h. */
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		sr_dbg("bus: Received SR_DF_HEADER packet.");
+		break;
+	case SR_DF_END:
+		sr_dbg("bus: Received SR_DF_END packet.");
+		break;
+	case SR_DF_META:
+		sr_dbg("bus: Received SR_DF_META packet.");
+		break;
+	case SR_DF_TRIGGER:
+		sr_dbg("bus: Received SR_DF_TRIGGER packet.");
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC packet (%" PRIu64 " bytes, "
+		       "unitsize = %d).", logic->length, logic->unitsize);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		sr_dbg("bus: Received SR_DF_FRAME_BEGIN packet.");
+		break;
+	case SR_DF_FRAME_END:
+		sr_dbg("bus: Received SR_DF_FRAME_END packet.");
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
+		       analog->num_samples);
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_RLE packet (%" PRIu64 " runs, "
+		       "unitsize = %d).", rle->num_runs, rle->unitsize);
+		break;
+	default:
+		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
+		break;
+	}
+}
+
+/**
+ * Helper to send a meta datafeed package (SR_DF_META) to the session bus.
+ *
+ * @param sdi The device instance to send the package from. Must not be NULL.
+ * @param key The config key to send to the session bus.
+ * @param var The value to send to the session bus.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
+		uint32_t key, GVariant *var)
+{
+	struct sr_meta_batch batch;
+
+	sr_meta_batch_init(&batch, sdi);
+	sr_meta_batch_add(&batch, key, var);
+
+	return sr_meta_batch_send(&batch);
+}
+
+/**
+ * Prepare a meta packet which carries several config keys.
+ *
+ * The packet's config items and list nodes live in the batch itself, so
+ * building and sending it doesn't allocate memory. Drivers which report
+ * several state changes at once use this instead of sending a meta
+ * packet per key.
+ *
+ * @param batch The batch, usually on the caller's stack.
+ * @param sdi The device instance which sends the packet.
+ *
+ * @private
+ */
+SR_PRIV void sr_meta_batch_init(struct sr_meta_batch *batch,
+		const struct sr_dev_inst *sdi)
+{
+	batch->sdi = sdi;
+	batch->count = 0;
+}
+
+/**
+ * Add a config key to a meta packet batch.
+ *
+ * A full batch gets sent before the key is added.
+ *
+ * @param batch The batch, see sr_meta_batch_init().
+ * @param key The config key (SR_CONF_*).
+ * @param var The value. A floating reference gets sunk, the batch drops
+ *            its reference after sending.
+ *
+ * @retval SR_OK Success.
+ * @retval other Sending a full batch failed, the key was added anyway.
+ *
+ * @private
+ */
+SR_PRIV int sr_meta_batch_add(struct sr_meta_batch *batch,
+		uint32_t key, GVariant *var)
+{
+	struct sr_config *cfg;
+	int ret;
+
+	ret = SR_OK;
+	if (batch->count == ARRAY_SIZE(batch->configs))
+		ret = sr_meta_batch_send(batch);
+
+	cfg = &batch->configs[batch->count++];
+	cfg->key = key;
+	cfg->data = g_variant_ref_sink(var);
+
+	return ret;
+}
+
+/**
+ * Send the keys of a meta packet batch, and empty the batch.
+ *
+ * Nothing gets sent when the batch is empty.
+ *
+ * @param batch The batch, see sr_meta_batch_init().
+ *
+ * @retval SR_OK Success.
+ * @retval other Sending the packet failed.
+ *
+ * @private
+ */
+SR_PRIV int sr_meta_batch_send(struct sr_meta_batch *batch)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	size_t i;
+	int ret;
+
+	if (!batch->count)
+		return SR_OK;
+
+	for (i = 0; i < batch->count; i++) {
+		batch->nodes[i].data = &batch->configs[i];
+		batch->nodes[i].next = (i + 1 < batch->count) ?
+			&batch->nodes[i + 1] : NULL;
+	}
+
+	memset(&meta, 0, sizeof(meta));
+	meta.config = &batch->nodes[0];
+
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+
+	ret = sr_session_send(batch->sdi, &packet);
+
+	for (i = 0; i < batch->count; i++)
+		g_variant_unref(batch->configs[i].data);
+	batch->count = 0;
+
+	return ret;
+}
+
+/*
+ * Logic data of a device which awaits delivery in a larger packet, see
+ * sr_session_logic_coalesce_set(). Each device of a running session
+ * has one. The timer which enforces the latency limit runs in the
+ * session's main context, the mutex keeps it apart from the thread
+ * which sends the device's packets.
+ */
+struct logic_coalesce {
+	struct sr_session *session;
+	const struct sr_dev_inst *sdi;
+	GRecMutex mutex;
+	uint8_t *buf;
+	size_t fill;
+	unsigned int unitsize;
+	/** When the first of the collected packets arrived. */
+	int64_t first;
+	/** Delivers the collected data when the latency limit is up. */
+	GSource *timer;
+	/** Set while the collected data gets delivered. */
+	gboolean busy;
+	struct logic_coalesce *next;
+};
+
+static void coalesce_start(struct sr_session *session)
+{
+	struct logic_coalesce *c;
+	GSList *l;
+
+	if (!session->coalesce_bytes)
+		return;
+
+	for (l = session->devs; l; l = l->next) {
+		c = g_malloc0(sizeof(*c));
+		c->session = session;
+		c->sdi = l->data;
+		g_rec_mutex_init(&c->mutex);
+		c->next = session->coalesce;
+		session->coalesce = c;
+	}
+}
+
+static struct logic_coalesce *coalesce_find(struct sr_session *session,
+		const struct sr_dev_inst *sdi)
+{
+	struct logic_coalesce *c;
+
+	for (c = session->coalesce; c; c = c->next) {
+		if (c->sdi == sdi)
+			return c;
+	}
+
+	return NULL;
+}
+
+static int session_send_now(struct sr_session *session,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+
+/*
+ * Deliver the collected logic data as one packet. It lives in memory
+ * of our own, not in the driver buffer which may be up for sending.
+ */
+static int coalesce_flush(struct sr_session *session,
+		struct logic_coalesce *c)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_buffer *prev;
+	int ret;
+
+	if (c->timer) {
+		g_source_destroy(c->timer);
+		g_source_unref(c->timer);
+		c->timer = NULL;
+	}
+	if (!c->fill)
+		return SR_OK;
+
+	logic.length = c->fill;
+	logic.unitsize = c->unitsize;
+	logic.data = c->buf;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	c->fill = 0;
+
+	prev = g_private_get(&send_buffer);
+	g_private_set(&send_buffer, NULL);
+	c->busy = TRUE;
+	ret = session_send_now(session, c->sdi, &packet);
+	c->busy = FALSE;
+	g_private_set(&send_buffer, prev);
+
+	return ret;
+}
+
+/* Deliver the collected data when no more packets came in time. */
+static gboolean coalesce_timeout(gpointer user_data)
+{
+	struct logic_coalesce *c;
+
+	c = user_data;
+	g_rec_mutex_lock(&c->mutex);
+	if (!c->busy)
+		coalesce_flush(c->session, c);
+	g_rec_mutex_unlock(&c->mutex);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void coalesce_arm(struct sr_session *session,
+		struct logic_coalesce *c)
+{
+	c->timer = g_timeout_source_new(session->coalesce_latency_us / 1000);
+	g_source_set_callback(c->timer, coalesce_timeout, c, NULL);
+	if (!session_source_attach(session, c->timer)) {
+		g_source_unref(c->timer);
+		c->timer = NULL;
+	}
+}
+
+/* Deliver what is left, the devices have stopped sending. */
+static void coalesce_stop(struct sr_session *session)
+{
+	struct logic_coalesce *c;
+
+	while ((c = session->coalesce)) {
+		g_rec_mutex_lock(&c->mutex);
+		coalesce_flush(session, c);
+		g_rec_mutex_unlock(&c->mutex);
+		session->coalesce = c->next;
+		g_rec_mutex_clear(&c->mutex);
+		g_free(c->buf);
+		g_free(c);
+	}
+}
+
+static int coalesce_send(struct sr_session *session,
+		struct logic_coalesce *c, const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	int ret;
+
+	logic = (packet->type == SR_DF_LOGIC) ? packet->payload : NULL;
+	if (logic && c->fill && (logic->unitsize != c->unitsize
+			|| c->fill + logic->length > session->coalesce_bytes)) {
+		ret = coalesce_flush(session, c);
+		if (ret != SR_OK)
+			return ret;
+	}
+	if (logic && logic->length < session->coalesce_bytes && !c->buf)
+		c->buf = g_try_malloc(session->coalesce_bytes);
+	if (!logic || logic->length >= session->coalesce_bytes || !c->buf) {
+		/* Keep the datafeed's order. */
+		ret = coalesce_flush(session, c);
+		if (ret != SR_OK)
+			return ret;
+		return session_send_now(session, c->sdi, packet);
+	}
+
+	if (!c->fill) {
+		c->unitsize = logic->unitsize;
+		c->first = g_get_monotonic_time();
+		if (session->coalesce_latency_us)
+			coalesce_arm(session, c);
+	}
+	memcpy(c->buf + c->fill, logic->data, logic->length);
+	c->fill += logic->length;
+
+	if (c->fill + c->unitsize > session->coalesce_bytes
+			|| (session->coalesce_latency_us && g_get_monotonic_time()
+				- c->first >= session->coalesce_latency_us))
+		return coalesce_flush(session, c);
+
+	return SR_OK;
+}
+
+/**
+ * Send a packet to whatever is listening on the datafeed bus.
+ *
+ * Hardware drivers use this to send a data packet to the frontend.
+ *
+ * @param sdi TODO.
+ * @param packet The datafeed packet to send to the session bus.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	struct logic_coalesce *c;
+	int ret;
+
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!packet) {
+		sr_err("%s: packet was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	/* Packets from the consumer thread bypass it, like the queue. */
+	session = sdi->session;
+	if (session->coalesce && !(session->dispatch
+			&& g_thread_self() == session->dispatch->thread)
+			&& (c = coalesce_find(session, sdi))) {
+		g_rec_mutex_lock(&c->mutex);
+		if (!c->busy) {
+			ret = coalesce_send(session, c, packet);
+			g_rec_mutex_unlock(&c->mutex);
+			return ret;
+		}
+		g_rec_mutex_unlock(&c->mutex);
+	}
+
+	return session_send_now(session, sdi, packet);
+}
+
+static int session_send_now(struct sr_session *session,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	int64_t time, prev, *cur, start;
+	int ret;
+
+	/*
+	 * Packets sent from within the consumer thread (e.g. by datafeed
+	 * callbacks) are dispatched right away, queueing them would
+	 * deadlock on a full queue.
+	 */
+	time = session->timestamps_enabled ? send_time() : 0;
+	start = sr_trace_now();
+	if (session->dispatch && g_thread_self() != session->dispatch->thread) {
+		ret = dispatch_queue_push(session, sdi, packet, time);
+	} else if (!time) {
+		ret = session_dispatch(sdi, packet);
+	} else {
+		cur = thread_time(&packet_time);
+		prev = *cur;
+		*cur = time;
+		ret = session_dispatch(sdi, packet);
+		*cur = prev;
+	}
+	sr_trace_span("session send", start, "type", packet->type);
+
+	return ret;
+}
+
+/**
+ * Send several packets to whatever is listening on the datafeed bus.
+ *
+ * Behaves like calling sr_session_send() for each of the packets in
+ * turn, but the per-packet overhead is paid once for the whole batch.
+ * Callbacks which were registered with
+ * sr_session_datafeed_batch_callback_add() receive all packets in a
+ * single call.
+ *
+ * When transform modules are active, each of the packets is run
+ * through the transform chain and delivered individually.
+ *
+ * @param sdi The device instance to send the packets from.
+ * @param packets Array of datafeed packets to send to the session bus.
+ * @param count Number of packets in the array.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_batch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packets, size_t count)
+{
+	struct sr_session *session;
+	int64_t prev, *cur, start;
+	size_t i;
+	int ret;
+
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!packets && count) {
+		sr_err("%s: packets was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (!count)
+		return SR_OK;
+
+	/*
+	 * The dispatch thread and the transforms take one at a time, and
+	 * so does run-length data which some callbacks need expanded.
+	 * Coalescing looks at each packet, too.
+	 */
+	session = sdi->session;
+	for (i = 0; i < count; i++) {
+		if (packets[i].type == SR_DF_LOGIC_RLE)
+			break;
+	}
+	if ((session->dispatch && g_thread_self() != session->dispatch->thread)
+			|| session->transforms || session->coalesce || i < count) {
+		for (i = 0; i < count; i++) {
+			ret = sr_session_send(sdi, &packets[i]);
+			if (ret != SR_OK)
+				return ret;
+		}
+		return SR_OK;
+	}
+
+	start = sr_trace_now();
+	if (!session->timestamps_enabled) {
+		ret = session_deliver(sdi, packets, count,
+			session->stats_enabled ? g_get_monotonic_time() : 0,
+			DELIVER_ALL);
+	} else {
+		cur = thread_time(&packet_time);
+		prev = *cur;
+		*cur = send_time();
+		ret = session_deliver(sdi, packets, count,
+			session->stats_enabled ? g_get_monotonic_time() : 0,
+			DELIVER_ALL);
+		*cur = prev;
+	}
+	sr_trace_span("session send batch", start, "count", count);
+
+	return ret;
+}
+
+static gboolean callback_wanted(const struct datafeed_callback *cb_struct,
+		enum deliver_to to)
+{
+	switch (to) {
+	case DELIVER_RLE_AWARE:
+		return (cb_struct->flags & SR_DATAFEED_CB_LOGIC_RLE) != 0;
+	case DELIVER_RLE_UNAWARE:
+		return (cb_struct->flags & SR_DATAFEED_CB_LOGIC_RLE) == 0;
+	default:
+		return TRUE;
+	}
+}
+
+/*
+ * Get the worker pool for thread-safe callbacks, creating it on first
+ * use. Returns NULL when all callbacks are to be run in sequence.
+ */
+static struct callback_pool *session_callback_pool(struct sr_session *session)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	unsigned int num_safe;
+
+	if (session->callback_pool)
+		return session->callback_pool;
+	if (session->callback_pool_unused)
+		return NULL;
+
+	num_safe = 0;
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->flags & SR_DATAFEED_CB_THREAD_SAFE)
+			num_safe++;
+	}
+
+	/* Not worth the thread hand-off unless workers run side by side. */
+	if (num_safe < 2) {
+		session->callback_pool_unused = TRUE;
+		return NULL;
+	}
+
+	session->callback_pool = callback_pool_new(
+			MIN(num_safe, g_get_num_processors()));
+	if (!session->callback_pool) {
+		sr_warn("Cannot create worker threads, running callbacks "
+			"in sequence.");
+		session->callback_pool_unused = TRUE;
+	}
+
+	return session->callback_pool;
+}
+
+/*
+ * Hand all thread-safe callbacks to the worker pool, run the unsafe
+ * ones in the calling thread meanwhile, and wait for all of them to
+ * return.
+ */
+static int dispatch_concurrent(struct sr_session *session,
+		struct callback_pool *pool, const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, enum deliver_to to)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	struct sr_datafeed_buffer *buf;
+	int64_t time;
+
+	buf = g_private_get(&send_buffer);
+	time = session->timestamps_enabled ? *thread_time(&packet_time) : 0;
+
+	g_mutex_lock(&pool->mutex);
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (!callback_wanted(cb_struct, to))
+			continue;
+		if (!(cb_struct->flags & SR_DATAFEED_CB_THREAD_SAFE))
+			continue;
+		cb_struct->pool = pool;
+		cb_struct->sdi = sdi;
+		cb_struct->packet = packet;
+		cb_struct->buf = buf;
+		cb_struct->packet_time = time;
+		pool->pending++;
+		g_thread_pool_push(pool->threads, cb_struct, NULL);
+	}
+	g_mutex_unlock(&pool->mutex);
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (!callback_wanted(cb_struct, to))
+			continue;
+		if (cb_struct->flags & SR_DATAFEED_CB_THREAD_SAFE)
+			continue;
+		run_callback(cb_struct, sdi, packet);
+	}
+
+	g_mutex_lock(&pool->mutex);
+	while (pool->pending)
+		g_cond_wait(&pool->cond, &pool->mutex);
+	g_mutex_unlock(&pool->mutex);
+
+	return SR_OK;
+}
+
+/* Account delivered packets in the session's statistics. */
+static void stats_account(struct sr_session *session,
+		const struct sr_datafeed_packet *packets, size_t count,
+		int64_t start)
+{
+	uint64_t bytes, latency;
+	size_t i;
+
+	bytes = 0;
+	for (i = 0; i < count; i++)
+		bytes += packet_payload_bytes(&packets[i]);
+	latency = g_get_monotonic_time() - start;
+
+	g_mutex_lock(&session->stats_mutex);
+	session->stats.packets += count;
+	session->stats.bytes += bytes;
+	if (latency > session->stats.max_latency)
+		session->stats.max_latency = latency;
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/*
+ * Pass packets which went through the transforms to the callbacks.
+ * The start time of the dispatch is only used for statistics, which
+ * account for run-length data separately.
+ */
+static int session_deliver(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packets, size_t count,
+		int64_t start, enum deliver_to to)
+{
+	struct sr_session *session;
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	struct datafeed_batch_callback *batch_struct;
+	struct callback_pool *pool;
+	const struct sr_datafeed_analog *analog;
+	size_t i;
+	int ret;
+
+	session = sdi->session;
+
+	if (sr_log_loglevel_get() >= SR_LOG_DBG) {
+		for (i = 0; i < count; i++)
+			datafeed_dump(&packets[i]);
+	}
+
+	/*
+	 * Callbacks which need analog packets' float values share one
+	 * conversion per packet, see sr_analog_to_float_view().
+	 */
+	pool = session_callback_pool(session);
+	for (i = 0; i < count; i++) {
+		analog = NULL;
+		if (packets[i].type == SR_DF_ANALOG)
+			analog = packets[i].payload;
+		if (analog)
+			sr_analog_float_view_begin(session->float_view, analog);
+		if (pool) {
+			ret = dispatch_concurrent(session, pool, sdi,
+					&packets[i], to);
+		} else {
+			for (l = session->datafeed_callbacks; l; l = l->next) {
+				cb_struct = l->data;
+				if (callback_wanted(cb_struct, to))
+					run_callback(cb_struct, sdi, &packets[i]);
+			}
+			ret = SR_OK;
+		}
+		if (analog)
+			sr_analog_float_view_end(session->float_view);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	/* Batch callbacks only ever see expanded logic data. */
+	if (to != DELIVER_RLE_AWARE) {
+		for (l = session->datafeed_batch_callbacks; l; l = l->next) {
+			batch_struct = l->data;
+			batch_struct->cb(sdi, packets, count,
+				batch_struct->cb_data);
+		}
+		if (session->merge) {
+			for (i = 0; i < count; i++)
+				sr_session_merge_feed(session->merge,
+					sdi, &packets[i]);
+		}
+	}
+
+	if (session->stats_enabled && to == DELIVER_ALL)
+		stats_account(session, packets, count, start);
+
+	return SR_OK;
+}
+
+/*
+ * Run a sequence of consecutive in-place transforms over logic data,
+ * block by block, so that each block still is in the cache when the
+ * next transform gets to it. On return, *item points to the last
+ * transform of the sequence.
+ */
+static int run_inplace_transforms(GSList **item,
+		const struct sr_datafeed_logic *logic)
+{
+	GSList *first, *last, *l;
+	struct sr_transform *t;
+	uint8_t *data;
+	uint64_t length, block, offset, n;
+	int ret;
+
+	first = last = *item;
+	while (last->next) {
+		t = last->next->data;
+		if (!t->module->receive_logic_inplace)
+			break;
+		last = last->next;
+	}
+	*item = last;
+
+	if (!logic->unitsize)
+		return SR_OK;
+
+	/* Only complete samples are passed to the transforms. */
+	data = logic->data;
+	length = logic->length - logic->length % logic->unitsize;
+	block = TRANSFORM_BLOCK_SIZE - TRANSFORM_BLOCK_SIZE % logic->unitsize;
+	if (!block || first == last)
+		block = length;
+
+	for (offset = 0; offset < length; offset += n) {
+		n = MIN(block, length - offset);
+		for (l = first; ; l = l->next) {
+			t = l->data;
+			sr_spew("Running transform module '%s' in place.",
+				t->module->id);
+			ret = t->module->receive_logic_inplace(t,
+					data + offset, n, logic->unitsize);
+			if (ret != SR_OK)
+				return ret;
+			if (l == last)
+				break;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Run the transforms and datafeed callbacks on a packet. */
+static int session_dispatch_to(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, enum deliver_to to)
+{
+	GSList *l;
+	struct sr_datafeed_packet *packet_in, *packet_out;
+	struct sr_transform *t;
+	int64_t start;
+	int ret;
+
+	start = sdi->session->stats_enabled ? g_get_monotonic_time() : 0;
 
 	/*
 	 * Pass the packet to the first transform module. If that returns
@@ -1153,6 +3369,15 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	packet_in = (struct sr_datafeed_packet *)packet;
 	for (l = sdi->session->transforms; l; l = l->next) {
 		t = l->data;
+		if (packet_in->type == SR_DF_LOGIC
+				&& t->module->receive_logic_inplace) {
+			ret = run_inplace_transforms(&l, packet_in->payload);
+			if (ret < 0) {
+				sr_err("Error while running transform module: %d.", ret);
+				return SR_ERR;
+			}
+			continue;
+		}
 		sr_spew("Running transform module '%s'.", t->module->id);
 		ret = t->module->receive(t, packet_in, &packet_out);
 		if (ret < 0) {
@@ -1180,14 +3405,139 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	 * If the last transform did output a packet, pass it to all datafeed
 	 * callbacks.
 	 */
-	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
-		cb_struct = l->data;
-		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+	if (start) {
+		g_mutex_lock(&sdi->session->stats_mutex);
+		sdi->session->stats.transform_time +=
+			g_get_monotonic_time() - start;
+		g_mutex_unlock(&sdi->session->stats_mutex);
 	}
 
-	return SR_OK;
+	return session_deliver(sdi, packet, 1, start, to);
+}
+
+/*
+ * Deliver a run-length packet. Callbacks which handle those get it as
+ * is, the others get the samples expanded into logic packets of at
+ * most RLE_EXPAND_SIZE bytes. The transforms only handle expanded data,
+ * when there are any, all callbacks receive their output.
+ */
+static int session_dispatch_rle(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_packet expanded;
+	struct sr_datafeed_logic logic;
+	struct sr_logic_rle_pos pos;
+	struct datafeed_callback *cb_struct;
+	gboolean have_aware, have_unaware;
+	enum deliver_to to;
+	uint64_t size;
+	int64_t start;
+	GSList *l;
+	int ret;
+
+	session = sdi->session;
+	rle = packet->payload;
+	if (!rle || !rle->unitsize)
+		return SR_ERR_ARG;
+
+	to = DELIVER_ALL;
+	if (!session->transforms) {
+		have_aware = have_unaware = FALSE;
+		for (l = session->datafeed_callbacks; l; l = l->next) {
+			cb_struct = l->data;
+			if (cb_struct->flags & SR_DATAFEED_CB_LOGIC_RLE)
+				have_aware = TRUE;
+			else
+				have_unaware = TRUE;
+		}
+		if (session->datafeed_batch_callbacks)
+			have_unaware = TRUE;
+
+		start = session->stats_enabled ? g_get_monotonic_time() : 0;
+		if (have_aware) {
+			ret = session_deliver(sdi, packet, 1, start,
+					DELIVER_RLE_AWARE);
+			if (ret != SR_OK)
+				return ret;
+		}
+		if (session->stats_enabled)
+			stats_account(session, packet, 1, start);
+		if (!have_unaware)
+			return SR_OK;
+		to = DELIVER_RLE_UNAWARE;
+	}
+
+	size = sr_logic_rle_num_samples(rle) * rle->unitsize;
+	size = MIN(size, RLE_EXPAND_SIZE - RLE_EXPAND_SIZE % rle->unitsize);
+	if (!size)
+		return SR_OK;
+	logic.unitsize = rle->unitsize;
+	logic.data = g_try_malloc(size);
+	if (!logic.data) {
+		sr_err("Cannot allocate buffer to expand run-length data.");
+		return SR_ERR_MALLOC;
+	}
+	expanded.type = SR_DF_LOGIC;
+	expanded.payload = &logic;
+
+	ret = SR_OK;
+	memset(&pos, 0, sizeof(pos));
+	while ((logic.length = sr_logic_rle_expand(rle, &pos,
+			logic.data, size))) {
+		ret = session_dispatch_to(sdi, &expanded, to);
+		if (ret != SR_OK)
+			break;
+	}
+	g_free(logic.data);
+
+	return ret;
+}
+
+static int session_dispatch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (packet->type == SR_DF_LOGIC_RLE)
+		return session_dispatch_rle(sdi, packet);
+
+	return session_dispatch_to(sdi, packet, DELIVER_ALL);
+}
+
+/**
+ * Send a packet whose payload data resides in a refcounted buffer.
+ *
+ * Behaves like sr_session_send(), but consumers which call
+ * sr_packet_copy() on the packet (or on a transform's output which
+ * still points into the buffer) take a reference to @a buf instead of
+ * duplicating the payload data.
+ *
+ * The caller keeps its own reference. When this function returns,
+ * sr_datafeed_buffer_is_shared() tells whether the memory may be
+ * reused, or whether a fresh buffer is needed for the next chunk.
+ *
+ * @param sdi The device instance to send the packet from.
+ * @param packet The datafeed packet to send to the session bus.
+ * @param buf The buffer which holds the payload data. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_buffer(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		struct sr_datafeed_buffer *buf)
+{
+	struct sr_datafeed_buffer *prev;
+	int ret;
+
+	prev = g_private_get(&send_buffer);
+	g_private_set(&send_buffer, buf);
+	ret = sr_session_send(sdi, packet);
+	g_private_set(&send_buffer, prev);
+
+	return ret;
 }
 
 /**
@@ -1238,6 +3588,7 @@ SR_PRIV int sr_session_fd_source_add(struct sr_session *session,
 		return SR_ERR;
 
 	g_source_set_callback(source, G_SOURCE_FUNC(cb), cb_data, NULL);
+	((struct fd_source *)source)->cb_data = cb_data;
 
 	ret = sr_session_source_add_internal(session, key, source);
 	g_source_unref(source);
@@ -1366,11 +3717,105 @@ SR_PRIV int sr_session_source_remove_internal(struct sr_session *session,
 		sr_warn("Cannot remove non-existing event source %p.", key);
 		return SR_ERR_BUG;
 	}
+	/* Drivers close the descriptor next, which might get reused. */
+	if (source->source_funcs == &fd_source_funcs)
+		fd_source_epoll_remove((struct fd_source *)source);
 	g_source_destroy(source);
 
 	return SR_OK;
 }
 
+/**
+ * Set the priority of a device's event sources.
+ *
+ * GLib dispatches the ready sources of the highest priority first, and
+ * sources of lower priority only when none of higher priority are
+ * ready. Drivers of slow instruments which do blocking I/O from their
+ * callbacks (SCPI queries, serial polling) can lower their sources'
+ * priority, such that they don't delay high-rate streams of other
+ * devices in the same session. Slow sources then get serviced while
+ * the fast streams wait for their next data.
+ *
+ * Applies to the sources of file descriptors, poll descriptors, I/O
+ * channels and timers which were added with @a cb_data as the callback
+ * data. The USB source is shared by all USB devices and keeps its
+ * priority.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb_data The callback data the sources were added with,
+ *                usually the device instance.
+ * @param priority The GLib priority, like G_PRIORITY_LOW.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such source.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_source_set_priority(struct sr_session *session,
+		const void *cb_data, int priority)
+{
+	GHashTableIter iter;
+	GSource *source;
+	struct fd_source *fsource;
+	gboolean found;
+
+	if (!session || !cb_data)
+		return SR_ERR_ARG;
+
+	found = FALSE;
+	g_hash_table_iter_init(&iter, session->event_sources);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&source)) {
+		if (source->source_funcs != &fd_source_funcs)
+			continue;
+		fsource = (struct fd_source *)source;
+		if (fsource->cb_data != cb_data)
+			continue;
+		g_source_set_priority(source, priority);
+		found = TRUE;
+	}
+
+	return found ? SR_OK : SR_ERR_ARG;
+}
+
+/**
+ * Have the source of a file descriptor also consider buffered data.
+ *
+ * Transports which read ahead into a buffer of their own hold data the
+ * descriptor no longer reports as readable. While @a pending returns
+ * TRUE, the source's callback runs without waiting for the descriptor,
+ * and sees G_IO_IN in its events.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param fd The file descriptor the source was added for.
+ * @param pending Checks for buffered data, or NULL to clear the hook.
+ * @param data Data for the check.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such source.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_source_set_pending(struct sr_session *session,
+		int fd, gboolean (*pending)(void *data), void *data)
+{
+	GSource *source;
+	struct fd_source *fsource;
+
+	if (!session)
+		return SR_ERR_ARG;
+
+	source = g_hash_table_lookup(session->event_sources,
+		GINT_TO_POINTER(fd));
+	if (!source || source->source_funcs != &fd_source_funcs)
+		return SR_ERR_ARG;
+
+	fsource = (struct fd_source *)source;
+	fsource->pending = pending;
+	fsource->pending_data = data;
+
+	return SR_OK;
+}
+
 /**
  * Remove the source belonging to the specified file descriptor.
  *
@@ -1494,26 +3939,148 @@ static void copy_src(struct sr_config *src, struct sr_datafeed_meta *meta_copy)
 	meta_copy->config = g_slist_append(meta_copy->config, item);
 }
 
+/*
+ * Check whether the payload data of a packet that is currently being
+ * dispatched resides in the send buffer, and return that buffer.
+ */
+static struct sr_datafeed_buffer *backing_buffer(const void *data,
+		size_t size)
+{
+	struct sr_datafeed_buffer *buf;
+	const uint8_t *start, *end;
+
+	buf = g_private_get(&send_buffer);
+	if (!buf || !data)
+		return NULL;
+
+	start = buf->data;
+	end = start + buf->size;
+	if ((const uint8_t *)data < start || (const uint8_t *)data > end)
+		return NULL;
+	if (size > (size_t)(end - (const uint8_t *)data))
+		return NULL;
+
+	return buf;
+}
+
+/**
+ * Get the number of samples in a run-length encoded logic payload.
+ *
+ * @param rle The SR_DF_LOGIC_RLE payload. Must not be NULL.
+ *
+ * @return The sum of all run lengths.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_logic_rle_num_samples(
+		const struct sr_datafeed_logic_rle *rle)
+{
+	uint64_t i, count;
+
+	if (!rle)
+		return 0;
+
+	count = 0;
+	for (i = 0; i < rle->num_runs; i++)
+		count += rle->run_lengths[i];
+
+	return count;
+}
+
+/**
+ * Expand run-length encoded logic data into plain samples.
+ *
+ * Fills as many whole samples into @a buf as fit, starting where the
+ * previous call left off. Clear @a pos to start from the beginning.
+ *
+ * @param rle The SR_DF_LOGIC_RLE payload. Must not be NULL.
+ * @param pos Read position, updated on return. Must not be NULL.
+ * @param buf Buffer which receives the samples.
+ * @param size Size of @a buf in bytes.
+ *
+ * @return The number of bytes written to @a buf, 0 when the payload is
+ *         exhausted or upon invalid arguments.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		struct sr_logic_rle_pos *pos, void *buf, uint64_t size)
+{
+	const uint8_t *value;
+	uint8_t *wp;
+	uint64_t count, n, i;
+
+	if (!rle || !pos || !buf || !rle->unitsize)
+		return 0;
+
+	wp = buf;
+	count = size / rle->unitsize;
+	while (count && pos->run < rle->num_runs) {
+		value = (const uint8_t *)rle->values + pos->run * rle->unitsize;
+		n = MIN(count, rle->run_lengths[pos->run] - pos->offset);
+		if (rle->unitsize == 1) {
+			memset(wp, value[0], n);
+			wp += n;
+		} else {
+			for (i = 0; i < n; i++) {
+				memcpy(wp, value, rle->unitsize);
+				wp += rle->unitsize;
+			}
+		}
+		count -= n;
+		pos->offset += n;
+		if (pos->offset == rle->run_lengths[pos->run]) {
+			pos->run++;
+			pos->offset = 0;
+		}
+	}
+
+	return wp - (uint8_t *)buf;
+}
+
+/**
+ * Create a copy of a datafeed packet which outlives the datafeed callback.
+ *
+ * Logic and analog payload data which resides in a refcounted buffer
+ * (see struct sr_datafeed_buffer) is shared with the copy rather than
+ * duplicated. All other data is copied.
+ *
+ * @param packet The packet to copy. Must not be NULL.
+ * @param copy Pointer to store the copy in. Must not be NULL. Release
+ *             the copy with sr_packet_free().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unknown packet type or allocation failure.
+ *
+ * @since 0.4.0
+ */
 SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy)
 {
+	struct packet_copy *pcopy;
 	const struct sr_datafeed_meta *meta;
 	struct sr_datafeed_meta *meta_copy;
 	const struct sr_datafeed_logic *logic;
 	struct sr_datafeed_logic *logic_copy;
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_logic_rle *rle_copy;
 	const struct sr_datafeed_analog *analog;
 	struct sr_datafeed_analog *analog_copy;
 	struct sr_analog_encoding *encoding_copy;
 	struct sr_analog_meaning *meaning_copy;
 	struct sr_analog_spec *spec_copy;
 	uint8_t *payload;
+	size_t size;
 
-	*copy = g_malloc0(sizeof(struct sr_datafeed_packet));
+	pcopy = g_malloc0(sizeof(*pcopy));
+	*copy = &pcopy->packet;
 	(*copy)->type = packet->type;
 
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1524,7 +4091,7 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	case SR_DF_META:
 		meta = packet->payload;
 		meta_copy = g_malloc0(sizeof(struct sr_datafeed_meta));
-		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy->config);
+		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy);
 		(*copy)->payload = meta_copy;
 		break;
 	case SR_DF_LOGIC:
@@ -1534,21 +4101,34 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 			return SR_ERR;
 		logic_copy->length = logic->length;
 		logic_copy->unitsize = logic->unitsize;
-		logic_copy->data = g_malloc(logic->length * logic->unitsize);
+		size = logic->length * logic->unitsize;
+		pcopy->buf = backing_buffer(logic->data, size);
+		if (pcopy->buf) {
+			sr_datafeed_buffer_ref(pcopy->buf);
+			logic_copy->data = logic->data;
+			(*copy)->payload = logic_copy;
+			break;
+		}
+		logic_copy->data = g_malloc(size);
 		if (!logic_copy->data) {
 			g_free(logic_copy);
 			return SR_ERR;
 		}
-		memcpy(logic_copy->data, logic->data, logic->length * logic->unitsize);
+		memcpy(logic_copy->data, logic->data, size);
 		(*copy)->payload = logic_copy;
 		break;
 	case SR_DF_ANALOG:
 		analog = packet->payload;
 		analog_copy = g_malloc(sizeof(*analog_copy));
-		analog_copy->data = g_malloc(
-				analog->encoding->unitsize * analog->num_samples);
-		memcpy(analog_copy->data, analog->data,
-				analog->encoding->unitsize * analog->num_samples);
+		size = analog->encoding->unitsize * analog->num_samples;
+		pcopy->buf = backing_buffer(analog->data, size);
+		if (pcopy->buf) {
+			sr_datafeed_buffer_ref(pcopy->buf);
+			analog_copy->data = analog->data;
+		} else {
+			analog_copy->data = g_malloc(size);
+			memcpy(analog_copy->data, analog->data, size);
+		}
 		analog_copy->num_samples = analog->num_samples;
 #if GLIB_CHECK_VERSION(2, 67, 3)
 		encoding_copy = g_memdup2(analog->encoding, sizeof(*analog->encoding));
@@ -1566,6 +4146,20 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		analog_copy->spec = spec_copy;
 		(*copy)->payload = analog_copy;
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		rle_copy = g_malloc(sizeof(*rle_copy));
+		rle_copy->num_runs = rle->num_runs;
+		rle_copy->unitsize = rle->unitsize;
+		rle_copy->values = g_malloc(rle->num_runs * rle->unitsize);
+		memcpy(rle_copy->values, rle->values,
+			rle->num_runs * rle->unitsize);
+		rle_copy->run_lengths = g_malloc(rle->num_runs
+			* sizeof(rle->run_lengths[0]));
+		memcpy(rle_copy->run_lengths, rle->run_lengths,
+			rle->num_runs * sizeof(rle->run_lengths[0]));
+		(*copy)->payload = rle_copy;
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 		return SR_ERR;
@@ -1574,17 +4168,30 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	return SR_OK;
 }
 
+/**
+ * Free a packet copy created by sr_packet_copy().
+ *
+ * @param packet The packet copy to free. Must not be NULL.
+ *
+ * @since 0.4.0
+ */
 SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 {
+	struct packet_copy *pcopy;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_datafeed_analog *analog;
 	struct sr_config *src;
 	GSList *l;
 
+	pcopy = (struct packet_copy *)packet;
+
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1603,22 +4210,207 @@ SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-		g_free(logic->data);
+		if (!pcopy->buf)
+			g_free(logic->data);
 		g_free((void *)packet->payload);
 		break;
 	case SR_DF_ANALOG:
 		analog = packet->payload;
-		g_free(analog->data);
+		if (!pcopy->buf)
+			g_free(analog->data);
 		g_free(analog->encoding);
 		g_slist_free(analog->meaning->channels);
 		g_free(analog->meaning);
 		g_free(analog->spec);
 		g_free((void *)packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		g_free(rle->values);
+		g_free(rle->run_lengths);
+		g_free((void *)packet->payload);
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 	}
-	g_free(packet);
+	if (pcopy->buf)
+		sr_datafeed_buffer_unref(pcopy->buf);
+	g_free(pcopy);
+}
+
+static void datafeed_buffer_free(void *data, void *cb_data)
+{
+	(void)cb_data;
+
+	sr_buffer_free(data);
+}
+
+/**
+ * Allocate a refcounted datafeed buffer.
+ *
+ * The buffer starts out with one reference, which is owned by the caller.
+ * The payload memory comes from a pool of buffers, which gets it back
+ * when the last reference is dropped.
+ *
+ * @param size The size of the payload memory in bytes. Must not be 0.
+ *
+ * @return The new buffer, or NULL upon allocation failure or invalid size.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_datafeed_buffer *sr_datafeed_buffer_new(size_t size)
+{
+	void *data;
+	struct sr_datafeed_buffer *buf;
+
+	if (!size)
+		return NULL;
+
+	data = sr_buffer_alloc(NULL, size);
+	if (!data)
+		return NULL;
+
+	buf = sr_datafeed_buffer_new_wrap(data, size, datafeed_buffer_free, NULL);
+	if (!buf)
+		sr_buffer_free(data);
+
+	return buf;
+}
+
+/**
+ * Wrap existing memory in a refcounted datafeed buffer.
+ *
+ * @param data The payload memory. Must not be NULL. Ownership passes
+ *             to the buffer.
+ * @param size The size of the payload memory in bytes.
+ * @param free_cb Callback which releases @a data when the last reference
+ *                is dropped. Can be NULL, in which case g_free() is used.
+ * @param cb_data Opaque pointer passed to @a free_cb.
+ *
+ * @return The new buffer with a refcount of 1, or NULL upon failure.
+ *
+ * @private
+ */
+SR_PRIV struct sr_datafeed_buffer *sr_datafeed_buffer_new_wrap(void *data,
+		size_t size, void (*free_cb)(void *data, void *cb_data),
+		void *cb_data)
+{
+	struct sr_datafeed_buffer *buf;
+
+	if (!data)
+		return NULL;
+
+	buf = g_try_malloc0(sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	buf->refcount = 1;
+	buf->data = data;
+	buf->size = size;
+	buf->free_cb = free_cb;
+	buf->cb_data = cb_data;
+
+	return buf;
+}
+
+/**
+ * Take a reference to a datafeed buffer.
+ *
+ * This may be called from any thread.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @return The buffer, for convenience.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_datafeed_buffer *sr_datafeed_buffer_ref(
+		struct sr_datafeed_buffer *buf)
+{
+	if (!buf)
+		return NULL;
+
+	g_atomic_int_inc(&buf->refcount);
+
+	return buf;
+}
+
+/**
+ * Drop a reference to a datafeed buffer.
+ *
+ * The payload memory is released when the last reference is dropped.
+ * This may be called from any thread.
+ *
+ * @param buf The buffer. NULL is silently ignored.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_datafeed_buffer_unref(struct sr_datafeed_buffer *buf)
+{
+	if (!buf)
+		return;
+
+	if (!g_atomic_int_dec_and_test(&buf->refcount))
+		return;
+
+	if (buf->free_cb)
+		buf->free_cb(buf->data, buf->cb_data);
+	else
+		g_free(buf->data);
+	g_free(buf);
+}
+
+/**
+ * Get the payload memory of a datafeed buffer.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @return The start of the payload memory, or NULL for a NULL buffer.
+ *
+ * @since 0.6.0
+ */
+SR_API void *sr_datafeed_buffer_data(const struct sr_datafeed_buffer *buf)
+{
+	if (!buf)
+		return NULL;
+
+	return buf->data;
+}
+
+/**
+ * Get the size of a datafeed buffer's payload memory.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @return The size in bytes, or 0 for a NULL buffer.
+ *
+ * @since 0.6.0
+ */
+SR_API size_t sr_datafeed_buffer_size(const struct sr_datafeed_buffer *buf)
+{
+	if (!buf)
+		return 0;
+
+	return buf->size;
+}
+
+/**
+ * Check whether references to a datafeed buffer exist besides the
+ * caller's own.
+ *
+ * Drivers use this after sending a packet to determine whether the
+ * buffer's memory can be reused for the next chunk of data.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @return TRUE if other references exist, FALSE otherwise.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_datafeed_buffer_is_shared(
+		const struct sr_datafeed_buffer *buf)
+{
+	return g_atomic_int_get(&buf->refcount) > 1;
 }
 
 /** @} */
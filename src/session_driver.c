@@ -23,6 +23,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <string.h>
 #include <zip.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -34,22 +35,107 @@
 #define CHUNKSIZE (4 * 1024 * 1024)
 /** @endcond */
 
+/* Number of read buffers which consumers can hold on to at a time. */
+#define NUM_READ_BUFFERS 4
+
+/* Time in us which unthrottled replay keeps the main loop busy for. */
+#define UNTHROTTLED_SLICE (100 * 1000)
+
+/* Upper limit for the number of chunks to read ahead. */
+#define MAX_READ_AHEAD 64
+
+/*
+ * Capture data which sits in memory, either a chunk which a worker
+ * thread decompresses ahead of its replay, or stored data in the
+ * mapped session file.
+ */
+struct chunk_job {
+	char *name;
+	uint64_t offset;
+	uint64_t size;
+	struct sr_datafeed_buffer *buf;
+	int status;
+	gboolean done;
+};
+
+/* Where a stored capture file's data is in the mapped session file. */
+struct mapped_entry {
+	uint64_t offset;
+	uint64_t size;
+};
+
+/*
+ * Replay of a capture file: the logic data, or an analog channel's.
+ * The file is either a single one, or a series of numbered chunks.
+ */
+struct replay_stream {
+	char *name;
+	/* The analog channel, NULL for logic data. */
+	struct sr_channel *ch;
+	size_t sample_size;
+	gboolean started;
+	gboolean chunked;
+	gboolean finished;
+	int cur_chunk;
+	/* The chunk which is being read, from the archive or memory. */
+	struct zip_file *capfile;
+	struct chunk_job *job;
+	uint64_t job_pos;
+	/* Chunks which are read ahead, and the next one to queue. */
+	GQueue *jobs;
+	int next_chunk;
+	/* Samples left to skip before playback starts, samples sent. */
+	uint64_t skip_samples;
+	uint64_t samples;
+	/* Analog samples which were read for interleaving, but not sent. */
+	float *stage;
+	size_t stage_size;
+	size_t stage_len;
+};
+
 SR_PRIV struct sr_dev_driver session_driver_info;
 
 struct session_vdev {
 	char *sessionfile;
 	char *capturefile;
 	struct zip *archive;
-	struct zip_file *capfile;
-	int bytes_read;
+	uint64_t bytes_read;
 	uint64_t samplerate;
 	int unitsize;
 	int num_logic_channels;
 	int num_analog_channels;
-	int cur_analog_channel;
-	GArray *analog_channels;
-	int cur_chunk;
+	/* The capture files which get replayed side by side. */
+	struct replay_stream *streams;
+	unsigned int num_streams;
+	unsigned int num_analog_streams;
+	/* Send all analog channels in one packet, while they keep up. */
+	gboolean interleave;
+	gboolean interleaving;
 	gboolean finished;
+	/* Sample number at which playback starts, or at the next edge. */
+	uint64_t start_sample;
+	gboolean seek_edge;
+	/* Read size, and the buffers which are sent downstream. */
+	uint64_t chunk_size;
+	size_t buffer_size;
+	GSList *buffers;
+	/* Replay in a loop, and when it started. */
+	gboolean unthrottled;
+	int64_t start_time;
+	/*
+	 * Read-ahead: the number of chunks, workers which decompress them,
+	 * and an archive handle per worker, as libzip handles must not get
+	 * shared between threads. The chunks get split among the streams.
+	 */
+	uint64_t read_ahead;
+	guint jobs_per_stream;
+	GThreadPool *pool;
+	GAsyncQueue *archives;
+	GMutex mutex;
+	GCond cond;
+	/* The mapped session file, and its stored entries by name. */
+	struct sr_datafeed_buffer *map;
+	GHashTable *map_index;
 };
 
 static const uint32_t devopts[] = {
@@ -59,151 +145,1058 @@ static const uint32_t devopts[] = {
 	SR_CONF_NUM_ANALOG_CHANNELS | SR_CONF_SET,
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_SESSIONFILE | SR_CONF_SET,
+	SR_CONF_CAPTURE_START_SAMPLE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_CHUNK_SIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_UNTHROTTLED | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_READ_AHEAD | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_SEEK_EDGE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_CAPTURE_INTERLEAVE | SR_CONF_GET | SR_CONF_SET,
 };
 
-static gboolean stream_session_data(struct sr_dev_inst *sdi)
+/* Check that a capture file can get decompressed. */
+static gboolean check_capture_file(const struct session_vdev *vdev,
+		const char *name, const struct zip_stat *zs)
+{
+#ifdef HAVE_ZIP_COMPRESSION_METHOD_SUPPORTED
+	if ((zs->valid & ZIP_STAT_COMP_METHOD) &&
+			!zip_compression_method_supported(zs->comp_method, 0)) {
+		sr_err("Capture file '%s' in session file '%s' uses "
+			"compression method %u, which libzip does not support.",
+			name, vdev->sessionfile, zs->comp_method);
+		return FALSE;
+	}
+#else
+	(void)vdev;
+	(void)name;
+	(void)zs;
+#endif
+
+	return TRUE;
+}
+
+/* Open a capture file, after checking that it can get decompressed. */
+static struct zip_file *open_capture_file(struct session_vdev *vdev,
+		const char *name, const struct zip_stat *zs)
+{
+	struct zip_file *zf;
+
+	if (!check_capture_file(vdev, name, zs))
+		return NULL;
+
+	if (!(zf = zip_fopen(vdev->archive, name, 0)))
+		sr_err("Failed to open capture file '%s': %s.",
+			name, zip_strerror(vdev->archive));
+
+	return zf;
+}
+
+/*
+ * Check whether a chunk ends before the start of playback. The archive's
+ * directory has the chunk's size, so it gets skipped without reading or
+ * decompressing any of its data.
+ */
+static gboolean skip_chunk(struct session_vdev *vdev,
+		struct replay_stream *st, const struct zip_stat *zs)
+{
+	uint64_t num_samples;
+
+	if (!st->skip_samples || !st->sample_size || !(zs->valid & ZIP_STAT_SIZE))
+		return FALSE;
+
+	num_samples = zs->size / st->sample_size;
+	if (num_samples > st->skip_samples)
+		return FALSE;
+
+	st->skip_samples -= num_samples;
+	sr_spew("Skipping %s, %" PRIu64 " samples.", zs->name, num_samples);
+
+	return TRUE;
+}
+
+static void free_read_buffers(struct session_vdev *vdev)
+{
+	g_slist_free_full(vdev->buffers,
+		(GDestroyNotify)sr_datafeed_buffer_unref);
+	vdev->buffers = NULL;
+}
+
+/*
+ * Get a buffer to read the next chunk into. Buffers which consumers kept
+ * a reference to must not get overwritten, any other one gets reused.
+ * When consumers hold all of them, the oldest one is left to them.
+ */
+static struct sr_datafeed_buffer *get_read_buffer(struct session_vdev *vdev)
+{
+	struct sr_datafeed_buffer *buf;
+	GSList *l;
+
+	for (l = vdev->buffers; l; l = l->next) {
+		if (!sr_datafeed_buffer_is_shared(l->data))
+			return l->data;
+	}
+
+	if (g_slist_length(vdev->buffers) >= NUM_READ_BUFFERS) {
+		l = g_slist_last(vdev->buffers);
+		sr_datafeed_buffer_unref(l->data);
+		vdev->buffers = g_slist_delete_link(vdev->buffers, l);
+	}
+
+	if (!(buf = sr_datafeed_buffer_new(vdev->buffer_size)))
+		return NULL;
+	vdev->buffers = g_slist_prepend(vdev->buffers, buf);
+
+	return buf;
+}
+
+/*
+ * Determine the size of reads, a multiple of the unit size. In the
+ * absence of a configured size, keep packets at the default size.
+ * Analog channels share the size, so that reading a time slice of
+ * all of them touches as much data as a read of the logic data.
+ */
+static size_t read_size(const struct session_vdev *vdev,
+		const struct replay_stream *st)
+{
+	size_t size;
+
+	size = vdev->chunk_size ? vdev->chunk_size : CHUNKSIZE;
+	if (st->ch && vdev->num_analog_streams > 1)
+		size /= vdev->num_analog_streams;
+	if (st->sample_size && size >= st->sample_size)
+		size -= size % st->sample_size;
+	else if (st->sample_size)
+		size = st->sample_size;
+
+	return size;
+}
+
+static void chunk_job_free(struct chunk_job *job)
+{
+	if (job->buf)
+		sr_datafeed_buffer_unref(job->buf);
+	g_free(job->name);
+	g_free(job);
+}
+
+/* Decompress a chunk in its entirety, using one of the workers' archives. */
+static void read_ahead_run(gpointer data, gpointer user_data)
+{
+	struct chunk_job *job;
+	struct session_vdev *vdev;
+	struct zip *archive;
+	struct zip_file *zf;
+	uint8_t *buf;
+	uint64_t pos;
+	zip_int64_t ret;
+
+	job = data;
+	vdev = user_data;
+
+	archive = g_async_queue_pop(vdev->archives);
+	job->status = SR_ERR;
+	if ((zf = zip_fopen(archive, job->name, 0))) {
+		buf = sr_datafeed_buffer_data(job->buf);
+		pos = 0;
+		while (pos < job->size) {
+			ret = zip_fread(zf, buf + pos, job->size - pos);
+			if (ret <= 0)
+				break;
+			pos += ret;
+		}
+		if (pos == job->size)
+			job->status = SR_OK;
+		zip_fclose(zf);
+	}
+	g_async_queue_push(vdev->archives, archive);
+
+	g_mutex_lock(&vdev->mutex);
+	job->done = TRUE;
+	g_cond_broadcast(&vdev->cond);
+	g_mutex_unlock(&vdev->mutex);
+}
+
+/*
+ * Queue jobs for a capture file's chunks, starting at its current chunk,
+ * until the stream's share of the read-ahead is in flight.
+ */
+static void read_ahead_queue(struct session_vdev *vdev, struct replay_stream *st)
+{
+	struct chunk_job *job;
+	struct zip_stat zs;
+	char *name;
+	guint count;
+
+	g_mutex_lock(&vdev->mutex);
+	count = g_queue_get_length(st->jobs);
+	g_mutex_unlock(&vdev->mutex);
+
+	if (!count)
+		st->next_chunk = st->cur_chunk;
+	while (count < vdev->jobs_per_stream) {
+		name = g_strdup_printf("%s-%d", st->name, st->next_chunk);
+		/* Mapped data needs no decompression. */
+		if (vdev->map_index && g_hash_table_contains(vdev->map_index, name)) {
+			g_free(name);
+			break;
+		}
+		if (zip_stat(vdev->archive, name, 0, &zs) == -1 ||
+				!(zs.valid & ZIP_STAT_SIZE) ||
+				!check_capture_file(vdev, name, &zs)) {
+			g_free(name);
+			break;
+		}
+		job = g_malloc0(sizeof(*job));
+		job->name = name;
+		job->size = zs.size;
+		if (!(job->buf = sr_datafeed_buffer_new(MAX(zs.size, 1)))) {
+			chunk_job_free(job);
+			break;
+		}
+		g_mutex_lock(&vdev->mutex);
+		g_queue_push_tail(st->jobs, job);
+		g_mutex_unlock(&vdev->mutex);
+		if (!g_thread_pool_push(vdev->pool, job, NULL))
+			read_ahead_run(job, vdev);
+		st->next_chunk++;
+		count++;
+	}
+}
+
+/*
+ * Take the job of the chunk which is up for replay, and have the chunks
+ * after it decompressed meanwhile. Returns NULL if the chunk could not
+ * get read ahead, it then gets read on demand.
+ */
+static struct chunk_job *read_ahead_take(struct session_vdev *vdev,
+		struct replay_stream *st, const char *name)
+{
+	struct chunk_job *job;
+
+	if (!vdev->pool)
+		return NULL;
+
+	read_ahead_queue(vdev, st);
+
+	g_mutex_lock(&vdev->mutex);
+	job = g_queue_peek_head(st->jobs);
+	if (job && strcmp(job->name, name) != 0)
+		job = NULL;
+	if (job) {
+		g_queue_pop_head(st->jobs);
+		while (!job->done)
+			g_cond_wait(&vdev->cond, &vdev->mutex);
+	}
+	g_mutex_unlock(&vdev->mutex);
+
+	if (job && job->status != SR_OK) {
+		sr_err("Failed to read capture file '%s'.", name);
+		chunk_job_free(job);
+		return NULL;
+	}
+	if (job)
+		read_ahead_queue(vdev, st);
+
+	return job;
+}
+
+static int read_ahead_start(struct session_vdev *vdev)
+{
+	struct zip *archive;
+	uint64_t i;
+	int ret;
+
+	if (!vdev->read_ahead)
+		return SR_OK;
+
+	vdev->archives = g_async_queue_new();
+	for (i = 0; i < vdev->read_ahead; i++) {
+		if (!(archive = zip_open(vdev->sessionfile, 0, &ret))) {
+			sr_err("Failed to open session file '%s': "
+			       "zip error %d.", vdev->sessionfile, ret);
+			return SR_ERR;
+		}
+		g_async_queue_push(vdev->archives, archive);
+	}
+	vdev->pool = g_thread_pool_new(read_ahead_run, vdev,
+		vdev->read_ahead, TRUE, NULL);
+	if (!vdev->pool)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static void read_ahead_stop(struct session_vdev *vdev)
+{
+	struct zip *archive;
+
+	/* Drop jobs which did not start yet, wait for running ones. */
+	if (vdev->pool)
+		g_thread_pool_free(vdev->pool, TRUE, TRUE);
+	vdev->pool = NULL;
+	if (vdev->archives) {
+		while ((archive = g_async_queue_try_pop(vdev->archives)))
+			zip_discard(archive);
+		g_async_queue_unref(vdev->archives);
+	}
+	vdev->archives = NULL;
+}
+
+static void unref_mapped_file(void *data, void *cb_data)
+{
+	(void)data;
+
+	g_mapped_file_unref(cb_data);
+}
+
+/*
+ * Find the stored entries in a mapped ZIP archive, from its central
+ * directory. Returns a table of the entries' data by name, or NULL if
+ * the archive's structure is not as expected.
+ */
+static GHashTable *map_index_new(const uint8_t *p, uint64_t len)
+{
+	GHashTable *index;
+	struct mapped_entry *entry;
+	const uint8_t *cd, *extra, *extra_end, *field;
+	uint64_t eocd, pos, count, cd_offset, size, comp_size, offset, data;
+	uint16_t method, name_len, extra_len, comment_len, field_len;
+	uint64_t i;
+
+	/* Find the end of central directory record, and the directory. */
+	if (len < 22)
+		return NULL;
+	for (eocd = len - 22; ; eocd--) {
+		if (RL32(p + eocd) == 0x06054b50)
+			break;
+		if (!eocd || len - eocd > 22 + 0xffff)
+			return NULL;
+	}
+	count = RL16(p + eocd + 10);
+	cd_offset = RL32(p + eocd + 16);
+	if (count == 0xffff || cd_offset == 0xffffffff) {
+		if (eocd < 20 || RL32(p + eocd - 20) != 0x07064b50)
+			return NULL;
+		pos = RL64(p + eocd - 20 + 8);
+		if (len < 56 || pos > len - 56 || RL32(p + pos) != 0x06064b50)
+			return NULL;
+		count = RL64(p + pos + 32);
+		cd_offset = RL64(p + pos + 48);
+	}
+
+	index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	pos = cd_offset;
+	for (i = 0; i < count; i++) {
+		if (pos > len || len - pos < 46 || RL32(p + pos) != 0x02014b50)
+			break;
+		cd = p + pos;
+		method = RL16(cd + 10);
+		comp_size = RL32(cd + 20);
+		size = RL32(cd + 24);
+		name_len = RL16(cd + 28);
+		extra_len = RL16(cd + 30);
+		comment_len = RL16(cd + 32);
+		offset = RL32(cd + 42);
+		if (len - pos < 46ULL + name_len + extra_len + comment_len)
+			break;
+		pos += 46 + name_len + extra_len + comment_len;
+
+		/* The ZIP64 extra field has the values which don't fit. */
+		extra = cd + 46 + name_len;
+		extra_end = extra + extra_len;
+		while (extra + 4 <= extra_end) {
+			field_len = RL16(extra + 2);
+			if (RL16(extra) != 0x0001 || extra + 4 + field_len > extra_end) {
+				extra += 4 + field_len;
+				continue;
+			}
+			field = extra + 4;
+			if (size == 0xffffffff && field + 8 <= extra_end) {
+				size = RL64(field);
+				field += 8;
+			}
+			if (comp_size == 0xffffffff && field + 8 <= extra_end) {
+				comp_size = RL64(field);
+				field += 8;
+			}
+			if (offset == 0xffffffff && field + 8 <= extra_end)
+				offset = RL64(field);
+			break;
+		}
+
+		/* Use stored data only, at the place its local header says. */
+		if (method != 0 || comp_size != size)
+			continue;
+		if (offset > len || len - offset < 30 || RL32(p + offset) != 0x04034b50)
+			continue;
+		data = offset + 30 + RL16(p + offset + 26) + RL16(p + offset + 28);
+		if (data > len || len - data < size)
+			continue;
+
+		entry = g_malloc(sizeof(*entry));
+		entry->offset = data;
+		entry->size = size;
+		g_hash_table_insert(index,
+			g_strndup((const char *)cd + 46, name_len), entry);
+	}
+
+	return index;
+}
+
+/*
+ * Map the session file, to send stored capture data from where it is
+ * in the file. Leaves everything to the ZIP reader when mapping fails.
+ */
+static void map_session_file(struct session_vdev *vdev)
+{
+	GMappedFile *mf;
+	GError *error;
+	const uint8_t *contents;
+	uint64_t len;
+
+	error = NULL;
+	if (!(mf = sr_file_map(vdev->sessionfile, &error))) {
+		sr_dbg("Cannot map session file: %s.", error->message);
+		g_error_free(error);
+		return;
+	}
+	contents = (const uint8_t *)g_mapped_file_get_contents(mf);
+	len = g_mapped_file_get_length(mf);
+	if (!contents || !(vdev->map_index = map_index_new(contents, len))) {
+		g_mapped_file_unref(mf);
+		return;
+	}
+	if (!g_hash_table_size(vdev->map_index)) {
+		g_hash_table_destroy(vdev->map_index);
+		vdev->map_index = NULL;
+		g_mapped_file_unref(mf);
+		return;
+	}
+
+	vdev->map = sr_datafeed_buffer_new_wrap((void *)contents, len,
+		unref_mapped_file, mf);
+	if (!vdev->map) {
+		g_hash_table_destroy(vdev->map_index);
+		vdev->map_index = NULL;
+		g_mapped_file_unref(mf);
+		return;
+	}
+	sr_dbg("Mapped session file, %u stored entries.",
+		g_hash_table_size(vdev->map_index));
+}
+
+static void unmap_session_file(struct session_vdev *vdev)
+{
+	if (vdev->map_index)
+		g_hash_table_destroy(vdev->map_index);
+	vdev->map_index = NULL;
+	/* Consumers may keep the mapping referenced beyond this point. */
+	if (vdev->map)
+		sr_datafeed_buffer_unref(vdev->map);
+	vdev->map = NULL;
+}
+
+/* Get a capture file's stored data from the mapped session file. */
+static struct chunk_job *map_take(struct session_vdev *vdev,
+		const struct replay_stream *st, const char *name)
+{
+	struct mapped_entry *entry;
+	struct chunk_job *job;
+
+	if (!vdev->map_index || !(entry = g_hash_table_lookup(vdev->map_index, name)))
+		return NULL;
+	/* Analog data gets accessed as floats. */
+	if (st->ch && entry->offset % sizeof(float))
+		return NULL;
+	if (entry->size > G_MAXINT)
+		return NULL;
+
+	job = g_malloc0(sizeof(*job));
+	job->name = g_strdup(name);
+	job->offset = entry->offset;
+	job->size = entry->size;
+	job->buf = sr_datafeed_buffer_ref(vdev->map);
+	job->status = SR_OK;
+	job->done = TRUE;
+
+	return job;
+}
+
+/* Open a capture file's data, from memory if it is there or read ahead. */
+static int open_chunk(struct session_vdev *vdev, struct replay_stream *st,
+		const char *name, const struct zip_stat *zs)
+{
+	st->job_pos = 0;
+	if ((st->job = map_take(vdev, st, name)) ||
+			(st->job = read_ahead_take(vdev, st, name))) {
+		sr_dbg("Took %s from memory.", name);
+		return SR_OK;
+	}
+	if (!(st->capfile = open_capture_file(vdev, name, zs)))
+		return SR_ERR;
+	sr_dbg("Opened %s.", name);
+
+	return SR_OK;
+}
+
+static void close_chunk(struct replay_stream *st)
+{
+	if (st->job)
+		chunk_job_free(st->job);
+	st->job = NULL;
+	if (st->capfile)
+		zip_fclose(st->capfile);
+	st->capfile = NULL;
+}
+
+/*
+ * Open a stream's next chunk, or its single capture file, when it
+ * has none open. Marks the stream finished after its last chunk.
+ */
+static int open_stream(struct session_vdev *vdev, struct replay_stream *st)
+{
+	struct zip_stat zs;
+	char *name;
+	int ret;
+
+	if (st->finished || st->capfile || st->job)
+		return SR_OK;
+
+	if (!st->started) {
+		st->started = TRUE;
+		/* The name is the unchunked file, or the chunks' base name. */
+		if (zip_stat(vdev->archive, st->name, 0, &zs) != -1)
+			return open_chunk(vdev, st, st->name, &zs);
+		name = g_strdup_printf("%s-1", st->name);
+		ret = zip_stat(vdev->archive, name, 0, &zs);
+		g_free(name);
+		if (ret == -1) {
+			sr_err("No capture file '%s' in session file '%s'.",
+				st->name, vdev->sessionfile);
+			return SR_ERR;
+		}
+		st->chunked = TRUE;
+	}
+	if (!st->chunked) {
+		st->finished = TRUE;
+		return SR_OK;
+	}
+
+	for (;;) {
+		st->cur_chunk++;
+		name = g_strdup_printf("%s-%d", st->name, st->cur_chunk);
+		if (zip_stat(vdev->archive, name, 0, &zs) == -1) {
+			/* We got all the chunks. */
+			g_free(name);
+			st->finished = TRUE;
+			return SR_OK;
+		}
+		if (skip_chunk(vdev, st, &zs)) {
+			g_free(name);
+			continue;
+		}
+		ret = open_chunk(vdev, st, name, &zs);
+		g_free(name);
+		return ret;
+	}
+}
+
+/* Read the edge index of the logic data, which srzip writes. */
+static uint8_t *read_edge_index(struct session_vdev *vdev, uint64_t *size)
+{
+	struct zip_stat zs;
+	struct zip_file *zf;
+	char *name;
+	uint8_t *index;
+	zip_int64_t len;
+
+	name = g_strdup_printf("index-%s", vdev->capturefile);
+	index = NULL;
+	if (zip_stat(vdev->archive, name, 0, &zs) != -1
+			&& (zf = zip_fopen_index(vdev->archive, zs.index, 0))) {
+		index = g_try_malloc(MAX(zs.size, 1));
+		len = index ? zip_fread(zf, index, zs.size) : -1;
+		zip_fclose(zf);
+		if (len < 0 || (uint64_t)len != zs.size) {
+			g_free(index);
+			index = NULL;
+		}
+		*size = zs.size;
+	}
+	g_free(name);
+
+	return index;
+}
+
+/*
+ * Determine where playback starts when it seeks to edges: at the start
+ * sample if an enabled logic channel changes in its chunk, else at the
+ * start of the next chunk in which one does. Chunks' sample counts are
+ * taken from the archive's directory, without reading any of them.
+ */
+static uint64_t seek_edge(const struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct sr_channel *ch;
+	struct zip_stat zs;
+	uint64_t index_size, pos, num_samples;
+	uint8_t *index, *mask;
+	const uint8_t *edges;
+	char *name;
+	GSList *l;
+	int chunk, i;
+	gboolean found;
+
+	vdev = sdi->priv;
+	if (!vdev->capturefile || vdev->unitsize <= 0)
+		return vdev->start_sample;
+	if (!(index = read_edge_index(vdev, &index_size))) {
+		sr_warn("No edge index in session file '%s', playback starts "
+			"at sample %" PRIu64 ".", vdev->sessionfile,
+			vdev->start_sample);
+		return vdev->start_sample;
+	}
+
+	mask = g_malloc0(vdev->unitsize);
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+			continue;
+		if (ch->index < vdev->unitsize * 8)
+			mask[ch->index / 8] |= 1 << (ch->index % 8);
+	}
+
+	pos = 0;
+	found = FALSE;
+	for (chunk = 1; !found; chunk++) {
+		name = g_strdup_printf("%s-%d", vdev->capturefile, chunk);
+		if (zip_stat(vdev->archive, name, 0, &zs) == -1) {
+			/* No more chunks, nothing to play back. */
+			g_free(name);
+			break;
+		}
+		g_free(name);
+		if ((uint64_t)chunk * vdev->unitsize > index_size) {
+			/* The index doesn't cover this chunk, play it back. */
+			found = TRUE;
+			break;
+		}
+		num_samples = zs.size / vdev->unitsize;
+		if (pos + num_samples > vdev->start_sample) {
+			edges = index + (chunk - 1) * vdev->unitsize;
+			for (i = 0; i < vdev->unitsize; i++) {
+				if (edges[i] & mask[i])
+					found = TRUE;
+			}
+		}
+		if (!found)
+			pos += num_samples;
+	}
+	g_free(mask);
+	g_free(index);
+
+	pos = MAX(pos, vdev->start_sample);
+	if (found)
+		sr_dbg("Seeking to edges, playback starts at sample %" PRIu64 ".",
+			pos);
+	else
+		sr_info("No edges after sample %" PRIu64 ".", vdev->start_sample);
+
+	return pos;
+}
+
+/*
+ * Set up a stream for the logic data, and one for each analog channel.
+ * Analog channels' capture files are numbered after the logic channels.
+ */
+static void create_streams(const struct sr_dev_inst *sdi)
 {
 	struct session_vdev *vdev;
+	struct replay_stream *st;
+	struct sr_channel *ch;
+	GSList *l;
+	unsigned int num_analog;
+	uint64_t start_sample;
+
+	vdev = sdi->priv;
+	vdev->streams = g_malloc0(sizeof(*vdev->streams)
+		* (1 + vdev->num_analog_channels));
+	vdev->num_streams = 0;
+
+	if (vdev->capturefile) {
+		st = &vdev->streams[vdev->num_streams++];
+		st->name = g_strdup(vdev->capturefile);
+		st->sample_size = vdev->unitsize;
+	}
+	num_analog = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_ANALOG)
+			continue;
+		if (num_analog >= (unsigned int)vdev->num_analog_channels)
+			break;
+		st = &vdev->streams[vdev->num_streams++];
+		st->name = g_strdup_printf("analog-1-%d",
+			vdev->num_logic_channels + num_analog + 1);
+		st->ch = ch;
+		st->sample_size = sizeof(float);
+		num_analog++;
+	}
+	vdev->num_analog_streams = num_analog;
+
+	/* Interleaving takes a read of each analog channel at a time. */
+	vdev->interleaving = vdev->interleave && num_analog > 1;
+	for (st = vdev->streams; st < vdev->streams + vdev->num_streams; st++) {
+		if (!vdev->interleaving || !st->ch)
+			continue;
+		st->stage_size = read_size(vdev, st) / sizeof(float);
+		st->stage = g_malloc(st->stage_size * sizeof(float));
+	}
+
+	start_sample = vdev->seek_edge ? seek_edge(sdi) : vdev->start_sample;
+	for (st = vdev->streams; st < vdev->streams + vdev->num_streams; st++) {
+		st->jobs = g_queue_new();
+		st->skip_samples = start_sample;
+	}
+	vdev->jobs_per_stream = vdev->num_streams ?
+		MAX(1, vdev->read_ahead / vdev->num_streams) : 0;
+}
+
+static void free_streams(struct session_vdev *vdev)
+{
+	struct replay_stream *st;
+
+	for (st = vdev->streams; st < vdev->streams + vdev->num_streams; st++) {
+		close_chunk(st);
+		g_queue_free_full(st->jobs, (GDestroyNotify)chunk_job_free);
+		g_free(st->name);
+		g_free(st->stage);
+	}
+	g_free(vdev->streams);
+	vdev->streams = NULL;
+	vdev->num_streams = 0;
+	vdev->num_analog_streams = 0;
+	vdev->interleaving = FALSE;
+}
+
+/*
+ * Pick the stream which is the furthest behind in time, so that the
+ * logic data and all analog channels of a time window arrive together.
+ */
+static struct replay_stream *next_stream(struct session_vdev *vdev)
+{
+	struct replay_stream *st, *next;
+
+	next = NULL;
+	for (st = vdev->streams; st < vdev->streams + vdev->num_streams; st++) {
+		if (st->finished && !st->stage_len)
+			continue;
+		if (!next || st->samples < next->samples)
+			next = st;
+	}
+
+	return next;
+}
+
+/* Send analog samples of the given channels, interleaved. */
+static void send_analog(const struct sr_dev_inst *sdi, GSList *channels,
+		float *data, uint64_t num_samples, struct sr_datafeed_buffer *buf)
+{
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
-	struct zip_stat zs;
-	int ret, got_data;
-	char capturefile[128];
-	void *buf;
 
-	got_data = FALSE;
-	vdev = sdi->priv;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	/* TODO: Use proper 'digits' value for this device (and its modes). */
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	analog.meaning->channels = channels;
+	analog.num_samples = num_samples;
+	analog.meaning->mq = SR_MQ_VOLTAGE;
+	analog.meaning->unit = SR_UNIT_VOLT;
+	analog.meaning->mqflags = SR_MQFLAG_DC;
+	analog.data = data;
+	sr_session_send_buffer(sdi, &packet, buf);
+}
 
-	if (!vdev->capfile) {
-		/* No capture file opened yet, or finished with the last
-		 * chunked one. */
-		if (vdev->capturefile && (vdev->cur_chunk == 0)) {
-			/* capturefile is always the unchunked base name. */
-			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
-				/* No chunks, just a single capture file. */
-				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", vdev->capturefile);
-			} else {
-				/* Try as first chunk filename. */
-				snprintf(capturefile, sizeof(capturefile) - 1, "%s-1", vdev->capturefile);
-				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
-						return FALSE;
-					sr_dbg("Opened %s.", capturefile);
-				} else {
-					sr_err("No capture file '%s' in " "session file '%s'.",
-							vdev->capturefile, vdev->sessionfile);
-					return FALSE;
-				}
-			}
+/*
+ * Read up to 'size' bytes of a stream's samples, across its chunks.
+ * Returns the number of bytes read, less at the end of the stream,
+ * or -1 on errors.
+ */
+static int64_t stream_read(struct session_vdev *vdev, struct replay_stream *st,
+		uint8_t *dst, size_t size)
+{
+	const uint8_t *src;
+	size_t pos, skip;
+	int64_t ret;
+
+	pos = 0;
+	while (pos < size) {
+		if (open_stream(vdev, st) != SR_OK)
+			return -1;
+		if (st->finished)
+			break;
+		if (st->job) {
+			src = (const uint8_t *)sr_datafeed_buffer_data(st->job->buf)
+				+ st->job->offset + st->job_pos;
+			ret = MIN(size - pos, st->job->size - st->job_pos);
+			memcpy(dst + pos, src, ret);
+			st->job_pos += ret;
 		} else {
-			/* Capture data is chunked, advance to the next chunk. */
-			vdev->cur_chunk++;
-			snprintf(capturefile, sizeof(capturefile) - 1, "%s-%d", vdev->capturefile,
-					vdev->cur_chunk);
-			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", capturefile);
-			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
-				vdev->capturefile = g_strdup_printf("analog-1-%d",
-						vdev->num_logic_channels + vdev->cur_analog_channel + 1);
-				vdev->cur_analog_channel++;
-				vdev->cur_chunk = 0;
-				return TRUE;
-			} else {
-				/* We got all the chunks, finish up. */
-				g_free(vdev->capturefile);
-
-				/* If the file has logic channels, the initial value for
-				 * capturefile is set by stream_session_data() - however only
-				 * once. In order to not mess this mechanism up, we simulate
-				 * this here if needed. For purely analog files, capturefile
-				 * is not set.
-				 */
-				if (vdev->num_logic_channels)
-					vdev->capturefile = g_strdup("logic-1");
-				else
-					vdev->capturefile = NULL;
+			ret = zip_fread(st->capfile, dst + pos, size - pos);
+		}
+		if (ret <= 0) {
+			close_chunk(st);
+			continue;
+		}
+		vdev->bytes_read += ret;
+		if (st->skip_samples) {
+			skip = MIN(st->skip_samples, (uint64_t)ret / st->sample_size);
+			st->skip_samples -= skip;
+			ret -= skip * st->sample_size;
+			memmove(dst + pos, dst + pos + skip * st->sample_size, ret);
+		}
+		pos += ret;
+	}
+
+	return pos;
+}
+
+/* Send a stream's staged samples, once interleaving has ended. */
+static gboolean send_staged(struct sr_dev_inst *sdi, struct replay_stream *st)
+{
+	struct sr_datafeed_buffer *buf;
+	GSList *channels;
+	float *data;
+
+	if (!(buf = sr_datafeed_buffer_new(st->stage_len * sizeof(float)))) {
+		sr_err("Failed to allocate analog buffer.");
+		return FALSE;
+	}
+	data = sr_datafeed_buffer_data(buf);
+	memcpy(data, st->stage, st->stage_len * sizeof(float));
+	channels = g_slist_prepend(NULL, st->ch);
+	send_analog(sdi, channels, data, st->stage_len, buf);
+	g_slist_free(channels);
+	sr_datafeed_buffer_unref(buf);
+	st->samples += st->stage_len;
+	st->stage_len = 0;
+
+	return TRUE;
+}
+
+/*
+ * Send a time slice of all analog channels in one packet, the samples
+ * interleaved. The channels' reads are staged, samples of channels
+ * which got ahead of others are kept for the next slice. Interleaving
+ * ends when a channel has no more samples, the others then continue
+ * one by one.
+ */
+static gboolean stream_interleaved(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct replay_stream *st, **analog;
+	struct sr_datafeed_buffer *buf;
+	GSList *channels;
+	float *data;
+	size_t count, i, j;
+	unsigned int n;
+	int64_t ret;
+
+	vdev = sdi->priv;
+
+	analog = g_malloc(sizeof(*analog) * vdev->num_analog_streams);
+	channels = NULL;
+	count = SIZE_MAX;
+	n = 0;
+	for (st = vdev->streams; st < vdev->streams + vdev->num_streams; st++) {
+		if (!st->ch)
+			continue;
+		if (st->stage_len < st->stage_size) {
+			ret = stream_read(vdev, st, (uint8_t *)(st->stage + st->stage_len),
+				(st->stage_size - st->stage_len) * sizeof(float));
+			if (ret < 0) {
+				g_slist_free(channels);
+				g_free(analog);
 				return FALSE;
 			}
+			st->stage_len += ret / sizeof(float);
 		}
+		count = MIN(count, st->stage_len);
+		analog[n++] = st;
+		channels = g_slist_append(channels, st->ch);
 	}
 
-	buf = g_malloc(CHUNKSIZE);
+	if (!count) {
+		sr_dbg("Analog channels ended, no more interleaving.");
+		vdev->interleaving = FALSE;
+		g_slist_free(channels);
+		g_free(analog);
+		return TRUE;
+	}
 
-	/* unitsize is not defined for purely analog session files. */
-	if (vdev->unitsize)
-		ret = zip_fread(vdev->capfile, buf,
-				CHUNKSIZE / vdev->unitsize * vdev->unitsize);
-	else
-		ret = zip_fread(vdev->capfile, buf, CHUNKSIZE);
-
-	if (ret > 0) {
-		if (vdev->cur_analog_channel != 0) {
-			got_data = TRUE;
-			packet.type = SR_DF_ANALOG;
-			packet.payload = &analog;
-			/* TODO: Use proper 'digits' value for this device (and its modes). */
-			sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
-			analog.meaning->channels = g_slist_prepend(NULL,
-					g_array_index(vdev->analog_channels,
-						struct sr_channel *, vdev->cur_analog_channel - 1));
-			analog.num_samples = ret / sizeof(float);
-			analog.meaning->mq = SR_MQ_VOLTAGE;
-			analog.meaning->unit = SR_UNIT_VOLT;
-			analog.meaning->mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
-		} else if (vdev->unitsize) {
-			got_data = TRUE;
-			if (ret % vdev->unitsize != 0)
-				sr_warn("Read size %d not a multiple of the"
-					" unit size %d.", ret, vdev->unitsize);
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = ret;
-			logic.unitsize = vdev->unitsize;
-			logic.data = buf;
-		} else {
-			/*
-			 * Neither analog data, nor logic which has
-			 * unitsize, must be an unexpected API use.
-			 */
-			sr_warn("Neither analog nor logic data. Ignoring.");
+	if (!(buf = sr_datafeed_buffer_new(count * n * sizeof(float)))) {
+		sr_err("Failed to allocate analog buffer.");
+		g_slist_free(channels);
+		g_free(analog);
+		return FALSE;
+	}
+	data = sr_datafeed_buffer_data(buf);
+	for (j = 0; j < n; j++) {
+		st = analog[j];
+		for (i = 0; i < count; i++)
+			data[i * n + j] = st->stage[i];
+		st->stage_len -= count;
+		memmove(st->stage, st->stage + count,
+			st->stage_len * sizeof(float));
+		st->samples += count;
+	}
+	send_analog(sdi, channels, data, count, buf);
+	sr_datafeed_buffer_unref(buf);
+	g_slist_free(channels);
+	g_free(analog);
+
+	return TRUE;
+}
+
+static gboolean stream_session_data(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct replay_stream *st;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_buffer *rdbuf;
+	GSList *channels;
+	uint8_t *buf, *data;
+	size_t size;
+	uint64_t skip;
+	int ret, len;
+
+	vdev = sdi->priv;
+
+	/* Get the next stream in time which has data. */
+	for (;;) {
+		if (!(st = next_stream(vdev)))
+			return FALSE;
+		if (st->ch && vdev->interleaving)
+			return stream_interleaved(sdi);
+		if (st->stage_len)
+			return send_staged(sdi, st);
+		if (open_stream(vdev, st) != SR_OK)
+			return FALSE;
+		if (!st->finished)
+			break;
+	}
+
+	size = read_size(vdev, st);
+	if (st->job) {
+		/* Send slices of the in-memory chunk as they are. */
+		rdbuf = st->job->buf;
+		buf = (uint8_t *)sr_datafeed_buffer_data(rdbuf)
+			+ st->job->offset + st->job_pos;
+		ret = MIN(size, st->job->size - st->job_pos);
+		st->job_pos += ret;
+	} else {
+		if (size > vdev->buffer_size) {
+			free_read_buffers(vdev);
+			vdev->buffer_size = size;
 		}
-		if (got_data) {
-			vdev->bytes_read += ret;
-			sr_session_send(sdi, &packet);
+		if (!(rdbuf = get_read_buffer(vdev))) {
+			sr_err("Failed to allocate read buffer.");
+			return FALSE;
 		}
+		buf = sr_datafeed_buffer_data(rdbuf);
+		ret = zip_fread(st->capfile, buf, size);
+	}
+
+	if (ret <= 0) {
+		/* Done with this capture file, there may be more chunks. */
+		close_chunk(st);
+		return TRUE;
+	}
+
+	/* Drop the samples before the start of playback. */
+	data = buf;
+	len = ret;
+	if (st->skip_samples && st->sample_size) {
+		skip = MIN(st->skip_samples, (uint64_t)ret / st->sample_size);
+		st->skip_samples -= skip;
+		data += skip * st->sample_size;
+		len -= skip * st->sample_size;
+	}
+	vdev->bytes_read += ret;
+	if (!len)
+		return TRUE;
+
+	if (st->ch) {
+		channels = g_slist_prepend(NULL, st->ch);
+		send_analog(sdi, channels, (float *)data, len / sizeof(float), rdbuf);
+		g_slist_free(channels);
+		st->samples += len / sizeof(float);
+	} else if (st->sample_size) {
+		if (len % st->sample_size != 0)
+			sr_warn("Read size %d not a multiple of the"
+				" unit size %zu.", len, st->sample_size);
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = len;
+		logic.unitsize = st->sample_size;
+		logic.data = data;
+		st->samples += len / st->sample_size;
+		sr_session_send_buffer(sdi, &packet, rdbuf);
 	} else {
-		/* done with this capture file */
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-		if (vdev->cur_chunk != 0) {
-			/* There might be more chunks, so don't fall through
-			 * to the SR_DF_END here. */
-			got_data = TRUE;
-		}
+		/*
+		 * Neither analog data, nor logic which has
+		 * unitsize, must be an unexpected API use.
+		 */
+		sr_warn("Neither analog nor logic data. Ignoring.");
+		st->finished = TRUE;
+		close_chunk(st);
+	}
+
+	return TRUE;
+}
+
+/* Release everything which replay of the session file used. */
+static void stop_replay(struct session_vdev *vdev)
+{
+	read_ahead_stop(vdev);
+	free_streams(vdev);
+	unmap_session_file(vdev);
+	if (vdev->archive) {
+		zip_discard(vdev->archive);
+		vdev->archive = NULL;
 	}
-	g_free(buf);
+	free_read_buffers(vdev);
+}
+
+/* Log the throughput of the replay, and the datafeed callbacks' share. */
+static void log_replay_stats(const struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct sr_session_stats stats;
+	double elapsed;
+
+	vdev = sdi->priv;
+	elapsed = (g_get_monotonic_time() - vdev->start_time) / 1e6;
+	if (elapsed <= 0)
+		return;
 
-	return got_data;
+	sr_info("Replayed %" PRIu64 " bytes in %.3f s, %.1f MB/s.",
+		vdev->bytes_read, elapsed, vdev->bytes_read / elapsed / 1e6);
+	if (sdi->session->stats_enabled &&
+			sr_session_stats_get(sdi->session, &stats) == SR_OK)
+		sr_info("Datafeed callbacks took %.3f s, transforms %.3f s.",
+			stats.callback_time / 1e6, stats.transform_time / 1e6);
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct session_vdev *vdev;
+	int64_t deadline;
 
 	(void)fd;
 	(void)revents;
@@ -211,19 +1204,22 @@ static int receive_data(int fd, int revents, void *cb_data)
 	sdi = cb_data;
 	vdev = sdi->priv;
 
-	if (!vdev->finished && !stream_session_data(sdi))
-		vdev->finished = TRUE;
+	/*
+	 * Unthrottled replay reads chunk after chunk, and only returns to
+	 * the main loop now and then to have other sources serviced.
+	 */
+	deadline = g_get_monotonic_time() + UNTHROTTLED_SLICE;
+	while (!vdev->finished) {
+		if (!stream_session_data(sdi))
+			vdev->finished = TRUE;
+		if (!vdev->unthrottled || g_get_monotonic_time() >= deadline)
+			break;
+	}
 	if (!vdev->finished)
 		return G_SOURCE_CONTINUE;
 
-	if (vdev->capfile) {
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-	}
-	if (vdev->archive) {
-		zip_discard(vdev->archive);
-		vdev->archive = NULL;
-	}
+	log_replay_stats(sdi);
+	stop_replay(vdev);
 
 	std_session_send_df_end(sdi);
 
@@ -241,6 +1237,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	di = sdi->driver;
 	drvc = di->context;
 	vdev = g_malloc0(sizeof(struct session_vdev));
+	g_mutex_init(&vdev->mutex);
+	g_cond_init(&vdev->cond);
 	sdi->priv = vdev;
 	drvc->instances = g_slist_append(drvc->instances, sdi);
 
@@ -249,7 +1247,11 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
-	const struct session_vdev *const vdev = sdi->priv;
+	struct session_vdev *vdev = sdi->priv;
+
+	stop_replay(vdev);
+	g_cond_clear(&vdev->cond);
+	g_mutex_clear(&vdev->mutex);
 	g_free(vdev->sessionfile);
 	g_free(vdev->capturefile);
 
@@ -278,6 +1280,24 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_UNITSIZE:
 		*data = g_variant_new_uint64(vdev->unitsize);
 		break;
+	case SR_CONF_CAPTURE_START_SAMPLE:
+		*data = g_variant_new_uint64(vdev->start_sample);
+		break;
+	case SR_CONF_CAPTURE_CHUNK_SIZE:
+		*data = g_variant_new_uint64(vdev->chunk_size);
+		break;
+	case SR_CONF_CAPTURE_UNTHROTTLED:
+		*data = g_variant_new_boolean(vdev->unthrottled);
+		break;
+	case SR_CONF_CAPTURE_READ_AHEAD:
+		*data = g_variant_new_uint64(vdev->read_ahead);
+		break;
+	case SR_CONF_CAPTURE_SEEK_EDGE:
+		*data = g_variant_new_boolean(vdev->seek_edge);
+		break;
+	case SR_CONF_CAPTURE_INTERLEAVE:
+		*data = g_variant_new_boolean(vdev->interleave);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -318,6 +1338,28 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_NUM_ANALOG_CHANNELS:
 		vdev->num_analog_channels = g_variant_get_int32(data);
 		break;
+	case SR_CONF_CAPTURE_START_SAMPLE:
+		vdev->start_sample = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_CAPTURE_CHUNK_SIZE:
+		if (g_variant_get_uint64(data) > G_MAXINT)
+			return SR_ERR_ARG;
+		vdev->chunk_size = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_CAPTURE_UNTHROTTLED:
+		vdev->unthrottled = g_variant_get_boolean(data);
+		break;
+	case SR_CONF_CAPTURE_READ_AHEAD:
+		if (g_variant_get_uint64(data) > MAX_READ_AHEAD)
+			return SR_ERR_ARG;
+		vdev->read_ahead = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_CAPTURE_SEEK_EDGE:
+		vdev->seek_edge = g_variant_get_boolean(data);
+		break;
+	case SR_CONF_CAPTURE_INTERLEAVE:
+		vdev->interleave = g_variant_get_boolean(data);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -335,20 +1377,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
 	struct session_vdev *vdev;
 	int ret;
-	GSList *l;
-	struct sr_channel *ch;
 
 	vdev = sdi->priv;
 	vdev->bytes_read = 0;
-	vdev->cur_analog_channel = 0;
-	vdev->analog_channels = g_array_sized_new(FALSE, FALSE,
-			sizeof(struct sr_channel *), vdev->num_analog_channels);
-	for (l = sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type == SR_CHANNEL_ANALOG)
-			g_array_append_val(vdev->analog_channels, ch);
-	}
-	vdev->cur_chunk = 0;
+	vdev->start_time = g_get_monotonic_time();
 	vdev->finished = FALSE;
 
 	sr_info("Opening archive %s file %s", vdev->sessionfile,
@@ -360,6 +1392,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	create_streams(sdi);
+	map_session_file(vdev);
+	if (read_ahead_start(vdev) != SR_OK) {
+		sr_warn("Reading chunks on demand.");
+		read_ahead_stop(vdev);
+	}
+
 	std_session_send_df_header(sdi);
 
 	/* freewheeling source */
@@ -0,0 +1,668 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <zip.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-export"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Converting session files with an output module, on several threads.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+/* Segments which are converted or wait for their turn, per thread. */
+#define SEGMENTS_PER_THREAD 2
+
+/*
+ * Most capture data a segment may span, which bounds the size of its
+ * text. Captures which can't be split up finer get converted serially.
+ */
+#define MAX_SEGMENT_SIZE (64 * 1024 * 1024)
+
+/*
+ * A chunk of the capture: the logic data's, or all analog channels'
+ * chunks of the same number, which hold the same number of samples.
+ * Number 0 is a capture file which is not split into chunks.
+ */
+struct export_chunk {
+	int number;
+	uint64_t size;
+};
+
+/* A run of chunks which an output instance of its own converts. */
+struct export_segment {
+	unsigned int first_chunk;
+	unsigned int num_chunks;
+	uint64_t start;
+	const struct sr_output *o;
+	GString *text;
+	int status;
+	gboolean done;
+};
+
+struct export_context {
+	const char *filename;
+	const struct sr_output_module *omod;
+	GHashTable *options;
+	const struct sr_dev_inst *sdi;
+	uint64_t samplerate;
+	struct timeval starttime;
+	/* The capture files, and the analog channels (NULL for logic). */
+	unsigned int num_streams;
+	char **stream_names;
+	struct sr_channel **stream_channels;
+	size_t sample_size;
+	GArray *chunks;
+	GArray *segments;
+	/* An archive handle per worker, libzip handles are not shared. */
+	GAsyncQueue *archives;
+	GMutex mutex;
+	GCond cond;
+};
+
+struct export_playback {
+	const struct sr_output *o;
+	struct sr_file_writer *fw;
+	int status;
+};
+/** @endcond */
+
+/*
+ * Find the chunks of the capture files. All streams must have chunks of
+ * the same numbers and sizes, or the capture can't be split up.
+ */
+static int find_chunks(struct export_context *ec, struct zip *archive)
+{
+	struct export_chunk chunk;
+	struct zip_stat zs;
+	unsigned int i;
+	uint64_t size;
+	char *name;
+	int number;
+
+	for (number = 1; ; number++) {
+		size = 0;
+		for (i = 0; i < ec->num_streams; i++) {
+			name = g_strdup_printf("%s-%d", ec->stream_names[i], number);
+			if (zip_stat(archive, name, 0, &zs) < 0
+					|| !(zs.valid & ZIP_STAT_SIZE)) {
+				g_free(name);
+				if (i == 0)
+					break;
+				return SR_ERR_NA;
+			}
+			g_free(name);
+			if (i > 0 && zs.size != size)
+				return SR_ERR_NA;
+			size = zs.size;
+		}
+		if (i < ec->num_streams)
+			break;
+		chunk.number = number;
+		chunk.size = size;
+		g_array_append_val(ec->chunks, chunk);
+	}
+	if (ec->chunks->len)
+		return SR_OK;
+
+	/* Capture files which are not split into chunks. */
+	size = 0;
+	for (i = 0; i < ec->num_streams; i++) {
+		if (zip_stat(archive, ec->stream_names[i], 0, &zs) < 0
+				|| !(zs.valid & ZIP_STAT_SIZE))
+			return SR_ERR_NA;
+		if (i > 0 && zs.size != size)
+			return SR_ERR_NA;
+		size = zs.size;
+	}
+	chunk.number = 0;
+	chunk.size = size;
+	g_array_append_val(ec->chunks, chunk);
+
+	return SR_OK;
+}
+
+/*
+ * Work out which capture files to convert, from the session file's
+ * metadata. Only files which hold either logic data or analog data of
+ * a single device can get split up.
+ */
+static int plan_export(struct export_context *ec)
+{
+	struct sr_session_file_info *info;
+	struct zip *archive;
+	struct zip_stat zs;
+	struct sr_channel *ch;
+	GKeyFile *kf;
+	GSList *l;
+	char *capturefile;
+	unsigned int i;
+	int ret;
+
+	if ((ret = sr_session_file_info_get(ec->filename, &info)) != SR_OK)
+		return ret;
+	ec->samplerate = info->samplerate;
+
+	if (!(archive = zip_open(ec->filename, 0, NULL))) {
+		sr_session_file_info_free(info);
+		return SR_ERR;
+	}
+	kf = NULL;
+	if (zip_stat(archive, "metadata", 0, &zs) == 0)
+		kf = sr_sessionfile_read_metadata(archive, &zs);
+
+	ret = SR_ERR_NA;
+	capturefile = NULL;
+	if (kf && !g_key_file_has_group(kf, "device 2"))
+		capturefile = g_key_file_get_string(kf, "device 1",
+			"capturefile", NULL);
+	if (capturefile && !info->num_analog_channels) {
+		ec->num_streams = 1;
+		ec->stream_names = g_malloc0(sizeof(char *) * 2);
+		ec->stream_names[0] = g_strdup(capturefile);
+		ec->stream_channels = g_malloc0(sizeof(struct sr_channel *));
+		ec->sample_size = info->unitsize;
+		ret = SR_OK;
+	} else if (kf && !capturefile && info->num_analog_channels) {
+		ec->num_streams = info->num_analog_channels;
+		ec->stream_names = g_malloc0(sizeof(char *) * (ec->num_streams + 1));
+		ec->stream_channels = g_malloc0(sizeof(struct sr_channel *)
+			* ec->num_streams);
+		for (i = 0, l = ec->sdi->channels; l && i < ec->num_streams; l = l->next) {
+			ch = l->data;
+			if (ch->type != SR_CHANNEL_ANALOG)
+				continue;
+			ec->stream_names[i] = g_strdup_printf("analog-1-%u",
+				info->num_logic_channels + i + 1);
+			ec->stream_channels[i++] = ch;
+		}
+		ec->sample_size = sizeof(float);
+		if (i == ec->num_streams)
+			ret = SR_OK;
+	}
+	if (ret == SR_OK)
+		ret = find_chunks(ec, archive);
+
+	g_free(capturefile);
+	if (kf)
+		g_key_file_free(kf);
+	zip_discard(archive);
+	sr_session_file_info_free(info);
+
+	return ret;
+}
+
+/*
+ * Split the capture into segments at the chunks which start at multiples
+ * of the output module's alignment. Fails when a segment would span more
+ * than MAX_SEGMENT_SIZE, because the chunks don't line up often enough.
+ */
+static int plan_segments(struct export_context *ec, uint64_t align)
+{
+	struct export_chunk *chunk;
+	struct export_segment seg, *last;
+	uint64_t pos, size;
+	unsigned int i;
+
+	pos = size = 0;
+	for (i = 0; i < ec->chunks->len; i++) {
+		chunk = &g_array_index(ec->chunks, struct export_chunk, i);
+		if (i == 0 || pos % align == 0) {
+			memset(&seg, 0, sizeof(seg));
+			seg.first_chunk = i;
+			seg.start = pos;
+			g_array_append_val(ec->segments, seg);
+			size = 0;
+		}
+		last = &g_array_index(ec->segments, struct export_segment,
+			ec->segments->len - 1);
+		last->num_chunks++;
+		pos += chunk->size / ec->sample_size;
+		size += chunk->size * ec->num_streams;
+		if (size > MAX_SEGMENT_SIZE) {
+			sr_dbg("Chunks don't line up with the alignment of %"
+				PRIu64 " samples.", align);
+			g_array_set_size(ec->segments, 0);
+			return SR_ERR_NA;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Collect the text of a packet's conversion. */
+static int export_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *text)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+
+	return ret;
+}
+
+/* Decompress a capture file's chunk in its entirety. */
+static uint8_t *read_chunk(struct zip *archive, const char *name, uint64_t size)
+{
+	struct zip_file *zf;
+	uint8_t *buf;
+	uint64_t pos;
+	zip_int64_t ret;
+
+	if (!(buf = g_try_malloc(MAX(size, 1)))) {
+		sr_err("Cannot allocate %" PRIu64 " bytes for '%s'.", size, name);
+		return NULL;
+	}
+	if (!(zf = zip_fopen(archive, name, 0))) {
+		sr_err("Failed to open capture file '%s': %s.",
+			name, zip_strerror(archive));
+		g_free(buf);
+		return NULL;
+	}
+	pos = 0;
+	while (pos < size) {
+		ret = zip_fread(zf, buf + pos, size - pos);
+		if (ret <= 0)
+			break;
+		pos += ret;
+	}
+	zip_fclose(zf);
+	if (pos != size) {
+		sr_err("Failed to read capture file '%s'.", name);
+		g_free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/* Send one stream's data of a chunk, the way the session driver does. */
+static int send_chunk(struct export_context *ec, const struct sr_output *o,
+		struct zip *archive, const struct export_chunk *chunk,
+		unsigned int stream, GString *text)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint8_t *buf;
+	char *name;
+	int ret;
+
+	if (chunk->number)
+		name = g_strdup_printf("%s-%d", ec->stream_names[stream],
+			chunk->number);
+	else
+		name = g_strdup(ec->stream_names[stream]);
+	buf = read_chunk(archive, name, chunk->size);
+	g_free(name);
+	if (!buf)
+		return SR_ERR;
+
+	if (ec->stream_channels[stream]) {
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+		analog.meaning->channels = g_slist_prepend(NULL,
+			ec->stream_channels[stream]);
+		analog.num_samples = chunk->size / sizeof(float);
+		analog.meaning->mq = SR_MQ_VOLTAGE;
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.meaning->mqflags = SR_MQFLAG_DC;
+		analog.data = buf;
+		ret = export_send(o, &packet, text);
+		g_slist_free(analog.meaning->channels);
+	} else {
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = chunk->size - chunk->size % ec->sample_size;
+		logic.unitsize = ec->sample_size;
+		logic.data = buf;
+		ret = export_send(o, &packet, text);
+	}
+	g_free(buf);
+
+	return ret;
+}
+
+/* Convert a segment, as if it was a capture of its own. */
+static int convert_segment(struct export_context *ec,
+		struct export_segment *seg, struct zip *archive)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_config src;
+	const struct sr_output *o;
+	const struct export_chunk *chunk;
+	unsigned int i, j;
+	int ret;
+
+	if (!(o = seg->o))
+		o = sr_output_new_segment(ec->omod, ec->options, ec->sdi,
+			seg->start, seg->start > 0);
+	seg->o = NULL;
+	if (!o)
+		return SR_ERR;
+	seg->text = g_string_sized_new(0);
+
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	header.starttime = ec->starttime;
+	ret = export_send(o, &packet, seg->text);
+
+	if (ret == SR_OK && ec->samplerate) {
+		packet.type = SR_DF_META;
+		packet.payload = &meta;
+		src.key = SR_CONF_SAMPLERATE;
+		src.data = g_variant_new_uint64(ec->samplerate);
+		meta.config = g_slist_append(NULL, &src);
+		ret = export_send(o, &packet, seg->text);
+		g_slist_free(meta.config);
+		g_variant_unref(src.data);
+	}
+
+	for (i = 0; i < seg->num_chunks && ret == SR_OK; i++) {
+		chunk = &g_array_index(ec->chunks, struct export_chunk,
+			seg->first_chunk + i);
+		for (j = 0; j < ec->num_streams && ret == SR_OK; j++)
+			ret = send_chunk(ec, o, archive, chunk, j, seg->text);
+	}
+
+	if (ret == SR_OK) {
+		packet.type = SR_DF_END;
+		packet.payload = NULL;
+		ret = export_send(o, &packet, seg->text);
+	}
+	sr_output_free(o);
+
+	return ret;
+}
+
+static void export_run(gpointer data, gpointer user_data)
+{
+	struct export_segment *seg;
+	struct export_context *ec;
+	struct zip *archive;
+
+	seg = data;
+	ec = user_data;
+
+	archive = g_async_queue_pop(ec->archives);
+	seg->status = convert_segment(ec, seg, archive);
+	g_async_queue_push(ec->archives, archive);
+
+	g_mutex_lock(&ec->mutex);
+	seg->done = TRUE;
+	g_cond_broadcast(&ec->cond);
+	g_mutex_unlock(&ec->mutex);
+}
+
+/*
+ * Convert the segments on a pool of workers, and write their text in
+ * order. Only a few segments per worker are in flight at a time, which
+ * bounds the memory which their text takes up.
+ */
+static int export_segments(struct export_context *ec, unsigned int threads,
+		struct sr_file_writer *fw)
+{
+	struct export_segment *seg;
+	struct zip *archive;
+	GThreadPool *pool;
+	unsigned int i, queued, window;
+	int ret, err;
+
+	ec->archives = g_async_queue_new();
+	for (i = 0; i < threads; i++) {
+		if (!(archive = zip_open(ec->filename, 0, &err))) {
+			sr_err("Failed to open session file '%s': zip error %d.",
+				ec->filename, err);
+			break;
+		}
+		g_async_queue_push(ec->archives, archive);
+	}
+	pool = NULL;
+	if (i == threads)
+		pool = g_thread_pool_new(export_run, ec, threads, TRUE, NULL);
+	if (!pool) {
+		while ((archive = g_async_queue_try_pop(ec->archives)))
+			zip_discard(archive);
+		g_async_queue_unref(ec->archives);
+		return SR_ERR;
+	}
+
+	sr_dbg("Converting %u segments on %u threads.", ec->segments->len, threads);
+	window = threads * SEGMENTS_PER_THREAD;
+	ret = SR_OK;
+	queued = 0;
+	for (i = 0; i < ec->segments->len; i++) {
+		while (queued < ec->segments->len && queued < i + window) {
+			seg = &g_array_index(ec->segments, struct export_segment, queued++);
+			if (ret != SR_OK)
+				seg->done = TRUE;
+			else if (!g_thread_pool_push(pool, seg, NULL))
+				export_run(seg, ec);
+		}
+		seg = &g_array_index(ec->segments, struct export_segment, i);
+		g_mutex_lock(&ec->mutex);
+		while (!seg->done)
+			g_cond_wait(&ec->cond, &ec->mutex);
+		g_mutex_unlock(&ec->mutex);
+		if (ret == SR_OK && seg->status != SR_OK)
+			ret = seg->status;
+		if (ret == SR_OK)
+			ret = sr_file_writer_write_string(fw, seg->text);
+		else if (seg->text)
+			g_string_free(seg->text, TRUE);
+		seg->text = NULL;
+	}
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+	while ((archive = g_async_queue_try_pop(ec->archives)))
+		zip_discard(archive);
+	g_async_queue_unref(ec->archives);
+
+	return ret;
+}
+
+static void playback_feed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct export_playback *pb;
+	GString *out;
+	int ret;
+
+	(void)sdi;
+
+	pb = cb_data;
+	if (pb->status != SR_OK)
+		return;
+
+	out = NULL;
+	if ((ret = sr_output_send(pb->o, packet, &out)) != SR_OK)
+		pb->status = ret;
+	if (out && pb->fw && pb->status == SR_OK)
+		pb->status = sr_file_writer_write_string(pb->fw, out);
+	else if (out)
+		g_string_free(out, TRUE);
+}
+
+/* Convert the capture in one piece, by replaying the session. */
+static int run_playback(struct sr_session *session,
+		const struct sr_dev_inst *sdi, const struct sr_output_module *omod,
+		GHashTable *options, const char *outfile, struct sr_file_writer *fw)
+{
+	struct export_playback pb;
+	int ret;
+
+	if (!(pb.o = sr_output_new(omod, options, sdi, outfile)))
+		return SR_ERR_ARG;
+	pb.fw = fw;
+	pb.status = SR_OK;
+
+	sr_session_datafeed_callback_add(session, playback_feed, &pb);
+	if ((ret = sr_session_start(session)) == SR_OK)
+		ret = sr_session_run(session);
+	sr_session_datafeed_callback_remove_all(session);
+	sr_output_free(pb.o);
+
+	return ret != SR_OK ? ret : pb.status;
+}
+
+/**
+ * Convert a session file with an output module.
+ *
+ * The capture gets split into segments at the boundaries of its stored
+ * chunks, which output instances of their own convert on a pool of
+ * worker threads. The segments' text gets written out in order. This
+ * requires a file which holds either logic data or analog data, and an
+ * output module which supports segments, like "csv", "bits", "hex",
+ * "binary" and "wav". Otherwise the session gets replayed into a single
+ * output instance, just like a client would do it.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param filename The name of the session file. Must not be NULL.
+ * @param omod The output module. Must not be NULL.
+ * @param options The output module's options, as for sr_output_new().
+ *                Can be NULL.
+ * @param outfile The name of the file to write. Must not be NULL.
+ * @param threads The number of worker threads, 0 for one per processor.
+ *
+ * @retval SR_OK Success
+ * @retval SR_ERR_ARG Invalid argument, or invalid output module options
+ * @retval SR_ERR_IO Writing the output file failed
+ * @retval other Loading or converting the session file failed
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_export(struct sr_context *ctx, const char *filename,
+		const struct sr_output_module *omod, GHashTable *options,
+		const char *outfile, unsigned int threads)
+{
+	struct export_context ec;
+	struct export_segment *seg;
+	struct sr_session *session;
+	struct sr_file_writer *fw;
+	const struct sr_output *o;
+	GSList *devlist;
+	int64_t now;
+	unsigned int i;
+	int ret, close_ret;
+
+	if (!ctx || !filename || !omod || !outfile)
+		return SR_ERR_ARG;
+	if (!threads)
+		threads = g_get_num_processors();
+
+	if ((ret = sr_session_load(ctx, filename, &session)) != SR_OK)
+		return ret;
+	devlist = NULL;
+	sr_session_dev_list(session, &devlist);
+	if (!devlist) {
+		sr_err("Session file '%s' holds no device.", filename);
+		sr_session_destroy(session);
+		return SR_ERR_DATA;
+	}
+
+	/* Modules set up their option defaults on first use. */
+	if (omod->options)
+		omod->options();
+
+	fw = NULL;
+	if (!sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING)) {
+		if (!(fw = sr_file_writer_new(outfile, 0))) {
+			g_slist_free(devlist);
+			sr_session_destroy(session);
+			return SR_ERR_IO;
+		}
+	}
+
+	memset(&ec, 0, sizeof(ec));
+	ec.filename = filename;
+	ec.omod = omod;
+	ec.options = options;
+	ec.sdi = devlist->data;
+	ec.chunks = g_array_new(FALSE, FALSE, sizeof(struct export_chunk));
+	ec.segments = g_array_new(FALSE, FALSE, sizeof(struct export_segment));
+	g_mutex_init(&ec.mutex);
+	g_cond_init(&ec.cond);
+	now = g_get_real_time();
+	ec.starttime.tv_sec = now / G_USEC_PER_SEC;
+	ec.starttime.tv_usec = now % G_USEC_PER_SEC;
+
+	/* Check whether the module's output of segments concatenates. */
+	o = NULL;
+	if (fw && g_slist_length(devlist) == 1 && plan_export(&ec) == SR_OK)
+		o = sr_output_new_segment(omod, options, ec.sdi, 0, FALSE);
+	if (o && o->segment_align
+			&& plan_segments(&ec, o->segment_align) == SR_OK) {
+		seg = &g_array_index(ec.segments, struct export_segment, 0);
+		seg->o = o;
+		ret = export_segments(&ec, MIN(threads, ec.segments->len), fw);
+	} else {
+		if (o)
+			sr_output_free(o);
+		sr_dbg("Converting '%s' in one piece.", filename);
+		ret = run_playback(session, ec.sdi, omod, options, outfile, fw);
+	}
+
+	close_ret = sr_file_writer_close(fw);
+	if (ret == SR_OK)
+		ret = close_ret;
+
+	for (i = 0; i < ec.segments->len; i++) {
+		seg = &g_array_index(ec.segments, struct export_segment, i);
+		if (seg->o)
+			sr_output_free(seg->o);
+	}
+	g_array_free(ec.segments, TRUE);
+	g_array_free(ec.chunks, TRUE);
+	g_strfreev(ec.stream_names);
+	g_free(ec.stream_channels);
+	g_mutex_clear(&ec.mutex);
+	g_cond_clear(&ec.cond);
+	g_slist_free(devlist);
+	sr_session_destroy(session);
+
+	return ret;
+}
+
+/** @} */
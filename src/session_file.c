@@ -111,33 +111,18 @@ SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 	return keyfile;
 }
 
-/** @private */
-SR_PRIV int sr_sessionfile_check(const char *filename)
+/* Check that an open archive is a session file this code can handle. */
+static int check_archive(struct zip *archive)
 {
-	struct zip *archive;
 	struct zip_file *zf;
 	struct zip_stat zs;
 	uint64_t version;
 	int ret;
 	char s[11];
 
-	if (!filename)
-		return SR_ERR_ARG;
-
-	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
-		sr_err("Not a regular file: %s.", filename);
-		return SR_ERR;
-	}
-
-	if (!(archive = zip_open(filename, 0, NULL)))
-		/* No logging: this can be used just to check if it's
-		 * a sigrok session file or not. */
-		return SR_ERR;
-
 	/* check "version" */
 	if (!(zf = zip_fopen(archive, "version", 0))) {
 		sr_dbg("Not a sigrok session file: no version found.");
-		zip_discard(archive);
 		return SR_ERR;
 	}
 	ret = zip_fread(zf, s, sizeof(s) - 1);
@@ -145,7 +130,6 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 		sr_err("Failed to read version file: %s",
 			zip_file_strerror(zf));
 		zip_fclose(zf);
-		zip_discard(archive);
 		return SR_ERR;
 	}
 	zip_fclose(zf);
@@ -154,7 +138,6 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 	if (version == 0 || version > 2) {
 		sr_dbg("Cannot handle sigrok session file version %" PRIu64 ".",
 			version);
-		zip_discard(archive);
 		return SR_ERR;
 	}
 	sr_spew("Detected sigrok session file version %" PRIu64 ".", version);
@@ -162,14 +145,37 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 	/* read "metadata" */
 	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
 		sr_dbg("Not a valid sigrok session file.");
-		zip_discard(archive);
 		return SR_ERR;
 	}
-	zip_discard(archive);
 
 	return SR_OK;
 }
 
+/** @private */
+SR_PRIV int sr_sessionfile_check(const char *filename)
+{
+	struct zip *archive;
+	int ret;
+
+	if (!filename)
+		return SR_ERR_ARG;
+
+	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+		sr_err("Not a regular file: %s.", filename);
+		return SR_ERR;
+	}
+
+	if (!(archive = zip_open(filename, 0, NULL)))
+		/* No logging: this can be used just to check if it's
+		 * a sigrok session file or not. */
+		return SR_ERR;
+
+	ret = check_archive(archive);
+	zip_discard(archive);
+
+	return ret;
+}
+
 /** @private */
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename, struct sr_session **session)
 {
@@ -393,4 +399,468 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	return ret;
 }
 
+/*
+ * Sum up the uncompressed sizes of a capture file's entries, from the
+ * archive's central directory. The file is either stored in one piece
+ * under its name, or in chunks named after it with a "-<number>" suffix.
+ */
+static uint64_t capture_file_size(struct zip *archive, const char *name)
+{
+	struct zip_stat zs;
+	zip_int64_t num_entries, i;
+	uint64_t size;
+	size_t len;
+	const char *p;
+
+	len = strlen(name);
+	size = 0;
+	num_entries = zip_get_num_entries(archive, 0);
+	for (i = 0; i < num_entries; i++) {
+		if (zip_stat_index(archive, i, 0, &zs) < 0)
+			continue;
+		if (!(zs.valid & ZIP_STAT_NAME) || !(zs.valid & ZIP_STAT_SIZE))
+			continue;
+		if (strncmp(zs.name, name, len))
+			continue;
+		p = zs.name + len;
+		if (*p == '-' && g_ascii_isdigit(p[1])) {
+			for (p++; g_ascii_isdigit(*p); p++)
+				;
+		}
+		if (*p != '\0')
+			continue;
+		size += zs.size;
+	}
+
+	return size;
+}
+
+/* Fill in the summary from the first device section of the metadata. */
+static int read_file_info(GKeyFile *kf, struct zip *archive,
+		struct sr_session_file_info *info)
+{
+	GError *error;
+	char **sections, **keys, *section, *val, *capturefile, *name;
+	unsigned int num_channels, idx, i;
+	uint64_t size;
+	int tmp, ret;
+
+	sections = g_key_file_get_groups(kf, NULL);
+	section = NULL;
+	for (i = 0; sections[i]; i++) {
+		if (!strncmp(sections[i], "device ", 7)) {
+			section = sections[i];
+			break;
+		}
+	}
+	if (!section) {
+		/* No device, therefore no samples. */
+		info->channel_names = g_malloc0(sizeof(char *));
+		g_strfreev(sections);
+		return SR_OK;
+	}
+
+	error = NULL;
+	ret = SR_OK;
+
+	if ((val = g_key_file_get_string(kf, section, "samplerate", NULL))) {
+		if (sr_parse_sizestring(val, &info->samplerate) != SR_OK)
+			ret = SR_ERR_DATA;
+		g_free(val);
+	}
+	if (g_key_file_has_key(kf, section, "total probes", NULL)) {
+		tmp = g_key_file_get_integer(kf, section, "total probes", &error);
+		if (tmp < 0 || error)
+			ret = SR_ERR_DATA;
+		else
+			info->num_logic_channels = tmp;
+		g_clear_error(&error);
+	}
+	if (g_key_file_has_key(kf, section, "total analog", NULL)) {
+		tmp = g_key_file_get_integer(kf, section, "total analog", &error);
+		if (tmp < 0 || error)
+			ret = SR_ERR_DATA;
+		else
+			info->num_analog_channels = tmp;
+		g_clear_error(&error);
+	}
+	capturefile = g_key_file_get_string(kf, section, "capturefile", NULL);
+	if (capturefile) {
+		tmp = g_key_file_get_integer(kf, section, "unitsize", &error);
+		if (tmp <= 0 || error)
+			ret = SR_ERR_DATA;
+		else
+			info->unitsize = tmp;
+		g_clear_error(&error);
+	}
+
+	/* Default names are the channel indices, as in sr_session_load(). */
+	num_channels = info->num_logic_channels + info->num_analog_channels;
+	info->channel_names = g_malloc0(sizeof(char *) * (num_channels + 1));
+	for (i = 0; i < num_channels; i++)
+		info->channel_names[i] = g_strdup_printf("%u", i);
+
+	keys = g_key_file_get_keys(kf, section, NULL, NULL);
+	for (i = 0; keys && keys[i] && ret == SR_OK; i++) {
+		if (!strncmp(keys[i], "probe", 5))
+			idx = g_ascii_strtoull(keys[i] + 5, NULL, 10);
+		else if (!strncmp(keys[i], "analog", 6))
+			idx = g_ascii_strtoull(keys[i] + 6, NULL, 10);
+		else
+			continue;
+		/* Logic channels are named "probeN", analog ones "analogN". */
+		if (idx == 0 || idx > num_channels
+				|| (keys[i][0] == 'p') != (idx <= info->num_logic_channels)) {
+			ret = SR_ERR_DATA;
+			break;
+		}
+		if (!(val = g_key_file_get_string(kf, section, keys[i], NULL))) {
+			ret = SR_ERR_DATA;
+			break;
+		}
+		g_free(info->channel_names[idx - 1]);
+		info->channel_names[idx - 1] = val;
+	}
+	g_strfreev(keys);
+
+	if (ret == SR_OK) {
+		/* All streams hold the same number of samples, count one. */
+		if (capturefile) {
+			size = capture_file_size(archive, capturefile);
+			info->num_samples = size / info->unitsize;
+		} else if (info->num_analog_channels) {
+			name = g_strdup_printf("analog-1-%u",
+				info->num_logic_channels + 1);
+			size = capture_file_size(archive, name);
+			g_free(name);
+			info->num_samples = size / sizeof(float);
+		}
+		if (info->samplerate) {
+			info->duration = info->num_samples / info->samplerate
+				* UINT64_C(1000000000);
+			info->duration += info->num_samples % info->samplerate
+				* UINT64_C(1000000000) / info->samplerate;
+		}
+	}
+
+	g_free(capturefile);
+	g_strfreev(sections);
+
+	return ret;
+}
+
+/* Open a session file, and read its metadata. */
+static int open_archive(const char *filename, struct zip **archive,
+		GKeyFile **kf)
+{
+	struct zip_stat zs;
+	int ret;
+
+	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+		sr_err("Not a regular file: %s.", filename);
+		return SR_ERR;
+	}
+	if (!(*archive = zip_open(filename, 0, NULL)))
+		return SR_ERR;
+
+	if ((ret = check_archive(*archive)) != SR_OK) {
+		zip_discard(*archive);
+		return ret;
+	}
+	if (zip_stat(*archive, "metadata", 0, &zs) < 0) {
+		zip_discard(*archive);
+		return SR_ERR;
+	}
+	if (!(*kf = sr_sessionfile_read_metadata(*archive, &zs))) {
+		zip_discard(*archive);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Read a summary of a session file, without loading the session.
+ *
+ * Only the metadata and the archive's central directory are read, which
+ * makes this suitable for listing many files. The sample count is taken
+ * from the sizes of the stored capture data, none of it is decompressed.
+ *
+ * @param filename The name of the session file.
+ * @param info Pointer where the newly allocated summary is stored. Free it
+ *             with sr_session_file_info_free().
+ *
+ * @retval SR_OK Success
+ * @retval SR_ERR_ARG Invalid argument
+ * @retval SR_ERR_DATA Malformed session file
+ * @retval SR_ERR This is not a session file
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_info_get(const char *filename,
+		struct sr_session_file_info **info)
+{
+	struct sr_session_file_info *fi;
+	struct zip *archive;
+	GKeyFile *kf;
+	int ret;
+
+	if (!filename || !info)
+		return SR_ERR_ARG;
+	*info = NULL;
+
+	if ((ret = open_archive(filename, &archive, &kf)) != SR_OK)
+		return ret;
+
+	fi = g_malloc0(sizeof(*fi));
+	ret = read_file_info(kf, archive, fi);
+	g_key_file_free(kf);
+	zip_discard(archive);
+
+	if (ret != SR_OK) {
+		sr_err("Invalid metadata in session file '%s'.", filename);
+		sr_session_file_info_free(fi);
+		return ret;
+	}
+	*info = fi;
+
+	return SR_OK;
+}
+
+/**
+ * Free a session file summary.
+ *
+ * @param info The summary returned by sr_session_file_info_get(). Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_file_info_free(struct sr_session_file_info *info)
+{
+	if (!info)
+		return;
+
+	g_strfreev(info->channel_names);
+	g_free(info);
+}
+
+
+/* Read an archive member in one piece. */
+static uint8_t *read_entry(struct zip *archive, const char *name,
+		uint64_t *size)
+{
+	struct zip_stat zs;
+	struct zip_file *zf;
+	uint8_t *buf;
+	zip_int64_t len;
+
+	if (zip_stat(archive, name, 0, &zs) < 0)
+		return NULL;
+	if (!(buf = g_try_malloc(MAX(zs.size, 1)))) {
+		sr_err("Cannot allocate %" PRIu64 " bytes for '%s'.",
+			(uint64_t)zs.size, name);
+		return NULL;
+	}
+	if (!(zf = zip_fopen_index(archive, zs.index, 0))) {
+		g_free(buf);
+		return NULL;
+	}
+	len = zip_fread(zf, buf, zs.size);
+	zip_fclose(zf);
+	if (len < 0 || (uint64_t)len != zs.size) {
+		sr_err("Failed to read '%s'.", name);
+		g_free(buf);
+		return NULL;
+	}
+	*size = zs.size;
+
+	return buf;
+}
+
+/* Decode the summary entries of one channel. */
+static int decode_summary(const struct sr_session_file_info *fi,
+		unsigned int channel, const uint8_t *data, uint64_t size,
+		struct sr_session_file_summary *sum)
+{
+	const uint8_t *entry;
+	uint64_t entry_size, i;
+	unsigned int unitsize;
+
+	if (channel < fi->num_logic_channels) {
+		/* The first sample, then a transition count per bit. */
+		unitsize = fi->unitsize;
+		entry_size = unitsize * (1 + 8 * sizeof(uint32_t));
+		if (!unitsize || size % entry_size)
+			return SR_ERR_DATA;
+		sum->num_entries = size / entry_size;
+		sum->first = g_try_malloc(MAX(sum->num_entries, 1));
+		sum->transitions = g_try_malloc(MAX(sum->num_entries, 1)
+			* sizeof(sum->transitions[0]));
+		if (!sum->first || !sum->transitions)
+			return SR_ERR_MALLOC;
+		for (i = 0; i < sum->num_entries; i++) {
+			entry = data + i * entry_size;
+			sum->first[i] = (entry[channel / 8] >> (channel % 8)) & 1;
+			sum->transitions[i] = read_u32le(entry + unitsize
+				+ channel * sizeof(uint32_t));
+		}
+	} else {
+		/* The minimum, then the maximum. */
+		entry_size = 2 * sizeof(float);
+		if (size % entry_size)
+			return SR_ERR_DATA;
+		sum->num_entries = size / entry_size;
+		sum->min = g_try_malloc(MAX(sum->num_entries, 1)
+			* sizeof(sum->min[0]));
+		sum->max = g_try_malloc(MAX(sum->num_entries, 1)
+			* sizeof(sum->max[0]));
+		if (!sum->min || !sum->max)
+			return SR_ERR_MALLOC;
+		for (i = 0; i < sum->num_entries; i++) {
+			entry = data + i * entry_size;
+			sum->min[i] = read_fltle(entry);
+			sum->max[i] = read_fltle(entry + sizeof(float));
+		}
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Read the summary of a session file channel's samples.
+ *
+ * The srzip output module stores summaries of the samples at decreasing
+ * resolutions, which lets viewers draw zoomed out captures without
+ * reading all samples. The coarsest summary whose entries cover at most
+ * the requested number of samples gets picked, or the finest one if all
+ * of them are coarser. Callers check samples_per_entry.
+ *
+ * @param filename The name of the session file.
+ * @param channel The channel's index, as in the loaded session: logic
+ *                channels first, then analog channels.
+ * @param samples_per_entry The number of samples which each entry may
+ *                          cover at most, e.g. the samples per pixel.
+ * @param summary Pointer where the newly allocated summary is stored.
+ *                Free it with sr_session_file_summary_free().
+ *
+ * @retval SR_OK Success
+ * @retval SR_ERR_ARG Invalid argument
+ * @retval SR_ERR_NA The file holds no summaries, e.g. as it was written
+ *                   by an older version
+ * @retval SR_ERR_DATA Malformed session file
+ * @retval SR_ERR_MALLOC Out of memory
+ * @retval SR_ERR This is not a session file
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_summary_get(const char *filename,
+		unsigned int channel, uint64_t samples_per_entry,
+		struct sr_session_file_summary **summary)
+{
+	struct sr_session_file_info fi;
+	struct sr_session_file_summary *sum;
+	struct zip *archive;
+	GKeyFile *kf;
+	GError *error;
+	uint64_t base, fanout, levels, level, size;
+	uint8_t *data;
+	char *name;
+	int ret;
+
+	if (!filename || !summary)
+		return SR_ERR_ARG;
+	*summary = NULL;
+
+	if ((ret = open_archive(filename, &archive, &kf)) != SR_OK)
+		return ret;
+
+	memset(&fi, 0, sizeof(fi));
+	ret = read_file_info(kf, archive, &fi);
+	g_strfreev(fi.channel_names);
+	if (ret == SR_OK && channel >= fi.num_logic_channels
+			+ fi.num_analog_channels) {
+		sr_err("No channel %u in session file '%s'.", channel, filename);
+		ret = SR_ERR_ARG;
+	}
+
+	base = fanout = levels = 0;
+	if (ret == SR_OK) {
+		if (!g_key_file_has_key(kf, "device 1", "summary levels", NULL))
+			ret = SR_ERR_NA;
+	}
+	if (ret == SR_OK) {
+		error = NULL;
+		base = g_key_file_get_uint64(kf, "device 1", "summary base", &error);
+		if (!error)
+			fanout = g_key_file_get_uint64(kf, "device 1",
+				"summary fanout", &error);
+		if (!error)
+			levels = g_key_file_get_uint64(kf, "device 1",
+				"summary levels", &error);
+		if (error || !base || fanout < 2 || !levels)
+			ret = SR_ERR_DATA;
+		g_clear_error(&error);
+	}
+	g_key_file_free(kf);
+	if (ret != SR_OK) {
+		zip_discard(archive);
+		return ret;
+	}
+
+	/* The coarsest level which doesn't exceed the requested size. */
+	level = 0;
+	size = base;
+	while (level + 1 < levels && size <= samples_per_entry / fanout) {
+		size *= fanout;
+		level++;
+	}
+
+	sum = g_malloc0(sizeof(*sum));
+	sum->samples_per_entry = size;
+	if (channel < fi.num_logic_channels)
+		name = g_strdup_printf("summary-logic-1-%" PRIu64, level);
+	else
+		name = g_strdup_printf("summary-analog-1-%u-%" PRIu64,
+			channel + 1, level);
+	data = read_entry(archive, name, &size);
+	zip_discard(archive);
+	if (!data) {
+		sr_err("Cannot read summary '%s'.", name);
+		ret = SR_ERR_DATA;
+	} else {
+		ret = decode_summary(&fi, channel, data, size, sum);
+		if (ret != SR_OK)
+			sr_err("Invalid summary '%s'.", name);
+	}
+	g_free(data);
+	g_free(name);
+
+	if (ret != SR_OK) {
+		sr_session_file_summary_free(sum);
+		return ret;
+	}
+	*summary = sum;
+
+	return SR_OK;
+}
+
+/**
+ * Free a session file channel's summary.
+ *
+ * @param summary The summary returned by sr_session_file_summary_get().
+ *                Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_file_summary_free(struct sr_session_file_summary *summary)
+{
+	if (!summary)
+		return;
+
+	g_free(summary->min);
+	g_free(summary->max);
+	g_free(summary->first);
+	g_free(summary->transitions);
+	g_free(summary);
+}
+
 /** @} */
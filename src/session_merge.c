@@ -0,0 +1,620 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-merge"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Merging the logic data of all devices of a session into one stream.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+/*
+ * Pending samples of a device which waits for the trigger or the data
+ * of another, after which alignment gets abandoned, and the others are
+ * filled in with zeros.
+ */
+#define MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+struct merge_dev {
+	const struct sr_dev_inst *sdi;
+	uint64_t samplerate;
+	uint16_t unitsize;
+	/* Samples not merged yet, starting at head. */
+	GByteArray *queue;
+	size_t head;
+	/* Samples the device received before its trigger. */
+	gboolean triggered;
+	uint64_t pre_trigger;
+	gboolean ended;
+	/* Samples which were filled in with zeros, to drop when they come. */
+	uint64_t skip;
+};
+
+struct sr_merge {
+	struct sr_session *session;
+	unsigned int flags;
+	sr_datafeed_callback cb;
+	void *cb_data;
+	/* Devices may feed the stage from different threads. */
+	GMutex mutex;
+
+	/* State of the current acquisition, while there is one. */
+	GSList *devs;
+	size_t num_devs;
+	size_t num_ended;
+	uint16_t unitsize;
+	gboolean header_sent;
+	gboolean samplerate_sent;
+	gboolean failed;
+	/* Waiting for the trigger of all devices. */
+	gboolean align_pending;
+	/* Merged samples to go before the trigger, or -1 for none. */
+	int64_t trigger_at;
+	GByteArray *out;
+};
+/** @endcond */
+
+static uint64_t dev_pending(const struct merge_dev *dev)
+{
+	if (!dev->unitsize)
+		return 0;
+
+	return (dev->queue->len - dev->head) / dev->unitsize;
+}
+
+static void dev_consume(struct merge_dev *dev, uint64_t samples)
+{
+	dev->head += samples * dev->unitsize;
+	/* Move the remainder to the front once most of the queue is gone. */
+	if (dev->head == dev->queue->len) {
+		g_byte_array_set_size(dev->queue, 0);
+		dev->head = 0;
+	} else if (dev->head > dev->queue->len / 2) {
+		g_byte_array_remove_range(dev->queue, 0, dev->head);
+		dev->head = 0;
+	}
+}
+
+/* Append zeros for samples which the device doesn't provide. */
+static void dev_fill_zero(struct merge_dev *dev, uint64_t samples)
+{
+	size_t len;
+
+	len = dev->queue->len;
+	g_byte_array_set_size(dev->queue, len + samples * dev->unitsize);
+	memset(dev->queue->data + len, 0, dev->queue->len - len);
+}
+
+static gboolean dev_has_logic(const struct sr_dev_inst *sdi)
+{
+	const struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void merge_reset(struct sr_merge *merge)
+{
+	struct merge_dev *dev;
+	GSList *l;
+
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		g_byte_array_unref(dev->queue);
+		g_free(dev);
+	}
+	g_slist_free(merge->devs);
+	merge->devs = NULL;
+	merge->num_devs = 0;
+	merge->num_ended = 0;
+	merge->unitsize = 0;
+	merge->header_sent = FALSE;
+	merge->samplerate_sent = FALSE;
+	merge->failed = FALSE;
+	merge->align_pending = FALSE;
+	merge->trigger_at = -1;
+	if (merge->out)
+		g_byte_array_set_size(merge->out, 0);
+}
+
+/*
+ * Take the session's devices as the sources of a new acquisition, those
+ * without logic channels don't contribute to the merged samples.
+ */
+static void merge_begin(struct sr_merge *merge)
+{
+	struct merge_dev *dev;
+	GSList *l;
+
+	merge_reset(merge);
+	for (l = merge->session->devs; l; l = l->next) {
+		if (!dev_has_logic(l->data))
+			continue;
+		dev = g_malloc0(sizeof(*dev));
+		dev->sdi = l->data;
+		dev->queue = g_byte_array_new();
+		merge->devs = g_slist_append(merge->devs, dev);
+		merge->num_devs++;
+	}
+	merge->align_pending = (merge->flags & SR_MERGE_ALIGN_TRIGGER) != 0;
+}
+
+static struct merge_dev *merge_find(const struct sr_merge *merge,
+		const struct sr_dev_inst *sdi)
+{
+	struct merge_dev *dev;
+	GSList *l;
+
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		if (dev->sdi == sdi)
+			return dev;
+	}
+
+	return NULL;
+}
+
+static const struct sr_dev_inst *merge_sdi(const struct sr_merge *merge)
+{
+	return ((const struct merge_dev *)merge->devs->data)->sdi;
+}
+
+static void merge_send(struct sr_merge *merge, int type, const void *payload)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = type;
+	packet.payload = payload;
+	merge->cb(merge_sdi(merge), &packet, merge->cb_data);
+}
+
+static void merge_send_samplerate(struct sr_merge *merge, uint64_t samplerate)
+{
+	struct sr_datafeed_meta meta;
+	struct sr_config src;
+	GSList node;
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(samplerate));
+	node.data = &src;
+	node.next = NULL;
+	meta.config = &node;
+	merge_send(merge, SR_DF_META, &meta);
+	g_variant_unref(src.data);
+}
+
+/* Interleave the next samples of all devices, and send them. */
+static void merge_send_logic(struct sr_merge *merge, uint64_t samples)
+{
+	struct sr_datafeed_logic logic;
+	struct merge_dev *dev;
+	const uint8_t *rp;
+	uint8_t *wp;
+	uint64_t i;
+	size_t offset;
+	GSList *l;
+
+	if (!samples)
+		return;
+
+	if (merge->num_devs == 1) {
+		/* Nothing to interleave, pass the queued data on. */
+		dev = merge->devs->data;
+		logic.data = dev->queue->data + dev->head;
+	} else {
+		g_byte_array_set_size(merge->out, samples * merge->unitsize);
+		offset = 0;
+		for (l = merge->devs; l; l = l->next) {
+			dev = l->data;
+			rp = dev->queue->data + dev->head;
+			wp = merge->out->data + offset;
+			for (i = 0; i < samples; i++) {
+				memcpy(wp, rp, dev->unitsize);
+				rp += dev->unitsize;
+				wp += merge->unitsize;
+			}
+			offset += dev->unitsize;
+		}
+		logic.data = merge->out->data;
+	}
+	logic.length = samples * merge->unitsize;
+	logic.unitsize = merge->unitsize;
+	merge_send(merge, SR_DF_LOGIC, &logic);
+
+	for (l = merge->devs; l; l = l->next)
+		dev_consume(l->data, samples);
+}
+
+/*
+ * Once all devices triggered, drop the samples which some devices got
+ * ahead of the others before their trigger. Devices which end without
+ * a trigger, or get too far ahead, leave the streams aligned at their
+ * start.
+ */
+static void merge_align(struct sr_merge *merge)
+{
+	struct merge_dev *dev;
+	uint64_t pre;
+	GSList *l;
+	gboolean all;
+
+	all = TRUE;
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		if (dev->ended && !dev->triggered) {
+			sr_dbg("%s ended without a trigger, aligning at start.",
+				dev->sdi->model);
+			merge->align_pending = FALSE;
+			return;
+		}
+		if (dev->queue->len - dev->head > MAX_PENDING_BYTES) {
+			sr_warn("Devices did not trigger together, aligning "
+				"at start.");
+			merge->align_pending = FALSE;
+			return;
+		}
+		all = all && dev->triggered;
+	}
+	if (!all)
+		return;
+
+	pre = UINT64_MAX;
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		pre = MIN(pre, dev->pre_trigger);
+	}
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		dev_consume(dev, dev->pre_trigger - pre);
+	}
+	merge->trigger_at = pre;
+	merge->align_pending = FALSE;
+}
+
+/* Send everything which all devices have data for. */
+static void merge_flush(struct sr_merge *merge)
+{
+	struct merge_dev *dev;
+	uint64_t samples;
+	GSList *l;
+
+	if (merge->align_pending)
+		merge_align(merge);
+	if (merge->align_pending)
+		return;
+
+	samples = UINT64_MAX;
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		/* Devices which are done hold the others back no longer. */
+		if (dev->ended && !dev_pending(dev))
+			continue;
+		if (!dev->unitsize)
+			return;
+		samples = MIN(samples, dev_pending(dev));
+	}
+	if (samples == UINT64_MAX)
+		return;
+	/* Fill in zeros for devices which ended early. */
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		if (!dev->ended || dev_pending(dev) >= samples)
+			continue;
+		dev_fill_zero(dev, samples - dev_pending(dev));
+	}
+
+	if (merge->trigger_at >= 0 && (uint64_t)merge->trigger_at <= samples) {
+		merge_send_logic(merge, merge->trigger_at);
+		samples -= merge->trigger_at;
+		merge->trigger_at = -1;
+		merge_send(merge, SR_DF_TRIGGER, NULL);
+	}
+	if (merge->trigger_at >= 0)
+		merge->trigger_at -= samples;
+	merge_send_logic(merge, samples);
+}
+
+/*
+ * A device got too far ahead of the others. Send its samples, with zeros
+ * for the others which lag behind, and drop theirs when they arrive. As
+ * long as a device didn't send any logic data, there's no telling where
+ * its samples go, the pending samples are dropped then.
+ */
+static void merge_overflow(struct sr_merge *merge, struct merge_dev *dev)
+{
+	struct merge_dev *other;
+	uint64_t samples, lag;
+	GSList *l;
+
+	samples = dev_pending(dev);
+	for (l = merge->devs; l; l = l->next) {
+		other = l->data;
+		if (other->unitsize)
+			continue;
+		sr_warn("No data from %s, dropping %" PRIu64 " samples of %s.",
+			other->sdi->model, samples, dev->sdi->model);
+		dev_consume(dev, samples);
+		return;
+	}
+
+	for (l = merge->devs; l; l = l->next) {
+		other = l->data;
+		if (dev_pending(other) >= samples)
+			continue;
+		lag = samples - dev_pending(other);
+		sr_warn("%s lags %" PRIu64 " samples behind, filling in zeros.",
+			other->sdi->model, lag);
+		dev_fill_zero(other, lag);
+		if (!other->ended)
+			other->skip += lag;
+	}
+	merge_flush(merge);
+}
+
+static void merge_fail(struct sr_merge *merge, const char *reason)
+{
+	sr_err("Cannot merge device data: %s.", reason);
+	merge->failed = TRUE;
+	if (merge->header_sent)
+		merge_send(merge, SR_DF_END, NULL);
+}
+
+static void merge_samplerate(struct sr_merge *merge, struct merge_dev *dev,
+		uint64_t samplerate)
+{
+	struct merge_dev *other;
+	GSList *l;
+
+	dev->samplerate = samplerate;
+	for (l = merge->devs; l; l = l->next) {
+		other = l->data;
+		if (!other->samplerate)
+			return;
+		if (other->samplerate != samplerate) {
+			merge_fail(merge, "samplerates differ");
+			return;
+		}
+	}
+	if (!merge->samplerate_sent) {
+		merge_send_samplerate(merge, samplerate);
+		merge->samplerate_sent = TRUE;
+	}
+}
+
+static void merge_logic(struct sr_merge *merge, struct merge_dev *dev,
+		const struct sr_datafeed_logic *logic)
+{
+	struct merge_dev *other;
+	const uint8_t *data;
+	uint64_t len, skip;
+	GSList *l;
+
+	if (!logic->unitsize || !logic->length)
+		return;
+	if (!dev->unitsize) {
+		dev->unitsize = logic->unitsize;
+		merge->unitsize = 0;
+		for (l = merge->devs; l; l = l->next) {
+			other = l->data;
+			merge->unitsize += other->unitsize;
+		}
+	} else if (dev->unitsize != logic->unitsize) {
+		merge_fail(merge, "unitsize changed");
+		return;
+	}
+
+	data = logic->data;
+	len = logic->length - logic->length % logic->unitsize;
+	if (dev->skip) {
+		skip = MIN(dev->skip, len / logic->unitsize);
+		dev->skip -= skip;
+		data += skip * logic->unitsize;
+		len -= skip * logic->unitsize;
+	}
+	g_byte_array_append(dev->queue, data, len);
+	if (!dev->triggered)
+		dev->pre_trigger += logic->length / logic->unitsize;
+	merge_flush(merge);
+	if (dev->queue->len - dev->head > MAX_PENDING_BYTES)
+		merge_overflow(merge, dev);
+}
+
+/**
+ * Feed a packet which a session delivers to its merge stage.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_merge_feed(struct sr_merge *merge,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	struct merge_dev *dev;
+	GSList *l;
+
+	g_mutex_lock(&merge->mutex);
+
+	if (packet->type == SR_DF_HEADER && !merge->devs)
+		merge_begin(merge);
+	if (!(dev = merge_find(merge, sdi))) {
+		g_mutex_unlock(&merge->mutex);
+		return;
+	}
+
+	/* Failures stop the stream, the next acquisition starts anew. */
+	if (merge->failed) {
+		if (packet->type == SR_DF_END && !dev->ended) {
+			dev->ended = TRUE;
+			if (++merge->num_ended == merge->num_devs)
+				merge_reset(merge);
+		}
+		g_mutex_unlock(&merge->mutex);
+		return;
+	}
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (!merge->header_sent) {
+			merge_send(merge, SR_DF_HEADER, packet->payload);
+			merge->header_sent = TRUE;
+		}
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				merge_samplerate(merge, dev,
+					g_variant_get_uint64(src->data));
+		}
+		break;
+	case SR_DF_TRIGGER:
+		if (!(merge->flags & SR_MERGE_ALIGN_TRIGGER) || dev->triggered)
+			break;
+		dev->triggered = TRUE;
+		merge_flush(merge);
+		break;
+	case SR_DF_LOGIC:
+		merge_logic(merge, dev, packet->payload);
+		break;
+	case SR_DF_END:
+		if (dev->ended)
+			break;
+		dev->ended = TRUE;
+		merge->num_ended++;
+		merge_flush(merge);
+		if (merge->num_ended < merge->num_devs)
+			break;
+		/* Alignment was given up, pass whatever is left on. */
+		merge->align_pending = FALSE;
+		merge_flush(merge);
+		merge_send(merge, SR_DF_END, NULL);
+		merge_reset(merge);
+		break;
+	default:
+		break;
+	}
+
+	g_mutex_unlock(&merge->mutex);
+}
+
+/**
+ * Release the merge stage of a session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_merge_free(struct sr_merge *merge)
+{
+	if (!merge)
+		return;
+
+	merge_reset(merge);
+	g_byte_array_unref(merge->out);
+	g_mutex_clear(&merge->mutex);
+	g_free(merge);
+}
+
+/**
+ * Merge the logic data of all devices of a session into one stream.
+ *
+ * The callback receives the packets of a virtual device, whose samples
+ * are the samples of all the session's devices with enabled logic
+ * channels side by side, in the order of sr_session_dev_list(). The
+ * callback's device argument is the first of these devices. The devices
+ * must run at the same samplerate. A merged sample gets sent once all
+ * devices have sent theirs, and devices which end early read as zero
+ * from then on. When a device gets 64 MiB of samples ahead of another,
+ * the samples which the other lags behind read as zero, and are dropped
+ * when they arrive.
+ *
+ * With SR_MERGE_ALIGN_TRIGGER, the streams get aligned such that the
+ * trigger positions of all devices coincide, and the merged stream has
+ * one trigger there. Packets other than header, samplerate meta data,
+ * trigger, logic and end packets are not part of the merged stream.
+ *
+ * The session's datafeed callbacks keep receiving the devices' own
+ * packets. With a single device, the merged data gets passed on
+ * without being copied again.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param flags Bitwise OR of enum sr_merge_flags values.
+ * @param cb Callback which receives the merged stream, or NULL to stop
+ *           merging.
+ * @param cb_data Opaque pointer passed in by the caller.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR The session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_merge_set(struct sr_session *session,
+		unsigned int flags, sr_datafeed_callback cb, void *cb_data)
+{
+	struct sr_merge *merge;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change the merge stage of a running session.");
+		return SR_ERR;
+	}
+
+	sr_session_merge_free(session->merge);
+	session->merge = NULL;
+	if (!cb)
+		return SR_OK;
+
+	merge = g_malloc0(sizeof(*merge));
+	merge->session = session;
+	merge->flags = flags;
+	merge->cb = cb;
+	merge->cb_data = cb_data;
+	merge->trigger_at = -1;
+	merge->out = g_byte_array_new();
+	g_mutex_init(&merge->mutex);
+	session->merge = merge;
+
+	return SR_OK;
+}
+
+/** @} */
@@ -0,0 +1,518 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_LINUX_FUTEX_H)
+#define HAVE_SHM_RING 1
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define LOG_PREFIX "shm-ring"
+
+/**
+ * @file
+ *
+ * Byte stream ring in POSIX shared memory, between one writer and one
+ * reader process on the same host.
+ *
+ * The segment starts with a page holding the header, the ring follows.
+ * The ring is mapped twice, back to back, so every range of up to the
+ * ring's size is contiguous in memory: the writer copies a record in
+ * with a single memcpy(), and the reader hands it on without copying.
+ *
+ * Read and write positions are free running 32 bit byte counts, which
+ * double as futex words. The side which has to wait announces itself
+ * in a waiter count, so the other side only enters the kernel when
+ * someone sleeps.
+ */
+
+#define SHM_RING_MAGIC "SRSHMRNG"
+#define SHM_RING_MAX_SIZE (1U << 30)
+/* Don't sleep longer than this, to notice the other side going away. */
+#define SHM_RING_POLL_MS 100
+
+enum {
+	SHM_RING_WRITER_DONE = 1 << 0,
+	SHM_RING_READER_GONE = 1 << 1,
+};
+
+struct shm_ring_header {
+	char magic[8];
+	uint32_t size;
+	gint head;
+	gint tail;
+	gint flags;
+	gint head_waiters;
+	gint tail_waiters;
+};
+
+struct sr_shm_ring {
+	struct shm_ring_header *hdr;
+	uint8_t *data;
+	uint32_t size;
+	size_t page;
+	char *name;
+	gboolean writer;
+};
+
+#ifdef HAVE_SHM_RING
+
+static void futex_wait(gint *addr, gint *waiters, gint val, int timeout_ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+	g_atomic_int_inc(waiters);
+	if (g_atomic_int_get(addr) == val)
+		syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+	g_atomic_int_add(waiters, -1);
+}
+
+static void futex_wake(gint *addr, gint *waiters)
+{
+	if (g_atomic_int_get(waiters))
+		syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int ring_map(struct sr_shm_ring *ring, int fd)
+{
+	uint8_t *base;
+
+	base = mmap(NULL, ring->page + 2 * (size_t)ring->size, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return SR_ERR_MALLOC;
+
+	if (mmap(base, ring->page, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+			|| mmap(base + ring->page, ring->size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+			fd, ring->page) == MAP_FAILED
+			|| mmap(base + ring->page + ring->size, ring->size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+			fd, ring->page) == MAP_FAILED) {
+		munmap(base, ring->page + 2 * (size_t)ring->size);
+		return SR_ERR_MALLOC;
+	}
+	ring->hdr = (struct shm_ring_header *)base;
+	ring->data = base + ring->page;
+
+	return SR_OK;
+}
+
+/**
+ * Create a ring, for writing.
+ *
+ * The segment's name exists from a successful return on, until the ring
+ * gets freed. Readers can open it in between. On errors there is no
+ * segment of this name, unless there was one before: an existing
+ * segment is left alone, be it another writer's or one of a writer
+ * which crashed, and creating the ring fails.
+ *
+ * @param name The segment's name, like "/sigrok".
+ * @param size The ring's size in bytes, a power of two and a multiple
+ *             of the page size.
+ *
+ * @return The ring, or NULL on errors.
+ *
+ * @private
+ */
+SR_PRIV struct sr_shm_ring *sr_shm_ring_create(const char *name, size_t size)
+{
+	struct sr_shm_ring *ring;
+	size_t page;
+	int fd;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (size < page || size > SHM_RING_MAX_SIZE || (size & (size - 1))) {
+		sr_err("Invalid ring size %zu.", size);
+		return NULL;
+	}
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		sr_err("Shared memory %s exists already, remove it if it "
+			"is stale.", name);
+		return NULL;
+	}
+	if (fd < 0) {
+		sr_err("Cannot create shared memory %s: %s", name,
+			g_strerror(errno));
+		return NULL;
+	}
+	/* From here on, the name is ours to remove on errors. */
+	if (ftruncate(fd, page + size) < 0) {
+		sr_err("Cannot size shared memory %s: %s", name,
+			g_strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	ring = g_malloc0(sizeof(*ring));
+	ring->size = size;
+	ring->page = page;
+	if (ring_map(ring, fd) != SR_OK) {
+		sr_err("Cannot map shared memory %s.", name);
+		close(fd);
+		shm_unlink(name);
+		g_free(ring);
+		return NULL;
+	}
+	close(fd);
+	ring->name = g_strdup(name);
+	ring->writer = TRUE;
+
+	ring->hdr->size = size;
+	/* Readers only accept a ring once the magic is there. */
+	g_atomic_int_set(&ring->hdr->flags, 0);
+	memcpy(ring->hdr->magic, SHM_RING_MAGIC, sizeof(ring->hdr->magic));
+
+	return ring;
+}
+
+/**
+ * Open an existing ring, for reading.
+ *
+ * @param name The segment's name.
+ *
+ * @return The ring, or NULL on errors.
+ *
+ * @private
+ */
+SR_PRIV struct sr_shm_ring *sr_shm_ring_open(const char *name)
+{
+	struct sr_shm_ring *ring;
+	struct shm_ring_header hdr;
+	struct stat st;
+	size_t page;
+	void *map;
+	int fd;
+
+	page = sysconf(_SC_PAGESIZE);
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		sr_err("Cannot open shared memory %s: %s", name,
+			g_strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < page) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, page, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+	munmap(map, page);
+	if (memcmp(hdr.magic, SHM_RING_MAGIC, sizeof(hdr.magic))
+			|| (size_t)st.st_size != page + hdr.size
+			|| hdr.size < page || hdr.size > SHM_RING_MAX_SIZE
+			|| (hdr.size & (hdr.size - 1))) {
+		sr_err("Shared memory %s holds no sigrok ring.", name);
+		close(fd);
+		return NULL;
+	}
+
+	ring = g_malloc0(sizeof(*ring));
+	ring->size = hdr.size;
+	ring->page = page;
+	if (ring_map(ring, fd) != SR_OK) {
+		sr_err("Cannot map shared memory %s.", name);
+		close(fd);
+		g_free(ring);
+		return NULL;
+	}
+	close(fd);
+	ring->name = g_strdup(name);
+
+	return ring;
+}
+
+/**
+ * Close a ring, and tell the other side about it.
+ *
+ * The writer also removes the segment's name. A reader which has it
+ * open keeps its mapping until it closes the ring.
+ *
+ * @private
+ */
+SR_PRIV void sr_shm_ring_free(struct sr_shm_ring *ring)
+{
+	struct shm_ring_header *hdr;
+
+	if (!ring)
+		return;
+	hdr = ring->hdr;
+
+	g_atomic_int_or((guint *)&hdr->flags, ring->writer
+		? SHM_RING_WRITER_DONE : SHM_RING_READER_GONE);
+	futex_wake(&hdr->head, &hdr->head_waiters);
+	futex_wake(&hdr->tail, &hdr->tail_waiters);
+
+	munmap(hdr, ring->page + 2 * (size_t)ring->size);
+	if (ring->writer)
+		shm_unlink(ring->name);
+	g_free(ring->name);
+	g_free(ring);
+}
+
+/**
+ * Get room for writing len bytes, waiting for the reader if needed.
+ *
+ * @return Where to write, or NULL when len exceeds the ring's size or
+ *         the reader went away.
+ *
+ * @private
+ */
+SR_PRIV uint8_t *sr_shm_ring_reserve(struct sr_shm_ring *ring, size_t len)
+{
+	struct shm_ring_header *hdr;
+	guint head, tail;
+
+	hdr = ring->hdr;
+
+	if (len > ring->size) {
+		sr_err("%zu bytes exceed the ring's size.", len);
+		return NULL;
+	}
+
+	head = g_atomic_int_get(&hdr->head);
+	while (TRUE) {
+		tail = g_atomic_int_get(&hdr->tail);
+		if (ring->size - (head - tail) >= len)
+			break;
+		if (g_atomic_int_get(&hdr->flags) & SHM_RING_READER_GONE) {
+			sr_err("The reader went away.");
+			return NULL;
+		}
+		futex_wait(&hdr->tail, &hdr->tail_waiters, tail,
+			SHM_RING_POLL_MS);
+	}
+
+	return ring->data + (head & (ring->size - 1));
+}
+
+/**
+ * Pass len bytes, written after sr_shm_ring_reserve(), to the reader.
+ *
+ * @private
+ */
+SR_PRIV void sr_shm_ring_commit(struct sr_shm_ring *ring, size_t len)
+{
+	struct shm_ring_header *hdr;
+
+	hdr = ring->hdr;
+
+	g_atomic_int_add(&hdr->head, len);
+	futex_wake(&hdr->head, &hdr->head_waiters);
+}
+
+/**
+ * Write len bytes to the ring, waiting for the reader if needed.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_IO The data doesn't fit, or the reader went away.
+ *
+ * @private
+ */
+SR_PRIV int sr_shm_ring_write(struct sr_shm_ring *ring,
+		const uint8_t *data, size_t len)
+{
+	uint8_t *dst;
+
+	if (!(dst = sr_shm_ring_reserve(ring, len)))
+		return SR_ERR_IO;
+	memcpy(dst, data, len);
+	sr_shm_ring_commit(ring, len);
+
+	return SR_OK;
+}
+
+/**
+ * Get the data which is ready for reading.
+ *
+ * The data stays valid until it gets consumed.
+ *
+ * @return The number of bytes at *data.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_shm_ring_peek(struct sr_shm_ring *ring, const uint8_t **data)
+{
+	guint head, tail;
+
+	head = g_atomic_int_get(&ring->hdr->head);
+	tail = g_atomic_int_get(&ring->hdr->tail);
+	*data = ring->data + (tail & (ring->size - 1));
+
+	return head - tail;
+}
+
+/**
+ * Release len bytes the reader is done with, for the writer to reuse.
+ *
+ * @private
+ */
+SR_PRIV void sr_shm_ring_consume(struct sr_shm_ring *ring, size_t len)
+{
+	struct shm_ring_header *hdr;
+
+	if (!len)
+		return;
+	hdr = ring->hdr;
+
+	g_atomic_int_add(&hdr->tail, len);
+	futex_wake(&hdr->tail, &hdr->tail_waiters);
+}
+
+/**
+ * Wait until the writer moves on from a write position.
+ *
+ * @param seen The write position the caller knows about.
+ * @param timeout_ms How long to wait at most, 0 to not wait.
+ *
+ * @return The current write position. It equals seen on timeouts, and
+ *         when the writer is done.
+ *
+ * @private
+ */
+SR_PRIV uint32_t sr_shm_ring_wait(struct sr_shm_ring *ring, uint32_t seen,
+		int timeout_ms)
+{
+	struct shm_ring_header *hdr;
+
+	hdr = ring->hdr;
+
+	if (timeout_ms > 0 && (guint)g_atomic_int_get(&hdr->head) == seen
+			&& !sr_shm_ring_writer_done(ring))
+		futex_wait(&hdr->head, &hdr->head_waiters, seen, timeout_ms);
+
+	return g_atomic_int_get(&hdr->head);
+}
+
+/**
+ * Check whether the writer closed the ring.
+ *
+ * Data which it wrote before can still be read.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_shm_ring_writer_done(struct sr_shm_ring *ring)
+{
+	return (g_atomic_int_get(&ring->hdr->flags) & SHM_RING_WRITER_DONE) != 0;
+}
+
+#else
+
+SR_PRIV struct sr_shm_ring *sr_shm_ring_create(const char *name, size_t size)
+{
+	(void)name;
+	(void)size;
+
+	sr_err("Shared memory rings are not supported on this platform.");
+
+	return NULL;
+}
+
+SR_PRIV struct sr_shm_ring *sr_shm_ring_open(const char *name)
+{
+	(void)name;
+
+	sr_err("Shared memory rings are not supported on this platform.");
+
+	return NULL;
+}
+
+SR_PRIV void sr_shm_ring_free(struct sr_shm_ring *ring)
+{
+	(void)ring;
+}
+
+SR_PRIV uint8_t *sr_shm_ring_reserve(struct sr_shm_ring *ring, size_t len)
+{
+	(void)ring;
+	(void)len;
+
+	return NULL;
+}
+
+SR_PRIV void sr_shm_ring_commit(struct sr_shm_ring *ring, size_t len)
+{
+	(void)ring;
+	(void)len;
+}
+
+SR_PRIV int sr_shm_ring_write(struct sr_shm_ring *ring,
+		const uint8_t *data, size_t len)
+{
+	(void)ring;
+	(void)data;
+	(void)len;
+
+	return SR_ERR_NA;
+}
+
+SR_PRIV size_t sr_shm_ring_peek(struct sr_shm_ring *ring, const uint8_t **data)
+{
+	(void)ring;
+
+	*data = NULL;
+
+	return 0;
+}
+
+SR_PRIV void sr_shm_ring_consume(struct sr_shm_ring *ring, size_t len)
+{
+	(void)ring;
+	(void)len;
+}
+
+SR_PRIV uint32_t sr_shm_ring_wait(struct sr_shm_ring *ring, uint32_t seen,
+		int timeout_ms)
+{
+	(void)ring;
+	(void)timeout_ms;
+
+	return seen;
+}
+
+SR_PRIV gboolean sr_shm_ring_writer_done(struct sr_shm_ring *ring)
+{
+	(void)ring;
+
+	return TRUE;
+}
+
+#endif
@@ -26,6 +26,57 @@
 #define LOG_PREFIX "soft-trigger"
 /** @endcond */
 
+/*
+ * Compiled form of a trigger stage. Matches on the stage's enabled
+ * channels are collected in bit masks, one set of words per 64 logic
+ * channels, such that whole samples get checked at once.
+ */
+struct soft_trigger_stage {
+	/* The stage has no matches at all, which is a client error. */
+	gboolean invalid;
+	/* The stage has matches which can never be met on logic data. */
+	gboolean never;
+	/* The stage needs the previous sample to check for edges. */
+	gboolean has_edges;
+	/* Masks, each num_words long, see the STAGE_* indices below. */
+	uint64_t *words;
+};
+
+/*
+ * Decoder state of a serial protocol condition. It sees every sample,
+ * and matches on the one which completes the wanted word or address.
+ */
+struct soft_trigger_proto {
+	int protocol;
+	/* Channel indices, see struct sr_trigger_protocol_match, or -1. */
+	int channels[3];
+	/* Levels of the previous sample, -1 before the first one. */
+	int last[3];
+	uint8_t value;
+	uint8_t mask;
+	/* UART: samples per bit, and the next bit's center, 24.8 fixed point. */
+	uint64_t bit_time;
+	uint64_t next_bit;
+	uint64_t elapsed;
+	/* SPI: sample data on rising clock edges, else on falling ones. */
+	gboolean sample_rising;
+	/* UART: within a frame. I2C: within an address. */
+	gboolean busy;
+	int num_bits;
+	uint8_t shift;
+};
+
+/** @cond PRIVATE */
+#define STAGE_LEVEL_MASK	0
+#define STAGE_LEVEL_VALUE	1
+#define STAGE_RISING		2
+#define STAGE_FALLING		3
+#define STAGE_EDGE		4
+#define STAGE_NUM_MASKS		5
+#define STAGE_MASK(stl, stage, kind) \
+	(&(stage)->words[(kind) * (stl)->num_words])
+/** @endcond */
+
 SR_PRIV int logic_channel_unitsize(GSList *channels)
 {
 	int number = 0;
@@ -41,11 +92,443 @@ SR_PRIV int logic_channel_unitsize(GSList *channels)
 	return (number + 7) / 8;
 }
 
+static void compile_stage(const struct soft_trigger_logic *stl,
+		const struct sr_trigger_stage *stage, struct soft_trigger_stage *cs)
+{
+	const struct sr_trigger_match *match;
+	GSList *l;
+	uint64_t *level_mask, *level_value, bit;
+	int w, num_edges;
+
+	cs->words = g_malloc0(STAGE_NUM_MASKS * stl->num_words * sizeof(uint64_t));
+	if (!stage->matches) {
+		cs->invalid = TRUE;
+		return;
+	}
+
+	level_mask = STAGE_MASK(stl, cs, STAGE_LEVEL_MASK);
+	level_value = STAGE_MASK(stl, cs, STAGE_LEVEL_VALUE);
+	num_edges = 0;
+	for (l = stage->matches; l; l = l->next) {
+		match = l->data;
+		if (!match->channel->enabled)
+			/* Ignore disabled channels with a trigger. */
+			continue;
+		if (match->channel->index >= stl->unitsize * 8) {
+			cs->never = TRUE;
+			continue;
+		}
+		w = match->channel->index / 64;
+		bit = UINT64_C(1) << (match->channel->index % 64);
+		switch (match->match) {
+		case SR_TRIGGER_ZERO:
+			/* Both levels on the same channel never match. */
+			if (level_value[w] & bit)
+				cs->never = TRUE;
+			level_mask[w] |= bit;
+			break;
+		case SR_TRIGGER_ONE:
+			if ((level_mask[w] & bit) && !(level_value[w] & bit))
+				cs->never = TRUE;
+			level_mask[w] |= bit;
+			level_value[w] |= bit;
+			break;
+		case SR_TRIGGER_RISING:
+			STAGE_MASK(stl, cs, STAGE_RISING)[w] |= bit;
+			num_edges++;
+			break;
+		case SR_TRIGGER_FALLING:
+			STAGE_MASK(stl, cs, STAGE_FALLING)[w] |= bit;
+			num_edges++;
+			break;
+		case SR_TRIGGER_EDGE:
+			STAGE_MASK(stl, cs, STAGE_EDGE)[w] |= bit;
+			num_edges++;
+			break;
+		default:
+			/* Analog conditions never match on logic data. */
+			cs->never = TRUE;
+			break;
+		}
+	}
+	cs->has_edges = num_edges > 0;
+}
+
+static void compile_protocol(struct soft_trigger_logic *stl,
+		const struct sr_trigger_stage *stage, struct soft_trigger_stage *cs)
+{
+	const struct sr_trigger_protocol_match *match;
+	struct soft_trigger_proto *proto;
+	struct sr_channel *ch;
+	GVariant *gvar;
+	uint64_t samplerate;
+	unsigned int i;
+
+	match = stage->protocol;
+	if (stl->num_stages > 1 || stage->matches) {
+		sr_err("Protocol triggers must be the only trigger condition.");
+		cs->invalid = TRUE;
+		return;
+	}
+	for (i = 0; i < ARRAY_SIZE(match->channels); i++) {
+		ch = match->channels[i];
+		if (ch && (!ch->enabled || ch->index >= stl->unitsize * 8)) {
+			sr_err("Protocol trigger channel %s is not captured.",
+				ch->name);
+			cs->invalid = TRUE;
+			return;
+		}
+	}
+
+	proto = g_malloc0(sizeof(*proto));
+	proto->protocol = match->protocol;
+	for (i = 0; i < ARRAY_SIZE(match->channels); i++) {
+		proto->channels[i] = match->channels[i] ? match->channels[i]->index : -1;
+		proto->last[i] = -1;
+	}
+	proto->value = match->value & match->mask;
+	proto->mask = match->mask;
+
+	switch (match->protocol) {
+	case SR_TRIGGER_PROTO_UART:
+		samplerate = 0;
+		if (sr_config_get(stl->sdi->driver, stl->sdi, NULL,
+				SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+			samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		/* The start bit's center must fall on a later sample. */
+		if (samplerate < 2 * match->baudrate) {
+			sr_err("UART trigger needs at least 2 samples per bit.");
+			g_free(proto);
+			cs->invalid = TRUE;
+			return;
+		}
+		proto->bit_time = (samplerate << 8) / match->baudrate;
+		break;
+	case SR_TRIGGER_PROTO_SPI:
+		proto->sample_rising = match->spi_mode == 0 || match->spi_mode == 3;
+		break;
+	}
+	stl->proto = proto;
+}
+
+/* Load up to 8 bytes of a little endian sample into a word. */
+static inline uint64_t load_word(const uint8_t *p, int len)
+{
+	uint64_t value;
+
+	switch (len) {
+	case 1:
+		return read_u8(p);
+	case 2:
+		return read_u16le(p);
+	case 4:
+		return read_u32le(p);
+	case 8:
+		return read_u64le(p);
+	}
+
+	value = 0;
+	while (len--)
+		value = (value << 8) | p[len];
+
+	return value;
+}
+
+static void load_sample(const struct soft_trigger_logic *stl,
+		const uint8_t *sample, uint64_t *words)
+{
+	int w;
+
+	for (w = 0; w < stl->num_words; w++)
+		words[w] = load_word(sample + w * 8,
+			MIN(8, stl->unitsize - w * 8));
+}
+
+static gboolean stage_match(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *cs, const uint64_t *cur,
+		const uint64_t *prev, gboolean have_prev)
+{
+	const uint64_t *level_mask, *level_value, *rising, *falling, *edge;
+	uint64_t s, p;
+	int w;
+
+	if (cs->never)
+		return FALSE;
+
+	level_mask = STAGE_MASK(stl, cs, STAGE_LEVEL_MASK);
+	level_value = STAGE_MASK(stl, cs, STAGE_LEVEL_VALUE);
+	for (w = 0; w < stl->num_words; w++) {
+		if ((cur[w] & level_mask[w]) != level_value[w])
+			return FALSE;
+	}
+
+	if (!cs->has_edges)
+		return TRUE;
+	/* First sample, don't have enough for an edge match yet. */
+	if (!have_prev)
+		return FALSE;
+
+	rising = STAGE_MASK(stl, cs, STAGE_RISING);
+	falling = STAGE_MASK(stl, cs, STAGE_FALLING);
+	edge = STAGE_MASK(stl, cs, STAGE_EDGE);
+	for (w = 0; w < stl->num_words; w++) {
+		s = cur[w];
+		p = prev[w];
+		if ((~p & s & rising[w]) != rising[w])
+			return FALSE;
+		if ((p & ~s & falling[w]) != falling[w])
+			return FALSE;
+		if (((p ^ s) & edge[w]) != edge[w])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Check all samples in a 64-bit word at once, for captures with 8, 16
+ * or 32 channels. Each lane's conditions collapse into a difference
+ * which is zero on a match, and the lowest zero lane is found with the
+ * usual borrow trick (lanes above the first match may report false
+ * hits, which doesn't matter here). With edges, prev holds the sample
+ * before offset i on entry and the one before the returned offset.
+ */
+static int scan_lanes(int unitsize, uint64_t level_mask,
+		uint64_t level_value, uint64_t rising, uint64_t falling,
+		uint64_t edge, gboolean has_edges, const uint8_t *buf,
+		int i, int end, uint64_t *prev)
+{
+	uint64_t ones, highs, s, p, diff, hit;
+	int bits, lane;
+
+	bits = unitsize * 8;
+	ones = UINT64_MAX / ((UINT64_C(1) << bits) - 1);
+	highs = ones << (bits - 1);
+	level_mask *= ones;
+	level_value *= ones;
+	rising *= ones;
+	falling *= ones;
+	edge *= ones;
+
+	p = 0;
+	for (; i + 8 <= end; i += 8) {
+		s = read_u64le(buf + i);
+		diff = (s & level_mask) ^ level_value;
+		if (has_edges) {
+			p = (s << bits) | *prev;
+			diff |= (~p & s & rising) ^ rising;
+			diff |= (p & ~s & falling) ^ falling;
+			diff |= ((p ^ s) & edge) ^ edge;
+		}
+		hit = (diff - ones) & ~diff & highs;
+		if (hit) {
+			lane = __builtin_ctzll(hit) / bits;
+			*prev = (p >> (lane * bits)) & (UINT64_MAX >> (64 - bits));
+			return i + lane * unitsize;
+		}
+		*prev = s >> (64 - bits);
+	}
+
+	return i;
+}
+
+/*
+ * Find the first sample from offset i on which matches a stage, for
+ * captures of up to 64 channels. This is where most of the time goes
+ * while waiting for a trigger, keep it to plain word operations which
+ * the compiler can keep in registers.
+ */
+static int scan_stage(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *cs, const uint8_t *buf,
+		int i, int end, uint64_t prev, gboolean have_prev)
+{
+	uint64_t level_mask, level_value, rising, falling, edge, s;
+	int unitsize;
+	gboolean lanes;
+
+	if (cs->never)
+		return end;
+
+	unitsize = stl->unitsize;
+	level_mask = STAGE_MASK(stl, cs, STAGE_LEVEL_MASK)[0];
+	level_value = STAGE_MASK(stl, cs, STAGE_LEVEL_VALUE)[0];
+
+	lanes = unitsize == 1 || unitsize == 2 || unitsize == 4;
+
+	if (!cs->has_edges) {
+		if (lanes)
+			i = scan_lanes(unitsize, level_mask, level_value,
+				0, 0, 0, FALSE, buf, i, end, &prev);
+		for (; i < end; i += unitsize) {
+			if ((load_word(buf + i, unitsize) & level_mask) == level_value)
+				break;
+		}
+		return i;
+	}
+
+	rising = STAGE_MASK(stl, cs, STAGE_RISING)[0];
+	falling = STAGE_MASK(stl, cs, STAGE_FALLING)[0];
+	edge = STAGE_MASK(stl, cs, STAGE_EDGE)[0];
+	if (lanes && !have_prev && i < end) {
+		/* The first sample can't match an edge. */
+		prev = load_word(buf + i, unitsize);
+		have_prev = TRUE;
+		i += unitsize;
+	}
+	if (lanes && have_prev)
+		i = scan_lanes(unitsize, level_mask, level_value, rising,
+			falling, edge, TRUE, buf, i, end, &prev);
+	for (; i < end; i += unitsize) {
+		s = load_word(buf + i, unitsize);
+		if (have_prev && (s & level_mask) == level_value
+				&& (~prev & s & rising) == rising
+				&& (prev & ~s & falling) == falling
+				&& ((prev ^ s) & edge) == edge)
+			break;
+		prev = s;
+		have_prev = TRUE;
+	}
+
+	return i;
+}
+
+static inline int sample_bit(const uint8_t *sample, int index)
+{
+	return (sample[index / 8] >> (index % 8)) & 1;
+}
+
+static gboolean proto_uart(struct soft_trigger_proto *proto, const int *level)
+{
+	int rx;
+
+	rx = level[0];
+	if (!proto->busy) {
+		/* Wait for the start bit's falling edge. */
+		if (proto->last[0] != 1 || rx)
+			return FALSE;
+		proto->busy = TRUE;
+		proto->elapsed = 0;
+		proto->next_bit = proto->bit_time / 2;
+		proto->num_bits = 0;
+		proto->shift = 0;
+		return FALSE;
+	}
+
+	proto->elapsed += 1 << 8;
+	if (proto->elapsed < proto->next_bit)
+		return FALSE;
+	proto->next_bit += proto->bit_time;
+
+	if (proto->num_bits == 0) {
+		/* A glitch rather than a start bit. */
+		if (rx)
+			proto->busy = FALSE;
+	} else if (proto->num_bits <= 8) {
+		proto->shift |= rx << (proto->num_bits - 1);
+	} else {
+		/* Stop bit. A framing error waits for the line to go idle. */
+		proto->busy = FALSE;
+		return rx && (proto->shift & proto->mask) == proto->value;
+	}
+	proto->num_bits++;
+
+	return FALSE;
+}
+
+static gboolean proto_spi(struct soft_trigger_proto *proto, const int *level)
+{
+	int clk, last_clk;
+
+	/* Words start when CS# gets asserted. */
+	if (proto->channels[2] >= 0 && level[2]) {
+		proto->num_bits = 0;
+		return FALSE;
+	}
+
+	clk = level[0];
+	last_clk = proto->last[0];
+	if (last_clk < 0 || clk == last_clk)
+		return FALSE;
+	if (clk != proto->sample_rising)
+		return FALSE;
+
+	proto->shift = (proto->shift << 1) | level[1];
+	if (++proto->num_bits < 8)
+		return FALSE;
+	proto->num_bits = 0;
+
+	return (proto->shift & proto->mask) == proto->value;
+}
+
+static gboolean proto_i2c(struct soft_trigger_proto *proto, const int *level)
+{
+	int scl, sda;
+
+	scl = level[0];
+	sda = level[1];
+	if (proto->last[0] < 0)
+		return FALSE;
+
+	if (scl && proto->last[0] && sda != proto->last[1]) {
+		/* SDA changing while SCL is high: (repeated) START or STOP. */
+		proto->busy = !sda;
+		proto->num_bits = 0;
+		proto->shift = 0;
+		return FALSE;
+	}
+	if (!proto->busy || !scl || proto->last[0])
+		return FALSE;
+
+	/* Rising SCL: the 7 address bits, then R/W#. */
+	proto->shift = (proto->shift << 1) | sda;
+	if (++proto->num_bits < 8)
+		return FALSE;
+	proto->busy = FALSE;
+
+	return ((proto->shift >> 1) & proto->mask) == proto->value;
+}
+
+/* Feed a sample to the protocol decoder, returns whether it matches. */
+static gboolean proto_feed(struct soft_trigger_proto *proto,
+		const uint8_t *sample)
+{
+	int level[3];
+	gboolean match;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(level); i++)
+		level[i] = proto->channels[i] >= 0 ?
+			sample_bit(sample, proto->channels[i]) : 0;
+
+	switch (proto->protocol) {
+	case SR_TRIGGER_PROTO_UART:
+		match = proto_uart(proto, level);
+		break;
+	case SR_TRIGGER_PROTO_SPI:
+		match = proto_spi(proto, level);
+		break;
+	case SR_TRIGGER_PROTO_I2C:
+		match = proto_i2c(proto, level);
+		break;
+	default:
+		match = FALSE;
+		break;
+	}
+	memcpy(proto->last, level, sizeof(proto->last));
+
+	return match;
+}
+
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples)
 {
 	struct soft_trigger_logic *stl;
+	struct sr_trigger_stage *stage;
+	GSList *l;
+	int i;
 
 	stl = g_malloc0(sizeof(struct soft_trigger_logic));
 	stl->sdi = sdi;
@@ -53,6 +536,10 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 	stl->unitsize = logic_channel_unitsize(sdi->channels);
 	stl->prev_sample = g_malloc0(stl->unitsize);
 	stl->pre_trigger_size = stl->unitsize * pre_trigger_samples;
+	if (sr_session_mem_charge(sdi, stl->pre_trigger_size) != SR_OK) {
+		soft_trigger_logic_free(stl);
+		return NULL;
+	}
 	stl->pre_trigger_buffer = g_try_malloc(stl->pre_trigger_size);
 	if (pre_trigger_samples > 0 && !stl->pre_trigger_buffer) {
 		/*
@@ -60,6 +547,7 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		 * g_try_malloc(0)) *and* more than 0 pretrigger samples
 		 * were requested.
 		 */
+		sr_session_mem_release(sdi, stl->pre_trigger_size);
 		soft_trigger_logic_free(stl);
 		return NULL;
 	}
@@ -70,11 +558,34 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		return NULL;
 	}
 
+	/* Compile the trigger's stages into bit masks. */
+	stl->num_words = (stl->unitsize + 7) / 8;
+	stl->cur_words = g_malloc0(2 * stl->num_words * sizeof(uint64_t));
+	stl->prev_words = stl->cur_words + stl->num_words;
+	stl->num_stages = g_slist_length(trigger->stages);
+	stl->stages = g_malloc0(stl->num_stages * sizeof(*stl->stages));
+	for (l = trigger->stages, i = 0; l; l = l->next, i++) {
+		stage = l->data;
+		if (stage->protocol)
+			compile_protocol(stl, stage, &stl->stages[i]);
+		else
+			compile_stage(stl, stage, &stl->stages[i]);
+	}
+
 	return stl;
 }
 
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
+	int i;
+
+	for (i = 0; i < stl->num_stages; i++)
+		g_free(stl->stages[i].words);
+	g_free(stl->stages);
+	g_free(stl->proto);
+	g_free(stl->cur_words);
+	if (stl->pre_trigger_buffer)
+		sr_session_mem_release(stl->sdi, stl->pre_trigger_size);
 	g_free(stl->pre_trigger_buffer);
 	g_free(stl->prev_sample);
 	g_free(stl);
@@ -110,64 +621,72 @@ static void pre_trigger_append(struct soft_trigger_logic *stl,
 static void pre_trigger_send(struct soft_trigger_logic *stl,
 		int *pre_trigger_samples)
 {
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = stl->unitsize;
+	struct sr_datafeed_packet packets[2];
+	struct sr_datafeed_logic logic[2];
+	uint8_t *start;
+	size_t size;
+	int i, count;
 
 	if (pre_trigger_samples)
-		*pre_trigger_samples = 0;
+		*pre_trigger_samples = stl->pre_trigger_fill / stl->unitsize;
 
-	/* If pre-trigger buffer not full, rewind head to the first valid sample. */
+	/*
+	 * The oldest sample is at the write position when the circular
+	 * buffer is full, and at its start otherwise. Wrap around at the
+	 * end of the buffer. The content is sent in place, as one or two
+	 * packets in a single batch.
+	 */
 	if (stl->pre_trigger_fill < stl->pre_trigger_size)
-		stl->pre_trigger_head = stl->pre_trigger_buffer;
+		start = stl->pre_trigger_buffer;
+	else
+		start = stl->pre_trigger_head;
 
-	/* Send logic packets for the pre-trigger circular buffer content. */
+	count = 0;
 	while (stl->pre_trigger_fill > 0) {
-		size_t size = MIN(stl->pre_trigger_buffer + stl->pre_trigger_size
-		                  - stl->pre_trigger_head, stl->pre_trigger_fill);
-		logic.length = size;
-		logic.data = stl->pre_trigger_head;
-		sr_session_send(stl->sdi, &packet);
-		stl->pre_trigger_head = stl->pre_trigger_buffer;
+		size = MIN(stl->pre_trigger_buffer + stl->pre_trigger_size
+		           - start, stl->pre_trigger_fill);
+		i = count++;
+		logic[i].length = size;
+		logic[i].unitsize = stl->unitsize;
+		logic[i].data = start;
+		packets[i].type = SR_DF_LOGIC;
+		packets[i].payload = &logic[i];
+		start = stl->pre_trigger_buffer;
 		stl->pre_trigger_fill -= size;
-		if (pre_trigger_samples)
-			*pre_trigger_samples += size / stl->unitsize;
 	}
+	stl->pre_trigger_head = stl->pre_trigger_buffer;
+
+	if (count)
+		sr_session_send_batch(stl->sdi, packets, count);
 }
 
-static gboolean logic_check_match(struct soft_trigger_logic *stl,
-		uint8_t *sample, struct sr_trigger_match *match)
+/* Send the pre-trigger data and the trigger, for a match at offset i. */
+static void trigger_fire(struct soft_trigger_logic *stl,
+		uint8_t *buf, int i, int *pre_trigger_samples)
 {
-	int bit, prev_bit;
-	gboolean result;
+	if (stl->frames)
+		std_session_send_df_frame_begin(stl->sdi);
+	pre_trigger_append(stl, buf, i);
+	pre_trigger_send(stl, pre_trigger_samples);
+	std_session_send_df_trigger(stl->sdi);
+}
 
-	stl->count++;
-	result = FALSE;
-	bit = *(sample + match->channel->index / 8)
-			& (1 << (match->channel->index % 8));
-	if (match->match == SR_TRIGGER_ZERO)
-		result = bit == 0;
-	else if (match->match == SR_TRIGGER_ONE)
-		result = bit != 0;
-	else {
-		/* Edge matches. */
-		if (stl->count == 1)
-			/* First sample, don't have enough for an edge match yet. */
-			return FALSE;
-		prev_bit = *(stl->prev_sample + match->channel->index / 8)
-				& (1 << (match->channel->index % 8));
-		if (match->match == SR_TRIGGER_RISING)
-			result = prev_bit == 0 && bit != 0;
-		else if (match->match == SR_TRIGGER_FALLING)
-			result = prev_bit != 0 && bit == 0;
-		else if (match->match == SR_TRIGGER_EDGE)
-			result = prev_bit != bit;
+/* Run the protocol decoder over the samples. */
+static int proto_check(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, int *pre_trigger_samples)
+{
+	int i, end;
+
+	end = len - len % stl->unitsize;
+	for (i = 0; i < end; i += stl->unitsize) {
+		if (!proto_feed(stl->proto, buf + i))
+			continue;
+		trigger_fire(stl, buf, i, pre_trigger_samples);
+		return i / stl->unitsize;
 	}
+	pre_trigger_append(stl, buf, len);
 
-	return result;
+	return -1;
 }
 
 /* Returns the offset (in samples) within buf of where the trigger
@@ -175,47 +694,63 @@ static gboolean logic_check_match(struct soft_trigger_logic *stl,
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		uint8_t *buf, int len, int *pre_trigger_samples)
 {
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *l_stage;
-	int offset;
+	struct soft_trigger_stage *stage;
+	uint64_t *cur, *prev, *tmp;
+	gboolean have_prev, had_prev, match_found;
+	int offset, unitsize, end, last;
 	int i;
-	gboolean match_found;
+
+	if (!stl->num_stages)
+		/* No stages supplied, client error. */
+		return SR_ERR_ARG;
+	if (stl->stages[0].invalid)
+		return SR_ERR_ARG;
+	if (stl->proto)
+		return proto_check(stl, buf, len, pre_trigger_samples);
+
+	unitsize = stl->unitsize;
+	end = len - len % unitsize;
+	cur = stl->cur_words;
+	prev = stl->prev_words;
+	had_prev = have_prev = stl->count > 0;
+	load_sample(stl, stl->prev_sample, prev);
 
 	offset = -1;
-	for (i = 0; i < len; i += stl->unitsize) {
-		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
-		stage = l_stage->data;
-		if (!stage->matches)
+	last = -1;
+	for (i = 0; i < end; i += unitsize) {
+		stage = &stl->stages[stl->cur_stage];
+		if (stage->invalid)
 			/* No matches supplied, client error. */
 			return SR_ERR_ARG;
 
-		match_found = TRUE;
-		for (l = stage->matches; l; l = l->next) {
-			match = l->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			if (!logic_check_match(stl, buf + i, match)) {
-				match_found = FALSE;
+		if (stl->cur_stage == 0 && stl->num_words == 1) {
+			/* Skip ahead to the first sample which may trigger. */
+			i = scan_stage(stl, stage, buf, i, end, prev[0], have_prev);
+			if (i >= end) {
+				last = end - unitsize;
 				break;
 			}
+			load_sample(stl, buf + i, cur);
+			match_found = TRUE;
+		} else {
+			load_sample(stl, buf + i, cur);
+			match_found = stage_match(stl, stage, cur, prev, have_prev);
 		}
-		memcpy(stl->prev_sample, buf + i, stl->unitsize);
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+		have_prev = TRUE;
+		last = i;
+
 		if (match_found) {
 			/* Matched on the current stage. */
-			if (l_stage->next) {
+			if (stl->cur_stage + 1 < stl->num_stages) {
 				/* Advance to next stage. */
 				stl->cur_stage++;
 			} else {
-				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
-				pre_trigger_send(stl, pre_trigger_samples);
-
-				/* Fire trigger. */
-				offset = i / stl->unitsize;
-
-				std_session_send_df_trigger(stl->sdi);
+				/* Matched on last stage, fire the trigger. */
+				trigger_fire(stl, buf, i, pre_trigger_samples);
+				offset = i / unitsize;
 				break;
 			}
 		} else if (stl->cur_stage > 0) {
@@ -228,16 +763,172 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 			 * which the counter increment at the end of the loop
 			 * takes care of.
 			 */
-			i -= stl->cur_stage * stl->unitsize;
-			if (i < -1)
-				i = -1; /* Oops, went back past this buffer. */
+			i -= stl->cur_stage * unitsize;
+			if (i < -unitsize)
+				i = -unitsize; /* Oops, went back past this buffer. */
+			/* Continue edge checks from the sample before. */
+			if (i >= 0) {
+				load_sample(stl, buf + i, prev);
+			} else {
+				load_sample(stl, stl->prev_sample, prev);
+				have_prev = had_prev;
+			}
 			/* Reset trigger stage. */
 			stl->cur_stage = 0;
 		}
 	}
 
+	/* Keep the last inspected sample for edge checks on the next buffer. */
+	if (last >= 0) {
+		memcpy(stl->prev_sample, buf + last, unitsize);
+		stl->count = 1;
+	}
+
 	if (offset == -1)
 		pre_trigger_append(stl, buf, len);
 
 	return offset;
 }
+
+/**
+ * Arm the trigger again, for segmented captures.
+ *
+ * Drivers call this after sending the post-trigger samples of a
+ * segment. The following samples get checked from the first stage on,
+ * with a fresh pre-trigger history, such that segments don't overlap.
+ *
+ * @param stl The soft trigger.
+ * @param last_sample The segment's last sample, which edges of the next
+ *                    one are relative to. Can be NULL.
+ *
+ * @private
+ */
+SR_PRIV void soft_trigger_logic_rearm(struct soft_trigger_logic *stl,
+		const uint8_t *last_sample)
+{
+	unsigned int i;
+
+	stl->cur_stage = 0;
+	stl->pre_trigger_fill = 0;
+	stl->pre_trigger_head = stl->pre_trigger_buffer;
+	if (last_sample) {
+		memcpy(stl->prev_sample, last_sample, stl->unitsize);
+		stl->count = 1;
+	} else {
+		stl->count = 0;
+	}
+
+	/* The decoder didn't see the segment, start over on a new word. */
+	if (stl->proto) {
+		stl->proto->busy = FALSE;
+		stl->proto->num_bits = 0;
+		for (i = 0; i < ARRAY_SIZE(stl->proto->last); i++)
+			stl->proto->last[i] = -1;
+	}
+}
+
+/**
+ * Compile a trigger into the form of a device's hardware trigger.
+ *
+ * Drivers describe what their hardware trigger can evaluate. Triggers
+ * which fit get translated into per stage bit masks for the device's
+ * registers. Drivers which also have soft trigger support fall back to
+ * it for triggers which don't fit, others reject them. Matches on
+ * disabled channels are ignored, as the soft trigger does.
+ *
+ * @param[in] trigger The session's trigger. Can be NULL.
+ * @param[in] caps The hardware trigger's capabilities.
+ * @param[out] stages The compiled stages, caps->max_stages of them.
+ * @param[out] num_stages The number of stages, 0 without a trigger.
+ *
+ * @retval SR_OK The trigger was compiled.
+ * @retval SR_ERR_NA The hardware cannot evaluate the trigger.
+ * @retval SR_ERR_ARG The trigger can never match.
+ *
+ * @private
+ */
+SR_PRIV int sr_trigger_hw_compile(const struct sr_trigger *trigger,
+		const struct sr_trigger_hw_caps *caps,
+		struct sr_trigger_hw_stage *stages, int *num_stages)
+{
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	struct sr_trigger_hw_stage *hw;
+	const GSList *ls, *lm;
+	uint64_t bit;
+	int idx, num_edges;
+
+	*num_stages = 0;
+	if (!trigger || !trigger->stages)
+		return SR_OK;
+
+	if ((int)g_slist_length(trigger->stages) > caps->max_stages) {
+		sr_dbg("Hardware trigger supports %d stage(s).",
+			caps->max_stages);
+		return SR_ERR_NA;
+	}
+
+	for (ls = trigger->stages; ls; ls = ls->next) {
+		stage = ls->data;
+		if (stage->protocol) {
+			sr_dbg("Hardware trigger cannot decode protocols.");
+			return SR_ERR_NA;
+		}
+		hw = &stages[(*num_stages)++];
+		memset(hw, 0, sizeof(*hw));
+		num_edges = 0;
+		for (lm = stage->matches; lm; lm = lm->next) {
+			match = lm->data;
+			if (!match->channel->enabled)
+				continue;
+			idx = match->channel->index;
+			if (match->channel->type != SR_CHANNEL_LOGIC
+					|| idx < 0 || idx >= caps->num_channels
+					|| idx >= 64) {
+				sr_dbg("Hardware trigger cannot check channel %s.",
+					match->channel->name);
+				return SR_ERR_NA;
+			}
+			if (!(caps->matches & (1 << match->match))) {
+				sr_dbg("Hardware trigger lacks match type %d.",
+					match->match);
+				return SR_ERR_NA;
+			}
+			bit = UINT64_C(1) << idx;
+			if (hw->mask & bit) {
+				sr_err("Conflicting conditions on channel %s.",
+					match->channel->name);
+				return SR_ERR_ARG;
+			}
+			hw->mask |= bit;
+			switch (match->match) {
+			case SR_TRIGGER_ONE:
+				hw->values |= bit;
+				break;
+			case SR_TRIGGER_RISING:
+				hw->values |= bit;
+				hw->edge_mask |= bit;
+				num_edges++;
+				break;
+			case SR_TRIGGER_FALLING:
+				hw->edge_mask |= bit;
+				num_edges++;
+				break;
+			case SR_TRIGGER_EDGE:
+				hw->edge_mask |= bit;
+				hw->any_edge_mask |= bit;
+				num_edges++;
+				break;
+			default:
+				break;
+			}
+		}
+		if (caps->max_edges && num_edges > caps->max_edges) {
+			sr_dbg("Hardware trigger supports %d edge(s) per stage.",
+				caps->max_edges);
+			return SR_ERR_NA;
+		}
+	}
+
+	return SR_OK;
+}
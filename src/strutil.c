@@ -35,6 +35,8 @@
 #include <string.h>
 #include <strings.h>
 #include <errno.h>
+#include <float.h>
+#include <math.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -294,6 +296,104 @@ SR_PRIV int sr_atof(const char *str, float *ret)
 	return SR_OK;
 }
 
+/*
+ * Fast path for the conversion of plain decimal text to a double.
+ *
+ * Handles "[ws][sign]digits[.digits][(e|E)[sign]digits]" when the
+ * significand fits 2^53 and the decimal exponent is in the range of
+ * exactly representable powers of ten. A single IEEE multiplication
+ * or division of two exact operands is then correctly rounded (Clinger's
+ * fast path), and yields the very same result as strtod() does. Returns
+ * FALSE for any other input, which callers pass to the full conversion.
+ */
+static const double pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22,
+};
+
+static gboolean atod_fast_path(const char *str, double *ret)
+{
+	const char *p;
+	gboolean negative, exp_negative, have_digits;
+	uint64_t mant;
+	int digits, exp, exp_val;
+	double value;
+
+	/* Excess precision (x87) would round twice, use the full path. */
+	if (FLT_EVAL_METHOD != 0)
+		return FALSE;
+
+	p = str;
+	while (g_ascii_isspace(*p))
+		p++;
+	negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	/* Significand, leading zeros are not significant. */
+	mant = 0;
+	digits = 0;
+	exp = 0;
+	have_digits = FALSE;
+	for (; g_ascii_isdigit(*p); p++) {
+		have_digits = TRUE;
+		if (!mant && *p == '0')
+			continue;
+		if (++digits > 19)
+			return FALSE;
+		mant = mant * 10 + (*p - '0');
+	}
+	if (*p == '.') {
+		for (p++; g_ascii_isdigit(*p); p++) {
+			have_digits = TRUE;
+			exp--;
+			if (!mant && *p == '0')
+				continue;
+			if (++digits > 19)
+				return FALSE;
+			mant = mant * 10 + (*p - '0');
+		}
+	}
+	if (!have_digits)
+		return FALSE;
+
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		exp_negative = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+		if (!g_ascii_isdigit(*p))
+			return FALSE;
+		exp_val = 0;
+		for (; g_ascii_isdigit(*p); p++) {
+			if (exp_val > 9999)
+				return FALSE;
+			exp_val = exp_val * 10 + (*p - '0');
+		}
+		exp += exp_negative ? -exp_val : exp_val;
+	}
+	if (*p)
+		return FALSE;
+
+	if (!mant) {
+		value = 0.0;
+	} else {
+		if (mant > (UINT64_C(1) << 53))
+			return FALSE;
+		if (exp < -22 || exp > 22)
+			return FALSE;
+		value = mant;
+		if (exp < 0)
+			value /= pow10[-exp];
+		else
+			value *= pow10[exp];
+	}
+	*ret = negative ? -value : value;
+
+	return TRUE;
+}
+
 /**
  * Convert a string representation of a numeric value to a double. The
  * conversion is strict and will fail if the complete string does not represent
@@ -314,6 +414,8 @@ SR_PRIV int sr_atod_ascii(const char *str, double *ret)
 	char *endptr = NULL;
 
 	errno = 0;
+	if (atod_fast_path(str, ret))
+		return SR_OK;
 	tmp = g_ascii_strtod(str, &endptr);
 
 	if (!endptr || *endptr || errno) {
@@ -417,6 +519,10 @@ SR_PRIV int sr_atof_ascii(const char *str, float *ret)
 	char *endptr = NULL;
 
 	errno = 0;
+	if (atod_fast_path(str, &tmp)) {
+		*ret = (float)tmp;
+		return SR_OK;
+	}
 	tmp = g_ascii_strtod(str, &endptr);
 
 	if (!endptr || *endptr || errno) {
@@ -439,6 +545,135 @@ SR_PRIV int sr_atof_ascii(const char *str, float *ret)
 	return SR_OK;
 }
 
+/*
+ * Get the double which the text "mant * 10^exp" converts to, in the
+ * fast path's range. Returns FALSE when that's not exactly known.
+ */
+static gboolean ftoa_candidate(uint64_t mant, int exp, double *ret)
+{
+	if (exp < -22 || exp > 22 || mant > (UINT64_C(1) << 53))
+		return FALSE;
+	if (exp < 0)
+		*ret = mant / pow10[-exp];
+	else
+		*ret = mant * pow10[exp];
+
+	return TRUE;
+}
+
+/* Print "mant * 10^exp" like "%g" does, without trailing zeros. */
+static int ftoa_print(char *buf, gboolean negative, uint64_t mant, int exp)
+{
+	char digits[24], *p;
+	int count, dexp, i;
+
+	while (mant && mant % 10 == 0) {
+		mant /= 10;
+		exp++;
+	}
+	count = 0;
+	do {
+		digits[count++] = '0' + mant % 10;
+		mant /= 10;
+	} while (mant);
+	/* Decimal exponent of the leading digit. */
+	dexp = exp + count - 1;
+
+	p = buf;
+	if (negative)
+		*p++ = '-';
+	if (dexp < -4 || dexp >= 9) {
+		*p++ = digits[--count];
+		if (count)
+			*p++ = '.';
+		while (count)
+			*p++ = digits[--count];
+		*p++ = 'e';
+		if (dexp < 0) {
+			*p++ = '-';
+			dexp = -dexp;
+		}
+		if (dexp >= 10)
+			*p++ = '0' + dexp / 10;
+		*p++ = '0' + dexp % 10;
+	} else if (dexp < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = -1; i > dexp; i--)
+			*p++ = '0';
+		while (count)
+			*p++ = digits[--count];
+	} else {
+		for (i = 0; i <= dexp; i++)
+			*p++ = count ? digits[--count] : '0';
+		if (count)
+			*p++ = '.';
+		while (count)
+			*p++ = digits[--count];
+	}
+	*p = '\0';
+
+	return p - buf;
+}
+
+/**
+ * Print a float with the fewest decimal digits which read back as the
+ * very same float value. This version ignores the locale.
+ *
+ * Reading the text back with sr_atod_ascii() or strtod(), and casting
+ * to float, yields the input value. The text is at most 15 characters
+ * long, and often much shorter than the "%.9g" format's, which always
+ * yields the same guarantee. Common values avoid printf() completely.
+ *
+ * @param[out] buf The output buffer, which holds at least
+ *                 SR_FTOA_BUFSIZE characters.
+ * @param[in] value The value to print.
+ *
+ * @return The text length, excluding the terminating NUL character.
+ *
+ * @private
+ */
+SR_PRIV int sr_ftoa_shortest(char *buf, float value)
+{
+	double mag, scaled, cand_lo, cand_hi;
+	uint64_t mant;
+	int dexp, prec, exp;
+	gboolean lo_ok, hi_ok;
+
+	if (value == 0.0f)
+		return ftoa_print(buf, signbit(value), 0, 0);
+	if (!isfinite(value))
+		goto fallback;
+
+	mag = fabs((double)value);
+	dexp = (int)floor(log10(mag));
+	for (prec = 1; prec <= 9; prec++) {
+		/*
+		 * The two candidates around the scaled value. Their exact
+		 * decimal to double conversion tells which of them read
+		 * back as the input value.
+		 */
+		exp = dexp - prec + 1;
+		if (exp < -22 || exp > 22)
+			goto fallback;
+		scaled = exp < 0 ? mag * pow10[-exp] : mag / pow10[exp];
+		mant = (uint64_t)floor(scaled);
+		lo_ok = ftoa_candidate(mant, exp, &cand_lo)
+			&& (float)cand_lo == (float)mag;
+		hi_ok = ftoa_candidate(mant + 1, exp, &cand_hi)
+			&& (float)cand_hi == (float)mag;
+		if (lo_ok && (!hi_ok || mag - cand_lo <= cand_hi - mag))
+			return ftoa_print(buf, value < 0, mant, exp);
+		if (hi_ok)
+			return ftoa_print(buf, value < 0, mant + 1, exp);
+	}
+
+fallback:
+	g_ascii_formatd(buf, SR_FTOA_BUFSIZE, "%.9g", value);
+
+	return strlen(buf);
+}
+
 /**
  * Compose a string with a format string in the buffer pointed to by buf.
  *
@@ -27,11 +27,30 @@
 #include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "sw_limits"
 
+/*
+ * Time in us for the acquisition time limit. Drivers check limits per
+ * received packet or sample, a coarse clock avoids the cost of a precise
+ * clock read where it is available. Its resolution of a few ms is good
+ * enough for limits in ms.
+ */
+static uint64_t sw_limits_time(void)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+
+	return g_get_monotonic_time();
+}
+
 /**
  * Initialize a software limit instance
  *
@@ -120,7 +139,10 @@ SR_PRIV void sr_sw_limits_acquisition_start(struct sr_sw_limits *limits)
 {
 	limits->samples_read = 0;
 	limits->frames_read = 0;
-	limits->start_time = g_get_monotonic_time();
+	limits->start_time = sw_limits_time();
+	limits->deadline = 0;
+	if (limits->limit_msec)
+		limits->deadline = limits->start_time + limits->limit_msec;
 }
 
 /**
@@ -151,15 +173,10 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits)
 		}
 	}
 
-	if (limits->limit_msec && limits->start_time) {
-		guint64 now;
-		now = g_get_monotonic_time();
-		if (now > limits->start_time &&
-			now - limits->start_time > limits->limit_msec) {
-			sr_dbg("Requested sampling time (%" PRIu64
-			       "ms) reached.", limits->limit_msec / 1000);
-			return TRUE;
-		}
+	if (limits->deadline && sw_limits_time() > limits->deadline) {
+		sr_dbg("Requested sampling time (%" PRIu64
+		       "ms) reached.", limits->limit_msec / 1000);
+		return TRUE;
 	}
 
 	return FALSE;
@@ -230,7 +247,7 @@ SR_PRIV int sr_sw_limits_get_remain(const struct sr_sw_limits *limits,
 			break;
 		if (!limits->start_time)
 			break;
-		now = g_get_monotonic_time();
+		now = sw_limits_time();
 		if (now < limits->start_time)
 			break;
 		elapsed = now - limits->start_time;
@@ -246,6 +263,26 @@ SR_PRIV int sr_sw_limits_get_remain(const struct sr_sw_limits *limits,
 	return SR_OK;
 }
 
+/**
+ * Get the number of samples which may be sent until the sample limit.
+ *
+ * Drivers which receive blocks of samples can size their packets with
+ * it, instead of checking the limit per sample.
+ *
+ * @param limits software limits instance
+ * @returns the remaining sample count, 0 when the limit was reached, or
+ *          UINT64_MAX when no sample limit is set.
+ */
+SR_PRIV uint64_t sr_sw_limits_samples_remain(const struct sr_sw_limits *limits)
+{
+	if (!limits->limit_samples)
+		return UINT64_MAX;
+	if (limits->samples_read >= limits->limit_samples)
+		return 0;
+
+	return limits->limit_samples - limits->samples_read;
+}
+
 /**
  * Update the amount of samples that have been read
  *
@@ -0,0 +1,288 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "trace"
+
+/**
+ * @file
+ *
+ * Tracing of acquisitions, for profiling.
+ *
+ * When the SIGROK_TRACE environment variable names a file, the USB
+ * transfers and the session's packet dispatch get recorded as timestamped
+ * events. The events go to a ring buffer, which keeps the most recent
+ * SIGROK_TRACE_EVENTS of them (default DEFAULT_TRACE_EVENTS). When the
+ * last libsigrok context exits, they get written to the file in the
+ * Chrome trace event format, which chrome://tracing and Perfetto load.
+ *
+ * Adding an event takes no lock. Writers which race for a slot after
+ * the ring wrapped around may garble that one event.
+ */
+
+#define DEFAULT_TRACE_EVENTS (256 * 1024)
+
+struct trace_event {
+	const char *name;
+	const char *arg_name;
+	int64_t arg;
+	int64_t ts;
+	int64_t dur;
+	const void *id;
+	unsigned int tid;
+	char phase;
+};
+
+/* Whether tracing is on, tested by sr_trace_enabled(). */
+SR_PRIV gboolean sr_trace_on;
+
+static char *trace_path;
+static struct trace_event *trace_events;
+static unsigned int trace_size;
+static unsigned int trace_head;
+static int trace_users;
+static int64_t trace_start;
+static int trace_next_tid;
+static GPrivate trace_tid;
+G_LOCK_DEFINE_STATIC(trace);
+
+/**
+ * Set up tracing when the environment asks for it.
+ *
+ * Every sr_init() calls this, and every sr_exit() calls sr_trace_exit().
+ *
+ * @private
+ */
+SR_PRIV void sr_trace_init(void)
+{
+	const char *path, *events;
+	uint64_t size;
+
+	G_LOCK(trace);
+	if (trace_users++ || !(path = g_getenv("SIGROK_TRACE")) || !*path) {
+		G_UNLOCK(trace);
+		return;
+	}
+
+	size = DEFAULT_TRACE_EVENTS;
+	events = g_getenv("SIGROK_TRACE_EVENTS");
+	if (events && *events)
+		size = MAX(g_ascii_strtoull(events, NULL, 10), 1);
+	/* A power of two, the ring index wraps around with the counter. */
+	size = MIN(size, (uint64_t)1 << 30);
+	trace_size = 1;
+	while (trace_size < size)
+		trace_size <<= 1;
+
+	trace_events = g_try_malloc0_n(trace_size, sizeof(*trace_events));
+	if (!trace_events) {
+		sr_err("Cannot allocate %u trace events.", trace_size);
+		G_UNLOCK(trace);
+		return;
+	}
+	trace_path = g_strdup(path);
+	trace_head = 0;
+	trace_start = g_get_monotonic_time();
+	sr_info("Tracing up to %u events to '%s'.", trace_size, trace_path);
+	sr_trace_on = TRUE;
+	G_UNLOCK(trace);
+}
+
+static void trace_write_event(FILE *file, const struct trace_event *ev,
+		gboolean first)
+{
+	fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"sigrok\",\"ph\":\"%c\","
+		"\"ts\":%" PRIi64 ",\"pid\":1,\"tid\":%u",
+		first ? "" : ",", ev->name, ev->phase,
+		ev->ts - trace_start, ev->tid);
+	if (ev->phase == 'X')
+		fprintf(file, ",\"dur\":%" PRIi64, ev->dur);
+	else if (ev->phase == 'i')
+		fprintf(file, ",\"s\":\"t\"");
+	else
+		fprintf(file, ",\"id\":\"%p\"", ev->id);
+	if (ev->arg_name)
+		fprintf(file, ",\"args\":{\"%s\":%" PRIi64 "}",
+			ev->arg_name, ev->arg);
+	fprintf(file, "}");
+}
+
+static void trace_write(void)
+{
+	FILE *file;
+	unsigned int head, count, i;
+	gboolean first;
+
+	if (!(file = g_fopen(trace_path, "w"))) {
+		sr_err("Cannot write trace to '%s': %s.", trace_path,
+			g_strerror(errno));
+		return;
+	}
+
+	head = (unsigned int)g_atomic_int_get(&trace_head);
+	count = MIN(head, trace_size);
+	if (head > trace_size)
+		sr_warn("Trace ring wrapped around, %u events got lost.",
+			head - trace_size);
+
+	fprintf(file, "{\"traceEvents\":[");
+	first = TRUE;
+	for (i = head - count; i != head; i++) {
+		if (!trace_events[i & (trace_size - 1)].name)
+			continue;
+		trace_write_event(file, &trace_events[i & (trace_size - 1)],
+			first);
+		first = FALSE;
+	}
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0)
+		sr_err("Failed to write trace to '%s'.", trace_path);
+	else
+		sr_info("Wrote %u trace events to '%s'.", count, trace_path);
+}
+
+/**
+ * Write the trace when the last user is gone, and stop tracing.
+ *
+ * @private
+ */
+SR_PRIV void sr_trace_exit(void)
+{
+	G_LOCK(trace);
+	if (--trace_users || !sr_trace_on) {
+		G_UNLOCK(trace);
+		return;
+	}
+
+	sr_trace_on = FALSE;
+	trace_write();
+	g_free(trace_events);
+	trace_events = NULL;
+	g_free(trace_path);
+	trace_path = NULL;
+	G_UNLOCK(trace);
+}
+
+/* Small per-thread numbers read better than system thread IDs. */
+static unsigned int trace_thread_id(void)
+{
+	void *tid;
+
+	if (!(tid = g_private_get(&trace_tid))) {
+		tid = GINT_TO_POINTER(g_atomic_int_add(&trace_next_tid, 1) + 1);
+		g_private_set(&trace_tid, tid);
+	}
+
+	return GPOINTER_TO_UINT(tid);
+}
+
+static void trace_add(char phase, const char *name, int64_t ts, int64_t dur,
+		const void *id, const char *arg_name, int64_t arg)
+{
+	struct trace_event *ev;
+	unsigned int slot;
+
+	if (!sr_trace_on)
+		return;
+
+	slot = (unsigned int)g_atomic_int_add(&trace_head, 1);
+	ev = &trace_events[slot & (trace_size - 1)];
+	ev->name = name;
+	ev->arg_name = arg_name;
+	ev->arg = arg;
+	ev->ts = ts;
+	ev->dur = dur;
+	ev->id = id;
+	ev->tid = trace_thread_id();
+	ev->phase = phase;
+}
+
+/**
+ * Get the start time of a span, see sr_trace_span().
+ *
+ * @return The current time in µs, or 0 when tracing is off.
+ *
+ * @private
+ */
+SR_PRIV int64_t sr_trace_now(void)
+{
+	return sr_trace_on ? g_get_monotonic_time() : 0;
+}
+
+/**
+ * Trace a span of work on the calling thread, which ends now.
+ *
+ * @param name The event name, must be a static string.
+ * @param start The start time from sr_trace_now(). Nothing gets traced
+ *              when it is 0.
+ * @param arg_name The name of the argument, a static string. Can be NULL.
+ * @param arg The argument value.
+ *
+ * @private
+ */
+SR_PRIV void sr_trace_span(const char *name, int64_t start,
+		const char *arg_name, int64_t arg)
+{
+	if (!start)
+		return;
+
+	trace_add('X', name, start, g_get_monotonic_time() - start, NULL,
+		arg_name, arg);
+}
+
+/**
+ * Trace an instant on the calling thread.
+ *
+ * @param name The event name, must be a static string.
+ * @param arg_name The name of the argument, a static string. Can be NULL.
+ * @param arg The argument value.
+ *
+ * @private
+ */
+SR_PRIV void sr_trace_instant(const char *name, const char *arg_name,
+		int64_t arg)
+{
+	trace_add('i', name, g_get_monotonic_time(), 0, NULL, arg_name, arg);
+}
+
+/**
+ * Trace the begin or end of an operation which spans threads or
+ * callbacks, such as a USB transfer in flight.
+ *
+ * @param name The event name, must be a static string. Must be the same
+ *             for the begin and the end.
+ * @param begin TRUE for the begin, FALSE for the end.
+ * @param id Identifies the operation, e.g. the transfer.
+ * @param arg_name The name of the argument, a static string. Can be NULL.
+ * @param arg The argument value.
+ *
+ * @private
+ */
+SR_PRIV void sr_trace_async(const char *name, gboolean begin, const void *id,
+		const char *arg_name, int64_t arg)
+{
+	trace_add(begin ? 'b' : 'e', name, g_get_monotonic_time(), 0, id,
+		arg_name, arg);
+}
@@ -0,0 +1,586 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/decimate"
+
+/* Analog values which get converted to float in one go on the stack. */
+#define CONVERT_BLOCK_SIZE 256
+
+enum analog_mode {
+	ANALOG_MEAN,
+	ANALOG_MIN,
+	ANALOG_MAX,
+	ANALOG_ENVELOPE,
+};
+
+enum logic_mode {
+	LOGIC_FIRST,
+	LOGIC_OR,
+	LOGIC_AND,
+	LOGIC_EDGE,
+};
+
+static const char *analog_modes[] = {
+	[ANALOG_MEAN] = "mean",
+	[ANALOG_MIN] = "min",
+	[ANALOG_MAX] = "max",
+	[ANALOG_ENVELOPE] = "envelope",
+};
+
+static const char *logic_modes[] = {
+	[LOGIC_FIRST] = "first",
+	[LOGIC_OR] = "or",
+	[LOGIC_AND] = "and",
+	[LOGIC_EDGE] = "edge",
+};
+
+/* A bucket in progress, for one analog channel. */
+struct analog_bucket {
+	double sum;
+	float min, max;
+};
+
+/*
+ * Buckets of the channels which come in the same packets, identified
+ * by their first channel.
+ */
+struct analog_state {
+	struct sr_channel *ch;
+	unsigned int num_channels;
+	uint64_t count;
+	struct analog_bucket *buckets;
+};
+
+struct context {
+	enum analog_mode analog_mode;
+	enum logic_mode logic_mode;
+	uint64_t analog_size;
+	uint64_t logic_size;
+	uint64_t rate_div;
+	uint64_t rate_mult;
+
+	GSList *analog_states;
+	float *analog_buffer;
+	size_t analog_buffer_size;
+
+	/* The logic bucket in progress, and its samples so far. */
+	uint16_t unitsize;
+	uint64_t logic_count;
+	uint8_t *logic_first;
+	uint8_t *logic_acc;
+	uint8_t *logic_buffer;
+	size_t logic_buffer_size;
+
+	GSList *meta_config;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_packet packet;
+};
+
+static int find_mode(const char *name, const char **modes, int num_modes)
+{
+	int i;
+
+	for (i = 0; i < num_modes; i++) {
+		if (!g_ascii_strcasecmp(name, modes[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *name;
+	uint64_t factor;
+	int analog_mode, logic_mode;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	factor = g_variant_get_uint64(g_hash_table_lookup(options, "factor"));
+	name = g_variant_get_string(g_hash_table_lookup(options, "analog"), NULL);
+	analog_mode = find_mode(name, analog_modes, ARRAY_SIZE(analog_modes));
+	if (analog_mode < 0) {
+		sr_err("Unknown analog mode '%s'.", name);
+		return SR_ERR_ARG;
+	}
+	name = g_variant_get_string(g_hash_table_lookup(options, "logic"), NULL);
+	logic_mode = find_mode(name, logic_modes, ARRAY_SIZE(logic_modes));
+	if (logic_mode < 0) {
+		sr_err("Unknown logic mode '%s'.", name);
+		return SR_ERR_ARG;
+	}
+	if (!factor || (analog_mode == ANALOG_ENVELOPE && factor % 2)) {
+		sr_err("Invalid factor %" PRIu64 ".", factor);
+		return SR_ERR_ARG;
+	}
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->analog_mode = analog_mode;
+	ctx->logic_mode = logic_mode;
+
+	/*
+	 * The envelope has a minimum and a maximum per bucket, which is
+	 * twice the rate. Logic data then gets decimated by half the
+	 * factor, so that all data keeps the same samplerate.
+	 */
+	ctx->analog_size = factor;
+	if (analog_mode == ANALOG_ENVELOPE) {
+		ctx->logic_size = factor / 2;
+		ctx->rate_mult = 2;
+	} else {
+		ctx->logic_size = factor;
+		ctx->rate_mult = 1;
+	}
+	ctx->rate_div = factor;
+
+	return SR_OK;
+}
+
+static struct analog_state *analog_state_get(struct context *ctx,
+		GSList *channels)
+{
+	struct analog_state *st;
+	GSList *l;
+
+	st = NULL;
+	for (l = ctx->analog_states; l; l = l->next) {
+		st = l->data;
+		if (st->ch == channels->data)
+			break;
+	}
+	if (l && st->num_channels == g_slist_length(channels))
+		return st;
+
+	/* A new set of channels, or a different one from before. */
+	if (l) {
+		ctx->analog_states = g_slist_remove(ctx->analog_states, st);
+		g_free(st->buckets);
+		g_free(st);
+	}
+	st = g_malloc0(sizeof(*st));
+	st->ch = channels->data;
+	st->num_channels = g_slist_length(channels);
+	st->buckets = g_malloc0(st->num_channels * sizeof(st->buckets[0]));
+	ctx->analog_states = g_slist_prepend(ctx->analog_states, st);
+
+	return st;
+}
+
+static void analog_bucket_reset(struct analog_state *st)
+{
+	unsigned int c;
+
+	for (c = 0; c < st->num_channels; c++) {
+		st->buckets[c].sum = 0;
+		st->buckets[c].min = G_MAXFLOAT;
+		st->buckets[c].max = -G_MAXFLOAT;
+	}
+	st->count = 0;
+}
+
+/* Write the finished buckets' values, return the number of samples. */
+static unsigned int analog_bucket_emit(const struct context *ctx,
+		const struct analog_state *st, float *out)
+{
+	unsigned int c, n;
+
+	n = st->num_channels;
+	for (c = 0; c < n; c++) {
+		switch (ctx->analog_mode) {
+		case ANALOG_MEAN:
+			out[c] = st->buckets[c].sum / st->count;
+			break;
+		case ANALOG_MIN:
+			out[c] = st->buckets[c].min;
+			break;
+		case ANALOG_MAX:
+			out[c] = st->buckets[c].max;
+			break;
+		case ANALOG_ENVELOPE:
+			out[c] = st->buckets[c].min;
+			out[n + c] = st->buckets[c].max;
+			break;
+		}
+	}
+
+	return ctx->analog_mode == ANALOG_ENVELOPE ? 2 : 1;
+}
+
+static int decimate_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct sr_datafeed_analog block;
+	struct analog_state *st;
+	struct analog_bucket *b;
+	float values[CONVERT_BLOCK_SIZE];
+	float *out;
+	uint64_t done, num_samples, out_samples;
+	size_t size, n, i;
+	unsigned int c, nch;
+	float v;
+
+	if (!analog->meaning->channels || !analog->num_samples)
+		return SR_OK;
+
+	st = analog_state_get(ctx, analog->meaning->channels);
+	if (!st->count)
+		analog_bucket_reset(st);
+	nch = st->num_channels;
+	if (nch > CONVERT_BLOCK_SIZE) {
+		sr_err("Too many channels in one packet.");
+		return SR_ERR;
+	}
+
+	/* Room for every bucket which can complete in this packet. */
+	num_samples = analog->num_samples;
+	out_samples = (st->count + num_samples) / ctx->analog_size
+		* ctx->rate_mult;
+	size = out_samples * nch * sizeof(float);
+	if (size > ctx->analog_buffer_size) {
+		out = g_try_realloc(ctx->analog_buffer, size);
+		if (!out) {
+			sr_err("Cannot allocate decimation buffer.");
+			return SR_ERR_MALLOC;
+		}
+		ctx->analog_buffer = out;
+		ctx->analog_buffer_size = size;
+	}
+
+	out = ctx->analog_buffer;
+	block = *analog;
+	for (done = 0; done < num_samples; done += n) {
+		n = MIN(num_samples - done, CONVERT_BLOCK_SIZE / nch);
+		block.data = (uint8_t *)analog->data +
+			done * nch * analog->encoding->unitsize;
+		block.num_samples = n;
+		if (sr_analog_to_float(&block, values) != SR_OK)
+			return SR_ERR;
+		for (i = 0; i < n; i++) {
+			for (c = 0; c < nch; c++) {
+				v = values[i * nch + c];
+				b = &st->buckets[c];
+				b->sum += v;
+				if (v < b->min)
+					b->min = v;
+				if (v > b->max)
+					b->max = v;
+			}
+			if (++st->count == ctx->analog_size) {
+				out += analog_bucket_emit(ctx, st, out) * nch;
+				analog_bucket_reset(st);
+			}
+		}
+	}
+
+	if (!out_samples) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+
+	/* Float values of the same quantity, on the same channels. */
+	ctx->encoding = *analog->encoding;
+	ctx->encoding.unitsize = sizeof(float);
+	ctx->encoding.is_signed = TRUE;
+	ctx->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	ctx->encoding.is_bigendian = TRUE;
+#else
+	ctx->encoding.is_bigendian = FALSE;
+#endif
+	sr_rational_set(&ctx->encoding.scale, 1, 1);
+	sr_rational_set(&ctx->encoding.offset, 0, 1);
+	ctx->meaning = *analog->meaning;
+	ctx->spec = *analog->spec;
+	ctx->analog.data = ctx->analog_buffer;
+	ctx->analog.num_samples = out_samples;
+	ctx->analog.encoding = &ctx->encoding;
+	ctx->analog.meaning = &ctx->meaning;
+	ctx->analog.spec = &ctx->spec;
+	ctx->packet.type = SR_DF_ANALOG;
+	ctx->packet.payload = &ctx->analog;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static void logic_bucket_start(struct context *ctx, const uint8_t *sample)
+{
+	memcpy(ctx->logic_first, sample, ctx->unitsize);
+	if (ctx->logic_mode == LOGIC_EDGE)
+		memset(ctx->logic_acc, 0, ctx->unitsize);
+	else
+		memcpy(ctx->logic_acc, sample, ctx->unitsize);
+}
+
+static void logic_bucket_add(struct context *ctx, const uint8_t *sample)
+{
+	uint8_t *acc, *first;
+	unsigned int j;
+
+	acc = ctx->logic_acc;
+	first = ctx->logic_first;
+	switch (ctx->logic_mode) {
+	case LOGIC_FIRST:
+		break;
+	case LOGIC_OR:
+		for (j = 0; j < ctx->unitsize; j++)
+			acc[j] |= sample[j];
+		break;
+	case LOGIC_AND:
+		for (j = 0; j < ctx->unitsize; j++)
+			acc[j] &= sample[j];
+		break;
+	case LOGIC_EDGE:
+		/* The bits which changed anywhere in the bucket. */
+		for (j = 0; j < ctx->unitsize; j++)
+			acc[j] |= sample[j] ^ first[j];
+		break;
+	}
+}
+
+static void logic_bucket_emit(const struct context *ctx, uint8_t *out)
+{
+	unsigned int j;
+
+	/* A bit which toggled takes the level after its first edge. */
+	if (ctx->logic_mode == LOGIC_EDGE) {
+		for (j = 0; j < ctx->unitsize; j++)
+			out[j] = ctx->logic_first[j] ^ ctx->logic_acc[j];
+	} else {
+		memcpy(out, ctx->logic_acc, ctx->unitsize);
+	}
+}
+
+static int decimate_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic,
+		struct sr_datafeed_packet **packet_out)
+{
+	const uint8_t *rp;
+	uint8_t *wp;
+	uint64_t num_samples, out_samples, i;
+	size_t size;
+
+	if (!logic->unitsize)
+		return SR_OK;
+
+	if (logic->unitsize != ctx->unitsize) {
+		ctx->unitsize = logic->unitsize;
+		ctx->logic_count = 0;
+		ctx->logic_first = g_realloc(ctx->logic_first, ctx->unitsize);
+		ctx->logic_acc = g_realloc(ctx->logic_acc, ctx->unitsize);
+	}
+
+	num_samples = logic->length / logic->unitsize;
+	out_samples = (ctx->logic_count + num_samples) / ctx->logic_size;
+	size = out_samples * ctx->unitsize;
+	if (size > ctx->logic_buffer_size) {
+		wp = g_try_realloc(ctx->logic_buffer, size);
+		if (!wp) {
+			sr_err("Cannot allocate decimation buffer.");
+			return SR_ERR_MALLOC;
+		}
+		ctx->logic_buffer = wp;
+		ctx->logic_buffer_size = size;
+	}
+
+	rp = logic->data;
+	wp = ctx->logic_buffer;
+	for (i = 0; i < num_samples; i++, rp += ctx->unitsize) {
+		if (!ctx->logic_count)
+			logic_bucket_start(ctx, rp);
+		else
+			logic_bucket_add(ctx, rp);
+		if (++ctx->logic_count == ctx->logic_size) {
+			logic_bucket_emit(ctx, wp);
+			wp += ctx->unitsize;
+			ctx->logic_count = 0;
+		}
+	}
+
+	if (!out_samples) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+
+	ctx->logic.length = size;
+	ctx->logic.unitsize = ctx->unitsize;
+	ctx->logic.data = ctx->logic_buffer;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+/* Pass on the metadata, with the samplerate after decimation. */
+static void decimate_meta(struct context *ctx,
+		const struct sr_datafeed_meta *meta,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct sr_config *src;
+	GVariant *data;
+	GSList *l;
+
+	g_slist_free_full(ctx->meta_config, (GDestroyNotify)sr_config_free);
+	ctx->meta_config = NULL;
+
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			data = g_variant_new_uint64(g_variant_get_uint64(src->data)
+				* ctx->rate_mult / ctx->rate_div);
+		else
+			data = g_variant_ref(src->data);
+		ctx->meta_config = g_slist_append(ctx->meta_config,
+			sr_config_new(src->key, data));
+		g_variant_unref(data);
+	}
+
+	ctx->meta.config = ctx->meta_config;
+	ctx->packet.type = SR_DF_META;
+	ctx->packet.payload = &ctx->meta;
+	*packet_out = &ctx->packet;
+}
+
+/* Start over at frame boundaries, partial buckets get dropped. */
+static void reset(struct context *ctx)
+{
+	struct analog_state *st;
+	GSList *l;
+
+	for (l = ctx->analog_states; l; l = l->next) {
+		st = l->data;
+		st->count = 0;
+	}
+	ctx->logic_count = 0;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+
+	switch (packet_in->type) {
+	case SR_DF_ANALOG:
+		return decimate_analog(ctx, packet_in->payload, packet_out);
+	case SR_DF_LOGIC:
+		return decimate_logic(ctx, packet_in->payload, packet_out);
+	case SR_DF_META:
+		decimate_meta(ctx, packet_in->payload, packet_out);
+		break;
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
+	case SR_DF_END:
+		reset(ctx);
+		break;
+	default:
+		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
+		break;
+	}
+
+	return SR_OK;
+}
+
+static void analog_state_free(void *data)
+{
+	struct analog_state *st;
+
+	st = data;
+	g_free(st->buckets);
+	g_free(st);
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_slist_free_full(ctx->analog_states, analog_state_free);
+	g_slist_free_full(ctx->meta_config, (GDestroyNotify)sr_config_free);
+	g_free(ctx->analog_buffer);
+	g_free(ctx->logic_first);
+	g_free(ctx->logic_acc);
+	g_free(ctx->logic_buffer);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "factor", "Factor", "Number of samples which become one", NULL, NULL },
+	{ "analog", "Analog", "Analog values per bucket: mean, min, max, or envelope (min and max)", NULL, NULL },
+	{ "logic", "Logic", "Logic values per bucket: first, or, and, or edge (level after a channel's first edge)", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	GSList *l;
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(16));
+		options[1].def = g_variant_ref_sink(g_variant_new_string("mean"));
+		l = NULL;
+		for (i = 0; i < ARRAY_SIZE(analog_modes); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(analog_modes[i])));
+		options[1].values = l;
+		options[2].def = g_variant_ref_sink(g_variant_new_string("first"));
+		l = NULL;
+		for (i = 0; i < ARRAY_SIZE(logic_modes); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(logic_modes[i])));
+		options[2].values = l;
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_decimate = {
+	.id = "decimate",
+	.name = "Decimate",
+	.desc = "Reduce the samplerate, keeping averages or envelopes",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,313 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/mask"
+
+/* Number of logic channels which the masks can address. */
+#define MAX_CHANNELS 64
+
+struct context {
+	uint64_t invert;
+	uint64_t mask;
+	gboolean repack;
+	/* Per-byte form of the masks, for the first bytes of a sample. */
+	uint8_t invert_bytes[MAX_CHANNELS / 8];
+	uint8_t mask_bytes[MAX_CHANNELS / 8];
+	/* Source bit position of each output channel when repacking. */
+	unsigned int num_channels;
+	unsigned int src_bits[MAX_CHANNELS];
+	/* Set when each output byte is a complete source byte. */
+	gboolean byte_aligned;
+	/*
+	 * Bit gather tables for other selections, one per source byte
+	 * which holds selected channels. An entry holds the packed bits
+	 * which the (inverted) source byte's value contributes.
+	 */
+	unsigned int num_gather;
+	unsigned int gather_byte[MAX_CHANNELS / 8];
+	uint64_t (*gather)[256];
+	uint16_t out_unitsize;
+	uint8_t *buffer;
+	size_t buffer_size;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GSList *l;
+	GString *map;
+	uint64_t selected;
+	unsigned int i, k, byte, value;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+
+	ctx->invert = g_variant_get_uint64(g_hash_table_lookup(options, "invert"));
+	ctx->mask = g_variant_get_uint64(g_hash_table_lookup(options, "mask"));
+	ctx->repack = g_variant_get_boolean(g_hash_table_lookup(options, "repack"));
+
+	for (i = 0; i < ARRAY_SIZE(ctx->invert_bytes); i++) {
+		ctx->invert_bytes[i] = (ctx->invert >> (8 * i)) & 0xff;
+		ctx->mask_bytes[i] = (ctx->mask >> (8 * i)) & 0xff;
+	}
+
+	if (!ctx->repack)
+		return SR_OK;
+
+	/* Keep the enabled logic channels which the mask lets through. */
+	selected = 0;
+	for (l = t->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+			continue;
+		if (ch->index >= MAX_CHANNELS) {
+			sr_err("Cannot repack channel %d, only the first %d "
+				"channels are supported.", ch->index, MAX_CHANNELS);
+			g_free(ctx);
+			t->priv = NULL;
+			return SR_ERR_ARG;
+		}
+		selected |= UINT64_C(1) << ch->index;
+	}
+	selected &= ctx->mask;
+
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		if (selected & (UINT64_C(1) << i))
+			ctx->src_bits[ctx->num_channels++] = i;
+	}
+	ctx->out_unitsize = (ctx->num_channels + 7) / 8;
+
+	/* Check whether repacking boils down to picking whole bytes. */
+	ctx->byte_aligned = (ctx->num_channels % 8) == 0;
+	for (k = 0; k < ctx->num_channels && ctx->byte_aligned; k++) {
+		if (ctx->src_bits[k] % 8 != k % 8)
+			ctx->byte_aligned = FALSE;
+		else if (ctx->src_bits[k] / 8 != ctx->src_bits[k - k % 8] / 8)
+			ctx->byte_aligned = FALSE;
+	}
+
+	sr_dbg("Repacking %u channels into %u byte(s) per sample%s.",
+		ctx->num_channels, ctx->out_unitsize,
+		ctx->byte_aligned ? ", by whole bytes" : "");
+
+	/*
+	 * Sample bits no longer match the channels' indices. Tell which
+	 * channel each bit carries, the first kept channel being bit 0.
+	 */
+	map = g_string_new(NULL);
+	for (k = 0; k < ctx->num_channels; k++) {
+		for (l = t->sdi->channels; l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_LOGIC
+					&& ch->index == (int)ctx->src_bits[k])
+				break;
+		}
+		g_string_append_printf(map, "%s%u=%s", k ? ", " : "",
+			k, l ? ch->name : "?");
+	}
+	if (ctx->num_channels)
+		sr_info("Repacked sample bits: %s.", map->str);
+	g_string_free(map, TRUE);
+
+	if (ctx->byte_aligned)
+		return SR_OK;
+
+	/* Precompute the bit gather, one table per used source byte. */
+	ctx->gather = g_malloc0(sizeof(*ctx->gather) * (MAX_CHANNELS / 8));
+	for (k = 0; k < ctx->num_channels; k++) {
+		byte = ctx->src_bits[k] / 8;
+		if (!ctx->num_gather || ctx->gather_byte[ctx->num_gather - 1] != byte)
+			ctx->gather_byte[ctx->num_gather++] = byte;
+		for (value = 0; value < 256; value++) {
+			if (value & (1 << (ctx->src_bits[k] % 8)))
+				ctx->gather[ctx->num_gather - 1][value] |= UINT64_C(1) << k;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Apply the invert and mask options to sample data in place. */
+static void mask_logic(const struct context *ctx,
+		uint8_t *data, uint64_t length, uint16_t unitsize)
+{
+	uint64_t i;
+	unsigned int j, n;
+
+	n = MIN(unitsize, ARRAY_SIZE(ctx->mask_bytes));
+	for (i = 0; i + unitsize <= length; i += unitsize) {
+		for (j = 0; j < n; j++)
+			data[i + j] = (data[i + j] ^ ctx->invert_bytes[j])
+				& ctx->mask_bytes[j];
+	}
+}
+
+/* Apply the invert option and pack the selected channels' bits. */
+static int repack_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *rp;
+	uint8_t *wp;
+	uint64_t num_samples, i, value;
+	unsigned int k, src;
+	size_t size;
+
+	num_samples = logic->length / logic->unitsize;
+	size = num_samples * ctx->out_unitsize;
+	if (size > ctx->buffer_size) {
+		ctx->buffer = g_try_realloc(ctx->buffer, size);
+		if (!ctx->buffer) {
+			ctx->buffer_size = 0;
+			sr_err("Cannot allocate repacking buffer.");
+			return SR_ERR_MALLOC;
+		}
+		ctx->buffer_size = size;
+	}
+
+	rp = logic->data;
+	wp = ctx->buffer;
+	if (ctx->byte_aligned) {
+		for (i = 0; i < num_samples; i++) {
+			for (k = 0; k < ctx->out_unitsize; k++) {
+				src = ctx->src_bits[8 * k] / 8;
+				wp[k] = (src < logic->unitsize) ?
+					rp[src] ^ ctx->invert_bytes[src] : 0;
+			}
+			rp += logic->unitsize;
+			wp += ctx->out_unitsize;
+		}
+	} else {
+		for (i = 0; i < num_samples; i++) {
+			value = 0;
+			for (k = 0; k < ctx->num_gather; k++) {
+				src = ctx->gather_byte[k];
+				if (src < logic->unitsize)
+					value |= ctx->gather[k][rp[src]
+						^ ctx->invert_bytes[src]];
+			}
+			for (k = 0; k < ctx->out_unitsize; k++)
+				wp[k] = value >> (8 * k);
+			rp += logic->unitsize;
+			wp += ctx->out_unitsize;
+		}
+	}
+
+	ctx->logic.length = size;
+	ctx->logic.unitsize = ctx->out_unitsize;
+	ctx->logic.data = ctx->buffer;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+
+	switch (packet_in->type) {
+	case SR_DF_LOGIC:
+		logic = packet_in->payload;
+		if (!logic->unitsize)
+			break;
+		if (!ctx->repack) {
+			mask_logic(ctx, logic->data, logic->length,
+				logic->unitsize);
+			break;
+		}
+		/* Nothing left to send when all channels were dropped. */
+		if (!ctx->num_channels) {
+			*packet_out = NULL;
+			break;
+		}
+		ret = repack_logic(ctx, logic);
+		if (ret != SR_OK)
+			return ret;
+		*packet_out = &ctx->packet;
+		break;
+	default:
+		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_free(ctx->buffer);
+	g_free(ctx->gather);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "invert", "Invert", "Bit mask of the logic channels to invert", NULL, NULL },
+	{ "mask", "Mask", "Bit mask of the logic channels to keep, others read as low", NULL, NULL },
+	{ "repack", "Repack", "Drop disabled and masked channels, pack the rest into fewer bytes", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	/* Default to passing all channels on unmodified. */
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(0));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(UINT64_MAX));
+		options[2].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_mask = {
+	.id = "mask",
+	.name = "Mask",
+	.desc = "Invert, mask, or drop logic channels",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
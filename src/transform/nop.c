@@ -38,6 +38,17 @@ static int receive(const struct sr_transform *t,
 	return SR_OK;
 }
 
+static int receive_logic_inplace(const struct sr_transform *t,
+		uint8_t *data, uint64_t length, uint16_t unitsize)
+{
+	(void)t;
+	(void)data;
+	(void)length;
+	(void)unitsize;
+
+	return SR_OK;
+}
+
 SR_PRIV struct sr_transform_module transform_nop = {
 	.id = "nop",
 	.name = "NOP",
@@ -45,5 +56,6 @@ SR_PRIV struct sr_transform_module transform_nop = {
 	.options = NULL,
 	.init = NULL,
 	.receive = receive,
+	.receive_logic_inplace = receive_logic_inplace,
 	.cleanup = NULL,
 };
@@ -26,6 +26,13 @@
 
 struct context {
 	struct sr_rational factor;
+	/* The scaled packet, the sender's packet is left alone. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	/* Converted values, when the factor can't go into the encoding. */
+	float *fbuf;
+	size_t fbuf_size;
 };
 
 static int init(struct sr_transform *t, GHashTable *options)
@@ -43,30 +50,99 @@ static int init(struct sr_transform *t, GHashTable *options)
 	return SR_OK;
 }
 
+/*
+ * Fall back to float values with the factor as their scale, for the
+ * rare case where the factor doesn't fit into the input's encoding.
+ */
+static int scale_as_float(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	size_t count;
+	int ret;
+
+	count = analog->num_samples * g_slist_length(analog->meaning->channels);
+	if (count > ctx->fbuf_size) {
+		g_free(ctx->fbuf);
+		ctx->fbuf = g_malloc(count * sizeof(ctx->fbuf[0]));
+		ctx->fbuf_size = count;
+	}
+	ret = sr_analog_to_float(analog, ctx->fbuf);
+	if (ret != SR_OK)
+		return ret;
+
+	ctx->encoding.unitsize = sizeof(float);
+	ctx->encoding.is_signed = TRUE;
+	ctx->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	ctx->encoding.is_bigendian = TRUE;
+#else
+	ctx->encoding.is_bigendian = FALSE;
+#endif
+	ctx->encoding.scale = ctx->factor;
+	sr_rational_set(&ctx->encoding.offset, 0, 1);
+	ctx->analog.data = ctx->fbuf;
+
+	return SR_OK;
+}
+
 static int receive(const struct sr_transform *t,
 		struct sr_datafeed_packet *packet_in,
 		struct sr_datafeed_packet **packet_out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_analog *analog;
+	int ret;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
 	ctx = t->priv;
 
+	/* Return the unmodified packet for all other types. */
+	*packet_out = packet_in;
+
 	switch (packet_in->type) {
 	case SR_DF_ANALOG:
+		/*
+		 * Scale a copy of the encoding, the sender may re-use its
+		 * own for the next packets. The factor applies to the
+		 * offset as well. This costs nothing per sample, the
+		 * consumer's conversion applies the combined scale.
+		 */
 		analog = packet_in->payload;
-		analog->encoding->scale.p *= ctx->factor.p;
-		analog->encoding->scale.q *= ctx->factor.q;
+		ctx->analog = *analog;
+		ctx->encoding = *analog->encoding;
+		ctx->analog.encoding = &ctx->encoding;
+		ret = sr_rational_mult(&ctx->encoding.scale,
+			&analog->encoding->scale, &ctx->factor);
+		if (ret == SR_OK)
+			ret = sr_rational_mult(&ctx->encoding.offset,
+				&analog->encoding->offset, &ctx->factor);
+		if (ret != SR_OK) {
+			ctx->encoding = *analog->encoding;
+			ret = scale_as_float(ctx, analog);
+			if (ret != SR_OK)
+				return ret;
+		}
+		ctx->packet.type = SR_DF_ANALOG;
+		ctx->packet.payload = &ctx->analog;
+		*packet_out = &ctx->packet;
 		break;
 	default:
 		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
 		break;
 	}
 
-	/* Return the in-place-modified packet. */
-	*packet_out = packet_in;
+	return SR_OK;
+}
+
+static int receive_logic_inplace(const struct sr_transform *t,
+		uint8_t *data, uint64_t length, uint16_t unitsize)
+{
+	/* Logic data has no scale, leave it alone. */
+	(void)t;
+	(void)data;
+	(void)length;
+	(void)unitsize;
 
 	return SR_OK;
 }
@@ -79,6 +155,7 @@ static int cleanup(struct sr_transform *t)
 		return SR_ERR_ARG;
 	ctx = t->priv;
 
+	g_free(ctx->fbuf);
 	g_free(ctx);
 	t->priv = NULL;
 
@@ -109,5 +186,6 @@ SR_PRIV struct sr_transform_module transform_scale = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_logic_inplace = receive_logic_inplace,
 	.cleanup = cleanup,
 };
@@ -0,0 +1,359 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/threshold"
+
+/*
+ * Selected analog channels get converted into the bits of one logic
+ * stream, the first selected channel being bit 0. Scopes send each
+ * channel's samples in packets of their own, so every channel has a
+ * write position in the buffer. Samples go out once all channels have
+ * reached them.
+ */
+struct channel_state {
+	struct sr_channel *ch;
+	float lo_thr;
+	float hi_thr;
+	uint8_t state;
+	uint64_t pos;
+};
+
+struct context {
+	unsigned int num_channels;
+	struct channel_state *channels;
+	uint16_t unitsize;
+	uint8_t *buffer;
+	uint64_t buffer_samples;
+	/* Samples at the start of the buffer which went out already. */
+	uint64_t sent;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+};
+
+/* Add a "name[=threshold]" entry of the channels option. */
+static int add_channel(const struct sr_transform *t, struct context *ctx,
+		const char *spec, double threshold, double hysteresis)
+{
+	struct channel_state *cs;
+	struct sr_channel *ch;
+	char **parts, *end;
+	GSList *l;
+	int ret;
+
+	parts = g_strsplit(spec, "=", 2);
+	g_strstrip(parts[0]);
+	ret = SR_ERR_ARG;
+
+	ch = NULL;
+	for (l = t->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG && !strcmp(ch->name, parts[0]))
+			break;
+		ch = NULL;
+	}
+	if (!ch) {
+		sr_err("No analog channel '%s'.", parts[0]);
+		goto out;
+	}
+	/* Its samples would never come, and hold up all others. */
+	if (!ch->enabled) {
+		sr_err("Channel %s is disabled.", ch->name);
+		goto out;
+	}
+	if (parts[1]) {
+		threshold = g_ascii_strtod(parts[1], &end);
+		if (end == parts[1] || *end) {
+			sr_err("Invalid threshold '%s' for channel %s.",
+				parts[1], ch->name);
+			goto out;
+		}
+	}
+
+	cs = &ctx->channels[ctx->num_channels++];
+	cs->ch = ch;
+	cs->lo_thr = threshold - hysteresis / 2;
+	cs->hi_thr = threshold + hysteresis / 2;
+	ret = SR_OK;
+
+out:
+	g_strfreev(parts);
+	return ret;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	const char *names;
+	char **specs;
+	double threshold, hysteresis;
+	GSList *l;
+	unsigned int i, max_channels;
+	int ret;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	names = g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL);
+	threshold = g_variant_get_double(g_hash_table_lookup(options, "threshold"));
+	hysteresis = g_variant_get_double(g_hash_table_lookup(options, "hysteresis"));
+	if (hysteresis < 0) {
+		sr_err("Hysteresis must not be negative.");
+		return SR_ERR_ARG;
+	}
+
+	max_channels = g_slist_length(t->sdi->channels);
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->channels = g_malloc0(max_channels * sizeof(ctx->channels[0]));
+
+	ret = SR_OK;
+	if (*names) {
+		specs = g_strsplit(names, ",", 0);
+		for (i = 0; specs[i] && ret == SR_OK; i++) {
+			if (ctx->num_channels == max_channels) {
+				sr_err("Too many channels selected.");
+				ret = SR_ERR_ARG;
+				break;
+			}
+			ret = add_channel(t, ctx, specs[i], threshold, hysteresis);
+		}
+		g_strfreev(specs);
+	} else {
+		/* Default to all enabled analog channels. */
+		for (l = t->sdi->channels; l; l = l->next) {
+			ch = l->data;
+			if (ch->type != SR_CHANNEL_ANALOG || !ch->enabled)
+				continue;
+			if (add_channel(t, ctx, ch->name, threshold,
+					hysteresis) != SR_OK)
+				ret = SR_ERR_ARG;
+		}
+	}
+
+	if (ret != SR_OK || !ctx->num_channels) {
+		if (ret == SR_OK)
+			sr_err("No analog channels to convert.");
+		g_free(ctx->channels);
+		g_free(ctx);
+		t->priv = NULL;
+		return SR_ERR_ARG;
+	}
+	ctx->unitsize = (ctx->num_channels + 7) / 8;
+
+	sr_dbg("Converting %u analog channel(s) into %u byte(s) per sample.",
+		ctx->num_channels, ctx->unitsize);
+
+	return SR_OK;
+}
+
+static struct channel_state *find_channel(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	GSList *channels;
+	unsigned int i;
+
+	/* Only packets of a single channel get converted. */
+	channels = analog->meaning->channels;
+	if (!channels || channels->next)
+		return NULL;
+
+	for (i = 0; i < ctx->num_channels; i++) {
+		if (ctx->channels[i].ch == channels->data)
+			return &ctx->channels[i];
+	}
+
+	return NULL;
+}
+
+/* Drop the samples which went out with the previous packet. */
+static void compact(struct context *ctx)
+{
+	uint64_t keep;
+	unsigned int i;
+
+	if (!ctx->sent)
+		return;
+
+	keep = 0;
+	for (i = 0; i < ctx->num_channels; i++) {
+		ctx->channels[i].pos -= ctx->sent;
+		keep = MAX(keep, ctx->channels[i].pos);
+	}
+	memmove(ctx->buffer, ctx->buffer + ctx->sent * ctx->unitsize,
+		keep * ctx->unitsize);
+	memset(ctx->buffer + keep * ctx->unitsize, 0,
+		(ctx->buffer_samples - keep) * ctx->unitsize);
+	ctx->sent = 0;
+}
+
+static int convert(struct context *ctx, struct channel_state *cs,
+		const struct sr_datafeed_analog *analog,
+		struct sr_datafeed_packet **packet_out)
+{
+	uint64_t count, size, ready;
+	unsigned int i, bit;
+	uint8_t *buffer;
+	int ret;
+
+	compact(ctx);
+
+	count = analog->num_samples;
+	if (cs->pos + count > ctx->buffer_samples) {
+		size = cs->pos + count;
+		buffer = g_try_realloc(ctx->buffer, size * ctx->unitsize);
+		if (!buffer) {
+			sr_err("Cannot allocate conversion buffer.");
+			return SR_ERR_MALLOC;
+		}
+		memset(buffer + ctx->buffer_samples * ctx->unitsize, 0,
+			(size - ctx->buffer_samples) * ctx->unitsize);
+		ctx->buffer = buffer;
+		ctx->buffer_samples = size;
+	}
+
+	bit = cs - ctx->channels;
+	if (cs->lo_thr == cs->hi_thr)
+		ret = sr_a2l_threshold_logic(analog, cs->lo_thr,
+			ctx->buffer + cs->pos * ctx->unitsize,
+			ctx->unitsize, bit, count);
+	else
+		ret = sr_a2l_schmitt_trigger_logic(analog, cs->lo_thr,
+			cs->hi_thr, &cs->state,
+			ctx->buffer + cs->pos * ctx->unitsize,
+			ctx->unitsize, bit, count);
+	if (ret != SR_OK)
+		return ret;
+	cs->pos += count;
+
+	ready = cs->pos;
+	for (i = 0; i < ctx->num_channels; i++)
+		ready = MIN(ready, ctx->channels[i].pos);
+	if (!ready) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+
+	ctx->logic.length = ready * ctx->unitsize;
+	ctx->logic.unitsize = ctx->unitsize;
+	ctx->logic.data = ctx->buffer;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+	ctx->sent = ready;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+/* Forget samples of channels which got ahead of the others. */
+static void reset(struct context *ctx)
+{
+	unsigned int i;
+
+	compact(ctx);
+	for (i = 0; i < ctx->num_channels; i++) {
+		if (ctx->channels[i].pos)
+			sr_dbg("Dropping %" PRIu64 " samples of channel %s.",
+				ctx->channels[i].pos, ctx->channels[i].ch->name);
+		ctx->channels[i].pos = 0;
+	}
+	if (ctx->buffer)
+		memset(ctx->buffer, 0, ctx->buffer_samples * ctx->unitsize);
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	struct channel_state *cs;
+	const struct sr_datafeed_analog *analog;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+
+	switch (packet_in->type) {
+	case SR_DF_ANALOG:
+		analog = packet_in->payload;
+		cs = find_channel(ctx, analog);
+		if (!cs)
+			break;
+		return convert(ctx, cs, analog, packet_out);
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
+	case SR_DF_END:
+		reset(ctx);
+		break;
+	default:
+		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_free(ctx->buffer);
+	g_free(ctx->channels);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "channels", "Channels", "Comma separated analog channels to convert, each optionally with =threshold, default all enabled", NULL, NULL },
+	{ "threshold", "Threshold", "Threshold between low and high", NULL, NULL },
+	{ "hysteresis", "Hysteresis", "Width of the band around the threshold in which the level is kept", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	/* Default to TTL levels, without hysteresis. */
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[1].def = g_variant_ref_sink(g_variant_new_double(1.4));
+		options[2].def = g_variant_ref_sink(g_variant_new_double(0.0));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_threshold = {
+	.id = "threshold",
+	.name = "Threshold",
+	.desc = "Convert analog channels into logic channels",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -45,12 +45,18 @@
 extern SR_PRIV struct sr_transform_module transform_nop;
 extern SR_PRIV struct sr_transform_module transform_scale;
 extern SR_PRIV struct sr_transform_module transform_invert;
+extern SR_PRIV struct sr_transform_module transform_mask;
+extern SR_PRIV struct sr_transform_module transform_threshold;
+extern SR_PRIV struct sr_transform_module transform_decimate;
 /** @endcond */
 
 static const struct sr_transform_module *transform_module_list[] = {
 	&transform_nop,
 	&transform_scale,
 	&transform_invert,
+	&transform_mask,
+	&transform_threshold,
+	&transform_decimate,
 	NULL,
 };
 
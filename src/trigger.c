@@ -84,6 +84,7 @@ SR_API void sr_trigger_free(struct sr_trigger *trig)
 
 		if (stage->matches)
 			g_slist_free_full(stage->matches, g_free);
+		g_free(stage->protocol);
 	}
 	g_slist_free_full(trig->stages, g_free);
 
@@ -178,4 +179,75 @@ SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 	return SR_OK;
 }
 
+/**
+ * Set the serial protocol condition of a trigger stage.
+ *
+ * The stage matches on the sample which completes a UART or SPI word,
+ * or an I2C address, with the given value. Such a stage must be the
+ * trigger's only stage, and must not have channel matches. Only the
+ * soft trigger evaluates protocol conditions.
+ *
+ * @param stage The trigger stage. Must not be NULL.
+ * @param match The condition, which gets copied. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument(s) were passed to this functions.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_protocol_match_set(struct sr_trigger_stage *stage,
+		const struct sr_trigger_protocol_match *match)
+{
+	int i, num_channels;
+
+	if (!stage || !match)
+		return SR_ERR_ARG;
+
+	switch (match->protocol) {
+	case SR_TRIGGER_PROTO_UART:
+		num_channels = 1;
+		if (!match->baudrate) {
+			sr_err("UART trigger needs a baud rate.");
+			return SR_ERR_ARG;
+		}
+		break;
+	case SR_TRIGGER_PROTO_SPI:
+		num_channels = 2;
+		if (match->spi_mode < 0 || match->spi_mode > 3) {
+			sr_err("Invalid SPI mode %d.", match->spi_mode);
+			return SR_ERR_ARG;
+		}
+		break;
+	case SR_TRIGGER_PROTO_I2C:
+		num_channels = 2;
+		if (match->value > 0x7f) {
+			sr_err("Invalid I2C address 0x%02x.", match->value);
+			return SR_ERR_ARG;
+		}
+		break;
+	default:
+		sr_err("Unsupported trigger protocol: %d.", match->protocol);
+		return SR_ERR_ARG;
+	}
+	for (i = 0; i < (int)ARRAY_SIZE(match->channels); i++) {
+		if (!match->channels[i]) {
+			if (i < num_channels) {
+				sr_err("Trigger protocol lacks a channel.");
+				return SR_ERR_ARG;
+			}
+			continue;
+		}
+		if (match->channels[i]->type != SR_CHANNEL_LOGIC) {
+			sr_err("Trigger protocols need logic channels.");
+			return SR_ERR_ARG;
+		}
+	}
+
+	if (!stage->protocol)
+		stage->protocol = g_malloc(sizeof(*stage->protocol));
+	*stage->protocol = *match;
+
+	return SR_OK;
+}
+
 /** @} */
@@ -22,8 +22,13 @@
 #include <config.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <glib.h>
 #include <libusb.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_SETSCHEDPARAM)
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -37,6 +42,76 @@
 typedef int libusb_os_handle;
 #endif
 
+/* String descriptors of a device, read once during a shared scan. */
+struct usb_dev_strings {
+	gboolean valid;
+	char manufacturer[64];
+	char product[64];
+};
+
+/** Snapshot of the USB bus which drivers share during sr_drivers_scan(). */
+struct sr_usb_scan {
+	libusb_device **devlist;
+	ssize_t count;
+	/* Protects the strings table, drivers scan from several threads. */
+	GMutex lock;
+	GHashTable *strings;
+};
+
+/** Arrivals of USB devices, e.g. after a firmware upload. */
+struct sr_usb_renum {
+	libusb_hotplug_callback_handle handle;
+	GMutex lock;
+	/* Port path -> monotonic time (gint64) of the last arrival. */
+	GHashTable *arrivals;
+};
+
+/**
+ * USB event handling of a context. libusb reports changes of its file
+ * descriptors to a single set of notifiers, which forward them to the
+ * event sources of all sessions. With an event thread, the sources do
+ * not poll at all.
+ */
+struct sr_usb_events {
+	/* Protects sources and inboxes, which several threads use. */
+	GMutex lock;
+	GSList *sources;
+	GThread *thread;
+	gboolean realtime;
+	int stop;
+	/* Session -> struct usb_inbox, with an event thread only. */
+	GHashTable *inboxes;
+};
+
+struct usb_source;
+
+/**
+ * Transfers of a session which completed in the USB event thread. Their
+ * callbacks run when the session's USB source dispatches, so drivers see
+ * completions in the session's thread, as without the event thread.
+ * All fields are protected by the lock of struct sr_usb_events.
+ */
+struct usb_inbox {
+	struct sr_usb_events *events;
+	struct sr_session *session;
+	/* The session's USB source, and each queued or pending transfer. */
+	unsigned int refcount;
+	/* The attached USB source, NULL while there is none. */
+	struct usb_source *source;
+	/* The USB source went away, completions run in the event thread. */
+	gboolean closed;
+	/* Completed transfers (struct usb_forward), oldest first. */
+	GQueue completions;
+};
+
+/* The driver's callback of a transfer which completes via an inbox. */
+struct usb_forward {
+	struct usb_inbox *inbox;
+	struct libusb_transfer *transfer;
+	libusb_transfer_cb_fn callback;
+	void *user_data;
+};
+
 /** Custom GLib event source for libusb I/O.
  */
 struct usb_source {
@@ -49,9 +124,189 @@ struct usb_source {
 	struct sr_session *session;
 
 	struct libusb_context *usb_ctx;
+	struct sr_usb_events *events;
+	/* Whether the source polls the libusb file descriptors. */
+	gboolean polling;
 	GPtrArray *pollfds;
+	/* Completions from the event thread, NULL without one. */
+	struct usb_inbox *inbox;
 };
 
+/* Take a reference to the inbox of a session, creating it if needed. */
+static struct usb_inbox *usb_inbox_get_locked(struct sr_usb_events *events,
+		struct sr_session *session)
+{
+	struct usb_inbox *inbox;
+
+	inbox = g_hash_table_lookup(events->inboxes, session);
+	if (!inbox) {
+		inbox = g_malloc0(sizeof(*inbox));
+		inbox->events = events;
+		inbox->session = session;
+		g_queue_init(&inbox->completions);
+		g_hash_table_insert(events->inboxes, session, inbox);
+	}
+	inbox->refcount++;
+
+	return inbox;
+}
+
+static void usb_inbox_unref_locked(struct usb_inbox *inbox)
+{
+	if (--inbox->refcount)
+		return;
+	g_hash_table_remove(inbox->events->inboxes, inbox->session);
+	g_free(inbox);
+}
+
+static gboolean usb_inbox_pending(struct usb_inbox *inbox)
+{
+	gboolean pending;
+
+	if (!inbox)
+		return FALSE;
+
+	g_mutex_lock(&inbox->events->lock);
+	pending = !g_queue_is_empty(&inbox->completions);
+	g_mutex_unlock(&inbox->events->lock);
+
+	return pending;
+}
+
+/* Have the driver see its own callback data again, and run its callback. */
+static void usb_forward_run(struct usb_forward *forward)
+{
+	struct libusb_transfer *transfer;
+
+	transfer = forward->transfer;
+	transfer->callback = forward->callback;
+	transfer->user_data = forward->user_data;
+	g_free(forward);
+	transfer->callback(transfer);
+}
+
+/*
+ * Run the callbacks of the transfers which completed so far. Transfers
+ * which drivers resubmit and which complete meanwhile wait for the next
+ * dispatch, so that this returns to the main loop.
+ */
+static void usb_inbox_deliver(struct usb_inbox *inbox)
+{
+	struct sr_usb_events *events;
+	struct usb_forward *forward;
+	unsigned int count;
+
+	events = inbox->events;
+	g_mutex_lock(&events->lock);
+	count = g_queue_get_length(&inbox->completions);
+	g_mutex_unlock(&events->lock);
+
+	while (count--) {
+		g_mutex_lock(&events->lock);
+		forward = g_queue_pop_head(&inbox->completions);
+		if (forward)
+			usb_inbox_unref_locked(inbox);
+		g_mutex_unlock(&events->lock);
+		if (!forward)
+			break;
+		usb_forward_run(forward);
+	}
+}
+
+/* Transfer callback in the event thread, hands the transfer to its session. */
+static void LIBUSB_CALL usb_forward_complete(struct libusb_transfer *transfer)
+{
+	struct usb_forward *forward;
+	struct usb_inbox *inbox;
+	struct sr_usb_events *events;
+
+	forward = transfer->user_data;
+	inbox = forward->inbox;
+	events = inbox->events;
+
+	g_mutex_lock(&events->lock);
+	if (!inbox->closed) {
+		g_queue_push_tail(&inbox->completions, forward);
+		if (inbox->source)
+			g_main_context_wakeup(g_source_get_context(
+				(GSource *)inbox->source));
+		g_mutex_unlock(&events->lock);
+		return;
+	}
+	usb_inbox_unref_locked(inbox);
+	g_mutex_unlock(&events->lock);
+
+	usb_forward_run(forward);
+}
+
+/**
+ * Have a transfer's callback run in the thread of the device's session,
+ * when the context has a USB event thread. Completions wait for the
+ * session's USB source (see usb_source_add()) to dispatch them. When
+ * the driver removed its USB source, later completions of the session
+ * run in the event thread again, the driver is done with the transfers
+ * then. The transfer must be submitted right after this.
+ *
+ * Transfers which the caller waits for in place, handling libusb events
+ * until their callback set a flag, must not get forwarded.
+ *
+ * @param sdi The device instance, which belongs to a session.
+ * @param transfer The transfer about to be submitted.
+ *
+ * @return Handle for sr_usb_forward_cancel(), NULL if the callback runs
+ *         unchanged.
+ *
+ * @private
+ */
+SR_PRIV void *sr_usb_forward_begin(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_events *events;
+	struct usb_forward *forward;
+
+	if (!sdi->session || !sdi->session->ctx)
+		return NULL;
+	events = sdi->session->ctx->usb_events;
+	if (!events || !events->thread)
+		return NULL;
+
+	forward = g_malloc(sizeof(*forward));
+	forward->transfer = transfer;
+	forward->callback = transfer->callback;
+	forward->user_data = transfer->user_data;
+	g_mutex_lock(&events->lock);
+	forward->inbox = usb_inbox_get_locked(events, sdi->session);
+	g_mutex_unlock(&events->lock);
+	transfer->callback = usb_forward_complete;
+	transfer->user_data = forward;
+
+	return forward;
+}
+
+/**
+ * Undo sr_usb_forward_begin() after the transfer failed to submit.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_forward_cancel(struct libusb_transfer *transfer,
+		void *handle)
+{
+	struct usb_forward *forward;
+	struct sr_usb_events *events;
+
+	forward = handle;
+	if (!forward)
+		return;
+
+	transfer->callback = forward->callback;
+	transfer->user_data = forward->user_data;
+	events = forward->inbox->events;
+	g_mutex_lock(&events->lock);
+	usb_inbox_unref_locked(forward->inbox);
+	g_mutex_unlock(&events->lock);
+	g_free(forward);
+}
+
 /** USB event source prepare() method.
  */
 static gboolean usb_source_prepare(GSource *source, int *timeout)
@@ -86,6 +341,9 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 	else
 		remaining_ms = -1;
 
+	if (usb_inbox_pending(usource->inbox))
+		remaining_ms = 0;
+
 	*timeout = remaining_ms;
 
 	return (remaining_ms == 0);
@@ -107,7 +365,8 @@ static gboolean usb_source_check(GSource *source)
 		pollfd = g_ptr_array_index(usource->pollfds, i);
 		revents |= pollfd->revents;
 	}
-	return (revents != 0 || (usource->due_us != INT64_MAX
+	return (revents != 0 || usb_inbox_pending(usource->inbox)
+		|| (usource->due_us != INT64_MAX
 			&& usource->due_us <= g_source_get_time(source)));
 }
 
@@ -138,7 +397,21 @@ static gboolean usb_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	/* Completions from the event thread, the driver's timeout may wait. */
+	if (usource->inbox) {
+		sr_session_receive_mark();
+		usb_inbox_deliver(usource->inbox);
+		sr_session_receive_unmark();
+		if (g_source_is_destroyed(source))
+			return G_SOURCE_REMOVE;
+		if (usource->due_us > g_source_get_time(source))
+			return G_SOURCE_CONTINUE;
+	}
+	/* Transfers completed, or are about to, unless this is a timeout. */
+	if (revents)
+		sr_session_receive_mark();
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))(-1, revents, user_data);
+	sr_session_receive_unmark();
 
 	if (G_LIKELY(keep) && G_LIKELY(!g_source_is_destroyed(source))) {
 		if (usource->timeout_us >= 0)
@@ -155,30 +428,52 @@ static gboolean usb_source_dispatch(GSource *source,
 static void usb_source_finalize(GSource *source)
 {
 	struct usb_source *usource;
+	struct sr_usb_events *events;
 
 	usource = (struct usb_source *)source;
+	events = usource->events;
 
 	sr_spew("%s", __func__);
 
-	libusb_set_pollfd_notifiers(usource->usb_ctx, NULL, NULL, NULL);
+	if (usource->polling) {
+		g_mutex_lock(&events->lock);
+		events->sources = g_slist_remove(events->sources, usource);
+		if (!events->sources)
+			libusb_set_pollfd_notifiers(usource->usb_ctx,
+				NULL, NULL, NULL);
+		g_mutex_unlock(&events->lock);
+	}
 
 	g_ptr_array_unref(usource->pollfds);
 	usource->pollfds = NULL;
 
+	/* Completions which are still queued must not get lost. */
+	if (usource->inbox) {
+		g_mutex_lock(&events->lock);
+		/* Unless the session has a new source already. */
+		if (!usource->inbox->source || usource->inbox->source == usource) {
+			usource->inbox->source = NULL;
+			usource->inbox->closed = TRUE;
+		}
+		g_mutex_unlock(&events->lock);
+		usb_inbox_deliver(usource->inbox);
+		g_mutex_lock(&events->lock);
+		usb_inbox_unref_locked(usource->inbox);
+		g_mutex_unlock(&events->lock);
+		usource->inbox = NULL;
+	}
+
 	sr_session_source_destroyed(usource->session,
 			usource->usb_ctx, source);
 }
 
-/** Callback invoked when a new libusb FD should be added to the poll set.
+/** Add a libusb FD to the poll set of an event source.
  */
-static LIBUSB_CALL void usb_pollfd_added(libusb_os_handle fd,
-		short events, void *user_data)
+static void usb_source_add_pollfd(struct usb_source *usource,
+		libusb_os_handle fd, short events)
 {
-	struct usb_source *usource;
 	GPollFD *pollfd;
 
-	usource = user_data;
-
 	if (G_UNLIKELY(g_source_is_destroyed(&usource->base)))
 		return;
 
@@ -194,16 +489,14 @@ static LIBUSB_CALL void usb_pollfd_added(libusb_os_handle fd,
 	g_source_add_poll(&usource->base, pollfd);
 }
 
-/** Callback invoked when a libusb FD should be removed from the poll set.
+/** Remove a libusb FD from the poll set of an event source.
  */
-static LIBUSB_CALL void usb_pollfd_removed(libusb_os_handle fd, void *user_data)
+static void usb_source_remove_pollfd(struct usb_source *usource,
+		libusb_os_handle fd)
 {
-	struct usb_source *usource;
 	GPollFD *pollfd;
 	unsigned int i;
 
-	usource = user_data;
-
 	if (G_UNLIKELY(g_source_is_destroyed(&usource->base)))
 		return;
 
@@ -222,6 +515,37 @@ static LIBUSB_CALL void usb_pollfd_removed(libusb_os_handle fd, void *user_data)
 		") not found in event source poll set.", (gintptr)fd);
 }
 
+/** Callback invoked when a new libusb FD should be added to the poll set.
+ */
+static LIBUSB_CALL void usb_pollfd_added(libusb_os_handle fd,
+		short events, void *user_data)
+{
+	struct sr_usb_events *usb_events;
+	GSList *l;
+
+	usb_events = user_data;
+
+	g_mutex_lock(&usb_events->lock);
+	for (l = usb_events->sources; l; l = l->next)
+		usb_source_add_pollfd(l->data, fd, events);
+	g_mutex_unlock(&usb_events->lock);
+}
+
+/** Callback invoked when a libusb FD should be removed from the poll set.
+ */
+static LIBUSB_CALL void usb_pollfd_removed(libusb_os_handle fd, void *user_data)
+{
+	struct sr_usb_events *usb_events;
+	GSList *l;
+
+	usb_events = user_data;
+
+	g_mutex_lock(&usb_events->lock);
+	for (l = usb_events->sources; l; l = l->next)
+		usb_source_remove_pollfd(l->data, fd);
+	g_mutex_unlock(&usb_events->lock);
+}
+
 /** Destroy notify callback for FDs maintained by the USB event source.
  */
 static void usb_source_free_pollfd(void *data)
@@ -243,13 +567,18 @@ static void usb_source_free_pollfd(void *data)
  * API at some point. Instead, drivers should install separate timer
  * event sources for their polling needs.
  *
+ * The sources of all sessions poll the libusb file descriptors, unless
+ * the context has an event thread which handles them. The source then
+ * runs the callbacks of the session's transfers which completed in the
+ * event thread, see sr_usb_forward_begin().
+ *
  * @param session The session the event source belongs to.
- * @param usb_ctx The libusb context for which to handle events.
+ * @param ctx The context for whose libusb context to handle events.
  * @param timeout_ms The timeout interval in ms, or -1 to wait indefinitely.
  * @return A new event source object, or NULL on failure.
  */
 static GSource *usb_source_new(struct sr_session *session,
-		struct libusb_context *usb_ctx, int timeout_ms)
+		struct sr_context *ctx, int timeout_ms)
 {
 	static GSourceFuncs usb_source_funcs = {
 		.prepare  = &usb_source_prepare,
@@ -259,12 +588,20 @@ static GSource *usb_source_new(struct sr_session *session,
 	};
 	GSource *source;
 	struct usb_source *usource;
+	struct sr_usb_events *events;
 	const struct libusb_pollfd **upollfds, **upfd;
 
-	upollfds = libusb_get_pollfds(usb_ctx);
-	if (!upollfds) {
-		sr_err("Failed to get libusb file descriptors.");
-		return NULL;
+	events = ctx->usb_events;
+	upollfds = NULL;
+	if (!events->thread) {
+		/* Take the descriptors and register in one go, see notifiers. */
+		g_mutex_lock(&events->lock);
+		upollfds = libusb_get_pollfds(ctx->libusb_ctx);
+		if (!upollfds) {
+			g_mutex_unlock(&events->lock);
+			sr_err("Failed to get libusb file descriptors.");
+			return NULL;
+		}
 	}
 	source = g_source_new(&usb_source_funcs, sizeof(struct usb_source));
 	usource = (struct usb_source *)source;
@@ -279,23 +616,416 @@ static GSource *usb_source_new(struct sr_session *session,
 		usource->due_us = INT64_MAX;
 	}
 	usource->session = session;
-	usource->usb_ctx = usb_ctx;
+	usource->usb_ctx = ctx->libusb_ctx;
+	usource->events = events;
 	usource->pollfds = g_ptr_array_new_full(8, &usb_source_free_pollfd);
 
-	for (upfd = upollfds; *upfd != NULL; upfd++)
-		usb_pollfd_added((*upfd)->fd, (*upfd)->events, usource);
+	if (!upollfds) {
+		g_mutex_lock(&events->lock);
+		usource->inbox = usb_inbox_get_locked(events, session);
+		usource->inbox->closed = FALSE;
+		g_mutex_unlock(&events->lock);
+		return source;
+	}
 
+	for (upfd = upollfds; *upfd != NULL; upfd++)
+		usb_source_add_pollfd(usource, (*upfd)->fd, (*upfd)->events);
 #if (LIBUSB_API_VERSION >= 0x01000104)
 	libusb_free_pollfds(upollfds);
 #else
 	free(upollfds);
 #endif
-	libusb_set_pollfd_notifiers(usb_ctx,
-		&usb_pollfd_added, &usb_pollfd_removed, usource);
+	if (!events->sources)
+		libusb_set_pollfd_notifiers(ctx->libusb_ctx,
+			&usb_pollfd_added, &usb_pollfd_removed, events);
+	events->sources = g_slist_prepend(events->sources, usource);
+	usource->polling = TRUE;
+	g_mutex_unlock(&events->lock);
 
 	return source;
 }
 
+/* Give the calling thread the lowest real-time priority. */
+static void usb_event_thread_realtime(void)
+{
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_SETSCHEDPARAM)
+	struct sched_param param;
+	int ret;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret != 0) {
+		sr_warn("Cannot raise USB event thread priority: %s.",
+			g_strerror(ret));
+		return;
+	}
+	sr_dbg("USB event thread runs with SCHED_FIFO priority %d.",
+		param.sched_priority);
+#else
+	sr_warn("Real-time priority is not supported on this platform.");
+#endif
+}
+
+static gpointer usb_event_thread(gpointer data)
+{
+	struct sr_context *ctx;
+	struct sr_usb_events *events;
+	struct timeval tv;
+	int ret;
+
+	ctx = data;
+	events = ctx->usb_events;
+
+	if (events->realtime)
+		usb_event_thread_realtime();
+
+	while (!g_atomic_int_get(&events->stop)) {
+		/* Bounded, in case interrupting the handler is unsupported. */
+		tv.tv_sec = 0;
+		tv.tv_usec = 100 * 1000;
+		ret = libusb_handle_events_timeout_completed(ctx->libusb_ctx,
+			&tv, &events->stop);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+			sr_err("Failed to handle USB events: %s.",
+				libusb_error_name(ret));
+			g_usleep(10 * 1000);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Set up the USB event handling of a context.
+ *
+ * @param ctx libsigrok context with an initialized libusb context.
+ * @param thread Whether to handle all USB events in a thread of the
+ *               context, instead of in the sessions' main loops.
+ * @param realtime Whether the thread asks for real-time priority.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR The event thread could not be started.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_events_init(struct sr_context *ctx, gboolean thread,
+		gboolean realtime)
+{
+	struct sr_usb_events *events;
+	GError *error;
+
+	events = g_malloc0(sizeof(*events));
+	g_mutex_init(&events->lock);
+	ctx->usb_events = events;
+
+	if (!thread)
+		return SR_OK;
+
+	events->inboxes = g_hash_table_new(NULL, NULL);
+	events->realtime = realtime;
+	error = NULL;
+	events->thread = g_thread_try_new("sr-usb-events",
+		usb_event_thread, ctx, &error);
+	if (!events->thread) {
+		sr_err("Failed to start USB event thread: %s.",
+			error->message);
+		g_error_free(error);
+		sr_usb_events_exit(ctx);
+		return SR_ERR;
+	}
+	sr_dbg("Handling USB events in a dedicated thread.");
+
+	return SR_OK;
+}
+
+/**
+ * Stop the USB event thread of a context, if there is one, and release
+ * the event handling state. All USB event sources must be gone.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_events_exit(struct sr_context *ctx)
+{
+	struct sr_usb_events *events;
+
+	events = ctx->usb_events;
+	if (!events)
+		return;
+
+	if (events->thread) {
+		g_atomic_int_set(&events->stop, 1);
+#if (LIBUSB_API_VERSION >= 0x01000105)
+		libusb_interrupt_event_handler(ctx->libusb_ctx);
+#endif
+		g_thread_join(events->thread);
+	}
+	if (events->inboxes)
+		g_hash_table_destroy(events->inboxes);
+	g_mutex_clear(&events->lock);
+	g_free(events);
+	ctx->usb_events = NULL;
+}
+
+/**
+ * Take a snapshot of the USB bus for a scan of several drivers.
+ *
+ * Until sr_usb_scan_end() is called, sr_usb_get_device_list() returns
+ * the devices of the snapshot instead of enumerating the bus again.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Enumeration failed, drivers enumerate on their own.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_scan_begin(struct sr_context *ctx)
+{
+	struct sr_usb_scan *scan;
+	libusb_device **devlist;
+	ssize_t count;
+
+	if (!ctx->libusb_ctx || ctx->usb_scan)
+		return SR_ERR;
+
+	count = libusb_get_device_list(ctx->libusb_ctx, &devlist);
+	if (count < 0) {
+		sr_err("Failed to get device list: %s.",
+		       libusb_error_name((int)count));
+		return SR_ERR;
+	}
+	sr_dbg("Sharing a list of %zd USB devices.", count);
+
+	scan = g_malloc0(sizeof(*scan));
+	scan->devlist = devlist;
+	scan->count = count;
+	g_mutex_init(&scan->lock);
+	scan->strings = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, g_free);
+	ctx->usb_scan = scan;
+
+	return SR_OK;
+}
+
+/**
+ * Release the USB bus snapshot of sr_usb_scan_begin().
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_scan_end(struct sr_context *ctx)
+{
+	struct sr_usb_scan *scan;
+
+	scan = ctx->usb_scan;
+	if (!scan)
+		return;
+	ctx->usb_scan = NULL;
+
+	g_hash_table_destroy(scan->strings);
+	g_mutex_clear(&scan->lock);
+	libusb_free_device_list(scan->devlist, 1);
+	g_free(scan);
+}
+
+/**
+ * Get the list of USB devices.
+ *
+ * This is libusb_get_device_list() for the context's libusb context,
+ * except that the devices of a shared snapshot are returned while
+ * several drivers scan (see sr_usb_scan_begin()).
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param[out] list The NULL terminated list of devices. Must be released
+ *                  with libusb_free_device_list(list, 1).
+ *
+ * @return The number of devices, or a negative libusb error code.
+ *
+ * @private
+ */
+SR_PRIV ssize_t sr_usb_get_device_list(struct sr_context *ctx,
+		libusb_device ***list)
+{
+	struct sr_usb_scan *scan;
+	libusb_device **copy;
+	ssize_t i;
+
+	scan = ctx->usb_scan;
+	if (!scan)
+		return libusb_get_device_list(ctx->libusb_ctx, list);
+
+	/* libusb_free_device_list() releases the array with free(). */
+	copy = calloc(scan->count + 1, sizeof(*copy));
+	if (!copy)
+		return LIBUSB_ERROR_NO_MEM;
+	for (i = 0; i < scan->count; i++)
+		copy[i] = libusb_ref_device(scan->devlist[i]);
+	*list = copy;
+
+	return scan->count;
+}
+
+static int LIBUSB_CALL usb_renum_arrived(libusb_context *usb_ctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	struct sr_usb_renum *renum;
+	char path[64];
+	gint64 *when;
+
+	(void)usb_ctx;
+	(void)event;
+
+	renum = user_data;
+	if (usb_get_port_path(dev, path, sizeof(path)) < 0)
+		return 0;
+	sr_spew("USB device arrived at %s.", path);
+
+	when = g_malloc(sizeof(*when));
+	*when = g_get_monotonic_time();
+	g_mutex_lock(&renum->lock);
+	g_hash_table_replace(renum->arrivals, g_strdup(path), when);
+	g_mutex_unlock(&renum->lock);
+
+	/* Keep the callback registered. */
+	return 0;
+}
+
+static int usb_renum_watch_locked(struct sr_context *ctx)
+{
+	struct sr_usb_renum *renum;
+	int ret;
+
+	if (ctx->usb_renum)
+		return SR_OK;
+	if (!ctx->libusb_ctx || !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return SR_ERR_NA;
+
+	renum = g_malloc0(sizeof(*renum));
+	g_mutex_init(&renum->lock);
+	renum->arrivals = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, g_free);
+	ret = libusb_hotplug_register_callback(ctx->libusb_ctx,
+		LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, LIBUSB_HOTPLUG_NO_FLAGS,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+		LIBUSB_HOTPLUG_MATCH_ANY, usb_renum_arrived, renum,
+		&renum->handle);
+	if (ret != LIBUSB_SUCCESS) {
+		sr_err("Failed to register hotplug callback: %s.",
+		       libusb_error_name(ret));
+		g_hash_table_destroy(renum->arrivals);
+		g_mutex_clear(&renum->lock);
+		g_free(renum);
+		return SR_ERR;
+	}
+	ctx->usb_renum = renum;
+
+	return SR_OK;
+}
+
+/**
+ * Start watching for USB devices to (re-)appear on the bus.
+ *
+ * This gets called before firmware uploads, which make a device leave
+ * the bus and come back with a new identity. The watch stays active
+ * until the context is released. Calling this more than once is fine.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK The watch is active.
+ * @retval SR_ERR_NA libusb does not support hotplug events here.
+ * @retval SR_ERR Failed to register the hotplug callback.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_renum_watch(struct sr_context *ctx)
+{
+	/* Drivers may upload firmware from concurrent scans. */
+	static GMutex watch_lock;
+	int ret;
+
+	g_mutex_lock(&watch_lock);
+	ret = usb_renum_watch_locked(ctx);
+	g_mutex_unlock(&watch_lock);
+
+	return ret;
+}
+
+/**
+ * Wait for a USB device to appear at a port.
+ *
+ * This handles libusb events until the device arrived at the port
+ * after the given time, and returns as soon as that happened.
+ * Several threads can wait for different devices at the same time.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param port_path The port path, see usb_get_port_path().
+ * @param since_us Monotonic time from before the device left the bus,
+ *                 e.g. the time of its firmware upload.
+ * @param timeout_ms Give up at this many milliseconds after since_us.
+ *
+ * @retval SR_OK The device arrived.
+ * @retval SR_ERR_TIMEOUT The device did not arrive in time.
+ * @retval SR_ERR_NA No watch is active, see sr_usb_renum_watch(). The
+ *         caller has to poll for the device instead.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_renum_wait(struct sr_context *ctx, const char *port_path,
+		int64_t since_us, int timeout_ms)
+{
+	struct sr_usb_renum *renum;
+	struct timeval tv;
+	gint64 *when, now, deadline, wait_us;
+	gboolean arrived;
+
+	renum = ctx->usb_renum;
+	if (!renum || !port_path)
+		return SR_ERR_NA;
+
+	deadline = since_us + (int64_t)timeout_ms * 1000;
+	while (1) {
+		g_mutex_lock(&renum->lock);
+		when = g_hash_table_lookup(renum->arrivals, port_path);
+		arrived = when && *when >= since_us;
+		g_mutex_unlock(&renum->lock);
+		if (arrived)
+			return SR_OK;
+
+		now = g_get_monotonic_time();
+		if (now >= deadline)
+			return SR_ERR_TIMEOUT;
+		wait_us = MIN(deadline - now, 100 * 1000);
+		tv.tv_sec = wait_us / G_USEC_PER_SEC;
+		tv.tv_usec = wait_us % G_USEC_PER_SEC;
+		libusb_handle_events_timeout_completed(ctx->libusb_ctx,
+			&tv, NULL);
+	}
+}
+
+/**
+ * Stop the watch of sr_usb_renum_watch().
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_renum_unwatch(struct sr_context *ctx)
+{
+	struct sr_usb_renum *renum;
+
+	renum = ctx->usb_renum;
+	if (!renum)
+		return;
+	ctx->usb_renum = NULL;
+
+	libusb_hotplug_deregister_callback(ctx->libusb_ctx, renum->handle);
+	g_hash_table_destroy(renum->arrivals);
+	g_mutex_clear(&renum->lock);
+	g_free(renum);
+}
+
 /**
  * Find USB devices according to a connection string.
  *
@@ -438,9 +1168,23 @@ SR_PRIV int sr_usb_open(libusb_context *usb_ctx, struct sr_usb_dev_inst *usb)
 	return ret;
 }
 
+static gboolean usb_dev_mem_detach(struct sr_usb_dev_inst *usb);
+
+/**
+ * Close an opened USB device.
+ *
+ * When transfer buffers in device memory are still referenced, e.g. by
+ * datafeed packets which a frontend holds on to, the handle stays open
+ * until the last of them is released.
+ *
+ * @param usb The USB device.
+ *
+ * @private
+ */
 SR_PRIV void sr_usb_close(struct sr_usb_dev_inst *usb)
 {
-	libusb_close(usb->devhdl);
+	if (usb_dev_mem_detach(usb))
+		libusb_close(usb->devhdl);
 	usb->devhdl = NULL;
 	sr_dbg("Closed USB device %d.%d.", usb->bus, usb->address);
 }
@@ -449,15 +1193,25 @@ SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data)
 {
 	GSource *source;
+	struct usb_source *usource;
 	int ret;
 
-	source = usb_source_new(session, ctx->libusb_ctx, timeout);
+	source = usb_source_new(session, ctx, timeout);
 	if (!source)
 		return SR_ERR;
 
 	g_source_set_callback(source, G_SOURCE_FUNC(cb), cb_data, NULL);
 
 	ret = sr_session_source_add_internal(session, ctx->libusb_ctx, source);
+	usource = (struct usb_source *)source;
+	if (ret == SR_OK && usource->inbox) {
+		/* Completions may have arrived before the source. */
+		g_mutex_lock(&ctx->usb_events->lock);
+		usource->inbox->source = usource;
+		if (!g_queue_is_empty(&usource->inbox->completions))
+			g_main_context_wakeup(g_source_get_context(source));
+		g_mutex_unlock(&ctx->usb_events->lock);
+	}
 	g_source_unref(source);
 
 	return ret;
@@ -514,39 +1268,753 @@ SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len)
  * @return TRUE if the device's configuration profile strings
  *         configuration, FALSE otherwise.
  */
-SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
-		const char *manufacturer, const char *product)
+SR_PRIV gboolean usb_match_manuf_prod(struct sr_context *ctx,
+		libusb_device *dev, const char *manufacturer, const char *product)
 {
 	struct libusb_device_descriptor des;
 	struct libusb_device_handle *hdl;
+	struct usb_dev_strings *strings, *cached;
 	gboolean ret;
-	unsigned char strdesc[64];
 
-	hdl = NULL;
-	ret = FALSE;
-	while (!ret) {
-		/* Assume the FW has not been loaded, unless proven wrong. */
-		libusb_get_device_descriptor(dev, &des);
+	/* Several drivers check the same devices during a shared scan. */
+	cached = NULL;
+	if (ctx && ctx->usb_scan) {
+		g_mutex_lock(&ctx->usb_scan->lock);
+		cached = g_hash_table_lookup(ctx->usb_scan->strings, dev);
+		g_mutex_unlock(&ctx->usb_scan->lock);
+	}
 
-		if (libusb_open(dev, &hdl) != 0)
-			break;
+	if (cached) {
+		strings = cached;
+	} else {
+		strings = g_malloc0(sizeof(*strings));
+		hdl = NULL;
+		while (!strings->valid) {
+			/* Assume the FW has not been loaded, unless proven wrong. */
+			libusb_get_device_descriptor(dev, &des);
+
+			if (libusb_open(dev, &hdl) != 0)
+				break;
+
+			if (libusb_get_string_descriptor_ascii(hdl,
+					des.iManufacturer,
+					(unsigned char *)strings->manufacturer,
+					sizeof(strings->manufacturer)) < 0)
+				break;
+			if (libusb_get_string_descriptor_ascii(hdl,
+					des.iProduct,
+					(unsigned char *)strings->product,
+					sizeof(strings->product)) < 0)
+				break;
+
+			strings->valid = TRUE;
+		}
+		if (hdl)
+			libusb_close(hdl);
+	}
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iManufacturer, strdesc, sizeof(strdesc)) < 0)
-			break;
-		if (strcmp((const char *)strdesc, manufacturer))
-			break;
+	ret = strings->valid && !strcmp(strings->manufacturer, manufacturer)
+		&& !strcmp(strings->product, product);
+
+	/* Keep the first result, other threads may still refer to it. */
+	if (!cached && ctx && ctx->usb_scan) {
+		g_mutex_lock(&ctx->usb_scan->lock);
+		if (!g_hash_table_lookup(ctx->usb_scan->strings, dev)) {
+			g_hash_table_insert(ctx->usb_scan->strings, dev, strings);
+			strings = NULL;
+		}
+		g_mutex_unlock(&ctx->usb_scan->lock);
+	}
+	if (!cached)
+		g_free(strings);
+
+	return ret;
+}
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iProduct, strdesc, sizeof(strdesc)) < 0)
+/*
+ * The device memory mappings of one opened device handle. Datafeed
+ * buffers can outlive the acquisition, and get released from whatever
+ * thread drops the last reference, possibly after the device got
+ * closed. Every mapping holds a reference, the open device another
+ * one. Once the device was closed, the last mapping to go closes the
+ * handle. All of this is protected by the dev_mem lock.
+ */
+struct usb_dev_mem_pool {
+	struct libusb_device_handle *devhdl;
+	unsigned int refcount;
+	/* The device was closed, the handle now belongs to the pool. */
+	gboolean detached;
+};
+
+/* A transfer buffer which was mapped from device memory. */
+struct usb_dev_mem {
+	struct usb_dev_mem_pool *pool;
+	void *data;
+	size_t size;
+};
+
+G_LOCK_DEFINE_STATIC(dev_mem);
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+/* All mappings of all devices, by their address. */
+static GHashTable *dev_mem_maps;
+#endif
+
+/* Drop a reference to a pool, with the dev_mem lock held. */
+static gboolean usb_dev_mem_pool_unref(struct usb_dev_mem_pool *pool)
+{
+	if (--pool->refcount)
+		return FALSE;
+	if (pool->detached)
+		libusb_close(pool->devhdl);
+	g_free(pool);
+
+	return TRUE;
+}
+
+/*
+ * Release the device's reference to its mappings. Returns whether the
+ * caller is to close the handle, which is not the case while mappings
+ * are still in use.
+ */
+static gboolean usb_dev_mem_detach(struct sr_usb_dev_inst *usb)
+{
+	struct usb_dev_mem_pool *pool;
+	gboolean close_handle;
+
+	/* A new handle starts out with a new attempt. */
+	usb->dev_mem_failed = FALSE;
+	if (!(pool = usb->dev_mem))
+		return TRUE;
+	usb->dev_mem = NULL;
+
+	G_LOCK(dev_mem);
+	pool->detached = pool->refcount > 1;
+	if (pool->detached)
+		sr_dbg("Transfer buffers of USB device %d.%d still in use, "
+			"closing it once they are released.",
+			usb->bus, usb->address);
+	close_handle = !pool->detached;
+	usb_dev_mem_pool_unref(pool);
+	G_UNLOCK(dev_mem);
+
+	return close_handle;
+}
+
+/**
+ * Allocate a buffer for bulk transfers.
+ *
+ * Where libusb and the OS support it (usbfs on Linux), the buffer is
+ * mapped from device memory, which the host controller can DMA into
+ * directly. This saves the kernel one copy of every received byte.
+ * Otherwise, or when the device memory is exhausted, the buffer comes
+ * from the buffer pool, on the host controller's NUMA node.
+ *
+ * @param usb The opened USB device the buffer is used with.
+ * @param size The buffer size in bytes.
+ *
+ * @return The buffer, to be released with sr_usb_buffer_free(), or NULL
+ *         upon errors.
+ *
+ * @private
+ */
+SR_PRIV void *sr_usb_buffer_alloc(struct sr_usb_dev_inst *usb, size_t size)
+{
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+	struct usb_dev_mem *mem;
+	void *data;
+
+	if (usb && usb->devhdl && !usb->dev_mem_failed && size) {
+		data = libusb_dev_mem_alloc(usb->devhdl, size);
+		if (data) {
+			mem = g_malloc(sizeof(*mem));
+			mem->data = data;
+			mem->size = size;
+			G_LOCK(dev_mem);
+			if (!usb->dev_mem) {
+				usb->dev_mem = g_malloc0(sizeof(*usb->dev_mem));
+				usb->dev_mem->devhdl = usb->devhdl;
+				usb->dev_mem->refcount = 1;
+			}
+			mem->pool = usb->dev_mem;
+			mem->pool->refcount++;
+			if (!dev_mem_maps)
+				dev_mem_maps = g_hash_table_new(g_direct_hash,
+					g_direct_equal);
+			g_hash_table_insert(dev_mem_maps, data, mem);
+			G_UNLOCK(dev_mem);
+			return data;
+		}
+		/* Don't retry for every buffer, it won't get better. */
+		sr_dbg("No device memory for transfer buffers, using the heap.");
+		usb->dev_mem_failed = TRUE;
+	}
+#endif
+
+	return sr_buffer_alloc_node(NULL, size, sr_usb_numa_node(usb));
+}
+
+/**
+ * Release a buffer which was allocated by sr_usb_buffer_alloc().
+ *
+ * This is safe from any thread, and also after the device was closed or
+ * its instance freed.
+ *
+ * @param usb The USB device the buffer was allocated for. Unused, the
+ *            buffer knows.
+ * @param data The buffer. If NULL, this function does nothing.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_buffer_free(struct sr_usb_dev_inst *usb, void *data)
+{
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+	struct usb_dev_mem *mem;
+
+	(void)usb;
+
+	if (!data)
+		return;
+
+	G_LOCK(dev_mem);
+	mem = dev_mem_maps ? g_hash_table_lookup(dev_mem_maps, data) : NULL;
+	if (mem) {
+		g_hash_table_remove(dev_mem_maps, data);
+		libusb_dev_mem_free(mem->pool->devhdl, data, mem->size);
+		usb_dev_mem_pool_unref(mem->pool);
+	}
+	G_UNLOCK(dev_mem);
+	if (mem) {
+		g_free(mem);
+		return;
+	}
+#else
+	(void)usb;
+#endif
+
+	sr_buffer_free(data);
+}
+
+/**
+ * Get the NUMA node of the host controller which a USB device is on.
+ *
+ * Buffers which the controller fills are best placed there. Only
+ * systems with several nodes report one.
+ *
+ * @param usb The USB device. Can be NULL.
+ *
+ * @return The node, or -1 when unknown or when it doesn't matter.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_numa_node(struct sr_usb_dev_inst *usb)
+{
+#ifdef __linux__
+	char *path, *contents;
+
+	if (!usb || usb->replay)
+		return -1;
+	if (usb->numa_checked)
+		return usb->numa_node;
+
+	usb->numa_checked = TRUE;
+	usb->numa_node = -1;
+	if (!g_file_test("/sys/devices/system/node/node1", G_FILE_TEST_EXISTS))
+		return -1;
+
+	/* The root hub's parent is the controller, e.g. a PCI device. */
+	path = g_strdup_printf("/sys/bus/usb/devices/usb%u/../numa_node",
+		usb->bus);
+	if (g_file_get_contents(path, &contents, NULL, NULL)) {
+		usb->numa_node = (int)g_ascii_strtoll(contents, NULL, 10);
+		g_free(contents);
+	}
+	g_free(path);
+	if (usb->numa_node >= 0)
+		sr_dbg("USB bus %u is on NUMA node %d.", usb->bus,
+			usb->numa_node);
+
+	return usb->numa_node;
+#else
+	(void)usb;
+	return -1;
+#endif
+}
+
+static void usb_datafeed_buffer_free(void *data, void *cb_data)
+{
+	/* The device instance may be gone by now, the buffer doesn't need it. */
+	(void)cb_data;
+
+	sr_usb_buffer_free(NULL, data);
+}
+
+/**
+ * Allocate a refcounted datafeed buffer for bulk transfers, see
+ * sr_usb_buffer_alloc().
+ *
+ * @private
+ */
+SR_PRIV struct sr_datafeed_buffer *sr_usb_datafeed_buffer_new(
+		struct sr_usb_dev_inst *usb, size_t size)
+{
+	struct sr_datafeed_buffer *buf;
+	void *data;
+
+	if (!size || !(data = sr_usb_buffer_alloc(usb, size)))
+		return NULL;
+
+	buf = sr_datafeed_buffer_new_wrap(data, size,
+		usb_datafeed_buffer_free, NULL);
+	if (!buf)
+		sr_usb_buffer_free(usb, data);
+
+	return buf;
+}
+
+/*
+ * Shared bulk IN streaming engine.
+ *
+ * A stream owns a fixed set of transfers and one spare buffer more than
+ * there are transfers. When a transfer completes, its buffer is swapped
+ * for a spare one and the transfer is resubmitted right away, before the
+ * driver gets to decode the data. Every submission gets a sequence number,
+ * and completed buffers are handed to the decode hook strictly in that
+ * order. Transfers which complete while no buffer is available, or which
+ * would run too far ahead of the decoder, are parked until a buffer is
+ * returned.
+ */
+
+/* Default number of consecutive empty or failed transfers to tolerate. */
+#define USB_STREAM_MAX_EMPTY 64
+
+struct usb_stream_slot {
+	uint8_t *buffer;
+	size_t length;
+	gboolean filled;
+};
+
+struct usb_stream_xfer {
+	struct sr_usb_stream *stream;
+	struct libusb_transfer *transfer;
+	uint64_t seq;
+	gboolean submitted;
+	gboolean parked;
+};
+
+struct sr_usb_stream {
+	const struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	size_t transfer_size;
+	sr_usb_stream_decode_cb decode;
+	sr_usb_stream_done_cb done;
+	void *cb_data;
+	unsigned int max_empty;
+
+	size_t num_transfers;
+	struct usb_stream_xfer *xfers;
+	/* All buffers, num_transfers + 1 of them. */
+	uint8_t **buffers;
+	/* Buffers attached to neither a transfer nor a pending slot. */
+	uint8_t **spare;
+	size_t num_spare;
+	/* Completed submissions, indexed by sequence number. */
+	struct usb_stream_slot *pending;
+	size_t num_pending;
+
+	uint64_t next_seq;
+	uint64_t deliver_seq;
+	size_t submitted;
+	unsigned int empty_count;
+	gboolean active;
+	gboolean stopping;
+	gboolean free_on_done;
+	int status;
+	/* Nesting depth of engine calls which must not see the stream end. */
+	int depth;
+};
+
+static void usb_stream_destroy(struct sr_usb_stream *stream)
+{
+	size_t i;
+
+	for (i = 0; stream->xfers && i < stream->num_transfers; i++)
+		libusb_free_transfer(stream->xfers[i].transfer);
+	for (i = 0; stream->buffers && i <= stream->num_transfers; i++)
+		sr_usb_buffer_free(stream->usb, stream->buffers[i]);
+	g_free(stream->xfers);
+	g_free(stream->buffers);
+	g_free(stream->spare);
+	g_free(stream->pending);
+	g_free(stream);
+}
+
+/* Run the done callback once the last transfer was released. */
+static void usb_stream_check_done(struct sr_usb_stream *stream)
+{
+	gboolean free_after;
+
+	if (stream->depth || !stream->active || !stream->stopping)
+		return;
+	if (stream->submitted)
+		return;
+
+	stream->active = FALSE;
+	free_after = stream->free_on_done;
+
+	sr_dbg("Stream ended after %" PRIu64 " transfers: %s.",
+		stream->deliver_seq, sr_strerror(stream->status));
+	if (stream->done)
+		stream->done(stream->sdi, stream->status, stream->cb_data);
+
+	/* The done callback may have released the stream itself. */
+	if (free_after)
+		usb_stream_destroy(stream);
+}
+
+static void usb_stream_halt(struct sr_usb_stream *stream, int status)
+{
+	size_t i;
+
+	if (!stream->stopping) {
+		stream->stopping = TRUE;
+		stream->status = status;
+		for (i = 0; i < stream->num_transfers; i++) {
+			stream->xfers[i].parked = FALSE;
+			if (stream->xfers[i].submitted)
+				sr_usb_cancel_transfer(stream->sdi,
+					stream->xfers[i].transfer);
+		}
+	}
+
+	usb_stream_check_done(stream);
+}
+
+static int usb_stream_submit(struct sr_usb_stream *stream,
+		struct usb_stream_xfer *xfer)
+{
+	struct libusb_transfer *transfer;
+	int ret;
+
+	transfer = xfer->transfer;
+	xfer->parked = TRUE;
+
+	if (stream->next_seq - stream->deliver_seq >= stream->num_pending)
+		return SR_OK;
+	if (!transfer->buffer) {
+		if (!stream->num_spare)
+			return SR_OK;
+		transfer->buffer = stream->spare[--stream->num_spare];
+	}
+
+	if ((ret = sr_usb_submit_transfer(stream->sdi, transfer)) != 0) {
+		sr_err("Failed to submit transfer: %s.", libusb_error_name(ret));
+		xfer->parked = FALSE;
+		return SR_ERR_IO;
+	}
+
+	xfer->parked = FALSE;
+	xfer->submitted = TRUE;
+	xfer->seq = stream->next_seq++;
+	stream->submitted++;
+
+	return SR_OK;
+}
+
+/* Resubmit transfers which were waiting for a buffer. */
+static void usb_stream_unpark(struct sr_usb_stream *stream)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < stream->num_transfers && !stream->stopping; i++) {
+		if (!stream->xfers[i].parked)
+			continue;
+		if ((ret = usb_stream_submit(stream, &stream->xfers[i])) != SR_OK)
+			usb_stream_halt(stream, ret);
+		else if (stream->xfers[i].parked)
 			break;
-		if (strcmp((const char *)strdesc, product))
+	}
+}
+
+/* Hand completed buffers to the decoder, in submission order. */
+static void usb_stream_deliver(struct sr_usb_stream *stream)
+{
+	struct usb_stream_slot *slot;
+	int64_t start;
+	int ret;
+
+	while (!stream->stopping) {
+		slot = &stream->pending[stream->deliver_seq % stream->num_pending];
+		if (!slot->filled)
 			break;
+		slot->filled = FALSE;
+
+		if (slot->buffer) {
+			start = sr_trace_now();
+			ret = stream->decode(stream->sdi, stream->deliver_seq,
+				slot->buffer, slot->length, stream->cb_data);
+			sr_trace_span("usb decode", start, "length", slot->length);
+			stream->spare[stream->num_spare++] = slot->buffer;
+			slot->buffer = NULL;
+			if (ret != SR_OK)
+				usb_stream_halt(stream, ret);
+		}
+		stream->deliver_seq++;
+	}
+
+	usb_stream_unpark(stream);
+}
+
+static void LIBUSB_CALL usb_stream_receive(struct libusb_transfer *transfer)
+{
+	struct usb_stream_xfer *xfer;
+	struct sr_usb_stream *stream;
+	struct usb_stream_slot *slot;
+	gboolean dropped, empty;
+	int ret;
+
+	xfer = transfer->user_data;
+	stream = xfer->stream;
+
+	xfer->submitted = FALSE;
+	stream->submitted--;
+	stream->depth++;
+	sr_session_receive_mark();
+
+	sr_spew("Transfer %" PRIu64 ": status %s, %d bytes.", xfer->seq,
+		libusb_error_name(transfer->status), transfer->actual_length);
+
+	if (stream->stopping)
+		goto out;
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		sr_err("Device disappeared during streaming.");
+		usb_stream_halt(stream, SR_ERR_IO);
+		goto out;
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data. */
+		dropped = FALSE;
+		break;
+	default:
+		dropped = TRUE;
+		break;
+	}
+	empty = !dropped && transfer->actual_length == 0;
+
+	slot = &stream->pending[xfer->seq % stream->num_pending];
+	slot->filled = TRUE;
+	slot->buffer = NULL;
+	slot->length = 0;
+	if (!dropped && !empty) {
+		slot->buffer = transfer->buffer;
+		slot->length = transfer->actual_length;
+		transfer->buffer = NULL;
+	}
+
+	if (dropped || empty) {
+		if (sr_trace_enabled())
+			sr_trace_instant(dropped ? "usb dropped" : "usb empty",
+				"seq", xfer->seq);
+		sr_session_report_transfers(stream->sdi, dropped, empty);
+		if (++stream->empty_count > stream->max_empty) {
+			/*
+			 * The device gave up. End the stream, the frontend
+			 * will work out that the sample count is short.
+			 */
+			sr_warn("Too many empty transfers, stopping.");
+			usb_stream_halt(stream, SR_ERR_TIMEOUT);
+			goto out;
+		}
+	} else {
+		stream->empty_count = 0;
+	}
+
+	/* Get the transfer back to the device before decoding. */
+	if ((ret = usb_stream_submit(stream, xfer)) != SR_OK) {
+		usb_stream_halt(stream, ret);
+		goto out;
+	}
+
+	usb_stream_deliver(stream);
+
+out:
+	stream->depth--;
+	usb_stream_check_done(stream);
+}
 
-		ret = TRUE;
+/**
+ * Create a bulk IN stream for a USB device.
+ *
+ * The transfers and their buffers are allocated here, once, and get
+ * reused for every acquisition which runs on the stream.
+ *
+ * @param sdi The device instance, its conn must be an opened USB device.
+ * @param endpoint The bulk IN endpoint address.
+ * @param num_transfers Number of transfers to keep in flight.
+ * @param transfer_size Size of each transfer in bytes.
+ * @param timeout Transfer timeout in ms.
+ * @param decode Called with each completed buffer, in order.
+ * @param done Called once the stream ended and all transfers came back.
+ * @param cb_data Opaque pointer passed to the callbacks.
+ *
+ * @return The new stream, or NULL upon errors.
+ *
+ * @private
+ */
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(const struct sr_dev_inst *sdi,
+		unsigned char endpoint, size_t num_transfers, size_t transfer_size,
+		unsigned int timeout, sr_usb_stream_decode_cb decode,
+		sr_usb_stream_done_cb done, void *cb_data)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_stream *stream;
+	struct libusb_transfer *transfer;
+	size_t i;
+
+	if (!sdi || !sdi->conn || !num_transfers || !transfer_size || !decode)
+		return NULL;
+	usb = sdi->conn;
+
+	stream = g_malloc0(sizeof(*stream));
+	stream->sdi = sdi;
+	stream->usb = usb;
+	stream->transfer_size = transfer_size;
+	stream->decode = decode;
+	stream->done = done;
+	stream->cb_data = cb_data;
+	stream->max_empty = USB_STREAM_MAX_EMPTY;
+	stream->num_transfers = num_transfers;
+	stream->num_pending = 2 * num_transfers;
+	stream->xfers = g_malloc0_n(num_transfers, sizeof(stream->xfers[0]));
+	stream->buffers = g_malloc0_n(num_transfers + 1, sizeof(stream->buffers[0]));
+	stream->spare = g_malloc0_n(num_transfers + 1, sizeof(stream->spare[0]));
+	stream->pending = g_malloc0_n(stream->num_pending,
+		sizeof(stream->pending[0]));
+
+	for (i = 0; i <= num_transfers; i++) {
+		stream->buffers[i] = sr_usb_buffer_alloc(usb, transfer_size);
+		if (!stream->buffers[i]) {
+			sr_err("USB transfer buffer malloc failed.");
+			usb_stream_destroy(stream);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < num_transfers; i++) {
+		if (!(transfer = libusb_alloc_transfer(0))) {
+			sr_err("USB transfer malloc failed.");
+			usb_stream_destroy(stream);
+			return NULL;
+		}
+		stream->xfers[i].stream = stream;
+		stream->xfers[i].transfer = transfer;
+		libusb_fill_bulk_transfer(transfer, usb->devhdl, endpoint,
+			stream->buffers[i], transfer_size, usb_stream_receive,
+			&stream->xfers[i], timeout);
+	}
+
+	return stream;
+}
+
+/**
+ * Set how many consecutive empty or failed transfers a stream tolerates
+ * before it gives up.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_set_max_empty(struct sr_usb_stream *stream,
+		unsigned int max_empty)
+{
+	if (stream)
+		stream->max_empty = max_empty;
+}
+
+/**
+ * Submit all transfers of a stream.
+ *
+ * Once this was called, the done callback runs exactly once, even when
+ * submitting fails. In that case it may run before this returns.
+ *
+ * @return SR_OK upon success, a negative error code otherwise.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_stream_start(struct sr_usb_stream *stream)
+{
+	size_t i;
+	int ret;
+
+	if (!stream)
+		return SR_ERR_ARG;
+	if (stream->active) {
+		sr_err("Stream is already running.");
+		return SR_ERR_BUG;
+	}
+
+	stream->next_seq = 0;
+	stream->deliver_seq = 0;
+	stream->empty_count = 0;
+	stream->stopping = FALSE;
+	stream->status = SR_OK;
+	memset(stream->pending, 0, stream->num_pending * sizeof(stream->pending[0]));
+	for (i = 0; i < stream->num_transfers; i++) {
+		stream->xfers[i].parked = FALSE;
+		stream->xfers[i].transfer->buffer = stream->buffers[i];
+	}
+	stream->spare[0] = stream->buffers[stream->num_transfers];
+	stream->num_spare = 1;
+	stream->active = TRUE;
+
+	stream->depth++;
+	for (i = 0; i < stream->num_transfers; i++) {
+		if ((ret = usb_stream_submit(stream, &stream->xfers[i])) != SR_OK) {
+			usb_stream_halt(stream, ret);
+			break;
+		}
 	}
-	if (hdl)
-		libusb_close(hdl);
+	ret = stream->status;
+	stream->depth--;
+	usb_stream_check_done(stream);
 
 	return ret;
 }
+
+/**
+ * Cancel all transfers of a running stream.
+ *
+ * Data which arrives from here on is discarded. The done callback runs
+ * once all transfers were released. Stopping a stream which does not
+ * run is a no-op.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_stop(struct sr_usb_stream *stream)
+{
+	if (!stream || !stream->active)
+		return;
+
+	usb_stream_halt(stream, SR_OK);
+}
+
+/**
+ * Release a stream.
+ *
+ * A running stream gets stopped, and is released after its done callback
+ * ran. It is fine to release a stream from within its done callback.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->active) {
+		stream->free_on_done = TRUE;
+		usb_stream_halt(stream, SR_OK);
+		return;
+	}
+
+	usb_stream_destroy(stream);
+}
@@ -0,0 +1,1106 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libusb.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "usb-replay"
+
+/**
+ * @file
+ *
+ * Recording and replay of USB transfers.
+ *
+ * Drivers make their transfers through the sr_usb_*_transfer()
+ * wrappers. When the SIGROK_USB_RECORD environment variable names a
+ * directory, each device writes the transfers it makes to a dump file in
+ * there. Scanning with a conn of "replay:<dump>" creates a device which
+ * completes its transfers from such a dump instead of the hardware, so
+ * that the driver's receive and conversion paths run without it. With
+ * tracing on (see trace.c), the wrappers also trace when transfers are
+ * in flight and how long the driver's callbacks take.
+ *
+ * Sessions in raw recording mode (see sr_session_raw_record_set()) have
+ * supporting drivers record from the acquisition start, and skip their
+ * decoding. The device's configuration goes into the dump, and gets
+ * restored when it is replayed, which then decodes the data.
+ *
+ * A writer thread writes the dump in blocks of RECORD_BLOCK_SIZE, so
+ * that the file system doesn't hold up the transfers' completion.
+ *
+ * A dump starts with the magic and a version, followed by records of
+ * DUMP_RECORD_SIZE bytes each (little endian), which are:
+ *  - the kind (control, bulk or asynchronous transfer, device identity)
+ *  - the endpoint, or the bmRequestType of control transfers
+ *  - the bRequest of control transfers
+ *  - the libusb error code or transfer status, as a signed byte
+ *  - the wValue and wIndex of control transfers, VID and PID of the device
+ *  - the transferred length
+ *  - the length of the data which follows, only IN data is recorded
+ * The first record identifies the device, its data are the manufacturer,
+ * product and serial number strings, each NUL terminated. A metadata
+ * record's data are "<config key id>=<GVariant text>" and
+ * "channels=<enabled channel names>" lines.
+ */
+
+#define DUMP_MAGIC "SRUSBDMP"
+#define DUMP_VERSION 1
+#define DUMP_HEADER_SIZE (sizeof(DUMP_MAGIC) - 1 + 4)
+#define DUMP_RECORD_SIZE 16
+
+#define RECORD_BLOCK_SIZE (4 * 1024 * 1024)
+/* Full blocks which may wait for the writer before recording stalls. */
+#define RECORD_MAX_BLOCKS 32
+
+enum usb_dump_kind {
+	DUMP_CONTROL,
+	DUMP_BULK,
+	DUMP_ASYNC,
+	DUMP_DEVICE,
+	DUMP_META,
+};
+
+/* Configuration which a raw recording's replay needs to decode it. */
+static const uint32_t meta_keys[] = {
+	SR_CONF_SAMPLERATE,
+	SR_CONF_LIMIT_SAMPLES,
+	SR_CONF_CONTINUOUS,
+	SR_CONF_EXTERNAL_CLOCK,
+	SR_CONF_CLOCK_EDGE,
+	SR_CONF_VOLTAGE_THRESHOLD,
+	SR_CONF_CAPTURE_RATIO,
+};
+
+struct usb_dump_record {
+	uint8_t kind;
+	uint8_t endpoint;
+	uint8_t request;
+	int status;
+	uint16_t value;
+	uint16_t index;
+	uint32_t length;
+	const uint8_t *data;
+	uint32_t data_length;
+};
+
+struct usb_replay_pending {
+	struct libusb_transfer *transfer;
+	gboolean cancelled;
+};
+
+/** A dump which completes the transfers of a USB device. */
+struct sr_usb_replay {
+	GMappedFile *file;
+	uint16_t vid;
+	uint16_t pid;
+	/* Manufacturer, product and serial number. */
+	char *strings[3];
+	/* Configuration lines of a raw recording, if any. */
+	char *meta;
+	/* Control and bulk transfers, in the order they were made. */
+	GArray *sync;
+	guint sync_pos;
+	/* Asynchronous transfers, per IN endpoint number. */
+	GArray *async[16];
+	guint async_pos[16];
+	struct sr_session *session;
+	/* Submitted transfers, completed from the session's main loop. */
+	GQueue *pending;
+	gboolean dispatching;
+};
+
+/** The dump file which a USB device records to. */
+struct sr_usb_record {
+	GMutex lock;
+	GCond cond;
+	FILE *file;
+	/* The block being filled. */
+	uint8_t *block;
+	size_t fill;
+	/* Full blocks for the writer thread. */
+	GQueue queue;
+	GThread *thread;
+	gboolean quit;
+	gboolean failed;
+};
+
+struct record_block {
+	uint8_t *data;
+	size_t length;
+};
+
+/* A transfer which gets recorded or traced on its way to the driver. */
+struct usb_xfer_hook {
+	struct sr_usb_record *record;
+	libusb_transfer_cb_fn callback;
+	void *user_data;
+};
+
+/* Nesting depth of driver callbacks, tells resubmissions from submissions. */
+static GPrivate usb_callback_depth;
+
+static void usb_record_write(struct sr_usb_record *record,
+		const struct usb_dump_record *rec);
+
+static void usb_record_identity(struct sr_usb_record *record,
+		struct sr_usb_dev_inst *usb)
+{
+	struct libusb_device_descriptor des;
+	struct usb_dump_record rec;
+	uint8_t index[3];
+	GString *strings;
+	char buf[64];
+	size_t i;
+
+	memset(&des, 0, sizeof(des));
+	libusb_get_device_descriptor(libusb_get_device(usb->devhdl), &des);
+	index[0] = des.iManufacturer;
+	index[1] = des.iProduct;
+	index[2] = des.iSerialNumber;
+
+	strings = g_string_new(NULL);
+	for (i = 0; i < ARRAY_SIZE(index); i++) {
+		buf[0] = '\0';
+		if (index[i] && libusb_get_string_descriptor_ascii(usb->devhdl,
+				index[i], (unsigned char *)buf, sizeof(buf)) < 0)
+			buf[0] = '\0';
+		g_string_append_len(strings, buf, strlen(buf) + 1);
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = DUMP_DEVICE;
+	rec.value = des.idVendor;
+	rec.index = des.idProduct;
+	rec.data = (const uint8_t *)strings->str;
+	rec.data_length = strings->len;
+	usb_record_write(record, &rec);
+	g_string_free(strings, TRUE);
+}
+
+static void usb_record_block_write(struct sr_usb_record *record,
+		struct record_block *block)
+{
+	if (!record->failed && fwrite(block->data, 1, block->length,
+			record->file) != block->length) {
+		sr_err("Failed to write USB dump: %s.", g_strerror(errno));
+		record->failed = TRUE;
+	}
+	sr_buffer_free(block->data);
+	g_free(block);
+}
+
+static gpointer usb_record_thread(gpointer data)
+{
+	struct sr_usb_record *record;
+	struct record_block *block;
+
+	record = data;
+
+	g_mutex_lock(&record->lock);
+	for (;;) {
+		if (!(block = g_queue_pop_head(&record->queue))) {
+			if (record->quit)
+				break;
+			g_cond_wait(&record->cond, &record->lock);
+			continue;
+		}
+		/* The recording side may wait for room. */
+		g_cond_broadcast(&record->cond);
+		g_mutex_unlock(&record->lock);
+		usb_record_block_write(record, block);
+		g_mutex_lock(&record->lock);
+	}
+	g_mutex_unlock(&record->lock);
+
+	return NULL;
+}
+
+/* Hand the current block to the writer. Called with the lock held. */
+static void usb_record_push(struct sr_usb_record *record)
+{
+	struct record_block *block;
+
+	if (!record->fill)
+		return;
+
+	block = g_malloc(sizeof(*block));
+	block->data = record->block;
+	block->length = record->fill;
+	record->block = NULL;
+	record->fill = 0;
+
+	if (!record->thread) {
+		usb_record_block_write(record, block);
+		return;
+	}
+	while (g_queue_get_length(&record->queue) >= RECORD_MAX_BLOCKS)
+		g_cond_wait(&record->cond, &record->lock);
+	g_queue_push_tail(&record->queue, block);
+	g_cond_broadcast(&record->cond);
+}
+
+/* Called with the lock held. */
+static void usb_record_append(struct sr_usb_record *record,
+		const uint8_t *data, size_t length)
+{
+	size_t count;
+
+	while (length) {
+		if (!record->block) {
+			record->block = sr_buffer_alloc(NULL, RECORD_BLOCK_SIZE);
+			if (!record->block) {
+				if (!record->failed)
+					sr_err("Cannot allocate USB dump block.");
+				record->failed = TRUE;
+				return;
+			}
+		}
+		count = MIN(length, RECORD_BLOCK_SIZE - record->fill);
+		memcpy(record->block + record->fill, data, count);
+		record->fill += count;
+		data += count;
+		length -= count;
+		if (record->fill == RECORD_BLOCK_SIZE)
+			usb_record_push(record);
+	}
+}
+
+static struct sr_usb_record *usb_record_open(struct sr_usb_dev_inst *usb,
+		const char *dir)
+{
+	struct sr_usb_record *record;
+	char *name, *path;
+	uint8_t header[DUMP_HEADER_SIZE];
+	FILE *file;
+
+	name = g_strdup_printf("usb-%d.%d.dump", usb->bus, usb->address);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+	file = g_fopen(path, "wb");
+	if (!file) {
+		sr_err("Cannot record to '%s': %s.", path, g_strerror(errno));
+		g_free(path);
+		return NULL;
+	}
+	/* Only whole blocks get written, stdio buffering won't help. */
+	setvbuf(file, NULL, _IONBF, 0);
+	sr_info("Recording USB transfers of %d.%d to '%s'.",
+		usb->bus, usb->address, path);
+	g_free(path);
+
+	record = g_malloc0(sizeof(*record));
+	g_mutex_init(&record->lock);
+	g_cond_init(&record->cond);
+	g_queue_init(&record->queue);
+	record->file = file;
+	record->thread = g_thread_try_new("sr-usb-record",
+		usb_record_thread, record, NULL);
+	if (!record->thread)
+		sr_warn("Cannot create USB dump writer, writing synchronously.");
+
+	memcpy(header, DUMP_MAGIC, sizeof(DUMP_MAGIC) - 1);
+	WL32(&header[sizeof(DUMP_MAGIC) - 1], DUMP_VERSION);
+	g_mutex_lock(&record->lock);
+	usb_record_append(record, header, sizeof(header));
+	g_mutex_unlock(&record->lock);
+	usb_record_identity(record, usb);
+
+	return record;
+}
+
+/* Write out what is left, and close the dump. */
+static void usb_record_close(struct sr_usb_record *record)
+{
+	g_mutex_lock(&record->lock);
+	usb_record_push(record);
+	record->quit = TRUE;
+	g_cond_broadcast(&record->cond);
+	g_mutex_unlock(&record->lock);
+	if (record->thread)
+		g_thread_join(record->thread);
+
+	sr_buffer_free(record->block);
+	if (fclose(record->file) != 0 || record->failed)
+		sr_err("USB dump is incomplete.");
+	g_cond_clear(&record->cond);
+	g_mutex_clear(&record->lock);
+	g_free(record);
+}
+
+static struct sr_usb_record *usb_record_get(struct sr_usb_dev_inst *usb)
+{
+	const char *dir;
+
+	if (usb->record_checked)
+		return usb->record;
+	usb->record_checked = TRUE;
+
+	if (!(dir = g_getenv("SIGROK_USB_RECORD")))
+		return NULL;
+	usb->record = usb_record_open(usb, dir);
+
+	return usb->record;
+}
+
+static void usb_record_write(struct sr_usb_record *record,
+		const struct usb_dump_record *rec)
+{
+	uint8_t header[DUMP_RECORD_SIZE];
+
+	W8(&header[0], rec->kind);
+	W8(&header[1], rec->endpoint);
+	W8(&header[2], rec->request);
+	W8(&header[3], (int8_t)rec->status);
+	WL16(&header[4], rec->value);
+	WL16(&header[6], rec->index);
+	WL32(&header[8], rec->length);
+	WL32(&header[12], rec->data_length);
+
+	g_mutex_lock(&record->lock);
+	usb_record_append(record, header, sizeof(header));
+	usb_record_append(record, rec->data, rec->data_length);
+	g_mutex_unlock(&record->lock);
+}
+
+/* Record the device's configuration, which decoding the dump needs. */
+static void usb_record_meta(struct sr_usb_record *record,
+		const struct sr_dev_inst *sdi)
+{
+	const struct sr_key_info *info;
+	const struct sr_channel *ch;
+	struct usb_dump_record rec;
+	GVariant *data;
+	GString *meta;
+	GSList *l;
+	gboolean first;
+	char *text;
+	size_t i;
+
+	meta = g_string_new(NULL);
+	for (i = 0; i < ARRAY_SIZE(meta_keys); i++) {
+		if (!(info = sr_key_info_get(SR_KEY_CONFIG, meta_keys[i])))
+			continue;
+		data = NULL;
+		if (sdi->driver->config_get(meta_keys[i], &data, sdi, NULL)
+				!= SR_OK || !data)
+			continue;
+		text = g_variant_print(data, TRUE);
+		g_string_append_printf(meta, "%s=%s\n", info->id, text);
+		g_free(text);
+		g_variant_unref(data);
+	}
+	g_string_append(meta, "channels=");
+	first = TRUE;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled)
+			continue;
+		g_string_append_printf(meta, "%s%s", first ? "" : ",", ch->name);
+		first = FALSE;
+	}
+	g_string_append_c(meta, '\n');
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = DUMP_META;
+	rec.data = (const uint8_t *)meta->str;
+	rec.data_length = meta->len;
+	usb_record_write(record, &rec);
+	g_string_free(meta, TRUE);
+}
+
+static void LIBUSB_CALL usb_hook_complete(struct libusb_transfer *transfer)
+{
+	struct usb_xfer_hook *hook;
+	struct usb_dump_record rec;
+	int64_t start;
+	int depth, length;
+
+	/* Have the driver see its own callback data again. */
+	hook = transfer->user_data;
+	transfer->callback = hook->callback;
+	transfer->user_data = hook->user_data;
+
+	if (hook->record) {
+		memset(&rec, 0, sizeof(rec));
+		rec.kind = DUMP_ASYNC;
+		rec.endpoint = transfer->endpoint;
+		rec.status = transfer->status;
+		rec.length = transfer->actual_length;
+		if (transfer->endpoint & LIBUSB_ENDPOINT_IN) {
+			rec.data = transfer->buffer;
+			rec.data_length = transfer->actual_length;
+		}
+		usb_record_write(hook->record, &rec);
+	}
+	g_free(hook);
+
+	if (!sr_trace_enabled()) {
+		transfer->callback(transfer);
+		return;
+	}
+
+	sr_trace_async("usb transfer", FALSE, transfer,
+		"status", transfer->status);
+	/* The driver may free the transfer in its callback. */
+	length = transfer->actual_length;
+	depth = GPOINTER_TO_INT(g_private_get(&usb_callback_depth));
+	g_private_set(&usb_callback_depth, GINT_TO_POINTER(depth + 1));
+	start = sr_trace_now();
+	transfer->callback(transfer);
+	sr_trace_span("usb callback", start, "length", length);
+	g_private_set(&usb_callback_depth, GINT_TO_POINTER(depth));
+}
+
+static gboolean usb_replay_parse(struct sr_usb_replay *replay)
+{
+	struct usb_dump_record rec;
+	const uint8_t *p, *end;
+	const char *str, *str_end;
+	guint ep;
+	size_t i;
+
+	p = (const uint8_t *)g_mapped_file_get_contents(replay->file);
+	end = p + g_mapped_file_get_length(replay->file);
+
+	if ((size_t)(end - p) < DUMP_HEADER_SIZE
+			|| memcmp(p, DUMP_MAGIC, sizeof(DUMP_MAGIC) - 1)) {
+		sr_err("Not a USB dump.");
+		return FALSE;
+	}
+	if (RL32(p + sizeof(DUMP_MAGIC) - 1) != DUMP_VERSION) {
+		sr_err("Unsupported USB dump version %u.",
+			RL32(p + sizeof(DUMP_MAGIC) - 1));
+		return FALSE;
+	}
+	p += DUMP_HEADER_SIZE;
+
+	while (end - p >= DUMP_RECORD_SIZE) {
+		rec.kind = R8(&p[0]);
+		rec.endpoint = R8(&p[1]);
+		rec.request = R8(&p[2]);
+		rec.status = (int8_t)R8(&p[3]);
+		rec.value = RL16(&p[4]);
+		rec.index = RL16(&p[6]);
+		rec.length = RL32(&p[8]);
+		rec.data_length = RL32(&p[12]);
+		if ((size_t)(end - p - DUMP_RECORD_SIZE) < rec.data_length)
+			break;
+		p += DUMP_RECORD_SIZE;
+		rec.data = p;
+		p += rec.data_length;
+
+		switch (rec.kind) {
+		case DUMP_DEVICE:
+			replay->vid = rec.value;
+			replay->pid = rec.index;
+			str = (const char *)rec.data;
+			str_end = str + rec.data_length;
+			for (i = 0; i < ARRAY_SIZE(replay->strings); i++) {
+				g_free(replay->strings[i]);
+				replay->strings[i] = g_strndup(str, str_end - str);
+				str = MIN(str + strlen(replay->strings[i]) + 1, str_end);
+			}
+			break;
+		case DUMP_META:
+			g_free(replay->meta);
+			replay->meta = g_strndup((const char *)rec.data,
+				rec.data_length);
+			break;
+		case DUMP_ASYNC:
+			if (!(rec.endpoint & LIBUSB_ENDPOINT_IN))
+				break;
+			ep = rec.endpoint & 0x0f;
+			if (!replay->async[ep])
+				replay->async[ep] = g_array_new(FALSE, FALSE, sizeof(rec));
+			g_array_append_val(replay->async[ep], rec);
+			break;
+		default:
+			g_array_append_val(replay->sync, rec);
+			break;
+		}
+	}
+	if (p != end)
+		sr_warn("Ignoring a truncated record at the end of the dump.");
+	if (!replay->strings[0]) {
+		sr_err("USB dump lacks the device identity.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void usb_replay_free(struct sr_usb_replay *replay)
+{
+	size_t i;
+
+	if (!g_queue_is_empty(replay->pending))
+		sr_warn("Releasing USB replay with transfers in flight.");
+	g_queue_free_full(replay->pending, g_free);
+	for (i = 0; i < ARRAY_SIZE(replay->async); i++) {
+		if (replay->async[i])
+			g_array_free(replay->async[i], TRUE);
+	}
+	for (i = 0; i < ARRAY_SIZE(replay->strings); i++)
+		g_free(replay->strings[i]);
+	g_free(replay->meta);
+	g_array_free(replay->sync, TRUE);
+	g_mapped_file_unref(replay->file);
+	g_free(replay);
+}
+
+/**
+ * Get the dump file name from a conn specification, if it selects replay.
+ *
+ * @private
+ */
+SR_PRIV const char *sr_usb_replay_path(const char *conn)
+{
+	if (!conn || !g_str_has_prefix(conn, SR_USB_REPLAY_PREFIX))
+		return NULL;
+
+	return conn + strlen(SR_USB_REPLAY_PREFIX);
+}
+
+/**
+ * Create a USB device instance which replays a dump.
+ *
+ * The instance never gets opened, its transfers complete from the dump
+ * in the main loop of the device's session. The dump gets released with
+ * the instance.
+ *
+ * @param path The dump file.
+ *
+ * @return The instance, or NULL upon errors.
+ *
+ * @private
+ */
+SR_PRIV struct sr_usb_dev_inst *sr_usb_replay_open(const char *path)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_replay *replay;
+	GError *error;
+
+	error = NULL;
+	replay = g_malloc0(sizeof(*replay));
+	replay->file = g_mapped_file_new(path, FALSE, &error);
+	if (!replay->file) {
+		sr_err("Cannot open '%s': %s.", path, error->message);
+		g_error_free(error);
+		g_free(replay);
+		return NULL;
+	}
+	replay->sync = g_array_new(FALSE, FALSE, sizeof(struct usb_dump_record));
+	replay->pending = g_queue_new();
+
+	if (!usb_replay_parse(replay)) {
+		usb_replay_free(replay);
+		return NULL;
+	}
+	sr_dbg("Replaying USB dump of %04x:%04x from '%s'.",
+		replay->vid, replay->pid, path);
+
+	usb = sr_usb_dev_inst_new(0, 0, NULL);
+	usb->replay = replay;
+	/* Don't record a replay. */
+	usb->record_checked = TRUE;
+
+	return usb;
+}
+
+/**
+ * Get the identity of the device which a replayed dump was recorded from.
+ *
+ * @param usb The USB device instance, see sr_usb_replay_open().
+ * @param[out] des The VID and PID, other fields are cleared.
+ * @param[out] strings The manufacturer, product and serial number.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_replay_identity(const struct sr_usb_dev_inst *usb,
+		struct libusb_device_descriptor *des, const char *strings[3])
+{
+	size_t i;
+
+	memset(des, 0, sizeof(*des));
+	des->idVendor = usb->replay->vid;
+	des->idProduct = usb->replay->pid;
+	for (i = 0; i < ARRAY_SIZE(usb->replay->strings); i++)
+		strings[i] = usb->replay->strings[i];
+}
+
+/**
+ * Release the recording or replay of a USB device instance.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_dump_free(struct sr_usb_dev_inst *usb)
+{
+	struct sr_usb_record *record;
+
+	if (usb->replay) {
+		usb_replay_free(usb->replay);
+		usb->replay = NULL;
+	}
+
+	if ((record = usb->record)) {
+		usb_record_close(record);
+		usb->record = NULL;
+	}
+}
+
+static gboolean name_listed(char **names, const char *name)
+{
+	for (; *names; names++) {
+		if (strcmp(*names, name) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Restore the configuration which a raw recording was made with.
+ *
+ * Call this for the device which replays a dump when the scan created
+ * it. Settings which the application makes later take precedence.
+ *
+ * @param sdi The device, its conn is the replayed USB device.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_replay_restore(struct sr_dev_inst *sdi)
+{
+	const struct sr_key_info *info;
+	struct sr_usb_dev_inst *usb;
+	struct sr_channel *ch;
+	GVariant *data;
+	GSList *l;
+	char **lines, **names, *value;
+	size_t i;
+
+	usb = sdi->conn;
+	if (!usb->replay || !usb->replay->meta)
+		return;
+
+	lines = g_strsplit(usb->replay->meta, "\n", 0);
+	for (i = 0; lines[i]; i++) {
+		if (!(value = strchr(lines[i], '=')))
+			continue;
+		*value++ = '\0';
+		if (strcmp(lines[i], "channels") == 0) {
+			names = g_strsplit(value, ",", 0);
+			for (l = sdi->channels; l; l = l->next) {
+				ch = l->data;
+				ch->enabled = name_listed(names, ch->name);
+			}
+			g_strfreev(names);
+			continue;
+		}
+		if (!(info = sr_key_info_name_get(SR_KEY_CONFIG, lines[i])))
+			continue;
+		if (!(data = g_variant_parse(NULL, value, NULL, NULL, NULL)))
+			continue;
+		if (sdi->driver->config_set(info->key, data, sdi, NULL) != SR_OK)
+			sr_dbg("Cannot restore '%s' of the recording.", info->id);
+		g_variant_unref(data);
+	}
+	g_strfreev(lines);
+}
+
+/**
+ * Start a raw recording of the device's transfers, when its session
+ * asks for one.
+ *
+ * Drivers call this when an acquisition starts. When it returns TRUE,
+ * they record their sample data to the dump instead of decoding and
+ * sending it, and call sr_usb_raw_record_stop() when the acquisition
+ * ends.
+ *
+ * @param sdi The device.
+ *
+ * @return TRUE when the session records raw transfers.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_usb_raw_record_start(const struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+	const char *dir;
+
+	usb = sdi->conn;
+	if (usb->replay || !sdi->session || !(dir = sdi->session->raw_record_dir))
+		return FALSE;
+
+	/* A recording which the environment asked for may be running. */
+	if (!usb_record_get(usb)) {
+		if (!(usb->record = usb_record_open(usb, dir)))
+			return FALSE;
+		usb->record_raw = TRUE;
+	}
+	usb_record_meta(usb->record, sdi);
+
+	return TRUE;
+}
+
+/**
+ * End a raw recording, see sr_usb_raw_record_start().
+ *
+ * Call this when no more transfers are in flight.
+ *
+ * @param sdi The device.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_raw_record_stop(const struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+
+	usb = sdi->conn;
+	if (!usb->record_raw)
+		return;
+
+	usb_record_close(usb->record);
+	usb->record = NULL;
+	usb->record_raw = FALSE;
+	/* Don't pick up the environment's recording in the middle. */
+	usb->record_checked = TRUE;
+}
+
+/*
+ * Take the next control or bulk transfer of the given kind from the
+ * dump. Transfers which the device made but the replay doesn't (e.g.
+ * for configuration done differently) get skipped.
+ */
+static const struct usb_dump_record *usb_replay_next_sync(
+		struct sr_usb_replay *replay, uint8_t kind,
+		uint8_t endpoint, uint8_t request)
+{
+	const struct usb_dump_record *rec;
+	guint i;
+
+	for (i = replay->sync_pos; i < replay->sync->len; i++) {
+		rec = &g_array_index(replay->sync, struct usb_dump_record, i);
+		if (rec->kind != kind || rec->endpoint != endpoint)
+			continue;
+		if (kind == DUMP_CONTROL && rec->request != request)
+			continue;
+		if (i != replay->sync_pos)
+			sr_dbg("Skipping %u USB dump records.", i - replay->sync_pos);
+		replay->sync_pos = i + 1;
+		return rec;
+	}
+
+	return NULL;
+}
+
+static void usb_replay_complete(struct sr_usb_replay *replay,
+		struct libusb_transfer *transfer)
+{
+	const struct usb_dump_record *rec;
+	GArray *records;
+	guint ep;
+	size_t len;
+
+	if (!(transfer->endpoint & LIBUSB_ENDPOINT_IN)) {
+		transfer->status = LIBUSB_TRANSFER_COMPLETED;
+		transfer->actual_length = transfer->length;
+		transfer->callback(transfer);
+		return;
+	}
+
+	ep = transfer->endpoint & 0x0f;
+	records = replay->async[ep];
+	if (!records || replay->async_pos[ep] >= records->len) {
+		/* The end of the recording looks like the device went away. */
+		transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+		transfer->actual_length = 0;
+	} else {
+		rec = &g_array_index(records, struct usb_dump_record,
+			replay->async_pos[ep]++);
+		len = MIN(rec->data_length, (size_t)transfer->length);
+		memcpy(transfer->buffer, rec->data, len);
+		transfer->status = rec->status;
+		transfer->actual_length = len;
+	}
+
+	transfer->callback(transfer);
+}
+
+static int usb_replay_dispatch(int fd, int revents, void *cb_data)
+{
+	struct sr_usb_replay *replay;
+	struct usb_replay_pending *pending;
+	struct libusb_transfer *transfer;
+	gboolean cancelled;
+	guint count;
+
+	(void)fd;
+	(void)revents;
+
+	replay = cb_data;
+
+	/* Transfers which get resubmitted now complete in the next round. */
+	replay->dispatching = TRUE;
+	count = g_queue_get_length(replay->pending);
+	while (count-- && (pending = g_queue_pop_head(replay->pending))) {
+		transfer = pending->transfer;
+		cancelled = pending->cancelled;
+		g_free(pending);
+		if (cancelled) {
+			transfer->status = LIBUSB_TRANSFER_CANCELLED;
+			transfer->actual_length = 0;
+			transfer->callback(transfer);
+		} else {
+			usb_replay_complete(replay, transfer);
+		}
+	}
+	replay->dispatching = FALSE;
+
+	if (!g_queue_is_empty(replay->pending))
+		return G_SOURCE_CONTINUE;
+
+	replay->session = NULL;
+
+	return G_SOURCE_REMOVE;
+}
+
+static int usb_replay_submit(struct sr_usb_replay *replay,
+		struct sr_session *session, struct libusb_transfer *transfer)
+{
+	struct usb_replay_pending *pending;
+
+	if (!session)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	pending = g_malloc0(sizeof(*pending));
+	pending->transfer = transfer;
+	g_queue_push_tail(replay->pending, pending);
+
+	/* The source gets removed when it runs out of transfers. */
+	if (!replay->session) {
+		replay->session = session;
+		sr_session_fd_source_add(session, replay, -1, 0, 0,
+			usb_replay_dispatch, replay);
+	}
+
+	return LIBUSB_SUCCESS;
+}
+
+/**
+ * Synchronous control transfer, see libusb_control_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_control_transfer(struct sr_usb_dev_inst *usb,
+		uint8_t request_type, uint8_t request, uint16_t value,
+		uint16_t index, unsigned char *data, uint16_t length,
+		unsigned int timeout)
+{
+	const struct usb_dump_record *rec;
+	struct sr_usb_record *record;
+	struct usb_dump_record out;
+	int ret;
+
+	if (usb->replay) {
+		rec = usb_replay_next_sync(usb->replay, DUMP_CONTROL,
+			request_type, request);
+		if (!rec)
+			return (request_type & LIBUSB_ENDPOINT_IN) ?
+				LIBUSB_ERROR_NO_DEVICE : length;
+		if (rec->status < 0)
+			return rec->status;
+		if (!(request_type & LIBUSB_ENDPOINT_IN))
+			return MIN(rec->length, length);
+		ret = MIN(rec->data_length, length);
+		memcpy(data, rec->data, ret);
+		return ret;
+	}
+
+	ret = libusb_control_transfer(usb->devhdl, request_type, request,
+		value, index, data, length, timeout);
+
+	if ((record = usb_record_get(usb))) {
+		memset(&out, 0, sizeof(out));
+		out.kind = DUMP_CONTROL;
+		out.endpoint = request_type;
+		out.request = request;
+		out.status = MIN(ret, 0);
+		out.value = value;
+		out.index = index;
+		out.length = MAX(ret, 0);
+		if (ret > 0 && (request_type & LIBUSB_ENDPOINT_IN)) {
+			out.data = data;
+			out.data_length = ret;
+		}
+		usb_record_write(record, &out);
+	}
+
+	return ret;
+}
+
+/**
+ * Synchronous bulk transfer, see libusb_bulk_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_bulk_transfer(struct sr_usb_dev_inst *usb,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout)
+{
+	const struct usb_dump_record *rec;
+	struct sr_usb_record *record;
+	struct usb_dump_record out;
+	int ret, done;
+
+	if (usb->replay) {
+		rec = usb_replay_next_sync(usb->replay, DUMP_BULK, endpoint, 0);
+		if (!rec && (endpoint & LIBUSB_ENDPOINT_IN))
+			return LIBUSB_ERROR_NO_DEVICE;
+		if (!rec) {
+			if (transferred)
+				*transferred = length;
+			return LIBUSB_SUCCESS;
+		}
+		done = MIN((int)rec->length, length);
+		if (endpoint & LIBUSB_ENDPOINT_IN) {
+			done = MIN((int)rec->data_length, length);
+			memcpy(data, rec->data, done);
+		}
+		if (transferred)
+			*transferred = done;
+		return rec->status;
+	}
+
+	done = 0;
+	ret = libusb_bulk_transfer(usb->devhdl, endpoint, data, length,
+		&done, timeout);
+	if (transferred)
+		*transferred = done;
+
+	if ((record = usb_record_get(usb))) {
+		memset(&out, 0, sizeof(out));
+		out.kind = DUMP_BULK;
+		out.endpoint = endpoint;
+		out.status = ret;
+		out.length = done;
+		if (endpoint & LIBUSB_ENDPOINT_IN) {
+			out.data = data;
+			out.data_length = done;
+		}
+		usb_record_write(record, &out);
+	}
+
+	return ret;
+}
+
+/**
+ * Submit an asynchronous transfer, see libusb_submit_transfer().
+ *
+ * With a USB event thread, the transfer's callback still runs in the
+ * thread of the device's session, see sr_usb_forward_begin().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_submit_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_record *record;
+	struct usb_xfer_hook *hook;
+	void *forward;
+	int ret;
+
+	usb = sdi->conn;
+	record = usb_record_get(usb);
+	if (!record && !sr_trace_enabled()) {
+		if (usb->replay)
+			return usb_replay_submit(usb->replay, sdi->session,
+				transfer);
+		forward = sr_usb_forward_begin(sdi, transfer);
+		if ((ret = libusb_submit_transfer(transfer)) != 0)
+			sr_usb_forward_cancel(transfer, forward);
+		return ret;
+	}
+
+	hook = g_malloc(sizeof(*hook));
+	hook->record = record;
+	hook->callback = transfer->callback;
+	hook->user_data = transfer->user_data;
+	transfer->callback = usb_hook_complete;
+	transfer->user_data = hook;
+
+	forward = NULL;
+	if (usb->replay) {
+		ret = usb_replay_submit(usb->replay, sdi->session, transfer);
+	} else {
+		forward = sr_usb_forward_begin(sdi, transfer);
+		ret = libusb_submit_transfer(transfer);
+	}
+	if (ret != 0) {
+		sr_usb_forward_cancel(transfer, forward);
+		transfer->callback = hook->callback;
+		transfer->user_data = hook->user_data;
+		g_free(hook);
+		return ret;
+	}
+
+	if (sr_trace_enabled()) {
+		if (g_private_get(&usb_callback_depth))
+			sr_trace_instant("usb resubmit", "endpoint",
+				transfer->endpoint);
+		sr_trace_async("usb transfer", TRUE, transfer,
+			"length", transfer->length);
+	}
+
+	return ret;
+}
+
+/**
+ * Cancel an asynchronous transfer, see libusb_cancel_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_cancel_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer)
+{
+	struct sr_usb_dev_inst *usb;
+	struct usb_replay_pending *pending;
+	GList *l;
+
+	usb = sdi->conn;
+	if (!usb->replay)
+		return libusb_cancel_transfer(transfer);
+
+	for (l = usb->replay->pending->head; l; l = l->next) {
+		pending = l->data;
+		if (pending->transfer != transfer)
+			continue;
+		if (pending->cancelled)
+			return LIBUSB_ERROR_NOT_FOUND;
+		pending->cancelled = TRUE;
+		return LIBUSB_SUCCESS;
+	}
+
+	return LIBUSB_ERROR_NOT_FOUND;
+}
@@ -428,6 +428,136 @@ START_TEST(test_analog_to_float_conv)
 }
 END_TEST
 
+/* Check the conversion of 24 bit signed little endian data. */
+START_TEST(test_analog_to_float_i24)
+{
+	static const uint8_t bytes[] = {
+		0x01, 0x00, 0x00,
+		0xfe, 0xff, 0xff,
+		0x00, 0x00, 0x80,
+		0xff, 0xff, 0x7f,
+	};
+	static const float want[] = { 1.0, -2.0, -8388608.0, 8388607.0, };
+	struct sr_channel ch = {
+		.index = 0,
+		.enabled = TRUE,
+		.type = SR_CHANNEL_ANALOG,
+		.name = "input",
+	};
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	float f_out[ARRAY_SIZE(want)];
+	size_t i;
+	int ret;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(want);
+	analog.data = (void *)bytes;
+	encoding.unitsize = 3;
+	encoding.is_float = FALSE;
+	encoding.is_signed = TRUE;
+	encoding.is_bigendian = FALSE;
+	meaning.channels = g_slist_append(NULL, &ch);
+
+	ret = sr_analog_to_float(&analog, f_out);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d", ret);
+	for (i = 0; i < ARRAY_SIZE(want); i++)
+		fail_unless(f_out[i] == want[i], "value %zu: %f != %f",
+			i, f_out[i], want[i]);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+/* Check deinterleaving and double precision conversion. */
+START_TEST(test_analog_to_float_channels)
+{
+	int ret;
+	size_t i;
+	struct sr_channel ch[2];
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	const uint8_t in[] = { 1, 0, 0xff, 0xff, 2, 0, 0xfe, 0xff, 3, 0, 0xfd, 0xff, };
+	float left[3], right[3], *outbufs[] = { left, right, };
+	double dout[6];
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = 3;
+	analog.data = (void *)in;
+	encoding.unitsize = sizeof(int16_t);
+	encoding.is_float = FALSE;
+	encoding.is_signed = TRUE;
+	encoding.is_bigendian = FALSE;
+	encoding.scale.p = 2;
+	meaning.channels = g_slist_append(NULL, &ch[0]);
+	meaning.channels = g_slist_append(meaning.channels, &ch[1]);
+
+	ret = sr_analog_to_float_channels(&analog, outbufs);
+	fail_unless(ret == SR_OK, "sr_analog_to_float_channels() failed: %d.", ret);
+	for (i = 0; i < 3; i++) {
+		fail_unless(left[i] == 2 * (i + 1), "%f != %zu", left[i], 2 * (i + 1));
+		fail_unless(right[i] == -2.0 * (i + 1), "%f != -%zu", right[i], 2 * (i + 1));
+	}
+
+	ret = sr_analog_to_double(&analog, dout);
+	fail_unless(ret == SR_OK, "sr_analog_to_double() failed: %d.", ret);
+	for (i = 0; i < 3; i++) {
+		fail_unless(dout[2 * i] == left[i]);
+		fail_unless(dout[2 * i + 1] == right[i]);
+	}
+
+	fail_unless(sr_analog_to_float_channels(&analog, NULL) == SR_ERR_ARG);
+	fail_unless(sr_analog_to_double(&analog, NULL) == SR_ERR_ARG);
+	fail_unless(sr_analog_to_double(NULL, dout) == SR_ERR_ARG);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+/* Check that native floats are used in place, others get converted. */
+START_TEST(test_analog_to_float_view)
+{
+	int ret;
+	size_t i;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	float fin[3] = { 1.5, -2.5, 3.5, }, fout[3];
+	const uint8_t in[] = { 1, 2, 3, };
+	const float *values;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = 3;
+	analog.data = fin;
+	meaning.channels = g_slist_append(NULL, &ch);
+
+	ret = sr_analog_to_float_view(&analog, fout, &values);
+	fail_unless(ret == SR_OK, "sr_analog_to_float_view() failed: %d.", ret);
+	fail_unless(values == fin, "Native floats were copied.");
+
+	analog.data = (void *)in;
+	encoding.unitsize = sizeof(uint8_t);
+	encoding.is_float = FALSE;
+	encoding.scale.p = 3;
+	ret = sr_analog_to_float_view(&analog, fout, &values);
+	fail_unless(ret == SR_OK, "sr_analog_to_float_view() failed: %d.", ret);
+	fail_unless(values == fout, "Values were not converted.");
+	for (i = 0; i < 3; i++)
+		fail_unless(values[i] == 3 * (i + 1), "%f != %zu", values[i], 3 * (i + 1));
+
+	fail_unless(sr_analog_to_float_view(&analog, NULL, &values) == SR_ERR_ARG);
+	fail_unless(sr_analog_to_float_view(&analog, fout, NULL) == SR_ERR_ARG);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_si_prefix)
 {
 	struct {
@@ -697,6 +827,9 @@ Suite *suite_analog(void)
 	tcase_add_test(tc, test_analog_to_float);
 	tcase_add_test(tc, test_analog_to_float_null);
 	tcase_add_test(tc, test_analog_to_float_conv);
+	tcase_add_test(tc, test_analog_to_float_i24);
+	tcase_add_test(tc, test_analog_to_float_channels);
+	tcase_add_test(tc, test_analog_to_float_view);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("analog_si_unit");
@@ -0,0 +1,1176 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Micro-benchmarks of the datafeed hot paths, run with "make bench".
+ *
+ * Each benchmark processes a fixed amount of data, generated from a
+ * fixed seed, and is repeated several times. The best run gets reported
+ * in MB/s and samples/s. Pass a substring to only run the benchmarks
+ * whose names contain it.
+ *
+ * With SIGROK_BENCH_USB_DUMPS naming a directory, the USB dumps in there
+ * get replayed through their driver's receive and conversion path. The
+ * dumps get recorded from a device with SIGROK_USB_RECORD set, and named
+ * <driver>[.<anything>].dump, e.g. fx2lafw.8ch-24mhz.dump.
+ *
+ * SIGROK_BENCH_DATA names a directory of reference data: USB dumps as
+ * above, session files, and files of any input module's format. Running
+ * "bench --generate <dir>" creates large CSV, VCD and session files from
+ * the demo device there. Their samples are the same on every run, the
+ * VCD header's date and the session archive's file times are not.
+ *
+ * With SIGROK_BENCH_JSON naming a file, the results also get written to
+ * it as JSON, for tracking them across releases.
+ */
+
+#include <config.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+
+#define BENCH_RUNS 3
+#define BENCH_SEED 42
+
+/* Logic data: 8 channels, one byte per sample. */
+#define LOGIC_SAMPLES (16 * 1024 * 1024)
+#define LOGIC_CHUNK (64 * 1024)
+/* Analog data: int16 samples of one channel. */
+#define ANALOG_SAMPLES (4 * 1024 * 1024)
+#define ANALOG_CHUNK (16 * 1024)
+/* Samples which the demo device sends in each session run. */
+#define DEMO_SAMPLES (16 * 1024 * 1024)
+/* Samples in each generated reference file. */
+#define GENERATE_SAMPLES (2 * 1024 * 1024)
+
+struct bench_count {
+	uint64_t bytes;
+	uint64_t samples;
+};
+
+typedef int (*bench_func)(void *data, struct bench_count *count);
+
+/* Outcome of one benchmark, for the JSON report. */
+struct bench_result {
+	char *name;
+	/* "ok", "failed" or "skipped". */
+	const char *status;
+	char *reason;
+	struct bench_count count;
+	int64_t best;
+};
+
+static struct sr_context *ctx;
+static const char *filter;
+static uint8_t *logic_data;
+static int16_t *analog_data;
+static GSList *results;
+
+static void result_add(const char *name, const char *status, char *reason,
+		const struct bench_count *count, int64_t best)
+{
+	struct bench_result *r;
+
+	r = g_malloc0(sizeof(*r));
+	r->name = g_strdup(name);
+	r->status = status;
+	r->reason = reason;
+	if (count)
+		r->count = *count;
+	r->best = best;
+	results = g_slist_append(results, r);
+}
+
+static void result_free(void *data)
+{
+	struct bench_result *r;
+
+	r = data;
+	g_free(r->name);
+	g_free(r->reason);
+	g_free(r);
+}
+
+G_GNUC_PRINTF(2, 3)
+static void bench_skip(const char *name, const char *format, ...)
+{
+	va_list args;
+	char *reason;
+
+	va_start(args, format);
+	reason = g_strdup_vprintf(format, args);
+	va_end(args);
+
+	printf("%-36s skipped, %s\n", name, reason);
+	result_add(name, "skipped", reason, NULL, 0);
+}
+
+static void bench_run(const char *name, bench_func func, void *data)
+{
+	struct bench_count count;
+	int64_t start, elapsed, best;
+	int i;
+
+	if (filter && !strstr(name, filter))
+		return;
+
+	best = INT64_MAX;
+	memset(&count, 0, sizeof(count));
+	for (i = 0; i < BENCH_RUNS; i++) {
+		memset(&count, 0, sizeof(count));
+		start = g_get_monotonic_time();
+		if (func(data, &count) != SR_OK) {
+			printf("%-36s failed\n", name);
+			result_add(name, "failed", NULL, NULL, 0);
+			return;
+		}
+		elapsed = g_get_monotonic_time() - start;
+		best = MIN(best, MAX(elapsed, 1));
+	}
+
+	if (!count.bytes) {
+		bench_skip(name, "no data processed");
+		return;
+	}
+	printf("%-36s %10.1f MB/s %14.0f samples/s\n", name,
+		(double)count.bytes / best,
+		(double)count.samples * G_USEC_PER_SEC / best);
+	result_add(name, "ok", NULL, &count, best);
+}
+
+static void generate_data(void)
+{
+	GRand *rand;
+	uint64_t i;
+
+	rand = g_rand_new_with_seed(BENCH_SEED);
+
+	/* Mostly stable lines with occasional edges, like real captures. */
+	logic_data = g_malloc(LOGIC_SAMPLES);
+	logic_data[0] = 0;
+	for (i = 1; i < LOGIC_SAMPLES; i++) {
+		logic_data[i] = logic_data[i - 1];
+		if (g_rand_int_range(rand, 0, 16) == 0)
+			logic_data[i] ^= 1 << g_rand_int_range(rand, 0, 8);
+	}
+
+	analog_data = g_malloc(ANALOG_SAMPLES * sizeof(int16_t));
+	for (i = 0; i < ANALOG_SAMPLES; i++)
+		analog_data[i] = g_rand_int_range(rand, -32768, 32768);
+
+	g_rand_free(rand);
+}
+
+/* An analog packet of one channel with int16 samples, scaled to volts. */
+struct analog_packet {
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+};
+
+static void analog_packet_init(struct analog_packet *p, struct sr_channel *ch)
+{
+	memset(p, 0, sizeof(*p));
+	p->encoding.unitsize = sizeof(int16_t);
+	p->encoding.is_signed = TRUE;
+	p->encoding.is_bigendian = G_BYTE_ORDER == G_BIG_ENDIAN;
+	p->encoding.digits = 4;
+	p->encoding.is_digits_decimal = TRUE;
+	sr_rational_set(&p->encoding.scale, 1, 1000);
+	sr_rational_set(&p->encoding.offset, 0, 1);
+	p->meaning.mq = SR_MQ_VOLTAGE;
+	p->meaning.unit = SR_UNIT_VOLT;
+	p->meaning.channels = g_slist_append(NULL, ch);
+	p->spec.spec_digits = 4;
+	p->analog.encoding = &p->encoding;
+	p->analog.meaning = &p->meaning;
+	p->analog.spec = &p->spec;
+}
+
+static void analog_packet_clear(struct analog_packet *p)
+{
+	g_slist_free(p->meaning.channels);
+}
+
+/*--- Analog conversions ---------------------------------------------------*/
+
+static int bench_analog_to_float(void *data, struct bench_count *count)
+{
+	struct analog_packet p;
+	float *out;
+	uint64_t i;
+	int ret;
+
+	(void)data;
+
+	analog_packet_init(&p, NULL);
+	out = g_malloc(ANALOG_CHUNK * sizeof(float));
+	ret = SR_OK;
+	for (i = 0; i < ANALOG_SAMPLES && ret == SR_OK; i += ANALOG_CHUNK) {
+		p.analog.data = analog_data + i;
+		p.analog.num_samples = ANALOG_CHUNK;
+		ret = sr_analog_to_float(&p.analog, out);
+		count->bytes += ANALOG_CHUNK * sizeof(int16_t);
+		count->samples += ANALOG_CHUNK;
+	}
+	g_free(out);
+	analog_packet_clear(&p);
+
+	return ret;
+}
+
+static int bench_a2l(void *data, struct bench_count *count)
+{
+	struct analog_packet p;
+	uint8_t *out, state;
+	uint64_t i;
+	gboolean schmitt;
+	int ret;
+
+	schmitt = GPOINTER_TO_INT(data);
+
+	analog_packet_init(&p, NULL);
+	out = g_malloc(ANALOG_CHUNK);
+	state = 0;
+	ret = SR_OK;
+	for (i = 0; i < ANALOG_SAMPLES && ret == SR_OK; i += ANALOG_CHUNK) {
+		p.analog.data = analog_data + i;
+		p.analog.num_samples = ANALOG_CHUNK;
+		if (schmitt)
+			ret = sr_a2l_schmitt_trigger(&p.analog, -1.0, 1.0,
+				&state, out, ANALOG_CHUNK);
+		else
+			ret = sr_a2l_threshold(&p.analog, 0.0, out,
+				ANALOG_CHUNK);
+		count->bytes += ANALOG_CHUNK * sizeof(int16_t);
+		count->samples += ANALOG_CHUNK;
+	}
+	g_free(out);
+	analog_packet_clear(&p);
+
+	return ret;
+}
+
+/*--- Session dispatch with the demo device -------------------------------*/
+
+static void count_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	struct bench_count *count;
+
+	(void)sdi;
+
+	count = cb_data;
+	if (packet->type == SR_DF_ANALOG) {
+		/* Samples are counted by the logic data, if any. */
+		analog = packet->payload;
+		count->bytes += (uint64_t)analog->num_samples
+			* analog->encoding->unitsize;
+		return;
+	}
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	logic = packet->payload;
+	count->bytes += logic->length;
+	count->samples += logic->length / logic->unitsize;
+}
+
+static struct sr_dev_driver *driver_find(const char *name);
+
+/* A new demo device, with the analog channels enabled or not. */
+static struct sr_dev_inst *demo_new(gboolean analog)
+{
+	struct sr_dev_driver *driver;
+	struct sr_channel *ch;
+	struct sr_dev_inst *sdi;
+	GSList *devices, *l;
+
+	if (!(driver = driver_find("demo")))
+		return NULL;
+	devices = sr_driver_scan(driver, NULL);
+	if (!devices)
+		return NULL;
+	sdi = devices->data;
+	g_slist_free(devices);
+	if (sr_dev_open(sdi) != SR_OK)
+		return NULL;
+
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_dev_channel_enable(ch, ch->type == SR_CHANNEL_LOGIC || analog);
+	}
+
+	return sdi;
+}
+
+static struct sr_dev_inst *demo_open(void)
+{
+	struct sr_dev_inst *sdi;
+
+	/* Only the logic data path is of interest. */
+	if (!(sdi = demo_new(FALSE)))
+		return NULL;
+	/* Keep the device from pacing the data to its samplerate. */
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_GHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_CAPTURE_UNTHROTTLED,
+		g_variant_new_boolean(TRUE));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(DEMO_SAMPLES));
+
+	return sdi;
+}
+
+struct session_bench {
+	struct sr_dev_inst *sdi;
+	/* Set a trigger on D0 which the data goes through the check of. */
+	gboolean trigger;
+};
+
+static int bench_session(void *data, struct bench_count *count)
+{
+	struct session_bench *sb;
+	struct sr_session *session;
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	struct sr_channel *ch;
+	int ret;
+
+	sb = data;
+
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sb->sdi);
+	sr_session_datafeed_callback_add(session, count_datafeed, count);
+
+	trigger = NULL;
+	if (sb->trigger) {
+		ch = sr_dev_inst_channels_get(sb->sdi)->data;
+		trigger = sr_trigger_new(NULL);
+		stage = sr_trigger_stage_add(trigger);
+		sr_trigger_match_add(stage, ch, SR_TRIGGER_RISING, 0);
+		sr_session_trigger_set(session, trigger);
+	}
+
+	ret = sr_session_start(session);
+	if (ret == SR_OK)
+		ret = sr_session_run(session);
+
+	sr_session_dev_remove(session, sb->sdi);
+	sr_session_destroy(session);
+	sr_trigger_free(trigger);
+
+	return ret;
+}
+
+/*--- Driver decode with replayed USB dumps --------------------------------*/
+
+struct replay_bench {
+	struct sr_dev_driver *driver;
+	char *conn;
+};
+
+static int bench_replay(void *data, struct bench_count *count)
+{
+	struct replay_bench *rb;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct sr_config src;
+	GSList *options, *devices, *l;
+	int ret;
+
+	rb = data;
+
+	/* The dump gets consumed, replay it from a new device every run. */
+	src.key = SR_CONF_CONN;
+	src.data = g_variant_ref_sink(g_variant_new_string(rb->conn));
+	options = g_slist_append(NULL, &src);
+	devices = sr_driver_scan(rb->driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	if (!devices)
+		return SR_ERR;
+	sdi = devices->data;
+	g_slist_free(devices);
+	if ((ret = sr_dev_open(sdi)) != SR_OK) {
+		sr_dev_clear(rb->driver);
+		return ret;
+	}
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_dev_channel_enable(ch, ch->type == SR_CHANNEL_LOGIC);
+	}
+
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sdi);
+	sr_session_datafeed_callback_add(session, count_datafeed, count);
+	ret = sr_session_start(session);
+	if (ret == SR_OK)
+		ret = sr_session_run(session);
+	sr_session_dev_remove(session, sdi);
+	sr_session_destroy(session);
+
+	sr_dev_close(sdi);
+	sr_dev_clear(rb->driver);
+
+	return ret;
+}
+
+static struct sr_dev_driver *driver_find(const char *name)
+{
+	struct sr_dev_driver **drivers;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers && drivers[i]; i++) {
+		if (strcmp(drivers[i]->name, name))
+			continue;
+		if (sr_driver_init(ctx, drivers[i]) != SR_OK)
+			return NULL;
+		return drivers[i];
+	}
+
+	return NULL;
+}
+
+static void bench_dump(const char *dir, const char *file)
+{
+	struct replay_bench rb;
+	char *driver_name, *name, *path;
+
+	driver_name = g_strndup(file, strcspn(file, "."));
+	name = g_strdup_printf("replay/%.*s", (int)(strlen(file)
+		- strlen(".dump")), file);
+	if (filter && !strstr(name, filter)) {
+		g_free(driver_name);
+		g_free(name);
+		return;
+	}
+	if (!(rb.driver = driver_find(driver_name))) {
+		bench_skip(name, "no driver '%s'", driver_name);
+	} else {
+		path = g_build_filename(dir, file, NULL);
+		rb.conn = g_strconcat("replay:", path, NULL);
+		bench_run(name, bench_replay, &rb);
+		g_free(rb.conn);
+		g_free(path);
+	}
+	g_free(driver_name);
+	g_free(name);
+}
+
+/*--- Output modules -------------------------------------------------------*/
+
+struct output_bench {
+	const struct sr_output_module *omod;
+	struct sr_dev_inst *sdi;
+	gboolean analog;
+};
+
+static int output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	if (out)
+		g_string_free(out, TRUE);
+
+	return ret;
+}
+
+static int bench_output(void *data, struct bench_count *count)
+{
+	struct output_bench *ob;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct analog_packet ap;
+	struct sr_config src;
+	uint64_t i;
+	int ret;
+
+	ob = data;
+
+	o = sr_output_new(ob->omod, NULL, ob->sdi, NULL);
+	if (!o)
+		return SR_ERR;
+
+	header.feed_version = 1;
+	header.starttime.tv_sec = 0;
+	header.starttime.tv_usec = 0;
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	ret = output_send(o, &packet);
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(SR_MHZ(1)));
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	if (ret == SR_OK)
+		ret = output_send(o, &packet);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	/* The analog channel is the last one of the device. */
+	analog_packet_init(&ap, g_slist_last(sr_dev_inst_channels_get(ob->sdi))->data);
+	if (ob->analog) {
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &ap.analog;
+		for (i = 0; i < ANALOG_SAMPLES && ret == SR_OK; i += ANALOG_CHUNK) {
+			ap.analog.data = analog_data + i;
+			ap.analog.num_samples = ANALOG_CHUNK;
+			ret = output_send(o, &packet);
+			count->bytes += ANALOG_CHUNK * sizeof(int16_t);
+			count->samples += ANALOG_CHUNK;
+		}
+	} else {
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.unitsize = 1;
+		for (i = 0; i < LOGIC_SAMPLES && ret == SR_OK; i += LOGIC_CHUNK) {
+			logic.data = logic_data + i;
+			logic.length = LOGIC_CHUNK;
+			ret = output_send(o, &packet);
+			count->bytes += LOGIC_CHUNK;
+			count->samples += LOGIC_CHUNK;
+		}
+	}
+	analog_packet_clear(&ap);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	if (ret == SR_OK)
+		ret = output_send(o, &packet);
+	sr_output_free(o);
+
+	return ret;
+}
+
+static void bench_outputs(void)
+{
+	const struct sr_output_module **omods;
+	struct output_bench ob;
+	struct sr_dev_inst *sdi;
+	char name[64], chname[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("sigrok", "bench", NULL);
+	for (i = 0; i < 8; i++) {
+		g_snprintf(chname, sizeof(chname), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, chname);
+	}
+	sr_dev_inst_channel_add(sdi, 8, SR_CHANNEL_ANALOG, "A0");
+
+	omods = sr_output_list();
+	for (i = 0; omods[i]; i++) {
+		/* Modules which write files on their own need a filename. */
+		if (sr_output_test_flag(omods[i], SR_OUTPUT_INTERNAL_IO_HANDLING))
+			continue;
+		ob.omod = omods[i];
+		ob.sdi = sdi;
+		ob.analog = FALSE;
+		g_snprintf(name, sizeof(name), "output/%s logic",
+			sr_output_id_get(omods[i]));
+		bench_run(name, bench_output, &ob);
+		ob.analog = TRUE;
+		g_snprintf(name, sizeof(name), "output/%s analog",
+			sr_output_id_get(omods[i]));
+		bench_run(name, bench_output, &ob);
+	}
+
+	/* User devices have no public destructor, it lives until exit. */
+}
+
+/*--- Input modules --------------------------------------------------------*/
+
+/* Input data in the format of a module, with its number of samples. */
+struct input_data {
+	GString *buf;
+	uint64_t samples;
+};
+
+static void input_data_raw(struct input_data *d, const char *id)
+{
+	if (!strcmp(id, "raw_analog")) {
+		d->buf = g_string_new_len((const char *)analog_data,
+			ANALOG_SAMPLES * sizeof(int16_t));
+		/* The default sample format is one signed byte. */
+		d->samples = ANALOG_SAMPLES * sizeof(int16_t);
+	} else {
+		d->buf = g_string_new_len((const char *)logic_data,
+			LOGIC_SAMPLES);
+		d->samples = LOGIC_SAMPLES;
+	}
+}
+
+static void input_data_csv(struct input_data *d)
+{
+	uint64_t i;
+	int b;
+
+	/* Text formats get fewer samples, they take more bytes each. */
+	d->samples = LOGIC_SAMPLES / 16;
+	d->buf = g_string_sized_new(d->samples * 16);
+	for (i = 0; i < d->samples; i++) {
+		for (b = 0; b < 8; b++) {
+			g_string_append_c(d->buf, '0' + ((logic_data[i] >> b) & 1));
+			g_string_append_c(d->buf, b < 7 ? ',' : '\n');
+		}
+	}
+}
+
+static void input_data_vcd(struct input_data *d)
+{
+	uint64_t i;
+	uint8_t prev, diff;
+	int b;
+
+	d->samples = LOGIC_SAMPLES / 16;
+	d->buf = g_string_new("$timescale 1 us $end\n$scope module bench $end\n");
+	for (b = 0; b < 8; b++)
+		g_string_append_printf(d->buf, "$var wire 1 %c D%d $end\n",
+			'!' + b, b);
+	g_string_append(d->buf, "$upscope $end\n$enddefinitions $end\n");
+
+	prev = ~logic_data[0];
+	for (i = 0; i < d->samples; i++) {
+		diff = logic_data[i] ^ prev;
+		if (!diff)
+			continue;
+		g_string_append_printf(d->buf, "#%" PRIu64 "\n", i);
+		for (b = 0; b < 8; b++) {
+			if (diff & (1 << b))
+				g_string_append_printf(d->buf, "%d%c\n",
+					(logic_data[i] >> b) & 1, '!' + b);
+		}
+		prev = logic_data[i];
+	}
+	g_string_append_printf(d->buf, "#%" PRIu64 "\n", d->samples);
+}
+
+static gboolean input_data_get(struct input_data *d, const char *id)
+{
+	d->buf = NULL;
+	if (!strcmp(id, "binary") || !strcmp(id, "raw_analog"))
+		input_data_raw(d, id);
+	else if (!strcmp(id, "csv"))
+		input_data_csv(d);
+	else if (!strcmp(id, "vcd"))
+		input_data_vcd(d);
+
+	return d->buf != NULL;
+}
+
+struct input_bench {
+	const struct sr_input_module *imod;
+	struct input_data data;
+};
+
+static int bench_input(void *data, struct bench_count *count)
+{
+	struct input_bench *ib;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct bench_count received;
+	GString *chunk;
+	size_t offset, len;
+	int ret;
+
+	ib = data;
+
+	in = sr_input_new(ib->imod, NULL);
+	if (!in)
+		return SR_ERR;
+	sr_session_new(ctx, &session);
+	memset(&received, 0, sizeof(received));
+	sr_session_datafeed_callback_add(session, count_datafeed, &received);
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+
+	/* Hand the data over in chunks, like reading a file does. */
+	ret = SR_OK;
+	chunk = g_string_sized_new(LOGIC_CHUNK);
+	for (offset = 0; offset < ib->data.buf->len && ret == SR_OK;
+			offset += len) {
+		len = MIN(LOGIC_CHUNK, ib->data.buf->len - offset);
+		g_string_assign(chunk, "");
+		g_string_append_len(chunk, ib->data.buf->str + offset, len);
+		ret = sr_input_send(in, chunk);
+	}
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+	g_string_free(chunk, TRUE);
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+
+	count->bytes = ib->data.buf->len;
+	/* Files' sample counts are whatever the module makes of them. */
+	count->samples = ib->data.samples ? ib->data.samples : received.samples;
+
+	return ret;
+}
+
+static void bench_inputs(void)
+{
+	const struct sr_input_module **imods;
+	struct input_bench ib;
+	char name[64];
+	const char *id;
+	int i;
+
+	imods = sr_input_list();
+	for (i = 0; imods[i]; i++) {
+		id = sr_input_id_get(imods[i]);
+		g_snprintf(name, sizeof(name), "input/%s", id);
+		if (filter && !strstr(name, filter))
+			continue;
+		if (!input_data_get(&ib.data, id)) {
+			bench_skip(name, "no generator for this format");
+			continue;
+		}
+		ib.imod = imods[i];
+		bench_run(name, bench_input, &ib);
+		g_string_free(ib.data.buf, TRUE);
+	}
+}
+
+/*--- Reference data files -------------------------------------------------*/
+
+struct file_bench {
+	char *path;
+	uint64_t size;
+};
+
+static int bench_session_file(void *data, struct bench_count *count)
+{
+	struct file_bench *fb;
+	struct sr_session *session;
+	struct bench_count received;
+	int ret;
+
+	fb = data;
+
+	if ((ret = sr_session_load(ctx, fb->path, &session)) != SR_OK)
+		return ret;
+	memset(&received, 0, sizeof(received));
+	sr_session_datafeed_callback_add(session, count_datafeed, &received);
+	ret = sr_session_start(session);
+	if (ret == SR_OK)
+		ret = sr_session_run(session);
+	sr_session_destroy(session);
+
+	/* The decompressed data, a session file's size says little. */
+	*count = received;
+
+	return ret;
+}
+
+static const struct sr_input_module *input_for_file(const char *file)
+{
+	const struct sr_input_module **imods;
+	const char *const *exts;
+	const char *ext;
+	int i, j;
+
+	if (!(ext = strrchr(file, '.')))
+		return NULL;
+	ext++;
+
+	imods = sr_input_list();
+	for (i = 0; imods[i]; i++) {
+		exts = sr_input_extensions_get(imods[i]);
+		for (j = 0; exts && exts[j]; j++) {
+			if (!g_ascii_strcasecmp(exts[j], ext))
+				return imods[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void bench_file(const char *dir, const char *file)
+{
+	struct file_bench fb;
+	struct input_bench ib;
+	char *name, *contents;
+	gsize len;
+
+	if (g_str_has_suffix(file, ".dump")) {
+		bench_dump(dir, file);
+		return;
+	}
+
+	name = g_strdup_printf("file/%s", file);
+	if (filter && !strstr(name, filter)) {
+		g_free(name);
+		return;
+	}
+	fb.path = g_build_filename(dir, file, NULL);
+
+	if (g_str_has_suffix(file, ".sr")) {
+		bench_run(name, bench_session_file, &fb);
+	} else if (!(ib.imod = input_for_file(file))) {
+		bench_skip(name, "no input module for this file");
+	} else if (!g_file_get_contents(fb.path, &contents, &len, NULL)) {
+		bench_skip(name, "cannot read '%s'", fb.path);
+	} else {
+		ib.data.buf = g_string_new_len(contents, len);
+		ib.data.samples = 0;
+		g_free(contents);
+		bench_run(name, bench_input, &ib);
+		g_string_free(ib.data.buf, TRUE);
+	}
+
+	g_free(fb.path);
+	g_free(name);
+}
+
+/* Run the benchmarks of all files, or only the dumps, in a directory. */
+static void bench_dir(const char *dir, gboolean dumps_only)
+{
+	const char *file;
+	char *path;
+	GDir *gdir;
+	GSList *files, *l;
+
+	if (!(gdir = g_dir_open(dir, 0, NULL))) {
+		bench_skip("file", "cannot open '%s'", dir);
+		return;
+	}
+	/* Sorted, so that reports of different runs line up. */
+	files = NULL;
+	while ((file = g_dir_read_name(gdir))) {
+		if (dumps_only && !g_str_has_suffix(file, ".dump"))
+			continue;
+		path = g_build_filename(dir, file, NULL);
+		if (file[0] != '.' && g_file_test(path, G_FILE_TEST_IS_REGULAR))
+			files = g_slist_prepend(files, g_strdup(file));
+		g_free(path);
+	}
+	g_dir_close(gdir);
+	files = g_slist_sort(files, (GCompareFunc)strcmp);
+
+	for (l = files; l; l = l->next)
+		bench_file(dir, l->data);
+	g_slist_free_full(files, g_free);
+}
+
+/* Reference files which "--generate" creates, and how. */
+static const struct {
+	const char *name;
+	const char *output;
+	gboolean analog;
+	/* Leave out the header, which has the time of the capture. */
+	gboolean no_header;
+} generate_files[] = {
+	{ "demo-logic.csv", "csv", FALSE, TRUE, },
+	{ "demo-logic.vcd", "vcd", FALSE, FALSE, },
+	{ "demo-mixed.sr", "srzip", TRUE, FALSE, },
+};
+
+struct generate_output {
+	const struct sr_output *o;
+	FILE *file;
+	int ret;
+};
+
+static void generate_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct generate_output *gen;
+	GString *out;
+
+	(void)sdi;
+
+	gen = cb_data;
+	if (gen->ret != SR_OK)
+		return;
+	out = NULL;
+	gen->ret = sr_output_send(gen->o, packet, &out);
+	if (!out)
+		return;
+	if (gen->file && fwrite(out->str, 1, out->len, gen->file) != out->len)
+		gen->ret = SR_ERR_IO;
+	g_string_free(out, TRUE);
+}
+
+/* Set a pattern on the demo device's channel group of the given name. */
+static void demo_pattern_set(struct sr_dev_inst *sdi, const char *group,
+		const char *pattern)
+{
+	struct sr_channel_group *cg;
+	GSList *l;
+
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (!strcmp(cg->name, group))
+			sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+				g_variant_new_string(pattern));
+	}
+}
+
+static int generate_file(const char *dir, size_t idx)
+{
+	const struct sr_output_module *omod;
+	struct generate_output gen;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GHashTable *options;
+	char *path;
+	int ret;
+
+	if (!(omod = sr_output_find((char *)generate_files[idx].output)))
+		return SR_ERR_NA;
+	/*
+	 * A new device every time, so the data doesn't depend on which
+	 * files got generated before. Its random pattern has a fixed seed.
+	 */
+	if (!(sdi = demo_new(generate_files[idx].analog)))
+		return SR_ERR;
+	demo_pattern_set(sdi, "Logic", "random");
+	demo_pattern_set(sdi, "Analog", "sine");
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_CAPTURE_UNTHROTTLED,
+		g_variant_new_boolean(TRUE));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(GENERATE_SAMPLES));
+
+	path = g_build_filename(dir, generate_files[idx].name, NULL);
+	gen.ret = SR_OK;
+	gen.file = NULL;
+	if (sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING)) {
+		/* The module writes the file itself. */
+		g_unlink(path);
+	} else if (!(gen.file = fopen(path, "wb"))) {
+		fprintf(stderr, "Cannot create '%s'.\n", path);
+		g_free(path);
+		sr_dev_close(sdi);
+		return SR_ERR_IO;
+	}
+	options = NULL;
+	if (generate_files[idx].no_header) {
+		options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)g_variant_unref);
+		g_hash_table_insert(options, "header",
+			g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+	}
+	gen.o = sr_output_new(omod, options, sdi, gen.file ? NULL : path);
+	if (options)
+		g_hash_table_destroy(options);
+	if (!gen.o) {
+		ret = SR_ERR;
+	} else {
+		sr_session_new(ctx, &session);
+		sr_session_dev_add(session, sdi);
+		sr_session_datafeed_callback_add(session, generate_datafeed, &gen);
+		ret = sr_session_start(session);
+		if (ret == SR_OK)
+			ret = sr_session_run(session);
+		sr_session_dev_remove(session, sdi);
+		sr_session_destroy(session);
+		if (ret == SR_OK)
+			ret = gen.ret;
+		sr_output_free(gen.o);
+	}
+	if (gen.file && fclose(gen.file) != 0 && ret == SR_OK)
+		ret = SR_ERR_IO;
+	sr_dev_close(sdi);
+
+	if (ret == SR_OK)
+		printf("Generated %s.\n", path);
+	else
+		fprintf(stderr, "Failed to generate '%s': %s.\n", path,
+			sr_strerror(ret));
+	g_free(path);
+
+	return ret;
+}
+
+static int generate_all(const char *dir)
+{
+	size_t i;
+	int ret;
+
+	if (g_mkdir_with_parents(dir, 0755) != 0) {
+		fprintf(stderr, "Cannot create directory '%s'.\n", dir);
+		return SR_ERR_IO;
+	}
+	for (i = 0; i < G_N_ELEMENTS(generate_files); i++) {
+		if ((ret = generate_file(dir, i)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/*--- JSON report ----------------------------------------------------------*/
+
+static void json_string(GString *json, const char *str)
+{
+	const unsigned char *p;
+
+	g_string_append_c(json, '"');
+	for (p = (const unsigned char *)str; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf(json, "\\%c", *p);
+		else if (*p < 0x20)
+			g_string_append_printf(json, "\\u%04x", *p);
+		else
+			g_string_append_c(json, *p);
+	}
+	g_string_append_c(json, '"');
+}
+
+/* Doubles always with a decimal point, whatever the locale. */
+static void json_double(GString *json, const char *format, double value)
+{
+	char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_string_append(json, g_ascii_formatd(buf, sizeof(buf), format, value));
+}
+
+static int write_json(const char *path)
+{
+	struct bench_result *r;
+	GString *json;
+	GSList *l;
+	char *str;
+	gboolean ok;
+
+	json = g_string_sized_new(4096);
+	g_string_append(json, "{\n\t\"libsigrok\": ");
+	json_string(json, sr_package_version_string_get());
+	g_string_append(json, ",\n\t\"host\": ");
+	str = sr_buildinfo_host_get();
+	json_string(json, str);
+	g_free(str);
+	g_string_append(json, ",\n\t\"cpu_features\": ");
+	str = sr_cpu_features_get();
+	json_string(json, str);
+	g_free(str);
+	g_string_append_printf(json, ",\n\t\"time\": %" PRId64
+		",\n\t\"runs\": %d,\n\t\"seed\": %d,\n\t\"benchmarks\": [",
+		g_get_real_time() / G_USEC_PER_SEC, BENCH_RUNS, BENCH_SEED);
+
+	for (l = results; l; l = l->next) {
+		r = l->data;
+		g_string_append(json, l == results ? "\n" : ",\n");
+		g_string_append(json, "\t\t{ \"name\": ");
+		json_string(json, r->name);
+		g_string_append(json, ", \"status\": ");
+		json_string(json, r->status);
+		if (r->reason) {
+			g_string_append(json, ", \"reason\": ");
+			json_string(json, r->reason);
+		}
+		if (!strcmp(r->status, "ok")) {
+			g_string_append_printf(json, ", \"bytes\": %" PRIu64
+				", \"samples\": %" PRIu64 ", \"best_us\": %" PRId64
+				", \"mb_per_s\": ", r->count.bytes,
+				r->count.samples, r->best);
+			json_double(json, "%.1f", (double)r->count.bytes / r->best);
+			g_string_append(json, ", \"samples_per_s\": ");
+			json_double(json, "%.0f", (double)r->count.samples
+				* G_USEC_PER_SEC / r->best);
+		}
+		g_string_append(json, " }");
+	}
+	g_string_append(json, "\n\t]\n}\n");
+
+	ok = g_file_set_contents(path, json->str, json->len, NULL);
+	g_string_free(json, TRUE);
+	if (!ok) {
+		fprintf(stderr, "Cannot write '%s'.\n", path);
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct session_bench sb;
+	const char *dir, *json;
+	int ret;
+
+	if (argc > 1 && !strcmp(argv[1], "--generate")) {
+		if (argc != 3) {
+			fprintf(stderr, "Usage: %s --generate <dir>\n", argv[0]);
+			return 1;
+		}
+		if (sr_init(&ctx) != SR_OK)
+			return 1;
+		sr_log_loglevel_set(SR_LOG_WARN);
+		ret = generate_all(argv[2]);
+		sr_exit(ctx);
+		return ret == SR_OK ? 0 : 1;
+	}
+	filter = argc > 1 ? argv[1] : NULL;
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	sr_log_loglevel_set(SR_LOG_WARN);
+	generate_data();
+
+	bench_run("analog/to_float", bench_analog_to_float, NULL);
+	bench_run("analog/a2l_threshold", bench_a2l, GINT_TO_POINTER(FALSE));
+	bench_run("analog/a2l_schmitt_trigger", bench_a2l, GINT_TO_POINTER(TRUE));
+
+	sb.sdi = demo_open();
+	if (sb.sdi) {
+		sb.trigger = FALSE;
+		bench_run("session/demo_dispatch", bench_session, &sb);
+		sb.trigger = TRUE;
+		bench_run("session/demo_soft_trigger", bench_session, &sb);
+		sr_dev_close(sb.sdi);
+	} else {
+		bench_skip("session/demo", "no demo device");
+	}
+
+	if ((dir = g_getenv("SIGROK_BENCH_USB_DUMPS")))
+		bench_dir(dir, TRUE);
+	if ((dir = g_getenv("SIGROK_BENCH_DATA")))
+		bench_dir(dir, FALSE);
+	else if (!g_getenv("SIGROK_BENCH_USB_DUMPS"))
+		bench_skip("file", "SIGROK_BENCH_DATA is not set");
+	bench_outputs();
+	bench_inputs();
+
+	ret = SR_OK;
+	if ((json = g_getenv("SIGROK_BENCH_JSON")) && *json)
+		ret = write_json(json);
+
+	g_slist_free_full(results, result_free);
+	g_free(logic_data);
+	g_free(analog_data);
+	sr_exit(ctx);
+
+	return ret == SR_OK ? 0 : 1;
+}
@@ -238,6 +238,115 @@ START_TEST(test_endian_write_inc)
 }
 END_TEST
 
+/* Big endian i16 samples, volts in 1/100 units minus 1. */
+static const uint8_t a2l_i16be[] = {
+	0x00, 0x64, 0x00, 0xc8, 0x00, 0xc7, 0x01, 0x2c,
+	0xff, 0x9c, 0x00, 0xfa, 0x00, 0x96, 0x00, 0xc9,
+};
+
+static void a2l_analog_init(struct sr_datafeed_analog *analog,
+		struct sr_analog_encoding *encoding,
+		struct sr_analog_meaning *meaning, GSList *channels)
+{
+	memset(analog, 0, sizeof(*analog));
+	memset(encoding, 0, sizeof(*encoding));
+	memset(meaning, 0, sizeof(*meaning));
+	encoding->unitsize = sizeof(int16_t);
+	encoding->is_signed = TRUE;
+	encoding->is_bigendian = TRUE;
+	encoding->scale.p = 1;
+	encoding->scale.q = 100;
+	encoding->offset.p = -1;
+	encoding->offset.q = 1;
+	meaning->channels = channels;
+	analog->encoding = encoding;
+	analog->meaning = meaning;
+	analog->data = (void *)a2l_i16be;
+	analog->num_samples = ARRAY_SIZE(a2l_i16be) / sizeof(int16_t);
+}
+
+START_TEST(test_a2l_threshold)
+{
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	GSList channel = { NULL, NULL };
+	uint8_t out[8], ref[8];
+	float values[8];
+	size_t i;
+
+	a2l_analog_init(&analog, &encoding, &meaning, &channel);
+
+	/* Integer samples compare like their float values. */
+	fail_unless(sr_analog_to_float(&analog, values) == SR_OK);
+	fail_unless(sr_a2l_threshold(&analog, 0.995, out, 8) == SR_OK);
+	for (i = 0; i < ARRAY_SIZE(out); i++)
+		fail_unless(out[i] == (values[i] >= 0.995), "sample %zu", i);
+	memcpy(ref, out, sizeof(ref));
+
+	/* The same with a negative scale, and inverted values. */
+	encoding.scale.p = -1;
+	encoding.offset.p = 1;
+	fail_unless(sr_a2l_threshold(&analog, -0.995, out, 8) == SR_OK);
+	for (i = 0; i < ARRAY_SIZE(out); i++)
+		fail_unless(out[i] == !ref[i], "sample %zu", i);
+}
+END_TEST
+
+START_TEST(test_a2l_logic)
+{
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	GSList channel = { NULL, NULL };
+	uint8_t logic[8 * 2], ref[8], state;
+	float values[8];
+	size_t i;
+
+	a2l_analog_init(&analog, &encoding, &meaning, &channel);
+	fail_unless(sr_a2l_threshold(&analog, 0.995, ref, 8) == SR_OK);
+
+	/* Only channel 11 of the 16-bit logic samples changes. */
+	memset(logic, 0x55, sizeof(logic));
+	fail_unless(sr_a2l_threshold_logic(&analog, 0.995, logic, 2, 11, 8) == SR_OK);
+	for (i = 0; i < ARRAY_SIZE(ref); i++) {
+		fail_unless(logic[2 * i] == 0x55);
+		fail_unless(logic[2 * i + 1] == (ref[i] ? 0x5d : 0x55));
+	}
+
+	fail_unless(sr_a2l_threshold_logic(&analog, 0.995, logic, 2, 16, 8) == SR_ERR_ARG);
+
+	/* The Schmitt-trigger keeps its state between the thresholds. */
+	fail_unless(sr_analog_to_float(&analog, values) == SR_OK);
+	state = 0;
+	memset(logic, 0, sizeof(logic));
+	fail_unless(sr_a2l_schmitt_trigger_logic(&analog, 0.45, 1.45,
+		&state, logic, 2, 0, 8) == SR_OK);
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		if (values[i] > 1.45)
+			fail_unless(logic[2 * i] == 1, "sample %zu", i);
+		else if (values[i] < 0.45)
+			fail_unless(logic[2 * i] == 0, "sample %zu", i);
+		else if (i > 0)
+			fail_unless(logic[2 * i] == logic[2 * (i - 1)]);
+	}
+	fail_unless(state == logic[2 * 7]);
+
+	/* Float samples take the conversion path, with the same results. */
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+	encoding.is_bigendian = FALSE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 1;
+	encoding.offset.p = 0;
+	analog.data = values;
+	memset(logic, 0, sizeof(logic));
+	fail_unless(sr_a2l_threshold_logic(&analog, 0.995, logic, 1, 7, 8) == SR_OK);
+	for (i = 0; i < ARRAY_SIZE(ref); i++)
+		fail_unless(logic[i] == (ref[i] ? 0x80 : 0));
+}
+END_TEST
+
 Suite *suite_conv(void)
 {
 	Suite *s;
@@ -253,5 +362,10 @@ Suite *suite_conv(void)
 	tcase_add_test(tc, test_endian_write_inc);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("a2l");
+	tcase_add_test(tc, test_a2l_threshold);
+	tcase_add_test(tc, test_a2l_logic);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -136,6 +136,41 @@ START_TEST(test_init_exit_3_reverse)
 }
 END_TEST
 
+/*
+ * Check whether a lazily initialized context without sanity checks
+ * works, and brings up its backends upon the first driver init.
+ */
+START_TEST(test_init_ex_lazy)
+{
+	int ret;
+	struct sr_context *sr_ctx;
+	struct sr_dev_driver **drivers;
+
+	ret = sr_init_ex(&sr_ctx, SR_INIT_LAZY);
+	fail_unless(ret == SR_OK, "sr_init_ex() failed: %d.", ret);
+	drivers = sr_driver_list(sr_ctx);
+	if (drivers && drivers[0]) {
+		ret = sr_driver_init(sr_ctx, drivers[0]);
+		fail_unless(ret == SR_OK, "sr_driver_init() failed: %d.", ret);
+	}
+	ret = sr_exit(sr_ctx);
+	fail_unless(ret == SR_OK, "sr_exit() failed: %d.", ret);
+}
+END_TEST
+
+/* Check whether a context with a USB event thread starts and stops it. */
+START_TEST(test_init_ex_usb_event_thread)
+{
+	int ret;
+	struct sr_context *sr_ctx;
+
+	ret = sr_init_ex(&sr_ctx, SR_INIT_USB_EVENT_THREAD);
+	fail_unless(ret == SR_OK, "sr_init_ex() failed: %d.", ret);
+	ret = sr_exit(sr_ctx);
+	fail_unless(ret == SR_OK, "sr_exit() failed: %d.", ret);
+}
+END_TEST
+
 /* Check whether sr_init(NULL) fails as it should. */
 START_TEST(test_init_null)
 {
@@ -175,6 +210,8 @@ Suite *suite_core(void)
 	tcase_add_test(tc, test_init_exit_2_reverse);
 	tcase_add_test(tc, test_init_exit_3);
 	tcase_add_test(tc, test_init_exit_3_reverse);
+	tcase_add_test(tc, test_init_ex_lazy);
+	tcase_add_test(tc, test_init_ex_usb_event_thread);
 	tcase_add_test(tc, test_init_null);
 	tcase_add_test(tc, test_exit_null);
 	suite_add_tcase(s, tc);
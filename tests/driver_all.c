@@ -40,6 +40,65 @@ START_TEST(test_driver_init_all)
 }
 END_TEST
 
+/* Check whether a scan of several drivers finds the demo device once. */
+START_TEST(test_drivers_scan)
+{
+	struct sr_dev_driver *drivers[3], *demo;
+	GSList *devices;
+
+	demo = srtest_driver_get("demo");
+	if (!demo)
+		return;
+	srtest_driver_init(srtest_ctx, demo);
+
+	drivers[0] = demo;
+	drivers[1] = demo;
+	drivers[2] = NULL;
+	devices = sr_drivers_scan(srtest_ctx, drivers, NULL);
+	fail_unless(g_slist_length(devices) == 1,
+		"Expected one demo device from a single scan.");
+	g_slist_free(devices);
+}
+END_TEST
+
+/* Check the typed config accessors on the demo device. */
+START_TEST(test_config_typed)
+{
+	struct sr_dev_driver *demo;
+	struct sr_dev_inst *sdi;
+	GSList *devices;
+	uint64_t samplerate;
+	gboolean b;
+	int ret;
+
+	demo = srtest_driver_get("demo");
+	if (!demo)
+		return;
+	srtest_driver_init(srtest_ctx, demo);
+
+	devices = sr_driver_scan(demo, NULL);
+	fail_unless(devices != NULL, "No demo device found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+	fail_unless(sr_dev_open(sdi) == SR_OK, "Cannot open demo device.");
+
+	ret = sr_config_set_u64(sdi, NULL, SR_CONF_SAMPLERATE, SR_KHZ(19));
+	fail_unless(ret == SR_OK, "Cannot set samplerate: %d.", ret);
+	ret = sr_config_get_u64(demo, sdi, NULL, SR_CONF_SAMPLERATE, &samplerate);
+	fail_unless(ret == SR_OK, "Cannot get samplerate: %d.", ret);
+	fail_unless(samplerate == SR_KHZ(19),
+		"Got samplerate %" PRIu64 ".", samplerate);
+
+	/* The samplerate is no boolean. */
+	ret = sr_config_get_bool(demo, sdi, NULL, SR_CONF_SAMPLERATE, &b);
+	fail_unless(ret == SR_ERR_ARG, "Type mismatch not detected.");
+	ret = sr_config_set_bool(sdi, NULL, SR_CONF_SAMPLERATE, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "Type mismatch not detected.");
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
 /*
  * Check whether setting a samplerate works.
  *
@@ -70,6 +129,8 @@ Suite *suite_driver_all(void)
 	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
 	tcase_add_test(tc, test_driver_available);
 	tcase_add_test(tc, test_driver_init_all);
+	tcase_add_test(tc, test_drivers_scan);
+	tcase_add_test(tc, test_config_typed);
 	// TODO: Currently broken.
 	// tcase_add_test(tc, test_config_get_set_samplerate);
 	suite_add_tcase(s, tc);
@@ -19,6 +19,9 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -33,6 +36,308 @@ START_TEST(test_input_available)
 }
 END_TEST
 
+/* Bytes per sr_input_send() call or mapped slice, splits data items. */
+#define FEED_SLICE 1000
+
+/*
+ * What an input instance sent to the session: the packet types, and
+ * all logic and analog samples. Packet boundaries may differ.
+ */
+struct feed_log {
+	GString *events;
+	GByteArray *logic;
+	GByteArray *analog;
+};
+
+static void feed_log_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct feed_log *log;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_config *src;
+	const uint8_t *value;
+	float *fdata;
+	char *text;
+	GSList *l;
+	uint64_t i, j;
+	size_t count;
+
+	(void)sdi;
+
+	log = cb_data;
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			text = g_variant_print(src->data, TRUE);
+			g_string_append_printf(log->events, "meta %u %s\n",
+				src->key, text);
+			g_free(text);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		g_byte_array_append(log->logic, logic->data, logic->length);
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		for (i = 0; i < rle->num_runs; i++) {
+			value = (const uint8_t *)rle->values + i * rle->unitsize;
+			for (j = 0; j < rle->run_lengths[i]; j++)
+				g_byte_array_append(log->logic, value, rle->unitsize);
+		}
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		count = analog->num_samples
+			* g_slist_length(analog->meaning->channels);
+		fdata = g_malloc0(count * sizeof(float) + 1);
+		fail_unless(sr_analog_to_float(analog, fdata) == SR_OK);
+		g_byte_array_append(log->analog, (const uint8_t *)fdata,
+			count * sizeof(float));
+		g_free(fdata);
+		break;
+	case SR_DF_HEADER:
+	case SR_DF_END:
+	case SR_DF_TRIGGER:
+		/* Where control packets are in the samples matters. */
+		g_string_append_printf(log->events, "%u at %u/%u\n",
+			packet->type, log->logic->len, log->analog->len);
+		break;
+	default:
+		g_string_append_printf(log->events, "%u\n", packet->type);
+		break;
+	}
+}
+
+/* Feed data to an input module, either copied or from a mapped file. */
+static void feed_input(const char *id, GHashTable *options,
+		const uint8_t *data, size_t len, gboolean mapped,
+		struct feed_log *log)
+{
+	const struct sr_input *in;
+	struct sr_session *session;
+	GString *buf;
+	char *path;
+	size_t pos, remain;
+	int fd;
+
+	log->events = g_string_new(NULL);
+	log->logic = g_byte_array_new();
+	log->analog = g_byte_array_new();
+
+	in = sr_input_new(sr_input_find(id), options);
+	fail_unless(in != NULL, "Cannot create %s input.", id);
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, feed_log_cb, log);
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+
+	if (mapped) {
+		fd = g_file_open_tmp("sr-input-XXXXXX", &path, NULL);
+		fail_unless(fd >= 0, "Cannot create temporary file.");
+		close(fd);
+		fail_unless(g_file_set_contents(path, (const char *)data, len,
+			NULL), "Cannot write temporary file.");
+		fail_unless(sr_input_map_file(in, path) == SR_OK,
+			"Cannot map the %s input file.", id);
+		do {
+			fail_unless(sr_input_send_mapped(in, FEED_SLICE,
+				&remain) == SR_OK, "Mapped %s input failed.", id);
+		} while (remain);
+		g_unlink(path);
+		g_free(path);
+	} else {
+		for (pos = 0; pos < len; pos += buf->len) {
+			buf = g_string_new_len((const char *)data + pos,
+				MIN(FEED_SLICE, len - pos));
+			fail_unless(sr_input_send(in, buf) == SR_OK,
+				"Copied %s input failed.", id);
+			g_string_free(buf, TRUE);
+		}
+	}
+	fail_unless(sr_input_end(in) == SR_OK, "Cannot end %s input.", id);
+	sr_input_free(in);
+	sr_session_destroy(session);
+}
+
+/* Check that mapped input gives the same feed as copied input. */
+static void check_mapped_input(const char *id, GHashTable *options,
+		const uint8_t *data, size_t len)
+{
+	struct feed_log copied, mapped;
+
+	feed_input(id, options, data, len, FALSE, &copied);
+	feed_input(id, options, data, len, TRUE, &mapped);
+
+	fail_unless(copied.logic->len || copied.analog->len,
+		"No samples from %s input.", id);
+	fail_unless(!strcmp(copied.events->str, mapped.events->str),
+		"Mapped %s input sends other packets:\n%s\nversus\n%s",
+		id, mapped.events->str, copied.events->str);
+	fail_unless(copied.logic->len == mapped.logic->len &&
+		!memcmp(copied.logic->data, mapped.logic->data,
+			copied.logic->len),
+		"Mapped %s input sends other logic samples.", id);
+	fail_unless(copied.analog->len == mapped.analog->len &&
+		!memcmp(copied.analog->data, mapped.analog->data,
+			copied.analog->len),
+		"Mapped %s input sends other analog samples.", id);
+
+	g_string_free(copied.events, TRUE);
+	g_string_free(mapped.events, TRUE);
+	g_byte_array_free(copied.logic, TRUE);
+	g_byte_array_free(mapped.logic, TRUE);
+	g_byte_array_free(copied.analog, TRUE);
+	g_byte_array_free(mapped.analog, TRUE);
+}
+
+static void put_u16(GByteArray *b, uint16_t v)
+{
+	uint8_t tmp[2] = { v & 0xff, v >> 8 };
+
+	g_byte_array_append(b, tmp, sizeof(tmp));
+}
+
+static void put_u32(GByteArray *b, uint32_t v)
+{
+	put_u16(b, v & 0xffff);
+	put_u16(b, v >> 16);
+}
+
+static void put_u64(GByteArray *b, uint64_t v)
+{
+	put_u32(b, v & 0xffffffff);
+	put_u32(b, v >> 32);
+}
+
+static void put_f64(GByteArray *b, double v)
+{
+	uint64_t u;
+
+	memcpy(&u, &v, sizeof(u));
+	put_u64(b, u);
+}
+
+/* Input modules which process mapped files in place. */
+START_TEST(test_input_mapped_binary)
+{
+	uint8_t data[10 * FEED_SLICE + 7];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 5 + (i >> 8);
+	check_mapped_input("binary", NULL, data, sizeof(data));
+}
+END_TEST
+
+/* Three channels of 16 bit PCM, samples cross slice boundaries. */
+START_TEST(test_input_mapped_wav)
+{
+	GByteArray *b;
+	unsigned int i;
+
+	b = g_byte_array_new();
+	g_byte_array_append(b, (const uint8_t *)"RIFF", 4);
+	put_u32(b, 36 + 3 * 2 * 5000);
+	g_byte_array_append(b, (const uint8_t *)"WAVEfmt ", 8);
+	put_u32(b, 16);
+	put_u16(b, 1);
+	put_u16(b, 3);
+	put_u32(b, 48000);
+	put_u32(b, 48000 * 3 * 2);
+	put_u16(b, 3 * 2);
+	put_u16(b, 16);
+	g_byte_array_append(b, (const uint8_t *)"data", 4);
+	put_u32(b, 3 * 2 * 5000);
+	for (i = 0; i < 3 * 5000; i++)
+		put_u16(b, i * 97);
+	check_mapped_input("wav", NULL, b->data, b->len);
+	g_byte_array_free(b, TRUE);
+}
+END_TEST
+
+/* Logic 2 analog export, and Logic 1 digital export of changes. */
+START_TEST(test_input_mapped_saleae)
+{
+	GHashTable *options;
+	GByteArray *b;
+	float value;
+	uint32_t u;
+	unsigned int i;
+
+	b = g_byte_array_new();
+	g_byte_array_append(b, (const uint8_t *)"<SALEAE>", 8);
+	put_u32(b, 0);
+	put_u32(b, 1);
+	put_f64(b, 0.0);
+	put_u64(b, 1000000);
+	put_u64(b, 1);
+	put_u64(b, 3000);
+	for (i = 0; i < 3000; i++) {
+		value = (float)i / 7;
+		memcpy(&u, &value, sizeof(u));
+		put_u32(b, u);
+	}
+	check_mapped_input("saleae", NULL, b->data, b->len);
+	g_byte_array_free(b, TRUE);
+
+	b = g_byte_array_new();
+	for (i = 0; i < 1000; i++) {
+		put_u64(b, i * 5 + i % 4);
+		put_u64(b, (uint64_t)i * 0x0101010101ULL);
+	}
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "format",
+		g_variant_ref_sink(g_variant_new_string("logic1-digital")));
+	g_hash_table_insert(options, "changed",
+		g_variant_ref_sink(g_variant_new_boolean(TRUE)));
+	g_hash_table_insert(options, "wordsize",
+		g_variant_ref_sink(g_variant_new_uint32(64)));
+	check_mapped_input("saleae", options, b->data, b->len);
+	g_hash_table_destroy(options);
+	g_byte_array_free(b, TRUE);
+}
+END_TEST
+
+/* An iprobe capture of 11 byte records, and the trailing commands. */
+START_TEST(test_input_mapped_trace32_ad)
+{
+	static const char name[] = "trace32 iprobe data";
+	static const char commands[] = " B::\n I.TWIDTH\n)";
+	GByteArray *b;
+	uint8_t header[0x50];
+	uint64_t timestamp;
+	unsigned int i;
+
+	memset(header, ' ', 0x20);
+	memcpy(header, name, strlen(name));
+	memset(header + 0x20, 0, sizeof(header) - 0x20);
+	header[0x36] = 0x0a;
+	header[0x38] = 11;
+	b = g_byte_array_new();
+	g_byte_array_append(b, header, sizeof(header));
+	b->data[0x3c] = 2000 & 0xff;
+	b->data[0x3d] = 2000 >> 8;
+	b->data[0x40] = 1999 & 0xff;
+	b->data[0x41] = 1999 >> 8;
+	timestamp = 0;
+	for (i = 0; i < 2000; i++) {
+		put_u64(b, timestamp);
+		timestamp += 64 * (1 + i % 3);
+		put_u16(b, i * 31);
+		g_byte_array_append(b, (const uint8_t *)"\x01", 1);
+	}
+	g_byte_array_append(b, (const uint8_t *)commands, strlen(commands));
+	check_mapped_input("trace32_ad", NULL, b->data, b->len);
+	g_byte_array_free(b, TRUE);
+}
+END_TEST
+
 Suite *suite_input_all(void)
 {
 	Suite *s;
@@ -44,5 +349,13 @@ Suite *suite_input_all(void)
 	tcase_add_test(tc, test_input_available);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("mapped");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_mapped_binary);
+	tcase_add_test(tc, test_input_mapped_wav);
+	tcase_add_test(tc, test_input_mapped_saleae);
+	tcase_add_test(tc, test_input_mapped_trace32_ad);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
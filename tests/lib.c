@@ -18,10 +18,13 @@
  */
 
 #include <config.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <zip.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -160,3 +163,50 @@ GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi)
 
 	return channels;
 }
+
+static void session_file_add(struct zip *archive, const char *name,
+		const void *data, size_t size)
+{
+	struct zip_source *src;
+
+	src = zip_source_buffer(archive, data, size, 0);
+	fail_unless(src != NULL, "Cannot create zip source.");
+	fail_unless(zip_file_add(archive, name, src, ZIP_FL_OVERWRITE) >= 0,
+		"Cannot add '%s' to session file.", name);
+}
+
+/*
+ * Write a session file with the given metadata, and the capture files
+ * which follow as triples of name, data and size, terminated by NULL.
+ * Returns the path of the file, which the caller removes when done.
+ */
+char *srtest_session_file_write(const char *metadata, ...)
+{
+	struct zip *archive;
+	va_list args;
+	const char *name;
+	const void *data;
+	size_t size;
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp("sr-session-XXXXXX.sr", &path, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+	g_unlink(path);
+
+	archive = zip_open(path, ZIP_CREATE, NULL);
+	fail_unless(archive != NULL, "Cannot create session file.");
+	session_file_add(archive, "version", "2", 1);
+	session_file_add(archive, "metadata", metadata, strlen(metadata));
+	va_start(args, metadata);
+	while ((name = va_arg(args, const char *))) {
+		data = va_arg(args, const void *);
+		size = va_arg(args, size_t);
+		session_file_add(archive, name, data, size);
+	}
+	va_end(args);
+	fail_unless(zip_close(archive) == 0, "Cannot write session file.");
+
+	return path;
+}
@@ -41,6 +41,8 @@ void srtest_check_samplerate(struct sr_context *sr_ctx, const char *drivername,
 
 GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi);
 
+char *srtest_session_file_write(const char *metadata, ...);
+
 Suite *suite_core(void);
 Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
@@ -19,6 +19,9 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -96,6 +99,755 @@ START_TEST(test_output_options)
 }
 END_TEST
 
+/* Check whether sr_file_writer keeps the order of small and large writes. */
+START_TEST(test_file_writer)
+{
+	struct sr_file_writer *fw;
+	GString *expected, *str;
+	gchar *path, *contents;
+	gsize length;
+	int fd, i;
+
+	fd = g_file_open_tmp("sr-file-writer-XXXXXX", &path, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+
+	/* A small budget, so that writing waits for the writer thread. */
+	fw = sr_file_writer_new(path, 256 * 1024);
+	fail_unless(fw != NULL, "Cannot create file writer.");
+	expected = g_string_new(NULL);
+	for (i = 0; i < 64; i++) {
+		str = g_string_new(NULL);
+		g_string_printf(str, "line %d\n", i);
+		if (i % 8 == 7) {
+			/* Large enough to be handed over without a copy. */
+			while (str->len < 100 * 1024)
+				g_string_append_c(str, 'a' + i % 26);
+		}
+		g_string_append_len(expected, str->str, str->len);
+		fail_unless(sr_file_writer_write_string(fw, str) == SR_OK);
+	}
+	fail_unless(sr_file_writer_write(fw, "end", 3) == SR_OK);
+	g_string_append(expected, "end");
+	fail_unless(sr_file_writer_close(fw) == SR_OK);
+
+	fail_unless(g_file_get_contents(path, &contents, &length, NULL));
+	fail_unless(length == expected->len, "Wrong file size.");
+	fail_unless(!memcmp(contents, expected->str, length),
+		"Wrong file contents.");
+
+	g_free(contents);
+	g_string_free(expected, TRUE);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+#define SRZIP_RATE 1000000
+/* More samples than fit one of the archive's chunks. */
+#define SRZIP_SAMPLES (5 * 1024 * 1024 + 123)
+#define SRZIP_BLOCK (64 * 1024)
+
+static uint8_t srzip_sample(uint64_t i)
+{
+	return (i * 7 + (i >> 12)) & 0xff;
+}
+
+/* A device with eight logic channels to create outputs for. */
+static struct sr_dev_inst *logic_dev_new(void)
+{
+	struct sr_dev_inst *sdi;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("sigrok", "output test", NULL);
+	for (i = 0; i < 8; i++) {
+		g_snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+
+	return sdi;
+}
+
+/* Send a packet to an output, and collect its text when wanted. */
+static void output_send(const struct sr_output *o, int type,
+		const void *payload, GString *text)
+{
+	struct sr_datafeed_packet packet;
+	GString *out;
+
+	packet.type = type;
+	packet.payload = payload;
+	out = NULL;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK,
+		"Cannot send packet type %d to output.", type);
+	if (out && text)
+		g_string_append_len(text, out->str, out->len);
+	if (out)
+		g_string_free(out, TRUE);
+}
+
+/* Send the header and the samplerate, at a fixed start time. */
+static void output_send_start(const struct sr_output *o, GString *text)
+{
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_config src;
+	GSList node;
+
+	header.feed_version = 1;
+	header.starttime.tv_sec = 0;
+	header.starttime.tv_usec = 0;
+	output_send(o, SR_DF_HEADER, &header, text);
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(SRZIP_RATE));
+	node.data = &src;
+	node.next = NULL;
+	meta.config = &node;
+	output_send(o, SR_DF_META, &meta, text);
+	g_variant_unref(src.data);
+}
+
+/*
+ * Write a session file of eight logic channels with the srzip output
+ * module. Without the end of the feed the output gets released as it
+ * would after an aborted acquisition.
+ */
+static char *srzip_write(GHashTable *options, gboolean send_end)
+{
+	const struct sr_output *o;
+	struct sr_datafeed_logic logic;
+	uint8_t block[SRZIP_BLOCK];
+	uint64_t i, pos;
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp("sr-srzip-XXXXXX.sr", &path, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+	o = sr_output_new(sr_output_find("srzip"), options, logic_dev_new(),
+		path);
+	fail_unless(o != NULL, "Cannot create srzip output.");
+	output_send_start(o, NULL);
+
+	logic.unitsize = 1;
+	logic.data = block;
+	for (pos = 0; pos < SRZIP_SAMPLES; pos += logic.length) {
+		logic.length = MIN(SRZIP_BLOCK, SRZIP_SAMPLES - pos);
+		for (i = 0; i < logic.length; i++)
+			block[i] = srzip_sample(pos + i);
+		output_send(o, SR_DF_LOGIC, &logic, NULL);
+	}
+	if (send_end)
+		output_send(o, SR_DF_END, NULL, NULL);
+	fail_unless(sr_output_free(o) == SR_OK, "Cannot free srzip output.");
+
+	return path;
+}
+
+struct srzip_compare {
+	uint64_t pos;
+	gboolean mismatch;
+};
+
+static void srzip_compare_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct srzip_compare *cmp;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t i;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	cmp = cb_data;
+	logic = packet->payload;
+	data = logic->data;
+	if (logic->unitsize != 1)
+		cmp->mismatch = TRUE;
+	for (i = 0; i < logic->length; i++) {
+		if (data[i] != srzip_sample(cmp->pos + i))
+			cmp->mismatch = TRUE;
+	}
+	cmp->pos += logic->length;
+}
+
+/* Read a session file back, and check it has all of the samples. */
+static void srzip_check(const char *path)
+{
+	struct sr_session_file_info *info;
+	struct sr_session *sess;
+	struct srzip_compare cmp;
+
+	fail_unless(sr_session_file_info_get(path, &info) == SR_OK,
+		"Cannot get session file info.");
+	fail_unless(info->samplerate == SRZIP_RATE, "Wrong samplerate.");
+	fail_unless(info->num_logic_channels == 8, "Wrong channel count.");
+	fail_unless(info->num_analog_channels == 0, "Wrong channel count.");
+	fail_unless(info->unitsize == 1, "Wrong unitsize.");
+	fail_unless(info->num_samples == SRZIP_SAMPLES,
+		"Wrong sample count %" PRIu64 ".", info->num_samples);
+	sr_session_file_info_free(info);
+
+	fail_unless(sr_session_load(srtest_ctx, path, &sess) == SR_OK,
+		"Cannot load session file.");
+	memset(&cmp, 0, sizeof(cmp));
+	sr_session_datafeed_callback_add(sess, srzip_compare_cb, &cmp);
+	fail_unless(sr_session_start(sess) == SR_OK, "Cannot start session.");
+	fail_unless(sr_session_run(sess) == SR_OK, "Cannot run session.");
+	sr_session_destroy(sess);
+	fail_unless(cmp.pos == SRZIP_SAMPLES, "Wrong number of samples read.");
+	fail_unless(!cmp.mismatch, "Samples read back differ.");
+}
+
+/* Check that a session file written by srzip reads back unchanged. */
+START_TEST(test_srzip_roundtrip)
+{
+	char *path;
+
+	path = srzip_write(NULL, TRUE);
+	srzip_check(path);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+/* Same with ZIP64 records, as in archives beyond 4 GiB. */
+START_TEST(test_srzip_roundtrip_zip64)
+{
+	GHashTable *options;
+	char *path;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "zip64",
+		g_variant_ref_sink(g_variant_new_boolean(TRUE)));
+	g_hash_table_insert(options, "codec",
+		g_variant_ref_sink(g_variant_new_string("store")));
+	path = srzip_write(options, TRUE);
+	g_hash_table_destroy(options);
+	srzip_check(path);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+/* An output released without the end of the feed keeps all samples. */
+START_TEST(test_srzip_abort)
+{
+	char *path;
+
+	path = srzip_write(NULL, FALSE);
+	srzip_check(path);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+/* Runs of logic samples, long and short, for the RLE tests. */
+static const uint64_t rle_lengths[] = {
+	1, 5, 1000, 3, 70000, 1, 2, 300000, 17,
+};
+static const uint8_t rle_values[] = {
+	0x00, 0x01, 0x01, 0x80, 0xff, 0x00, 0x55, 0xaa, 0x0f,
+};
+
+#define RLE_RUNS G_N_ELEMENTS(rle_lengths)
+
+/* Send the runs as SR_DF_LOGIC_RLE packets, split in two. */
+static void rle_send_runs(const struct sr_output *o, GString *text)
+{
+	struct sr_datafeed_logic_rle rle;
+	uint64_t lengths[RLE_RUNS];
+	uint8_t values[RLE_RUNS];
+
+	memcpy(lengths, rle_lengths, sizeof(lengths));
+	memcpy(values, rle_values, sizeof(values));
+	rle.unitsize = 1;
+	rle.num_runs = RLE_RUNS / 2;
+	rle.values = values;
+	rle.run_lengths = lengths;
+	output_send(o, SR_DF_LOGIC_RLE, &rle, text);
+	rle.num_runs = RLE_RUNS - RLE_RUNS / 2;
+	rle.values = values + RLE_RUNS / 2;
+	rle.run_lengths = lengths + RLE_RUNS / 2;
+	output_send(o, SR_DF_LOGIC_RLE, &rle, text);
+}
+
+/* Send the same runs as SR_DF_LOGIC packets, expanded. */
+static void rle_send_expanded(const struct sr_output *o, GString *text)
+{
+	struct sr_datafeed_logic logic;
+	uint8_t *data;
+	uint64_t i;
+
+	for (i = 0; i < RLE_RUNS; i++) {
+		data = g_malloc(rle_lengths[i]);
+		memset(data, rle_values[i], rle_lengths[i]);
+		logic.length = rle_lengths[i];
+		logic.unitsize = 1;
+		logic.data = data;
+		output_send(o, SR_DF_LOGIC, &logic, text);
+		g_free(data);
+	}
+}
+
+/* Get the complete text of an output module for the runs. */
+static GString *rle_output_text(const char *id, gboolean rle)
+{
+	const struct sr_output *o;
+	GString *text;
+	char *date, *end;
+
+	o = sr_output_new(sr_output_find(id), NULL, logic_dev_new(), NULL);
+	fail_unless(o != NULL, "Cannot create %s output.", id);
+	text = g_string_new(NULL);
+	output_send_start(o, text);
+	if (rle)
+		rle_send_runs(o, text);
+	else
+		rle_send_expanded(o, text);
+	output_send(o, SR_DF_END, NULL, text);
+	fail_unless(sr_output_free(o) == SR_OK, "Cannot free %s output.", id);
+
+	/* The VCD header has the current time, which has to go. */
+	date = strstr(text->str, "$date");
+	if (date && (end = strstr(date, "$end\n")))
+		g_string_erase(text, date - text->str, end + 5 - date);
+
+	return text;
+}
+
+/* Check that run-length encoded input gives the same text as plain input. */
+START_TEST(test_output_rle)
+{
+	static const char *ids[] = { "vcd", "csv", "bits", "hex", "ascii" };
+	GString *rle, *expanded;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		if (!sr_output_find(ids[i]))
+			continue;
+		rle = rle_output_text(ids[i], TRUE);
+		expanded = rle_output_text(ids[i], FALSE);
+		fail_unless(rle->len > 0, "No %s output.", ids[i]);
+		fail_unless(rle->len == expanded->len &&
+			!memcmp(rle->str, expanded->str, rle->len),
+			"The %s output differs for RLE input.", ids[i]);
+		g_string_free(rle, TRUE);
+		g_string_free(expanded, TRUE);
+	}
+}
+END_TEST
+
+static void rle_compare_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	GByteArray *samples;
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	samples = cb_data;
+	logic = packet->payload;
+	g_byte_array_append(samples, logic->data,
+		logic->length * logic->unitsize);
+}
+
+/* Check that srzip stores RLE input as the expanded samples. */
+START_TEST(test_srzip_rle)
+{
+	const struct sr_output *o;
+	struct sr_session *sess;
+	GByteArray *samples;
+	uint64_t i, j, pos;
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp("sr-srzip-XXXXXX.sr", &path, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+	o = sr_output_new(sr_output_find("srzip"), NULL, logic_dev_new(),
+		path);
+	fail_unless(o != NULL, "Cannot create srzip output.");
+	output_send_start(o, NULL);
+	rle_send_runs(o, NULL);
+	output_send(o, SR_DF_END, NULL, NULL);
+	fail_unless(sr_output_free(o) == SR_OK, "Cannot free srzip output.");
+
+	fail_unless(sr_session_load(srtest_ctx, path, &sess) == SR_OK,
+		"Cannot load session file.");
+	samples = g_byte_array_new();
+	sr_session_datafeed_callback_add(sess, rle_compare_cb, samples);
+	fail_unless(sr_session_start(sess) == SR_OK, "Cannot start session.");
+	fail_unless(sr_session_run(sess) == SR_OK, "Cannot run session.");
+	sr_session_destroy(sess);
+
+	pos = 0;
+	for (i = 0; i < RLE_RUNS; i++) {
+		for (j = 0; j < rle_lengths[i]; j++, pos++) {
+			fail_unless(pos < samples->len, "Samples missing.");
+			fail_unless(samples->data[pos] == rle_values[i],
+				"Wrong sample at %" PRIu64 ".", pos);
+		}
+	}
+	fail_unless(pos == samples->len, "Too many samples read back.");
+	g_byte_array_free(samples, TRUE);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+/*
+ * Check the Arrow output's stream against a reference file: a schema
+ * with three Bool columns and the samplerate, record batches of eight
+ * rows, the last one shorter, and the end-of-stream marker.
+ */
+START_TEST(test_output_arrow)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_logic logic;
+	GHashTable *options;
+	GString *text;
+	uint8_t data[20];
+	char *golden;
+	gsize len;
+	int i;
+
+	sdi = sr_dev_inst_user_new("sigrok", "arrow test", NULL);
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_LOGIC, "D1");
+	sr_dev_inst_channel_add(sdi, 2, SR_CHANNEL_LOGIC, "D2");
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "rows",
+		g_variant_ref_sink(g_variant_new_uint64(8)));
+	o = sr_output_new(sr_output_find("arrow"), options, sdi, NULL);
+	g_hash_table_destroy(options);
+	fail_unless(o != NULL, "Cannot create arrow output.");
+
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = i * 7 + i / 8;
+	text = g_string_new(NULL);
+	output_send_start(o, text);
+	logic.length = sizeof(data);
+	logic.unitsize = 1;
+	logic.data = data;
+	output_send(o, SR_DF_LOGIC, &logic, text);
+	output_send(o, SR_DF_END, NULL, text);
+	fail_unless(sr_output_free(o) == SR_OK, "Cannot free arrow output.");
+
+	fail_unless(g_file_get_contents(TESTS_DATADIR "/arrow-logic.arrows",
+		&golden, &len, NULL), "Cannot read the reference file.");
+	fail_unless(text->len == len && !memcmp(text->str, golden, len),
+		"The Arrow stream differs from the reference file.");
+	g_free(golden);
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+#define PIPELINE_SAMPLES 16
+
+static const char *pipeline_ids[] = { "analog-binary", "csv", "analog" };
+
+/* Send a packet to a single output, or to all outputs of a pipeline. */
+static void pipeline_send(struct sr_output_pipeline *pipeline,
+		const struct sr_output *o, int type, const void *payload,
+		GString **text)
+{
+	struct sr_datafeed_packet packet;
+	GString *out[G_N_ELEMENTS(pipeline_ids)];
+	unsigned int i;
+
+	if (o) {
+		output_send(o, type, payload, text[0]);
+		return;
+	}
+
+	packet.type = type;
+	packet.payload = payload;
+	fail_unless(sr_output_pipeline_send(pipeline, &packet, out) == SR_OK,
+		"Cannot send packet type %d to the pipeline.", type);
+	for (i = 0; i < G_N_ELEMENTS(out); i++) {
+		if (!out[i])
+			continue;
+		g_string_append_len(text[i], out[i]->str, out[i]->len);
+		g_string_free(out[i], TRUE);
+	}
+}
+
+/* Send the header, samplerate and integer analog data of two channels. */
+static void pipeline_send_all(struct sr_output_pipeline *pipeline,
+		const struct sr_output *o, const struct sr_dev_inst *sdi,
+		GString **text)
+{
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	GSList node;
+	int16_t data[2 * PIPELINE_SAMPLES];
+	unsigned int i;
+
+	header.feed_version = 1;
+	header.starttime.tv_sec = 0;
+	header.starttime.tv_usec = 0;
+	pipeline_send(pipeline, o, SR_DF_HEADER, &header, text);
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(SRZIP_RATE));
+	node.data = &src;
+	node.next = NULL;
+	meta.config = &node;
+	pipeline_send(pipeline, o, SR_DF_META, &meta, text);
+	g_variant_unref(src.data);
+
+	for (i = 0; i < G_N_ELEMENTS(data); i++)
+		data[i] = (int16_t)((int)i * 1234 - 20000);
+	memset(&encoding, 0, sizeof(encoding));
+	encoding.unitsize = sizeof(int16_t);
+	encoding.is_signed = TRUE;
+	encoding.digits = 2;
+	encoding.is_digits_decimal = TRUE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 100;
+	encoding.offset.p = 0;
+	encoding.offset.q = 1;
+	memset(&meaning, 0, sizeof(meaning));
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	meaning.channels = sr_dev_inst_channels_get(sdi);
+	spec.spec_digits = 2;
+	analog.data = data;
+	analog.num_samples = PIPELINE_SAMPLES;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	pipeline_send(pipeline, o, SR_DF_ANALOG, &analog, text);
+
+	pipeline_send(pipeline, o, SR_DF_END, NULL, text);
+}
+
+/*
+ * Check that outputs in a pipeline give the same text as on their own,
+ * for outputs which take analog data as it is as well as those which
+ * use the floats which the pipeline converted them to.
+ */
+START_TEST(test_output_pipeline_analog)
+{
+	struct sr_output_pipeline *pipeline;
+	const struct sr_output *o[G_N_ELEMENTS(pipeline_ids)];
+	struct sr_dev_inst *sdi;
+	GString *text[G_N_ELEMENTS(pipeline_ids)], *single;
+	unsigned int i;
+
+	sdi = sr_dev_inst_user_new("sigrok", "pipeline test", NULL);
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_ANALOG, "A0");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_ANALOG, "A1");
+
+	pipeline = sr_output_pipeline_new();
+	for (i = 0; i < G_N_ELEMENTS(pipeline_ids); i++) {
+		o[i] = sr_output_new(sr_output_find(pipeline_ids[i]),
+			NULL, sdi, NULL);
+		fail_unless(o[i] != NULL, "Cannot create %s output.",
+			pipeline_ids[i]);
+		fail_unless(sr_output_pipeline_add(pipeline, o[i]) == SR_OK,
+			"Cannot add %s output to the pipeline.", pipeline_ids[i]);
+		text[i] = g_string_new(NULL);
+	}
+	pipeline_send_all(pipeline, NULL, sdi, text);
+	sr_output_pipeline_free(pipeline);
+	for (i = 0; i < G_N_ELEMENTS(pipeline_ids); i++)
+		sr_output_free(o[i]);
+
+	for (i = 0; i < G_N_ELEMENTS(pipeline_ids); i++) {
+		o[i] = sr_output_new(sr_output_find(pipeline_ids[i]),
+			NULL, sdi, NULL);
+		single = g_string_new(NULL);
+		pipeline_send_all(NULL, o[i], sdi, &single);
+		sr_output_free(o[i]);
+		fail_unless(text[i]->len > 0, "No %s output.", pipeline_ids[i]);
+		fail_unless(text[i]->len == single->len &&
+			!memcmp(text[i]->str, single->str, single->len),
+			"The %s output differs in a pipeline.", pipeline_ids[i]);
+		g_string_free(text[i], TRUE);
+		g_string_free(single, TRUE);
+	}
+}
+END_TEST
+
+#define CHANNELS_SAMPLES 64
+
+/* Send float samples of the given channels, interleaved. */
+static void output_send_floats(const struct sr_output *o, GSList *channels,
+		const float *data, GString *text)
+{
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	memset(&encoding, 0, sizeof(encoding));
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+	encoding.is_bigendian = G_BYTE_ORDER == G_BIG_ENDIAN;
+	encoding.digits = 2;
+	encoding.is_digits_decimal = TRUE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 1;
+	encoding.offset.p = 0;
+	encoding.offset.q = 1;
+	memset(&meaning, 0, sizeof(meaning));
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	meaning.channels = channels;
+	spec.spec_digits = 2;
+	analog.data = (void *)data;
+	analog.num_samples = CHANNELS_SAMPLES;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	output_send(o, SR_DF_ANALOG, &analog, text);
+}
+
+static float channels_sample(unsigned int ch, unsigned int i)
+{
+	return ch ? 10.0 - i * 0.25 : i * 0.5;
+}
+
+struct channels_compare {
+	uint64_t pos[2];
+	gboolean mismatch;
+};
+
+static void channels_compare_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct channels_compare *cmp;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_channel *ch;
+	unsigned int num_channels, pos;
+	float *values;
+	GSList *l;
+	uint64_t i;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_ANALOG)
+		return;
+	cmp = cb_data;
+	analog = packet->payload;
+	num_channels = g_slist_length(analog->meaning->channels);
+	values = g_malloc(analog->num_samples * num_channels * sizeof(float));
+	if (sr_analog_to_float(analog, values) != SR_OK)
+		cmp->mismatch = TRUE;
+	pos = 0;
+	for (l = analog->meaning->channels; l; l = l->next, pos++) {
+		ch = l->data;
+		if (ch->index < 0 || ch->index > 1) {
+			cmp->mismatch = TRUE;
+			continue;
+		}
+		for (i = 0; i < analog->num_samples; i++) {
+			if (values[i * num_channels + pos] != channels_sample(
+					ch->index, cmp->pos[ch->index] + i))
+				cmp->mismatch = TRUE;
+		}
+		cmp->pos[ch->index] += analog->num_samples;
+	}
+	g_free(values);
+}
+
+/*
+ * Check that outputs take analog packets which hold several channels,
+ * and give the same as for packets of one channel each.
+ */
+START_TEST(test_output_analog_channels)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_session *sess;
+	struct channels_compare cmp;
+	GSList *channels, node;
+	GString *text[2];
+	float data[2 * CHANNELS_SAMPLES], single[CHANNELS_SAMPLES];
+	const char *defs[2];
+	char *path;
+	unsigned int i, j, ch;
+	int fd;
+
+	sdi = sr_dev_inst_user_new("sigrok", "channels test", NULL);
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_ANALOG, "A0");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_ANALOG, "A1");
+	channels = sr_dev_inst_channels_get(sdi);
+	for (i = 0; i < CHANNELS_SAMPLES; i++) {
+		data[2 * i] = channels_sample(0, i);
+		data[2 * i + 1] = channels_sample(1, i);
+	}
+
+	/* VCD, all channels at once and one by one. */
+	for (i = 0; i < 2; i++) {
+		o = sr_output_new(sr_output_find("vcd"), NULL, sdi, NULL);
+		fail_unless(o != NULL, "Cannot create vcd output.");
+		text[i] = g_string_new(NULL);
+		output_send_start(o, text[i]);
+		if (!i) {
+			output_send_floats(o, channels, data, text[i]);
+		} else {
+			node.next = NULL;
+			for (ch = 0; ch < 2; ch++) {
+				node.data = g_slist_nth_data(channels, ch);
+				for (j = 0; j < CHANNELS_SAMPLES; j++)
+					single[j] = channels_sample(ch, j);
+				output_send_floats(o, &node, single, text[i]);
+			}
+		}
+		output_send(o, SR_DF_END, NULL, text[i]);
+		sr_output_free(o);
+		/* The header has the current time. */
+		defs[i] = strstr(text[i]->str, "$enddefinitions");
+		fail_unless(defs[i] != NULL, "No vcd definitions.");
+	}
+	fail_unless(!strcmp(defs[0], defs[1]),
+		"The vcd output differs for packets of several channels.");
+	g_string_free(text[0], TRUE);
+	g_string_free(text[1], TRUE);
+
+	/* srzip, each channel reads back on its own. */
+	fd = g_file_open_tmp("sr-srzip-XXXXXX.sr", &path, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+	o = sr_output_new(sr_output_find("srzip"), NULL, sdi, path);
+	fail_unless(o != NULL, "Cannot create srzip output.");
+	output_send_start(o, NULL);
+	output_send_floats(o, channels, data, NULL);
+	output_send(o, SR_DF_END, NULL, NULL);
+	fail_unless(sr_output_free(o) == SR_OK, "Cannot free srzip output.");
+
+	fail_unless(sr_session_load(srtest_ctx, path, &sess) == SR_OK,
+		"Cannot load session file.");
+	memset(&cmp, 0, sizeof(cmp));
+	sr_session_datafeed_callback_add(sess, channels_compare_cb, &cmp);
+	fail_unless(sr_session_start(sess) == SR_OK, "Cannot start session.");
+	fail_unless(sr_session_run(sess) == SR_OK, "Cannot run session.");
+	sr_session_destroy(sess);
+	fail_unless(cmp.pos[0] == CHANNELS_SAMPLES
+		&& cmp.pos[1] == CHANNELS_SAMPLES,
+		"Wrong number of samples read.");
+	fail_unless(!cmp.mismatch, "Samples read back differ.");
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
 Suite *suite_output_all(void)
 {
 	Suite *s;
@@ -110,6 +862,19 @@ Suite *suite_output_all(void)
 	tcase_add_test(tc, test_output_desc);
 	tcase_add_test(tc, test_output_find);
 	tcase_add_test(tc, test_output_options);
+	tcase_add_test(tc, test_file_writer);
+	tcase_add_test(tc, test_output_rle);
+	tcase_add_test(tc, test_output_arrow);
+	tcase_add_test(tc, test_output_pipeline_analog);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("srzip");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_srzip_roundtrip);
+	tcase_add_test(tc, test_srzip_roundtrip_zip64);
+	tcase_add_test(tc, test_srzip_abort);
+	tcase_add_test(tc, test_output_analog_channels);
+	tcase_add_test(tc, test_srzip_rle);
 	suite_add_tcase(s, tc);
 
 	return s;
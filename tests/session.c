@@ -19,6 +19,9 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -118,6 +121,277 @@ START_TEST(test_session_destroy_bogus)
 }
 END_TEST
 
+/*
+ * Check whether sr_session_file_info_get() fails for bogus arguments
+ * and files which don't exist.
+ */
+START_TEST(test_session_file_info_bogus)
+{
+	struct sr_session_file_info *info;
+	int ret;
+
+	ret = sr_session_file_info_get(NULL, &info);
+	fail_unless(ret == SR_ERR_ARG, "sr_session_file_info_get(NULL) worked.");
+	ret = sr_session_file_info_get("/nonexistent/file.sr", NULL);
+	fail_unless(ret == SR_ERR_ARG, "Missing info pointer was accepted.");
+	info = (void *)1;
+	ret = sr_session_file_info_get("/nonexistent/file.sr", &info);
+	fail_unless(ret != SR_OK, "Nonexistent file was accepted.");
+	fail_unless(info == NULL, "No NULL info for a nonexistent file.");
+	sr_session_file_info_free(NULL);
+}
+END_TEST
+
+/*
+ * Check whether sr_session_file_info_get() reports the samplerate,
+ * channels and sample count of a session file with several chunks.
+ */
+START_TEST(test_session_file_info_fixture)
+{
+	struct sr_session_file_info *info;
+	const char *names[] = { "CLK", "DATA", "CS", "RST", "V1" };
+	unsigned int i;
+	int ret;
+
+	ret = sr_session_file_info_get(TESTS_DATADIR "/capture.sr", &info);
+	fail_unless(ret == SR_OK, "Failed to get the file info: %d.", ret);
+	fail_unless(info != NULL, "No file info.");
+	fail_unless(info->samplerate == SR_MHZ(2),
+		"Wrong samplerate: %" PRIu64 ".", info->samplerate);
+	fail_unless(info->num_logic_channels == 4,
+		"Wrong logic channel count: %u.", info->num_logic_channels);
+	fail_unless(info->num_analog_channels == 1,
+		"Wrong analog channel count: %u.", info->num_analog_channels);
+	fail_unless(info->unitsize == 1, "Wrong unitsize: %u.", info->unitsize);
+	fail_unless(info->num_samples == 3000 + 1234,
+		"Wrong sample count: %" PRIu64 ".", info->num_samples);
+	fail_unless(info->duration == UINT64_C(2117000),
+		"Wrong duration: %" PRIu64 ".", info->duration);
+	fail_unless(info->channel_names != NULL, "No channel names.");
+	for (i = 0; i < G_N_ELEMENTS(names); i++) {
+		fail_unless(info->channel_names[i] != NULL,
+			"Channel name %u missing.", i);
+		fail_unless(!strcmp(info->channel_names[i], names[i]),
+			"Wrong name for channel %u: %s.", i,
+			info->channel_names[i]);
+	}
+	fail_unless(info->channel_names[i] == NULL, "Extra channel names.");
+	sr_session_file_info_free(info);
+}
+END_TEST
+
+/*
+ * Check whether sr_session_file_summary_get() fails for bogus arguments
+ * and files which don't exist.
+ */
+START_TEST(test_session_file_summary_bogus)
+{
+	struct sr_session_file_summary *summary;
+	int ret;
+
+	ret = sr_session_file_summary_get(NULL, 0, 1000, &summary);
+	fail_unless(ret == SR_ERR_ARG, "sr_session_file_summary_get(NULL) worked.");
+	ret = sr_session_file_summary_get("/nonexistent/file.sr", 0, 1000, NULL);
+	fail_unless(ret == SR_ERR_ARG, "Missing summary pointer was accepted.");
+	summary = (void *)1;
+	ret = sr_session_file_summary_get("/nonexistent/file.sr", 0, 1000, &summary);
+	fail_unless(ret != SR_OK, "Nonexistent file was accepted.");
+	fail_unless(summary == NULL, "No NULL summary for a nonexistent file.");
+	sr_session_file_summary_free(NULL);
+}
+END_TEST
+
+/*
+ * Check whether sr_session_file_export() fails for bogus arguments
+ * and files which don't exist.
+ */
+START_TEST(test_session_file_export_bogus)
+{
+	const struct sr_output_module *omod;
+	int ret;
+
+	omod = sr_output_find("csv");
+	fail_unless(omod != NULL, "No csv output module.");
+	ret = sr_session_file_export(NULL, "/nonexistent/file.sr", omod,
+		NULL, "/nonexistent/file.csv", 0);
+	fail_unless(ret == SR_ERR_ARG, "Missing context was accepted.");
+	ret = sr_session_file_export(srtest_ctx, NULL, omod,
+		NULL, "/nonexistent/file.csv", 0);
+	fail_unless(ret == SR_ERR_ARG, "sr_session_file_export(NULL) worked.");
+	ret = sr_session_file_export(srtest_ctx, "/nonexistent/file.sr", NULL,
+		NULL, "/nonexistent/file.csv", 0);
+	fail_unless(ret == SR_ERR_ARG, "Missing output module was accepted.");
+	ret = sr_session_file_export(srtest_ctx, "/nonexistent/file.sr", omod,
+		NULL, NULL, 0);
+	fail_unless(ret == SR_ERR_ARG, "Missing output file was accepted.");
+	ret = sr_session_file_export(srtest_ctx, "/nonexistent/file.sr", omod,
+		NULL, "/nonexistent/file.csv", 0);
+	fail_unless(ret != SR_OK, "Nonexistent file was accepted.");
+}
+END_TEST
+
+static const char export_metadata[] =
+	"[global]\n"
+	"sigrok version=0.6.0\n"
+	"\n"
+	"[device 1]\n"
+	"capturefile=logic-1\n"
+	"total probes=8\n"
+	"samplerate=1000000\n"
+	"probe1=D0\n"
+	"probe2=D1\n"
+	"probe3=D2\n"
+	"probe4=D3\n"
+	"probe5=D4\n"
+	"probe6=D5\n"
+	"probe7=D6\n"
+	"probe8=D7\n"
+	"unitsize=1\n";
+
+/* Export a session file to a temporary file, and read it back. */
+static GString *export_text(const char *path, const char *id,
+		GHashTable *options, unsigned int threads)
+{
+	char *outfile, *text;
+	gsize len;
+	int fd;
+
+	fd = g_file_open_tmp("sr-export-XXXXXX", &outfile, NULL);
+	fail_unless(fd >= 0, "Cannot create temporary file.");
+	close(fd);
+	fail_unless(sr_session_file_export(srtest_ctx, path, sr_output_find(id),
+		options, outfile, threads) == SR_OK,
+		"Cannot export to %s on %u threads.", id, threads);
+	fail_unless(g_file_get_contents(outfile, &text, &len, NULL),
+		"Cannot read the %s export.", id);
+	g_unlink(outfile);
+	g_free(outfile);
+
+	return g_string_new_len(text, len);
+}
+
+/* Send a packet to an output, and collect its text. */
+static void plain_send(const struct sr_output *o, int type,
+		const void *payload, GString *text)
+{
+	struct sr_datafeed_packet packet;
+	GString *out;
+
+	packet.type = type;
+	packet.payload = payload;
+	out = NULL;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK,
+		"Cannot send packet type %d to output.", type);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/*
+ * Run a whole capture through one output in a single pass, the way an
+ * acquisition of the session file's device would feed it.
+ */
+static GString *plain_text(const char *id, GHashTable *options,
+		const uint8_t *data, size_t length)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_config src;
+	GSList node;
+	GString *text;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("sigrok", "export test", NULL);
+	for (i = 0; i < 8; i++) {
+		g_snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	o = sr_output_new(sr_output_find(id), options, sdi, NULL);
+	fail_unless(o != NULL, "Cannot create %s output.", id);
+
+	text = g_string_new(NULL);
+	header.feed_version = 1;
+	header.starttime.tv_sec = 0;
+	header.starttime.tv_usec = 0;
+	plain_send(o, SR_DF_HEADER, &header, text);
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(SR_MHZ(1)));
+	node.data = &src;
+	node.next = NULL;
+	meta.config = &node;
+	plain_send(o, SR_DF_META, &meta, text);
+	g_variant_unref(src.data);
+	logic.length = length;
+	logic.unitsize = 1;
+	logic.data = (void *)data;
+	plain_send(o, SR_DF_LOGIC, &logic, text);
+	plain_send(o, SR_DF_END, NULL, text);
+	sr_output_free(o);
+
+	return text;
+}
+
+/*
+ * Check that exporting on several threads gives the same file as on
+ * one thread, and as a single pass of the output over all samples. The
+ * chunks have sizes which don't all line up with the modules' segment
+ * alignment, nor does their total.
+ */
+START_TEST(test_session_file_export_threads)
+{
+	static const char *ids[] = { "csv", "bits", "hex", "binary" };
+	static uint8_t data[4096 + 1000 + 4096 + 64 + 3000 + 777];
+	GHashTable *options;
+	GString *serial, *parallel, *plain;
+	char *path;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i * 13 + (i >> 7)) & 0xff;
+	path = srtest_session_file_write(export_metadata,
+		"logic-1-1", data, (size_t)4096,
+		"logic-1-2", data + 4096, (size_t)1000,
+		"logic-1-3", data + 5096, (size_t)4096,
+		"logic-1-4", data + 9192, (size_t)64,
+		"logic-1-5", data + 9256, (size_t)3000,
+		"logic-1-6", data + 12256, (size_t)777, NULL);
+
+	/* The CSV header has the current time. */
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "header",
+		g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		if (!sr_output_find(ids[i]))
+			continue;
+		serial = export_text(path, ids[i], i == 0 ? options : NULL, 1);
+		parallel = export_text(path, ids[i], i == 0 ? options : NULL, 4);
+		fail_unless(serial->len > 0, "No %s export.", ids[i]);
+		fail_unless(serial->len == parallel->len &&
+			!memcmp(serial->str, parallel->str, serial->len),
+			"The %s export differs on several threads.", ids[i]);
+		plain = plain_text(ids[i], i == 0 ? options : NULL,
+			data, sizeof(data));
+		fail_unless(serial->len == plain->len &&
+			!memcmp(serial->str, plain->str, serial->len),
+			"The %s export differs from a single pass.", ids[i]);
+		g_string_free(serial, TRUE);
+		g_string_free(parallel, TRUE);
+		g_string_free(plain, TRUE);
+	}
+
+	g_hash_table_destroy(options);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
 START_TEST(test_session_trigger_set_get)
 {
 	int ret;
@@ -185,6 +459,362 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+/*
+ * Check whether datafeed buffer refcounting works.
+ * If the memory isn't accessible (or something segfaults) this test
+ * will fail.
+ */
+START_TEST(test_datafeed_buffer_ref_unref)
+{
+	struct sr_datafeed_buffer *buf;
+	uint8_t *data;
+
+	buf = sr_datafeed_buffer_new(64);
+	fail_unless(buf != NULL, "sr_datafeed_buffer_new() failed.");
+	fail_unless(sr_datafeed_buffer_size(buf) == 64);
+	data = sr_datafeed_buffer_data(buf);
+	fail_unless(data != NULL);
+	memset(data, 0x55, 64);
+
+	fail_unless(sr_datafeed_buffer_ref(buf) == buf);
+	sr_datafeed_buffer_unref(buf);
+	/* Still one reference left, the memory must be valid. */
+	fail_unless(data[63] == 0x55);
+	sr_datafeed_buffer_unref(buf);
+
+	/* Zero-sized buffers and NULL arguments are rejected. */
+	fail_unless(sr_datafeed_buffer_new(0) == NULL);
+	fail_unless(sr_datafeed_buffer_data(NULL) == NULL);
+	fail_unless(sr_datafeed_buffer_size(NULL) == 0);
+	sr_datafeed_buffer_unref(NULL);
+}
+END_TEST
+
+/*
+ * Check whether copying a logic packet outside of a session duplicates
+ * the payload data.
+ */
+START_TEST(test_packet_copy_logic)
+{
+	int ret;
+	uint8_t samples[] = { 0x01, 0x02, 0x03, 0x04 };
+	struct sr_datafeed_logic logic, *logic_copy;
+	struct sr_datafeed_packet packet, *copy;
+
+	logic.length = sizeof(samples);
+	logic.unitsize = 1;
+	logic.data = samples;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	ret = sr_packet_copy(&packet, &copy);
+	fail_unless(ret == SR_OK, "sr_packet_copy() failed: %d.", ret);
+	fail_unless(copy->type == SR_DF_LOGIC);
+	logic_copy = (struct sr_datafeed_logic *)copy->payload;
+	fail_unless(logic_copy->length == logic.length);
+	fail_unless(logic_copy->data != logic.data);
+	fail_unless(!memcmp(logic_copy->data, samples, sizeof(samples)));
+	sr_packet_free(copy);
+}
+END_TEST
+
+/* Check whether run-length logic data expands in chunks of any size. */
+START_TEST(test_logic_rle_expand)
+{
+	uint16_t values[] = { 0x1234, 0x0001, 0xffff };
+	uint64_t run_lengths[] = { 3, 1, 5 };
+	uint16_t expected[] = { 0x1234, 0x1234, 0x1234, 0x0001,
+		0xffff, 0xffff, 0xffff, 0xffff, 0xffff };
+	uint16_t buf[ARRAY_SIZE(expected)];
+	struct sr_datafeed_logic_rle rle;
+	struct sr_logic_rle_pos pos;
+	uint64_t len, total;
+	size_t chunk;
+
+	rle.num_runs = ARRAY_SIZE(values);
+	rle.unitsize = sizeof(values[0]);
+	rle.values = values;
+	rle.run_lengths = run_lengths;
+	fail_unless(sr_logic_rle_num_samples(&rle) == ARRAY_SIZE(expected));
+
+	for (chunk = 1; chunk <= ARRAY_SIZE(expected); chunk++) {
+		memset(&pos, 0, sizeof(pos));
+		memset(buf, 0, sizeof(buf));
+		total = 0;
+		/* Odd sizes leave room for a partial sample which stays unused. */
+		while ((len = sr_logic_rle_expand(&rle, &pos,
+				(uint8_t *)buf + total, chunk * 2 + 1))) {
+			fail_unless(len % 2 == 0 && len <= chunk * 2);
+			total += len;
+		}
+		fail_unless(total == sizeof(expected));
+		fail_unless(!memcmp(buf, expected, sizeof(expected)));
+	}
+
+	fail_unless(sr_logic_rle_expand(NULL, &pos, buf, sizeof(buf)) == 0);
+}
+END_TEST
+
+/*
+ * Check whether the dispatch thread setup and statistics work for a
+ * session which is not running.
+ */
+START_TEST(test_session_dispatch_thread)
+{
+	int ret;
+	struct sr_session *sess;
+	struct sr_session_dispatch_stats stats;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_dispatch_thread_set(sess, 100);
+	fail_unless(ret == SR_OK, "sr_session_dispatch_thread_set() failed.");
+	ret = sr_session_dispatch_stats_get(sess, &stats);
+	fail_unless(ret == SR_OK, "sr_session_dispatch_stats_get() failed.");
+	/* No run yet, all statistics must still be zero. */
+	fail_unless(stats.depth == 0 && stats.packets == 0);
+	fail_unless(stats.high_water_bytes == 0);
+
+	ret = sr_session_dispatch_memory_set(sess, 64 * 1024 * 1024);
+	fail_unless(ret == SR_OK, "sr_session_dispatch_memory_set() failed.");
+	fail_unless(sr_session_dispatch_memory_set(NULL, 0) == SR_ERR_ARG);
+
+	ret = sr_session_logic_coalesce_set(sess, 64 * 1024, 50);
+	fail_unless(ret == SR_OK, "sr_session_logic_coalesce_set() failed.");
+	fail_unless(sr_session_logic_coalesce_set(NULL, 0, 0) == SR_ERR_ARG);
+
+	fail_unless(sr_session_dispatch_thread_set(NULL, 16) == SR_ERR_ARG);
+	fail_unless(sr_session_dispatch_stats_get(sess, NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_dispatch_stats_get(NULL, &stats) == SR_ERR_ARG);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+static void dummy_datafeed_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+	(void)packet;
+	(void)cb_data;
+}
+
+/* Check the datafeed statistics API on a session which never ran. */
+START_TEST(test_session_stats)
+{
+	int ret;
+	uint64_t elapsed;
+	struct sr_session *sess;
+	struct sr_session_stats stats;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_stats_enable(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_stats_enable() failed.");
+	ret = sr_session_stats_get(sess, &stats);
+	fail_unless(ret == SR_OK, "sr_session_stats_get() failed.");
+	fail_unless(stats.packets == 0 && stats.bytes == 0);
+	fail_unless(stats.dropped_transfers == 0 && stats.empty_transfers == 0);
+	fail_unless(stats.memory_used == 0 && stats.memory_peak == 0);
+
+	ret = sr_session_memory_limit_set(sess, 256 * 1024 * 1024);
+	fail_unless(ret == SR_OK, "sr_session_memory_limit_set() failed.");
+	fail_unless(sr_session_memory_limit_set(NULL, 0) == SR_ERR_ARG);
+
+	/* Unknown callbacks have no time to report. */
+	ret = sr_session_callback_time_get(sess, dummy_datafeed_cb, NULL, &elapsed);
+	fail_unless(ret == SR_ERR_ARG);
+	sr_session_datafeed_callback_add(sess, dummy_datafeed_cb, NULL);
+	ret = sr_session_callback_time_get(sess, dummy_datafeed_cb, NULL, &elapsed);
+	fail_unless(ret == SR_OK && elapsed == 0);
+
+	fail_unless(sr_session_stats_enable(NULL, TRUE) == SR_ERR_ARG);
+	fail_unless(sr_session_stats_get(sess, NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_stats_get(NULL, &stats) == SR_ERR_ARG);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check the timestamp API on a session which never ran. */
+START_TEST(test_session_timestamps)
+{
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	fail_unless(sr_session_timestamps_enable(sess, TRUE) == SR_OK);
+	fail_unless(sr_session_timestamps_enable(sess, TRUE) == SR_OK);
+	/* Outside of a datafeed callback there is no packet time. */
+	fail_unless(sr_session_packet_time_get() == 0);
+	fail_unless(sr_session_timestamps_enable(sess, FALSE) == SR_OK);
+	fail_unless(sr_session_timestamps_enable(NULL, TRUE) == SR_ERR_ARG);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check setting up and removing the merge stage of a session. */
+START_TEST(test_session_merge_set)
+{
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	fail_unless(sr_session_merge_set(sess, SR_MERGE_ALIGN_TRIGGER,
+		dummy_datafeed_cb, NULL) == SR_OK);
+	/* Replacing and removing the stage must not leak or fail. */
+	fail_unless(sr_session_merge_set(sess, 0,
+		dummy_datafeed_cb, NULL) == SR_OK);
+	fail_unless(sr_session_merge_set(sess, 0, NULL, NULL) == SR_OK);
+	fail_unless(sr_session_merge_set(NULL, 0,
+		dummy_datafeed_cb, NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_merge_set(sess, 0,
+		dummy_datafeed_cb, NULL) == SR_OK);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* What the merge stage sent to its callback. */
+struct merge_result {
+	GByteArray *data;
+	uint16_t unitsize;
+	int headers, ends;
+};
+
+static void merge_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct merge_result *res;
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+
+	res = cb_data;
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		res->headers++;
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		fail_unless(!res->unitsize || res->unitsize == logic->unitsize,
+			"Merged unitsize changed.");
+		res->unitsize = logic->unitsize;
+		g_byte_array_append(res->data, logic->data, logic->length);
+		break;
+	case SR_DF_END:
+		res->ends++;
+		break;
+	default:
+		break;
+	}
+}
+
+#define MERGE_LEN_A 1000
+#define MERGE_LEN_B 600
+
+static const char merge_metadata[] =
+	"[global]\n"
+	"sigrok version=0.6.0\n"
+	"\n"
+	"[device 1]\n"
+	"capturefile=logic-1\n"
+	"total probes=8\n"
+	"samplerate=1000000\n"
+	"probe1=A0\n"
+	"unitsize=1\n"
+	"\n"
+	"[device 2]\n"
+	"capturefile=logic-2\n"
+	"total probes=8\n"
+	"samplerate=1000000\n"
+	"probe1=B0\n"
+	"unitsize=1\n";
+
+/*
+ * Replay a session file of two devices through the merge stage. The
+ * devices send different amounts of data in chunks of different size,
+ * so they get ahead of each other, and the second one ends early.
+ */
+static void merge_replay(struct merge_result *res)
+{
+	struct sr_session *sess;
+	GSList *devs;
+	uint8_t a[MERGE_LEN_A], b[MERGE_LEN_B];
+	char *path;
+	int i;
+
+	for (i = 0; i < MERGE_LEN_A; i++)
+		a[i] = i;
+	for (i = 0; i < MERGE_LEN_B; i++)
+		b[i] = 0xff - i;
+	path = srtest_session_file_write(merge_metadata,
+		"logic-1-1", a, sizeof(a), "logic-2-1", b, sizeof(b), NULL);
+
+	fail_unless(sr_session_load(srtest_ctx, path, &sess) == SR_OK,
+		"Cannot load session file.");
+	fail_unless(sr_session_dev_list(sess, &devs) == SR_OK);
+	fail_unless(g_slist_length(devs) == 2, "Expected two devices.");
+	fail_unless(sr_config_set(devs->data, NULL, SR_CONF_CAPTURE_CHUNK_SIZE,
+		g_variant_new_uint64(7)) == SR_OK);
+	fail_unless(sr_config_set(devs->next->data, NULL,
+		SR_CONF_CAPTURE_CHUNK_SIZE, g_variant_new_uint64(64)) == SR_OK);
+	g_slist_free(devs);
+
+	res->data = g_byte_array_new();
+	fail_unless(sr_session_merge_set(sess, 0, merge_cb, res) == SR_OK);
+	fail_unless(sr_session_start(sess) == SR_OK, "Cannot start session.");
+	fail_unless(sr_session_run(sess) == SR_OK, "Cannot run session.");
+
+	sr_session_destroy(sess);
+	g_unlink(path);
+	g_free(path);
+}
+
+/* Check the merged samples of two devices which are out of step. */
+START_TEST(test_session_merge_skew)
+{
+	struct merge_result res;
+	const uint8_t *p;
+	int i;
+
+	memset(&res, 0, sizeof(res));
+	merge_replay(&res);
+
+	fail_unless(res.headers == 1 && res.ends == 1,
+		"Wrong number of header or end packets.");
+	fail_unless(res.unitsize == 2, "Wrong merged unitsize %d.", res.unitsize);
+	fail_unless(res.data->len == 2 * MERGE_LEN_A,
+		"Wrong number of merged samples.");
+	p = res.data->data;
+	for (i = 0; i < MERGE_LEN_A; i++) {
+		fail_unless(p[2 * i] == (uint8_t)i,
+			"Wrong first device sample %d.", i);
+		/* The second device reads as zero after its end. */
+		fail_unless(p[2 * i + 1] ==
+			(i < MERGE_LEN_B ? (uint8_t)(0xff - i) : 0),
+			"Wrong second device sample %d.", i);
+	}
+
+	g_byte_array_unref(res.data);
+}
+END_TEST
+
+/* Check the sync master setup on a session without devices. */
+START_TEST(test_session_sync_master_set)
+{
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	fail_unless(sr_session_sync_master_set(sess, NULL) == SR_OK);
+	fail_unless(sr_session_sync_master_set(NULL, NULL) == SR_ERR_ARG);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -199,6 +829,17 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_new_multiple);
 	tcase_add_test(tc, test_session_destroy);
 	tcase_add_test(tc, test_session_destroy_bogus);
+	tcase_add_test(tc, test_session_dispatch_thread);
+	tcase_add_test(tc, test_session_stats);
+	tcase_add_test(tc, test_session_timestamps);
+	tcase_add_test(tc, test_session_merge_set);
+	tcase_add_test(tc, test_session_merge_skew);
+	tcase_add_test(tc, test_session_sync_master_set);
+	tcase_add_test(tc, test_session_file_info_bogus);
+	tcase_add_test(tc, test_session_file_info_fixture);
+	tcase_add_test(tc, test_session_file_summary_bogus);
+	tcase_add_test(tc, test_session_file_export_bogus);
+	tcase_add_test(tc, test_session_file_export_threads);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("trigger");
@@ -209,5 +850,12 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("packet");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_datafeed_buffer_ref_unref);
+	tcase_add_test(tc, test_packet_copy_logic);
+	tcase_add_test(tc, test_logic_rle_expand);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -21,8 +21,12 @@
 #include <check.h>
 #include <errno.h>
 #include <locale.h>
+#include <math.h>
 #include <libsigrok/libsigrok.h>
+#include <stdlib.h>
+#include <string.h>
 #include "lib.h"
+#include "libsigrok-internal.h"
 
 #if 0
 static void test_vsnprintf(const char *expected, char *format, ...)
@@ -430,6 +434,58 @@ START_TEST(test_exponent)
 }
 END_TEST
 
+static void test_ftoa(float value, const char *expected)
+{
+	char buf[SR_FTOA_BUFSIZE];
+	int len;
+
+	len = sr_ftoa_shortest(buf, value);
+	fail_unless(!strcmp(buf, expected),
+		    "Invalid result for '%s': %s.", expected, buf);
+	fail_unless(len == (int)strlen(buf), "Invalid length for '%s'.", buf);
+}
+
+START_TEST(test_ftoa_shortest)
+{
+	test_ftoa(0.0f, "0");
+	test_ftoa(-0.0f, "-0");
+	test_ftoa(1.0f, "1");
+	test_ftoa(100.0f, "100");
+	test_ftoa(-2.5f, "-2.5");
+	test_ftoa(0.1f, "0.1");
+	test_ftoa(3.3f, "3.3");
+	test_ftoa(0.3f, "0.3");
+	test_ftoa(0.001f, "0.001");
+	test_ftoa(1e-5f, "1e-5");
+	test_ftoa(1e9f, "1e9");
+	test_ftoa(123456789.0f, "123456790");
+}
+END_TEST
+
+START_TEST(test_ftoa_roundtrip)
+{
+	char buf[SR_FTOA_BUFSIZE];
+	uint32_t bits;
+	float value;
+	double readback;
+	int i;
+
+	/* Any finite float reads back as itself, in at most 15 chars. */
+	srand(1);
+	for (i = 0; i < 100000; i++) {
+		bits = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		memcpy(&value, &bits, sizeof(value));
+		if (!isfinite(value))
+			continue;
+		sr_ftoa_shortest(buf, value);
+		fail_unless(strlen(buf) <= 15, "Too long: %s.", buf);
+		fail_unless(sr_atod_ascii(buf, &readback) == SR_OK);
+		fail_unless((float)readback == value,
+			    "Mismatch for %.9g: %s.", value, buf);
+	}
+}
+END_TEST
+
 Suite *suite_strutil(void)
 {
 	Suite *s;
@@ -452,5 +508,10 @@ Suite *suite_strutil(void)
 	tcase_add_test(tc, test_exponent);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("sr_ftoa_shortest");
+	tcase_add_test(tc, test_ftoa_shortest);
+	tcase_add_test(tc, test_ftoa_roundtrip);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
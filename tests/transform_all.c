@@ -19,6 +19,8 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -96,6 +98,239 @@ START_TEST(test_transform_options)
 }
 END_TEST
 
+/* Check whether the 'mask' module provides its options. */
+START_TEST(test_transform_mask_options)
+{
+	const struct sr_option **opt;
+	int i;
+
+	opt = sr_transform_options_get(sr_transform_find("mask"));
+	fail_unless(opt != NULL, "Transform module 'mask' has options.");
+	for (i = 0; opt[i]; i++)
+		fail_unless(opt[i]->def != NULL, "No default for '%s'.", opt[i]->id);
+	fail_unless(i == 3, "Unexpected number of 'mask' options.");
+	sr_transform_options_free(opt);
+}
+END_TEST
+
+/* Check whether the 'threshold' module provides its options. */
+START_TEST(test_transform_threshold_options)
+{
+	const struct sr_option **opt;
+	int i;
+
+	opt = sr_transform_options_get(sr_transform_find("threshold"));
+	fail_unless(opt != NULL, "Transform module 'threshold' has options.");
+	for (i = 0; opt[i]; i++)
+		fail_unless(opt[i]->def != NULL, "No default for '%s'.", opt[i]->id);
+	fail_unless(i == 3, "Unexpected number of 'threshold' options.");
+	sr_transform_options_free(opt);
+}
+END_TEST
+
+/* Check whether the 'decimate' module provides its options. */
+START_TEST(test_transform_decimate_options)
+{
+	const struct sr_option **opt;
+	int i;
+
+	opt = sr_transform_options_get(sr_transform_find("decimate"));
+	fail_unless(opt != NULL, "Transform module 'decimate' has options.");
+	for (i = 0; opt[i]; i++)
+		fail_unless(opt[i]->def != NULL, "No default for '%s'.", opt[i]->id);
+	fail_unless(i == 3, "Unexpected number of 'decimate' options.");
+	fail_unless(g_slist_length(opt[1]->values) == 4);
+	fail_unless(g_slist_length(opt[2]->values) == 4);
+	sr_transform_options_free(opt);
+}
+END_TEST
+
+/* Collect the logic samples which come out of the transforms. */
+static void collect_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	logic = packet->payload;
+	g_string_append_len(cb_data, logic->data, logic->length);
+}
+
+/* Replay a session file through a transform, and return its logic output. */
+static GString *transform_run(const char *path, const char *id,
+		GHashTable *options)
+{
+	struct sr_session *session;
+	const struct sr_transform *t;
+	GSList *devices;
+	GString *out;
+
+	fail_unless(sr_session_load(srtest_ctx, path, &session) == SR_OK,
+		"Cannot load the session file.");
+	devices = NULL;
+	sr_session_dev_list(session, &devices);
+	fail_unless(devices != NULL, "No device in the session file.");
+	t = sr_transform_new(sr_transform_find(id), options, devices->data);
+	fail_unless(t != NULL, "Cannot create the '%s' transform.", id);
+	g_slist_free(devices);
+
+	out = g_string_new(NULL);
+	sr_session_datafeed_callback_add(session, collect_datafeed, out);
+	fail_unless(sr_session_start(session) == SR_OK,
+		"Cannot start the session.");
+	fail_unless(sr_session_run(session) == SR_OK,
+		"Cannot run the session.");
+	sr_session_destroy(session);
+	sr_transform_free(t);
+
+	return out;
+}
+
+static unsigned int count_high(const GString *out)
+{
+	unsigned int i, count;
+
+	count = 0;
+	for (i = 0; i < out->len; i++)
+		count += out->str[i] & 1;
+
+	return count;
+}
+
+/*
+ * Check whether the 'threshold' options move the level at which the
+ * analog ramp of a session file turns high.
+ */
+START_TEST(test_transform_threshold_levels)
+{
+	static const char metadata[] =
+		"[global]\n"
+		"sigrok version=0.6.0\n"
+		"\n"
+		"[device 1]\n"
+		"samplerate=1000000\n"
+		"total analog=1\n"
+		"analog1=A0\n";
+	float data[50];
+	GHashTable *options;
+	GString *out;
+	char *path;
+	unsigned int i;
+
+	/* Halfway between the steps, so that no sample is at a threshold. */
+	for (i = 0; i < G_N_ELEMENTS(data); i++)
+		data[i] = i * 0.1 + 0.05;
+	path = srtest_session_file_write(metadata,
+		"analog-1-1", data, sizeof(data), NULL);
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+
+	/* The default of 1.4 V. */
+	out = transform_run(path, "threshold", NULL);
+	fail_unless(out->len == G_N_ELEMENTS(data),
+		"Wrong sample count: %u.", (unsigned int)out->len);
+	fail_unless(count_high(out) == 36,
+		"Wrong high count at 1.4 V: %u.", count_high(out));
+	g_string_free(out, TRUE);
+
+	g_hash_table_insert(options, "threshold",
+		g_variant_ref_sink(g_variant_new_double(3.0)));
+	out = transform_run(path, "threshold", options);
+	fail_unless(out->len == G_N_ELEMENTS(data),
+		"Wrong sample count: %u.", (unsigned int)out->len);
+	fail_unless(count_high(out) == 20,
+		"Wrong high count at 3.0 V: %u.", count_high(out));
+	g_string_free(out, TRUE);
+
+	/* A channel's own threshold takes precedence. */
+	g_hash_table_insert(options, "channels",
+		g_variant_ref_sink(g_variant_new_string("A0=0.5")));
+	out = transform_run(path, "threshold", options);
+	fail_unless(count_high(out) == 45,
+		"Wrong high count at 0.5 V: %u.", count_high(out));
+	g_string_free(out, TRUE);
+
+	g_hash_table_destroy(options);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
+/*
+ * Check whether the 'decimate' options change the number of samples
+ * which come out, and which of the bucket's samples they are.
+ */
+START_TEST(test_transform_decimate_factor)
+{
+	static const char metadata[] =
+		"[global]\n"
+		"sigrok version=0.6.0\n"
+		"\n"
+		"[device 1]\n"
+		"capturefile=logic-1\n"
+		"total probes=8\n"
+		"samplerate=1000000\n"
+		"probe1=D0\n"
+		"probe2=D1\n"
+		"probe3=D2\n"
+		"probe4=D3\n"
+		"probe5=D4\n"
+		"probe6=D5\n"
+		"probe7=D6\n"
+		"probe8=D7\n"
+		"unitsize=1\n";
+	uint8_t data[1024];
+	GHashTable *options;
+	GString *out;
+	char *path;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i & 0xff;
+	path = srtest_session_file_write(metadata,
+		"logic-1", data, sizeof(data), NULL);
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+
+	/* The default factor of 16, keeping each bucket's first sample. */
+	out = transform_run(path, "decimate", NULL);
+	fail_unless(out->len == sizeof(data) / 16,
+		"Wrong sample count: %u.", (unsigned int)out->len);
+	for (i = 0; i < out->len; i++)
+		fail_unless((uint8_t)out->str[i] == data[i * 16],
+			"Wrong sample %u at factor 16.", i);
+	g_string_free(out, TRUE);
+
+	g_hash_table_insert(options, "factor",
+		g_variant_ref_sink(g_variant_new_uint64(4)));
+	out = transform_run(path, "decimate", options);
+	fail_unless(out->len == sizeof(data) / 4,
+		"Wrong sample count: %u.", (unsigned int)out->len);
+	for (i = 0; i < out->len; i++)
+		fail_unless((uint8_t)out->str[i] == data[i * 4],
+			"Wrong sample %u at factor 4.", i);
+	g_string_free(out, TRUE);
+
+	/* The counter's low bits are set somewhere in each bucket. */
+	g_hash_table_insert(options, "logic",
+		g_variant_ref_sink(g_variant_new_string("or")));
+	out = transform_run(path, "decimate", options);
+	fail_unless(out->len == sizeof(data) / 4,
+		"Wrong sample count: %u.", (unsigned int)out->len);
+	for (i = 0; i < out->len; i++)
+		fail_unless((uint8_t)out->str[i] == (data[i * 4] | 3),
+			"Wrong sample %u with 'or'.", i);
+	g_string_free(out, TRUE);
+
+	g_hash_table_destroy(options);
+	g_unlink(path);
+	g_free(path);
+}
+END_TEST
+
 Suite *suite_transform_all(void)
 {
 	Suite *s;
@@ -110,6 +345,11 @@ Suite *suite_transform_all(void)
 	tcase_add_test(tc, test_transform_desc);
 	tcase_add_test(tc, test_transform_find);
 	tcase_add_test(tc, test_transform_options);
+	tcase_add_test(tc, test_transform_mask_options);
+	tcase_add_test(tc, test_transform_threshold_options);
+	tcase_add_test(tc, test_transform_decimate_options);
+	tcase_add_test(tc, test_transform_threshold_levels);
+	tcase_add_test(tc, test_transform_decimate_factor);
 	suite_add_tcase(s, tc);
 
 	return s;
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -249,6 +250,73 @@ START_TEST(test_trigger_match_add_bogus)
 }
 END_TEST
 
+/* Check the validation of protocol conditions. */
+START_TEST(test_trigger_protocol_match_set)
+{
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+	struct sr_trigger_protocol_match m;
+	struct sr_channel *chl, *cha;
+
+	t = sr_trigger_new("T");
+	s = sr_trigger_stage_add(t);
+	chl = g_malloc0(sizeof(struct sr_channel));
+	chl->type = SR_CHANNEL_LOGIC;
+	chl->enabled = TRUE;
+	chl->name = g_strdup("L0");
+	cha = g_malloc0(sizeof(struct sr_channel));
+	cha->index = 1;
+	cha->type = SR_CHANNEL_ANALOG;
+	cha->enabled = TRUE;
+	cha->name = g_strdup("A0");
+
+	memset(&m, 0, sizeof(m));
+	m.protocol = SR_TRIGGER_PROTO_UART;
+	m.channels[0] = chl;
+	m.value = 0x55;
+	m.mask = 0xff;
+	fail_unless(sr_trigger_protocol_match_set(NULL, &m) == SR_ERR_ARG);
+	fail_unless(sr_trigger_protocol_match_set(s, NULL) == SR_ERR_ARG);
+
+	/* UART needs a baud rate. */
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	fail_unless(s->protocol == NULL);
+	m.baudrate = 115200;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_OK);
+	fail_unless(s->protocol != NULL);
+	fail_unless(s->protocol->value == 0x55);
+
+	/* SPI needs two logic channels and a valid mode. */
+	m.protocol = SR_TRIGGER_PROTO_SPI;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	m.channels[1] = cha;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	m.channels[1] = chl;
+	m.spi_mode = 4;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	m.spi_mode = 3;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_OK);
+	fail_unless(s->protocol->protocol == SR_TRIGGER_PROTO_SPI);
+
+	/* I2C addresses have 7 bits. */
+	m.protocol = SR_TRIGGER_PROTO_I2C;
+	m.value = 0x80;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	m.value = 0x50;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_OK);
+
+	m.protocol = 0;
+	fail_unless(sr_trigger_protocol_match_set(s, &m) == SR_ERR_ARG);
+	fail_unless(s->protocol->protocol == SR_TRIGGER_PROTO_I2C);
+
+	sr_trigger_free(t);
+	g_free(chl->name);
+	g_free(chl);
+	g_free(cha->name);
+	g_free(cha);
+}
+END_TEST
+
 Suite *suite_trigger(void)
 {
 	Suite *s;
@@ -274,6 +342,7 @@ Suite *suite_trigger(void)
 	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
 	tcase_add_test(tc, test_trigger_match_add);
 	tcase_add_test(tc, test_trigger_match_add_bogus);
+	tcase_add_test(tc, test_trigger_protocol_match_set);
 	suite_add_tcase(s, tc);
 
 	return s;